@@ -0,0 +1,31 @@
+// --readTickets and --writeTickets cap the reads and writes running at once, and serverStatus
+// reports the pools under globalLock.tickets.
+
+var conn = MongoRunner.runMongod({ readTickets: 2, writeTickets: 1 });
+var testDB = conn.getDB('jstests_admission_tickets');
+var coll = testDB.t;
+
+for (var i = 0; i < 100; ++i)
+    coll.insert({ i : i });
+assert.eq(null, testDB.getLastError());
+assert.eq(100, coll.find().itcount());
+coll.update({}, { $inc : { i : 1 } }, false, true);
+coll.remove({ i : { $lt : 50 } });
+assert.eq(null, testDB.getLastError());
+assert.eq(51, coll.count());
+
+var tickets = testDB.serverStatus().globalLock.tickets;
+assert(tickets, "no tickets in globalLock");
+assert.eq(2, tickets.read.totalTickets);
+assert.eq(1, tickets.write.totalTickets);
+// only the serverStatus command itself is running, and commands don't take tickets
+assert.eq(0, tickets.read.out);
+assert.eq(0, tickets.write.out);
+assert.lte(0, tickets.read.totalQueuedMicros);
+
+MongoRunner.stopMongod(conn);
+
+// without the options there are no pools, and nothing is reported
+conn = MongoRunner.runMongod({});
+assert.eq(undefined, conn.getDB('admin').serverStatus().globalLock.tickets);
+MongoRunner.stopMongod(conn);
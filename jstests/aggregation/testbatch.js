@@ -0,0 +1,53 @@
+// stages which hand documents on in batches, mixed with those which don't
+
+// use the aggregation test db
+db = db.getSiblingDB('aggdb');
+
+var t = db.testbatch;
+t.drop();
+for (var i = 0; i < 1000; ++i)
+    t.insert({ _id : i, a : i % 7, b : i });
+
+function sumOf(pred) {
+    var s = 0;
+    for (var i = 0; i < 1000; ++i) {
+        if (pred(i))
+            s += i * 2;
+    }
+    return s;
+}
+
+// $match and $project feeding $group a batch at a time
+var out = t.aggregate({ $match : { a : { $ne : 3 } } },
+                      { $project : { a : 1, c : { $multiply : [ "$b", 2 ] } } },
+                      { $match : { c : { $gt : 10 } } },
+                      { $group : { _id : null, n : { $sum : 1 }, c : { $sum : "$c" } } });
+assert.commandWorked(out);
+var n = 0;
+for (var i = 0; i < 1000; ++i) {
+    if ((i % 7 != 3) && (i * 2 > 10))
+        ++n;
+}
+assert.eq(n, out.result[0].n);
+assert.eq(sumOf(function(i) { return (i % 7 != 3) && (i * 2 > 10); }), out.result[0].c);
+
+// with a stage in between that only goes a document at a time
+out = t.aggregate({ $match : { a : { $ne : 3 } } },
+                  { $skip : 5 },
+                  { $project : { c : { $multiply : [ "$b", 2 ] } } },
+                  { $group : { _id : null, n : { $sum : 1 } } });
+assert.commandWorked(out);
+var ne3 = 0;
+for (var i = 0; i < 1000; ++i) {
+    if (i % 7 != 3)
+        ++ne3;
+}
+assert.eq(ne3 - 5, out.result[0].n);
+
+// and with the batched stages at the end, read one at a time
+out = t.aggregate({ $match : { a : 0 } },
+                  { $project : { _id : 0, b : 1 } },
+                  { $match : { b : { $lt : 50 } } });
+assert.commandWorked(out);
+assert.eq([ { b : 0 }, { b : 7 }, { b : 14 }, { b : 21 }, { b : 28 }, { b : 35 },
+            { b : 42 }, { b : 49 } ], out.result);
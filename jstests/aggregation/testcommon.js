@@ -0,0 +1,51 @@
+// repeated subexpressions in a $project, and $cond / $ifNull with constant predicates
+
+// use the aggregation test db
+db = db.getSiblingDB('aggdb');
+
+var t = db.testcommon;
+t.drop();
+t.insert({ _id : 1, a : 2, b : { c : 3 }, d : [ { e : 1 }, { e : 2 } ] });
+t.insert({ _id : 2, a : 5, b : { c : 0 }, d : [] });
+t.insert({ _id : 3, a : 1, b : { c : null } });
+
+var fields = {
+    x : { $add : [ "$a", "$b.c" ] },
+    y : { $multiply : [ { $add : [ "$a", "$b.c" ] }, 2 ] },
+    z : { $cond : [ { $gt : [ { $add : [ "$a", "$b.c" ] }, 4 ] }, "$a", "$b.c" ] },
+    w : { $ifNull : [ "$b.c", "$a" ] },
+    v : "$a"
+};
+
+function project(spec) {
+    var out = t.aggregate({ $project : spec }, { $sort : { _id : 1 } });
+    assert.commandWorked(out);
+    return out.result;
+}
+
+// each field comes out as it does when nothing is shared with other fields
+var all = project(fields);
+for (var f in fields) {
+    var spec = {};
+    spec[f] = fields[f];
+    var alone = project(spec);
+    assert.eq(alone.length, all.length, f);
+    for (var i = 0; i < alone.length; ++i)
+        assert.eq(alone[i][f], all[i][f], f + i);
+}
+
+// a constant condition leaves just the branch taken
+assert.eq(project({ v : "$a" }), project({ v : { $cond : [ true, "$a", 0 ] } }));
+assert.eq(project({ v : "$d.e" }),
+          project({ v : { $cond : [ { $eq : [ 1, 2 ] }, "$a", "$d.e" ] } }));
+assert.eq(project({ v : { $add : [ "$a", 1 ] } }),
+          project({ v : { $ifNull : [ null, { $add : [ "$a", 1 ] } ] } }));
+
+// the shared subexpressions show up as they were written
+var explain = db.runCommand({ aggregate : "testcommon", explain : true, pipeline : [
+    { $project : { x : { $add : [ "$a", "$a" ] }, y : { $add : [ "$a", "$a" ] },
+                   z : { $cond : [ false, 1, "$a" ] } } } ] });
+assert.commandWorked(explain);
+assert.eq({ $project : { x : { $add : [ "$a", "$a" ] }, y : { $add : [ "$a", "$a" ] },
+                         z : "$a" } },
+          explain.serverPipeline[explain.serverPipeline.length - 1]);
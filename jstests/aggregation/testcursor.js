@@ -0,0 +1,68 @@
+// aggregate output returned through a cursor, batch by batch
+
+// use the aggregation test db
+db = db.getSiblingDB('aggdb');
+
+var t = db.testcursor;
+t.drop();
+var bigStr = new Array(1001).join("x");
+for (var i = 0; i < 1000; ++i)
+    t.insert({ _id : i, a : i % 10, s : bigStr });
+
+function ids(c) {
+    return c.map(function(o) { return o._id; });
+}
+
+function range(n) {
+    var a = [];
+    for (var i = 0; i < n; ++i)
+        a.push(i);
+    return a;
+}
+
+// everything comes back, the first batch held to batchSize
+var res = db.runCommand({ aggregate : t.getName(), pipeline : [ { $sort : { _id : 1 } } ],
+                          cursor : { batchSize : 7 } });
+assert.commandWorked(res);
+assert.eq(7, res.cursor.firstBatch.length);
+assert.eq("aggdb.testcursor", res.cursor.ns);
+assert.eq(range(1000), ids(new DBCommandCursor(db.getMongo(), res)));
+
+// and by default, no more than fits in a reply
+res = db.runCommand({ aggregate : t.getName(), pipeline : [ { $sort : { _id : 1 } } ], cursor : {} });
+assert.commandWorked(res);
+assert.gt(1000, res.cursor.firstBatch.length);
+assert.eq(range(1000), ids(new DBCommandCursor(db.getMongo(), res)));
+
+// an empty first batch, then small getMores
+assert.eq(range(1000), ids(t.aggregateCursor([ { $sort : { _id : 1 } } ], 0)));
+assert.eq(range(1000), ids(t.aggregateCursor([ { $sort : { _id : 1 } } ], 3)));
+
+// all of it in the first batch leaves no cursor open
+res = db.runCommand({ aggregate : t.getName(),
+                      pipeline : [ { $group : { _id : "$a", n : { $sum : 1 } } } ],
+                      cursor : {} });
+assert.commandWorked(res);
+assert.eq(0, bsonWoCompare({x : res.cursor.id}, {x : NumberLong(0)}));
+assert.eq(10, res.cursor.firstBatch.length);
+res.cursor.firstBatch.forEach(function(o) { assert.eq(100, o.n); });
+
+// the same as without a cursor
+var pipeline = [ { $match : { a : { $lt : 5 } } }, { $project : { a : 1 } }, { $skip : 10 },
+                 { $limit : 300 } ];
+assert.eq(t.aggregate(pipeline).result, t.aggregateCursor(pipeline, 13).toArray());
+
+// dropping the collection kills the cursor
+var c = t.aggregateCursor([ { $match : {} } ], 2);
+c.next();
+c.next();
+t.drop();
+assert.throws(function() { c.itcount(); });
+
+// a bad cursor spec is an error
+assert.commandFailed(db.runCommand({ aggregate : t.getName(), pipeline : [], cursor : 1 }));
+assert.commandFailed(db.runCommand({ aggregate : t.getName(), pipeline : [], cursor : { x : 1 } }));
+assert.commandFailed(db.runCommand({ aggregate : t.getName(), pipeline : [],
+                                     cursor : { batchSize : -1 } }));
+assert.commandFailed(db.runCommand({ aggregate : t.getName(), pipeline : [],
+                                     cursor : { batchSize : "a" } }));
@@ -0,0 +1,48 @@
+// $group keys and $addToSet members that are equal compare equal whatever their numeric types,
+// and values of the same type still sort and group correctly
+db = db.getSiblingDB('aggdb');
+var c = db.groupkeys;
+c.drop();
+
+c.insert({ k: 1, v: 1 });
+c.insert({ k: NumberLong(1), v: NumberLong(1) });
+c.insert({ k: 1.0, v: 2.0 });
+c.insert({ k: 2.5, v: 2 });
+c.insert({ k: "a", v: "x" });
+c.insert({ k: "a", v: "x" });
+c.insert({ k: "b", v: "y" });
+var oid = ObjectId();
+c.insert({ k: oid, v: oid });
+c.insert({ k: oid, v: ObjectId() });
+
+var res = c.aggregate(
+    { $group: { _id: "$k", n: { $sum: 1 }, vs: { $addToSet: "$v" } } }
+);
+assert.commandWorked(res);
+var groups = {};
+res.result.forEach(function(g) { groups[tojson(g._id)] = g; });
+assert.eq(5, res.result.length, tojson(res.result));
+
+assert.eq(3, groups[tojson(1)].n);
+assert.eq(2, groups[tojson(1)].vs.length); // 1 and NumberLong(1) are the same member
+assert.eq(1, groups[tojson(2.5)].n);
+assert.eq(2, groups[tojson("a")].n);
+assert.eq(["x"], groups[tojson("a")].vs);
+assert.eq(1, groups[tojson("b")].n);
+assert.eq(2, groups[tojson(oid)].n);
+assert.eq(2, groups[tojson(oid)].vs.length);
+
+// sorting the same-typed keys
+c.drop();
+for (var i = 0; i < 100; i++)
+    c.insert({ i: (i * 37) % 100, l: NumberLong((i * 53) % 100), d: ((i * 17) % 100) / 4,
+               s: "s" + ((i * 31) % 100 + 100) });
+["i", "l", "d", "s"].forEach(function(f) {
+    var sort = {};
+    sort[f] = 1;
+    var out = c.aggregate({ $sort: sort }).result;
+    assert.eq(100, out.length);
+    for (var j = 1; j < out.length; j++)
+        assert.lte(out[j - 1][f], out[j][f], f);
+});
+c.drop();
@@ -0,0 +1,46 @@
+// $group should write partial groups to disk and merge them when its groups
+// don't fit in aggregationGroupMemoryLimitBytes, with the same results as
+// grouping in memory.
+
+var t = db.agggroupspill;
+t.drop();
+
+var pad = new Array(200).toString();
+for (var i = 0; i < 5000; ++i)
+    t.save({ _id : i, k : (i * 7919) % 1500, v : i % 17, pad : pad });
+
+function groupAll() {
+    var res = db.runCommand({ aggregate : "agggroupspill", pipeline : [
+        { $sort : { _id : 1 } },
+        { $group : { _id : "$k",
+                     n : { $sum : 1 },
+                     total : { $sum : "$v" },
+                     avg : { $avg : "$v" },
+                     lo : { $min : "$v" },
+                     hi : { $max : "$v" },
+                     first : { $first : "$_id" },
+                     last : { $last : "$_id" },
+                     all : { $push : "$_id" },
+                     vs : { $addToSet : "$v" } } },
+        { $sort : { _id : 1 } }
+    ]});
+    assert.commandWorked(res);
+    res.result.forEach(function(d) { d.vs.sort(); });
+    return res.result;
+}
+
+var inMemory = groupAll();
+assert.eq(1500, inMemory.length, "wrong number of groups");
+
+var was = db.adminCommand({ getParameter : 1,
+                            aggregationGroupMemoryLimitBytes : 1 })
+    .aggregationGroupMemoryLimitBytes;
+assert.commandWorked(db.adminCommand({ setParameter : 1,
+                                       aggregationGroupMemoryLimitBytes : 16 * 1024 }));
+
+var spilled = groupAll();
+
+assert.commandWorked(db.adminCommand({ setParameter : 1,
+                                       aggregationGroupMemoryLimitBytes : was }));
+
+assert.eq(inMemory, spilled, "spilled group differs");
@@ -0,0 +1,47 @@
+// a $group on an indexed field streams its groups from the index order
+
+// use the aggregation test db
+db = db.getSiblingDB('aggdb');
+
+var t = db.testgroupstream;
+t.drop();
+for (var i = 0; i < 500; ++i)
+    t.insert({ a : i % 13, b : i });
+t.insert({ b : -1 });
+t.insert({ a : null, b : -2 });
+t.ensureIndex({ a : 1 });
+
+function grouped(pipeline) {
+    var out = t.aggregate(pipeline);
+    assert.commandWorked(out);
+    var groups = {};
+    out.result.forEach(function(g) { groups[tojson(g._id)] = g; });
+    return groups;
+}
+
+// the same groups whether the input comes in order or not
+var pipeline = [ { $group : { _id : "$a", n : { $sum : 1 }, s : { $sum : "$b" } } } ];
+var streamed = grouped(pipeline);
+t.dropIndex({ a : 1 });
+var hashed = grouped(pipeline);
+assert.eq(hashed, streamed);
+assert.eq(14, Object.keySet(streamed).length);
+assert.eq(2, streamed[tojson(null)].n);
+
+// the explain shows the cursor taking the index order
+t.ensureIndex({ a : 1 });
+var explain = db.runCommand({ aggregate : "testgroupstream", explain : true,
+                              pipeline : pipeline });
+assert.commandWorked(explain);
+assert.eq({ a : 1 }, explain.serverPipeline[0].cursor.sort);
+
+// and with a query on the group field
+var out = t.aggregate({ $match : { a : { $gte : 10 } } }, pipeline[0]);
+assert.commandWorked(out);
+assert.eq(3, out.result.length);
+
+// not when some document has an array there
+t.insert({ a : [ 1, 2 ], b : 0 });
+out = t.aggregate(pipeline);
+assert.commandWorked(out);
+assert.eq(15, out.result.length);
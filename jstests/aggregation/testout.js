@@ -0,0 +1,63 @@
+// $out replaces a collection with a pipeline's output
+
+// use the aggregation test db
+db = db.getSiblingDB('aggdb');
+
+var t = db.testout;
+var out = db.testout_out;
+t.drop();
+out.drop();
+for (var i = 0; i < 2500; ++i)
+    t.insert({ _id : i, a : i % 10, b : i });
+
+function noTemps() {
+    return db.getCollectionNames().filter(function(n) {
+        return n.indexOf("tmp.agg_out.") == 0;
+    });
+}
+
+// more than a batch's worth, and nothing returned
+var res = t.aggregate({ $project : { a : 1, c : { $multiply : [ "$b", 2 ] } } },
+                      { $out : out.getName() });
+assert.commandWorked(res);
+assert.eq(0, res.result.length);
+assert.eq(2500, out.count());
+assert.eq({ _id : 7, a : 7, c : 14 }, out.findOne({ _id : 7 }));
+
+// the old contents go, and the indexes stay, built over the new ones
+out.ensureIndex({ total : 1 });
+out.ensureIndex({ a : 1, c : -1 });
+assert.commandWorked(t.aggregate({ $group : { _id : "$a", total : { $sum : "$b" } } },
+                                 { $out : out.getName() }));
+assert.eq(10, out.count());
+assert.eq(3, out.getIndexes().length);
+assert.eq(10, out.find().hint({ total : 1 }).itcount());
+assert.eq(312000, out.findOne({ _id : 3 }).total);
+
+// documents without an _id get one
+assert.commandWorked(t.aggregate({ $match : { a : 0 } }, { $project : { _id : 0, b : 1 } },
+                                 { $out : out.getName() }));
+assert.eq(250, out.count());
+assert(out.findOne()._id);
+
+// no output leaves an empty collection
+assert.commandWorked(t.aggregate({ $match : { a : 11 } }, { $out : out.getName() }));
+assert.eq(0, out.count());
+assert.contains(out.getName(), db.getCollectionNames());
+
+// and the input can be the output
+assert.commandWorked(t.aggregate({ $match : { a : { $lt : 5 } } }, { $out : t.getName() }));
+assert.eq(1250, t.count());
+
+assert.eq([], noTemps());
+
+// bad specs
+assert.commandFailed(t.aggregate({ $out : out.getName() }, { $match : {} }));
+assert.commandFailed(t.aggregate({ $out : 1 }));
+assert.commandFailed(t.aggregate({ $out : "" }));
+assert.commandFailed(t.aggregate({ $out : "system.foo" }));
+assert.commandFailed(t.aggregate({ $out : "a$b" }));
+assert.eq([], noTemps());
+
+t.drop();
+out.drop();
@@ -0,0 +1,61 @@
+// pipelines whose scan is split across several threads
+
+// use the aggregation test db
+db = db.getSiblingDB('aggdb');
+var admin = db.getSisterDB('admin');
+
+var t = db.testparallel;
+t.drop();
+for (var i = 0; i < 20000; ++i)
+    t.insert({ _id : i, a : i % 37, b : i % 5, c : [ i % 3, i % 4 ], d : "s" + (i % 11) });
+
+var pipelines = [
+    [ { $group : { _id : "$a", n : { $sum : 1 }, s : { $sum : "$_id" } } } ],
+    [ { $match : { b : { $ne : 2 } } },
+      { $project : { a : 1, b : 1, e : { $multiply : [ "$a", "$b" ] } } },
+      { $group : { _id : { a : "$a", b : "$b" }, avg : { $avg : "$e" },
+                   lo : { $min : "$e" }, hi : { $max : "$e" } } },
+      { $sort : { _id : 1 } } ],
+    [ { $unwind : "$c" },
+      { $group : { _id : "$c", n : { $sum : 1 }, d : { $addToSet : "$d" } } },
+      { $project : { n : 1, nd : { $size : "$d" } } } ],
+    [ { $group : { _id : "$b", first : { $first : "$_id" } } } ],
+    [ { $match : { a : { $lt : 3 } } }, { $limit : 10 },
+      { $group : { _id : null, n : { $sum : 1 } } } ]
+];
+
+function run(pipeline) {
+    var out = t.aggregate(pipeline);
+    assert.commandWorked(out);
+    var result = out.result;
+    result.sort(function(l, r) { return tojson(l._id) < tojson(r._id) ? -1 : 1; });
+    return result;
+}
+
+var serial = [];
+for (var i = 0; i < pipelines.length; ++i)
+    serial.push(run(pipelines[i]));
+
+assert.commandWorked(admin.runCommand({ setParameter : 1, aggregationThreads : 4 }));
+var p = admin.runCommand({ getParameter : 1, aggregationThreads : 1 });
+assert.eq(4, p.aggregationThreads);
+
+for (var i = 0; i < pipelines.length; ++i)
+    assert.eq(serial[i], run(pipelines[i]), "pipeline " + i);
+
+// an error in a worker comes back as it would have on one thread
+var u = db.testparallel2;
+u.drop();
+for (var i = 0; i < 2000; ++i)
+    u.insert({ _id : i, e : new Date(i), f : (i == 1500) ? new Date(0) : 1 });
+var bad = u.aggregate({ $project : { x : { $add : [ "$e", "$f" ] } } },
+                      { $group : { _id : null, n : { $sum : 1 } } });
+assert.eq(0, bad.ok);
+assert.eq(16000, bad.code);
+
+// explain is unaffected
+var explain = t.runCommand("aggregate", { pipeline : pipelines[0], explain : true });
+assert.commandWorked(explain);
+
+assert.commandFailed(admin.runCommand({ setParameter : 1, aggregationThreads : 0 }));
+assert.commandWorked(admin.runCommand({ setParameter : 1, aggregationThreads : 1 }));
@@ -0,0 +1,45 @@
+// When the pipeline's dependencies are known, the cursor only converts the
+// top-level fields it needs; results must be the same as converting all.
+
+var t = db.aggselectfields;
+t.drop();
+
+for (var i = 0; i < 100; ++i) {
+    var doc = { _id : i, a : i % 5, b : { c : i, d : "x" + i }, e : [ i, i + 1 ] };
+    for (var j = 0; j < 200; ++j)
+        doc["f" + j] = j;
+    t.save(doc);
+}
+
+function agg(pipeline) {
+    var res = db.runCommand({ aggregate : "aggselectfields", pipeline : pipeline });
+    assert.commandWorked(res);
+    return res.result;
+}
+
+// an inclusion $project keeps _id by default and sees dotted paths
+var projected = agg([ { $project : { a : 1, c : "$b.c" } } ]);
+assert.eq(100, projected.length);
+for (var i = 0; i < projected.length; ++i) {
+    var d = projected[i];
+    assert.eq({ _id : d._id, a : d._id % 5, c : d._id }, d);
+}
+
+// a later $match, $unwind and $group only need their own fields
+var grouped = agg([
+    { $match : { "b.d" : { $ne : "x3" } } },
+    { $unwind : "$e" },
+    { $group : { _id : "$a", n : { $sum : 1 }, f : { $max : "$f199" } } },
+    { $sort : { _id : 1 } }
+]);
+assert.eq([ { _id : 0, n : 40, f : 199 },
+            { _id : 1, n : 40, f : 199 },
+            { _id : 2, n : 40, f : 199 },
+            { _id : 3, n : 38, f : 199 },
+            { _id : 4, n : 40, f : 199 } ], grouped);
+
+// an exclusion $project leaves the set open, so every field comes through
+var all = agg([ { $project : { f0 : 0 } }, { $limit : 1 } ]);
+assert.eq(undefined, all[0].f0);
+assert.eq(199, all[0].f199);
+assert.eq({ c : 0, d : "x0" }, all[0].b);
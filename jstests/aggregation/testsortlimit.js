@@ -0,0 +1,51 @@
+// A leading $match, $sort and $limit should be handed to the query optimizer
+// when an index can provide the order, so that the cursor stops early.
+
+var t = db.aggsortlimit;
+t.drop();
+
+for (var i = 0; i < 1000; ++i)
+    t.save({ _id : i, a : (i * 7919) % 1000, b : i % 10 });
+
+var pipeline = [
+    { $match : { b : { $gte : 5 } } },
+    { $sort : { a : -1 } },
+    { $limit : 10 },
+    { $project : { _id : 0, a : 1 } }
+];
+
+function run() {
+    var res = db.runCommand({ aggregate : "aggsortlimit", pipeline : pipeline });
+    assert.commandWorked(res);
+    return res.result.map(function(d) { return d.a; });
+}
+
+function cursorStage() {
+    var res = db.runCommand({ aggregate : "aggsortlimit", explain : true,
+                              pipeline : pipeline });
+    assert.commandWorked(res);
+    return res.serverPipeline[0];
+}
+
+// without an index, the sort is done in memory, so the cursor isn't limited
+var unindexed = run();
+assert.eq(10, unindexed.length, "wrong number of results");
+var stage = cursorStage();
+assert.eq(undefined, stage.sort, "sort pushed down without an index");
+assert.eq(undefined, stage.limit, "limit pushed down before an in-memory sort");
+
+// with an index, the cursor provides the order and stops after the limit
+t.ensureIndex({ a : 1 });
+var indexed = run();
+assert.eq(unindexed, indexed, "indexed sort differs");
+stage = cursorStage();
+assert.eq({ a : -1 }, stage.sort, "sort wasn't pushed down");
+assert.eq(10, stage.limit, "limit wasn't pushed down");
+
+for (var i = 1; i < indexed.length; ++i)
+    assert.gt(indexed[i - 1], indexed[i]);
+
+// a $limit directly after the $match limits the cursor too
+pipeline = [ { $match : { b : 3 } }, { $limit : 5 } ];
+assert.eq(5, run().length, "wrong number of results for match and limit");
+assert.eq(5, cursorStage().limit, "limit after match wasn't pushed down");
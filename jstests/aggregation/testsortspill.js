@@ -0,0 +1,44 @@
+// $sort should write sorted runs to disk and merge them when the documents
+// don't fit in aggregationSortMemoryLimitBytes, with the same results as an
+// in-memory sort.
+
+var t = db.aggsortspill;
+t.drop();
+
+var big = new Array(1024).toString();
+for (var i = 0; i < 2000; ++i)
+    t.save({ _id : i, a : (i * 7919) % 2000, b : i % 3, big : big });
+
+function sortedIds(sortSpec) {
+    var res = db.runCommand({ aggregate : "aggsortspill", pipeline : [
+        { $sort : sortSpec },
+        { $project : { _id : 1 } }
+    ]});
+    assert.commandWorked(res);
+    return res.result.map(function(d) { return d._id; });
+}
+
+var inMemoryA = sortedIds({ a : 1 });
+var inMemoryB = sortedIds({ b : -1, a : 1 });
+
+var was = db.adminCommand({ getParameter : 1,
+                            aggregationSortMemoryLimitBytes : 1 })
+    .aggregationSortMemoryLimitBytes;
+assert.commandWorked(db.adminCommand({ setParameter : 1,
+                                       aggregationSortMemoryLimitBytes : 100 * 1024 }));
+
+var spilledA = sortedIds({ a : 1 });
+var spilledB = sortedIds({ b : -1, a : 1 });
+
+assert.commandWorked(db.adminCommand({ setParameter : 1,
+                                       aggregationSortMemoryLimitBytes : was }));
+
+assert.eq(2000, spilledA.length, "spilled sort lost documents");
+assert.eq(inMemoryA, spilledA, "spilled sort on a differs");
+assert.eq(inMemoryB, spilledB, "spilled sort on b, a differs");
+
+for (var i = 1; i < spilledA.length; ++i)
+    assert.lt((spilledA[i - 1] * 7919) % 2000, (spilledA[i] * 7919) % 2000);
+
+assert.commandFailed(db.adminCommand({ setParameter : 1,
+                                       aggregationSortMemoryLimitBytes : 0 }));
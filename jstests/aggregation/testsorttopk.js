@@ -0,0 +1,55 @@
+// A $sort followed by a $limit should only keep the first documents while
+// sorting, with the same results as sorting everything.
+
+var t = db.aggsorttopk;
+t.drop();
+
+var big = new Array(1024).toString();
+for (var i = 0; i < 2000; ++i)
+    t.save({ _id : i, a : (i * 7919) % 2000, b : i % 7, big : big });
+
+function sortedIds(sortSpec, limit) {
+    var pipeline = [ { $sort : sortSpec } ];
+    if (limit)
+        pipeline.push({ $limit : limit });
+    pipeline.push({ $project : { _id : 1 } });
+
+    var res = db.runCommand({ aggregate : "aggsorttopk", pipeline : pipeline });
+    assert.commandWorked(res);
+    return res.result.map(function(d) { return d._id; });
+}
+
+var allA = sortedIds({ a : -1 });
+var allBA = sortedIds({ b : 1, a : 1 });
+
+assert.eq(allA.slice(0, 10), sortedIds({ a : -1 }, 10), "top 10 on a differs");
+assert.eq(allBA.slice(0, 25), sortedIds({ b : 1, a : 1 }, 25),
+          "top 25 on b, a differs");
+assert.eq(allA, sortedIds({ a : -1 }, 5000), "limit past the end differs");
+assert.eq(allA.slice(0, 1), sortedIds({ a : -1 }, 1), "top 1 differs");
+
+// the top documents fit even when the whole collection doesn't
+var was = db.adminCommand({ getParameter : 1,
+                            aggregationSortMemoryLimitBytes : 1 })
+    .aggregationSortMemoryLimitBytes;
+assert.commandWorked(db.adminCommand({ setParameter : 1,
+                                       aggregationSortMemoryLimitBytes : 100 * 1024 }));
+
+var topSmall = sortedIds({ a : -1 }, 10);
+var topLarge = sortedIds({ a : -1 }, 500);
+
+assert.commandWorked(db.adminCommand({ setParameter : 1,
+                                       aggregationSortMemoryLimitBytes : was }));
+
+assert.eq(allA.slice(0, 10), topSmall, "top 10 near the memory limit differs");
+assert.eq(allA.slice(0, 500), topLarge, "top 500 past the memory limit differs");
+
+// the limit is absorbed into the sort, and still shows up in explain
+var explain = db.runCommand({ aggregate : "aggsorttopk", explain : true,
+                              pipeline : [ { $sort : { a : 1 } },
+                                           { $limit : 20 },
+                                           { $limit : 10 } ] });
+assert.commandWorked(explain);
+var pipeline = explain.serverPipeline;
+assert.eq({ $sort : { a : 1 } }, pipeline[pipeline.length - 2]);
+assert.eq(10, pipeline[pipeline.length - 1].$limit);
@@ -0,0 +1,63 @@
+// $unwind results which share the fields of the document they came from
+
+// use the aggregation test db
+db = db.getSiblingDB('aggdb');
+
+var t = db.testunwindshare;
+t.drop();
+var big = [];
+for (var i = 0; i < 500; ++i)
+    big.push(i);
+t.insert({ _id : 1, pad : new Array(1000).join('x'), a : big,
+           s : { t : { u : [ 1, 2, 3 ] }, v : 5 }, b : [ 'p', 'q' ] });
+
+// a top level array; the other fields come through unchanged
+var out = t.aggregate({ $unwind : "$a" });
+assert.commandWorked(out);
+assert.eq(500, out.result.length);
+for (var i = 0; i < 500; ++i) {
+    assert.eq(i, out.result[i].a);
+    assert.eq(999, out.result[i].pad.length);
+    assert.eq([ 'p', 'q' ], out.result[i].b);
+    assert.eq(5, out.result[i].s.v);
+}
+
+// a nested path keeps the siblings at each level
+out = t.aggregate({ $unwind : "$s.t.u" });
+assert.commandWorked(out);
+assert.eq(3, out.result.length);
+for (var i = 0; i < 3; ++i) {
+    assert.eq(i + 1, out.result[i].s.t.u);
+    assert.eq(5, out.result[i].s.v);
+    assert.eq(500, out.result[i].a.length);
+}
+
+// unwinding the result of an unwind, then changing it downstream
+out = t.aggregate({ $unwind : "$b" },
+                  { $unwind : "$a" },
+                  { $match : { a : { $lt : 3 } } },
+                  { $project : { a : 1, b : 1, c : { $add : [ "$a", 10 ] } } });
+assert.commandWorked(out);
+assert.eq([ { _id : 1, a : 0, b : 'p', c : 10 },
+            { _id : 1, a : 1, b : 'p', c : 11 },
+            { _id : 1, a : 2, b : 'p', c : 12 },
+            { _id : 1, a : 0, b : 'q', c : 10 },
+            { _id : 1, a : 1, b : 'q', c : 11 },
+            { _id : 1, a : 2, b : 'q', c : 12 } ], out.result);
+
+// grouping on the unwound value
+out = t.aggregate({ $unwind : "$a" },
+                  { $group : { _id : { $mod : [ "$a", 5 ] }, n : { $sum : 1 } } },
+                  { $sort : { _id : 1 } });
+assert.commandWorked(out);
+assert.eq(5, out.result.length);
+for (var i = 0; i < 5; ++i)
+    assert.eq({ _id : i, n : 100 }, out.result[i]);
+
+// an empty array still loses the field, and a missing field passes through
+t.insert({ _id : 2, a : [], c : 1 });
+t.insert({ _id : 3, c : 2 });
+out = t.aggregate({ $match : { _id : { $gt : 1 } } }, { $unwind : "$a" },
+                  { $sort : { _id : 1 } });
+assert.commandWorked(out);
+assert.eq([ { _id : 2, c : 1 }, { _id : 3, c : 2 } ], out.result);
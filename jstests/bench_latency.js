@@ -0,0 +1,44 @@
+// benchRun latency percentiles, a target rate, and threads spread over several hosts
+
+t = db.bench_latency;
+t.drop();
+t.insert( { _id : 1 , x : 1 } );
+
+ops = [ { op : "findOne" , ns : t.getFullName() , query : { _id : 1 } } ,
+        { op : "update" , ns : t.getFullName() , query : { _id : 1 } , update : { $inc : { x : 1 } } } ];
+
+function args( extra ) {
+    var a = { ops : ops , parallel : 2 , seconds : 1 , host : db.getMongo().host };
+    if ( jsTest.options().auth ) {
+        a.db = 'admin';
+        a.username = jsTest.options().adminUser;
+        a.password = jsTest.options().adminPassword;
+    }
+    for ( var k in extra )
+        a[k] = extra[k];
+    return a;
+}
+
+res = benchRun( args( {} ) );
+printjson( res );
+["findOneLatencyMicros", "updateLatencyMicros"].forEach( function( k ) {
+    var l = res[k];
+    assert( l , "no " + k + ": " + tojson( res ) );
+    assert.lte( l.p50 , l.p99 , k );
+    assert.lte( l.p99 , l.p999 , k );
+    assert.lte( l.p999 , l.max , k );
+} );
+
+// 100 ops a second over 1 second, so about 50 updates
+before = t.findOne().x;
+res = benchRun( args( { opsPerSecond : 100 } ) );
+printjson( res );
+updates = t.findOne().x - before;
+assert.gt( updates , 30 , "rate too low" );
+assert.lt( updates , 80 , "rate not limited" );
+
+// the same host twice is two targets
+before = t.findOne().x;
+res = benchRun( args( { hosts : [ db.getMongo().host , db.getMongo().host ] , seconds : .5 } ) );
+assert.lt( before , t.findOne().x , "no updates through hosts" );
+assert( res.update > 0 , "opcounters summed over hosts: " + tojson( res ) );
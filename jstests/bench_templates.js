@@ -0,0 +1,38 @@
+// benchRun templates: interleaved sequences across threads, and skewed keys
+t = db.bench_templates
+t.drop();
+
+benchArgs = { ops : [ { ns : t.getFullName() ,
+                        op : "insert" ,
+                        doc : { _id : { "#SEQ_INT" : [ 0 , 1 ] } ,
+                                s : { "#RAND_STRING" : [ 10 ] } ,
+                                o : { "#OID" : 1 } } } ,
+                      { ns : t.getFullName() ,
+                        op : "update" ,
+                        query : { _id : { "#LATEST" : [ 0 , 1 , 100 ] } } ,
+                        update : { $inc : { x : 1 } , $set : { z : { "#ZIPF" : [ 1000 ] } } } } ] ,
+              parallel : 2 ,
+              seconds : 1 ,
+              randomSeed : 17 ,
+              host : db.getMongo().host }
+
+if (jsTest.options().auth) {
+    benchArgs['db'] = 'admin';
+    benchArgs['username'] = jsTest.options().adminUser;
+    benchArgs['password'] = jsTest.options().adminPassword;
+}
+
+res = benchRun( benchArgs )
+printjson( res );
+
+// the two threads take alternate values of the sequence, so neither inserts the other's keys
+assert.lt( 0 , t.find( { _id : { $mod : [ 2 , 0 ] } } ).count() );
+assert.lt( 0 , t.find( { _id : { $mod : [ 2 , 1 ] } } ).count() );
+
+var doc = t.findOne( { s : { $exists : true } } );
+assert.eq( 10 , doc.s.length , "RAND_STRING" );
+assert( doc.o instanceof ObjectId , "OID" );
+
+// updates only went to keys that had been inserted
+assert.lt( 0 , t.find( { x : { $gt : 0 } } ).count() );
+t.find( { z : { $exists : true } } ).forEach( function( d ) { assert.lt( d.z , 1000 ); } );
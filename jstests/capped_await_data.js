@@ -0,0 +1,37 @@
+// an awaitData cursor tailing a capped collection waits for an insert, and returns as soon as
+// one goes in
+
+t = db.capped_await_data;
+t.drop();
+db.createCollection( t.getName() , { capped : true , size : 100000 } );
+t.insert( { a : 0 } );
+db.getLastError();
+
+c = t.find().addOption( DBQuery.Option.tailable ).addOption( DBQuery.Option.awaitData );
+assert.eq( 0 , c.next().a );
+
+// nothing comes: the getMore holds on for a while before giving up
+start = new Date();
+assert( !c.hasNext() );
+assert.lte( 1000 , new Date() - start , "didn't wait" );
+
+p = startParallelShell( 'sleep( 500 ); db.capped_await_data.insert( { a : 1 } ); db.getLastError();' );
+start = new Date();
+assert( c.hasNext() , "missed the insert" );
+assert.eq( 1 , c.next().a );
+took = new Date() - start;
+p();
+assert.gt( 3000 , took , "woke on the timeout, not the insert" );
+
+// inserts into other capped collections don't wake it, its own does
+o = db.capped_await_data_other;
+o.drop();
+db.createCollection( o.getName() , { capped : true , size : 100000 } );
+p = startParallelShell( 'for ( i = 0; i < 10; i++ ) { sleep( 50 ); db.capped_await_data_other.insert( { i : i } ); } ' +
+                        'db.capped_await_data.insert( { a : 2 } ); db.getLastError();' );
+assert.soon( function() { return c.hasNext(); } , "missed the insert" , 20000 , 10 );
+assert.eq( 2 , c.next().a );
+p();
+
+t.drop();
+o.drop();
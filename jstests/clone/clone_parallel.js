@@ -0,0 +1,41 @@
+// copydb and clone copy a database's collections several at a time, with their indexes
+
+var baseName = "jstests_clone_parallel";
+
+ports = allocatePorts( 2 );
+
+f = startMongod( "--port", ports[ 0 ], "--dbpath", "/data/db/" + baseName + "_from", "--nohttpinterface", "--bind_ip", "127.0.0.1" ).getDB( baseName );
+t = startMongod( "--port", ports[ 1 ], "--dbpath", "/data/db/" + baseName + "_to", "--nohttpinterface", "--bind_ip", "127.0.0.1" ).getDB( baseName );
+
+for( c = 0; c < 6; ++c ) {
+    for( i = 0; i < 500; ++i ) {
+        f[ "c" + c ].save( { i: i, c: c } );
+    }
+    f[ "c" + c ].ensureIndex( { i: 1 } );
+}
+assert.isnull( f.getLastError() );
+
+function check( d ) {
+    for( c = 0; c < 6; ++c ) {
+        assert.eq( 500, d[ "c" + c ].count(), "c" + c );
+        assert.eq( 1, d[ "c" + c ].find( { i: 7 } ).hint( { i: 1 } ).itcount(), "c" + c + " index" );
+    }
+    assert.eq( 12, d.system.indexes.count() );
+}
+
+admin = t.getSisterDB( "admin" );
+assert.commandWorked( admin.runCommand( { copydb: 1, fromhost: "localhost:" + ports[ 0 ], fromdb: baseName, todb: baseName, threads: 3 } ) );
+check( t );
+
+other = t.getSisterDB( baseName + "_clone" );
+assert.commandWorked( admin.runCommand( { copydb: 1, fromhost: "localhost:" + ports[ 0 ], fromdb: baseName, todb: other.getName(), threads: 1 } ) );
+check( other );
+
+t.dropDatabase();
+assert.commandWorked( t.cloneDatabase( "localhost:" + ports[ 0 ] ) );
+check( t );
+
+t.dropDatabase();
+assert.commandFailed( t.runCommand( { clone: "localhost:" + ports[ 0 ], threads: 0 } ) );
+assert.commandFailed( admin.runCommand( { copydb: 1, fromhost: "localhost:" + ports[ 0 ], fromdb: baseName, todb: baseName, threads: 65 } ) );
+assert.eq( 0, t.c0.count() );
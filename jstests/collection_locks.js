@@ -0,0 +1,62 @@
+// --collectionLocks locks a collection beneath an intent lock on its database, so writes to its
+// other collections don't wait for it
+
+var baseName = "jstests_collection_locks";
+var port = allocatePorts( 1 )[ 0 ];
+var m = startMongodEmpty( "--port", port, "--dbpath", "/data/db/" + baseName, "--collectionLocks" );
+db = m.getDB( baseName );
+
+// creating a collection still takes the whole database, after that just the collection is locked
+for ( var i = 0; i < 100; ++i ) {
+    db.a.insert( { i : i } );
+    db.b.insert( { i : i } );
+}
+db.a.ensureIndex( { i : 1 } );
+db.a.update( { i : 5 } , { $set : { y : 1 } } );
+db.b.remove( { i : 5 } );
+assert.isnull( db.getLastError() );
+assert.eq( 100 , db.a.find().itcount() );
+assert.eq( 1 , db.a.find( { i : 5 } ).hint( { i : 1 } ).next().y );
+assert.eq( 99 , db.b.count() );
+
+var locks = db.serverStatus().locks[ baseName ];
+printjson( locks );
+assert( locks.collections , tojson( locks ) );
+assert( locks.collections.a , tojson( locks.collections ) );
+assert( locks.collections.b , tojson( locks.collections ) );
+assert.lt( 0 , locks.collections.a.timeLocked.W );
+assert.lt( 0 , locks.timeLocked.w , "database not intent locked" );
+// commands, indexes and system collections lock the database
+for ( var c in locks.collections ) {
+    assert.eq( -1 , c.indexOf( "$" ) , c );
+    assert.eq( -1 , c.indexOf( "system." ) , c );
+}
+
+// a slow multi update holds a, and only intent locks the database
+var s = startParallelShell( "db.getSisterDB( '" + baseName + "' ).a.update( " +
+                            "{ $where : function() { sleep( 100 ); return false; } } , " +
+                            "{ $set : { z : 1 } } , false , true ); db.getLastError();" );
+var op;
+assert.soon( function() {
+    var inprog = db.currentOp( { ns : baseName + ".a" , op : "update" } ).inprog;
+    if ( inprog.length == 0 || !inprog[ 0 ].locks )
+        return false;
+    op = inprog[ 0 ];
+    return op.locks[ "." + baseName ] == "w" && op.locks[ "." + baseName + ".a" ] == "W";
+} , "slow update isn't holding collection a" );
+printjson( op );
+
+db.b.insert( { during : 1 } );
+assert.isnull( db.getLastError() );
+assert.eq( 1 , db.b.count( { during : 1 } ) );
+
+db.killOp( op.opid );
+s();
+
+// dropping a collection forgets its lock
+db.b.drop();
+locks = db.serverStatus().locks[ baseName ];
+assert( !locks.collections.b , tojson( locks.collections ) );
+assert( locks.collections.a , tojson( locks.collections ) );
+
+stopMongod( port );
@@ -0,0 +1,30 @@
+// collStats reports how often each collection and index was read, and how much wasn't resident
+
+t = db.collstats_io;
+t.drop();
+t.ensureIndex( { a : 1 } );
+for ( var i = 0; i < 100; i++ )
+    t.insert( { a : i , s : "x" } );
+db.getLastError();
+
+for ( var i = 0; i < 100; i++ )
+    assert( t.findOne( { a : i } ) );
+
+var s = t.stats();
+printjson( s.io );
+printjson( s.indexIO );
+
+assert( s.io.accesses >= 100 , "io.accesses" );
+assert( s.io.notInMemoryRatio >= 0 && s.io.notInMemoryRatio <= 1 , "io.notInMemoryRatio" );
+assert( s.indexIO.a_1 , "indexIO.a_1" );
+assert( s.indexIO._id_ , "indexIO._id_" );
+
+// dropping an index or the collection starts its counts over
+t.dropIndex( { a : 1 } );
+t.ensureIndex( { a : 1 } );
+assert.gt( 100 , t.stats().indexIO.a_1.accesses , "recreated index" );
+
+t.drop();
+t.insert( { a : 1 } );
+db.getLastError();
+assert.gt( 100 , t.stats().io.accesses , "recreated collection" );
@@ -0,0 +1,56 @@
+// incremental compact empties the most fragmented extents a batch at a time and frees them,
+// keeping every index pointing at the documents it moved, while other writes carry on
+
+t = db.compact_incremental;
+t.drop();
+
+big = new Array( 1024 ).join( "x" );
+for ( i = 0; i < 20000; i++ )
+    t.insert( { _id : i , a : i % 100 , b : i , s : big } );
+t.ensureIndex( { a : 1 } );
+t.ensureIndex( { b : 1 } , { unique : true } );
+assert.isnull( db.getLastError() );
+
+// the early extents end up mostly free
+t.remove( { _id : { $lt : 16000 } , b : { $not : { $mod : [ 10 , 0 ] } } } );
+assert.isnull( db.getLastError() );
+n = t.count();
+assert.eq( 1600 + 4000 , n );
+before = t.stats();
+
+assert.commandFailed( db.runCommand( { compact : t.getName() , incremental : true , batchSize : 0 } ) );
+assert.commandFailed( db.runCommand( { compact : t.getName() , incremental : true , minFreeRatio : 2 } ) );
+
+// writes go on in the meantime
+p = startParallelShell( 'for ( i = 20000; i < 21000; i++ ) db.compact_incremental.insert( { _id : i , a : i % 100 , b : i } ); ' +
+                        'db.getLastError();' );
+res = db.runCommand( { compact : t.getName() , incremental : true , batchSize : 50 } );
+p();
+printjson( res );
+assert.commandWorked( res );
+assert.lt( 0 , res.extentsFreed );
+assert.lt( 0 , res.moved );
+assert.lte( res.moved / 50 , res.batches );
+
+after = t.stats();
+assert.gt( before.numExtents , after.numExtents );
+assert.eq( n + 1000 , t.count() );
+
+v = t.validate( true );
+assert( v.valid , tojson( v ) );
+
+// every index finds every document where it is now
+for ( i = 0; i < 21000; i += 7 ) {
+    var want = ( i >= 16000 || i % 10 == 0 ) ? 1 : 0;
+    assert.eq( want , t.find( { _id : i } ).itcount() , "_id " + i );
+    assert.eq( want , t.find( { b : i } ).hint( { b : 1 } ).itcount() , "b " + i );
+}
+assert.eq( n + 1000 , t.find().hint( { a : 1 } ).itcount() );
+assert.eq( ( n + 1000 ) / 100 , t.find( { a : 37 } ).hint( { a : 1 } ).itcount() );
+
+// nothing left worth doing
+res = db.runCommand( { compact : t.getName() , incremental : true , minFreeRatio : 0.9 } );
+assert.commandWorked( res );
+assert.eq( 0 , res.extentsFreed );
+
+t.drop();
@@ -0,0 +1,36 @@
+// A count scanning the whole collection may split the collection's extents among several threads.
+
+var t = db.jstests_countc;
+t.drop();
+
+var pad = new Array(500).join("x");
+for (var i = 0; i < 20000; ++i)
+    t.insert({ a : i % 7, b : i, pad : pad });
+db.getLastError();
+assert.gt(t.stats().numExtents, 4);
+
+function checkCount(query, options) {
+    var serial = db.runCommand(Object.extend({ count : t.getName(), query : query }, options));
+    for (var threads = 2; threads <= 64; threads *= 2) {
+        var parallel = db.runCommand(Object.extend({ count : t.getName(), query : query,
+                                                     parallel : threads }, options));
+        assert.commandWorked(parallel);
+        assert.eq(serial.n, parallel.n, tojson(query) + " with " + threads + " threads");
+    }
+    return serial.n;
+}
+
+assert.eq(2857, checkCount({ a : 3 }));
+assert.eq(10000, checkCount({ b : { $lt : 10000 } }));
+assert.eq(0, checkCount({ c : 1 }));
+assert.eq(20000, checkCount({ a : { $exists : true } }));
+assert.eq(857, checkCount({ a : 3 }, { skip : 2000 }));
+assert.eq(10, checkCount({ a : 3 }, { limit : 10 }));
+
+// $where counts on a single thread
+assert.eq(2857, checkCount({ $where : "this.a == 3" }));
+
+// and queries using an index don't scan the whole collection
+t.ensureIndex({ b : 1 });
+assert.eq(100, checkCount({ b : { $gte : 500, $lt : 600 } }));
+assert.eq(2857, checkCount({ a : 3, b : { $gte : 0 } }));
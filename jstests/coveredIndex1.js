@@ -59,6 +59,10 @@ assert.eq( t.find({obj: {a: 1, b: "blah"}}, {obj: 1, _id: 0}).explain().indexOnl
 t.dropIndex({obj: 1});
 t.ensureIndex({"obj.a": 1, "obj.b": 1})
 assert.eq( t.find({"obj.a": 1}, {obj: 1}).explain().indexOnly, false, "Shouldnt use index when introspecting object");
+// dotted fields of the key are returned as subobjects
+assert.eq( t.find({"obj.a": 1}, {"obj.a": 1, _id: 0}).explain().indexOnly, true, "Find is not using covered index");
+assert.eq( t.find({"obj.a": 1}, {"obj.a": 1, "obj.b": 1, _id: 0}).explain().indexOnly, true, "Find is not using covered index");
+assert.eq( t.findOne({"obj.a": 1}, {"obj.a": 1, "obj.b": 1, _id: 0}), {obj: {a: 1, b: "blah"}}, "Covered dotted fields not nested");
 
 assert(t.validate().valid);
 
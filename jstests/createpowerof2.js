@@ -0,0 +1,28 @@
+// create with usePowerOf2Sizes, and reuse of freed space with power of two record sizes
+
+var t = db.createpowerof2;
+t.drop();
+
+assert.commandWorked(db.createCollection("createpowerof2", { usePowerOf2Sizes : true }));
+assert.eq(1, t.stats().userFlags & 1, "usePowerOf2Sizes flag not set");
+
+// churn: documents of varying sizes deleted and reinserted.  with power of two sizes the
+// freed records fit the new ones, so the collection doesn't keep growing.
+function pad(n) {
+    return new Array(n).toString();
+}
+for (var i = 0; i < 1000; ++i)
+    t.insert({ _id : i, x : pad(100 + (i * 37) % 400) });
+assert.eq(null, db.getLastError());
+var size = t.stats().storageSize;
+
+for (var pass = 0; pass < 5; ++pass) {
+    t.remove({ _id : { $mod : [ 2, pass % 2 ] } });
+    for (var i = pass % 2; i < 1000; i += 2)
+        t.insert({ _id : i, x : pad(100 + (i * 53 + pass) % 400) });
+    assert.eq(null, db.getLastError());
+}
+assert.eq(1000, t.count());
+assert.eq(size, t.stats().storageSize, "collection grew under churn");
+
+t.drop();
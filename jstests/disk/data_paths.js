@@ -0,0 +1,53 @@
+// with --dataPaths a database's data files from db.1 on go to the extra directories in turn, and
+// are found there again after a restart and removed with the database
+
+var baseName = "jstests_disk_data_paths";
+port = allocatePorts( 1 )[ 0 ];
+dbpath = "/data/db/" + baseName + "/";
+stripe = "/data/db/" + baseName + "_stripe/";
+resetDbpath( dbpath );
+resetDbpath( stripe );
+
+function start() {
+    return startMongodNoReset( "--port", port, "--dbpath", dbpath, "--dataPaths", stripe,
+                               "--smallfiles", "--nohttpinterface", "--bind_ip", "127.0.0.1" );
+}
+
+function names( dir ) {
+    var r = [];
+    listFiles( dir ).forEach( function( f ) { if ( !f.isDirectory ) r.push( f.name.substring( dir.length ) ); } );
+    return r;
+}
+
+m = start();
+t = m.getDB( baseName ).data_paths;
+big = new Array( 64 * 1024 ).toString();
+for ( i = 0; i < 2000; i++ )
+    t.insert( { _id : i , big : big } );
+assert.isnull( t.getDB().getLastError() );
+t.getDB().adminCommand( { fsync : 1 } );
+
+// db.0 and db.ns in the dbpath, db.1 and db.3 on the stripe, db.2 back in the dbpath
+main = names( dbpath );
+striped = names( stripe );
+printjson( main );
+printjson( striped );
+assert.contains( baseName + ".0" , main );
+assert.contains( baseName + ".ns" , main );
+assert.contains( baseName + ".1" , striped );
+assert.contains( baseName + ".2" , main );
+assert.eq( -1 , main.indexOf( baseName + ".1" ) );
+
+stopMongod( port );
+m = start();
+t = m.getDB( baseName ).data_paths;
+assert.eq( 2000 , t.count() );
+assert.eq( big , t.findOne( { _id : 1999 } ).big );
+
+t.getDB().dropDatabase();
+assert.eq( [] , names( stripe ).filter( function( n ) { return n.indexOf( baseName + "." ) == 0; } ) );
+stopMongod( port );
+
+// it has to be a directory, and not the dbpath
+assert.eq( 2 , runMongoProgram( "mongod", "--port", port, "--dbpath", dbpath, "--dataPaths", stripe + "nonexistent" ) );
+assert.eq( 2 , runMongoProgram( "mongod", "--port", port, "--dbpath", dbpath, "--dataPaths", dbpath ) );
@@ -0,0 +1,54 @@
+// a database with more namespaces than its .ns file holds grows into db.ns.1 and on, and finds
+// them all again after a restart
+
+port = allocatePorts( 1 )[ 0 ];
+baseName = "jstests_disk_nsgrow";
+dbpath = "/data/db/" + baseName + "/";
+
+function start( reset ) {
+    var f = reset ? startMongod : startMongodNoReset;
+    return f( "--port", port, "--dbpath", dbpath, "--nssize", "1", "--smallfiles", "--noprealloc",
+              "--nohttpinterface", "--bind_ip", "127.0.0.1" );
+}
+
+m = start( true );
+db = m.getDB( baseName );
+
+// a collection and its _id index each take one
+n = 2000;
+for ( i = 0; i < n; i++ )
+    db[ "c" + i ].insert( { i : i } );
+assert.isnull( db.getLastError() );
+
+stats = db.stats();
+printjson( stats );
+assert.lt( 1 , stats.nsFiles );
+assert.lt( 1 , stats.nsSizeMB );
+assert( listFiles( dbpath ).some( function( f ) { return f.name == dbpath + baseName + ".ns.1"; } ) );
+
+// more than 10 indexes has an $extra, which goes with the collection wherever that is
+c = db[ "c" + ( n - 1 ) ];
+for ( i = 0; i < 15; i++ ) {
+    var k = {};
+    k[ "k" + i ] = 1;
+    c.ensureIndex( k );
+}
+assert.isnull( db.getLastError() );
+assert.eq( 16 , c.getIndexes().length );
+
+// dropped ones are gone and their slots reused
+db.c0.drop();
+assert.eq( n , db.getCollectionNames().length ); // n - 1, and system.indexes
+db.c0.insert( { i : 0 } );
+
+stopMongod( port );
+m = start( false );
+db = m.getDB( baseName );
+for ( i = 0; i < n; i += 97 )
+    assert.eq( i , db[ "c" + i ].findOne().i );
+assert.eq( 16 , db[ "c" + ( n - 1 ) ].getIndexes().length );
+assert.eq( n + 1 , db.getCollectionNames().length );
+
+db.dropDatabase();
+assert( !listFiles( dbpath ).some( function( f ) { return f.name.indexOf( baseName + ".ns" ) >= 0; } ) );
+stopMongod( port );
@@ -34,9 +34,11 @@ assert.eq( 1000 , x.stats.nscannedObjects , "AC3" )
 
 t.ensureIndex( { a : 1 } )
 
+// an index led by the key is scanned one value at a time
 x = d( "a" );
-assert.eq( 1000 , x.stats.n , "BA1" )
-assert.eq( 1000 , x.stats.nscanned , "BA2" )
+assert.eq( 10 , x.values.length , "BA0" )
+assert.eq( 10 , x.stats.n , "BA1" )
+assert.eq( 10 , x.stats.nscanned , "BA2" )
 assert.eq( 0 , x.stats.nscannedObjects , "BA3" )
 
 x = d( "a" , { a : { $gt : 5 } } );
@@ -58,3 +60,18 @@ assert.eq( 171 , x.stats.n )
 assert.eq( 275 , x.stats.nscanned )
 // Disable temporarily - exact value doesn't matter.
 // assert.eq( 266 , x.stats.nscannedObjects )
+
+// values skipped over come out the same as scanning every key, also past a descending field
+// and with removed keys in between
+t.dropIndexes();
+t.ensureIndex( { a : -1, b : 1 } );
+t.remove( { a : 3 } );
+t.remove( { a : 7, b : { $gt : 2 } } );
+x = d( "a" );
+expected = [];
+[ 9, 8, 7, 6, 5, 4, 2, 1, 0 ].forEach( function( v ) {
+    if ( t.count( { a : v } ) )
+        expected.push( v );
+} );
+assert.eq( expected , x.values , "CA1" )
+assert.eq( 0 , x.stats.nscannedObjects , "CA2" )
@@ -0,0 +1,45 @@
+// distinct on the leading field of a compound index, with a query on the fields after it, skips
+// through the index one value at a time rather than scanning the collection
+
+t = db.distinct_index3;
+t.drop();
+
+for ( i = 0; i < 2000; i++ ) {
+    t.insert( { region : "r" + ( i % 8 ) , status : i % 50 , x : i } );
+}
+t.ensureIndex( { region : 1 , status : 1 } );
+
+function d( k , q ) {
+    return t.runCommand( "distinct" , { key : k , query : q } );
+}
+
+function expected( q ) {
+    var seen = {};
+    var out = [];
+    t.find( q ).sort( { region : 1 } ).forEach( function( o ) {
+        if ( !seen[ o.region ] ) {
+            seen[ o.region ] = true;
+            out.push( o.region );
+        }
+    } );
+    return out;
+}
+
+function check( q , msg ) {
+    var x = d( "region" , q );
+    assert.eq( expected( q ) , x.values , msg );
+    assert.eq( 0 , x.stats.nscannedObjects , msg + " objects" );
+    assert.eq( x.values.length , x.stats.n , msg + " n" );
+    assert.gt( 100 , x.stats.nscanned , msg + " nscanned" );
+}
+
+check( { status : 3 } , "A" );
+check( { status : { $gt : 45 } } , "B" );
+check( { status : { $in : [ 1 , 17 , 30 ] } } , "C" );
+check( { status : 1 } , "D" ); // only odd regions
+check( { status : 1000 } , "E" );
+
+// a query on a field outside the index isn't answered this way
+x = d( "region" , { x : 5 } );
+assert.eq( [ "r5" ] , x.values , "F" );
+assert.eq( "BasicCursor" , x.stats.cursor , "F cursor" );
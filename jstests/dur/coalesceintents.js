@@ -0,0 +1,43 @@
+/* test durability when many small, overlapping and adjacent write intents are declared
+   in one group commit, so that they get merged while being declared
+*/
+
+var testname = "coalesceintents";
+var path = "/data/db/" + testname + "dur";
+var port = 30001;
+
+var conn = startMongodEmpty("--port", port, "--dbpath", path, "--dur", "--smallfiles",
+                            "--journalOptions", /*DurParanoid*/8);
+var d = conn.getDB("test");
+
+var doc = { _id : 0 };
+for (var f = 0; f < 100; ++f)
+    doc["f" + f] = 0;
+for (var i = 0; i < 50; ++i) {
+    doc._id = i;
+    d.foo.insert(doc);
+}
+d.getLastError();
+
+// lots of in place $inc's of neighbouring fields of the same documents
+for (var pass = 0; pass < 20; ++pass) {
+    for (var i = 0; i < 50; ++i) {
+        var inc = {};
+        for (var f = pass % 3; f < 100; f += 3)
+            inc["f" + f] = 1;
+        d.foo.update({ _id : i }, { $inc : inc });
+    }
+}
+var res = d.runCommand({ getLastError : 1, j : true });
+assert.eq(null, res.err, "getLastError failed");
+
+var expected = d.foo.find().sort({ _id : 1 }).toArray();
+
+stopMongod(port, /*signal*/9);
+
+conn = startMongodNoReset("--port", port, "--dbpath", path, "--dur", "--smallfiles");
+d = conn.getDB("test");
+assert.eq(expected, d.foo.find().sort({ _id : 1 }).toArray(), "data differs after recovery");
+stopMongod(port);
+
+print(testname + " SUCCESS");
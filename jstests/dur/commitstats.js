@@ -0,0 +1,40 @@
+/* serverStatus().dur reports each group commit's size, the j:true writers waiting on it, and
+   how long writers were held up by it
+*/
+
+var testname = "commitstats";
+var path = "/data/db/" + testname + "dur";
+var port = 30001;
+
+var conn = startMongodEmpty("--port", port, "--dbpath", path, "--dur", "--smallfiles");
+var d = conn.getDB("test");
+
+var x = "x";
+while (x.length < 1000)
+    x += x;
+for (var i = 0; i < 100; ++i) {
+    d.foo.insert({ _id : i, x : x });
+    assert.eq(null, d.runCommand({ getLastError : 1, j : true }).err);
+}
+
+var dur = d.serverStatus().dur;
+printjson(dur);
+
+function total(h) {
+    var n = 0;
+    for (var k in h)
+        n += h[k];
+    return n;
+}
+
+assert.lt(0, total(dur.commitBytes), "no commit sizes");
+assert.lt(0, total(dur.commitWaiters.perCommit), "no commit waiters");
+assert.eq(0, dur.commitWaiters.current);
+assert.lt(0, total(dur.writersBlocked.latencies), "no writer blocked times");
+assert(dur.writersBlocked.maxMs >= 0);
+assert(dur.maxCommitWaiters >= 0);
+assert(dur.maxWritersBlockedMs >= 0);
+
+stopMongod(port);
+
+print(testname + " SUCCESS");
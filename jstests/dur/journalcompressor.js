@@ -0,0 +1,41 @@
+/* test recovery from journal sections written with each --journalCompressor, including
+   recovering with a different setting than the one the sections were written with
+*/
+
+var testname = "journalcompressor";
+var path = "/data/db/" + testname + "dur";
+var port = 30001;
+
+function run(writeWith, recoverWith) {
+    print("\n" + testname + " write with " + writeWith + ", recover with " + recoverWith);
+
+    var conn = startMongodEmpty("--port", port, "--dbpath", path, "--dur", "--smallfiles",
+                                "--journalCompressor", writeWith);
+    var d = conn.getDB("test");
+    assert.eq(writeWith, d.serverStatus().dur.journalCompressor);
+
+    var x = "x";
+    while (x.length < 1000)
+        x += x;
+    for (var i = 0; i < 1000; ++i)
+        d.foo.insert({ _id : i, x : x, n : i });
+    d.foo.update({}, { $inc : { n : 1 } }, false, true);
+    var res = d.runCommand({ getLastError : 1, j : true });
+    assert.eq(null, res.err, "getLastError failed");
+
+    stopMongod(port, /*signal*/9);
+
+    conn = startMongodNoReset("--port", port, "--dbpath", path, "--dur", "--smallfiles",
+                              "--journalCompressor", recoverWith);
+    d = conn.getDB("test");
+    assert.eq(1000, d.foo.count(), "wrong count after recovery");
+    assert.eq(1000, d.foo.find({ $where : "this.n == this._id + 1" }).count(),
+              "updates lost in recovery");
+    stopMongod(port);
+}
+
+run("none", "none");
+run("none", "snappy");
+run("snappy", "none");
+
+print(testname + " SUCCESS");
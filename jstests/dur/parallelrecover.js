@@ -0,0 +1,44 @@
+/* test recovery when sections have writes to many data files, which recovery applies on
+   several threads split by file, and when a file is created mid journal
+*/
+
+var testname = "parallelrecover";
+var path = "/data/db/" + testname + "dur";
+var port = 30001;
+
+var conn = startMongodEmpty("--port", port, "--dbpath", path, "--dur", "--smallfiles",
+                            "--syncdelay", 0);
+var x = "x";
+while (x.length < 4096)
+    x += x;
+
+// big batches to several databases, so that most sections touch many files
+for (var pass = 0; pass < 5; ++pass) {
+    for (var db = 0; db < 6; ++db) {
+        var d = conn.getDB("test" + db);
+        for (var i = 0; i < 200; ++i)
+            d.foo.insert({ _id : pass * 1000 + i, x : x, n : 0 });
+        d.foo.update({}, { $inc : { n : 1 } }, false, true);
+    }
+}
+// a database that only exists in the journal
+conn.getDB("testlate").foo.insert({ _id : 1 });
+var res = conn.getDB("test0").runCommand({ getLastError : 1, j : true });
+assert.eq(null, res.err, "getLastError failed");
+
+stopMongod(port, /*signal*/9);
+
+conn = startMongodNoReset("--port", port, "--dbpath", path, "--dur", "--smallfiles");
+for (var db = 0; db < 6; ++db) {
+    var d = conn.getDB("test" + db);
+    assert.eq(1000, d.foo.count(), "wrong count in test" + db);
+    // the first pass's documents were updated five times, the last pass's once
+    for (var pass = 0; pass < 5; ++pass)
+        assert.eq(200, d.foo.find({ _id : { $gte : pass * 1000, $lt : pass * 1000 + 200 },
+                                    n : 5 - pass }).count(),
+                  "lost updates in test" + db + " pass " + pass);
+}
+assert.eq(1, conn.getDB("testlate").foo.count(), "file created in the journal is missing");
+stopMongod(port);
+
+print(testname + " SUCCESS");
@@ -0,0 +1,49 @@
+/* test durability with pipelined group commits
+   writes acknowledged with getLastError j:true must survive a kill -9, while
+   another client keeps the commits busy enough that groups overlap
+*/
+
+var testname = "pipelinedcommit";
+var path = "/data/db/" + testname + "dur";
+var port = 30001;
+
+function run(journalOptions) {
+    print("\n" + testname + " journalOptions " + journalOptions);
+
+    var conn = startMongodEmpty("--port", port, "--dbpath", path, "--dur",
+                                "--smallfiles", "--journalOptions", journalOptions,
+                                "--journalCommitInterval", 2);
+    var d = conn.getDB("test");
+
+    // background load, so the next group is being prepared while one is written
+    var load = startParallelShell(
+        "var x = 'x'; while (x.length < 4096) x += x;" +
+        "for (var i = 0; i < 20000; ++i) db.bar.insert({ _id : i, x : x });",
+        port);
+
+    var acked = -1;
+    for (var i = 0; i < 2000; ++i) {
+        d.foo.insert({ _id : i });
+        if (i % 50 == 49) {
+            var res = d.runCommand({ getLastError : 1, j : true });
+            assert.eq(null, res.err, "getLastError failed");
+            acked = i;
+        }
+    }
+
+    stopMongod(port, /*signal*/9);
+    load();
+
+    conn = startMongodNoReset("--port", port, "--dbpath", path, "--dur",
+                              "--smallfiles", "--journalOptions", journalOptions);
+    d = conn.getDB("test");
+    for (var i = 0; i <= acked; ++i)
+        assert.eq(1, d.foo.find({ _id : i }).itcount(),
+                  "acknowledged write " + i + " was lost");
+    stopMongod(port);
+}
+
+run(/*DurParanoid*/8);
+run(/*DurParanoid|DurNoPipelinedCommit*/8 | 128);
+
+print(testname + " SUCCESS");
@@ -0,0 +1,35 @@
+/* test flushing data files at --syncRateMB: written ranges get flushed, with progress in
+   serverStatus, and the rate can be changed with setParameter
+*/
+
+var testname = "throttledflush";
+var path = "/data/db/" + testname + "dur";
+var port = 30001;
+
+var conn = startMongodEmpty("--port", port, "--dbpath", path, "--dur", "--smallfiles",
+                            "--syncdelay", 1, "--syncRateMB", 20);
+var d = conn.getDB("test");
+var admin = conn.getDB("admin");
+
+assert.eq(20, admin.runCommand({ getParameter : 1, syncRateMB : 1 }).syncRateMB);
+
+var x = "x";
+while (x.length < 4096)
+    x += x;
+for (var i = 0; i < 2000; ++i)
+    d.foo.insert({ _id : i, x : x });
+d.getLastError();
+
+assert.soon(function() {
+    var t = d.serverStatus().backgroundFlushing.throttled;
+    return t && t.totalFlushedMB >= 4 && t.backlogMB == 0;
+}, "written ranges weren't flushed", 60000);
+
+var res = admin.runCommand({ setParameter : 1, syncRateMB : 0 });
+assert.commandWorked(res);
+assert.eq(20, res.was);
+assert.commandFailed(admin.runCommand({ setParameter : 1, syncRateMB : -1 }));
+
+stopMongod(port);
+
+print(testname + " SUCCESS");
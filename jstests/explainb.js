@@ -0,0 +1,29 @@
+// Explain reports the time spent in each stage of reading a find's results.
+
+t = db.jstests_explainb;
+t.drop();
+
+for( i = 0; i < 1000; ++i ) {
+    t.save( { a:i, b:i%10 } );
+}
+t.ensureIndex( { a:1 } );
+
+function checkStages( explain ) {
+    s = explain.stages;
+    assert( s, tojson( explain ) );
+    [ "advanceMicros", "matchMicros", "projectMicros", "yieldMicros",
+     "recordsNotInMemory" ].forEach( function( f ) {
+                                        assert.lte( 0, s[ f ], f );
+                                    } );
+}
+
+checkStages( t.find( { b:3 } ).explain() );
+checkStages( t.find( { a:{ $gt:100 }, b:3 }, { b:1 } ).explain() );
+checkStages( t.find( { $or:[ { a:5 }, { b:3 } ] } ).explain() );
+checkStages( t.find( { a:{ $gt:100 } } ).sort( { b:1 } ).explain( true ) );
+
+// Stages are not reported by the clauses of an $or, only for the whole query.
+e = t.find( { $or:[ { a:5 }, { a:7 } ] } ).explain();
+assert.eq( 2, e.clauses.length );
+assert( !e.clauses[ 0 ].stages );
+checkStages( e );
@@ -0,0 +1,68 @@
+// fileread returns just the bytes of a range of a GridFS file, from only the chunks it covers
+
+db.fs.files.drop();
+db.fs.chunks.drop();
+db.fs.chunks.ensureIndex( { files_id : 1 , n : 1 } );
+
+// 4 byte chunks: "abcd" "efgh" "ijkl" "mn"
+s = "abcdefghijklmn";
+db.fs.files.insert( { _id : 1 , length : s.length , chunkSize : 4 } );
+for ( n = 0; n * 4 < s.length; n++ )
+    db.fs.chunks.insert( { files_id : 1 , n : n , data : BinData( 0 , base64( s.substring( n * 4 , n * 4 + 4 ) ) ) } );
+assert.isnull( db.getLastError() );
+
+function base64( str ) {
+    // enough for the sake of the test: ascii, padded
+    var chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    var out = "";
+    for ( var i = 0; i < str.length; i += 3 ) {
+        var a = str.charCodeAt( i ) , b = str.charCodeAt( i + 1 ) , c = str.charCodeAt( i + 2 );
+        var k = ( a << 16 ) | ( ( b || 0 ) << 8 ) | ( c || 0 );
+        out += chars.charAt( k >> 18 ) + chars.charAt( ( k >> 12 ) & 63 ) +
+            ( i + 1 < str.length ? chars.charAt( ( k >> 6 ) & 63 ) : "=" ) +
+            ( i + 2 < str.length ? chars.charAt( k & 63 ) : "=" );
+    }
+    return out;
+}
+
+function read( offset , length , extra ) {
+    var cmd = { fileread : 1 , offset : offset , length : length };
+    for ( var k in extra )
+        cmd[ k ] = extra[ k ];
+    var res = db.runCommand( cmd );
+    assert.commandWorked( res );
+    return res;
+}
+
+function check( offset , length ) {
+    var res = read( offset , length );
+    var want = s.substring( offset , offset + length );
+    assert.eq( want.length , res.length , offset + "," + length );
+    assert.eq( base64( want ) , res.data.base64() , offset + "," + length );
+}
+
+check( 0 , 14 );
+check( 0 , 4 );
+check( 1 , 2 );
+check( 3 , 2 );
+check( 5 , 8 );
+check( 12 , 2 );
+check( 10 , 100 );
+check( 14 , 10 );
+check( 6 , 0 );
+
+// chunkSize given rather than looked up
+assert.eq( base64( "efgh" ) , read( 4 , 4 , { chunkSize : 4 } ).data.base64() );
+
+// without length, to the end
+assert.eq( 8 , db.runCommand( { fileread : 1 , offset : 6 } ).length );
+
+// a missing chunk stops it short
+db.fs.chunks.remove( { n : 2 } );
+assert.eq( 6 , read( 2 , 12 ).length );
+
+assert.commandFailed( db.runCommand( { fileread : 2 , offset : 0 , length : 4 } ) , "no such file" );
+assert.commandFailed( db.runCommand( { fileread : 1 , offset : -1 , length : 4 } ) );
+
+db.fs.files.drop();
+db.fs.chunks.drop();
@@ -0,0 +1,57 @@
+// findAndModify with a limit claims up to that many documents at once, in sort order, and
+// returns them all in values
+
+t = db.find_and_modify_batch;
+t.drop();
+
+for ( i = 0; i < 20; i++ )
+    t.insert( { _id : i , priority : i % 10 , state : "ready" } );
+t.ensureIndex( { priority : -1 } );
+
+function claim( cmd ) {
+    cmd.findAndModify = t.getName();
+    var res = db.runCommand( cmd );
+    assert.commandWorked( res );
+    return res.values;
+}
+
+// the highest priority first, old values by default
+v = claim( { query : { state : "ready" } , sort : { priority : -1 } , limit : 4 ,
+             update : { $set : { state : "taken" } } } );
+assert.eq( 4 , v.length );
+v.forEach( function( o ) { assert.lte( 8 , o.priority , tojson( o ) ); assert.eq( "ready" , o.state ); } );
+assert.eq( 4 , t.count( { state : "taken" } ) );
+assert.eq( 0 , t.count( { state : "taken" , priority : { $lt : 8 } } ) );
+
+// and new ones, projected
+v = claim( { query : { state : "ready" } , limit : 3 , update : { $set : { state : "taken" } } ,
+             "new" : true , fields : { state : 1 } } );
+assert.eq( 3 , v.length );
+v.forEach( function( o ) { assert.eq( "taken" , o.state ); assert.isnull( o.priority ); } );
+assert.eq( 7 , t.count( { state : "taken" } ) );
+
+// fewer than the limit left
+v = claim( { query : { state : "ready" } , remove : true , limit : 100 } );
+assert.eq( 13 , v.length );
+assert.eq( 0 , t.count( { state : "ready" } ) );
+assert.eq( 0 , claim( { query : { state : "ready" } , remove : true , limit : 5 } ).length );
+
+// the positional operator still sees the query
+t.drop();
+t.insert( { _id : 1 , tasks : [ { n : 1 , done : false } , { n : 2 , done : false } ] } );
+claim( { query : { "tasks.n" : 2 } , limit : 1 , update : { $set : { "tasks.$.done" : true } } } );
+assert.eq( [ false , true ] , t.findOne().tasks.map( function( x ) { return x.done; } ) );
+
+// and without a limit, a single findAndModify only touches the document it returns
+t.drop();
+t.insert( { _id : 1 , a : 1 } );
+t.insert( { _id : 2 , a : 1 } );
+out = t.findAndModify( { query : { a : 1 } , update : { $inc : { a : 1 } } , "new" : true } );
+assert.eq( 2 , out.a );
+assert.eq( 1 , t.count( { a : 1 } ) );
+
+assert.commandFailed( db.runCommand( { findAndModify : t.getName() , limit : 0 , remove : true } ) );
+assert.commandFailed( db.runCommand( { findAndModify : t.getName() , limit : 2 , upsert : true , query : { _id : 5 } , update : { x : 1 } } ) );
+assert.commandFailed( db.runCommand( { findAndModify : t.getName() , limit : 2 , sort : { b : 1 } , remove : true } ) );
+
+t.drop();
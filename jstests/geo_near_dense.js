@@ -0,0 +1,64 @@
+// $near and geoNear over a dense cluster with sparse points around it give the same nearest
+// points as a brute force sort, and the best first cell search only looks at keys close by
+
+t = db.geo_near_dense;
+t.drop();
+
+Random.srand( 5678 );
+id = 0;
+// a dense city block
+for ( i = 0; i < 5000; i++ )
+    t.insert( { _id : id++ , loc : [ 10 + Random.rand() , 20 + Random.rand() ] } );
+// and the countryside
+for ( i = 0; i < 500; i++ )
+    t.insert( { _id : id++ , loc : [ Random.rand() * 300 - 150 , Random.rand() * 160 - 80 ] } );
+t.ensureIndex( { loc : "2d" } );
+assert.isnull( db.getLastError() );
+
+all = t.find().toArray();
+
+function nearest( p , n , maxDistance ) {
+    var d = [];
+    for ( var i = 0; i < all.length; i++ ) {
+        var dx = all[ i ].loc[ 0 ] - p[ 0 ] , dy = all[ i ].loc[ 1 ] - p[ 1 ];
+        var dist = Math.sqrt( dx * dx + dy * dy );
+        if ( maxDistance === undefined || dist <= maxDistance )
+            d.push( dist );
+    }
+    d.sort( function( a , b ) { return a - b; } );
+    return d.slice( 0 , n );
+}
+
+function check( p , n , maxDistance ) {
+    var cmd = { geoNear : t.getName() , near : p , num : n };
+    if ( maxDistance !== undefined )
+        cmd.maxDistance = maxDistance;
+    var res = db.runCommand( cmd );
+    assert.commandWorked( res );
+    var want = nearest( p , n , maxDistance );
+    assert.eq( want.length , res.results.length , tojson( p ) );
+    for ( var i = 0; i < want.length; i++ )
+        assert.close( want[ i ] , res.results[ i ].dis , tojson( p ) + " " + i , 10 );
+
+    var q = { $near : p };
+    if ( maxDistance !== undefined )
+        q.$maxDistance = maxDistance;
+    assert.eq( want.length , t.find( { loc : q } ).limit( n ).itcount() );
+    return res.stats;
+}
+
+stats = check( [ 10.5 , 20.5 ] , 10 );
+printjson( stats );
+assert.gt( 2500 , stats.btreelocs , "looked at too much of the block" );
+
+check( [ 10.5 , 20.5 ] , 100 );
+check( [ 10 , 20 ] , 50 );
+check( [ 11.01 , 21.01 ] , 50 );
+check( [ 10.5 , 20.5 ] , 100 , 0.05 );
+check( [ 0 , 0 ] , 20 );
+check( [ 60 , -40 ] , 5 );
+check( [ 179 , 89 ] , 5 );
+check( [ 10.5 , 20.5 ] , 6000 );
+check( [ 50 , 50 ] , 10 , 1 );
+
+t.drop();
@@ -0,0 +1,45 @@
+// $within $polygon agrees with a brute force ray cast for a concave polygon, including points out
+// past its bounds that the edge table rejects without walking the edges
+
+t = db.geo_polygon4;
+t.drop();
+
+for ( x = -20; x <= 20; x++ )
+    for ( y = -20; y <= 20; y++ )
+        t.insert( { loc : [ x , y ] } );
+t.ensureIndex( { loc : "2d" } );
+assert.isnull( db.getLastError() );
+
+// a U, open to the top
+poly = [ [ -10 , -10 ] , [ 10 , -10 ] , [ 10 , 10 ] , [ 5 , 10 ] , [ 5 , -5 ] , [ -5 , -5 ] , [ -5 , 10 ] , [ -10 , 10 ] ];
+
+function inside( p ) {
+    // on an edge counts as in
+    for ( var i = 0; i < poly.length; i++ ) {
+        var a = poly[ i ] , b = poly[ ( i + 1 ) % poly.length ];
+        var cross = ( b[ 0 ] - a[ 0 ] ) * ( p[ 1 ] - a[ 1 ] ) - ( b[ 1 ] - a[ 1 ] ) * ( p[ 0 ] - a[ 0 ] );
+        if ( cross == 0 && p[ 0 ] >= Math.min( a[ 0 ] , b[ 0 ] ) && p[ 0 ] <= Math.max( a[ 0 ] , b[ 0 ] ) &&
+             p[ 1 ] >= Math.min( a[ 1 ] , b[ 1 ] ) && p[ 1 ] <= Math.max( a[ 1 ] , b[ 1 ] ) )
+            return true;
+    }
+    var c = false;
+    for ( var i = 0 , j = poly.length - 1; i < poly.length; j = i++ ) {
+        var a = poly[ i ] , b = poly[ j ];
+        if ( ( a[ 1 ] > p[ 1 ] ) != ( b[ 1 ] > p[ 1 ] ) &&
+             p[ 0 ] < ( b[ 0 ] - a[ 0 ] ) * ( p[ 1 ] - a[ 1 ] ) / ( b[ 1 ] - a[ 1 ] ) + a[ 0 ] )
+            c = !c;
+    }
+    return c;
+}
+
+want = 0;
+t.find().forEach( function( o ) { if ( inside( o.loc ) ) want++; } );
+
+found = t.find( { loc : { $within : { $polygon : poly } } } ).toArray();
+assert.eq( want , found.length );
+found.forEach( function( o ) { assert( inside( o.loc ) , tojson( o.loc ) ); } );
+
+// the notch of the U is out
+assert.eq( 0 , t.find( { loc : { $within : { $polygon : poly } } , "loc.1" : { $gt : -5 } , "loc.0" : { $gt : -5 , $lt : 5 } } ).itcount() );
+
+t.drop();
@@ -0,0 +1,67 @@
+// group gives the same results whether its reduce is done natively or in JavaScript
+
+t = db.group_native;
+t.drop();
+
+for ( i = 0; i < 100; i++ )
+    t.insert( { a : i % 7 , b : i % 3 , x : i , y : i / 2 } );
+
+function run( reduce , initial , extra ) {
+    var cmd = { key : { a : 1 } , reduce : reduce , initial : initial };
+    for ( var k in extra )
+        cmd[ k ] = extra[ k ];
+    return t.group( cmd );
+}
+
+// the native versions, and ones the server can't tell are the same
+counted = run( function( obj , prev ) { prev.count++; } , { count : 0 } );
+assert.eq( 7 , counted.length );
+assert.eq( counted , run( function( obj , prev ) { var one = 1; prev.count += one; } , { count : 0 } ) );
+assert.eq( counted , run( function( obj , prev ) { prev.count = prev.count + 1; } , { count : 0 } ) );
+
+summed = run( function( o , p ) { p.n += 1; p.total += o.x; p.half = p.half + o.y; } ,
+              { n : 0 , total : 5 , half : 0 , other : "z" } );
+assert.eq( summed , run( function( o , p ) { if ( true ) { p.n += 1; p.total += o.x; p.half = p.half + o.y; } } ,
+                         { n : 0 , total : 5 , half : 0 , other : "z" } ) );
+summed.forEach( function( g ) {
+    var want = 5;
+    for ( var i = g.a; i < 100; i += 7 )
+        want += i;
+    assert.eq( want , g.total , tojson( g ) );
+    assert.eq( "z" , g.other );
+} );
+
+// a field that isn't always a number goes back to the function
+t.insert( { a : 0 , x : "s" } );
+t.insert( { a : 1 } );
+mixed = run( function( o , p ) { p.total += o.x; } , { total : 0 } );
+assert.eq( "string" , typeof( mixed[ 0 ].total ) );
+assert( isNaN( mixed[ 1 ].total ) );
+
+// with $keyf, and with finalize
+assert.eq( counted.map( function( g ) { return g.count; } ),
+           t.group( { $keyf : function( o ) { return { a : o.a }; } , cond : { x : { $exists : true , $type : 1 } } ,
+                      reduce : function( obj , prev ) { prev.count++; } , initial : { count : 0 } } )
+           .map( function( g ) { return g.count; } ) );
+fin = run( function( obj , prev ) { prev.count++; } , { count : 0 } ,
+           { cond : { x : { $type : 1 } } , finalize : function( out ) { out.twice = out.count * 2; } } );
+fin.forEach( function( g ) { assert.eq( g.count * 2 , g.twice ); } );
+
+// a declarative $reduce needs no initial
+res = t.group( { key : { b : 1 } , cond : { x : { $type : 1 } } ,
+                 reduce : { n : { $sum : 1 } , top : { $max : "$x" } , avg : { $avg : "$x" } } } );
+assert.eq( 3 , res.length );
+res.forEach( function( g ) {
+    assert.eq( [ 99 , 97 , 98 ][ g.b ] , g.top , tojson( g ) );
+    assert.eq( g.b == 0 ? 34 : 33 , g.n , tojson( g ) );
+} );
+
+// and may be finalized
+res = t.group( { key : { b : 1 } , cond : { x : { $type : 1 } } , reduce : { n : { $sum : 1 } } ,
+                 finalize : function( out ) { return { b : out.b , m : out.n + 1 }; } } );
+res.forEach( function( g ) { assert.eq( g.b == 0 ? 35 : 34 , g.m , tojson( g ) ); } );
+
+assert.throws( function() { t.group( { key : { b : 1 } , reduce : { n : { $nosuch : 1 } } } ); } );
+assert.throws( function() { t.group( { key : { b : 1 } , reduce : { $n : { $sum : 1 } } } ); } );
+
+t.drop();
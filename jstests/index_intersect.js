@@ -0,0 +1,49 @@
+// A query constraining two fields with separate indexes may scan one index while skipping the
+// records missing from the other, instead of fetching every record the first index finds.
+
+var t = db.jstests_index_intersect;
+t.drop();
+
+for (var i = 0; i < 5000; ++i)
+    t.insert({ _id : i, a : i % 50, b : Math.floor(i / 50) % 50, c : i });
+db.getLastError();
+t.ensureIndex({ a : 1 });
+t.ensureIndex({ b : 1 });
+
+function checkSame(query) {
+    var expected = t.find(query).hint({ $natural : 1 }).sort({ _id : 1 }).toArray();
+    var results = t.find(query).toArray().sort(function(x, y) { return x._id - y._id; });
+    assert.eq(expected, results, tojson(query));
+}
+
+function cursorFor(query) {
+    return t.find(query).explain().cursor;
+}
+
+// the intersection reads 100 keys from each index but only fetches the 2 matches
+var explain = t.find({ a : 5, b : 7 }).explain(true);
+assert.eq(2, explain.n);
+assert.eq("BtreeCursor a_1 intersect b_1", explain.cursor);
+assert.gte(explain.intersectNscanned, 100);
+assert.lte(explain.intersectNscanned, 101);
+assert.eq(2, explain.nscannedObjects);
+checkSame({ a : 5, b : 7 });
+
+// ranges and lists on either field
+checkSame({ a : { $in : [ 1, 2, 3 ] }, b : { $gt : 40 } });
+checkSame({ a : 5, b : { $in : [ 7, 8 ] }, c : { $lt : 2500 } });
+assert.eq("BtreeCursor a_1 multi intersect b_1",
+          cursorFor({ a : { $in : [ 1, 2, 3 ] }, b : { $in : [ 40, 41, 42 ] } }));
+
+// a multikey second index still finds every match
+t.update({ _id : 357 }, { $set : { b : [ 1, 7 ] } });
+t.update({ _id : 5 }, { $set : { b : [ 7, 8 ] } });
+db.getLastError();
+checkSame({ a : 5, b : 7 });
+checkSame({ a : 7, b : 7 });
+assert.eq(3, t.find({ a : 5, b : 7 }).itcount());
+
+// no intersection when one index answers the query alone, or if the query is sorted
+assert.eq("BtreeCursor a_1", cursorFor({ a : 5 }));
+assert.eq(-1, cursorFor({ a : 5, b : 7, _id : 255 }).indexOf("intersect"));
+assert.eq(-1, t.find({ a : 5, b : 7 }).sort({ c : 1 }).explain().cursor.indexOf("intersect"));
@@ -0,0 +1,73 @@
+// A partial index only has keys for the documents matching its partialFilterExpression, and is
+// only used for queries which can't match any other document.
+
+var t = db.jstests_index_partial;
+t.drop();
+
+for (var i = 0; i < 1000; ++i)
+    t.insert({ _id : i, status : (i % 100 == 0 ? "pending" : "done"), a : i });
+db.getLastError();
+
+t.ensureIndex({ status : 1, a : 1 }, { partialFilterExpression : { status : "pending" } });
+assert.eq(null, db.getLastError());
+
+t.ensureIndex({ a : 1 }, { partialFilterExpression : { a : { $gte : 500, $lt : 800 } },
+                           name : "a_partial" });
+assert.eq(null, db.getLastError());
+
+function cursorFor(query) {
+    return t.find(query).explain().cursor;
+}
+
+function checkCount(n, query) {
+    assert.eq(n, t.find(query).itcount(), tojson(query));
+    assert.eq(n, t.find(query).hint({ $natural : 1 }).itcount(), tojson(query));
+}
+
+// only the matching documents have keys
+assert.eq(10, t.find().hint({ status : 1, a : 1 }).itcount());
+assert.eq(300, t.find().hint("a_partial").itcount());
+assert(t.validate().valid);
+
+// queries implying the filter use the index
+assert.eq("BtreeCursor status_1_a_1", cursorFor({ status : "pending" }));
+assert.eq("BtreeCursor status_1_a_1", cursorFor({ status : "pending", a : { $gt : 300 } }));
+assert.eq("BtreeCursor a_partial", cursorFor({ a : { $gt : 600, $lte : 700 } }));
+assert.eq("BtreeCursor a_partial", cursorFor({ a : 500 }));
+checkCount(10, { status : "pending" });
+checkCount(6, { status : "pending", a : { $gt : 300 } });
+checkCount(100, { a : { $gt : 600, $lte : 700 } });
+
+// and the others don't
+assert.eq("BasicCursor", cursorFor({ status : "done" }));
+assert.eq("BasicCursor", cursorFor({ status : { $in : [ "pending", "done" ] } }));
+assert.eq("BasicCursor", cursorFor({ a : { $gt : 600 } }));
+assert.eq("BasicCursor", cursorFor({ a : 800 }));
+checkCount(990, { status : "done" });
+checkCount(399, { a : { $gt : 600 } });
+checkCount(1, { a : 800 });
+checkCount(1, { status : "pending", a : 100 });
+checkCount(1000, { status : { $in : [ "pending", "done" ] } });
+
+// distinct doesn't read values from an index which is missing documents
+assert.eq([ "done", "pending" ], t.distinct("status").sort());
+
+// documents move in and out of the index when updated
+t.update({ status : "pending" }, { $set : { status : "done" } }, false, true);
+t.update({ _id : { $lt : 5 } }, { $set : { status : "pending" } }, false, true);
+db.getLastError();
+assert.eq(5, t.find().hint({ status : 1, a : 1 }).itcount());
+checkCount(5, { status : "pending" });
+t.remove({ _id : 1 });
+checkCount(4, { status : "pending" });
+assert(t.validate().valid);
+
+// unsupported filters are rejected
+t.ensureIndex({ b : 1 }, { partialFilterExpression : { b : { $in : [ 1, 2 ] } } });
+assert(db.getLastError(), "expected an error for $in");
+t.ensureIndex({ b : 1 }, { partialFilterExpression : { $or : [ { b : 1 } ] } });
+assert(db.getLastError(), "expected an error for $or");
+t.ensureIndex({ b : 1 }, { partialFilterExpression : 5 });
+assert(db.getLastError(), "expected an error for a non object filter");
+t.ensureIndex({ loc : "2d" }, { partialFilterExpression : { b : 1 } });
+assert(db.getLastError(), "expected an error for a special index");
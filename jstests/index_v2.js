@@ -0,0 +1,120 @@
+// v:2 indexes store keys after a prefix their bucket shares.  They must give the same results
+// as v:1 indexes while taking less space when compound keys have long common leading values.
+
+var v1 = db.jstests_index_v2_v1;
+var v2 = db.jstests_index_v2;
+v1.drop();
+v2.drop();
+
+var tenantPad = new Array(200).join("t");
+var pathPad = "/" + new Array(150).join("p") + "/";
+
+function doc(i) {
+    var d = { tenant : tenantPad + (i % 7), path : pathPad + i, i : i };
+    if (i % 97 == 0)
+        d.path = i; // a different type in the middle of the keys
+    if (i % 101 == 0)
+        d.path = { sub : i }; // a key which can't be stored in compact format
+    return d;
+}
+
+function insert(from, to) {
+    for (var i = from; i < to; ++i) {
+        v1.insert(doc(i));
+        v2.insert(doc(i));
+    }
+    db.getLastError();
+}
+
+function index(t, v, key) {
+    t.ensureIndex(key, { v : v });
+    assert.eq(null, db.getLastError());
+}
+
+function checkSame(query, key) {
+    var a = v1.find(query, { _id : 0 }).sort(key).hint(key).toArray();
+    var b = v2.find(query, { _id : 0 }).sort(key).hint(key).toArray();
+    assert.eq(a.length, b.length, "count differs for " + tojson(query));
+    assert.eq(a, b, "results differ for " + tojson(query));
+}
+
+function checkValid() {
+    var res = v2.validate(true);
+    assert(res.valid, "v:2 index invalid " + tojson(res));
+}
+
+var key = { tenant : 1, path : 1 };
+var name = "tenant_1_path_1";
+
+// built bottom up, then added to
+insert(0, 3000);
+index(v1, 1, key);
+index(v2, 2, key);
+insert(3000, 6000);
+
+v2.getIndexes().forEach(function(ix) {
+    if (ix.name == name)
+        assert.eq(2, ix.v);
+});
+checkValid();
+
+checkSame({}, key);
+checkSame({ tenant : tenantPad + 3 }, key);
+checkSame({ tenant : tenantPad + 3, path : { $gt : pathPad + 4000 } }, key);
+checkSame({ tenant : { $gte : tenantPad + 2, $lt : tenantPad + 5 } }, key);
+checkSame({ tenant : tenantPad + 0, path : 0 }, key);
+assert.eq(1, v2.find({ tenant : tenantPad + 5, path : pathPad + 12 }).hint(key).itcount());
+
+var s1 = v1.stats().indexSizes[name];
+var s2 = v2.stats().indexSizes[name];
+assert.lt(s2, s1 * 0.75, "v:2 index isn't smaller: " + s2 + " vs " + s1);
+
+// removes merge and balance buckets whose keys share different prefixes
+for (var i = 0; i < 6000; i += 3) {
+    v1.remove({ i : i });
+    v2.remove({ i : i });
+}
+v1.remove({ i : { $gte : 1000, $lt : 4000 } });
+v2.remove({ i : { $gte : 1000, $lt : 4000 } });
+db.getLastError();
+checkValid();
+checkSame({}, key);
+checkSame({ tenant : tenantPad + 6 }, key);
+
+// and keys go back in between the remaining ones
+insert(6000, 8000);
+for (var i = 1000; i < 4000; i += 2) {
+    v1.insert(doc(i));
+    v2.insert(doc(i));
+}
+db.getLastError();
+checkValid();
+checkSame({}, key);
+checkSame({ tenant : tenantPad + 1, path : { $lt : pathPad + 5 } }, key);
+
+// descending fields compare against the prefix the same way
+var desc = { tenant : 1, path : -1 };
+index(v1, 1, desc);
+index(v2, 2, desc);
+checkSame({ tenant : tenantPad + 4 }, desc);
+
+// reIndex keeps the version
+assert.commandWorked(v2.reIndex());
+v2.getIndexes().forEach(function(ix) {
+    if (ix.name != "_id_")
+        assert.eq(2, ix.v);
+});
+checkValid();
+checkSame({}, key);
+
+// unique v:2 indexes still find duplicates
+v2.drop();
+v2.ensureIndex(key, { v : 2, unique : true });
+insert(0, 500);
+v2.insert(doc(250));
+assert(db.getLastError(), "expected a duplicate key error");
+assert.eq(500, v2.count());
+
+// and v:3 is not a version we build
+v2.ensureIndex({ i : 1 }, { v : 3 });
+assert(db.getLastError(), "built an index of an unknown version");
@@ -0,0 +1,37 @@
+// changes made through subobjects of lazily converted documents must not be lost
+
+t = db.js_lazy_subobj;
+t.drop();
+
+t.save( { _id : 1 , a : { b : { c : 1 } , d : 2 } , e : [ { f : 1 } ] } );
+
+// reading subobjects leaves the document as it was
+db.eval( function() {
+    var o = db.js_lazy_subobj.findOne();
+    var x = o.a.b.c + o.a.d;
+    db.js_lazy_subobj_out.save( o );
+} );
+assert.eq( t.findOne() , db.js_lazy_subobj_out.findOne() , "A" );
+
+// changing a nested field shows in the saved document
+db.eval( function() {
+    var o = db.js_lazy_subobj.findOne();
+    o.a.b.c = 5;
+    db.js_lazy_subobj.save( o );
+} );
+assert.eq( 5 , t.findOne().a.b.c , "B" );
+assert.eq( 2 , t.findOne().a.d , "C" );
+
+// as does one made through a subobject held after its parent is gone
+db.eval( function() {
+    var b = db.js_lazy_subobj.findOne().a.b;
+    var o = { _id : 2 , b : b };
+    b.g = 1;
+    db.js_lazy_subobj.save( o );
+} );
+assert.eq( { c : 5 , g : 1 } , t.findOne( { _id : 2 } ).b , "D" );
+
+// read only objects give back the same subobject each time
+assert.eq( 2 , t.find( function() { return this.a === undefined || this.a.b === this.a.b; } ).count() , "E" );
+
+db.js_lazy_subobj_out.drop();
@@ -0,0 +1,27 @@
+// scopes left by one connection are picked up by the next one, stored functions and all
+
+var admin = db.getSisterDB( "admin" );
+var old = admin.runCommand( { getParameter : 1 , jsPooledScopesPerDb : 1 } ).jsPooledScopesPerDb;
+assert.eq( old , admin.runCommand( { setParameter : 1 , jsPooledScopesPerDb : 2 } ).was , "A" );
+assert.commandFailed( admin.runCommand( { setParameter : 1 , jsPooledScopesPerDb : -1 } ) , "B" );
+
+t = db.js_pooled_scopes;
+t.drop();
+for ( var i = 0; i < 10; i++ )
+    t.save( { x : i } );
+
+db.system.js.remove( { _id : "jsPooledLimit" } );
+db.system.js.save( { _id : "jsPooledLimit" , value : 5 } );
+
+for ( var i = 0; i < 5; i++ ) {
+    var c = new Mongo( db.getMongo().host ).getDB( db.getName() ).js_pooled_scopes;
+    assert.eq( 5 , c.find( function() { return this.x < jsPooledLimit; } ).count() , "C" + i );
+}
+
+// a scope from the pool sees changes to stored functions made since it was last used
+db.system.js.save( { _id : "jsPooledLimit" , value : 3 } );
+var c = new Mongo( db.getMongo().host ).getDB( db.getName() ).js_pooled_scopes;
+assert.eq( 3 , c.find( function() { return this.x < jsPooledLimit; } ).count() , "D" );
+
+db.system.js.remove( { _id : "jsPooledLimit" } );
+admin.runCommand( { setParameter : 1 , jsPooledScopesPerDb : old } );
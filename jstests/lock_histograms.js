@@ -0,0 +1,45 @@
+// serverStatus.locks carries wait and hold time histograms, and lockHolders reports the
+// longest exclusive holds once lockHolderSampling is on.
+
+var t = db.jstests_lock_histograms;
+t.drop();
+
+var admin = db.getSisterDB("admin");
+var was = admin.runCommand({ setParameter : 1, lockHolderSampling : true });
+assert.commandWorked(was);
+
+for (var i = 0; i < 1000; ++i)
+    t.insert({ _id : i });
+db.getLastError();
+t.find().itcount();
+
+var status = db.serverStatus();
+var locks = status.locks;
+assert(locks["."].waitMicros, tojson(locks["."]));
+assert(locks["."].holdMicros, tojson(locks["."]));
+
+// the inserts hold either the global lock or the database's exclusively
+var total = 0;
+for (var l in locks) {
+    var w = locks[l].holdMicros ? locks[l].holdMicros.W : {};
+    for (var b in w)
+        total += w[b];
+}
+assert.gt(total, 0, tojson(locks));
+
+var byOp = status.lockWaitByOp;
+assert(byOp, "no lockWaitByOp in serverStatus");
+var inserts = 0;
+for (var b in byOp.insert)
+    inserts += byOp.insert[b];
+assert.gt(inserts, 0, tojson(byOp));
+
+var res = admin.runCommand({ lockHolders : 1 });
+assert.commandWorked(res);
+assert(res.sampling, tojson(res));
+assert(res.holders instanceof Array, tojson(res));
+for (var i = 0; i + 1 < res.holders.length; ++i)
+    assert.gte(res.holders[i].micros, res.holders[i + 1].micros, tojson(res));
+
+assert.eq(true, admin.runCommand({ getParameter : 1, lockHolderSampling : 1 }).lockHolderSampling);
+admin.runCommand({ setParameter : 1, lockHolderSampling : was.was });
@@ -0,0 +1,35 @@
+// serverStatus().memAccounting counts the memory of the subsystems which grow with load
+
+t = db.mem_accounting;
+t.drop();
+for ( i = 0; i < 1000; i++ )
+    t.insert( { a : i , s : "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxx" } );
+db.getLastError();
+
+function mem() {
+    return db.serverStatus( { memAccounting : 1 } ).memAccounting;
+}
+
+m = mem();
+printjson( m );
+[ "clientCursors" , "cursorBatches" , "mapReduce" , "aggregation" , "writeIntents" ,
+  "connectionStacks" , "top" ].forEach( function( tag ) {
+    assert( m[tag] , "no " + tag );
+    assert( m[tag].bytes >= 0 , tag );
+    assert( m[tag].peakBytes >= m[tag].bytes , tag );
+} );
+assert( m.connectionStacks.bytes > 0 , "this connection has a stack" );
+assert( m.top.bytes > 0 , "top has this collection" );
+
+// an open cursor is counted until it is exhausted
+before = mem().clientCursors.bytes;
+c = t.find().batchSize( 10 );
+c.next();
+assert.lt( before , mem().clientCursors.bytes );
+c.itcount();
+assert.eq( before , mem().clientCursors.bytes );
+
+// so is a $group's state while it runs
+res = t.aggregate( { $group : { _id : "$a" , s : { $push : "$s" } } } );
+assert.eq( 1000 , res.result.length );
+assert.lt( 0 , mem().aggregation.peakBytes );
@@ -0,0 +1,26 @@
+// serverStatus reports how data file mappings are placed in memory, and on linux --hugePages and
+// --numa change it
+
+p = db.serverStatus().mem.placement;
+printjson( p );
+assert( p , "no mem.placement" );
+assert.lt( 0 , p.pageSize );
+assert.eq( "boolean" , typeof p.hugePages );
+assert( p.numa , "no numa policy" );
+
+if ( db.hostInfo().os.type == "Linux" ) {
+    var baseName = "jstests_mem_placement";
+    var port = allocatePorts( 1 )[ 0 ];
+    var m = startMongodEmpty( "--port", port, "--dbpath", "/data/db/" + baseName, "--hugePages", "--numa", "interleave" );
+    // data files are mapped, and placed, as they're made
+    m.getDB( baseName ).t.insert( { a : 1 } );
+    assert.isnull( m.getDB( baseName ).getLastError() );
+
+    p = m.getDB( "admin" ).serverStatus().mem.placement;
+    printjson( p );
+    assert( p.hugePages );
+    assert.eq( "interleave" , p.numa );
+    assert.lte( 1 , p.numaNodes );
+    assert( p.hugePagesOS , "no os huge page setting" );
+    stopMongod( port );
+}
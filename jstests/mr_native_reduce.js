@@ -0,0 +1,49 @@
+// a reduce given as accumulators runs natively, with the same results as the equivalent js
+
+t = db.mr_native_reduce;
+t.drop();
+
+for ( var i = 0; i < 5000; i++ )
+    t.insert( { k : i % 13 , n : i , tag : "t" + ( i % 7 ) } );
+db.getLastError();
+
+function sorted( res ){
+    return res.results.sort( function( a , b ){ return a._id - b._id; } );
+}
+
+// the whole value
+m = function(){ emit( this.k , this.n ); }
+var js = t.mapReduce( m , function( k , vs ){ return Array.sum( vs ); } , { out : { inline : 1 } } );
+var nat = t.mapReduce( m , { $sum : "value" } , { out : { inline : 1 } } );
+assert.eq( sorted( js ) , sorted( nat ) , "sum" );
+
+nat = t.mapReduce( m , { $max : "value" } , { out : { inline : 1 } } );
+sorted( nat ).forEach( function( o ){
+    assert.eq( t.find( { k : o._id } ).sort( { n : -1 } ).limit( 1 ).next().n , o.value , tojson( o ) );
+} );
+
+// one accumulator per field, reduced again on the way to a collection
+m = function(){ emit( this.k , { count : 1 , low : this.n , tags : [ this.tag ] } ); }
+var spec = { count : { $sum : "value.count" } , low : { $min : "value.low" } , tags : { $addToSet : "value.tags" } };
+nat = t.mapReduce( m , spec , { out : "mr_native_reduce_out" } );
+assert( nat.ok , tojson( nat ) );
+db.mr_native_reduce_out.find().forEach( function( o ){
+    assert.eq( t.count( { k : o._id } ) , o.value.count , tojson( o ) );
+    assert.eq( o._id , o.value.low , tojson( o ) );
+    assert.eq( 7 , o.value.tags.length , tojson( o ) );
+} );
+
+// with a js finalize
+nat = t.mapReduce( m , { count : { $sum : "value.count" } } ,
+                   { out : { inline : 1 } , finalize : function( k , v ){ return v.count * 2; } } );
+sorted( nat ).forEach( function( o ){
+    assert.eq( 2 * t.count( { k : o._id } ) , o.value , tojson( o ) );
+} );
+
+// bad specs
+assert.throws( function(){ t.mapReduce( m , { $avg : "value" } , { out : { inline : 1 } } ); } );
+assert.throws( function(){ t.mapReduce( m , { $sum : "n" } , { out : { inline : 1 } } ); } );
+assert.throws( function(){ t.mapReduce( m , { tags : { $push : "value.count" } } , { out : { inline : 1 } } ); } );
+
+db.mr_native_reduce_out.drop();
+t.drop();
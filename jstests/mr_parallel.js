@@ -0,0 +1,50 @@
+// setParameter mapReduceThreads spreads the map phase of a collection scan over several threads;
+// the results are the same as with one
+
+t = db.mr_parallel;
+t.drop();
+
+var pad = new Array( 200 ).join( "x" );
+for ( var i = 0; i < 20000; i++ )
+    t.insert( { k : i % 37 , n : i , pad : pad } );
+db.getLastError();
+assert.lt( 1 , t.stats().numExtents , "need several extents" );
+
+m = function(){ emit( this.k , { count : 1 , sum : this.n } ); }
+r = function( k , vs ){
+    var o = { count : 0 , sum : 0 };
+    vs.forEach( function( v ){ o.count += v.count; o.sum += v.sum; } );
+    return o;
+}
+
+function run( threads , opts ){
+    assert.commandWorked( db.adminCommand( { setParameter : 1 , mapReduceThreads : threads } ) );
+    var res = t.mapReduce( m , r , opts );
+    assert( res.ok , tojson( res ) );
+    return res;
+}
+
+function results( res ){
+    var a = res.results ? res.results : res.find().sort( { _id : 1 } ).toArray();
+    return tojson( a.sort( function( x , y ){ return x._id - y._id; } ) );
+}
+
+[ { out : { inline : 1 } } ,
+  { out : "mr_parallel_out" } ,
+  { out : { inline : 1 } , query : { n : { $gte : 5000 } } } ].forEach( function( opts ){
+    var one = run( 1 , opts );
+    var expected = results( one );
+    var many = run( 4 , opts );
+    assert.eq( expected , results( many ) , tojson( opts ) );
+    assert.eq( one.counts.input , many.counts.input , tojson( opts ) );
+    assert.eq( one.counts.emit , many.counts.emit , tojson( opts ) );
+} );
+
+// a limit needs the documents in order, so is still mapped on one thread
+var res = run( 4 , { out : { inline : 1 } , limit : 100 } );
+assert.eq( 100 , res.counts.input );
+
+assert.commandFailed( db.adminCommand( { setParameter : 1 , mapReduceThreads : 0 } ) );
+db.adminCommand( { setParameter : 1 , mapReduceThreads : 1 } );
+db.mr_parallel_out.drop();
+t.drop();
@@ -0,0 +1,37 @@
+// map/reduce jobs too big for memory spill their emits to sorted run files, not to a collection
+
+t = db.mr_spill;
+t.drop();
+db.mr_spill_out.drop();
+
+// plenty of distinct keys and values, so reduceInMemory can't keep the map small
+var pad = new Array( 100 ).join( "y" );
+for ( var i = 0; i < 30000; i++ )
+    t.insert( { k : i % 10000 , pad : pad + i } );
+db.getLastError();
+
+m = function(){ emit( this.k , { count : 1 , pad : this.pad } ); }
+r = function( k , vs ){
+    var o = { count : 0 , pad : "" };
+    vs.forEach( function( v ){ o.count += v.count; if ( v.pad > o.pad ) o.pad = v.pad; } );
+    return o;
+}
+
+res = t.mapReduce( m , r , { out : "mr_spill_out" } );
+assert( res.ok , tojson( res ) );
+assert.eq( 30000 , res.counts.input );
+assert.eq( 10000 , res.counts.output );
+
+var out = db.mr_spill_out;
+assert.eq( 10000 , out.count() );
+out.find().forEach( function( o ){
+    assert.eq( 3 , o.value.count , tojson( o ) );
+} );
+
+// nothing left behind
+db.getCollectionNames().forEach( function( c ){
+    assert( ! /^tmp\.mr\./.test( c ) , "leftover " + c );
+} );
+
+out.drop();
+t.drop();
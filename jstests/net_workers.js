@@ -0,0 +1,39 @@
+// With --netWorkers a few threads serve many connections, and each connection keeps its own
+// last error and cursors as its messages move between the threads.
+
+var conn = MongoRunner.runMongod({ netWorkers : 2 });
+var testDB = conn.getDB("test");
+testDB.net_workers.drop();
+testDB.net_workers.ensureIndex({ x : 1 }, { unique : true });
+
+var conns = [];
+for (var i = 0; i < 20; ++i)
+    conns.push(new Mongo(conn.host));
+
+// every other connection hits a duplicate key; the rest must not see its error
+for (var pass = 0; pass < 3; ++pass) {
+    for (var i = 0; i < conns.length; ++i) {
+        var db = conns[i].getDB("test");
+        var x = (i % 2 == 0) ? -1 : pass * 100 + i;
+        db.net_workers.insert({ x : x });
+    }
+    for (var i = 0; i < conns.length; ++i) {
+        var err = conns[i].getDB("test").getLastError();
+        if (i % 2 == 0 && (pass > 0 || i > 0))
+            assert(err, "connection " + i + " lost its duplicate key error");
+        else
+            assert.eq(null, err, "connection " + i + " saw an error that isn't its own");
+    }
+}
+
+// a cursor opened on one message is continued by getMores served by any worker
+for (var i = 0; i < 200; ++i)
+    testDB.net_workers.insert({ x : 1000 + i });
+var cursors = [];
+for (var i = 0; i < conns.length; ++i)
+    cursors.push(conns[i].getDB("test").net_workers.find({ x : { $gte : 1000 } }).batchSize(10));
+for (var i = 0; i < conns.length; ++i)
+    assert.eq(200, cursors[i].itcount());
+
+assert.gte(testDB.serverStatus().connections.current, 21);
+MongoRunner.stopMongod(conn);
@@ -0,0 +1,30 @@
+// Servers started with --networkCompression compress large messages on the connections they
+// open to each other, here the one cloneCollection reads through.
+
+var source = MongoRunner.runMongod({ networkCompression : "" });
+var dest = MongoRunner.runMongod({ networkCompression : "" });
+
+var t = source.getDB("test").network_compression;
+t.drop();
+var doc = new Array(2000).join("compress me ");
+for (var i = 0; i < 500; ++i)
+    t.insert({ _id : i, doc : doc });
+source.getDB("test").getLastError();
+
+// the shell doesn't offer compression, so nothing it receives is compressed
+assert.eq(0, source.getDB("admin").serverStatus().network.compression.sent.messages);
+
+var res = dest.getDB("test").runCommand({ cloneCollection : "test.network_compression",
+                                          from : source.host });
+assert.commandWorked(res);
+assert.eq(500, dest.getDB("test").network_compression.count());
+assert.eq(doc, dest.getDB("test").network_compression.findOne({ _id : 7 }).doc);
+
+var sent = source.getDB("admin").serverStatus().network.compression.sent;
+var received = dest.getDB("admin").serverStatus().network.compression.received;
+assert.gt(sent.messages, 0, tojson(sent));
+assert.gt(received.messages, 0, tojson(received));
+assert.lt(received.wireBytes, received.bytes, tojson(received));
+
+MongoRunner.stopMongod(dest);
+MongoRunner.stopMongod(source);
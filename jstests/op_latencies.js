@@ -0,0 +1,33 @@
+// serverStatus keeps latency histograms for each kind of operation, split into its phases.
+
+var t = db.jstests_op_latencies;
+t.drop();
+
+function counts() {
+    return db.serverStatus().opLatencies;
+}
+
+var before = counts();
+assert(before, "no opLatencies in serverStatus");
+
+for (var i = 0; i < 20; ++i) {
+    t.insert({ i : i });
+}
+t.find().itcount();
+t.update({ i : 1 }, { $set : { j : 1 } });
+t.remove({ i : 2 });
+db.getLastError();
+
+var after = counts();
+["query", "insert", "update", "remove", "command"].forEach(function(k) {
+    assert(after[k], "no latencies for " + k + ": " + tojson(after));
+    assert.lt(before[k].count, after[k].count, k);
+    ["queue", "receive", "lockWait", "execute", "write", "total"].forEach(function(p) {
+        assert(after[k][p], "no " + p + " histogram for " + k + ": " + tojson(after[k]));
+    });
+    var n = 0;
+    for (var b in after[k].total) {
+        n += after[k].total[b];
+    }
+    assert.eq(after[k].count, n, k + " total histogram doesn't add up: " + tojson(after[k]));
+});
@@ -1,61 +1,69 @@
+// record padding follows how much updates grow the documents of each size
+
 p = db.getCollection("padding");
 p.drop();
 
+function growth() {
+    return p.stats().recordGrowth;
+}
+
+var small = "aaaaaaaaaaaaaaa";
+var grown = small + small + "aaaaaaa";
+
 for (var i = 0; i < 1000; i++) {
-    p.insert({ x: 1, y: "aaaaaaaaaaaaaaa" });
+    p.insert({ _id: i, x: 1, y: small });
 }
 
 assert(p.stats().paddingFactor == 1);
+assert.eq(0, growth().updates);
 
+// each document grows by a bit less than half, and has to move
 for (var i = 0; i < 1000; i++) {
-    var x = p.findOne();
-    x.y = x.y + "aaaaaaaaaaaaaaaa";
-    p.update({}, x);
-    if (i % 100 == 0)
+    p.update({ _id: i }, { $set: { y: grown } });
+}
+assert.eq(null, db.getLastError());
+
+var g = growth();
+printjson(g);
+assert.eq(1000, g.updates);
+assert.eq(1000, g.moves);
+assert.eq(1, g.moveRate);
+assert.eq(2000, g.indexKeysRewritten, "_id key removed and reinserted for each move");
+var pf = p.stats().paddingFactor;
+assert(pf > 1.3 && pf < 1.6, "padding factor " + pf);
 
-        print(p.stats().paddingFactor);
+// new documents are padded for that, so the same growth fits in place
+for (var i = 1000; i < 2000; i++) {
+    p.insert({ _id: i, x: 1, y: small });
+}
+for (var i = 1000; i < 2000; i++) {
+    p.update({ _id: i }, { $set: { y: grown } });
 }
+assert.eq(null, db.getLastError());
+assert.eq(1000, growth().moves, "padded documents moved");
 
-assert(p.stats().paddingFactor > 1.9);
+// updates that don't grow bring it back down
+for (var i = 0; i < 2000; i++) {
+    p.update({ _id: i }, { $inc: { x: 1 } });
+}
+pf = p.stats().paddingFactor;
+assert(pf < 1.1, "padding factor " + pf);
 
-// this should make it go down
-for (var i = 0; i < 1000; i++) {
-    p.update({}, { $inc: { x: 1} });
-    if (i % 100 == 0)
-        print(p.stats().paddingFactor);
+// larger documents that don't grow aren't padded for the small ones
+var big = new Array(3000).toString();
+for (var i = 2000; i < 2300; i++) {
+    p.insert({ _id: i, x: 1, y: big });
+}
+for (var i = 0; i < 300; i++) {
+    p.update({ _id: i }, { $set: { y: small } });
+    p.update({ _id: i }, { $set: { y: grown } });
 }
-assert(p.stats().paddingFactor < 1.7);
+for (var i = 2000; i < 2300; i++) {
+    p.update({ _id: i }, { $inc: { x: 1 } });
+}
+g = growth();
+printjson(g);
+assert(g.paddingBySize["128"] > 1.1, "small documents not padded");
+assert.eq(1, g.paddingBySize["4096"], "large documents padded");
 
-for (var i = 0; i < 1000; i++) {
-    if (i % 2 == 0) {
-        p.update({}, { $inc: { x: 1} });
-    }
-    else {
-        var x = p.findOne();
-        x.y = x.y + "aaaaaaaaaaaaaaaa";
-        p.update({}, x);
-    }
-    if( i % 100 == 0 )
-        print(p.stats().paddingFactor);
-}
-var ps = p.stats().paddingFactor;
-assert(ps > 1.7 && ps < 1.9);
-
-// 50/50 inserts and nonfitting updates
-for (var i = 0; i < 1000; i++) {
-    if (i % 2 == 0) {
-        p.insert({});
-    }
-    else {
-        var x = p.findOne();
-        x.y = x.y + "aaaaaaaaaaaaaaaa";
-        p.update({}, x);
-    }
-    if (i % 100 == 0)
-        print(p.stats().paddingFactor);
-}
-
-// should have trended somewhat higher over the above. 
-// speed of increase would be higher with more indexes.
-assert(p.stats().paddingFactor > ps + 0.02 , "now: " + p.stats().paddingFactor + " ps: " + ps );
 p.drop();
@@ -0,0 +1,34 @@
+// profile entries are queued and written by a background thread; reads of system.profile
+// flush the queue first, so they see the operations before them
+
+var pdb = db.getSisterDB( "profile_queue" );
+pdb.dropDatabase();
+pdb.foo.insert( { x : 1 } );
+pdb.getLastError();
+
+pdb.setProfilingLevel( 2 );
+
+for ( var i = 0; i < 50; i++ )
+    pdb.foo.findOne( { x : i } );
+
+assert.eq( 50 , pdb.system.profile.count( { op : "query" , ns : "profile_queue.foo" } ) ,
+           "queued entries should be written before a read of system.profile" );
+assert( pdb.system.profile.find( { ns : "profile_queue.foo" } ).sort( { $natural : -1 } ).next().query ,
+        "entry should keep the query" );
+
+var s = db.serverStatus().profiler;
+printjson( s );
+assert( s.queued >= 50 , "profiler.queued" );
+assert( s.written >= 50 , "profiler.written" );
+
+pdb.setProfilingLevel( 0 );
+
+// the background thread writes entries nobody asks for
+var before = db.serverStatus().profiler.written;
+pdb.setProfilingLevel( 2 );
+pdb.foo.findOne();
+assert.soon( function() { return db.serverStatus().profiler.written > before; } ,
+             "profileWriter should flush on its own" );
+pdb.setProfilingLevel( 0 );
+
+pdb.dropDatabase();
@@ -0,0 +1,75 @@
+// Collections with cacheQueryResults set answer repeated queries from a cache of replies, which
+// any write to the collection empties.
+
+var t = db.jstests_query_result_cache;
+t.drop();
+
+for (var i = 0; i < 100; ++i)
+    t.insert({ _id : i, a : i % 10, b : 0 });
+db.getLastError();
+
+function hits() {
+    return db.serverStatus().queryResultCache.hits;
+}
+
+function checkHit(hit, cursor, expected) {
+    var before = hits();
+    assert.eq(expected, cursor.toArray());
+    assert.eq(before + (hit ? 1 : 0), hits());
+}
+
+function checkQuery(hit, query, fields) {
+    var expected = t.find(query, fields).hint({ $natural : 1 }).toArray();
+    checkHit(hit, t.find(query, fields), expected);
+}
+
+// not cached until the collection is flagged
+checkQuery(false, { a : 1 });
+checkQuery(false, { a : 1 });
+
+assert.commandWorked(db.runCommand({ collMod : t.getName(), cacheQueryResults : true }));
+checkQuery(false, { a : 1 });
+checkQuery(true, { a : 1 });
+checkQuery(true, { a : 1 });
+assert.eq(2, t.stats().queryResultCache.entries); // with the $natural query
+
+// the fields, sort, skip and limit are part of the key
+checkQuery(false, { a : 1 }, { b : 1 });
+checkQuery(true, { a : 1 }, { b : 1 });
+function docs(ids) {
+    return ids.map(function(id) { return { _id : id, a : 2, b : 0 }; });
+}
+checkHit(false, t.find({ a : 2 }).sort({ _id : -1 }).skip(2).limit(-3), docs([ 72, 62, 52 ]));
+checkHit(true, t.find({ a : 2 }).sort({ _id : -1 }).skip(2).limit(-3), docs([ 72, 62, 52 ]));
+checkHit(false, t.find({ a : 2 }).sort({ _id : 1 }).skip(2).limit(-3), docs([ 22, 32, 42 ]));
+
+// every kind of write empties the cache
+t.insert({ _id : 100, a : 1 });
+db.getLastError();
+checkQuery(false, { a : 1 });
+checkQuery(true, { a : 1 });
+t.update({ _id : 11 }, { $inc : { b : 1 } }); // in place
+db.getLastError();
+checkQuery(false, { a : 1 });
+t.update({ _id : 21 }, { a : 1, b : "a longer value than fits in the old record" });
+db.getLastError();
+checkQuery(false, { a : 1 });
+t.remove({ _id : 31 });
+db.getLastError();
+checkQuery(false, { a : 1 });
+checkQuery(true, { a : 1 });
+assert.eq(10, t.find({ a : 1 }).itcount());
+
+// replies leaving a cursor open, and explains, are not cached
+var all = t.find().hint({ $natural : 1 }).toArray();
+checkHit(false, t.find().batchSize(5), all);
+checkHit(false, t.find().batchSize(5), all);
+var before = hits();
+t.find({ a : 1 }).explain();
+t.find({ a : 1 }).explain();
+assert.eq(before, hits());
+
+// and clearing the flag stops caching
+assert.commandWorked(db.runCommand({ collMod : t.getName(), cacheQueryResults : false }));
+checkQuery(false, { a : 1 });
+assert.eq(undefined, t.stats().queryResultCache);
@@ -0,0 +1,55 @@
+// a collection created with recordChecksums keeps each document's checksum up to date through
+// inserts, in place updates, moves and compact, which validate checksums:true and sampled reads check
+
+t = db.record_checksums;
+t.drop();
+assert.commandWorked( db.createCollection( t.getName() , { recordChecksums : true } ) );
+
+function checkAll( n ) {
+    var res = db.runCommand( { validate : t.getName() , checksums : true , threads : 3 } );
+    assert.commandWorked( res );
+    assert( res.valid , tojson( res ) );
+    assert.eq( n , res.checked , tojson( res ) );
+    assert.eq( 0 , res.bad , tojson( res ) );
+    assert.eq( 0 , res.noChecksum , tojson( res ) );
+}
+
+for ( i = 0; i < 1000; i++ )
+    t.insert( { _id : i , a : i , b : "x" , c : [ 1 , 2 ] } );
+assert.isnull( db.getLastError() );
+checkAll( 1000 );
+
+// a lone $inc, several mods in place, one by _id, and growing ones that move the document
+t.update( {} , { $inc : { a : 1 } } , false , true );
+t.update( {} , { $inc : { a : 1 } , $set : { b : "y" } } , false , true );
+t.update( { _id : 7 } , { $set : { b : "z" } } );
+t.update( { _id : { $lt : 100 } } , { $set : { b : new Array( 500 ).join( "g" ) } } , false , true );
+t.update( { _id : 5 } , { _id : 5 , replaced : true } );
+assert.isnull( db.getLastError() );
+checkAll( 1000 );
+assert.eq( 3 , t.findOne( { _id : 500 } ).a );
+
+t.remove( { _id : { $gte : 900 } } );
+assert.commandWorked( db.runCommand( { compact : t.getName() } ) );
+checkAll( 900 );
+
+// every read checked
+admin = db.getSisterDB( "admin" );
+was = admin.runCommand( { setParameter : 1 , recordChecksumSampleRate : 1 } ).was;
+before = db.serverStatus().recordChecksums;
+assert.eq( 900 , t.find().itcount() );
+after = db.serverStatus().recordChecksums;
+assert.lte( 900 , after.sampled - before.sampled );
+assert.eq( before.sampledBad , after.sampledBad );
+admin.runCommand( { setParameter : 1 , recordChecksumSampleRate : was } );
+
+// not for capped collections, and a collection without them can't be checked for them
+db.record_checksums_capped.drop();
+assert.commandFailed( db.createCollection( "record_checksums_capped" , { capped : true , size : 4096 , recordChecksums : true } ) );
+db.record_checksums_none.drop();
+db.record_checksums_none.insert( { a : 1 } );
+assert.commandFailed( db.runCommand( { validate : "record_checksums_none" , checksums : true } ) );
+assert.commandFailed( db.runCommand( { validate : t.getName() , checksums : true , threads : 0 } ) );
+
+t.drop();
+db.record_checksums_none.drop();
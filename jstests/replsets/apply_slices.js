@@ -0,0 +1,40 @@
+// setParameter replApplySliceOps applies big batches in slices, letting reads onto a secondary
+// in between them.  whatever a reader sees is a prefix of the primary's writes.
+
+var replTest = new ReplSetTest( { name : "apply_slices" , nodes : 2 } );
+replTest.startSet();
+replTest.initiate();
+
+var master = replTest.getMaster();
+var slave = replTest.getSecondaries()[0];
+slave.setSlaveOk();
+
+var res = slave.adminCommand( { setParameter : 1 , replApplySliceOps : 10 } );
+assert.commandWorked( res );
+assert.eq( 0 , res.was );
+assert.eq( 10 , slave.adminCommand( { getParameter : 1 , replApplySliceOps : 1 } ).replApplySliceOps );
+assert.commandFailed( slave.adminCommand( { setParameter : 1 , replApplySliceOps : -1 } ) );
+
+var db = master.getDB( "test" );
+db.foo.insert( { _id : "n" , n : 0 } );
+replTest.awaitReplication();
+
+// each update bumps n and inserts the document for it, so a reader who sees n = k must also
+// see the k documents inserted before
+for ( var i = 1; i <= 2000; i++ ) {
+    db.foo.insert( { _id : i } );
+    db.foo.update( { _id : "n" } , { $set : { n : i } } );
+}
+db.getLastError();
+
+var sdb = slave.getDB( "test" );
+assert.soon( function() {
+    var n = sdb.foo.findOne( { _id : "n" } ).n;
+    assert.lte( n , sdb.foo.count() - 1 , "saw n before the inserts preceding it" );
+    return n == 2000;
+} );
+
+replTest.awaitReplication();
+assert.eq( 2001 , sdb.foo.count() );
+
+replTest.stopSet();
@@ -0,0 +1,39 @@
+// a member's initial sync clones several collections at once, building their secondary indexes
+// after the data, and clears its progress in local when done
+
+var basename = "initial_sync_parallel";
+var replTest = new ReplSetTest( { name : basename , nodes : 1 } );
+replTest.startSet();
+replTest.initiate();
+
+var master = replTest.getMaster();
+for ( var d = 0; d < 2; d++ ) {
+    var db = master.getDB( "d" + d );
+    for ( var c = 0; c < 5; c++ ) {
+        var coll = db["c" + c];
+        for ( var i = 0; i < 1000; i++ )
+            coll.insert( { _id : i , a : i % 17 , b : "x" + i } );
+        coll.ensureIndex( { a : 1 } );
+        coll.ensureIndex( { b : 1 , a : -1 } );
+    }
+    db.getLastError();
+}
+
+var member = replTest.add();
+replTest.reInitiate();
+replTest.awaitSecondaryNodes();
+replTest.awaitReplication();
+
+member.setSlaveOk();
+for ( var d = 0; d < 2; d++ ) {
+    for ( var c = 0; c < 5; c++ ) {
+        var coll = member.getDB( "d" + d )["c" + c];
+        assert.eq( 1000 , coll.count() , coll.getFullName() );
+        assert.eq( 3 , coll.getIndexes().length , coll.getFullName() );
+        assert.eq( 59 , coll.find( { a : 3 } ).hint( { a : 1 } ).itcount() , coll.getFullName() );
+    }
+}
+
+assert.eq( 0 , member.getDB( "local" ).replset.initialSync.count() );
+
+replTest.stopSet();
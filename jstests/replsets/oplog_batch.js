@@ -0,0 +1,43 @@
+// a primary logs the documents of a multi-insert and a multi-update as a batch: one oplog entry
+// per document, in order, with distinct times, which secondaries apply as usual
+
+var basename = "oplog_batch";
+var replTest = new ReplSetTest( { name : basename , nodes : 2 } );
+replTest.startSet();
+replTest.initiate();
+
+var master = replTest.getMaster();
+var coll = master.getDB( "test" ).batched;
+var docs = [];
+for ( var i = 0; i < 2000; i++ )
+    docs.push( { _id : i , x : i % 10 , s : "abcdefghij" } );
+coll.insert( docs );
+assert.isnull( master.getDB( "test" ).getLastError() );
+
+coll.update( { x : 3 } , { $inc : { y : 1 } } , false , true );
+assert.isnull( master.getDB( "test" ).getLastError() );
+coll.remove( { x : 9 } );
+master.getDB( "test" ).getLastError();
+
+function tsLess( a , b ) {
+    return a.t < b.t || ( a.t == b.t && a.i < b.i );
+}
+
+var oplog = master.getDB( "local" ).oplog.rs;
+var inserts = oplog.find( { ns : "test.batched" , op : "i" } ).sort( { $natural : 1 } ).toArray();
+assert.eq( 2000 , inserts.length );
+for ( var i = 0; i < inserts.length; i++ ) {
+    assert.eq( i , inserts[i].o._id );
+    if ( i > 0 )
+        assert( tsLess( inserts[i - 1].ts , inserts[i].ts ) , "ts out of order at " + i );
+}
+assert.eq( 200 , oplog.find( { ns : "test.batched" , op : "u" } ).itcount() );
+
+replTest.awaitReplication();
+var slave = replTest.liveNodes.slaves[0];
+slave.setSlaveOk();
+var scoll = slave.getDB( "test" ).batched;
+assert.eq( 1800 , scoll.count() );
+assert.eq( 200 , scoll.find( { y : 1 } ).count() );
+
+replTest.stopSet();
@@ -0,0 +1,47 @@
+// setParameter oplogCompression stores the o: of large oplog entries compressed; readers of the
+// oplog, secondaries included, get the entries back as they were logged
+
+var replTest = new ReplSetTest( { name : "oplog_compression" , nodes : 2 } );
+replTest.startSet();
+replTest.initiate();
+
+var master = replTest.getMaster();
+replTest.getSecondaries().concat( [ master ] ).forEach( function( node ) {
+    assert.commandWorked( node.adminCommand( { setParameter : 1 , oplogCompression : true } ) );
+} );
+
+var db = master.getDB( "test" );
+var oplog = master.getDB( "local" ).oplog.rs;
+var big = new Array( 10 * 1024 ).join( "z" );
+
+var sizeBefore = oplog.stats().size;
+for ( var i = 0; i < 100; i++ )
+    db.foo.insert( { _id : i , s : big } );
+db.foo.update( { _id : 0 } , { $set : { s : big + "y" } } );
+assert.isnull( db.getLastError( 2 ) );
+
+// the entries take much less room than the documents they carry
+assert.lt( oplog.stats().size - sizeBefore , 100 * big.length / 4 );
+
+var inserts = oplog.find( { ns : "test.foo" , op : "i" } ).sort( { $natural : 1 } ).toArray();
+assert.eq( 100 , inserts.length );
+inserts.forEach( function( e , i ) {
+    assert( !e.oz , "compressed entry returned: " + e._id );
+    assert.eq( { _id : i , s : big } , e.o );
+} );
+var u = oplog.findOne( { ns : "test.foo" , op : "u" } );
+assert.eq( { _id : 0 } , u.o2 );
+assert.eq( big + "y" , u.o.$set.s );
+
+// fields other than o: can still be matched, and tailing from a ts works
+assert.eq( 100 , oplog.find( { ns : "test.foo" , op : "i" , ts : { $gte : inserts[0].ts } } ).itcount() );
+
+replTest.awaitReplication();
+var slave = replTest.getSecondaries()[0];
+slave.setSlaveOk();
+assert.eq( 100 , slave.getDB( "test" ).foo.count() );
+assert.eq( big + "y" , slave.getDB( "test" ).foo.findOne( { _id : 0 } ).s );
+var slaveOplog = slave.getDB( "local" ).oplog.rs;
+assert.eq( { _id : 99 , s : big } , slaveOplog.find( { ns : "test.foo" , op : "i" } ).sort( { $natural : -1 } ).next().o );
+
+replTest.stopSet();
@@ -0,0 +1,40 @@
+// setParameter oplogPreImages logs the document an update or delete replaced, for rollback to
+// restore without refetching; secondaries apply such entries as usual
+
+var replTest = new ReplSetTest( { name : "oplog_preimages" , nodes : 2 } );
+replTest.startSet();
+replTest.initiate();
+
+var master = replTest.getMaster();
+var db = master.getDB( "test" );
+var oplog = master.getDB( "local" ).oplog.rs;
+
+db.foo.insert( { _id : 1 , x : 1 } );
+db.foo.insert( { _id : 2 , x : 2 } );
+db.foo.update( { _id : 1 } , { $inc : { x : 1 } } );
+db.getLastError();
+assert( !oplog.findOne( { ns : "test.foo" , op : "u" } ).pre , "pre-image logged while off" );
+
+assert.commandWorked( master.adminCommand( { setParameter : 1 , oplogPreImages : true } ) );
+assert.eq( true , master.adminCommand( { getParameter : 1 , oplogPreImages : 1 } ).oplogPreImages );
+
+db.foo.update( { _id : 1 } , { $set : { y : "a" } } );
+db.foo.update( { _id : 2 } , { x : 20 } );
+db.foo.remove( { _id : 2 } );
+assert.isnull( db.getLastError() );
+
+var ops = oplog.find( { ns : "test.foo" } ).sort( { $natural : -1 } ).limit( 3 ).toArray().reverse();
+assert.eq( "u" , ops[0].op );
+assert.eq( { _id : 1 , x : 2 } , ops[0].pre );
+assert.eq( "u" , ops[1].op );
+assert.eq( { _id : 2 , x : 2 } , ops[1].pre );
+assert.eq( "d" , ops[2].op );
+assert.eq( { _id : 2 , x : 20 } , ops[2].pre );
+
+replTest.awaitReplication();
+var slave = replTest.liveNodes.slaves[0];
+slave.setSlaveOk();
+assert.eq( { _id : 1 , x : 2 , y : "a" } , slave.getDB( "test" ).foo.findOne( { _id : 1 } ) );
+assert.eq( 1 , slave.getDB( "test" ).foo.count() );
+
+replTest.stopSet();
@@ -0,0 +1,29 @@
+// replSetGetStatus reports the ping, lag and fetch throughput each member is scored on as a
+// sync source
+
+var basename = "sync_source_cost";
+var replTest = new ReplSetTest( { name : basename , nodes : 3 } );
+replTest.startSet( { oplogSize : 50 } );
+replTest.initiate();
+
+var master = replTest.getMaster();
+var coll = master.getDB( "test" ).foo;
+var big = new Array( 16 * 1024 ).join( "x" );
+for ( var i = 0; i < 200; i++ )
+    coll.insert( { _id : i , s : big } );
+master.getDB( "test" ).getLastError( 3 , 60000 );
+
+var slave = replTest.liveNodes.slaves[0];
+var status = slave.getDB( "admin" ).runCommand( { replSetGetStatus : 1 } );
+assert( status.ok , tojson( status ) );
+
+var others = status.members.filter( function( m ) { return !m.self; } );
+assert.eq( 2 , others.length );
+others.forEach( function( m ) {
+    assert( m.syncSourceCost , "no syncSourceCost for " + m.name + ": " + tojson( status ) );
+    assert.eq( m.pingMs , m.syncSourceCost.pingMs );
+    assert( m.syncSourceCost.lagSecs >= 0 );
+    assert( m.syncSourceCost.cost >= m.syncSourceCost.pingMs );
+} );
+
+replTest.stopSet();
@@ -0,0 +1,23 @@
+// Query and getMore replies reuse the buffer of the connection's previous reply.
+
+var t = db.jstests_reply_buffers;
+t.drop();
+
+var big = new Array(10000).join("x");
+for (var i = 0; i < 500; ++i)
+    t.insert({ _id : i, big : big });
+db.getLastError();
+
+var before = db.serverStatus().replyBuffers;
+assert(before, "no replyBuffers section in serverStatus");
+
+// each getMore builds its reply into the buffer the last one sent
+for (var pass = 0; pass < 3; ++pass) {
+    var n = 0;
+    t.find().batchSize(50).forEach(function(d) { assert.eq(big, d.big); ++n; });
+    assert.eq(500, n);
+}
+
+var after = db.serverStatus().replyBuffers;
+assert.gt(after.reused, before.reused, tojson(after));
+assert.lte(after.pooledBytes, 128 * 1024 * 1024);
@@ -0,0 +1,31 @@
+// sampleCpu attributes cpu samples to the op and namespace each thread was running
+
+t = db.sample_cpu;
+t.drop();
+for ( var i = 0; i < 1000; i++ )
+    t.insert( { x : i } );
+db.getLastError();
+
+// keep a query burning cpu while the sampler runs
+var load = startParallelShell( "var end = new Date().getTime() + 4000;" +
+                               "while ( new Date().getTime() < end )" +
+                               "    db.sample_cpu.find( { $where : 'for ( var i = 0; i < 100; i++ ) {} return true;' } ).itcount();" );
+
+res = db.adminCommand( { sampleCpu : 1 , seconds : 2 , hz : 200 , stacks : 2 } );
+load();
+
+if ( ! res.ok && /not supported/.test( res.errmsg ) ) {
+    print( "sampleCpu not supported here, skipping" );
+}
+else {
+    assert.commandWorked( res );
+    printjson( res.byOp.slice( 0 , 3 ) );
+    assert.lt( 0 , res.samples );
+    var mine = res.byOp.filter( function( g ) { return g.ns == t.getFullName(); } );
+    assert.lt( 0 , mine.length , "no samples for " + t.getFullName() );
+    assert( mine[0].op == "query" || mine[0].op == "getmore" , mine[0].op );
+    assert.lt( 0 , mine[0].stacks.length );
+    assert.lt( 0 , mine[0].stacks[0].frames.length );
+
+    assert.commandFailed( db.adminCommand( { sampleCpu : 1 , seconds : 120 } ) );
+}
@@ -0,0 +1,26 @@
+// serverStatus with a sections array generates only the sections named, and the histograms
+// mongostat --latencies reads are there when asked for.
+
+var full = db.adminCommand({ serverStatus : 1 });
+assert(full.ok, tojson(full));
+assert(full.opcounters && full.mem && full.locks && full.backgroundFlushing, tojson(full));
+
+var some = db.adminCommand({ serverStatus : 1, sections : ["opcounters", "opLatencies", "backgroundFlushing"] });
+assert(some.ok, tojson(some));
+assert(some.host && some.uptime !== undefined && some.localTime, "basic fields: " + tojson(some));
+assert(some.opcounters && some.opLatencies, tojson(some));
+assert(some.backgroundFlushing.latencies, "flush histogram: " + tojson(some.backgroundFlushing));
+["mem", "locks", "globalLock", "extra_info", "cursors", "network", "asserts", "dur"].forEach(function(s) {
+    assert.eq(undefined, some[s], s + " wasn't asked for");
+});
+
+var none = db.adminCommand({ serverStatus : 1, sections : [] });
+assert(none.ok, tojson(none));
+assert.eq(undefined, none.opcounters, tojson(none));
+
+if (full.dur) {
+    var dur = db.adminCommand({ serverStatus : 1, sections : ["dur"] }).dur;
+    ["prepLogBuffer", "writeToJournal", "writeToDataFiles", "remapPrivateView"].forEach(function(p) {
+        assert(dur.latencies[p], "no " + p + " histogram: " + tojson(dur));
+    });
+}
@@ -7,3 +7,33 @@ now = db.adminCommand( { "getParameter" : "*" } )
 assert.eq( old , now , "A" )
 assert.eq( old.logLevel , tmp1.was , "B" )
 assert.eq( 5 , tmp2.was , "C" )
+
+// replication prefetch settings are checked before they are changed; mongod only
+if ( db.isMaster().msg != "isdbgrid" ) {
+    old = db.adminCommand( { "getParameter" : 1 , "replIndexPrefetch" : 1 , "replPrefetchDepth" : 1 } )
+    assert.commandWorked( old , "D" )
+
+    tmp1 = db.adminCommand( { "setParameter" : 1 , "replIndexPrefetch" : "_id_only" } )
+    assert.commandWorked( tmp1 , "E" )
+    assert.eq( old.replIndexPrefetch , tmp1.was , "F" )
+    assert.eq( "_id_only" , db.adminCommand( { "getParameter" : 1 , "replIndexPrefetch" : 1 } ).replIndexPrefetch , "G" )
+
+    [ "bogus" , "ALL" , "" , 1 , true , null ].forEach( function( v ) {
+        assert.commandFailed( db.adminCommand( { "setParameter" : 1 , "replIndexPrefetch" : v } ) , "H " + tojson( v ) )
+    } )
+    assert.eq( "_id_only" , db.adminCommand( { "getParameter" : 1 , "replIndexPrefetch" : 1 } ).replIndexPrefetch , "I" )
+
+    tmp2 = db.adminCommand( { "setParameter" : 1 , "replPrefetchDepth" : 10 } )
+    assert.commandWorked( tmp2 , "J" )
+    assert.eq( old.replPrefetchDepth , tmp2.was , "K" )
+
+    [ -1 , 100001 , "10" , true ].forEach( function( v ) {
+        assert.commandFailed( db.adminCommand( { "setParameter" : 1 , "replPrefetchDepth" : v } ) , "L " + tojson( v ) )
+    } )
+    assert.eq( 10 , db.adminCommand( { "getParameter" : 1 , "replPrefetchDepth" : 1 } ).replPrefetchDepth , "M" )
+
+    db.adminCommand( { "setParameter" : 1 , "replIndexPrefetch" : old.replIndexPrefetch } )
+    db.adminCommand( { "setParameter" : 1 , "replPrefetchDepth" : old.replPrefetchDepth } )
+    now = db.adminCommand( { "getParameter" : 1 , "replIndexPrefetch" : 1 , "replPrefetchDepth" : 1 } )
+    assert.eq( old , now , "N" )
+}
@@ -0,0 +1,50 @@
+// mongos returns aggregate output through a cursor, merging what the shards hand it as it goes
+
+s = new ShardingTest( { name : "aggregation_cursor" , shards : 2 , mongos : 1 } );
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { _id : 1 } } );
+s.stopBalancer();
+
+db = s.getDB( "test" );
+var N = 2000;
+var bigStr = new Array( 1001 ).join( "x" );
+for ( var i = 0; i < N; i++ )
+    db.foo.insert( { _id : i , a : i % 20 , s : bigStr } );
+db.unsharded.insert( db.foo.find( { _id : { $lt : 100 } } ).toArray() );
+db.getLastError();
+
+s.adminCommand( { split : "test.foo" , middle : { _id : N / 2 } } );
+s.adminCommand( { movechunk : "test.foo" , find : { _id : 0 } , to : "shard0000" } );
+s.adminCommand( { movechunk : "test.foo" , find : { _id : N - 1 } , to : "shard0001" } );
+
+function ids( c ) {
+    return c.map( function( o ) { return o._id; } ).sort( function( x , y ) { return x - y; } );
+}
+
+function range( n ) {
+    var a = [];
+    for ( var i = 0; i < n; i++ )
+        a.push( i );
+    return a;
+}
+
+// more than fits in one reply, from both shards
+assert.eq( range( N ) , ids( db.foo.aggregateCursor( [ { $match : {} } ] ) ) );
+assert.eq( range( N ) , ids( db.foo.aggregateCursor( [ { $project : { a : 1 } } ] , 5 ) ) );
+assert.eq( range( N ) , ids( db.foo.aggregateCursor( [ { $sort : { _id : 1 } } ] , 0 ) ) );
+
+// merged by _id
+var res = db.foo.aggregateCursor( [ { $group : { _id : "$a" , n : { $sum : 1 } } } ] , 3 ).toArray();
+assert.eq( 20 , res.length );
+res.forEach( function( o ) { assert.eq( N / 20 , o.n , tojson( o ) ); } );
+
+// the same as without a cursor
+var pipeline = [ { $match : { a : { $lt : 3 } } } , { $project : { a : 1 } } , { $sort : { _id : -1 } } ,
+                 { $limit : 50 } ];
+assert.eq( db.foo.aggregate( pipeline ).result , db.foo.aggregateCursor( pipeline , 7 ).toArray() );
+
+// an unsharded collection is passed through to its shard
+assert.eq( range( 100 ) , ids( db.unsharded.aggregateCursor( [ { $match : {} } ] , 10 ) ) );
+
+s.stop();
@@ -0,0 +1,21 @@
+// $out through mongos:  passed through for an unsharded collection, refused for a sharded one
+
+s = new ShardingTest( { name : "aggregation_out" , shards : 2 , mongos : 1 } );
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { _id : 1 } } );
+
+db = s.getDB( "test" );
+for ( var i = 0; i < 100; i++ ) {
+    db.foo.insert( { _id : i , a : i % 4 } );
+    db.unsharded.insert( { _id : i , a : i % 4 } );
+}
+db.getLastError();
+
+assert.commandWorked( db.unsharded.aggregate( { $match : { a : 1 } } , { $out : "out" } ) );
+assert.eq( 25 , db.out.count() );
+
+assert.commandFailed( db.foo.aggregate( { $match : { a : 1 } } , { $out : "out" } ) );
+assert.eq( 25 , db.out.count() );
+
+s.stop();
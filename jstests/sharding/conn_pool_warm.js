@@ -0,0 +1,30 @@
+// mongos can keep connections ready to each host and limit how many it makes to one at once
+
+s = new ShardingTest( { name : "conn_pool_warm" , shards : 2 , mongos : 1 ,
+                        other : { mongosOptions : { connPoolMinPerHost : 2 , connPoolMaxConnecting : 1 } } } );
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { x : 1 } } );
+
+db = s.getDB( "test" );
+for ( var i = 0; i < 100; i++ )
+    db.foo.insert( { x : i } );
+db.getLastError();
+assert.eq( 100 , db.foo.find().itcount() );
+
+var stats = s.getDB( "admin" ).runCommand( "connPoolStats" );
+assert( stats.ok , tojson( stats ) );
+var hosts = 0;
+for ( var h in stats.hosts ) {
+    if ( h == "createdByType" )
+        continue;
+    var p = stats.hosts[h];
+    assert.eq( 0 , p.connecting , "connections left connecting to " + h + ": " + tojson( p ) );
+    assert.lte( 0 , p.waits , tojson( p ) );
+    assert.lte( 0 , p.waitMicros , tojson( p ) );
+    assert.lte( 0 , p.warmed , tojson( p ) );
+    hosts++;
+}
+assert.lt( 0 , hosts , tojson( stats ) );
+
+s.stop();
@@ -0,0 +1,27 @@
+// distinct on a sharded collection merges the shards' values into one sorted, duplicate free list
+
+s = new ShardingTest( { name : "distinct_merge" , shards : 2 , mongos : 1 } );
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { x : 1 } } );
+s.stopBalancer();
+
+db = s.getDB( "test" );
+for ( var i = 0; i < 200; i++ )
+    db.foo.insert( { x : i , y : i % 10 , z : [ i % 3 , "s" + ( i % 2 ) ] } );
+db.foo.insert( { x : 1000 , y : 4.0 } );
+db.foo.insert( { x : 1001 } );
+db.getLastError();
+
+s.adminCommand( { split : "test.foo" , middle : { x : 100 } } );
+var from = s.getServer( "test" );
+var to = s.getOther( from );
+assert.commandWorked( s.adminCommand( { movechunk : "test.foo" , find : { x : 150 } , to : to.name } ) );
+
+// every shard has every value of y, and equal numbers are one value
+assert.eq( [ 0 , 1 , 2 , 3 , 4 , 5 , 6 , 7 , 8 , 9 ] , db.foo.distinct( "y" ) );
+assert.eq( [ 0 , 1 , 2 , "s0" , "s1" ] , db.foo.distinct( "z" ) );
+assert.eq( [ 3 , 4 , 5 ] , db.foo.distinct( "y" , { x : { $gte : 93 , $lt : 106 } , y : { $gte : 3 , $lte : 5 } } ) );
+assert.eq( [ ] , db.foo.distinct( "nothere" ) );
+
+s.stop();
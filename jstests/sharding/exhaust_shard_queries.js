@@ -0,0 +1,38 @@
+// with --exhaustShardQueries mongos has shards stream the batches of its queries
+
+s = new ShardingTest( { name : "exhaust_shard_queries" , shards : 2 , mongos : 1 ,
+                        other : { mongosOptions : { exhaustShardQueries : "" } } } );
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { x : 1 } } );
+s.adminCommand( { split : "test.foo" , middle : { x : 5000 } } );
+s.adminCommand( { movechunk : "test.foo" , find : { x : 5000 } , to : s.getOther( s.getServer( "test" ) ).name } );
+
+db = s.getDB( "test" );
+
+var big = new Array( 1024 ).toString();
+for ( var i = 0; i < 10000; i++ )
+    db.foo.insert( { x : i , big : big } );
+db.getLastError();
+
+// several batches from each shard, merged both unsorted and sorted
+assert.eq( 10000 , db.foo.find().itcount() , "unsorted" );
+var last = -1;
+db.foo.find().sort( { x : 1 } ).forEach( function( o ) {
+    assert.eq( last + 1 , o.x , "sorted" );
+    last = o.x;
+} );
+assert.eq( 9999 , last );
+
+// dropping cursors part way through leaves the connections to the shards usable
+for ( var i = 0; i < 10; i++ ) {
+    var c = db.foo.find();
+    for ( var j = 0; j < 150; j++ )
+        c.next();
+    c = null;
+    gc();
+}
+assert.eq( 10000 , db.foo.find().itcount() , "after abandoned cursors" );
+assert.eq( 10000 , db.foo.count() );
+
+s.stop();
@@ -0,0 +1,36 @@
+// slaveOk reads through a mongos started with --hedgedReads give the same answers, and a read
+// slower than the set's recent reads is sent to the other secondary as well
+
+var st = new ShardingTest( { name : "hedged_reads" , shards : 1 , mongos : 1 ,
+                             rs : { nodes : 3 , oplogSize : 10 } ,
+                             other : { mongosOptions : { hedgedReads : "" } } } );
+
+var mongos = st.s;
+var replTest = st.rs0;
+var coll = mongos.getDB( "test" ).foo;
+
+for ( var i = 0; i < 100; i++ )
+    coll.insert( { _id : i , x : i % 10 } );
+coll.getDB().runCommand( { getLastError : 1 , w : replTest.nodes.length } );
+
+ReplSetTest.awaitRSClientHosts( mongos , replTest.getSecondaries() , { ok : true , secondary : true } );
+coll.setSlaveOk( true );
+
+var hedged = function() { return mongos.getDB( "admin" ).serverStatus().hedgedReads; };
+assert( hedged().enabled );
+
+for ( var i = 0; i < 50; i++ ) {
+    assert.eq( i % 10 , coll.findOne( { _id : i } ).x );
+    assert.eq( 10 , coll.find( { x : i % 10 } ).itcount() );
+}
+assert( hedged().hedgeable > 0 , tojson( hedged() ) );
+
+// far slower than anything before, so each waits past the hedge delay
+for ( var i = 0; i < 3; i++ )
+    assert.eq( 10 , coll.find( { x : 1 , $where : "sleep( 50 ); return true;" } ).itcount() );
+
+var stats = hedged();
+printjson( stats );
+assert( stats.hedged > 0 , "nothing hedged" );
+
+st.stop();
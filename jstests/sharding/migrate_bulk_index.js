@@ -0,0 +1,36 @@
+// a shard receiving its first chunk of a collection builds the secondary indexes after the clone
+
+s = new ShardingTest( { name : "migrate_bulk_index" , shards : 2 , mongos : 1 } );
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { x : 1 } } );
+
+db = s.getDB( "test" );
+db.foo.ensureIndex( { y : 1 } );
+db.foo.ensureIndex( { z : 1 } , { unique : true } );
+for ( var i = 0; i < 2000; i++ )
+    db.foo.insert( { x : i , y : i % 10 , z : i } );
+db.getLastError();
+
+s.adminCommand( { split : "test.foo" , middle : { x : 1000 } } );
+
+var from = s.getServer( "test" );
+var to = s.getOther( from );
+assert.eq( 0 , to.getDB( "test" ).foo.count() );
+
+assert.commandWorked( s.adminCommand( { movechunk : "test.foo" , find : { x : 1500 } , to : to.name } ) );
+
+var t = to.getDB( "test" ).foo;
+assert.eq( 1000 , t.count() );
+assert.eq( 4 , t.getIndexes().length , tojson( t.getIndexes() ) );
+assert.eq( 100 , t.find( { y : 3 } ).hint( { y : 1 } ).itcount() );
+assert.eq( 1 , t.find( { z : 1234 } ).hint( { z : 1 } ).itcount() );
+assert.eq( 1 , t.find( { x : 1234 } ).hint( { x : 1 } ).itcount() );
+assert.eq( 1 , t.validate().valid ? 1 : 0 );
+
+// the donor's side, which already had data, still moves back as before
+assert.commandWorked( s.adminCommand( { movechunk : "test.foo" , find : { x : 10 } , to : to.name } ) );
+assert.eq( 2000 , t.count() );
+assert.eq( 2000 , db.foo.find().itcount() );
+
+s.stop();
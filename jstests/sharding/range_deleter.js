@@ -0,0 +1,39 @@
+// the donor deletes a migrated chunk in batches in the background and reports its backlog
+
+s = new ShardingTest( { name : "range_deleter" , shards : 2 , mongos : 1 } );
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { x : 1 } } );
+
+db = s.getDB( "test" );
+for ( var i = 0; i < 1000; i++ )
+    db.foo.insert( { x : i } );
+db.getLastError();
+
+s.adminCommand( { split : "test.foo" , middle : { x : 500 } } );
+
+var from = s.getServer( "test" );
+var to = s.getOther( from );
+
+assert.commandWorked( from.getDB( "admin" ).runCommand( { setParameter : 1 , rangeDeleterBatchSize : 10 } ) );
+assert.commandWorked( from.getDB( "admin" ).runCommand( { setParameter : 1 , rangeDeleterMaxDocsPerSec : 1000 } ) );
+assert.eq( 10 , from.getDB( "admin" ).runCommand( { getParameter : 1 , rangeDeleterBatchSize : 1 } ).rangeDeleterBatchSize );
+assert( ! from.getDB( "admin" ).runCommand( { setParameter : 1 , rangeDeleterBatchSize : 0 } ).ok );
+
+var before = from.getDB( "admin" ).serverStatus().rangeDeleter;
+
+assert.commandWorked( s.adminCommand( { movechunk : "test.foo" , find : { x : 600 } , to : to.name } ) );
+
+assert.soon( function() {
+    return from.getDB( "admin" ).serverStatus().rangeDeleter.backlog == 0;
+} , "range deleter backlog never drained" , 60000 );
+
+var after = from.getDB( "admin" ).serverStatus().rangeDeleter;
+assert.eq( 500 , after.docsDeleted - before.docsDeleted , tojson( after ) );
+assert.lte( 50 , after.batches - before.batches , tojson( after ) );
+assert.eq( 0 , from.getDB( "local" ).rangeDeletions.count() );
+
+assert.eq( 500 , from.getDB( "test" ).foo.count() );
+assert.eq( 1000 , db.foo.find().itcount() );
+
+s.stop();
@@ -0,0 +1,59 @@
+// each shard is sent only the $in values and $or clauses its chunks can match
+
+s = new ShardingTest( { name : "shard_query_narrowing" , shards : 2 , mongos : 1 } );
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { x : 1 } } );
+s.stopBalancer();
+
+db = s.getDB( "test" );
+for ( var i = 0; i < 100; i++ )
+    db.foo.insert( { x : i , y : i % 2 } );
+db.getLastError();
+
+s.adminCommand( { split : "test.foo" , middle : { x : 50 } } );
+var from = s.getServer( "test" );
+var to = s.getOther( from );
+assert.commandWorked( s.adminCommand( { movechunk : "test.foo" , find : { x : 75 } , to : to.name } ) );
+
+// the query the shard last saw against test.foo
+function lastQuery( shard ) {
+    var p = shard.getDB( "test" ).system.profile.find( { ns : "test.foo" , op : "query" } ).sort( { $natural : -1 } ).limit( 1 ).next();
+    return p.query.query || p.query.$query || p.query;
+}
+
+[ from , to ].forEach( function( shard ) {
+    var sdb = shard.getDB( "test" );
+    sdb.setProfilingLevel( 0 );
+    sdb.system.profile.drop();
+    sdb.setProfilingLevel( 2 );
+} );
+
+assert.eq( 4 , db.foo.find( { x : { $in : [ 1 , 2 , 60 , 70 ] } } ).itcount() );
+assert.eq( [ 1 , 2 ] , lastQuery( from ).x.$in );
+assert.eq( [ 60 , 70 ] , lastQuery( to ).x.$in );
+
+// the rest of the query, and the sort, go along unchanged
+assert.eq( [ 2 , 60 , 70 ] , db.foo.find( { x : { $in : [ 1 , 2 , 60 , 70 ] , $gt : 1 } } ).sort( { x : 1 } ).toArray().map( function( z ) { return z.x; } ) );
+assert.eq( 1 , lastQuery( from ).x.$gt );
+assert.eq( [ 60 , 70 ] , lastQuery( to ).x.$in );
+
+assert.eq( 7 , db.foo.find( { y : 0 , $or : [ { x : { $lt : 10 } } , { x : { $gt : 94 } } ] } ).itcount() );
+assert.eq( [ { x : { $lt : 10 } } ] , lastQuery( from ).$or );
+assert.eq( [ { x : { $gt : 94 } } ] , lastQuery( to ).$or );
+assert.eq( 0 , lastQuery( to ).y );
+
+// clauses which don't restrict the shard key go to every shard
+assert.eq( 50 , db.foo.find( { $or : [ { x : 1 } , { y : 1 } , { x : 99 } ] } ).itcount() );
+assert.eq( 2 , lastQuery( from ).$or.length );
+assert.eq( 2 , lastQuery( to ).$or.length );
+
+// regexes match more than one value, so the $in is left as it was
+assert.eq( 1 , db.foo.find( { x : { $in : [ 1 , /a/ ] } } ).itcount() );
+assert.eq( 2 , lastQuery( to ).x.$in.length );
+
+[ from , to ].forEach( function( shard ) {
+    shard.getDB( "test" ).setProfilingLevel( 0 );
+} );
+
+s.stop();
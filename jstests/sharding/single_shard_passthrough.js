@@ -0,0 +1,54 @@
+// queries and inserts bound for just one shard are forwarded as they came:  results, getMore,
+// ContinueOnError and shard key reordering are the same as when mongos rebuilds them
+
+s = new ShardingTest( { name : "single_shard_passthrough" , shards : 2 , mongos : 1 } );
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { x : 1 } } );
+s.stopBalancer();
+
+s.adminCommand( { split : "test.foo" , middle : { x : 50 } } );
+s.adminCommand( { movechunk : "test.foo" , find : { x : 0 } , to : "shard0000" } );
+s.adminCommand( { movechunk : "test.foo" , find : { x : 50 } , to : "shard0001" } );
+
+db = s.getDB( "test" );
+
+// the shard key already in front, one chunk per batch
+var low = [] , high = [];
+for ( var i = 0; i < 100; i++ )
+    ( i < 50 ? low : high ).push( { x : i , _id : i , v : i % 7 } );
+db.foo.insert( low );
+db.foo.insert( high );
+assert.isnull( db.getLastError() );
+assert.eq( 50 , s.shard0.getDB( "test" ).foo.count() );
+assert.eq( 50 , s.shard1.getDB( "test" ).foo.count() );
+
+// not in front:  still moved to the front on the way through
+db.foo.insert( { v : 1 , x : 200 , _id : 200 } );
+assert.isnull( db.getLastError() );
+assert.eq( [ "x" , "_id" , "v" ] , Object.keySet( db.foo.findOne( { x : 200 } ) ) );
+assert.eq( [ "x" , "_id" , "v" ] , Object.keySet( db.foo.findOne( { x : 10 } ) ) );
+
+// ContinueOnError is always on through mongos, also for a forwarded batch
+db.foo.insert( [ { x : 60 , _id : 300 } , { x : 61 , _id : 60 } , { x : 62 , _id : 301 } ] );
+assert.eq( 11000 , db.getLastErrorObj().code );
+assert.eq( 1 , db.foo.count( { _id : 301 } ) );
+
+// a targeted query, with getMores through the shard's own cursor
+var c = db.foo.find( { x : { $gte : 50 , $lt : 100 } } ).sort( { x : 1 } ).batchSize( 7 );
+var n = 0;
+while ( c.hasNext() ) {
+    assert.eq( 50 + n , c.next().x );
+    n++;
+}
+assert.eq( 50 , n );
+assert.eq( 7 , db.foo.find( { x : { $lt : 50 } , v : 3 } ).itcount() );
+assert.eq( 14 , db.foo.find( { v : 3 } ).itcount() );
+assert.eq( 1 , db.foo.find( { x : 10 } ).explain().n );
+
+// unsharded collections as well
+for ( var i = 0; i < 30; i++ )
+    db.unsharded.insert( { _id : i } );
+assert.eq( 30 , db.unsharded.find().batchSize( 4 ).itcount() );
+
+s.stop();
@@ -0,0 +1,38 @@
+// mongos merges sorted results from many shards, batch by batch
+
+s = new ShardingTest( { name : "sort_merge" , shards : 3 , mongos : 1 } );
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { x : 1 } } );
+s.stopBalancer();
+
+db = s.getDB( "test" );
+var N = 3000;
+for ( var i = 0; i < N; i++ )
+    db.foo.insert( { x : i , y : ( i * 7919 ) % N , pad : "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa" } );
+db.getLastError();
+
+s.adminCommand( { split : "test.foo" , middle : { x : 1000 } } );
+s.adminCommand( { split : "test.foo" , middle : { x : 2000 } } );
+s.adminCommand( { movechunk : "test.foo" , find : { x : 1500 } , to : "shard0001" } );
+s.adminCommand( { movechunk : "test.foo" , find : { x : 2500 } , to : "shard0002" } );
+s.adminCommand( { movechunk : "test.foo" , find : { x : 500 } , to : "shard0000" } );
+
+function ys( c ) {
+    return c.toArray().map( function( z ) { return z.y; } );
+}
+
+function range( from , to , step ) {
+    var a = [];
+    for ( var i = from; step > 0 ? i < to : i > to; i += step )
+        a.push( i );
+    return a;
+}
+
+assert.eq( range( 0 , N , 1 ) , ys( db.foo.find().sort( { y : 1 } ) ) );
+assert.eq( range( N - 1 , -1 , -1 ) , ys( db.foo.find().sort( { y : -1 } ).batchSize( 7 ) ) );
+assert.eq( range( 100 , 110 , 1 ) , ys( db.foo.find().sort( { y : 1 } ).skip( 100 ).limit( 10 ) ) );
+assert.eq( range( 2000 , N , 1 ) , ys( db.foo.find( { y : { $gte : 2000 } } ).sort( { y : 1 } ).batchSize( 50 ) ) );
+assert.eq( [ 0 , 1 , 2 ] , ys( db.foo.find().sort( { y : 1 } ).limit( -3 ) ) );
+
+s.stop();
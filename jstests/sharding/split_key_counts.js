@@ -0,0 +1,43 @@
+// splitVector remembers how many keys a range it walked had, plus the inserts into it since
+
+s = new ShardingTest( { name : "split_key_counts" , shards : 1 , mongos : 1 } );
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { x : 1 } } );
+
+db = s.getDB( "test" );
+for ( var i = 0; i < 1000; i++ )
+    db.foo.insert( { x : i } );
+db.getLastError();
+
+var shardAdmin = s.shard0.getDB( "admin" );
+function chunkKeys() {
+    var res = shardAdmin.runCommand( { splitVector : "test.foo" , keyPattern : { x : 1 } ,
+                                       min : { x : 100 } , max : { x : 200 } ,
+                                       maxChunkSizeBytes : db.foo.dataSize() } );
+    assert.commandWorked( res );
+    assert.eq( 0 , res.splitKeys.length , tojson( res ) );
+    return res.chunkKeys;
+}
+
+assert.eq( 100 , chunkKeys() );
+assert.eq( 100 , chunkKeys() );
+
+// inserts into the range are added, those outside aren't
+db.foo.insert( { x : 150.5 } );
+db.foo.insert( { x : 500.5 } );
+db.getLastError();
+assert.eq( 101 , chunkKeys() );
+
+// deletes aren't taken off, so it's an upper bound
+db.foo.remove( { x : { $gte : 100 , $lt : 150 } } );
+db.getLastError();
+assert.eq( 101 , chunkKeys() );
+
+// an upsert isn't followed, so the range is walked again
+db.foo.update( { x : 1500 } , { $set : { y : 1 } } , true );
+db.getLastError();
+assert.eq( 51 , chunkKeys() );
+assert.eq( 51 , chunkKeys() );
+
+s.stop();
@@ -0,0 +1,44 @@
+// mongos splits a writeBatch per shard and merges the outcomes back into statement order
+
+s = new ShardingTest( "write_batch" , 2 , 0 , 1 );
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { x : 1 } } );
+s.adminCommand( { split : "test.foo" , middle : { x : 0 } } );
+s.adminCommand( { movechunk : "test.foo" , find : { x : 0 } , to : s.getOther( s.getServer( "test" ) ).name } );
+
+db = s.getDB( "test" );
+
+res = db.runCommand( { writeBatch : "foo" ,
+                       writes : [ { insert : { x : -1 , a : 1 } } ,
+                                  { insert : { x : 1 , a : 1 } } ,
+                                  { insert : { x : 2 , a : 1 } } ,
+                                  { update : { q : { a : 1 } , u : { $inc : { a : 1 } } , multi : true } } ,
+                                  { update : { q : { x : -1 } , u : { $set : { b : 1 } } } } ,
+                                  { remove : { q : { x : 2 } } } ,
+                                  { insert : { a : 1 } } ] ,
+                       ordered : false ,
+                       writeConcern : { w : 1 } } );
+assert.commandWorked( res );
+printjson( res );
+assert.eq( 6 , res.applied , "applied" );
+assert.eq( 7 , res.results.length , "results" );
+assert.eq( 3 , res.results[3].n , "broadcast multi update counts every shard" );
+assert.eq( 1 , res.results[4].n , "targeted update" );
+assert.eq( 1 , res.results[5].n , "remove" );
+assert( res.results[6].err , "insert without a shard key" );
+
+assert.eq( 2 , db.foo.count() );
+assert.eq( 1 , db.foo.find( { x : -1 , a : 2 , b : 1 } ).count() );
+assert.eq( 1 , db.foo.find( { x : 1 , a : 2 } ).count() );
+
+// an ordered batch stops at its first failure, even when the next statement is for another shard
+res = db.runCommand( { writeBatch : "foo" ,
+                       writes : [ { insert : { x : -5 , _id : 5 } } ,
+                                  { insert : { x : -5 , _id : 5 } } ,
+                                  { insert : { x : 5 } } ] } );
+assert.eq( 1 , res.applied , tojson( res ) );
+assert.eq( 2 , res.results.length , tojson( res ) );
+assert.eq( 0 , db.foo.find( { x : 5 } ).count() );
+
+s.stop();
@@ -0,0 +1,43 @@
+// writebacks from a stale mongos are replayed, in order per connection, and show in serverStatus
+
+var st = new ShardingTest( { name : "writeback_batch" , shards : 2 , mongos : 2 } );
+st.stopBalancer();
+
+var mongosA = st.s0;
+var mongosB = st.s1;
+
+var admin = mongosA.getDB( "admin" );
+admin.runCommand( { enablesharding : "test" } );
+admin.runCommand( { shardcollection : "test.foo" , key : { x : 1 } } );
+
+var collA = mongosA.getCollection( "test.foo" );
+var collB = mongosB.getCollection( "test.foo" );
+collB.findOne(); // mongosB learns the current version
+
+admin.runCommand( { split : "test.foo" , middle : { x : 0 } } );
+var from = st.getServer( "test" );
+var to = st.getOther( from );
+assert.commandWorked( admin.runCommand( { movechunk : "test.foo" , find : { x : 10 } , to : to.name } ) );
+
+// mongosB still sends these to the old shard, which writes them back, and the later
+// updates must land after the inserts they update
+for ( var i = 0; i < 50; i++ )
+    collB.insert( { x : i , n : 0 } );
+for ( var i = 0; i < 50; i++ )
+    collB.update( { x : i } , { $inc : { n : 1 } } );
+assert.eq( null , collB.getDB().getLastError() );
+
+assert.eq( 50 , collA.find().itcount() );
+assert.eq( 50 , collA.find( { n : 1 } ).itcount() );
+
+var wb = mongosB.getDB( "admin" ).serverStatus().writeBacks;
+printjson( wb );
+assert( wb.replayed > 0 , "nothing replayed" );
+assert.eq( 0 , wb.inFlight );
+
+var queues = from.getDB( "admin" ).serverStatus().writeBackQueues;
+printjson( queues );
+assert( queues.maxQueued > 0 );
+assert.eq( 0 , queues.totalOpsQueued );
+
+st.stop();
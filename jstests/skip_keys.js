@@ -0,0 +1,46 @@
+// skip over an index whose bounds are exactly the query passes whole runs of keys at once; the
+// results are the same as a collection scan's
+
+t = db.jstests_skip_keys;
+t.drop();
+
+for( i = 0; i < 20000; ++i ) {
+    t.save( { _id : i , a : i % 100 , b : i , c : ( i % 7 == 0 ) ? "x" : "y" } );
+}
+// leave some unused keys behind
+t.remove( { _id : { $mod : [ 13 , 0 ] } } );
+t.ensureIndex( { a : 1 , b : 1 } );
+t.ensureIndex( { b : -1 } );
+assert.isnull( db.getLastError() );
+
+function check( query , sort , skip , hint ) {
+    var want = t.find( query ).sort( sort ).hint( { $natural : 1 } ).toArray();
+    want.sort( function( x , y ) {
+                  for( var k in sort ) {
+                      if ( x[ k ] != y[ k ] )
+                          return ( x[ k ] < y[ k ] ? -1 : 1 ) * sort[ k ];
+                  }
+                  return 0;
+              } );
+    var got = t.find( query ).sort( sort ).hint( hint ).skip( skip ).limit( 5 ).toArray();
+    assert.eq( want.slice( skip , skip + 5 ) , got , tojson( query ) + " " + skip );
+}
+
+[ 0 , 1 , 150 , 5000 , 15000 , 18000 , 30000 ].forEach( function( skip ) {
+    check( {} , { b : 1 } , skip , { b : -1 } );
+    check( {} , { b : -1 } , skip , { b : -1 } );
+    check( { b : { $gte : 3000 , $lt : 17000 } } , { b : 1 } , skip , { b : -1 } );
+    check( { b : { $gt : 3000 } } , { b : -1 } , skip , { b : -1 } );
+    check( { a : 42 } , { a : 1 , b : 1 } , skip , { a : 1 , b : 1 } );
+    check( { a : 42 , b : { $gt : 1000 } } , { a : 1 , b : 1 } , skip , { a : 1 , b : 1 } );
+    check( { a : { $gte : 10 , $lt : 20 } } , { a : 1 , b : 1 } , skip , { a : 1 , b : 1 } );
+    check( { a : { $lt : 50 } , b : { $lt : 10000 } } , { a : 1 , b : 1 } , skip , { a : 1 , b : 1 } );
+    // a residual predicate is still matched for each one
+    check( { b : { $gt : 100 } , c : "x" } , { b : -1 } , skip , { b : -1 } );
+    check( { a : { $in : [ 3 , 7 ] } } , { a : 1 , b : 1 } , skip , { a : 1 , b : 1 } );
+} );
+
+// getMore after a skip
+assert.eq( 20000 - Math.ceil( 20000 / 13 ) - 1000 , t.find().hint( { b : -1 } ).skip( 1000 ).itcount() );
+
+t.drop();
@@ -0,0 +1,53 @@
+// with maxParallelMigrations the balancer runs moves between distinct shards at once
+
+s = new ShardingTest( "slow_sharding_balance_parallel" , 4 , 1 , 1 , { chunksize : 1 } )
+
+s.config.settings.update( { _id : "balancer" } , { $set : { maxParallelMigrations : 2 } } , true );
+
+bigString = ""
+while ( bigString.length < 10000 )
+    bigString += "asdasdasdasdadasdasdasdasdasdasdasdasda";
+
+// two collections whose chunks start out on different shards
+var names = [ "test1" , "test2" ];
+for ( var d = 0; d < names.length; d++ ) {
+    s.adminCommand( { enablesharding : names[d] } );
+    var primary = s.getServer( names[d] ).name;
+    var wanted = s._connections[d].name;
+    if ( primary != wanted )
+        s.adminCommand( { moveprimary : names[d] , to : wanted } );
+
+    var db = s.getDB( names[d] );
+    var inserted = 0;
+    var num = 0;
+    while ( inserted < ( 10 * 1024 * 1024 ) ){
+        db.foo.insert( { _id : num++ , s : bigString } );
+        inserted += bigString.length;
+    }
+    db.getLastError();
+    s.adminCommand( { shardcollection : names[d] + ".foo" , key : { _id : 1 } } );
+}
+
+function diff( ns ){
+    var x = {};
+    s.config.shards.find().forEach( function( z ){ x[z._id] = 0; } );
+    s.config.chunks.find( { ns : ns } ).forEach( function( z ){ x[z.shard]++; } );
+    printjson( x );
+    var max = 0, min = Infinity;
+    for ( var k in x ) {
+        max = Math.max( max , x[k] );
+        min = Math.min( min , x[k] );
+    }
+    return max - min;
+}
+
+assert.lt( 10 , diff( "test1.foo" ) , "setup test1" );
+assert.lt( 10 , diff( "test2.foo" ) , "setup test2" );
+
+assert.soon( function(){
+    return diff( "test1.foo" ) < 3 && diff( "test2.foo" ) < 3;
+} , "balance didn't happen" , 1000 * 60 * 5 , 5000 );
+
+assert.eq( 0 , s.config.chunks.count( { jumbo : true } ) );
+
+s.stop();
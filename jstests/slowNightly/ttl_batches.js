@@ -0,0 +1,36 @@
+// the TTL monitor deletes in batches of ttlBatchSize, going straight on to the next while an
+// index has a backlog, and reports what it did per index in serverStatus().ttl
+
+admin = db.getSisterDB( "admin" );
+assert.commandWorked( admin.runCommand( { setParameter : 1 , ttlBatchSize : 50 } ) );
+assert.commandWorked( admin.runCommand( { setParameter : 1 , ttlMonitorSleepSecs : 1 } ) );
+
+t = db.ttl_batches;
+t.drop();
+
+now = (new Date()).getTime();
+for ( i = 0; i < 500; i++ )
+    t.insert( { x : new Date( now - 3600 * 1000 - i ) } );
+for ( i = 0; i < 10; i++ )
+    t.insert( { x : new Date( now + 3600 * 1000 ) } );
+// $lt a date doesn't take in other types
+for ( i = 0; i < 10; i++ )
+    t.insert( { x : i } );
+db.getLastError();
+
+t.ensureIndex( { x : -1 } , { expireAfterSeconds : 60 } );
+
+assert.soon( function() { return t.count() == 20; } , "never deleted" , 120 * 1000 );
+assert.eq( 10 , t.find( { x : { $type : 16 } } ).count() );
+
+stats = db.serverStatus( { ttl : 1 } ).ttl;
+printjson( stats );
+idx = stats.indexes[ t.getFullName() + ".x_-1" ];
+assert( idx , "no stats for the index" );
+assert.eq( 500 , idx.deleted );
+assert.lte( 10 , idx.batches );
+assert.eq( 0 , idx.lagSecs );
+
+assert.commandWorked( admin.runCommand( { setParameter : 1 , ttlBatchSize : 1000 } ) );
+assert.commandWorked( admin.runCommand( { setParameter : 1 , ttlMonitorSleepSecs : 60 } ) );
+t.drop();
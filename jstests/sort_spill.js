@@ -0,0 +1,64 @@
+// a $sortSpill query whose sort outgrows $maxSortBytes goes on in an external sort, returning the
+// rest of its results through getMore; without $sortSpill it still fails
+
+t = db.jstests_sort_spill;
+t.drop();
+
+filler = new Array( 10 * 1024 ).toString();
+for( i = 0; i < 1000; ++i ) {
+    t.save( { _id : i , a : ( i * 7919 ) % 1000 , filler : filler } );
+}
+assert.isnull( db.getLastError() );
+
+function spilled( sortSpec , skip , limit ) {
+    var c = t.find( {} , { filler : 0 } ).sort( sortSpec );
+    if ( skip )
+        c.skip( skip );
+    if ( limit )
+        c.limit( limit );
+    return c._addSpecial( "$sortSpill" , true )._addSpecial( "$maxSortBytes" , 256 * 1024 );
+}
+
+function checkOrder( sortSpec , skip , limit ) {
+    var r = spilled( sortSpec , skip , limit ).toArray();
+    var want = limit ? Math.min( limit , 1000 - skip ) : 1000 - skip;
+    assert.eq( want , r.length , tojson( sortSpec ) );
+    var dir = sortSpec.a;
+    for( var i = 0; i < r.length; ++i ) {
+        var a = dir > 0 ? skip + i : 999 - skip - i;
+        assert.eq( a , r[ i ].a , tojson( sortSpec ) + " " + i );
+        assert.isnull( r[ i ].filler );
+    }
+}
+
+checkOrder( { a : 1 } , 0 );
+checkOrder( { a : -1 } , 0 );
+checkOrder( { a : 1 } , 100 );
+checkOrder( { a : 1 } , 50 , 600 );
+checkOrder( { a : -1 } , 990 , 50 );
+
+// the first batch is capped by size, the rest come with getMore
+c = t.find().sort( { a : 1 } )._addSpecial( "$sortSpill" , true )._addSpecial( "$maxSortBytes" , 256 * 1024 );
+assert.gt( 1000 , c.objsLeftInBatch() );
+assert.eq( 1000 , c.itcount() );
+
+r = spilled( { a : 1 } ).showDiskLoc().toArray();
+assert.eq( 1000 , r.length );
+for( i = 0; i < r.length; ++i ) {
+    assert( r[ i ].$diskLoc , "no $diskLoc" );
+}
+
+// a lower limit is also checked without spilling
+assert.throws( function() {
+              t.find().sort( { a : 1 } )._addSpecial( "$maxSortBytes" , 256 * 1024 ).itcount();
+              } );
+assert( db.getLastError().match( /too much data for sort\(\) with no index/ ) );
+assert.throws( function() {
+              t.find().sort( { a : 1 } )._addSpecial( "$maxSortBytes" , 0 ).itcount();
+              } );
+
+// indexed sorts don't need it
+t.ensureIndex( { a : 1 } );
+checkOrder( { a : 1 } , 0 );
+
+t.drop();
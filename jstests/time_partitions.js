@@ -0,0 +1,94 @@
+// a time partitioned collection puts each document in the bucket collection for its date, with
+// the parent's indexes; findPartitioned scans only the buckets the query's date range can match,
+// and expiry drops whole buckets
+
+hour = 3600 * 1000;
+base = 1000 * hour; // on a bucket boundary
+
+db.tp.drop();
+assert.commandWorked( db.createCollection( "tp" , { timePartitioned : { field : "ts" , bucketSecs : 3600 } } ) );
+t = db.tp;
+t.ensureIndex( { host : 1 } );
+
+for ( h = 0; h < 5; h++ )
+    for ( i = 0; i < 10; i++ )
+        t.insert( { ts : new Date( base + h * hour + i ) , host : "h" + i } );
+assert.isnull( db.getLastError() );
+
+assert.eq( 0 , t.count() , "parent holds documents" );
+for ( h = 0; h < 5; h++ ) {
+    b = db.getCollection( "tp.tp" + ( base + h * hour ) );
+    assert.eq( 10 , b.count() , "bucket " + h );
+    assert.eq( 2 , b.getIndexes().length , "bucket " + h + " indexes" );
+}
+
+// needs the date
+t.insert( { host : "x" } );
+assert( db.getLastError() );
+t.insert( { ts : 5 } );
+assert( db.getLastError() );
+
+function find( query , extra ) {
+    var cmd = { findPartitioned : "tp" , query : query };
+    for ( var k in extra )
+        cmd[ k ] = extra[ k ];
+    var res = db.runCommand( cmd );
+    assert.commandWorked( res );
+    return res;
+}
+
+res = find( {} );
+assert.eq( 50 , res.n );
+assert.eq( 5 , res.buckets );
+assert.eq( 5 , res.bucketsScanned );
+
+res = find( { ts : { $gte : new Date( base + hour ) , $lt : new Date( base + 3 * hour ) } } );
+assert.eq( 20 , res.n );
+assert.eq( 2 , res.bucketsScanned );
+
+res = find( { ts : { $lt : new Date( base + hour ) } , host : "h3" } );
+assert.eq( 1 , res.n );
+assert.eq( 1 , res.bucketsScanned );
+
+res = find( { ts : new Date( base + 4 * hour + 7 ) } );
+assert.eq( 1 , res.n );
+assert.eq( 1 , res.bucketsScanned );
+
+res = find( { ts : { $gt : new Date( base + 10 * hour ) } } );
+assert.eq( 0 , res.n );
+assert.eq( 0 , res.bucketsScanned );
+
+// the newest first, stopping once it has enough
+res = find( {} , { limit : 3 , reverse : true } );
+assert.eq( 3 , res.n );
+assert.eq( 1 , res.bucketsScanned );
+assert.eq( base + 4 * hour + 9 , res.results[ 0 ].ts.getTime() );
+
+assert( !db.runCommand( { findPartitioned : "tp.tp" + base } ).ok , "a bucket isn't partitioned" );
+
+// dropping the parent drops its buckets
+t.drop();
+assert.eq( 0 , db.system.namespaces.count( { name : new RegExp( "^" + db.getName() + "\\.tp\\." ) } ) );
+
+assert.commandFailed( db.createCollection( "tp" , { timePartitioned : { field : "ts" } } ) );
+assert.commandFailed( db.createCollection( "tp" , { timePartitioned : { field : "ts" , bucketSecs : 60 } , capped : true , size : 4096 } ) );
+
+// buckets entirely past expireAfterSeconds are dropped by the TTL monitor
+admin = db.getSisterDB( "admin" );
+assert.commandWorked( admin.runCommand( { setParameter : 1 , ttlMonitorSleepSecs : 1 } ) );
+db.tpx.drop();
+assert.commandWorked( db.createCollection( "tpx" , { timePartitioned : { field : "ts" , bucketSecs : 3600 , expireAfterSeconds : 3600 } } ) );
+now = (new Date()).getTime();
+for ( i = 0; i < 100; i++ )
+    db.tpx.insert( { ts : new Date( now - 10 * hour + i ) } );
+for ( i = 0; i < 100; i++ )
+    db.tpx.insert( { ts : new Date( now ) } );
+assert.isnull( db.getLastError() );
+
+assert.soon( function() { return db.runCommand( { findPartitioned : "tpx" } ).buckets == 1; } ,
+             "expired bucket never dropped" , 60 * 1000 );
+assert.eq( 100 , db.runCommand( { findPartitioned : "tpx" } ).n );
+assert.lte( 1 , db.serverStatus( { ttl : 1 } ).ttl.bucketsDropped );
+
+assert.commandWorked( admin.runCommand( { setParameter : 1 , ttlMonitorSleepSecs : 60 } ) );
+db.tpx.drop();
@@ -0,0 +1,40 @@
+// mongodump splitting a big collection into _id ranges dumped at once, compressed, and
+// mongorestore and bsondump reading the segments back
+
+t = new ToolTest( "dumpsegments" );
+
+c = t.startDB( "foo" );
+
+// more than the 64MB a collection has to be before it's split
+var big = new Array( 4096 ).join( "x" );
+for ( var i = 0; i < 20000; i++ )
+    c.insert( { _id : i , pad : big } );
+c.ensureIndex( { x : 1 } );
+db = t.db;
+db.small.insert( { _id : 1 } );
+db.getLastError();
+
+assert.eq( 0 , t.runTool( "dump" , "--out" , t.ext , "--numSegments" , "4" , "--compress" , "snappy" ) ,
+           "dump" );
+
+var dir = t.ext + "/" + t.baseName;
+var files = listFiles( dir ).map( function( f ) { return f.name.substring( f.name.lastIndexOf( "/" ) + 1 ); } );
+assert.contains( "foo.bson" , files , "first segment" );
+assert.contains( "foo.bson.1" , files , "second segment" );
+assert.contains( "small.bson" , files , "small collection" );
+assert( files.indexOf( "small.bson.1" ) < 0 , "small collection split" );
+
+c.drop();
+db.small.drop();
+
+assert.eq( 0 , t.runTool( "restore" , "--dir" , t.ext ) , "restore" );
+assert.eq( 20000 , c.count() , "count" );
+assert.eq( 20000 , c.find().sort( { _id : 1 } ).toArray().map( function( d ) { return d._id; } )
+           .filter( function( id , i ) { return id == i; } ).length , "every _id once" );
+assert.eq( 1 , db.small.count() , "small count" );
+assert.eq( 2 , db.system.indexes.count( { ns : c.getFullName() } ) , "indexes" );
+
+// bsondump reads all of the segments when given the first
+assert.eq( 0 , runMongoProgram( "bsondump" , dir + "/foo.bson" ) , "bsondump" );
+
+t.stop();
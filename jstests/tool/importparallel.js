@@ -0,0 +1,34 @@
+// mongoimport parsing and inserting on several threads, in batches
+
+t = new ToolTest( "importparallel" );
+
+c = t.startDB( "foo" );
+
+for ( var i = 0; i < 5000; i++ )
+    c.insert( { _id : i , s : "a \"quoted\"\né string" , n : i * 1.5 , big : 12345678901 ,
+                a : [ i , { b : null , c : true } ] , o : ObjectId() , d : new Date( i ) } );
+db = t.db;
+db.getLastError();
+var expected = c.find().sort( { _id : 1 } ).toArray();
+
+t.runTool( "export" , "--out" , t.extFile , "-d" , t.baseName , "-c" , "foo" );
+
+c.drop();
+assert.eq( 0 , t.runTool( "import" , "--file" , t.extFile , "-d" , t.baseName , "-c" , "foo" ,
+                          "--numWorkers" , "4" , "--batchSize" , "100" ) , "import" );
+assert.eq( 5000 , c.count() , "count" );
+assert.eq( expected , c.find().sort( { _id : 1 } ).toArray() , "documents" );
+
+// batched, on the one connection
+c.drop();
+assert.eq( 0 , t.runTool( "import" , "--file" , t.extFile , "-d" , t.baseName , "-c" , "foo" ,
+                          "--batchSize" , "7" ) , "serial import" );
+assert.eq( expected , c.find().sort( { _id : 1 } ).toArray() , "serial documents" );
+
+// the duplicates don't stop the rest
+c.remove( { _id : { $gte : 2500 } } );
+assert.eq( 0 , t.runTool( "import" , "--file" , t.extFile , "-d" , t.baseName , "-c" , "foo" ,
+                          "--numWorkers" , "3" ) , "import over existing" );
+assert.eq( 5000 , c.count() , "count over existing" );
+
+t.stop();
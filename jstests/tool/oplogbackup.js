@@ -0,0 +1,48 @@
+// mongooplog --backup archiving an oplog incrementally, and --replay applying the archive
+
+t = new ToolTest( "oplogbackup" );
+
+db = t.startDB();
+
+output = db.output;
+db.createCollection( "oplog" , { capped : true , size : 1024 * 1024 } );
+
+function addOps( from , to ) {
+    for ( var i = from; i < to; i++ ) {
+        db.oplog.insert( { ts : new Timestamp() , op : "i" , ns : output.getFullName() , o : { _id : i } } );
+        db.oplog.insert( { ts : new Timestamp() , op : "u" , ns : output.getFullName() , o2 : { _id : i } ,
+                           o : { $set : { x : i } } } );
+    }
+    db.oplog.insert( { ts : new Timestamp() , op : "i" , ns : db.other.getFullName() , o : { _id : to } } );
+    db.getLastError();
+}
+
+var dir = t.ext + "/oplog";
+function backup() {
+    return t.runTool( "oplog" , "--oplogns" , db.getName() + ".oplog" , "--from" , "127.0.0.1:" + t.port ,
+                      "--backup" , dir , "--compress" , "snappy" );
+}
+
+addOps( 0 , 100 );
+assert.eq( 0 , backup() , "first backup" );
+var files = listFiles( dir );
+assert.eq( 1 , files.length , "one segment" );
+
+// the second run only archives what's new
+addOps( 100 , 150 );
+assert.eq( 0 , backup() , "second backup" );
+assert.eq( 0 , backup() , "nothing new" );
+assert.eq( 2 , listFiles( dir ).length , "two segments" );
+
+assert.eq( 0 , t.runTool( "oplog" , "--replay" , dir , "--numWorkers" , "2" , "--batchSize" , "7" ) , "replay" );
+assert.eq( 150 , output.count() , "replayed" );
+assert.eq( 150 , output.count( { $where : "this.x == this._id" } ) , "updates in order" );
+assert.eq( 2 , db.other.count() , "other namespace" );
+
+// once the oplog has moved past the archive, backing up again fails
+db.oplog.drop();
+db.createCollection( "oplog" , { capped : true , size : 1024 * 1024 } );
+addOps( 150 , 151 );
+assert.neq( 0 , backup() , "oplog rolled over" );
+
+t.stop();
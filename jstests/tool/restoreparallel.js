@@ -0,0 +1,48 @@
+// mongorestore loading several collections at once, in batches, with the indexes built last
+
+t = new ToolTest( "restoreparallel" );
+
+c = t.startDB( "a" );
+db = t.db;
+
+var big = new Array( 4000 ).join( "x" );
+var names = [ "a" , "b" , "c" , "d" , "e" ];
+for ( var j = 0; j < names.length; j++ ) {
+    var coll = db[names[j]];
+    for ( var i = 0; i < 3000; i++ )
+        coll.insert( { _id : i , x : i % 17 , pad : big } );
+    coll.ensureIndex( { x : 1 } );
+    coll.ensureIndex( { x : -1 , _id : 1 } , { unique : true } );
+}
+db.getLastError();
+assert.eq( 3 * names.length , db.system.indexes.count() , "setup" );
+
+assert.eq( 0 , t.runTool( "dump" , "--out" , t.ext ) , "dump" );
+
+db.dropDatabase();
+assert.eq( 0 , db.system.indexes.count() , "after drop" );
+
+assert.eq( 0 , t.runTool( "restore" , "--dir" , t.ext , "--numParallelCollections" , "3" ) ,
+           "restore" );
+
+for ( var j = 0; j < names.length; j++ ) {
+    var coll = db[names[j]];
+    assert.eq( 3000 , coll.count() , names[j] + " count" );
+    assert.eq( 3000 / 17 | 0 , coll.find( { x : 16 } ).count() , names[j] + " query" );
+    assert.eq( 3 , coll.getIndexes().length , names[j] + " indexes" );
+}
+
+// restoring over what's there doesn't stop at the duplicates
+db.a.remove( { _id : { $gte : 1000 } } );
+assert.eq( 0 , t.runTool( "restore" , "--dir" , t.ext , "--numParallelCollections" , "2" ) ,
+           "restore again" );
+assert.eq( 3000 , db.a.count() , "restore again count" );
+
+// one at a time is still the same
+db.dropDatabase();
+assert.eq( 0 , t.runTool( "restore" , "--dir" , t.ext , "--numParallelCollections" , "1" ) ,
+           "serial restore" );
+for ( var j = 0; j < names.length; j++ )
+    assert.eq( 3000 , db[names[j]].count() , names[j] + " serial count" );
+
+t.stop();
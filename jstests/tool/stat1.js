@@ -21,3 +21,7 @@ assert.eq(x, 0, "mongostat should exit successfully with eliot:eliot");
 
 x = runMongoProgram( "mongostat", "--host", "127.0.0.1:"+port, "--username", "eliot", "--password", "wrong", "--rowcount", "1" );
 assert.eq(x, _isWindows() ? -1 : 255, "mongostat should exit with -1 with eliot:wrong");
+
+x = runMongoProgram( "mongostat", "--host", "127.0.0.1:"+port, "--username", "eliot", "--password", "eliot", "--rowcount", "3",
+                     "--latencies", "--intervalMillis", "200" );
+assert.eq(x, 0, "mongostat --latencies with a sub-second interval should exit successfully");
@@ -0,0 +1,53 @@
+// touch pages in a collection's data and indexes, all of them or only named indexes or an _id
+// range, on any number of threads and at a capped rate
+
+t = db.touch1;
+t.drop();
+
+for ( i = 0; i < 5000; i++ )
+    t.insert( { _id : i , a : i , s : "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx" } );
+t.ensureIndex( { a : 1 } );
+assert.isnull( db.getLastError() );
+
+function touch( extra ) {
+    var cmd = { touch : t.getName() };
+    for ( var k in extra )
+        cmd[ k ] = extra[ k ];
+    var res = db.runCommand( cmd );
+    assert.commandWorked( res , tojson( cmd ) );
+    return res;
+}
+
+all = touch( { data : true , index : true } );
+assert.lt( 0 , all.bytes );
+
+data = touch( { data : true , threads : 1 } );
+parallel = touch( { data : true , threads : 8 } );
+assert.eq( data.bytes , parallel.bytes );
+indexes = touch( { index : true } );
+assert.eq( all.bytes , data.bytes + indexes.bytes );
+
+// named indexes
+a = touch( { index : "a_1" } );
+id = touch( { index : [ "_id_" ] } );
+assert.eq( indexes.bytes , a.bytes + id.bytes );
+assert.commandFailed( db.runCommand( { touch : t.getName() , index : [ "nosuch_1" ] } ) );
+assert.commandFailed( db.runCommand( { touch : t.getName() , index : [ 1 ] } ) );
+
+// an _id range is the records in it, which are less than the whole collection
+some = touch( { data : true , idRange : { min : 100 , max : 199 } } );
+assert.lt( 100 * Object.bsonsize( t.findOne() ) , some.bytes + 1 );
+assert.gt( data.bytes , some.bytes );
+none = touch( { data : true , idRange : { min : 10000 , max : 20000 } } );
+assert.eq( 0 , none.bytes );
+assert.commandFailed( db.runCommand( { touch : t.getName() , data : true , idRange : { min : 1 } } ) );
+
+// about a MB at 1MB/s takes a while
+slow = touch( { data : true , rateMB : 1 } );
+assert.lte( ( data.bytes / ( 1024 * 1024 ) - 1 ) * 1000 , slow.millis );
+
+assert.commandFailed( db.runCommand( { touch : t.getName() , data : true , threads : 0 } ) );
+assert.commandFailed( db.runCommand( { touch : t.getName() , data : true , rateMB : -1 } ) );
+assert.commandFailed( db.runCommand( { touch : t.getName() } ) );
+
+t.drop();
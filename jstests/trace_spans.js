@@ -0,0 +1,39 @@
+// spans of each request, recorded while setParameter traceSpans is on
+
+t = db.trace_spans;
+t.drop();
+t.ensureIndex( { a : 1 } );
+for ( i = 0; i < 100; i++ )
+    t.insert( { a : i } );
+db.getLastError();
+
+admin = db.getSisterDB( "admin" );
+assert.eq( false , admin.runCommand( { getParameter : 1 , traceSpans : 1 } ).traceSpans );
+assert.eq( 0 , admin.runCommand( { traceSpans : 1 } ).spans.length , "spans while off" );
+
+assert.commandWorked( admin.runCommand( { setParameter : 1 , traceSpans : true } ) );
+assert.eq( 10 , t.find( { a : { $gte : 90 } } ).itcount() );
+
+res = admin.runCommand( { traceSpans : 1 } );
+assert( res.enabled );
+printjson( res.spans.slice( -20 ) );
+
+// the query's spans are together under one trace id
+stages = {};
+res.spans.forEach( function( s ) {
+    assert( s.traceId , "no trace id" );
+    assert( s.micros >= 0 );
+    if ( s.stage == "btree" )
+        stages.btree = s.traceId;
+} );
+assert( stages.btree , "no btree span" );
+query = admin.runCommand( { traceSpans : 1 , traceId : stages.btree } ).spans;
+seen = {};
+query.forEach( function( s ) { assert.eq( stages.btree , s.traceId ); seen[s.stage] = true; } );
+assert( seen.receive , "no receive span" );
+assert( seen.plan , "no plan span" );
+assert( seen.send , "no send span" );
+
+assert.eq( 5 , admin.runCommand( { traceSpans : 1 , limit : 5 } ).spans.length );
+
+assert.commandWorked( admin.runCommand( { setParameter : 1 , traceSpans : false } ) );
@@ -0,0 +1,48 @@
+// updates that don't touch an indexed field leave a collection's many indexes alone, and those
+// that touch one change only that index's keys, whether or not the document can stay in place
+
+t = db.update_index_skip;
+t.drop();
+
+fields = [];
+for ( i = 0; i < 12; i++ )
+    fields.push( "f" + i );
+for ( i = 0; i < 200; i++ ) {
+    var o = { _id : i , a : [] , s : "" };
+    fields.forEach( function( f , j ) { o[ f ] = i * 100 + j; } );
+    t.insert( o );
+}
+fields.forEach( function( f ) { var k = {}; k[ f ] = 1; t.ensureIndex( k ); } );
+t.ensureIndex( { "sub.x" : 1 } );
+assert.isnull( db.getLastError() );
+
+function check() {
+    assert( t.validate( true ).valid );
+    fields.forEach( function( f , j ) {
+        var k = {};
+        k[ f ] = 1;
+        assert.eq( 200 , t.find().hint( k ).itcount() , f );
+        var q = {};
+        q[ f ] = 150 * 100 + j;
+        assert.eq( 150 , t.findOne( q )._id , f );
+    } );
+}
+
+// unindexed, in the padding and moving
+t.update( {} , { $push : { a : 1 } } , false , true );
+t.update( {} , { $set : { s : new Array( 2000 ).toString() } } , false , true );
+assert.isnull( db.getLastError() );
+check();
+
+// one indexed field, and a subfield of an index on a dotted path
+t.update( { _id : 150 } , { $set : { f3 : -1 , s : "" } } );
+assert.eq( 150 , t.findOne( { f3 : -1 } , { _id : 1 } )._id );
+t.update( { _id : 150 } , { $set : { f3 : 150 * 100 + 3 } } );
+t.update( { _id : 7 } , { $set : { sub : { x : 5 } } } );
+assert.eq( 7 , t.find( { "sub.x" : 5 } ).hint( { "sub.x" : 1 } ).next()._id );
+t.update( { _id : 7 } , { $inc : { "sub.x" : 1 } } );
+assert.eq( 0 , t.find( { "sub.x" : 5 } ).hint( { "sub.x" : 1 } ).itcount() );
+assert.eq( 7 , t.find( { "sub.x" : 6 } ).hint( { "sub.x" : 1 } ).next()._id );
+check();
+
+t.drop();
@@ -0,0 +1,55 @@
+// a lone $inc, or $set of a same size value, is written into the document where it is; those that
+// can't be, and updates of indexed fields, still come out right
+
+t = db.update_single_inplace;
+t.drop();
+
+t.insert( { _id : 1 , i : NumberInt( 1 ) , l : NumberLong( 1 ) , d : 1.5 , s : "abc" , o : { n : NumberInt( 2 ) } } );
+
+t.update( { _id : 1 } , { $inc : { i : NumberInt( 2 ) } } );
+t.update( { _id : 1 } , { $inc : { l : NumberLong( 2 ) } } );
+t.update( { _id : 1 } , { $inc : { d : 1 } } );
+t.update( { _id : 1 } , { $inc : { "o.n" : NumberInt( 3 ) } } );
+t.update( { _id : 1 } , { $set : { s : "xyz" } } );
+assert.isnull( db.getLastError() );
+o = t.findOne();
+assert.eq( 3 , o.i );
+assert.eq( NumberLong( 3 ) , o.l );
+assert.eq( 2.5 , o.d );
+assert.eq( 5 , o.o.n );
+assert.eq( "xyz" , o.s );
+
+// not in place: a double into an int, an int past its max, a longer string, a missing field
+t.update( { _id : 1 } , { $inc : { i : 0.5 } } );
+assert.eq( 3.5 , t.findOne().i );
+t.update( { _id : 1 } , { $set : { i : NumberInt( 2147483647 ) } } );
+t.update( { _id : 1 } , { $inc : { i : NumberInt( 1 ) } } );
+assert.eq( NumberLong( "2147483648" ) , t.findOne().i );
+t.update( { _id : 1 } , { $set : { s : "longer" } } );
+assert.eq( "longer" , t.findOne().s );
+t.update( { _id : 1 } , { $inc : { m : 1 } } );
+assert.eq( 1 , t.findOne().m );
+t.update( { _id : 1 } , { $inc : { s : 1 } } );
+assert( db.getLastError() , "$inc of a string" );
+
+// through a query rather than _id, and many at once
+t.drop();
+for ( i = 0; i < 100; i++ )
+    t.insert( { _id : i , g : i % 2 , c : 0 } );
+t.update( { g : 1 } , { $inc : { c : 1 } } , false , true );
+assert.eq( 50 , t.count( { c : 1 } ) );
+t.update( { g : 0 } , { $inc : { c : 2 } } );
+assert.eq( 1 , t.count( { c : 2 } ) );
+
+// an indexed counter changes its own index's keys; the other indexes are left as they are
+t.ensureIndex( { c : 1 } );
+t.ensureIndex( { g : 1 } );
+for ( i = 0; i < 10; i++ )
+    t.update( { _id : i } , { $inc : { c : 10 } } );
+assert.isnull( db.getLastError() );
+assert.eq( 10 , t.find( { c : { $gte : 10 } } ).hint( { c : 1 } ).itcount() );
+assert.eq( 90 , t.find( { c : { $lt : 10 } } ).hint( { c : 1 } ).itcount() );
+assert.eq( 50 , t.find( { g : 1 } ).hint( { g : 1 } ).itcount() );
+assert( t.validate( true ).valid );
+
+t.drop();
@@ -0,0 +1,41 @@
+// with --warmRestartSecs the server notes the hot regions of its data files in hotpages.bson,
+// again at shutdown, and reads them back in when it's next started
+
+var baseName = "jstests_warm_restart";
+var port = allocatePorts( 1 )[ 0 ];
+var dbpath = "/data/db/" + baseName;
+
+var m = startMongodEmpty( "--port", port, "--dbpath", dbpath, "--warmRestartSecs", 1 );
+var t = m.getDB( baseName ).t;
+var big = new Array( 1024 ).join( "x" );
+for ( var i = 0; i < 5000; i++ )
+    t.insert( { i : i , s : big } );
+assert.isnull( m.getDB( baseName ).getLastError() );
+assert.eq( 5000, t.find().itcount() );
+
+assert.soon( function() { return m.getDB( "admin" ).serverStatus().warmRestart.snapshots > 0; },
+             "never noted the hot pages", 30 * 1000 );
+assert.lt( 0, m.getDB( "admin" ).serverStatus().warmRestart.hotBytes );
+
+function hotPagesFile() {
+    return listFiles( dbpath ).filter( function( f ) { return f.name.match( /hotpages\.bson$/ ); } );
+}
+assert.eq( 1, hotPagesFile().length );
+
+stopMongod( port );
+assert.eq( 1, hotPagesFile().length, "nothing noted at shutdown" );
+
+// back up, it reads the regions in again; the data hasn't been touched yet
+m = startMongoProgram( "mongod", "--port", port, "--dbpath", dbpath, "--warmRestartSecs", 1 );
+assert.soon( function() {
+                 var s = m.getDB( "admin" ).serverStatus().warmRestart;
+                 return s.prefetchedBytes > 0 && !s.prefetching;
+             }, "didn't read back the hot regions", 30 * 1000 );
+assert.eq( 5000, m.getDB( baseName ).t.count() );
+
+// without the option it's left alone
+stopMongod( port );
+m = startMongoProgram( "mongod", "--port", port, "--dbpath", dbpath );
+assert.eq( 5000, m.getDB( baseName ).t.count() );
+assert.eq( 0, m.getDB( "admin" ).serverStatus().warmRestart.prefetchedBytes );
+stopMongod( port );
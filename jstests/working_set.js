@@ -0,0 +1,22 @@
+// serverStatus().workingSet estimates the distinct pages touched, by database
+
+t = db.working_set;
+t.drop();
+t.ensureIndex( { x : 1 } );
+for ( var i = 0; i < 1000; i++ )
+    t.insert( { x : i , s : "abcdefghijklmnopqrstuvwxyz" } );
+t.find().itcount();
+for ( var i = 0; i < 100; i++ )
+    t.findOne( { x : i * 10 } );
+
+ws = db.serverStatus( { sections : [ "workingSet" ] } ).workingSet;
+printjson( ws );
+assert.eq( 4096 , ws.pageSize );
+
+mine = ws.dbs[ db.getName() ];
+assert( mine , "no entry for " + db.getName() );
+[ "1min" , "10min" , "1h" ].forEach( function( w ) {
+    assert.lt( 0 , mine[ w ].dataPages , w );
+    assert.lt( 0 , mine[ w ].indexPages , w );
+    assert.lt( 0 , ws.overall[ w ].dataPages , w );
+} );
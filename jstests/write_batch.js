@@ -0,0 +1,50 @@
+// writeBatch applies several writes and reports each one's outcome in a single reply
+
+t = db.write_batch;
+t.drop();
+
+function batch( writes, extra ) {
+    var cmd = { writeBatch : t.getName(), writes : writes };
+    for ( var k in extra )
+        cmd[k] = extra[k];
+    return db.runCommand( cmd );
+}
+
+res = batch( [ { insert : { _id : 1, a : 1 } },
+               { insert : { _id : 2, a : 1 } },
+               { update : { q : { a : 1 }, u : { $inc : { a : 1 } }, multi : true } },
+               { update : { q : { _id : 3 }, u : { $set : { a : 5 } }, upsert : true } },
+               { remove : { q : { _id : 1 } } } ],
+             { writeConcern : { w : 1 } } );
+assert.commandWorked( res );
+assert.eq( 5, res.applied, tojson( res ) );
+assert.eq( 5, res.results.length, tojson( res ) );
+assert.eq( 2, res.results[2].n, "multi update" );
+assert( res.results[2].updatedExisting, "multi update updatedExisting" );
+assert( ! res.results[3].updatedExisting, "upsert updatedExisting" );
+assert.eq( 1, res.results[4].n, "remove" );
+assert.isnull( res.writeConcern.err, tojson( res ) );
+assert.eq( [ { _id : 2, a : 2 }, { _id : 3, a : 5 } ], t.find().sort( { _id : 1 } ).toArray() );
+
+// an ordered batch stops at the first failure
+res = batch( [ { insert : { _id : 10 } }, { insert : { _id : 10 } }, { insert : { _id : 11 } } ] );
+assert.commandWorked( res );
+assert.eq( 1, res.applied, tojson( res ) );
+assert.eq( 2, res.results.length, tojson( res ) );
+assert.eq( 11000, res.results[1].code, tojson( res ) );
+assert.eq( 0, t.find( { _id : 11 } ).count() );
+
+// an unordered one carries on
+res = batch( [ { insert : { _id : 20 } }, { insert : { _id : 20 } }, { insert : { _id : 21 } } ],
+             { ordered : false } );
+assert.eq( 2, res.applied, tojson( res ) );
+assert.eq( 3, res.results.length, tojson( res ) );
+assert( res.results[1].err, tojson( res ) );
+assert.eq( 1, t.find( { _id : 21 } ).count() );
+
+// malformed statements fail on their own
+res = batch( [ { upsert : { q : {} } }, { update : { q : { _id : 2 } } } ], { ordered : false } );
+assert.eq( 0, res.applied, tojson( res ) );
+assert.eq( 2, res.results.length, tojson( res ) );
+
+assert.commandFailed( db.runCommand( { writeBatch : t.getName(), writes : 1 } ) );
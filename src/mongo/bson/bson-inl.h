@@ -252,7 +252,7 @@ dodouble:
             BSONElement e = i.next();
             const char *p = e.fieldName();
             for( unsigned i = 0; i < n; i++ ) {
-                if( strcmp(p, fieldNames[i]) == 0 ) {
+                if( p[0] == fieldNames[i][0] && strcmp(p, fieldNames[i]) == 0 ) {
                     fields[i] = e;
                     break;
                 }
@@ -261,10 +261,18 @@ dodouble:
     }
 
     inline BSONElement BSONObj::getField(const StringData& name) const {
+        return getField(name.data(), name.size());
+    }
+
+    inline BSONElement BSONObj::getField(const char *name, unsigned len) const {
+        // next() has already measured each field name, so comparing the first byte and the
+        // length rejects nearly every other field without looking at the rest of its name
+        const char first = len ? name[0] : '\0';
         BSONObjIterator i(*this);
         while ( i.more() ) {
             BSONElement e = i.next();
-            if ( strcmp(e.fieldName(), name.data()) == 0 )
+            const char *f = e.fieldName();
+            if ( f[0] == first && e.fieldNameSize() == (int)len + 1 && memcmp(f, name, len) == 0 )
                 return e;
         }
         return BSONElement();
@@ -789,8 +797,9 @@ dodouble:
         if ( e.eoo() ) {
             const char *p = strchr(name, '.');
             if ( p ) {
-                std::string left(name, p-name);
-                BSONObj sub = getObjectField(left.c_str());
+                BSONElement left = getField(name, (unsigned)(p-name));
+                BSONType t = left.type();
+                BSONObj sub = t == Object || t == Array ? left.embeddedObject() : BSONObj();
                 return sub.isEmpty() ? BSONElement() : sub.getFieldDotted(p+1);
             }
         }
@@ -915,10 +924,16 @@ dodouble:
         return BSONFieldValue<BSONObj>( _name , b.obj() );
     }
 
-    // used by jsonString()
-    inline std::string escape( std::string s , bool escape_slash=false) {
-        StringBuilder ret;
-        for ( std::string::iterator i = s.begin(); i != s.end(); ++i ) {
+    // used by jsonString(); appends the len bytes at s to ret, escaped
+    inline void escape( StringBuilder& ret , const char* s , size_t len , bool escape_slash=false ) {
+        const char* run = s; // the bytes since the last one escaped, written together
+        const char* end = s + len;
+        for ( const char* i = s; i != end; ++i ) {
+            // most bytes need no escaping
+            if ( ( *i < 0 || *i > 0x1f ) && *i != '"' && *i != '\\' && *i != '/' )
+                continue;
+            ret.write( run , i - run );
+            run = i + 1;
             switch ( *i ) {
             case '"':
                 ret << "\\\"";
@@ -944,17 +959,19 @@ dodouble:
             case '\t':
                 ret << "\\t";
                 break;
-            default:
-                if ( *i >= 0 && *i <= 0x1f ) {
-                    //TODO: these should be utf16 code-units not bytes
-                    char c = *i;
-                    ret << "\\u00" << toHexLower(&c, 1);
-                }
-                else {
-                    ret << *i;
-                }
+            default: {
+                //TODO: these should be utf16 code-units not bytes
+                char c = *i;
+                ret << "\\u00" << toHexLower(&c, 1);
+            }
             }
         }
+        ret.write( run , end - run );
+    }
+
+    inline std::string escape( std::string s , bool escape_slash=false) {
+        StringBuilder ret;
+        escape( ret , s.data() , s.size() , escape_slash );
         return ret.str();
     }
 
@@ -91,6 +91,15 @@ namespace mongo {
             init(holder);
         }
 
+        /** Construct a BSONObj for data somewhere inside holder's buffer, e.g. one of several
+         *  objects built end to end in it.  Every BSONObj made from holder shares the buffer,
+         *  which is freed along with the last of them.
+        */
+        BSONObj(Holder* holder, const char *data) {
+            _holder = holder;
+            init(data);
+        }
+
         /** Construct an empty BSONObj -- that is, {}. */
         BSONObj();
 
@@ -150,6 +159,8 @@ namespace mongo {
             @param pretty if true we try to add some lf's and indentation
         */
         std::string jsonString( JsonStringFormat format = Strict, int pretty = 0 ) const;
+        /** appends jsonString() to s, so any number of objects can be written to one buffer */
+        void jsonString( StringBuilder& s, JsonStringFormat format = Strict, int pretty = 0 ) const;
 
         /** note: addFields always adds _id even if not specified */
         int addFields(BSONObj& from, std::set<std::string>& fields); /* returns n added */
@@ -197,6 +208,11 @@ namespace mongo {
         */
         BSONElement getField(const StringData& name) const;
 
+        /** Like getField(), for the field named by the first len bytes of name, e.g. the first
+            component of a dotted name.
+        */
+        BSONElement getField(const char *name, unsigned len) const;
+
         /** Get several fields at once. This is faster than separate getField() calls as the size of 
             elements iterated can then be calculated only once each.
             @param n number of fieldNames, and number of elements in the fields array
@@ -102,6 +102,15 @@ namespace mongo {
             _b.skip( 4 );
         }
 
+        /** @param buf where the object is built, usually on the caller's stack, until it outgrows
+         *  the size bytes there and moves to the heap.  done() costs nothing more; obj() hands out
+         *  a heap copy.  see StackBSONObjBuilder.
+         */
+        BSONObjBuilder( char *buf , int size ) : _b(_buf), _buf(buf, size), _offset( sizeof(unsigned) ), _s( this ) , _tracker(0) , _doneCalled(false) {
+            _b.appendNum((unsigned)0); // ref-count
+            _b.skip(4);
+        }
+
         BSONObjBuilder( const BSONSizeTracker & tracker ) : _b(_buf) , _buf(tracker.getSize() + sizeof(unsigned) ), _offset( sizeof(unsigned) ), _s( this ) , _tracker( (BSONSizeTracker*)(&tracker) ) , _doneCalled(false) {
             _b.appendNum((unsigned)0); // ref-count
             _b.skip(4);
@@ -553,6 +562,15 @@ namespace mongo {
             bool own = owned();
             massert( 10335 , "builder does not own memory", own );
             doneFast();
+            if ( _b.onCallersBuffer() ) {
+                // not ours to hand over, so the object gets a copy, ref-count and all
+                char *copy = (char *) malloc( _b.len() );
+                if ( copy == 0 )
+                    msgasserted( 16414 , "out of memory BSONObjBuilder::obj" );
+                memcpy( copy , _b.buf() , _b.len() );
+                _b.kill();
+                return BSONObj( (BSONObj::Holder*) copy );
+            }
             BSONObj::Holder* h = (BSONObj::Holder*)_b.buf();
             decouple(); // sets _b.buf() to NULL
             return BSONObj(h);
@@ -585,6 +603,7 @@ namespace mongo {
 
         /* assume ownership of the buffer - you must then free it (with free()) */
         char* decouple(int& l) {
+            massert( 16411 , "can't decouple a caller's buffer" , ! _b.onCallersBuffer() );
             char *x = _done();
             verify( x );
             l = _b.len();
@@ -592,6 +611,7 @@ namespace mongo {
             return x;
         }
         void decouple() {
+            massert( 16415 , "can't decouple a caller's buffer" , ! _b.onCallersBuffer() );
             _b.decouple();    // post done() call version.  be sure jsobj frees...
         }
 
@@ -689,6 +709,21 @@ namespace mongo {
         static bool numStrsReady; // for static init safety. see comments in db/jsobj.cpp
     };
 
+    template <int N>
+    struct BSONObjBuilderSpace {
+        char _space[N];
+    };
+
+    /** A BSONObjBuilder which builds in N bytes of its own, so on the stack a small temporary
+        object never touches the heap.  Past N it carries on on the heap as usual.
+    */
+    template <int N = 512>
+    class StackBSONObjBuilder : private BSONObjBuilderSpace<N>, public BSONObjBuilder {
+    public:
+        // the space base is constructed first, so it's there for BSONObjBuilder to use
+        StackBSONObjBuilder() : BSONObjBuilder( this->_space , N ) { }
+    };
+
     class BSONArrayBuilder : public BSONBuilderBase, private boost::noncopyable {
     public:
         BSONArrayBuilder() : _i(0), _b() {}
@@ -22,8 +22,8 @@
 #include "mongo/platform/atomic_word.h"
 #include "mongo/bson/bsonobjbuilder.h"
 #include "mongo/bson/oid.h"
-#include "mongo/bson/util/atomic_int.h"
 #include "mongo/db/nonce.h"
+#include "mongo/util/concurrency/threadlocal.h"
 
 #define verify MONGO_verify
 
@@ -113,11 +113,35 @@ namespace mongo {
         ourMachineAndPid = x;
     }
 
+    /**
+     * a thread's block of OID increments, reserved from the shared counter so that only one in
+     * OIDIncBlock::Size generations writes to it.  a block is used only in the second it was
+     * reserved in, so increments from two blocks can't meet in one time unless the counter goes
+     * all the way round within a second, the same as for one shared increment.
+     */
+    struct OIDIncBlock {
+        enum { Size = 256 };
+        OIDIncBlock() : next( 0 ), end( 0 ), secs( 0 ) { }
+        unsigned next;
+        unsigned end;
+        unsigned secs;
+    };
+
+    TSP_DECLARE(OIDIncBlock, oidIncBlock)
+    TSP_DEFINE(OIDIncBlock, oidIncBlock)
+
     void OID::init() {
-        static AtomicUInt inc = (unsigned) Security::getNonce();
+        static AtomicUInt32 inc( (unsigned) Security::getNonce() );
+
+        unsigned t = (unsigned) time(0);
+        OIDIncBlock *block = oidIncBlock.getMake();
+        if ( block->next == block->end || block->secs != t ) {
+            block->next = inc.fetchAndAdd( OIDIncBlock::Size );
+            block->end = block->next + OIDIncBlock::Size;
+            block->secs = t;
+        }
 
         {
-            unsigned t = (unsigned) time(0);
             unsigned char *T = (unsigned char *) &t;
             _time[0] = T[3]; // big endian order because we use memcmp() to compare OID's
             _time[1] = T[2];
@@ -128,7 +152,7 @@ namespace mongo {
         _machineAndPid = ourMachineAndPid;
 
         {
-            int new_inc = inc++;
+            unsigned new_inc = block->next++;
             unsigned char *T = (unsigned char *) &new_inc;
             _inc[0] = T[2];
             _inc[1] = T[1];
@@ -61,11 +61,38 @@ namespace mongo {
     template <typename Allocator>
     class StringBuilderImpl;
 
+    /** malloc, but for a first buffer the caller may hand it, which it uses until outgrown */
     class TrivialAllocator { 
     public:
-        void* Malloc(size_t sz) { return malloc(sz); }
-        void* Realloc(void *p, size_t sz) { return realloc(p, sz); }
-        void Free(void *p) { free(p); }
+        TrivialAllocator() : _first(0), _firstSize(0) { }
+        void startIn(char *first, size_t firstSize) {
+            _first = first;
+            _firstSize = firstSize;
+        }
+        bool isCallers(const void *p) const { return p && p == _first; }
+
+        void* Malloc(size_t sz) {
+            if( _first && sz <= _firstSize ) return _first;
+            return malloc(sz);
+        }
+        void* Realloc(void *p, size_t sz) {
+            if( isCallers(p) ) {
+                if( sz <= _firstSize ) return p;
+                void *d = malloc(sz);
+                if ( d == 0 )
+                    msgasserted( 16412 , "out of memory TrivialAllocator::Realloc" );
+                memcpy(d, p, _firstSize);
+                return d;
+            }
+            return realloc(p, sz);
+        }
+        void Free(void *p) {
+            if( !isCallers(p) )
+                free(p);
+        }
+    private:
+        char *_first;
+        size_t _firstSize;
     };
 
     class StackAllocator {
@@ -112,8 +139,19 @@ namespace mongo {
             }
             l = 0;
         }
+        /** starts out in buf, of bufSize bytes, which stays the caller's; see TrivialAllocator */
+        _BufBuilder(char *buf, int bufSize) : size(bufSize) {
+            al.startIn(buf, bufSize);
+            data = (char *) al.Malloc(size);
+            if( data == 0 )
+                msgasserted(16413, "out of memory BufBuilder");
+            l = 0;
+        }
         ~_BufBuilder() { kill(); }
 
+        /** @return true while still in the buffer the caller constructed it with */
+        bool onCallersBuffer() const { return al.isCallers(data); }
+
         void kill() {
             if ( data ) {
                 al.Free(data);
@@ -147,6 +185,14 @@ namespace mongo {
         /* assume ownership of the buffer - you must then free() it */
         void decouple() { data = 0; }
 
+        /** frees the buffer and takes over buf, of bufSize bytes, which came from al's Malloc */
+        void adopt( char *buf, int bufSize ) {
+            kill();
+            data = buf;
+            size = bufSize;
+            l = 0;
+        }
+
         void appendUChar(unsigned char j) {
             *((unsigned char*)grow(sizeof(unsigned char))) = j;
         }
@@ -322,6 +368,9 @@ namespace mongo {
         void reset( int maxSize = 0 ) { _buf.reset( maxSize ); }
 
         std::string str() const { return std::string(_buf.data, _buf.l); }
+
+        /** the characters appended so far, not null terminated. valid until the next append */
+        const char* data() const { return _buf.data; }
         
         int len() const { return _buf.l; }
 
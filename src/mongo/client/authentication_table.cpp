@@ -45,6 +45,11 @@ namespace mongo {
         return mapFindWithDefault( _dbs, dbname, Auth() );
     }
 
+    Auth::Level AuthenticationTable::getLevelForDb( const std::string& dbname ) const {
+        DBAuthMap::const_iterator i = _dbs.find( dbname );
+        return i == _dbs.end() ? Auth::NONE : i->second.level;
+    }
+
     // Takes the authentication state from the given BSONObj
     void AuthenticationTable::setFromBSON( const BSONObj& obj ) {
         _dbs.clear();
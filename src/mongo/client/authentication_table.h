@@ -46,6 +46,9 @@ namespace mongo {
 
         Auth getAuthForDb( const std::string& dbname ) const;
 
+        /** @return the level of getAuthForDb( dbname ), without copying the user name */
+        Auth::Level getLevelForDb( const std::string& dbname ) const;
+
         // Takes the authentication state from the given BSONObj, replcacing whatever state it had.
         void setFromBSON( const BSONObj& obj );
 
@@ -22,6 +22,7 @@
 #include "connpool.h"
 #include "syncclusterconnection.h"
 #include "../s/shard.h"
+#include "mongo/util/timer.h"
 
 namespace mongo {
 
@@ -119,7 +120,28 @@ namespace mongo {
         _created++;
     }
 
+    int PoolForHost::numToWarm() const {
+        // only hosts we've used; the first request to a host still connects itself
+        if ( _created == 0 )
+            return 0;
+        int n = (int) min( _minPerHost, _maxPerHost ) - numAvailable() - _connecting;
+        if ( _maxConnecting )
+            n = min( n, (int) _maxConnecting - _connecting );
+        return max( n, 0 );
+    }
+
+    void PoolForHost::appendStats( BSONObjBuilder& b ) const {
+        b.append( "available" , numAvailable() );
+        b.appendNumber( "created" , numCreated() );
+        b.append( "connecting" , _connecting );
+        b.appendNumber( "warmed" , _warmed );
+        b.appendNumber( "waits" , _waits );
+        b.appendNumber( "waitMicros" , (long long) _waitMicros );
+    }
+
     unsigned PoolForHost::_maxPerHost = 50;
+    unsigned PoolForHost::_minPerHost = 0;
+    unsigned PoolForHost::_maxConnecting = 0;
 
     // ------ DBConnectionPool ------
 
@@ -128,23 +150,56 @@ namespace mongo {
     DBConnectionPool::DBConnectionPool() 
         : _mutex("DBConnectionPool") , 
           _name( "dbconnectionpool" ) , 
-          _hooks( new list<DBConnectionHook*>() ) { 
+          _hooks( new list<DBConnectionHook*>() ),
+          _waiting( 0 ) {
     }
 
     DBClientBase* DBConnectionPool::_get(const string& ident , double socketTimeout ) {
         verify( ! inShutdown() );
         scoped_lock L(_mutex);
         PoolForHost& p = _pools[PoolKey(ident,socketTimeout)];
-        return p.get( this , socketTimeout );
+        DBClientBase *c = p.get( this , socketTimeout );
+        if ( c == 0 && p.atConnectingLimit() ) {
+            // one of the connections being made, or one released meanwhile, will likely
+            // serve us sooner than yet another connect to a host which may be struggling
+            Timer t;
+            _waiting++;
+            while ( c == 0 && p.atConnectingLimit() && ! inShutdown() ) {
+                _connectingDone.timed_wait( L.boost() , boost::posix_time::seconds( 1 ) );
+                c = p.get( this , socketTimeout );
+            }
+            _waiting--;
+            p.waited( t.micros() );
+        }
+        if ( c == 0 )
+            p.startedConnecting();
+        return c;
     }
 
-    DBClientBase* DBConnectionPool::_finishCreate( const string& host , double socketTimeout , DBClientBase* conn ) {
-        {
-            scoped_lock L(_mutex);
-            PoolForHost& p = _pools[PoolKey(host,socketTimeout)];
-            p.createdOne( conn );
+    DBClientBase* DBConnectionPool::_create( const string& ident , const ConnectionString& cs , double socketTimeout , string& errmsg ) {
+        DBClientBase *c = 0;
+        try {
+            c = cs.connect( errmsg, socketTimeout );
         }
-        
+        catch ( ... ) {
+            _doneConnecting( ident , socketTimeout , 0 );
+            throw;
+        }
+        _doneConnecting( ident , socketTimeout , c );
+        return c;
+    }
+
+    void DBConnectionPool::_doneConnecting( const string& ident , double socketTimeout , DBClientBase* c ) {
+        scoped_lock L(_mutex);
+        PoolForHost& p = _pools[PoolKey(ident,socketTimeout)];
+        p.doneConnecting();
+        if ( c )
+            p.createdOne( c );
+        if ( _waiting )
+            _connectingDone.notify_all();
+    }
+
+    DBClientBase* DBConnectionPool::_finishCreate( const string& host , double socketTimeout , DBClientBase* conn ) {
         try {
             onCreate( conn );
             onHandedOut( conn );
@@ -171,7 +226,7 @@ namespace mongo {
         }
 
         string errmsg;
-        c = url.connect( errmsg, socketTimeout );
+        c = _create( url.toString() , url , socketTimeout , errmsg );
         uassert( 13328 ,  _name + ": connect failed " + url.toString() + " : " + errmsg , c );
 
         return _finishCreate( url.toString() , socketTimeout , c );
@@ -192,9 +247,12 @@ namespace mongo {
 
         string errmsg;
         ConnectionString cs = ConnectionString::parse( host , errmsg );
-        uassert( 13071 , (string)"invalid hostname [" + host + "]" + errmsg , cs.isValid() );
+        if ( ! cs.isValid() ) {
+            _doneConnecting( host , socketTimeout , 0 );
+            uasserted( 13071 , (string)"invalid hostname [" + host + "]" + errmsg );
+        }
 
-        c = cs.connect( errmsg, socketTimeout );
+        c = _create( host , cs , socketTimeout , errmsg );
         if ( ! c )
             throw SocketException( SocketException::CONNECT_ERROR , host , 11002 , str::stream() << _name << " error: " << errmsg );
         return _finishCreate( host , socketTimeout , c );
@@ -208,6 +266,8 @@ namespace mongo {
         }
         scoped_lock L(_mutex);
         _pools[PoolKey(host,c->getSoTimeout())].done(this,c);
+        if ( _waiting )
+            _connectingDone.notify_all();
     }
 
 
@@ -274,8 +334,7 @@ namespace mongo {
                 string s = str::stream() << i->first.ident << "::" << i->first.timeout;
 
                 BSONObjBuilder temp( bb.subobjStart( s ) );
-                temp.append( "available" , i->second.numAvailable() );
-                temp.appendNumber( "created" , i->second.numCreated() );
+                i->second.appendStats( temp );
                 temp.done();
 
                 avail += i->second.numAvailable();
@@ -381,6 +440,54 @@ namespace mongo {
                 // we don't care if there was a socket error
             }
         }
+
+        if ( PoolForHost::getMinPerHost() > 0 )
+            _warm();
+    }
+
+    void DBConnectionPool::_warm() {
+        vector<PoolKey> toMake;
+        {
+            scoped_lock lk( _mutex );
+            for ( PoolMap::iterator i=_pools.begin(); i!=_pools.end(); ++i ) {
+                int n = i->second.numToWarm();
+                for ( int j = 0; j < n; j++ ) {
+                    i->second.startedConnecting();
+                    toMake.push_back( i->first );
+                }
+            }
+        }
+
+        for ( size_t i=0; i<toMake.size(); i++ ) {
+            const PoolKey& k = toMake[i];
+            string errmsg;
+            ConnectionString cs = ConnectionString::parse( k.ident , errmsg );
+            if ( ! cs.isValid() ) {
+                _doneConnecting( k.ident , k.timeout , 0 );
+                continue;
+            }
+
+            DBClientBase *c = 0;
+            try {
+                c = _create( k.ident , cs , k.timeout , errmsg );
+                if ( c == 0 ) {
+                    LOG(1) << _name << ": couldn't warm a connection to " << k.ident << ": " << errmsg << endl;
+                    continue;
+                }
+                onCreate( c );
+            }
+            catch ( std::exception& e ) {
+                LOG(1) << _name << ": couldn't warm a connection to " << k.ident << ": " << e.what() << endl;
+                delete c;
+                continue;
+            }
+
+            {
+                scoped_lock lk( _mutex );
+                _pools[k].warmedOne();
+            }
+            release( k.ident , c );
+        }
     }
 
     // ------ ScopedDbConnection ------
@@ -19,6 +19,8 @@
 
 #include <stack>
 
+#include <boost/thread/condition.hpp>
+
 #include "mongo/util/background.h"
 #include "mongo/client/dbclientinterface.h"
 
@@ -34,12 +36,16 @@ namespace mongo {
     class PoolForHost {
     public:
         PoolForHost()
-            : _created(0) {}
+            : _created(0), _connecting(0), _waits(0), _waitMicros(0), _warmed(0) {}
 
         PoolForHost( const PoolForHost& other ) {
             verify(other._pool.size() == 0);
             _created = other._created;
             verify( _created == 0 );
+            _connecting = 0;
+            _waits = 0;
+            _waitMicros = 0;
+            _warmed = 0;
         }
 
         ~PoolForHost();
@@ -62,8 +68,31 @@ namespace mongo {
         
         void getStaleConnections( vector<DBClientBase*>& stale );
 
+        /** connections being made to this host, by get() misses and by warming */
+        int numConnecting() const { return _connecting; }
+        bool atConnectingLimit() const { return _maxConnecting && _connecting >= (int) _maxConnecting; }
+        void startedConnecting() { _connecting++; }
+        void doneConnecting() { verify( _connecting > 0 ); _connecting--; }
+
+        /** how many connections to make so that _minPerHost are available */
+        int numToWarm() const;
+        void warmedOne() { _warmed++; }
+
+        /** a get() had to wait for micros because of the connecting limit */
+        void waited( unsigned long long micros ) { _waits++; _waitMicros += micros; }
+
+        void appendStats( BSONObjBuilder& b ) const;
+
         static void setMaxPerHost( unsigned max ) { _maxPerHost = max; }
         static unsigned getMaxPerHost() { return _maxPerHost; }
+
+        /** connections to keep available to each host used, made between requests; 0 for none */
+        static void setMinPerHost( unsigned min ) { _minPerHost = min; }
+        static unsigned getMinPerHost() { return _minPerHost; }
+
+        /** most connections to make to one host at once; 0 for no limit */
+        static void setMaxConnecting( unsigned max ) { _maxConnecting = max; }
+        static unsigned getMaxConnecting() { return _maxConnecting; }
     private:
 
         struct StoredConnection {
@@ -80,7 +109,14 @@ namespace mongo {
         long long _created;
         ConnectionString::ConnectionType _type;
 
+        int _connecting;
+        long long _waits;
+        unsigned long long _waitMicros;
+        long long _warmed;
+
         static unsigned _maxPerHost;
+        static unsigned _minPerHost;
+        static unsigned _maxConnecting;
     };
 
     class DBConnectionHook {
@@ -141,9 +177,21 @@ namespace mongo {
     private:
         DBConnectionPool( DBConnectionPool& p );
         
+        /**
+         * @return a pooled connection, or NULL after reserving a connecting slot, which the
+         * caller must give back through _create() or _doneConnecting().  waits while the host
+         * is at its connecting limit.
+         */
         DBClientBase* _get( const string& ident , double socketTimeout );
 
+        /** connects, giving back the slot _get() reserved either way */
+        DBClientBase* _create( const string& ident , const ConnectionString& cs , double socketTimeout , string& errmsg );
+        void _doneConnecting( const string& ident , double socketTimeout , DBClientBase* c );
+
         DBClientBase* _finishCreate( const string& ident , double socketTimeout, DBClientBase* conn );
+
+        /** makes connections, outside of any request, to hosts with fewer than getMinPerHost() */
+        void _warm();
         
         struct PoolKey {
             PoolKey( string i , double t ) : ident( i ) , timeout( t ) {}
@@ -162,6 +210,10 @@ namespace mongo {
         
         PoolMap _pools;
 
+        // signalled when a connection is made or released, for _get()s at a connecting limit
+        boost::condition _connectingDone;
+        int _waiting;
+
         // pointers owned by me, right now they leak on shutdown
         // _hooks itself also leaks because it creates a shutdown race condition
         list<DBConnectionHook*> * _hooks; 
@@ -28,6 +28,7 @@
 #include "mongo/db/namespacestring.h"
 #include "mongo/s/util.h"
 #include "mongo/util/md5.hpp"
+#include "mongo/util/trace_span.h"
 
 #ifdef MONGO_SSL
 // TODO: Remove references to cmdline from the client.
@@ -638,6 +639,7 @@ namespace mongo {
 
     bool DBClientConnection::_connect( string& errmsg ) {
         _serverString = _server.toString();
+        clearEarlyReplies(); // they were for the old socket
 
         // we keep around SockAddr for connection life -- maybe MessagingPort
         // requires that?
@@ -667,6 +669,16 @@ namespace mongo {
         }
 #endif
 
+        if ( cmdLine.networkCompression ) {
+            BSONObjBuilder b;
+            b.append( "isMaster", 1 );
+            appendCompressionOffer( b );
+            BSONObj info;
+            // servers which don't compress ignore the offer
+            if ( DBClientWithCommands::runCommand( "admin", b.obj(), info ) && offersCompression( info ) )
+                p->setCompressing( true );
+        }
+
         return true;
     }
 
@@ -754,8 +766,8 @@ namespace mongo {
             const BSONObj *fieldsToReturn,
             int queryOptions ) {
 
-        // mask options
-        queryOptions &= (int)( QueryOption_NoCursorTimeout | QueryOption_SlaveOk );
+        // mask options.  OplogReplay can stay, for reading an oplog from a point onwards
+        queryOptions &= (int)( QueryOption_NoCursorTimeout | QueryOption_SlaveOk | QueryOption_OplogReplay );
 
         auto_ptr<DBClientCursor> c( this->query(ns, query, 0, 0, fieldsToReturn, queryOptions) );
         uassert( 16090, "socket error for mapping query", c.get() );
@@ -781,8 +793,8 @@ namespace mongo {
             return DBClientBase::query( f, ns, query, fieldsToReturn, queryOptions );
         }
 
-        // mask options
-        queryOptions &= (int)( QueryOption_NoCursorTimeout | QueryOption_SlaveOk );
+        // mask options.  OplogReplay can stay, for reading an oplog from a point onwards
+        queryOptions &= (int)( QueryOption_NoCursorTimeout | QueryOption_SlaveOk | QueryOption_OplogReplay );
         queryOptions |= (int)QueryOption_Exhaust;
 
         auto_ptr<DBClientCursor> c( this->query(ns, query, 0, 0, fieldsToReturn, queryOptions) );
@@ -805,11 +817,7 @@ namespace mongo {
             }
         }
         catch(std::exception&) {
-            /* connection CANNOT be used anymore as more data may be on the way from the server.
-               we have to reconnect.
-               */
-            _failed = true;
-            p->shutdown();
+            c.reset();
             throw;
         }
 
@@ -1004,6 +1012,8 @@ namespace mongo {
 
     void assembleRequest( const string &ns, BSONObj query, int nToReturn, int nToSkip, const BSONObj *fieldsToReturn, int queryOptions, Message &toSend ) {
         CHECK_OBJECT( query , "assembleRequest query" );
+        if ( TraceSpans::propagate )
+            query = TraceSpans::tagQuery( query , str::endsWith( ns , ".$cmd" ) );
         // see query.h for the protocol we are using here.
         BufBuilder b;
         int opts = queryOptions;
@@ -1026,6 +1036,8 @@ namespace mongo {
             _failed = true;
             throw;
         }
+        if ( doesOpGetAResponse( toSend.operation() ) )
+            _pending.insert( toSend.header()->id );
     }
 
     void DBClientConnection::sayPiggyBack( Message &toSend ) {
@@ -1036,12 +1048,69 @@ namespace mongo {
         return port().recv(m);
     }
 
+    bool DBClientConnection::recvReplyTo( Message &m, int requestId ) {
+        for ( deque< pair<int, Message*> >::iterator i = _earlyReplies.begin(); i != _earlyReplies.end(); ++i ) {
+            if ( i->first == requestId ) {
+                m = *i->second;
+                delete i->second;
+                _earlyReplies.erase( i );
+                return true;
+            }
+        }
+
+        while ( 1 ) {
+            Message r;
+            if ( ! port().recv( r ) ) {
+                _failed = true;
+                return false;
+            }
+            int responseTo = r.header()->responseTo;
+            _pending.erase( responseTo );
+            if ( responseTo == requestId ) {
+                m = r;
+                return true;
+            }
+            if ( _earlyReplies.size() >= (size_t) MaxEarlyReplies ) {
+                LOG(1) << "dropping unclaimed reply to " << _earlyReplies.front().first << " from " << _serverString << endl;
+                delete _earlyReplies.front().second;
+                _earlyReplies.pop_front();
+            }
+            _earlyReplies.push_back( make_pair( responseTo, new Message( r ) ) );
+        }
+    }
+
+    void DBClientConnection::abandonExhaust() {
+        /* connection CANNOT be used anymore as more data may be on the way from the server.
+           we have to reconnect.
+           */
+        _failed = true;
+        p->shutdown();
+    }
+
+    void DBClientConnection::clearEarlyReplies() {
+        for ( deque< pair<int, Message*> >::iterator i = _earlyReplies.begin(); i != _earlyReplies.end(); ++i )
+            delete i->second;
+        _earlyReplies.clear();
+        _pending.clear();
+    }
+
     bool DBClientConnection::call( Message &toSend, Message &response, bool assertOk , string * actualServer ) {
         /* todo: this is very ugly messagingport::call returns an error code AND can throw
                  an exception.  we should make it return void and just throw an exception anytime
                  it fails
         */
         checkConnection();
+        TraceSpan span( TraceSpans::Remote );
+        if ( ! _pending.empty() || ! _earlyReplies.empty() ) {
+            // other requests are outstanding, so the next reply may not be ours
+            say( toSend );
+            if ( ! recvReplyTo( response, toSend.header()->id ) ) {
+                if ( assertOk )
+                    uasserted( 10278 , str::stream() << "dbclient error communicating with server: " << getServerAddress() );
+                return false;
+            }
+            return true;
+        }
         try {
             if ( !port().call(toSend, response) ) {
                 _failed = true;
@@ -19,14 +19,22 @@
 
 #include "mongo/client/dbclient_rs.h"
 
+#include <algorithm>
 #include <fstream>
 
+#include <boost/thread/thread.hpp>
+
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
 #include "mongo/bson/util/builder.h"
 #include "mongo/client/connpool.h"
 #include "mongo/client/dbclientcursor.h"
 #include "mongo/db/dbmessage.h"
 #include "mongo/db/jsobj.h"
 #include "mongo/db/json.h"
+#include "mongo/platform/atomic_word.h"
 #include "mongo/util/background.h"
 #include "mongo/util/scopeguard.h"
 #include "mongo/util/timer.h"
@@ -90,9 +98,10 @@ namespace mongo {
 
     ReplicaSetMonitor::ReplicaSetMonitor( const string& name , const vector<HostAndPort>& servers )
         : _lock( "ReplicaSetMonitor instance" ),
-          _checkConnectionLock( "ReplicaSetMonitor check connection lock" ),
+          _checksRunning( 0 ),
           _name( name ), _master(-1),
-          _nextSlave(0), _localThresholdMillis(cmdLine.defaultLocalThresholdMillis) {
+          _nextSlave(0), _localThresholdMillis(cmdLine.defaultLocalThresholdMillis),
+          _readSamples(0), _readPercentileMillis(0) {
 
         uassert( 13642 , "need at least 1 node for a replica set" , servers.size() > 0 );
 
@@ -108,7 +117,7 @@ namespace mongo {
             // Don't check servers we have already
             if( _find_inlock( servers[i] ) >= 0 ) continue;
 
-            auto_ptr<DBClientConnection> conn( new DBClientConnection( true , 0, 5.0 ) );
+            auto_ptr<DBClientConnection> conn( new DBClientConnection( true , 0, CheckTimeoutSecs ) );
             try{
                 if( ! conn->connect( servers[i] , errmsg ) ){
                     throw DBException( errmsg, 15928 );
@@ -133,6 +142,12 @@ namespace mongo {
     }
 
     ReplicaSetMonitor::~ReplicaSetMonitor() {
+        {
+            // checks a _check() stopped waiting for still use the members
+            scoped_lock lk( _lock );
+            while ( _checksRunning > 0 )
+                _checkDone.wait( lk.boost() );
+        }
         _nodes.clear();
         _master = -1;
     }
@@ -294,14 +309,18 @@ namespace mongo {
         LOG(2) << "dbclient_rs getSlave " << getServerAddress() << endl;
 
         HostAndPort fallbackNode;
+        int fallbackPing = 0;
         scoped_lock lk( _lock );
 
         for ( size_t itNode = 0; itNode < _nodes.size(); ++itNode ) {
             _nextSlave = ( _nextSlave + 1 ) % _nodes.size();
             if ( _nextSlave != _master ) {
                 if ( _nodes[ _nextSlave ].okForSecondaryQueries() ) {
-                    // found an ok slave; may not be local.
-                    fallbackNode = _nodes[ _nextSlave ].addr;
+                    // found an ok slave; may not be local.  fall back to the nearest
+                    if ( fallbackNode.empty() || _nodes[ _nextSlave ].pingTimeMillis < fallbackPing ) {
+                        fallbackNode = _nodes[ _nextSlave ].addr;
+                        fallbackPing = _nodes[ _nextSlave ].pingTimeMillis;
+                    }
                     if ( ! preferLocal )
                         return fallbackNode;
                     else if ( _nodes[ _nextSlave ].isLocalSecondary_inlock( _localThresholdMillis ) ) {
@@ -309,7 +328,7 @@ namespace mongo {
                         log(2) << "dbclient_rs getSlave found local secondary for queries: "
                                << _nextSlave << ", ping time: "
                                << _nodes[ _nextSlave ].pingTimeMillis << endl;
-                        return fallbackNode;
+                        return _nodes[ _nextSlave ].addr;
                     }
                 }
                 else
@@ -319,7 +338,7 @@ namespace mongo {
         }
 
         if ( ! fallbackNode.empty() ) {
-            // use a non-local secondary, even if local was preferred
+            // use the nearest non-local secondary, even if local was preferred
             log(1) << "dbclient_rs getSlave falling back to a non-local secondary node" << endl;
             return fallbackNode;
         }
@@ -345,6 +364,51 @@ namespace mongo {
         }
     }
 
+    void ReplicaSetMonitor::noteSecondaryReadMillis( int millis ) {
+        scoped_lock lk( _lock );
+        if ( _readMillis.size() < (size_t) ReadSamples )
+            _readMillis.push_back( millis );
+        else
+            _readMillis[ _readSamples % ReadSamples ] = millis;
+        _readSamples++;
+
+        if ( _readSamples % MinReadSamples == 0 ) {
+            vector<int> v = _readMillis;
+            vector<int>::iterator p = v.begin() + v.size() * 95 / 100;
+            std::nth_element( v.begin() , p , v.end() );
+            _readPercentileMillis = *p;
+        }
+    }
+
+    int ReplicaSetMonitor::getHedgeDelayMillis( const HostAndPort& member ) {
+        scoped_lock lk( _lock );
+        // millisecond times round down, so even a set answering everything at once waits a little
+        if ( _readSamples >= (unsigned) MinReadSamples )
+            return max( _readPercentileMillis , 2 );
+
+        int ping = 0;
+        for ( unsigned i = 0; i < _nodes.size(); i++ ) {
+            if ( _nodes[i].addr == member )
+                ping = _nodes[i].pingTimeMillis;
+        }
+        return 4 * ping + 10;
+    }
+
+    HostAndPort ReplicaSetMonitor::getHedgeTarget( const HostAndPort& member ) {
+        scoped_lock lk( _lock );
+        HostAndPort nearest;
+        int nearestPing = 0;
+        for ( unsigned i = 0; i < _nodes.size(); i++ ) {
+            if ( (int) i == _master || _nodes[i].addr == member || ! _nodes[i].okForSecondaryQueries() )
+                continue;
+            if ( nearest.empty() || _nodes[i].pingTimeMillis < nearestPing ) {
+                nearest = _nodes[i].addr;
+                nearestPing = _nodes[i].pingTimeMillis;
+            }
+        }
+        return nearest;
+    }
+
     void ReplicaSetMonitor::_checkStatus( const string& hostAddr ) {
         BSONObj status;
 
@@ -500,7 +564,7 @@ namespace mongo {
 
             // Connect to new node
             HostAndPort h( *i );
-            DBClientConnection * newConn = new DBClientConnection( true, 0, 5.0 );
+            DBClientConnection * newConn = new DBClientConnection( true, 0, CheckTimeoutSecs );
 
             string errmsg;
             try{
@@ -522,11 +586,18 @@ namespace mongo {
             string& maybePrimary, bool verbose, int nodesOffset ) {
 
         verify( conn );
-        scoped_lock lk( _checkConnectionLock );
         bool isMaster = false;
         bool changed = false;
         bool errorOccured = false;
 
+        {
+            scoped_lock lk( _lock );
+            while ( _connsInCheck.count( conn ) )
+                _checkDone.wait( lk.boost() );
+            _connsInCheck.insert( conn );
+        }
+        ON_BLOCK_EXIT_OBJ( *this, &ReplicaSetMonitor::_doneChecking, conn );
+
         if ( nodesOffset >= 0 ){
             scoped_lock lk( _lock );
             if ( !_checkConnMatch_inlock( conn, nodesOffset )) {
@@ -615,99 +686,45 @@ namespace mongo {
     void ReplicaSetMonitor::_check( bool checkAllSecondaries ) {
         LOG(1) <<  "_check : " << getServerAddress() << endl;
 
-        int newMaster = -1;
-        shared_ptr<DBClientConnection> nodeConn;
-        
         for ( int retry = 0; retry < 2; retry++ ) {
-            bool triedQuickCheck = false;
-
-            if ( !checkAllSecondaries ) {
+            {
                 scoped_lock lk( _lock );
-                if ( _master >= 0 && _nodes[_master].ok ) {
-                  /* Nothing else to do since another thread already
-                   * found a usable _master
-                   */
-                  return;
-                }
-            }
-
-            for ( unsigned i = 0; /* should not check while outside of lock! */ ; i++ ) {
-                {
-                    scoped_lock lk( _lock );
-                    if ( i >= _nodes.size() ) break;
-                    nodeConn = _nodes[i].conn;
+                if ( !checkAllSecondaries && _masterOk_inlock() ) {
+                    /* Nothing else to do since another thread already
+                     * found a usable _master
+                     */
+                    return;
                 }
 
-                string maybePrimary;
-                if ( _checkConnection( nodeConn.get(), maybePrimary, retry, i ) ) {
-                    scoped_lock lk( _lock );
-                    if ( _checkConnMatch_inlock( nodeConn.get(), i )) {
-                        newMaster = i;
-                        if ( newMaster != _master ) {
-                            log() << "Primary for replica set " << _name
-                                  << " changed to " << _nodes[newMaster].addr << endl;
+                shared_ptr<CheckRound> round = _round;
+                if ( ! round || round->left == 0 ) {
+                    round.reset( new CheckRound() );
+                    _round = round;
+                    for ( unsigned i = 0; i < _nodes.size(); i++ ) {
+                        try {
+                            boost::thread thr( boost::bind( &ReplicaSetMonitor::_checkInBackground, this,
+                                                            _nodes[i].conn, i, retry > 0, round ) );
                         }
-                        _master = i;
-
-                        if ( !checkAllSecondaries )
-                            return;
-                    }
-                    else {
-                        /*
-                         * Somebody modified _nodes and most likely set the new
-                         * _master, so try again.
-                         */
-                        break;
+                        catch ( boost::thread_resource_error& ) {
+                            warning() << "couldn't start a thread to check " << _nodes[i].addr
+                                      << " in replica set " << _name << endl;
+                            continue;
+                        }
+                        round->left++;
+                        _checksRunning++;
                     }
                 }
 
-
-                if ( ! triedQuickCheck && ! maybePrimary.empty() ) {
-                    int probablePrimaryIdx = -1;
-                    shared_ptr<DBClientConnection> probablePrimaryConn;
-
-                    {
-                        scoped_lock lk( _lock );
-                        probablePrimaryIdx = _find_inlock( maybePrimary );
-                        probablePrimaryConn = _nodes[probablePrimaryIdx].conn;
-                    }
-
-                    if ( probablePrimaryIdx >= 0 ) {
-                        triedQuickCheck = true;
-
-                        string dummy;
-                        if ( _checkConnection( probablePrimaryConn.get(), dummy,
-                                false, probablePrimaryIdx ) ) {
-
-                            scoped_lock lk( _lock );
-
-                            if ( _checkConnMatch_inlock( probablePrimaryConn.get(),
-                                                         probablePrimaryIdx )) {
-                              
-
-                                newMaster = probablePrimaryIdx;
-                                if ( newMaster != _master ) {
-                                    log() << "Primary for replica set " << _name << " changed to " << _nodes[newMaster].addr << endl;
-                                }
-                                _master = probablePrimaryIdx;
-
-                                if ( ! checkAllSecondaries )
-                                    return;
-                            }
-                            else {
-                                /*
-                                 * Somebody modified _nodes and most likely set the
-                                 * new _master, so try again.
-                                 */
-                                break;
-                            }
-                        }
-                    }
+                // a dead or slow member can't hold up learning the primary from the others
+                Timer t;
+                while ( round->left > 0 && ( checkAllSecondaries || ! _masterOk_inlock() ) &&
+                        t.seconds() < 2 * CheckTimeoutSecs ) {
+                    _checkDone.timed_wait( lk.boost() , boost::posix_time::seconds( 1 ) );
                 }
+
+                if ( _masterOk_inlock() )
+                    return;
             }
-            
-            if ( newMaster >= 0 )
-                return;
 
             sleepsecs( 1 );
         }
@@ -719,6 +736,36 @@ namespace mongo {
         }
     }
 
+    void ReplicaSetMonitor::_checkInBackground( shared_ptr<DBClientConnection> conn , unsigned nodesOffset ,
+                                                bool verbose , shared_ptr<CheckRound> round ) {
+        bool isMaster = false;
+        try {
+            string maybePrimary;
+            isMaster = _checkConnection( conn.get(), maybePrimary, verbose, nodesOffset );
+        }
+        catch ( std::exception& e ) {
+            log( ! verbose ) << "ReplicaSetMonitor check of " << conn->toString() << " failed: " << e.what() << endl;
+        }
+
+        scoped_lock lk( _lock );
+        if ( isMaster && _checkConnMatch_inlock( conn.get(), nodesOffset ) ) {
+            if ( (int)nodesOffset != _master ) {
+                log() << "Primary for replica set " << _name
+                      << " changed to " << _nodes[nodesOffset].addr << endl;
+            }
+            _master = nodesOffset;
+        }
+        round->left--;
+        _checksRunning--;
+        _checkDone.notify_all();
+    }
+
+    void ReplicaSetMonitor::_doneChecking( DBClientConnection* conn ) {
+        scoped_lock lk( _lock );
+        _connsInCheck.erase( conn );
+        _checkDone.notify_all();
+    }
+
     void ReplicaSetMonitor::check( bool checkAllSecondaries ) {
         shared_ptr<DBClientConnection> masterConn;
 
@@ -838,6 +885,63 @@ namespace mongo {
     // ----- DBClientReplicaSet ---------
     // --------------------------------
 
+    bool DBClientReplicaSet::_hedgedReads = false;
+
+    static AtomicUInt64 hedgeableReads;     // slaveOk reads which could have been hedged
+    static AtomicUInt64 readsHedged;        // those sent to a second secondary
+    static AtomicUInt64 hedgeWins;          // hedged reads the second secondary answered first
+    static AtomicUInt64 loserCursorsKilled;
+    static AtomicUInt64 losersDropped;      // closed without reading, too many were being read
+    static AtomicUInt32 losersFinishing;
+
+    // replies to the losing side of hedged reads being read at once, beyond which they're dropped
+    static const unsigned MaxLosersFinishing = 64;
+
+    /**
+     * waits up to millis, or with -1 indefinitely, for a reply to come on a or b (which may be 0)
+     * @return 0 if a has something to read, 1 if b does, -1 if neither came in time
+     */
+    static int waitForReply( DBClientConnection* a , DBClientConnection* b , int millis ) {
+        int fa = a->port().psock->rawFD();
+        int fb = b ? b->port().psock->rawFD() : -1;
+#ifdef _WIN32
+        fd_set fds;
+        FD_ZERO( &fds );
+        FD_SET( fa , &fds );
+        if ( b )
+            FD_SET( fb , &fds );
+        timeval tv;
+        tv.tv_sec = millis / 1000;
+        tv.tv_usec = ( millis % 1000 ) * 1000;
+        int n = select( 0 , &fds , 0 , 0 , millis < 0 ? 0 : &tv );
+        if ( n == 0 )
+            return -1;
+        // on an error, a's recv will say what's wrong
+        return n < 0 || FD_ISSET( fa , &fds ) ? 0 : 1;
+#else
+        pollfd fds[2];
+        fds[0].fd = fa;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        fds[1].fd = fb;
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+        int n = poll( fds , b ? 2 : 1 , millis );
+        if ( n == 0 )
+            return -1;
+        return n < 0 || fds[0].revents ? 0 : 1;
+#endif
+    }
+
+    /** copies a message held in a single buffer, as queries are */
+    static void copyMessage( Message& from , Message& to ) {
+        MsgData* d = from.singleData();
+        MsgData* c = (MsgData*) malloc( d->len );
+        verify( c );
+        memcpy( c , d , d->len );
+        to.setData( c , true );
+    }
+
     DBClientReplicaSet::DBClientReplicaSet( const string& name , const vector<HostAndPort>& servers, double so_timeout )
         : _monitor( ReplicaSetMonitor::get( name , servers ) ),
           _so_timeout( so_timeout ) {
@@ -889,6 +993,112 @@ namespace mongo {
     }
 
 
+    DBClientConnection * DBClientReplicaSet::checkHedge() {
+        HostAndPort h = _monitor->getHedgeTarget( _slaveHost );
+        if ( h.empty() )
+            return 0;
+
+        if ( h == _hedgeHost && _hedge && ! _hedge->isFailed() )
+            return _hedge.get();
+
+        _hedgeHost = h;
+        _hedge.reset( new DBClientConnection( true , this , _so_timeout ) );
+        _hedge->connect( _hedgeHost );
+        _auth( _hedge.get() );
+        return _hedge.get();
+    }
+
+    bool DBClientReplicaSet::_hedgedRecv( Message& toSend , int requestId , Message& response , string* actualServer ) {
+        DBClientConnection* winner = _slave.get();
+        int winnerId = requestId;
+        Timer t;
+
+        // with other replies outstanding, something to read needn't be the answer to this
+        if ( winner->onlyAwaiting( requestId ) ) {
+            hedgeableReads.fetchAndAdd( 1 );
+            if ( waitForReply( winner , 0 , _monitor->getHedgeDelayMillis( _slaveHost ) ) < 0 ) {
+                DBClientConnection* hedge = 0;
+                try {
+                    hedge = checkHedge();
+                    if ( hedge )
+                        hedge->say( toSend );
+                }
+                catch ( DBException& e ) {
+                    LOG(1) << "can't hedge read to " << _hedgeHost << causedBy( e ) << endl;
+                    _hedge.reset();
+                    hedge = 0;
+                }
+
+                if ( hedge ) {
+                    readsHedged.fetchAndAdd( 1 );
+                    int loserId = toSend.header()->id;
+                    int millis = _so_timeout > 0 ? (int) ( _so_timeout * 1000 ) : -1;
+                    if ( waitForReply( winner , hedge , millis ) == 1 ) {
+                        // the faster member serves this client's reads from now on
+                        hedgeWins.fetchAndAdd( 1 );
+                        _slave.swap( _hedge );
+                        std::swap( _slaveHost , _hedgeHost );
+                        winner = hedge;
+                        winnerId = loserId;
+                        loserId = requestId;
+                    }
+
+                    // the loser is busy until its reply comes, so the next hedge connects afresh
+                    boost::shared_ptr<DBClientConnection> loser;
+                    loser.swap( _hedge );
+                    loser->setReplSetClientCallback( 0 );
+                    bool finishing = false;
+                    if ( losersFinishing.fetchAndAdd( 1 ) < MaxLosersFinishing ) {
+                        try {
+                            boost::thread t( boost::bind( &DBClientReplicaSet::_finishLoser , loser , loserId ) );
+                            finishing = true;
+                        }
+                        catch ( boost::thread_resource_error& ) {
+                        }
+                    }
+                    if ( ! finishing ) {
+                        losersFinishing.fetchAndSubtract( 1 );
+                        losersDropped.fetchAndAdd( 1 );
+                    }
+                }
+            }
+        }
+
+        if ( actualServer )
+            *actualServer = winner->getServerAddress();
+        if ( ! winner->recvReplyTo( response , winnerId ) )
+            return false;
+        response.header()->responseTo = requestId;
+        _monitor->noteSecondaryReadMillis( t.millis() );
+        return true;
+    }
+
+    void DBClientReplicaSet::_finishLoser( boost::shared_ptr<DBClientConnection> conn , int requestId ) {
+        try {
+            Message m;
+            if ( conn->recvReplyTo( m , requestId ) ) {
+                QueryResult* r = (QueryResult*) m.singleData();
+                if ( r->cursorId ) {
+                    conn->killCursor( r->cursorId );
+                    loserCursorsKilled.fetchAndAdd( 1 );
+                }
+            }
+        }
+        catch ( std::exception& e ) {
+            LOG(1) << "error reading the slower reply to a hedged read: " << e.what() << endl;
+        }
+        losersFinishing.fetchAndSubtract( 1 );
+    }
+
+    void DBClientReplicaSet::appendHedgeStats( BSONObjBuilder& b ) {
+        b.appendBool( "enabled" , _hedgedReads );
+        b.appendNumber( "hedgeable" , (long long) hedgeableReads.load() );
+        b.appendNumber( "hedged" , (long long) readsHedged.load() );
+        b.appendNumber( "hedgeWins" , (long long) hedgeWins.load() );
+        b.appendNumber( "loserCursorsKilled" , (long long) loserCursorsKilled.load() );
+        b.appendNumber( "losersDropped" , (long long) losersDropped.load() );
+    }
+
     void DBClientReplicaSet::_auth( DBClientConnection * conn ) {
         for ( list<AuthInfo>::iterator i=_auths.begin(); i!=_auths.end(); ++i ) {
             const AuthInfo& a = *i;
@@ -1049,6 +1259,13 @@ namespace mongo {
                             *actualServer = slave->getServerAddress();
                         slave->say( toSend );
 
+                        _lazyState._hedgeable.reset();
+                        if ( _hedgedReads && slave->onlyAwaiting( toSend.header()->id ) ) {
+                            _lazyState._hedgeable.reset( new Message() );
+                            copyMessage( toSend , *_lazyState._hedgeable );
+                            _lazyState._requestId = toSend.header()->id;
+                        }
+
                         _lazyState._lastOp = lastOp;
                         _lazyState._slaveOk = slaveOk;
                         _lazyState._retries = i;
@@ -1089,6 +1306,32 @@ namespace mongo {
         }
     }
 
+    bool DBClientReplicaSet::recvReplyTo( Message& m, int requestId ) {
+
+        verify( _lazyState._lastClient );
+
+        try {
+            if ( _lazyState._hedgeable && requestId == _lazyState._requestId &&
+                 _lazyState._lastClient == _slave.get() ) {
+                shared_ptr<Message> toSend = _lazyState._hedgeable;
+                _lazyState._hedgeable.reset();
+                bool ok = _hedgedRecv( *toSend , requestId , m , 0 );
+                _lazyState._lastClient = _slave.get();
+                return ok;
+            }
+            return _lazyState._lastClient->recvReplyTo( m, requestId );
+        }
+        catch( DBException& e ){
+            log() << "could not receive data from " << _lazyState._lastClient << causedBy( e ) << endl;
+            return false;
+        }
+    }
+
+    void DBClientReplicaSet::abandonExhaust() {
+        if ( _lazyState._lastClient )
+            _lazyState._lastClient->abandonExhaust();
+    }
+
     void DBClientReplicaSet::checkResponse( const char* data, int nReturned, bool* retry, string* targetHost ){
 
         // For now, do exactly as we did before, so as not to break things.  In general though, we
@@ -1169,7 +1412,15 @@ namespace mongo {
                         DBClientConnection* s = checkSlave();
                         if ( actualServer )
                             *actualServer = s->getServerAddress();
-                        return s->call( toSend , response , assertOk );
+                        if ( ! _hedgedReads )
+                            return s->call( toSend , response , assertOk );
+
+                        s->say( toSend );
+                        if ( _hedgedRecv( toSend , toSend.header()->id , response , actualServer ) )
+                            return true;
+                        if ( assertOk )
+                            uasserted( 10278 , str::stream() << "dbclient error communicating with server: " << _slaveHost.toString() );
+                        return false;
                     }
                     catch ( DBException &e ) {
                     	LOG(1) << "can't call replica set slave " << i << " : " << _slaveHost << causedBy( e ) << endl;
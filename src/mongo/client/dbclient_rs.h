@@ -21,6 +21,7 @@
 
 #include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/condition.hpp>
 #include <set>
 #include <utility>
 
@@ -195,6 +196,19 @@ namespace mongo {
          **/
         void setLocalThresholdMillis( const int millis );
 
+        /** records how long a secondary took to answer a slaveOk read */
+        void noteSecondaryReadMillis( int millis );
+
+        /**
+         * @return how long to wait for member to answer a slaveOk read before asking another
+         *     secondary as well: the 95th percentile of recent reads' times, or until there
+         *     have been enough of those, a few times member's ping time
+         */
+        int getHedgeDelayMillis( const HostAndPort& member );
+
+        /** @return the nearest secondary other than member, or an empty HostAndPort if none */
+        HostAndPort getHedgeTarget( const HostAndPort& member );
+
     private:
         /**
          * This populates a list of hosts from the list of seeds (discarding the
@@ -204,15 +218,28 @@ namespace mongo {
          */
         ReplicaSetMonitor( const string& name , const vector<HostAndPort>& servers );
 
+        /** how long one member's check may take, in seconds */
+        enum { CheckTimeoutSecs = 5 };
+
         /**
-         * Checks all connections from the host list and sets the current
-         * master.
+         * Checks all connections from the host list at once, each on its own thread,
+         * and sets the current master.  A thread already waiting on a round of checks
+         * joins it rather than starting another.
          * 
-         * @param checkAllSecondaries if set to false, stop immediately when
-         *    the master is found or when _master is not -1.
+         * @param checkAllSecondaries if set to false, return as soon as any check finds
+         *    the master, or if _master is already set and ok.
          */
         void _check( bool checkAllSecondaries );
 
+        /** checks one member for _check(), on a thread of its own */
+        struct CheckRound;
+        void _checkInBackground( shared_ptr<DBClientConnection> conn , unsigned nodesOffset ,
+                                 bool verbose , shared_ptr<CheckRound> round );
+
+        bool _masterOk_inlock() const {
+            return _master >= 0 && _master < (int)_nodes.size() && _nodes[_master].ok;
+        }
+
         /**
          * Use replSetGetStatus command to make sure hosts in host list are up
          * and readable.  Sets Node::ok appropriately.
@@ -262,18 +289,28 @@ namespace mongo {
          */
         bool _checkConnMatch_inlock( DBClientConnection* conn, size_t nodeOffset ) const;
 
-        // protects _localThresholdMillis, _nodes and refs to _nodes (eg. _master & _nextSlave)
+        /** lets another _checkConnection() of conn go ahead */
+        void _doneChecking( DBClientConnection* conn );
+
+        // protects _localThresholdMillis, _nodes and refs to _nodes (eg. _master & _nextSlave),
+        // and the check state below
         mutable mongo::mutex _lock;
 
         /**
-         * "Synchronizes" the _checkConnection method. Should ideally be one mutex per
-         * connection object being used. The purpose of this lock is to make sure that
-         * the reply from the connection the lock holder got is the actual response
-         * to what it sent.
-         *
-         * Deadlock WARNING: never acquire this while holding _lock
+         * The connections _checkConnection() is using.  Only one check at a time may use a
+         * connection, so that the reply each gets is the response to what it sent.
          */
-        mutable mongo::mutex  _checkConnectionLock;
+        std::set<DBClientConnection*> _connsInCheck;
+
+        struct CheckRound {
+            CheckRound() : left( 0 ) { }
+            int left; // checks still running
+        };
+        shared_ptr<CheckRound> _round; // the latest round of _check(), maybe finished
+        int _checksRunning; // over all rounds; the destructor waits for them
+
+        // signalled when a check of a connection finishes
+        boost::condition _checkDone;
 
         string _name;
 
@@ -289,6 +326,12 @@ namespace mongo {
         static map<string,ReplicaSetMonitorPtr> _sets; // set name to Monitor
         static ConfigChangeHook _hook;
         int _localThresholdMillis; // local ping latency threshold (protected by _lock)
+
+        // recent slaveOk read times for getHedgeDelayMillis(), a ring (protected by _lock)
+        enum { ReadSamples = 256, MinReadSamples = 32 };
+        std::vector<int> _readMillis;
+        unsigned _readSamples;      // recorded in all, the ring's next slot is this % ReadSamples
+        int _readPercentileMillis;  // 95th percentile, worked out every MinReadSamples reads
     };
 
     /** Use this class to connect to a replica set of servers.  The class will manage
@@ -348,6 +391,8 @@ namespace mongo {
 
         virtual void say( Message &toSend, bool isRetry = false , string* actualServer = 0);
         virtual bool recv( Message &toRecv );
+        virtual bool recvReplyTo( Message &toRecv, int requestId );
+        virtual void abandonExhaust();
         virtual void checkResponse( const char* data, int nReturned, bool* retry = NULL, string* targetHost = NULL );
 
         /* this is the callback from our underlying connections to notify us that we got a "not master" error.
@@ -378,6 +423,19 @@ namespace mongo {
         virtual bool call( Message &toSend, Message &response, bool assertOk=true , string * actualServer = 0 );
         virtual bool callRead( Message& toSend , Message& response ) { return checkMaster()->callRead( toSend , response ); }
 
+        // ---- hedged reads ------
+
+        /**
+         * when on, a slaveOk query which its secondary hasn't answered within
+         * ReplicaSetMonitor::getHedgeDelayMillis() is sent to another secondary too, and the
+         * first answer is used.  The other is read in the background and its cursor killed.
+         */
+        static void setHedgedReads( bool on ) { _hedgedReads = on; }
+        static bool hedgedReads() { return _hedgedReads; }
+
+        /** counts of reads hedged and won, for serverStatus */
+        static void appendHedgeStats( BSONObjBuilder& b );
+
 
     protected:
         virtual void sayPiggyBack( Message &toSend ) { checkMaster()->say( toSend ); }
@@ -390,6 +448,19 @@ namespace mongo {
         DBClientConnection * checkMaster();
         DBClientConnection * checkSlave();
 
+        /** @return a connection to a secondary other than the slave, or 0 if there's none */
+        DBClientConnection * checkHedge();
+
+        /**
+         * receives the reply to toSend, a slaveOk query sent to the slave as requestId.  If the
+         * slave is slow to answer, toSend goes to another secondary too, and whichever answers
+         * first becomes the slave.
+         */
+        bool _hedgedRecv( Message& toSend , int requestId , Message& response , string* actualServer );
+
+        /** receives the reply to requestId on conn in the background, kills its cursor, and closes conn */
+        static void _finishLoser( boost::shared_ptr<DBClientConnection> conn , int requestId );
+
         void _auth( DBClientConnection * conn );
 
         ReplicaSetMonitorPtr _monitor;
@@ -398,7 +469,13 @@ namespace mongo {
         scoped_ptr<DBClientConnection> _master;
 
         HostAndPort _slaveHost;
-        scoped_ptr<DBClientConnection> _slave;
+        boost::shared_ptr<DBClientConnection> _slave;
+
+        // a hedged read's second secondary, only held while a read is hedged
+        HostAndPort _hedgeHost;
+        boost::shared_ptr<DBClientConnection> _hedge;
+
+        static bool _hedgedReads;
         
         double _so_timeout;
 
@@ -428,12 +505,16 @@ namespace mongo {
          */
         class LazyState {
         public:
-            LazyState() : _lastClient( NULL ), _lastOp( -1 ), _slaveOk( false ), _retries( 0 ) {}
+            LazyState() : _lastClient( NULL ), _lastOp( -1 ), _slaveOk( false ), _retries( 0 ), _requestId( 0 ) {}
             DBClientConnection* _lastClient;
             int _lastOp;
             bool _slaveOk;
             int _retries;
 
+            // a copy of a slaveOk query said to the slave, kept if the read may be hedged
+            shared_ptr<Message> _hedgeable;
+            int _requestId;
+
         } _lazyState;
 
     };
@@ -32,22 +32,25 @@ namespace mongo {
 
     void DBClientCursor::_finishConsInit() {
         _originalHost = _client->toString();
+        _lazyRequestId = 0;
+        _readAhead = false;
+        _readAheadId = 0;
     }
 
-    int DBClientCursor::nextBatchSize() {
+    int DBClientCursor::nextBatchSize( int toReturn ) const {
 
-        if ( nToReturn == 0 )
+        if ( toReturn == 0 )
             return batchSize;
 
         if ( batchSize == 0 )
-            return nToReturn;
+            return toReturn;
 
-        return batchSize < nToReturn ? batchSize : nToReturn;
+        return batchSize < toReturn ? batchSize : toReturn;
     }
 
     void DBClientCursor::_assembleInit( Message& toSend ) {
         if ( !cursorId ) {
-            assembleRequest( ns, query, nextBatchSize() , nToSkip, fieldsToReturn, opts, toSend );
+            assembleRequest( ns, query, nextBatchSize( nToReturn ) , nToSkip, fieldsToReturn, opts, toSend );
         }
         else {
             BufBuilder b;
@@ -59,6 +62,15 @@ namespace mongo {
         }
     }
 
+    void DBClientCursor::_assembleGetMore( Message& toSend, int toReturn ) {
+        BufBuilder b;
+        b.appendNum(opts);
+        b.appendStr(ns);
+        b.appendNum(nextBatchSize( toReturn ));
+        b.appendNum(cursorId);
+        toSend.setData(dbGetMore, b.buf(), b.len());
+    }
+
     bool DBClientCursor::init() {
         Message toSend;
         _assembleInit( toSend );
@@ -82,11 +94,12 @@ namespace mongo {
         Message toSend;
         _assembleInit( toSend );
         _client->say( toSend, isRetry, &_originalHost );
+        _lazyRequestId = toSend.header()->id;
     }
 
     bool DBClientCursor::initLazyFinish( bool& retry ) {
 
-        bool recvd = _client->recv( *batch.m );
+        bool recvd = _client->recvReplyTo( *batch.m, _lazyRequestId );
 
         // If we get a bad response, return false
         if ( ! recvd || batch.m->empty() ) {
@@ -119,22 +132,29 @@ namespace mongo {
     void DBClientCursor::requestMore() {
         verify( cursorId && batch.pos == batch.nReturned );
 
+        if ( opts & QueryOption_Exhaust ) {
+            exhaustReceiveMore();
+            return;
+        }
+
         if (haveLimit) {
             nToReturn -= batch.nReturned;
             verify(nToReturn > 0);
         }
-        BufBuilder b;
-        b.appendNum(opts);
-        b.appendStr(ns);
-        b.appendNum(nextBatchSize());
-        b.appendNum(cursorId);
+
+        // a read ahead was asked for while the last batch was read
+        bool asked = _readAheadId || _readAheadReply.get();
+        if ( asked )
+            _claimReadAhead();
 
         Message toSend;
-        toSend.setData(dbGetMore, b.buf(), b.len());
-        auto_ptr<Message> response(new Message());
+        if ( ! asked )
+            _assembleGetMore( toSend, nToReturn );
+        auto_ptr<Message> response( asked ? _readAheadReply.release() : new Message() );
 
         if ( _client ) {
-            _client->call( toSend, *response );
+            if ( ! asked )
+                _client->call( toSend, *response );
             this->batch.m = response;
             dataReceived();
         }
@@ -142,7 +162,8 @@ namespace mongo {
             verify( _scopedHost.size() );
             scoped_ptr<ScopedDbConnection> conn(
                     ScopedDbConnection::getScopedDbConnection( _scopedHost ) );
-            conn->get()->call( toSend , *response );
+            if ( ! asked )
+                conn->get()->call( toSend , *response );
             _client = conn->get();
             this->batch.m = response;
             dataReceived();
@@ -161,6 +182,44 @@ namespace mongo {
             batch.m = response;
             dataReceived();
         }
+        else {
+            // the stream is broken, and the connection with it
+            cursorId = 0;
+        }
+    }
+
+    void DBClientCursor::_sendReadAhead() {
+        if ( ! cursorId || batch.pos * 2 < batch.nReturned )
+            return;
+        if ( opts & ( QueryOption_CursorTailable | QueryOption_Exhaust ) )
+            return;
+        // what nToReturn will be once this batch is used up
+        int toReturn = haveLimit ? nToReturn - batch.nReturned : nToReturn;
+        if ( haveLimit && toReturn <= 0 )
+            return;
+        // replies are matched to their requests only by a DBClientConnection, so anything else
+        // sent on it meanwhile still gets its own
+        DBClientConnection *conn = dynamic_cast<DBClientConnection*>( _client );
+        if ( ! conn )
+            return;
+
+        Message toSend;
+        _assembleGetMore( toSend, toReturn );
+        conn->say( toSend );
+        _readAheadId = toSend.header()->id;
+    }
+
+    /** takes the read ahead's reply off the connection into _readAheadReply, if it isn't there yet */
+    void DBClientCursor::_claimReadAhead() {
+        if ( _readAheadReply.get() )
+            return;
+        verify( _readAheadId && _client );
+        auto_ptr<Message> response(new Message());
+        int id = _readAheadId;
+        _readAheadId = 0;
+        uassert( 16422 , str::stream() << "dbclient error communicating with server: " << _client->getServerAddress() ,
+                 _client->recvReplyTo( *response, id ) && ! response->empty() );
+        _readAheadReply = response;
     }
 
     void DBClientCursor::dataReceived( bool& retry, string& host ) {
@@ -189,6 +248,7 @@ namespace mongo {
         batch.nReturned = qr->nReturned;
         batch.pos = 0;
         batch.data = qr->data();
+        batch.memory.set( qr->len );
 
         _client->checkResponse( batch.data, batch.nReturned, &retry, &host ); // watches for "not master"
 
@@ -237,6 +297,8 @@ namespace mongo {
         BSONObj o(batch.data);
         batch.data += o.objsize();
         /* todo would be good to make data null at end of batch for safety */
+        if ( _readAhead && ! _readAheadId && ! _readAheadReply.get() )
+            _sendReadAhead();
         return o;
     }
 
@@ -290,6 +352,10 @@ namespace mongo {
         verify( conn );
         verify( conn->get() );
 
+        // the connection goes back to the pool, so the reply to a read ahead has to come off it now
+        if ( _readAheadId )
+            _claimReadAhead();
+
         if ( conn->get()->type() == ConnectionString::SET ||
              conn->get()->type() == ConnectionString::SYNC ) {
             if( _lazyHost.size() > 0 )
@@ -314,7 +380,18 @@ namespace mongo {
 
         DESTRUCTOR_GUARD (
 
-        if ( cursorId && _ownCursor && ! inShutdown() ) {
+        if ( _readAheadId && _client ) {
+            // so the connection isn't left waiting on it; the cursor may have ended with it, too
+            _claimReadAhead();
+        }
+        if ( _readAheadReply.get() )
+            cursorId = ( (QueryResult *) _readAheadReply->singleData() )->cursorId;
+
+        if ( streaming() && _client ) {
+            // the server won't read a killCursors until it's done sending, so drop the connection
+            _client->abandonExhaust();
+        }
+        else if ( cursorId && _ownCursor && ! inShutdown() ) {
             BufBuilder b;
             b.appendNum( (int)0 ); // reserved
             b.appendNum( (int)1 ); // number
@@ -24,6 +24,7 @@
 #include "mongo/client/dbclientinterface.h"
 #include "mongo/db/jsobj.h"
 #include "mongo/db/json.h"
+#include "mongo/util/mem_accounting.h"
 #include "mongo/util/net/message.h"
 
 namespace mongo {
@@ -57,6 +58,21 @@ namespace mongo {
         int objsLeftInBatch() const { _assertIfNull(); return _putBack.size() + batch.nReturned - batch.pos; }
         bool moreInCurrentBatch() { return objsLeftInBatch() > 0; }
 
+        /** the number of documents each following getMore asks for; 0 leaves it to the server */
+        int getBatchSize() const { return batchSize; }
+        void setBatchSize( int bs ) { batchSize = bs == 1 ? 2 : bs; }
+
+        /**
+         * read ahead: once half of a batch has been read, send the getMore for the next one, so
+         * the server and the network work on it while the rest of this batch is used.  At most
+         * one getMore is in flight, so the cursor holds at most the batch being read and the one
+         * coming.  Only over a DBClientConnection, which matches pipelined replies to requests,
+         * and not for tailable or exhaust cursors; otherwise, and once the cursor is attach()ed,
+         * batches are asked for when they run out as usual.
+         */
+        void setReadAhead( bool on ) { _readAhead = on; }
+        bool readAhead() const { return _readAhead; }
+
         /** next
            @return next object in the result cursor.
            on an error at the remote server, you will get back:
@@ -118,6 +134,9 @@ namespace mongo {
 
         bool tailable() const { return (opts & QueryOption_CursorTailable) != 0; }
 
+        /** true while the server is still sending batches of an exhaust query unasked */
+        bool streaming() const { return ( opts & QueryOption_Exhaust ) && cursorId != 0; }
+
         /** see ResultFlagType (constants.h) for flag values
             mostly these flags are for internal purposes -
             ResultFlag_ErrSet is the possible exception to that
@@ -149,9 +168,13 @@ namespace mongo {
             ns(_ns),
             nToReturn( _nToReturn ),
             haveLimit( _nToReturn > 0 && !(options & QueryOption_CursorTailable)),
+            nToSkip( 0 ),
+            fieldsToReturn( 0 ),
             opts( options ),
+            batchSize( 0 ),
             cursorId(_cursorId),
-            _ownCursor( true ) {
+            _ownCursor( true ),
+            wasError( false ) {
             _finishConsInit();
         }
 
@@ -194,15 +217,16 @@ namespace mongo {
             int nReturned;
             int pos;
             const char *data;
+            MemAccounting::Charge memory; // of m
         public:
-            Batch() : m( new Message() ), nReturned(), pos(), data() { }
+            Batch() : m( new Message() ), nReturned(), pos(), data(), memory( MemAccounting::CursorBatches ) { }
         };
 
     private:
         friend class DBClientBase;
         friend class DBClientConnection;
 
-        int nextBatchSize();
+        int nextBatchSize( int toReturn ) const;
         void _finishConsInit();
         
         Batch batch;
@@ -222,12 +246,18 @@ namespace mongo {
         bool _ownCursor; // see decouple()
         string _scopedHost;
         string _lazyHost;
+        int _lazyRequestId; // of the query initLazy() sent
         bool wasError;
+        bool _readAhead;                  // see setReadAhead()
+        int _readAheadId;                 // of the getMore in flight, 0 if none
+        auto_ptr<Message> _readAheadReply; // its reply, if claimed before the reply was needed
 
         void dataReceived() { bool retry; string lazyHost; dataReceived( retry, lazyHost ); }
         void dataReceived( bool& retry, string& lazyHost );
         void requestMore();
         void exhaustReceiveMore(); // for exhaust
+        void _sendReadAhead();
+        void _claimReadAhead();
 
         // Don't call from a virtual function
         void _assertIfNull() const { uassert(13348, "connection died", this); }
@@ -238,6 +268,7 @@ namespace mongo {
 
         // init pieces
         void _assembleInit( Message& toSend );
+        void _assembleGetMore( Message& toSend, int toReturn );
     };
 
     /** iterate over objects in current batch only - will not cause a network call
@@ -433,6 +433,12 @@ namespace mongo {
         virtual void sayPiggyBack( Message &toSend ) = 0;
         /* used by QueryOption_Exhaust.  To use that your subclass must implement this. */
         virtual bool recv( Message& m ) { verify(false); return false; }
+        /** receives the reply to requestId, sent earlier by say().  connections which allow
+            several requests outstanding keep replies to the others that arrive first. */
+        virtual bool recvReplyTo( Message& m, int requestId ) { return recv( m ); }
+        /** an exhaust cursor was dropped with batches still on the way, so the connection
+            can't carry anything else; it has to be reconnected */
+        virtual void abandonExhaust() { }
         // In general, for lazy queries, we'll need to say, recv, then checkResponse
         virtual void checkResponse( const char* data, int nReturned, bool* retry = NULL, string* targetHost = NULL ) {
             if( retry ) *retry = false; if( targetHost ) *targetHost = "";
@@ -790,6 +796,12 @@ namespace mongo {
 
         virtual string toString() = 0;
 
+        /**
+         * Look up the options available on this client.  Caches the answer from
+         * _lookupAvailableOptions(), below.
+         */
+        QueryOptions availableOptions();
+
     protected:
         /** if the result of a command is ok*/
         bool isOk(const BSONObj&);
@@ -799,12 +811,6 @@ namespace mongo {
 
         BSONObj _countCmd(const string &ns, const BSONObj& query, int options, int limit, int skip );
 
-        /**
-         * Look up the options available on this client.  Caches the answer from
-         * _lookupAvailableOptions(), below.
-         */
-        QueryOptions availableOptions();
-
         virtual QueryOptions _lookupAvailableOptions();
 
     private:
@@ -935,6 +941,7 @@ namespace mongo {
 
         virtual ~DBClientConnection() {
             _numConnections--;
+            clearEarlyReplies();
         }
 
         /** Connect to a Mongo database server.
@@ -1003,6 +1010,14 @@ namespace mongo {
 
         MessagingPort& port() { verify(p); return *p; }
 
+        /** @return whether requestId is the only request said on this connection and not yet answered */
+        bool onlyAwaiting( int requestId ) const {
+            return _pending.size() == 1 && _pending.count( requestId ) && _earlyReplies.empty();
+        }
+
+        /** changes the replica set connection told when this connection finds it isn't master */
+        void setReplSetClientCallback( DBClientReplicaSet* rsClient ) { clientSet = rsClient; }
+
         string toStringLong() const {
             stringstream ss;
             ss << _serverString;
@@ -1019,9 +1034,15 @@ namespace mongo {
         virtual bool callRead( Message& toSend , Message& response ) { return call( toSend , response ); }
         virtual void say( Message &toSend, bool isRetry = false , string * actualServer = 0 );
         virtual bool recv( Message& m );
+        virtual bool recvReplyTo( Message& m, int requestId );
+        virtual void abandonExhaust();
         virtual void checkResponse( const char *data, int nReturned, bool* retry = NULL, string* host = NULL );
         virtual bool call( Message &toSend, Message &response, bool assertOk = true , string * actualServer = 0 );
         virtual ConnectionString::ConnectionType type() const { return ConnectionString::MASTER; }
+
+        /** @return the number of queries and getMores sent by say() whose replies haven't
+            been received */
+        size_t numPendingReplies() const { return _pending.size(); }
         void setSoTimeout(double to) { _so_timeout = to; }
         double getSoTimeout() const { return _so_timeout; }
 
@@ -1055,6 +1076,14 @@ namespace mongo {
         double _so_timeout;
         bool _connect( string& errmsg );
 
+        /* requests may be pipelined: say() several queries (lazy cursors, Future::CommandResult),
+           then the replies are claimed in any order with recvReplyTo(). the server answers in
+           the order it was asked, so replies that come before the one wanted wait here. */
+        enum { MaxEarlyReplies = 128 }; // beyond that they belong to abandoned requests
+        set<int> _pending;                          // ids of requests whose reply hasn't come
+        deque< pair<int, Message*> > _earlyReplies; // responseTo and the reply, oldest first
+        void clearEarlyReplies();
+
         static AtomicUInt _numConnections;
         static bool _lazyKillCursor; // lazy means we piggy back kill cursors on next op
 
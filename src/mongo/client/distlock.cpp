@@ -97,6 +97,9 @@ namespace mongo {
                 Date_t pingTime;
 
                 try {
+                    // Taken before the ping is sent, so a lease reckoned from it never outlasts the ping
+                    unsigned long long sent = curTimeMillis64();
+
                     scoped_ptr<ScopedDbConnection> connPtr(
                             ScopedDbConnection::getScopedDbConnection( addr.toString(), 30.0 ) );
                     ScopedDbConnection& conn = *connPtr;
@@ -120,6 +123,8 @@ namespace mongo {
                         continue;
                     }
 
+                    pinged( pingId, sent );
+
                     // remove really old entries from the lockpings collection if they're not holding a lock
                     // (this may happen if an instance of a process was taken down and no new instance came up to
                     // replace it for a quite a while)
@@ -166,30 +171,32 @@ namespace mongo {
                     if( numOldLocks > 0 )
                         log( DistributedLock::logLvl - 1 ) << "trying to delete " << _oldLockOIDs.size() << " old lock entries for process " << process << endl;
 
-                    bool removed = false;
-                    for( list<OID>::iterator i = _oldLockOIDs.begin(); i != _oldLockOIDs.end();
-                            i = ( removed ? _oldLockOIDs.erase( i ) : ++i ) ) {
-                        removed = false;
+                    // All of them go in one update, rather than a round trip to every config server per lock
+                    if( numOldLocks > 0 ) {
+                        BSONArrayBuilder oids;
+                        for( list<OID>::iterator i = _oldLockOIDs.begin(); i != _oldLockOIDs.end(); ++i )
+                            oids.append( *i );
+
                         try {
-                            // Got OID from lock with id, so we don't need to specify id again
+                            // Got OIDs from locks with ids, so we don't need to specify ids again
                             conn->update( DistributedLock::locksNS ,
-                                          BSON( "ts" << *i ),
-                                          BSON( "$set" << BSON( "state" << 0 ) ) );
+                                          BSON( "ts" << BSON( "$in" << oids.arr() ) ),
+                                          BSON( "$set" << BSON( "state" << 0 ) ) ,
+                                          false , true );
 
                             // Either the update went through or it didn't, either way we're done trying to
                             // unlock
-                            log( DistributedLock::logLvl - 1 ) << "handled late remove of old distributed lock with ts " << *i << endl;
-                            removed = true;
+                            log( DistributedLock::logLvl - 1 ) << "handled late remove of " << numOldLocks << " old distributed locks" << endl;
+                            _oldLockOIDs.clear();
                         }
                         catch( UpdateNotTheSame& ) {
-                            log( DistributedLock::logLvl - 1 ) << "partially removed old distributed lock with ts " << *i << endl;
-                            removed = true;
+                            log( DistributedLock::logLvl - 1 ) << "partially removed " << numOldLocks << " old distributed locks" << endl;
+                            _oldLockOIDs.clear();
                         }
                         catch ( std::exception& e) {
-                            warning() << "could not remove old distributed lock with ts " << *i
+                            warning() << "could not remove " << numOldLocks << " old distributed locks"
                                       << causedBy( e ) <<  endl;
                         }
-
                     }
 
                     if( numOldLocks > 0 && _oldLockOIDs.size() > 0 ){
@@ -261,6 +268,21 @@ namespace mongo {
             return s;
         }
 
+        void pinged( const string& pingId, unsigned long long when ) {
+            scoped_lock lk( _mutex );
+            _lastPinged[ pingId ] = when;
+        }
+
+        /**
+         * @return the local time (curTimeMillis64) the ping thread for this process last sent a ping
+         * which reached the config servers, or 0 if it hasn't yet
+         */
+        unsigned long long lastPinged( const ConnectionString& conn, const string& processId ) {
+            scoped_lock lk( _mutex );
+            map<string, unsigned long long>::const_iterator i = _lastPinged.find( pingThreadId( conn, processId ) );
+            return i == _lastPinged.end() ? 0 : i->second;
+        }
+
         void addUnlockOID( const OID& oid ) {
             // Modifying the lock from some other thread
             scoped_lock lk( _mutex );
@@ -295,11 +317,13 @@ namespace mongo {
 
             _kill.erase( pingId );
             _seen.erase( pingId );
+            _lastPinged.erase( pingId );
 
         }
 
         set<string> _kill;
         set<string> _seen;
+        map<string, unsigned long long> _lastPinged;
         mongo::mutex _mutex;
         list<OID> _oldLockOIDs;
 
@@ -474,6 +498,21 @@ namespace mongo {
         return true;
     }
 
+    bool DistributedLock::canRenew( const BSONObj& held ) {
+
+        if( held["state"].numberInt() != 2 || held["process"].type() != String ||
+            held["process"].String() != _processId || held["ts"].type() != jstOID )
+            return false;
+
+        if( distLockPinger.willUnlockOID( held["ts"].OID() ) )
+            return false;
+
+        // No one may force a lock before seeing its process's ping unchanged for the takeover time, so
+        // while our last ping is well inside that (allowing for clock skew), the lock is still ours.
+        unsigned long long pinged = distLockPinger.lastPinged( _conn, _processId );
+        return pinged > 0 && curTimeMillis64() < pinged + _lockTimeout / 2;
+    }
+
     // Semantics of this method are basically that if the lock cannot be acquired, returns false, can be retried.
     // If the lock should not be tried again (some unexpected error) a LockException is thrown.
     // If we are only trying to re-enter a currently held lock, reenter should be true.
@@ -500,6 +539,45 @@ namespace mongo {
                 ScopedDbConnection::getScopedDbConnection( _conn.toString() ) );
         ScopedDbConnection& conn = *connPtr;
 
+        // Renewing a lock we were told we hold, within our ping lease, only needs to check the lock
+        // document is unchanged, without reading pings or remote times.
+        if ( reenter && canRenew( *other ) ) {
+
+            string lockName = _name + string("/") + _processId;
+
+            try {
+
+                conn->update( locksNS , BSON( "_id" << _id["_id"].String() << "state" << 2 << "ts" << (*other)["ts"] ),
+                              BSON( "$set" << BSON( "state" << 2 ) ) );
+
+                BSONObj err = conn->getLastErrorDetailed();
+                string errMsg = DBClientWithCommands::getLastErrorString(err);
+
+                if ( errMsg.empty() && err["n"].type() && err["n"].numberInt() >= 1 ) {
+                    log( logLvl - 1 ) << "renewed distributed lock '" << lockName << "'" << endl;
+                    *other = other->getOwned();
+                    conn.done();
+                    return true;
+                }
+
+                // Otherwise we can't be sure the lock is still ours, check it the long way below
+                log( logLvl - 1 ) << "could not renew lock '" << lockName << "' "
+                                  << ( !errMsg.empty() ? causedBy(errMsg) : string("(lock changed)") ) << endl;
+
+            }
+            catch( UpdateNotTheSame& ) {
+                // NOT ok to continue since our lock isn't held by all servers, so isn't valid.
+                warning() << "inconsistent state renewing lock, lock " << lockName << " not held" << endl;
+                conn.done();
+                return false;
+            }
+            catch( std::exception& e ) {
+                conn.done();
+                throw LockException( str::stream() << "exception renewing distributed lock "
+                                     << lockName << causedBy( e ), 13660);
+            }
+        }
+
         BSONObjBuilder queryBuilder;
         queryBuilder.appendElements( _id );
         queryBuilder.append( "state" , 0 );
@@ -733,11 +811,10 @@ namespace mongo {
             BSONObj err = conn->getLastErrorDetailed();
             string errMsg = DBClientWithCommands::getLastErrorString(err);
 
-            currLock = conn->findOne( locksNS , _id );
-
             if ( !errMsg.empty() || !err["n"].type() || err["n"].numberInt() < 1 ) {
                 ( errMsg.empty() ? log( logLvl - 1 ) : warning() ) << "could not acquire lock '" << lockName << "' "
                         << ( !errMsg.empty() ? causedBy( errMsg ) : string("(another update won)") ) << endl;
+                currLock = conn->findOne( locksNS , _id );
                 *other = currLock;
                 other->getOwned();
                 gotLock = false;
@@ -845,6 +922,8 @@ namespace mongo {
             try {
 
                 BSONObjBuilder finalLockDetails;
+                BSONObjBuilder finalLock;
+                finalLock.appendElements( _id );
                 BSONObjIterator bi( lockDetails );
                 while( bi.more() ) {
                     BSONElement el = bi.next();
@@ -852,22 +931,24 @@ namespace mongo {
                         finalLockDetails.append( "state", 2 );
                     else finalLockDetails.append( el );
                 }
+                BSONObj finalSet = finalLockDetails.obj();
+                finalLock.appendElements( finalSet );
 
-                conn->update( locksNS , _id , BSON( "$set" << finalLockDetails.obj() ) );
+                conn->update( locksNS , _id , BSON( "$set" << finalSet ) );
 
                 BSONObj err = conn->getLastErrorDetailed();
                 string errMsg = DBClientWithCommands::getLastErrorString(err);
 
-                currLock = conn->findOne( locksNS , _id );
-
                 if ( !errMsg.empty() || !err["n"].type() || err["n"].numberInt() < 1 ) {
                     warning() << "could not finalize winning lock " << lockName
                               << ( !errMsg.empty() ? causedBy( errMsg ) : " (did not update lock) " ) << endl;
+                    currLock = conn->findOne( locksNS , _id );
                     gotLock = false;
                 }
                 else {
-                    // SUCCESS!
+                    // SUCCESS!  The lock document is now exactly what we set, no need to read it back
                     gotLock = true;
+                    currLock = finalLock.obj();
                 }
 
             }
@@ -120,7 +120,8 @@ namespace mongo {
          * @param why human readable description of why the lock is being taken (used to log)
          * @param whether this is a lock re-entry or a new lock
          * @param other configdb's lock document that is currently holding the lock, if lock is taken, or our own lock
-         * details if not
+         * details if not.  When re-entering, passing in the lock document we got lets a recently pinged lock be
+         * renewed with a single update
          * @return true if it managed to grab the lock
          */
         bool lock_try( const string& why , bool reenter = false, BSONObj * other = 0 );
@@ -177,6 +178,12 @@ namespace mongo {
         void setLastPing( const PingData& pd ){ lastPings.setLastPing( _conn, _name, pd ); }
         PingData getLastPing(){ return lastPings.getLastPing( _conn, _name ); }
 
+        /**
+         * @return true if held is a finalized lock document of this process, which our pinger has
+         * pinged recently enough that no one else could have forced it
+         */
+        bool canRenew( const BSONObj& held );
+
         // May or may not exist, depending on startup
         mongo::mutex _mutex;
         string _threadId;
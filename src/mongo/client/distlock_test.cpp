@@ -239,6 +239,15 @@ namespace mongo {
                             break;
                         }
 
+                        if( count % 2 == 1 ) {
+                            BSONObj held = lockObj;
+                            if( ! myLock->lock_try( "Testing lock renewal.", true, &held ) || held["ts"].OID() != lockObj["ts"].OID() ) {
+                                errors = true;
+                                log() << "**** !Could not renew lock already held" << endl;
+                                break;
+                            }
+                        }
+
                         if( count % 3 == 1 && myLock->lock_try( "Testing lock non-re-entry.", false ) ) {
                             errors = true;
                             log() << "**** !Invalid lock re-entry" << endl;
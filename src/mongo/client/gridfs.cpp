@@ -24,6 +24,7 @@
 
 #include "mongo/client/gridfs.h"
 #include "mongo/client/dbclientcursor.h"
+#include "mongo/util/md5.hpp"
 
 #if defined(_WIN32)
 #include <io.h>
@@ -39,6 +40,9 @@ namespace mongo {
 
     const unsigned DEFAULT_CHUNK_SIZE = 256 * 1024;
 
+    // the chunks of a file are sent about this much at a time, in one OP_INSERT
+    const int CHUNK_BATCH_BYTES = 8 * 1024 * 1024;
+
     GridFSChunk::GridFSChunk( BSONObj o ) {
         _data = o;
     }
@@ -56,6 +60,7 @@ namespace mongo {
         _filesNS = dbName + "." + prefix + ".files";
         _chunksNS = dbName + "." + prefix + ".chunks";
         _chunkSize = DEFAULT_CHUNK_SIZE;
+        _clientSideMD5 = false;
 
         client.ensureIndex( _filesNS , BSON( "filename" << 1 ) );
         client.ensureIndex( _chunksNS , BSON( "files_id" << 1 << "n" << 1 ) );
@@ -74,6 +79,57 @@ namespace mongo {
         return _chunkSize;
     }
 
+    /**
+     * Inserts a file's chunks a batch at a time rather than a message each, md5ing them on
+     * the way when asked to.
+     */
+    class GridFSChunkWriter : boost::noncopyable {
+    public:
+        GridFSChunkWriter( DBClientBase& client , const string& ns , const BSONObj& idObj , bool md5 )
+            : _client( client ) , _ns( ns ) , _idObj( idObj ) , _md5( md5 ) , _chunkNumber( 0 ) , _batchBytes( 0 ) {
+            if ( _md5 )
+                md5_init( &_md5State );
+        }
+
+        void append( const char* data , int len ) {
+            if ( _md5 )
+                md5_append( &_md5State , (const md5_byte_t*) data , len );
+            GridFSChunk c( _idObj , _chunkNumber++ , data , len );
+            _batch.push_back( c._data );
+            _batchBytes += c._data.objsize();
+            if ( _batchBytes >= CHUNK_BATCH_BYTES )
+                flush();
+        }
+
+        /** @return the md5, if asked for, of all that was appended */
+        string finish() {
+            flush();
+            if ( ! _md5 )
+                return "";
+            md5digest d;
+            md5_finish( &_md5State , d );
+            return digestToString( d );
+        }
+
+    private:
+        void flush() {
+            if ( _batch.empty() )
+                return;
+            _client.insert( _ns , _batch );
+            _batch.clear();
+            _batchBytes = 0;
+        }
+
+        DBClientBase& _client;
+        const string _ns;
+        const BSONObj _idObj;
+        const bool _md5;
+        md5_state_t _md5State;
+        int _chunkNumber;
+        vector<BSONObj> _batch;
+        int _batchBytes;
+    };
+
     BSONObj GridFS::storeFile( const char* data , size_t length , const string& remoteName , const string& contentType) {
         char const * const end = data + length;
 
@@ -81,17 +137,14 @@ namespace mongo {
         id.init();
         BSONObj idObj = BSON("_id" << id);
 
-        int chunkNumber = 0;
+        GridFSChunkWriter chunks( _client , _chunksNS , idObj , _clientSideMD5 );
         while (data < end) {
             int chunkLen = MIN(_chunkSize, (unsigned)(end-data));
-            GridFSChunk c(idObj, chunkNumber, data, chunkLen);
-            _client.insert( _chunksNS.c_str() , c._data );
-
-            chunkNumber++;
+            chunks.append( data , chunkLen );
             data += chunkLen;
         }
 
-        return insertFile(remoteName, id, length, contentType);
+        return insertFile(remoteName, id, length, contentType, chunks.finish());
     }
 
 
@@ -109,12 +162,12 @@ namespace mongo {
         id.init();
         BSONObj idObj = BSON("_id" << id);
 
-        int chunkNumber = 0;
+        GridFSChunkWriter chunks( _client , _chunksNS , idObj , _clientSideMD5 );
         gridfs_offset length = 0;
+        // the chunk is copied into its BSONObj, so one buffer does for all of them
+        boost::scoped_array<char> buf( new char[_chunkSize+1] );
         while (!feof(fd)) {
-            //boost::scoped_array<char>buf (new char[_chunkSize+1]);
-            char * buf = new char[_chunkSize+1];
-            char* bufPos = buf;//.get();
+            char* bufPos = buf.get();
             unsigned int chunkLen = 0; // how much in the chunk now
             while(chunkLen != _chunkSize && !feof(fd)) {
                 int readLen = fread(bufPos, 1, _chunkSize - chunkLen, fd);
@@ -124,33 +177,37 @@ namespace mongo {
                 verify(chunkLen <= _chunkSize);
             }
 
-            GridFSChunk c(idObj, chunkNumber, buf, chunkLen);
-            _client.insert( _chunksNS.c_str() , c._data );
-
+            chunks.append( buf.get() , chunkLen );
             length += chunkLen;
-            chunkNumber++;
-            delete[] buf;
         }
 
         if (fd != stdin)
             fclose( fd );
 
-        return insertFile((remoteName.empty() ? fileName : remoteName), id, length, contentType);
+        return insertFile((remoteName.empty() ? fileName : remoteName), id, length, contentType, chunks.finish());
     }
 
-    BSONObj GridFS::insertFile(const string& name, const OID& id, gridfs_offset length, const string& contentType) {
-
-        BSONObj res;
-        if ( ! _client.runCommand( _dbName.c_str() , BSON( "filemd5" << id << "root" << _prefix ) , res ) )
-            throw UserException( 9008 , "filemd5 failed" );
+    BSONObj GridFS::insertFile(const string& name, const OID& id, gridfs_offset length, const string& contentType,
+                               const string& md5) {
 
         BSONObjBuilder file;
         file << "_id" << id
              << "filename" << name
              << "chunkSize" << _chunkSize
-             << "uploadDate" << DATENOW
-             << "md5" << res["md5"]
-             ;
+             << "uploadDate" << DATENOW;
+
+        if ( md5.empty() ) {
+            BSONObj res;
+            if ( ! _client.runCommand( _dbName.c_str() , BSON( "filemd5" << id << "root" << _prefix ) , res ) )
+                throw UserException( 9008 , "filemd5 failed" );
+            file << "md5" << res["md5"];
+        }
+        else {
+            // filemd5 would have failed had a chunk not gone in; this is the cheap way to know
+            string err = _client.getLastError();
+            uassert( 16404 , "inserting chunks failed: " + err , err.empty() );
+            file << "md5" << md5;
+        }
 
         if (length < 1024*1024*1024) { // 2^30
             file << "length" << (int) length;
@@ -225,8 +282,17 @@ namespace mongo {
 
         const int num = getNumChunks();
 
+        BSONObjBuilder b;
+        b.appendAs( _obj["_id"] , "files_id" );
+        Query q( b.obj() );
+        q.sort( BSON( "n" << 1 ) );
+        auto_ptr<DBClientCursor> cursor = _grid->_client.query( _grid->_chunksNS.c_str() , q );
+        uassert( 16405 , "couldn't query the chunks" , cursor.get() );
+
         for ( int i=0; i<num; i++ ) {
-            GridFSChunk c = getChunk( i );
+            uassert( 10014 ,  "chunk is empty!" , cursor->more() );
+            GridFSChunk c( cursor->next() );
+            uassert( 16406 , str::stream() << "missing chunk " << i , c.number() == i );
 
             int len;
             const char * data = c.data( len );
@@ -236,6 +302,32 @@ namespace mongo {
         return getContentLength();
     }
 
+    gridfs_offset GridFile::write( ostream & out , gridfs_offset offset , gridfs_offset length ) const {
+        _exists();
+
+        const gridfs_offset end = min( offset + length , getContentLength() );
+        gridfs_offset at = offset;
+        while ( at < end ) {
+            BSONObjBuilder b;
+            b.appendAs( _obj["_id"] , "fileread" );
+            b << "root" << _grid->_prefix
+              << "offset" << (long long) at
+              << "length" << (long long) ( end - at )
+              << "chunkSize" << getChunkSize();
+
+            BSONObj res;
+            uassert( 16409 , "fileread failed: " + res.toString() ,
+                     _grid->_client.runCommand( _grid->_dbName , b.obj() , res ) );
+
+            int len;
+            const char * data = res["data"].binDataClean( len );
+            uassert( 16410 , str::stream() << "chunk is missing at byte " << at , len > 0 );
+            out.write( data , len );
+            at += len;
+        }
+        return at > offset ? at - offset : 0;
+    }
+
     gridfs_offset GridFile::write( const string& where ) const {
         if (where == "-") {
             return write( cout );
@@ -27,6 +27,7 @@ namespace mongo {
 
     class GridFS;
     class GridFile;
+    class GridFSChunkWriter;
 
     class GridFSChunk {
     public:
@@ -43,9 +44,14 @@ namespace mongo {
             return _data["data"].binDataClean( len );
         }
 
+        int number() const {
+            return _data["n"].numberInt();
+        }
+
     private:
         BSONObj _data;
         friend class GridFS;
+        friend class GridFSChunkWriter;
     };
 
 
@@ -70,6 +76,12 @@ namespace mongo {
 
         unsigned int getChunkSize() const;
 
+        /**
+         * md5 the file as it's stored rather than have the server read it back for the md5
+         * with filemd5.  off by default.
+         */
+        void setClientSideMD5( bool on ) { _clientSideMD5 = on; }
+
         /**
          * puts the file reference by fileName into the db
          * @param fileName local filename relative to process
@@ -127,9 +139,11 @@ namespace mongo {
         string _filesNS;
         string _chunksNS;
         unsigned int _chunkSize;
+        bool _clientSideMD5;
 
-        // insert fileobject. All chunks must be in DB.
-        BSONObj insertFile(const string& name, const OID& id, gridfs_offset length, const string& contentType);
+        // insert fileobject. All chunks must be in DB.  md5 is the file's, or empty to ask the server
+        BSONObj insertFile(const string& name, const OID& id, gridfs_offset length, const string& contentType,
+                           const string& md5 = "");
 
         friend class GridFile;
     };
@@ -184,10 +198,19 @@ namespace mongo {
         GridFSChunk getChunk( int n ) const;
 
         /**
-           write the file to the output stream
+           write the file to the output stream.  the chunks come in one query, so each batch
+           of them is read while the last is written.
          */
         gridfs_offset write( ostream & out ) const;
 
+        /**
+           write bytes [offset, offset+length) of the file, clipped to its end, to the output
+           stream.  the server cuts the range out of the chunks, so only the bytes asked for
+           are sent.
+           @return the number of bytes written
+         */
+        gridfs_offset write( ostream & out , gridfs_offset offset , gridfs_offset length ) const;
+
         /**
            write the file to this filename
          */
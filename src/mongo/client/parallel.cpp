@@ -442,6 +442,16 @@ namespace mongo {
         _finishCons();
     }
 
+    bool ParallelSortClusteredCursor::_exhaustShardQueries = false;
+
+    int ParallelSortClusteredCursor::shardQueryOptions() {
+        int options = _qSpec.options();
+        if ( _exhaustShardQueries && ! isCommand() && ! isExplain() && _qSpec.ntoreturn() == 0 &&
+             ! ( options & QueryOption_CursorTailable ) )
+            options |= QueryOption_Exhaust;
+        return options;
+    }
+
     ParallelSortClusteredCursor::ParallelSortClusteredCursor( const QuerySpec& qSpec, const CommandInfo& cInfo )
         : ClusteredCursor( qSpec ),
           _qSpec( qSpec ), _cInfo( cInfo ), _totalTries( 0 )
@@ -463,6 +473,7 @@ namespace mongo {
         _numServers = _servers.size();
         _lastFrom = 0;
         _cursors = 0;
+        _mergeStarted = false;
 
         if( ! _qSpec.isEmpty() ){
 
@@ -552,6 +563,12 @@ namespace mongo {
                 }
             }
 
+            // a cursor still being streamed to takes its connection down with it, so it has
+            // to go before the connection does
+            if( pcState->cursor && pcState->cursor->streaming() ){
+                pcState->cursor.reset();
+            }
+
             // Double-check conn is closed
             if( pcState->conn ){
                 pcState->conn->done();
@@ -754,6 +771,20 @@ namespace mongo {
         }
     }
     
+    /** @return query with its filter, which may be wrapped along with orderby etc., replaced */
+    static BSONObj replaceFilter( const BSONObj& query, const BSONObj& filter ) {
+        bool hasDollar;
+        if( ! Query( query ).isComplex( &hasDollar ) ) return filter;
+
+        const char* name = hasDollar ? "$query" : "query";
+        BSONObjBuilder b;
+        BSONForEach( e, query ){
+            if( strcmp( e.fieldName(), name ) == 0 ) b.append( name, filter );
+            else b.append( e );
+        }
+        return b.obj();
+    }
+
     void ParallelSortClusteredCursor::startInit() {
 
         bool returnPartial = ( _qSpec.options() & QueryOption_PartialResults );
@@ -771,6 +802,7 @@ namespace mongo {
 
         set<Shard> todoStorage;
         set<Shard>& todo = todoStorage;
+        map<Shard,BSONObj> shardQueries;
         string vinfo;
 
         if( isVersioned() ){
@@ -787,6 +819,14 @@ namespace mongo {
             if( manager ) manager->getShardsForQuery( todo, specialFilter ? _cInfo.cmdFilter : _qSpec.filter() );
             else if( primary ) todo.insert( *primary );
 
+            // Each shard only needs the $in values and $or clauses its chunks can match
+            if( manager && ! specialFilter && todo.size() > 1 ){
+                map<Shard,BSONObj> filters;
+                manager->getShardQueries( filters, todo, _qSpec.filter() );
+                for( map<Shard,BSONObj>::iterator i = filters.begin(); i != filters.end(); ++i )
+                    shardQueries[ i->first ] = replaceFilter( _qSpec.query(), i->second );
+            }
+
             // Close all cursors on extra shards first, as these will be invalid
             for( map< Shard, PCMData >::iterator i = _cursorMap.begin(), end = _cursorMap.end(); i != end; ++i ){
 
@@ -868,6 +908,9 @@ namespace mongo {
 
                 const string& ns = _qSpec.ns();
 
+                map<Shard,BSONObj>::const_iterator sq = shardQueries.find( shard );
+                BSONObj query = sq == shardQueries.end() ? _qSpec.query() : sq->second;
+
                 // Setup cursor
                 if( ! state->cursor ){
 
@@ -875,12 +918,12 @@ namespace mongo {
                     // or if the number of shards to query is > 1
                     if( ( isVersioned() && ! primary ) || _qShards.size() > 1 ){
 
-                        state->cursor.reset( new DBClientCursor( state->conn->get(), ns, _qSpec.query(),
+                        state->cursor.reset( new DBClientCursor( state->conn->get(), ns, query,
                                                                  isCommand() ? 1 : 0, // nToReturn (0 if query indicates multi)
                                                                  0, // nToSkip
                                                                  // Does this need to be a ptr?
                                                                  _qSpec.fields().isEmpty() ? 0 : _qSpec.fieldsData(), // fieldsToReturn
-                                                                 _qSpec.options(), // options
+                                                                 shardQueryOptions(), // options
                                                                  // NtoReturn is weird.
                                                                  // If zero, it means use default size, so we do that for all cursors
                                                                  // If positive, it's the batch size (we don't want this cursor limiting results), that's
@@ -903,7 +946,7 @@ namespace mongo {
                                                                  _qSpec.ntoskip(), // nToSkip
                                                                  // Does this need to be a ptr?
                                                                  _qSpec.fields().isEmpty() ? 0 : _qSpec.fieldsData(), // fieldsToReturn
-                                                                 _qSpec.options(), // options
+                                                                 shardQueryOptions(), // options
                                                                  0 ) ); // batchSize
                     }
                 }
@@ -1530,6 +1573,11 @@ namespace mongo {
             _needToSkip = n;
         }
 
+        if ( ! _sortKey.isEmpty() ) {
+            _startMerge();
+            return ! _merge.empty();
+        }
+
         for ( int i=0; i<_numServers; i++ ) {
             if ( _cursors[i].more() )
                 return true;
@@ -1537,7 +1585,84 @@ namespace mongo {
         return false;
     }
 
+    namespace {
+        /** orders cursor indexes so that the one with the first document is on top of a heap */
+        class MergeOrder {
+        public:
+            MergeOrder( FilteringClientCursor* cursors, const BSONObj& sortKey )
+                : _cursors( cursors ), _sortKey( sortKey ) {}
+            bool operator()( int a, int b ) const {
+                return _cursors[a].peek().woSortOrder( _cursors[b].peek(), _sortKey, true ) > 0;
+            }
+        private:
+            FilteringClientCursor* _cursors;
+            const BSONObj& _sortKey;
+        };
+    }
+
+    void ParallelSortClusteredCursor::_startMerge() {
+        if ( _mergeStarted )
+            return;
+        _mergeStarted = true;
+
+        for ( int i = 0; i < _numServers; i++ ) {
+            if ( _cursors[i].more() )
+                _merge.push_back( i );
+            else if ( _cursors[i].rawMData() )
+                _cursors[i].rawMData()->pcState->done = true;
+        }
+        make_heap( _merge.begin(), _merge.end(), MergeOrder( _cursors, _sortKey ) );
+    }
+
+    /**
+     * Sizes the next batch from cursor i by how much of the merge it has supplied: each
+     * getMore asks for twice what the last batch held, so a shard whose documents sort late
+     * isn't made to send megabytes nobody reads, while one the merge keeps draining soon
+     * reaches the server's own limit.
+     */
+    void ParallelSortClusteredCursor::_growBatch( int i ) {
+        enum { FirstBatch = 101, MaxBatch = 64 * 1024 };
+
+        DBClientCursor* c = _cursors[i].raw();
+        if ( ! c || c->moreInCurrentBatch() || c->getCursorId() == 0 )
+            return;
+
+        // a negative batch size means a single batch was all that was wanted
+        int bs = c->getBatchSize();
+        if ( bs < 0 )
+            return;
+        if ( bs == 0 )
+            bs = FirstBatch;
+        c->setBatchSize( bs < MaxBatch / 2 ? bs * 2 : MaxBatch );
+    }
+
     BSONObj ParallelSortClusteredCursor::next() {
+        if ( ! _sortKey.isEmpty() ) {
+            _startMerge();
+            uassert( 10019 ,  "no more elements" , ! _merge.empty() );
+
+            MergeOrder order( _cursors, _sortKey );
+            pop_heap( _merge.begin(), _merge.end(), order );
+            int from = _merge.back();
+            _merge.pop_back();
+
+            // taking the last document of the batch prefetches from the next one
+            _growBatch( from );
+            BSONObj best = _cursors[from].next();
+
+            if( _cursors[from].rawMData() )
+                _cursors[from].rawMData()->pcState->count++;
+
+            if ( _cursors[from].more() ) {
+                _merge.push_back( from );
+                push_heap( _merge.begin(), _merge.end(), order );
+            }
+            else if( _cursors[from].rawMData() ) {
+                _cursors[from].rawMData()->pcState->done = true;
+            }
+            return best;
+        }
+
         BSONObj best = BSONObj();
         int bestFrom = -1;
 
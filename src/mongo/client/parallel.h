@@ -367,6 +367,11 @@ namespace mongo {
 
         virtual void explain(BSONObjBuilder& b);
 
+        /** have shards stream the batches of plain multi-batch queries, rather than wait for
+            a getMore for each.  each such cursor keeps its connection, and a thread on its
+            shard, until it is drained or dropped */
+        static void setExhaustShardQueries( bool on ) { _exhaustShardQueries = on; }
+
     protected:
         void _finishCons();
         void _init();
@@ -397,6 +402,17 @@ namespace mongo {
         int _needToSkip;
 
     private:
+        /** with a sort, the cursors with more to give, as a heap on their next documents */
+        vector<int> _merge;
+        bool _mergeStarted;
+
+        void _startMerge();
+        void _growBatch( int i );
+        static bool _exhaustShardQueries;
+
+        /** @return the options to query a shard with */
+        int shardQueryOptions();
+
         /**
          * Setups the shard version of the connection. When using a replica
          * set connection and the primary cannot be reached, the version
@@ -434,6 +450,12 @@ namespace mongo {
                 return _res;
             }
 
+            /**
+             * @return the connection given to spawnCommand(), over which the getMore()s of a
+             *         cursor the command returned go; NULL if none was given
+             */
+            DBClientBase* getConnection() const { return _connHolder ? 0 : _conn; }
+
             /**
                blocks until command is done
                returns ok()
@@ -466,7 +488,9 @@ namespace mongo {
          * @param server server name
          * @param db db name
          * @param cmd cmd to exec
-         * @param conn optional connection to use.  will use standard pooled if non-specified
+         * @param conn optional connection to use.  will use standard pooled if non-specified.
+         *             several commands may be spawned on one DBClientConnection at once; their
+         *             requests are pipelined and each join() claims its own reply.
          */
         static shared_ptr<CommandResult> spawnCommand( const string& server , const string& db , const BSONObj& cmd , int options , DBClientBase * conn = 0 );
     };
@@ -20,6 +20,8 @@
 
 #include "mongo/client/syncclusterconnection.h"
 
+#include <boost/thread/thread.hpp>
+
 #include "mongo/client/dbclientcursor.h"
 #include "mongo/db/dbmessage.h"
 
@@ -76,50 +78,78 @@ namespace mongo {
         return fsync( errmsg );
     }
 
-    bool SyncClusterConnection::fsync( string& errmsg ) {
-        bool ok = true;
-        errmsg = "";
-        for ( size_t i=0; i<_conns.size(); i++ ) {
-            BSONObj res;
+    void SyncClusterConnection::_onEach( const boost::function<void(size_t)>& f ) {
+        boost::thread_group threads;
+        for ( size_t i = 1; i < _conns.size(); i++ ) {
             try {
-                if ( _conns[i]->simpleCommand( "admin" , &res , "fsync" ) )
-                    continue;
+                threads.create_thread( boost::bind( f , i ) );
             }
-            catch ( DBException& e ) {
-                errmsg += e.toString();
-            }
-            catch ( std::exception& e ) {
-                errmsg += e.what();
-            }
-            catch ( ... ) {
-                warning() << "unknown exception in SyncClusterConnection::fsync" << endl;
+            catch ( boost::thread_resource_error& ) {
+                f( i );
             }
+        }
+        if ( ! _conns.empty() )
+            f( 0 );
+        threads.join_all();
+    }
+
+    void SyncClusterConnection::_fsyncOne( size_t i , vector<string>* errors ) {
+        string* errmsg = &(*errors)[i];
+        BSONObj res;
+        try {
+            if ( _conns[i]->simpleCommand( "admin" , &res , "fsync" ) )
+                return;
+        }
+        catch ( DBException& e ) {
+            *errmsg += e.toString();
+        }
+        catch ( std::exception& e ) {
+            *errmsg += e.what();
+        }
+        catch ( ... ) {
+            warning() << "unknown exception in SyncClusterConnection::fsync" << endl;
+        }
+        *errmsg += " " + _conns[i]->toString() + ":" + res.toString();
+    }
+
+    bool SyncClusterConnection::fsync( string& errmsg ) {
+        vector<string> errors( _conns.size() );
+        _onEach( boost::bind( &SyncClusterConnection::_fsyncOne , this , _1 , &errors ) );
+
+        bool ok = true;
+        errmsg = "";
+        for ( size_t i=0; i<errors.size(); i++ ) {
+            if ( errors[i].empty() )
+                continue;
             ok = false;
-            errmsg += " " + _conns[i]->toString() + ":" + res.toString();
+            errmsg += errors[i];
         }
         return ok;
     }
 
+    void SyncClusterConnection::_lastErrorOne( size_t i , vector<string>* errors ) {
+        BSONObj* res = &_lastErrors[i];
+        string* err = &(*errors)[i];
+        try {
+            if ( ! _conns[i]->runCommand( "admin" , BSON( "getlasterror" << 1 << "fsync" << 1 ) , *res ) )
+                *err = "cmd failed: ";
+        }
+        catch ( std::exception& e ) {
+            *err += e.what();
+        }
+        catch ( ... ) {
+            *err += "unknown failure";
+        }
+        *res = res->getOwned();
+    }
+
     void SyncClusterConnection::_checkLast() {
         _lastErrors.clear();
-        vector<string> errors;
+        _lastErrors.resize( _conns.size() );
+        vector<string> errors( _conns.size() );
 
-        for ( size_t i=0; i<_conns.size(); i++ ) {
-            BSONObj res;
-            string err;
-            try {
-                if ( ! _conns[i]->runCommand( "admin" , BSON( "getlasterror" << 1 << "fsync" << 1 ) , res ) )
-                    err = "cmd failed: ";
-            }
-            catch ( std::exception& e ) {
-                err += e.what();
-            }
-            catch ( ... ) {
-                err += "unknown failure";
-            }
-            _lastErrors.push_back( res.getOwned() );
-            errors.push_back( err );
-        }
+        // each server fsyncs, so wait on all of them at once
+        _onEach( boost::bind( &SyncClusterConnection::_lastErrorOne , this , _1 , &errors ) );
 
         verify( _lastErrors.size() == errors.size() && _lastErrors.size() == _conns.size() );
 
@@ -173,9 +203,15 @@ namespace mongo {
                 if ( ! prepare( errmsg ) )
                     throw UserException( 13104 , (string)"SyncClusterConnection::findOne prepare failed: " + errmsg );
 
-                vector<BSONObj> all;
-                for ( size_t i=0; i<_conns.size(); i++ ) {
-                    all.push_back( _conns[i]->findOne( ns , query , 0 , queryOptions ).getOwned() );
+                vector<BSONObj> all( _conns.size() );
+                vector<string> errors( _conns.size() );
+                _onEach( boost::bind( &SyncClusterConnection::_findOneOn , this , _1 ,
+                                      boost::cref( ns ) , boost::cref( query ) , queryOptions ,
+                                      &all , &errors ) );
+                for ( size_t i=0; i<errors.size(); i++ ) {
+                    uassert( 16424 , str::stream() << "write $cmd failed on " << _conns[i]->toString()
+                                                   << ": " << errors[i] ,
+                             errors[i].empty() );
                 }
 
                 _checkLast();
@@ -199,6 +235,23 @@ namespace mongo {
         return DBClientBase::findOne( ns , query , fieldsToReturn , queryOptions );
     }
 
+    void SyncClusterConnection::_findOneOn( size_t i , const string& ns , const Query& query ,
+                                            int queryOptions , vector<BSONObj>* results ,
+                                            vector<string>* errors ) {
+        try {
+            (*results)[i] = _conns[i]->findOne( ns , query , 0 , queryOptions ).getOwned();
+        }
+        catch ( DBException& e ) {
+            (*errors)[i] = e.toString();
+        }
+        catch ( std::exception& e ) {
+            (*errors)[i] = e.what();
+        }
+        catch ( ... ) {
+            (*errors)[i] = "unknown failure";
+        }
+    }
+
     bool SyncClusterConnection::auth(const string &dbname, const string &username, const string &password_text, string& errmsg, bool digestPassword, Auth::Level* level) {
         for (vector<DBClientConnection*>::iterator it = _conns.begin(); it < _conns.end(); it++) {
             massert( 15848, "sync cluster of sync clusters?", (*it)->type() != ConnectionString::SYNC);
@@ -111,6 +111,19 @@ namespace mongo {
         void _checkLast();
         void _connect( string host );
 
+        /**
+         * calls f( i ) for each of the servers, each in its own thread so the round trips
+         * overlap, and returns once they all have.  f mustn't throw.
+         */
+        void _onEach( const boost::function<void(size_t)>& f );
+
+        // the parts of fsync(), _checkLast() and findOne() run against server i, each leaving
+        // its result and any error in slot i of the vectors given
+        void _fsyncOne( size_t i , vector<string>* errors );
+        void _lastErrorOne( size_t i , vector<string>* errors );
+        void _findOneOn( size_t i , const string& ns , const Query& query , int queryOptions ,
+                         vector<BSONObj>* results , vector<string>* errors );
+
         string _address;
         vector<string> _connAddresses;
         vector<DBClientConnection*> _conns;
@@ -0,0 +1,127 @@
+// @file admission.cpp
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+
+#include "mongo/db/admission.h"
+
+#include "mongo/db/jsobj.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/util/concurrency/ticketholder.h"
+#include "mongo/util/mongoutils/str.h"
+#include "mongo/util/net/message.h"
+#include "mongo/util/timer.h"
+
+namespace mongo {
+
+    namespace {
+
+        struct Pool : boost::noncopyable {
+            Pool() : tickets( 0 ), limited( false ) {}
+            TicketHolder tickets;
+            bool limited;
+            AtomicUInt32 waiting;       // queued for a ticket now
+            AtomicInt64 waits;          // ops which had to queue
+            AtomicInt64 waitMicros;     // total time they queued
+
+            void acquire() {
+                if ( tickets.tryAcquire() )
+                    return;
+                waiting.fetchAndAdd( 1 );
+                Timer t;
+                tickets.waitForTicket();
+                waitMicros.fetchAndAdd( t.micros() );
+                waits.fetchAndAdd( 1 );
+                waiting.subtractAndFetch( 1 );
+            }
+
+            void append( BSONObjBuilder &b, const char *name ) const {
+                BSONObjBuilder p( b.subobjStart( name ) );
+                p.append( "out", tickets.used() );
+                p.append( "available", tickets.available() );
+                p.append( "totalTickets", tickets.outof() );
+                p.append( "queued", static_cast<int>( waiting.load() ) );
+                p.appendNumber( "totalQueued", waits.load() );
+                p.appendNumber( "totalQueuedMicros", waitMicros.load() );
+                p.done();
+            }
+        };
+
+        Pool readPool;
+        Pool writePool;
+
+        Pool &pool( AdmissionTicket::Kind kind ) {
+            verify( kind != AdmissionTicket::None );
+            return kind == AdmissionTicket::Read ? readPool : writePool;
+        }
+
+    } // namespace
+
+    AdmissionTicket::Kind AdmissionTicket::kindFor( int op, bool isCommand, bool nested,
+                                                    const char *ns ) {
+        Kind kind;
+        switch( op ) {
+        case dbQuery:
+        case dbGetMore:
+            kind = Read;
+            break;
+        case dbInsert:
+        case dbUpdate:
+        case dbDelete:
+            kind = Write;
+            break;
+        default:
+            // the message of other ops may not start with an ns
+            return None;
+        }
+        if ( isCommand || nested || str::startsWith( ns, "local." ) )
+            return None;
+        return kind;
+    }
+
+    AdmissionTicket::AdmissionTicket( Kind kind ) : _held( None ) {
+        if ( kind == None || !pool( kind ).limited )
+            return;
+        pool( kind ).acquire();
+        _held = kind;
+    }
+
+    AdmissionTicket::~AdmissionTicket() {
+        if ( _held != None )
+            pool( _held ).tickets.release();
+    }
+
+    void AdmissionTicket::setPoolSize( Kind kind, int tickets ) {
+        Pool &p = pool( kind );
+        p.limited = tickets > 0;
+        if ( p.limited )
+            p.tickets.resize( tickets );
+    }
+
+    void AdmissionTicket::appendStats( BSONObjBuilder &b ) {
+        if ( !readPool.limited && !writePool.limited )
+            return;
+        BSONObjBuilder t( b.subobjStart( "tickets" ) );
+        if ( readPool.limited )
+            readPool.append( t, "read" );
+        if ( writePool.limited )
+            writePool.append( t, "write" );
+        t.done();
+    }
+
+} // namespace mongo
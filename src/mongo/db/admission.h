@@ -0,0 +1,58 @@
+// @file admission.h - Caps on the client reads and writes running at once.
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+
+namespace mongo {
+
+    class BSONObjBuilder;
+
+    /**
+     * A ticket from the read or write pool, taken by assembleResponse before any lock so that no
+     * more than --readTickets queries and getMores and --writeTickets inserts, updates and
+     * deletes run at once.  The others queue here, rather than all at once on the lock where
+     * thousands of connections would spend their time context switching.
+     *
+     * A pool of size 0, the default, admits everything.  Commands, nested operations and ops on
+     * the local database never take a ticket: they may wait on other operations (getLastError on
+     * replication, say) which would need a ticket of their own.
+     */
+    class AdmissionTicket : boost::noncopyable {
+    public:
+        enum Kind { None, Read, Write };
+
+        /** @return the pool an operation waits on, or None. */
+        static Kind kindFor( int op, bool isCommand, bool nested, const char *ns );
+
+        /** Waits for a ticket of 'kind', unless its pool is unlimited. */
+        AdmissionTicket( Kind kind );
+        ~AdmissionTicket();
+
+        /** Called at startup, before any operation is admitted.  0 for no limit. */
+        static void setPoolSize( Kind kind, int tickets );
+
+        /** serverStatus globalLock.tickets; nothing is appended if both pools are unlimited. */
+        static void appendStats( BSONObjBuilder &b );
+
+    private:
+        Kind _held;
+    };
+
+} // namespace mongo
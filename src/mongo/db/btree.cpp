@@ -27,8 +27,11 @@
 #include "dbhelpers.h"
 #include "curop-inl.h"
 #include "stats/counters.h"
+#include "stats/namespace_io.h"
+#include "stats/working_set.h"
 #include "dur_commitjob.h"
 #include "btreebuilder.h"
+#include "mongo/util/concurrency/threadlocal.h"
 #include "mongo/util/startup_test.h"
 #include "../server.h"
 
@@ -36,6 +39,7 @@ namespace mongo {
 
     BOOST_STATIC_ASSERT( Record::HeaderSize == 16 );
     BOOST_STATIC_ASSERT( Record::HeaderSize + BtreeData_V1::BucketSize == 8192 );
+    BOOST_STATIC_ASSERT( Record::HeaderSize + BtreeData_V2::BucketSize == 8192 );
 
     NOINLINE_DECL void checkFailed(unsigned line) {
         static time_t last;
@@ -327,7 +331,7 @@ namespace mongo {
         KeyNode kn = keyNode(this->n-1);
         recLoc = kn.recordLoc;
         key.assign(kn.key);
-        int keysize = kn.key.dataSize();
+        int keysize = this->_keySize(k(this->n-1).keyDataOfs());
 
         massert( 10283 , "rchild not null in btree popBack()", this->nextChild.isNull());
 
@@ -345,7 +349,8 @@ namespace mongo {
     /** add a key.  must be > all existing.  be careful to set next ptr right. */
     template< class V >
     bool BucketBasics<V>::_pushBack(const DiskLoc recordLoc, const Key& key, const Ordering &order, const DiskLoc prevChild) {
-        int bytesNeeded = key.dataSize() + sizeof(_KeyNode);
+        int keySize = this->_storedSize(key);
+        int bytesNeeded = keySize + sizeof(_KeyNode);
         if ( bytesNeeded > this->emptySize )
             return false;
         verify( bytesNeeded <= this->emptySize );
@@ -363,10 +368,11 @@ namespace mongo {
         _KeyNode& kn = k(this->n++);
         kn.prevChildBucket = prevChild;
         kn.recordLoc = recordLoc;
-        kn.setKeyDataOfs( (short) _alloc(key.dataSize()) );
+        kn.setKeyDataOfs( (short) _alloc(keySize) );
         short ofs = kn.keyDataOfs();
         char *p = dataAt(ofs);
-        memcpy(p, key.data(), key.dataSize());
+        if ( this->_storeKey(p, key) )
+            setNotPacked();
 
         return true;
     }
@@ -383,9 +389,13 @@ namespace mongo {
     bool BucketBasics<V>::basicInsert(const DiskLoc thisLoc, int &keypos, const DiskLoc recordLoc, const Key& key, const Ordering &order) const {
         check( this->n < 1024 );
         check( keypos >= 0 && keypos <= this->n );
-        int bytesNeeded = key.dataSize() + sizeof(_KeyNode);
+        int keySize = this->_storedSize(key);
+        int bytesNeeded = keySize + sizeof(_KeyNode);
         if ( bytesNeeded > this->emptySize ) {
             _pack(thisLoc, order, keypos);
+            // packing may have changed the bucket's key prefix
+            keySize = this->_storedSize(key);
+            bytesNeeded = keySize + sizeof(_KeyNode);
             if ( bytesNeeded > this->emptySize )
                 return false;
         }
@@ -415,10 +425,14 @@ namespace mongo {
         _KeyNode& kn = b->k(keypos);
         kn.prevChildBucket.Null();
         kn.recordLoc = recordLoc;
-        kn.setKeyDataOfs((short) b->_alloc(key.dataSize()) );
+        kn.setKeyDataOfs((short) b->_alloc(keySize) );
         char *p = b->dataAt(kn.keyDataOfs());
-        getDur().declareWriteIntent(p, key.dataSize());
-        memcpy(p, key.data(), key.dataSize());
+        getDur().declareWriteIntent(p, keySize);
+        if ( b->_storeKey(p, key) ) {
+            // stored whole, so a repack may find a prefix it shares
+            getDur().declareWriteIntent(&b->flags, sizeof(this->flags));
+            b->setNotPacked();
+        }
         return true;
     }
 
@@ -544,19 +558,33 @@ namespace mongo {
      * This function is expected to be called on a packed bucket.
      */
     template< class V >
-    int BucketBasics<V>::splitPos( int keypos ) const {
+    int BucketBasics<V>::splitPos( int keypos, int edge ) const {
         verify( this->n > 2 );
         int split = 0;
-        int rightSize = 0;
-        // when splitting a btree node, if the new key is greater than all the other keys, we should not do an even split, but a 90/10 split.
-        // see SERVER-983
-        // TODO I think we only want to do the 90% split on the rhs node of the tree.
-        int rightSizeLimit = ( this->topSize + sizeof( _KeyNode ) * this->n ) / ( keypos == this->n ? 10 : 2 );
-        for( int i = this->n - 1; i > -1; --i ) {
-            rightSize += keyNode( i ).key.dataSize() + sizeof( _KeyNode );
-            if ( rightSize > rightSizeLimit ) {
-                split = i;
-                break;
+        // when splitting a btree node, if the new key is greater than all the other keys of the
+        // tree, we should not do an even split, but a 90/10 split.  see SERVER-983.  the same
+        // goes, mirrored, for keys less than all the others, as for a descending index on an
+        // increasing field.  elsewhere in the tree an append to one bucket is no hint about the
+        // next insert, so those splits stay even.
+        int sizeLimit = ( this->topSize + sizeof( _KeyNode ) * this->n ) / ( edge != 0 ? 10 : 2 );
+        if ( edge < 0 && keypos == 0 ) {
+            int leftSize = 0;
+            for( int i = 0; i < this->n; ++i ) {
+                leftSize += this->_keySize( k( i ).keyDataOfs() ) + sizeof( _KeyNode );
+                if ( leftSize > sizeLimit ) {
+                    split = i;
+                    break;
+                }
+            }
+        }
+        else {
+            int rightSize = 0;
+            for( int i = this->n - 1; i > -1; --i ) {
+                rightSize += this->_keySize( k( i ).keyDataOfs() ) + sizeof( _KeyNode );
+                if ( rightSize > sizeLimit ) {
+                    split = i;
+                    break;
+                }
             }
         }
         // safeguards - we must not create an empty bucket
@@ -585,10 +613,11 @@ namespace mongo {
         _KeyNode &kn = k( i );
         kn.recordLoc = recordLoc;
         kn.prevChildBucket = prevChildBucket;
-        short ofs = (short) _alloc( key.dataSize() );
+        short ofs = (short) _alloc( this->_storedSize( key ) );
         kn.setKeyDataOfs( ofs );
         char *p = dataAt( ofs );
-        memcpy( p, key.data(), key.dataSize() );
+        if ( this->_storeKey( p, key ) )
+            setNotPacked();
     }
 
     template< class V >
@@ -742,25 +771,46 @@ namespace mongo {
      * note result might be an Unused location!
      */
 
-    bool guessIncreasing = false;
+    /** set while inserting a key that is likely to go after all the keys of the buckets on its
+        path, so find() probes the last key first.  an insert starts out guessing at the root and
+        stops as soon as its key doesn't go to the right end of a bucket: appends of increasing
+        keys then cost one compare per level, other inserts at most one extra compare overall.
+        per thread, so an insert doesn't steer the lookups of readers or of other inserts.
+    */
+    TSP_DECLARE(bool, btreeGuessIncreasing)
+    TSP_DEFINE(bool, btreeGuessIncreasing)
+    static inline bool& guessIncreasing() { return *btreeGuessIncreasing.getMake(); }
+
     template< class V >
     bool BtreeBucket<V>::find(const IndexDetails& idx, const Key& key, const DiskLoc &rl, 
 			      const Ordering &order, int& pos, bool assertIfDup) const {
         Loc recordLoc;
         recordLoc = rl;
-        globalIndexCounters.btree( (char*)this );
+        if ( Record::blockCheckSupported() ) {
+            bool inMemory = Record::likelyInPhysicalMemory( (const char*)this );
+            globalIndexCounters.btree( inMemory );
+            NamespaceIO::noteBucket( idx , inMemory );
+        }
+        WorkingSet::note( this , WorkingSet::Index );
 
         // binary search for this key
         bool dupsChecked = false;
         int l=0;
         int h=this->n-1;
         int m = (l+h)/2;
-        if( guessIncreasing ) {
+        bool *guess = btreeGuessIncreasing.get();
+        if( guess && *guess ) {
             m = h;
         }
         while ( l <= h ) {
-            KeyNode M = this->keyNode(m);
-            int x = key.woCompare(M.key, order);
+            const _KeyNode &M = k(m);
+            // whichever way this compare goes, the next probe's key data is elsewhere in the
+            // bucket; start loading both candidates so the miss overlaps this compare
+            if ( l < m )
+                this->prefetchKey( (l+m-1)/2 );
+            if ( m < h )
+                this->prefetchKey( (m+1+h)/2 );
+            int x = this->_compareKey(key, M.keyDataOfs(), order);
             if ( x == 0 ) {
                 if( assertIfDup ) {
                     if( k(m).isUnused() ) {
@@ -984,7 +1034,7 @@ namespace mongo {
         const BtreeBucket *r = BTREE(this->childForPos( leftIndex + 1 ));
 
         int KNS = sizeof( _KeyNode );
-        int rightSizeLimit = ( l->topSize + l->n * KNS + keyNode( leftIndex ).key.dataSize() + KNS + r->topSize + r->n * KNS ) / 2;
+        int rightSizeLimit = ( l->usedDataSize() + keyNode( leftIndex ).key.dataSize() + KNS + r->usedDataSize() ) / 2;
         // This constraint should be ensured by only calling this function
         // if we go below the low water mark.
         verify( rightSizeLimit < BtreeBucket<V>::bodySize() );
@@ -1083,6 +1133,21 @@ namespace mongo {
         return -1; // just to compile
     }
 
+    template< class V >
+    bool BtreeBucket<V>::onEdge( const DiskLoc &thisLoc, int direction ) const {
+        DiskLoc loc = thisLoc;
+        const BtreeBucket *b = this;
+        while( !b->parent.isNull() ) {
+            const BtreeBucket *p = BTREE(b->parent);
+            const DiskLoc edgeChild = direction > 0 ? p->nextChild : p->k( 0 ).prevChildBucket;
+            if ( edgeChild != loc )
+                return false;
+            loc = b->parent;
+            b = p;
+        }
+        return true;
+    }
+
     template< class V >
     bool BtreeBucket<V>::tryBalanceChildren( const DiskLoc thisLoc, int leftIndex, IndexDetails &id, const Ordering &order ) const {
         // If we can merge, then we must merge rather than balance to preserve
@@ -1090,6 +1155,12 @@ namespace mongo {
         if ( canMergeChildren( thisLoc, leftIndex ) ) {
             return false;
         }
+        // Balancing relies on each child fitting a bucket body, which v2 children
+        // whose keys share a prefix may not when sized with their keys whole.
+        if ( BTREE(this->childForPos( leftIndex ))->packedDataSize( 0 ) > this->bodySize() ||
+                BTREE(this->childForPos( leftIndex + 1 ))->packedDataSize( 0 ) > this->bodySize() ) {
+            return false;
+        }
         thisLoc.btreemod<V>()->doBalanceChildren( thisLoc, leftIndex, id, order );
         return true;
     }
@@ -1215,11 +1286,11 @@ namespace mongo {
         }
 
         BtreeBucket *pm = BTREEMOD(this->parent);
-        if ( mayBalanceRight ) {
+        if ( mayBalanceRight && p->canMergeChildren( this->parent, parentIdx ) ) {
             pm->doMergeChildren( this->parent, parentIdx, id, order );
             return true;
         }
-        else if ( mayBalanceLeft ) {
+        else if ( mayBalanceLeft && p->canMergeChildren( this->parent, parentIdx - 1 ) ) {
             pm->doMergeChildren( this->parent, parentIdx - 1, id, order );
             return true;
         }
@@ -1227,6 +1298,20 @@ namespace mongo {
         return false;
     }
 
+    template< class V >
+    bool BtreeBucket<V>::relocate(const DiskLoc thisLoc, IndexDetails& id, const BSONObj& key,
+                                  const DiskLoc oldLoc, const DiskLoc newLoc ) const {
+        int pos;
+        bool found;
+        const Ordering ord = Ordering::make(id.keyPattern());
+        DiskLoc loc = locate(id, thisLoc, key, ord, pos, found, oldLoc, 1);
+        if ( !found ) {
+            return false;
+        }
+        loc.btree<V>()->k(pos).writing().recordLoc = newLoc;
+        return true;
+    }
+
     /** remove a key from the index */
     template< class V >
     bool BtreeBucket<V>::unindex(const DiskLoc thisLoc, IndexDetails& id, const BSONObj& key, const DiskLoc recordLoc ) const {
@@ -1360,9 +1445,15 @@ namespace mongo {
         if ( split_debug )
             out() << "    " << thisLoc.toString() << ".split" << endl;
 
-        int split = this->splitPos( keypos );
+        int edge = 0;
+        if ( keypos == this->n && onEdge( thisLoc, 1 ) )
+            edge = 1;
+        else if ( keypos == 0 && onEdge( thisLoc, -1 ) )
+            edge = -1;
+        int split = this->splitPos( keypos, edge );
         DiskLoc rLoc = addBucket(idx);
         BtreeBucket *r = rLoc.btreemod<V>();
+        r->copyPrefixFrom(*this);
         if ( split_debug )
             out() << "     split:" << split << ' ' << keyNode(split).key.toString() << " n:" << this->n << endl;
         for ( int i = split+1; i < this->n; i++ ) {
@@ -1530,6 +1621,24 @@ namespace mongo {
             return pos == this->n ? DiskLoc() /*theend*/ : thisLoc;
     }
 
+    template< class V >
+    Record* BtreeBucket<V>::bucketNotInMemory(const IndexDetails& idx, const DiskLoc& thisLoc, const BSONObj& key, const DiskLoc &recordLoc) const {
+        KeyOwned k(key);
+        const Ordering order = Ordering::make(idx.keyPattern());
+        DiskLoc loc = thisLoc;
+        while( !loc.isNull() ) {
+            Record *r = loc.rec();
+            if ( !r->likelyInPhysicalMemory() )
+                return r;
+            const BtreeBucket<V> *b = BTREE(loc);
+            int p;
+            if ( b->find(idx, k, recordLoc, order, p, /*assertIfDup*/ false) )
+                return 0;
+            loc = b->childForPos(p);
+        }
+        return 0;
+    }
+
     template< class V >
     bool BtreeBucket<V>::customFind( int l, int h, const BSONObj &keyBegin, int keyBeginLen, bool afterKey, const vector< const BSONElement * > &keyEnd, const vector< bool > &keyEndInclusive, const Ordering &order, int direction, DiskLoc &thisLoc, int &keyOfs, pair< DiskLoc, int > &bestParent ) {
         const BtreeBucket<V> * bucket = BTREE(thisLoc);
@@ -1705,6 +1814,8 @@ namespace mongo {
 
         int pos;
         bool found = find(c.idx, c.key, c.recordLoc, c.order, pos, !dupsAllowed);
+        if ( pos != this->n )
+            guessIncreasing() = false;
 
         if ( found ) {
             const _KeyNode& kn = k(pos);
@@ -1754,6 +1865,8 @@ namespace mongo {
 
         int pos;
         bool found = find(idx, key, recordLoc, order, pos, !dupsAllowed);
+        if ( pos != this->n )
+            guessIncreasing() = false;
         if ( insert_debug ) {
             out() << "  " << thisLoc.toString() << '.' << "_insert " <<
                   key.toString() << '/' << recordLoc.toString() <<
@@ -1825,7 +1938,15 @@ namespace mongo {
             problem() << "ERROR: key too large len:" << c.key.dataSize() << " max:" << this->KeyMax << ' ' << c.key.dataSize() << ' ' << c.idx.indexNamespace() << endl;
             return; // op=Nothing
         }
-        insertStepOne(thisLoc, c, dupsAllowed);
+        guessIncreasing() = true;
+        try {
+            insertStepOne(thisLoc, c, dupsAllowed);
+        }
+        catch( ... ) {
+            guessIncreasing() = false;
+            throw;
+        }
+        guessIncreasing() = false;
     }
 
     /** todo: meaning of return code unclear clean up */
@@ -1834,7 +1955,6 @@ namespace mongo {
                                const BSONObj& _key, const Ordering &order, bool dupsAllowed,
                                IndexDetails& idx, bool toplevel) const 
     {
-        guessIncreasing = _key.firstElementType() == jstOID && idx.isIdIndex();
         KeyOwned key(_key);
 
         dassert(toplevel); 
@@ -1846,15 +1966,16 @@ namespace mongo {
         }
 
         int x;
+        guessIncreasing() = true;
         try {
             x = _insert(thisLoc, recordLoc, key, order, dupsAllowed, DiskLoc(), DiskLoc(), idx);
             this->assertValid( order );
         }
         catch( ... ) { 
-            guessIncreasing = false;
+            guessIncreasing() = false;
             throw;
         }
-        guessIncreasing = false;
+        guessIncreasing() = false;
         return x;
     }
 
@@ -1945,10 +2066,150 @@ namespace mongo {
         // b->dumpTree(id.head, order);
     }
 
+    /* - BucketBasics<V2> ----------------------------------------------- */
+
+    template<>
+    int BucketBasics<V2>::packedDataSize( int refPos ) const {
+        int size = 0;
+        for( int j = 0; j < this->n; ++j ) {
+            if ( mayDropKey( j, refPos ) ) {
+                continue;
+            }
+            short ofs = k( j ).keyDataOfs();
+            int sz = this->_keySize( ofs );
+            if ( this->data[ ofs ] == Prefixed ) {
+                sz += this->prefixLen - 1;
+            }
+            size += sz + sizeof( _KeyNode );
+        }
+        return size;
+    }
+
+    /**
+     * Besides dropping keys as the other versions do, picks the bucket's prefix: the current
+     * one, the longest one all its compact format keys share, or none, whichever stores the
+     * keys in the fewest bytes.  So packing never needs more room than the keys had.
+     */
+    template<>
+    void BucketBasics<V2>::_packReadyForMod( const Ordering &order, int &refPos ) {
+        assertWritable();
+
+        if ( this->flags & Packed )
+            return;
+
+        int i = 0;
+        for ( int j = 0; j < this->n; j++ ) {
+            if( mayDropKey( j, refPos ) ) {
+                continue; // key is unused and has no children - drop it
+            }
+            if( i != j ) {
+                if ( refPos == j ) {
+                    refPos = i; // i < j so j will never be refPos again
+                }
+                k( i ) = k( j );
+            }
+            ++i;
+        }
+        if ( refPos == this->n ) {
+            refPos = i;
+        }
+        this->n = i;
+
+        // The key data stays where it is until the new layout is copied in below.
+        const char *oldPrefix = this->prefix();
+        int oldLen = this->prefixLen;
+        int wholeSize = 0;
+        int oldSize = oldLen;
+        Key first;
+        int newLen = -1;
+        for ( int j = 0; j < this->n; j++ ) {
+            Key key = this->_keyAt( k( j ).keyDataOfs() );
+            wholeSize += key.dataSize();
+            oldSize += storedSize( key, oldPrefix, oldLen );
+            if ( !key.isCompactFormat() ) {
+                continue;
+            }
+            if ( newLen < 0 ) {
+                first.assign( key );
+                newLen = first.commonPrefixSize( first );
+            }
+            else if ( newLen > 0 ) {
+                newLen = min( newLen, first.commonPrefixSize( key ) );
+            }
+        }
+        if ( newLen < 0 ) {
+            newLen = 0;
+        }
+        int newSize = wholeSize;
+        if ( newLen > 0 ) {
+            newSize = newLen;
+            for ( int j = 0; j < this->n; j++ ) {
+                newSize += storedSize( this->_keyAt( k( j ).keyDataOfs() ), first.data(), newLen );
+            }
+        }
+
+        const char *chosen = oldPrefix;
+        int len = oldLen;
+        int best = oldSize;
+        if ( newSize < best ) {
+            chosen = first.data();
+            len = newLen;
+            best = newSize;
+        }
+        if ( wholeSize < best ) {
+            chosen = 0;
+            len = 0;
+        }
+
+        int tdz = totalDataSize();
+        char temp[V2::BucketSize];
+        int ofs = tdz - len;
+        int newPrefixOfs = ofs;
+        if ( len ) {
+            memcpy( temp + ofs, chosen, len );
+        }
+        for ( int j = 0; j < this->n; j++ ) {
+            Key key = this->_keyAt( k( j ).keyDataOfs() );
+            ofs -= storedSize( key, temp + newPrefixOfs, len );
+            storeKey( temp + ofs, key, temp + newPrefixOfs, len );
+            k( j ).setKeyDataOfsSavingUse( ofs );
+        }
+        int dataUsed = tdz - ofs;
+        memcpy( this->data + ofs, temp + ofs, dataUsed );
+
+        this->prefixOfs = newPrefixOfs;
+        this->prefixLen = len;
+        this->topSize = dataUsed;
+        this->emptySize = tdz - dataUsed - this->n * sizeof( _KeyNode );
+        {
+            int foo = this->emptySize;
+            verify( foo >= 0 );
+        }
+
+        setPacked();
+
+        assertValid( order );
+    }
+
+    template<>
+    void BucketBasics<V2>::copyPrefixFrom( const BucketBasics<V2> &src ) {
+        verify( this->n == 0 && this->prefixLen == 0 );
+        if ( src.prefixLen == 0 ) {
+            return;
+        }
+        this->prefixOfs = _alloc( src.prefixLen );
+        this->prefixLen = src.prefixLen;
+        memcpy( dataAt( this->prefixOfs ), src.prefix(), src.prefixLen );
+        // the prefix may not pay for itself with the keys we get, so let the next pack decide
+        setNotPacked();
+    }
+
     template class BucketBasics<V0>;
     template class BucketBasics<V1>;
+    template class BucketBasics<V2>;
     template class BtreeBucket<V0>;
     template class BtreeBucket<V1>;
+    template class BtreeBucket<V2>;
     template struct __KeyNode<DiskLoc>;
     template struct __KeyNode<DiskLoc56Bit>;
 
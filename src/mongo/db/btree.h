@@ -182,6 +182,19 @@ namespace mongo {
         static const int KeyMax = OldBucketSize / 10;
         // A sentinel value sometimes used to identify a deallocated bucket.
         static const int INVALID_N_SENTINEL = -1;
+
+    protected:
+        /** Per version access to the bson key storage, see BtreeData_V2. */
+        Key _keyAt(short ofs) const { return Key(data + ofs); }
+        int _keySize(short ofs) const { return Key(data + ofs).dataSize(); }
+        int _storedSize(const Key& key) const { return key.dataSize(); }
+        bool _storeKey(char *p, const Key& key) const {
+            memcpy(p, key.data(), key.dataSize());
+            return false;
+        }
+        int _compareKey(const Key& key, short ofs, const Ordering &o) const {
+            return key.woCompare(Key(data + ofs), o);
+        }
     };
 
     // a a a ofs ofs ofs ofs
@@ -290,10 +303,123 @@ namespace mongo {
         char data[4];
 
         void _init() { }
+
+        /** @see BtreeData_V0 */
+        Key _keyAt(short ofs) const { return Key(data + ofs); }
+        int _keySize(short ofs) const { return Key(data + ofs).dataSize(); }
+        int _storedSize(const Key& key) const { return key.dataSize(); }
+        bool _storeKey(char *p, const Key& key) const {
+            memcpy(p, key.data(), key.dataSize());
+            return false;
+        }
+        int _compareKey(const Key& key, short ofs, const Ordering &o) const {
+            return key.woCompare(Key(data + ofs), o);
+        }
+    };
+
+    /**
+     * Same as BtreeData_V1, except that a bucket may keep a prefix: a run of whole leading
+     * elements, in compact format, that its keys have in common.  A key that starts with the
+     * prefix is stored as a Prefixed byte followed by the rest of the key, so that compound
+     * keys with long common leading values such as {tenant:1, path:1} take a fraction of the
+     * space.  Other keys are stored whole.
+     *
+     * The prefix lives in the bson key region and is chosen when the bucket is packed.  As
+     * moving keys between buckets may change what they take up, merging and balancing size
+     * v2 buckets by their keys' whole sizes, see packedDataSize().
+     */
+    class BtreeData_V2 {
+    public:
+        typedef DiskLoc56Bit Loc;
+        typedef __KeyNode<Loc> _KeyNode;
+        typedef KeyV2 Key;
+        typedef KeyV2Owned KeyOwned;
+        enum { BucketSize = 8192-16 }; // leave room for Record header
+        // largest key size we allow, which KeyV2 must be able to put back together.
+        static const int KeyMax = KeyV2::MaxSize;
+        // A sentinel value sometimes used to identify a deallocated bucket.
+        static const unsigned short INVALID_N_SENTINEL = 0xffff;
+        /** First byte of a key stored after the prefix.  No key in KeyV1 format starts with it. */
+        enum { Prefixed = 0 };
+
+        /** @return size of key when stored in a bucket with the given prefix */
+        static int storedSize(const KeyV1& key, const char *prefix, int prefixLen) {
+            return key.hasPrefix(prefix, prefixLen) ? 1 + key.dataSize() - prefixLen : key.dataSize();
+        }
+        /**
+         * Store key at p, which has storedSize() bytes, for a bucket with the given prefix.
+         * @return true if the key was stored whole though a different prefix might fit it.
+         */
+        static bool storeKey(char *p, const KeyV1& key, const char *prefix, int prefixLen) {
+            if ( key.hasPrefix(prefix, prefixLen) ) {
+                *p = Prefixed;
+                memcpy(p + 1, key.data() + prefixLen, key.dataSize() - prefixLen);
+                return false;
+            }
+            memcpy(p, key.data(), key.dataSize());
+            return key.isCompactFormat();
+        }
+    protected:
+        /** Parent bucket of this bucket, which isNull() for the root bucket. */
+        Loc parent;
+        /** Given that there are n keys, this is the n index child. */
+        Loc nextChild;
+
+        unsigned short flags;
+
+        /** basicInsert() assumes the next three members are consecutive and in this order: */
+
+        /** Size of the empty region. */
+        unsigned short emptySize;
+        /** Size used for bson storage, including the prefix and storage of old keys. */
+        unsigned short topSize;
+        /* Number of keys in the bucket. */
+        unsigned short n;
+
+        /** Offset of the prefix within the body, and its size, which is 0 if there is none. */
+        unsigned short prefixOfs;
+        unsigned short prefixLen;
+
+        /* Beginning of the bucket's body */
+        char data[4];
+
+        void _init() {
+            prefixOfs = 0;
+            prefixLen = 0;
+        }
+
+        const char * prefix() const { return data + prefixOfs; }
+
+        /** @return the key stored at ofs, put back together if it was stored after the prefix */
+        Key _keyAt(short ofs) const {
+            const char *p = data + ofs;
+            if ( *p == Prefixed )
+                return Key(prefix(), prefixLen, p + 1);
+            return Key(p);
+        }
+        /** @return bytes taken by the key stored at ofs */
+        int _keySize(short ofs) const {
+            const char *p = data + ofs;
+            if ( *p == Prefixed )
+                return 1 + KeyV1(p + 1).dataSize();
+            return KeyV1(p).dataSize();
+        }
+        /** @return bytes key takes when stored in this bucket */
+        int _storedSize(const Key& key) const { return storedSize(key, prefix(), prefixLen); }
+        /** @see storeKey() */
+        bool _storeKey(char *p, const Key& key) const { return storeKey(p, key, prefix(), prefixLen); }
+        /** Compares key to the one stored at ofs, without putting the stored key back together. */
+        int _compareKey(const Key& key, short ofs, const Ordering &o) const {
+            const char *p = data + ofs;
+            if ( *p == Prefixed )
+                return key.woCompare(prefix(), prefixLen, p + 1, o);
+            return key.woCompare(KeyV1(p), o);
+        }
     };
 
     typedef BtreeData_V0 V0;
     typedef BtreeData_V1 V1;
+    typedef BtreeData_V2 V2;
 
     /**
      * This class adds functionality to BtreeData for managing a single bucket.
@@ -490,8 +616,14 @@ namespace mongo {
         /** Pack when already writable */
         void _packReadyForMod(const Ordering &order, int &refPos);
 
-        /** @return the size the bucket's body would have if we were to call pack() */
+        /**
+         * @return the size the bucket's body would have if we were to call pack().  For v2
+         * buckets this is the size with every key stored whole, which bounds what the keys
+         * take up in any bucket they are moved to.
+         */
         int packedDataSize( int refPos ) const;
+        /** @return bytes used by a packed bucket's body, sized as packedDataSize() does */
+        int usedDataSize() const { return this->topSize + this->n * sizeof( _KeyNode ); }
         void setNotPacked() { this->flags &= ~Packed; }
         void setPacked() { this->flags |= Packed; }
         /**
@@ -553,8 +685,11 @@ namespace mongo {
          * @return the key index to be promoted on split
          * @param keypos The requested index of a key to insert, which may affect
          *  the choice of split position.
+         * @param edge 1 if the key goes after every key of the tree, -1 if it goes before
+         *  every key, 0 otherwise.  Keys appended at an edge keep coming, so that side of
+         *  the split is left nearly empty.
          */
-        int splitPos( int keypos ) const;
+        int splitPos( int keypos, int edge ) const;
 
         /**
          * Preconditions: nAdd * sizeof( _KeyNode ) <= emptySize
@@ -577,8 +712,20 @@ namespace mongo {
          *    _KeyNode data and without shifting any other _KeyNode objects.
          */
         void setKey( int i, const DiskLoc recordLoc, const Key& key, const DiskLoc prevChildBucket );
+
+        /**
+         * Preconditions: this bucket is empty
+         * Postconditions: this bucket has the same key prefix as 'src', so keys moved here from
+         *  'src' take no more space than they did there.  A no-op for versions without prefixes.
+         */
+        void copyPrefixFrom( const BucketBasics &src ) { }
     };
 
+    template<> int BucketBasics<V2>::packedDataSize( int refPos ) const;
+    template<> inline int BucketBasics<V2>::usedDataSize() const { return packedDataSize( 0 ); }
+    template<> void BucketBasics<V2>::_packReadyForMod( const Ordering &order, int &refPos );
+    template<> void BucketBasics<V2>::copyPrefixFrom( const BucketBasics<V2> &src );
+
     class IndexInsertionContinuation;
 
     template< class V>
@@ -708,6 +855,17 @@ namespace mongo {
          */
         bool unindex(const DiskLoc thisLoc, IndexDetails& id, const BSONObj& key, const DiskLoc recordLoc) const;
 
+        /**
+         * Preconditions: no other key equal to 'key' is in the btree, as for a unique index,
+         *  so newLoc sorts in the same place oldLoc does
+         * Postconditions:
+         *  - If key / oldLoc are in the btree, that key points at newLoc instead, @return true.
+         *    Nothing moves, so the shape of the tree and cursors' positions in it are unchanged.
+         *  - If key / oldLoc are not in the btree, @return false and do nothing.
+         */
+        bool relocate(const DiskLoc thisLoc, IndexDetails& id, const BSONObj& key, const DiskLoc oldLoc,
+                      const DiskLoc newLoc) const;
+
         /**
          * locate may return an "unused" key that is just a marker.  so be careful.
          *   looks for a key:recordloc pair.
@@ -729,6 +887,14 @@ namespace mongo {
          */
         DiskLoc findSingle( const IndexDetails &indexdetails , const DiskLoc& thisLoc, const BSONObj& key ) const;
 
+        /**
+         * Follows the path locate() takes to key:recordLoc, without touching any bucket which
+         * isn't likely in physical memory.
+         * @return the first such bucket on the path, or 0 if they all are.
+         */
+        Record* bucketNotInMemory( const IndexDetails &idx, const DiskLoc& thisLoc,
+                                   const BSONObj& key, const DiskLoc &recordLoc ) const;
+
         /**
          * Advance to next or previous key in the index.
          * @param direction to advance.
@@ -899,14 +1065,25 @@ namespace mongo {
          */
         int indexInParent( const DiskLoc &thisLoc ) const;        
 
+        /**
+         * @return true if no key of the tree sorts after (direction 1) or before
+         *  (direction -1) the keys of this bucket and its descendants.
+         */
+        bool onEdge( const DiskLoc &thisLoc, int direction ) const;
+
     public:
         Key keyAt(int i) const {
             if( i >= this->n ) 
                 return Key();
-            return Key(this->data + k(i).keyDataOfs());
+            return this->_keyAt(k(i).keyDataOfs());
         }
     protected:
 
+        /** hint that key i's data will be compared against soon */
+        void prefetchKey(int i) const {
+            prefetch( const_cast<char*>( this->data + k(i).keyDataOfs() ) );
+        }
+
         /**
          * Preconditions:
          *  - This bucket is packed.
@@ -1108,6 +1285,29 @@ namespace mongo {
         
         virtual long long nscanned() { return _nscanned; }
 
+        /**
+         * Once a scan has read PrefetchAfterKeys keys, on entering each bucket ask the os to read
+         * in the records of the bucket's remaining keys, in file offset order, rather than fault
+         * them in one at a time in key order.  Not done while only key fields are returned.
+         */
+        void setPrefetchRecords( bool prefetch ) { _prefetchRecords = prefetch; }
+        static const long long PrefetchAfterKeys = 32;
+
+        /**
+         * Move to the first key with a different value of the leading index field than the
+         * current key, skipping the rest of the current value's keys.
+         * @return ok()
+         */
+        bool advancePastLeadingValue();
+
+        /**
+         * Advance past up to n keys, as n calls to advance() would, without prefetching records.
+         * Within a leaf bucket of a scan over one contiguous run of keys, only the last key
+         * advanced to is compared with the bounds.  For skipping keys the caller knows all match.
+         * @return the number of keys advanced past, fewer than n only at the end of the scan
+         */
+        long long advanceKeys( long long n );
+
         /** for debugging only */
         const DiskLoc getBucket() const { return bucket; }
         int getKeyOfs() const { return keyOfs; }
@@ -1122,6 +1322,20 @@ namespace mongo {
          */
         virtual bool skipUnusedKeys() = 0;
 
+        /** Appends the record locations of the used keys from keyOfs to the end of the bucket. */
+        virtual void bucketRecordLocs( vector<DiskLoc> &locs ) const = 0;
+
+        /**
+         * @return the offset in this bucket up to n used keys on from keyOfs with no child bucket
+         * in between, or keyOfs if there are none.
+         * @param used set to the number of used keys advanced past.
+         */
+        virtual int leafRunEnd( long long n, long long &used ) const = 0;
+
+        /** @return true if 'key' is within the bounds; keys past endKey are not. */
+        bool keyInBounds( const BSONObj &key ) const;
+        void prefetchBucketRecords();
+
         bool skipOutOfRangeKeysAndCheckEnd();
         void skipAndCheck();
         void checkEnd();
@@ -1164,6 +1378,8 @@ namespace mongo {
         shared_ptr<Projection::KeyOnly> _keyFieldsOnly;
         bool _independentFieldRanges;
         long long _nscanned;
+        bool _prefetchRecords;
+        DiskLoc _prefetchedBucket;
     };
 
     /**
@@ -1180,7 +1396,7 @@ namespace mongo {
     template< class V >
     BucketBasics<V>::KeyNode::KeyNode(const BucketBasics<V>& bb, const _KeyNode &k) :
         prevChildBucket(k.prevChildBucket),
-        recordLoc(k.recordLoc), key(bb.data+k.keyDataOfs())
+        recordLoc(k.recordLoc), key(bb._keyAt(k.keyDataOfs()))
     { }
 
 } // namespace mongo;
@@ -53,6 +53,16 @@ namespace mongo {
         b = cur.btreemod<V>();
     }
 
+    template<class V>
+    bool BtreeBuilder<V>::pushBackOrRepack(BtreeBucket<V> *bucket, const DiskLoc recordLoc, const Key& key, const DiskLoc prevChild) {
+        if ( bucket->_pushBack(recordLoc, key, ordering, prevChild) )
+            return true;
+        // keys pushed whole leave a v2 bucket unpacked, and packing may give them a shared prefix
+        int zeropos = 0;
+        bucket->_packReadyForMod(ordering, zeropos);
+        return bucket->_pushBack(recordLoc, key, ordering, prevChild);
+    }
+
     template<class V>
     void BtreeBuilder<V>::mayCommitProgressDurably() {
         if ( getDur().commitIfNeeded() ) {
@@ -81,7 +91,7 @@ namespace mongo {
             }
         }
 
-        if ( ! b->_pushBack(loc, *key, ordering, DiskLoc()) ) {
+        if ( ! pushBackOrRepack(b, loc, *key, DiskLoc()) ) {
             // bucket was full
             newBucket();
             b->pushBack(loc, *key, ordering, DiskLoc());
@@ -120,7 +130,7 @@ namespace mongo {
                 bool keepX = ( x->n != 0 );
                 DiskLoc keepLoc = keepX ? xloc : x->nextChild;
 
-                if ( ! up->_pushBack(r, k, ordering, keepLoc) ) {
+                if ( ! pushBackOrRepack(up, r, k, keepLoc) ) {
                     // current bucket full
                     DiskLoc n = BtreeBucket<V>::addBucket(idx);
                     up->setTempNext(n);
@@ -180,5 +190,6 @@ namespace mongo {
 
     template class BtreeBuilder<V0>;
     template class BtreeBuilder<V1>;
+    template class BtreeBuilder<V2>;
 
 }
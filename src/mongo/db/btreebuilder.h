@@ -27,6 +27,8 @@ namespace mongo {
         BtreeBucket<V> *b;
 
         void newBucket();
+        /** _pushBack(), packing the bucket to make room if it has to */
+        bool pushBackOrRepack(BtreeBucket<V> *bucket, const DiskLoc recordLoc, const Key& key, const DiskLoc prevChild);
         void buildNextLevel(DiskLoc);
         void mayCommitProgressDurably();
 
@@ -22,6 +22,7 @@
 #include "jsobj.h"
 #include "curop-inl.h"
 #include "queryutil.h"
+#include "mongo/util/trace_span.h"
 
 namespace mongo {
 
@@ -92,6 +93,31 @@ namespace mongo {
             return u;
         }
 
+        void bucketRecordLocs( vector<DiskLoc> &locs ) const {
+            const BtreeBucket<V> *b = bucket.btree<V>();
+            for( int i = keyOfs; i >= 0 && i < b->getN(); i += _direction ) {
+                const _KeyNode &kn = b->k( i );
+                if ( kn.isUsed() )
+                    locs.push_back( kn.recordLoc );
+            }
+        }
+
+        int leafRunEnd( long long n, long long &used ) const {
+            const BtreeBucket<V> *b = bucket.btree<V>();
+            int end = keyOfs;
+            used = 0;
+            for( int i = keyOfs + _direction; used < n && i >= 0 && i < b->getN(); i += _direction ) {
+                // the keys between two of a bucket's keys are in the child of the greater one
+                if ( !b->k( _direction > 0 ? i : i + 1 ).prevChildBucket.isNull() )
+                    break;
+                if ( b->k( i ).isUsed() ) {
+                    end = i;
+                    ++used;
+                }
+            }
+            return end;
+        }
+
         /* Since the last noteLocation(), our key may have moved around, and that old cached
            information may thus be stale and wrong (although often it is right).  We check
            that here; if we have moved, we have to search back for where we were at.
@@ -168,6 +194,7 @@ namespace mongo {
             indexDetails.head.btree<V>()->dump();
         }
         virtual DiskLoc _locate(const BSONObj& key, const DiskLoc& loc) {
+            TraceSpan span( TraceSpans::Btree );
             bool found;
             return indexDetails.head.btree<V>()->
                      locate(indexDetails, indexDetails.head, key, _ordering, keyOfs, found, loc, _direction);
@@ -187,6 +214,7 @@ namespace mongo {
 
     template class BtreeCursorImpl<V0>;
     template class BtreeCursorImpl<V1>;
+    template class BtreeCursorImpl<V2>;
 
     BtreeCursor* BtreeCursor::make(
         NamespaceDetails *_d, const IndexDetails& _id,
@@ -206,6 +234,9 @@ namespace mongo {
     BtreeCursor* BtreeCursor::make( NamespaceDetails * nsd , int idxNo , const IndexDetails& indexDetails ) {
         int v = indexDetails.version();
         
+        if( v == 2 ) 
+            return new BtreeCursorImpl<V2>( nsd , idxNo , indexDetails );
+
         if( v == 1 ) 
             return new BtreeCursorImpl<V1>( nsd , idxNo , indexDetails );
         
@@ -240,6 +271,7 @@ namespace mongo {
     BtreeCursor::BtreeCursor( NamespaceDetails* nsd , int theIndexNo, const IndexDetails& id ) 
         : d( nsd ) , idxNo( theIndexNo ) , indexDetails( id ) , _ordering(Ordering::make(BSONObj())){
         _nscanned = 0;
+        _prefetchRecords = false;
     }
 
     void BtreeCursor::_finishConstructorInit() {
@@ -351,6 +383,7 @@ namespace mongo {
     }
 
     void BtreeCursor::advanceTo( const BSONObj &keyBegin, int keyBeginLen, bool afterKey, const vector< const BSONElement * > &keyEnd, const vector< bool > &keyEndInclusive) {
+        TraceSpan span( TraceSpans::Btree );
         _advanceTo( bucket, keyOfs, keyBegin, keyBeginLen, afterKey, keyEnd, keyEndInclusive, _ordering, _direction );
     }
 
@@ -371,9 +404,84 @@ namespace mongo {
         else {
             skipAndCheck();
         }
+        if ( _prefetchRecords && ok() && bucket != _prefetchedBucket ) {
+            prefetchBucketRecords();
+        }
         return ok();
     }
 
+    void BtreeCursor::prefetchBucketRecords() {
+        _prefetchedBucket = bucket;
+        if ( _keyFieldsOnly || _nscanned < PrefetchAfterKeys ) {
+            return;
+        }
+        vector<DiskLoc> locs;
+        bucketRecordLocs( locs );
+        Record::prefetch( locs );
+    }
+
+    bool BtreeCursor::advancePastLeadingValue() {
+        killCurrentOp.checkForInterrupt();
+        if ( bucket.isNull() )
+            return false;
+
+        // with afterKey, only the leading field of the key is compared, so the end bounds are
+        // never looked at
+        int nFields = _order.nFields();
+        vector< const BSONElement * > keyEnd( nFields );
+        vector< bool > keyEndInclusive( nFields, true );
+        BSONObj key = currKey().getOwned();
+        advanceTo( key, 1, true, keyEnd, keyEndInclusive );
+
+        if ( !_independentFieldRanges ) {
+            skipUnusedKeys();
+            checkEnd();
+            if ( ok() ) {
+                ++_nscanned;
+            }
+        }
+        else {
+            skipAndCheck();
+        }
+        return ok();
+    }
+
+    bool BtreeCursor::keyInBounds( const BSONObj &key ) const {
+        if ( _independentFieldRanges ) {
+            return _bounds->matchesKey( key );
+        }
+        if ( endKey.isEmpty() ) {
+            return true;
+        }
+        int cmp = sgn( endKey.woCompare( key, _order ) );
+        return ( cmp == _direction ) || ( cmp == 0 && _endKeyInclusive );
+    }
+
+    long long BtreeCursor::advanceKeys( long long n ) {
+        // a run of keys within bounds at either end is all within them when the bounds are
+        const bool contiguous = !_independentFieldRanges || _bounds->contiguous();
+        const bool prefetch = _prefetchRecords;
+        _prefetchRecords = false;
+        long long done = 0;
+        while( done < n && ok() ) {
+            if ( contiguous ) {
+                long long used;
+                int end = leafRunEnd( n - done, used );
+                if ( used > 0 && keyInBounds( keyAt( end ) ) ) {
+                    keyOfs = end;
+                    _nscanned += used;
+                    done += used;
+                    continue;
+                }
+            }
+            if ( advance() ) {
+                ++done;
+            }
+        }
+        _prefetchRecords = prefetch;
+        return done;
+    }
+
     void BtreeCursor::noteLocation() {
         if ( !eof() ) {
             BSONObj o = currKey().getOwned();
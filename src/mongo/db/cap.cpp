@@ -29,6 +29,7 @@
 #include "json.h"
 #include "clientcursor.h"
 #include "index_update.h"
+#include "oplog.h"
 
 /*
  capped collection layout
@@ -323,6 +324,9 @@ namespace mongo {
         DEV verify( this == nsdetails(ns) );
         verify( cappedLastDelRecLastExtent().isValid() );
 
+        // the space of the newest ops gets reused by ops written after
+        OplogStartIndex::invalidate( ns );
+
         // We iteratively remove the newest document until the newest document
         // is 'end', then we remove 'end' if requested.
         bool foundLast = false;
@@ -418,6 +422,7 @@ namespace mongo {
         DEV verify( this == nsdetails(ns) );
         massert( 13424, "collection must be capped", isCapped() );
         massert( 13425, "background index build in progress", !indexBuildInProgress );
+        OplogStartIndex::invalidate( ns );
         
         vector<BSONObj> indexes = Helpers::findAll( Namespace( ns ).getSisterNS( "system.indexes" ) , BSON( "ns" << ns ) );
         for ( unsigned i=0; i<indexes.size(); i++ ) {
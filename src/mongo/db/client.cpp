@@ -629,6 +629,7 @@ namespace mongo {
 
         nscanned = -1;
         idhack = false;
+        cachedResult = false;
         scanAndOrder = false;
         nupdated = -1;
         nmoved = -1;
@@ -675,6 +676,7 @@ namespace mongo {
 
         OPDEBUG_TOSTRING_HELP( nscanned );
         OPDEBUG_TOSTRING_HELP_BOOL( idhack );
+        OPDEBUG_TOSTRING_HELP_BOOL( cachedResult );
         OPDEBUG_TOSTRING_HELP_BOOL( scanAndOrder );
         OPDEBUG_TOSTRING_HELP( nmoved );
         OPDEBUG_TOSTRING_HELP( nupdated );
@@ -722,6 +724,7 @@ namespace mongo {
 
         OPDEBUG_APPEND_NUMBER( nscanned );
         OPDEBUG_APPEND_BOOL( idhack );
+        OPDEBUG_APPEND_BOOL( cachedResult );
         OPDEBUG_APPEND_BOOL( scanAndOrder );
         OPDEBUG_APPEND_BOOL( moved );
         OPDEBUG_APPEND_NUMBER( nmoved );
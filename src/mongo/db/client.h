@@ -35,6 +35,8 @@
 #include "../util/concurrency/rwlock.h"
 #include "d_concurrency.h"
 #include "mongo/db/lockstate.h"
+#include "mongo/db/namespace_cache.h"
+#include "mongo/util/arena.h"
 #include "mongo/util/paths.h"
 
 namespace mongo {
@@ -128,6 +130,11 @@ namespace mongo {
 
         LockState& lockState() { return _ls; }
 
+        /** memory for the current request, reset when it ends.  see Arena::Scope */
+        Arena& arena() { return _arena; }
+
+        NamespaceCache& nsCache() { return _nsCache; }
+
     private:
         Client(const char *desc, AbstractMessagingPort *p = 0);
         friend class CurOp;
@@ -149,6 +156,8 @@ namespace mongo {
         PageFaultRetryableSection *_pageFaultRetryableSection;
 
         LockState _ls;
+        Arena _arena;
+        NamespaceCache _nsCache;
         
         friend class PageFaultRetryableSection; // TEMP
         friend class NoPageFaultsAllowed; // TEMP
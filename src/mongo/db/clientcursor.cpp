@@ -31,26 +31,37 @@
 #include "repl_block.h"
 #include "../util/processinfo.h"
 #include "../util/timer.h"
+#include "../util/mem_accounting.h"
 #include "mongo/client/dbclientinterface.h"
 #include "mongo/db/scanandorder.h"
 #include "pagefault.h"
+#include "oplog.h"
+#include "repl/rs_optime.h"
 
 namespace mongo {
 
-    CCById ClientCursor::clientCursorsById;
+    // intentional leak, like ccmutex: the shard mutexes may still be held at shutdown
+    ClientCursor::Shard *ClientCursor::_shards = new ClientCursor::Shard[ ClientCursor::NShards ];
+    CCByNs ClientCursor::clientCursorsByNs;
     boost::recursive_mutex& ClientCursor::ccmutex( *(new boost::recursive_mutex()) );
     long long ClientCursor::numberTimedOut = 0;
+    long long ClientCursor::numberTimedOutLastMinute = 0;
+    long long ClientCursor::numberTimedOutBeforeMinute = 0;
+    AtomicUInt64 ClientCursor::_idleClock;
 
     void aboutToDeleteForSharding( const Database* db , const DiskLoc& dl ); // from s/d_logic.h
 
     /*static*/ void ClientCursor::assertNoCursors() {
         recursive_scoped_lock lock(ccmutex);
-        if( clientCursorsById.size() ) {
-            log() << "ERROR clientcursors exist but should not at this point" << endl;
-            ClientCursor *cc = clientCursorsById.begin()->second;
-            log() << "first one: " << cc->_cursorid << ' ' << cc->_ns << endl;
-            clientCursorsById.clear();
-            verify(false);
+        for( unsigned i = 0; i < NShards; i++ ) {
+            CCById &byId = _shards[i].byId;
+            if( byId.size() ) {
+                log() << "ERROR clientcursors exist but should not at this point" << endl;
+                ClientCursor *cc = byId.begin()->second;
+                log() << "first one: " << cc->_cursorid << ' ' << cc->_ns << endl;
+                byId.clear();
+                verify(false);
+            }
         }
     }
 
@@ -93,30 +104,26 @@ namespace mongo {
             verify(db);
             verify( str::startsWith(ns, db->name) );
 
-            for( LockedIterator i; i.ok(); ) {
-                ClientCursor *cc = i.current();
+            recursive_scoped_lock lock(ccmutex);
 
-                bool shouldDelete = false;
-                if ( cc->_db == db ) {
-                    if (isDB) {
-                        // already checked that db matched above
-                        dassert( str::startsWith(cc->_ns.c_str(), ns) );
-                        shouldDelete = true;
-                    }
-                    else {
-                        if ( str::equals(cc->_ns.c_str(), ns) )
-                            shouldDelete = true;
-                    }
-                }
-                
-                if ( shouldDelete ) {
-                    i.deleteAndAdvance();
-                }
-                else {
-                    i.advance();
+            // ids rather than pointers, as deleting one cursor may delete others
+            vector<CursorId> toDelete;
+            for( CCByNs::const_iterator i = clientCursorsByNs.lower_bound( ns );
+                 i != clientCursorsByNs.end() && str::startsWith( i->first, ns ); ++i ) {
+                if ( !isDB && i->first != ns )
+                    break;
+                for( set<ClientCursor*>::const_iterator j = i->second.begin(); j != i->second.end(); ++j ) {
+                    if ( (*j)->_db == db )
+                        toDelete.push_back( (*j)->_cursorid );
                 }
             }
 
+            for( vector<CursorId>::const_iterator i = toDelete.begin(); i != toDelete.end(); ++i ) {
+                ClientCursor *cc = find_inlock( *i, false );
+                if ( cc )
+                    delete cc;
+            }
+
             /*
             note : we can't iterate byloc because clientcursors may exist with a loc of null in which case
                    they are not in the map.  perhaps they should not exist though in the future?  something to
@@ -139,54 +146,65 @@ namespace mongo {
         }
     }
 
-    /* note called outside of locks (other than ccmutex) so care must be exercised */
+    /* note called outside of locks (other than the shard's) so care must be exercised */
     bool ClientCursor::shouldTimeout( unsigned millis ) {
-        _idleAgeMillis += millis;
-        return _idleAgeMillis > 600000 && _pinValue == 0;
+        return (unsigned long long) idleTime() + millis > TimeoutMillis && _pinValue == 0;
     }
 
     /* called every 4 seconds.  millis is amount of idle time passed since the last call -- could be zero */
     void ClientCursor::idleTimeReport(unsigned millis) {
-        bool foundSomeToTimeout = false;
+        unsigned long long now = _idleClock.fetchAndAdd( millis ) + millis;
 
-        // two passes so that we don't need to readlock unless we really do some timeouts
-        // we assume here that incrementing _idleAgeMillis outside readlock is ok.
+        // two passes so that we don't need to readlock unless we really do some timeouts.  the
+        // first only looks at the cursors whose time may be up, as of when each was filed
+        vector<CursorId> toTimeout;
         {
-            recursive_scoped_lock lock(ccmutex);
-            {
-                unsigned sz = clientCursorsById.size();
-                static time_t last;
-                if( sz >= 100000 ) { 
-                    if( time(0) - last > 300 ) {
-                        last = time(0);
-                        log() << "warning number of open cursors is very large: " << sz << endl;
-                    }
+            unsigned sz = numCursors();
+            static time_t last;
+            if( sz >= 100000 ) { 
+                if( time(0) - last > 300 ) {
+                    last = time(0);
+                    log() << "warning number of open cursors is very large: " << sz << endl;
                 }
             }
-            for ( CCById::iterator i = clientCursorsById.begin(); i != clientCursorsById.end();  ) {
-                CCById::iterator j = i;
-                i++;
-                if( j->second->shouldTimeout( millis ) ) {
-                    foundSomeToTimeout = true;
-                }
+        }
+        // a shard at a time, so getMores on the other shards don't wait for us
+        for( unsigned s = 0; s < NShards; s++ ) {
+            recursive_scoped_lock lock( _shards[s].m );
+            vector<long long> due;
+            _shards[s].timeouts.expire( now, &due );
+            for ( vector<long long>::const_iterator i = due.begin(); i != due.end(); ++i ) {
+                ClientCursor *cc = find_inlock( *i, false );
+                if ( ! cc )
+                    continue;
+                if( cc->shouldTimeout( 0 ) )
+                    toTimeout.push_back( *i );
+                // filed again from when it was last used.  one timed out below leaves the wheel
+                // as it is deleted; one used since it was filed is just due later
+                cc->_timeoutTick = _shards[s].timeouts.add( *i, cc->_lastUsed + TimeoutMillis, now );
             }
         }
 
-        if( foundSomeToTimeout ) {
+        if( ! toTimeout.empty() ) {
             Lock::GlobalRead lk;
-            for( LockedIterator i; i.ok(); ) {
-                ClientCursor *cc = i.current();
-                if( cc->shouldTimeout(0) ) {
+            recursive_scoped_lock lock( ccmutex );
+            for ( vector<CursorId>::const_iterator i = toTimeout.begin(); i != toTimeout.end(); ++i ) {
+                recursive_scoped_lock shardLock( shardFor( *i ).m );
+                ClientCursor *cc = find_inlock( *i, false );
+                if( cc && cc->shouldTimeout(0) ) {
                     numberTimedOut++;
                     LOG(1) << "killing old cursor " << cc->_cursorid << ' ' << cc->_ns
                            << " idle:" << cc->idleTime() << "ms\n";
-                    i.deleteAndAdvance();
-                }
-                else {
-                    i.advance();
+                    delete cc;
                 }
             }
         }
+
+        if ( now / 60000 != ( now - millis ) / 60000 ) {
+            recursive_scoped_lock lock( ccmutex );
+            numberTimedOutLastMinute = numberTimedOut - numberTimedOutBeforeMinute;
+            numberTimedOutBeforeMinute = numberTimedOut;
+        }
     }
 
     /* must call when a btree bucket going away.
@@ -245,8 +263,8 @@ namespace mongo {
                   << ' ' << toAdvance[2000]->_pinValue
                   << ' ' << toAdvance[1000]->_pos
                   << ' ' << toAdvance[2000]->_pos
-                  << ' ' << toAdvance[1000]->_idleAgeMillis
-                  << ' ' << toAdvance[2000]->_idleAgeMillis
+                  << ' ' << toAdvance[1000]->idleTime()
+                  << ' ' << toAdvance[2000]->idleTime()
                   << ' ' << toAdvance[1000]->_doingDeletes
                   << ' ' << toAdvance[2000]->_doingDeletes
                   << endl;
@@ -294,19 +312,51 @@ namespace mongo {
     }
     void aboutToDelete(const DiskLoc& dl) { ClientCursor::aboutToDelete(dl); }
 
+    ClientCursor::LockedIterator::LockedIterator() : _lock( ccmutex ), _shard( 0 ) {
+        _shards[0].m.lock();
+        _i = _shards[0].byId.begin();
+        skipToCursor();
+    }
+
+    ClientCursor::LockedIterator::~LockedIterator() {
+        if ( ok() )
+            _shards[_shard].m.unlock();
+    }
+
+    void ClientCursor::LockedIterator::skipToCursor() {
+        while ( _i == _shards[_shard].byId.end() ) {
+            _shards[_shard].m.unlock();
+            if ( ++_shard == NShards )
+                return;
+            _shards[_shard].m.lock();
+            _i = _shards[_shard].byId.begin();
+        }
+    }
+
+    void ClientCursor::LockedIterator::advance() {
+        ++_i;
+        skipToCursor();
+    }
+
     void ClientCursor::LockedIterator::deleteAndAdvance() {
         ClientCursor *cc = current();
         CursorId id = cc->cursorid();
         delete cc;
-        _i = clientCursorsById.upper_bound( id );
+        _i = _shards[_shard].byId.upper_bound( id );
+        skipToCursor();
     }
     
+    /** what a cursor holds itself, not counting its Cursor */
+    static long long clientCursorBytes( const ClientCursor& cc ) {
+        return sizeof( ClientCursor ) + cc.ns().size() + cc.query().objsize();
+    }
+
     ClientCursor::ClientCursor(int queryOptions, const shared_ptr<Cursor>& c, const string& ns, BSONObj query ) :
         _ns(ns), _db( cc().database() ),
         _c(c), _pos(0),
         _query(query),  _queryOptions(queryOptions),
-        _idleAgeMillis(0), _pinValue(0),
-        _doingDeletes(false), _yieldSometimesTracker(128,10) {
+        _lastUsed( _idleClock.load() ), _timeoutTick( -1 ), _pinValue(0),
+        _doingDeletes(false), _yieldSometimesTracker(64,5) {
 
         Lock::assertAtLeastReadLocked(ns);
 
@@ -316,7 +366,15 @@ namespace mongo {
             noTimeout();
         recursive_scoped_lock lock(ccmutex);
         _cursorid = allocCursorId_inlock();
-        clientCursorsById.insert( make_pair(_cursorid, this) );
+        {
+            Shard &s = shardFor( _cursorid );
+            recursive_scoped_lock shardLock( s.m );
+            s.byId.insert( make_pair(_cursorid, this) );
+            if ( _pinValue == 0 )
+                _timeoutTick = s.timeouts.add( _cursorid, _lastUsed + TimeoutMillis, _lastUsed );
+        }
+        clientCursorsByNs[_ns].insert( this );
+        MemAccounting::add( MemAccounting::ClientCursors , clientCursorBytes( *this ) );
 
         if ( ! _c->modifiedKeys() ) {
             // store index information so we can decide if we can
@@ -347,7 +405,18 @@ namespace mongo {
         {
             recursive_scoped_lock lock(ccmutex);
             setLastLoc_inlock( DiskLoc() ); // removes us from bylocation multimap
-            clientCursorsById.erase(_cursorid);
+            CCByNs::iterator i = clientCursorsByNs.find( _ns );
+            if ( i != clientCursorsByNs.end() ) {
+                i->second.erase( this );
+                if ( i->second.empty() )
+                    clientCursorsByNs.erase( i );
+            }
+            Shard &s = shardFor( _cursorid );
+            recursive_scoped_lock shardLock( s.m );
+            s.byId.erase(_cursorid);
+            if ( _timeoutTick >= 0 )
+                s.timeouts.remove( _cursorid, _timeoutTick );
+            MemAccounting::remove( MemAccounting::ClientCursors , clientCursorBytes( *this ) );
 
             // defensive:
             _cursorid = INVALID_CURSOR_ID;
@@ -432,8 +501,13 @@ namespace mongo {
         }
         else {
             DiskLoc loc = c()->currLoc();
-            mongo::fillQueryResultFromObj( b, fields.get(), c()->current(),
-                                          ( ( pq && pq->showDiskLoc() ) ? &loc : 0 ) );
+            BSONObj current = c()->current();
+            if ( str::equals( _ns.c_str(), rsoplog ) ) {
+                // see oplogCompression
+                current = uncompressOplogEntry( current );
+            }
+            mongo::fillQueryResultFromObj( b, fields.get(), current,
+                                          ( ( pq && pq->showDiskLoc() && ! loc.isNull() ) ? &loc : 0 ) );
         }
     }
 
@@ -443,7 +517,8 @@ namespace mongo {
     */
     void ClientCursor::updateLocation() {
         verify( _cursorid );
-        _idleAgeMillis = 0;
+        // no need to refile: the sweep that finds it filed too early files it again from here
+        _lastUsed = _idleClock.load();
         _c->prepareToYield();
         DiskLoc cl = _c->refLoc();
         if ( lastLoc() == cl ) {
@@ -483,7 +558,7 @@ namespace mongo {
             // TODO
             return 0;
         }
-        else if ( need == WillNeed ) {
+        else if ( need == WillNeed || need == WillModify ) {
             // no-op
         }
         else {
@@ -496,40 +571,84 @@ namespace mongo {
             return 0;
         
         Record * rec = l.rec();
-        if ( rec->likelyInPhysicalMemory() ) 
+        if ( ! rec->likelyInPhysicalMemory() ) 
+            return rec;
+
+        if ( need == WillModify )
+            return _indexBucketForYield( l );
+
+        return 0;
+    }
+
+    Record* ClientCursor::_indexBucketForYield( const DiskLoc& loc ) {
+        NamespaceDetails *d = nsdetails( _ns.c_str() );
+        if ( ! d )
             return 0;
-        
-        return rec;
+        BSONObj obj = loc.obj();
+        NamespaceDetails::IndexIterator i = d->ii();
+        while( i.more() ) {
+            IndexDetails& idx = i.next();
+            if ( idx.head.isNull() )
+                continue;
+            BSONObjSet keys;
+            idx.getKeysFromObject( obj, keys );
+            for( BSONObjSet::const_iterator k = keys.begin(); k != keys.end(); ++k ) {
+                Record *bucket = idx.idxInterface().bucketNotInMemory( idx, idx.head, *k, loc );
+                if ( bucket )
+                    return bucket;
+            }
+        }
+        return 0;
     }
 
     bool ClientCursor::yieldSometimes( RecordNeeds need, bool *yielded ) {
+        return _yieldSometimes( need, yielded, 0 );
+    }
+
+    bool ClientCursor::yieldSometimes( RecordNeeds need, bool *yielded,
+                                       const boost::function<void()> &beforeYield ) {
+        return _yieldSometimes( need, yielded, &beforeYield );
+    }
+
+    bool ClientCursor::_yieldSometimes( RecordNeeds need, bool *yielded,
+                                        const boost::function<void()> *beforeYield ) {
         if ( yielded ) {
             *yielded = false;   
         }
         if ( ! _yieldSometimesTracker.intervalHasElapsed() ) {
+            // within the work quantum we only give way for page faults
             Record* rec = _recordForYield( need );
             if ( rec ) {
                 // yield for page fault
                 if ( yielded ) {
                     *yielded = true;   
                 }
+                if ( beforeYield )
+                    (*beforeYield)();
                 return yield( suggestYieldMicros() , rec );
             }
             return true;
         }
 
-        int micros = suggestYieldMicros();
-        if ( micros > 0 ) {
-            if ( yielded ) {
-                *yielded = true;   
-            }
-            return yield( micros , _recordForYield( need ) );
+        // uncontended, as in an idle system: keep going without looking at every client
+        if ( ! Lock::othersWaiting() && killCurrentOp.checkForInterruptNoAssert()[0] == 0 )
+            return true;
+
+        // someone is queued behind us, so release even if they came too late to be counted
+        int micros = std::max( suggestYieldMicros() , 0 );
+        if ( yielded ) {
+            *yielded = true;   
         }
-        return true;
+        if ( beforeYield )
+            (*beforeYield)();
+        return yield( micros , _recordForYield( need ) );
     }
 
     void ClientCursor::staticYield( int micros , const StringData& ns , Record * rec ) {
         killCurrentOp.checkForInterrupt( false );
+
+        // what has been written so far goes into the oplog before anyone else gets the lock
+        OplogBatch::flushCurrent();
         {
             auto_ptr<LockMongoFilesShared> lk;
             if ( rec ) {
@@ -658,17 +777,23 @@ namespace mongo {
 
     void ClientCursor::appendStats( BSONObjBuilder& result ) {
         recursive_scoped_lock lock(ccmutex);
-        result.appendNumber("totalOpen", clientCursorsById.size() );
-        result.appendNumber("clientCursors_size", (int) numCursors());
+        unsigned total = numCursors();
+        result.appendNumber("totalOpen", (size_t) total );
+        result.appendNumber("clientCursors_size", (int) total);
         result.appendNumber("timedOut" , numberTimedOut);
+        result.appendNumber("timedOutLastMinute" , numberTimedOutLastMinute);
         unsigned pinned = 0;
         unsigned notimeout = 0;
-        for ( CCById::iterator i = clientCursorsById.begin(); i != clientCursorsById.end(); i++ ) {
-            unsigned p = i->second->_pinValue;
-            if( p >= 100 )
-                pinned++;
-            else if( p > 0 )
-                notimeout++;
+        for ( unsigned s = 0; s < NShards; s++ ) {
+            recursive_scoped_lock shardLock( _shards[s].m );
+            CCById &byId = _shards[s].byId;
+            for ( CCById::iterator i = byId.begin(); i != byId.end(); i++ ) {
+                unsigned p = i->second->_pinValue;
+                if( p >= 100 )
+                    pinned++;
+                else if( p > 0 )
+                    notimeout++;
+            }
         }
         if( pinned ) 
             result.append("pinned", pinned);
@@ -750,14 +875,25 @@ namespace mongo {
     void ClientCursor::find( const string& ns , set<CursorId>& all ) {
         recursive_scoped_lock lock(ccmutex);
 
-        for ( CCById::iterator i=clientCursorsById.begin(); i!=clientCursorsById.end(); ++i ) {
-            if ( i->second->_ns == ns )
-                all.insert( i->first );
+        CCByNs::const_iterator i = clientCursorsByNs.find( ns );
+        if ( i == clientCursorsByNs.end() )
+            return;
+        for ( set<ClientCursor*>::const_iterator j = i->second.begin(); j != i->second.end(); ++j )
+            all.insert( (*j)->_cursorid );
+    }
+
+    unsigned ClientCursor::numCursors() {
+        unsigned n = 0;
+        for ( unsigned s = 0; s < NShards; s++ ) {
+            recursive_scoped_lock lock( _shards[s].m );
+            n += _shards[s].byId.size();
         }
+        return n;
     }
 
     bool ClientCursor::erase( CursorId id ) {
         recursive_scoped_lock lock( ccmutex );
+        recursive_scoped_lock shardLock( shardFor( id ).m );
         ClientCursor *cursor = find_inlock( id );
         if ( ! cursor )
             return false;
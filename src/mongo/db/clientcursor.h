@@ -38,6 +38,8 @@
 #include "matcher.h"
 #include "projection.h"
 #include "s/d_chunk_manager.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/util/timer_wheel.h"
 
 namespace mongo {
 
@@ -72,6 +74,7 @@ namespace mongo {
     */
     typedef map<CursorId, ClientCursor*> CCById;
     typedef map<ByLocKey, ClientCursor*> CCByLoc;
+    typedef map<string, set<ClientCursor*> > CCByNs;
 
     extern BSONObj id_obj;
 
@@ -90,7 +93,7 @@ namespace mongo {
         public:
             Pin( long long cursorid ) :
                 _cursorid( INVALID_CURSOR_ID ) {
-                recursive_scoped_lock lock( ccmutex );
+                recursive_scoped_lock lock( shardFor( cursorid ).m );
                 ClientCursor *cursor = ClientCursor::find_inlock( cursorid, true );
                 if ( cursor ) {
                     uassert( 12051, "clientcursor already in use? driver problem?",
@@ -154,22 +157,26 @@ namespace mongo {
         };
 
         /**
-         * Iterates through all ClientCursors, under its own ccmutex lock.
-         * Also supports deletion on the fly.
+         * Iterates through all ClientCursors, under its own ccmutex lock and the lock of the
+         * shard it is in.  Also supports deletion on the fly.
          */
         class LockedIterator : boost::noncopyable {
         public:
-            LockedIterator() : _lock( ccmutex ), _i( clientCursorsById.begin() ) {}
-            bool ok() const { return _i != clientCursorsById.end(); }
+            LockedIterator();
+            ~LockedIterator();
+            bool ok() const { return _shard < NShards; }
             ClientCursor *current() const { return _i->second; }
-            void advance() { ++_i; }
+            void advance();
             /**
              * Delete 'current' and advance. Properly handles cascading deletions that may occur
              * when one ClientCursor is directly deleted.
              */
             void deleteAndAdvance();
         private:
+            /** if _i is at the end of its shard, moves on to the next cursor in a later one */
+            void skipToCursor();
             recursive_scoped_lock _lock;
+            unsigned _shard;
             CCById::const_iterator _i;
         };
         
@@ -206,11 +213,15 @@ namespace mongo {
          */
         bool yield( int microsToSleep = -1 , Record * recordToLoad = 0 );
 
+        /** WillModify needs the record and the index buckets its keys are in, as when it is
+            about to be deleted or have indexed fields updated. */
         enum RecordNeeds {
-            DontNeed = -1 , MaybeCovered = 0 , WillNeed = 100
+            DontNeed = -1 , MaybeCovered = 0 , WillNeed = 100 , WillModify = 200
         };
             
         /**
+         * Yields for a page fault at any time, and otherwise, once per work quantum, only if
+         * Lock::othersWaiting() or the op has been killed.
          * @param needRecord whether or not the next record has to be read from disk for sure
          *                   if this is true, will yield of next record isn't in memory
          * @param yielded true if a yield occurred, and potentially if a yield did not occur
@@ -218,6 +229,13 @@ namespace mongo {
          */
         bool yieldSometimes( RecordNeeds need, bool *yielded = 0 );
 
+        /**
+         * As above, but calls beforeYield() just before yielding, for callers holding state that
+         * is only valid while the lock is held.
+         */
+        bool yieldSometimes( RecordNeeds need, bool *yielded,
+                             const boost::function<void()> &beforeYield );
+
         static int suggestYieldMicros();
         static void staticYield( int micros , const StringData& ns , Record * rec );
 
@@ -303,9 +321,11 @@ namespace mongo {
     private:
         void setLastLoc_inlock(DiskLoc);
 
+        /** the caller must hold shardFor( id ).m, or ccmutex */
         static ClientCursor* find_inlock(CursorId id, bool warn = true) {
-            CCById::iterator it = clientCursorsById.find(id);
-            if ( it == clientCursorsById.end() ) {
+            CCById &byId = shardFor( id ).byId;
+            CCById::iterator it = byId.find(id);
+            if ( it == byId.end() ) {
                 if ( warn )
                     OCCASIONALLY out() << "ClientCursor::find(): cursor not found in map " << id << " (ok after a drop)\n";
                 return 0;
@@ -321,7 +341,7 @@ namespace mongo {
 
     public:
         static ClientCursor* find(CursorId id, bool warn = true) {
-            recursive_scoped_lock lock(ccmutex);
+            recursive_scoped_lock lock( shardFor( id ).m );
             ClientCursor *c = find_inlock(id, warn);
             // if this asserts, your code was not thread safe - you either need to set no timeout
             // for the cursor or keep a ClientCursor::Pointer in scope for it.
@@ -349,14 +369,18 @@ namespace mongo {
         }
 
         /**
-         * @param millis amount of idle passed time since last call
+         * @param millis idle time to count on top of what has passed since the cursor was used
          */
         bool shouldTimeout( unsigned millis );
 
         void storeOpForSlave( DiskLoc last );
         void updateSlaveLocation( CurOp& curop );
 
-        unsigned idleTime() const { return _idleAgeMillis; }
+        unsigned idleTime() const {
+            // _lastUsed may be newer than the clock read just before it
+            unsigned long long now = _idleClock.load(), used = _lastUsed;
+            return now > used ? (unsigned) ( now - used ) : 0;
+        }
 
         void setDoingDeletes( bool doingDeletes ) {_doingDeletes = doingDeletes; }
 
@@ -370,7 +394,7 @@ namespace mongo {
         static void idleTimeReport(unsigned millis);
 
         static void appendStats( BSONObjBuilder& result );
-        static unsigned numCursors() { return clientCursorsById.size(); }
+        static unsigned numCursors();
         static void informAboutToDeleteBucket(const DiskLoc& b);
         static void aboutToDelete(const DiskLoc& dl);
         static void find( const string& ns , set<CursorId>& all );
@@ -385,6 +409,11 @@ namespace mongo {
         CCByLoc& byLoc() { return _db->ccByLoc; }
         
         Record* _recordForYield( RecordNeeds need );
+        /** @return a bucket holding one of loc's index keys which isn't likely in memory, or 0. */
+        Record* _indexBucketForYield( const DiskLoc& loc );
+
+        bool _yieldSometimes( RecordNeeds need, bool *yielded,
+                              const boost::function<void()> *beforeYield );
 
     private:
 
@@ -403,7 +432,8 @@ namespace mongo {
         OpTime _slaveReadTill;
 
         DiskLoc _lastLoc;                        // use getter and setter not this (important)
-        unsigned _idleAgeMillis;                 // how long has the cursor been around, relative to server idle time
+        unsigned long long _lastUsed;            // _idleClock when the cursor was last used
+        long long _timeoutTick;                  // where it is filed in its shard's wheel, -1 if not
 
         /* 0 = normal
            1 = no timeout allowed
@@ -412,7 +442,7 @@ namespace mongo {
         unsigned _pinValue;
 
         bool _doingDeletes; // when true we are the delete and aboutToDelete shouldn't manipulate us
-        ElapsedTracker _yieldSometimesTracker;
+        ElapsedTracker _yieldSometimesTracker; // the work quantum between looks at the lock queues
 
         ShardChunkManagerPtr _chunkManager;
 
@@ -427,9 +457,35 @@ namespace mongo {
 
     private: // static members
 
-        static CCById clientCursorsById;
+        /**
+         * Cursors by id, split by id so that getMores on different cursors don't wait for each
+         * other.  Looking a cursor up, and pinning it, takes only its shard's lock.  Adding or
+         * removing a cursor takes ccmutex and then the shard's lock, so holding ccmutex keeps
+         * every shard's map stable; only do that to hold more than one shard lock at once.
+         */
+        struct Shard {
+            Shard() : timeouts( TimeoutSlotMillis , TimeoutSlots ) {}
+            boost::recursive_mutex m;
+            CCById byId;
+            TimerWheel timeouts; // the shard's cursors which can time out, by when they next may
+        };
+        enum { TimeoutMillis = 600000 ,
+               TimeoutSlotMillis = 4000 , // how often ClientCursorMonitor looks
+               TimeoutSlots = 256 };
+        enum { NShards = 16 };
+        static Shard& shardFor( CursorId id ) {
+            unsigned long long x = id;
+            return _shards[ ( x ^ ( x >> 32 ) ) % NShards ];
+        }
+        static Shard *_shards;
+
+        static CCByNs clientCursorsByNs; // so invalidate() only visits the namespace's cursors
         static long long numberTimedOut;
-        static boost::recursive_mutex& ccmutex;   // must use this for all statics above!
+        static long long numberTimedOutLastMinute;
+        static long long numberTimedOutBeforeMinute;
+        /** server idle time, advanced by idleTimeReport(); the clock cursor timeouts are kept in */
+        static AtomicUInt64 _idleClock;
+        static boost::recursive_mutex& ccmutex;   // must use this for all statics above, and byLoc
         static CursorId allocCursorId_inlock();
 
     };
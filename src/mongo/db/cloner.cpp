@@ -17,6 +17,9 @@
 */
 
 #include "pch.h"
+
+#include <boost/thread/thread.hpp>
+
 #include "cloner.h"
 #include "pdfile.h"
 #include "../bson/util/builder.h"
@@ -68,8 +71,45 @@ namespace mongo {
         bool go(const char *masterHost, const CloneOptions& opts, set<string>& clonedColls, string& errmsg, int *errCode = 0);
 
         bool copyCollection( const string& ns , const BSONObj& query , string& errmsg , bool mayYield, bool mayBeInterrupted, bool copyIndexes = true, bool logForRepl = true );
+
+        /**
+         * creates the collection named in collection, an entry of the source's system.namespaces,
+         * in todb and copies its documents, building only the _id index.  The database must be write
+         * locked.
+         */
+        void cloneCollectionData( const BSONObj& collection , const string& todb , const CloneOptions& opts , bool masterSameProcess );
     };
 
+    /** the collections a clone's threads share */
+    struct ParallelClone {
+        ParallelClone() : m( "ParallelClone" ) { }
+        mongo::mutex m;
+        list<BSONObj> toClone;  // system.namespaces entries not yet started (protected by m)
+        string errmsg;          // the first failure; once set the threads stop (protected by m)
+        ProgressMeter* pm;      // the cloning op's collections done (protected by m)
+    };
+
+    /** collections clone and copydb clone at once when no threads field is given */
+    static const int defaultCloneThreads = 4;
+
+    /** sets opts.collectionThreads from a clone command's optional threads field */
+    static bool parseCloneThreads( const BSONObj& cmdObj , CloneOptions& opts , string& errmsg ) {
+        BSONElement e = cmdObj["threads"];
+        if ( e.eoo() ) {
+            opts.collectionThreads = defaultCloneThreads;
+            return true;
+        }
+        if ( ! e.isNumber() || e.numberInt() < 1 || e.numberInt() > 64 ) {
+            errmsg = "threads has to be >= 1 and <= 64";
+            return false;
+        }
+        opts.collectionThreads = e.numberInt();
+        return true;
+    }
+
+    /** clones collections taken from pc until there are none left, on its own connection */
+    static void cloneCollections( const string masterHost , const string todb , CloneOptions opts , ParallelClone* pc );
+
     /* for index info object:
          { "name" : "name_1" , "ns" : "foo.index3" , "key" :  { "name" : 1.0 } }
        we need to fix up the value in the "ns" parameter so that the name prefix is correct on a
@@ -111,10 +151,12 @@ namespace mongo {
     }
 
     struct Cloner::Fun {
-        Fun() : lastLog(0) { }
+        Fun() : lastLog(0), pm(0) { }
         time_t lastLog;
         void operator()( DBClientCursorBatchIterator &i ) {
-            Lock::GlobalWrite lk;
+            // only the collection being filled, so other databases, and the cloner's other
+            // threads while they fetch, aren't held up
+            Lock::DBWrite lk( to_collection );
             if ( context ) {
                 context->relocked();
             }
@@ -125,7 +167,8 @@ namespace mongo {
                     if( now - lastLog >= 60 ) { 
                         // report progress
                         if( lastLog )
-                            log() << "clone " << to_collection << ' ' << n << endl;
+                            log() << "clone " << to_collection << ' ' << n << " ("
+                                  << n * 1000LL / max( timer.millis() , 1 ) << " objects/sec)" << endl;
                         lastLog = now;
                     }
                     mayInterrupt( _mayBeInterrupted );
@@ -151,6 +194,11 @@ namespace mongo {
                 }
 
                 ++n;
+                if ( pm ) {
+                    if ( (unsigned long long) n > pm->total() )
+                        pm->setTotalWhileRunning( n );
+                    pm->hit();
+                }
 
                 BSONObj js = tmp;
                 if ( isindex ) {
@@ -188,6 +236,8 @@ namespace mongo {
         Client::Context *context;
         bool _mayYield;
         bool _mayBeInterrupted;
+        ProgressMeter *pm;
+        Timer timer;
     };
 
     /* copy the specified collection
@@ -210,6 +260,19 @@ namespace mongo {
         f._mayBeInterrupted = mayBeInterrupted;
 
         int options = QueryOption_NoCursorTimeout | ( slaveOk ? QueryOption_SlaveOk : 0 );
+
+        // the source's count is free without a filter, and the progress only needs to be close
+        auto_ptr<ProgressMeterHolder> pm;
+        if ( ! isindex && query.getFilter().isEmpty() && ( mayYield || ! masterSameProcess ) ) {
+            unsigned long long total = 0;
+            {
+                dbtempreleaseif r( mayYield );
+                total = conn->count( from_collection , BSONObj() , options & QueryOption_SlaveOk );
+            }
+            pm.reset( new ProgressMeterHolder( cc().curop()->setMessage( "clone" , max( total , 1ULL ) ) ) );
+            f.pm = &cc().curop()->getProgressMeter();
+        }
+
         {
             f.context = cc().getContext();
             mayInterrupt( mayBeInterrupted );
@@ -282,6 +345,96 @@ namespace mongo {
     extern bool inDBRepair;
     void ensureIdIndexForNewNs(const char *ns);
 
+    void Cloner::cloneCollectionData( const BSONObj& collection , const string& todb , const CloneOptions& opts , bool masterSameProcess ) {
+        log(2) << "  really will clone: " << collection << endl;
+        const char * from_name = collection["name"].valuestr();
+        BSONObj options = collection.getObjectField("options");
+
+        /* change name "<fromdb>.collection" -> <todb>.collection */
+        const char *p = strchr(from_name, '.');
+        verify(p);
+        string to_name = todb + p;
+
+        if ( opts.noteCollection )
+            opts.noteCollection( to_name , false );
+
+        bool wantIdIndex = false;
+        {
+            string err;
+            const char *toname = to_name.c_str();
+            /* we defer building id index for performance - building it in batch is much faster */
+            userCreateNS(toname, options, err, opts.logForRepl, &wantIdIndex);
+        }
+        log(1) << "\t\t cloning " << from_name << " -> " << to_name << endl;
+        Query q;
+        if( opts.snapshot )
+            q.snapshot();
+        copy(from_name, to_name.c_str(), false, opts.logForRepl, masterSameProcess, opts.slaveOk, opts.mayYield, opts.mayBeInterrupted, q);
+
+        if( wantIdIndex ) {
+            /* we need dropDups to be true as we didn't do a true snapshot and this is before applying oplog operations
+               that occur during the initial sync.  inDBRepair makes dropDups be true.
+               */
+            bool old = inDBRepair;
+            try {
+                inDBRepair = true;
+                ensureIdIndexForNewNs(to_name.c_str());
+                inDBRepair = old;
+            }
+            catch(...) {
+                inDBRepair = old;
+                throw;
+            }
+        }
+
+        if ( opts.noteCollection )
+            opts.noteCollection( to_name , true );
+    }
+
+    static void cloneCollections( const string masterHost , const string todb , CloneOptions opts , ParallelClone* pc ) {
+        Client::initThread( "clone" );
+        string errmsg;
+        try {
+            ConnectionString cs = ConnectionString::parse( masterHost, errmsg );
+            auto_ptr<DBClientBase> con( cs.connect( errmsg ) );
+            if ( ! con.get() || ! replAuthenticate( con.get() ) ) {
+                errmsg = str::stream() << "can't connect to " << masterHost << " to clone: " << errmsg;
+            }
+            else {
+                Cloner c;
+                c.setConnection( con.release() );
+                while ( 1 ) {
+                    BSONObj collection;
+                    {
+                        scoped_lock lk( pc->m );
+                        if ( pc->toClone.empty() || ! pc->errmsg.empty() )
+                            break;
+                        collection = pc->toClone.front();
+                        pc->toClone.pop_front();
+                    }
+                    mayInterrupt( opts.mayBeInterrupted );
+                    {
+                        Client::WriteContext ctx( todb );
+                        c.cloneCollectionData( collection , todb , opts , false );
+                    }
+                    scoped_lock lk( pc->m );
+                    pc->pm->hit();
+                }
+            }
+        }
+        catch ( DBException& e ) {
+            errmsg = str::stream() << "error cloning: " << e.toString();
+        }
+
+        if ( ! errmsg.empty() ) {
+            log() << errmsg << endl;
+            scoped_lock lk( pc->m );
+            if ( pc->errmsg.empty() )
+                pc->errmsg = errmsg;
+        }
+        cc().shutdown();
+    }
+
     bool Cloner::go(const char *masterHost, string& errmsg, const string& fromdb, bool logForRepl, bool slaveOk, bool useReplAuth, bool snapshot, bool mayYield, bool mayBeInterrupted, int *errCode) {
 
         CloneOptions opts;
@@ -307,6 +460,8 @@ namespace mongo {
         massert( 10289 ,  "useReplAuth is not written to replication log", !opts.useReplAuth || !opts.logForRepl );
 
         string todb = cc().database()->name;
+        // other connections to the source can't log in with the credentials one given to us has
+        bool ownConnection = ! conn.get();
         stringstream a,b;
         a << "localhost:" << cmdLine.port;
         b << "127.0.0.1:" << cmdLine.port;
@@ -416,48 +571,35 @@ namespace mongo {
             }
         }
 
-        for ( list<BSONObj>::iterator i=toClone.begin(); i != toClone.end(); i++ ) {
+        if ( opts.collectionThreads > 1 && opts.mayYield && ! masterSameProcess && ownConnection && toClone.size() > 1 ) {
+            ParallelClone pc;
+            pc.toClone = toClone;
+            ProgressMeterHolder pm( cc().curop()->setMessage( "clone collections" , toClone.size() , 10 ) );
+            pc.pm = &cc().curop()->getProgressMeter();
+            size_t n = min( toClone.size() , (size_t) opts.collectionThreads );
+            log(1) << "\t cloning " << toClone.size() << " collections " << n << " at a time" << endl;
+
+            boost::thread_group threads;
+            for ( size_t i = 0; i < n; i++ )
+                threads.create_thread( boost::bind( &cloneCollections , string( masterHost ) , todb , opts , &pc ) );
             {
-                mayInterrupt( opts.mayBeInterrupted );
-                dbtempreleaseif r( opts.mayYield );
+                // the threads each take the lock held here as they need it
+                dbtemprelease r;
+                threads.join_all();
             }
-            BSONObj collection = *i;
-            log(2) << "  really will clone: " << collection << endl;
-            const char * from_name = collection["name"].valuestr();
-            BSONObj options = collection.getObjectField("options");
-
-            /* change name "<fromdb>.collection" -> <todb>.collection */
-            const char *p = strchr(from_name, '.');
-            verify(p);
-            string to_name = todb + p;
 
-            bool wantIdIndex = false;
-            {
-                string err;
-                const char *toname = to_name.c_str();
-                /* we defer building id index for performance - building it in batch is much faster */
-                userCreateNS(toname, options, err, opts.logForRepl, &wantIdIndex);
-            }
-            log(1) << "\t\t cloning " << from_name << " -> " << to_name << endl;
-            Query q;
-            if( opts.snapshot )
-                q.snapshot();
-            copy(from_name, to_name.c_str(), false, opts.logForRepl, masterSameProcess, opts.slaveOk, opts.mayYield, opts.mayBeInterrupted, q);
-
-            if( wantIdIndex ) {
-                /* we need dropDups to be true as we didn't do a true snapshot and this is before applying oplog operations
-                   that occur during the initial sync.  inDBRepair makes dropDups be true.
-                   */
-                bool old = inDBRepair;
-                try {
-                    inDBRepair = true;
-                    ensureIdIndexForNewNs(to_name.c_str());
-                    inDBRepair = old;
-                }
-                catch(...) {
-                    inDBRepair = old;
-                    throw;
+            if ( ! pc.errmsg.empty() ) {
+                errmsg = pc.errmsg;
+                return false;
+            }
+        }
+        else {
+            for ( list<BSONObj>::iterator i=toClone.begin(); i != toClone.end(); i++ ) {
+                {
+                    mayInterrupt( opts.mayBeInterrupted );
+                    dbtempreleaseif r( opts.mayYield );
                 }
+                cloneCollectionData( *i , todb , opts , masterSameProcess );
             }
         }
 
@@ -521,7 +663,7 @@ namespace mongo {
         virtual LockType locktype() const { return WRITE; }
         virtual void help( stringstream &help ) const {
             help << "clone this database from an instance of the db on another host\n";
-            help << "{ clone : \"host13\" }";
+            help << "{ clone : \"host13\" [, threads : <collections cloned at once>] }";
         }
         CmdClone() : Command("clone") { }
         virtual bool run(const string& dbname , BSONObj& cmdObj, int, string& errmsg, BSONObjBuilder& result, bool fromRepl) {
@@ -532,6 +674,8 @@ namespace mongo {
             CloneOptions opts;
             opts.fromDB = dbname;
             opts.logForRepl = ! fromRepl;
+            if ( ! parseCloneThreads( cmdObj , opts , errmsg ) )
+                return false;
 
             // See if there's any collections we should ignore
             if( cmdObj["collsToIgnore"].type() == Array ){
@@ -672,7 +816,7 @@ namespace mongo {
         virtual LockType locktype() const { return NONE; }
         virtual void help( stringstream &help ) const {
             help << "copy a database from another host to this host\n";
-            help << "usage: {copydb: 1, fromhost: <hostname>, fromdb: <db>, todb: <db>[, slaveOk: <bool>, username: <username>, nonce: <nonce>, key: <key>]}";
+            help << "usage: {copydb: 1, fromhost: <hostname>, fromdb: <db>, todb: <db>[, slaveOk: <bool>, threads: <n>, username: <username>, nonce: <nonce>, key: <key>]}";
         }
         virtual bool run(const string& dbname, BSONObj& cmdObj, int, string& errmsg, BSONObjBuilder& result, bool fromRepl) {
             bool slaveOk = cmdObj["slaveOk"].trueValue();
@@ -691,6 +835,13 @@ namespace mongo {
                 return false;
             }
 
+            CloneOptions opts;
+            opts.fromDB = fromdb;
+            opts.logForRepl = ! fromRepl;
+            opts.slaveOk = slaveOk;
+            if ( ! parseCloneThreads( cmdObj , opts , errmsg ) )
+                return false;
+
             // SERVER-4328 todo lock just the two db's not everything for the fromself case
             scoped_ptr<Lock::ScopedLock> lk( fromSelf ? 
                                              static_cast<Lock::ScopedLock*>( new Lock::GlobalWrite() ) : 
@@ -713,7 +864,8 @@ namespace mongo {
                 c.setConnection( authConn_.release() );
             }
             Client::Context ctx(todb);
-            bool res = c.go(fromhost.c_str(), errmsg, fromdb, /*logForReplication=*/!fromRepl, slaveOk, /*replauth*/false, /*snapshot*/true, /*mayYield*/true, /*mayBeInterrupted*/ false);
+            set<string> clonedColls;
+            bool res = c.go( fromhost.c_str(), opts, clonedColls, errmsg );
             return res;
         }
     } cmdcopydb;
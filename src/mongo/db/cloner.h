@@ -18,6 +18,8 @@
 
 #pragma once
 
+#include <boost/function.hpp>
+
 #include "jsobj.h"
 
 namespace mongo {
@@ -34,6 +36,8 @@ namespace mongo {
 
             syncData = true;
             syncIndexes = true;
+
+            collectionThreads = 1;
         }
             
         string fromDB;
@@ -48,6 +52,18 @@ namespace mongo {
 
         bool syncData;
         bool syncIndexes;
+
+        /**
+         * collections cloned at once, each on a thread and connection of its own.  Only a clone
+         * from another process which may yield clones more than one at a time.
+         */
+        int collectionThreads;
+
+        /**
+         * if set, called with the database write locked as each collection's data starts to
+         * be cloned (with cloned false) and when it has been (with cloned true)
+         */
+        boost::function<void (const string& ns, bool cloned)> noteCollection;
     };
 
     bool cloneFrom( const string& masterHost , 
@@ -71,6 +71,7 @@ namespace mongo {
         ("bind_ip", po::value<string>(&cmdLine.bind_ip), "comma separated list of ip addresses to listen on - all local ips by default")
         ("maxConns",po::value<int>(), maxConnInfoBuilder.str().c_str())
         ("objcheck", "inspect client data for validity on receipt")
+        ("networkCompression", "compress messages over 4KB with snappy on connections to and from servers which also have this on")
         ("logpath", po::value<string>() , "log file to send write to instead of stdout - has to be a file, not directory" )
         ("logappend" , "append to logpath instead of over-writing" )
         ("pidfilepath", po::value<string>(), "full path to pidfile (if not set, no pidfile is created)")
@@ -263,6 +264,10 @@ namespace mongo {
             cmdLine.objcheck = true;
         }
 
+        if (params.count("networkCompression")) {
+            cmdLine.networkCompression = true;
+        }
+
         if (params.count("bind_ip")) {
             // passing in wildcard is the same as default behavior; remove and warn
             if ( cmdLine.bind_ip ==  "0.0.0.0" ) {
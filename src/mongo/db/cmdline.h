@@ -86,6 +86,7 @@ namespace mongo {
 
         bool dur;                       // --dur durability (now --journal)
         unsigned journalCommitInterval; // group/batch commit interval ms
+        string journalCompressor;       // --journalCompressor how journal sections are compressed: "snappy" or "none"
 
         /** --durOptions 7      dump journal and terminate without doing anything further
             --durOptions 4      recover and terminate without listening
@@ -97,11 +98,13 @@ namespace mongo {
             DurParanoid = 8,      // paranoid mode enables extra checks
             DurAlwaysCommit = 16, // do a group commit every time the writelock is released
             DurAlwaysRemap = 32,  // remap the private view after every group commit (may lag to the next write lock acquisition, but will do all files then)
-            DurNoCheckSpace = 64  // don't check that there is enough room for journal files before startup (for diskfull tests)
+            DurNoCheckSpace = 64, // don't check that there is enough room for journal files before startup (for diskfull tests)
+            DurNoPipelinedCommit = 128 // hold groupCommitMutex through each commit's journal write instead of letting the next commit prepare meanwhile
         };
         int durOptions;          // --durOptions <n> for debugging
 
         bool objcheck;         // --objcheck
+        bool networkCompression; // --networkCompression
 
         long long oplogSize;   // --oplogSize
         int defaultProfile;    // --profile
@@ -110,6 +113,8 @@ namespace mongo {
         int pretouch;          // --pretouch for replication application (experimental)
         bool moveParanoia;     // for move chunk paranoia
         double syncdelay;      // seconds between fsyncs
+        unsigned syncRateMB;   // --syncRateMB with journaling, flush data files continuously at up to this MB/s. 0 = all at once every syncdelay
+        int netWorkers;        // --netWorkers threads to serve connections from. 0 = a thread per connection
 
         bool noUnixSocket;     // --nounixsocket
         bool doFork;           // --fork
@@ -157,13 +162,14 @@ namespace mongo {
         port(DefaultDBPort), rest(false), jsonp(false), quiet(false),
         noTableScan(false), prealloc(true), preallocj(true), smallfiles(sizeof(int*) == 4),
         configsvr(false), quota(false), quotaFiles(8), cpu(false),
-        durOptions(0), objcheck(false), oplogSize(0), defaultProfile(0),
+        durOptions(0), objcheck(false), networkCompression(false), oplogSize(0), defaultProfile(0),
         slowMS(100), defaultLocalThresholdMillis(10), pretouch(0), moveParanoia( true ),
-        syncdelay(60), noUnixSocket(false), doFork(0), socket("/tmp") 
+        syncdelay(60), syncRateMB(0), netWorkers(0), noUnixSocket(false), doFork(0), socket("/tmp") 
     {
         started = time(0);
 
         journalCommitInterval = 0; // 0 means use default
+        journalCompressor = "snappy";
         dur = false;
 #if defined(_DURABLEDEFAULTON)
         dur = true;
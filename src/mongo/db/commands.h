@@ -168,4 +168,10 @@ namespace mongo {
 
     bool _runCommands(const char *ns, BSONObj& jsobj, BufBuilder &b, BSONObjBuilder& anObjBuilder, bool fromRepl, int queryOptions);
 
+    /**
+     * waits as getLastError does for cmdObj's j, fsync and w options, reporting into result.
+     * replication isn't waited for if hadError.  @return false if the options conflict
+     */
+    bool awaitWriteConcern( const BSONObj& cmdObj, bool hadError, BSONObjBuilder& result, string& errmsg );
+
 } // namespace mongo
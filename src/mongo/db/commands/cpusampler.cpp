@@ -0,0 +1,232 @@
+/** @file cpusampler.cpp
+    sampling cpu profiler, attributing samples to the operation each thread is running
+*/
+
+/**
+ *    Copyright (C) 2012 10gen Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * { sampleCpu : 1 , seconds : 5 , hz : 100 , stacks : 5 }
+ *
+ * For the given number of seconds, a SIGPROF timer interrupts whichever thread is using cpu
+ * hz times a cpu second, and the handler records that thread's stack along with the op type
+ * and namespace of its current CurOp.  The command then returns the samples grouped by op and
+ * namespace, busiest first, each with its most frequent stacks.  Nothing runs between
+ * samplings, so unlike _cpuProfilerStart this costs nothing unless in use and needs no special
+ * build, but it shouldn't be used at the same time as that, as both depend on SIGPROF.
+ */
+
+#include "pch.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mongo/db/client.h"
+#include "mongo/db/commands.h"
+#include "mongo/db/curop.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/util/stacktrace.h"
+
+#if defined(MONGO_HAVE_EXECINFO_BACKTRACE) && !defined(_WIN32)
+#define MONGO_CPU_SAMPLER 1
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+namespace mongo {
+
+    namespace {
+
+        enum {
+            MaxFrames = 24 ,
+            SkippedFrames = 2 , // the handler, and the signal trampoline
+            NsLen = 64 ,
+            MaxSamples = 16 * 1024
+        };
+
+        struct Sample {
+            int op;
+            int depth;
+            char ns[NsLen];
+            void *frames[MaxFrames];
+        };
+
+        // while sampling, the samples so far; written only by the signal handler
+        Sample *samples = 0;
+        AtomicUInt32 nextSample;
+        AtomicUInt32 dropped;
+
+        mongo::mutex samplerMutex( "cpuSampler" ); // one sampling at a time
+
+#ifdef MONGO_CPU_SAMPLER
+        void onSigprof( int ) {
+            unsigned i = nextSample.fetchAndAdd( 1 );
+            if ( i >= (unsigned) MaxSamples ) {
+                dropped.fetchAndAdd( 1 );
+                return;
+            }
+            Sample &s = samples[i];
+            s.op = 0;
+            s.ns[0] = 0;
+            Client *c = currentClient.get();
+            CurOp *op = c ? c->curop() : 0;
+            if ( op && op->active() ) {
+                s.op = op->getOp();
+                // the ns may be changing under us; a torn read only mislabels this sample
+                const char *ns = op->getNS();
+                int j = 0;
+                for ( ; j < NsLen - 1 && ns[j]; j++ )
+                    s.ns[j] = ns[j];
+                s.ns[j] = 0;
+            }
+            s.depth = getStackFrames( s.frames , MaxFrames );
+        }
+#endif
+
+        struct Group {
+            Group() : count(0) { }
+            int count;
+            std::map< std::vector<void*> , int > stacks;
+        };
+
+        bool byCount( const std::pair<int, std::vector<void*> >& a ,
+                      const std::pair<int, std::vector<void*> >& b ) {
+            return a.first > b.first;
+        }
+
+        bool groupByCount( const std::pair<int, std::string>& a ,
+                           const std::pair<int, std::string>& b ) {
+            return a.first > b.first;
+        }
+    }
+
+    class CpuSamplerCommand : public Command {
+    public:
+        CpuSamplerCommand() : Command( "sampleCpu" ) { }
+        virtual bool slaveOk() const { return true; }
+        virtual bool adminOnly() const { return true; }
+        virtual LockType locktype() const { return NONE; }
+        virtual void help( stringstream& help ) const {
+            help << "samples which stacks are using cpu, by op and namespace\n"
+                 "{ sampleCpu : 1 , seconds : 5 , hz : 100 , stacks : 5 }";
+        }
+
+        virtual bool run( const string& dbname , BSONObj& cmdObj , int , string& errmsg ,
+                          BSONObjBuilder& result , bool fromRepl ) {
+#ifndef MONGO_CPU_SAMPLER
+            errmsg = "cpu sampling is not supported on this platform";
+            return false;
+#else
+            double seconds = cmdObj["seconds"].isNumber() ? cmdObj["seconds"].number() : 5;
+            int hz = cmdObj["hz"].isNumber() ? cmdObj["hz"].numberInt() : 100;
+            int nStacks = cmdObj["stacks"].isNumber() ? cmdObj["stacks"].numberInt() : 5;
+            if ( seconds <= 0 || seconds > 60 || hz <= 0 || hz > 1000 ) {
+                errmsg = "seconds must be in (0, 60] and hz in (0, 1000]";
+                return false;
+            }
+
+            scoped_lock lk( samplerMutex );
+            std::vector<Sample> buf( MaxSamples );
+            samples = &buf[0];
+            nextSample.store( 0 );
+            dropped.store( 0 );
+
+            // backtrace allocates on first use, which mustn't happen in the handler
+            void *prime[1];
+            getStackFrames( prime , 1 );
+
+            struct sigaction sa, old;
+            memset( &sa , 0 , sizeof( sa ) );
+            sa.sa_handler = onSigprof;
+            sa.sa_flags = SA_RESTART;
+            sigemptyset( &sa.sa_mask );
+            sigaction( SIGPROF , &sa , &old );
+
+            struct itimerval timer;
+            timer.it_interval.tv_sec = 0;
+            timer.it_interval.tv_usec = 1000000 / hz;
+            timer.it_value = timer.it_interval;
+            setitimer( ITIMER_PROF , &timer , 0 );
+
+            sleepmillis( (long long) ( seconds * 1000 ) );
+
+            memset( &timer , 0 , sizeof( timer ) );
+            setitimer( ITIMER_PROF , &timer , 0 );
+            sigaction( SIGPROF , &old , 0 );
+
+            unsigned n = std::min( nextSample.load() , (unsigned) MaxSamples );
+            // a handler still running on another thread could be writing its sample
+            sleepmillis( 10 );
+            samples = 0;
+
+            std::map< std::string , Group > groups;
+            for ( unsigned i = 0; i < n; i++ ) {
+                const Sample &s = buf[i];
+                std::string key = std::string( opToString( s.op ) ) + " " + s.ns;
+                Group &g = groups[key];
+                g.count++;
+                int first = std::min( (int) SkippedFrames , s.depth );
+                g.stacks[ std::vector<void*>( s.frames + first , s.frames + s.depth ) ]++;
+            }
+
+            std::vector< std::pair<int, std::string> > order;
+            for ( std::map< std::string , Group >::iterator i = groups.begin(); i != groups.end(); ++i )
+                order.push_back( std::make_pair( i->second.count , i->first ) );
+            std::sort( order.begin() , order.end() , groupByCount );
+
+            result.append( "samples" , (int) n );
+            result.append( "dropped" , (int) dropped.load() );
+            result.append( "seconds" , seconds );
+            result.append( "hz" , hz );
+
+            BSONArrayBuilder byOp( result.subarrayStart( "byOp" ) );
+            for ( unsigned i = 0; i < order.size(); i++ ) {
+                Group &g = groups[ order[i].second ];
+                BSONObjBuilder b( byOp.subobjStart() );
+                std::string::size_type space = order[i].second.find( ' ' );
+                b.append( "op" , order[i].second.substr( 0 , space ) );
+                b.append( "ns" , order[i].second.substr( space + 1 ) );
+                b.append( "samples" , g.count );
+                b.append( "percent" , 100.0 * g.count / n );
+
+                std::vector< std::pair<int, std::vector<void*> > > stacks;
+                for ( std::map< std::vector<void*> , int >::iterator j = g.stacks.begin();
+                      j != g.stacks.end(); ++j )
+                    stacks.push_back( std::make_pair( j->second , j->first ) );
+                std::sort( stacks.begin() , stacks.end() , byCount );
+
+                BSONArrayBuilder sb( b.subarrayStart( "stacks" ) );
+                for ( int j = 0; j < nStacks && j < (int) stacks.size(); j++ ) {
+                    BSONObjBuilder stack( sb.subobjStart() );
+                    stack.append( "samples" , stacks[j].first );
+                    std::vector<std::string> frames;
+                    if ( ! stacks[j].second.empty() )
+                        describeStackFrames( &stacks[j].second[0] , stacks[j].second.size() , &frames );
+                    stack.append( "frames" , frames );
+                    stack.done();
+                }
+                sb.done();
+                b.done();
+            }
+            byOp.done();
+            return true;
+#endif
+        }
+    } cpuSamplerCommand;
+
+} // namespace mongo
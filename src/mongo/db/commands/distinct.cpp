@@ -19,6 +19,9 @@
 #include "../commands.h"
 #include "../instance.h"
 #include "../clientcursor.h"
+#include "../btree.h"
+#include "../matcher.h"
+#include "../queryutil.h"
 #include "../../util/timer.h"
 
 namespace mongo {
@@ -32,6 +35,50 @@ namespace mongo {
             help << "{ distinct : 'collection name' , key : 'a.b' , query : {} }";
         }
 
+        /**
+         * @return a cursor over an index led by 'key' that visits only the keys matching the
+         * query's ranges on the other index fields, or 0 if there is no such index or the query
+         * optimizer has a better plan.  Such an index holds each value of the key in one run of
+         * keys, so after a match the scan can step straight to the next value.
+         */
+        static BtreeCursor *valueScanCursor( NamespaceDetails *d, const string &ns,
+                                             const string &key, const BSONObj &query ) {
+            if ( ! query["$or"].eoo() )
+                return 0;
+            FieldRangeSet frs( ns.c_str(), query, /*singleKey*/true );
+            if ( ! frs.matchPossible() || ! frs.getSpecial().empty() )
+                return 0;
+
+            int idxNo = -1;
+            NamespaceDetails::IndexIterator ii = d->ii();
+            while ( ii.more() ) {
+                IndexDetails& idx = ii.next();
+                const char *first = idx.keyPattern().firstElementFieldName();
+                // an index whose leading field is constrained gives the optimizer a real plan
+                if ( ! frs.range( first ).universal() )
+                    return 0;
+                if ( idxNo < 0 && key == first && ! d->isMultikey( ii.pos() - 1 ) &&
+                     ! idx.getSpec().getType() && ! idx.getSpec().isPartial() )
+                    idxNo = ii.pos() - 1;
+            }
+            if ( idxNo < 0 )
+                return 0;
+
+            IndexDetails& idx = d->idx( idxNo );
+            shared_ptr<CoveredIndexMatcher> matcher;
+            if ( ! query.isEmpty() ) {
+                matcher.reset( new CoveredIndexMatcher( query, idx.keyPattern() ) );
+                // fetching records in key order could cost more than the table scan
+                if ( matcher->needRecord() )
+                    return 0;
+            }
+            shared_ptr<FieldRangeVector> frv( new FieldRangeVector( frs, idx.getSpec(), 1 ) );
+            BtreeCursor *c = BtreeCursor::make( d, idxNo, idx, frv, 0, 1 );
+            if ( matcher )
+                c->setMatcher( matcher );
+            return c;
+        }
+
         bool run(const string& dbname, BSONObj& cmdObj, int, string& errmsg, BSONObjBuilder& result, bool fromRepl ) {
             Timer t;
             string ns = dbname + '.' + cmdObj.firstElement().valuestr();
@@ -62,7 +109,11 @@ namespace mongo {
             }
 
             shared_ptr<Cursor> cursor;
-            if ( ! query.isEmpty() ) {
+            BtreeCursor *valueScan = valueScanCursor( d, ns, key, query );
+            if ( valueScan ) {
+                cursor.reset( valueScan );
+            }
+            else if ( ! query.isEmpty() ) {
                 cursor = NamespaceDetailsTransient::getCursor(ns.c_str() , query , BSONObj() );
             }
             else {
@@ -73,7 +124,8 @@ namespace mongo {
                 while ( ii.more() ) {
                     IndexDetails& idx = ii.next();
 
-                    if ( d->isMultikey( ii.pos() - 1 ) )
+                    // a partial index doesn't hold every document
+                    if ( d->isMultikey( ii.pos() - 1 ) || idx.getSpec().isPartial() )
                         continue;
 
                     if ( idx.inKeyPattern( key ) ) {
@@ -99,9 +151,11 @@ namespace mongo {
             while ( cursor->ok() ) {
                 nscanned++;
                 bool loadedRecord = false;
+                bool matched = false;
 
                 if ( cursor->currentMatches( &md ) && !cursor->getsetdup( cursor->currLoc() ) ) {
                     n++;
+                    matched = true;
 
                     BSONObj holder;
                     BSONElementSet temp;
@@ -126,7 +180,10 @@ namespace mongo {
                 if ( loadedRecord || md.hasLoadedRecord() )
                     nscannedObjects++;
 
-                cursor->advance();
+                if ( valueScan && matched )
+                    valueScan->advancePastLeadingValue();
+                else
+                    cursor->advance();
 
                 if (!cc->yieldSometimes( ClientCursor::MaybeCovered )) {
                     cc.release();
@@ -21,6 +21,7 @@
 #include "mongo/client/dbclientcursor.h"
 #include "mongo/db/clientcursor.h"
 #include "mongo/db/cursor.h"
+#include "mongo/db/db.h"
 #include "mongo/db/instance.h"
 #include "mongo/db/pipeline/document.h"
 
@@ -35,6 +36,54 @@ namespace mongo {
         pCursor.reset();
     }
 
+    void DocumentSourceCursor::noteLocation() {
+        if (!pClientCursor)
+            return;
+
+        /* as a query's getMore() leaves its cursor */
+        ClientCursor::YieldData data;
+        if (!pClientCursor->prepareToYield(data))
+            pCursor->noteLocation();
+    }
+
+    void DocumentSourceCursor::checkLocation() {
+        if (pCursor)
+            pCursor->recoverFromYield();
+    }
+
+    void DocumentSourceCursor::unlock() {
+        verify(!pTempRelease);
+
+        /* a cursor that can't yield can't be left while others write */
+        yielded = false;
+        if (pClientCursor) {
+            uassert(16433, "$out can't follow a query whose cursor can't yield",
+                    pClientCursor->prepareToYield(yieldData));
+            yielded = true;
+        }
+
+        pTempRelease.reset(new dbtempreleasecond);
+        if (!pTempRelease->unlocked()) {
+            pTempRelease.reset();
+            relock();
+            uassert(16434, "$out can't release the lock the aggregation was run with",
+                    false);
+        }
+    }
+
+    void DocumentSourceCursor::relock() {
+        pTempRelease.reset();
+        if (yielded) {
+            yielded = false;
+            if (!ClientCursor::recoverFromYield(yieldData)) {
+                /* the ClientCursor is gone; don't touch it again */
+                releaseCursor();
+                uasserted(16435,
+                          "collection or database disappeared while $out wrote");
+            }
+        }
+    }
+
     bool DocumentSourceCursor::eof() {
         /* if we haven't gotten the first one yet, do so now */
         if (!pCurrent.get())
@@ -79,6 +128,16 @@ namespace mongo {
     }
 
     void DocumentSourceCursor::findNext() {
+        /*
+          Once we've produced as many documents as the pipeline wants,
+          there's no need to hang on to the cursor.
+         */
+        if (limit && (nProduced >= limit)) {
+            pCurrent.reset();
+            releaseCursor();
+            return;
+        }
+
         /* standard cursor usage pattern */
         while(pCursor->ok()) {
             CoveredIndexMatcher *pCIM; // save intermediate result
@@ -97,10 +156,10 @@ namespace mongo {
                 else {
                     /* grab the matching document */
                     BSONObj documentObj(pCursor->current());
-                    // TODO SERVER-5090 add the dependency map
                     pCurrent = Document::createFromBsonObj(
-                        &documentObj, NULL /* LATER pDependencies.get()*/);
+                        &documentObj, selectAll ? NULL : &vSelectField);
                 }
+                ++nProduced;
                 advanceAndYield();
                 return;
             }
@@ -133,6 +192,9 @@ namespace mongo {
                 pBuilder->append("sort", *pSort);
             }
 
+            if (limit)
+                pBuilder->append("limit", limit);
+
             // construct query for explain
             BSONObjBuilder queryBuilder;
             queryBuilder.append("$query", *pQuery);
@@ -155,9 +217,14 @@ namespace mongo {
         const intrusive_ptr<ExpressionContext> &pCtx):
         DocumentSource(pCtx),
         pCurrent(),
+        limit(0),
+        nProduced(0),
+        selectAll(true),
+        vSelectField(),
         pCursor(pTheCursor),
         pDependencies(),
-        pClientCursor() {
+        pClientCursor(),
+        yielded(false) {
         pClientCursor.reset(
             new ClientCursor(QueryOption_NoCursorTimeout, pTheCursor, ns));
     }
@@ -188,17 +255,49 @@ namespace mongo {
         pSelect = pBsonObj;
 
         /*
-          Extract the fields into a map so that we can look them up quickly
-          if we need them because we end up using Cursor::current() and fetching
-          the whole document in findNext().
+          Extract the top-level field names so that findNext() only converts
+          what the pipeline will use when it ends up using Cursor::current()
+          and fetching the whole document.  Pipelines usually refer to only
+          a handful of fields, so these are kept in a vector.
         */
-        // TODO SERVER-5090 $$$
+        selectAll = true;
+        vSelectField.clear();
+        if (pSelect->isEmpty())
+            return;
+
+        vSelectField.push_back(Document::idName);
+        BSONObjIterator selectIterator(*pSelect);
+        while(selectIterator.more()) {
+            BSONElement selectElement(selectIterator.next());
+            const char *pPath = selectElement.fieldName();
+
+            /*
+              Anything that isn't a plain field path (e.g. a $where a
+              $match refers to) might need any field, so keep them all.
+             */
+            if (*pPath == '$') {
+                vSelectField.clear();
+                return;
+            }
+
+            const char *pDot = strchr(pPath, '.');
+            string fieldName(pDot ? string(pPath, pDot - pPath) :
+                             string(pPath));
+            if (find(vSelectField.begin(), vSelectField.end(), fieldName) ==
+                vSelectField.end())
+                vSelectField.push_back(fieldName);
+        }
+        selectAll = false;
     }
 
     void DocumentSourceCursor::setSort(const shared_ptr<BSONObj> &pBsonObj) {
         pSort = pBsonObj;
     }
 
+    void DocumentSourceCursor::setLimit(long long theLimit) {
+        limit = theLimit;
+    }
+
     void DocumentSourceCursor::keepAlive(
         const shared_ptr<void> &pVoid) {
         pDependencies.push_back(pVoid);
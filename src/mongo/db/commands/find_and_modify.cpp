@@ -33,8 +33,10 @@ namespace mongo {
             help <<
                  "{ findAndModify: \"collection\", query: {processed:false}, update: {$set: {processed:true}}, new: true}\n"
                  "{ findAndModify: \"collection\", query: {processed:false}, remove: true, sort: {priority:-1}}\n"
+                 "{ findAndModify: \"collection\", query: {processed:false}, remove: true, limit: 100}\n"
                  "Either update or remove is required, all other fields have default values.\n"
-                 "Output is in the \"value\" field\n";
+                 "Output is in the \"value\" field, or with a limit the \"values\" array of up to that many\n"
+                 "documents, all claimed at once\n";
         }
 
         CmdFindAndModify() : Command("findAndModify", false, "findandmodify") { }
@@ -44,7 +46,7 @@ namespace mongo {
         
         /* this will eventually replace run,  once sort is handled */
         bool runNoDirectClient( const string& dbname, BSONObj& cmdObj, int, string& errmsg, BSONObjBuilder& result, bool) {
-            verify( cmdObj["sort"].eoo() );
+            verify( cmdObj["sort"].eoo() || ! cmdObj["limit"].eoo() );
 
             string ns = dbname + '.' + cmdObj.firstElement().valuestr();
 
@@ -70,6 +72,19 @@ namespace mongo {
                 errmsg = "need remove or update";
                 return false;
             }
+
+            BSONElement limit = cmdObj["limit"];
+            if ( ! limit.eoo() ) {
+                uassert( 16425 , "findAndModify limit must be a positive number" ,
+                         limit.isNumber() && limit.numberLong() > 0 );
+                if ( upsert ) {
+                    errmsg = "limit and upsert can't co-exist";
+                    return false;
+                }
+                // no PageFaultRetryableSection: a retry part way through would claim some twice
+                return runBatch( ns , query , cmdObj.getObjectField( "sort" ) , fields , update ,
+                                 limit.numberLong() , returnNew , remove , result );
+            }
             
             PageFaultRetryableSection s;
             while ( 1 ) {
@@ -104,6 +119,40 @@ namespace mongo {
                 
         }
 
+        /** @return whether update uses the positional $ operator, which needs the query matched */
+        static bool _isPositional( const BSONObj& update ) {
+            BSONObjIterator i( update );
+            while ( i.more() ) {
+                BSONElement op = i.next();
+                if ( op.type() != Object )
+                    continue;
+                BSONObjIterator j( op.embeddedObject() );
+                while ( j.more() ) {
+                    if ( strstr( j.next().fieldName() , ".$" ) )
+                        return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * @return a query for just doc, found by its _id, so that changing it doesn't run the
+         * whole query again.  the rest of the query is kept for a positional update
+         */
+        static BSONObj _queryForFound( const BSONObj& doc , const BSONObj& query , const BSONObj& update ) {
+            BSONObjBuilder b;
+            b.append( doc["_id"] );
+            if ( ! update.isEmpty() && _isPositional( update ) ) {
+                BSONObjIterator i( query );
+                while ( i.more() ) {
+                    BSONElement e = i.next();
+                    if ( strcmp( e.fieldName() , "_id" ) )
+                        b.append( e );
+                }
+            }
+            return b.obj();
+        }
+
         bool runNoDirectClient( const string& ns , 
                                 const BSONObj& query , const BSONObj& fields , const BSONObj& update , 
                                 bool upsert , bool returnNew , bool remove ,
@@ -115,10 +164,16 @@ namespace mongo {
             BSONObj doc;
             
             bool found = Helpers::findOne( ns.c_str() , query , doc );
+            // doc is only good until it is changed
+            BSONObj foundQuery;
+            if ( found && doc.hasField( "_id" ) )
+                foundQuery = _queryForFound( doc , query , update );
+            const BSONObj& target = foundQuery.isEmpty() ? query : foundQuery;
+
             if ( remove ) {
                 _appendHelper( result , doc , found , fields );
                 if ( found ) {
-                    deleteObjects( ns.c_str() , query , true , true );
+                    deleteObjects( ns.c_str() , target , true , true );
                 }
             }
             else {
@@ -134,10 +189,11 @@ namespace mongo {
                         _appendHelper( result , doc , found , fields );
                     }
                     
-                    updateObjects( ns.c_str() , update , query , upsert , false , true , cc().curop()->debug() );
+                    updateObjects( ns.c_str() , update , target , upsert , false , true , cc().curop()->debug() );
                     
                     if ( returnNew ) {
-                        verify( Helpers::findOne( ns.c_str() , query , doc ) );
+                        BSONObj again = foundQuery.isEmpty() ? query : BSON( "_id" << foundQuery["_id"] );
+                        verify( Helpers::findOne( ns.c_str() , again , doc ) );
                         _appendHelper( result , doc , true , fields );
                     }
                     
@@ -146,11 +202,54 @@ namespace mongo {
             
             return true;
         }
+
+        /**
+         * claims up to limit documents matching query, in sort order, removing or updating each
+         * one under the one lock, and appends them as "values"
+         */
+        bool runBatch( const string& ns , const BSONObj& query , const BSONObj& sort ,
+                       const BSONObj& fields , const BSONObj& update , long long limit ,
+                       bool returnNew , bool remove , BSONObjBuilder& result ) {
+            Lock::DBWrite lk( ns );
+
+            vector<BSONObj> docs;
+            {
+                shared_ptr<Cursor> c = NamespaceDetailsTransient::getCursor( ns.c_str() , query , sort );
+                uassert( 16426 , "findAndModify with a limit can only sort on an index" , c );
+                for ( ; c->ok() && (long long) docs.size() < limit; c->advance() ) {
+                    if ( c->currentMatches() && ! c->getsetdup( c->currLoc() ) )
+                        docs.push_back( c->current().getOwned() );
+                }
+            }
+
+            Projection p;
+            if ( ! fields.isEmpty() )
+                p.init( fields );
+
+            BSONArrayBuilder values( result.subarrayStart( "values" ) );
+            for ( unsigned i = 0; i < docs.size(); i++ ) {
+                BSONObj doc = docs[i];
+                uassert( 16427 , "findAndModify with a limit needs documents with an _id" ,
+                         doc.hasField( "_id" ) );
+                BSONObj target = _queryForFound( doc , query , update );
+                if ( remove ) {
+                    deleteObjects( ns.c_str() , target , true , true );
+                }
+                else {
+                    updateObjects( ns.c_str() , update , target , false , false , true , cc().curop()->debug() );
+                    if ( returnNew && ! Helpers::findOne( ns.c_str() , BSON( "_id" << doc["_id"] ) , doc ) )
+                        continue;
+                }
+                values.append( fields.isEmpty() ? doc : p.transform( doc ) );
+            }
+            values.done();
+            return true;
+        }
         
         virtual bool run(const string& dbname, BSONObj& cmdObj, int x, string& errmsg, BSONObjBuilder& result, bool y) {
             static DBDirectClient db;
 
-            if ( cmdObj["sort"].eoo() )
+            if ( cmdObj["sort"].eoo() || ! cmdObj["limit"].eoo() )
                 return runNoDirectClient( dbname , cmdObj , x, errmsg , result, y );
 
             string ns = dbname + '.' + cmdObj.firstElement().valuestr();
@@ -16,13 +16,220 @@
 */
 
 #include "pch.h"
+#include <pcrecpp.h>
 #include "../commands.h"
 #include "../instance.h"
 #include "../../scripting/engine.h"
 #include "../clientcursor.h"
+#include "../interrupt_status_mongod.h"
+#include "../pipeline/accumulator.h"
+#include "../pipeline/document.h"
+#include "../pipeline/document_source.h"
+#include "../pipeline/expression.h"
+#include "../pipeline/expression_context.h"
 
 namespace mongo {
 
+    // the statements of a reduce function GroupReduce can do natively, on prev.field
+    static const pcrecpp::RE reduceFunction( "\\s*function\\s*\\w*\\s*\\(\\s*(\\w+)\\s*,\\s*(\\w+)\\s*\\)\\s*\\{(.*)\\}\\s*;?\\s*" ,
+                                             pcrecpp::RE_Options().set_dotall( true ) );
+    static const pcrecpp::RE reduceIncrement( "(\\w+)\\.(\\w+)\\s*\\+\\+|\\+\\+\\s*(\\w+)\\.(\\w+)" );
+    static const pcrecpp::RE reduceAddNumber( "(\\w+)\\.(\\w+)\\s*\\+=\\s*([0-9]+(?:\\.[0-9]+)?)" );
+    static const pcrecpp::RE reduceAddField( "(\\w+)\\.(\\w+)\\s*\\+=\\s*(\\w+)\\.(\\w+)" );
+    static const pcrecpp::RE reduceSetNumber( "(\\w+)\\.(\\w+)\\s*=\\s*(\\w+)\\.(\\w+)\\s*\\+\\s*([0-9]+(?:\\.[0-9]+)?)" );
+    static const pcrecpp::RE reduceSetField( "(\\w+)\\.(\\w+)\\s*=\\s*(\\w+)\\.(\\w+)\\s*\\+\\s*(\\w+)\\.(\\w+)" );
+
+    /**
+     * A group's reduce, done with Accumulators rather than JavaScript when it doesn't need any:
+     * each output field is accumulated over the group's documents, as a $group field is.
+     *
+     * A $reduce given as an object of { field : { $op : operand } } asks for that directly.  The
+     * commonest reduce functions, which only count or add fields of the document to fields of
+     * initial, amount to $sums; those are recognized, and give what the function would, which
+     * means going back to the function if a document's field isn't a number.
+     */
+    class GroupReduce {
+    public:
+        GroupReduce() : _ctx( ExpressionContext::create( &InterruptStatusMongod::status ) ),
+            _fromFunction( false ) {
+        }
+
+        /** @return false, with errmsg set, if spec isn't a valid $reduce object */
+        bool initFromSpec( const BSONObj& spec , string& errmsg ) {
+            BSONObjIterator i( spec );
+            while ( i.more() ) {
+                BSONElement e = i.next();
+                if ( e.fieldName()[0] == '$' ) {
+                    errmsg = str::stream() << "$reduce field can't be an operator name: " << e.fieldName();
+                    return false;
+                }
+
+                DocumentSourceGroup::AccumulatorFactory factory;
+                intrusive_ptr<Expression> operand;
+                DocumentSourceGroup::parseAccumulator( e.fieldName() , &e , &factory , &operand );
+                add( e.fieldName() , factory , operand );
+            }
+            return true;
+        }
+
+        /** @return false if code isn't a reduce function this can do */
+        bool initFromFunction( const string& code , const BSONObj& initial ) {
+            string obj, prev, body;
+            if ( ! reduceFunction.FullMatch( code , &obj , &prev , &body ) || obj == prev )
+                return false;
+
+            _fromFunction = true;
+            size_t start = 0;
+            while ( start <= body.size() ) {
+                size_t end = body.find_first_of( ";\n" , start );
+                if ( end == string::npos )
+                    end = body.size();
+                string statement = body.substr( start , end - start );
+                start = end + 1;
+
+                size_t first = statement.find_first_not_of( " \t\r" );
+                if ( first == string::npos )
+                    continue;
+                statement = statement.substr( first , statement.find_last_not_of( " \t\r" ) + 1 - first );
+
+                string p1, f1, p2, f2, o, g, number;
+                intrusive_ptr<Expression> operand;
+                if ( reduceIncrement.FullMatch( statement , &p1 , &f1 , &p2 , &f2 ) ) {
+                    if ( p1.empty() ) {
+                        p1 = p2;
+                        f1 = f2;
+                    }
+                    operand = ExpressionConstant::create( Value::createDouble( 1 ) );
+                }
+                else if ( reduceAddNumber.FullMatch( statement , &p1 , &f1 , &number ) ) {
+                    operand = ExpressionConstant::create( Value::createDouble( atof( number.c_str() ) ) );
+                }
+                else if ( reduceAddField.FullMatch( statement , &p1 , &f1 , &o , &g ) ) {
+                    if ( o != obj )
+                        return false;
+                    operand = ExpressionFieldPath::create( g );
+                }
+                else if ( reduceSetNumber.FullMatch( statement , &p1 , &f1 , &p2 , &f2 , &number ) ) {
+                    if ( p2 != p1 || f2 != f1 )
+                        return false;
+                    operand = ExpressionConstant::create( Value::createDouble( atof( number.c_str() ) ) );
+                }
+                else if ( reduceSetField.FullMatch( statement , &p1 , &f1 , &p2 , &f2 , &o , &g ) ) {
+                    if ( p2 != p1 || f2 != f1 || o != obj )
+                        return false;
+                    operand = ExpressionFieldPath::create( g );
+                }
+                else {
+                    return false;
+                }
+
+                // it has to add to a number in initial, once
+                if ( p1 != prev || ! initial[ f1 ].isNumber() ||
+                     find( _names.begin() , _names.end() , f1 ) != _names.end() )
+                    return false;
+
+                if ( ! g.empty() && find( _fields.begin() , _fields.end() , g ) == _fields.end() )
+                    _fields.push_back( g );
+                add( f1 , AccumulatorSum::create , operand );
+            }
+            return ! _names.empty();
+        }
+
+        /** @return false if obj needs the reduce function run on it after all */
+        bool canAccumulate( const BSONObj& obj ) const {
+            for ( unsigned i = 0; i < _fields.size(); i++ ) {
+                if ( ! obj[ _fields[i] ].isNumber() )
+                    return false;
+            }
+            return true;
+        }
+
+        typedef vector< intrusive_ptr<Accumulator> > Accumulators;
+
+        /** a new group's accumulators */
+        void create( Accumulators* accumulators ) const {
+            for ( unsigned i = 0; i < _names.size(); i++ ) {
+                intrusive_ptr<Accumulator> a( (*_factories[i])( _ctx ) );
+                a->addOperand( _operands[i] );
+                accumulators->push_back( a );
+            }
+        }
+
+        void accumulate( const BSONObj& obj , const Accumulators& accumulators ) const {
+            BSONObj o = obj;
+            intrusive_ptr<Document> doc( Document::createFromBsonObj( &o , _fromFunction ? &_fields : 0 ) );
+            for ( unsigned i = 0; i < accumulators.size(); i++ )
+                accumulators[i]->evaluate( doc );
+        }
+
+        /**
+         * a group's output, laid out as the JavaScript lays it out:  the key's fields, then
+         * initial's, with the accumulated values in place of those they replace
+         */
+        BSONObj output( const BSONObj& key , const BSONObj& initial , const Accumulators& accumulators ) const {
+            BSONObjBuilder b;
+            BSONObjIterator k( key );
+            while ( k.more() ) {
+                BSONElement e = k.next();
+                BSONElement i = initial[ e.fieldName() ];
+                if ( ! appendResult( b , e.fieldName() , i , accumulators ) )
+                    b.append( i.eoo() ? e : i );
+            }
+
+            BSONObjIterator i( initial );
+            while ( i.more() ) {
+                BSONElement e = i.next();
+                if ( key.hasField( e.fieldName() ) )
+                    continue;
+                if ( ! appendResult( b , e.fieldName() , e , accumulators ) )
+                    b.append( e );
+            }
+
+            for ( unsigned n = 0; n < _names.size(); n++ ) {
+                if ( ! key.hasField( _names[n].c_str() ) && ! initial.hasField( _names[n].c_str() ) )
+                    accumulators[n]->getValue()->addToBsonObj( &b , _names[n] );
+            }
+            return b.obj();
+        }
+
+    private:
+        void add( const string& name , DocumentSourceGroup::AccumulatorFactory factory ,
+                  const intrusive_ptr<Expression>& operand ) {
+            _names.push_back( name );
+            _factories.push_back( factory );
+            _operands.push_back( operand );
+        }
+
+        /** @return false if name isn't accumulated */
+        bool appendResult( BSONObjBuilder& b , const string& name , const BSONElement& initial ,
+                           const Accumulators& accumulators ) const {
+            vector<string>::const_iterator i = find( _names.begin() , _names.end() , name );
+            if ( i == _names.end() )
+                return false;
+            intrusive_ptr<const Value> value = accumulators[ i - _names.begin() ]->getValue();
+
+            if ( ! _fromFunction ) {
+                value->addToBsonObj( &b , name );
+                return true;
+            }
+
+            // a JavaScript number, which is only an int if it was one to begin with
+            double total = initial.number() + value->coerceToDouble();
+            if ( initial.type() == NumberInt && (int)total == total )
+                b.append( name , (int)total );
+            else
+                b.append( name , total );
+            return true;
+        }
+
+        intrusive_ptr<ExpressionContext> _ctx;
+        vector<string> _names;
+        vector<DocumentSourceGroup::AccumulatorFactory> _factories;
+        vector< intrusive_ptr<Expression> > _operands;
+        bool _fromFunction;
+        vector<string> _fields; // of the documents, for a function's $sums
+    };
+
     class GroupCommand : public Command {
     public:
         GroupCommand() : Command("group") {}
@@ -47,6 +254,107 @@ namespace mongo {
             return obj.extractFields( keyPattern , true ).getOwned();
         }
 
+        /**
+         * group with the reduce done natively.
+         * @return false, with nothing written to result, if a document needs the reduce function
+         */
+        bool groupNative( string realdbname , const string& ns , const BSONObj& query ,
+                          BSONObj keyPattern , string keyFunctionCode , const GroupReduce& reduce ,
+                          BSONObj initial , string finalize ,
+                          BSONObjBuilder& result ) {
+
+            // JavaScript is only used for the key and finalize functions
+            auto_ptr<Scope> s;
+            if ( keyFunctionCode.size() || finalize.size() ) {
+                s = globalScriptEngine->getPooledScope( realdbname );
+                s->localConnect( realdbname.c_str() );
+            }
+
+            ScriptingFunction keyFunction = 0;
+            if ( keyFunctionCode.size() ) {
+                keyFunction = s->createFunction( keyFunctionCode.c_str() );
+            }
+
+            map<BSONObj,int,BSONObjCmp> groupIndex;
+            vector<BSONObj> keys;
+            vector<GroupReduce::Accumulators> groups;
+            long long count = 0;
+
+            shared_ptr<Cursor> cursor = NamespaceDetailsTransient::getCursor(ns.c_str() , query);
+            ClientCursor::Holder ccPointer( new ClientCursor( QueryOption_NoCursorTimeout, cursor,
+                                                             ns ) );
+
+            while ( cursor->ok() ) {
+
+                if ( !ccPointer->yieldSometimes( ClientCursor::MaybeCovered ) ||
+                    !cursor->ok() ) {
+                    break;
+                }
+
+                if ( !cursor->currentMatches() || cursor->getsetdup( cursor->currLoc() ) ) {
+                    cursor->advance();
+                    continue;
+                }
+
+                if ( !ccPointer->yieldSometimes( ClientCursor::WillNeed ) ||
+                    !cursor->ok() ) {
+                    break;
+                }
+
+                BSONObj obj = cursor->current();
+                cursor->advance();
+
+                if ( ! reduce.canAccumulate( obj ) )
+                    return false;
+
+                BSONObj key = getKey( obj , keyPattern , keyFunction , 0 , s.get() );
+                count++;
+
+                int& n = groupIndex[key];
+                if ( n == 0 ) {
+                    n = groupIndex.size();
+                    uassert( 16444 ,  "group() can't handle more than 20000 unique keys" , n <= 20000 );
+
+                    keys.push_back( key );
+                    groups.push_back( GroupReduce::Accumulators() );
+                    reduce.create( &groups.back() );
+                }
+
+                reduce.accumulate( obj , groups[ n - 1 ] );
+            }
+            ccPointer.reset();
+
+            ScriptingFunction f = 0;
+            if ( finalize.size() ) {
+                s->exec( "$finalize = " + finalize , "finalize define" , false , true , true , 100 );
+                f = s->createFunction(
+                        "function(){ "
+                        "  var ret = $finalize($out); "
+                        "  if (ret !== undefined) "
+                        "    $out = ret; "
+                        "}" );
+            }
+
+            BSONArrayBuilder retval( result.subarrayStart( "retval" ) );
+            for ( unsigned i = 0; i < groups.size(); i++ ) {
+                BSONObj out = reduce.output( keys[i] , initial , groups[i] );
+                if ( f ) {
+                    s->setObject( "$out" , out , false );
+                    s->invoke( f , 0, 0 , 0 , true );
+                    out = s->getObject( "$out" );
+                }
+                retval.append( out );
+            }
+            retval.done();
+
+            result.append( "count" , (double)count );
+            result.append( "keys" , (int)(groups.size()) );
+            if ( s.get() )
+                s->gc();
+
+            return true;
+        }
+
         bool group( string realdbname , const string& ns , const BSONObj& query ,
                     BSONObj keyPattern , string keyFunctionCode , string reduceCode , const char * reduceScope ,
                     BSONObj initial , string finalize ,
@@ -155,11 +463,6 @@ namespace mongo {
 
         bool run(const string& dbname, BSONObj& jsobj, int, string& errmsg, BSONObjBuilder& result, bool fromRepl ) {
 
-            if ( !globalScriptEngine ) {
-                errmsg = "server-side JavaScript execution is disabled";
-                return false;
-            }
-            
             /* db.$cmd.findOne( { group : <p> } ) */
             const BSONObj& p = jsobj.firstElement().embeddedObjectUserCheck();
 
@@ -200,8 +503,11 @@ namespace mongo {
                 return false;
             }
 
-            BSONElement initial = p["initial"];
-            if ( initial.type() != Object ) {
+            // a $reduce object of accumulators needs no initial
+            BSONObj initial;
+            if ( p["initial"].type() == Object )
+                initial = p["initial"].embeddedObject();
+            else if ( ! p["initial"].eoo() || reduce.type() != Object ) {
                 errmsg = "initial has to be an object";
                 return false;
             }
@@ -211,9 +517,35 @@ namespace mongo {
             if (p["finalize"].type())
                 finalize = p["finalize"]._asCode();
 
+            GroupReduce native;
+            bool isNative;
+            if ( reduce.type() == Object ) {
+                if ( ! native.initFromSpec( reduce.embeddedObject() , errmsg ) )
+                    return false;
+                isNative = true;
+            }
+            else {
+                isNative = native.initFromFunction( reduce._asCode() , initial );
+            }
+
+            if ( !globalScriptEngine && ( !isNative || keyf.size() || finalize.size() ) ) {
+                errmsg = "server-side JavaScript execution is disabled";
+                return false;
+            }
+
+            if ( isNative && groupNative( dbname , ns , q , key , keyf , native , initial , finalize , result ) )
+                return true;
+
+            // a $reduce object always gets done natively
+            verify( reduce.type() != Object );
+            if ( !globalScriptEngine ) {
+                errmsg = "server-side JavaScript execution is disabled";
+                return false;
+            }
+
             return group( dbname , ns , q ,
                           key , keyf , reduce._asCode() , reduce.type() != CodeWScope ? 0 : reduce.codeWScopeScopeDataUnsafe() ,
-                          initial.embeddedObject() , finalize ,
+                          initial , finalize ,
                           errmsg , result );
         }
 
@@ -16,6 +16,9 @@
  */
 
 #include "pch.h"
+
+#include <boost/thread/thread.hpp>
+
 #include "../db.h"
 #include "../instance.h"
 #include "../commands.h"
@@ -25,6 +28,11 @@
 #include "../matcher.h"
 #include "../clientcursor.h"
 #include "../replutil.h"
+#include "../extsort.h"
+#include "../interrupt_status_mongod.h"
+#include "../pipeline/accumulator.h"
+#include "../pipeline/document.h"
+#include "../pipeline/expression_context.h"
 #include "../../s/d_chunk_manager.h"
 #include "../../s/d_logic.h"
 #include "../../s/grid.h"
@@ -33,6 +41,9 @@
 
 namespace mongo {
 
+    // threads the map phase of a job is spread over (setParameter mapReduceThreads)
+    int mapReduceThreads = 1;
+
     namespace mr {
 
         AtomicUInt Config::JOB_NUMBER;
@@ -214,6 +225,125 @@ namespace mongo {
             _reduce( x , key , endSizeEstimate );
         }
 
+        NativeReducer::NativeReducer( const BSONObj& spec ) {
+            BSONObjIterator i( spec );
+            while ( i.more() ) {
+                BSONElement e = i.next();
+                if ( e.fieldName()[0] == '$' ) {
+                    uassert( 16372 , "a reduce accumulating the whole value can have just the one operator" , spec.nFields() == 1 );
+                    _fields.push_back( _parseField( "" , e ) );
+                }
+                else {
+                    uassert( 16372 , str::stream() << "reduce field " << e.fieldName() << " must be an object with one operator" ,
+                             e.type() == Object && e.embeddedObject().nFields() == 1 );
+                    _fields.push_back( _parseField( e.fieldName() , e.embeddedObject().firstElement() ) );
+                }
+            }
+            uassert( 16372 , "empty reduce" , ! _fields.empty() );
+        }
+
+        NativeReducer::Field NativeReducer::_parseField( const string& name , const BSONElement& e ) {
+            Field f;
+            f.name = name;
+            f.op = e.fieldName();
+            uassert( 16373 , str::stream() << "unsupported reduce operator " << f.op ,
+                     f.op == "$sum" || f.op == "$min" || f.op == "$max" || f.op == "$addToSet" || f.op == "$push" );
+
+            string path = e.type() == String ? e.String() : "";
+            uassert( 16374 , str::stream() << f.op << " takes \"value\" or a \"value.\" path" ,
+                     path == "value" || str::startsWith( path , "value." ) );
+            f.path = path.substr( 5 );
+            if ( ! f.path.empty() )
+                f.path = f.path.substr( 1 );
+            return f;
+        }
+
+        BSONObj NativeReducer::reduce( const BSONList& tuples ) {
+            if (tuples.size() <= 1)
+                return tuples[0];
+            BSONObjBuilder b;
+            b.appendAs( tuples[0].firstElement() , "0" );
+            _reduce( tuples , b , "1" );
+            return b.obj();
+        }
+
+        BSONObj NativeReducer::finalReduce( const BSONList& tuples , Finalizer * finalizer ) {
+            BSONObjBuilder b;
+            b.appendAs( tuples[0].firstElement() , "_id" );
+            if ( tuples.size() == 1 ) {
+                BSONObjIterator it( tuples[0] );
+                it.next();
+                b.appendAs( it.next() , "value" );
+            }
+            else {
+                _reduce( tuples , b , "value" );
+            }
+            BSONObj res = b.obj();
+
+            if ( finalizer )
+                res = finalizer->finalize( res );
+            return res;
+        }
+
+        void NativeReducer::_reduce( const BSONList& tuples , BSONObjBuilder& b , const char * fieldName ) {
+            // $addToSet and $push take arrays apart as they do when merging shards' results
+            intrusive_ptr<ExpressionContext> ctx( ExpressionContext::create( &InterruptStatusMongod::status ) );
+            ctx->setInRouter( true );
+
+            scoped_ptr<BSONObjBuilder> sub;
+            if ( ! _fields[0].name.empty() )
+                sub.reset( new BSONObjBuilder( b.subobjStart( fieldName ) ) );
+
+            for ( unsigned f = 0; f < _fields.size(); f++ ) {
+                const Field& field = _fields[f];
+                intrusive_ptr<Accumulator> acc;
+                if ( field.op == "$sum" )
+                    acc = AccumulatorSum::create( ctx );
+                else if ( field.op == "$min" )
+                    acc = AccumulatorMinMax::createMin( ctx );
+                else if ( field.op == "$max" )
+                    acc = AccumulatorMinMax::createMax( ctx );
+                else if ( field.op == "$addToSet" )
+                    acc = AccumulatorAddToSet::create( ctx );
+                else
+                    acc = AccumulatorPush::create( ctx );
+                acc->addOperand( ExpressionFieldPath::create( "v" ) );
+
+                unsigned n = 0;
+                for ( BSONList::const_iterator i = tuples.begin(); i != tuples.end(); ++i ) {
+                    BSONObjIterator it( *i );
+                    it.next();
+                    BSONElement v = it.next();
+                    if ( ! field.path.empty() )
+                        v = v.type() == Object ? v.embeddedObject().getFieldDotted( field.path ) : BSONElement();
+                    if ( v.eoo() )
+                        continue;
+
+                    if ( field.op == "$sum" )
+                        uassert( 16375 , str::stream() << "$sum of a non-number: " << v , v.isNumber() );
+                    else if ( field.op == "$addToSet" || field.op == "$push" )
+                        uassert( 16376 , str::stream() << field.op << " needs arrays to be emitted, not " << v , v.type() == Array );
+
+                    BSONObjBuilder d;
+                    d.appendAs( v , "v" );
+                    BSONObj o = d.obj();
+                    acc->evaluate( Document::createFromBsonObj( &o ) );
+                    n++;
+                }
+
+                const string name = sub ? field.name : string( fieldName );
+                BSONObjBuilder& out = sub ? *sub : b;
+                if ( n )
+                    acc->getValue()->addToBsonObj( &out , name );
+                else if ( ! sub )
+                    out.appendNull( name );
+            }
+
+            if ( sub )
+                sub->done();
+            ++numReduces;
+        }
+
         Config::Config( const string& _dbname , const BSONObj& cmdObj ) :
             outNonAtomic(false)
         {
@@ -285,8 +415,6 @@ namespace mongo {
             if ( outType != INMEMORY ) { // setup names
                 tempLong = str::stream() << (outDB.empty() ? dbname : outDB) << ".tmp.mr." << cmdObj.firstElement().String() << "_" << JOB_NUMBER++;
 
-                incLong = tempLong + "_inc";
-
                 finalLong = str::stream() << (outDB.empty() ? dbname : outDB) << "." << finalShort;
             }
 
@@ -297,7 +425,14 @@ namespace mongo {
                     scopeSetup = cmdObj["scope"].embeddedObjectUserCheck();
 
                 mapper.reset( new JSMapper( cmdObj["map"] ) );
-                reducer.reset( new JSReducer( cmdObj["reduce"] ) );
+                if ( cmdObj["reduce"].type() == Object ) {
+                    reducer.reset( new NativeReducer( cmdObj["reduce"].embeddedObject() ) );
+                    // js mode reduces in the scope, which a native reduce has no code for
+                    jsMode = false;
+                }
+                else {
+                    reducer.reset( new JSReducer( cmdObj["reduce"] ) );
+                }
                 if ( cmdObj["finalize"].type() && cmdObj["finalize"].trueValue() )
                     finalizer.reset( new JSFinalizer( cmdObj["finalize"] ) );
 
@@ -336,21 +471,6 @@ namespace mongo {
             if ( ! _onDisk )
                 return;
 
-            if (_config.incLong != _config.tempLong) {
-                // create the inc collection and make sure we have index on "0" key
-                _db.dropCollection( _config.incLong );
-                {
-                    Client::WriteContext ctx( _config.incLong );
-                    string err;
-                    if ( ! userCreateNS( _config.incLong.c_str() , BSON( "autoIndexId" << 0 << "temp" << true ) , err , false ) ) {
-                        uasserted( 13631 , str::stream() << "userCreateNS failed for mr incLong ns: " << _config.incLong << " err: " << err );
-                    }
-                }
-
-                BSONObj sortKey = BSON( "0" << 1 );
-                _db.ensureIndex( _config.incLong , sortKey );
-            }
-
             // create temp collection
             _db.dropCollection( _config.tempLong );
             {
@@ -548,15 +668,23 @@ namespace mongo {
         }
 
         /**
-         * Insert doc into the inc collection
+         * Spill a tuple to disk, to be merged back in key order by the final reduce.  The run
+         * files aren't journaled: a job doesn't survive a restart anyway.
          */
-        void State::_insertToInc( BSONObj& o ) {
+        void State::_insertToInc( const BSONObj& o ) {
             verify( _onDisk );
-            theDataFileMgr.insertWithObjMod( _config.incLong.c_str() , o , true );
-            getDur().commitIfNeeded();
+            if ( ! _spill ) {
+                // runs are kept to a few MB, rather than what an index build would use, as the
+                // point of spilling is to bound the job's memory
+                _spill.reset( new BSONObjExternalSorter( *IndexDetails::iis[1] , BSON( "0" << 1 ) , 16 * 1024 * 1024 ) );
+                _spill->hintNumObjects( 100000 );
+            }
+            _spill->add( o , DiskLoc() );
+            _numSpilled++;
         }
 
-        State::State( const Config& c ) : _config( c ), _size(0), _dupCount(0), _numEmits(0) {
+        State::State( const Config& c , bool worker ) :
+            _config( c ), _worker( worker ), _size(0), _sizeCharge( MemAccounting::MapReduce ), _dupCount(0), _numSpilled(0), _numEmits(0) {
             _temp.reset( new InMemory() );
             _onDisk = _config.outType != Config::INMEMORY;
         }
@@ -570,10 +698,9 @@ namespace mongo {
         }
 
         State::~State() {
-            if ( _onDisk ) {
+            if ( _onDisk && ! _worker ) {
                 try {
                     _db.dropCollection( _config.tempLong );
-                    _db.dropCollection( _config.incLong );
                 }
                 catch ( std::exception& e ) {
                     error() << "couldn't cleanup after map reduce: " << e.what() << endl;
@@ -588,7 +715,7 @@ namespace mongo {
         }
 
         /**
-         * Initialize the mapreduce operation, creating the inc collection
+         * Initialize the mapreduce operation
          */
         void State::init() {
             // setup js
@@ -717,90 +844,53 @@ namespace mongo {
                 return;
             }
 
-            // use index on "0" to pull sorted data
+            // merge the sorted runs of each spill, and the spills with each other, in key order
             verify( _temp->size() == 0 );
-            BSONObj sortKey = BSON( "0" << 1 );
-            {
-                bool foundIndex = false;
-
-                auto_ptr<DBClientCursor> idx = _db.getIndexes( _config.incLong );
-                while ( idx.get() && idx->more() ) {
-                    BSONObj x = idx->next();
-                    if ( sortKey.woCompare( x["key"].embeddedObject() ) == 0 ) {
-                        foundIndex = true;
-                        break;
-                    }
-                }
-
-                verify( foundIndex );
+            vector< shared_ptr<BSONObjExternalSorter> > spills( _workerSpills );
+            if ( _spill )
+                spills.push_back( _spill );
+
+            vector< shared_ptr<BSONObjExternalSorter::Iterator> > its;
+            vector<BSONObj> heads; // the next tuple of each spill; empty once it has run out
+            for ( unsigned i = 0; i < spills.size(); i++ ) {
+                spills[i]->sort();
+                its.push_back( shared_ptr<BSONObjExternalSorter::Iterator>( spills[i]->iterator().release() ) );
+                heads.push_back( its[i]->more() ? its[i]->next().first : BSONObj() );
             }
 
-            Client::ReadContext ctx( _config.incLong );
-
-            BSONObj prev;
             BSONList all;
 
-            verify( pm == op->setMessage( "m/r: (3/3) final reduce to collection" , _db.count( _config.incLong, BSONObj(), QueryOption_SlaveOk ) ) );
+            verify( pm == op->setMessage( "m/r: (3/3) final reduce to collection" , _numSpilled ) );
 
-            shared_ptr<Cursor> temp =
-            NamespaceDetailsTransient::bestGuessCursor( _config.incLong.c_str() , BSONObj() ,
-                                                       sortKey );
-            auto_ptr<ClientCursor> cursor( new ClientCursor( QueryOption_NoCursorTimeout , temp , _config.incLong.c_str() ) );
+            while ( 1 ) {
+                int least = -1;
+                for ( unsigned i = 0; i < heads.size(); i++ ) {
+                    if ( heads[i].isEmpty() )
+                        continue;
+                    if ( least < 0 || heads[i].woCompare( heads[least] , BSONObj() , false ) < 0 )
+                        least = i;
+                }
+                if ( least < 0 )
+                    break;
 
-            // iterate over all sorted objects
-            while ( cursor->ok() ) {
-                BSONObj o = cursor->current().getOwned();
-                cursor->advance();
+                BSONObj o = heads[least];
+                heads[least] = its[least]->more() ? its[least]->next().first : BSONObj();
 
                 pm.hit();
 
-                if ( o.woSortOrder( prev , sortKey ) == 0 ) {
-                    // object is same as previous, add to array
-                    all.push_back( o );
-                    if ( pm->hits() % 1000 == 0 ) {
-                        if ( ! cursor->yield() ) {
-                            cursor.release();
-                            break;
-                        }
-                        killCurrentOp.checkForInterrupt();
-                    }
-                    continue;
-                }
-
-                ClientCursor::YieldLock yield (cursor.get());
-
-                try {
-                    // reduce a finalize array
+                if ( ! all.empty() && o.firstElement().woCompare( all[0].firstElement() , false ) != 0 ) {
+                    // reduce and finalize the tuples of the previous key
                     finalReduce( all );
+                    all.clear();
                 }
-                catch (...) {
-                    yield.relock();
-                    cursor.release();
-                    throw;
-                }
-
-                all.clear();
-                prev = o;
                 all.push_back( o );
 
-                if ( ! yield.stillOk() ) {
-                    cursor.release();
-                    break;
-                }
-
-                killCurrentOp.checkForInterrupt();
+                if ( pm->hits() % 1000 == 0 )
+                    killCurrentOp.checkForInterrupt();
             }
-            
-            // we need to release here since we temp release below
-            cursor.release();
 
-            {
-                dbtempreleasecond tl;
-                if ( ! tl.unlocked() )
-                    log( LL_WARNING ) << "map/reduce can't temp release" << endl;
-                // reduce and finalize last array
-                finalReduce( all );
-            }
+            // reduce and finalize last array
+            finalReduce( all );
 
             pm.finished();
         }
@@ -808,7 +898,7 @@ namespace mongo {
         /**
          * Attempts to reduce objects in the memory map.
          * A new memory map will be created to hold the results.
-         * If applicable, objects with unique key may be dumped to inc collection.
+         * If applicable, objects with unique key may be spilled to disk.
          * Input and output objects are both {"0": key, "1": val}
          */
         void State::reduceInMemory() {
@@ -829,8 +919,7 @@ namespace mongo {
                 if ( all.size() == 1 ) {
                     // only 1 value for this key
                     if ( _onDisk ) {
-                        // this key has low cardinality, so just write to collection
-                        Client::WriteContext ctx(_config.incLong.c_str());
+                        // this key has low cardinality, so just spill it
                         _insertToInc( *(all.begin()) );
                     }
                     else {
@@ -851,15 +940,12 @@ namespace mongo {
         }
 
         /**
-         * Dumps the entire in memory map to the inc collection.
+         * Spills the entire in memory map to disk.
          */
         void State::dumpToInc() {
             if ( ! _onDisk )
                 return;
 
-            Lock::DBWrite kl(_config.incLong);
-            Client::Context ctx(_config.incLong);
-
             for ( InMemory::iterator i=_temp->begin(); i!=_temp->end(); i++ ) {
                 BSONList& all = i->second;
                 if ( all.size() < 1 )
@@ -873,6 +959,30 @@ namespace mongo {
 
         }
 
+        void State::mergeInMemory( State& worker ) {
+            verify( ! _jsMode && ! worker._jsMode );
+
+            for ( InMemory::iterator i=worker._temp->begin(); i!=worker._temp->end(); ++i ) {
+                BSONList& all = i->second;
+                for ( BSONList::iterator j=all.begin(); j!=all.end(); ++j )
+                    _add( _temp.get() , *j , _size );
+            }
+            worker._temp->clear();
+            worker._size = 0;
+            worker._sizeCharge.set( 0 );
+            _sizeCharge.set( _size );
+
+            if ( worker._spill ) {
+                _workerSpills.push_back( worker._spill );
+                worker._spill.reset();
+            }
+            _numSpilled += worker._numSpilled;
+            worker._numSpilled = 0;
+
+            _numEmits += worker._numEmits;
+            _config.reducer->numReduces += worker._config.reducer->numReduces;
+        }
+
         /**
          * Adds object to in memory map
          */
@@ -893,6 +1003,7 @@ namespace mongo {
          * this method checks the size of in memory map and potentially flushes to disk
          */
         void State::checkSize() {
+            _sizeCharge.set( _size );
             if (_jsMode) {
                 // try to reduce if it is beneficial
                 int dupCt = _scope->getNumberInt("_dupCt");
@@ -925,8 +1036,9 @@ namespace mongo {
                 // if size is still high, or values are not reducing well, dump
                 if ( _onDisk && (_size > _config.maxInMemSize || _size > oldSize / 2) ) {
                     dumpToInc();
-                    log(1) << "  MR - dumping to db" << endl;
+                    log(1) << "  MR - dumping to disk" << endl;
                 }
+                _sizeCharge.set( _size );
             }
         }
 
@@ -966,6 +1078,184 @@ namespace mongo {
             return BSONObj();
         }
 
+        /** the extents a parallel map phase's threads share */
+        struct ParallelMap {
+            ParallelMap( const string& db , const BSONObj& c , State& s ) :
+                m( "ParallelMap" ), dbname( db ), cmd( c ), state( s ),
+                op( 0 ), errCode( 0 ), num( 0 ), mapTime( 0 ) { }
+            mongo::mutex m;
+            const string dbname;
+            const BSONObj cmd;
+            State& state;                   // the job's own; the threads merge into it (protected by m)
+            ShardChunkManagerPtr chunkManager;
+            CurOp* op;                      // the job's, checked for a killOp
+            map<string,bool> auth;          // dbs the job's client may use, and if it may write them
+            list<DiskLoc> extents;          // not yet mapped (protected by m)
+            string errmsg;                  // the first failure; once set the threads stop (protected by m)
+            int errCode;
+            long long num;                  // documents mapped (protected by m)
+            long long mapTime;              // micros spent in the map function (protected by m)
+        };
+
+        class InExtent : public AdvanceStrategy {
+            virtual DiskLoc next( const DiskLoc &prev ) const {
+                return prev.rec()->nextInExtent( prev );
+            }
+        } inExtent;
+
+        /**
+         * @return the extents to spread the map phase over, or none if it's better run on one
+         * thread: only a plain scan of a collection can be split up, and the job's sort or limit
+         * would need the documents in order.
+         */
+        static list<DiskLoc> parallelMapExtents( const Config& config ) {
+            list<DiskLoc> extents;
+            if ( mapReduceThreads <= 1 || config.jsMode || ! config.sort.isEmpty() || config.limit )
+                return extents;
+
+            Client::ReadContext ctx( config.ns );
+            NamespaceDetails *d = nsdetails( config.ns.c_str() );
+            if ( ! d || d->isCapped() )
+                return extents;
+
+            // with an index to use, scanning everything is no faster for being split up
+            shared_ptr<Cursor> c = NamespaceDetailsTransient::getCursor( config.ns.c_str() , config.filter , BSONObj() );
+            if ( ! c || ! c->indexKeyPattern().isEmpty() )
+                return extents;
+
+            for ( DiskLoc e = d->firstExtent; ! e.isNull(); e = e.ext()->xnext )
+                extents.push_back( e );
+            if ( extents.size() < 2 )
+                extents.clear();
+            return extents;
+        }
+
+        /**
+         * maps the documents of one extent into state.
+         * @return false if the collection went away while yielding
+         */
+        static bool mapExtent( ParallelMap* pm , State& state , const DiskLoc& extent ,
+                               shared_ptr<CoveredIndexMatcher> matcher ,
+                               long long& num , long long& mapTime ) {
+            const Config& config = state.config();
+            Lock::DBRead lock( config.ns );
+            // no version check, as for the single threaded map: the job holds a cursor open
+            Client::Context ctx( config.ns, dbpath, true, false );
+
+            // the collection may have been dropped or compacted since the extents were listed
+            NamespaceDetails *d = nsdetails( config.ns.c_str() );
+            if ( ! d )
+                return false;
+            DiskLoc e = d->firstExtent;
+            while ( ! e.isNull() && e != extent )
+                e = e.ext()->xnext;
+            if ( e.isNull() )
+                return false;
+
+            shared_ptr<Cursor> temp( new BasicCursor( extent.ext()->firstRecord , &inExtent ) );
+            temp->setMatcher( matcher );
+            auto_ptr<ClientCursor> cursor( new ClientCursor( QueryOption_NoCursorTimeout , temp , config.ns.c_str() ) );
+
+            Timer mt;
+            while ( cursor->ok() ) {
+                if ( ! cursor->currentMatches() ) {
+                    cursor->advance();
+                    continue;
+                }
+
+                BSONObj o = cursor->current();
+                cursor->advance();
+
+                if ( pm->chunkManager && ! pm->chunkManager->belongsToMe( o ) )
+                    continue;
+
+                if ( config.verbose ) mt.reset();
+                config.mapper->map( o );
+                if ( config.verbose ) mapTime += mt.micros();
+
+                num++;
+                if ( num % 1000 == 0 ) {
+                    ClientCursor::YieldLock yield (cursor.get());
+                    state.checkSize();
+
+                    if ( ! yield.stillOk() ) {
+                        cursor.release();
+                        return false;
+                    }
+
+                    killCurrentOp.checkForInterrupt();
+                    uassert( 11601 , "operation was interrupted" , ! pm->op->killed() );
+                }
+            }
+            return true;
+        }
+
+        /** maps extents taken from pm until there are none left, with a js scope of its own */
+        static void mapExtents( ParallelMap* pm ) {
+            Client::initThread( "mr map" );
+            AuthenticationInfo *ai = cc().getAuthenticationInfo();
+            for ( map<string,bool>::const_iterator i = pm->auth.begin(); i != pm->auth.end(); ++i ) {
+                if ( i->second )
+                    ai->authorize( i->first , "_mr" );
+                else
+                    ai->authorizeReadOnly( i->first , "_mr" );
+            }
+
+            string errmsg;
+            int errCode = 0;
+            try {
+                // the functions are compiled into this thread's scope, so need a config of their
+                // own; the results go to the job's collections
+                Config config( pm->dbname , pm->cmd );
+                config.tempLong = pm->state.config().tempLong;
+                config.finalLong = pm->state.config().finalLong;
+
+                State state( config , true );
+                state.init();
+
+                shared_ptr<CoveredIndexMatcher> matcher( new CoveredIndexMatcher( config.filter , BSONObj() ) );
+                long long num = 0;
+                long long mapTime = 0;
+                bool more = true;
+                while ( more ) {
+                    DiskLoc extent;
+                    {
+                        scoped_lock lk( pm->m );
+                        if ( pm->extents.empty() || ! pm->errmsg.empty() )
+                            break;
+                        extent = pm->extents.front();
+                        pm->extents.pop_front();
+                    }
+                    more = mapExtent( pm , state , extent , matcher , num , mapTime );
+                }
+
+                // reduce what can be before handing it over
+                state.reduceInMemory();
+
+                scoped_lock lk( pm->m );
+                pm->state.mergeInMemory( state );
+                pm->num += num;
+                pm->mapTime += mapTime;
+            }
+            catch ( DBException& e ) {
+                errmsg = e.what();
+                errCode = e.getCode();
+            }
+            catch ( std::exception& e ) {
+                errmsg = e.what();
+            }
+
+            if ( ! errmsg.empty() ) {
+                log() << "mr map thread failed: " << errmsg << endl;
+                scoped_lock lk( pm->m );
+                if ( pm->errmsg.empty() ) {
+                    pm->errmsg = errmsg;
+                    pm->errCode = errCode;
+                }
+            }
+            cc().shutdown();
+        }
+
         /**
          * This class represents a map/reduce command executed on a single server
          */
@@ -1054,7 +1344,39 @@ namespace mongo {
 
                     wassert( config.limit < 0x4000000 ); // see case on next line to 32 bit unsigned
                     long long mapTime = 0;
-                    {
+                    list<DiskLoc> extents = parallelMapExtents( config );
+                    if ( ! extents.empty() ) {
+                        // each thread maps whole extents into a map of its own, which is merged
+                        // into state's to be reduced as usual
+                        ParallelMap par( dbname , cmd , state );
+                        par.chunkManager = chunkManager;
+                        par.op = op;
+                        par.extents = extents;
+                        AuthenticationInfo *ai = client.getAuthenticationInfo();
+                        const string dbs[] = { dbname , config.outDB };
+                        for ( unsigned i = 0; i < 2; i++ ) {
+                            if ( dbs[i].empty() )
+                                continue;
+                            if ( ai->isAuthorized( dbs[i] ) )
+                                par.auth[dbs[i]] = true;
+                            else if ( ai->isAuthorizedReads( dbs[i] ) && ! par.auth.count( dbs[i] ) )
+                                par.auth[dbs[i]] = false;
+                        }
+
+                        size_t n = min( extents.size() , (size_t) mapReduceThreads );
+                        log(1) << "mr: mapping " << extents.size() << " extents of " << config.ns << " on " << n << " threads" << endl;
+                        boost::thread_group threads;
+                        for ( size_t i = 0; i < n; i++ )
+                            threads.create_thread( boost::bind( &mapExtents , &par ) );
+                        threads.join_all();
+
+                        if ( ! par.errmsg.empty() )
+                            uasserted( par.errCode ? par.errCode : 16371 , str::stream() << "parallel map failed: " << par.errmsg );
+                        num = par.num;
+                        mapTime = par.mapTime;
+                        pm.hit( (int) num );
+                    }
+                    else {
                         // We've got a cursor preventing migrations off, now re-establish our useful cursor
 
                         // Need lock and context to use it
@@ -1136,7 +1458,7 @@ namespace mongo {
                     // do reduce in memory
                     // this will be the last reduce needed for inline mode
                     state.reduceInMemory();
-                    // if not inline: dump the in memory map to inc collection, all data is on disk
+                    // if not inline: spill the in memory map, all data is on disk
                     state.dumpToInc();
                     // final reduce
                     state.finalReduce( op , pm );
@@ -1209,9 +1531,6 @@ namespace mongo {
                 State state(config);
                 state.init();
 
-                // no need for incremental collection because records are already sorted
-                config.incLong = config.tempLong;
-
                 BSONObj shardCounts = cmdObj["shardCounts"].embeddedObjectUserCheck();
                 BSONObj counts = cmdObj["counts"].embeddedObjectUserCheck();
 
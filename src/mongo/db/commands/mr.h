@@ -19,8 +19,12 @@
 
 #include "pch.h"
 
+#include "mongo/util/mem_accounting.h"
+
 namespace mongo {
 
+    class BSONObjExternalSorter;
+
     namespace mr {
 
         typedef vector<BSONObj> BSONList;
@@ -120,6 +124,35 @@ namespace mongo {
             JSFunction _func;
         };
 
+        /**
+         * a reduce given as accumulators rather than code, run without calling into js.  either
+         * one accumulator for the whole value, as in { $sum : "value" }, or one per field of it:
+         * { count : { $sum : "value.count" } , tags : { $addToSet : "value.tags" } }.
+         * $sum, $min and $max, and $addToSet and $push of arrays, are supported; as the output of
+         * a reduce may be reduced again, the reduced value must have the shape of those emitted.
+         */
+        class NativeReducer : public Reducer {
+        public:
+            NativeReducer( const BSONObj& spec );
+            virtual void init( State * state ) {}
+
+            virtual BSONObj reduce( const BSONList& tuples );
+            virtual BSONObj finalReduce( const BSONList& tuples , Finalizer * finalizer );
+
+        private:
+            struct Field {
+                string name;    // in the reduced value; empty for the value itself
+                string op;
+                string path;    // within the emitted value; empty for the value itself
+            };
+            static Field _parseField( const string& name , const BSONElement& e );
+
+            /** appends the reduced value of tuples to b as fieldName */
+            void _reduce( const BSONList& tuples , BSONObjBuilder& b , const char * fieldName );
+
+            vector<Field> _fields;
+        };
+
         class JSFinalizer : public Finalizer  {
         public:
             JSFinalizer( const BSONElement& code ) : _func( "_finalize" , code ) {}
@@ -174,7 +207,6 @@ namespace mongo {
             BSONObj scopeSetup;
 
             // output tables
-            string incLong;
             string tempLong;
 
             string finalShort;
@@ -210,7 +242,11 @@ namespace mongo {
          */
         class State {
         public:
-            State( const Config& c );
+            /**
+             * @param worker true for the state of one thread of a parallel map, which shares the
+             *        job's collections and leaves them to the job's own State
+             */
+            State( const Config& c , bool worker = false );
             ~State();
 
             void init();
@@ -229,7 +265,7 @@ namespace mongo {
 
             /**
              * if size is big, run a reduce
-             * if its still big, dump to temp collection
+             * if its still big, spill it to disk
              */
             void checkSize();
 
@@ -239,11 +275,17 @@ namespace mongo {
             void reduceInMemory();
 
             /**
-             * transfers in memory storage to temp collection
+             * transfers in memory storage to the sorted runs of spilled tuples
              */
             void dumpToInc();
-            void insertToInc( BSONObj& o );
-            void _insertToInc( BSONObj& o );
+
+            /**
+             * moves what a parallel map thread has left in memory into this state's map,
+             * along with its spilled tuples and its emit and reduce counts
+             */
+            void mergeInMemory( State& worker );
+
+            void _insertToInc( const BSONObj& o );
 
             // ------ reduce stage -----------
 
@@ -300,11 +342,19 @@ namespace mongo {
 
             scoped_ptr<Scope> _scope;
             bool _onDisk; // if the end result of this map reduce is disk or not
+            bool _worker; // a parallel map thread's state, see State()
 
             scoped_ptr<InMemory> _temp;
             long _size; // bytes in _temp
+            MemAccounting::Charge _sizeCharge; // _size as of the last checkSize(), for serverStatus
             long _dupCount; // number of duplicate key entries
 
+            // tuples spilled from _temp, written to unjournaled run files and sorted by key
+            shared_ptr<BSONObjExternalSorter> _spill;
+            // the spills of a parallel map's threads, merged with _spill in the final reduce
+            vector< shared_ptr<BSONObjExternalSorter> > _workerSpills;
+            long long _numSpilled; // tuples in _spill and _workerSpills
+
             long long _numEmits;
 
             bool _jsMode;
@@ -33,9 +33,20 @@ namespace mongo {
     const char Pipeline::explainName[] = "explain";
     const char Pipeline::fromRouterName[] = "fromRouter";
     const char Pipeline::splitMongodPipelineName[] = "splitMongodPipeline";
+    const char Pipeline::cursorName[] = "cursor";
+    const char Pipeline::batchSizeName[] = "batchSize";
     const char Pipeline::serverPipelineName[] = "serverPipeline";
     const char Pipeline::mongosPipelineName[] = "mongosPipeline";
 
+    /* a cursor's first batch is as big as a query's, by default */
+    static const long long defaultFirstBatchSize = 101;
+
+    /*
+      Like a query's getMore(), a first batch stops once it is this big,
+      which leaves room for a document of any size after it in the reply.
+     */
+    static const int firstBatchBytes = 4 * 1024 * 1024;
+
     Pipeline::~Pipeline() {
     }
 
@@ -43,7 +54,10 @@ namespace mongo {
         collectionName(),
         sourceVector(),
         explain(false),
+        cursor(false),
+        batchSize(defaultFirstBatchSize),
         splitMongodPipeline(false),
+        mergeShardResultsById(false),
         pCtx(pTheCtx) {
     }
 
@@ -67,10 +81,8 @@ namespace mongo {
          DocumentSourceLimit::createFromBson},
         {DocumentSourceMatch::matchName,
          DocumentSourceMatch::createFromBson},
-#ifdef LATER /* https://jira.mongodb.org/browse/SERVER-3253 */
         {DocumentSourceOut::outName,
          DocumentSourceOut::createFromBson},
-#endif
         {DocumentSourceProject::projectName,
          DocumentSourceProject::createFromBson},
         {DocumentSourceSkip::skipName,
@@ -117,6 +129,30 @@ namespace mongo {
                 continue;
             }
 
+            /* check for a cursor to return the output through */
+            if (!strcmp(pFieldName, cursorName)) {
+                uassert(16428, str::stream() << cursorName <<
+                        " must be an object, as in { " << batchSizeName <<
+                        " : <n> }", cmdElement.type() == Object);
+                pPipeline->cursor = true;
+
+                BSONObjIterator cursorIterator(cmdElement.embeddedObject());
+                while(cursorIterator.more()) {
+                    BSONElement cursorElement(cursorIterator.next());
+                    uassert(16429, str::stream() <<
+                            "unrecognized field in " << cursorName <<
+                            ": \"" << cursorElement.fieldName() << "\"",
+                            !strcmp(cursorElement.fieldName(),
+                                    batchSizeName));
+                    uassert(16430, str::stream() << batchSizeName <<
+                            " must be a number no less than zero",
+                            cursorElement.isNumber() &&
+                            (cursorElement.numberLong() >= 0));
+                    pPipeline->batchSize = cursorElement.numberLong();
+                }
+                continue;
+            }
+
             /* if the request came from the router, we're in a shard */
             if (!strcmp(pFieldName, fromRouterName)) {
                 pCtx->setInShard(cmdElement.Bool());
@@ -183,6 +219,12 @@ namespace mongo {
                 }
             }
 
+            /* $out consumes everything, so nothing can follow it */
+            uassert(16439, str::stream() << DocumentSourceOut::outName <<
+                    " can only be the final stage in the pipeline",
+                    (iStep == nSteps - 1) ||
+                    !dynamic_cast<DocumentSourceOut *>(pSource.get()));
+
             pSourceVector->push_back(pSource);
         }
 
@@ -269,6 +311,14 @@ namespace mongo {
         pShardPipeline->collectionName = collectionName;
         pShardPipeline->explain = explain;
 
+        /*
+          The shards return their output through cursors, so that mongos
+          can merge it as it arrives rather than a shard's all at once, and
+          so that a shard's output isn't limited to the size of a single
+          reply.  Explains don't have any output to return.
+         */
+        pShardPipeline->cursor = pCtx->getInRouter() && !explain;
+
         /* put the source list aside */
         SourceVector tempVector(sourceVector);
         sourceVector.clear();
@@ -293,7 +343,21 @@ namespace mongo {
              */
             if (pGroup) {
                 /* start this pipeline with the group merger */
-                sourceVector.push_back(pGroup->createMerger());
+                intrusive_ptr<DocumentSourceGroup> pMerger(
+                    pGroup->createMerger());
+                sourceVector.push_back(pMerger);
+
+                /*
+                  The shards' groups send their results in _id order (see
+                  DocumentSourceGroup::populate()), so in mongos the merger
+                  can stream through them once they're merged by _id,
+                  instead of hashing every partial group again.  Explains
+                  don't return any results to merge.
+                 */
+                if (pCtx->getInRouter() && !explain) {
+                    pMerger->setInputSortedByKey(true);
+                    mergeShardResultsById = true;
+                }
 
                 /* and then add everything that remains and quit */
                 for(size_t tempn = tempVector.size(), tempi = 0;
@@ -306,6 +370,11 @@ namespace mongo {
         return pShardPipeline;
     }
 
+    bool Pipeline::hasOutStage() const {
+        return !sourceVector.empty() &&
+            dynamic_cast<DocumentSourceOut *>(sourceVector.back().get());
+    }
+
     bool Pipeline::getInitialQuery(BSONObjBuilder *pQueryBuilder) const
     {
         if (!sourceVector.size())
@@ -342,6 +411,12 @@ namespace mongo {
             pBuilder->append(explainName, explain);
         }
 
+        if (cursor) {
+            BSONObjBuilder cursorBuilder(pBuilder->subobjStart(cursorName));
+            cursorBuilder.append(batchSizeName, batchSize);
+            cursorBuilder.done();
+        }
+
         bool btemp;
         if ((btemp = getSplitMongodPipeline())) {
             pBuilder->append(splitMongodPipelineName, btemp);
@@ -352,8 +427,8 @@ namespace mongo {
         }
     }
 
-    bool Pipeline::run(BSONObjBuilder &result, string &errmsg,
-                       const intrusive_ptr<DocumentSource> &pInputSource) {
+    intrusive_ptr<DocumentSource> Pipeline::stitch(
+        const intrusive_ptr<DocumentSource> &pInputSource) {
 
         /* chain together the sources we found */
         DocumentSource *pSource = pInputSource.get();
@@ -363,7 +438,47 @@ namespace mongo {
             pTemp->setSource(pSource);
             pSource = pTemp.get();
         }
+
         /* pSource is left pointing at the last source in the chain */
+        return pSource;
+    }
+
+    bool Pipeline::fillFirstBatch(
+        BSONArrayBuilder *pBatch,
+        const intrusive_ptr<DocumentSource> &pOutput) const {
+        bool hasDocument = !pOutput->eof();
+        for(; hasDocument; hasDocument = pOutput->advance()) {
+            if (pBatch->arrSize() >= batchSize)
+                break;
+
+            BSONObjBuilder documentBuilder;
+            pOutput->getCurrent()->toBson(&documentBuilder);
+            BSONObj document(documentBuilder.done());
+
+            /* leave the document for the next batch if this one is full */
+            if (pBatch->arrSize() && (pBatch->len() + document.objsize() >
+                                      firstBatchBytes))
+                break;
+
+            pBatch->append(document);
+        }
+
+        return hasDocument;
+    }
+
+    void Pipeline::writeCursor(BSONObjBuilder &result, long long cursorId,
+                               const string &ns, BSONArrayBuilder *pBatch) {
+        BSONObjBuilder cursorBuilder(result.subobjStart(cursorName));
+        cursorBuilder.append("id", cursorId);
+        cursorBuilder.append("ns", ns);
+        cursorBuilder.append("firstBatch", pBatch->arr());
+        cursorBuilder.done();
+    }
+
+    bool Pipeline::run(BSONObjBuilder &result, string &errmsg,
+                       const intrusive_ptr<DocumentSource> &pInputSource) {
+
+        intrusive_ptr<DocumentSource> pSource(stitch(pInputSource));
 
         /*
           Iterate through the resulting documents, and add them to the result.
@@ -390,7 +505,7 @@ namespace mongo {
                     intrusive_ptr<Document> pDocument(pSource->getCurrent());
 
                     /* add the document to the result set */
-                    BSONObjBuilder documentBuilder;
+                    StackBSONObjBuilder<> documentBuilder;
                     pDocument->toBson(&documentBuilder);
                     resultArray.append(documentBuilder.done());
                 }
@@ -70,6 +70,17 @@ namespace mongo {
         */
         intrusive_ptr<Pipeline> splitForSharded();
 
+        /**
+          After splitForSharded() in mongos, should the shard results be
+          merged in _id order (see DocumentSourceCommandFutures::
+          setMergeById())?  This is the case when the split was at a
+          $group:  the shards then send their partial groups in _id order,
+          so that the merging $group can combine them as they stream by.
+
+          @returns true if the shard results should be merged by _id
+         */
+        bool getMergeShardResultsById() const;
+
         /**
            If the pipeline starts with a $match, dump its BSON predicate
            specification to the supplied builder and return true.
@@ -104,6 +115,49 @@ namespace mongo {
         bool run(BSONObjBuilder &result, string &errmsg,
                  const intrusive_ptr<DocumentSource> &pSource);
 
+        /**
+          Chain the Pipeline's sources together after the given source,
+          so that its output can be read from the last of them.  This is
+          what run() does first; a cursor over the output uses it instead
+          of run() to read the output a batch at a time.
+
+          The caller must keep pSource, and the Pipeline, for as long as it
+          reads from the source this returns.
+
+          @param pSource the document source to use at the head of the chain
+          @returns the source the Pipeline's output comes out of
+        */
+        intrusive_ptr<DocumentSource> stitch(
+            const intrusive_ptr<DocumentSource> &pSource);
+
+        /**
+          Read the first batch of a cursor over the Pipeline's output:  up
+          to the batchSize the command asked for, and no more than will
+          comfortably fit in the reply with it.
+
+          On return, if there is more output, pOutput's current document
+          is the first one the next batch is to return.
+
+          @param pBatch where to put the documents
+          @param pOutput the source from stitch()
+          @returns true if there is output beyond the batch
+        */
+        bool fillFirstBatch(BSONArrayBuilder *pBatch,
+                            const intrusive_ptr<DocumentSource> &pOutput) const;
+
+        /**
+          Write the reply to a command that asked for a cursor:  the
+          cursor's id, which is zero if the batch holds all the output,
+          its namespace, for getMore()s, and the batch.
+
+          @param result builder to write the result to
+          @param cursorId the cursor to get more output from
+          @param ns the namespace the cursor belongs to
+          @param pBatch the batch from fillFirstBatch()
+        */
+        static void writeCursor(BSONObjBuilder &result, long long cursorId,
+                                const string &ns, BSONArrayBuilder *pBatch);
+
         /**
           Debugging:  should the processing pipeline be split within
           mongod, simulating the real mongos/mongod split?  This is determined
@@ -124,6 +178,23 @@ namespace mongo {
          */
         bool isExplain() const;
 
+        /**
+           Ask if the output is to be returned through a cursor, as the
+           "cursor" field of an "aggregate" command asks, rather than in a
+           single reply document.
+
+           @returns true if the output goes through a cursor
+         */
+        bool isCursorCommand() const;
+
+        /**
+           Ask if the pipeline ends with a $out, which writes the output to
+           a collection instead of returning it.
+
+           @returns true if the last stage is a $out
+         */
+        bool hasOutStage() const;
+
         /**
           The aggregation command name.
          */
@@ -145,6 +216,8 @@ namespace mongo {
         static const char explainName[];
         static const char fromRouterName[];
         static const char splitMongodPipelineName[];
+        static const char cursorName[];
+        static const char batchSizeName[];
         static const char serverPipelineName[];
         static const char mongosPipelineName[];
 
@@ -195,7 +268,11 @@ namespace mongo {
         SourceVector sourceVector;
         bool explain;
 
+        bool cursor;
+        long long batchSize; // for the first batch of the cursor
+
         bool splitMongodPipeline;
+        bool mergeShardResultsById;
         intrusive_ptr<ExpressionContext> pCtx;
     };
 
@@ -221,6 +298,14 @@ namespace mongo {
         return explain;
     }
 
+    inline bool Pipeline::isCursorCommand() const {
+        return cursor;
+    }
+
+    inline bool Pipeline::getMergeShardResultsById() const {
+        return mergeShardResultsById;
+    }
+
 } // namespace mongo
 
 
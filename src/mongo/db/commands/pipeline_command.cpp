@@ -16,6 +16,7 @@
 
 #include "pch.h"
 
+#include "db/clientcursor.h"
 #include "db/commands/pipeline.h"
 #include "db/commands/pipeline_d.h"
 #include "db/cursor.h"
@@ -29,6 +30,129 @@
 
 namespace mongo {
 
+    /*
+      Create the ExpressionContext for a pipeline run on this server.  Unlike
+      mongos, we have a dbpath, so stages may spill to disk under its _tmp.
+     */
+    static intrusive_ptr<ExpressionContext> createMongodExpressionContext() {
+        intrusive_ptr<ExpressionContext> pCtx(
+            ExpressionContext::create(&InterruptStatusMongod::status));
+
+        stringstream ss;
+        ss << dbpath;
+        if (dbpath[dbpath.size() - 1] != '/')
+            ss << "/";
+        ss << "_tmp";
+        pCtx->setTempDir(ss.str());
+
+        return pCtx;
+    }
+
+    /*
+      The output of a pipeline, as a Cursor, so that a ClientCursor can
+      hand it out through getMore()s.  The pipeline's own cursor over the
+      collection has a ClientCursor of its own, which it yields with, and
+      which is told about deletes while the lock is released between
+      getMore()s; noteLocation() and checkLocation() look after that.
+     */
+    class PipelineCursor :
+        public Cursor {
+    public:
+        PipelineCursor(const intrusive_ptr<Pipeline> &pPipeline,
+                       const intrusive_ptr<DocumentSource> &pInput,
+                       const intrusive_ptr<DocumentSourceCursor> &pSource);
+
+        /* where the command reads the first batch from */
+        const intrusive_ptr<DocumentSource> &getOutput() const;
+
+        // virtuals from Cursor
+        virtual bool ok();
+        virtual Record* _current() { return NULL; }
+        virtual BSONObj current();
+        virtual DiskLoc currLoc() { return DiskLoc(); }
+        virtual bool advance();
+        virtual DiskLoc refLoc() { return DiskLoc(); }
+        virtual bool supportGetMore() { return true; }
+        virtual void noteLocation();
+        virtual void checkLocation();
+        /* the pipeline's own cursor yields, this has nothing to yield */
+        virtual bool supportYields() { return false; }
+        virtual string toString() { return "PipelineCursor"; }
+        /* the output is documents the pipeline made, without duplicates */
+        virtual bool getsetdup(DiskLoc loc) { return false; }
+        virtual bool isMultiKey() const { return false; }
+        virtual bool modifiedKeys() const { return false; }
+        virtual long long nscanned() { return 0; }
+
+    private:
+        /*
+          A drop deletes the ClientCursor this belongs to, and so this,
+          even while the pipeline's cursor is yielding inside one of the
+          calls above.  Each holds onto the pipeline with one of these for
+          as long as it runs, so that the yield can fail safely.
+         */
+        class Hold {
+        public:
+            Hold(const PipelineCursor *pCursor);
+        private:
+            intrusive_ptr<Pipeline> pPipeline;
+            intrusive_ptr<DocumentSource> pInput;
+            intrusive_ptr<DocumentSourceCursor> pSource;
+            intrusive_ptr<DocumentSource> pOutput;
+        };
+
+        intrusive_ptr<Pipeline> pPipeline;
+        intrusive_ptr<DocumentSource> pInput;
+        intrusive_ptr<DocumentSourceCursor> pSource;
+        intrusive_ptr<DocumentSource> pOutput;
+    };
+
+    PipelineCursor::PipelineCursor(
+        const intrusive_ptr<Pipeline> &pThePipeline,
+        const intrusive_ptr<DocumentSource> &pTheInput,
+        const intrusive_ptr<DocumentSourceCursor> &pTheSource):
+        pPipeline(pThePipeline),
+        pInput(pTheInput),
+        pSource(pTheSource),
+        pOutput(pThePipeline->stitch(pTheInput)) {
+    }
+
+    const intrusive_ptr<DocumentSource> &PipelineCursor::getOutput() const {
+        return pOutput;
+    }
+
+    PipelineCursor::Hold::Hold(const PipelineCursor *pCursor):
+        pPipeline(pCursor->pPipeline),
+        pInput(pCursor->pInput),
+        pSource(pCursor->pSource),
+        pOutput(pCursor->pOutput) {
+    }
+
+    bool PipelineCursor::ok() {
+        Hold hold(this);
+        return !pOutput->eof();
+    }
+
+    BSONObj PipelineCursor::current() {
+        Hold hold(this);
+        BSONObjBuilder documentBuilder;
+        pOutput->getCurrent()->toBson(&documentBuilder);
+        return documentBuilder.obj();
+    }
+
+    bool PipelineCursor::advance() {
+        Hold hold(this);
+        return pOutput->advance();
+    }
+
+    void PipelineCursor::noteLocation() {
+        pSource->noteLocation();
+    }
+
+    void PipelineCursor::checkLocation() {
+        pSource->checkLocation();
+    }
+
     /** mongodb "commands" (sent via db.$cmd.findOne(...))
         subclass to make a command.  define a singleton object for it.
         */
@@ -107,6 +231,18 @@ namespace mongo {
             const string &ns, const string &db,
             intrusive_ptr<Pipeline> &pPipeline,
             intrusive_ptr<ExpressionContext> &pCtx);
+
+        /*
+          When the command asks for a cursor, the execute code path returns
+          the first batch, and leaves the rest to a ClientCursor, rather
+          than running the pipeline to the end.  This is called with the
+          READ lock runExecute() holds.
+         */
+        bool runCursor(
+            BSONObjBuilder &result, const string &ns,
+            intrusive_ptr<Pipeline> &pPipeline,
+            intrusive_ptr<DocumentSourceCursor> &pSource,
+            intrusive_ptr<ExpressionContext> &pCtx);
     };
 
     // self-registering singleton static instance
@@ -189,9 +325,41 @@ namespace mongo {
 
         intrusive_ptr<DocumentSourceCursor> pSource(
             PipelineD::prepareCursorSource(pPipeline, db, pCtx));
+
+        /* the debugging split runs the pipeline to the end, as it is */
+        if (pPipeline->isCursorCommand() &&
+            !pPipeline->getSplitMongodPipeline())
+            return runCursor(result, ns, pPipeline, pSource, pCtx);
+
         return executePipeline(result, errmsg, ns, pPipeline, pSource, pCtx);
     }
 
+    bool PipelineCommand::runCursor(
+        BSONObjBuilder &result, const string &ns,
+        intrusive_ptr<Pipeline> &pPipeline,
+        intrusive_ptr<DocumentSourceCursor> &pSource,
+        intrusive_ptr<ExpressionContext> &pCtx) {
+
+        intrusive_ptr<DocumentSource> pInput(
+            PipelineD::prepareParallel(pPipeline, pSource, pCtx));
+        shared_ptr<PipelineCursor> pCursor(
+            new PipelineCursor(pPipeline, pInput, pSource));
+
+        BSONArrayBuilder batch;
+        CursorId cursorId = 0;
+        if (pPipeline->fillFirstBatch(&batch, pCursor->getOutput())) {
+            /* the ClientCursor owns the pipeline from here on */
+            ClientCursor *pClientCursor =
+                new ClientCursor(0, pCursor, ns);
+            pClientCursor->incPos(batch.arrSize());
+            pCursor->noteLocation();
+            cursorId = pClientCursor->cursorid();
+        }
+
+        Pipeline::writeCursor(result, cursorId, ns, &batch);
+        return true;
+    }
+
     bool PipelineCommand::executePipeline(
         BSONObjBuilder &result, string &errmsg, const string &ns,
         intrusive_ptr<Pipeline> &pPipeline,
@@ -199,8 +367,11 @@ namespace mongo {
         intrusive_ptr<ExpressionContext> &pCtx) {
 
         /* this is the normal non-debug path */
-        if (!pPipeline->getSplitMongodPipeline())
-            return pPipeline->run(result, errmsg, pSource);
+        if (!pPipeline->getSplitMongodPipeline()) {
+            intrusive_ptr<DocumentSource> pInput(
+                PipelineD::prepareParallel(pPipeline, pSource, pCtx));
+            return pPipeline->run(result, errmsg, pInput);
+        }
 
         /* setup as if we're in the router */
         pCtx->setInRouter(true);
@@ -239,7 +410,7 @@ namespace mongo {
 
         /* on the shard servers, create the local pipeline */
         intrusive_ptr<ExpressionContext> pShardCtx(
-            ExpressionContext::create(&InterruptStatusMongod::status));
+            createMongodExpressionContext());
         intrusive_ptr<Pipeline> pShardPipeline(
             Pipeline::parseCommand(errmsg, shardBson, pShardCtx));
         if (!pShardPipeline.get()) {
@@ -282,7 +453,7 @@ namespace mongo {
                               BSONObjBuilder &result, bool fromRepl) {
 
         intrusive_ptr<ExpressionContext> pCtx(
-            ExpressionContext::create(&InterruptStatusMongod::status));
+            createMongodExpressionContext());
 
         /* try to parse the command; if this fails, then we didn't run */
         intrusive_ptr<Pipeline> pPipeline(
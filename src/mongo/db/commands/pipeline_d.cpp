@@ -18,14 +18,270 @@
 #include "mongo/db/commands/pipeline_d.h"
 
 #include "mongo/db/cursor.h"
+#include "mongo/db/dbhelpers.h"
+#include "mongo/db/instance.h"
+#include "mongo/db/oplog.h"
+#include "mongo/db/pdfile.h"
 #include "mongo/db/queryutil.h"
+#include "mongo/db/replutil.h"
 #include "mongo/db/commands/pipeline.h"
 #include "mongo/db/pipeline/dependency_tracker.h"
 #include "mongo/db/pipeline/document_source.h"
+#include "mongo/db/pipeline/expression_context.h"
 
 
 namespace mongo {
 
+    /* the most threads to run an aggregation on; see prepareParallel() */
+    int aggregationThreads = 1;
+
+    /*
+      Create the ParsedQuery the query optimizer plans the cursor with.
+
+      The ParsedQuery refers to the BSON it is given rather than copying
+      it, so the wrapped form of the query is returned in *ppWrapped for
+      the caller to keep alive for as long as the ParsedQuery is.  The
+      query is always wrapped so that a match on a field called "query"
+      isn't mistaken for the wrapped form.
+     */
+    static shared_ptr<ParsedQuery> createParsedQuery(
+        const char *ns, const BSONObj &query, const BSONObj &sort,
+        long long limit, shared_ptr<BSONObj> *ppWrapped) {
+        BSONObjBuilder wrappedBuilder;
+        wrappedBuilder.append("$query", query);
+        if (!sort.isEmpty())
+            wrappedBuilder.append("$orderby", sort);
+        ppWrapped->reset(new BSONObj(wrappedBuilder.obj()));
+
+        /* a negative ntoreturn is a hard limit */
+        int nToReturn = 0;
+        if (limit)
+            nToReturn = -(int)min(limit, (long long)numeric_limits<int>::max());
+
+        return shared_ptr<ParsedQuery>(
+            new ParsedQuery(ns, 0, nToReturn, 0, **ppWrapped, BSONObj()));
+    }
+
+    /*
+      Whether any index of the collection which starts with the field is
+      multikey.  Each document's group key is then not one of its index
+      keys, and an index scan doesn't bring equal group keys together.
+     */
+    static bool multikeyOn(const string &ns, const string &field) {
+        NamespaceDetails *d = nsdetails(ns.c_str());
+        if (!d)
+            return false;
+
+        for(int i = 0; i < d->nIndexes; ++i) {
+            if (d->isMultikey(i) &&
+                (field == d->idx(i).keyPattern().firstElementFieldName()))
+                return true;
+        }
+
+        return false;
+    }
+
+    /* whether the query only has conditions on the field, if any at all */
+    static bool onlyQueries(const BSONObj &query, const string &field) {
+        BSONObjIterator it(query);
+        while(it.more()) {
+            if (field != it.next().fieldName())
+                return false;
+        }
+
+        return true;
+    }
+
+    /*
+      Writes a $out's output into a temporary collection, a batch per write
+      lock, and then renames it over the output collection.  The indexes
+      the output collection had are built once everything is written, so
+      that they are built in bulk rather than a key at a time.
+
+      The pipeline is run with a read lock, which can't be held while
+      writing, so that is released for each write, with the cursor at the
+      head of the pipeline kept safe as a yield keeps it.
+     */
+    class OutWriter :
+        public DocumentSourceOut::Writer {
+    public:
+        OutWriter(const intrusive_ptr<DocumentSourceCursor> &pSource,
+                  const string &outNs);
+
+        // virtuals from DocumentSourceOut::Writer
+        virtual void insert(const vector<BSONObj> &batch);
+        virtual void finish();
+        virtual void abandon();
+
+    private:
+        /* release the read lock for as long as this is in scope */
+        class Unlock :
+            boost::noncopyable {
+        public:
+            Unlock(DocumentSourceCursor *pSource);
+            ~Unlock();
+
+            /* take the lock back; this throws if the cursor is gone */
+            void relock();
+
+        private:
+            DocumentSourceCursor *pSource;
+            bool locked;
+        };
+
+        /* create the temporary collection; called without a lock */
+        void createTemp();
+
+        /* copy the output collection's indexes to the temporary one */
+        void copyIndexes(DBDirectClient &client);
+
+        intrusive_ptr<DocumentSourceCursor> pSource;
+        string outNs;
+        string tempNs;
+        bool created;
+
+        static AtomicUInt jobNumber;
+    };
+
+    AtomicUInt OutWriter::jobNumber;
+
+    OutWriter::Unlock::Unlock(DocumentSourceCursor *pTheSource):
+        pSource(pTheSource),
+        locked(false) {
+        pSource->unlock();
+    }
+
+    OutWriter::Unlock::~Unlock() {
+        if (!locked) {
+            DESTRUCTOR_GUARD( pSource->relock(); )
+        }
+    }
+
+    void OutWriter::Unlock::relock() {
+        locked = true;
+        pSource->relock();
+    }
+
+    OutWriter::OutWriter(const intrusive_ptr<DocumentSourceCursor> &pTheSource,
+                         const string &theOutNs):
+        pSource(pTheSource),
+        outNs(theOutNs),
+        created(false) {
+        tempNs = str::stream() << nsToDatabase(outNs.c_str()) <<
+            ".tmp.agg_out." << jobNumber++;
+    }
+
+    void OutWriter::createTemp() {
+        Client::WriteContext ctx(tempNs);
+        uassert(16440, str::stream() << DocumentSourceOut::outName <<
+                " can only write on a primary",
+                isMasterNs(tempNs.c_str()));
+
+        /* temp, so that it's dropped at startup if we don't finish */
+        string errmsg;
+        uassert(16441, str::stream() << "couldn't create " << tempNs <<
+                " for " << DocumentSourceOut::outName << ": " << errmsg,
+                userCreateNS(tempNs.c_str(), BSON("temp" << true),
+                             errmsg, true));
+        created = true;
+    }
+
+    void OutWriter::copyIndexes(DBDirectClient &client) {
+        const string indexesNs(
+            Namespace(tempNs.c_str()).getSisterNS("system.indexes"));
+
+        auto_ptr<DBClientCursor> pIndexes(client.getIndexes(outNs));
+        while(pIndexes->more()) {
+            BSONObj index(pIndexes->next());
+            if (str::equals(index.getStringField("name"), "_id_"))
+                continue;
+
+            BSONObjBuilder indexBuilder(index.objsize() + 16);
+            indexBuilder.append("ns", tempNs);
+            BSONObjIterator fieldIterator(index);
+            while(fieldIterator.more()) {
+                BSONElement field(fieldIterator.next());
+                if (str::equals(field.fieldName(), "_id") ||
+                    str::equals(field.fieldName(), "ns"))
+                    continue;
+
+                indexBuilder.append(field);
+            }
+
+            /* there is data by now, so the index is built from a sort */
+            Client::WriteContext ctx(tempNs);
+            theDataFileMgr.insertAndLog(
+                indexesNs.c_str(), indexBuilder.obj(), false);
+        }
+    }
+
+    void OutWriter::insert(const vector<BSONObj> &batch) {
+        Unlock unlock(pSource.get());
+        if (!created)
+            createTemp();
+
+        {
+            Client::WriteContext ctx(tempNs);
+
+            /* log the batch together; flushed before the lock goes */
+            OplogBatch oplogBatch;
+            for(size_t i = 0; i < batch.size(); ++i) {
+                theDataFileMgr.insertAndLog(tempNs.c_str(), batch[i], false);
+                OplogBatch::commitIfNeeded();
+            }
+        }
+
+        unlock.relock();
+    }
+
+    void OutWriter::finish() {
+        /*
+          The input has all been read.  Its cursor mustn't be yielding when
+          the output collection is dropped, in case that's the one it read.
+         */
+        pSource->releaseCursor();
+
+        Unlock unlock(pSource.get());
+        if (!created)
+            createTemp();
+
+        DBDirectClient client;
+        copyIndexes(client);
+
+        {
+            /* as map/reduce does, so that no one sees it missing */
+            Lock::GlobalWrite lock;
+            client.dropCollection(outNs);
+
+            BSONObj info;
+            uassert(16442, str::stream() << DocumentSourceOut::outName <<
+                    " couldn't rename " << tempNs << " to " << outNs <<
+                    ": " << info,
+                    client.runCommand("admin",
+                                      BSON("renameCollection" << tempNs <<
+                                           "to" << outNs), info));
+            created = false;
+        }
+
+        unlock.relock();
+    }
+
+    void OutWriter::abandon() {
+        if (!created)
+            return;
+
+        try {
+            Unlock unlock(pSource.get());
+            DBDirectClient client;
+            client.dropCollection(tempNs);
+            created = false;
+            unlock.relock();
+        }
+        catch(...) {
+            /* it is temp, so it will be dropped at startup otherwise */
+        }
+    }
+
     intrusive_ptr<DocumentSourceCursor> PipelineD::prepareCursorSource(
         const intrusive_ptr<Pipeline> &pPipeline,
         const string &dbName,
@@ -102,19 +358,12 @@ namespace mongo {
         shared_ptr<BSONObj> pSelectObj(new BSONObj(selectBuilder.obj()));
 
         /*
-          In order to send the select-list into the Cursor factory below,
-          we need a ParsedQuery.
-
-          LATER: if the query engine survives in its current form, early
-          limits and skips may also be optimized here. Ideally, we get
-          redo the query engine to be based on DocumentSources, and this all
-          gets a lot simpler.
+          The ParsedQuery we create below keeps a pointer to the namespace,
+          so hang on to that for as long as the cursor.
          */
-        string fullName(dbName + "." + pPipeline->getCollectionName());
-        shared_ptr<ParsedQuery> pParsedQuery(
-            new ParsedQuery(fullName.c_str(), 0, 0, 0,
-                            *pQueryObj, *pSelectObj));
-        // TODO use this in the getCursor() calls below SERVER-5090
+        shared_ptr<string> pFullName(
+            new string(dbName + "." + pPipeline->getCollectionName()));
+        const string &fullName = *pFullName;
 
         /*
           Look for an initial sort; we'll try to add this to the
@@ -135,15 +384,59 @@ namespace mongo {
             }
         }
 
+        /*
+          Without a $sort, if an index brings the documents in order of an
+          initial $group's key, the group can combine them as they stream
+          by instead of holding every group in memory.  On a shard the
+          groups go to the router in _id order, which this might not
+          match, so leave those to sort their groups.  A query on other
+          fields might have a much better index than the one for the
+          order, so this is only tried when there's none.
+         */
+        DocumentSourceGroup *pGroup = NULL;
+        if (!pSort && pSources->size() && !pExpCtx->getInShard()) {
+            pGroup = dynamic_cast<DocumentSourceGroup *>(
+                pSources->front().get());
+            if (pGroup) {
+                BSONObjBuilder groupSortBuilder;
+                string field(pGroup->inputSortToBson(&groupSortBuilder));
+                if (field.empty() || !onlyQueries(*pQueryObj, field) ||
+                    multikeyOn(fullName, field))
+                    pGroup = NULL;
+                else
+                    sortBuilder.appendElements(groupSortBuilder.done());
+            }
+        }
+
         /* Create the sort object; see comments on the query object above */
         shared_ptr<BSONObj> pSortObj(new BSONObj(sortBuilder.obj()));
 
+        /*
+          Look for a limit: one the sort absorbed from a $limit after it, or
+          a $limit right after the match, if there's no sort.  If the cursor
+          can provide the order, this tells the query optimizer how many
+          documents we want, and lets the cursor stop as soon as it has
+          produced them.  If the sort has to be done in memory after all,
+          the limit applies to the sorted output, not the cursor, and we
+          don't use it.
+         */
+        long long limit = 0;
+        if (pSort)
+            limit = pSort->getLimit();
+        else if (pSources->size()) {
+            const DocumentSourceLimit *pLimit =
+                dynamic_cast<DocumentSourceLimit *>(pSources->front().get());
+            if (pLimit)
+                limit = pLimit->getLimit();
+        }
+
         /* for debugging purposes, show what the query and sort are */
         DEV {
             (log() << "\n---- query BSON\n" <<
              pQueryObj->jsonString(Strict, 1) << "\n----\n").flush();
             (log() << "\n---- sort BSON\n" <<
              pSortObj->jsonString(Strict, 1) << "\n----\n").flush();
+            (log() << "\n---- limit\n" << limit << "\n----\n").flush();
             (log() << "\n---- fullName\n" <<
              fullName << "\n----\n").flush();
         }
@@ -164,34 +457,78 @@ namespace mongo {
           If we are able to incorporate the sort into the cursor, remove it
           from the head of the pipeline.
 
+          In either case, the query optimizer gets a ParsedQuery carrying the
+          sort and the limit (as a hard limit, the same as a negative
+          ntoreturn on a find), so that it can plan for only needing the
+          first few documents.  The select-list isn't given to it yet;
+          TODO this also requires the flag from SERVER-6023 in order not to
+          gum up a sort, and DocumentSourceCursor doesn't use covered
+          results yet (SERVER-5090).
+
           LATER - we should be able to find this out before we create the
           cursor.  Either way, we can then apply other optimizations there
           are tickets for, such as SERVER-4507.
          */
         shared_ptr<Cursor> pCursor;
+        shared_ptr<ParsedQuery> pParsedQuery;
+        shared_ptr<BSONObj> pWrappedQuery;
         bool initSort = false;
-        if (pSort) {
+        if (pSort || pGroup) {
             /* try to create the cursor with the query and the sort */
+            shared_ptr<BSONObj> pSortedWrapped;
+            shared_ptr<ParsedQuery> pSortedQuery(
+                createParsedQuery(fullName.c_str(), *pQueryObj, *pSortObj,
+                                  limit, &pSortedWrapped));
             shared_ptr<Cursor> pSortedCursor(
-                pCursor = NamespaceDetailsTransient::getCursor(
-                    fullName.c_str(), *pQueryObj, *pSortObj));
+                NamespaceDetailsTransient::getCursor(
+                    fullName.c_str(), *pQueryObj, *pSortObj,
+                    QueryPlanSelectionPolicy::any(), NULL, pSortedQuery));
+
+            if (pSortedCursor.get() && pGroup) {
+                /* success:  the group can stream */
+                pGroup->setInputSortedByKey(true);
 
-            if (pSortedCursor.get()) {
-                /* success:  remove the sort from the pipeline */
+                pCursor = pSortedCursor;
+                pParsedQuery = pSortedQuery;
+                pWrappedQuery = pSortedWrapped;
+                initSort = true;
+            }
+            else if (pSortedCursor.get()) {
+                /*
+                  success:  remove the sort from the pipeline, leaving
+                  behind any limit it had absorbed
+                 */
                 pSources->erase(pSources->begin());
+                if (limit)
+                    pSources->insert(pSources->begin(),
+                                     DocumentSourceLimit::create(pExpCtx,
+                                                                 limit));
 
                 pCursor = pSortedCursor;
+                pParsedQuery = pSortedQuery;
+                pWrappedQuery = pSortedWrapped;
                 initSort = true;
             }
+            else {
+                /* the limit belongs to the in-memory sort's output */
+                limit = 0;
+            }
         }
 
         if (!pCursor.get()) {
             /* try to create the cursor without the sort */
+            shared_ptr<BSONObj> pUnsortedWrapped;
+            shared_ptr<ParsedQuery> pUnsortedQuery(
+                createParsedQuery(fullName.c_str(), *pQueryObj, BSONObj(),
+                                  limit, &pUnsortedWrapped));
             shared_ptr<Cursor> pUnsortedCursor(
-                pCursor = NamespaceDetailsTransient::getCursor(
-                    fullName.c_str(), *pQueryObj));
+                NamespaceDetailsTransient::getCursor(
+                    fullName.c_str(), *pQueryObj, BSONObj(),
+                    QueryPlanSelectionPolicy::any(), NULL, pUnsortedQuery));
 
             pCursor = pUnsortedCursor;
+            pParsedQuery = pUnsortedQuery;
+            pWrappedQuery = pUnsortedWrapped;
         }
 
         /* wrap the cursor with a DocumentSource and return that */
@@ -211,12 +548,117 @@ namespace mongo {
         pSource->setSelect(pSelectObj);
         if (initSort)
             pSource->setSort(pSortObj);
+        if (limit)
+            pSource->setLimit(limit);
 
         shared_ptr<void> pVoid(
             static_pointer_cast<void, ParsedQuery>(pParsedQuery));
         pSource->keepAlive(pVoid);
+        pSource->keepAlive(static_pointer_cast<void, BSONObj>(pWrappedQuery));
+        pSource->keepAlive(static_pointer_cast<void, string>(pFullName));
+
+        /* a $out writes with the lock this source takes; see OutWriter */
+        if (pPipeline->hasOutStage()) {
+            DocumentSourceOut *pOut =
+                static_cast<DocumentSourceOut *>(pSources->back().get());
+            shared_ptr<DocumentSourceOut::Writer> pWriter(
+                new OutWriter(pSource,
+                              dbName + "." + pOut->getOutputCollection()));
+            pOut->setWriter(pWriter);
+        }
 
         return pSource;
     }
 
+    /* whether a query has a $where anywhere, which needs this thread's JS */
+    static bool hasWhere(const BSONObj &query) {
+        BSONObjIterator it(query);
+        while(it.more()) {
+            BSONElement element(it.next());
+            if (strcmp(element.fieldName(), "$where") == 0)
+                return true;
+            if (element.isABSONObj() && hasWhere(element.embeddedObject()))
+                return true;
+        }
+
+        return false;
+    }
+
+    /*
+      Whether a stage handles each document on its own, and can do so on
+      any thread.
+     */
+    static bool handlesEachDocument(DocumentSource *pSource) {
+        DocumentSourceMatch *pMatch =
+            dynamic_cast<DocumentSourceMatch *>(pSource);
+        if (pMatch) {
+            BSONObjBuilder queryBuilder;
+            pMatch->toMatcherBson(&queryBuilder);
+            return !hasWhere(queryBuilder.done());
+        }
+
+        return (dynamic_cast<DocumentSourceProject *>(pSource) ||
+                dynamic_cast<DocumentSourceUnwind *>(pSource));
+    }
+
+    intrusive_ptr<DocumentSource> PipelineD::prepareParallel(
+        const intrusive_ptr<Pipeline> &pPipeline,
+        const intrusive_ptr<DocumentSourceCursor> &pSource,
+        const intrusive_ptr<ExpressionContext> &pExpCtx) {
+
+        /*
+          On a shard, the $group has to send mongos its partial groups,
+          which the merge here would finish.
+         */
+        const int nThreads = aggregationThreads;
+        if ((nThreads < 2) || pPipeline->isExplain() ||
+            pExpCtx->getInShard())
+            return pSource;
+
+        /* look for the $group that ends the part to run in parallel */
+        Pipeline::SourceVector *pSources = &pPipeline->sourceVector;
+        DocumentSourceGroup *pGroup = NULL;
+        for(Pipeline::SourceVector::iterator iter(pSources->begin()),
+                listEnd(pSources->end()); iter != listEnd; ++iter) {
+            pGroup = dynamic_cast<DocumentSourceGroup *>(iter->get());
+            if (pGroup)
+                break;
+            if (!handlesEachDocument(iter->get()))
+                return pSource;
+        }
+        if (!pGroup || pGroup->dependsOnInputOrder())
+            return pSource;
+
+        /*
+          Split the pipeline as mongos would, and give each worker its own
+          copy of the shards' part, parsed from BSON as a shard would.
+         */
+        pExpCtx->setInRouter(true);
+        intrusive_ptr<Pipeline> pShardSplit(pPipeline->splitForSharded());
+
+        BSONObjBuilder shardBuilder;
+        pShardSplit->toBson(&shardBuilder);
+        BSONObj shardBson(shardBuilder.done());
+
+        intrusive_ptr<DocumentSourceParallel> pParallel(
+            DocumentSourceParallel::create(pExpCtx));
+        for(int i = 0; i < nThreads; ++i) {
+            intrusive_ptr<ExpressionContext> pWorkerCtx(
+                ExpressionContext::create(
+                    pParallel->getWorkerInterruptStatus()));
+            pWorkerCtx->setTempDir(pExpCtx->getTempDir());
+
+            /* this already parsed once, so it can't fail now */
+            string errmsg;
+            intrusive_ptr<Pipeline> pWorkerPipeline(
+                Pipeline::parseCommand(errmsg, shardBson, pWorkerCtx));
+            verify(pWorkerPipeline.get());
+
+            pParallel->addWorker(pWorkerPipeline->sourceVector, pWorkerCtx);
+        }
+
+        pParallel->setSource(pSource.get());
+        return pParallel;
+    }
+
 } // namespace mongo
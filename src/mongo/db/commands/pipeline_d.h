@@ -20,6 +20,7 @@
 
 namespace mongo {
 
+    class DocumentSource;
     class DocumentSourceCursor;
     class ExpressionContext;
     class Pipeline;
@@ -57,6 +58,30 @@ namespace mongo {
             const string &dbName,
             const intrusive_ptr<ExpressionContext> &pExpCtx);
 
+        /**
+           Set the pipeline up to run the part a shard would run, up to and
+           including its first $group, on aggregationThreads threads, each
+           taking a share of the input.  The pipeline is split as it would
+           be for sharding, and what remains of it merges the workers'
+           partial groups, as mongos would.
+
+           This is only done when that gives the same result as running it
+           on one thread:  the stages before the $group must each handle
+           documents one at a time, and the $group mustn't depend on the
+           order of its input.
+
+           @param pPipeline the logical "this" for this operation
+           @param pSource the cursor source from prepareCursorSource()
+           @param pExpCtx the expression context for this pipeline
+           @returns the source to run the pipeline from:  a
+             DocumentSourceParallel reading pSource, or pSource itself if
+             the pipeline is to run on this thread alone
+         */
+        static intrusive_ptr<DocumentSource> prepareParallel(
+            const intrusive_ptr<Pipeline> &pPipeline,
+            const intrusive_ptr<DocumentSourceCursor> &pSource,
+            const intrusive_ptr<ExpressionContext> &pExpCtx);
+
     private:
         PipelineD(); // does not exist:  prevent instantiation
     };
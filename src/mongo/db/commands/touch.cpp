@@ -20,11 +20,14 @@
 
 #include "pch.h"
 
+#include <set>
+
 #include "mongo/db/commands.h"
 #include "mongo/db/d_concurrency.h"
 #include "mongo/db/curop-inl.h"
 #include "mongo/db/index.h"
 #include "mongo/db/pdfile.h"
+#include "mongo/util/mongoutils/str.h"
 #include "mongo/util/timer.h"
 #include "mongo/util/touch_pages.h"
 
@@ -40,8 +43,12 @@ namespace mongo {
         virtual void help( stringstream& help ) const {
             help << "touch collection\n"
                 "Page in all pages of memory containing every extent for the given collection\n"
-                "{ touch : <collection_name>, [data : true] , [index : true] }\n"
-                " at least one of data or index must be true; default is both are false\n";
+                "{ touch : <collection_name>, [data : true] , [index : true | <name> | [<names>]] ,\n"
+                "  [idRange : { min : <_id>, max : <_id> }] , [threads : <n>] , [rateMB : <MB/s>] }\n"
+                " at least one of data or index must be true; default is both are false\n"
+                " index may name the indexes to touch rather than all of them\n"
+                " with idRange, data touches only the documents with _id in [min, max]\n"
+                " threads (default 4) say how many ranges are read at once; rateMB caps their total read rate\n";
         }
         virtual bool requiresAuth() { return true; }
         TouchCmd() : Command("touch") { }
@@ -64,14 +71,63 @@ namespace mongo {
                 return false;
             }
 
-            bool touch_indexes( cmdObj["index"].trueValue() );
+            BSONElement index = cmdObj["index"];
+            bool touch_indexes( index.type() == String || index.type() == Array || index.trueValue() );
             bool touch_data( cmdObj["data"].trueValue() );
 
             if ( ! (touch_indexes || touch_data) ) {
                 errmsg = "must specify at least one of (data:true, index:true)";
                 return false;
             }
-            bool ok = touch( ns, errmsg, touch_data, touch_indexes, result );
+
+            // the names of the indexes to touch, or none for all of them
+            std::set< std::string > names;
+            if ( index.type() == String ) {
+                names.insert( index.String() );
+            }
+            else if ( index.type() == Array ) {
+                BSONForEach( e, index.Obj() ) {
+                    if ( e.type() != String ) {
+                        errmsg = "index names must be strings";
+                        return false;
+                    }
+                    names.insert( e.String() );
+                }
+                if ( names.empty() ) {
+                    errmsg = "no index names given";
+                    return false;
+                }
+            }
+
+            BSONObj idRange;
+            if ( cmdObj["idRange"].isABSONObj() ) {
+                idRange = cmdObj["idRange"].Obj();
+                if ( idRange["min"].eoo() || idRange["max"].eoo() ) {
+                    errmsg = "idRange needs a min and a max";
+                    return false;
+                }
+            }
+            else if ( ! cmdObj["idRange"].eoo() ) {
+                errmsg = "idRange must be an object";
+                return false;
+            }
+
+            TouchOptions options;
+            options.threads = 4;
+            if ( cmdObj["threads"].isNumber() )
+                options.threads = cmdObj["threads"].numberInt();
+            if ( options.threads < 1 || options.threads > 64 ) {
+                errmsg = "threads must be from 1 to 64";
+                return false;
+            }
+            if ( cmdObj["rateMB"].isNumber() )
+                options.rateMB = cmdObj["rateMB"].numberInt();
+            if ( options.rateMB < 0 ) {
+                errmsg = "rateMB can't be negative; 0 is no limit";
+                return false;
+            }
+
+            bool ok = touch( ns, errmsg, touch_data, touch_indexes, names, idRange, options, result );
             return ok;
         }
 
@@ -79,34 +135,51 @@ namespace mongo {
                     std::string& errmsg, 
                     bool touch_data, 
                     bool touch_indexes, 
+                    const std::set< std::string >& names,
+                    const BSONObj& idRange,
+                    const TouchOptions& options,
                     BSONObjBuilder& result ) {
 
-            if (touch_data) {
-                log() << "touching namespace " << ns << endl;
-                touchNs( ns );
-                log() << "touching namespace " << ns << " complete" << endl;
-            }
+            Timer t;
+            long long bytes = 0;
 
+            // enumerate indexes, before touching anything, so a bad name fails straight away
+            std::vector< std::string > indexes;
             if (touch_indexes) {
-                // enumerate indexes
-                std::vector< std::string > indexes;
-                {
-                    Client::ReadContext ctx(ns);
-                    NamespaceDetails *nsd = nsdetails(ns.c_str());
-                    massert( 16153, "namespace does not exist", nsd );
-                    
-                    NamespaceDetails::IndexIterator ii = nsd->ii(); 
-                    while ( ii.more() ) {
-                        IndexDetails& idx = ii.next();
+                Client::ReadContext ctx(ns);
+                NamespaceDetails *nsd = nsdetails(ns.c_str());
+                massert( 16153, "namespace does not exist", nsd );
+
+                std::set< std::string > missing = names;
+                NamespaceDetails::IndexIterator ii = nsd->ii(); 
+                while ( ii.more() ) {
+                    IndexDetails& idx = ii.next();
+                    if ( names.empty() || missing.erase( idx.indexName() ) )
                         indexes.push_back( idx.indexNamespace() );
-                    }
                 }
-                for ( std::vector<std::string>::const_iterator it = indexes.begin(); 
-                      it != indexes.end(); 
-                      it++ ) {
-                    touchNs( *it );
+                if ( ! missing.empty() ) {
+                    errmsg = str::stream() << "no index named " << *missing.begin();
+                    return false;
                 }
             }
+
+            if (touch_data) {
+                log() << "touching namespace " << ns << endl;
+                if ( idRange.isEmpty() )
+                    bytes += touchNs( ns, options );
+                else
+                    bytes += touchIdRange( ns, idRange["min"], idRange["max"], options );
+                log() << "touching namespace " << ns << " complete" << endl;
+            }
+
+            for ( std::vector<std::string>::const_iterator it = indexes.begin(); 
+                  it != indexes.end(); 
+                  it++ ) {
+                bytes += touchNs( *it, options );
+            }
+
+            result.appendNumber( "bytes", bytes );
+            result.append( "millis", t.millis() );
             return true;
         }
         
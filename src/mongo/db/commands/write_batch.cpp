@@ -0,0 +1,77 @@
+// write_batch.cpp
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include "../commands.h"
+#include "../instance.h"
+
+namespace mongo {
+
+    /**
+     * Several inserts, updates and removes, and the getLastError options to apply to all of
+     * them, in one round trip.
+     */
+    class CmdWriteBatch : public Command {
+    public:
+        CmdWriteBatch() : Command( "writeBatch" ) { }
+        virtual bool logTheOp() { return false; } // each write is logged as it is applied
+        virtual bool slaveOk() const { return false; }
+        // takes the write lock itself, so that it can wait for w after letting go of it
+        virtual LockType locktype() const { return NONE; }
+        virtual void help( stringstream &help ) const {
+            help << "{ writeBatch : 'collection' , writes : [ { insert : doc } ,\n"
+                 << "                                        { update : { q : query , u : obj , upsert : bool , multi : bool } } ,\n"
+                 << "                                        { remove : { q : query , justOne : bool } } ] ,\n"
+                 << "  ordered : true , writeConcern : { w : n , j : bool , fsync : bool , wtimeout : ms } }\n"
+                 << "results holds one outcome per statement applied, in order.  an ordered batch (the default) "
+                 << "stops at the first statement that fails.";
+        }
+
+        bool run( const string& dbname, BSONObj& cmdObj, int, string& errmsg, BSONObjBuilder& result, bool fromRepl ) {
+            string ns = dbname + '.' + cmdObj.firstElement().valuestrsafe();
+
+            if ( cmdObj["writes"].type() != Array ) {
+                errmsg = "writes must be an array of statements";
+                return false;
+            }
+            vector<BSONObj> statements;
+            BSONForEach( e, cmdObj["writes"].embeddedObject() ) {
+                if ( e.type() != Object ) {
+                    errmsg = "write batch statements must be objects";
+                    return false;
+                }
+                statements.push_back( e.embeddedObject() );
+            }
+            const bool ordered = cmdObj["ordered"].eoo() || cmdObj["ordered"].trueValue();
+
+            BSONArrayBuilder results;
+            long long applied = applyWriteBatch( ns.c_str(), statements, ordered, results );
+            result.appendNumber( "applied" , applied );
+            result.append( "results" , results.arr() );
+
+            BSONObj writeConcern = cmdObj.getObjectField( "writeConcern" );
+            if ( writeConcern.isEmpty() )
+                return true;
+            BSONObjBuilder b( result.subobjStart( "writeConcern" ) );
+            bool ok = awaitWriteConcern( writeConcern, applied == 0, b, errmsg );
+            b.done();
+            return ok;
+        }
+    } cmdWriteBatch;
+
+}
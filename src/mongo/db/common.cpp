@@ -26,21 +26,21 @@
  */
 namespace mongo {
 
-    NOINLINE_DECL OpTime OpTime::skewed() {
+    NOINLINE_DECL OpTime OpTime::skewed( const OpTime& prev ) {
         bool toLog = false;
         ONCE toLog = true;
         RARELY toLog = true;
-        last.i++;
-        if ( last.i & 0x80000000 )
+        OpTime next( prev.secs, prev.i + 1 );
+        if ( next.i & 0x80000000 )
             toLog = true;
         if ( toLog ) {
-            log() << "clock skew detected  prev: " << last.secs << " now: " << (unsigned) time(0) << endl;
+            log() << "clock skew detected  prev: " << prev.secs << " now: " << (unsigned) time(0) << endl;
         }
-        if ( last.i & 0x80000000 ) {
+        if ( next.i & 0x80000000 ) {
             log() << "error large clock skew detected, shutting down" << endl;
             throw ClockSkewException();
         }
-        return last;
+        return next;
     }
 
 }
@@ -22,14 +22,18 @@
 
 #include "mongo/db/compact.h"
 
+#include "mongo/client/dbclientinterface.h"
 #include "mongo/db/background.h"
+#include "mongo/db/clientcursor.h"
 #include "mongo/db/commands.h"
 #include "mongo/db/d_concurrency.h"
 #include "mongo/db/curop-inl.h"
+#include "mongo/db/cursor.h"
 #include "mongo/db/extsort.h"
 #include "mongo/db/index.h"
 #include "mongo/db/index_update.h"
 #include "mongo/db/pdfile.h"
+#include "mongo/db/record_checksums.h"
 #include "mongo/util/concurrency/task.h"
 #include "mongo/util/timer.h"
 #include "mongo/util/touch_pages.h"
@@ -39,6 +43,7 @@ namespace mongo {
     void addRecordToRecListInExtent(Record *r, DiskLoc loc);
     DiskLoc allocateSpaceForANewRecord(const char *ns, NamespaceDetails *d, int lenWHdr, bool god);
     void freeExtents(DiskLoc firstExt, DiskLoc lastExt);
+    void aboutToMoveForSharding( const Database* db , const DiskLoc& from , const DiskLoc& to ); // from s/d_logic.h
 
     /* this should be done in alloc record not here, but doing here for now. 
        really dumb; it's a start.
@@ -101,7 +106,7 @@ namespace mongo {
                         oldObjSize += sz;
                         oldObjSizeWithPadding += recOld->netLength();
 
-                        unsigned lenWHdr = sz + Record::HeaderSize;
+                        unsigned lenWHdr = sz + RecordChecksums::extra( d ) + Record::HeaderSize;
                         unsigned lenWPadding = lenWHdr;
                         {
                             lenWPadding = static_cast<unsigned>(pf*lenWPadding);
@@ -118,6 +123,8 @@ namespace mongo {
                         recNew = (Record *) getDur().writingPtr(recNew, lenWHdr);
                         addRecordToRecListInExtent(recNew, loc);
                         memcpy(recNew->data(), objOld.objdata(), sz);
+                        if ( RecordChecksums::extra( d ) )
+                            RecordChecksums::update( recNew );
 
                         {
                             // extract keys for all indexes we will be rebuilding
@@ -207,7 +214,9 @@ namespace mongo {
                 BSONObj::iterator i(idx.info.obj());
                 while( i.more() ) { 
                     BSONElement e = i.next();
-                    if( !str::equals(e.fieldName(), "v") && !str::equals(e.fieldName(), "background") ) {
+                    // older versions are rebuilt at the default version, v:2 stays prefix compressed
+                    bool dropVersion = str::equals(e.fieldName(), "v") && e.numberInt() != 2;
+                    if( !dropVersion && !str::equals(e.fieldName(), "background") ) {
                         b.append(e);
                     }
                 }
@@ -294,7 +303,9 @@ namespace mongo {
 
         bool ok;
         {
-            Lock::DBWrite lk(ns);
+            // the whole database: freeing extents (and making the free list) isn't safe beneath
+            // just a collection lock
+            Lock::DBWrite lk(nsToDatabase(ns));
             BackgroundOperation::assertNoBgOpInProgForNs(ns.c_str());
             Client::Context ctx(ns);
             NamespaceDetails *d = nsdetails(ns.c_str());
@@ -316,6 +327,276 @@ namespace mongo {
         return ok;
     }
 
+    /** @return true if loc is in the extent at E */
+    static bool inExtent(const DiskLoc& loc, const DiskLoc& E, const Extent *e) {
+        return loc.a() == E.a() && loc.getOfs() >= E.getOfs() && loc.getOfs() < E.getOfs() + e->length;
+    }
+
+    /** takes E's free records off d's deleted lists, so nothing new is put in E */
+    static void sealExtent(NamespaceDetails *d, const DiskLoc& E) {
+        Extent *e = E.ext();
+        for( int b = 0; b < Buckets; b++ ) { 
+            DiskLoc prev;
+            for( DiskLoc L = d->deletedList[b]; !L.isNull(); ) { 
+                DiskLoc next = L.drec()->nextDeleted();
+                if( !inExtent(L, E, e) ) {
+                    prev = L;
+                }
+                else if( prev.isNull() ) {
+                    d->deletedList[b].writing() = next;
+                }
+                else {
+                    prev.drec()->nextDeleted().writing() = next;
+                }
+                L = next;
+            }
+        }
+    }
+
+    /** undoes sealExtent for an extent we are giving up on: the gaps between its records go back on the deleted lists */
+    static void unsealExtent(NamespaceDetails *d, const DiskLoc& E) {
+        // anything deleted from E since it was sealed is on the lists again, and is a gap here too
+        sealExtent(d, E);
+        Extent *e = E.ext();
+        vector< pair<int,int> > recs; // ofs, lengthWithHeaders
+        for( DiskLoc L = e->firstRecord; !L.isNull(); L = L.rec()->nextInExtent(L) ) 
+            recs.push_back( make_pair(L.getOfs(), L.rec()->lengthWithHeaders()) );
+        sort(recs.begin(), recs.end());
+        recs.push_back( make_pair(E.getOfs() + e->length, 0) );
+
+        int at = E.getOfs() + Extent::HeaderSize();
+        for( unsigned i = 0; i < recs.size(); i++ ) { 
+            if( recs[i].first > at ) { 
+                DiskLoc gap(E.a(), at);
+                DeletedRecord *dr = getDur().writing(gap.drec());
+                dr->lengthWithHeaders() = recs[i].first - at;
+                dr->extentOfs() = E.getOfs();
+                d->addDeletedRec(dr, gap);
+            }
+            at = max(at, recs[i].first + recs[i].second);
+        }
+    }
+
+    /** moves the record at L, in the sealed extent E, to wherever the allocator puts it */
+    static void moveRecord(const char *ns, NamespaceDetails *d, const DiskLoc& E, const DiskLoc L, double pf, int pb) {
+        Record *recOld = L.rec();
+        BSONObj objOld = BSONObj::make(recOld);
+        unsigned sz = objOld.objsize();
+        unsigned lenWHdr = sz + RecordChecksums::extra( d ) + Record::HeaderSize;
+        unsigned lenWPadding = recOld->lengthWithHeaders();
+        if( pf != 0 || pb != 0 ) { 
+            lenWPadding = static_cast<unsigned>(pf*lenWHdr) + pb;
+            lenWPadding = lenWPadding & quantizeMask(lenWPadding);
+            if( lenWPadding < lenWHdr || lenWPadding > BSONObjMaxUserSize / 2 ) { 
+                lenWPadding = lenWHdr;
+            }
+        }
+
+        DiskLoc loc = allocateSpaceForANewRecord(ns, d, lenWPadding, false);
+        uassert(16417, "compact error out of space during compaction", !loc.isNull());
+        massert(16418, "compact allocated a record in the extent it is emptying", !inExtent(loc, E, E.ext()));
+        Record *recNew = loc.rec();
+        {
+            NamespaceDetails::Stats *s = getDur().writing(&d->stats);
+            s->datasize += recNew->netLength();
+            s->nrecords++;
+        }
+        recNew = (Record *) getDur().writingPtr(recNew, lenWHdr);
+        addRecordToRecListInExtent(recNew, loc);
+        memcpy(recNew->data(), objOld.objdata(), sz);
+        if ( RecordChecksums::extra( d ) )
+            RecordChecksums::update( recNew );
+
+        // a key of a unique index has only the one entry, so pointing it at the new location keeps
+        // it in order; other indexes order equal keys by location, so theirs are taken out and put back
+        NamespaceDetails::IndexIterator ii = d->ii();
+        while( ii.more() ) { 
+            IndexDetails& idx = ii.next();
+            bool unique = idx.unique() || idx.isIdIndex();
+            BSONObjSet keys;
+            idx.getKeysFromObject(objOld, keys);
+            for( BSONObjSet::iterator k = keys.begin(); k != keys.end(); k++ ) { 
+                if( unique && idx.idxInterface().relocate(idx.head, idx, *k, L, loc) )
+                    continue;
+                idx.idxInterface().unindex(idx.head, idx, *k, L);
+                idx.idxInterface().bt_insert(idx.head, loc, *k, Ordering::make(idx.keyPattern()), true, idx);
+            }
+        }
+
+        aboutToMoveForSharding(cc().database(), L, loc);
+        ClientCursor::aboutToDelete(L);
+        theDataFileMgr._deleteRecord(d, ns, recOld, L, false);
+    }
+
+    /** unlinks the empty extent E from d's extent list and frees it */
+    static void dropExtent(NamespaceDetails *d, const DiskLoc& E) {
+        Extent *e = E.ext();
+        verify( e->firstRecord.isNull() );
+        verify( d->lastExtent != E );
+        if( e->xprev.isNull() )
+            d->firstExtent.writing() = e->xnext;
+        else
+            e->xprev.ext()->xnext.writing() = e->xnext;
+        e->xnext.ext()->xprev.writing() = e->xprev;
+        getDur().writing(e)->markEmpty();
+        freeExtents(E, E);
+    }
+
+    struct IncrementalStats { 
+        IncrementalStats() : extentsFreed(0), bytesFreed(0), moved(0), batches(0) { }
+        int extentsFreed;
+        long long bytesFreed;
+        long long moved;
+        long long batches;
+    };
+
+    /** empties the extent at E batchSize records at a time, letting go of the lock between batches, then frees it
+        @return false if E was left as it is; errmsg says why
+    */
+    static bool compactExtentIncrementally(const string& ns, const DiskLoc& E, int batchSize, bool validate,
+                                           double pf, int pb, IncrementalStats& stats, string& errmsg) {
+        bool sealed = false;
+        // a cursor that goes nowhere: dropping the collection, or its indexes, invalidates it, so
+        // while it's still there E is still ours and is as we left it
+        CursorId canary = 0;
+        while( 1 ) { 
+            Lock::DBWrite lk(nsToDatabase(ns)); // as in compact()
+            Client::Context ctx(ns);
+            NamespaceDetails *d = nsdetails(ns.c_str());
+            if( canary && !ClientCursor::find(canary, false) ) { 
+                // can't tell a dropIndexes from a drop and create, so what was free in E stays
+                // off the free list until compact or repair
+                errmsg = "collection was dropped or its indexes changed";
+                return false;
+            }
+            if( !d ) { 
+                errmsg = "namespace was dropped";
+                return false;
+            }
+            if( !canary ) { 
+                shared_ptr<Cursor> c( new BasicCursor(DiskLoc()) );
+                canary = (new ClientCursor(QueryOption_NoCursorTimeout, c, ns))->cursorid();
+            }
+            // erases it on the way out, while we still hold the lock
+            ClientCursor::Holder canaryHolder( ClientCursor::find(canary, false) );
+
+            Extent *e = E.ext();
+            if( d->lastExtent == E ) { 
+                // what came after it was freed
+                if( sealed )
+                    unsealExtent(d, E);
+                errmsg = "extent is now the last";
+                return false;
+            }
+
+            if( sealed && *killCurrentOp.checkForInterruptNoAssert() ) { 
+                unsealExtent(d, E);
+                getDur().commitIfNeeded();
+                killCurrentOp.checkForInterrupt(false);
+            }
+
+            if( BackgroundOperation::inProgForNs(ns.c_str()) ) { 
+                if( sealed )
+                    unsealExtent(d, E);
+                errmsg = "a background operation started on the collection";
+                return false;
+            }
+
+            if( !sealed && validate ) { 
+                for( DiskLoc L = e->firstRecord; !L.isNull(); L = L.rec()->nextInExtent(L) ) { 
+                    if( !BSONObj::make(L.rec()).valid() ) { 
+                        errmsg = "extent holds an invalid object";
+                        return false;
+                    }
+                }
+            }
+
+            // others may have freed space in E while we didn't have the lock
+            sealExtent(d, E);
+            sealed = true;
+
+            try { 
+                for( int n = 0; n < batchSize && !e->firstRecord.isNull(); n++ ) { 
+                    moveRecord(ns.c_str(), d, E, e->firstRecord, pf, pb);
+                    stats.moved++;
+                    getDur().commitIfNeeded();
+                }
+            }
+            catch(...) { 
+                unsealExtent(d, E);
+                throw;
+            }
+            stats.batches++;
+
+            if( e->firstRecord.isNull() ) { 
+                stats.bytesFreed += e->length;
+                dropExtent(d, E);
+                stats.extentsFreed++;
+                NamespaceDetailsTransient::get(ns.c_str()).notifyOfWriteOp();
+                getDur().commitIfNeeded();
+                return true;
+            }
+            canaryHolder.release();
+        }
+    }
+
+    bool compactIncremental(const string& ns, string &errmsg, bool validate, BSONObjBuilder& result,
+                            double pf, int pb, int batchSize, int maxExtents, double minFreeRatio) {
+        massert( 14028, "bad ns", NamespaceString::normal(ns.c_str()) );
+        massert( 14027, "can't compact a system namespace", !str::contains(ns, ".system.") );
+
+        // the most fragmented first, going by the free records in each extent, which are many
+        // fewer than the records in it. the last extent is left alone: that's where new ones go
+        vector< pair<double,DiskLoc> > candidates;
+        {
+            Client::ReadContext ctx(ns);
+            NamespaceDetails *d = nsdetails(ns.c_str());
+            massert( 13660, str::stream() << "namespace " << ns << " does not exist", d );
+            massert( 13661, "cannot compact capped collection", !d->isCapped() );
+
+            map<DiskLoc,long long> freeBytes;
+            for( int b = 0; b < Buckets; b++ ) { 
+                for( DiskLoc L = d->deletedList[b]; !L.isNull(); L = L.drec()->nextDeleted() ) { 
+                    DeletedRecord *dr = L.drec();
+                    freeBytes[ DiskLoc(L.a(), dr->extentOfs()) ] += dr->lengthWithHeaders();
+                }
+            }
+            for( DiskLoc L = d->firstExtent; L != d->lastExtent; L = L.ext()->xnext ) { 
+                double ratio = static_cast<double>(freeBytes[L]) / L.ext()->length;
+                if( ratio >= minFreeRatio )
+                    candidates.push_back( make_pair(-ratio, L) );
+            }
+        }
+        sort(candidates.begin(), candidates.end());
+        if( maxExtents > 0 && candidates.size() > (unsigned) maxExtents )
+            candidates.resize(maxExtents);
+
+        log() << "compact incremental " << ns << " begin, " << candidates.size() << " extents" << endl;
+        ProgressMeterHolder pm( cc().curop()->setMessage( "compact extent" , candidates.size() ) );
+        IncrementalStats stats;
+        int skipped = 0;
+        for( unsigned i = 0; i < candidates.size(); i++ ) { 
+            killCurrentOp.checkForInterrupt(false);
+            string why;
+            if( !compactExtentIncrementally(ns, candidates[i].second, batchSize, validate, pf, pb, stats, why) ) { 
+                log() << "compact skipping extent " << candidates[i].second.toString() << ": " << why << endl;
+                skipped++;
+            }
+            pm.hit();
+        }
+        pm.finished();
+        log() << "compact incremental " << ns << " end, freed " << stats.extentsFreed << " extents ("
+              << stats.bytesFreed/1000000.0 << "MB)" << endl;
+
+        result.append("extentsFreed", stats.extentsFreed);
+        result.appendNumber("bytesFreed", stats.bytesFreed);
+        result.appendNumber("moved", stats.moved);
+        result.appendNumber("batches", stats.batches);
+        if( skipped )
+            result.append("extentsSkipped", skipped);
+        return true;
+    }
+
     bool isCurrentlyAReplSetPrimary();
 
     class CompactCmd : public Command {
@@ -330,7 +611,12 @@ namespace mongo {
                 "warning: this operation blocks the server and is slow. you can cancel with cancelOp()\n"
                 "{ compact : <collection_name>, [force:true], [validate:true] }\n"
                 "  force - allows to run on a replica set primary\n"
-                "  validate - check records are noncorrupt before adding to newly compacting extents. slower but safer (default is true in this version)\n";
+                "  validate - check records are noncorrupt before adding to newly compacting extents. slower but safer (default is true in this version)\n"
+                "{ compact : <collection_name>, incremental:true, [batchSize:<n>], [maxExtents:<n>], [minFreeRatio:<r>] }\n"
+                "  moves the documents out of the extents with the most free space, batchSize (default 100) at a time,\n"
+                "  letting other operations run between batches, and frees the extents. fine on a primary\n"
+                "  maxExtents - most extents to empty, default all of them\n"
+                "  minFreeRatio - extents less free than this are left alone (default .25)\n";
         }
         virtual bool requiresAuth() { return true; }
         CompactCmd() : Command("compact") { }
@@ -342,7 +628,8 @@ namespace mongo {
                 return false;
             }
 
-            if( isCurrentlyAReplSetPrimary() && !cmdObj["force"].trueValue() ) { 
+            bool incremental = cmdObj["incremental"].trueValue();
+            if( !incremental && isCurrentlyAReplSetPrimary() && !cmdObj["force"].trueValue() ) { 
                 errmsg = "will not run compact on an active replica set primary as this is a slow blocking operation. use force:true to force";
                 return false;
             }
@@ -386,6 +673,23 @@ namespace mongo {
             }
 
             bool validate = !cmdObj.hasElement("validate") || cmdObj["validate"].trueValue(); // default is true at the moment
+            if( incremental ) { 
+                // documents keep their padding unless told otherwise
+                if( !cmdObj.hasElement("paddingFactor") && !cmdObj.hasElement("paddingBytes") )
+                    pf = 0;
+                int batchSize = cmdObj.hasElement("batchSize") ? cmdObj["batchSize"].numberInt() : 100;
+                int maxExtents = cmdObj["maxExtents"].numberInt();
+                double minFreeRatio = cmdObj.hasElement("minFreeRatio") ? cmdObj["minFreeRatio"].numberDouble() : 0.25;
+                if( batchSize < 1 ) { 
+                    errmsg = "batchSize must be positive";
+                    return false;
+                }
+                if( minFreeRatio < 0 || minFreeRatio > 1 ) { 
+                    errmsg = "minFreeRatio must be from 0 to 1";
+                    return false;
+                }
+                return compactIncremental(ns, errmsg, validate, result, pf, pb, batchSize, maxExtents, minFreeRatio);
+            }
             bool ok = compact(ns, errmsg, validate, result, pf, pb);
             return ok;
         }
@@ -35,6 +35,11 @@ namespace mongo {
         void addKeys(const IndexSpec& spec, const BSONObj& o, DiskLoc loc) { 
             BSONObjSet keys;
             spec.getKeys(o, keys);
+            addKeys(keys, loc);
+        }
+
+        /** add the keys already extracted from the record at loc */
+        void addKeys(const BSONObjSet& keys, DiskLoc loc) { 
             int k = 0;
             for ( BSONObjSet::iterator i=keys.begin(); i != keys.end(); i++ ) {
                 if( ++k == 2 ) {
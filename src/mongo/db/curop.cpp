@@ -118,7 +118,8 @@ namespace mongo {
     }
 
     BSONObj CurOp::infoNoauth() {
-        BSONObjBuilder b;
+        // built on the stack and copied out at its size, often in a loop over every client
+        StackBSONObjBuilder<1024> b;
         b.append("opid", _opNum);
         bool a = _active && _start;
         b.append("active", a);
@@ -155,7 +156,7 @@ namespace mongo {
         
         if ( ! _message.empty() ) {
             if ( _progressMeter.isActive() ) {
-                StringBuilder buf;
+                ArenaStringBuilder buf;
                 buf << _message.toString() << " " << _progressMeter.toString();
                 b.append( "msg" , buf.str() );
                 BSONObjBuilder sub( b.subobjStart( "progress" ) );
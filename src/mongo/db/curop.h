@@ -61,6 +61,7 @@ namespace mongo {
         // debugging/profile info
         long long nscanned;
         bool idhack;         // indicates short circuited code path on an update to make the update faster
+        bool cachedResult;   // query reply copied from the collection's QueryResultCache
         bool scanAndOrder;   // scanandorder query plan aspect was used
         long long  nupdated; // number of records updated
         long long  nmoved;   // updates resulted in a move (moves are expensive)
@@ -24,6 +24,7 @@
 #include "../util/concurrency/mapsf.h"
 #include "../util/assert_util.h"
 #include "client.h"
+#include "databaseholder.h"
 #include "namespacestring.h"
 #include "d_globals.h"
 #include "mongomutex.h"
@@ -103,6 +104,56 @@ namespace mongo {
         new WrapperForRWLock("admin")
     };
 
+    static bool collectionLocks = false;
+
+    /* ns->lock for collections, with --collectionLocks.  Only made for collections that exist,
+       and looked up only under the database's intent lock.  A collection's lock is deleted when
+       the collection is dropped under the database's exclusive lock, so no other thread can be
+       holding it or waiting for it then.  (Dropped under a global lock, it lingers like dblocks.)
+    */
+    static mapsf<string,WrapperForRWLock*> collectionlocks;
+
+    void WrapperForRWLock::useBigReader() {
+        bigReader = true;
+        // the nestable locks are made at static initialization, the rest on first use
+        nestableLocks[Lock::local]->switchToBigReader();
+        nestableLocks[Lock::admin]->switchToBigReader();
+        mapsf<string,WrapperForRWLock*>::ref r(dblocks);
+        for( map<string,WrapperForRWLock*>::iterator i = r.r.begin(); i != r.r.end(); i++ )
+            i->second->switchToBigReader();
+    }
+
+    void Lock::useCollectionLocks() {
+        // the database locks made from now on are QLocks, so nothing may be locked yet
+        verify( dblocks.empty() );
+        collectionLocks = true;
+    }
+
+    bool Lock::collectionLockingEnabled() {
+        return collectionLocks;
+    }
+
+    /** @return true if ns names a user collection: not a database, command, index or system ns. */
+    static bool isCollectionNs( const string& ns ) {
+        size_t dot = ns.find( '.' );
+        return dot != string::npos && dot + 1 < ns.size() && ns.find( '$' ) == string::npos &&
+            ns.compare( dot + 1 , 7 , "system." ) != 0;
+    }
+
+    /** we hold db's intent lock and the top lock, so ns can neither be created nor dropped. */
+    static bool collectionExists( const string& db , const string& ns ) {
+        Database *d = dbHolder().get( db , dbpath );
+        return d && d->namespaceIndex.details( ns.c_str() );
+    }
+
+    static WrapperForRWLock* getCollectionLock( const string& ns ) {
+        mapsf<string,WrapperForRWLock*>::ref r(collectionlocks);
+        WrapperForRWLock*& lock = r[ns];
+        if( lock == 0 )
+            lock = new WrapperForRWLock(ns.c_str());
+        return lock;
+    }
+
     static void locked_W();
     static void unlocking_w();
     static void unlocking_W();
@@ -222,11 +273,26 @@ namespace mongo {
         b.append("local", nestableLocks[Lock::local]->stats.report());
         {
             mapsf<string,WrapperForRWLock*>::ref r(dblocks);
+            mapsf<string,WrapperForRWLock*>::ref c(collectionlocks);
             for( map<string,WrapperForRWLock*>::const_iterator i = r.r.begin(); i != r.r.end(); i++ ) {
-                b.append(i->first, i->second->stats.report());
+                BSONObjBuilder d( b.subobjStart(i->first) );
+                d.appendElements(i->second->stats.report());
+                const string prefix = i->first + '.';
+                map<string,WrapperForRWLock*>::const_iterator j = c.r.lower_bound(prefix);
+                if( j != c.r.end() && str::startsWith(j->first, prefix) ) {
+                    BSONObjBuilder colls( d.subobjStart("collections") );
+                    for( ; j != c.r.end() && str::startsWith(j->first, prefix); j++ ) {
+                        colls.append(j->first.substr(prefix.size()), j->second->stats.report());
+                    }
+                    colls.done();
+                }
+                d.done();
             }
         }
         result.append("locks", b.obj());
+        BSONObjBuilder o( result.subobjStart("lockWaitByOp") );
+        LockStat::reportByOp( o );
+        o.done();
     }
 
     int Lock::isLocked() {
@@ -289,6 +355,68 @@ namespace mongo {
         return DB_LEVEL_LOCKING_ENABLED;
     }
 
+    void Lock::forgetCollectionLock(const StringData& ns) {
+        if( !collectionLocks )
+            return;
+        LockState& ls = lockState();
+        char db[MaxDatabaseNameLen];
+        nsToDatabase(ns.data(), db);
+        if( ls.otherCount() <= 0 || ls.collectionCount() || ls.otherName() != db ) {
+            // only our database's exclusive lock keeps other threads off its collection locks.
+            // under a global lock one can still be held by a thread waiting for the top lock.
+            return;
+        }
+        mapsf<string,WrapperForRWLock*>::ref r(collectionlocks);
+        map<string,WrapperForRWLock*>::iterator i = r.r.find(ns.data());
+        if( i != r.r.end() ) {
+            delete i->second;
+            r.r.erase(i);
+        }
+    }
+
+    bool Lock::othersWaiting() {
+        LockState& ls = lockState();
+        const LockStat& q = qlk.stats;
+        switch( ls.threadState() ) {
+        case 'r':
+            if( q.waiting('W') )
+                return true;
+            break;
+        case 'w':
+            if( q.waiting('W') || q.waiting('R') )
+                return true;
+            break;
+        case 'R':
+            return q.waiting('W') || q.waiting('w');
+        case 'W':
+            return q.waiting('W') || q.waiting('R') || q.waiting('w') || q.waiting('r');
+        default:
+            return false;
+        }
+
+        // with --collectionLocks, r and w may hold just a collection beneath a database intent lock
+        if( ls.collectionCount() ) {
+            WrapperForRWLock *c = ls.collectionLock();
+            if( c->stats.waiting('W') )
+                return true;
+            if( ls.collectionCount() > 0 && c->stats.waiting('R') )
+                return true;
+        }
+
+        // r and w also hold a database lock, where writers to the same database queue up
+        int type = ls.otherCount();
+        WrapperForRWLock *db = ls.otherLock();
+        if( type == 0 ) {
+            type = ls.nestableCount();
+            db = nestableLocks[ls.whichNestable()];
+        }
+        if( type == 0 || db == 0 )
+            return false;
+        if( db->stats.waiting('W') )
+            return true;
+        return type > 0 && db->stats.waiting('R');
+    }
+
     RWLockRecursive &Lock::ParallelBatchWriterMode::_batchLock = *(new RWLockRecursive("special"));
     void Lock::ParallelBatchWriterMode::iAmABatchParticipant() {
         lockState()._batchWriter = true;
@@ -473,7 +601,7 @@ namespace mongo {
         }
     }
 
-    void Lock::DBWrite::lockOther(const string& db) {
+    void Lock::DBWrite::lockOther(const string& db, bool intent) {
         fassert( 16252, !db.empty() );
         LockState& ls = lockState();
 
@@ -493,7 +621,7 @@ namespace mongo {
             mapsf<string,WrapperForRWLock*>::ref r(dblocks);
             WrapperForRWLock*& lock = r[db];
             if( lock == 0 )
-                lock = new WrapperForRWLock(db.c_str());
+                lock = new WrapperForRWLock(db.c_str(), collectionLocks);
             ls.lockedOther( db , 1 , lock );
         }
         else { 
@@ -502,10 +630,43 @@ namespace mongo {
         }
         
         fassert(16134,_weLocked==0);
-        ls.otherLock()->lock();
+        if( intent )
+            ls.otherLock()->lock_intent();
+        else
+            ls.otherLock()->lock();
         _weLocked = ls.otherLock();
     }
 
+    /** --collectionLocks: lock ns beneath an intent lock on db, then the top lock.
+        @return false, with nothing locked, if that doesn't apply and db must be locked instead.
+    */
+    bool Lock::DBWrite::lockCollection(LockState& ls, const string& db, const string& ns) {
+        if( !collectionLocks || !isCollectionNs(ns) || ls.otherCount() )
+            return false;
+        lockOther(db, true);
+
+        // the top lock comes after the collection lock, as a thread in w_to_X waits for every
+        // other 'w' holder.  so peek under 'r' first; creating ns would need db exclusively.
+        qlk.lock_r();
+        bool exists = collectionExists(db, ns);
+        qlk.unlock_r();
+        if( exists ) {
+            _collectionLocked = getCollectionLock(ns);
+            ls.lockedCollection(ns, 1, _collectionLocked);
+            _collectionLocked->lock();
+            lockTop(ls);
+            // a global write lock between the peek and lockTop may have closed the database
+            if( collectionExists(db, ns) )
+                return true;
+            unlockDB();
+            return false;
+        }
+        ls.unlockedOther();
+        _weLocked->unlock_intent();
+        _weLocked = 0;
+        return false;
+    }
+
     static Lock::Nestable n(const char *db) { 
         if( str::equals(db, "local") )
             return Lock::local;
@@ -520,6 +681,7 @@ namespace mongo {
         _locked_W=false;
         _locked_w=false; 
         _weLocked=0;
+        _collectionLocked=0;
 
         LockState& ls = lockState();
         massert( 16186 , "can't get a DBWrite while having a read lock" , ! ls.hasAnyReadLock() );
@@ -536,8 +698,16 @@ namespace mongo {
                 _locked_W = true;
                 return;
             } 
-            if( !nested )
+            if( !nested ) {
+                if( ls.collectionCount() ) {
+                    uassert( 16446 , str::stream() << "can't lock " << ns << " for writing while only collection "
+                             << ls.collectionName() << " is locked (--collectionLocks)" , ls.isLocked( ns , true ) );
+                }
+                else if( lockCollection(ls, db, ns) ) {
+                    return;
+                }
                 lockOther(db);
+            }
             lockTop(ls);
             if( nested )
                 lockNestable(nested);
@@ -553,6 +723,7 @@ namespace mongo {
         Acquiring a( 'r' );
         _locked_r=false; 
         _weLocked=0; 
+        _collectionLocked=0;
         LockState& ls = lockState();
         if ( ls.isRW() )
             return;
@@ -560,8 +731,16 @@ namespace mongo {
             char db[MaxDatabaseNameLen];
             nsToDatabase(ns.data(), db);
             Nestable nested = n(db);
-            if( !nested )
+            if( !nested ) {
+                if( ls.collectionCount() ) {
+                    uassert( 16447 , str::stream() << "can't lock " << ns << " while only collection "
+                             << ls.collectionName() << " is locked (--collectionLocks)" , ls.isLocked( ns ) );
+                }
+                else if( lockCollection(ls, db, ns) ) {
+                    return;
+                }
                 lockOther(db);
+            }
             lockTop(ls);
             if( nested )
                 lockNestable(nested);
@@ -588,13 +767,22 @@ namespace mongo {
     }
 
     void Lock::DBWrite::unlockDB() {
+        const bool intent = _collectionLocked != 0;
+        if( _collectionLocked ) {
+            lockState().unlockedCollection();
+            _collectionLocked->unlock();
+            _collectionLocked = 0;
+        }
         if( _weLocked ) {
             if ( _nested )
                 lockState().unlockedNestable();
             else
                 lockState().unlockedOther();
     
-            _weLocked->unlock();
+            if( intent )
+                _weLocked->unlock_intent();
+            else
+                _weLocked->unlock();
         }
         if( _locked_w ) {
             if (DB_LEVEL_LOCKING_ENABLED) {
@@ -610,13 +798,22 @@ namespace mongo {
         _locked_W = _locked_w = false;
     }
     void Lock::DBRead::unlockDB() {
+        const bool intent = _collectionLocked != 0;
+        if( _collectionLocked ) {
+            lockState().unlockedCollection();
+            _collectionLocked->unlock_shared();
+            _collectionLocked = 0;
+        }
         if( _weLocked ) {
             if( _nested )
                 lockState().unlockedNestable();
             else
                 lockState().unlockedOther();
 
-            _weLocked->unlock_shared();
+            if( intent )
+                _weLocked->unlock_intent_shared();
+            else
+                _weLocked->unlock_shared();
         }
 
         if( _locked_r ) {
@@ -654,7 +851,7 @@ namespace mongo {
         }
     }
 
-    void Lock::DBRead::lockOther(const string& db) {
+    void Lock::DBRead::lockOther(const string& db, bool intent) {
         fassert( 16255, !db.empty() );
         LockState& ls = lockState();
 
@@ -674,7 +871,7 @@ namespace mongo {
             mapsf<string,WrapperForRWLock*>::ref r(dblocks);
             WrapperForRWLock*& lock = r[db];
             if( lock == 0 )
-                lock = new WrapperForRWLock(db.c_str());
+                lock = new WrapperForRWLock(db.c_str(), collectionLocks);
             ls.lockedOther( db , -1 , lock );
         }
         else { 
@@ -682,10 +879,38 @@ namespace mongo {
             ls.lockedOther(-1);
         }
         fassert(16135,_weLocked==0);
-        ls.otherLock()->lock_shared();
+        if( intent )
+            ls.otherLock()->lock_intent_shared();
+        else
+            ls.otherLock()->lock_shared();
         _weLocked = ls.otherLock();
     }
 
+    /** as DBWrite::lockCollection, for reading */
+    bool Lock::DBRead::lockCollection(LockState& ls, const string& db, const string& ns) {
+        if( !collectionLocks || !isCollectionNs(ns) || ls.otherCount() )
+            return false;
+        lockOther(db, true);
+
+        qlk.lock_r();
+        bool exists = collectionExists(db, ns);
+        qlk.unlock_r();
+        if( exists ) {
+            _collectionLocked = getCollectionLock(ns);
+            ls.lockedCollection(ns, -1, _collectionLocked);
+            _collectionLocked->lock_shared();
+            lockTop(ls);
+            if( collectionExists(db, ns) )
+                return true;
+            unlockDB();
+            return false;
+        }
+        ls.unlockedOther();
+        _weLocked->unlock_intent_shared();
+        _weLocked = 0;
+        return false;
+    }
+
     Lock::DBWrite::UpgradeToExclusive::UpgradeToExclusive() {
         fassert( 16187, lockState().threadState() == 'w' );
         _gotUpgrade = qlk.w_to_X();
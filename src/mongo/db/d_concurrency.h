@@ -50,6 +50,24 @@ namespace mongo {
 
         static bool dbLevelLockingEnabled(); 
 
+        /** --collectionLocks: DBWrite and DBRead given an existing collection's ns lock that
+            collection, beneath an intent lock on its database, so operations on different
+            collections of one database run concurrently.  Anything else still locks the whole
+            database.  Call at startup, before any database is locked.
+        */
+        static void useCollectionLocks();
+        static bool collectionLockingEnabled();
+
+        /** forget the collection lock of ns, as ns is dropped or renamed.  only done under ns's
+            database lock held exclusively; under a global lock the collection lock is kept, as
+            the database locks themselves are, and is used again if the name is. */
+        static void forgetCollectionLock(const StringData& ns);
+
+        /** @return true if another thread is queued for a lock we hold, in a mode ours blocks.
+            cheap enough to call per document; used to yield only when someone is waiting.
+        */
+        static bool othersWaiting();
+
         class ScopedLock;
 
         // note: avoid TempRelease when possible. not a good thing.
@@ -132,7 +150,8 @@ namespace mongo {
 
             void lockTop(LockState&);
             void lockNestable(Nestable db);
-            void lockOther(const string& db);
+            void lockOther(const string& db, bool intent = false);
+            bool lockCollection(LockState&, const string& db, const string& ns);
             void lockDB(const string& ns);
             void unlockDB();
 
@@ -158,6 +177,7 @@ namespace mongo {
             bool _locked_w;
             bool _locked_W;
             WrapperForRWLock *_weLocked;
+            WrapperForRWLock *_collectionLocked; // then _weLocked is held in intent mode
             const string _what;
             bool _nested;
         };
@@ -166,7 +186,8 @@ namespace mongo {
         class DBRead : public ScopedLock {
             void lockTop(LockState&);
             void lockNestable(Nestable db);
-            void lockOther(const string& db);
+            void lockOther(const string& db, bool intent = false);
+            bool lockCollection(LockState&, const string& db, const string& ns);
             void lockDB(const string& ns);
             void unlockDB();
 
@@ -181,6 +202,7 @@ namespace mongo {
         private:
             bool _locked_r;
             WrapperForRWLock *_weLocked;
+            WrapperForRWLock *_collectionLocked; // then _weLocked is held in intent mode
             string _what;
             bool _nested;
             
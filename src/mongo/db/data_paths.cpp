@@ -0,0 +1,95 @@
+// data_paths.cpp
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+
+#include "mongo/db/data_paths.h"
+
+#include <boost/filesystem/operations.hpp>
+
+#include "mongo/db/namespace_details.h"
+
+namespace mongo {
+
+    extern string dbpath;
+
+    vector<string> dataPaths;
+    bool dataPathsByFreeSpace = false;
+
+    vector<boost::filesystem::path> dataFileDirs( const string& path , const string& db ) {
+        vector<boost::filesystem::path> dirs( 1 , boost::filesystem::path( path ) );
+        if ( path == dbpath ) {
+            for ( unsigned i = 0; i < dataPaths.size(); i++ )
+                dirs.push_back( boost::filesystem::path( dataPaths[i] ) );
+        }
+        if ( directoryperdb ) {
+            for ( unsigned i = 0; i < dirs.size(); i++ )
+                dirs[i] /= db;
+        }
+        return dirs;
+    }
+
+    static string leafName( const string& db , int n ) {
+        stringstream ss;
+        ss << db << '.' << n;
+        return ss.str();
+    }
+
+    boost::filesystem::path findDataFile( const string& path , const string& db , int n ) {
+        vector<boost::filesystem::path> dirs = dataFileDirs( path , db );
+        string leaf = leafName( db , n );
+        // the dbpath first: that's where everything from before --dataPaths is
+        for ( unsigned i = 0; i < dirs.size(); i++ ) {
+            boost::filesystem::path p = dirs[i] / leaf;
+            if ( boost::filesystem::exists( p ) )
+                return p;
+        }
+        return boost::filesystem::path();
+    }
+
+    boost::filesystem::path dataFilePath( const string& path , const string& db , int n ) {
+        vector<boost::filesystem::path> dirs = dataFileDirs( path , db );
+        string leaf = leafName( db , n );
+        if ( dirs.size() == 1 || n == 0 )
+            return dirs[0] / leaf;
+
+        boost::filesystem::path found = findDataFile( path , db , n );
+        if ( ! found.empty() )
+            return found;
+
+        unsigned pick = n % dirs.size();
+        if ( dataPathsByFreeSpace ) {
+            boost::uintmax_t most = 0;
+            for ( unsigned i = 0; i < dirs.size(); i++ ) {
+                boost::filesystem::path root = i == 0 ? boost::filesystem::path( path ) : boost::filesystem::path( dataPaths[i-1] );
+                boost::uintmax_t avail = 0;
+                MONGO_ASSERT_ON_EXCEPTION( avail = boost::filesystem::space( root ).available );
+                if ( avail > most ) {
+                    most = avail;
+                    pick = i;
+                }
+            }
+        }
+
+        if ( pick > 0 && directoryperdb && ! boost::filesystem::exists( dirs[pick] ) ) {
+            MONGO_ASSERT_ON_EXCEPTION_WITH_MSG( boost::filesystem::create_directory( dirs[pick] ), "create dir for db " );
+        }
+        return dirs[pick] / leaf;
+    }
+
+} // namespace mongo
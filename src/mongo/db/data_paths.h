@@ -0,0 +1,45 @@
+// data_paths.h
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <boost/filesystem/path.hpp>
+#include <string>
+#include <vector>
+
+namespace mongo {
+
+    /** --dataPaths: more directories for the data files, db.1 on, of databases under the dbpath;
+        db.0 and db.ns stay in the dbpath */
+    extern std::vector<std::string> dataPaths;
+
+    /** --dataPathPolicy: a new file goes to the directory with the most free space, rather than in
+        turn */
+    extern bool dataPathsByFreeSpace;
+
+    /** @return the directories db's data files may be in under path: path's own, then dataPaths' if
+        path is the dbpath, each with db's directory under it for --directoryperdb */
+    std::vector<boost::filesystem::path> dataFileDirs( const std::string& path , const std::string& db );
+
+    /** @return where db.n is, or an empty path if it isn't anywhere */
+    boost::filesystem::path findDataFile( const std::string& path , const std::string& db , int n );
+
+    /** @return where db.n is, or if there's none yet, where to make it */
+    boost::filesystem::path dataFilePath( const std::string& path , const std::string& db , int n );
+
+} // namespace mongo
@@ -22,6 +22,8 @@
 #include "instance.h"
 #include "clientcursor.h"
 #include "databaseholder.h"
+#include "mongo/db/data_paths.h"
+#include "../util/file_allocator.h"
 
 #include <boost/filesystem/operations.hpp>
 
@@ -50,6 +52,7 @@ namespace mongo {
     Database::~Database() {
         verify( Lock::isW() );
         magic = 0;
+        NamespaceCache::invalidate(); // its NamespaceIndex goes with it
         size_t n = _files.size();
         for ( size_t i = 0; i < n; i++ )
             delete _files[i];
@@ -59,7 +62,8 @@ namespace mongo {
     }
 
     Database::Database(const char *nm, bool& newDb, const string& _path )
-        : name(nm), path(_path), namespaceIndex( path, name ),
+        : name(nm), path(_path), _lastFileFilledMillis(0), _extentMutex("dbextents"),
+          namespaceIndex( path, name ),
           profileName(name + ".system.profile")
     {
         try {
@@ -86,6 +90,8 @@ namespace mongo {
                 }
 #endif
             }
+            if( Lock::collectionLockingEnabled() )
+                _files.reserve( DiskLoc::MaxFiles );
             newDb = namespaceIndex.exists();
             profile = cmdLine.defaultProfile;
             checkDuplicateUncasedNames(true);
@@ -161,14 +167,7 @@ namespace mongo {
     }
     
     boost::filesystem::path Database::fileName( int n ) const {
-        stringstream ss;
-        ss << name << '.' << n;
-        boost::filesystem::path fullName;
-        fullName = boost::filesystem::path(path);
-        if ( directoryperdb )
-            fullName /= name;
-        fullName /= ss.str();
-        return fullName;
+        return dataFilePath( path, name, n );
     }
 
     bool Database::openExistingFile( int n ) { 
@@ -265,7 +264,7 @@ namespace mongo {
             string fullNameString = fullName.string();
             p = new MongoDataFile(n);
             int minSize = 0;
-            if ( n != 0 && _files[ n - 1 ] )
+            if ( n != 0 && n - 1 < (int) _files.size() && _files[ n - 1 ] )
                 minSize = _files[ n - 1 ]->getHeader()->fileLength;
             if ( sizeNeeded + DataFileHeader::HeaderSize > minSize )
                 minSize = sizeNeeded + DataFileHeader::HeaderSize;
@@ -284,15 +283,46 @@ namespace mongo {
         return preallocateOnly ? 0 : p;
     }
 
+    /** most files preallocated ahead of the newest, when files fill faster than they allocate */
+    static const int MaxFilesAhead = 4;
+
     MongoDataFile* Database::addAFile( int sizeNeeded, bool preallocateNextFile ) {
         assertDbWriteLocked(this);
         int n = (int) _files.size();
+
+        // did the newest file fill up, or is this another one for an extent that didn't fit?
+        bool filled = false;
+        if ( n > 0 ) {
+            DataFileHeader *h = _files[ n - 1 ]->getHeader();
+            filled = h->unusedLength < h->fileLength / 2;
+        }
+
         MongoDataFile *ret = getFile( n, sizeNeeded );
-        if ( preallocateNextFile )
-            preallocateAFile();
+        if ( preallocateNextFile ) {
+            // the next file should be ready by the time this one fills.  if the last one filled
+            // in less time than a file takes to allocate, allocate further ahead.
+            int ahead = 1;
+            unsigned long long now = curTimeMillis64();
+            if ( filled && _lastFileFilledMillis && !cmdLine.quota ) {
+                unsigned long long fillMillis = now - _lastFileFilledMillis + 1;
+                ahead += (int) min( FileAllocator::get()->lastAllocationMillis() / fillMillis,
+                                    (unsigned long long) MaxFilesAhead - 1 );
+            }
+            if ( filled )
+                _lastFileFilledMillis = now;
+            preallocateFiles( ahead );
+        }
         return ret;
     }
 
+    void Database::preallocateFiles( int n ) {
+        for ( int i = 0; i < n && numFiles() + i < DiskLoc::MaxFiles; i++ ) {
+            if ( i > 0 )
+                LOG(1) << "preallocating " << fileName( numFiles() + i ).string() << " ahead" << endl;
+            getFile( numFiles() + i, 0, true );
+        }
+    }
+
     bool fileIndexExceedsQuota( const char *ns, int fileIndex, bool enforceQuota ) {
         return
             cmdLine.quota &&
@@ -350,6 +380,7 @@ namespace mongo {
 
 
     Extent* Database::allocExtent( const char *ns, int size, bool capped, bool enforceQuota ) {
+        SimpleMutex::scoped_lock lk(_extentMutex);
         // todo: when profiling, these may be worth logging into profile collection
         bool fromFreeList = true;
         Extent *e = DataFileMgr::allocFromFreeList( ns, size, capped );
@@ -392,7 +423,7 @@ namespace mongo {
     }
 
     bool Database::exists(int n) const { 
-        return boost::filesystem::exists( fileName( n ) ); 
+        return ! findDataFile( path, name, n ).empty(); 
     }
 
     int Database::numFiles() const { 
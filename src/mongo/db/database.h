@@ -87,6 +87,12 @@ namespace mongo {
          */
         void preallocateAFile() { getFile( numFiles() , 0, true ); }
 
+        /**
+         * makes sure we have n extra files at the end, and requests allocation of those we don't.
+         * safe to call this multiple times.
+         */
+        void preallocateFiles( int n );
+
         MongoDataFile* suitableFile( const char *ns, int sizeNeeded, bool preallocate, bool enforceQuota );
 
         Extent* allocExtent( const char *ns, int size, bool capped, bool enforceQuota );
@@ -131,8 +137,19 @@ namespace mongo {
         // must be in the dbLock when touching this (and write locked when writing to of course)
         // however during Database object construction we aren't, which is ok as it isn't yet visible
         //   to others and we are in the dbholder lock then.
+        // with --collectionLocks writers to two collections only intent lock the db, so files are
+        //   added in _extentMutex, and room for every file is reserved up front so that readers
+        //   never see the vector move.
         vector<MongoDataFile*> _files;
 
+        // when addAFile() last found the newest file filled up, for sizing the preallocation
+        // look ahead.  write locked.
+        unsigned long long _lastFileFilledMillis;
+
+        // held by allocExtent(): the free list, file headers and new files are shared by all the
+        // collections of a database.  only contended with --collectionLocks.
+        SimpleMutex _extentMutex;
+
     public: // this should be private later
 
         NamespaceIndex namespaceIndex;
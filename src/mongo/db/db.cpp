@@ -22,11 +22,13 @@
 #include <boost/filesystem/operations.hpp>
 #include <fstream>
 
+#include "mongo/db/admission.h"
 #include "mongo/db/client.h"
 #include "mongo/db/clientcursor.h"
 #include "mongo/db/cmdline.h"
 #include "mongo/db/d_concurrency.h"
 #include "mongo/db/d_globals.h"
+#include "mongo/db/data_paths.h"
 #include "mongo/db/db.h"
 #include "mongo/db/dbmessage.h"
 #include "mongo/db/dbwebserver.h"
@@ -34,14 +36,21 @@
 #include "mongo/db/instance.h"
 #include "mongo/db/introspect.h"
 #include "mongo/db/json.h"
+#include "mongo/db/lockstat.h"
+#include "mongo/db/lockstate.h"
 #include "mongo/db/module.h"
+#include "mongo/db/mongommf.h"
 #include "mongo/db/pdfile.h"
 #include "mongo/db/repl.h"
 #include "mongo/db/repl/rs.h"
+#include "mongo/db/reply_buffers.h"
 #include "mongo/db/restapi.h"
+#include "mongo/db/security.h"
 #include "mongo/db/stats/counters.h"
 #include "mongo/db/stats/snapshots.h"
 #include "mongo/db/ttl.h"
+#include "mongo/db/warm_restart.h"
+#include "mongo/s/d_logic.h"
 #include "mongo/s/d_writeback.h"
 #include "mongo/scripting/engine.h"
 #include "mongo/util/background.h"
@@ -51,7 +60,10 @@
 #include "mongo/util/ramlog.h"
 #include "mongo/util/stacktrace.h"
 #include "mongo/util/startup_test.h"
+#include "mongo/util/stringutils.h"
 #include "mongo/util/text.h"
+#include "mongo/util/timer.h"
+#include "mongo/util/trace_span.h"
 #include "mongo/util/version.h"
 
 #if defined(_WIN32)
@@ -180,15 +192,32 @@ namespace mongo {
         }
 
         virtual void process( Message& m , AbstractMessagingPort* port , LastError * le) {
+            bool received = true; // false for the getMores we make up for exhaust cursors
             while ( true ) {
                 if ( inShutdown() ) {
                     log() << "got request after shutdown()" << endl;
                     break;
                 }
 
+                unsigned long long lat[OpLatencyCounters::NPhases] = { 0 };
+                unsigned long long started = curTimeMicros64();
+                if ( received && port->recvStartMicros && port->recvEndMicros >= port->recvStartMicros ) {
+                    started = port->recvStartMicros;
+                    lat[OpLatencyCounters::Receive] = port->recvEndMicros - port->recvStartMicros;
+                    if ( port->queuedMicros && port->queuedMicros < started ) {
+                        lat[OpLatencyCounters::Queue] = started - port->queuedMicros;
+                        started = port->queuedMicros;
+                    }
+                }
+                OpKind kind = opKind( m.operation(), m.operation() == dbQuery ? DbMessage( m ).getns() : 0 );
+
+                if ( received )
+                    TraceSpans::beginRequest( port->recvStartMicros , port->recvEndMicros );
                 lastError.startRequest( m , le );
 
                 DbResponse dbresponse;
+                unsigned long long lockWaitBefore = LockStat::threadWaitMicros();
+                unsigned long long executeStart = curTimeMicros64();
                 try {
                     assembleResponse( m, dbresponse, port->remote() );
                 }
@@ -196,9 +225,17 @@ namespace mongo {
                     log() << "ClockSkewException - shutting down" << endl;
                     exitCleanly( EXIT_CLOCK_SKEW );
                 }
+                unsigned long long executeEnd = curTimeMicros64();
+                lat[OpLatencyCounters::LockWait] = LockStat::threadWaitMicros() - lockWaitBefore;
+                if ( executeEnd - executeStart > lat[OpLatencyCounters::LockWait] )
+                    lat[OpLatencyCounters::Execute] = executeEnd - executeStart - lat[OpLatencyCounters::LockWait];
 
                 if ( dbresponse.response ) {
                     port->reply(m, *dbresponse.response, dbresponse.responseTo);
+                    unsigned long long sent = curTimeMicros64();
+                    lat[OpLatencyCounters::Write] = sent - executeEnd;
+                    lat[OpLatencyCounters::Total] = sent - started;
+                    opLatencyCounters.record( kind, lat );
                     if( dbresponse.exhaust ) {
                         MsgData *header = dbresponse.response->header();
                         QueryResult *qr = (QueryResult *) header;
@@ -218,20 +255,61 @@ namespace mongo {
                             b.appendNum(cursorid);
                             m.appendData(b.buf(), b.len());
                             b.decouple();
+                            ReplyBuffers::recycle( *dbresponse.response );
                             DEV log() << "exhaust=true sending more" << endl;
                             beNice();
+                            received = false;
                             continue; // this goes back to top loop
                         }
                     }
+                    ReplyBuffers::recycle( *dbresponse.response );
+                }
+                else {
+                    lat[OpLatencyCounters::Total] = executeEnd - started;
+                    opLatencyCounters.record( kind, lat );
                 }
                 break;
             }
+            TraceSpans::endRequest();
         }
 
         virtual void disconnected( AbstractMessagingPort* p ) {
             Client * c = currentClient.get();
             if( c ) c->shutdown();
             globalScriptEngine->threadDone();
+
+            // a pooled worker thread goes on to serve other connections
+            currentClient.reset(0);
+            ShardedConnectionInfo::reset();
+            lastNonce.reset();
+        }
+
+        /** everything thread local which belongs to the connection rather than the thread */
+        struct ConnectionState {
+            Client *client;
+            ShardedConnectionInfo *sharding;
+            nonce64 *nonce;
+        };
+
+        virtual bool canDetach() const { return true; }
+
+        virtual void* detach() {
+            ConnectionState *s = new ConnectionState();
+            s->client = currentClient.release();
+            s->sharding = ShardedConnectionInfo::release();
+            s->nonce = lastNonce.release();
+            return s;
+        }
+
+        virtual void attach( void* state ) {
+            ConnectionState *s = static_cast<ConnectionState*>( state );
+            verify( currentClient.get() == 0 );
+            currentClient.reset( s->client );
+            ShardedConnectionInfo::set( s->sharding );
+            lastNonce.reset( s->nonce );
+            delete s;
+            string name = str::stream() << "conn" << currentClient.get()->getConnectionId();
+            setThreadName( name.c_str() );
         }
 
     };
@@ -241,6 +319,7 @@ namespace mongo {
         MessageServer::Options options;
         options.port = port;
         options.ipList = cmdLine.bind_ip;
+        options.workers = cmdLine.netWorkers;
 
         MessageServer * server = createServer( options , new MyMessageHandler() );
         server->setAsTimeTracker();
@@ -397,6 +476,60 @@ namespace mongo {
      * does background async flushes of mmapped files
      */
     class DataFileSync : public BackgroundJob {
+#if !defined(_WIN32)
+        /** flush the ranges of the data files written since the last pass, pacing ourself to about
+            --syncRateMB, rather than all at once.  only with journaling, where WRITETODATAFILES notes
+            what it writes.  the pass counts as a flushAll for the journal lsn once it finishes.
+            @return number of files flushed
+        */
+        int throttledFlush() {
+            typedef vector< pair<char*, size_t> > Ranges;
+            Ranges ranges;
+            unsigned long long total = 0;
+            int numFiles = 0;
+
+            MongoFile::notifyPreFlush();
+            {
+                LockMongoFilesShared lk;
+                set<MongoFile*>& files = MongoFile::getAllFiles();
+                for( set<MongoFile*>::iterator i = files.begin(); i != files.end(); ++i ) {
+                    if( !(*i)->isMongoMMF() )
+                        continue;
+                    unsigned long long n = ((MongoMMF*) *i)->takeWrittenRanges(ranges);
+                    if( n ) {
+                        total += n;
+                        numFiles++;
+                    }
+                }
+            }
+            globalFlushCounters.passStarted(total);
+
+            // we don't hold a lock while we flush; a view closed meanwhile was flushed by its close
+            const size_t Chunk = 1024 * 1024;
+            unsigned long long done = 0;
+            Timer t;
+            for( Ranges::iterator i = ranges.begin(); i != ranges.end(); ++i ) {
+                for( size_t ofs = 0; ofs < i->second; ofs += Chunk ) {
+                    if( inShutdown() )
+                        return numFiles; // files are all flushed at shutdown
+                    size_t len = std::min(Chunk, i->second - ofs);
+                    MemoryMappedFile::flushRange(i->first + ofs, len);
+                    done += len;
+                    globalFlushCounters.flushedSome(len);
+
+                    unsigned rate = cmdLine.syncRateMB;
+                    if( rate ) {
+                        long long ahead = (long long) (done * 1000000 / (rate * 1024ULL * 1024)) - t.micros();
+                        if( ahead > 0 )
+                            sleepmicros(ahead);
+                    }
+                }
+            }
+            MongoFile::notifyPostFlush();
+            return numFiles;
+        }
+#endif
+
     public:
         string name() const { return "DataFileSync"; }
         void run() {
@@ -424,7 +557,13 @@ namespace mongo {
                 }
 
                 Date_t start = jsTime();
-                int numFiles = MemoryMappedFile::flushAll( true );
+                int numFiles;
+#if !defined(_WIN32)
+                if( cmdLine.dur && cmdLine.syncRateMB )
+                    numFiles = throttledFlush();
+                else
+#endif
+                    numFiles = MemoryMappedFile::flushAll( true );
                 time_flushing = (int) (jsTime() - start);
 
                 globalFlushCounters.flushed(time_flushing);
@@ -533,6 +672,8 @@ namespace mongo {
         d.clientCursorMonitor.go();
         PeriodicTask::theRunner->go();
         startTTLBackgroundJob();
+        startWarmRestartJob();
+        startRangeDeleter();
 
 #ifndef _WIN32
         CmdLine::launchOk();
@@ -632,25 +773,38 @@ static int mongoDbMain(int argc, char* argv[]) {
 
     general_options.add_options()
     ("auth", "run with security")
+    ("collectionLocks", "lock collections beneath an intent lock on their database, so operations on different collections of a database run concurrently")
     ("cpu", "periodically show cpu and iowait utilization")
+    ("dataPathPolicy", po::value<string>(), "how --dataPaths are given new data files: roundRobin (default) or freeSpace")
+    ("dataPaths", po::value<string>(), "comma separated directories, on other volumes, to spread each database's data files across along with the dbpath")
+    ("dbLocks", po::value<string>(), "database lock implementation: rwlock (default) or bigreader, which scales better with many readers")
     ("dbpath", po::value<string>() , dbpathBuilder.str().c_str())
     ("diaglog", po::value<int>(), "0=off 1=W 2=R 3=both 7=W+some reads")
     ("directoryperdb", "each database will be stored in a separate directory")
+#if defined(__linux__)
+    ("hugePages", "advise the os to back data file mappings with transparent huge pages, where it supports them for files")
+#endif
     ("ipv6", "enable IPv6 support (disabled by default)")
     ("journal", "enable journaling")
     ("journalCommitInterval", po::value<unsigned>(), "how often to group/batch commit (ms)")
+    ("journalCompressor", po::value<string>(), "compression for journal sections: snappy (default) or none")
     ("journalOptions", po::value<int>(), "journal diagnostic options")
     ("jsonp","allow JSONP access via http (has security implications)")
     ("noauth", "run without security")
     ("nohttpinterface", "disable http interface")
+    ("netWorkers", po::value<int>(&cmdLine.netWorkers)->default_value(0), "serve connections from this many threads, waiting for their messages with epoll, instead of a thread each (linux only; 0=a thread per connection)")
     ("nojournal", "disable journaling (journaling is on by default for 64 bit)")
     ("noprealloc", "disable data file preallocation - will often hurt performance")
     ("noscripting", "disable scripting engine")
     ("notablescan", "do not allow table scans")
     ("nssize", po::value<int>()->default_value(16), ".ns file size (in MB) for new databases")
+#if defined(__linux__)
+    ("numa", po::value<string>(), "where data file pages are put on a NUMA host: interleave (across all nodes), local (the node that reads them first) or default")
+#endif
     ("profile",po::value<int>(), "0=off 1=slow, 2=all")
     ("quota", "limits each database to a certain number of files (8 default)")
     ("quotaFiles", po::value<int>(), "number of files allowed per db, requires --quota")
+    ("readTickets", po::value<int>(), "most queries and getMores to run at once, the rest wait before locking (0=no limit)")
     ("repair", "run repair on all dbs")
     ("repairpath", po::value<string>() , "root directory for repair files - defaults to dbpath" )
     ("rest","turn on simple rest api")
@@ -660,8 +814,12 @@ static int mongoDbMain(int argc, char* argv[]) {
     ("slowms",po::value<int>(&cmdLine.slowMS)->default_value(100), "value of slow for profile and console log" )
     ("smallfiles", "use a smaller default file size")
     ("syncdelay",po::value<double>(&cmdLine.syncdelay)->default_value(60), "seconds between disk syncs (0=never, but not recommended)")
+    ("syncRateMB",po::value<unsigned>(&cmdLine.syncRateMB)->default_value(0), "with journaling, flush data files continuously at up to this many MB/s instead of all at once every syncdelay (0=off)")
     ("sysinfo", "print some diagnostic system information")
     ("upgrade", "upgrade db if needed")
+    ("warmRestartRateMB", po::value<int>(&warmRestartRateMB)->default_value(64), "how fast to read the hot regions back in at startup, in MB/s (0=no limit)")
+    ("warmRestartSecs", po::value<int>(&warmRestartSecs)->default_value(0), "every this many seconds note which regions of the data files are in memory, and read them back in at startup (0=off)")
+    ("writeTickets", po::value<int>(), "most inserts, updates and deletes to run at once, the rest wait before locking (0=no limit)")
     ;
 
 #if defined(_WIN32)
@@ -785,6 +943,29 @@ static int mongoDbMain(int argc, char* argv[]) {
         if ( params.count("directoryperdb")) {
             directoryperdb = true;
         }
+        if ( params.count("dataPaths") ) {
+            splitStringDelim( params["dataPaths"].as<string>(), &dataPaths, ',' );
+            for ( unsigned i = 0; i < dataPaths.size(); i++ ) {
+                if ( ! boost::filesystem::is_directory( dataPaths[i] ) ) {
+                    out() << "--dataPaths: " << dataPaths[i] << " is not a directory" << endl;
+                    dbexit( EXIT_BADOPTIONS );
+                }
+                if ( boost::filesystem::exists( dbpath ) && boost::filesystem::equivalent( dataPaths[i], dbpath ) ) {
+                    out() << "--dataPaths: " << dataPaths[i] << " is the dbpath" << endl;
+                    dbexit( EXIT_BADOPTIONS );
+                }
+            }
+        }
+        if ( params.count("dataPathPolicy") ) {
+            string policy = params["dataPathPolicy"].as<string>();
+            if ( policy == "freeSpace" ) {
+                dataPathsByFreeSpace = true;
+            }
+            else if ( policy != "roundRobin" ) {
+                out() << "--dataPathPolicy must be roundRobin or freeSpace" << endl;
+                dbexit( EXIT_BADOPTIONS );
+            }
+        }
         if (params.count("cpu")) {
             cmdLine.cpu = true;
         }
@@ -826,6 +1007,13 @@ static int mongoDbMain(int argc, char* argv[]) {
                 dbexit( EXIT_BADOPTIONS );
             }
         }
+        if( params.count("journalCompressor") ) {
+            cmdLine.journalCompressor = params["journalCompressor"].as<string>();
+            if( cmdLine.journalCompressor != "snappy" && cmdLine.journalCompressor != "none" ) {
+                out() << "--journalCompressor must be snappy or none" << endl;
+                dbexit( EXIT_BADOPTIONS );
+            }
+        }
         if (params.count("journalOptions")) {
             cmdLine.durOptions = params["journalOptions"].as<int>();
         }
@@ -859,6 +1047,54 @@ static int mongoDbMain(int argc, char* argv[]) {
         if (params.count("noscripting")) {
             scriptingEnabled = false;
         }
+        if (params.count("readTickets")) {
+            int n = params["readTickets"].as<int>();
+            if ( n < 0 ) {
+                out() << "--readTickets must be >= 0" << endl;
+                dbexit( EXIT_BADOPTIONS );
+            }
+            AdmissionTicket::setPoolSize( AdmissionTicket::Read, n );
+        }
+        if (params.count("writeTickets")) {
+            int n = params["writeTickets"].as<int>();
+            if ( n < 0 ) {
+                out() << "--writeTickets must be >= 0" << endl;
+                dbexit( EXIT_BADOPTIONS );
+            }
+            AdmissionTicket::setPoolSize( AdmissionTicket::Write, n );
+        }
+        if (params.count("collectionLocks")) {
+            Lock::useCollectionLocks();
+        }
+        if (params.count("dbLocks")) {
+            string impl = params["dbLocks"].as<string>();
+            if ( impl == "bigreader" ) {
+                WrapperForRWLock::useBigReader();
+            }
+            else if ( impl != "rwlock" ) {
+                out() << "unknown --dbLocks implementation " << impl << endl;
+                dbexit( EXIT_BADOPTIONS );
+            }
+        }
+        if (params.count("hugePages")) {
+            MemoryMappedFile::hugePages = true;
+        }
+        if (params.count("numa")) {
+            string policy = params["numa"].as<string>();
+            if ( policy == "interleave" ) {
+                MemoryMappedFile::numaPolicy = MemoryMappedFile::NumaInterleave;
+            }
+            else if ( policy == "local" ) {
+                MemoryMappedFile::numaPolicy = MemoryMappedFile::NumaLocal;
+            }
+            else if ( policy != "default" ) {
+                out() << "--numa must be interleave, local or default" << endl;
+                dbexit( EXIT_BADOPTIONS );
+            }
+            // before the server's threads start, so they all have it. a container may not allow
+            // it, which leaves the os's placement, with a warning
+            MemoryMappedFile::applyNumaPolicy();
+        }
         if (params.count("noprealloc")) {
             cmdLine.prealloc = false;
             cout << "note: noprealloc may hurt performance in many applications" << endl;
@@ -50,23 +50,355 @@
 #include "dur_stats.h"
 #include "../server.h"
 #include "mongo/s/d_index_locator.h"
+#include "mongo/s/d_logic.h"
+#include "mongo/db/admission.h"
+#include "mongo/db/dbhelpers.h"
+#include "mongo/db/lockstat.h"
+#include "mongo/db/reply_buffers.h"
+#include "mongo/db/stats/namespace_io.h"
+#include "mongo/db/stats/working_set.h"
+#include "mongo/util/arena.h"
+#include "mongo/util/mem_accounting.h"
 #include "mongo/db/index_update.h"
+#include "mongo/db/pipeline/document_source.h"
+#include "mongo/db/prefetch.h"
+#include "mongo/db/record_checksums.h"
+#include "mongo/db/repl/bgsync.h"
+#include "mongo/db/repl/rs_sync.h"
+#include "mongo/db/time_partitions.h"
+#include "mongo/db/ttl.h"
+#include "mongo/db/warm_restart.h"
 
 namespace mongo {
 
     namespace dur { 
         void setAgeOutJournalFiles(bool rotate);
     }
+    extern int replInitialSyncThreads;
+    extern int mapReduceThreads;
+    extern int jsPooledScopesPerDb;
+    extern int aggregationThreads;
     /** @return true if fields found */
     bool setParmsMongodSpecific(const string& dbname, BSONObj& cmdObj, string& errmsg, BSONObjBuilder& result, bool fromRepl ) { 
+        bool found = false;
         BSONElement e = cmdObj["ageOutJournalFiles"];
         if( !e.eoo() ) {
             bool r = e.trueValue();
             log() << "ageOutJournalFiles " << r << endl;
             dur::setAgeOutJournalFiles(r);
-            return true;
+            found = true;
+        }
+        e = cmdObj["replIndexPrefetch"];
+        if( !e.eoo() ) {
+            IndexPrefetchMode mode;
+            if( e.type() != String || !parseIndexPrefetchMode(e.String(), &mode) ) {
+                errmsg = "replIndexPrefetch must be one of \"none\", \"_id_only\" or \"all\"";
+                return false;
+            }
+            result.append("was", indexPrefetchModeName(replIndexPrefetch));
+            replIndexPrefetch = mode;
+            log() << "setParameter replIndexPrefetch=" << indexPrefetchModeName(mode) << endl;
+            found = true;
+        }
+        e = cmdObj["replPrefetchDepth"];
+        if( !e.eoo() ) {
+            if( !e.isNumber() || e.numberLong() < 0 || e.numberLong() > 100000 ) {
+                errmsg = "replPrefetchDepth has to be >= 0 and <= 100000";
+                return false;
+            }
+            result.append("was", (int) replPrefetchDepth);
+            replPrefetchDepth = (unsigned) e.numberLong();
+            log() << "setParameter replPrefetchDepth=" << replPrefetchDepth << endl;
+            found = true;
+        }
+        e = cmdObj["replApplySliceOps"];
+        if( !e.eoo() ) {
+            if( !e.isNumber() || e.numberLong() < 0 || e.numberLong() > 100000 ) {
+                errmsg = "replApplySliceOps has to be >= 0 and <= 100000";
+                return false;
+            }
+            result.append("was", (int) replApplySliceOps);
+            replApplySliceOps = (unsigned) e.numberLong();
+            log() << "setParameter replApplySliceOps=" << replApplySliceOps << endl;
+            found = true;
+        }
+        e = cmdObj["replInitialSyncThreads"];
+        if( !e.eoo() ) {
+            if( !e.isNumber() || e.numberLong() < 1 || e.numberLong() > 64 ) {
+                errmsg = "replInitialSyncThreads has to be >= 1 and <= 64";
+                return false;
+            }
+            result.append("was", replInitialSyncThreads);
+            replInitialSyncThreads = e.numberInt();
+            log() << "setParameter replInitialSyncThreads=" << replInitialSyncThreads << endl;
+            found = true;
+        }
+        e = cmdObj["mapReduceThreads"];
+        if( !e.eoo() ) {
+            if( !e.isNumber() || e.numberLong() < 1 || e.numberLong() > 64 ) {
+                errmsg = "mapReduceThreads has to be >= 1 and <= 64";
+                return false;
+            }
+            result.append("was", mapReduceThreads);
+            mapReduceThreads = e.numberInt();
+            log() << "setParameter mapReduceThreads=" << mapReduceThreads << endl;
+            found = true;
+        }
+        e = cmdObj["jsPooledScopesPerDb"];
+        if( !e.eoo() ) {
+            if( !e.isNumber() || e.numberLong() < 0 || e.numberLong() > 100 ) {
+                errmsg = "jsPooledScopesPerDb has to be >= 0 and <= 100";
+                return false;
+            }
+            result.append("was", jsPooledScopesPerDb);
+            jsPooledScopesPerDb = e.numberInt();
+            log() << "setParameter jsPooledScopesPerDb=" << jsPooledScopesPerDb << endl;
+            found = true;
+        }
+        e = cmdObj["aggregationThreads"];
+        if( !e.eoo() ) {
+            if( !e.isNumber() || e.numberLong() < 1 || e.numberLong() > 64 ) {
+                errmsg = "aggregationThreads has to be >= 1 and <= 64";
+                return false;
+            }
+            result.append("was", aggregationThreads);
+            aggregationThreads = e.numberInt();
+            log() << "setParameter aggregationThreads=" << aggregationThreads << endl;
+            found = true;
+        }
+        e = cmdObj["oplogCompression"];
+        if( !e.eoo() ) {
+            result.append("was", oplogCompression);
+            oplogCompression = e.trueValue();
+            log() << "setParameter oplogCompression=" << oplogCompression << endl;
+            found = true;
+        }
+        e = cmdObj["oplogPreImages"];
+        if( !e.eoo() ) {
+            result.append("was", oplogPreImages);
+            oplogPreImages = e.trueValue();
+            log() << "setParameter oplogPreImages=" << oplogPreImages << endl;
+            found = true;
+        }
+        e = cmdObj["aggregationSortMemoryLimitBytes"];
+        if( !e.eoo() ) {
+            if( !e.isNumber() || e.numberLong() <= 0 ) {
+                errmsg = "aggregationSortMemoryLimitBytes has to be > 0";
+                return false;
+            }
+            result.append("was", (long long) DocumentSourceSort::maxMemoryUsageBytes);
+            DocumentSourceSort::maxMemoryUsageBytes = (size_t) e.numberLong();
+            log() << "setParameter aggregationSortMemoryLimitBytes=" << DocumentSourceSort::maxMemoryUsageBytes << endl;
+            found = true;
+        }
+        e = cmdObj["aggregationGroupMemoryLimitBytes"];
+        if( !e.eoo() ) {
+            if( !e.isNumber() || e.numberLong() <= 0 ) {
+                errmsg = "aggregationGroupMemoryLimitBytes has to be > 0";
+                return false;
+            }
+            result.append("was", (long long) DocumentSourceGroup::maxMemoryUsageBytes);
+            DocumentSourceGroup::maxMemoryUsageBytes = (size_t) e.numberLong();
+            log() << "setParameter aggregationGroupMemoryLimitBytes=" << DocumentSourceGroup::maxMemoryUsageBytes << endl;
+            found = true;
+        }
+        e = cmdObj["syncRateMB"];
+        if( !e.eoo() ) {
+            if( !e.isNumber() || e.numberLong() < 0 ) {
+                errmsg = "syncRateMB has to be >= 0";
+                return false;
+            }
+            result.append("was", (int) cmdLine.syncRateMB);
+            cmdLine.syncRateMB = (unsigned) e.numberLong();
+            log() << "setParameter syncRateMB=" << cmdLine.syncRateMB << endl;
+            found = true;
+        }
+        e = cmdObj["lockHolderSampling"];
+        if( !e.eoo() ) {
+            result.append("was", LockStat::sampleHolders);
+            LockStat::sampleHolders = e.trueValue();
+            log() << "setParameter lockHolderSampling=" << LockStat::sampleHolders << endl;
+            found = true;
+        }
+        e = cmdObj["rangeDeleterBatchSize"];
+        if( !e.eoo() ) {
+            if( !e.isNumber() || e.numberLong() <= 0 ) {
+                errmsg = "rangeDeleterBatchSize has to be > 0";
+                return false;
+            }
+            result.append("was", rangeDeleterBatchSize);
+            rangeDeleterBatchSize = e.numberInt();
+            log() << "setParameter rangeDeleterBatchSize=" << rangeDeleterBatchSize << endl;
+            found = true;
+        }
+        e = cmdObj["rangeDeleterMaxDocsPerSec"];
+        if( !e.eoo() ) {
+            if( !e.isNumber() || e.numberLong() < 0 ) {
+                errmsg = "rangeDeleterMaxDocsPerSec has to be >= 0";
+                return false;
+            }
+            result.append("was", rangeDeleterMaxDocsPerSec);
+            rangeDeleterMaxDocsPerSec = e.numberInt();
+            log() << "setParameter rangeDeleterMaxDocsPerSec=" << rangeDeleterMaxDocsPerSec << endl;
+            found = true;
+        }
+        e = cmdObj["recordChecksumSampleRate"];
+        if( !e.eoo() ) {
+            if( !e.isNumber() || e.numberLong() < 0 || e.numberLong() > 0x7fffffff ) {
+                errmsg = "recordChecksumSampleRate has to be >= 0";
+                return false;
+            }
+            result.append("was", recordChecksumSampleRate);
+            recordChecksumSampleRate = e.numberInt();
+            log() << "setParameter recordChecksumSampleRate=" << recordChecksumSampleRate << endl;
+            found = true;
+        }
+        e = cmdObj["ttlBatchSize"];
+        if( !e.eoo() ) {
+            if( !e.isNumber() || e.numberLong() <= 0 || e.numberLong() > 1000000 ) {
+                errmsg = "ttlBatchSize has to be > 0 and <= 1000000";
+                return false;
+            }
+            result.append("was", ttlBatchSize);
+            ttlBatchSize = e.numberInt();
+            log() << "setParameter ttlBatchSize=" << ttlBatchSize << endl;
+            found = true;
+        }
+        e = cmdObj["ttlMaxDocsPerSec"];
+        if( !e.eoo() ) {
+            if( !e.isNumber() || e.numberLong() < 0 ) {
+                errmsg = "ttlMaxDocsPerSec has to be >= 0";
+                return false;
+            }
+            result.append("was", ttlMaxDocsPerSec);
+            ttlMaxDocsPerSec = e.numberInt();
+            log() << "setParameter ttlMaxDocsPerSec=" << ttlMaxDocsPerSec << endl;
+            found = true;
+        }
+        e = cmdObj["warmRestartSecs"];
+        if( !e.eoo() ) {
+            if( !e.isNumber() || e.numberLong() < 0 ) {
+                errmsg = "warmRestartSecs has to be >= 0";
+                return false;
+            }
+            result.append("was", warmRestartSecs);
+            warmRestartSecs = e.numberInt();
+            log() << "setParameter warmRestartSecs=" << warmRestartSecs << endl;
+            found = true;
         }
-        return false;
+        e = cmdObj["warmRestartRateMB"];
+        if( !e.eoo() ) {
+            if( !e.isNumber() || e.numberLong() < 0 ) {
+                errmsg = "warmRestartRateMB has to be >= 0";
+                return false;
+            }
+            result.append("was", warmRestartRateMB);
+            warmRestartRateMB = e.numberInt();
+            log() << "setParameter warmRestartRateMB=" << warmRestartRateMB << endl;
+            found = true;
+        }
+        e = cmdObj["ttlMonitorSleepSecs"];
+        if( !e.eoo() ) {
+            if( !e.isNumber() || e.numberLong() < 1 || e.numberLong() > 3600 ) {
+                errmsg = "ttlMonitorSleepSecs has to be >= 1 and <= 3600";
+                return false;
+            }
+            result.append("was", ttlMonitorSleepSecs);
+            ttlMonitorSleepSecs = e.numberInt();
+            log() << "setParameter ttlMonitorSleepSecs=" << ttlMonitorSleepSecs << endl;
+            found = true;
+        }
+        return found;
+    }
+
+    /** @return true if fields found */
+    bool getParmsMongodSpecific(BSONObj& cmdObj, bool all, BSONObjBuilder& result) {
+        bool found = false;
+        if( all || cmdObj.hasElement("replIndexPrefetch") ) {
+            result.append("replIndexPrefetch", indexPrefetchModeName(replIndexPrefetch));
+            found = true;
+        }
+        if( all || cmdObj.hasElement("replPrefetchDepth") ) {
+            result.append("replPrefetchDepth", (int) replPrefetchDepth);
+            found = true;
+        }
+        if( all || cmdObj.hasElement("replApplySliceOps") ) {
+            result.append("replApplySliceOps", (int) replApplySliceOps);
+            found = true;
+        }
+        if( all || cmdObj.hasElement("replInitialSyncThreads") ) {
+            result.append("replInitialSyncThreads", replInitialSyncThreads);
+            found = true;
+        }
+        if( all || cmdObj.hasElement("mapReduceThreads") ) {
+            result.append("mapReduceThreads", mapReduceThreads);
+            found = true;
+        }
+        if( all || cmdObj.hasElement("jsPooledScopesPerDb") ) {
+            result.append("jsPooledScopesPerDb", jsPooledScopesPerDb);
+            found = true;
+        }
+        if( all || cmdObj.hasElement("aggregationThreads") ) {
+            result.append("aggregationThreads", aggregationThreads);
+            found = true;
+        }
+        if( all || cmdObj.hasElement("oplogCompression") ) {
+            result.append("oplogCompression", oplogCompression);
+            found = true;
+        }
+        if( all || cmdObj.hasElement("oplogPreImages") ) {
+            result.append("oplogPreImages", oplogPreImages);
+            found = true;
+        }
+        if( all || cmdObj.hasElement("aggregationSortMemoryLimitBytes") ) {
+            result.append("aggregationSortMemoryLimitBytes", (long long) DocumentSourceSort::maxMemoryUsageBytes);
+            found = true;
+        }
+        if( all || cmdObj.hasElement("aggregationGroupMemoryLimitBytes") ) {
+            result.append("aggregationGroupMemoryLimitBytes", (long long) DocumentSourceGroup::maxMemoryUsageBytes);
+            found = true;
+        }
+        if( all || cmdObj.hasElement("syncRateMB") ) {
+            result.append("syncRateMB", (int) cmdLine.syncRateMB);
+            found = true;
+        }
+        if( all || cmdObj.hasElement("lockHolderSampling") ) {
+            result.append("lockHolderSampling", LockStat::sampleHolders);
+            found = true;
+        }
+        if( all || cmdObj.hasElement("rangeDeleterBatchSize") ) {
+            result.append("rangeDeleterBatchSize", rangeDeleterBatchSize);
+            found = true;
+        }
+        if( all || cmdObj.hasElement("rangeDeleterMaxDocsPerSec") ) {
+            result.append("rangeDeleterMaxDocsPerSec", rangeDeleterMaxDocsPerSec);
+            found = true;
+        }
+        if( all || cmdObj.hasElement("recordChecksumSampleRate") ) {
+            result.append("recordChecksumSampleRate", recordChecksumSampleRate);
+            found = true;
+        }
+        if( all || cmdObj.hasElement("ttlBatchSize") ) {
+            result.append("ttlBatchSize", ttlBatchSize);
+            found = true;
+        }
+        if( all || cmdObj.hasElement("ttlMaxDocsPerSec") ) {
+            result.append("ttlMaxDocsPerSec", ttlMaxDocsPerSec);
+            found = true;
+        }
+        if( all || cmdObj.hasElement("ttlMonitorSleepSecs") ) {
+            result.append("ttlMonitorSleepSecs", ttlMonitorSleepSecs);
+            found = true;
+        }
+        if( all || cmdObj.hasElement("warmRestartSecs") ) {
+            result.append("warmRestartSecs", warmRestartSecs);
+            found = true;
+        }
+        if( all || cmdObj.hasElement("warmRestartRateMB") ) {
+            result.append("warmRestartRateMB", warmRestartRateMB);
+            found = true;
+        }
+        return found;
     }
 
     /* reset any errors so that getlasterror comes back clean.
@@ -104,6 +436,105 @@ namespace mongo {
     */
     BSONObj *getLastErrorDefault = 0;
 
+    bool awaitWriteConcern( const BSONObj& cmdObj, bool hadError, BSONObjBuilder& result, string& errmsg ) {
+        Client& c = cc();
+
+        if ( cmdObj["j"].trueValue() ) { 
+            if( !getDur().awaitCommit() ) {
+                // --journal is off
+                result.append("jnote", "journaling not enabled on this server");
+            }
+            if( cmdObj["fsync"].trueValue() ) { 
+                errmsg = "fsync and j options are not used together";
+                return false;
+            }
+        }
+        else if ( cmdObj["fsync"].trueValue() ) {
+            Timer t;
+            if( !getDur().awaitCommit() ) {
+                // if get here, not running with --journal
+                log() << "fsync from getlasterror" << endl;
+                result.append( "fsyncFiles" , MemoryMappedFile::flushAll( true ) );
+            }
+            else {
+                // this perhaps is temp.  how long we wait for the group commit to occur.
+                result.append( "waited", t.millis() );
+            }
+        }
+
+        if ( hadError ) {
+            // doesn't make sense to wait for replication
+            // if there was an error
+            return true;
+        }
+
+        BSONElement e = cmdObj["w"];
+        if ( e.ok() ) {
+            int timeout = cmdObj["wtimeout"].numberInt();
+            Timer t;
+
+            long long passes = 0;
+            char buf[32];
+            while ( 1 ) {
+                OpTime op(c.getLastOp());
+                
+                if ( op.isNull() ) {
+                    if ( anyReplEnabled() ) {
+                        result.append( "wnote" , "no write has been done on this connection" );
+                    }
+                    else if ( e.isNumber() && e.numberInt() <= 1 ) {
+                        // don't do anything
+                        // w=1 and no repl, so this is fine
+                    }
+                    else {
+                        // w=2 and no repl
+                        result.append( "wnote" , "no replication has been enabled, so w=2+ won't work" );
+                        result.append( "err", "norepl" );
+                        return true; 
+                    }
+                    break;
+                }
+
+                // check this first for w=0 or w=1
+                if ( opReplicatedEnough( op, e ) ) {
+                    break;
+                }
+
+                // if replication isn't enabled (e.g., config servers)
+                if ( ! anyReplEnabled() ) {
+                    result.append( "err", "norepl" );
+                    return true;
+                }
+
+
+                if ( timeout > 0 && t.millis() >= timeout ) {
+                    result.append( "wtimeout" , true );
+                    errmsg = "timed out waiting for slaves";
+                    result.append( "waited" , t.millis() );
+                    result.append( "err" , "timeout" );
+                    return true;
+                }
+
+                verify( sprintf( buf , "w block pass: %lld" , ++passes ) < 30 );
+                c.curop()->setMessage( buf );
+
+                // woken as soon as a slave reports reaching op; the slices bound how long a
+                // kill, or a stepdown which needs no slave to report, goes unnoticed
+                int wait = 100;
+                if ( timeout > 0 )
+                    wait = max( 1, min( wait, timeout - t.millis() ) );
+                if ( awaitReplication( op, e, wait ) ) {
+                    break;
+                }
+                killCurrentOp.checkForInterrupt();
+            }
+            result.appendNumber( "wtime" , t.millis() );
+        }
+
+        result.appendNull( "err" );
+        return true;
+    }
+
     class CmdGetLastError : public Command {
     public:
         CmdGetLastError() : Command("getLastError", false, "getlasterror") { }
@@ -148,92 +579,7 @@ namespace mongo {
                 }
             }
 
-            if ( cmdObj["j"].trueValue() ) { 
-                if( !getDur().awaitCommit() ) {
-                    // --journal is off
-                    result.append("jnote", "journaling not enabled on this server");
-                }
-                if( cmdObj["fsync"].trueValue() ) { 
-                    errmsg = "fsync and j options are not used together";
-                    return false;
-                }
-            }
-            else if ( cmdObj["fsync"].trueValue() ) {
-                Timer t;
-                if( !getDur().awaitCommit() ) {
-                    // if get here, not running with --journal
-                    log() << "fsync from getlasterror" << endl;
-                    result.append( "fsyncFiles" , MemoryMappedFile::flushAll( true ) );
-                }
-                else {
-                    // this perhaps is temp.  how long we wait for the group commit to occur.
-                    result.append( "waited", t.millis() );
-                }
-            }
-
-            if ( err ) {
-                // doesn't make sense to wait for replication
-                // if there was an error
-                return true;
-            }
-
-            BSONElement e = cmdObj["w"];
-            if ( e.ok() ) {
-                int timeout = cmdObj["wtimeout"].numberInt();
-                Timer t;
-
-                long long passes = 0;
-                char buf[32];
-                while ( 1 ) {
-                    OpTime op(c.getLastOp());
-                    
-                    if ( op.isNull() ) {
-                        if ( anyReplEnabled() ) {
-                            result.append( "wnote" , "no write has been done on this connection" );
-                        }
-                        else if ( e.isNumber() && e.numberInt() <= 1 ) {
-                            // don't do anything
-                            // w=1 and no repl, so this is fine
-                        }
-                        else {
-                            // w=2 and no repl
-                            result.append( "wnote" , "no replication has been enabled, so w=2+ won't work" );
-                            result.append( "err", "norepl" );
-                            return true; 
-                        }
-                        break;
-                    }
-
-                    // check this first for w=0 or w=1
-                    if ( opReplicatedEnough( op, e ) ) {
-                        break;
-                    }
-
-                    // if replication isn't enabled (e.g., config servers)
-                    if ( ! anyReplEnabled() ) {
-                        result.append( "err", "norepl" );
-                        return true;
-                    }
-
-
-                    if ( timeout > 0 && t.millis() >= timeout ) {
-                        result.append( "wtimeout" , true );
-                        errmsg = "timed out waiting for slaves";
-                        result.append( "waited" , t.millis() );
-                        result.append( "err" , "timeout" );
-                        return true;
-                    }
-
-                    verify( sprintf( buf , "w block pass: %lld" , ++passes ) < 30 );
-                    c.curop()->setMessage( buf );
-                    sleepmillis(1);
-                    killCurrentOp.checkForInterrupt();
-                }
-                result.appendNumber( "wtime" , t.millis() );
-            }
-
-            result.appendNull( "err" );
-            return true;
+            return awaitWriteConcern( cmdObj, err, result, errmsg );
         }
     } cmdGetLastError;
 
@@ -444,7 +790,22 @@ namespace mongo {
         virtual LockType locktype() const { return NONE; }
 
         virtual void help( stringstream& help ) const {
-            help << "returns lots of administrative server statistics";
+            help << "returns lots of administrative server statistics.  { sections : [ ... ] } limits it to the sections named";
+        }
+
+        /**
+         * with a sections array, only those sections are generated, so that frequent pollers
+         * like mongostat don't pay for the rest.  the fields before the sections always are.
+         */
+        static bool wanted( const BSONObj& cmdObj , const char *section ) {
+            BSONElement sections = cmdObj["sections"];
+            if ( sections.type() != Array )
+                return true;
+            BSONForEach( e , sections.Obj() ) {
+                if ( e.type() == String && str::equals( e.valuestr() , section ) )
+                    return true;
+            }
+            return false;
         }
 
         bool run(const string& dbname, BSONObj& cmdObj, int, string& errmsg, BSONObjBuilder& result, bool fromRepl) {
@@ -463,9 +824,10 @@ namespace mongo {
             result.append("uptimeEstimate",(double) (start/1000));
             result.appendDate( "localTime" , jsTime() );
 
-            reportLockStats(result);
+            if ( wanted( cmdObj , "locks" ) )
+                reportLockStats(result);
 
-            {
+            if ( wanted( cmdObj , "globalLock" ) ) {
                 BSONObjBuilder t;
 
                 unsigned long long last, start, timeLocked;
@@ -497,13 +859,15 @@ namespace mongo {
                     ttt.done();
                 }
 
+                AdmissionTicket::appendStats( t );
+
 
 
                 result.append( "globalLock" , t.obj() );
             }
             timeBuilder.appendNumber( "after basic" , Listener::getElapsedTimeMillis() - start );
 
-            {
+            if ( wanted( cmdObj , "mem" ) ) {
                 BSONObjBuilder t( result.subobjStart( "mem" ) );
 
                 t.append("bits",  ( sizeof(int*) == 4 ? 32 : 64 ) );
@@ -530,6 +894,12 @@ namespace mongo {
                     m *= 2;
                     t.appendNumber( "mappedWithJournal" , m );
                 }
+
+                {
+                    BSONObjBuilder pb( t.subobjStart( "placement" ) );
+                    MemoryMappedFile::appendPlacementStats( pb );
+                    pb.done();
+                }
                 
                 int overhead = v - m - connTicketHolder.used();
 
@@ -543,7 +913,7 @@ namespace mongo {
             }
             timeBuilder.appendNumber( "after mem" , Listener::getElapsedTimeMillis() - start );
 
-            {
+            if ( wanted( cmdObj , "connections" ) ) {
                 BSONObjBuilder bb( result.subobjStart( "connections" ) );
                 bb.append( "current" , connTicketHolder.used() );
                 bb.append( "available" , connTicketHolder.available() );
@@ -551,7 +921,7 @@ namespace mongo {
             }
             timeBuilder.appendNumber( "after connections" , Listener::getElapsedTimeMillis() - start );
 
-            {
+            if ( wanted( cmdObj , "extra_info" ) ) {
                 BSONObjBuilder bb( result.subobjStart( "extra_info" ) );
                 bb.append("note", "fields vary by platform");
                 ProcessInfo p;
@@ -561,36 +931,124 @@ namespace mongo {
 
             }
 
-            {
+            if ( wanted( cmdObj , "indexCounters" ) ) {
                 BSONObjBuilder bb( result.subobjStart( "indexCounters" ) );
                 globalIndexCounters.append( bb );
                 bb.done();
             }
 
-            {
+            if ( wanted( cmdObj , "backgroundFlushing" ) ) {
                 BSONObjBuilder bb( result.subobjStart( "backgroundFlushing" ) );
                 globalFlushCounters.append( bb );
                 bb.done();
             }
 
-            {
+            if ( wanted( cmdObj , "cursors" ) ) {
                 BSONObjBuilder bb( result.subobjStart( "cursors" ) );
                 ClientCursor::appendStats( bb );
                 bb.done();
             }
 
-            {
+            if ( wanted( cmdObj , "queryResultCache" ) ) {
+                BSONObjBuilder bb( result.subobjStart( "queryResultCache" ) );
+                QueryResultCache::appendGlobalStats( bb );
+                bb.done();
+            }
+
+            if ( wanted( cmdObj , "requestArena" ) ) {
+                BSONObjBuilder bb( result.subobjStart( "requestArena" ) );
+                Arena::appendStats( bb );
+                bb.done();
+            }
+
+            if ( wanted( cmdObj , "memAccounting" ) ) {
+                BSONObjBuilder bb( result.subobjStart( "memAccounting" ) );
+                MemAccounting::appendStats( bb );
+                bb.done();
+            }
+
+            if ( wanted( cmdObj , "replyBuffers" ) ) {
+                BSONObjBuilder bb( result.subobjStart( "replyBuffers" ) );
+                ReplyBuffers::appendStats( bb );
+                bb.done();
+            }
+
+            if ( wanted( cmdObj , "mutexContention" ) ) {
+                BSONObjBuilder bb( result.subobjStart( "mutexContention" ) );
+                vector<MutexContention::Entry> mutexes;
+                MutexContention::snapshot( mutexes );
+                for ( unsigned i = 0; i < mutexes.size(); i++ ) {
+                    BSONObjBuilder m( bb.subobjStart( mutexes[i].name ) );
+                    m.appendNumber( "contended" , (long long) mutexes[i].contended );
+                    m.appendNumber( "spun" , (long long) mutexes[i].spun );
+                    m.appendNumber( "parked" , (long long) mutexes[i].parked );
+                    m.done();
+                }
+                bb.done();
+            }
+
+            if ( wanted( cmdObj , "network" ) ) {
                 BSONObjBuilder bb( result.subobjStart( "network" ) );
                 networkCounter.append( bb );
                 bb.done();
             }
 
+            if ( wanted( cmdObj , "opLatencies" ) ) {
+                BSONObjBuilder bb( result.subobjStart( "opLatencies" ) );
+                opLatencyCounters.append( bb );
+                bb.done();
+            }
+
+            if ( wanted( cmdObj , "recordChecksums" ) ) {
+                BSONObjBuilder bb( result.subobjStart( "recordChecksums" ) );
+                RecordChecksums::appendStats( bb );
+                bb.done();
+            }
+
+            if ( wanted( cmdObj , "ttl" ) ) {
+                BSONObjBuilder bb( result.subobjStart( "ttl" ) );
+                appendTTLStats( bb );
+                bb.done();
+            }
+
+            if ( wanted( cmdObj , "warmRestart" ) ) {
+                BSONObjBuilder bb( result.subobjStart( "warmRestart" ) );
+                appendWarmRestartStats( bb );
+                bb.done();
+            }
+
+            if ( wanted( cmdObj , "workingSet" ) ) {
+                BSONObjBuilder bb( result.subobjStart( "workingSet" ) );
+                WorkingSet::append( bb );
+                bb.done();
+            }
+
+            if ( wanted( cmdObj , "profiler" ) ) {
+                BSONObjBuilder bb( result.subobjStart( "profiler" ) );
+                appendProfileStats( bb );
+                bb.done();
+            }
+
+            if ( wanted( cmdObj , "rangeDeleter" ) ) {
+                BSONObjBuilder bb( result.subobjStart( "rangeDeleter" ) );
+                appendRangeDeleterStats( bb );
+                bb.done();
+            }
+
 
             timeBuilder.appendNumber( "after counters" , Listener::getElapsedTimeMillis() - start );
 
-            if ( anyReplEnabled() ) {
+            if ( anyReplEnabled() && wanted( cmdObj , "repl" ) ) {
                 BSONObjBuilder bb( result.subobjStart( "repl" ) );
                 appendReplicationInfo( bb , authed , cmdObj["repl"].numberInt() );
+                if ( replSet ) {
+                    BSONObjBuilder prefetch( bb.subobjStart( "prefetch" ) );
+                    appendReplPrefetchStats( prefetch );
+                    prefetch.done();
+                    BSONObjBuilder buffer( bb.subobjStart( "buffer" ) );
+                    replset::BackgroundSync::get()->appendBufferStats( buffer );
+                    buffer.done();
+                }
                 bb.done();
 
                 if ( ! _isMaster() ) {
@@ -601,9 +1059,10 @@ namespace mongo {
 
             timeBuilder.appendNumber( "after repl" , Listener::getElapsedTimeMillis() - start );
 
-            result.append( "opcounters" , globalOpCounters.getObj() );
+            if ( wanted( cmdObj , "opcounters" ) )
+                result.append( "opcounters" , globalOpCounters.getObj() );
 
-            {
+            if ( wanted( cmdObj , "asserts" ) ) {
                 BSONObjBuilder asserts( result.subobjStart( "asserts" ) );
                 asserts.append( "regular" , assertionCount.regular );
                 asserts.append( "warning" , assertionCount.warning );
@@ -615,15 +1074,20 @@ namespace mongo {
 
             timeBuilder.appendNumber( "after asserts" , Listener::getElapsedTimeMillis() - start );
 
-            result.append( "writeBacksQueued" , ! writeBackManager.queuesEmpty() );
+            if ( wanted( cmdObj , "writeBackQueues" ) ) {
+                result.append( "writeBacksQueued" , ! writeBackManager.queuesEmpty() );
+                BSONObjBuilder bb( result.subobjStart( "writeBackQueues" ) );
+                writeBackManager.appendStats( bb );
+                bb.done();
+            }
 
-            if( cmdLine.dur ) {
+            if( cmdLine.dur && wanted( cmdObj , "dur" ) ) {
                 result.append("dur", dur::stats.asObj());
             }
 
             timeBuilder.appendNumber( "after dur" , Listener::getElapsedTimeMillis() - start );
 
-            {
+            if ( wanted( cmdObj , "warnings" ) ) {
                 RamLog* rl = RamLog::get( "warnings" );
                 massert(15880, "no ram log for warnings?" , rl);
                 
@@ -661,8 +1125,7 @@ namespace mongo {
         virtual LockType locktype() const { return NONE; }
         CmdGetOpTime() : Command("getoptime") { }
         bool run(const string& dbname, BSONObj& cmdObj, int, string& errmsg, BSONObjBuilder& result, bool fromRepl) {
-            mutex::scoped_lock lk(OpTime::m);
-            result.appendDate("optime", OpTime::now(lk).asDate());
+            result.appendDate("optime", OpTime::now().asDate());
             return true;
         }
     } cmdgetoptime;
@@ -725,6 +1188,8 @@ namespace mongo {
                 return false;
             }
             uassert( 10039 ,  "can't drop collection with reserved $ character in name", strchr(nsToDrop.c_str(), '$') == 0 );
+            if ( d->isUserFlagSet( NamespaceDetails::Flag_TimePartitioned ) )
+                TimePartitions::dropBuckets( nsToDrop );
             dropCollection( nsToDrop, errmsg, result );
             return true;
         }
@@ -872,7 +1337,10 @@ namespace mongo {
             auto_ptr<DBClientCursor> i = db.query( dbname + ".system.indexes" , BSON( "ns" << toDeleteNs ) , 0 , 0 , 0 , QueryOption_SlaveOk );
             BSONObjBuilder b;
             while ( i->more() ) {
-                BSONObj o = i->next().removeField("v").getOwned();
+                BSONObj o = i->next();
+                if ( o["v"].numberInt() != 2 ) // keep prefix compressed indexes at v:2
+                    o = o.removeField("v");
+                o = o.getOwned();
                 b.append( BSONObjBuilder::numStr( all.size() ) , o );
                 all.push_back( o );
             }
@@ -1133,6 +1601,99 @@ namespace mongo {
         }
     } cmdFileMD5;
 
+    /**
+     * Returns bytes [offset, offset+length) of a GridFS file, looking at only the chunks the range
+     * covers and copying only the bytes wanted from each.  The reply is one BinData, so a long
+     * range comes back short and the caller asks again from where it ended.
+     */
+    class CmdFileRead : public Command {
+    public:
+        CmdFileRead() : Command( "fileread" ) {}
+        virtual bool slaveOk() const { return true; }
+        virtual void help( stringstream& help ) const {
+            help << "read a byte range of a GridFS file\n"
+                    "{ fileread : <files_id>, root : \"fs\", offset : <byte>, length : <bytes>, chunkSize : <n> }\n"
+                    "chunkSize is looked up in <root>.files if not given.  data can be shorter than length, at the end of\n"
+                    "the file, when the range won't fit in one reply or at the end of the chunks on this shard; 'offset'\n"
+                    "and 'length' give what it holds";
+        }
+        virtual LockType locktype() const { return READ; }
+        bool run(const string& dbname, BSONObj& jsobj, int, string& errmsg, BSONObjBuilder& result, bool fromRepl ) {
+            string root = jsobj.getStringField( "root" );
+            if ( root.size() == 0 )
+                root = "fs";
+            string ns = dbname + "." + root + ".chunks";
+
+            Client::Context ctx (ns);
+
+            BSONElement id = jsobj.firstElement();
+            long long offset = jsobj["offset"].numberLong();
+            long long length = jsobj["length"].isNumber() ? jsobj["length"].numberLong()
+                                                          : numeric_limits<long long>::max();
+            if ( offset < 0 || length < 0 ) {
+                errmsg = "offset and length can't be negative";
+                return false;
+            }
+
+            long long chunkSize = jsobj["chunkSize"].numberLong();
+            if ( chunkSize == 0 ) {
+                BSONObj file;
+                if ( ! Helpers::findOne( dbname + "." + root + ".files" , BSON( "_id" << id ) , file ) ) {
+                    errmsg = "file not found";
+                    return false;
+                }
+                chunkSize = file["chunkSize"].numberLong();
+            }
+            if ( chunkSize <= 0 ) {
+                errmsg = "chunkSize must be positive";
+                return false;
+            }
+
+            // room for the rest of the reply
+            length = min( length , (long long) ( BSONObjMaxUserSize - 64 * 1024 ) );
+            long long end = offset + length;
+            int first = (int) ( offset / chunkSize );
+            int last = (int) ( ( end + chunkSize - 1 ) / chunkSize ); // exclusive
+
+            BSONObj query = BSON( "files_id" << id << "n" << GTE << first << LT << last );
+            BSONObj sort = BSON( "files_id" << 1 << "n" << 1 );
+            shared_ptr<Cursor> cursor = NamespaceDetailsTransient::bestGuessCursor(ns.c_str(),
+                                                                                   query, sort);
+            if ( ! cursor ) {
+                errmsg = "need an index on { files_id : 1 , n : 1 }";
+                return false;
+            }
+
+            BufBuilder data;
+            int n = first;
+            for ( ; cursor->ok() && length > 0; cursor->advance() ) {
+                if ( ! cursor->currentMatches() )
+                    continue;
+
+                BSONObj obj = cursor->current();
+                int myn = obj["n"].numberInt();
+                if ( myn != n )
+                    break; // on another shard, or missing: the caller finds out asking from here
+                n++;
+
+                int len;
+                const char* p = obj["data"].binDataClean( len );
+                long long chunkStart = (long long) myn * chunkSize;
+                long long from = max( offset , chunkStart ) - chunkStart;
+                long long to = min( end , chunkStart + len ) - chunkStart;
+                if ( to > from )
+                    data.appendBuf( p + from , (int) ( to - from ) );
+                if ( chunkStart + len < chunkStart + chunkSize )
+                    break; // the short last chunk
+            }
+
+            result.appendNumber( "offset" , offset );
+            result.appendNumber( "length" , (long long) data.len() );
+            result.appendBinData( "data" , data.len() , BinDataGeneral , data.buf() );
+            return true;
+        }
+    } cmdFileRead;
+
     class CmdDatasize : public Command {
         virtual string parseNs(const string& dbname, const BSONObj& cmdObj) const { 
             return parseNsFullyQualified(dbname, cmdObj);
@@ -1307,6 +1868,16 @@ namespace mongo {
             result.append( "nindexes" , nsd->nIndexes );
             result.append( "lastExtentSize" , nsd->lastExtentSize / scale );
             result.append( "paddingFactor" , nsd->paddingFactor() );
+            {
+                BSONObjBuilder growth( result.subobjStart( "recordGrowth" ) );
+                NamespaceDetailsTransient::get( ns.c_str() ).recordGrowth().appendStats( growth );
+                growth.done();
+            }
+            if ( nsd->isUserFlagSet( NamespaceDetails::Flag_CacheQueryResults ) ) {
+                BSONObjBuilder cache( result.subobjStart( "queryResultCache" ) );
+                NamespaceDetailsTransient::get( ns.c_str() ).queryResultCache().appendStats( cache );
+                cache.done();
+            }
             result.append( "systemFlags" , nsd->systemFlags() );
             result.append( "userFlags" , nsd->userFlags() );
 
@@ -1314,6 +1885,23 @@ namespace mongo {
             result.appendNumber( "totalIndexSize" , getIndexSizeForCollection(dbname, ns, &indexSizes, scale) / scale );
             result.append("indexSizes", indexSizes.obj());
 
+            {
+                BSONObjBuilder io( result.subobjStart( "io" ) );
+                NamespaceIO::appendCollection( ns , io );
+                io.done();
+            }
+            {
+                BSONObjBuilder indexIO( result.subobjStart( "indexIO" ) );
+                NamespaceDetails::IndexIterator ii = nsd->ii();
+                while ( ii.more() ) {
+                    IndexDetails& idx = ii.next();
+                    BSONObjBuilder b( indexIO.subobjStart( idx.indexName() ) );
+                    NamespaceIO::appendIndex( idx.indexNamespace() , b );
+                    b.done();
+                }
+                indexIO.done();
+            }
+
             if ( nsd->isCapped() ) {
                 result.append( "capped" , nsd->isCapped() );
                 result.appendNumber( "max" , nsd->maxCappedDocs() );
@@ -1354,6 +1942,17 @@ namespace mongo {
                 }
                 
             }
+
+            if ( jsobj["cacheQueryResults"].type() ) {
+                result.appendBool( "cacheQueryResults_old" , nsd->isUserFlagSet( NamespaceDetails::Flag_CacheQueryResults ) );
+                if ( jsobj["cacheQueryResults"].trueValue() ) {
+                    nsd->setUserFlag( NamespaceDetails::Flag_CacheQueryResults );
+                }
+                else {
+                    nsd->clearUserFlag( NamespaceDetails::Flag_CacheQueryResults );
+                    NamespaceDetailsTransient::get( ns.c_str() ).queryResultCache().clear();
+                }
+            }
             
             if ( oldFlags != nsd->userFlags() ) {
                 nsd->syncUserFlags( ns );
@@ -1432,8 +2031,10 @@ namespace mongo {
             result.appendNumber( "indexes" , indexes );
             result.appendNumber( "indexSize" , indexSize / scale );
             result.appendNumber( "fileSize" , d->fileSize() / scale );
-            if( d )
-                result.appendNumber( "nsSizeMB", (int) d->namespaceIndex.fileLength() / 1024 / 1024 );
+            if( d ) {
+                result.appendNumber( "nsSizeMB", (long long) ( d->namespaceIndex.fileLength() / 1024 / 1024 ) );
+                result.append( "nsFiles", d->namespaceIndex.nFiles() );
+            }
 
             return true;
         }
@@ -1976,7 +2577,9 @@ namespace mongo {
         // anObjBuilder.append("ok", ok);
         anObjBuilder.append("ok", ok?1.0:0.0);
         BSONObj x = anObjBuilder.done();
-        b.appendBuf((void*) x.objdata(), x.objsize());
+        // runQuery builds the result in b itself
+        if ( &anObjBuilder.bb() != &b )
+            b.appendBuf((void*) x.objdata(), x.objsize());
 
         return true;
     }
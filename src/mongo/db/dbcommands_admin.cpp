@@ -30,6 +30,7 @@
 #include "cmdline.h"
 #include "btree.h"
 #include "curop-inl.h"
+#include "record_checksums.h"
 #include "../util/background.h"
 #include "../util/logfile.h"
 #include "../util/alignedbuilder.h"
@@ -156,7 +157,9 @@ namespace mongo {
         }
 
         virtual void help(stringstream& h) const { h << "Validate contents of a namespace by scanning its data structures for correctness.  Slow.\n"
-                                                        "Add full:true option to do a more thorough check"; }
+                                                        "Add full:true option to do a more thorough check.\n"
+                                                        "checksums:true only checks the record checksums, of a collection created with recordChecksums,\n"
+                                                        "reading its extents on threads:<n> (default 4) threads"; }
 
         virtual LockType locktype() const { return READ; }
         //{ validate: "collectionnamewithoutthedbpart" [, scandata: <bool>] [, full: <bool> } */
@@ -173,11 +176,39 @@ namespace mongo {
             }
 
             result.append( "ns", ns );
+            if ( cmdObj["checksums"].trueValue() )
+                return validateChecksums( ns.c_str(), d, cmdObj, errmsg, result );
             validateNS( ns.c_str() , d, cmdObj, result);
             return true;
         }
 
     private:
+        bool validateChecksums( const char *ns, NamespaceDetails *d, const BSONObj& cmdObj, string& errmsg, BSONObjBuilder& result ) {
+            if ( ! RecordChecksums::enabled( d ) ) {
+                errmsg = "collection has no record checksums";
+                return false;
+            }
+            int threads = 4;
+            if ( cmdObj["threads"].isNumber() )
+                threads = cmdObj["threads"].numberInt();
+            if ( threads < 1 || threads > 64 ) {
+                errmsg = "threads must be from 1 to 64";
+                return false;
+            }
+
+            DiskLoc firstBad;
+            RecordChecksums::Counts counts = RecordChecksums::scan( d, threads, &firstBad );
+            result.appendNumber( "checked", counts.checked );
+            result.appendNumber( "bad", counts.bad );
+            result.appendNumber( "noChecksum", counts.none );
+            if ( counts.bad ) {
+                result.append( "firstBad", firstBad.toString() );
+                warning() << "validate found " << counts.bad << " bad record checksums in " << ns << endl;
+            }
+            result.appendBool( "valid", counts.bad == 0 );
+            return true;
+        }
+
         void validateNS(const char *ns, NamespaceDetails *d, const BSONObj& cmdObj, BSONObjBuilder& result) {
             const bool full = cmdObj["full"].trueValue();
             const bool scanData = full || cmdObj["scandata"].trueValue();
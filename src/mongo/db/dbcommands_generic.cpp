@@ -39,6 +39,7 @@
 #include "background.h"
 #include "../util/version.h"
 #include "../util/ramlog.h"
+#include "../util/trace_span.h"
 #include "repl/multicmd.h"
 #include "server.h"
 
@@ -123,6 +124,9 @@ namespace mongo {
         */
     unsigned replApplyBatchSize = 1;
 
+    // tempish
+    bool getParmsMongodSpecific(BSONObj& cmdObj, bool all, BSONObjBuilder& result);
+
     class CmdGet : public Command {
     public:
         CmdGet() : Command( "getParameter" ) { }
@@ -137,6 +141,19 @@ namespace mongo {
             help << "  notablescan\n";
             help << "  logLevel\n";
             help << "  syncdelay\n";
+            help << "  replIndexPrefetch\n";
+            help << "  replPrefetchDepth\n";
+            help << "  replApplySliceOps\n";
+            help << "  replInitialSyncThreads\n";
+            help << "  mapReduceThreads\n";
+            help << "  jsPooledScopesPerDb\n";
+            help << "  aggregationThreads\n";
+            help << "  oplogCompression\n";
+            help << "  oplogPreImages\n";
+            help << "  aggregationSortMemoryLimitBytes\n";
+            help << "  aggregationGroupMemoryLimitBytes\n";
+            help << "  syncRateMB\n";
+            help << "  traceSpans\n";
             help << "{ getParameter:'*' } to get everything\n";
         }
         bool run(const string& dbname, BSONObj& cmdObj, int, string& errmsg, BSONObjBuilder& result, bool fromRepl ) {
@@ -159,6 +176,10 @@ namespace mongo {
             if( all || cmdObj.hasElement("replApplyBatchSize") ) {
                 result.append("replApplyBatchSize", replApplyBatchSize);
             }
+            if( all || cmdObj.hasElement("traceSpans") ) {
+                result.append("traceSpans", TraceSpans::enabled);
+            }
+            getParmsMongodSpecific(cmdObj, all, result);
 
             if ( before == result.len() ) {
                 errmsg = "no option found to get";
@@ -185,11 +206,27 @@ namespace mongo {
             help << "  logLevel\n";
             help << "  notablescan\n";
             help << "  quiet\n";
+            help << "  replIndexPrefetch\n";
+            help << "  replPrefetchDepth\n";
+            help << "  replApplySliceOps\n";
+            help << "  replInitialSyncThreads\n";
+            help << "  mapReduceThreads\n";
+            help << "  jsPooledScopesPerDb\n";
+            help << "  aggregationThreads\n";
+            help << "  oplogCompression\n";
+            help << "  oplogPreImages\n";
+            help << "  aggregationSortMemoryLimitBytes\n";
+            help << "  aggregationGroupMemoryLimitBytes\n";
             help << "  syncdelay\n";
+            help << "  syncRateMB\n";
+            help << "  traceSpans\n";
         }
         bool run(const string& dbname, BSONObj& cmdObj, int, string& errmsg, BSONObjBuilder& result, bool fromRepl ) {
             int s = 0;
             bool found = setParmsMongodSpecific(dbname, cmdObj, errmsg, result, fromRepl);
+            if( !errmsg.empty() ) {
+                return false;
+            }
             if( cmdObj.hasElement("journalCommitInterval") ) { 
                 if( !cmdLine.dur ) { 
                     errmsg = "journaling is off";
@@ -243,6 +280,11 @@ namespace mongo {
                 DBException::traceExceptions = cmdObj["traceExceptions"].Bool();
                 s++;
             }
+            if( cmdObj.hasElement( "traceSpans" ) ) {
+                if( s == 0 ) result.append( "was", TraceSpans::enabled );
+                TraceSpans::enabled = cmdObj["traceSpans"].trueValue();
+                s++;
+            }
 
             if( s == 0 && !found ) {
                 errmsg = "no option found to set, use help:true to see options ";
@@ -465,4 +507,30 @@ namespace mongo {
 
     } getLogCmd;
 
+    class TraceSpansCmd : public Command {
+    public:
+        TraceSpansCmd() : Command( "traceSpans" ) {}
+
+        virtual bool slaveOk() const { return true; }
+        virtual LockType locktype() const { return NONE; }
+        virtual bool adminOnly() const { return true; }
+
+        virtual void help( stringstream& help ) const {
+            help << "the most recent request spans recorded while setParameter traceSpans is on\n";
+            help << "{ traceSpans : 1 [, traceId : <id>] [, limit : <n>] }";
+        }
+
+        virtual bool run(const string& dbname , BSONObj& cmdObj, int, string& errmsg, BSONObjBuilder& result, bool) {
+            unsigned long long traceId = (unsigned long long) cmdObj["traceId"].numberLong();
+            int limit = cmdObj["limit"].isNumber() ? cmdObj["limit"].numberInt() : 1000;
+
+            result.append( "enabled" , TraceSpans::enabled );
+            BSONArrayBuilder arr( result.subarrayStart( "spans" ) );
+            TraceSpans::append( arr , traceId , limit );
+            arr.done();
+            return true;
+        }
+
+    } traceSpansCmd;
+
 }
@@ -286,6 +286,50 @@ namespace mongo {
         return num;
     }
 
+    long long Helpers::removeRangeBatch( const string& ns , const BSONObj& min , const BSONObj& max , int maxDocs , RemoveCallback * callback, bool fromMigrate ) {
+        BSONObj keya , keyb;
+        BSONObj minClean = toKeyFormat( min , keya );
+        BSONObj maxClean = toKeyFormat( max , keyb );
+        verify( keya == keyb );
+        verify( maxDocs > 0 );
+
+        Client::Context ctx(ns);
+
+        NamespaceDetails* nsd = nsdetails( ns.c_str() );
+        if ( ! nsd )
+            return 0;
+
+        int ii = nsd->findIndexByKeyPattern( keya );
+        verify( ii >= 0 );
+
+        // earlier batches took their keys out of the index, so the range always starts at min
+        vector<DiskLoc> locs;
+        {
+            IndexDetails& i = nsd->idx( ii );
+            scoped_ptr<Cursor> c( BtreeCursor::make( nsd , ii , i , minClean , maxClean , false , 1 ) );
+            while ( c->ok() && locs.size() < (unsigned) maxDocs ) {
+                locs.push_back( c->currLoc() );
+                c->advance();
+            }
+        }
+
+        sort( locs.begin() , locs.end() );
+
+        for ( unsigned i = 0; i < locs.size(); i++ ) {
+            DiskLoc rloc = locs[i];
+
+            if ( callback )
+                callback->goingToDelete( rloc.obj() );
+
+            logOp( "d" , ns.c_str() , rloc.obj()["_id"].wrap() , 0 , 0 , fromMigrate );
+            theDataFileMgr.deleteRecord(ns.c_str() , rloc.rec(), rloc);
+
+            getDur().commitIfNeeded();
+        }
+
+        return locs.size();
+    }
+
     void Helpers::emptyCollection(const char *ns) {
         Client::Context context(ns);
         deleteObjects(ns, BSONObj(), false);
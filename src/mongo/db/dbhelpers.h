@@ -127,6 +127,19 @@ namespace mongo {
                                       RemoveCallback * callback = 0, 
                                       bool fromMigrate = false );
 
+        /**
+         * Removes up to maxDocs documents from the front of the range, in DiskLoc order rather
+         * than key order to cut down on seeks.  Never yields, so with a small maxDocs the
+         * caller can drop its write lock between batches.  Does oplog the deletions.
+         * @return the number removed; fewer than maxDocs means the range is empty
+         */
+        static long long removeRangeBatch( const string& ns ,
+                                           const BSONObj& min ,
+                                           const BSONObj& max ,
+                                           int maxDocs ,
+                                           RemoveCallback * callback = 0 ,
+                                           bool fromMigrate = false );
+
         /**
          * Remove all documents from a collection.
          * You do not need to set the database before calling.
@@ -43,11 +43,17 @@
        PREPLOGBUFFER()
      READLOCK mmmutex
        commitJob.reset()
+     LOCK journalWriteMutex                             // waits for the previous group's journal write
      UNLOCK dbMutex                                     // now other threads can write
+     UNLOCK groupCommitMutex                            // now the next group can be prepared
        WRITETOJOURNAL()
        WRITETODATAFILES()
      UNLOCK mmmutex
-     UNLOCK groupCommitMutex
+     UNLOCK journalWriteMutex
+
+     groups are double buffered (see builderForNextCommit()), so that the next group's PREPLOGBUFFER can
+     run while this group is still being written.  with --journalOptions DurNoPipelinedCommit,
+     groupCommitMutex is instead held until the end, as it used to be.
 
      on the next write lock acquisition for dbMutex:    // see MongoMutex::_acquiredWriteLock()
        REMAPPRIVATEVIEW()
@@ -66,11 +72,15 @@
 #include "dur_commitjob.h"
 #include "dur_recover.h"
 #include "dur_stats.h"
+#include "stats/counters.h"
 #include "../util/concurrency/race.h"
+#include "../util/histogram.h"
 #include "../util/mongoutils/hash.h"
 #include "../util/mongoutils/str.h"
+#include "../util/scopeguard.h"
 #include "../util/timer.h"
 #include "mongo/util/stacktrace.h"
+#include "mongo/util/trace_span.h"
 #include "../server.h"
 #include "mongo/db/commands/fsync.h"
 
@@ -105,6 +115,51 @@ namespace mongo {
             _b.reset();
             curr = &_a;
             _intervalMicros = 3000000;
+            for ( int p = 0; p < NPhases; p++ )
+                _latencies[p] = newMicrosHistogram();
+            _writersBlocked = newMicrosHistogram();
+            _maxWriterBlockedMicros = 0;
+
+            Histogram::Options opts;
+            opts.initialValue = 0;
+            opts.exponential = true;
+            opts.numBuckets = 20;
+            opts.bucketSize = 4096;     // 8KB .. 1GB
+            _commitBytes = new Histogram( opts );
+            opts.numBuckets = 12;
+            opts.bucketSize = 1;        // 2 .. 2048
+            _commitWaiters = new Histogram( opts );
+        }
+
+        void Stats::recordPhase( Phase p , unsigned long long micros ) {
+            _latencies[p]->insert( microsBucketValue( micros ) );
+        }
+
+        void Stats::recordCommit( unsigned long long journaledBytes ) {
+            unsigned waiters = _awaitingCommit.get();
+            _commitBytes->insert( microsBucketValue( journaledBytes ) );
+            _commitWaiters->insert( waiters );
+            if( journaledBytes > curr->_maxCommitBytes )
+                curr->_maxCommitBytes = journaledBytes;
+            if( waiters > curr->_maxCommitWaiters )
+                curr->_maxCommitWaiters = waiters;
+        }
+
+        void Stats::recordWritersBlocked( unsigned long long micros ) {
+            _writersBlocked->insert( microsBucketValue( micros ) );
+            if( micros > curr->_maxWriterBlockedMicros )
+                curr->_maxWriterBlockedMicros = micros;
+            if( micros > _maxWriterBlockedMicros )
+                _maxWriterBlockedMicros = micros;
+        }
+
+        BSONObj Stats::latencies() {
+            static const char * const phaseNames[NPhases] =
+                { "prepLogBuffer", "writeToJournal", "writeToDataFiles", "remapPrivateView" };
+            BSONObjBuilder b;
+            for ( int p = 0; p < NPhases; p++ )
+                b.append( phaseNames[p] , histogramReport( *_latencies[p] ) );
+            return b.obj();
         }
 
         Stats::S * Stats::other() {
@@ -142,6 +197,9 @@ namespace mongo {
                        "compression" << _journaledBytes / (_uncompressedBytes+1.0) <<
                        "commitsInWriteLock" << _commitsInWriteLock <<
                        "earlyCommits" << _earlyCommits << 
+                       "maxCommitMB" << _maxCommitBytes / 1000000.0 <<
+                       "maxCommitWaiters" << _maxCommitWaiters <<
+                       "maxWritersBlockedMs" << _maxWriterBlockedMicros / 1000.0 <<
                        "timeMs" <<
                        BSON( "dt" << _dtMillis <<
                              "prepLogBuffer" << (unsigned) (_prepLogBufferMicros/1000) <<
@@ -156,11 +214,22 @@ namespace mongo {
                 b << "ageOutJournalFiles" << false;*/
             if( cmdLine.journalCommitInterval != 0 )
                 b << "journalCommitIntervalMs" << cmdLine.journalCommitInterval;
+            b << "journalCompressor" << cmdLine.journalCompressor;
             return b.obj();
         }
 
         BSONObj Stats::asObj() {
-            return other()->_asObj();
+            BSONObjBuilder b;
+            b.appendElements( other()->_asObj() );
+            b.append( "latencies" , latencies() );
+            b.append( "commitBytes" , histogramReport( *_commitBytes ) );
+            b.append( "commitWaiters" ,
+                      BSON( "current" << _awaitingCommit.get() <<
+                            "perCommit" << histogramReport( *_commitWaiters ) ) );
+            b.append( "writersBlocked" ,
+                      BSON( "maxMs" << _maxWriterBlockedMicros / 1000.0 <<
+                            "latencies" << histogramReport( *_writersBlocked ) ) );
+            return b.obj();
         }
 
         void Stats::rotate() {
@@ -208,6 +277,9 @@ namespace mongo {
         }
 
         bool DurableImpl::awaitCommit() {
+            TraceSpan span( TraceSpans::CommitWait );
+            stats.startAwaitingCommit();
+            ON_BLOCK_EXIT_OBJ( stats , &Stats::stopAwaitingCommit );
             commitJob._notify.awaitBeyondNow();
             return true;
         }
@@ -443,6 +515,9 @@ namespace mongo {
 
         extern size_t privateMapBytes;
 
+        /** how long one REMAPPRIVATEVIEW pass may hold the write lock, unless it has to catch up */
+        static const unsigned long long RemapPrivateViewMaxMicros = 5000;
+
         static void _REMAPPRIVATEVIEW() {
             // todo: Consider using ProcessInfo herein and watching for getResidentSize to drop.  that could be a way 
             //       to assure very good behavior here.
@@ -461,8 +536,13 @@ namespace mongo {
             // remapping.
             unsigned long long now = curTimeMicros64();
             double fraction = (now-lastRemap)/2000000.0;
-            if( cmdLine.durOptions & CmdLine::DurAlwaysRemap )
+            // unless we must catch up, stop after a few milliseconds so the write lock isn't held
+            // for long; files we didn't get to keep willNeedRemap() and are done on the next pass.
+            bool timeBounded = true;
+            if( cmdLine.durOptions & CmdLine::DurAlwaysRemap ) {
                 fraction = 1;
+                timeBounded = false;
+            }
             lastRemap = now;
 
 #if defined(_WIN32)
@@ -486,6 +566,7 @@ namespace mongo {
                 double f = privateMapBytes / ((double)UncommittedBytesLimit);
                 if( f > fraction ) { 
                     fraction = f;
+                    timeBounded = false;
                 }
                 privateMapBytes = 0;
             }
@@ -503,11 +584,13 @@ namespace mongo {
                 if( i == e ) i = b;
             }
             unsigned startedAt = startAt;
-            startAt = (startAt + ntodo) % sz; // mark where to start next time
 
             Timer t;
-            for( unsigned x = 0; x < ntodo; x++ ) {
+            unsigned x = 0;
+            for( ; x < ntodo; x++ ) {
                 dassert( i != e );
+                if( timeBounded && t.micros() > RemapPrivateViewMaxMicros )
+                    break;
                 if( (*i)->isMongoMMF() ) {
                     MongoMMF *mmf = (MongoMMF*) *i;
                     verify(mmf);
@@ -515,11 +598,12 @@ namespace mongo {
                         mmf->willNeedRemap() = false;
                         mmf->remapThePrivateView();
                     }
-                    i++;
-                    if( i == e ) i = b;
                 }
+                i++;
+                if( i == e ) i = b;
             }
-            LOG(2) << "journal REMAPPRIVATEVIEW done startedAt: " << startedAt << " n:" << ntodo << ' ' << t.millis() << "ms" << endl;
+            startAt = (startedAt + x) % sz; // mark where to start next time
+            LOG(2) << "journal REMAPPRIVATEVIEW done startedAt: " << startedAt << " n:" << x << '/' << ntodo << ' ' << t.millis() << "ms" << endl;
         }
 
         /** We need to remap the private views periodically. otherwise they would become very large.
@@ -528,17 +612,37 @@ namespace mongo {
         void REMAPPRIVATEVIEW() {
             Timer t;
             _REMAPPRIVATEVIEW();
-            stats.curr->_remapPrivateViewMicros += t.micros();
+            unsigned long long m = t.micros();
+            stats.curr->_remapPrivateViewMicros += m;
+            stats.recordPhase( Stats::RemapPrivateView , m );
         }
 
-        // this is a pseudo-local variable in the groupcommit functions 
+        // these are pseudo-local variables in the groupcommit functions 
         // below.  however we don't truly do that so that we don't have to 
-        // reallocate, and more importantly regrow it, on every single commit.
-        static AlignedBuilder __theBuilder(4 * 1024 * 1024);
+        // reallocate, and more importantly regrow them, on every single commit.
+        // there are two so that one group can be prepared while the previous
+        // one is still being written.
+        static AlignedBuilder __theBuilder0(4 * 1024 * 1024);
+        static AlignedBuilder __theBuilder1(4 * 1024 * 1024);
+
+        static bool pipelinedCommits() {
+            return (cmdLine.durOptions & CmdLine::DurNoPipelinedCommit) == 0;
+        }
+
+        /** the builder for the group about to be prepared.  at most one group is being written
+            (in journalWriteMutex) while another is prepared (in groupCommitMutex), and the one
+            being written is always the one before, so alternating is enough.
+        */
+        static AlignedBuilder& builderForNextCommit() {
+            commitJob.groupCommitMutex.dassertLocked();
+            static unsigned n;
+            if( !pipelinedCommits() )
+                return __theBuilder0;
+            return (++n & 1) ? __theBuilder1 : __theBuilder0;
+        }
 
         static bool _groupCommitWithLimitedLocks() {
             unspoolWriteIntents(); // in case we were doing some writing ourself (likely impossible with limitedlocks version)
-            AlignedBuilder &ab = __theBuilder;
 
             verify( ! Lock::isLocked() );
 
@@ -547,28 +651,44 @@ namespace mongo {
             // also needs to stop greed. our time to work before clearing lk1 is not too bad, so 
             // not super critical, but likely 'correct'.  todo.
             scoped_ptr<Lock::GlobalRead> lk1( new Lock::GlobalRead() );
+            Timer writersBlocked;
 
-            SimpleMutex::scoped_lock lk2(commitJob.groupCommitMutex);
+            scoped_ptr<SimpleMutex::scoped_lock> lk2( new SimpleMutex::scoped_lock(commitJob.groupCommitMutex) );
 
             commitJob.commitingBegin(); // increments the commit epoch for getlasterror j:true
 
             if( !commitJob.hasWritten() ) {
-                // getlasterror request could have came after the data was already committed
+                // getlasterror request could have came after the data was already committed.
+                // that data may still be on its way to the journal in the previous group though.
+                SimpleMutex::scoped_lock lk4(commitJob.journalWriteMutex);
                 commitJob.committingNotifyCommitted();
                 return true;
             }
 
+            AlignedBuilder &ab = builderForNextCommit();
             JSectHeader h;
             PREPLOGBUFFER(h,ab); // need to be in readlock (writes excluded) for this
 
             LockMongoFilesShared lk3;
 
             unsigned abLen = ab.len();
+            const NotifyAll::When commitNumber = commitJob.committingNumber();
             commitJob.committingReset(); // must be reset before allowing anyone to write
             DEV verify( !commitJob.hasWritten() );
 
+            // the previous group may still be in WRITETOJOURNAL or WRITETODATAFILES; it had to
+            // finish before ours starts.  we wait here, after our PREPLOGBUFFER overlapped with it
+            // and before releasing groupCommitMutex, so groups reach the journal in order.
+            SimpleMutex::scoped_lock lk4(commitJob.journalWriteMutex);
+
             // release the readlock -- allowing others to now write while we are writing to the journal (etc.)
             lk1.reset();
+            stats.recordWritersBlocked( writersBlocked.micros() );
+
+            // and groupCommitMutex -- writers unspooling their write intents, and the next group's
+            // PREPLOGBUFFER, needn't wait for our journal write
+            if( pipelinedCommits() )
+                lk2.reset();
 
             // ****** now other threads can do writes ******
 
@@ -577,7 +697,7 @@ namespace mongo {
 
             // data is now in the journal, which is sufficient for acknowledging getLastError.
             // (ok to crash after that)
-            commitJob.committingNotifyCommitted();
+            commitJob.notifyCommitted(commitNumber);
 
             // note the higher-up-the-chain locking of filesLockedFsync is important here, 
             // as we are not in Lock::GlobalRead anymore. private view readers won't see 
@@ -626,8 +746,6 @@ namespace mongo {
             unspoolWriteIntents(); // in case we were doing some writing ourself
 
             {
-                AlignedBuilder &ab = __theBuilder;
-
                 // we need to make sure two group commits aren't running at the same time
                 // (and we are only read locked in the dbMutex, so it could happen)
                 SimpleMutex::scoped_lock lk(commitJob.groupCommitMutex);
@@ -635,13 +753,20 @@ namespace mongo {
                 commitJob.commitingBegin();
 
                 if( !commitJob.hasWritten() ) {
-                    // getlasterror request could have came after the data was already committed
+                    // getlasterror request could have came after the data was already committed,
+                    // possibly in a group that is still being written
+                    SimpleMutex::scoped_lock lk2(commitJob.journalWriteMutex);
                     commitJob.committingNotifyCommitted();
                 }
                 else {
+                    AlignedBuilder &ab = builderForNextCommit();
                     JSectHeader h;
                     PREPLOGBUFFER(h,ab);
 
+                    // wait for the previous group's journal write, if it's still going.  we stay in
+                    // the db lock for ours, which is required for remapping below.
+                    SimpleMutex::scoped_lock lk2(commitJob.journalWriteMutex);
+
                     // todo : write to the journal outside locks, as this write can be slow.
                     //        however, be careful then about remapprivateview as that cannot be done 
                     //        if new writes are then pending in the private maps.
@@ -701,7 +826,12 @@ namespace mongo {
         */
         static void groupCommit(Lock::GlobalWrite *lgw) {
             try {
+                // an early commit holds up writers as long as it takes; the durThread's are
+                // timed by durThreadGroupCommit(), from when it gets its write lock
+                Timer t;
                 _groupCommit(lgw);
+                if( lgw == 0 )
+                    stats.recordWritersBlocked( t.micros() );
             }
             catch(DBException& e ) { 
                 log() << "dbexception in groupCommit causing immediate shutdown: " << e.toString() << endl;
@@ -740,8 +870,10 @@ namespace mongo {
             // note our "stopgreed" parm -- to stop greed by others while we are working. you can't write 
             // anytime soon anyway if we are journaling for a while, that was the idea.
             Lock::GlobalWrite w(/*stopgreed:*/true);
+            Timer writersBlocked;
             w.downgrade();
             groupCommit(&w);
+            stats.recordWritersBlocked( writersBlocked.micros() );
         }
 
         /** called when a MongoMMF is closing -- we need to go ahead and group commit in that case before its
@@ -803,6 +935,9 @@ namespace mongo {
                     //DEV log() << "privateMapBytes=" << privateMapBytes << endl;
 
                     durThreadGroupCommit();
+
+                    // outside of the commit, so recycling old journal files doesn't delay it
+                    journalRotate();
                 }
                 catch(std::exception& e) {
                     log() << "exception in durThread causing immediate shutdown: " << e.what() << endl;
@@ -870,6 +1005,7 @@ namespace mongo {
             // (dbMutex) locks. This line waits for that to complete if already underway.
             {
                 SimpleMutex::scoped_lock lk(commitJob.groupCommitMutex);
+                SimpleMutex::scoped_lock lk2(commitJob.journalWriteMutex);
             }
 
             commitNow();
@@ -107,11 +107,28 @@ namespace mongo {
             dassert(contains(other));
         }
 
+        void IntentsAndDurOps::coalesce() {
+            if( _intents.empty() )
+                return;
+            sort(_intents.begin(), _intents.end());
+            vector<WriteIntent>::iterator last = _intents.begin();
+            for( vector<WriteIntent>::iterator i = last + 1; i != _intents.end(); i++ ) {
+                if( last->joinsWith(*i) )
+                    last->absorb(*i);
+                else
+                    *++last = *i;
+            }
+            _intents.erase(last + 1, _intents.end());
+            // don't come back until we have grown a good deal again, so this stays amortized n log n
+            _coalesceAt = max((size_t) CoalesceMin, _intents.size() * 2);
+        }
+
         void IntentsAndDurOps::clear() {
             assertLockedForCommitting();
             commitJob.groupCommitMutex.dassertLocked();
             _alreadyNoted.clear();
             _intents.clear();
+            _coalesceAt = CoalesceMin;
             _durOps.clear();
 #if defined(DEBUG_WRITE_INTENT)
             cout << "_debug clear\n";
@@ -157,7 +174,9 @@ namespace mongo {
 
         CommitJob::CommitJob() : 
             groupCommitMutex("groupCommit"),
-            _hasWritten(false)
+            journalWriteMutex("journalWrite"),
+            _hasWritten(false),
+            _intentsMemory(MemAccounting::WriteIntents)
         { 
             _commitNumber = 0;
             _bytes = 0;
@@ -202,6 +221,7 @@ namespace mongo {
 
                 // remember intent. we will journal it in a bit
                 _intentsAndDurOps.insertWriteIntent(p, len);
+                _intentsMemory.set( _intentsAndDurOps._intents.capacity() * sizeof(WriteIntent) );
 
                 {
                     // a bit over conservative in counting pagebytes used
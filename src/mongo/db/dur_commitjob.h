@@ -21,6 +21,7 @@
 #include "../util/alignedbuilder.h"
 #include "../util/mongoutils/hash.h"
 #include "../util/concurrency/synchronization.h"
+#include "../util/mem_accounting.h"
 #include "cmdline.h"
 #include "durop.h"
 #include "dur.h"
@@ -45,6 +46,13 @@ namespace mongo {
             bool operator < (const WriteIntent& rhs) const { return end() < rhs.end(); }
             bool overlaps(const WriteIntent& rhs) const    { return (start() <= rhs.end() && end() >= rhs.start()); }
             bool contains(const WriteIntent& rhs) const    { return (start() <= rhs.start() && end() >= rhs.end()); }
+            /** true if rhs, which must not end before me, overlaps me or starts right where i end.
+                we don't join at a page boundary as a different file's view may begin there.
+            */
+            bool joinsWith(const WriteIntent& rhs) const {
+                dassert( end() <= rhs.end() );
+                return rhs.start() < end() || (rhs.start() == end() && ((size_t) end() & 0xfff));
+            }
             // merge into me:
             void absorb(const WriteIntent& other);
             friend ostream& operator << (ostream& out, const WriteIntent& wi) {
@@ -86,9 +94,15 @@ namespace mongo {
             pair<void*,int> nodes[N];
         };
 
-        /** our record of pending/uncommitted write intents */
+        /** our record of pending/uncommitted write intents.
+            an intent that joins the previous one is merged into it as it arrives, and when the
+            vector has grown a lot since we last did so we sort and merge it in place; so many small
+            overlapping writes to the same pages don't pile up until commit time.
+        */
         class IntentsAndDurOps : boost::noncopyable {
         public:
+            IntentsAndDurOps() : _coalesceAt(CoalesceMin) { }
+
             vector<WriteIntent> _intents;
             Already<127> _alreadyNoted;
             vector< shared_ptr<DurOp> > _durOps; // all the ops other than basic writes
@@ -97,12 +111,28 @@ namespace mongo {
             void clear();
 
             void insertWriteIntent(void* p, int len) {
-                _intents.push_back(WriteIntent(p,len));
+                WriteIntent w(p,len);
+                if( !_intents.empty() ) {
+                    WriteIntent& last = _intents.back();
+                    if( last.end() <= w.end() ? last.joinsWith(w) : w.joinsWith(last) ) {
+                        last.absorb(w);
+                        return;
+                    }
+                }
+                _intents.push_back(w);
+                if( _intents.size() >= _coalesceAt )
+                    coalesce();
                 wassert( _intents.size() < 2000000 );
             }
+
+            /** sort _intents and merge the ones that overlap or are adjacent */
+            void coalesce();
             #if defined(DEBUG_WRITE_INTENT)
             map<void*,int> _debug;
             #endif
+        private:
+            enum { CoalesceMin = 16 * 1024 };
+            size_t _coalesceAt; // coalesce() when _intents reaches this size
         };
 
         /** so we don't have to lock the groupCommitMutex too often */
@@ -136,6 +166,11 @@ namespace mongo {
 
         public:
             SimpleMutex groupCommitMutex;
+            /** held while a commit writes to the journal and then the data files.  it is acquired while
+                holding groupCommitMutex, which may then be released first, so that the next group can
+                be prepared while this one is being written.  commits reach the journal in order.
+            */
+            SimpleMutex journalWriteMutex;
             CommitJob();
 
             /** note an operation other than a "basic write". threadsafe (locks in the impl) */
@@ -160,6 +195,17 @@ namespace mongo {
                 groupCommitMutex.dassertLocked();
                 _notify.notifyAll(_commitNumber); 
             }
+            /** the number of the commit under way, for a journal write that completes after
+                groupCommitMutex has been released.  pass it to notifyCommitted() then. */
+            NotifyAll::When committingNumber() const {
+                groupCommitMutex.dassertLocked();
+                return _commitNumber;
+            }
+            /** as committingNotifyCommitted(), for a commitNumber saved with committingNumber() */
+            void notifyCommitted(NotifyAll::When commitNumber) {
+                journalWriteMutex.dassertLocked();
+                _notify.notifyAll(commitNumber);
+            }
             /** we use the commitjob object over and over, calling reset() rather than reconstructing */
             void committingReset() {
                 groupCommitMutex.dassertLocked();
@@ -170,12 +216,12 @@ namespace mongo {
             /** we check how much written and if it is getting to be a lot, we commit sooner. */
             size_t bytes() const { return _bytes; }
 
-            /** used in prepbasicwrites. sorted so that overlapping and duplicate items 
-             * can be merged.  we sort here so the caller receives something they must 
+            /** used in prepbasicwrites. sorted, with overlapping, duplicate and adjacent items
+             * merged.  we do that here so the caller receives something they must 
              * keep const from their pov. */
             const vector<WriteIntent>& getIntentsSorted() {
                 groupCommitMutex.dassertLocked();
-                sort(_intentsAndDurOps._intents.begin(), _intentsAndDurOps._intents.end());
+                _intentsAndDurOps.coalesce();
                 return _intentsAndDurOps._intents;
             }
 
@@ -184,6 +230,7 @@ namespace mongo {
         private:
             NotifyAll::When _commitNumber;
             IntentsAndDurOps _intentsAndDurOps;
+            MemAccounting::Charge _intentsMemory; // what _intents has reserved, for serverStatus
             size_t _bytes;
         public:
             NotifyAll _notify;                  // for getlasterror fsync:true acknowledgements
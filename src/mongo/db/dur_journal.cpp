@@ -286,31 +286,37 @@ namespace mongo {
             return res;
         }
 
-        // throws
-        void preallocateFile(boost::filesystem::path p, unsigned long long len) {
-            if( exists(p) ) 
-                return;
-            
-            log() << "preallocating a journal file " << p.string() << endl;
-
+        /** write zeros to [from, len) of f, so that the space is really allocated */
+        static void zeroFill(File& f, fileofs from, unsigned long long len) {
             const unsigned BLKSZ = 1024 * 1024;
             verify( len % BLKSZ == 0 );
+            verify( from % BLKSZ == 0 );
 
             AlignedBuilder b(BLKSZ);            
             memset((void*)b.buf(), 0, BLKSZ);
 
-            ProgressMeter m(len, 3/*secs*/, 10/*hits between time check (once every 6.4MB)*/);
+            ProgressMeter m(len - from, 3/*secs*/, 10/*hits between time check (once every 6.4MB)*/);
 
-            File f;
-            f.open( p.string().c_str() , /*read-only*/false , /*direct-io*/false );
-            verify( f.is_open() );
-            fileofs loc = 0;
+            fileofs loc = from;
             while ( loc < len ) {
                 f.write( loc , b.buf() , BLKSZ );
                 loc += BLKSZ;
                 m.hit(BLKSZ);
             }
             verify( loc == len );
+        }
+
+        // throws
+        void preallocateFile(boost::filesystem::path p, unsigned long long len) {
+            if( exists(p) ) 
+                return;
+            
+            log() << "preallocating a journal file " << p.string() << endl;
+
+            File f;
+            f.open( p.string().c_str() , /*read-only*/false , /*direct-io*/false );
+            verify( f.is_open() );
+            zeroFill(f, 0, len);
             f.fsync();
         }
 
@@ -386,13 +392,19 @@ namespace mongo {
                             boost::filesystem::path temppath = filepath.string() + ".temp";
                             boost::filesystem::rename(p, temppath);
                             {
-                                // zero the header
+                                // zero the header.  we keep the rest of the file as it is, so that journaling
+                                // into it again overwrites blocks that are already allocated; recovery stops
+                                // at the first section with a different fileId.  a file that ended up short
+                                // is filled out to the full size here, rather than on the commit path later.
                                 File f;
                                 f.open(temppath.string().c_str(), false, false);
                                 char buf[8192];
                                 memset(buf, 0, 8192);
                                 f.write(0, buf, 8192);
                                 f.truncate(DataLimitPerJournalFile);
+                                fileofs len = f.len() & ~((fileofs) (1024 * 1024 - 1));
+                                if( len < DataLimitPerJournalFile )
+                                    zeroFill(f, len, DataLimitPerJournalFile);
                                 f.fsync();
                             }
                             boost::filesystem::rename(temppath, filepath);
@@ -603,27 +615,36 @@ namespace mongo {
             _written = 0;
         }
 
-        /** remove older journal files.
-            be in _curLogFileMutex but not dbMutex when calling
+        /** remove (or recycle into prealloc files) older journal files.
+            renaming, zeroing and syncing them is slow, so we don't hold _curLogFileMutex meanwhile,
+            and journal() doesn't wait for us.  only durThread calls this.
         */
         void Journal::removeUnneededJournalFiles() {
-            while( !_oldJournalFiles.empty() ) {
-                JFile f = _oldJournalFiles.front();
-
-                if( f.lastEventTimeMs < _lastFlushTime + ExtraKeepTimeMs ) {
+            list<JFile> unneeded;
+            {
+                SimpleMutex::scoped_lock lk(_curLogFileMutex);
+                while( !_oldJournalFiles.empty() ) {
+                    if( _oldJournalFiles.front().lastEventTimeMs >= _lastFlushTime + ExtraKeepTimeMs )
+                        break;
                     // eligible for deletion
-                    boost::filesystem::path p( f.filename );
-                    log() << "old journal file will be removed: " << f.filename << endl;
-                    removeOldJournalFile(p);
-                }
-                else {
-                    break;
+                    unneeded.push_back(_oldJournalFiles.front());
+                    _oldJournalFiles.pop_front();
                 }
+            }
 
-                _oldJournalFiles.pop_front();
+            for( list<JFile>::iterator i = unneeded.begin(); i != unneeded.end(); ++i ) {
+                log() << "old journal file will be removed: " << i->filename << endl;
+                removeOldJournalFile( boost::filesystem::path(i->filename) );
             }
         }
 
+        void Journal::rotate() {
+            if( inShutdown() )
+                return;
+            removeUnneededJournalFiles();
+        }
+        void journalRotate() { j.rotate(); }
+
         /*int getAgeOutJournalFiles() {
             mutex::try_lock lk(j._curLogFileMutex, 4000);
             if( !lk.ok )
@@ -653,9 +674,19 @@ namespace mongo {
                 return;
 
             if( _curLogFile ) {
-                _curLogFile->truncate();
+                if( usingPreallocate ) {
+                    // the rest of a prealloced file is zeros or an older journal.  rather than truncate
+                    // it, mark the end so recovery knows the file ended cleanly, and keep the blocks
+                    // for when it is recycled.
+                    AlignedBuilder b(Alignment);
+                    memset(b.atOfs(b.skip(Alignment)), 0, Alignment);
+                    _curLogFile->synchronousAppend(b.buf(), b.len());
+                }
+                else {
+                    _curLogFile->truncate();
+                }
                 closeCurrentJournalFile();
-                removeUnneededJournalFiles();
+                // the old files are removed by rotate(), from durThread
             }
 
             try {
@@ -680,30 +711,41 @@ namespace mongo {
         void WRITETOJOURNAL(JSectHeader h, AlignedBuilder& uncompressed) {
             Timer t;
             j.journal(h, uncompressed);
-            stats.curr->_writeToJournalMicros += t.micros();
+            unsigned long long m = t.micros();
+            stats.curr->_writeToJournalMicros += m;
+            stats.recordPhase( Stats::WriteToJournal , m );
         }
         void Journal::journal(const JSectHeader& h, const AlignedBuilder& uncompressed) {
             RACECHECK
             static AlignedBuilder b(32*1024*1024);
+            // with a fast journal device, compressing can cost more than writing the extra bytes
+            static const JSectHeader::Compression compression = 
+                cmdLine.journalCompressor == "none" ? JSectHeader::NoCompression : JSectHeader::Snappy;
             /* buffer to journal will be
                JSectHeader
                compressed operations
                JSectFooter
             */
             const unsigned headTailSize = sizeof(JSectHeader) + sizeof(JSectFooter);
-            const unsigned max = maxCompressedLength(uncompressed.len()) + headTailSize;
+            const unsigned max = ( compression == JSectHeader::Snappy ? 
+                                   maxCompressedLength(uncompressed.len()) : uncompressed.len() ) + headTailSize;
             b.reset(max);
 
             {
-                dassert( h.sectionLen() == (unsigned) 0xffffffff ); // we will backfill later
+                dassert( h.sectionLen() == (unsigned) JSectHeader::LenMask ); // we will backfill later
                 b.appendStruct(h);
             }
 
-            size_t compressedLength = 0;
-            rawCompress(uncompressed.buf(), uncompressed.len(), b.cur(), &compressedLength);
-            verify( compressedLength < 0xffffffff );
-            verify( compressedLength < max );
-            b.skip(compressedLength);
+            if( compression == JSectHeader::Snappy ) {
+                size_t compressedLength = 0;
+                rawCompress(uncompressed.buf(), uncompressed.len(), b.cur(), &compressedLength);
+                verify( compressedLength < 0xffffffff );
+                verify( compressedLength < max );
+                b.skip(compressedLength);
+            }
+            else {
+                b.appendBuf(uncompressed.buf(), uncompressed.len());
+            }
 
             // footer
             unsigned L = 0xffffffff;
@@ -711,10 +753,11 @@ namespace mongo {
                 // pad to alignment, and set the total section length in the JSectHeader
                 verify( 0xffffe000 == (~(Alignment-1)) );
                 unsigned lenUnpadded = b.len() + sizeof(JSectFooter);
+                verify( lenUnpadded <= JSectHeader::LenMask );
                 L = (lenUnpadded + Alignment-1) & (~(Alignment-1));
                 dassert( L >= lenUnpadded );
 
-                ((JSectHeader*)b.atOfs(0))->setSectionLen(lenUnpadded);
+                ((JSectHeader*)b.atOfs(0))->setSectionLen(lenUnpadded, compression);
 
                 JSectFooter f(b.buf(), b.len()); // computes checksum
                 b.appendStruct(f);
@@ -735,6 +778,7 @@ namespace mongo {
                 _written += w;
                 verify( w <= L );
                 stats.curr->_journaledBytes += L;
+                stats.recordCommit( L );
                 _curLogFile->synchronousAppend((const void *) b.buf(), L);
                 _rotate();
             }
@@ -37,7 +37,7 @@ namespace mongo {
         /** assure journal/ dir exists. throws */
         void journalMakeDir();
 
-        /** check if time to rotate files; assure a file is open.
+        /** remove or recycle journal files that are no longer needed.
              done separately from the journal() call as we can do this part
              outside of lock.
             only called by durThread.
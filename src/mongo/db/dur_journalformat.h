@@ -36,10 +36,12 @@ namespace mongo {
 
             // x4142 is asci--readable if you look at the file with head/less -- thus the starting values were near
             // that.  simply incrementing the version # is safe on a fwd basis.
+            // 0x4149 is the same as 0x414a except that it has no compression bits in JSectHeader, as every
+            // section was snappy compressed; we can still recover from it.
 #if defined(_NOCOMPRESS)
-            enum { CurrentVersion = 0x4148 };
+            enum { CurrentVersion = 0x4148, OldestVersionOk = 0x4148 };
 #else
-            enum { CurrentVersion = 0x4149 };
+            enum { CurrentVersion = 0x414a, OldestVersionOk = 0x4149 };
 #endif
             unsigned short _version;
 
@@ -55,25 +57,33 @@ namespace mongo {
             char reserved3[8026]; // 8KB total for the file header
             char txt2[2];         // "\n\n" at the end
 
-            bool versionOk() const { return _version == CurrentVersion; }
+            bool versionOk() const { return _version >= OldestVersionOk && _version <= CurrentVersion; }
             bool valid() const { return magic[0] == 'j' && txt2[1] == '\n' && fileId; }
         };
 
         /** "Section" header.  A section corresponds to a group commit.
             len is length of the entire section including header and footer.
             header and footer are not compressed, just the stuff in between.
+            the top two bits of the length say how the stuff in between was compressed.
         */
         struct JSectHeader {
         private:
-            unsigned _sectionLen;          // unpadded length in bytes of the whole section
+            unsigned _sectionLen;          // unpadded length in bytes of the whole section, and the Compression
         public:
+            enum Compression { Snappy = 0, NoCompression = 1 };
+            enum { LenMask = 0x3fffffff, CompressionShift = 30 };
+
             unsigned long long seqNumber;  // sequence number that can be used on recovery to not do too much work
             unsigned long long fileId;     // matches JHeader::fileId
-            unsigned sectionLen() const { return _sectionLen; }
+            unsigned sectionLen() const { return _sectionLen & LenMask; }
+            unsigned compression() const { return _sectionLen >> CompressionShift; }
 
             // we store the unpadded length so we can use that when we uncompress. to 
             // get the true total size this must be rounded up to the Alignment.
-            void setSectionLen(unsigned lenUnpadded) { _sectionLen = lenUnpadded; }
+            void setSectionLen(unsigned lenUnpadded, Compression c = Snappy) {
+                dassert( lenUnpadded <= LenMask );
+                _sectionLen = lenUnpadded | (((unsigned) c) << CompressionShift);
+            }
 
             unsigned sectionLenWithPadding() const { 
                 unsigned x = (sectionLen() + (Alignment-1)) & (~(Alignment-1));
@@ -34,7 +34,7 @@ namespace mongo {
             /** call during startup by journalMakeDir() */
             void init();
 
-            /** check if time to rotate files.  assure a file is open.
+            /** remove or recycle journal files that are no longer needed.
                 done separately from the journal() call as we can do this part
                 outside of lock.
                 thread: durThread()
@@ -83,6 +83,7 @@ namespace mongo {
 
             JEntry e;
             e.len = min(i->length(), (unsigned)(mmf->length() - ofs)); //dont write past end of file
+            mmf->noteDirty(ofs, e.len);
             verify( ofs <= 0x80000000 );
             e.ofs = (unsigned) ofs;
             e.setFileNo( mmf->fileSuffixNo() );
@@ -128,29 +129,19 @@ namespace mongo {
             RelativePath lastDbPath;
 
             assertNothingSpooled();
+            // already merged, so each one is a separate JEntry
             const vector<WriteIntent>& _intents = commitJob.getIntentsSorted();
             verify( !_intents.empty() );
 
-            WriteIntent last;
             for( vector<WriteIntent>::const_iterator i = _intents.begin(); i != _intents.end(); i++ ) { 
-                if( i->start() < last.end() ) { 
-                    // overlaps
-                    last.absorb(*i);
-                }
-                else { 
-                    // discontinuous
-                    if( i != _intents.begin() )
-                        prepBasicWrite_inlock(bb, &last, lastDbPath);
-                    last = *i;
-                }
+                prepBasicWrite_inlock(bb, &*i, lastDbPath);
             }
-            prepBasicWrite_inlock(bb, &last, lastDbPath);
         }
 
         static void resetLogBuffer(/*out*/JSectHeader& h, AlignedBuilder& bb) {
             bb.reset();
 
-            h.setSectionLen(0xffffffff);  // total length, will fill in later
+            h.setSectionLen(JSectHeader::LenMask);  // total length, will fill in later
             h.seqNumber = getLastDataFileFlushTime();
             h.fileId = j.curFileId();
         }
@@ -182,7 +173,9 @@ namespace mongo {
             Timer t;
             j.assureLogFileOpen(); // so fileId is set
             _PREPLOGBUFFER(h, ab);
-            stats.curr->_prepLogBufferMicros += t.micros();
+            unsigned long long m = t.micros();
+            stats.curr->_prepLogBufferMicros += m;
+            stats.recordPhase( Stats::PrepLogBuffer , m );
         }
 
     }
@@ -41,6 +41,7 @@
 #include <fcntl.h>
 #include "dur_commitjob.h"
 #include <boost/filesystem/operations.hpp>
+#include <boost/thread/thread.hpp>
 
 using namespace mongoutils;
 
@@ -48,6 +49,18 @@ namespace mongo {
 
     namespace dur {
 
+        /** a section of a journal file, read ahead so that it can be uncompressed on a worker thread */
+        struct RecoverySection {
+            RecoverySection(const JSectHeader *h, const char *data, unsigned len, const JSectFooter *f) :
+                h(h), data(data), len(len), f(f), uncompressedOk(false) { }
+            const JSectHeader *h;  // these are pointers into the memory mapped journal file
+            const char *data;
+            unsigned len;
+            const JSectFooter *f;
+            string uncompressed;
+            bool uncompressedOk;   // if false, processSection() uncompresses (or reports the error) itself
+        };
+
         struct ParsedJournalEntry { /*copyable*/
             ParsedJournalEntry() : e(0) { }
 
@@ -101,20 +114,34 @@ namespace mongo {
             const bool _doDurOps;
             string _uncompressed;
         public:
-            JournalSectionIterator(const JSectHeader& h, const void *compressed, unsigned compressedLen, bool doDurOpsRecovering) :
+            /** @param uncompressed if not null, what compressed uncompresses to; we take its contents */
+            JournalSectionIterator(const JSectHeader& h, const void *compressed, unsigned compressedLen, bool doDurOpsRecovering,
+                                   string *uncompressed = 0) :
                 _h(h),
                 _lastDbName(0)
                 , _doDurOps(doDurOpsRecovering)
             {
                 verify( doDurOpsRecovering );
-                bool ok = uncompress((const char *)compressed, compressedLen, &_uncompressed);
+                verify( compressedLen == _h.sectionLen() - sizeof(JSectFooter) - sizeof(JSectHeader) );
+                if( _h.compression() == JSectHeader::NoCompression ) {
+                    _entries = auto_ptr<BufReader>( new BufReader((const char *) compressed, compressedLen) );
+                    return;
+                }
+                if( _h.compression() != JSectHeader::Snappy ) {
+                    log() << "unknown journal section compression " << _h.compression() << endl;
+                    msgasserted(16343, "unknown journal section compression");
+                }
+                bool ok = true;
+                if( uncompressed )
+                    _uncompressed.swap(*uncompressed);
+                else
+                    ok = uncompress((const char *)compressed, compressedLen, &_uncompressed);
                 if( !ok ) { 
                     // it should always be ok (i think?) as there is a previous check to see that the JSectFooter is ok
                     log() << "couldn't uncompress journal section" << endl;
                     msgasserted(15874, "couldn't uncompress journal section");
                 }
                 const char *p = _uncompressed.c_str();
-                verify( compressedLen == _h.sectionLen() - sizeof(JSectFooter) - sizeof(JSectHeader) );
                 _entries = auto_ptr<BufReader>( new BufReader(p, _uncompressed.size()) );
             }
 
@@ -191,8 +218,11 @@ namespace mongo {
             else
                 ss << fileNo;
 
-            // relative name -> full path name
-            boost::filesystem::path full(dbpath);
+            // relative name -> full path name; files on one of --dataPaths are journalled by full path
+            boost::filesystem::path full(ss.str());
+            if( full.is_complete() )
+                return full.string();
+            full = dbpath;
             full /= ss.str();
             return full.string();
         }
@@ -212,12 +242,61 @@ namespace mongo {
         void RecoveryJob::_close() {
             MongoFile::flushAll(true);
             _mmfs.clear();
+            _lastMMF = 0;
         }
 
-        void RecoveryJob::write(const ParsedJournalEntry& entry) {
+        ThreadPool* RecoveryJob::getWorkers() {
+            if( !_recovering )
+                return 0;
+            if( _nWorkers == 0 ) {
+                int n = (int) boost::thread::hardware_concurrency();
+                _nWorkers = std::max( 1 , std::min( n , 8 ) );
+                if( _nWorkers > 1 ) {
+                    log() << "recover using " << _nWorkers << " threads" << endl;
+                    _workers.reset( new ThreadPool(_nWorkers) );
+                }
+            }
+            return _workers.get();
+        }
+
+        /** copy a basic write to its data file, which is open.
+            @return the number of bytes written
+        */
+        static unsigned writeToDataFile(MongoMMF *mmf, const JEntry *e, bool recovering) {
+            if ((e->ofs + e->len) <= mmf->length()) {
+                verify(mmf->view_write());
+                verify(e->srcData());
+
+                void* dest = (char*)mmf->view_write() + e->ofs;
+                memcpy(dest, e->srcData(), e->len);
+                mmf->noteWritten(e->ofs, e->len);
+                return e->len;
+            }
+            else {
+                massert(13622, "Trying to write past end of file in WRITETODATAFILES", recovering);
+            }
+            return 0;
+        }
+
+        typedef vector< pair<MongoMMF*, const JEntry*> > FileWrites;
+
+        /** run on a recovery worker.  all the writes for one data file are in the same FileWrites, in
+            journal order, so the file ends up as if they had been applied one after another.
+        */
+        static void writeToDataFiles(const FileWrites *writes) {
+            for( FileWrites::const_iterator i = writes->begin(); i != writes->end(); ++i ) {
+                writeToDataFile(i->first, i->second, /*recovering*/true);
+            }
+        }
+
+        MongoMMF* RecoveryJob::findMMF(const ParsedJournalEntry& entry) {
             //TODO(mathias): look into making some of these dasserts
             verify(entry.e);
             verify(entry.dbName);
+
+            if( _lastMMF && entry.dbName == _lastDbName && entry.e->getFileNo() == _lastFileNo )
+                return _lastMMF;
+
             verify(strnlen(entry.dbName, MaxDatabaseNameLen) < MaxDatabaseNameLen);
 
             const string fn = fileName(entry.dbName, entry.e->getFileNo());
@@ -243,17 +322,15 @@ namespace mongo {
                 mmf = sp.get();
             }
 
-            if ((entry.e->ofs + entry.e->len) <= mmf->length()) {
-                verify(mmf->view_write());
-                verify(entry.e->srcData());
+            _lastDbName = entry.dbName;
+            _lastFileNo = entry.e->getFileNo();
+            _lastMMF = mmf;
+            return mmf;
+        }
 
-                void* dest = (char*)mmf->view_write() + entry.e->ofs;
-                memcpy(dest, entry.e->srcData(), entry.e->len);
-                stats.curr->_writeToDataFilesBytes += entry.e->len;
-            }
-            else {
-                massert(13622, "Trying to write past end of file in WRITETODATAFILES", _recovering);
-            }
+        void RecoveryJob::write(const ParsedJournalEntry& entry) {
+            MongoMMF *mmf = findMMF(entry);
+            stats.curr->_writeToDataFilesBytes += writeToDataFile(mmf, entry.e, _recovering);
         }
 
         void RecoveryJob::applyEntry(const ParsedJournalEntry& entry, bool apply, bool dump) {
@@ -287,21 +364,77 @@ namespace mongo {
             }
         }
 
+        /** sections with fewer basic write bytes than this are applied on the calling thread */
+        static const unsigned long long MinParallelApplyBytes = 256 * 1024;
+
+        /** the basic writes are split across the recovery workers by data file.  DurOp's are applied on
+            this thread, after the writes before them, since they may create or close files.
+        */
+        void RecoveryJob::applyEntriesInParallel(const vector<ParsedJournalEntry> &entries) {
+            ThreadPool *workers = getWorkers();
+            vector<FileWrites> writes(_nWorkers);
+            unsigned long long bytes = 0;
+            vector<ParsedJournalEntry>::const_iterator i = entries.begin();
+            while( 1 ) {
+                if( i != entries.end() && i->e ) {
+                    MongoMMF *mmf = findMMF(*i);
+                    writes[ mongoutils::hashPointer(mmf) % _nWorkers ].push_back( make_pair(mmf, i->e) );
+                    bytes += i->e->len;
+                    ++i;
+                    continue;
+                }
+
+                // apply the writes so far
+                unsigned nonEmpty = 0;
+                for( unsigned w = 0; w < _nWorkers; w++ )
+                    if( !writes[w].empty() )
+                        nonEmpty++;
+                if( nonEmpty > 1 && bytes >= MinParallelApplyBytes ) {
+                    for( unsigned w = 0; w < _nWorkers; w++ )
+                        if( !writes[w].empty() )
+                            workers->schedule(writeToDataFiles, &writes[w]);
+                    workers->join();
+                }
+                else {
+                    for( unsigned w = 0; w < _nWorkers; w++ )
+                        writeToDataFiles(&writes[w]);
+                }
+                stats.curr->_writeToDataFilesBytes += bytes;
+                bytes = 0;
+                for( unsigned w = 0; w < _nWorkers; w++ )
+                    writes[w].clear();
+
+                if( i == entries.end() )
+                    break;
+                applyEntry(*i, /*apply*/true, /*dump*/false);
+                ++i;
+            }
+        }
+
         void RecoveryJob::applyEntries(const vector<ParsedJournalEntry> &entries) {
             bool apply = (cmdLine.durOptions & CmdLine::DurScanOnly) == 0;
             bool dump = cmdLine.durOptions & CmdLine::DurDumpJournal;
             if( dump )
                 log() << "BEGIN section" << endl;
 
-            for( vector<ParsedJournalEntry>::const_iterator i = entries.begin(); i != entries.end(); ++i ) {
-                applyEntry(*i, apply, dump);
+            // the db name pointers may be into the previous section's buffer
+            _lastMMF = 0;
+
+            if( apply && !dump && getWorkers() ) {
+                applyEntriesInParallel(entries);
+            }
+            else {
+                for( vector<ParsedJournalEntry>::const_iterator i = entries.begin(); i != entries.end(); ++i ) {
+                    applyEntry(*i, apply, dump);
+                }
             }
 
             if( dump )
                 log() << "END section" << endl;
         }
 
-        void RecoveryJob::processSection(const JSectHeader *h, const void *p, unsigned len, const JSectFooter *f) {
+        void RecoveryJob::processSection(const JSectHeader *h, const void *p, unsigned len, const JSectFooter *f,
+                                         string *uncompressed) {
             scoped_lock lk(_mx);
             RACECHECK
 
@@ -325,7 +458,7 @@ namespace mongo {
 
             auto_ptr<JournalSectionIterator> i;
             if( _recovering ) {
-                i = auto_ptr<JournalSectionIterator>(new JournalSectionIterator(*h, p, len, _recovering));
+                i = auto_ptr<JournalSectionIterator>(new JournalSectionIterator(*h, p, len, _recovering, uncompressed));
             }
             else { 
                 i = auto_ptr<JournalSectionIterator>(new JournalSectionIterator(*h, /*after header*/p, /*w/out header*/len));
@@ -363,11 +496,44 @@ namespace mongo {
             applyEntries(entries);
         }
 
+        /** how many sections per recovery worker we read ahead and uncompress at once */
+        static const unsigned MaxSectionsReadAhead = 2;
+
+        static void uncompressSection(RecoverySection *s) {
+            s->uncompressedOk = uncompress(s->data, s->len, &s->uncompressed);
+        }
+
+        void RecoveryJob::processSections(vector<RecoverySection>& sections) {
+            vector<RecoverySection> todo;
+            todo.swap(sections);
+            if( todo.empty() )
+                return;
+
+            ThreadPool *workers = getWorkers();
+            if( workers && todo.size() > 1 && (cmdLine.durOptions & CmdLine::DurScanOnly) == 0 ) {
+                for( vector<RecoverySection>::iterator i = todo.begin(); i != todo.end(); ++i ) {
+                    // skip the ones processSection() will skip
+                    if( i->h->compression() == JSectHeader::Snappy &&
+                        _lastDataSyncedFromLastRun <= i->h->seqNumber + ExtraKeepTimeMs ) {
+                        workers->schedule(uncompressSection, &*i);
+                    }
+                }
+                workers->join();
+            }
+
+            // applied in journal order
+            for( vector<RecoverySection>::iterator i = todo.begin(); i != todo.end(); ++i ) {
+                processSection(i->h, i->data, i->len, i->f, i->uncompressedOk ? &i->uncompressed : 0);
+            }
+        }
+
         /** apply a specific journal file, that is already mmap'd
             @param p start of the memory mapped file
             @return true if this is detected to be the last file (ends abruptly)
         */
         bool RecoveryJob::processFileBuffer(const void *p, unsigned len) {
+            // sections read but not yet processed
+            vector<RecoverySection> sections;
             try {
                 unsigned long long fileId;
                 BufReader br(p,len);
@@ -408,20 +574,35 @@ namespace mongo {
                             log() << "Ending processFileBuffer at differing fileId want:" << fileId << " got:" << h.fileId << endl;
                             log() << "  sect len:" << h.sectionLen() << " seqnum:" << h.seqNumber << endl;
                         }
-                        return true;
+                        processSections(sections);
+                        // zeros are where a prealloced file ended when we rotated to the next one; what
+                        // follows them is an older journal that was recycled into this file
+                        bool endMarker = h.fileId == 0 && h.seqNumber == 0 && h.sectionLen() == 0;
+                        return !endMarker;
                     }
                     unsigned slen = h.sectionLen();
                     unsigned dataLen = slen - sizeof(JSectHeader) - sizeof(JSectFooter);
                     const char *hdr = (const char *) br.skip(h.sectionLenWithPadding());
                     const char *data = hdr + sizeof(JSectHeader);
                     const char *footer = data + dataLen;
-                    processSection((const JSectHeader*) hdr, data, dataLen, (const JSectFooter*) footer);
+                    sections.push_back( RecoverySection((const JSectHeader*) hdr, data, dataLen, (const JSectFooter*) footer) );
+                    if( sections.size() >= MaxSectionsReadAhead * max(_nWorkers, 1U) )
+                        processSections(sections);
 
                     // ctrl c check
                     killCurrentOp.checkForInterrupt(false);
                 }
+                processSections(sections);
             }
             catch( BufReader::eof& ) {
+                // an abrupt end while reading a section's header; the sections before it are complete.
+                // processSections() empties sections first, so if it threw this we don't retry them.
+                try {
+                    processSections(sections);
+                }
+                catch( BufReader::eof& ) {
+                    // a section that ends early, as before this is an abrupt end
+                }
                 if( cmdLine.durOptions & CmdLine::DurDumpJournal )
                     log() << "ABRUPT END" << endl;
                 return true; // abrupt end
@@ -469,6 +650,8 @@ namespace mongo {
             }
 
             close();
+            _workers.reset();
+            _nWorkers = 0;
 
             if( cmdLine.durOptions & CmdLine::DurScanOnly ) {
                 uasserted(13545, str::stream() << "--durOptions " << (int) CmdLine::DurScanOnly << " (scan only) specified");
@@ -4,6 +4,7 @@
 
 #include "dur_journalformat.h"
 #include "../util/concurrency/mutex.h"
+#include "../util/concurrency/thread_pool.h"
 #include "../util/file.h"
 
 namespace mongo {
@@ -11,31 +12,51 @@ namespace mongo {
 
     namespace dur {
         struct ParsedJournalEntry;
+        struct RecoverySection;
 
         /** call go() to execute a recovery from existing journal files.
          */
         class RecoveryJob : boost::noncopyable {
         public:
-            RecoveryJob() : _lastDataSyncedFromLastRun(0), 
+            RecoveryJob() : _nWorkers(0), _lastMMF(0), _lastDataSyncedFromLastRun(0), 
                 _mx("recovery"), _recovering(false) { _lastSeqMentionedInConsoleLog = 1; }
             void go(vector<boost::filesystem::path>& files);
             ~RecoveryJob();
 
-            /** @param data data between header and footer. compressed if recovering. */
-            void processSection(const JSectHeader *h, const void *data, unsigned len, const JSectFooter *f);
+            /** @param data data between header and footer. compressed if recovering.
+                @param uncompressed if not null, data already uncompressed by a recovery worker; 
+                       its contents are taken.
+            */
+            void processSection(const JSectHeader *h, const void *data, unsigned len, const JSectFooter *f,
+                                string *uncompressed = 0);
 
             void close(); // locks and calls _close()
 
             static RecoveryJob & get() { return _instance; }
         private:
+            /** the data file for entry, opening it if we are recovering */
+            MongoMMF* findMMF(const ParsedJournalEntry& entry);
             void write(const ParsedJournalEntry& entry); // actually writes to the file
             void applyEntry(const ParsedJournalEntry& entry, bool apply, bool dump);
             void applyEntries(const vector<ParsedJournalEntry> &entries);
+            void applyEntriesInParallel(const vector<ParsedJournalEntry> &entries);
             bool processFileBuffer(const void *, unsigned len);
+            /** uncompresses the sections in parallel, then processes them in order.  empties sections. */
+            void processSections(vector<RecoverySection>& sections);
             bool processFile(boost::filesystem::path journalfile);
             void _close(); // doesn't lock
 
+            /** recovery workers, null until first needed.  we only use them when recovering
+                on a box with more than one core. */
+            ThreadPool* getWorkers();
+            boost::scoped_ptr<ThreadPool> _workers;
+            unsigned _nWorkers;
+
             list<boost::shared_ptr<MongoMMF> > _mmfs;
+            // the file for the last entry written, so we don't look it up for every entry
+            const char *_lastDbName;
+            int _lastFileNo;
+            MongoMMF *_lastMMF;
 
             unsigned long long _lastDataSyncedFromLastRun;
             unsigned long long _lastSeqMentionedInConsoleLog;
@@ -1,6 +1,12 @@
 // @file dur_stats.h
 
+#pragma once
+
+#include "mongo/bson/util/atomic_int.h"
+
 namespace mongo {
+    class Histogram;
+
     namespace dur {
 
         /** journaling stats.  the model here is that the commit thread is the only writer, and that reads are
@@ -10,6 +16,24 @@ namespace mongo {
             Stats();
             void rotate();
             BSONObj asObj();
+
+            enum Phase { PrepLogBuffer, WriteToJournal, WriteToDataFiles, RemapPrivateView, NPhases };
+
+            /** adds one group commit's time in a phase to the histograms kept since startup, which
+                show stalls the interval totals average away */
+            void recordPhase( Phase p , unsigned long long micros );
+            BSONObj latencies();
+
+            /** one group commit's journal write, with the number of j:true writers then waiting */
+            void recordCommit( unsigned long long journaledBytes );
+
+            /** a stretch of a group commit during which no one could write */
+            void recordWritersBlocked( unsigned long long micros );
+
+            /** brackets a getlasterror j:true wait for the next group commit */
+            void startAwaitingCommit() { _awaitingCommit++; }
+            void stopAwaitingCommit() { _awaitingCommit--; }
+
             unsigned _intervalMicros;
             struct S {
                 BSONObj _asObj();
@@ -35,12 +59,22 @@ namespace mongo {
                 // - data being written faster than the normal group commit interval
                 unsigned _commitsInWriteLock;
 
+                unsigned _maxCommitWaiters;
+                unsigned long long _maxCommitBytes;
+                unsigned long long _maxWriterBlockedMicros;
+
                 unsigned _dtMillis;
             };
             S *curr;
         private:
             S _a,_b;
             unsigned long long _lastRotate;
+            Histogram *_latencies[NPhases]; // leaked, like the other histograms
+            Histogram *_commitBytes;
+            Histogram *_commitWaiters;
+            Histogram *_writersBlocked;
+            unsigned long long _maxWriterBlockedMicros; // since startup
+            AtomicUInt _awaitingCommit;
             S* other();
         };
         extern Stats stats;
@@ -182,6 +182,16 @@ namespace mongo {
         return *ret;
     }
     
+    BSONObj ExplainStageTimes::bson() const {
+        BSONObjBuilder bob;
+        bob.appendNumber( "advanceMicros", _advanceMicros );
+        bob.appendNumber( "matchMicros", _matchMicros );
+        bob.appendNumber( "projectMicros", _projectMicros );
+        bob.appendNumber( "yieldMicros", _yieldMicros );
+        bob.appendNumber( "recordsNotInMemory", _recordsNotInMemory );
+        return bob.obj();
+    }
+
     void ExplainQueryInfo::noteIterate( bool match, bool loadedRecord, bool chunkSkip ) {
         verify( !_clauses.empty() );
         _clauses.back()->noteIterate( match, loadedRecord, chunkSkip );
@@ -200,6 +210,10 @@ namespace mongo {
     void ExplainQueryInfo::setAncillaryInfo( const AncillaryInfo &ancillaryInfo ) {
         _ancillaryInfo = ancillaryInfo;
     }
+
+    void ExplainQueryInfo::setStageTimes( const ExplainStageTimes &stageTimes ) {
+        _stageTimes = stageTimes;
+    }
     
     BSONObj ExplainQueryInfo::bson() const {
         BSONObjBuilder bob;
@@ -224,6 +238,7 @@ namespace mongo {
             bob.appendNumber( "nscanned", nscanned );
             bob.appendNumber( "millis", _timer.duration() );
         }
+        bob.append( "stages", _stageTimes.bson() );
         
         if ( !_ancillaryInfo._oldPlan.isEmpty() ) {
             bob.append( "oldPlan", _ancillaryInfo._oldPlan );
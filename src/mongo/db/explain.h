@@ -40,6 +40,25 @@ namespace mongo {
         int _duration;
     };
     
+    /**
+     * Time a query spends in each stage of reading its results, recorded for explain only.
+     * Advancing the cursor includes btree traversal and, for a QueryOptimizerCursor, the work of
+     * the plans raced against each other; matching includes loading each record the matcher
+     * needs, of which those not likely in physical memory are counted.
+     */
+    struct ExplainStageTimes {
+        ExplainStageTimes() :
+        _advanceMicros(), _matchMicros(), _projectMicros(), _yieldMicros(),
+        _recordsNotInMemory() {
+        }
+        BSONObj bson() const;
+        long long _advanceMicros;
+        long long _matchMicros;
+        long long _projectMicros;
+        long long _yieldMicros;
+        long long _recordsNotInMemory;
+    };
+
     class ExplainClauseInfo;
     
     /** Data describing execution of a query plan. */
@@ -131,6 +150,7 @@ namespace mongo {
             BSONObj _oldPlan;
         };
         void setAncillaryInfo( const AncillaryInfo &ancillaryInfo );
+        void setStageTimes( const ExplainStageTimes &stageTimes );
         
         /* Add information about a clause to this query. */
         void addClauseInfo( const shared_ptr<ExplainClauseInfo> &info );
@@ -141,6 +161,7 @@ namespace mongo {
         
         list<shared_ptr<ExplainClauseInfo> > _clauses;
         AncillaryInfo _ancillaryInfo;
+        ExplainStageTimes _stageTimes;
         DurationTimer _timer;
     };
     
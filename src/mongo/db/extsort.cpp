@@ -19,46 +19,36 @@
 #include "pch.h"
 #include "extsort.h"
 #include "namespace-inl.h"
+#include "client.h"
 #include "../util/file.h"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <fstream>
+#include <boost/thread/thread.hpp>
 #include <boost/filesystem/convenience.hpp>
 #include <boost/filesystem/operations.hpp>
 
 namespace mongo {
 
-    HLMutex BSONObjExternalSorter::_extSortMutex("s");
-    IndexInterface *BSONObjExternalSorter::extSortIdxInterface;
-    Ordering BSONObjExternalSorter::extSortOrder( Ordering::make(BSONObj()) );
-    unsigned long long BSONObjExternalSorter::_compares = 0;
     unsigned long long BSONObjExternalSorter::_uniqueNumber = 0;
     static SimpleMutex _uniqueNumberMutex( "uniqueNumberMutex" );
 
     /*static*/
-    int BSONObjExternalSorter::_compare(IndexInterface& i, const Data& l, const Data& r, const Ordering& order) { 
-        RARELY killCurrentOp.checkForInterrupt();
-        _compares++;
+    int BSONObjExternalSorter::_compare(IndexInterface& i, const Data& l, const Data& r, const Ordering& order,
+                                        unsigned long long* compares) {
+        // the sorter's own threads have no Client; the caller's thread checks for them
+        RARELY if ( haveClient() ) killCurrentOp.checkForInterrupt();
+        (*compares)++;
         int x = i.keyCompare(l.first, r.first, order);
         if ( x )
             return x;
         return l.second.compare( r.second );
     }
 
-    /*static*/
-    int BSONObjExternalSorter::extSortComp( const void *lv, const void *rv ) {
-        DEV RARELY {
-            _extSortMutex.dassertLocked(); // must be as we use a global var
-        }
-        Data * l = (Data*)lv;
-        Data * r = (Data*)rv;
-        return _compare(*extSortIdxInterface, *l, *r, extSortOrder);
-    };
-
     BSONObjExternalSorter::BSONObjExternalSorter( IndexInterface &i, const BSONObj & order , long maxFileSize )
         : _idxi(i), _order( order.getOwned() ) , _maxFilesize( maxFileSize ) ,
-          _arraySize(1000000), _cur(0), _curSizeSoFar(0), _sorted(0) {
+          _arraySize(1000000), _cur(0), _curSizeSoFar(0), _sorted(0), _compares(0) {
 
         stringstream rootpath;
         rootpath << dbpath;
@@ -77,7 +67,6 @@ namespace mongo {
         log(1) << "external sort root: " << _root.string() << endl;
 
         create_directories( _root );
-        _compares = 0;
     }
 
     BSONObjExternalSorter::~BSONObjExternalSorter() {
@@ -89,13 +78,85 @@ namespace mongo {
         wassert( removed == 1 + _files.size() );
     }
 
+    /* in-memory runs smaller than this many keys per thread are sorted on the caller's thread alone */
+    static const int minParallelSortKeys = 10000;
+
+    /*static*/
+    int BSONObjExternalSorter::numSortThreads() {
+        int n = (int) boost::thread::hardware_concurrency();
+        return std::max( 1 , std::min( n , 8 ) );
+    }
+
+    ThreadPool& BSONObjExternalSorter::_getPool() {
+        if ( ! _pool )
+            _pool.reset( new ThreadPool( std::max( 1 , numSortThreads() - 1 ) ) );
+        return *_pool;
+    }
+
+    void BSONObjExternalSorter::_sortRange( Data * begin , Data * end , unsigned long long * compares ) {
+        try {
+            std::sort( begin , end , MyCmp( _idxi , _order , compares ) );
+        }
+        catch ( std::exception& e ) {
+            log() << "external sort: error sorting in memory: " << e.what() << endl;
+            _poolFailures++;
+        }
+    }
+
+    void BSONObjExternalSorter::_mergeRanges( Data * begin , Data * middle , Data * end , unsigned long long * compares ) {
+        try {
+            std::inplace_merge( begin , middle , end , MyCmp( _idxi , _order , compares ) );
+        }
+        catch ( std::exception& e ) {
+            log() << "external sort: error merging in memory: " << e.what() << endl;
+            _poolFailures++;
+        }
+    }
+
     void BSONObjExternalSorter::_sortInMem() {
-        // extSortComp needs to use glpbals
-        // qsort_r only seems available on bsd, which is what i really want to use
-        HLMutex::scoped_lock lk(_extSortMutex);
-        extSortIdxInterface = &_idxi;
-        extSortOrder = Ordering::make(_order);
-        _cur->sort( BSONObjExternalSorter::extSortComp );
+        Data * data = _cur->data();
+        const int n = _cur->size();
+        const int pieces = std::min( numSortThreads() , n / minParallelSortKeys );
+        if ( pieces <= 1 ) {
+            _cur->sort( MyCmp( _idxi , _order , &_compares ) );
+            return;
+        }
+
+        // sort the pieces side by side, then merge neighbouring pieces pairwise until one is left.
+        // the caller's thread takes the first piece so that it keeps checking for interrupts.
+        ThreadPool& pool = _getPool();
+        vector<Data*> bounds;
+        for ( int i = 0; i <= pieces; i++ )
+            bounds.push_back( data + (int) ( (long long) n * i / pieces ) );
+        vector<unsigned long long> compares( pieces , 0 );
+        _poolFailures.zero();
+
+        try {
+            for ( int i = 1; i < pieces; i++ )
+                pool.schedule( &BSONObjExternalSorter::_sortRange , this , bounds[i] , bounds[i+1] , &compares[i] );
+            std::sort( bounds[0] , bounds[1] , MyCmp( _idxi , _order , &compares[0] ) );
+            pool.join();
+
+            for ( int width = 1; width < pieces; width *= 2 ) {
+                uassert( 16338 , "external sort: in-memory sort failed, see log" , _poolFailures.get() == 0 );
+                killCurrentOp.checkForInterrupt();
+                for ( int i = 0; i + width < pieces; i += 2 * width ) {
+                    pool.schedule( &BSONObjExternalSorter::_mergeRanges , this ,
+                                   bounds[i] , bounds[i+width] , bounds[std::min( i + 2 * width , pieces )] ,
+                                   &compares[i] );
+                }
+                pool.join();
+            }
+        }
+        catch ( ... ) {
+            // the pool threads must be done with the buffer before anyone else touches it
+            pool.join();
+            throw;
+        }
+        uassert( 16338 , "external sort: in-memory sort failed, see log" , _poolFailures.get() == 0 );
+
+        for ( int i = 0; i < pieces; i++ )
+            _compares += compares[i];
     }
 
     void BSONObjExternalSorter::sort() {
@@ -185,11 +246,13 @@ namespace mongo {
     // ---------------------------------
 
     BSONObjExternalSorter::Iterator::Iterator( BSONObjExternalSorter * sorter ) :
-        _cmp( sorter->_idxi, sorter->_order ) , _in( 0 ) {
+        _heap( HeadCmp( MyCmp( sorter->_idxi , sorter->_order , &sorter->_compares ) ) ) , _in( 0 ) {
 
         for ( list<string>::iterator i=sorter->_files.begin(); i!=sorter->_files.end(); i++ ) {
-            _files.push_back( new FileIterator( *i ) );
-            _stash.push_back( pair<Data,bool>( Data( BSONObj() , DiskLoc() ) , false ) );
+            FileIterator * f = new FileIterator( *i );
+            _files.push_back( f );
+            if ( f->more() )
+                _heap.push( Head( f->next() , _files.size() - 1 ) );
         }
 
         if ( _files.size() == 0 && sorter->_cur ) {
@@ -209,13 +272,7 @@ namespace mongo {
         if ( _in )
             return _it != _in->end();
 
-        for ( vector<FileIterator*>::iterator i=_files.begin(); i!=_files.end(); i++ )
-            if ( (*i)->more() )
-                return true;
-        for ( vector< pair<Data,bool> >::iterator i=_stash.begin(); i!=_stash.end(); i++ )
-            if ( i->second )
-                return true;
-        return false;
+        return ! _heap.empty();
     }
 
     BSONObjExternalSorter::Data BSONObjExternalSorter::Iterator::next() {
@@ -226,29 +283,76 @@ namespace mongo {
             return d;
         }
 
-        Data best;
-        int slot = -1;
+        verify( ! _heap.empty() );
+        Head best = _heap.top();
+        _heap.pop();
 
-        for ( unsigned i=0; i<_stash.size(); i++ ) {
+        FileIterator * f = _files[best.second];
+        if ( f->more() )
+            _heap.push( Head( f->next() , best.second ) );
 
-            if ( ! _stash[i].second ) {
-                if ( _files[i]->more() )
-                    _stash[i] = pair<Data,bool>( _files[i]->next() , true );
-                else
-                    continue;
-            }
+        return best.first;
+    }
 
-            if ( slot == -1 || _cmp( best , _stash[i].first ) == 0 ) {
-                best = _stash[i].first;
-                slot = i;
-            }
+    // -----------------------------------
+
+    /* keys handed from the merge thread to the consumer at a time, and batches that may be queued */
+    static const unsigned asyncIteratorBatchSize = 1000;
+    static const unsigned asyncIteratorQueueDepth = 16;
+
+    BSONObjExternalSorter::AsyncIterator::AsyncIterator( BSONObjExternalSorter * sorter ) :
+        _it( new Iterator( sorter ) ) , _queue( asyncIteratorQueueDepth ) , _stop( false ) ,
+        _pos( 0 ) , _done( false ) {
+        sorter->_getPool().schedule( &AsyncIterator::_merge , this );
+    }
 
+    BSONObjExternalSorter::AsyncIterator::~AsyncIterator() {
+        _stop = true;
+        // keep draining so the merge thread can't block on a full queue
+        while ( ! _done ) {
+            if ( ! _queue.blockingPop() )
+                _done = true;
+        }
+    }
+
+    /*static*/
+    void BSONObjExternalSorter::AsyncIterator::_merge( AsyncIterator * it ) {
+        try {
+            while ( ! it->_stop && it->_it->more() ) {
+                Batch batch( new vector<Data>() );
+                batch->reserve( asyncIteratorBatchSize );
+                while ( batch->size() < asyncIteratorBatchSize && it->_it->more() )
+                    batch->push_back( it->_it->next() );
+                it->_queue.push( batch );
+            }
+        }
+        catch ( std::exception& e ) {
+            it->_error = e.what();
+            if ( it->_error.empty() )
+                it->_error = "unknown error";
         }
+        it->_queue.push( Batch() );
+    }
 
-        verify( slot >= 0 );
-        _stash[slot].second = false;
+    bool BSONObjExternalSorter::AsyncIterator::more() {
+        if ( _batch && _pos < _batch->size() )
+            return true;
+        if ( _done )
+            return false;
+
+        _batch = _queue.blockingPop();
+        _pos = 0;
+        if ( ! _batch ) {
+            _done = true;
+            uassert( 16339 , "external sort merge failed: " + _error , _error.empty() );
+            return false;
+        }
+        return true;
+    }
 
-        return best;
+    BSONObjExternalSorter::Data BSONObjExternalSorter::AsyncIterator::next() {
+        verify( more() );
+        return (*_batch)[_pos++];
     }
 
     // -----------------------------------
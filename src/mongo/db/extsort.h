@@ -20,12 +20,16 @@
 
 #include "pch.h"
 
+#include <queue>
+
 #include "mongo/db/index.h"
 #include "mongo/db/jsobj.h"
 #include "mongo/db/namespace-inl.h"
 #include "mongo/db/curop-inl.h"
 #include "mongo/util/array.h"
 #include "mongo/util/mmap.h"
+#include "mongo/util/queue.h"
+#include "mongo/util/concurrency/thread_pool.h"
 
 namespace mongo {
 
@@ -39,26 +43,25 @@ namespace mongo {
         typedef pair<BSONObj,DiskLoc> Data;
  
     private:
-        static HLMutex _extSortMutex;
         IndexInterface& _idxi;
 
-        static int _compare(IndexInterface& i, const Data& l, const Data& r, const Ordering& order);
+        static int _compare(IndexInterface& i, const Data& l, const Data& r, const Ordering& order,
+                            unsigned long long* compares);
 
+        /** per sorter comparator, so that sorts in different threads don't serialize */
         class MyCmp {
         public:
-            MyCmp( IndexInterface& i, BSONObj order = BSONObj() ) : _i(i), _order( Ordering::make(order) ) {}
+            MyCmp( IndexInterface& i, BSONObj order , unsigned long long* compares ) :
+                _i(i), _order( Ordering::make(order) ), _compares(compares) {}
             bool operator()( const Data &l, const Data &r ) const {
-                return _compare(_i, l, r, _order) < 0;
+                return _compare(_i, l, r, _order, _compares) < 0;
             };
         private:
             IndexInterface& _i;
             const Ordering _order;
+            unsigned long long* _compares;
         };
 
-        static IndexInterface *extSortIdxInterface;
-        static Ordering extSortOrder;
-        static int extSortComp( const void *lv, const void *rv );
-
         class FileIterator : boost::noncopyable {
         public:
             FileIterator( string file );
@@ -75,6 +78,12 @@ namespace mongo {
 
         typedef FastArray<Data> InMemory;
 
+        /**
+         * threads used for one sort, including the caller's.  in-memory runs are sorted in this many
+         * pieces side by side, and parallel index builds extract keys on as many threads.
+         */
+        static int numSortThreads();
+
         class Iterator : boost::noncopyable {
         public:
 
@@ -84,15 +93,57 @@ namespace mongo {
             Data next();
 
         private:
-            MyCmp _cmp;
+            /** the head of each file; the least one is on top of the merge heap */
+            typedef pair<Data,unsigned> Head;
+            class HeadCmp {
+            public:
+                HeadCmp( const MyCmp& cmp ) : _cmp(cmp) {}
+                bool operator()( const Head& l, const Head& r ) const {
+                    if ( _cmp( r.first , l.first ) )
+                        return true;
+                    if ( _cmp( l.first , r.first ) )
+                        return false;
+                    return l.second > r.second;
+                }
+            private:
+                MyCmp _cmp;
+            };
+
             vector<FileIterator*> _files;
-            vector< pair<Data,bool> > _stash;
+            priority_queue< Head , vector<Head> , HeadCmp > _heap;
 
             InMemory * _in;
             InMemory::iterator _it;
 
         };
 
+        /**
+         * same results as Iterator, but the merge runs on one of the sorter's threads and hands the
+         * keys back in batches through a bounded queue, so that it overlaps with whatever the caller
+         * does with each key (e.g. BtreeBuilder).  errors in the merge are rethrown from more().
+         */
+        class AsyncIterator : boost::noncopyable {
+        public:
+            AsyncIterator( BSONObjExternalSorter * sorter );
+            /** stops the merge, and waits for it to let go of the sorter */
+            ~AsyncIterator();
+            bool more();
+            Data next();
+
+        private:
+            typedef shared_ptr< vector<Data> > Batch; // an empty Batch marks the end
+            static void _merge( AsyncIterator * it );
+
+            auto_ptr<Iterator> _it;
+            BlockingQueue<Batch> _queue;
+            volatile bool _stop;
+            string _error; // set by _merge before it queues the end marker
+
+            Batch _batch;
+            unsigned _pos;
+            bool _done;
+        };
+
         void add( const BSONObj& o , const DiskLoc & loc );
         void add( const BSONObj& o , int a , int b ) {
             add( o , DiskLoc( a , b ) );
@@ -106,6 +157,11 @@ namespace mongo {
             return auto_ptr<Iterator>( new Iterator( this ) );
         }
 
+        auto_ptr<AsyncIterator> asyncIterator() {
+            uassert( 16340 ,  "not sorted" , _sorted );
+            return auto_ptr<AsyncIterator>( new AsyncIterator( this ) );
+        }
+
         int numFiles() {
             return _files.size();
         }
@@ -120,6 +176,9 @@ namespace mongo {
     private:
 
         void _sortInMem();
+        ThreadPool& _getPool();
+        void _sortRange( Data * begin , Data * end , unsigned long long * compares );
+        void _mergeRanges( Data * begin , Data * middle , Data * end , unsigned long long * compares );
 
         void sort( string file );
         void finishMap();
@@ -135,7 +194,10 @@ namespace mongo {
         list<string> _files;
         bool _sorted;
 
-        static unsigned long long _compares;
+        unsigned long long _compares;
         static unsigned long long _uniqueNumber;
+
+        scoped_ptr<ThreadPool> _pool; // created on first use, numSortThreads() - 1 threads
+        AtomicUInt _poolFailures;
     };
 }
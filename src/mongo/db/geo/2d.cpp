@@ -30,6 +30,8 @@
 #include "core.h"
 #include "../../util/timer.h"
 
+#include <queue>
+
 // Note: we use indexinterface herein to talk to the btree code. In the future it would be nice to 
 //       be able to use the V1 key class (see key.h) instead of toBson() which has some cost.
 //       toBson() is new with v1 so this could be slower than it used to be?  a quick profiling
@@ -585,13 +587,14 @@ namespace mongo {
     class Polygon {
     public:
 
-        Polygon( void ) : _centroidCalculated( false ) {}
+        Polygon( void ) : _centroidCalculated( false ), _edgesCalculated( false ) {}
 
-        Polygon( vector<Point> points ) : _centroidCalculated( false ),
+        Polygon( vector<Point> points ) : _centroidCalculated( false ), _edgesCalculated( false ),
             _points( points ) { }
 
         void add( Point p ) {
             _centroidCalculated = false;
+            _edgesCalculated = false;
             _points.push_back( p );
         }
 
@@ -610,25 +613,34 @@ namespace mongo {
 
         int contains( const Point &p, double fudge ) const {
 
+            calculateEdges();
+
+            // Farther than fudge from the bounds is outside, and near no edge
+            if( p._x + fudge < _edgeBounds._min._x || p._x - fudge > _edgeBounds._max._x ||
+                p._y + fudge < _edgeBounds._min._y || p._y - fudge > _edgeBounds._max._y ) {
+                return -1;
+            }
+
             Box fudgeBox( Point( p._x - fudge, p._y - fudge ), Point( p._x + fudge, p._y + fudge ) );
 
             int counter = 0;
-            Point p1 = _points[0];
-            for ( int i = 1; i <= size(); i++ ) {
-                Point p2 = _points[i % size()];
+            for ( unsigned i = 0; i < _edges.size(); i++ ) {
+                const Edge& e = _edges[i];
+                const Point& p1 = e._p1;
+                const Point& p2 = e._p2;
 
                 GEODEBUG( "Doing intersection check of " << fudgeBox.toString() << " with seg " << p1.toString() << " to " << p2.toString() );
 
                 // We need to check whether or not this segment intersects our error box
                 if( fudge > 0 &&
                         // Points not too far below box
-                        fudgeBox._min._y <= std::max( p1._y, p2._y ) &&
+                        fudgeBox._min._y <= e._maxY &&
                         // Points not too far above box
-                        fudgeBox._max._y >= std::min( p1._y, p2._y ) &&
+                        fudgeBox._max._y >= e._minY &&
                         // Points not too far to left of box
-                        fudgeBox._min._x <= std::max( p1._x, p2._x ) &&
+                        fudgeBox._min._x <= e._maxX &&
                         // Points not too far to right of box
-                        fudgeBox._max._x >= std::min( p1._x, p2._x ) ) {
+                        fudgeBox._max._x >= e._minX ) {
 
                     GEODEBUG( "Doing detailed check" );
 
@@ -645,7 +657,7 @@ namespace mongo {
                     // Do intersection check for vertical sides
                     if ( p1._y != p2._y ) {
 
-                        double invSlope = ( p2._x - p1._x ) / ( p2._y - p1._y );
+                        double invSlope = e._invSlope;
 
                         double xintersT = ( fudgeBox._max._y - p1._y ) * invSlope + p1._x;
                         if( fudgeBox._min._x <= xintersT && fudgeBox._max._x >= xintersT ) {
@@ -664,7 +676,7 @@ namespace mongo {
                     // Do intersection check for horizontal sides
                     if( p1._x != p2._x ) {
 
-                        double slope = ( p2._y - p1._y ) / ( p2._x - p1._x );
+                        double slope = e._slope;
 
                         double yintersR = ( p1._x - fudgeBox._max._x ) * slope + p1._y;
                         if( fudgeBox._min._y <= yintersR && fudgeBox._max._y >= yintersR ) {
@@ -690,16 +702,16 @@ namespace mongo {
                     // If this is a horizontal line we won't intersect, so check this
                     if( p1._y == p2._y && p._y == p1._y ){
                         // Check that the x-coord lies in the line
-                        if( p._x >= std::min( p1._x, p2._x ) && p._x <= std::max( p1._x, p2._x ) ) return 1;
+                        if( p._x >= e._minX && p._x <= e._maxX ) return 1;
                     }
 
                 }
 
                 // Normal intersection test.
                 // TODO: Invert these for clearer logic?
-                if ( p._y > std::min( p1._y, p2._y ) ) {
-                    if ( p._y <= std::max( p1._y, p2._y ) ) {
-                        if ( p._x <= std::max( p1._x, p2._x ) ) {
+                if ( p._y > e._minY ) {
+                    if ( p._y <= e._maxY ) {
+                        if ( p._x <= e._maxX ) {
                             if ( p1._y != p2._y ) {
                                 double xinters = (p._y-p1._y)*(p2._x-p1._x)/(p2._y-p1._y)+p1._x;
                                 // Special case of point on vertical line
@@ -722,8 +734,6 @@ namespace mongo {
                         }
                     }
                 }
-
-                p1 = p2;
             }
 
             if ( counter % 2 == 0 ) {
@@ -794,11 +804,44 @@ namespace mongo {
 
     private:
 
+        // An edge and what contains() needs of it, worked out once rather than for each point
+        struct Edge {
+            Edge( const Point& p1, const Point& p2 ) : _p1( p1 ), _p2( p2 ),
+                _minX( std::min( p1._x, p2._x ) ), _maxX( std::max( p1._x, p2._x ) ),
+                _minY( std::min( p1._y, p2._y ) ), _maxY( std::max( p1._y, p2._y ) ),
+                _invSlope( p1._y != p2._y ? ( p2._x - p1._x ) / ( p2._y - p1._y ) : 0 ),
+                _slope( p1._x != p2._x ? ( p2._y - p1._y ) / ( p2._x - p1._x ) : 0 ) {
+            }
+            Point _p1, _p2;
+            double _minX, _maxX, _minY, _maxY;
+            double _invSlope; // when not horizontal
+            double _slope;    // when not vertical
+        };
+
+        void calculateEdges() const {
+            if ( _edgesCalculated ) return;
+            _edges.clear();
+            for ( int i = 1; i <= size(); i++ )
+                _edges.push_back( Edge( _points[i - 1], _points[i % size()] ) );
+            _edgeBounds._min = _edgeBounds._max = _points[0];
+            for ( unsigned i = 0; i < _edges.size(); i++ ) {
+                _edgeBounds._min._x = std::min( _edgeBounds._min._x, _edges[i]._minX );
+                _edgeBounds._min._y = std::min( _edgeBounds._min._y, _edges[i]._minY );
+                _edgeBounds._max._x = std::max( _edgeBounds._max._x, _edges[i]._maxX );
+                _edgeBounds._max._y = std::max( _edgeBounds._max._y, _edges[i]._maxY );
+            }
+            _edgesCalculated = true;
+        }
+
         bool _centroidCalculated;
         Point _centroid;
 
         Box _bounds;
 
+        mutable bool _edgesCalculated;
+        mutable vector<Edge> _edges;
+        mutable Box _edgeBounds;
+
         vector<Point> _points;
     };
 
@@ -2146,6 +2189,12 @@ namespace mongo {
 
 #endif
 
+           if( _type == GEO_PLAIN ){
+               nearestCells();
+               expandEndPoints();
+               return;
+           }
+
            // Part 1
            {
                do {
@@ -2228,6 +2277,91 @@ namespace mongo {
 
         }
 
+        // A geohash cell, ordered so a priority_queue gives the one nearest _near first
+        struct Cell {
+            Cell( const GeoHash& h, double d ) : hash( h ), minDistance( d ) {}
+            GeoHash hash;
+            double minDistance; // the least any point in the cell can be from _near
+            bool operator<( const Cell& other ) const { return minDistance > other.minDistance; }
+        };
+
+        double minDistance( const Box& b ) const {
+            double dx = std::max( 0.0, std::max( b._min._x - _near._x, _near._x - b._max._x ) );
+            double dy = std::max( 0.0, std::max( b._min._y - _near._y, _near._y - b._max._y ) );
+            return sqrt( dx * dx + dy * dy );
+        }
+
+        /**
+         * Best first search of the geohash cells, from the whole space down, nearest cell first.
+         * A cell with more than maxPointsHeuristic keys is split into its four children, a
+         * smaller one has its keys added, and a cell farther than the points found so far can
+         * be isn't scanned at all.  So each key is looked at once, and the queue holds little more
+         * than the cells bordering the ones taken.  Only for plain distances, as a box's least
+         * spherical distance isn't as simple; those expand boxes around the start instead.
+         */
+        void nearestCells() {
+            static const char* children[] = { "00", "01", "10", "11" };
+
+            priority_queue<Cell> cells;
+            cells.push( Cell( GeoHash(), 0 ) );
+            vector<GeoKeyNode> keys;
+            while( ! cells.empty() ){
+                Cell c = cells.top();
+                cells.pop();
+
+                // what approxKeyCheck() lets in
+                double bound = ( _points.size() < _max ? _maxDistance : farthest() ) + 2 * _distError;
+                if( c.minDistance > bound ) break;
+
+                keys.clear();
+                bool leaf = c.hash.getBits() >= _g->_bits;
+                if( ! scanCell( c.hash, leaf ? -1 : maxPointsHeuristic, keys ) ){
+                    for( int i = 0; i < 4; i++ ){
+                        GeoHash child = c.hash + children[i];
+                        double d = minDistance( Box( _g, child ) );
+                        if( d <= bound ) cells.push( Cell( child, d ) );
+                    }
+                    continue;
+                }
+
+                GEODEBUG( "adding " << keys.size() << " keys of cell " << c.hash << " at " << c.minDistance );
+                for( unsigned i = 0; i < keys.size(); i++ ){
+                    _foundInExp++;
+                    add( keys[i] );
+                }
+                processExtraPoints();
+            }
+            _state = DONE;
+        }
+
+        /**
+         * Puts the keys under cell in keys, unless there are more than limit (-1 for none).
+         * @return false if there were
+         */
+        bool scanCell( const GeoHash& cell, int limit, vector<GeoKeyNode>& keys ){
+            BSONObj query = BSON( _spec->_geo << BSON( "$lt" << MAXKEY << cell.wrap( "$gte" ).firstElement() ) );
+            FieldRangeSet frs( _spec->getDetails()->parentNS().c_str(), query, true, false );
+
+            BSONObjBuilder bob;
+            bob.append( _spec->_geo, 1 );
+            for( vector<string>::const_iterator i = _spec->_other.begin(); i != _spec->_other.end(); i++ ){
+                bob.append( *i, 1 );
+            }
+            IndexSpec iSpec( bob.obj() );
+
+            shared_ptr<FieldRangeVector> frv( new FieldRangeVector( frs, iSpec, 1 ) );
+            scoped_ptr<BtreeCursor> cursor( BtreeCursor::make( nsdetails( _spec->getDetails()->parentNS().c_str() ),
+                                                               *( _spec->getDetails() ), frv, 1 ) );
+            for( ; cursor->ok(); cursor->advance() ){
+                BSONObj k = cursor->currKey();
+                if( ! GeoHash( k.firstElement() ).hasPrefix( cell ) ) break;
+                _nscanned++;
+                if( limit >= 0 && keys.size() == (unsigned) limit ) return false;
+                keys.push_back( GeoKeyNode( cursor->getBucket(), cursor->getKeyOfs(), cursor->currLoc(), k ) );
+            }
+            return true;
+        }
+
         void addExactPoints( const GeoPoint& pt, Holder& points, bool force ){
             int before, after;
             addExactPoints( pt, points, before, after, force );
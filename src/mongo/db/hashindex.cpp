@@ -124,6 +124,18 @@ namespace mongo {
         }
         inArray.done();
         inObj.done();
+
+        //A single value, the common case for lookups by a hashed shard key, needs no
+        //interval iteration: scan the keys equal to its hash
+        if ( intervals.size() == 1 ) {
+            BSONObj key = BSON( "" << makeSingleKey( intervals[0]._lower._bound , _seed , _hashVersion ) );
+            const shared_ptr< BtreeCursor > pointCursor(
+                    BtreeCursor::make( nsdetails( _spec->getDetails()->parentNS().c_str()),
+                                       *( _spec->getDetails() ), key , key , true , 1 ) );
+            pointCursor->setMatcher( forceDocMatcher );
+            return pointCursor;
+        }
+
         BSONObj newQuery = newQueryBuilder.obj();
 
         //Use the point-intervals of the new query to create a Btree cursor
@@ -25,6 +25,8 @@
 #include "background.h"
 #include "repl/rs.h"
 #include "ops/delete.h"
+#include "stats/namespace_io.h"
+#include "mongo/db/ops/update_internal.h"
 #include "mongo/util/scopeguard.h"
 
 
@@ -77,6 +79,10 @@ namespace mongo {
         virtual bool unindex(const DiskLoc thisLoc, IndexDetails& id, const BSONObj& key, const DiskLoc recordLoc) const {
             return thisLoc.btree<V>()->unindex(thisLoc, id, key, recordLoc);
         }
+        virtual bool relocate(const DiskLoc thisLoc, IndexDetails& id, const BSONObj& key, const DiskLoc oldLoc,
+                              const DiskLoc newLoc) const {
+            return thisLoc.btree<V>()->relocate(thisLoc, id, key, oldLoc, newLoc);
+        }
         virtual int bt_insert(const DiskLoc thisLoc, const DiskLoc recordLoc,
                       const BSONObj& key, const Ordering &order, bool dupsAllowed,
                       IndexDetails& idx, bool toplevel = true) const {
@@ -120,6 +126,10 @@ namespace mongo {
         virtual DiskLoc advance(const DiskLoc& thisLoc, int& keyOfs, int direction, const char *caller) { 
             return thisLoc.btree<V>()->advance(thisLoc,keyOfs,direction,caller);
         }
+        virtual Record* bucketNotInMemory(const IndexDetails &idx, const DiskLoc& thisLoc, const BSONObj& key,
+                                          const DiskLoc &recordLoc) const {
+            return thisLoc.btree<V>()->bucketNotInMemory(idx, thisLoc, key, recordLoc);
+        }
     };
 
     int oldCompare(const BSONObj& l,const BSONObj& r, const Ordering &o); // key.cpp
@@ -134,10 +144,16 @@ namespace mongo {
         return l.woCompare(r, ordering, /*considerfieldname*/false);
     }
 
+    template <>
+    int IndexInterfaceImpl< V2 >::keyCompare(const BSONObj& l, const BSONObj& r, const Ordering &ordering) { 
+        return l.woCompare(r, ordering, /*considerfieldname*/false);
+    }
+
     IndexInterfaceImpl<V0> iii_v0;
     IndexInterfaceImpl<V1> iii_v1;
+    IndexInterfaceImpl<V2> iii_v2;
 
-    IndexInterface *IndexDetails::iis[] = { &iii_v0, &iii_v1 };
+    IndexInterface *IndexDetails::iis[] = { &iii_v0, &iii_v1, &iii_v2 };
 
     int removeFromSysIndexes(const char *ns, const char *idxName) {
         string system_indexes = cc().database()->name + ".system.indexes";
@@ -196,6 +212,7 @@ namespace mongo {
             NamespaceDetailsTransient::get( pns.c_str() ).deletedIndex();
 
             string name = indexName();
+            NamespaceIO::forget( ns );
 
             /* important to catch exception here so we can finish cleanup below. */
             try {
@@ -240,11 +257,21 @@ namespace mongo {
     }
 
     void getIndexChanges(vector<IndexChanges>& v, const char *ns, NamespaceDetails& d,
-                         BSONObj newObj, BSONObj oldObj, bool &changedId) {
+                         BSONObj newObj, BSONObj oldObj, bool &changedId, const ModSet *mods) {
         int z = d.nIndexesBeingBuilt();
         v.resize(z);
+        // the ModSet was checked against every indexed field when it was made
+        if( mods && mods->isIndexed() <= 0 )
+            return;
+        NamespaceDetailsTransient *nsdt = mods ? &NamespaceDetailsTransient::get(ns) : 0;
         for( int i = 0; i < z; i++ ) {
             IndexDetails& idx = d.idx(i);
+            if( mods ) {
+                // the fields of a background index being built aren't in the transient's sets
+                const set<string> *keys = nsdt->indexKeys(i);
+                if( keys ? !mods->touchesIndex(*keys) : !mods->touchesIndex(idx) )
+                    continue; // its keys are the same, no need to make them twice
+            }
             BSONObj idxKey = idx.info.obj().getObjectField("key"); // eg { ts : 1 }
             IndexChanges& ch = v[i];
             idx.getKeysFromObject(oldObj, ch.oldkeys);
@@ -278,6 +305,48 @@ namespace mongo {
         return true;
     }
 
+    static bool simpleFilterValue(const BSONElement& e) {
+        return e.type() != Object && e.type() != Array && e.type() != RegEx;
+    }
+
+    /* should be { <field> : <simpletype>, <field> : { $gt|$gte|$lt|$lte : <simpletype>, ... }, ... }
+       so that whether a query implies it can be decided from the query's field ranges alone.
+    */
+    static bool validPartialFilter(const BSONObj& filter) {
+        if( filter.isEmpty() )
+            return false;
+        BSONObjIterator i(filter);
+        while( i.more() ) {
+            BSONElement e = i.next();
+            if( e.fieldName()[0] == '$' )
+                return false;
+            if( e.type() != Object ) {
+                if( !simpleFilterValue(e) )
+                    return false;
+                continue;
+            }
+            BSONObj ops = e.embeddedObject();
+            if( ops.isEmpty() )
+                return false;
+            BSONObjIterator j(ops);
+            while( j.more() ) {
+                BSONElement op = j.next();
+                switch( op.getGtLtOp(-1) ) {
+                case BSONObj::GT:
+                case BSONObj::GTE:
+                case BSONObj::LT:
+                case BSONObj::LTE:
+                    break;
+                default:
+                    return false;
+                }
+                if( !simpleFilterValue(op) )
+                    return false;
+            }
+        }
+        return true;
+    }
+
     /* Prepare to build an index.  Does not actually build it (except for a special _id case).
        - We validate that the params are good
        - That the index does not already exist
@@ -375,6 +444,15 @@ namespace mongo {
         string pluginName = IndexPlugin::findPluginName( key );
         IndexPlugin * plugin = pluginName.size() ? IndexPlugin::get( pluginName ) : 0;
 
+        BSONElement filter = io["partialFilterExpression"];
+        if ( !filter.eoo() ) {
+            uassert(16344, str::stream() << "bad partialFilterExpression " << filter.toString(false)
+                    << ", only equality and $gt/$gte/$lt/$lte on fields are supported",
+                    filter.type() == Object && validPartialFilter(filter.embeddedObject()));
+            uassert(16345, "partialFilterExpression is not supported on the _id index or on special index types",
+                    !IndexDetails::isIdIndexPattern(key) && !plugin);
+        }
+
 
         { 
             BSONObj o = io;
@@ -388,7 +466,7 @@ namespace mongo {
                 // note (one day) we may be able to fresh build less versions than we can use
                 // isASupportedIndexVersionNumber() is what we can use
                 uassert(14803, str::stream() << "this version of mongod cannot build new indexes of version number " << vv, 
-                    vv == 0 || vv == 1);
+                    vv == 0 || vv == 1 || vv == 2);
                 v = (int) vv;
             }
             // idea is to put things we use a lot earlier
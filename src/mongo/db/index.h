@@ -56,6 +56,8 @@ namespace mongo {
         virtual long long fullValidate(const DiskLoc& thisLoc, const BSONObj &order) = 0;
         virtual DiskLoc findSingle(const IndexDetails &indexdetails , const DiskLoc& thisLoc, const BSONObj& key) const = 0;
         virtual bool unindex(const DiskLoc thisLoc, IndexDetails& id, const BSONObj& key, const DiskLoc recordLoc) const = 0;
+        virtual bool relocate(const DiskLoc thisLoc, IndexDetails& id, const BSONObj& key, const DiskLoc oldLoc,
+                              const DiskLoc newLoc) const = 0;
         virtual int bt_insert(const DiskLoc thisLoc, const DiskLoc recordLoc,
             const BSONObj& key, const Ordering &order, bool dupsAllowed,
             IndexDetails& idx, bool toplevel = true) const = 0;
@@ -70,6 +72,8 @@ namespace mongo {
         virtual DiskLoc locate(const IndexDetails &idx , const DiskLoc& thisLoc, const BSONObj& key, const Ordering &order,
                                int& pos, bool& found, const DiskLoc &recordLoc, int direction=1) = 0;
         virtual DiskLoc advance(const DiskLoc& thisLoc, int& keyOfs, int direction, const char *caller) = 0;
+        virtual Record* bucketNotInMemory(const IndexDetails &idx, const DiskLoc& thisLoc, const BSONObj& key,
+                                          const DiskLoc &recordLoc) const = 0;
     };
 
     /* Details about a particular index. There is one of these effectively for each object in
@@ -219,7 +223,7 @@ namespace mongo {
                     it may not mean we can build the index version in question: we may not maintain building 
                     of indexes in old formats in the future.
         */
-        static bool isASupportedIndexVersionNumber(int v) { return (v&1)==v; } // v == 0 || v == 1
+        static bool isASupportedIndexVersionNumber(int v) { return v >= 0 && v <= 2; }
 
         /** @return the interface for this interface, which varies with the index version.
             used for backward compatibility of index versions/formats.
@@ -227,7 +231,7 @@ namespace mongo {
         IndexInterface& idxInterface() const { 
             int v = version();
             dassert( isASupportedIndexVersionNumber(v) );
-            return *iis[v&1];
+            return *iis[v];
         }
 
         static IndexInterface *iis[];
@@ -250,10 +254,12 @@ namespace mongo {
         }
     };
 
+    class ModSet;
     class NamespaceDetails;
     // changedId should be initialized to false
+    // with mods, the update newObj came from, indexes of fields it doesn't touch are skipped
     void getIndexChanges(vector<IndexChanges>& v, const char *ns, NamespaceDetails& d,
-                         BSONObj newObj, BSONObj oldObj, bool &cangedId);
+                         BSONObj newObj, BSONObj oldObj, bool &cangedId, const ModSet *mods = 0);
     void dupCheck(vector<IndexChanges>& v, NamespaceDetails& d, DiskLoc curObjLoc);
 
     void assureSysIndexesEmptied(const char *ns, IndexDetails *exceptForIdIndex);
@@ -84,12 +84,13 @@ namespace mongo {
                              NamespaceDetails *d,
                              int idxNo,
                              const BSONObj& obj,
-                             DiskLoc recordLoc) {
+                             DiskLoc recordLoc,
+                             const bool allowDups) {
         IndexDetails &idx = d->idx(idxNo);
         idx.getKeysFromObject(obj, keys);
         if( keys.empty() )
             return;
-        bool dupsAllowed = !idx.unique();
+        bool dupsAllowed = allowDups || !idx.unique();
         Ordering ordering = Ordering::make(idx.keyPattern());
         
         verify( !recordLoc.isNull() );
@@ -209,6 +210,89 @@ namespace mongo {
 
     SortPhaseOne *precalced = 0;
 
+    /**
+     * extracts the index keys for batches of records on several threads, for phase one of a bulk
+     * index build.  the caller's thread adds the keys to the sorter in record order, so the result
+     * is the same as calling SortPhaseOne::addKeys() for each record.
+     * the records must stay put until flush(), which holds as we have the write lock throughout.
+     */
+    class PhaseOneKeyExtractor : boost::noncopyable {
+    public:
+        PhaseOneKeyExtractor(const IndexSpec& spec, SortPhaseOne& p1, int nThreads) :
+            _spec(spec), _p1(p1), _nThreads(nThreads), _pool(nThreads - 1) {
+            _objs.reserve(batchSize);
+            _locs.reserve(batchSize);
+        }
+
+        void add(const BSONObj& o, DiskLoc loc) {
+            _objs.push_back(o);
+            _locs.push_back(loc);
+            if( _objs.size() >= batchSize )
+                flush();
+        }
+
+        void flush();
+
+    private:
+        static const unsigned batchSize = 10000;
+
+        static void extract(PhaseOneKeyExtractor *e, unsigned slice);
+        unsigned sliceBegin(unsigned slice) const { return _objs.size() * slice / _nThreads; }
+
+        const IndexSpec& _spec;
+        SortPhaseOne& _p1;
+        const int _nThreads;
+        ThreadPool _pool;
+
+        vector<BSONObj> _objs;
+        vector<DiskLoc> _locs;
+        vector<BSONObjSet> _keys;
+        vector<char> _failed; // per slice
+    };
+
+    /*static*/
+    void PhaseOneKeyExtractor::extract(PhaseOneKeyExtractor *e, unsigned slice) {
+        try {
+            unsigned end = e->sliceBegin(slice + 1);
+            for( unsigned i = e->sliceBegin(slice); i < end; i++ )
+                e->_spec.getKeys(e->_objs[i], e->_keys[i]);
+        }
+        catch(...) {
+            e->_failed[slice] = 1;
+        }
+    }
+
+    void PhaseOneKeyExtractor::flush() {
+        const unsigned n = _objs.size();
+        _keys.clear();
+        _keys.resize(n);
+        _failed.assign(_nThreads, 0);
+
+        for( int slice = 1; slice < _nThreads; slice++ )
+            _pool.schedule(&PhaseOneKeyExtractor::extract, this, (unsigned) slice);
+        extract(this, 0);
+        _pool.join();
+
+        // redo any slice that failed here, so the caller gets the same exception it would have
+        // gotten extracting the keys itself
+        for( int slice = 0; slice < _nThreads; slice++ ) {
+            if( !_failed[slice] )
+                continue;
+            unsigned end = sliceBegin(slice + 1);
+            for( unsigned i = sliceBegin(slice); i < end; i++ ) {
+                _keys[i].clear();
+                _spec.getKeys(_objs[i], _keys[i]);
+            }
+        }
+
+        for( unsigned i = 0; i < n; i++ )
+            _p1.addKeys(_keys[i], _locs[i]);
+
+        _objs.clear();
+        _locs.clear();
+        _keys.clear();
+    }
+
     template< class V >
     void buildBottomUpPhases2And3(bool dupsAllowed, IndexDetails& idx, BSONObjExternalSorter& sorter, 
         bool dropDups, set<DiskLoc> &dupsToDrop, CurOp * op, SortPhaseOne *phase1, ProgressMeterHolder &pm,
@@ -217,7 +301,8 @@ namespace mongo {
     {
         BtreeBuilder<V> btBuilder(dupsAllowed, idx);
         BSONObj keyLast;
-        auto_ptr<BSONObjExternalSorter::Iterator> i = sorter.iterator();
+        // merge the runs on another thread while this one builds the btree
+        auto_ptr<BSONObjExternalSorter::AsyncIterator> i = sorter.asyncIterator();
         verify( pm == op->setMessage( "index: (2/3) btree bottom up" , phase1->nkeys , 10 ) );
         while( i->more() ) {
             RARELY killCurrentOp.checkForInterrupt();
@@ -289,16 +374,25 @@ namespace mongo {
             p1.sorter.reset( new BSONObjExternalSorter(idx.idxInterface(), order) );
             p1.sorter->hintNumObjects( d->stats.nrecords );
             const IndexSpec& spec = idx.getSpec();
+            const int nThreads = BSONObjExternalSorter::numSortThreads();
+            scoped_ptr<PhaseOneKeyExtractor> extractor;
+            if ( nThreads > 1 )
+                extractor.reset( new PhaseOneKeyExtractor( spec, p1, nThreads ) );
             while ( c->ok() ) {
                 BSONObj o = c->current();
                 DiskLoc loc = c->currLoc();
-                p1.addKeys(spec, o, loc);
+                if ( extractor )
+                    extractor->add(o, loc);
+                else
+                    p1.addKeys(spec, o, loc);
                 c->advance();
                 pm.hit();
                 if ( logLevel > 1 && p1.n % 10000 == 0 ) {
                     printMemInfo( "\t iterating objects" );
                 }
             };
+            if ( extractor )
+                extractor->flush();
         }
         pm.finished();
 
@@ -320,6 +414,8 @@ namespace mongo {
             buildBottomUpPhases2And3<V0>(dupsAllowed, idx, sorter, dropDups, dupsToDrop, op, phase1, pm, t);
         else if( idx.version() == 1 ) 
             buildBottomUpPhases2And3<V1>(dupsAllowed, idx, sorter, dropDups, dupsToDrop, op, phase1, pm, t);
+        else if( idx.version() == 2 ) 
+            buildBottomUpPhases2And3<V2>(dupsAllowed, idx, sorter, dropDups, dupsToDrop, op, phase1, pm, t);
         else
             verify(false);
 
@@ -334,10 +430,126 @@ namespace mongo {
         return phase1->n;
     }
 
+    /**
+     * the keys of the records a background index build has scanned since it last yielded.  they
+     * are added to the index in key order, so that inserts next to each other in the tree follow
+     * one another and find its buckets in cache, rather than landing all over the index in record
+     * order.  the batch is only valid while the write lock is held, so it is flushed whenever the
+     * build is about to yield; writes made while yielded update the index themselves.
+     */
+    class BackgroundKeyBatch : boost::noncopyable {
+    public:
+        enum { MaxKeys = 10000 };
+
+        BackgroundKeyBatch(const char *ns, NamespaceDetails *d, IndexDetails& idx, int idxNo) :
+            _ns(ns), _d(d), _idx(idx), _idxNo(idxNo), _ii(idx.idxInterface()),
+            _ordering(Ordering::make(idx.keyPattern())),
+            _dupsAllowed(!idx.unique()), _dropDups(idx.dropDups()), _numDropped(0) {
+        }
+
+        void add(const BSONObj& obj, DiskLoc recordLoc) {
+            verify( !recordLoc.isNull() );
+            BSONObjSet keys;
+            _idx.getKeysFromObject(obj, keys);
+            if( keys.size() > 1 )
+                _d->setIndexIsMultikey(_ns, _idxNo);
+            for ( BSONObjSet::iterator i = keys.begin(); i != keys.end(); i++ )
+                _keys.push_back( KeyAndLoc( *i, recordLoc ) );
+        }
+
+        bool full() const { return _keys.size() >= MaxKeys; }
+
+        /** add the batched keys to the index.  with dropDups, records with a duplicate key are deleted. */
+        void flush() {
+            std::sort( _keys.begin(), _keys.end(), KeyOrder( _ii, _ordering ) );
+            set<DiskLoc> dropped;
+            for ( vector<KeyAndLoc>::const_iterator i = _keys.begin(); i != _keys.end(); ++i ) {
+                if ( dropped.count( i->loc ) )
+                    continue;
+                try {
+                    if ( !_dupsAllowed && _dropDups ) {
+                        LastError::Disabled led( lastError.get() );
+                        insert( *i );
+                    }
+                    else {
+                        insert( *i );
+                    }
+                }
+                catch( AssertionException& e ) {
+                    if( e.interrupted() ) {
+                        killCurrentOp.checkForInterrupt();
+                    }
+                    if ( !_dropDups ) {
+                        log() << "background addExistingToIndex exception " << e.what() << endl;
+                        throw;
+                    }
+                    // also removes the keys of the record already added from this batch
+                    theDataFileMgr.deleteRecord( _ns, i->loc.rec(), i->loc, false, true, true );
+                    dropped.insert( i->loc );
+                    _numDropped++;
+                }
+            }
+            _keys.clear();
+        }
+
+        unsigned long long numDropped() const { return _numDropped; }
+
+    private:
+        struct KeyAndLoc {
+            KeyAndLoc( const BSONObj& k, DiskLoc l ) : key( k ), loc( l ) { }
+            BSONObj key;
+            DiskLoc loc;
+        };
+
+        /** the order of the index, with record location breaking ties as the btree does */
+        class KeyOrder {
+        public:
+            KeyOrder( IndexInterface& ii, const Ordering& ordering ) :
+                _ii( ii ), _ordering( ordering ) { }
+            bool operator()( const KeyAndLoc& l, const KeyAndLoc& r ) const {
+                int x = _ii.keyCompare( l.key, r.key, _ordering );
+                if ( x != 0 )
+                    return x < 0;
+                return l.loc < r.loc;
+            }
+        private:
+            IndexInterface& _ii;
+            const Ordering& _ordering;
+        };
+
+        void insert( const KeyAndLoc& k ) {
+            try {
+                _ii.bt_insert( _idx.head, k.loc, k.key, _ordering, _dupsAllowed, _idx );
+            }
+            catch( AssertionException& e ) {
+                if( e.getCode() == 10287 && _idxNo == _d->nIndexes ) {
+                    // the record was written while we yielded, and indexed then
+                    DEV log() << "info: caught key already in index on bg indexing (ok)" << endl;
+                    return;
+                }
+                if( !_dupsAllowed ) {
+                    // dup key exception, presumably.
+                    throw;
+                }
+                problem() << " caught assertion addKeysToIndex " << _idx.indexNamespace() << " " << k.loc.toString() << endl;
+            }
+        }
+
+        const char *_ns;
+        NamespaceDetails *_d;
+        IndexDetails& _idx;
+        const int _idxNo;
+        IndexInterface& _ii;
+        const Ordering _ordering;
+        const bool _dupsAllowed;
+        const bool _dropDups;
+        vector<KeyAndLoc> _keys;
+        unsigned long long _numDropped;
+    };
+
     class BackgroundIndexBuildJob : public BackgroundOperation {
 
         unsigned long long addExistingToIndex(const char *ns, NamespaceDetails *d, IndexDetails& idx, int idxNo) {
-            bool dupsAllowed = !idx.unique();
             bool dropDups = idx.dropDups();
 
             ProgressMeter& progress = cc().curop()->setMessage( "bg index build" , d->stats.nrecords );
@@ -350,18 +562,13 @@ namespace mongo {
                 cc.reset( new ClientCursor(QueryOption_NoCursorTimeout, c, ns) );
             }
 
+            BackgroundKeyBatch batch(ns, d, idx, idxNo);
+            boost::function<void()> flushBatch = boost::bind(&BackgroundKeyBatch::flush, &batch);
+
             while ( cc->ok() ) {
                 BSONObj js = cc->current();
                 try {
-                    {
-                        if ( !dupsAllowed && dropDups ) {
-                            LastError::Disabled led( lastError.get() );
-                            addKeysToIndex(ns, d, idxNo, js, cc->currLoc(), dupsAllowed);
-                        }
-                        else {
-                            addKeysToIndex(ns, d, idxNo, js, cc->currLoc(), dupsAllowed);
-                        }
-                    }
+                    batch.add(js, cc->currLoc());
                     cc->advance();
                 }
                 catch( AssertionException& e ) {
@@ -395,9 +602,12 @@ namespace mongo {
                 n++;
                 progress.hit();
 
+                if ( batch.full() )
+                    batch.flush();
+
                 getDur().commitIfNeeded();
 
-                if ( cc->yieldSometimes( ClientCursor::WillNeed ) ) {
+                if ( cc->yieldSometimes( ClientCursor::WillNeed, 0, flushBatch ) ) {
                     progress.setTotalWhileRunning( d->stats.nrecords );
                 }
                 else {
@@ -406,6 +616,8 @@ namespace mongo {
                     break;
                 }
             }
+            batch.flush();
+            numDropped += batch.numDropped();
             progress.finished();
             if ( dropDups )
                 log() << "\t backgroundIndexBuild dupsToDrop: " << numDropped << endl;
@@ -38,12 +38,15 @@ namespace mongo {
                                          DiskLoc loc, bool shouldBeUnlocked);
 
     // Given an object, populate "inserter" with information necessary to update indexes.
+    // allowDups skips the unique key check, for callers that only want to page in the
+    // index (the prefetcher).
     void fetchIndexInserters(BSONObjSet & /*out*/keys,
                              IndexInterface::IndexInserter &inserter,
                              NamespaceDetails *d,
                              int idxNo,
                              const BSONObj& obj,
-                             DiskLoc recordLoc);
+                             DiskLoc recordLoc,
+                             const bool allowDups = false);
 
     bool dropIndexes( NamespaceDetails *d, const char *ns, const char *name, string &errmsg, BSONObjBuilder &anObjBuilder, bool maydeleteIdIndex );
 
@@ -21,6 +21,8 @@
 #include "index.h"
 #include "btree.h"
 #include "background.h"
+#include "matcher.h"
+#include "queryutil.h"
 #include "../util/stringutils.h"
 #include "../util/text.h"
 
@@ -81,6 +83,15 @@ namespace mongo {
         _sparse = info["sparse"].trueValue();
         uassert( 13529 , "sparse only works for single field keys" , ! _sparse || _nFields );
 
+        {
+            // partial filter, validated when the index was created
+            BSONElement f = info["partialFilterExpression"];
+            if ( f.type() == Object && ! f.embeddedObject().isEmpty() ) {
+                _filter = f.embeddedObject().getOwned();
+                _filterMatcher.reset( new Matcher( _filter ) );
+                _filterRanges.reset( new FieldRangeSet( info["ns"].valuestrsafe(), _filter, true ) );
+            }
+        }
 
         {
             // build _nullKey
@@ -269,6 +280,55 @@ namespace mongo {
         const IndexSpec &_spec;
     };
 
+    /**
+     * The keys of one document, built end to end in a single buffer rather than each in a
+     * BSONObj of its own.  moveTo() sorts and deduplicates them in place and hands the distinct
+     * ones to a BSONObjSet as BSONObjs sharing the buffer, so a multikey document costs one
+     * buffer and a set node per distinct key instead of an object and a node per array member.
+     */
+    class KeyBuffer : boost::noncopyable {
+    public:
+        KeyBuffer() : _buf( 512 ) {
+            _buf.appendNum( (unsigned) 0 ); // refcount, see BSONObj::Holder
+        }
+
+        /** @return the buffer to build the next key in, with a BSONObjBuilder( buf ) */
+        BufBuilder& startKey() {
+            _offsets.push_back( _buf.len() );
+            return _buf;
+        }
+
+        void moveTo( BSONObjSet &keys ) {
+            if ( _offsets.empty() )
+                return;
+            BSONObj::Holder *holder = reinterpret_cast<BSONObj::Holder*>( _buf.buf() );
+            _buf.decouple();
+            const BSONObj first( holder ); // frees the buffer even if no key is new to keys
+            const char *base = reinterpret_cast<const char*>( holder );
+
+            OffsetLess less( base, keys.key_comp() );
+            sort( _offsets.begin(), _offsets.end(), less );
+            for( unsigned i = 0; i < _offsets.size(); ++i ) {
+                if ( i > 0 && ! less( _offsets[ i - 1 ], _offsets[ i ] ) )
+                    continue; // a duplicate of the key before it
+                keys.insert( keys.end(), BSONObj( holder, base + _offsets[ i ] ) );
+            }
+        }
+
+    private:
+        struct OffsetLess {
+            OffsetLess( const char *base, const BSONObjCmp &cmp ) : _base( base ), _cmp( cmp ) {}
+            bool operator()( int l, int r ) const {
+                return _cmp( BSONObj( _base + l ), BSONObj( _base + r ) );
+            }
+            const char *_base;
+            BSONObjCmp _cmp;
+        };
+
+        BufBuilder _buf;
+        vector<int> _offsets;
+    };
+
     class KeyGeneratorV1 {
     public:
         KeyGeneratorV1( const IndexSpec &spec ) : _spec( spec ) {}
@@ -280,7 +340,9 @@ namespace mongo {
             }
             vector<const char*> fieldNames( _spec._fieldNames );
             vector<BSONElement> fixed( _spec._fixed );
-            _getKeys( fieldNames , fixed , obj, keys );
+            KeyBuffer buffer;
+            _getKeys( fieldNames , fixed , obj, buffer );
+            buffer.moveTo( keys );
             if ( keys.empty() && ! _spec._sparse )
                 keys.insert( _spec._nullKey );
         }     
@@ -290,9 +352,10 @@ namespace mongo {
          * @param arrayNestedArray - set if the returned element is an array nested directly within arr.
          */
         BSONElement extractNextElement( const BSONObj &obj, const BSONObj &arr, const char *&field, bool &arrayNestedArray ) const {
-            string firstField = mongoutils::str::before( field, '.' );
-            bool haveObjField = !obj.getField( firstField ).eoo();
-            BSONElement arrField = arr.getField( firstField );
+            const char *dot = strchr( field, '.' );
+            const unsigned firstLen = dot ? dot - field : strlen( field );
+            bool haveObjField = !obj.getField( field, firstLen ).eoo();
+            BSONElement arrField = arr.getField( field, firstLen );
             bool haveArrField = !arrField.eoo();
 
             // An index component field name cannot exist in both a document array and one of that array's children.
@@ -311,7 +374,7 @@ namespace mongo {
             return BSONElement();
         }
         
-        void _getKeysArrEltFixed( vector<const char*> &fieldNames , vector<BSONElement> &fixed , const BSONElement &arrEntry, BSONObjSet &keys, int numNotFound, const BSONElement &arrObjElt, const set< unsigned > &arrIdxs, bool mayExpandArrayUnembedded ) const {
+        void _getKeysArrEltFixed( vector<const char*> &fieldNames , vector<BSONElement> &fixed , const BSONElement &arrEntry, KeyBuffer &keys, int numNotFound, const BSONElement &arrObjElt, const set< unsigned > &arrIdxs, bool mayExpandArrayUnembedded ) const {
             // set up any terminal array values
             for( set<unsigned>::const_iterator j = arrIdxs.begin(); j != arrIdxs.end(); ++j ) {
                 if ( *fieldNames[ *j ] == '\0' ) {
@@ -323,15 +386,15 @@ namespace mongo {
         }
         
         /**
-         * @param fieldNames - fields to index, may be postfixes in recursive calls
-         * @param fixed - values that have already been identified for their index fields
+         * @param fieldNames - fields to index, may be postfixes in recursive calls; advanced in place
+         * @param fixed - values that have already been identified for their index fields; set in place
          * @param obj - object from which keys should be extracted, based on names in fieldNames
-         * @param keys - set where index keys are written
+         * @param keys - buffer where index keys are written
          * @param numNotFound - number of index fields that have already been identified as missing
          * @param array - array from which keys should be extracted, based on names in fieldNames
          *        If obj and array are both nonempty, obj will be one of the elements of array.
          */        
-        void _getKeys( vector<const char*> fieldNames , vector<BSONElement> fixed , const BSONObj &obj, BSONObjSet &keys, int numNotFound = 0, const BSONObj &array = BSONObj() ) const {
+        void _getKeys( vector<const char*> &fieldNames , vector<BSONElement> &fixed , const BSONObj &obj, KeyBuffer &keys, int numNotFound = 0, const BSONObj &array = BSONObj() ) const {
             BSONElement arrElt;
             set<unsigned> arrIdxs;
             bool mayExpandArrayUnembedded = true;
@@ -376,11 +439,11 @@ namespace mongo {
                 if ( _spec._sparse && numNotFound == _spec._nFields ) {
                     return;
                 }            
-                BSONObjBuilder b(_spec._sizeTracker);
+                BSONObjBuilder b( keys.startKey() );
                 for( vector< BSONElement >::iterator i = fixed.begin(); i != fixed.end(); ++i ) {
                     b.appendAs( *i, "" );
                 }
-                keys.insert( b.obj() );
+                b.done();
             }
             else if ( arrElt.embeddedObject().firstElement().eoo() ) {
                 // Empty array, so set matching fields to undefined.
@@ -388,10 +451,16 @@ namespace mongo {
             }
             else {
                 // Non empty array that can be expanded, so generate a key for each member.
+                // each member starts from where this level left the field names and values;
+                // assigning them back reuses the vectors rather than copying them per member
+                const vector<const char*> levelFieldNames( fieldNames );
+                const vector<BSONElement> levelFixed( fixed );
                 BSONObj arrObj = arrElt.embeddedObject();
                 BSONObjIterator i( arrObj );
                 while( i.more() ) {
                     _getKeysArrEltFixed( fieldNames, fixed, i.next(), keys, numNotFound, arrElt, arrIdxs, mayExpandArrayUnembedded );
+                    fieldNames = levelFieldNames;
+                    fixed = levelFixed;
                 }
             }
         }
@@ -400,13 +469,18 @@ namespace mongo {
     };
     
     void IndexSpec::getKeys( const BSONObj &obj, BSONObjSet &keys ) const {
+        if ( _filterMatcher && ! _filterMatcher->matches( obj ) ) {
+            // documents outside a partial index's filter have no keys at all
+            return;
+        }
         switch( indexVersion() ) {
             case 0: {
                 KeyGeneratorV0 g( *this );
                 g.getKeys( obj, keys );
                 break;
             }
-            case 1: {
+            case 1:
+            case 2: { // v2 indexes prefix compress v1 format keys
                 KeyGeneratorV1 g( *this );
                 g.getKeys( obj, keys );
                 break;
@@ -432,6 +506,19 @@ namespace mongo {
         return false;
     }
 
+    bool IndexSpec::filterImplied( const FieldRangeSet &queryRanges ) const {
+        if ( ! _filterRanges )
+            return true;
+        // the multikey query ranges hold a value of some matching document's field, and
+        // each filter field matches any value inside its (single key) range
+        const map<string,FieldRange> &filterRanges = _filterRanges->ranges();
+        for( map<string,FieldRange>::const_iterator i = filterRanges.begin(); i != filterRanges.end(); ++i ) {
+            if ( ! ( queryRanges.range( i->first.c_str() ) <= i->second ) )
+                return false;
+        }
+        return true;
+    }
+
     IndexSuitability IndexSpec::suitability( const BSONObj& query , const BSONObj& order ) const {
         if ( _indexType.get() )
             return _indexType->suitability( query , order );
@@ -34,6 +34,8 @@ namespace mongo {
     class IndexType; // TODO: this name sucks
     class IndexPlugin;
     class IndexDetails;
+    class Matcher;
+    class FieldRangeSet;
 
     enum IndexSuitability { USELESS = 0 , HELPFUL = 1 , OPTIMAL = 2 };
 
@@ -165,6 +167,18 @@ namespace mongo {
 
         bool isSparse() const { return _sparse; }
 
+        /** @return true if only documents matching partialFilterExpression have keys. */
+        bool isPartial() const { return ! _filter.isEmpty(); }
+
+        const BSONObj& partialFilter() const { return _filter; }
+
+        /**
+         * @return true if every document a query could match with the given
+         * (multikey) ranges also matches the partial filter, so that using the
+         * index won't miss matches.  Always true for indexes that aren't partial.
+         */
+        bool filterImplied( const FieldRangeSet &queryRanges ) const;
+
     protected:
 
         int indexVersion() const;
@@ -184,6 +198,9 @@ namespace mongo {
 
         int _nFields; // number of fields in the index
         bool _sparse; // if the index is sparse
+        BSONObj _filter; // partialFilterExpression, empty if the index isn't partial
+        shared_ptr<Matcher> _filterMatcher;
+        shared_ptr<FieldRangeSet> _filterRanges;
         shared_ptr<IndexType> _indexType;
         const IndexDetails * _details;
 
@@ -32,6 +32,7 @@
 #include "json.h"
 #include "replutil.h"
 #include "../s/d_logic.h"
+#include "../s/d_writeback.h"
 #include "../util/file_allocator.h"
 #include "../util/goodies.h"
 #include "cmdline.h"
@@ -47,11 +48,16 @@
 #include "ops/delete.h"
 #include "ops/query.h"
 #include "ops/update.h"
+#include "oplog.h"
 #include "pagefault.h"
 #include <fstream>
 #include <boost/filesystem/operations.hpp>
 #include "dur_commitjob.h"
 #include "mongo/db/commands/fsync.h"
+#include "mongo/db/admission.h"
+#include "mongo/db/time_partitions.h"
+#include "mongo/db/warm_restart.h"
+#include "mongo/util/trace_span.h"
 
 namespace mongo {
     
@@ -80,39 +86,46 @@ namespace mongo {
 #endif
 
 
-    /*static*/ OpTime OpTime::_now() {
-        OpTime result;
-        unsigned t = (unsigned) time(0);
-        if ( last.secs == t ) {
-            last.i++;
-            result = last;
-        }
-        else if ( t < last.secs ) {
-            result = skewed(); // separate function to keep out of the hot code path
-        }
-        else { 
-            last = OpTime(t, 1);
-            result = last;
+    /*static*/ OpTime OpTime::now() {
+        while( 1 ) {
+            const unsigned long long prev = last.load();
+            const OpTime p( prev );
+            unsigned t = (unsigned) time(0);
+            OpTime result;
+            if ( p.secs == t ) {
+                result = OpTime( t, p.i + 1 );
+            }
+            else if ( t < p.secs ) {
+                result = skewed( p ); // separate function to keep out of the hot code path
+            }
+            else {
+                result = OpTime( t, 1 );
+            }
+            if ( last.compareAndSwap( prev, result.asDate() ) == prev ) {
+                // every advance of last wakes waitForDifferent(), not just the ones under m
+                notifier.notify_all();
+                return result;
+            }
         }
-        notifier.notify_all();
-        return last;
+    }
+    /*static*/ OpTime OpTime::_now() {
+        return now();
     }
     OpTime OpTime::now(const mongo::mutex::scoped_lock&) {
         return _now();
     }
     OpTime OpTime::getLast(const mongo::mutex::scoped_lock&) {
-        return last;
+        return OpTime( last.load() );
     }
     boost::condition OpTime::notifier;
     mongo::mutex OpTime::m("optime");
 
-    // OpTime::now() uses mutex, thus it is in this file not in the cpp files used by drivers and such
+    // OpTime::now() is in this file, not in the cpp files used by drivers and such
     void BSONElementManipulator::initTimestamp() {
         massert( 10332 ,  "Expected CurrentTime type", _element.type() == Timestamp );
         unsigned long long &timestamp = *( reinterpret_cast< unsigned long long* >( value() ) );
         if ( timestamp == 0 ) {
-            mutex::scoped_lock lk(OpTime::m);
-            timestamp = OpTime::now(lk).asDate();
+            timestamp = OpTime::now().asDate();
         }
     }
     void BSONElementManipulator::SetNumber(double d) {
@@ -241,6 +254,9 @@ namespace mongo {
         shared_ptr<AssertionException> ex;
 
         try {
+            if ( TraceSpans::enabled )
+                TraceSpans::joinTrace( TraceSpans::traceIdOf( q.query ) );
+            flushProfileIfRead( q.ns , q.query );
             dbresponse.exhaust = runQuery(m, q, op, *resp);
             verify( !resp->empty() );
         }
@@ -357,6 +373,9 @@ namespace mongo {
         Client& c = cc();
         if ( c.getAuthenticationInfo() )
             c.getAuthenticationInfo()->startRequest();
+
+        // scratch memory for this request, reset when it returns
+        Arena::Scope arenaScope( c.arena() );
         
         auto_ptr<CurOp> nestedOp;
         CurOp* currentOpP = c.curop();
@@ -374,6 +393,9 @@ namespace mongo {
         OpDebug& debug = currentOp.debug();
         debug.op = op;
 
+        // queue here rather than on the lock if too many reads or writes are running already
+        AdmissionTicket ticket( AdmissionTicket::kindFor( op, isCommand, nestedOp.get() != 0, ns ) );
+
         long long logThreshold = cmdLine.slowMS;
         bool shouldLog = logLevel >= 1;
 
@@ -449,6 +471,9 @@ namespace mongo {
                 debug.exceptionInfo = e.getInfo();
                 shouldLog = true;
             }
+
+            // a write queued for a mongos which isn't keeping up waits here, out of the lock
+            writeBackManager.waitForRoom();
         }
         currentOp.ensureStarted();
         currentOp.done();
@@ -457,27 +482,12 @@ namespace mongo {
         logThreshold += currentOp.getExpectedLatencyMs();
 
         if ( shouldLog || debug.executionTime > logThreshold ) {
-            mongo::tlog() << debug << endl;
+            mongo::tlog() << debug << TraceSpans::currentSummary() << endl;
         }
 
         if ( currentOp.shouldDBProfile( debug.executionTime ) ) {
-            // performance profiling is on
-            if ( Lock::isReadLocked() ) {
-                mongo::log(1) << "note: not profiling because recursive read lock" << endl;
-            }
-            else if ( lockedForWriting() ) {
-                mongo::log(1) << "note: not profiling because doing fsync+lock" << endl;
-            }
-            else {
-                Lock::DBWrite lk( currentOp.getNS() );
-                if ( dbHolder()._isLoaded( nsToDatabase( currentOp.getNS() ) , dbpath ) ) {
-                    Client::Context cx( currentOp.getNS(), dbpath, false );
-                    profile(c , currentOp );
-                }
-                else {
-                    mongo::log() << "note: not profiling because db went away - probably a close on: " << currentOp.getNS() << endl;
-                }
-            }
+            // performance profiling is on; queued, and written out of this op's locks
+            profile(c , currentOp );
         }
         
         debug.reset();
@@ -572,6 +582,8 @@ namespace mongo {
                 
                 UpdateResult res = updateObjects(ns, toupdate, query, upsert, multi, true, op.debug() );
                 lastError.getSafe()->recordUpdate( res.existing , res.num , res.upserted ); // for getlasterror
+                if ( upsert && ! res.existing )
+                    noteUpsertForSplit( ns );
                 break;
             }
             catch ( PageFaultException& e ) {
@@ -622,7 +634,7 @@ namespace mongo {
 
     void OpTime::waitForDifferent(unsigned millis){
         mutex::scoped_lock lk(m);
-        while (*this == last) {
+        while (*this == OpTime(last.load())) {
             if (!notifier.timed_wait(lk.boost(), boost::posix_time::milliseconds(millis)))
                 return; // timed out
         }
@@ -647,23 +659,37 @@ namespace mongo {
         bool exhaust = false;
         QueryResult* msgdata = 0;
         OpTime last;
+        shared_ptr<CappedInsertNotifier> notifier;
+        unsigned long long lastInsert = 0;
+        const bool oplog = str::startsWith(ns, "local.oplog.");
         while( 1 ) {
             try {
                 const NamespaceString nsString( ns );
                 uassert( 16258, str::stream() << "Invalid ns [" << ns << "]", nsString.isValid() );
 
-                if (str::startsWith(ns, "local.oplog.")){
-                    if (pass == 0) {
-                        mutex::scoped_lock lk(OpTime::m);
-                        last = OpTime::getLast(lk);
-                    }
-                    else {
+                // awaitData, and the last pass found nothing: wait for an insert
+                if (pass > 0) {
+                    if (oplog)
                         last.waitForDifferent(1000/*ms*/);
-                    }
+                    else if (notifier)
+                        notifier->waitForInsert(lastInsert, 1000/*ms*/);
                 }
 
                 Client::ReadContext ctx(ns);
 
+                // read locked, so no insert can come between this and the getMore finding nothing
+                if (oplog) {
+                    mutex::scoped_lock lk(OpTime::m);
+                    last = OpTime::getLast(lk);
+                }
+                else if (pass > 0) {
+                    // the collection's notifier is only made for a cursor that waits, so the
+                    // second pass looks again without waiting
+                    if (!notifier)
+                        notifier = NamespaceDetailsTransient::cappedInsertNotifier(ns);
+                    lastInsert = notifier->version();
+                }
+
                 // call this readlocked so state can't change
                 replVerifyReadsOk();
                 msgdata = processGetMore(ns, ntoreturn, cursorid, curop, pass, exhaust);
@@ -691,8 +717,6 @@ namespace mongo {
                 pass++;
                 if (debug)
                     sleepmillis(20);
-                else
-                    sleepmillis(2);
                 
                 // note: the 1100 is beacuse of the waitForDifferent above
                 // should eventually clean this up a bit
@@ -750,26 +774,44 @@ namespace mongo {
                 uassert( 13511 , "document to insert can't have $ fields" , e.fieldName()[0] != '$' );
             }
         }
+        string bucket;
+        TimePartitions::Spec partitions;
+        if ( TimePartitions::spec( ns , &partitions ) ) {
+            bucket = TimePartitions::bucketFor( ns , partitions , js );
+            ns = bucket.c_str();
+        }
         theDataFileMgr.insertWithObjMod(ns, js, false); // js may be modified in the call to add an _id field.
         logOp("i", ns, js);
+        noteInsertForSplit(ns, js);
     }
 
-    NOINLINE_DECL void insertMulti(bool keepGoing, const char *ns, vector<BSONObj>& objs) {
-        size_t i;
-        for (i=0; i<objs.size(); i++){
+    /** @param i the first document to insert; on return or exception, the first one not done */
+    NOINLINE_DECL void insertMulti(bool keepGoing, const char *ns, vector<BSONObj>& objs, size_t& i) {
+        const size_t start = i;
+        // log the documents together; flushed before any fault gives up the lock
+        OplogBatch batch;
+        for (; i<objs.size(); i++){
             try {
+                // the documents before this one are done, so it may give up the lock to fault in
+                // index pages as long as it hasn't written anything itself
+                cc().newTopLevelRequest();
                 checkAndInsert(ns, objs[i]);
-                getDur().commitIfNeeded();
+                OplogBatch::commitIfNeeded();
             } catch (const UserException&) {
                 if (!keepGoing || i == objs.size()-1){
-                    globalOpCounters.incInsertInWriteLock(i);
+                    globalOpCounters.incInsertInWriteLock(i - start);
                     throw;
                 }
                 // otherwise ignore and keep going
+            } catch (PageFaultException&) {
+                // flush() turns page faults off, so it can't fault again here and drop the ops
+                globalOpCounters.incInsertInWriteLock(i - start);
+                batch.flush();
+                throw;
             }
         }
 
-        globalOpCounters.incInsertInWriteLock(i);
+        globalOpCounters.incInsertInWriteLock(i - start);
     }
 
     void receivedInsert(Message& m, CurOp& op) {
@@ -790,25 +832,121 @@ namespace mongo {
             multi.push_back( d.nextJsObj() );
         }
 
-        Lock::DBWrite lk(ns);
+        // an insert that would fault on a cold index bucket while finding where its keys go,
+        // before it has written anything, releases the lock, faults the bucket in and retries
+        PageFaultRetryableSection s;
+        size_t done = 0;
+        while ( 1 ) {
+            try {
+                Lock::DBWrite lk(ns);
 
-        // CONCURRENCY TODO: is being read locked in big log sufficient here?
-        // writelock is used to synchronize stepdowns w/ writes
-        uassert( 10058 , "not master", isMasterNs(ns) );
+                // CONCURRENCY TODO: is being read locked in big log sufficient here?
+                // writelock is used to synchronize stepdowns w/ writes
+                uassert( 10058 , "not master", isMasterNs(ns) );
 
-        if ( handlePossibleShardedMessage( m , 0 ) )
-            return;
+                if ( handlePossibleShardedMessage( m , 0 ) )
+                    return;
+
+                Client::Context ctx(ns);
 
-        Client::Context ctx(ns);
+                if( !multi.empty() ) {
+                    const bool keepGoing = d.reservedField() & InsertOption_ContinueOnError;
+                    insertMulti(keepGoing, ns, multi, done);
+                    return;
+                }
 
-        if( !multi.empty() ) {
-            const bool keepGoing = d.reservedField() & InsertOption_ContinueOnError;
-            insertMulti(keepGoing, ns, multi);
-            return;
+                checkAndInsert(ns, first);
+                globalOpCounters.incInsertInWriteLock(1);
+                break;
+            }
+            catch ( PageFaultException& e ) {
+                LOG(2) << "receivedInsert got a PageFaultException" << endl;
+                e.touch();
+            }
         }
+    }
+
+    /** applies one statement of a write batch.  @return its outcome */
+    static BSONObj applyWriteStatement( const char *ns, const BSONObj& statement ) {
+        BSONElement op = statement.firstElement();
+        const char *kind = op.fieldName();
+        uassert( 16350 , str::stream() << "write batch statements must be an insert, update or remove: " << statement ,
+                 op.type() == Object &&
+                 ( str::equals( kind , "insert" ) || str::equals( kind , "update" ) || str::equals( kind , "remove" ) ) );
+        BSONObj arg = op.embeddedObject();
+
+        BSONObjBuilder b;
+        if ( str::equals( kind , "insert" ) ) {
+            BSONObj js = arg;
+            checkAndInsert( ns, js );
+            globalOpCounters.incInsertInWriteLock( 1 );
+            b.append( "n" , 1 );
+        }
+        else if ( str::equals( kind , "update" ) ) {
+            uassert( 16351 , "update statements need a u object" , arg["u"].type() == Object );
+            BSONObj toupdate = arg["u"].embeddedObject();
+            uassert( 16353 , "update object too large" , toupdate.objsize() <= BSONObjMaxUserSize );
+            BSONObj query = arg.getObjectField( "q" );
+            globalOpCounters.gotUpdate();
+            UpdateResult res = updateObjects( ns, toupdate, query, arg["upsert"].trueValue(),
+                                              arg["multi"].trueValue(), true, cc().curop()->debug() );
+            lastError.getSafe()->recordUpdate( res.existing , res.num , res.upserted );
+            if ( arg["upsert"].trueValue() && ! res.existing )
+                noteUpsertForSplit( ns );
+            b.appendNumber( "n" , res.num );
+            b.appendBool( "updatedExisting" , res.existing );
+            if ( res.upserted.isSet() )
+                b.append( "upserted" , res.upserted );
+        }
+        else {
+            globalOpCounters.gotDelete();
+            long long n = deleteObjects( ns, arg.getObjectField( "q" ), arg["justOne"].trueValue(), true );
+            lastError.getSafe()->recordDelete( n );
+            b.appendNumber( "n" , n );
+        }
+        return b.obj();
+    }
+
+    long long applyWriteBatch( const char *ns, const vector<BSONObj>& statements, bool ordered, BSONArrayBuilder& results ) {
+        long long applied = 0;
+        size_t i = 0;
+        PageFaultRetryableSection s;
+        while ( 1 ) {
+            try {
+                Lock::DBWrite lk( ns );
+
+                // writelock is used to synchronize stepdowns w/ writes
+                uassert( 16352 , "not master" , isMasterNs( ns ) );
 
-        checkAndInsert(ns, first);
-        globalOpCounters.incInsertInWriteLock(1);
+                Client::Context ctx( ns );
+
+                for ( ; i < statements.size(); i++ ) {
+                    // like insertMulti, what's done stays done if a later statement faults
+                    cc().newTopLevelRequest();
+                    try {
+                        results.append( applyWriteStatement( ns, statements[i] ) );
+                        applied++;
+                    }
+                    catch ( SendStaleConfigException& ) {
+                        throw;
+                    }
+                    catch ( DBException& e ) {
+                        BSONObjBuilder b;
+                        b.append( "err" , e.what() );
+                        b.append( "code" , e.getCode() );
+                        results.append( b.obj() );
+                        if ( ordered )
+                            return applied;
+                    }
+                    getDur().commitIfNeeded();
+                }
+                return applied;
+            }
+            catch ( PageFaultException& e ) {
+                LOG(2) << "applyWriteBatch got a PageFaultException" << endl;
+                e.touch();
+            }
+        }
     }
 
     void getDatabaseNames( vector< string > &names , const string& usePath ) {
@@ -971,6 +1109,11 @@ namespace mongo {
             MemoryMappedFile::flushAll(true);
         }
 
+        if( warmRestartSecs > 0 ) {
+            log() << "shutdown: noting hot data file regions..." << endl;
+            snapshotHotPages();
+        }
+
         log() << "shutdown: closing all files..." << endl;
         stringstream ss3;
         MemoryMappedFile::closeAllFiles( ss3 );
@@ -1054,6 +1197,8 @@ namespace mongo {
         // block the dur thread from doing any work for the rest of the run
         log(2) << "shutdown: groupCommitMutex" << endl;
         SimpleMutex::scoped_lock lk(dur::commitJob.groupCommitMutex);
+        // and wait for a journal write that may still be finishing outside groupCommitMutex
+        SimpleMutex::scoped_lock lk2(dur::commitJob.journalWriteMutex);
 
 #ifdef _WIN32
         // Windows Service Controller wants to be told when we are down,
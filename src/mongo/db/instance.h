@@ -73,6 +73,14 @@ namespace mongo {
 
     void assembleResponse( Message &m, DbResponse &dbresponse, const HostAndPort &client );
 
+    /**
+     * Applies the insert, update and remove statements of a writeBatch command to ns, under
+     * one acquisition of the write lock unless a page fault makes it yield.  Each statement's
+     * outcome is appended to results in order; if ordered, the batch stops at the first one
+     * that fails.  @return how many statements succeeded
+     */
+    long long applyWriteBatch( const char *ns, const vector<BSONObj>& statements, bool ordered, BSONArrayBuilder& results );
+
     void getDatabaseNames( vector< string > &names , const string& usePath = dbpath );
 
     /* returns true if there is no data on this server.  useful when starting replication.
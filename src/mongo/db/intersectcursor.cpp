@@ -0,0 +1,102 @@
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+
+#include "mongo/db/intersectcursor.h"
+
+#include <algorithm>
+
+#include "mongo/db/btree.h"
+#include "mongo/db/queryutil.h"
+
+namespace mongo {
+
+    IntersectCursor::IntersectCursor( const shared_ptr<Cursor> &c, NamespaceDetails *d, int idxNo,
+                                      const IndexDetails &id,
+                                      const shared_ptr<FieldRangeVector> &bounds ) :
+        _c( c ),
+        _otherIndexName( id.indexName() ),
+        _otherNscanned(),
+        _filtering( true ),
+        _nSkipped() {
+        scoped_ptr<BtreeCursor> other( BtreeCursor::make( d, idxNo, id, bounds, 0, 1 ) );
+        while( other->ok() ) {
+            if ( other->nscanned() > MaxLocs ) {
+                // not selective enough to be worth the memory, nothing is skipped
+                _filtering = false;
+                break;
+            }
+            _otherLocs.push_back( other->currLoc() );
+            other->advance();
+        }
+        _otherNscanned = other->nscanned();
+        if ( _filtering ) {
+            sort( _otherLocs.begin(), _otherLocs.end() );
+            _otherLocs.erase( unique( _otherLocs.begin(), _otherLocs.end() ), _otherLocs.end() );
+        }
+        else {
+            vector<DiskLoc>().swap( _otherLocs );
+        }
+        skipOutsideOther();
+    }
+
+    bool IntersectCursor::inOther( const DiskLoc &loc ) const {
+        return !_filtering || binary_search( _otherLocs.begin(), _otherLocs.end(), loc );
+    }
+
+    void IntersectCursor::skipOutsideOther() {
+        while( _c->ok() && !inOther( _c->currLoc() ) ) {
+            ++_nSkipped;
+            _c->advance();
+        }
+    }
+
+    long long IntersectCursor::nscanned() {
+        long long keys = _otherNscanned + _c->nscanned();
+        return keys / 4 + ( _c->nscanned() - _nSkipped );
+    }
+
+    bool IntersectCursor::advance() {
+        _c->advance();
+        skipOutsideOther();
+        return ok();
+    }
+
+    void IntersectCursor::checkLocation() {
+        _c->checkLocation();
+        skipOutsideOther();
+    }
+
+    void IntersectCursor::recoverFromTouchingEarlierIterate() {
+        _c->recoverFromTouchingEarlierIterate();
+        skipOutsideOther();
+    }
+
+    void IntersectCursor::recoverFromYield() {
+        _c->recoverFromYield();
+        skipOutsideOther();
+    }
+
+    void IntersectCursor::explainDetails( BSONObjBuilder &b ) {
+        _c->explainDetails( b );
+        b << "intersectIndex" << _otherIndexName;
+        b << "intersectNscanned" << _otherNscanned;
+        b << "intersectSkipped" << _nSkipped;
+        b << "intersectFiltering" << _filtering;
+    }
+
+} // namespace mongo
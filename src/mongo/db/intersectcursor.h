@@ -0,0 +1,96 @@
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "mongo/db/cursor.h"
+
+namespace mongo {
+
+    class FieldRangeVector;
+    class IndexDetails;
+
+    /**
+     * Iterates a btree cursor over one index, skipping the records missing from the ranges of a
+     * second index on another field, so that only records in both are returned for matching.
+     * The second index is scanned up front into a sorted list of DiskLocs; it is abandoned if it
+     * holds more than MaxLocs keys, and then the cursor returns everything the first one does.
+     *
+     * The filter may only skip records which can't match, so the matcher still checks the full
+     * document of each record returned.
+     */
+    class IntersectCursor : public Cursor {
+    public:
+        IntersectCursor( const shared_ptr<Cursor> &c, NamespaceDetails *d, int idxNo,
+                         const IndexDetails &id, const shared_ptr<FieldRangeVector> &bounds );
+
+        virtual bool ok() { return _c->ok(); }
+        virtual Record* _current() { return _c->_current(); }
+        virtual BSONObj current() { return _c->current(); }
+        virtual DiskLoc currLoc() { return _c->currLoc(); }
+        virtual bool advance();
+        virtual BSONObj currKey() const { return _c->currKey(); }
+        virtual DiskLoc refLoc() { return _c->refLoc(); }
+        virtual void aboutToDeleteBucket( const DiskLoc &b ) { _c->aboutToDeleteBucket( b ); }
+        virtual BSONObj indexKeyPattern() { return _c->indexKeyPattern(); }
+        virtual bool supportGetMore() { return _c->supportGetMore(); }
+        virtual void noteLocation() { _c->noteLocation(); }
+        virtual void checkLocation();
+        virtual void prepareToTouchEarlierIterate() { _c->prepareToTouchEarlierIterate(); }
+        virtual void recoverFromTouchingEarlierIterate();
+        virtual bool supportYields() { return _c->supportYields(); }
+        virtual void prepareToYield() { _c->prepareToYield(); }
+        virtual void recoverFromYield();
+        virtual string toString() { return _c->toString() + " intersect " + _otherIndexName; }
+        virtual bool getsetdup( DiskLoc loc ) { return _c->getsetdup( loc ); }
+        virtual bool isMultiKey() const { return _c->isMultiKey(); }
+        virtual bool modifiedKeys() const { return _c->modifiedKeys(); }
+        virtual BSONObj prettyIndexBounds() const { return _c->prettyIndexBounds(); }
+        /**
+         * Keys read without fetching their record count a quarter, so that this cursor may win a
+         * plan race against a cursor which fetches the record of each key it reads.
+         */
+        virtual long long nscanned();
+        virtual CoveredIndexMatcher *matcher() const { return _c->matcher(); }
+        virtual shared_ptr< CoveredIndexMatcher > matcherPtr() const { return _c->matcherPtr(); }
+        virtual bool currentMatches( MatchDetails *details = 0 ) {
+            return _c->currentMatches( details );
+        }
+        virtual void setMatcher( shared_ptr< CoveredIndexMatcher > matcher ) {
+            _c->setMatcher( matcher );
+        }
+        /** Never covered: the other index's fields must be read from the document. */
+        virtual void setKeyFieldsOnly( const shared_ptr<Projection::KeyOnly> &keyFieldsOnly ) {}
+        virtual void explainDetails( BSONObjBuilder &b );
+
+        /** The most keys read from the other index before it is abandoned. */
+        static const long long MaxLocs = 20000;
+
+    private:
+        /** @return true if a record at 'loc' may be in the other index's ranges. */
+        bool inOther( const DiskLoc &loc ) const;
+        /** Skips forward to a record in the other index's ranges. */
+        void skipOutsideOther();
+
+        shared_ptr<Cursor> _c;
+        string _otherIndexName;
+        long long _otherNscanned;
+        bool _filtering;
+        vector<DiskLoc> _otherLocs; // sorted, unique
+        long long _nSkipped;
+    };
+
+} // namespace mongo
@@ -24,21 +24,157 @@
 #include "jsobj.h"
 #include "pdfile.h"
 #include "curop.h"
+#include "databaseholder.h"
+#include "commands/fsync.h"
+#include "../util/background.h"
 
 namespace mongo {
 
-    BufBuilder profileBufBuilder; // reused, instead of allocated every time - avoids a malloc/free cycle
+    namespace {
+
+        enum {
+            MaxQueued = 10000 ,
+            MaxQueuedBytes = 16 * 1024 * 1024 ,
+            FlushIntervalMillis = 100
+        };
+
+        /**
+         * profile entries waiting to be written.  profile() only takes this mutex, briefly, so
+         * an operation's profiling no longer holds its database's write lock.
+         */
+        class ProfileQueue {
+        public:
+            ProfileQueue() : _m( "profileQueue" ), _bytes( 0 ), _queued( 0 ), _written( 0 ),
+                _dropped( 0 ), _writerStarted( false ) { }
+
+            /** @return false, counting a drop, if the queue is full */
+            bool push( const string& ns , const BSONObj& o , bool* startWriter ) {
+                SimpleMutex::scoped_lock lk( _m );
+                *startWriter = ! _writerStarted;
+                _writerStarted = true;
+                if ( _q.size() >= (size_t) MaxQueued || _bytes + o.objsize() > (size_t) MaxQueuedBytes ) {
+                    _dropped++;
+                    return false;
+                }
+                _q.push_back( make_pair( ns , o ) );
+                _bytes += o.objsize();
+                _queued++;
+                return true;
+            }
 
-    void profile( const Client& c , CurOp& currentOp ) {
-        verify( Lock::somethingWriteLocked() );
+            void takeAll( deque< pair<string,BSONObj> >& out ) {
+                SimpleMutex::scoped_lock lk( _m );
+                _q.swap( out );
+                _bytes = 0;
+            }
+
+            bool empty() {
+                SimpleMutex::scoped_lock lk( _m );
+                return _q.empty();
+            }
+
+            void noteWritten( long long n ) {
+                SimpleMutex::scoped_lock lk( _m );
+                _written += n;
+            }
+
+            void noteDropped( long long n ) {
+                SimpleMutex::scoped_lock lk( _m );
+                _dropped += n;
+            }
+
+            void appendStats( BSONObjBuilder& b ) {
+                SimpleMutex::scoped_lock lk( _m );
+                b.appendNumber( "waiting" , (long long) _q.size() );
+                b.appendNumber( "queued" , _queued );
+                b.appendNumber( "written" , _written );
+                b.appendNumber( "dropped" , _dropped );
+            }
+
+        private:
+            SimpleMutex _m;
+            deque< pair<string,BSONObj> > _q;
+            size_t _bytes;
+            long long _queued;
+            long long _written;
+            long long _dropped;
+            bool _writerStarted;
+        } profileQueue;
+
+        // held while writing, so that batches go into system.profile in the order they were queued
+        mongo::mutex profileWriteMutex( "profileWrite" );
+
+        /** @return false if ns doesn't exist */
+        bool writeProfileEntries( const string& ns , const vector<BSONObj>& entries ) {
+            Lock::DBWrite lk( ns );
+            if ( ! dbHolder()._isLoaded( nsToDatabase( ns ) , dbpath ) )
+                return false;
+            Client::Context cx( ns , dbpath , false );
+            // write: not replicated
+            NamespaceDetails *d = cx.db()->namespaceIndex.details( ns.c_str() );
+            if ( ! d ) {
+                static time_t last;
+                if( time(0) > last+10 ) {
+                    log() << "profile: warning ns " << ns << " does not exist" << endl;
+                    last = time(0);
+                }
+                return false;
+            }
+            for ( unsigned i = 0; i < entries.size(); i++ ) {
+                int len = entries[i].objsize();
+                Record *r = theDataFileMgr.fast_oplog_insert( d , ns.c_str() , len );
+                memcpy( getDur().writingPtr( r->data() , len ) , entries[i].objdata() , len );
+            }
+            return true;
+        }
 
-        Database *db = c.database();
-        DEV verify( db );
-        const char *ns = db->profileName.c_str();
+        void writeQueuedProfile() {
+            scoped_lock lk( profileWriteMutex );
+            deque< pair<string,BSONObj> > q;
+            profileQueue.takeAll( q );
+
+            // one lock for each run of entries for the same database
+            while ( ! q.empty() ) {
+                string ns = q.front().first;
+                vector<BSONObj> entries;
+                while ( ! q.empty() && q.front().first == ns ) {
+                    entries.push_back( q.front().second );
+                    q.pop_front();
+                }
+                if ( writeProfileEntries( ns , entries ) )
+                    profileQueue.noteWritten( entries.size() );
+                else
+                    profileQueue.noteDropped( entries.size() );
+            }
+        }
+
+        class ProfileWriter : public BackgroundJob {
+        public:
+            virtual string name() const { return "profileWriter"; }
+            virtual void run() {
+                Client::initThread( name().c_str() );
+                while ( ! inShutdown() ) {
+                    sleepmillis( FlushIntervalMillis );
+                    // don't wait behind an fsync lock; anything queued meanwhile may be dropped
+                    if ( lockedForWriting() || profileQueue.empty() )
+                        continue;
+                    try {
+                        writeQueuedProfile();
+                    }
+                    catch ( DBException& e ) {
+                        log() << "profileWriter: " << e.what() << endl;
+                    }
+                }
+                cc().shutdown();
+            }
+        };
+    }
+
+    void profile( const Client& c , CurOp& currentOp ) {
+        const string ns = nsToDatabase( currentOp.getNS() ) + ".system.profile";
         
-        // build object
-        profileBufBuilder.reset();
-        BSONObjBuilder b(profileBufBuilder);
+        // build object, in the operation's arena as it's copied out for the queue
+        ArenaBSONObjBuilder b( 4096 );
         b.appendDate("ts", jsTime());
         currentOp.debug().append( currentOp , b );
 
@@ -47,7 +183,7 @@ namespace mongo {
         if ( c.getAuthenticationInfo() )
             b.append( "user" , c.getAuthenticationInfo()->getUser( nsToDatabase( ns ) ) );
 
-        BSONObj p = b.done();
+        BSONObj p = b.obj();
 
         if (p.objsize() > 100*1024){
             string small = p.toString(/*isArray*/false, /*full*/false);
@@ -55,7 +191,7 @@ namespace mongo {
             warning() << "can't add full line to system.profile: " << small;
 
             // rebuild with limited info
-            BSONObjBuilder b(profileBufBuilder);
+            BSONObjBuilder b;
             b.appendDate("ts", jsTime());
             b.append("client", c.clientAddress() );
             if ( c.getAuthenticationInfo() )
@@ -66,23 +202,32 @@ namespace mongo {
                 b.append("abbreviated", small);
             }
 
-            p = b.done();
+            p = b.obj();
         }
 
-        // write: not replicated
-        NamespaceDetails *d = db->namespaceIndex.details(ns);
-        if( d ) {
-            int len = p.objsize();
-            Record *r = theDataFileMgr.fast_oplog_insert(d, ns, len);
-            memcpy(getDur().writingPtr(r->data(), len), p.objdata(), len);
-        }
-        else { 
-            static time_t last;
-            if( time(0) > last+10 ) {
-                log() << "profile: warning ns " << ns << " does not exist" << endl;
-                last = time(0);
-            }
-        }
+        bool startWriter;
+        profileQueue.push( ns , p , &startWriter );
+        if ( startWriter )
+            ( new ProfileWriter() )->go();
+    }
+
+    void flushProfileIfRead( const char *ns , const BSONObj& query ) {
+        if ( profileQueue.empty() || Lock::isLocked() || lockedForWriting() )
+            return;
+        // a find on system.profile, or a command (count, aggregate...) naming it
+        const char *coll = strchr( ns , '.' );
+        if ( ! coll )
+            return;
+        coll++;
+        bool reads = str::equals( coll , "system.profile" ) ||
+            ( str::equals( coll , "$cmd" ) && query.firstElement().type() == String &&
+              str::equals( query.firstElement().valuestr() , "system.profile" ) );
+        if ( reads )
+            writeQueuedProfile();
+    }
+
+    void appendProfileStats( BSONObjBuilder& b ) {
+        profileQueue.appendStats( b );
     }
 
 } // namespace mongo
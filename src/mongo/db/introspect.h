@@ -29,6 +29,19 @@ namespace mongo {
        do when database->profile is set
     */
 
+    /**
+     * queues currentOp's entry for its database's system.profile, which a background thread
+     * writes in batches.  needs no lock.  if too much is queued the entry is dropped, and counted.
+     */
     void profile( const Client& c , CurOp& currentOp );
 
+    /**
+     * writes out what profile() has queued if the query to ns reads system.profile, so readers
+     * see the operations before theirs.  call with no lock held.
+     */
+    void flushProfileIfRead( const char *ns , const BSONObj& query );
+
+    /** the queue's counters, for serverStatus */
+    void appendProfileStats( BSONObjBuilder& b );
+
 } // namespace mongo
@@ -61,30 +61,51 @@ namespace mongo {
     MinKeyLabeler MINKEY;
     MaxKeyLabeler MAXKEY;
 
+    // what a stringstream of the given precision writes for x, without the stream
+    static void appendDouble( StringBuilder& s , double x , int precision ) {
+        char buf[32];
+        int n = mongo_snprintf( buf , sizeof( buf ) , "%.*g" , precision , x );
+        verify( n > 0 && n < (int) sizeof( buf ) );
+        s.write( buf , n );
+    }
+
     // need to move to bson/, but has dependency on base64 so move that to bson/util/ first.
-    inline string BSONElement::jsonString( JsonStringFormat format, bool includeFieldNames, int pretty ) const {
+    string BSONElement::jsonString( JsonStringFormat format, bool includeFieldNames, int pretty ) const {
+        StringBuilder s;
+        jsonString( s, format, includeFieldNames, pretty );
+        return s.str();
+    }
+
+    void BSONElement::jsonString( StringBuilder& s, JsonStringFormat format, bool includeFieldNames, int pretty ) const {
         BSONType t = type();
         int sign;
-        if ( t == Undefined )
-            return "undefined";
+        if ( t == Undefined ) {
+            s << "undefined";
+            return;
+        }
 
-        stringstream s;
-        if ( includeFieldNames )
-            s << '"' << escape( fieldName() ) << "\" : ";
+        if ( includeFieldNames ) {
+            s << '"';
+            escape( s, fieldName(), fieldNameSize() - 1 );
+            s << "\" : ";
+        }
         switch ( type() ) {
         case mongo::String:
         case Symbol:
-            s << '"' << escape( string(valuestr(), valuestrsize()-1) ) << '"';
+            s << '"';
+            escape( s, valuestr(), valuestrsize()-1 );
+            s << '"';
             break;
         case NumberLong:
             s << _numberLong();
             break;
         case NumberInt:
+            s << _numberInt();
+            break;
         case NumberDouble:
             if ( number() >= -numeric_limits< double >::max() &&
                     number() <= numeric_limits< double >::max() ) {
-                s.precision( 16 );
-                s << number();
+                appendDouble( s, number(), 16 );
             }
             else if ( mongo::isNaN(number()) ) {
                 s << "NaN";
@@ -106,7 +127,7 @@ namespace mongo {
             s << "null";
             break;
         case Object:
-            s << embeddedObject().jsonString( format, pretty );
+            embeddedObject().jsonString( s, format, pretty );
             break;
         case mongo::Array: {
             if ( embeddedObject().isEmpty() ) {
@@ -129,7 +150,7 @@ namespace mongo {
                         s << "undefined";
                     }
                     else {
-                        s << e.jsonString( format, false, pretty?pretty+1:0 );
+                        e.jsonString( s, format, false, pretty?pretty+1:0 );
                         e = i.next();
                     }
                     count++;
@@ -177,11 +198,10 @@ namespace mongo {
             BinDataType type = BinDataType( *(char *)( (int *)( value() ) + 1 ) );
             s << "{ \"$binary\" : \"";
             char *start = ( char * )( value() ) + sizeof( int ) + 1;
-            base64::encode( s , start , len );
-            s << "\", \"$type\" : \"" << hex;
-            s.width( 2 );
-            s.fill( '0' );
-            s << type << dec;
+            s << base64::encode( start , len );
+            char typeHex[3];
+            mongo_snprintf( typeHex , sizeof( typeHex ) , "%02x" , (unsigned) type & 0xff );
+            s << "\", \"$type\" : \"" << typeHex;
             s << "\" }";
             break;
         }
@@ -197,7 +217,7 @@ namespace mongo {
                     s << '"' << date().toString() << '"';
             }
             else
-                s << date();
+                s << date().millis;
             if ( format == Strict )
                 s << " }";
             else
@@ -205,11 +225,14 @@ namespace mongo {
             break;
         case RegEx:
             if ( format == Strict ) {
-                s << "{ \"$regex\" : \"" << escape( regex() );
+                s << "{ \"$regex\" : \"";
+                escape( s, regex(), strlen( regex() ) );
                 s << "\", \"$options\" : \"" << regexFlags() << "\" }";
             }
             else {
-                s << "/" << escape( regex() , true ) << "/";
+                s << "/";
+                escape( s, regex(), strlen( regex() ), true );
+                s << "/";
                 // FIXME Worry about alpha order?
                 for ( const char *f = regexFlags(); *f; ++f ) {
                     switch ( *f ) {
@@ -228,7 +251,9 @@ namespace mongo {
             BSONObj scope = codeWScopeObject();
             if ( ! scope.isEmpty() ) {
                 s << "{ \"$code\" : " << _asCode() << " , "
-                  << " \"$scope\" : " << scope.jsonString() << " }";
+                  << " \"$scope\" : ";
+                scope.jsonString( s );
+                s << " }";
                 break;
             }
         }
@@ -238,7 +263,7 @@ namespace mongo {
             break;
 
         case Timestamp:
-            s << "{ \"t\" : " << timestampTime() << " , \"i\" : " << timestampInc() << " }";
+            s << "{ \"t\" : " << timestampTime().millis << " , \"i\" : " << timestampInc() << " }";
             break;
 
         case MinKey:
@@ -256,7 +281,6 @@ namespace mongo {
             string message = ss.str();
             massert( 10312 ,  message.c_str(), false );
         }
-        return s.str();
     }
 
     int BSONElement::getGtLtOp( int def ) const {
@@ -392,16 +416,24 @@ namespace mongo {
     }
 
     string BSONObj::jsonString( JsonStringFormat format, int pretty ) const {
+        StringBuilder s;
+        jsonString( s, format, pretty );
+        return s.str();
+    }
 
-        if ( isEmpty() ) return "{}";
+    void BSONObj::jsonString( StringBuilder& s, JsonStringFormat format, int pretty ) const {
+
+        if ( isEmpty() ) {
+            s << "{}";
+            return;
+        }
 
-        StringBuilder s;
         s << "{ ";
         BSONObjIterator i(*this);
         BSONElement e = i.next();
         if ( !e.eoo() )
             while ( 1 ) {
-                s << e.jsonString( format, true, pretty?pretty+1:0 );
+                e.jsonString( s, format, true, pretty?pretty+1:0 );
                 e = i.next();
                 if ( e.eoo() )
                     break;
@@ -416,10 +448,120 @@ namespace mongo {
                 }
             }
         s << " }";
-        return s.str();
+    }
+
+    /**
+     * The common case of valid(): walks the bytes once, without building elements or throwing.
+     * @return true only if p..p+maxLen starts with a well formed object; false may still be
+     * valid as far as the element by element check is concerned.
+     */
+    static bool quickValid( const char* p , int maxLen , int depth ) {
+        if ( maxLen < 5 || depth > 100 )
+            return false;
+        const int size = *(const int*) p;
+        if ( size < 5 || size > maxLen || p[size-1] != 0 )
+            return false;
+        const char* end = p + size - 1; // the EOO
+        p += 4;
+        while ( p < end ) {
+            const BSONType t = (BSONType) (signed char) *p++;
+            // the field name; the EOO ends the search at worst
+            const char* z = (const char*) memchr( p , 0 , end - p + 1 );
+            if ( z == end )
+                return false;
+            p = z + 1;
+            const int remain = end - p;
+            int len;
+            switch ( t ) {
+            case Undefined:
+            case jstNULL:
+            case MaxKey:
+            case MinKey:
+                len = 0;
+                break;
+            case Bool:
+                len = 1;
+                break;
+            case NumberInt:
+                len = 4;
+                break;
+            case Timestamp:
+            case Date:
+            case NumberDouble:
+            case NumberLong:
+                len = 8;
+                break;
+            case jstOID:
+                len = 12;
+                break;
+            case String:
+            case Code:
+            case Symbol:
+            case DBRef: {
+                if ( remain < 4 )
+                    return false;
+                int x = *(const int*) p;
+                if ( x <= 0 || x > remain - 4 || p[4+x-1] != 0 )
+                    return false;
+                len = 4 + x;
+                if ( t == DBRef )
+                    len += 12;
+                break;
+            }
+            case BinData: {
+                if ( remain < 5 )
+                    return false;
+                int x = *(const int*) p;
+                if ( x < 0 || x > remain - 5 )
+                    return false;
+                len = 5 + x;
+                break;
+            }
+            case Object:
+            case Array:
+                if ( ! quickValid( p , remain , depth + 1 ) )
+                    return false;
+                len = *(const int*) p;
+                break;
+            case RegEx: {
+                const char* a = (const char*) memchr( p , 0 , remain );
+                if ( ! a )
+                    return false;
+                const char* b = (const char*) memchr( a + 1 , 0 , end - ( a + 1 ) );
+                if ( ! b )
+                    return false;
+                len = b + 1 - p;
+                break;
+            }
+            case CodeWScope: {
+                if ( remain < 14 )
+                    return false;
+                int total = *(const int*) p;
+                int x = *(const int*) ( p + 4 );
+                if ( total > remain || x <= 0 || x > total - 13 || p[8+x-1] != 0 ||
+                     memchr( p + 8 , 0 , x ) != p + 8 + x - 1 )
+                    return false;
+                if ( ! quickValid( p + 8 + x , total - 8 - x , depth + 1 ) ||
+                     *(const int*) ( p + 8 + x ) != total - 8 - x )
+                    return false;
+                len = total;
+                break;
+            }
+            default:
+                return false;
+            }
+            if ( len > remain )
+                return false;
+            p += len;
+        }
+        return p == end;
     }
 
     bool BSONObj::valid() const {
+        if ( quickValid( objdata() , objsize() , 0 ) )
+            return true;
+
+        // the slow way, which is the word on anything odd
         try {
             BSONObjIterator it(*this);
             while( it.moreWithEOO() ) {
@@ -583,9 +725,8 @@ namespace mongo {
         if ( e.eoo() ) {
             const char *p = strchr(name.data(), '.');
             if ( p ) {
-                string left(name.data(), p-name.data());
                 const char* next = p+1;
-                BSONElement e = obj->getField( left.c_str() );
+                BSONElement e = obj->getField( name.data(), (unsigned)(p-name.data()) );
 
                 if (e.type() == Object) {
                     e.embeddedObject().getFieldsDotted(next, ret, expandLastArray );
@@ -640,7 +781,7 @@ namespace mongo {
         BSONElement sub;
 
         if ( p ) {
-            sub = getField( string(name, p-name) );
+            sub = getField( name, (unsigned)(p-name) );
             name = p + 1;
         }
         else {
@@ -624,12 +624,293 @@ namespace mongo {
         ObjectBuilder &b;
     };
 
+    /**
+     * A hand written parser for plain JSON, which is most of what fromjson() sees: objects,
+     * arrays, strings, numbers, true, false, null and undefined, with the field names and
+     * escapes JsonGrammar takes and giving the same BSON.  Anything else -- a '$' field name,
+     * which all the extended types start with, a value which isn't one of the above, or an
+     * error -- makes it give up, and JsonGrammar parses the input instead.
+     */
+    class PlainJsonParser : boost::noncopyable {
+    public:
+        PlainJsonParser( const char *str ) : _p( str ) {}
+
+        /** @return false if the input needs JsonGrammar.  b is then in no particular state */
+        bool parse( BSONObjBuilder &b ) {
+            skipSpace();
+            if ( *_p != '{' || ! object( b ) )
+                return false;
+            skipSpace();
+            return true;
+        }
+
+        /** where the parse stopped, after any trailing space */
+        const char *stop() const { return _p; }
+
+    private:
+        void skipSpace() {
+            while ( isspace( (unsigned char) *_p ) )
+                _p++;
+        }
+
+        static bool isDigit( char c ) { return c >= '0' && c <= '9'; }
+
+        static bool isNameChar( char c ) {
+            return isalnum( (unsigned char) c ) || c == '$' || c == '_';
+        }
+
+        bool object( BSONObjBuilder &b ) {
+            _p++;
+            skipSpace();
+            if ( *_p == '}' ) {
+                _p++;
+                return true;
+            }
+            string name;
+            while ( true ) {
+                if ( ! fieldName( name ) )
+                    return false;
+                skipSpace();
+                if ( *_p != ':' )
+                    return false;
+                _p++;
+                skipSpace();
+                if ( ! value( b , name.c_str() ) )
+                    return false;
+                skipSpace();
+                if ( *_p == '}' ) {
+                    _p++;
+                    return true;
+                }
+                if ( *_p != ',' )
+                    return false;
+                _p++;
+                skipSpace();
+            }
+        }
+
+        bool array( BSONObjBuilder &b ) {
+            _p++;
+            skipSpace();
+            if ( *_p == ']' ) {
+                _p++;
+                return true;
+            }
+            for ( int i = 0; ; i++ ) {
+                if ( ! value( b , BSONObjBuilder::numStr( i ).c_str() ) )
+                    return false;
+                skipSpace();
+                if ( *_p == ']' ) {
+                    _p++;
+                    return true;
+                }
+                if ( *_p != ',' )
+                    return false;
+                _p++;
+                skipSpace();
+            }
+        }
+
+        bool fieldName( string &name ) {
+            if ( *_p == '"' || *_p == '\'' ) {
+                if ( ! str( name ) )
+                    return false;
+            }
+            else {
+                if ( ! ( isalpha( (unsigned char) *_p ) || *_p == '$' || *_p == '_' ) )
+                    return false;
+                const char *start = _p;
+                while ( isNameChar( *_p ) )
+                    _p++;
+                name.assign( start , _p );
+            }
+            // the extended types, and the reserved names JsonGrammar rejects
+            return name.empty() || name[0] != '$';
+        }
+
+        bool value( BSONObjBuilder &b , const char *fieldName ) {
+            switch ( *_p ) {
+            case '"':
+            case '\'':
+                if ( ! str( _str ) )
+                    return false;
+                b.append( fieldName , _str );
+                return true;
+            case '{': {
+                BSONObjBuilder sub( b.subobjStart( fieldName ) );
+                if ( ! object( sub ) )
+                    return false;
+                sub.done();
+                return true;
+            }
+            case '[': {
+                BSONObjBuilder sub( b.subarrayStart( fieldName ) );
+                if ( ! array( sub ) )
+                    return false;
+                sub.done();
+                return true;
+            }
+            case 't':
+                if ( ! keyword( "true" ) )
+                    return false;
+                b.appendBool( fieldName , true );
+                return true;
+            case 'f':
+                if ( ! keyword( "false" ) )
+                    return false;
+                b.appendBool( fieldName , false );
+                return true;
+            case 'n':
+                if ( ! keyword( "null" ) )
+                    return false;
+                b.appendNull( fieldName );
+                return true;
+            case 'u':
+                if ( ! keyword( "undefined" ) )
+                    return false;
+                b.appendUndefined( fieldName );
+                return true;
+            default:
+                return number( b , fieldName );
+            }
+        }
+
+        bool keyword( const char *word ) {
+            size_t len = strlen( word );
+            if ( strncmp( _p , word , len ) != 0 || isNameChar( _p[len] ) )
+                return false;
+            _p += len;
+            return true;
+        }
+
+        // what JsonGrammar's number and integer take, less NaN, Infinity and the looser forms
+        bool number( BSONObjBuilder &b , const char *fieldName ) {
+            const char *start = _p;
+            if ( *_p == '-' )
+                _p++;
+            if ( ! isDigit( *_p ) )
+                return false;
+            long long n = 0;
+            int digits = 0;
+            for ( ; isDigit( *_p ); _p++, digits++ )
+                n = n * 10 + ( *_p - '0' );
+
+            bool real = false;
+            if ( *_p == '.' ) {
+                _p++;
+                if ( ! isDigit( *_p ) )
+                    return false;
+                while ( isDigit( *_p ) )
+                    _p++;
+                real = true;
+            }
+            if ( *_p == 'e' || *_p == 'E' ) {
+                _p++;
+                if ( *_p == '+' || *_p == '-' )
+                    _p++;
+                if ( ! isDigit( *_p ) )
+                    return false;
+                while ( isDigit( *_p ) )
+                    _p++;
+                real = true;
+            }
+
+            if ( real ) {
+                b.append( fieldName , strtod( start , 0 ) );
+                return true;
+            }
+            // can't overflow; longer ones are left to JsonGrammar
+            if ( digits > 18 )
+                return false;
+            if ( *start == '-' )
+                n = -n;
+            if ( n >= numeric_limits<int>::min() && n <= numeric_limits<int>::max() )
+                b.append( fieldName , (int) n );
+            else
+                b.append( fieldName , n );
+            return true;
+        }
+
+        // a quoted string, with the escapes JsonGrammar's str and singleQuoteStr take
+        bool str( string &s ) {
+            const char quote = *_p++;
+            s.clear();
+            while ( true ) {
+                const char *run = _p;
+                while ( *_p != quote && *_p != '\\' && (unsigned char) *_p >= 0x20 )
+                    _p++;
+                s.append( run , _p );
+                if ( *_p == quote ) {
+                    _p++;
+                    return true;
+                }
+                if ( *_p != '\\' )
+                    return false;
+
+                _p++;
+                switch ( *_p ) {
+                case 'b': s += '\b'; break;
+                case 'f': s += '\f'; break;
+                case 'n': s += '\n'; break;
+                case 'r': s += '\r'; break;
+                case 't': s += '\t'; break;
+                case 'v': s += '\v'; break;
+                case 'u':
+                    if ( ! unicodeEscape( s ) )
+                        return false;
+                    break;
+                default:
+                    // hex and octal aren't supported
+                    if ( *_p == '\0' || *_p == 'x' || isDigit( *_p ) )
+                        return false;
+                    s += *_p;
+                }
+                _p++;
+            }
+        }
+
+        // the uXXXX of an escape, as utf8 the way chU writes it
+        bool unicodeEscape( string &s ) {
+            for ( int i = 1; i <= 4; i++ ) {
+                if ( ! isxdigit( (unsigned char) _p[i] ) )
+                    return false;
+            }
+            unsigned char first = fromHex( _p + 1 );
+            unsigned char second = fromHex( _p + 3 );
+            if ( first == 0 && second < 0x80 )
+                s += second;
+            else if ( first < 0x08 ) {
+                s += char( 0xc0 | ( ( first << 2 ) | ( second >> 6 ) ) );
+                s += char( 0x80 | ( ~0xc0 & second ) );
+            }
+            else {
+                s += char( 0xe0 | ( first >> 4 ) );
+                s += char( 0x80 | ( ~0xc0 & ( ( first << 2 ) | ( second >> 6 ) ) ) );
+                s += char( 0x80 | ( ~0xc0 & second ) );
+            }
+            _p += 4;
+            return true;
+        }
+
+        const char *_p;
+        string _str; // for string values, to keep their buffer between them
+    };
+
     BSONObj fromjson( const char *str , int* len) {
         if ( str[0] == '\0' ) {
             if (len) *len = 0;
             return BSONObj();
         }
 
+        {
+            BSONObjBuilder plain;
+            PlainJsonParser plainParser( str );
+            if ( plainParser.parse( plain ) && ( len || *plainParser.stop() == '\0' ) ) {
+                if (len) *len = plainParser.stop() - str;
+                return plain.obj();
+            }
+        }
+
         ObjectBuilder b;
         JsonGrammar parser( b );
         parse_info<> result = parse( str, parser, space_p );
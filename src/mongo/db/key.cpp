@@ -514,13 +514,58 @@ namespace mongo {
         return 0;
     }
 
+    /** @return true if o is { "" : <NumberLong> }, as the keys of a hashed index are */
+    static inline bool isSingleLong(const BSONObj& o) {
+        const char *p = o.objdata();
+        return o.objsize() == 4 + 1 + 1 + 8 + 1 && p[4] == NumberLong && p[5] == 0;
+    }
+
     // at least one of this and right are traditional BSON format
     int NOINLINE_DECL KeyV1::compareHybrid(const KeyV1& right, const Ordering& order) const { 
         BSONObj L = toBson();
         BSONObj R = right.toBson();
+        // most 64 bit hashes can't be stored exactly as a double, so the keys of a hashed index
+        // are nearly all traditional BSON.  compare those quickly as every probe of a lookup
+        // ends up here
+        if( isSingleLong(L) && isSingleLong(R) ) {
+            long long a = L.firstElement()._numberLong();
+            long long b = R.firstElement()._numberLong();
+            int x = a < b ? -1 : ( a == b ? 0 : 1 );
+            return order.descending(1) ? -x : x;
+        }
         return L.woCompare(R, order, /*considerfieldname*/false);
     }
 
+    /** compares the compact format elements at l and r onward.  mask is the ordering bit of
+        the first of them.
+    */
+    static inline int compareElements(const unsigned char *l, const unsigned char *r, const Ordering &order, unsigned mask) {
+        while( 1 ) { 
+            char lval = *l; 
+            char rval = *r;
+            {
+                int x = compare(l, r); // updates l and r pointers
+                if( x ) {
+                    if( order.descending(mask) )
+                        x = -x;
+                    return x;
+                }
+            }
+
+            {
+                int x = ((int)(lval & cHASMORE)) - ((int)(rval & cHASMORE));
+                if( x ) 
+                    return x;
+                if( (lval & cHASMORE) == 0 )
+                    break;
+            }
+
+            mask <<= 1;
+        }
+
+        return 0;
+    }
+
     int KeyV1::woCompare(const KeyV1& right, const Ordering &order) const {
         const unsigned char *l = _keyData;
         const unsigned char *r = right._keyData;
@@ -528,9 +573,21 @@ namespace mongo {
         if( (*l|*r) == IsBSON ) // only can do this if cNOTUSED maintained
             return compareHybrid(right, order);
 
+        return compareElements(l, r, order, 1);
+    }
+
+    int KeyV1::woCompare(const char *prefix, int prefixLen, const char *suffix, const Ordering &order) const {
+        if( !isCompactFormat() ) {
+            KeyV2 right(prefix, prefixLen, suffix);
+            return compareHybrid(right, order);
+        }
+
+        const unsigned char *l = _keyData;
+        const unsigned char *r = (const unsigned char *) prefix;
+        const unsigned char *end = r + prefixLen;
         unsigned mask = 1;
-        while( 1 ) { 
-            char lval = *l; 
+        while( r < end ) {
+            char lval = *l;
             char rval = *r;
             {
                 int x = compare(l, r); // updates l and r pointers
@@ -542,17 +599,16 @@ namespace mongo {
             }
 
             {
+                // every prefix element has more after it, so we are less if we stop here
                 int x = ((int)(lval & cHASMORE)) - ((int)(rval & cHASMORE));
-                if( x ) 
+                if( x )
                     return x;
-                if( (lval & cHASMORE) == 0 )
-                    break;
             }
 
             mask <<= 1;
         }
 
-        return 0;
+        return compareElements(l, (const unsigned char *) suffix, order, mask);
     }
 
     static unsigned sizes[] = {
@@ -604,6 +660,46 @@ namespace mongo {
         return p - _keyData;
     }
 
+    int KeyV1::commonPrefixSize(const KeyV1& right) const {
+        if( !isCompactFormat() || !right.isCompactFormat() )
+            return 0;
+
+        const unsigned char *l = _keyData;
+        const unsigned char *r = right._keyData;
+        int size = 0;
+        // the last element of either key is never part of a prefix
+        while( (*l & cHASMORE) && (*r & cHASMORE) ) {
+            unsigned z = sizeOfElement(l);
+            if( z != sizeOfElement(r) || memcmp(l, r, z) )
+                break;
+            size += z;
+            l += z; r += z;
+        }
+        return size;
+    }
+
+    bool KeyV1::hasPrefix(const char *prefix, int prefixLen) const {
+        return prefixLen > 0 && isCompactFormat() && dataSize() > prefixLen &&
+            memcmp(_keyData, prefix, prefixLen) == 0;
+    }
+
+    KeyV2::KeyV2(const char *prefix, int prefixLen, const char *suffix) {
+        int suffixSize = KeyV1(suffix).dataSize();
+        verify( prefixLen + suffixSize <= (int) sizeof(_buf) );
+        memcpy(_buf, prefix, prefixLen);
+        memcpy(_buf + prefixLen, suffix, suffixSize);
+        _keyData = _buf;
+    }
+
+    void KeyV2::assign(const KeyV2& rhs) {
+        if( rhs._keyData != rhs._buf ) {
+            _keyData = rhs._keyData;
+            return;
+        }
+        memcpy(_buf, rhs._buf, rhs.dataSize());
+        _keyData = _buf;
+    }
+
     bool KeyV1::woEqual(const KeyV1& right) const {
         const unsigned char *l = _keyData;
         const unsigned char *r = right._keyData;
@@ -668,6 +764,314 @@ namespace mongo {
         return true;
     }
 
+    // KeyNormalized
+
+    namespace {
+
+        enum NormalizedTypeBits {
+            NormalizedInt = 0, NormalizedLong = 1, NormalizedDouble = 2, NormalizedNegativeZero = 3,
+            NormalizedString = 0, NormalizedSymbol = 1
+        };
+
+        /** the byte a canonical type is written as.  0 is left for the end of an embedded object */
+        inline unsigned char normalizedType(int canonicalType) {
+            return (unsigned char) (canonicalType + 2);
+        }
+
+        class NormalizedWriter {
+        public:
+            NormalizedWriter(string& bytes, string& typeBits) : _bytes(bytes), _typeBits(typeBits), _flip(0) { }
+            void setDescending(bool d) { _flip = d ? 0xff : 0; }
+            void byte(unsigned char c) { _bytes += (char) (c ^ _flip); }
+            void bytes(const char *p, int n) {
+                for( int i = 0; i < n; i++ )
+                    byte(p[i]);
+            }
+            void bigEndian(unsigned long long x, int n) {
+                for( int i = n - 1; i >= 0; i-- )
+                    byte((unsigned char) (x >> (8 * i)));
+            }
+            /** a 0 ends it, and a 0 inside it is written 0 0xff, so shorter sorts first */
+            void str(const char *p, int n) {
+                for( int i = 0; i < n; i++ ) {
+                    byte(p[i]);
+                    if( p[i] == 0 )
+                        byte(0xff);
+                }
+                byte(0);
+                byte(0);
+            }
+            void typeBit(char t) { _typeBits += t; }
+        private:
+            string& _bytes;
+            string& _typeBits;
+            unsigned char _flip;
+        };
+
+        class NormalizedReader {
+        public:
+            NormalizedReader(const string& bytes, const string& typeBits) :
+                _bytes(bytes), _typeBits(typeBits), _pos(0), _typeBit(0), _flip(0) { }
+            bool atEnd() const { return _pos >= _bytes.size(); }
+            void setDescending(bool d) { _flip = d ? 0xff : 0; }
+            unsigned char byte() {
+                verify( _pos < _bytes.size() );
+                return (unsigned char) _bytes[_pos++] ^ _flip;
+            }
+            void bytes(char *p, int n) {
+                for( int i = 0; i < n; i++ )
+                    p[i] = (char) byte();
+            }
+            unsigned long long bigEndian(int n) {
+                unsigned long long x = 0;
+                for( int i = 0; i < n; i++ )
+                    x = (x << 8) | byte();
+                return x;
+            }
+            string str() {
+                string s;
+                while( 1 ) {
+                    unsigned char c = byte();
+                    if( c == 0 && byte() == 0 )
+                        return s;
+                    s += (char) c;
+                }
+            }
+            string cstr() {
+                string s;
+                for( unsigned char c = byte(); c; c = byte() )
+                    s += (char) c;
+                return s;
+            }
+            char typeBit() {
+                verify( _typeBit < _typeBits.size() );
+                return _typeBits[_typeBit++];
+            }
+        private:
+            const string& _bytes;
+            const string& _typeBits;
+            size_t _pos;
+            size_t _typeBit;
+            unsigned char _flip;
+        };
+
+        bool normalizeObject(NormalizedWriter& w, const BSONObj& o);
+
+        /** NaN first, then the doubles in order with -0 and 0 the same */
+        bool normalizeNumber(NormalizedWriter& w, const BSONElement& e) {
+            double d;
+            switch( e.type() ) {
+            case NumberInt:
+                d = e._numberInt();
+                w.typeBit(NormalizedInt);
+                break;
+            case NumberLong: {
+                long long x = e._numberLong();
+                d = (double) x;
+                if( !( d >= -9223372036854775808.0 && d < 9223372036854775808.0 ) || (long long) d != x )
+                    return false;
+                w.typeBit(NormalizedLong);
+                break;
+            }
+            default:
+                d = e._numberDouble();
+                w.typeBit(d == 0 && 1 / d < 0 ? NormalizedNegativeZero : NormalizedDouble);
+            }
+
+            unsigned long long bits = 0;
+            if( isNaN(d) ) {
+                w.bigEndian(0, 8);
+                return true;
+            }
+            if( d != 0 )
+                memcpy(&bits, &d, sizeof(bits));
+            if( bits >> 63 )
+                bits = ~bits;
+            else
+                bits |= 1ULL << 63;
+            w.bigEndian(bits, 8);
+            return true;
+        }
+
+        bool normalizeValue(NormalizedWriter& w, const BSONElement& e) {
+            switch( e.type() ) {
+            case MinKey:
+            case MaxKey:
+            case Undefined:
+            case jstNULL:
+                return true;
+            case NumberInt:
+            case NumberLong:
+            case NumberDouble:
+                return normalizeNumber(w, e);
+            case Symbol:
+            case mongo::String:
+                w.typeBit(e.type() == Symbol ? NormalizedSymbol : NormalizedString);
+                // fall through
+            case Code:
+                w.str(e.valuestr(), e.valuestrsize() - 1);
+                return true;
+            case Object:
+            case mongo::Array:
+                return normalizeObject(w, e.embeddedObject());
+            case BinData:
+                // by length first, like compareElementValues
+                w.bigEndian(e.objsize(), 4);
+                w.bytes(e.value() + 4, e.objsize() + 1);
+                return true;
+            case jstOID:
+                w.bytes(e.value(), 12);
+                return true;
+            case mongo::Bool:
+                w.byte(*e.value());
+                return true;
+            case mongo::Date:
+                // signed
+                w.bigEndian(e.date().millis ^ (1ULL << 63), 8);
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        /** elements compare by type, then field name, then value; the shorter object first */
+        bool normalizeObject(NormalizedWriter& w, const BSONObj& o) {
+            BSONObjIterator i(o);
+            while( i.more() ) {
+                BSONElement e = i.next();
+                w.byte(normalizedType(e.canonicalType()));
+                w.bytes(e.fieldName(), e.fieldNameSize());
+                if( !normalizeValue(w, e) )
+                    return false;
+            }
+            w.byte(0);
+            return true;
+        }
+
+        void appendString(BSONObjBuilder& b, BSONType t, const string& name, const string& s) {
+            // built by hand as s may hold zeros
+            BufBuilder& bb = b.bb();
+            bb.appendNum((char) t);
+            bb.appendStr(name);
+            bb.appendNum((int) s.size() + 1);
+            bb.appendBuf(s.data(), s.size());
+            bb.appendChar(0);
+        }
+
+        void denormalizeValue(NormalizedReader& r, unsigned char type, const string& name, BSONObjBuilder& b) {
+            switch( (int) type - normalizedType(0) ) {
+            case MinKey:
+                b.appendMinKey(name);
+                break;
+            case MaxKey:
+                b.appendMaxKey(name);
+                break;
+            case 0:
+                b.appendUndefined(name);
+                break;
+            case 5:
+                b.appendNull(name);
+                break;
+            case 10: {
+                unsigned long long bits = r.bigEndian(8);
+                double d = numeric_limits<double>::quiet_NaN();
+                if( bits ) {
+                    bits = ( bits >> 63 ) ? bits & ~( 1ULL << 63 ) : ~bits;
+                    memcpy(&d, &bits, sizeof(d));
+                }
+                switch( r.typeBit() ) {
+                case NormalizedInt: b.append(name, (int) d); break;
+                case NormalizedLong: b.append(name, (long long) d); break;
+                case NormalizedNegativeZero: b.append(name, -0.0); break;
+                default: b.append(name, d);
+                }
+                break;
+            }
+            case 15: {
+                BSONType t = r.typeBit() == NormalizedSymbol ? Symbol : mongo::String;
+                appendString(b, t, name, r.str());
+                break;
+            }
+            case 60:
+                appendString(b, Code, name, r.str());
+                break;
+            case 20:
+            case 25: {
+                BSONObjBuilder sub( type == normalizedType(20) ? b.subobjStart(name) : b.subarrayStart(name) );
+                for( unsigned char t = r.byte(); t; t = r.byte() ) {
+                    string field = r.cstr();
+                    denormalizeValue(r, t, field, sub);
+                }
+                sub.done();
+                break;
+            }
+            case 30: {
+                int len = (int) r.bigEndian(4);
+                BinDataType subtype = (BinDataType) r.byte();
+                string data(len, 0);
+                if( len )
+                    r.bytes(&data[0], len);
+                b.appendBinData(name, len, subtype, data.data());
+                break;
+            }
+            case 35: {
+                char oid[sizeof(OID)];
+                r.bytes(oid, sizeof(OID));
+                b.appendOID(name, (OID *) oid);
+                break;
+            }
+            case 40:
+                b.appendBool(name, r.byte() != 0);
+                break;
+            case 45:
+                b.appendDate(name, Date_t(r.bigEndian(8) ^ (1ULL << 63)));
+                break;
+            default:
+                verify(false);
+            }
+        }
+
+    }
+
+    bool KeyNormalized::normalize(const BSONObj& obj, const Ordering& o) {
+        _bytes.clear();
+        _typeBits.clear();
+        NormalizedWriter w(_bytes, _typeBits);
+        int n = 0;
+        BSONObjIterator i(obj);
+        while( i.more() ) {
+            BSONElement e = i.next();
+            // index keys compare without their field names
+            w.setDescending(n < 32 && o.get(n) < 0);
+            n++;
+            w.byte(normalizedType(e.canonicalType()));
+            if( !normalizeValue(w, e) ) {
+                _bytes.clear();
+                _typeBits.clear();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    int KeyNormalized::compare(const KeyNormalized& r) const {
+        size_t common = std::min(_bytes.size(), r._bytes.size());
+        int x = memcmp(_bytes.data(), r._bytes.data(), common);
+        if( x )
+            return x;
+        return (int) _bytes.size() - (int) r._bytes.size();
+    }
+
+    BSONObj KeyNormalized::toBson(const Ordering& o) const {
+        NormalizedReader r(_bytes, _typeBits);
+        BSONObjBuilder b;
+        for( int n = 0; !r.atEnd(); n++ ) {
+            r.setDescending(n < 32 && o.get(n) < 0);
+            denormalizeValue(r, r.byte(), "", b);
+        }
+        return b.obj();
+    }
+
     struct CmpUnitTest : public StartupTest {
         void run() {
             char a[2];
@@ -27,6 +27,9 @@ namespace mongo {
         KeyBson is a legacy wrapper implementation for old BSONObj style keys for v:0 indexes.
 
         KeyV1 is the new implementation.
+
+        KeyV2 is KeyV1 as read out of a v:2 bucket, where keys may be stored as a suffix to a prefix
+        that is shared by the bucket.
     */
     class KeyBson /* "KeyV0" */ { 
     public:
@@ -86,6 +89,19 @@ namespace mongo {
         BSONElement _firstElement() const { return bson().firstElement(); }
         bool isCompactFormat() const { return *_keyData != IsBSON; }
 
+        /** same as woCompare() against the key whose data is prefix followed by suffix, without
+            putting that key together.  prefix must be a run of whole compact format elements.
+        */
+        int woCompare(const char *prefix, int prefixLen, const char *suffix, const Ordering &o) const;
+
+        /** @return size in bytes of the leading whole elements that this and r have in common,
+                    never counting the last element of either.  0 unless both are in compact format.
+        */
+        int commonPrefixSize(const KeyV1& r) const;
+
+        /** @return true if this is a compact format key that starts with prefix and continues past it */
+        bool hasPrefix(const char *prefix, int prefixLen) const;
+
         bool isValid() const { return _keyData > (const unsigned char*)1; }
     protected:
         enum { IsBSON = 0xff };
@@ -115,4 +131,76 @@ namespace mongo {
         void traditional(const BSONObj& obj); // store as traditional bson not as compact format
     };
 
+    // corresponding to BtreeData_V2
+    class KeyV2 : public KeyV1 {
+        void operator=(const KeyV2&); // use assign()
+    public:
+        /** the largest key we can put back together, which is the largest key a bucket stores */
+        enum { MaxSize = 1024 };
+
+        KeyV2() { }
+
+        /** a key stored whole; we are just a wrapper */
+        explicit KeyV2(const char *keyData) : KeyV1(keyData) { }
+
+        /** a key stored as a suffix to its bucket's prefix.  the two are copied into our own buffer
+            so that the key reads as one KeyV1 and stays valid if the bucket's prefix is moved.
+        */
+        KeyV2(const char *prefix, int prefixLen, const char *suffix);
+
+        KeyV2(const KeyV2& rhs) : KeyV1() { assign(rhs); }
+
+        /** copies our buffer when rhs put its key together in one */
+        void assign(const KeyV2& rhs);
+
+    private:
+        unsigned char _buf[MaxSize];
+    };
+
+    class KeyV2Owned : public KeyV2 {
+        void operator=(const KeyV2Owned&);
+        KeyV2Owned(const KeyV2Owned&);
+    public:
+        /** @obj a BSON object to be translated to KeyV1 format, as with KeyV1Owned */
+        KeyV2Owned(const BSONObj& obj) : _key(obj) {
+            _keyData = (const unsigned char *) _key.data();
+        }
+
+    private:
+        KeyV1Owned _key;
+    };
+
+    /** A key encoded so that its bytes sort, by memcmp, in the key's order under an Ordering:
+        for keys a and b normalized with the same Ordering o, a.compare( b ) has the sign of
+        a.toBson().woCompare( b.toBson(), o, false ).  Descending fields are written with their
+        bytes inverted, so comparing needs neither the Ordering nor any switching on types.
+
+        Not every key normalizes.  Regexes, dbrefs, code with scope and timestamps, which don't
+        compare as their bytes, and longs that a double can't hold exactly, which compare with
+        doubles as doubles, make normalize() fail; such keys keep to woCompare().
+
+        What the bytes leave out, whether a number was an int, a long or a double and a string
+        or a symbol, goes in separate type bits, so that toBson() gives the key back as it was
+        (but for the payload of a NaN) without the index's documents, as for a covered query.
+    */
+    class KeyNormalized {
+    public:
+        /** @return false, leaving this empty, if obj has something that can't be normalized */
+        bool normalize(const BSONObj& obj, const Ordering& o);
+
+        /** memcmp order; only meaningful for keys normalized with the same Ordering */
+        int compare(const KeyNormalized& r) const;
+
+        const char * data() const { return _bytes.data(); }
+        int dataSize() const { return (int) _bytes.size(); }
+        bool isEmpty() const { return _bytes.empty(); }
+
+        /** @return the key, with the "" field names of an index key.  o as normalized with */
+        BSONObj toBson(const Ordering& o) const;
+
+    private:
+        string _bytes;
+        string _typeBits; // one per number, string or symbol, in the order they are written
+    };
+
 };
@@ -19,10 +19,148 @@
 
 #include "mongo/pch.h"
 #include "lockstat.h"
+#include "mongo/db/client.h"
+#include "mongo/db/commands.h"
+#include "mongo/db/curop.h"
 #include "mongo/db/jsobj.h"
+#include "mongo/db/stats/counters.h"
+#include "mongo/util/concurrency/threadlocal.h"
+#include "mongo/util/histogram.h"
+#include "mongo/util/stacktrace.h"
+#include "mongo/util/trace_span.h"
 
 namespace mongo { 
 
+    bool LockStat::sampleHolders = false;
+
+    namespace {
+        // leaked, as exiting threads may still take locks during static destruction
+        Histogram** waitByOp() {
+            static Histogram** h = 0;
+            if ( h == 0 ) {
+                Histogram** n = new Histogram*[NOpKinds];
+                for ( int i = 0; i < NOpKinds; i++ )
+                    n[i] = newMicrosHistogram();
+                h = n;
+            }
+            return h;
+        }
+        // built before threads start, so the lazy init above doesn't race
+        Histogram** waitByOpInit = waitByOp();
+
+        // leaked for the same reason
+        ThreadLocalValue<unsigned long long>& threadWait() {
+            static ThreadLocalValue<unsigned long long> *t = new ThreadLocalValue<unsigned long long>();
+            return *t;
+        }
+        ThreadLocalValue<unsigned long long>& threadWaitInit = threadWait();
+
+        OpKind currentOpKind() {
+            Client *c = currentClient.get();
+            if ( c == 0 )
+                return OpOther;
+            CurOp *op = c->curop();
+            if ( op == 0 )
+                return OpOther;
+            return opKind( op->getOp(), op->getNS() );
+        }
+
+        /** the longest exclusive holds of the last Window seconds, with what held them */
+        class HolderSampler {
+        public:
+            enum { Keep = 10, WindowSecs = 60, MinMicros = 1000 };
+
+            HolderSampler() : _m( "lockHolderSampler" ) { }
+
+            void note( const string& lock, unsigned long long micros ) {
+                if ( micros < (unsigned long long) MinMicros )
+                    return;
+                time_t now = time( 0 );
+                {
+                    scoped_lock lk( _m );
+                    expire( now );
+                    if ( _samples.size() >= (size_t) Keep && micros <= _samples.back().micros )
+                        return;
+                }
+
+                // gathered outside the mutex; the stack walk is slow
+                Sample s;
+                s.when = now;
+                s.lock = lock;
+                s.micros = micros;
+                Client *c = currentClient.get();
+                if ( c && c->curop() )
+                    s.op = c->curop()->infoNoauth();
+                stringstream ss;
+                printStackTrace( ss );
+                s.stack = ss.str();
+
+                scoped_lock lk( _m );
+                list<Sample>::iterator i = _samples.begin();
+                while ( i != _samples.end() && i->micros >= micros )
+                    ++i;
+                _samples.insert( i, s );
+                if ( _samples.size() > (size_t) Keep )
+                    _samples.pop_back();
+            }
+
+            void report( BSONObjBuilder& b ) {
+                scoped_lock lk( _m );
+                expire( time( 0 ) );
+                BSONArrayBuilder a( b.subarrayStart( "holders" ) );
+                for ( list<Sample>::const_iterator i = _samples.begin(); i != _samples.end(); ++i ) {
+                    BSONObjBuilder s( a.subobjStart() );
+                    s.appendTimeT( "when", i->when );
+                    s.append( "lock", i->lock );
+                    s.appendNumber( "micros", (long long) i->micros );
+                    s.append( "op", i->op );
+                    s.append( "stack", i->stack );
+                    s.done();
+                }
+                a.done();
+            }
+
+        private:
+            struct Sample {
+                time_t when;
+                string lock;
+                unsigned long long micros;
+                BSONObj op;
+                string stack;
+            };
+
+            void expire( time_t now ) {
+                list<Sample>::iterator i = _samples.begin();
+                while ( i != _samples.end() ) {
+                    if ( now - i->when > WindowSecs )
+                        i = _samples.erase( i );
+                    else
+                        ++i;
+                }
+            }
+
+            mongo::mutex _m;
+            list<Sample> _samples; // longest first
+        };
+
+        HolderSampler& holderSampler() {
+            static HolderSampler *s = new HolderSampler();
+            return *s;
+        }
+        HolderSampler& holderSamplerInit = holderSampler();
+    }
+
+    LockStat::LockStat( const string& name ) : holdHistogram( newMicrosHistogram() ), _name( name ) {
+        for ( int i = 0; i < N; i++ )
+            waitHistogram[i] = newMicrosHistogram();
+    }
+
+    LockStat::~LockStat() {
+        for ( int i = 0; i < N; i++ )
+            delete waitHistogram[i];
+        delete holdHistogram;
+    }
+
     BSONObj LockStat::report() const { 
         BSONObjBuilder x;
         BSONObjBuilder y;
@@ -38,12 +176,36 @@ namespace mongo {
             y.append("r", timeAcquiring[2].load());
             y.append("w", timeAcquiring[3].load());
         }
+        BSONObjBuilder w;
+        static const char * const names[N] = { "R", "W", "r", "w" };
+        for ( int i = 0; i < N; i++ ) {
+            BSONObj h = histogramReport( *waitHistogram[i] );
+            if ( !h.isEmpty() )
+                w.append( names[i], h );
+        }
         return BSON(
             "timeLocked" << x.obj() << 
-            "timeAcquiring" << y.obj()
+            "timeAcquiring" << y.obj() <<
+            "waitMicros" << w.obj() <<
+            "holdMicros" << BSON( "W" << histogramReport( *holdHistogram ) )
         );
     }
 
+    void LockStat::reportByOp( BSONObjBuilder& b ) {
+        Histogram** h = waitByOp();
+        for ( int i = 0; i < NOpKinds; i++ )
+            b.append( opKindNames[i], histogramReport( *h[i] ) );
+    }
+
+    unsigned long long LockStat::threadWaitMicros() {
+        return threadWait().get();
+    }
+
+    void LockStat::reportLongestHolders( BSONObjBuilder& b ) {
+        b.append( "sampling", sampleHolders );
+        holderSampler().report( b );
+    }
+
     unsigned LockStat::mapNo(char type) {
         switch( type ) { 
         case 'R' : return 0;
@@ -59,21 +221,52 @@ namespace mongo {
     LockStat::Acquiring::Acquiring(LockStat& _ls, char t) : ls(_ls) { 
         type = mapNo(t);
         dassert( type < N );
+        ls.numWaiting[type].fetchAndAdd(1);
     }
 
     // note: we have race conditions on the following += 
     // hmmm....
 
     LockStat::Acquiring::~Acquiring() { 
-        ls.timeAcquiring[type].fetchAndAdd(static_cast<long long>(tmr.micros()));
+        unsigned long long micros = tmr.micros();
+        ls.numWaiting[type].fetchAndSubtract(1);
+        ls.timeAcquiring[type].fetchAndAdd(static_cast<long long>(micros));
+        ls.waitHistogram[type]->insert( microsBucketValue( micros ) );
+        waitByOp()[currentOpKind()]->insert( microsBucketValue( micros ) );
+        threadWait().getRef() += micros;
+        if ( TraceSpans::enabled ) {
+            unsigned long long now = curTimeMicros64();
+            TraceSpans::record( TraceSpans::Lock , now - micros , now );
+        }
         if( type == 1 ) 
             ls.W_Timer.reset();
     }
 
     void LockStat::unlocking(char tp) { 
         unsigned type = mapNo(tp);
-        if( type == 1 ) 
-            timeLocked[type].fetchAndAdd(static_cast<long long>(W_Timer.micros()));
+        if( type == 1 ) {
+            unsigned long long micros = W_Timer.micros();
+            timeLocked[type].fetchAndAdd(static_cast<long long>(micros));
+            holdHistogram->insert( microsBucketValue( micros ) );
+            if( sampleHolders )
+                holderSampler().note( _name, micros );
+        }
     }
 
+    class CmdLockHolders : public Command {
+    public:
+        CmdLockHolders() : Command( "lockHolders" ) {}
+        virtual bool slaveOk() const { return true; }
+        virtual bool adminOnly() const { return true; }
+        virtual void help( stringstream& help ) const {
+            help << "the longest exclusive lock holds of the last minute, with the operation and stack\n"
+                    "holding each. sampling must be on: { setParameter : 1, lockHolderSampling : true }";
+        }
+        virtual LockType locktype() const { return NONE; }
+        bool run(const string& dbname, BSONObj& jsobj, int, string& errmsg, BSONObjBuilder& result, bool fromRepl ) {
+            LockStat::reportLongestHolders( result );
+            return true;
+        }
+    } cmdLockHolders;
+
 }
@@ -19,16 +19,28 @@
 
 #pragma once
 
+#include <string>
+
 #include "util/timer.h"
 #include "mongo/platform/atomic_word.h"
 
 namespace mongo { 
 
     class BSONObj;
+    class BSONObjBuilder;
+    class Histogram;
 
+    /** times acquiring and holding one lock, in total and as histograms of microseconds.
+        exclusive holds also feed the lock holder sampler when setParameter lockHolderSampling
+        is on, which keeps the longest recent ones with the operation and stack that held them.
+    */
     class LockStat { 
         enum { N = 4 };
     public:
+        /** @param name of the lock, for the sampler: "." for the global lock, else the db */
+        explicit LockStat( const std::string& name = "." );
+        ~LockStat();
+
         Timer W_Timer;
 
         struct Acquiring {
@@ -41,12 +53,33 @@ namespace mongo {
 
         void unlocking(char type);
 
+        /** @return how many threads are in an Acquiring of type, i.e. queued for the lock */
+        int waiting(char type) const { return numWaiting[mapNo(type)].load(); }
+
         BSONObj report() const;
 
+        /** wait time histograms over all locks, by the type of operation waiting */
+        static void reportByOp( BSONObjBuilder& b );
+
+        /** microseconds this thread has spent waiting for locks, all told */
+        static unsigned long long threadWaitMicros();
+
+        /** the longest exclusive holds in the sampler's window, longest first */
+        static void reportLongestHolders( BSONObjBuilder& b );
+
+        static bool sampleHolders;
+
     private:
         // RWrw
         AtomicInt64 timeAcquiring[N];
         AtomicInt64 timeLocked[N];
+        AtomicInt32 numWaiting[N];
+
+        // counts may be lost to races, which is fine for a histogram
+        Histogram *waitHistogram[N];
+        Histogram *holdHistogram; // W only, as shared holds have no single timer
+
+        const std::string _name;
 
         static unsigned mapNo(char type);
     };
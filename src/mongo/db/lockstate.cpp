@@ -26,6 +26,8 @@
 
 namespace mongo {
 
+    bool WrapperForRWLock::bigReader = false;
+
     LockState::LockState() 
         : _batchWriter(false),
           _recursive(0),
@@ -34,6 +36,8 @@ namespace mongo {
           _nestableCount(0), 
           _otherCount(0), 
           _otherLock(NULL),
+          _collectionCount(0),
+          _collectionLock(NULL),
           _scopedLk(NULL)
     {
     }
@@ -50,13 +54,26 @@ namespace mongo {
         return _threadState == 'r' || _threadState == 'R';
     }
 
-    bool LockState::isLocked( const StringData& ns ) {
+    bool LockState::isLocked( const StringData& ns , bool write ) {
         char db[MaxDatabaseNameLen];
         nsToDatabase(ns.data(), db);
         
         DEV verify( _otherName.find( '.' ) == string::npos ); // XXX this shouldn't be here, but somewhere
-        if ( _otherCount && db == _otherName )
-            return true;
+        if ( _otherCount && db == _otherName ) {
+            if ( _collectionCount == 0 )
+                return true;
+
+            // the database is only intent locked.  we may use the database itself (its files and
+            // extent allocation have their own latch), our collection and its indexes, and read
+            // system collections, which are only written under the database's exclusive lock.
+            const size_t L = _collectionName.size();
+            if ( ns.size() == _otherName.size() )
+                return true;
+            if ( ns.size() >= L && _collectionName.compare( 0 , L , ns.data() , L ) == 0 &&
+                 ( ns.size() == L || ( ns.size() > L + 1 && ns.data()[L] == '.' && ns.data()[L+1] == '$' ) ) )
+                return true;
+            return !write && mongoutils::str::startsWith( ns.data() + _otherName.size() + 1 , "system." );
+        }
 
         if ( _nestableCount ) {
             if ( mongoutils::str::equals( db , "local" ) )
@@ -88,6 +105,14 @@ namespace mongo {
         return "?";
     }
 
+    static string intentKind(int n) { 
+        if( n > 0 )
+            return "w";
+        if( n < 0 ) 
+            return "r";
+        return "?";
+    }
+
     
     /** Note: this is is called by the currentOp command, which is a different 
               thread. So be careful about thread safety here. For example reading 
@@ -114,7 +139,15 @@ namespace mongo {
             if( k ) {
                 string s = ".";
                 s += k->name();
-                b.append(s, kind(_otherCount));
+                b.append(s, _collectionCount ? intentKind(_otherCount) : kind(_otherCount));
+            }
+        }
+        if( _collectionCount ) { 
+            WrapperForRWLock *k = _collectionLock;
+            if( k ) {
+                string s = ".";
+                s += k->name();
+                b.append(s, kind(_collectionCount));
             }
         }
         BSONObj o = b.obj();
@@ -141,6 +174,9 @@ namespace mongo {
             if( _otherCount ) {
                 ss << " otherdb:" << _otherName;
             }
+            if( _collectionCount ) {
+                ss << " collectionCount:" << _collectionCount << " collection:" << _collectionName;
+            }
             if( _nestableCount ) {
                 ss << " nestableCount:" << _nestableCount << " which:";
                 if( _whichNestable == Lock::local ) 
@@ -204,5 +240,18 @@ namespace mongo {
         _otherLock = 0;
     }
 
+    void LockState::lockedCollection( const string& ns , int type , WrapperForRWLock* lock ) {
+        fassert( 16347 , _collectionCount == 0 && _otherCount == type );
+        _collectionName = ns;
+        _collectionCount = type;
+        _collectionLock = lock;
+    }
+
+    void LockState::unlockedCollection() {
+        _collectionName = "";
+        _collectionCount = 0;
+        _collectionLock = 0;
+    }
+
 
 }
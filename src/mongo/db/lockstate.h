@@ -20,6 +20,8 @@
 #pragma once
 
 #include "mongo/db/d_concurrency.h"
+#include "mongo/util/concurrency/brlock.h"
+#include "mongo/util/concurrency/qlock.h"
 
 namespace mongo {
 
@@ -42,7 +44,7 @@ namespace mongo {
         bool isW() const; // W
         bool hasAnyReadLock() const; // explicitly rR
         
-        bool isLocked( const StringData& ns ); // rwRW
+        bool isLocked( const StringData& ns , bool write = false ); // rwRW
 
         // ----
 
@@ -71,6 +73,14 @@ namespace mongo {
         void lockedOther( const string& db , int type , WrapperForRWLock* lock );
         void lockedOther( int type );  // "same lock as last time" case 
         void unlockedOther();
+
+        /** with --collectionLocks: the collection held beneath an intent lock on the "other" db */
+        int collectionCount() const { return _collectionCount; }
+        string collectionName() const { return _collectionName; }
+        WrapperForRWLock* collectionLock() const { return _collectionLock; }
+        void lockedCollection( const string& ns , int type , WrapperForRWLock* lock );
+        void unlockedCollection();
+
         bool _batchWriter;
     private:
         unsigned _recursive;           // we allow recursively asking for a lock; we track that here
@@ -86,6 +96,12 @@ namespace mongo {
         string _otherName;             // which database are we locking and working with (besides local/admin) 
         WrapperForRWLock* _otherLock;  // so we don't have to check the map too often (the map has a mutex)
 
+        // collection level locking, only with --collectionLocks.  while set, _otherLock is held
+        // in intent mode and only this collection (and its indexes) is locked for real.
+        int _collectionCount;          // >0 means write lock, <0 read lock, 0 none held
+        string _collectionName;        // full ns of that collection
+        WrapperForRWLock* _collectionLock;
+
         // for temprelease
         // for the nonrecursive case. otherwise there would be many
         // the first lock goes here, which is ok since we can't yield recursive locks
@@ -93,16 +109,72 @@ namespace mongo {
         
     };
 
+    /** the database locks.  Uses a SimpleRWLock, or a BRLock with --dbLocks=bigreader, and
+        allocates only the one in use; nothing is locked before the option is parsed at startup.
+        With --collectionLocks a database's lock is a QLock instead, so it can also be held in the
+        intent modes (lock_intent*) beneath which its collections are locked.
+    */
     class WrapperForRWLock : boost::noncopyable { 
-        SimpleRWLock r;
+        const string _name;
+        scoped_ptr<SimpleRWLock> r;
+        scoped_ptr<BRLock> br;
+        scoped_ptr<QLock> q;
+        static bool bigReader;
     public:
-        string name() const { return r.name; }
+        string name() const { return _name; }
         LockStat stats;
-        WrapperForRWLock(const char *name) : r(name) { }
-        void lock()          { LockStat::Acquiring a(stats,'W'); r.lock();          }
-        void lock_shared()   { LockStat::Acquiring a(stats,'R'); r.lock_shared();   }
-        void unlock()        { stats.unlocking('W');             r.unlock();        }
-        void unlock_shared() { stats.unlocking('R');             r.unlock_shared(); }
+        WrapperForRWLock(const char *name, bool intents = false) : _name(name), stats(name) {
+            if( intents ) q.reset( new QLock() );
+            else if( bigReader ) br.reset( new BRLock() ); 
+            else r.reset( new SimpleRWLock(name) );
+        }
+
+        /** for --dbLocks=bigreader: locks made from now on, and the ones made before the
+            option was parsed, use a BRLock.  Nothing may hold or wait for a lock yet. */
+        static void useBigReader();
+
+        void lock() {
+            LockStat::Acquiring a(stats,'W');
+            if( q ) q->lock_W(); else if( br ) br->lock(); else r->lock();
+        }
+        void lock_shared() {
+            LockStat::Acquiring a(stats,'R');
+            if( q ) q->lock_R(); else if( br ) br->lock_shared(); else r->lock_shared();
+        }
+        void unlock() {
+            stats.unlocking('W');
+            if( q ) q->unlock_W(); else if( br ) br->unlock(); else r->unlock();
+        }
+        void unlock_shared() {
+            stats.unlocking('R');
+            if( q ) q->unlock_R(); else if( br ) br->unlock_shared(); else r->unlock_shared();
+        }
+
+        bool hasIntents() const { return q.get() != 0; }
+        void lock_intent() {
+            LockStat::Acquiring a(stats,'w');
+            q->lock_w();
+        }
+        void lock_intent_shared() {
+            LockStat::Acquiring a(stats,'r');
+            q->lock_r();
+        }
+        void unlock_intent() {
+            stats.unlocking('w');
+            q->unlock_w();
+        }
+        void unlock_intent_shared() {
+            stats.unlocking('r');
+            q->unlock_r();
+        }
+
+    private:
+        void switchToBigReader() {
+            if( q )
+                return;
+            r.reset();
+            br.reset( new BRLock() );
+        }
     };
 
 
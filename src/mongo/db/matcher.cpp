@@ -145,8 +145,23 @@ namespace mongo {
         _where = 0;
     }
 
+    static bool isTopLevelCompare( const BSONElement &e, int op ) {
+        switch( op ) {
+        case BSONObj::Equality:
+        case BSONObj::LT:
+        case BSONObj::LTE:
+        case BSONObj::GT:
+        case BSONObj::GTE:
+        case BSONObj::opIN:
+            return strchr( e.fieldName(), '.' ) == 0;
+        default:
+            return false;
+        }
+    }
+
     ElementMatcher::ElementMatcher( BSONElement e , int op, bool isNot )
-        : _toMatch( e ) , _compareOp( op ), _isNot( isNot ), _subMatcherOnPrimitives(false) {
+        : _toMatch( e ) , _compareOp( op ), _isNot( isNot ), _subMatcherOnPrimitives(false),
+          _topLevel( isTopLevelCompare( e, op ) ) {
         if ( op == BSONObj::opMOD ) {
             BSONObj o = e.embeddedObject();
             _mod = o["0"].numberInt();
@@ -174,9 +189,10 @@ namespace mongo {
     }
 
     ElementMatcher::ElementMatcher( BSONElement e , int op , const BSONObj& array, bool isNot )
-        : _toMatch( e ) , _compareOp( op ), _isNot( isNot ), _subMatcherOnPrimitives(false) {
+        : _toMatch( e ) , _compareOp( op ), _isNot( isNot ), _subMatcherOnPrimitives(false),
+          _topLevel( isTopLevelCompare( e, op ) ) {
 
-        _myset.reset( new set<BSONElement,element_lt>() );
+        _myset.reset( new ElementSet() );
 
         BSONObjIterator i( array );
         while ( i.more() ) {
@@ -209,6 +225,7 @@ namespace mongo {
                 _myset->insert(ie);
             }
         }
+        _myset->done();
 
         if ( _allMatchers.size() ) {
             uassert( 13020 , "with $all, can't mix $elemMatch and others" , _myset->size() == 0 && !_myregex.get());
@@ -549,7 +566,7 @@ namespace mongo {
                     break;
                 case BSONObj::opIN: {
                     bool inContainsArray = false;
-                    for( set<BSONElement,element_lt>::const_iterator j = i->_myset->begin(); j != i->_myset->end(); ++j ) {
+                    for( ElementSet::const_iterator j = i->_myset->begin(); j != i->_myset->end(); ++j ) {
                         if ( j->type() == Array ) {
                             inContainsArray = true;
                             break;
@@ -729,7 +746,7 @@ namespace mongo {
             BSONElementSet myValues;
             obj.getFieldsDotted( fieldName , myValues );
 
-            for( set< BSONElement, element_lt >::const_iterator i = em._myset->begin(); i != em._myset->end(); ++i ) {
+            for( ElementSet::const_iterator i = em._myset->begin(); i != em._myset->end(); ++i ) {
                 // ignore nulls
                 if ( i->type() == jstNULL )
                     continue;
@@ -890,6 +907,19 @@ namespace mongo {
         return -1;
     }
 
+    /* Same result as matchesDotted() for a comparison on a top level field, without the
+       field name parsing and recursion.  Arrays still go through matchesDotted().
+    */
+    inline int Matcher::matchesTopLevel(const BSONObj& obj, const ElementMatcher& bm, MatchDetails * details) const {
+        const BSONElement& m = bm._toMatch;
+        BSONElement e = obj.getField( m.fieldName() );
+        if ( e.type() == Array )
+            return matchesDotted( m.fieldName(), m, obj, bm._compareOp, bm, false, details );
+        if ( valuesMatch( e, m, bm._compareOp, bm ) )
+            return 1;
+        return e.eoo() ? 0 : -1;
+    }
+
     extern int dump;
 
     /* See if an object matches the query.
@@ -907,11 +937,14 @@ namespace mongo {
            could be slow sometimes. */
 
         // check normal non-regex cases:
+        const bool indexed = !_constrainIndexKey.isEmpty();
         for ( unsigned i = 0; i < _basics.size(); i++ ) {
             const ElementMatcher& bm = _basics[i];
             const BSONElement& m = bm._toMatch;
             // -1=mismatch. 0=missing element. 1=match
-            int cmp = matchesDotted(m.fieldName(), m, jsobj, bm._compareOp, bm , false , details );
+            int cmp = ( bm._topLevel && !indexed ) ?
+                matchesTopLevel( jsobj, bm, details ) :
+                matchesDotted(m.fieldName(), m, jsobj, bm._compareOp, bm , false , details );
             if ( cmp == 0 && bm._compareOp == BSONObj::opEXISTS ) {
                 // If missing, match cmp is opposite of $exists spec.
                 cmp = -retExistsFound(bm);
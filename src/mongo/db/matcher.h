@@ -51,6 +51,41 @@ namespace mongo {
         }
     };
 
+    /**
+     * The values of an $in, $nin or $all, kept sorted in a vector rather than a tree so that
+     * checking a document against a list of thousands of values is a binary search over
+     * contiguous elements.
+     */
+    class ElementSet {
+    public:
+        typedef vector<BSONElement>::const_iterator const_iterator;
+
+        /** Values may be inserted in any order, but done() must be called before lookups. */
+        void insert( const BSONElement &e ) { _elements.push_back( e ); }
+
+        /** Sorts the values and drops duplicates, keeping the first inserted of equal values. */
+        void done() {
+            stable_sort( _elements.begin(), _elements.end(), element_lt() );
+            _elements.erase( unique( _elements.begin(), _elements.end(), equal ),
+                             _elements.end() );
+        }
+
+        int count( const BSONElement &e ) const {
+            return binary_search( _elements.begin(), _elements.end(), e, element_lt() ) ? 1 : 0;
+        }
+
+        size_t size() const { return _elements.size(); }
+        const_iterator begin() const { return _elements.begin(); }
+        const_iterator end() const { return _elements.end(); }
+
+    private:
+        static bool equal( const BSONElement &l, const BSONElement &r ) {
+            return !element_lt()( l, r ) && !element_lt()( r, l );
+        }
+
+        vector<BSONElement> _elements;
+    };
+
     /**
      * An interface for visiting a Matcher and all of its nested Matchers and ElementMatchers.
      * RegexMatchers are not visited.
@@ -65,7 +100,7 @@ namespace mongo {
     class ElementMatcher {
     public:
 
-        ElementMatcher() {
+        ElementMatcher() : _topLevel() {
         }
 
         ElementMatcher( BSONElement e , int op, bool isNot );
@@ -83,7 +118,7 @@ namespace mongo {
         BSONElement _toMatch;
         int _compareOp;
         bool _isNot;
-        shared_ptr< set<BSONElement,element_lt> > _myset;
+        shared_ptr< ElementSet > _myset;
         shared_ptr< vector<RegexMatcher> > _myregex;
 
         // these are for specific operators
@@ -95,6 +130,10 @@ namespace mongo {
         bool _subMatcherOnPrimitives ;
 
         vector< shared_ptr<Matcher> > _allMatchers;
+
+        // set for a plain comparison on a field without a '.', which a document can be
+        // checked against with a single getField() when the field isn't an array
+        bool _topLevel;
     };
 
     class Where; // used for $where javascript eval
@@ -243,6 +282,9 @@ namespace mongo {
 
         int valuesMatch(const BSONElement& l, const BSONElement& r, int op, const ElementMatcher& bm) const;
 
+        /** matchesDotted() for an ElementMatcher with _topLevel set. */
+        int matchesTopLevel(const BSONObj& obj, const ElementMatcher& bm, MatchDetails * details) const;
+
         bool parseClause( const BSONElement &e );
         void parseExtractedClause( const BSONElement &e, list< shared_ptr< Matcher > > &matchers );
 
@@ -35,9 +35,100 @@ using namespace mongoutils;
 
 namespace mongo {
 
+    static const size_t RemapChunkSize = 64 * 1024;
+
+    void MongoMMF::noteDirty(size_t ofs, unsigned len) {
+        if( len == 0 )
+            return;
+        if( _dirtyChunks.empty() ) {
+            _dirtyChunks.resize( (length() + RemapChunkSize - 1) / RemapChunkSize );
+        }
+        size_t last = min( (ofs + len - 1) / RemapChunkSize, _dirtyChunks.size() - 1 );
+        for( size_t i = ofs / RemapChunkSize; i <= last; i++ ) {
+            if( !_dirtyChunks[i] ) {
+                _dirtyChunks[i] = true;
+                _nDirtyChunks++;
+            }
+        }
+    }
+
+    void MongoMMF::clearDirty() {
+        if( _nDirtyChunks ) {
+            _dirtyChunks.assign(_dirtyChunks.size(), false);
+            _nDirtyChunks = 0;
+        }
+    }
+
+#if !defined(_WIN32)
+    /** remap each run of dirty chunks with one mmap call */
+    void MongoMMF::remapDirtyChunks() {
+        const size_t n = _dirtyChunks.size();
+        size_t i = 0;
+        while( i < n ) {
+            if( !_dirtyChunks[i] ) {
+                i++;
+                continue;
+            }
+            size_t j = i + 1;
+            while( j < n && _dirtyChunks[j] )
+                j++;
+            size_t ofs = i * RemapChunkSize;
+            size_t end = (size_t) min( (unsigned long long) j * RemapChunkSize, length() );
+            remapPrivateViewRange(_view_private, ofs, end - ofs);
+            i = j;
+        }
+        clearDirty();
+    }
+#endif
+
+    static const size_t FlushChunkSize = 1024 * 1024;
+
+    void MongoMMF::noteWritten(size_t ofs, unsigned len) {
+        if( len == 0 )
+            return;
+        SimpleMutex::scoped_lock lk(_writtenMutex);
+        if( _writtenChunks.empty() ) {
+            _writtenChunks.resize( (length() + FlushChunkSize - 1) / FlushChunkSize );
+        }
+        size_t last = min( (ofs + len - 1) / FlushChunkSize, _writtenChunks.size() - 1 );
+        for( size_t i = ofs / FlushChunkSize; i <= last; i++ )
+            _writtenChunks[i] = true;
+    }
+
+    unsigned long long MongoMMF::takeWrittenRanges(vector< pair<char*, size_t> >& ranges) {
+        SimpleMutex::scoped_lock lk(_writtenMutex);
+        unsigned long long total = 0;
+        const size_t n = _writtenChunks.size();
+        size_t i = 0;
+        while( i < n ) {
+            if( !_writtenChunks[i] ) {
+                i++;
+                continue;
+            }
+            size_t j = i;
+            while( j < n && _writtenChunks[j] )
+                _writtenChunks[j++] = false;
+            size_t ofs = i * FlushChunkSize;
+            size_t end = (size_t) min( (unsigned long long) j * FlushChunkSize, length() );
+            ranges.push_back( make_pair( ((char *) _view_write) + ofs, end - ofs ) );
+            total += end - ofs;
+            i = j;
+        }
+        return total;
+    }
+
     void MongoMMF::remapThePrivateView() {
         verify( cmdLine.dur );
 
+#if !defined(_WIN32)
+        // if only part of the file was written, reset just those chunks.  remapping the whole
+        // view would also drop the clean pages we have mapped, and they would fault back in.
+        if( _nDirtyChunks && _nDirtyChunks <= _dirtyChunks.size() / 2 ) {
+            remapDirtyChunks();
+            return;
+        }
+#endif
+
         // todo 1.9 : it turns out we require that we always remap to the same address.
         // so the remove / add isn't necessary and can be removed?
         void *old = _view_private;
@@ -45,6 +136,7 @@ namespace mongo {
         _view_private = remapPrivateView(_view_private);
         //privateViews.add(_view_private, this);
         fassert( 16112, _view_private == old );
+        clearDirty();
     }
 
     /** register view. threadsafe */
@@ -201,7 +293,7 @@ namespace mongo {
         return false;
     }
 
-    MongoMMF::MongoMMF() : _willNeedRemap(false) {
+    MongoMMF::MongoMMF() : _willNeedRemap(false), _nDirtyChunks(0), _writtenMutex("mmfWritten") {
         _view_write = _view_private = 0;
     }
 
@@ -19,6 +19,7 @@
 
 #include "../util/mmap.h"
 #include "../util/paths.h"
+#include "../util/concurrency/mutex.h"
 
 namespace mongo {
 
@@ -89,8 +90,26 @@ namespace mongo {
         */
         bool& willNeedRemap() { return _willNeedRemap; }
 
+        /** note that [ofs, ofs+len) of the private view has been written.
+            set in PREPLOGBUFFER along with willNeedRemap(), so that REMAPPRIVATEVIEW only
+            has to reset the chunks that were touched.
+        */
+        void noteDirty(size_t ofs, unsigned len);
+
         void remapThePrivateView();
 
+        /** note that [ofs, ofs+len) of the write view was written, for the throttled data file
+            flusher.  set in WRITETODATAFILES.  threadsafe
+        */
+        void noteWritten(size_t ofs, unsigned len);
+
+        /** take the ranges of the write view written since the last time, so they can be flushed.
+            threadsafe
+            @param ranges appended to, as a pointer into the write view and a length
+            @return total length of the ranges taken
+        */
+        unsigned long long takeWrittenRanges(vector< pair<char*, size_t> >& ranges);
+
         virtual bool isMongoMMF() { return true; }
 
     private:
@@ -98,11 +117,22 @@ namespace mongo {
         void *_view_write;
         void *_view_private;
         bool _willNeedRemap;
+        /** one bit per RemapChunkSize bytes of the view, set for chunks written since the last remap */
+        vector<bool> _dirtyChunks;
+        unsigned _nDirtyChunks;
+        /** one bit per FlushChunkSize bytes of the write view, set for chunks written since they were
+            last taken by takeWrittenRanges() */
+        SimpleMutex _writtenMutex;
+        vector<bool> _writtenChunks;
         RelativePath _p;   // e.g. "somepath/dbname"
         int _fileSuffixNo;  // e.g. 3.  -1="ns"
 
         void setPath(string pathAndFileName);
         bool finishOpening();
+        void clearDirty();
+#if !defined(_WIN32)
+        void remapDirtyChunks();
+#endif
     };
 
     /** for durability support we want to be able to map pointers to specific MongoMMF objects.
@@ -0,0 +1,107 @@
+// namespace_cache.h
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+
+#include "mongo/bson/util/atomic_int.h"
+
+namespace mongo {
+
+    class NamespaceDetails;
+    class NamespaceDetailsTransient;
+    class NamespaceIndex;
+
+    /* The last few namespaces a Client looked up, so an op asking for its collection's
+       NamespaceDetails and NamespaceDetailsTransient over and over doesn't hash the name in the
+       namespace index, or look it up in the transient map under _qcMutex, each time.
+
+       An entry is only good in the epoch it was filled in.  The epoch moves on whenever a cached
+       pointer could go stale: a namespace added or dropped, transients cleared, a database closed.
+       Those are all done in a write lock, so while a Client holds its lock, what it found stays
+       good.
+    */
+    class NamespaceCache {
+    public:
+        enum { Size = 4 };
+
+        NamespaceCache() : _next(0) {}
+
+        /** @return the cached NamespaceDetails of ns in ni, or 0 if there's none */
+        NamespaceDetails* details( const NamespaceIndex *ni , const char *ns ) {
+            Entry *e = find( ns );
+            return e && e->ni == ni ? e->d : 0;
+        }
+        void noteDetails( NamespaceIndex *ni , const char *ns , NamespaceDetails *d ) {
+            Entry& e = entry( ns );
+            e.ni = ni;
+            e.d = d;
+        }
+
+        /** @return the cached NamespaceDetailsTransient of ns, or 0 if there's none */
+        NamespaceDetailsTransient* transient( const char *ns ) {
+            Entry *e = find( ns );
+            return e ? e->t : 0;
+        }
+        void noteTransient( const char *ns , NamespaceDetailsTransient *t ) {
+            entry( ns ).t = t;
+        }
+
+        /** what every Client has cached is no longer good */
+        static void invalidate() { _epoch++; }
+
+    private:
+        struct Entry {
+            Entry() : epoch(0), ni(0), d(0), t(0) {}
+            unsigned epoch;
+            std::string ns;
+            NamespaceIndex *ni;
+            NamespaceDetails *d;
+            NamespaceDetailsTransient *t;
+        };
+
+        Entry* find( const char *ns ) {
+            unsigned epoch = _epoch.get();
+            for ( int i = 0; i < Size; i++ ) {
+                if ( _entries[i].epoch == epoch && _entries[i].ns == ns )
+                    return &_entries[i];
+            }
+            return 0;
+        }
+
+        /** @return ns' entry, a cleared one in place of the least recently made if there isn't one */
+        Entry& entry( const char *ns ) {
+            Entry *e = find( ns );
+            if ( e )
+                return *e;
+            e = &_entries[_next];
+            _next = ( _next + 1 ) % Size;
+            *e = Entry();
+            e->epoch = _epoch.get();
+            e->ns = ns;
+            return *e;
+        }
+
+        // starts at 1, so an unused entry, epoch 0, is never good
+        static AtomicUInt _epoch;
+        Entry _entries[Size];
+        int _next;
+    };
+
+} // namespace mongo
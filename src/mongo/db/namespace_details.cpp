@@ -30,6 +30,7 @@
 #include "mongo/db/ops/delete.h"
 #include "mongo/db/ops/update.h"
 #include "mongo/db/pdfile.h"
+#include "mongo/db/stats/namespace_io.h"
 #include "mongo/scripting/engine.h"
 #include "mongo/util/hashtab.h"
 
@@ -85,6 +86,19 @@ namespace mongo {
         return ret;
     }
 
+    boost::filesystem::path NamespaceIndex::_morePath( int i ) const {
+        stringstream ss;
+        ss << path().string() << '.' << i;
+        return boost::filesystem::path( ss.str() );
+    }
+
+    unsigned long long NamespaceIndex::fileLength() const {
+        unsigned long long len = f.length();
+        for ( unsigned i = 0; i < _more.size(); i++ )
+            len += _more[i].f->length();
+        return len;
+    }
+
     void NamespaceIndex::maybeMkdir() const {
         if ( !directoryperdb )
             return;
@@ -197,6 +211,100 @@ namespace mongo {
         ht = new HashTable<Namespace,NamespaceDetails>(p, (int) len, "namespace index");
         if( checkNsFilesOnLoad )
             ht->iterAll(namespaceOnLoadCallback);
+        ht->iterAll( _cacheCallback , this );
+
+        for ( int i = 1; boost::filesystem::exists( _morePath( i ) ); i++ )
+            _openMore( i , 0 );
+    }
+
+    void NamespaceIndex::_cacheCallback( const Namespace& k , NamespaceDetails& v , void *extra ) {
+        ((NamespaceIndex *) extra)->_cache[k] = &v;
+    }
+
+    void NamespaceIndex::_openMore( int i , unsigned long long len ) {
+        verify( i == (int) _more.size() + 1 );
+        MoreTable t;
+        t.f.reset( new MongoMMF() );
+        string pathString = _morePath( i ).string();
+        void *p = 0;
+        bool created = len != 0;
+        if ( !created ) {
+            if ( t.f->open( pathString , true ) ) {
+                len = t.f->length();
+                uassert( 16419 , str::stream() << "bad .ns file length " << pathString , len % (1024*1024) == 0 );
+                p = t.f->getView();
+            }
+        }
+        else if ( t.f->create( pathString , len , true ) ) {
+            getDur().createdFile( pathString , len ); // always a new file
+            p = t.f->getView();
+        }
+        uassert( 16420 , str::stream() << "couldn't open " << pathString , p );
+
+        verify( len <= 0x7fffffff );
+        t.ht.reset( new Table( p , (int) len , "namespace index" ) );
+        _more.push_back( t );
+        if ( !created && checkNsFilesOnLoad )
+            t.ht->iterAll( namespaceOnLoadCallback );
+        t.ht->iterAll( _cacheCallback , this );
+    }
+
+    NamespaceIndex::Table* NamespaceIndex::_tableOf( const NamespaceDetails *d ) {
+        const char *p = (const char *) d;
+        for ( int i = -1; i < (int) _more.size(); i++ ) {
+            Table *t = i < 0 ? ht : _more[i].ht.get();
+            const char *buf = (const char *) t->_buf;
+            if ( p >= buf && p < buf + t->n * sizeof(Table::Node) )
+                return t;
+        }
+        verify( false );
+        return 0;
+    }
+
+    NamespaceDetails* NamespaceIndex::_put( const Namespace& n , const NamespaceDetails &details , Table *in ) {
+        // already there, update it where it is
+        Cache::const_iterator i = _cache.find( n );
+        if ( i != _cache.end() )
+            in = _tableOf( i->second );
+
+        Table *t = in;
+        if ( in ) {
+            if ( !in->put( n , details ) )
+                return 0;
+        }
+        else {
+            // the first table with room, so space from drops in the older ones is used again
+            t = ht;
+            unsigned j = 0;
+            while ( !t->put( n , details ) ) {
+                if ( j == _more.size() ) {
+                    unsigned long long len = j == 0 ? f.length() : _more.back().f->length();
+                    len = min( 2 * len , 0x7ff00000ULL ); // a whole number of MB under 2GB
+                    log() << "namespace index for " << database_ << " is full, growing into "
+                          << _morePath( j + 1 ).string() << ' ' << len / 1024 / 1024 << "MB" << endl;
+                    _openMore( j + 1 , len );
+                    t = _more[j].ht.get();
+                    uassert( 10081 , "too many namespaces/collections" , t->put( n , details ) );
+                    break;
+                }
+                t = _more[j++].ht.get();
+            }
+        }
+
+        NamespaceDetails *d = t->get( n );
+        verify( d );
+        _cache[n] = d;
+        NamespaceCache::invalidate();
+        return d;
+    }
+
+    void NamespaceIndex::_kill( const Namespace& n ) {
+        Cache::iterator i = _cache.find( n );
+        if ( i == _cache.end() )
+            return;
+        _tableOf( i->second )->kill( n );
+        _cache.erase( i );
+        NamespaceCache::invalidate();
     }
 
     static void namespaceGetNamespacesCallback( const Namespace& k , NamespaceDetails& v , void * extra ) {
@@ -208,8 +316,11 @@ namespace mongo {
         verify( onlyCollections ); // TODO: need to implement this
         //                                  need boost::bind or something to make this less ugly
 
-        if ( ht )
-            ht->iterAll( namespaceGetNamespacesCallback , (void*)&tofill );
+        if ( !ht )
+            return;
+        ht->iterAll( namespaceGetNamespacesCallback , (void*)&tofill );
+        for ( unsigned i = 0; i < _more.size(); i++ )
+            _more[i].ht->iterAll( namespaceGetNamespacesCallback , (void*)&tofill );
     }
 
     void NamespaceDetails::addDeletedRec(DeletedRecord *d, DiskLoc dloc) {
@@ -318,15 +429,23 @@ namespace mongo {
        @param peekOnly just look up where and don't reserve
        returned item is out of the deleted list upon return
     */
+    /** how far __stdAlloc() searches the last bucket for a fit */
+    static const int MaxLastBucketChain = 1000;
+
     DiskLoc NamespaceDetails::__stdAlloc(int len, bool peekOnly) {
         DiskLoc *prev;
         DiskLoc *bestprev = 0;
         DiskLoc bestmatch;
-        int bestmatchlen = 0x7fffffff;
+        int bestmatchlen = 0x7fffffff; // of bestmatch, less the allowance below if it is in lastExtent
         int b = bucket(len);
         DiskLoc cur = deletedList[b];
         prev = &deletedList[b];
-        int extra = 5; // look for a better fit, a little.
+        // look for a better fit, a little.  with power of 2 sizes anything that fits is in the right
+        // size class already, so we take the first one.
+        int extra = isUserFlagSet( Flag_UsePowerOf2Sizes ) ? 1 : 5;
+        // we'd rather take a record in the last extent, where inserts are going now, so that records
+        // land near their neighbours; but not when it is much bigger than a fit elsewhere.
+        const int lastExtentAllowance = len >> 3;
         int chain = 0;
         while ( 1 ) {
             {
@@ -354,11 +473,15 @@ namespace mongo {
                 continue;
             }
             DeletedRecord *r = cur.drec();
-            if ( r->lengthWithHeaders() >= len &&
-                 r->lengthWithHeaders() < bestmatchlen ) {
-                bestmatchlen = r->lengthWithHeaders();
-                bestmatch = cur;
-                bestprev = prev;
+            if ( r->lengthWithHeaders() >= len ) {
+                int l = r->lengthWithHeaders();
+                if ( DiskLoc(cur.a(), r->extentOfs()) == lastExtent )
+                    l -= lastExtentAllowance;
+                if ( l < bestmatchlen ) {
+                    bestmatchlen = l;
+                    bestmatch = cur;
+                    bestprev = prev;
+                }
             }
             if ( bestmatchlen < 0x7fffffff && --extra <= 0 )
                 break;
@@ -368,6 +491,12 @@ namespace mongo {
                 chain = 0;
                 cur.Null();
             }
+            else if ( chain > MaxLastBucketChain && bestmatchlen == 0x7fffffff ) {
+                // there is no bigger bucket to move to.  rather than walk all of a long chain of
+                // small records here, get a new extent.
+                log(1) << "alloc: gave up after " << chain << " deleted records in the last bucket" << endl;
+                return DiskLoc();
+            }
             else {
                 /*this defensive check only made sense for the mmap storage engine:
                   if ( r->nextDeleted.getOfs() == 0 ) {
@@ -455,15 +584,16 @@ namespace mongo {
 
     void NamespaceIndex::kill_ns(const char *ns) {
         Lock::assertWriteLocked(ns);
+        Lock::forgetCollectionLock(ns);
         if ( !ht )
             return;
         Namespace n(ns);
-        ht->kill(n);
+        _kill(n);
 
         for( int i = 0; i<=1; i++ ) {
             try {
                 Namespace extra(n.extraName(i).c_str());
-                ht->kill(extra);
+                _kill(extra);
             }
             catch(DBException&) { 
                 dlog(3) << "caught exception in kill_ns" << endl;
@@ -479,7 +609,7 @@ namespace mongo {
         Lock::assertWriteLocked(ns);
         init();
         Namespace n(ns);
-        uassert( 10081 , "too many namespaces/collections", ht->put(n, details));
+        _put(n, details, 0);
     }
 
     /* extra space for indexes when more than 10 */
@@ -490,13 +620,14 @@ namespace mongo {
         Namespace extra(n.extraName(i).c_str()); // throws userexception if ns name too long
 
         massert( 10350 ,  "allocExtra: base ns missing?", d );
-        massert( 10351 ,  "allocExtra: extra already exists", ht->get(extra) == 0 );
+        massert( 10351 ,  "allocExtra: extra already exists", _cache.count(extra) == 0 );
 
         NamespaceDetails::Extra temp;
         temp.init();
-        uassert( 10082 ,  "allocExtra: too many namespaces/collections", ht->put(extra, (NamespaceDetails&) temp));
-        NamespaceDetails::Extra *e = (NamespaceDetails::Extra *) ht->get(extra);
-        return e;
+        // in d's own table, as d finds it by offset
+        NamespaceDetails *e = _put(extra, (NamespaceDetails&) temp, _tableOf(d));
+        uassert( 10082 ,  "allocExtra: too many namespaces/collections", e);
+        return (NamespaceDetails::Extra *) e;
     }
     NamespaceDetails::Extra* NamespaceDetails::allocExtra(const char *ns, int nindexessofar) {
         NamespaceIndex *ni = nsindex(ns);
@@ -615,6 +746,8 @@ namespace mongo {
 
     /* ------------------------------------------------------------------------- */
 
+    AtomicUInt NamespaceCache::_epoch(1);
+
     SimpleMutex NamespaceDetailsTransient::_qcMutex("qc");
     SimpleMutex NamespaceDetailsTransient::_isMutex("is");
     map< string, shared_ptr< NamespaceDetailsTransient > > NamespaceDetailsTransient::_nsdMap;
@@ -627,6 +760,18 @@ namespace mongo {
         _indexSpecs.clear();
     }
 
+    NamespaceDetailsTransient& NamespaceDetailsTransient::get(const char *ns) {
+        Client *c = currentClient.get();
+        NamespaceDetailsTransient *t = c ? c->nsCache().transient(ns) : 0;
+        if ( t )
+            return *t;
+        SimpleMutex::scoped_lock lk(_qcMutex);
+        NamespaceDetailsTransient& nsdt = get_inlock(ns);
+        if ( c )
+            c->nsCache().noteTransient(ns, &nsdt);
+        return nsdt;
+    }
+
     /*static*/ NOINLINE_DECL NamespaceDetailsTransient& NamespaceDetailsTransient::make_inlock(const char *ns) {
         shared_ptr< NamespaceDetailsTransient > &t = _nsdMap[ ns ];
         verify( t.get() == 0 );
@@ -653,6 +798,20 @@ namespace mongo {
     NamespaceDetailsTransient::~NamespaceDetailsTransient() { 
     }
 
+    shared_ptr<CappedInsertNotifier> NamespaceDetailsTransient::cappedInsertNotifier( const char *ns ) {
+        SimpleMutex::scoped_lock lk(_qcMutex);
+        shared_ptr<CappedInsertNotifier> &n = get_inlock(ns)._cappedInsertNotifier;
+        if ( !n )
+            n.reset( new CappedInsertNotifier() );
+        return n;
+    }
+
+    void NamespaceDetailsTransient::notifyCappedInsert() {
+        // only made under a read lock, so this can't race with it
+        if ( _cappedInsertNotifier )
+            _cappedInsertNotifier->notifyAll();
+    }
+
     void NamespaceDetailsTransient::clearForPrefix(const char *prefix) {
         SimpleMutex::scoped_lock lk(_qcMutex);
         vector< string > found;
@@ -665,9 +824,11 @@ namespace mongo {
         for( vector< string >::iterator i = found.begin(); i != found.end(); ++i ) {
             _nsdMap[ *i ].reset();
         }
+        NamespaceCache::invalidate();
     }
 
     void NamespaceDetailsTransient::eraseForPrefix(const char *prefix) {
+        NamespaceIO::forget( prefix );
         SimpleMutex::scoped_lock lk(_qcMutex);
         vector< string > found;
         for( ouriter i = _nsdMap.begin(); i != _nsdMap.end(); ++i ) {
@@ -679,16 +840,22 @@ namespace mongo {
         for( vector< string >::iterator i = found.begin(); i != found.end(); ++i ) {
             _nsdMap.erase(*i);
         }
+        NamespaceCache::invalidate();
     }
 
     void NamespaceDetailsTransient::computeIndexKeys() {
         _indexKeys.clear();
+        _indexKeysByIndex.clear();
         NamespaceDetails *d = nsdetails(_ns.c_str());
         if ( ! d )
             return;
         NamespaceDetails::IndexIterator i = d->ii();
-        while( i.more() )
-            i.next().keyPattern().getFieldNames(_indexKeys);
+        while( i.more() ) {
+            BSONObj keyPattern = i.next().keyPattern();
+            keyPattern.getFieldNames(_indexKeys);
+            _indexKeysByIndex.push_back( set<string>() );
+            keyPattern.getFieldNames(_indexKeysByIndex.back());
+        }
         _keysComputed = true;
     }
 
@@ -744,7 +911,7 @@ namespace mongo {
 
 
 
-    int NamespaceDetails::getRecordAllocationSize( int minRecordSize ) {
+    int NamespaceDetails::getRecordAllocationSize( int minRecordSize, const RecordGrowth *growth ) {
         if ( _paddingFactor == 0 ) {
             warning() << "implicit updgrade of paddingFactor of very old collection" << endl;
             setPaddingFactor(1.0);
@@ -758,11 +925,97 @@ namespace mongo {
             return x;
         }
 
+        if ( growth && !isCapped() )
+            return static_cast<int>(minRecordSize * growth->padding( minRecordSize, _paddingFactor ));
+
         return static_cast<int>(minRecordSize * _paddingFactor);
     }
 
     /* ------------------------------------------------------------------------- */
 
+    RecordGrowth::RecordGrowth() : _updates(0), _moves(0), _keysRewritten(0) {
+    }
+
+    void RecordGrowth::noteUpdate( NamespaceDetails *d, int oldSize, int newSize,
+                                   bool moved, int keysRewritten ) {
+        _updates++;
+        if ( moved ) {
+            _moves++;
+            _keysRewritten += keysRewritten;
+        }
+
+        SizeClass& c = _classes[ NamespaceDetails::bucket( oldSize + Record::HeaderSize ) ];
+        c.total++;
+        if ( newSize > oldSize ) {
+            if ( !c.growth ) {
+                Histogram::Options opts;
+                opts.numBuckets = MaxPaddingPercent / GrowthBucketPercent + 1; // last is over the max
+                opts.bucketSize = GrowthBucketPercent;
+                opts.initialValue = 0;
+                c.growth.reset( new Histogram( opts ) );
+            }
+            long long growth = newSize - oldSize;
+            c.growth->insert( static_cast<uint32_t>( ( growth * 100 + oldSize - 1 ) / oldSize ) );
+        }
+        if ( ++c.updates < WindowSize )
+            return;
+
+        // half way to the new padding, so one odd window doesn't swing it all the way
+        double p = endWindow( c );
+        c.padding = c.padding == 0 ? p : ( c.padding + p ) / 2;
+
+        double sum = 0;
+        long long n = 0;
+        for ( int i = 0; i < Buckets; i++ ) {
+            if ( _classes[i].padding == 0 )
+                continue;
+            sum += _classes[i].padding * _classes[i].total;
+            n += _classes[i].total;
+        }
+        double pf = sum / n;
+        if ( fabs( pf - d->paddingFactor() ) >= 0.001 )
+            d->setPaddingFactor( pf );
+    }
+
+    double RecordGrowth::endWindow( SizeClass& c ) {
+        unsigned fit = c.updates; // updates that fit in the padding so far
+        unsigned movesAllowed = c.updates * MovePercent / 100;
+        double p = 1.0;
+        if ( c.growth ) {
+            for ( uint32_t i = 0; i < c.growth->getBucketsNum(); i++ )
+                fit -= c.growth->getCount( i );
+            for ( uint32_t i = 0; c.updates - fit > movesAllowed; i++ ) {
+                fit += c.growth->getCount( i );
+                p = 1.0 + min( c.growth->getBoundary( i ), (uint32_t) MaxPaddingPercent ) / 100.0;
+            }
+            c.growth->clear();
+        }
+        c.updates = 0;
+        return p;
+    }
+
+    double RecordGrowth::padding( int lenWHdr, double dflt ) const {
+        double p = _classes[ NamespaceDetails::bucket( lenWHdr ) ].padding;
+        return p == 0 ? dflt : p;
+    }
+
+    void RecordGrowth::appendStats( BSONObjBuilder& b ) const {
+        b.appendNumber( "updates", _updates );
+        b.appendNumber( "moves", _moves );
+        b.append( "moveRate", _updates ? double( _moves ) / _updates : 0.0 );
+        b.appendNumber( "indexKeysRewritten", _keysRewritten );
+
+        // keyed by the size class's upper bound in bytes
+        BSONObjBuilder bySize( b.subobjStart( "paddingBySize" ) );
+        for ( int i = 0; i < Buckets; i++ ) {
+            if ( _classes[i].padding != 0 )
+                bySize.append( BSONObjBuilder::numStr( bucketSizes[i] ), _classes[i].padding );
+        }
+        bySize.done();
+    }
+
+    /* ------------------------------------------------------------------------- */
+
     /* add a new namespace to the system catalog (<dbname>.system.namespaces).
        options: { capped : ..., size : ... }
     */
@@ -20,6 +20,8 @@
 
 #include "pch.h"
 
+#include <boost/unordered_map.hpp>
+
 #include "mongo/db/d_concurrency.h"
 #include "mongo/db/diskloc.h"
 #include "mongo/db/index.h"
@@ -28,10 +30,14 @@
 #include "mongo/db/namespace.h"
 #include "mongo/db/queryoptimizercursor.h"
 #include "mongo/db/querypattern.h"
+#include "mongo/db/queryresultcache.h"
 #include "mongo/util/hashtab.h"
+#include "mongo/util/histogram.h"
 
 namespace mongo {
+    class CappedInsertNotifier;
     class Database;
+    class RecordGrowth;
 
     /** @return true if a client can modify this namespace even though it is under ".system."
         For example <dbname>.system.users is ok for regular clients to update.
@@ -190,7 +196,10 @@ namespace mongo {
         };
 
         enum UserFlags {
-            Flag_UsePowerOf2Sizes = 1 << 0
+            Flag_UsePowerOf2Sizes = 1 << 0,
+            Flag_CacheQueryResults = 1 << 1, // see QueryResultCache
+            Flag_TimePartitioned = 1 << 2, // see TimePartitions
+            Flag_RecordChecksums = 1 << 3 // see RecordChecksums
         };
 
         IndexDetails& idx(int idxNo, bool missingExpected = false );
@@ -242,7 +251,7 @@ namespace mongo {
          *         will be >= oldRecordSize
          *         based on padding and any other flags
          */
-        int getRecordAllocationSize( int minRecordSize );
+        int getRecordAllocationSize( int minRecordSize, const RecordGrowth *growth = 0 );
 
         double paddingFactor() const { return _paddingFactor; }
 
@@ -250,40 +259,6 @@ namespace mongo {
             *getDur().writing(&_paddingFactor) = paddingFactor;
         }
 
-        /* called to indicate that an update fit in place.  
-           fits also called on an insert -- idea there is that if you had some mix and then went to
-           pure inserts it would adapt and PF would trend to 1.0.  note update calls insert on a move
-           so there is a double count there that must be adjusted for below.
-
-           todo: greater sophistication could be helpful and added later.  for example the absolute 
-                 size of documents might be considered -- in some cases smaller ones are more likely 
-                 to grow than larger ones in the same collection? (not always)
-        */
-        void paddingFits() {
-            MONGO_SOMETIMES(sometimes, 4) { // do this on a sampled basis to journal less
-                double x = _paddingFactor - 0.001;
-                if ( x >= 1.0 ) {
-                    setPaddingFactor( x );
-                }
-            }
-        }
-        void paddingTooSmall() {            
-            MONGO_SOMETIMES(sometimes, 4) { // do this on a sampled basis to journal less       
-                /* the more indexes we have, the higher the cost of a move.  so we take that into 
-                   account herein.  note on a move that insert() calls paddingFits(), thus
-                   here for example with no inserts and nIndexes = 1 we have
-                   .001*4-.001 or a 3:1 ratio to non moves -> 75% nonmoves.  insert heavy 
-                   can pushes this down considerably. further tweaking will be a good idea but 
-                   this should be an adequate starting point.
-                */
-                double N = min(nIndexes,7) + 3;
-                double x = _paddingFactor + (0.001 * N);
-                if ( x <= 2.0 ) {
-                    setPaddingFactor( x );
-                }
-            }
-        }
-
         // @return offset in indexes[]
         int findIndexByName(const char *name);
 
@@ -401,6 +376,58 @@ namespace mongo {
     class ParsedQuery;
     class QueryPlanSummary;
     
+    /* Growth of updated documents in one collection, by deleted list size class, and the padding
+       it calls for.  A single padding factor nudged up on moves and down on fits swings back and
+       forth, and pads small documents for large ones growing (or the other way around).  Instead,
+       each size class keeps a histogram of how much its updates grow documents, and every
+       WindowSize updates takes the smallest padding that all but MovePercent of them fit in.
+
+       Kept in NamespaceDetailsTransient, so it starts over on a restart; the collection's
+       paddingFactor is set to the average padding so there is something to start from.
+       Assumed to be in write lock for noteUpdate().
+    */
+    class RecordGrowth : boost::noncopyable {
+    public:
+        enum {
+            WindowSize = 256,         // updates within a size class between padding changes
+            MovePercent = 10,         // of the updates in a window, these may still move
+            MaxPaddingPercent = 100,  // padding factor 2.0
+            GrowthBucketPercent = 5   // histogram resolution
+        };
+
+        RecordGrowth();
+
+        /** an update took a document from oldSize to newSize bytes.  if it had to move,
+            keysRewritten is the number of index keys that were removed and reinserted for it.
+        */
+        void noteUpdate( NamespaceDetails *d, int oldSize, int newSize, bool moved, int keysRewritten );
+
+        /** @return padding for a new record of lenWHdr bytes, or dflt if its size class has not
+                    seen a window of updates yet
+        */
+        double padding( int lenWHdr, double dflt ) const;
+
+        /** updates, moves and index key rewrites since startup, and padding by size class */
+        void appendStats( BSONObjBuilder& b ) const;
+
+    private:
+        struct SizeClass {
+            SizeClass() : updates(0), total(0), padding(0) {}
+            scoped_ptr<Histogram> growth;  // percent grown by updates that grew, this window
+            unsigned updates;              // this window, including those that didn't grow
+            long long total;               // since startup
+            double padding;                // 0 until the first window is done
+        };
+
+        /** @return the padding the window calls for, and clear it for the next */
+        double endWindow( SizeClass& c );
+
+        SizeClass _classes[Buckets];
+        long long _updates;
+        long long _moves;
+        long long _keysRewritten;
+    };
+
     /* NamespaceDetailsTransient
 
        these are things we know / compute about a namespace that are transient -- things
@@ -497,6 +524,7 @@ namespace mongo {
     private:
         bool _keysComputed;
         set<string> _indexKeys;
+        vector< set<string> > _indexKeysByIndex; // the same, one set per (finished) index
         void computeIndexKeys();
     public:
         /* get set of index keys for this namespace.  handy to quickly check if a given
@@ -509,6 +537,14 @@ namespace mongo {
             return _indexKeys;
         }
 
+        /* the fields of index idxNo's key, or 0 if it isn't a finished index */
+        const set<string>* indexKeys( int idxNo ) {
+            DEV Lock::assertWriteLocked(_ns);
+            if ( !_keysComputed )
+                computeIndexKeys();
+            return idxNo < (int) _indexKeysByIndex.size() ? &_indexKeysByIndex[idxNo] : 0;
+        }
+
         /* IndexSpec caching */
     private:
         map<const IndexDetails*,IndexSpec> _indexSpecs;
@@ -526,10 +562,41 @@ namespace mongo {
             return spec;
         }
 
+        /* record padding ------------------------------------------------------- */
+    private:
+        RecordGrowth _recordGrowth;
+    public:
+        RecordGrowth& recordGrowth() { return _recordGrowth; }
+
+        /* query result cache, for collections with Flag_CacheQueryResults ------- */
+    private:
+        QueryResultCache _qrCache;
+    public:
+        QueryResultCache& queryResultCache() { return _qrCache; }
+
+        /* awaitData cursors on a capped collection wait on this -------------- */
+    private:
+        shared_ptr<CappedInsertNotifier> _cappedInsertNotifier; // null until one waits
+    public:
+        /* ns's notifier, made if this is the first wait.  read locked, which an insert can't
+           come in under; the caller's reference keeps it good through a drop */
+        static shared_ptr<CappedInsertNotifier> cappedInsertNotifier( const char *ns );
+        /* write locked */
+        void notifyCappedInsert();
+
+        /* time partitioning, for collections with Flag_TimePartitioned -------- */
+    private:
+        BSONObj _timePartitioned;
+    public:
+        /* the timePartitioned create option, cached from system.namespaces.  you must be in
+           the qcMutex when calling this */
+        BSONObj& timePartitioned() { return _timePartitioned; }
+
         /* query cache (for query optimizer) ------------------------------------- */
     private:
         int _qcWriteCount;
         map<QueryPattern,CachedQueryPlan> _qcCache;
+        map<QueryPattern,QueryPlanHistory> _qcHistory; // survives expireQueryCache()
         static NamespaceDetailsTransient& make_inlock(const char *ns);
     public:
         static SimpleMutex _qcMutex;
@@ -542,29 +609,46 @@ namespace mongo {
            */
         static NamespaceDetailsTransient& get_inlock(const char *ns);
 
-        static NamespaceDetailsTransient& get(const char *ns) {
-            // todo : _qcMutex will create bottlenecks in our parallelism
-            SimpleMutex::scoped_lock lk(_qcMutex);
-            return get_inlock(ns);
-        }
+        /** from the Client's NamespaceCache when it can be, else under _qcMutex */
+        static NamespaceDetailsTransient& get(const char *ns);
 
+        /* forget cached plans, their history and cached results, e.g. because the indexes changed */
         void clearQueryCache() {
+            expireQueryCache();
+            _qcHistory.clear();
+            _qrCache.clear();
+        }
+        /* forget cached plans, but keep the history of patterns whose plan is stable */
+        void expireQueryCache() {
             _qcCache.clear();
             _qcWriteCount = 0;
+            if ( _qcHistory.size() > 1000 )
+                _qcHistory.clear();
         }
-        /* you must notify the cache if you are doing writes, as query plan utility will change */
+        /* you must notify the cache if you are doing writes, as query plan utility will change and
+           cached results become stale */
         void notifyOfWriteOp() {
+            _qrCache.clear();
             if ( _qcCache.empty() )
                 return;
             if ( ++_qcWriteCount >= 100 )
-                clearQueryCache();
+                expireQueryCache();
         }
         CachedQueryPlan cachedQueryPlanForPattern( const QueryPattern &pattern ) {
-            return _qcCache[ pattern ];
+            CachedQueryPlan &cached = _qcCache[ pattern ];
+            if ( cached.indexKey().isEmpty() ) {
+                // the same index won every recent race, so use it without racing again; a
+                // plan doing much worse than its history still falls back to a race
+                map<QueryPattern,QueryPlanHistory>::const_iterator i = _qcHistory.find( pattern );
+                if ( i != _qcHistory.end() && i->second.stable() )
+                    cached = i->second.plan();
+            }
+            return cached;
         }
         void registerCachedQueryPlanForPattern( const QueryPattern &pattern,
                                                const CachedQueryPlan &cachedQueryPlan ) {
             _qcCache[ pattern ] = cachedQueryPlan;
+            _qcHistory[ pattern ].notePlan( cachedQueryPlan );
         }
 
     }; /* NamespaceDetailsTransient */
@@ -581,6 +665,14 @@ namespace mongo {
     /* NamespaceIndex is the ".ns" file you see in the data directory.  It is the "system catalog"
        if you will: at least the core parts.  (Additional info in system.* collections.)
     */
+    /* The namespaces of a database are in the hash table of db.ns, of --nssize.  When a new one
+       doesn't fit, another table, twice as big as the last, is made in db.ns.1, db.ns.2 and so on.
+       Tables never move once mapped, so a NamespaceDetails* stays good until the database closes;
+       an $extra is always in the same table as its collection, as it is found by an offset from it.
+
+       Lookups go through _cache, a copy of every table's keys in memory, rather than probing each
+       table.  It changes only in the write lock, so any number of readers may use it at once.
+    */
     class NamespaceIndex {
     public:
         NamespaceIndex(const string &dir, const string &database) :
@@ -600,9 +692,11 @@ namespace mongo {
         NamespaceDetails* details(const char *ns) {
             if ( !ht )
                 return 0;
-            Namespace n(ns);
-            NamespaceDetails *d = ht->get(n);
-            if ( d && d->isCapped() )
+            Cache::const_iterator i = _cache.find(Namespace(ns));
+            if ( i == _cache.end() )
+                return 0;
+            NamespaceDetails *d = i->second;
+            if ( d->isCapped() )
                 d->cappedCheckMigrate();
             return d;
         }
@@ -626,14 +720,41 @@ namespace mongo {
 
         boost::filesystem::path path() const;
 
-        unsigned long long fileLength() const { return f.length(); }
+        /** of db.ns and the tables it has grown into */
+        unsigned long long fileLength() const;
+
+        /** number of .ns files, 1 until the first table fills up */
+        int nFiles() const { return ht ? 1 + _more.size() : 0; }
 
     private:
+        typedef HashTable<Namespace,NamespaceDetails> Table;
+        struct NamespaceHash {
+            size_t operator()( const Namespace& n ) const { return n.hash(); }
+        };
+        typedef boost::unordered_map<Namespace,NamespaceDetails*,NamespaceHash> Cache;
+        struct MoreTable {
+            shared_ptr<MongoMMF> f;
+            shared_ptr<Table> ht;
+        };
+
         void _init();
         void maybeMkdir() const;
 
+        /** db.ns.<i> */
+        boost::filesystem::path _morePath( int i ) const;
+        /** maps an existing db.ns.<i>, or makes one of len bytes if len isn't 0, into _more */
+        void _openMore( int i , unsigned long long len );
+        /** @return the table d is in */
+        Table* _tableOf( const NamespaceDetails *d );
+        /** puts n in a table with room for it, or a new one, and in _cache */
+        NamespaceDetails* _put( const Namespace& n , const NamespaceDetails &details , Table *in );
+        void _kill( const Namespace& n );
+        static void _cacheCallback( const Namespace& k , NamespaceDetails& v , void *extra );
+
         MongoMMF f;
-        HashTable<Namespace,NamespaceDetails> *ht;
+        Table *ht;
+        vector<MoreTable> _more;
+        Cache _cache;
         string dir_;
         string database_;
     };
@@ -29,7 +29,10 @@
 #include "ops/update.h"
 #include "ops/delete.h"
 #include "mongo/db/instance.h"
+#include "mongo/db/pagefault.h"
 #include "mongo/db/repl/bgsync.h"
+#include "mongo/util/compress.h"
+#include "mongo/util/concurrency/threadlocal.h"
 
 namespace mongo {
 
@@ -37,29 +40,89 @@ namespace mongo {
     void logOpForSharding( const char * opstr , const char * ns , const BSONObj& obj , BSONObj * patt );
 
     int __findingStartInitialTimeout = 5; // configurable for testing
+    int __oplogStartCheckpointBytes = 4 * 1024 * 1024; // configurable for testing
+
+    bool oplogPreImages = false;
+    bool oplogCompression = false;
+
+    // o: smaller than this isn't worth compressing
+    static const int OplogCompressMinBytes = 256;
+
+    /** @return true, with z set to o compressed, if oplogCompression is on and it saves enough */
+    static bool compressForOplog(const BSONObj& o, string *z) {
+        if ( !oplogCompression || o.objsize() < OplogCompressMinBytes )
+            return false;
+        compress(o.objdata(), o.objsize(), z);
+        return z->size() < (size_t) o.objsize() / 8 * 7;
+    }
+
+    /** @return op with o: replaced by a compressed oz:, or op itself if that isn't worth it */
+    static BSONObj compressOplogEntry(const BSONObj& op) {
+        BSONElement o = op["o"];
+        string z;
+        if ( o.type() != Object || !compressForOplog(o.embeddedObject(), &z) )
+            return op;
+
+        BSONObjBuilder b(op.objsize());
+        BSONObjIterator i(op);
+        while ( i.more() ) {
+            BSONElement e = i.next();
+            if ( e.rawdata() != o.rawdata() )
+                b.append(e);
+        }
+        b.appendBinData("oz", z.size(), BinDataGeneral, z.data());
+        return b.obj();
+    }
+
+    BSONObj uncompressOplogEntry(const BSONObj& op) {
+        BSONElement oz = op["oz"];
+        if ( oz.type() != BinData )
+            return op;
+
+        int len;
+        const char *data = oz.binData(len);
+        string o;
+        massert(16370, "couldn't uncompress oplog entry", uncompress(data, len, &o));
+
+        BSONObjBuilder b(op.objsize() + o.size());
+        BSONObjIterator i(op);
+        while ( i.more() ) {
+            BSONElement e = i.next();
+            if ( e.rawdata() != oz.rawdata() )
+                b.append(e);
+        }
+        b.append("o", BSONObj(o.data()));
+        return b.obj();
+    }
 
     // cached copies of these...so don't rename them, drop them, etc.!!!
     static NamespaceDetails *localOplogMainDetails = 0;
     static Database *localDB = 0;
     static NamespaceDetails *rsOplogDetails = 0;
+    static OplogStartIndex localOplogMainStart;
+    static OplogStartIndex rsOplogStart;
     void oplogCheckCloseDatabase( Database * db ) {
         verify( Lock::isW() );
         localDB = 0;
         localOplogMainDetails = 0;
         rsOplogDetails = 0;
         resetSlaveCache();
+        OplogStartIndex::invalidateAll();
     }
 
-    static void _logOpUninitialized(const char *opstr, const char *ns, const char *logNS, const BSONObj& obj, BSONObj *o2, bool *bb, bool fromMigrate ) {
+    static void _logOpUninitialized(const char *opstr, const char *ns, const char *logNS, const BSONObj& obj, BSONObj *o2, bool *bb, bool fromMigrate, const BSONObj& pre ) {
         uassert(13288, "replSet error write op to db before replSet initialized", str::startsWith(ns, "local.") || *opstr == 'n');
     }
 
     /** write an op to the oplog that is already built.
         todo : make _logOpRS() call this so we don't repeat ourself?
         */
-    void _logOpObjRS(const BSONObj& op) {
+    void _logOpObjRS(const BSONObj& fetched) {
         Lock::DBWrite lk("local");
 
+        // what we fetched was uncompressed for us, whatever the source stores
+        const BSONObj op = compressOplogEntry(fetched);
+
         const OpTime ts = op["ts"]._opTime();
         long long h = op["h"].numberLong();
 
@@ -75,8 +138,10 @@ namespace mongo {
             Client::Context ctx( logns , localDB, false );
             {
                 int len = op.objsize();
-                Record *r = theDataFileMgr.fast_oplog_insert(rsOplogDetails, logns, len);
+                DiskLoc loc;
+                Record *r = theDataFileMgr.fast_oplog_insert(rsOplogDetails, logns, len, &loc);
                 memcpy(getDur().writingPtr(r->data(), len), op.objdata(), len);
+                rsOplogStart.noteInsert(rsOplogDetails, ts, loc, len);
             }
             /* todo: now() has code to handle clock skew.  but if the skew server to server is large it will get unhappy.
                      this code (or code in now() maybe) should be improved.
@@ -94,20 +159,9 @@ namespace mongo {
         }
     }
 
-    /** given a BSON object, create a new one at dst which is the existing (partial) object
-        with a new object element appended at the end with fieldname "o".
-
-        @param partial already build object with everything except the o member.  e.g. something like:
-               { ts:..., ns:..., os2:... }
-        @param o a bson object to be added with fieldname "o"
-        @dst   where to put the newly built combined object.  e.g. ends up as something like:
-               { ts:..., ns:..., os2:..., o:... }
-    */
-    void append_O_Obj(char *dst, const BSONObj& partial, const BSONObj& o) {
+    /** builds append_O_Obj()'s object into p, which the caller has declared it is writing */
+    static void build_O_Obj(void *p, const BSONObj& partial, const BSONObj& o) {
         const int size1 = partial.objsize() - 1;  // less the EOO char
-        const int oOfs = size1+3;                 // 3 = byte BSONOBJTYPE + byte 'o' + byte \0
-
-        void *p = getDur().writingPtr(dst, oOfs+o.objsize()+1);
 
         memcpy(p, partial.objdata(), size1);
 
@@ -124,11 +178,27 @@ namespace mongo {
         *b = EOO;
     }
 
+    /** given a BSON object, create a new one at dst which is the existing (partial) object
+        with a new object element appended at the end with fieldname "o".
+
+        @param partial already build object with everything except the o member.  e.g. something like:
+               { ts:..., ns:..., os2:... }
+        @param o a bson object to be added with fieldname "o"
+        @dst   where to put the newly built combined object.  e.g. ends up as something like:
+               { ts:..., ns:..., os2:..., o:... }
+    */
+    void append_O_Obj(char *dst, const BSONObj& partial, const BSONObj& o) {
+        const int size1 = partial.objsize() - 1;  // less the EOO char
+        const int oOfs = size1+3;                 // 3 = byte BSONOBJTYPE + byte 'o' + byte \0
+
+        build_O_Obj(getDur().writingPtr(dst, oOfs+o.objsize()+1), partial, o);
+    }
+
     // global is safe as we are in write lock. we put the static outside the function to avoid the implicit mutex 
     // the compiler would use if inside the function.  the reason this is static is to avoid a malloc/free for this
     // on every logop call.
     static BufBuilder logopbufbuilder(8*1024);
-    static void _logOpRS(const char *opstr, const char *ns, const char *logNS, const BSONObj& obj, BSONObj *o2, bool *bb, bool fromMigrate ) {
+    static void _logOpRS(const char *opstr, const char *ns, const char *logNS, const BSONObj& obj, BSONObj *o2, bool *bb, bool fromMigrate, const BSONObj& pre ) {
         Lock::DBWrite lk1("local");
 
         if ( strncmp(ns, "local.", 6) == 0 ) {
@@ -167,11 +237,18 @@ namespace mongo {
             b.appendBool("b", *bb);
         if ( o2 )
             b.append("o2", *o2);
+        if ( !pre.isEmpty() )
+            b.append("pre", pre);
+        string z;
+        const bool compressed = compressForOplog(obj, &z);
+        if ( compressed )
+            b.appendBinData("oz", z.size(), BinDataGeneral, z.data());
         BSONObj partial = b.done();
         int posz = partial.objsize();
-        int len = posz + obj.objsize() + 1 + 2 /*o:*/;
+        int len = compressed ? posz : posz + obj.objsize() + 1 + 2 /*o:*/;
 
         Record *r;
+        DiskLoc loc;
         DEV verify( logNS == 0 );
         {
             const char *logns = rsoplog;
@@ -183,7 +260,7 @@ namespace mongo {
                 massert(13347, "local.oplog.rs missing. did you drop it? if so restart server", rsOplogDetails);
             }
             Client::Context ctx( logns , localDB, false );
-            r = theDataFileMgr.fast_oplog_insert(rsOplogDetails, logns, len);
+            r = theDataFileMgr.fast_oplog_insert(rsOplogDetails, logns, len, &loc);
             /* todo: now() has code to handle clock skew.  but if the skew server to server is large it will get unhappy.
                      this code (or code in now() maybe) should be improved.
                      */
@@ -198,13 +275,171 @@ namespace mongo {
             }
         }
 
-        append_O_Obj(r->data(), partial, obj);
+        if ( compressed )
+            memcpy(getDur().writingPtr(r->data(), len), partial.objdata(), len);
+        else
+            append_O_Obj(r->data(), partial, obj);
+        rsOplogStart.noteInsert(rsOplogDetails, ts, loc, len);
 
         if ( logLevel >= 6 ) {
             log( 6 ) << "logOp:" << BSONObj::make(r) << endl;
         }
     }
 
+    /** _logOpRS() for a batch of ops: their records are allocated together and filled in
+        through a single write intent */
+    static void _logOpsRS(const vector<OplogBatch::Op>& ops) {
+        Lock::DBWrite lk1("local");
+        mutex::scoped_lock lk2(OpTime::m);
+
+        massert(16366, "replSet error : logOp() but not primary?",
+                theReplSet && theReplSet->box.getState().primary());
+
+        // build every entry but its o: field, back to back, to learn the records' lengths
+        BufBuilder partials(ops.size() * 64);
+        vector<int> offsets;
+        vector<int> lens;
+        vector<bool> compressed;
+        vector<OpTime> times;
+        long long hashNew = theReplSet->lastH;
+        for( vector<OplogBatch::Op>::const_iterator i = ops.begin(); i != ops.end(); ++i ) {
+            const OpTime ts = OpTime::now(lk2);
+            hashNew = (hashNew * 131 + ts.asLL()) * 17 + theReplSet->selfId();
+
+            const int start = partials.len();
+            BSONObjBuilder b(partials);
+            b.appendTimestamp("ts", ts.asDate());
+            b.append("h", hashNew);
+            b.append("op", i->opstr);
+            b.append("ns", i->ns);
+            if ( i->fromMigrate )
+                b.appendBool("fromMigrate", true);
+            if ( i->hasB )
+                b.appendBool("b", i->b);
+            if ( i->hasO2 )
+                b.append("o2", i->o2);
+            if ( !i->pre.isEmpty() )
+                b.append("pre", i->pre);
+            string z;
+            const bool c = compressForOplog(i->obj, &z);
+            if ( c )
+                b.appendBinData("oz", z.size(), BinDataGeneral, z.data());
+            b.done();
+
+            offsets.push_back(start);
+            compressed.push_back(c);
+            lens.push_back(partials.len() - start + ( c ? 0 : i->obj.objsize() + 1 + 2 /*o:*/ ));
+            times.push_back(ts);
+        }
+
+        const char *logns = rsoplog;
+        if ( rsOplogDetails == 0 ) {
+            Client::Context ctx( logns , dbpath, false);
+            localDB = ctx.db();
+            verify( localDB );
+            rsOplogDetails = nsdetails(logns);
+            massert(16367, "local.oplog.rs missing. did you drop it? if so restart server", rsOplogDetails);
+        }
+        Client::Context ctx( logns , localDB, false );
+
+        vector<DiskLoc> locs;
+        char *w = theDataFileMgr.fast_oplog_insert_batch(rsOplogDetails, logns, lens, &locs);
+        for( unsigned i = 0; i < ops.size(); i++ ) {
+            char *rec = w + ( locs[i].getOfs() - locs[0].getOfs() );
+            BSONObj partial(partials.buf() + offsets[i]);
+            if ( compressed[i] )
+                memcpy(rec + Record::HeaderSize, partial.objdata(), partial.objsize());
+            else
+                build_O_Obj(rec + Record::HeaderSize, partial, ops[i].obj);
+            rsOplogStart.noteInsert(rsOplogDetails, times[i], locs[i], lens[i]);
+        }
+
+        if( !(theReplSet->lastOpTimeWritten<times.front()) ) {
+            log() << "replSet ERROR possible failover clock skew issue? " << theReplSet->lastOpTimeWritten << ' ' << times.front() << rsLog;
+        }
+        theReplSet->lastOpTimeWritten = times.back();
+        theReplSet->lastH = hashNew;
+        ctx.getClient()->setLastOp( times.back() );
+
+        LOG( 6 ) << "logOp: batch of " << ops.size() << endl;
+    }
+
+    static ThreadLocalValue<OplogBatch*> currentOplogBatch;
+
+    OplogBatch::OplogBatch() : _active( currentOplogBatch.get() == 0 ), _bytes(0) {
+        if ( _active )
+            currentOplogBatch.set( this );
+    }
+
+    OplogBatch::~OplogBatch() {
+        if ( !_active )
+            return;
+        currentOplogBatch.set( 0 );
+        flush(); // doesn't throw
+    }
+
+    void OplogBatch::flush() {
+        if ( _ops.empty() )
+            return;
+        // the ops' data is already written, so their entries can't be dropped: secondaries would
+        // silently diverge.  they stay queued until written, and not writing them is fatal.
+        // page faults are off as we are often unwinding from one, with the lock still held.
+        try {
+            NoPageFaultsAllowed npfa;
+            _logOpsRS( _ops );
+        }
+        catch ( std::exception& e ) {
+            error() << "couldn't write " << _ops.size() << " batched ops to the oplog: " << e.what() << endl;
+            fassertFailed( 16448 );
+        }
+        catch ( ... ) {
+            error() << "couldn't write " << _ops.size() << " batched ops to the oplog" << endl;
+            fassertFailed( 16449 );
+        }
+        _ops.clear();
+        _bytes = 0;
+    }
+
+    void OplogBatch::flushCurrent() {
+        OplogBatch *batch = currentOplogBatch.get();
+        if ( batch )
+            batch->flush();
+    }
+
+    void OplogBatch::commitIfNeeded() {
+        if ( getDur().aCommitIsNeeded() )
+            flushCurrent();
+        getDur().commitIfNeeded();
+    }
+
+    bool OplogBatch::add( const char *opstr, const char *ns, const BSONObj& obj, BSONObj *o2, bool *bb, bool fromMigrate, const BSONObj& pre ) {
+        OplogBatch *batch = currentOplogBatch.get();
+        if ( batch == 0 || strlen( opstr ) >= sizeof( Op().opstr ) )
+            return false;
+
+        // _logOpRS() doesn't log these, but may have to notice them
+        if ( strncmp( ns, "local.", 6 ) == 0 )
+            return false;
+
+        batch->_ops.push_back( Op() );
+        Op &op = batch->_ops.back();
+        strcpy( op.opstr, opstr );
+        op.ns = ns;
+        op.obj = obj.isOwned() ? obj : obj.getOwned();
+        op.hasO2 = o2 != 0;
+        if ( o2 )
+            op.o2 = o2->getOwned();
+        op.hasB = bb != 0;
+        op.b = bb && *bb;
+        op.fromMigrate = fromMigrate;
+        op.pre = pre.getOwned();
+
+        batch->_bytes += op.obj.objsize() + ( o2 ? op.o2.objsize() : 0 ) + op.pre.objsize();
+        if ( batch->_bytes >= (size_t) MaxBytes )
+            batch->flush();
+        return true;
+    }
+
     /* we write to local.oplog.$main:
          { ts : ..., op: ..., ns: ..., o: ... }
        ts: an OpTime timestamp
@@ -225,7 +460,7 @@ namespace mongo {
 
        note this is used for single collection logging even when --replSet is enabled.
     */
-    static void _logOpOld(const char *opstr, const char *ns, const char *logNS, const BSONObj& obj, BSONObj *o2, bool *bb, bool fromMigrate ) {
+    static void _logOpOld(const char *opstr, const char *ns, const char *logNS, const BSONObj& obj, BSONObj *o2, bool *bb, bool fromMigrate, const BSONObj& pre ) {
         Lock::DBWrite lk("local");
         static BufBuilder bufbuilder(8*1024); // todo there is likely a mutex on this constructor
 
@@ -262,6 +497,8 @@ namespace mongo {
         int len = po_sz + obj.objsize() + 1 + 2 /*o:*/;
 
         Record *r;
+        NamespaceDetails *d;
+        DiskLoc loc;
         if( logNS == 0 ) {
             logNS = "local.oplog.$main";
             if ( localOplogMainDetails == 0 ) {
@@ -272,23 +509,27 @@ namespace mongo {
                 verify( localOplogMainDetails );
             }
             Client::Context ctx( logNS , localDB, false );
-            r = theDataFileMgr.fast_oplog_insert(localOplogMainDetails, logNS, len);
+            d = localOplogMainDetails;
+            r = theDataFileMgr.fast_oplog_insert(d, logNS, len, &loc);
         }
         else {
             Client::Context ctx( logNS, dbpath, false );
-            verify( nsdetails( logNS ) );
+            d = nsdetails( logNS );
+            verify( d );
             // first we allocate the space, then we fill it below.
-            r = theDataFileMgr.fast_oplog_insert( nsdetails( logNS ), logNS, len);
+            r = theDataFileMgr.fast_oplog_insert( d, logNS, len, &loc );
         }
 
         append_O_Obj(r->data(), partial, obj);
+        if ( OplogStartIndex *start = OplogStartIndex::forNs( logNS ) )
+            start->noteInsert( d, ts, loc, len );
 
         context.getClient()->setLastOp( ts );
 
         LOG( 6 ) << "logging op:" << BSONObj::make(r) << endl;
     } 
 
-    static void (*_logOp)(const char *opstr, const char *ns, const char *logNS, const BSONObj& obj, BSONObj *o2, bool *bb, bool fromMigrate ) = _logOpOld;
+    static void (*_logOp)(const char *opstr, const char *ns, const char *logNS, const BSONObj& obj, BSONObj *o2, bool *bb, bool fromMigrate, const BSONObj& pre ) = _logOpOld;
     void newReplUp() {
         replSettings.master = true;
         _logOp = _logOpRS;
@@ -300,13 +541,13 @@ namespace mongo {
     void oldRepl() { _logOp = _logOpOld; }
 
     void logKeepalive() {
-        _logOp("n", "", 0, BSONObj(), 0, 0, false);
+        _logOp("n", "", 0, BSONObj(), 0, 0, false, BSONObj());
     }
     void logOpComment(const BSONObj& obj) {
-        _logOp("n", "", 0, obj, 0, 0, false);
+        _logOp("n", "", 0, obj, 0, 0, false, BSONObj());
     }
     void logOpInitiate(const BSONObj& obj) {
-        _logOpRS("n", "", 0, obj, 0, 0, false);
+        _logOpRS("n", "", 0, obj, 0, 0, false, BSONObj());
     }
 
     /*@ @param opstr:
@@ -316,9 +557,13 @@ namespace mongo {
           d delete / remove
           u update
     */
-    void logOp(const char *opstr, const char *ns, const BSONObj& obj, BSONObj *patt, bool *b, bool fromMigrate) {
+    void logOp(const char *opstr, const char *ns, const BSONObj& obj, BSONObj *patt, bool *b, bool fromMigrate, const BSONObj& pre) {
         if ( replSettings.master ) {
-            _logOp(opstr, ns, 0, obj, patt, b, fromMigrate);
+            // only replica set rollback reads pre-images, and an entry must stay a legal object
+            const BSONObj& logPre = ( _logOp == _logOpRS &&
+                                      pre.objsize() + obj.objsize() <= BSONObjMaxUserSize ) ? pre : BSONObj();
+            if ( _logOp != _logOpRS || !OplogBatch::add(opstr, ns, obj, patt, b, fromMigrate, logPre) )
+                _logOp(opstr, ns, 0, obj, patt, b, fromMigrate, logPre);
         }
 
         logOpForSharding( opstr , ns , obj , patt );
@@ -402,6 +647,115 @@ namespace mongo {
 
     // -------------------------------------
 
+    OplogStartIndex::OplogStartIndex() : _m( "OplogStartIndex" ) {
+        _reset();
+    }
+
+    OplogStartIndex* OplogStartIndex::forNs( const char *ns ) {
+        if ( strcmp( ns, rsoplog ) == 0 )
+            return &rsOplogStart;
+        if ( strcmp( ns, "local.oplog.$main" ) == 0 )
+            return &localOplogMainStart;
+        return 0;
+    }
+
+    void OplogStartIndex::invalidate( const char *ns ) {
+        OplogStartIndex *i = forNs( ns );
+        if ( i ) {
+            SimpleMutex::scoped_lock lk( i->_m );
+            i->_reset();
+        }
+    }
+
+    void OplogStartIndex::invalidateAll() {
+        invalidate( rsoplog );
+        invalidate( "local.oplog.$main" );
+    }
+
+    void OplogStartIndex::_reset() {
+        _checkpoints.clear();
+        _loaded = false;
+        _written = 0;
+        _lastCheckpoint = 0;
+        _capacity = 0;
+    }
+
+    void OplogStartIndex::_load( NamespaceDetails *d ) {
+        _reset();
+        _capacity = d->storageSize();
+        for ( DiskLoc e = d->firstExtent; !e.isNull(); e = e.ext()->xnext ) {
+            DiskLoc first = e.ext()->firstRecord;
+            if ( first.isNull() )
+                continue;
+            BSONElement ts = first.obj()[ "ts" ];
+            if ( ts.type() != Timestamp )
+                continue;
+            _checkpoints.push_back( Checkpoint( ts._opTime(), first, 0 ) );
+        }
+        // a looped oplog's extents aren't in ts order
+        sort( _checkpoints.begin(), _checkpoints.end() );
+        _loaded = true;
+    }
+
+    void OplogStartIndex::noteInsert( NamespaceDetails *d, const OpTime &ts, const DiskLoc &loc, int len ) {
+        // writers hold the local write lock, so there is no reader to race with outside _m
+        _written += len;
+        if ( _loaded && _written - _lastCheckpoint < __oplogStartCheckpointBytes )
+            return;
+
+        SimpleMutex::scoped_lock lk( _m );
+        if ( !_loaded ) {
+            _load( d );
+            return;
+        }
+        if ( _checkpoints.empty() || _checkpoints.back().ts < ts )
+            _checkpoints.push_back( Checkpoint( ts, loc, _written ) );
+        _lastCheckpoint = _written;
+
+        // anything a whole oplog's worth back has been written over
+        while ( !_checkpoints.empty() && _written - _checkpoints.front().written > _capacity )
+            _checkpoints.pop_front();
+    }
+
+    DiskLoc OplogStartIndex::findStart( NamespaceDetails *d, const OpTime &oldest, const Matcher &matcher ) {
+        SimpleMutex::scoped_lock lk( _m );
+        if ( !_loaded )
+            _load( d );
+
+        // ops are deleted oldest first, so checkpoints from the oldest op on are all still there
+        size_t lo = lower_bound( _checkpoints.begin(), _checkpoints.end(), oldest ) - _checkpoints.begin();
+        size_t hi = _checkpoints.size();
+        if ( lo == hi )
+            return DiskLoc();
+
+        // ops match from some ts on, so binary search for the last checkpoint before that
+        size_t probes = 0;
+        for ( size_t mid = lo; lo < hi; mid = lo + ( hi - lo ) / 2 ) {
+            const Checkpoint &c = _checkpoints[ mid ];
+            BSONObj op = c.loc.obj();
+            if ( op[ "ts" ]._opTime() != c.ts ) {
+                log() << "oplog start index out of date, dropping it" << endl;
+                _reset();
+                return DiskLoc();
+            }
+            if ( matcher.matches( op ) ) {
+                if ( probes == 0 )
+                    return DiskLoc();
+                hi = mid;
+            }
+            else {
+                lo = mid + 1;
+            }
+            probes++;
+        }
+
+        // lo is now the first matching checkpoint.  past the last one, the scan back from the
+        // end covers no more than the ops since it
+        if ( lo == _checkpoints.size() )
+            return DiskLoc();
+        return _checkpoints[ lo - 1 ].loc;
+    }
+
     FindingStartCursor *FindingStartCursor::make( const QueryPlan &qp ) {
         auto_ptr<FindingStartCursor> ret( new FindingStartCursor( qp ) );
         ret->init();
@@ -520,9 +874,12 @@ namespace mongo {
         _findingStartCursor.reset( new ClientCursor(QueryOption_NoCursorTimeout, c, _qp.ns()) );
     }
 
-    bool FindingStartCursor::firstDocMatchesOrEmpty() const {
+    bool FindingStartCursor::firstDocMatchesOrEmpty( OpTime *oldest ) const {
         shared_ptr<Cursor> c = _qp.newCursor();
-        return !c->ok() || _matcher->matchesCurrent( c.get() );
+        if ( !c->ok() )
+            return true;
+        *oldest = c->current()[ "ts" ]._opTime();
+        return _matcher->matchesCurrent( c.get() );
     }
     
     void FindingStartCursor::init() {
@@ -532,11 +889,23 @@ namespace mongo {
         b.append( tsElt );
         BSONObj tsQuery = b.obj();
         _matcher.reset(new CoveredIndexMatcher(tsQuery, _qp.indexKey()));
-        if ( firstDocMatchesOrEmpty() ) {
+        OpTime oldest;
+        if ( firstDocMatchesOrEmpty( &oldest ) ) {
             _c = _qp.newCursor();
             _findingStart = false;
             return;
         }
+        OplogStartIndex *index = OplogStartIndex::forNs( _qp.ns() );
+        if ( index ) {
+            DiskLoc start = index->findStart( _qp.nsd(), oldest, _matcher->docMatcher() );
+            if ( !start.isNull() ) {
+                // the first match is within a checkpoint's worth of ops after start
+                createClientCursor( start );
+                _findingStartTimer.reset();
+                _findingStartMode = InExtent;
+                return;
+            }
+        }
         // Use a ClientCursor here so we can release db mutex while scanning
         // oplog (can take quite a while with large oplogs).
         shared_ptr<Cursor> c = _qp.newReverseCursor();
@@ -48,10 +48,84 @@ namespace mongo {
 
        See _logOp() in oplog.cpp for more details.
     */
-    void logOp( const char *opstr, const char *ns, const BSONObj& obj, BSONObj *patt = 0, bool *b = 0, bool fromMigrate = false );
+    void logOp( const char *opstr, const char *ns, const BSONObj& obj, BSONObj *patt = 0, bool *b = 0, bool fromMigrate = false,
+                const BSONObj& pre = BSONObj() );
+
+    /**
+     * setParameter oplogPreImages.  When set, a replica set primary logs the whole document an
+     * update or delete replaced as the entry's pre: field, and rollback restores documents from
+     * these instead of refetching them from the new primary.  Costs the oplog the size of each
+     * document changed.
+     */
+    extern bool oplogPreImages;
+
+    /**
+     * setParameter oplogCompression.  When set, the o: of a replica set oplog entry is stored
+     * snappy compressed, as BinData in an oz: field, if that saves enough to be worth it.  The
+     * other fields stay as they are, so finding and matching entries by ts works as before.
+     *
+     * Queries and getMores on local.oplog.rs return entries with o: put back, so the members
+     * syncing from this one, and any other oplog reader, never see oz:.  Query predicates on
+     * o: fields can't match a compressed entry though.
+     */
+    extern bool oplogCompression;
+
+    /** @return op with its o: put back if it was stored compressed, else op itself */
+    BSONObj uncompressOplogEntry( const BSONObj& op );
 
     void logKeepalive();
 
+    /**
+     * Batches the oplog entries of the writes an operation makes under one write lock.  While
+     * one is open on a thread, logOp() on a replica set primary queues entries here instead of
+     * writing each one.  flush() then reserves all their records in one capped allocation,
+     * builds the entries straight into it, and declares a single journal intent for the lot.
+     *
+     * The queued ops' data is already written, so the batch must be flushed before the lock is
+     * released or the journal commits: ClientCursor::staticYield() flushes it, writers call
+     * commitIfNeeded() below instead of the journal's, and the destructor flushes the rest.
+     * Unowned objects are copied when queued, as the records they point into may change.
+     *
+     * Only the outermost batch opened on a thread collects ops.
+     */
+    class OplogBatch : boost::noncopyable {
+    public:
+        enum { MaxBytes = 256 * 1024 };
+
+        OplogBatch();
+        ~OplogBatch();
+
+        /** writes the queued entries to the oplog, with page faults off.  never throws: a
+            failure ends the process, as the ops it would lose are already applied here */
+        void flush();
+
+        /** flushes the thread's batch, if there is one */
+        static void flushCurrent();
+
+        /** flushes the thread's batch if the journal is about to commit, then lets it */
+        static void commitIfNeeded();
+
+        /** @return false if no batch is open to take the op, or it can't batch it */
+        static bool add( const char *opstr, const char *ns, const BSONObj& obj, BSONObj *o2, bool *bb, bool fromMigrate, const BSONObj& pre );
+
+        struct Op {
+            char opstr[4];
+            string ns;
+            BSONObj obj;
+            BSONObj o2;
+            BSONObj pre;
+            bool hasO2;
+            bool hasB;
+            bool b;
+            bool fromMigrate;
+        };
+
+    private:
+        bool _active;
+        vector<Op> _ops;
+        size_t _bytes;
+    };
+
     /** puts obj in the oplog as a comment (a no-op).  Just for diags.
         convention is
           { msg : "text", ... }
@@ -61,8 +135,68 @@ namespace mongo {
     void oplogCheckCloseDatabase( Database * db );
 
     extern int __findingStartInitialTimeout; // configurable for testing
+    extern int __oplogStartCheckpointBytes; // configurable for testing
 
     class QueryPlan;
+
+    /**
+     * A sparse in memory index of an oplog: the ts and location of one op every
+     * __oplogStartCheckpointBytes written, so FindingStartCursor can binary search for where an
+     * oplogReplay query starts and scan forward from there instead of walking back from the end.
+     *
+     * The first time it is used after startup it is loaded with the first op of each extent, a
+     * coarse start that the checkpoints taken as ops are logged replace as the oplog cycles.
+     * It is forgotten when the oplog is truncated, emptied or dropped, or local is closed.
+     * Checkpoints older than the oldest op left may point at reused space and are never read.
+     *
+     * Ops are noted under the local write lock; lookups may come from several readers at once,
+     * so the checkpoints are kept behind a mutex.
+     */
+    class OplogStartIndex : boost::noncopyable {
+    public:
+        OplogStartIndex();
+
+        /** @return the index of ns if it is an oplog, otherwise 0 */
+        static OplogStartIndex* forNs( const char *ns );
+
+        /** forgets what is known about ns, if it is an oplog */
+        static void invalidate( const char *ns );
+
+        /** forgets both oplogs' indexes, e.g. as local is being closed */
+        static void invalidateAll();
+
+        /** notes the op of len bytes just written at loc, taking a checkpoint if it is due */
+        void noteInsert( NamespaceDetails *d, const OpTime &ts, const DiskLoc &loc, int len );
+
+        /**
+         * @return the latest checkpoint whose op doesn't match, for a forward scan to the first
+         * op that does.  Null if the index can't narrow the search: the first match comes before
+         * the first usable checkpoint or after the last one, where the scan back from the end
+         * is as short.
+         * @param oldest the ts of the first op in the oplog
+         */
+        DiskLoc findStart( NamespaceDetails *d, const OpTime &oldest, const Matcher &matcher );
+
+    private:
+        struct Checkpoint {
+            Checkpoint( const OpTime &t, const DiskLoc &l, long long w ) : ts( t ), loc( l ), written( w ) {}
+            bool operator<( const OpTime &t ) const { return ts < t; }
+            bool operator<( const Checkpoint &c ) const { return ts < c.ts; }
+            OpTime ts;
+            DiskLoc loc;
+            long long written; // _written when it was taken
+        };
+
+        void _reset();
+        void _load( NamespaceDetails *d );
+
+        SimpleMutex _m;
+        std::deque<Checkpoint> _checkpoints;
+        bool _loaded;
+        long long _written;        // bytes noted since loading
+        long long _lastCheckpoint; // _written at the last checkpoint
+        long long _capacity;       // storage size of the oplog; older checkpoints are overwritten
+    };
     
     /** Implements an optimized procedure for finding the first op in the oplog. */
     class FindingStartCursor {
@@ -129,7 +263,8 @@ namespace mongo {
         void destroyClientCursor() {
             _findingStartCursor.reset( 0 );
         }
-        bool firstDocMatchesOrEmpty() const;
+        /** sets oldest to the ts of the first op, unless the oplog is empty */
+        bool firstDocMatchesOrEmpty( OpTime *oldest ) const;
     };
 
     class Sync {
@@ -20,13 +20,23 @@ namespace mongo {
     public:
         OplogReader( bool doHandshake = true );
         ~OplogReader() { }
-        void resetCursor() { cursor.reset(); }
+        void resetCursor() {
+            bool wasStreaming = cursor.get() && cursor->streaming();
+            cursor.reset();
+            if ( wasStreaming )
+                reconnect();
+        }
         void resetConnection() {
             cursor.reset();
             _conn.reset();
         }
+        /** don't send anything on this while a tailing query with QueryOption_Exhaust is open */
         DBClientConnection* conn() { return _conn.get(); }
         BSONObj findOne(const char *ns, const Query& q) {
+            // a streaming cursor has the connection to itself
+            if ( cursor.get() && cursor->streaming() )
+                resetCursor();
+            uassert( 16365, "lost the connection to the sync source", conn() );
             return conn()->findOne(ns, q, 0, QueryOption_SlaveOk);
         }
         BSONObj getLastOp(const char *ns) {
@@ -106,6 +116,9 @@ namespace mongo {
         void putBack(BSONObj op) { cursor->putBack(op); }
         
     private:
+        /** replaces the connection with a fresh one to the same host */
+        void reconnect();
+
         /** @return true iff connection was successful */ 
         bool commonConnect(const string& hostName);
         bool passthroughHandshake(const BSONObj& rid, const int f);
@@ -18,13 +18,122 @@
 
 #include "count.h"
 
+#include <boost/thread/thread.hpp>
+
 #include "../client.h"
 #include "../clientcursor.h"
 #include "../namespace.h"
 #include "../queryutil.h"
 #include "mongo/client/dbclientinterface.h"
+#include "mongo/db/curop.h"
+#include "mongo/db/matcher.h"
 
 namespace mongo {
+
+    /** @return true if 'query' has a $where at any depth, which needs the thread's js scope. */
+    static bool hasWhere( const BSONObj &query ) {
+        BSONObjIterator i( query );
+        while( i.more() ) {
+            BSONElement e = i.next();
+            if ( str::equals( e.fieldName(), "$where" ) ||
+                ( e.isABSONObj() && hasWhere( e.embeddedObject() ) ) ) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * The matches of a query among a collection's extents, counted by several threads.  Each
+     * thread takes the next extent no thread has taken, so a few large extents don't leave the
+     * other threads idle.  The threads read records without a lock of their own, relying on the
+     * thread which started them holding the read lock until they finish.
+     */
+    class ParallelCount : boost::noncopyable {
+    public:
+        typedef vector< pair< MongoDataFile*, Extent* > > Extents;
+
+        ParallelCount( const BSONObj &query, const Extents &extents ) :
+            _query( query ),
+            _extents( extents ),
+            _count(),
+            _stop(),
+            _m( "ParallelCount" ) {
+        }
+
+        /** The body of each thread. */
+        void run() {
+            Client::initThread( "parallelCount" );
+            try {
+                Matcher matcher( _query );
+                long long count = 0;
+                unsigned i;
+                while( !_stop && ( i = _next++ ) < _extents.size() ) {
+                    MongoDataFile *file = _extents[ i ].first;
+                    DiskLoc loc = _extents[ i ].second->firstRecord;
+                    while( !loc.isNull() && !_stop ) {
+                        Record *r = file->recordAt( loc );
+                        if ( matcher.matches( BSONObj::make( r ) ) ) {
+                            ++count;
+                        }
+                        loc = r->nextInExtent( loc );
+                    }
+                }
+                SimpleMutex::scoped_lock lk( _m );
+                _count += count;
+            }
+            catch( const std::exception &e ) {
+                SimpleMutex::scoped_lock lk( _m );
+                _error = e.what();
+                _stop = true;
+            }
+            cc().shutdown();
+        }
+
+        void stop() { _stop = true; }
+        long long count() const { return _count; }
+        const string &error() const { return _error; }
+
+    private:
+        BSONObj _query;
+        const Extents &_extents;
+        AtomicUInt _next;
+        long long _count;
+        volatile bool _stop;
+        string _error;
+        SimpleMutex _m;
+    };
+
+    static long long parallelCount( NamespaceDetails *d, const BSONObj &query, int nThreads ) {
+        ParallelCount::Extents extents;
+        Database *database = cc().database();
+        for( DiskLoc ext = d->firstExtent; !ext.isNull(); ext = ext.ext()->xnext ) {
+            extents.push_back( make_pair( database->getFile( ext.a() ), ext.ext() ) );
+        }
+        nThreads = min( min( nThreads, ParallelCountMaxThreads ), (int)extents.size() );
+
+        ParallelCount count( query, extents );
+        vector< shared_ptr< boost::thread > > threads;
+        for( int i = 0; i < nThreads; ++i ) {
+            threads.push_back( shared_ptr< boost::thread >
+                              ( new boost::thread( boost::bind( &ParallelCount::run,
+                                                                &count ) ) ) );
+        }
+        const char *interrupted = "";
+        for( unsigned i = 0; i < threads.size(); ++i ) {
+            while( !threads[ i ]->timed_join( boost::posix_time::milliseconds( 100 ) ) ) {
+                if ( !*interrupted ) {
+                    interrupted = killCurrentOp.checkForInterruptNoAssert();
+                    if ( *interrupted ) {
+                        count.stop();
+                    }
+                }
+            }
+        }
+        uassert( 11601, interrupted, !*interrupted );
+        uassert( 16346, "parallel count failed: " + count.error(), count.error().empty() );
+        return count.count();
+    }
     
     long long runCount( const char *ns, const BSONObj &cmd, string &err ) {
         Client::Context cx(ns);
@@ -56,6 +165,12 @@ namespace mongo {
         ClientCursor::Holder ccPointer;
         ElapsedTracker timeToStartYielding( 256, 20 );
         try {
+            int parallel = cmd["parallel"].numberInt();
+            if ( parallel > 1 && dynamic_cast<BasicCursor*>( cursor.get() ) &&
+                !d->isCapped() && !hasWhere( query ) ) {
+                return applySkipLimit( parallelCount( d, query, parallel ), cmd );
+            }
+
             while( cursor->ok() ) {
                 if ( !ccPointer ) {
                     if ( timeToStartYielding.intervalHasElapsed() ) {
@@ -22,9 +22,14 @@
 namespace mongo {
     
     /**
-     * { count: "collectionname"[, query: <query>] }
+     * { count: "collectionname"[, query: <query>][, parallel: <threads>] }
+     * With 'parallel', a count which would scan the whole collection splits its extents among up
+     * to that many threads, at most ParallelCountMaxThreads.  The read lock is held, without
+     * yielding, until the scan is done.
      * @return -1 on ns does not exist error and other errors, 0 on other errors, otherwise the match count.
      */
     long long runCount(const char *ns, const BSONObj& cmd, string& err);
+
+    const int ParallelCountMaxThreads = 32;
     
 } // namespace mongo
@@ -66,6 +66,7 @@ namespace mongo {
         CursorId id = cc->cursorid();
 
         bool canYield = !god && !(creal->matcher() && creal->matcher()->docMatcher().atomic());
+        DiskLoc touchedBeforeDelete;
 
         do {
             // TODO: we can generalize this I believe
@@ -98,6 +99,20 @@ namespace mongo {
 
             bool match = creal->currentMatches();
 
+            if ( match && canYield && rloc != touchedBeforeDelete ) {
+                // unindexing faults on any bucket not in memory while we hold the write lock;
+                // instead touch them with the lock released, then look at this document again.
+                touchedBeforeDelete = rloc;
+                bool yielded;
+                if ( ! cc->yieldSometimes( ClientCursor::WillModify, &yielded ) ) {
+                    cc.release();
+                    break;
+                }
+                if ( yielded ) {
+                    continue;
+                }
+            }
+
             cc->advance();
             
             if ( ! match )
@@ -122,7 +137,8 @@ namespace mongo {
                     BSONObjBuilder b;
                     b.append( e );
                     bool replJustOne = true;
-                    logOp( "d", ns, b.done(), 0, &replJustOne );
+                    logOp( "d", ns, b.done(), 0, &replJustOne, false,
+                           oplogPreImages ? rloc.obj() : BSONObj() );
                 }
                 else {
                     problem() << "deleted object without id, not logging" << endl;
@@ -22,6 +22,7 @@
 #include "../clientcursor.h"
 #include "../oplog.h"
 #include "../../bson/util/builder.h"
+#include "../btree.h"
 #include "../replutil.h"
 #include "../scanandorder.h"
 #include "../commands.h"
@@ -30,6 +31,8 @@
 #include "../../server.h"
 #include "../queryoptimizercursor.h"
 #include "../pagefault.h"
+#include "../reply_buffers.h"
+#include "../record_checksums.h"
 
 namespace mongo {
 
@@ -87,7 +90,8 @@ namespace mongo {
 
         int bufSize = 512 + sizeof( QueryResult ) + MaxBytesToReturnToClientAtOnce;
 
-        BufBuilder b( bufSize );
+        BufBuilder b( 0 );
+        ReplyBuffers::reserve( b, bufSize );
         b.skip(sizeof(QueryResult));
         int resultFlags = ResultFlag_AwaitCapable;
         int start = 0;
@@ -113,6 +117,7 @@ namespace mongo {
             Cursor *c = cc->c();
             c->recoverFromYield();
             DiskLoc last;
+            bool sampleChecksums = RecordChecksums::enabled( nsdetails( ns ) );
 
             // This manager may be stale, but it's the state of chunking when the cursor was created.
             ShardChunkManagerPtr manager = cc->getChunkManager();
@@ -155,6 +160,8 @@ namespace mongo {
                         last = c->currLoc();
                         n++;
 
+                        if ( sampleChecksums && ! c->keyFieldsOnly() && ! last.isNull() )
+                            RecordChecksums::sample( ns, c->_current(), last );
                         cc->fillQueryResultFromObj( b );
 
                         if ( ( ntoreturn && n >= ntoreturn ) || b.len() > MaxBytesToReturnToClientAtOnce ) {
@@ -196,6 +203,7 @@ namespace mongo {
         qr->cursorId = cursorid;
         qr->startingFrom = start;
         qr->nReturned = n;
+        ReplyBuffers::sending( b );
         b.decouple();
 
         return qr;
@@ -209,6 +217,7 @@ namespace mongo {
     shared_ptr<ExplainQueryInfo> ExplainRecordingStrategy::doneQueryInfo() {
         shared_ptr<ExplainQueryInfo> ret = _doneQueryInfo();
         ret->setAncillaryInfo( _ancillaryInfo );
+        ret->setStageTimes( _stageTimes );
         return ret;
     }
     
@@ -289,7 +298,9 @@ namespace mongo {
     _parsedQuery( parsedQuery ),
     _cursor( cursor ),
     _queryOptimizerCursor( dynamic_pointer_cast<QueryOptimizerCursor>( _cursor ) ),
-    _buf( buf ) {
+    _buf( buf ),
+    _uncompressOplog( str::equals( parsedQuery.ns(), rsoplog ) ),
+    _sampleChecksums( RecordChecksums::enabled( nsdetails( parsedQuery.ns() ) ) ) {
     }
 
     void ResponseBuildStrategy::resetBuf() {
@@ -309,17 +320,86 @@ namespace mongo {
                 return keyFieldsOnly->hydrate( _cursor->currKey() );
             }
         }
+        if ( _sampleChecksums ) {
+            RecordChecksums::sample( _parsedQuery.ns(), _cursor->_current(), _cursor->currLoc() );
+        }
         BSONObj ret = _cursor->current();
         verify( ret.isValid() );
+        if ( _uncompressOplog ) {
+            return uncompressOplogEntry( ret );
+        }
         return ret;
     }
 
+    /**
+     * @return true if every key within the bounds of an index with 'keyPattern' matches 'query':
+     * each field is indexed and compared only by equality to a simple value or by $gt, $gte, $lt
+     * and $lte, whose ranges are the bounds.
+     */
+    static bool boundsMatchQuery( const BSONObj &query, const BSONObj &keyPattern ) {
+        BSONObjIterator i( query );
+        while( i.more() ) {
+            BSONElement e = i.next();
+            if ( !keyPattern[ e.fieldName() ].isNumber() ) {
+                return false;
+            }
+            if ( e.type() == RegEx || e.type() == Array ) {
+                return false;
+            }
+            if ( e.type() != Object ) {
+                continue;
+            }
+            BSONObjIterator j( e.embeddedObject() );
+            if ( !j.more() ) {
+                return false;
+            }
+            while( j.more() ) {
+                BSONElement op = j.next();
+                switch( op.getGtLtOp( -1 ) ) {
+                    case BSONObj::GT:
+                    case BSONObj::GTE:
+                    case BSONObj::LT:
+                    case BSONObj::LTE:
+                        break;
+                    default:
+                        return false;
+                }
+                if ( op.mayEncapsulate() || op.type() == RegEx ) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @return 'cursor' if skipped matches may be passed over without looking at each: a btree
+     * cursor with a single key per document, whose bounds match just what the query does.  Not
+     * for explain, which counts each match, or a sharded collection, whose orphans don't count.
+     */
+    static BtreeCursor *keySkipCursor( const ParsedQuery &parsedQuery,
+                                       const shared_ptr<Cursor> &cursor ) {
+        if ( parsedQuery.getSkip() == 0 || parsedQuery.isExplain() ||
+            shardingState.needShardChunkManager( parsedQuery.ns() ) ) {
+            return 0;
+        }
+        BtreeCursor *btreeCursor = dynamic_cast<BtreeCursor*>( cursor.get() );
+        if ( !btreeCursor || btreeCursor->isMultiKey() ) {
+            return 0;
+        }
+        if ( !boundsMatchQuery( parsedQuery.getFilter(), btreeCursor->indexKeyPattern() ) ) {
+            return 0;
+        }
+        return btreeCursor;
+    }
+
     OrderedBuildStrategy::OrderedBuildStrategy( const ParsedQuery &parsedQuery,
                                                const shared_ptr<Cursor> &cursor,
                                                BufBuilder &buf ) :
     ResponseBuildStrategy( parsedQuery, cursor, buf ),
     _skip( _parsedQuery.getSkip() ),
-    _bufferedMatches() {
+    _bufferedMatches(),
+    _keySkipCursor( keySkipCursor( _parsedQuery, _cursor ) ) {
     }
     
     bool OrderedBuildStrategy::handleMatch( bool &orderedMatch ) {
@@ -329,6 +409,11 @@ namespace mongo {
         }
         if ( _skip > 0 ) {
             --_skip;
+            if ( _keySkipCursor && _skip > 0 ) {
+                // in batches so the query still yields; the last key skipped is advanced past by
+                // the caller
+                _skip -= (int) _keySkipCursor->advanceKeys( std::min( _skip, 10000 ) );
+            }
             return orderedMatch = false;
         }
         // Explain does not obey soft limits, so matches should not be buffered.
@@ -343,16 +428,20 @@ namespace mongo {
     ReorderBuildStrategy* ReorderBuildStrategy::make( const ParsedQuery& parsedQuery,
                                                       const shared_ptr<Cursor>& cursor,
                                                       BufBuilder& buf,
-                                                      const QueryPlanSummary& queryPlan ) {
-        auto_ptr<ReorderBuildStrategy> ret( new ReorderBuildStrategy( parsedQuery, cursor, buf ) );
+                                                      const QueryPlanSummary& queryPlan,
+                                                      bool allowSpill ) {
+        auto_ptr<ReorderBuildStrategy> ret( new ReorderBuildStrategy( parsedQuery, cursor, buf,
+                                                                      allowSpill ) );
         ret->init( queryPlan );
         return ret.release();
     }
 
     ReorderBuildStrategy::ReorderBuildStrategy( const ParsedQuery &parsedQuery,
                                                const shared_ptr<Cursor> &cursor,
-                                               BufBuilder &buf ) :
+                                               BufBuilder &buf,
+                                               bool allowSpill ) :
     ResponseBuildStrategy( parsedQuery, cursor, buf ),
+    _allowSpill( allowSpill ),
     _bufferedMatches() {
     }
     
@@ -381,6 +470,10 @@ namespace mongo {
         _bufferedMatches = ret;
         return ret;
     }
+
+    shared_ptr<Cursor> ReorderBuildStrategy::remainingResults() {
+        return _scanAndOrder->remaining();
+    }
     
     ScanAndOrder *
     ReorderBuildStrategy::newScanAndOrder( const QueryPlanSummary &queryPlan ) const {
@@ -398,7 +491,9 @@ namespace mongo {
         return new ScanAndOrder( _parsedQuery.getSkip(),
                                 _parsedQuery.getNumToReturn(),
                                 _parsedQuery.getOrder(),
-                                *fieldRangeSet );
+                                *fieldRangeSet,
+                                _parsedQuery.getMaxSortBytes(),
+                                _allowSpill && _parsedQuery.sortSpill() );
     }
 
     HybridBuildStrategy* HybridBuildStrategy::make( const ParsedQuery& parsedQuery,
@@ -418,8 +513,9 @@ namespace mongo {
     }
 
     void HybridBuildStrategy::init() {
+        // no spilling, as the memory limit exception is what retires an out of order plan here
         _reorderBuild.reset( ReorderBuildStrategy::make( _parsedQuery, _cursor, _buf,
-                                                         QueryPlanSummary() ) );
+                                                         QueryPlanSummary(), false ) );
     }
 
     bool HybridBuildStrategy::handleMatch( bool &orderedMatch ) {
@@ -486,7 +582,8 @@ namespace mongo {
     _parsedQuery( parsedQuery ),
     _cursor( cursor ),
     _queryOptimizerCursor( dynamic_pointer_cast<QueryOptimizerCursor>( _cursor ) ),
-    _buf( 32768 ) { // TODO be smarter here
+    _buf( 0 ) {
+        ReplyBuffers::reserve( _buf, 32768 ); // TODO be smarter here
     }
     
     void QueryResponseBuilder::init( const QueryPlanSummary &queryPlan, const BSONObj &oldPlan ) {
@@ -497,14 +594,32 @@ namespace mongo {
     }
 
     bool QueryResponseBuilder::addMatch() {
-        if ( !currentMatches() ) {
+        ExplainStageTimes *stageTimes = _explain->stageTimes();
+        if ( stageTimes ) {
+            // Only explain pays for the timers.
+            Timer matchTimer;
+            bool matches = currentMatches();
+            stageTimes->_matchMicros += matchTimer.micros();
+            if ( !matches ) {
+                return false;
+            }
+        }
+        else if ( !currentMatches() ) {
             return false;
         }
         if ( !chunkMatches() ) {
             return false;
         }
         bool orderedMatch = false;
-        bool match = _builder->handleMatch( orderedMatch );
+        bool match;
+        if ( stageTimes ) {
+            Timer projectTimer;
+            match = _builder->handleMatch( orderedMatch );
+            stageTimes->_projectMicros += projectTimer.micros();
+        }
+        else {
+            match = _builder->handleMatch( orderedMatch );
+        }
         _explain->noteIterate( match, orderedMatch, true, false );
         return match;
     }
@@ -543,12 +658,20 @@ namespace mongo {
             return 1;
         }
         if ( _buf.len() > 0 ) {
+            ReplyBuffers::sending( _buf );
             result.appendData( _buf.buf(), _buf.len() );
             _buf.decouple();
         }
         return _builder->bufferedMatches();
     }
 
+    shared_ptr<Cursor> QueryResponseBuilder::remainingResults() {
+        if ( _parsedQuery.isExplain() ) {
+            return shared_ptr<Cursor>();
+        }
+        return _builder->remainingResults();
+    }
+
     ShardChunkManagerPtr QueryResponseBuilder::newChunkManager() const {
         if ( !shardingState.needShardChunkManager( _parsedQuery.ns() ) ) {
             return ShardChunkManagerPtr();
@@ -595,15 +718,25 @@ namespace mongo {
         if ( singlePlan ||
             !queryOptimizerPlans.mayRunInOrderPlan() ) {
             return shared_ptr<ResponseBuildStrategy>
-            ( ReorderBuildStrategy::make( _parsedQuery, _cursor, _buf, queryPlan ) );
+            ( ReorderBuildStrategy::make( _parsedQuery, _cursor, _buf, queryPlan, true ) );
         }
         return shared_ptr<ResponseBuildStrategy>
         ( HybridBuildStrategy::make( _parsedQuery, _queryOptimizerCursor, _buf ) );
     }
 
     bool QueryResponseBuilder::currentMatches() {
+        ExplainStageTimes *stageTimes = _explain->stageTimes();
+        bool inMemory = true;
+        if ( stageTimes ) {
+            DiskLoc loc = _cursor->currLoc();
+            inMemory = loc.isNull() || loc.rec()->likelyInPhysicalMemory();
+        }
         MatchDetails details;
-        if ( _cursor->currentMatches( &details ) ) {
+        bool matches = _cursor->currentMatches( &details );
+        if ( !inMemory && details.hasLoadedRecord() ) {
+            ++stageTimes->_recordsNotInMemory;
+        }
+        if ( matches ) {
             return true;
         }
         _explain->noteIterate( false, false, details.hasLoadedRecord(), false );
@@ -622,8 +755,32 @@ namespace mongo {
         return false;
     }
     
+    /** Advance 'cursor', adding the time taken to 'stageTimes' if they are recorded. */
+    static void advanceCursor( Cursor &cursor, ExplainStageTimes *stageTimes ) {
+        if ( !stageTimes ) {
+            cursor.advance();
+            return;
+        }
+        Timer advanceTimer;
+        cursor.advance();
+        stageTimes->_advanceMicros += advanceTimer.micros();
+    }
+
+    /** @return true if the reply to 'pq' may be taken from, and saved in, the result cache. */
+    static bool queryResultCacheable( const char *ns, const ParsedQuery &pq ) {
+        NamespaceDetails *d = nsdetails( ns );
+        return d && d->isUserFlagSet( NamespaceDetails::Flag_CacheQueryResults ) &&
+                !pq.isExplain() &&
+                !pq.hasOption( QueryOption_CursorTailable ) &&
+                !pq.hasOption( QueryOption_OplogReplay ) &&
+                !pq.hasOption( QueryOption_Exhaust ) &&
+                !shardingState.needShardChunkManager( ns );
+    }
+
     /**
      * Run a query with a cursor provided by the query optimizer, or FindingStartCursor.
+     * @param resultCacheKey - if not empty, a reply holding every result, computed without
+     * yielding, is saved in the collection's QueryResultCache under this key.
      * @yields the db lock.
      */
     const char *queryWithQueryOptimizer( Message &m, int queryOptions, const char *ns,
@@ -632,6 +789,7 @@ namespace mongo {
                                         const shared_ptr<ParsedQuery> &pq_shared,
                                         const BSONObj &oldPlan,
                                         const ConfigVersion &shardingVersionAtStart,
+                                        const string &resultCacheKey,
                                         Message &result ) {
 
         const ParsedQuery &pq( *pq_shared );
@@ -652,16 +810,27 @@ namespace mongo {
                 ( QueryResponseBuilder::make( pq, cursor, queryPlan, oldPlan ) );
         bool saveClientCursor = false;
         const char *exhaust = 0;
+        bool everYielded = false;
         OpTime slaveReadTill;
         ClientCursor::Holder ccPointer( new ClientCursor( QueryOption_NoCursorTimeout, cursor,
                                                          ns ) );
         
-        for( ; cursor->ok(); cursor->advance() ) {
+        ExplainStageTimes *stageTimes = queryResponseBuilder->stageTimes();
+        for( ; cursor->ok(); advanceCursor( *cursor, stageTimes ) ) {
 
             bool yielded = false;
-            if ( !ccPointer->yieldSometimes( ClientCursor::MaybeCovered, &yielded ) ||
-                !cursor->ok() ) {
+            bool yieldOk;
+            if ( stageTimes ) {
+                Timer yieldTimer;
+                yieldOk = ccPointer->yieldSometimes( ClientCursor::MaybeCovered, &yielded );
+                stageTimes->_yieldMicros += yieldTimer.micros();
+            }
+            else {
+                yieldOk = ccPointer->yieldSometimes( ClientCursor::MaybeCovered, &yielded );
+            }
+            if ( !yieldOk || !cursor->ok() ) {
                 cursor.reset();
+                everYielded = true;
                 queryResponseBuilder->noteYield();
                 // !!! TODO The queryResponseBuilder still holds cursor.  Currently it will not do
                 // anything unsafe with the cursor in handoff(), but this is very fragile.
@@ -675,6 +844,7 @@ namespace mongo {
             }
 
             if ( yielded ) {
+                everYielded = true;
                 queryResponseBuilder->noteYield();
             }
             
@@ -733,6 +903,15 @@ namespace mongo {
 
         int nReturned = queryResponseBuilder->handoff( result );
 
+        if ( pq.wantMore() && pq.getNumToReturn() != 1 ) {
+            // a sort that went to disk returns the rest of its results from there
+            shared_ptr<Cursor> sorted = queryResponseBuilder->remainingResults();
+            if ( sorted ) {
+                cursor = sorted;
+                saveClientCursor = true;
+            }
+        }
+
         ccPointer.reset();
         long long cursorid = 0;
         if ( saveClientCursor ) {
@@ -783,6 +962,11 @@ namespace mongo {
         qr->setOperation(opReply);
         qr->startingFrom = 0;
         qr->nReturned = nReturned;
+
+        // Without a yield no write could have changed the results while they were read.
+        if ( !resultCacheKey.empty() && cursorid == 0 && !everYielded ) {
+            NamespaceDetailsTransient::get( ns ).queryResultCache().put( resultCacheKey, qr );
+        }
         
         int duration = curop.elapsedMillis();
         bool dbprofile = curop.shouldDBProfile( duration );
@@ -872,7 +1056,8 @@ namespace mongo {
         if ( pq.couldBeCommand() ) {
             BufBuilder bb;
             bb.skip(sizeof(QueryResult));
-            BSONObjBuilder cmdResBuf;
+            // the command's result is built in place in the reply, rather than copied there
+            BSONObjBuilder cmdResBuf( bb );
             if ( runCommands(ns, jsobj, curop, bb, cmdResBuf, false, queryOptions) ) {
                 curop.debug().iscommand = true;
                 curop.debug().query = jsobj;
@@ -942,6 +1127,21 @@ namespace mongo {
                     }
                 }
                 
+                // Answer a repeated query from the result cache.
+
+                string resultCacheKey;
+                if ( queryResultCacheable( ns, pq ) ) {
+                    resultCacheKey = QueryResultCache::makeKey( q );
+                    if ( NamespaceDetailsTransient::get( ns ).queryResultCache()
+                            .get( resultCacheKey, result ) ) {
+                        QueryResult *qr = (QueryResult *) result.header();
+                        curop.debug().cachedResult = true;
+                        curop.debug().responseLength = qr->len;
+                        curop.debug().nreturned = qr->nReturned;
+                        return NULL;
+                    }
+                }
+
                 // Run a regular query.
                 
                 BSONObj oldPlan;
@@ -951,7 +1151,8 @@ namespace mongo {
                 }
                 
                 return queryWithQueryOptimizer( m, queryOptions, ns, jsobj, curop, query, order,
-                                                pq_shared, oldPlan, shardingVersionAtStart, result );
+                                                pq_shared, oldPlan, shardingVersionAtStart,
+                                                resultCacheKey, result );
             }
             catch ( PageFaultException& e ) {
                 e.touch();
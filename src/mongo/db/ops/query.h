@@ -30,6 +30,7 @@
 
 namespace mongo {
 
+    class BtreeCursor;
     class ParsedQuery;
     class QueryOptimizerCursor;
     class QueryPlanSummary;
@@ -61,6 +62,8 @@ namespace mongo {
         virtual void noteYield() {}
         /** @return number of ordered matches noted. */
         virtual long long orderedMatches() const { return 0; }
+        /** @return the stage times to add to, or 0 if explain events are not recorded. */
+        virtual ExplainStageTimes *stageTimes() { return &_stageTimes; }
         /** @return ExplainQueryInfo for a complete query. */
         shared_ptr<ExplainQueryInfo> doneQueryInfo();
     protected:
@@ -68,12 +71,14 @@ namespace mongo {
         virtual shared_ptr<ExplainQueryInfo> _doneQueryInfo() = 0;
     private:
         ExplainQueryInfo::AncillaryInfo _ancillaryInfo;
+        ExplainStageTimes _stageTimes;
     };
     
     /** No explain events are recorded. */
     class NoExplainStrategy : public ExplainRecordingStrategy {
     public:
         NoExplainStrategy();
+        virtual ExplainStageTimes *stageTimes() { return 0; }
     private:
         /** @asserts always. */
         virtual shared_ptr<ExplainQueryInfo> _doneQueryInfo();
@@ -151,6 +156,11 @@ namespace mongo {
          * to getMore.
          */
         virtual void finishedFirstBatch() {}
+        /**
+         * @return a cursor over the results that didn't fit in the buffer, once matches have been
+         * rewritten, or null if there are none or they come from the original cursor.
+         */
+        virtual shared_ptr<Cursor> remainingResults() { return shared_ptr<Cursor>(); }
         /** Reset the buffer. */
         void resetBuf();
     protected:
@@ -163,6 +173,8 @@ namespace mongo {
         shared_ptr<Cursor> _cursor;
         shared_ptr<QueryOptimizerCursor> _queryOptimizerCursor;
         BufBuilder &_buf;
+        const bool _uncompressOplog; // see oplogCompression
+        const bool _sampleChecksums; // see RecordChecksums
     };
 
     /** Build strategy for a cursor returning in order results. */
@@ -175,6 +187,7 @@ namespace mongo {
     private:
         int _skip;
         int _bufferedMatches;
+        BtreeCursor *_keySkipCursor; // to skip a run of keys at a time, if every key matches
     };
     
     class ScanAndOrder;
@@ -185,18 +198,23 @@ namespace mongo {
         static ReorderBuildStrategy* make( const ParsedQuery& parsedQuery,
                                            const shared_ptr<Cursor>& cursor,
                                            BufBuilder& buf,
-                                           const QueryPlanSummary& queryPlan );
+                                           const QueryPlanSummary& queryPlan,
+                                           bool allowSpill );
         virtual bool handleMatch( bool &orderedMatch );
         /** Handle a match without performing deduping. */
         void _handleMatchNoDedup();
         virtual int rewriteMatches();
         virtual int bufferedMatches() const { return _bufferedMatches; }
+        virtual shared_ptr<Cursor> remainingResults();
     private:
+        /** @param allowSpill let a $sortSpill query's sort go to disk */
         ReorderBuildStrategy( const ParsedQuery& parsedQuery,
                               const shared_ptr<Cursor>& cursor,
-                              BufBuilder& buf );
+                              BufBuilder& buf,
+                              bool allowSpill );
         void init( const QueryPlanSummary& queryPlan );
         ScanAndOrder *newScanAndOrder( const QueryPlanSummary &queryPlan ) const;
+        const bool _allowSpill;
         shared_ptr<ScanAndOrder> _scanAndOrder;
         int _bufferedMatches;
     };
@@ -256,6 +274,8 @@ namespace mongo {
         bool addMatch();
         /** Note that a yield occurred. */
         void noteYield();
+        /** @return the explain stage times to add to, or 0 if this is not an explain query. */
+        ExplainStageTimes *stageTimes() { return _explain->stageTimes(); }
         /** @return true if there are enough results to return the first batch. */
         bool enoughForFirstBatch() const;
         /** @return true if there are enough results to return the full result set. */
@@ -270,6 +290,8 @@ namespace mongo {
          * @return the number of results in the buffer.
          */
         int handoff( Message &result );
+        /** @return a cursor over results past those handed off, for a sort that went to disk. */
+        shared_ptr<Cursor> remainingResults();
         /** A chunk manager found at the beginning of the query. */
         ShardChunkManagerPtr chunkManager() const { return _chunkManager; }
 
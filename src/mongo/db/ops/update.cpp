@@ -21,6 +21,7 @@
 #include "mongo/db/oplog.h"
 #include "mongo/db/pagefault.h"
 #include "mongo/db/queryutil.h"
+#include "mongo/db/record_checksums.h"
 #include "mongo/client/dbclientinterface.h"
 
 #include "update.h"
@@ -85,17 +86,43 @@ namespace mongo {
            regular ones at the moment. */
         if ( isOperatorUpdate ) {
             const BSONObj& onDisk = loc.obj();
+            BSONObj pre = logop && oplogPreImages ? onDisk.getOwned() : BSONObj();
+
+            BSONObj singleOpLog;
+            if ( mods->applySingleInPlace( onDisk , &singleOpLog ) ) {
+                DEBUGUPDATE( "\t\t\t updateById doing single in place update" );
+                if ( RecordChecksums::extra( d ) )
+                    RecordChecksums::update( r );
+                if ( nsdt ) {
+                    nsdt->notifyOfWriteOp();
+                    nsdt->recordGrowth().noteUpdate( d, onDisk.objsize(), onDisk.objsize(), false, 0 );
+                }
+                if ( logop ) {
+                    logOp("u", ns, singleOpLog.isEmpty() ? updateobj : singleOpLog,
+                          &patternOrig, 0, fromMigrate, pre );
+                }
+                return UpdateResult( 1 , 1 , 1 , BSONObj() );
+            }
+
             auto_ptr<ModSetState> mss = mods->prepare( onDisk );
 
-            if( mss->canApplyInPlace() ) {
+            // changing an indexed field in place would leave the index keys stale;
+            // updateRecord() below moves them
+            if( mss->canApplyInPlace() && mods->isIndexed() <= 0 ) {
                 mss->applyModsInPlace(true);
+                if ( RecordChecksums::extra( d ) )
+                    RecordChecksums::update( r );
                 DEBUGUPDATE( "\t\t\t updateById doing in place update" );
+                if ( nsdt ) {
+                    nsdt->notifyOfWriteOp();
+                    nsdt->recordGrowth().noteUpdate( d, onDisk.objsize(), onDisk.objsize(), false, 0 );
+                }
             }
             else {
                 BSONObj newObj = mss->createNewFromMods();
                 checkTooLarge(newObj);
                 verify(nsdt);
-                theDataFileMgr.updateRecord(ns, d, nsdt, r, loc , newObj.objdata(), newObj.objsize(), debug);
+                theDataFileMgr.updateRecord(ns, d, nsdt, r, loc , newObj.objdata(), newObj.objsize(), debug, false, mods);
             }
 
             if ( logop ) {
@@ -112,10 +139,10 @@ namespace mongo {
                 if( mss->needOpLogRewrite() ) {
                     DEBUGUPDATE( "\t rewrite update: " << mss->getOpLogRewrite() );
                     logOp("u", ns, mss->getOpLogRewrite() ,
-                          &pattern, 0, fromMigrate );
+                          &pattern, 0, fromMigrate, pre );
                 }
                 else {
-                    logOp("u", ns, updateobj, &pattern, 0, fromMigrate );
+                    logOp("u", ns, updateobj, &pattern, 0, fromMigrate, pre );
                 }
             }
             return UpdateResult( 1 , 1 , 1 , BSONObj() );
@@ -125,9 +152,10 @@ namespace mongo {
         BSONElementManipulator::lookForTimestamps( updateobj );
         checkNoMods( updateobj );
         verify(nsdt);
+        BSONObj pre = logop && oplogPreImages ? loc.obj().getOwned() : BSONObj();
         theDataFileMgr.updateRecord(ns, d, nsdt, r, loc , updateobj.objdata(), updateobj.objsize(), debug );
         if ( logop ) {
-            logOp("u", ns, updateobj, &patternOrig, 0, fromMigrate );
+            logOp("u", ns, updateobj, &patternOrig, 0, fromMigrate, pre );
         }
         return UpdateResult( 1 , 0 , 1 , BSONObj() );
     }
@@ -176,8 +204,9 @@ namespace mongo {
             modsIsIndexed = mods->isIndexed();
         }
 
-        if( planPolicy.permitOptimalIdPlan() && !multi && isSimpleIdQuery(patternOrig) && d &&
-           !modsIsIndexed ) {
+        // { _id : ... } updates, which include every update a secondary applies, go straight
+        // to the document through the _id index, without the query optimizer or a matcher.
+        if( planPolicy.permitOptimalIdPlan() && !multi && isSimpleIdQuery(patternOrig) && d ) {
             int idxNo = d->findIdIndex();
             if( idxNo >= 0 ) {
                 debug.idhack = true;
@@ -221,6 +250,9 @@ namespace mongo {
             set<DiskLoc> seenObjects;
             MatchDetails details;
             auto_ptr<ClientCursor> cc;
+            DiskLoc touchedBeforeUpdate;
+            // a multi update logs its documents together; yields flush what has been logged
+            scoped_ptr<OplogBatch> batch( multi && logop ? new OplogBatch() : 0 );
             do {
 
                 if ( cc.get() == 0 &&
@@ -287,6 +319,29 @@ namespace mongo {
                     continue;
                 }
 
+                if ( multi && modsIsIndexed > 0 && ! atomic &&
+                     c->currLoc() != touchedBeforeUpdate ) {
+                    // updating the indexes faults on any bucket not in memory while we hold the
+                    // write lock; instead touch them with the lock released, then look at this
+                    // document again.
+                    touchedBeforeUpdate = c->currLoc();
+                    if ( cc.get() == 0 ) {
+                        shared_ptr< Cursor > cPtr = c;
+                        cc.reset( new ClientCursor( QueryOption_NoCursorTimeout , cPtr , ns ) );
+                    }
+                    bool didYield;
+                    if ( ! cc->yieldSometimes( ClientCursor::WillModify, &didYield ) ) {
+                        cc.release();
+                        break;
+                    }
+                    if ( didYield ) {
+                        d = nsdetails(ns);
+                        nsdt = &NamespaceDetailsTransient::get(ns);
+                        debug.nscanned--; // counted again when it is read again
+                        continue;
+                    }
+                }
+
                 Record* r = c->_current();
                 DiskLoc loc = c->currLoc();
 
@@ -351,77 +406,106 @@ namespace mongo {
                         forceRewrite = true;
                     }
 
-                    auto_ptr<ModSetState> mss = useMods->prepare( onDisk );
-
-                    bool willAdvanceCursor = multi && c->ok() && ( modsIsIndexed || ! mss->canApplyInPlace() );
-
-                    if ( willAdvanceCursor ) {
-                        if ( cc.get() ) {
-                            cc->setDoingDeletes( true );
-                        }
-                        c->prepareToTouchEarlierIterate();
-                    }
-
-                    if ( modsIsIndexed <= 0 && mss->canApplyInPlace() ) {
-                        mss->applyModsInPlace( true );// const_cast<BSONObj&>(onDisk) );
+                    BSONObj pre = logop && oplogPreImages ? onDisk.getOwned() : BSONObj();
 
-                        DEBUGUPDATE( "\t\t\t doing in place update" );
+                    BSONObj singleOpLog;
+                    if ( !forceRewrite && useMods->applySingleInPlace( onDisk , &singleOpLog ) ) {
+                        // a counter style $inc or $set, written where it lies
+                        DEBUGUPDATE( "\t\t\t doing single in place update" );
+                        if ( RecordChecksums::extra( d ) )
+                            RecordChecksums::update( r );
                         if ( profile && !multi )
                             debug.fastmod = true;
-
-                        if ( modsIsIndexed ) {
-                            seenObjects.insert( loc );
+                        nsdt->notifyOfWriteOp();
+                        nsdt->recordGrowth().noteUpdate( d, onDisk.objsize(), onDisk.objsize(),
+                                                         false, 0 );
+                        if ( logop ) {
+                            logOp("u", ns, singleOpLog.isEmpty() ? updateobj : singleOpLog,
+                                  &pattern, 0, fromMigrate, pre );
                         }
-
-                        d->paddingFits();
+                        numModded++;
+                        if ( ! multi )
+                            return UpdateResult( 1 , 1 , numModded , BSONObj() );
                     }
                     else {
-                        if ( rs )
-                            rs->goingToDelete( onDisk );
-
-                        BSONObj newObj = mss->createNewFromMods();
-                        checkTooLarge(newObj);
-                        DiskLoc newLoc = theDataFileMgr.updateRecord(ns,
-                                                                     d,
-                                                                     nsdt,
-                                                                     r,
-                                                                     loc,
-                                                                     newObj.objdata(),
-                                                                     newObj.objsize(),
-                                                                     debug);
-
-                        if ( newLoc != loc || modsIsIndexed ){
-                            // log() << "Moved obj " << newLoc.obj()["_id"] << " from " << loc << " to " << newLoc << endl;
-                            // object moved, need to make sure we don' get again
-                            seenObjects.insert( newLoc );
+                        auto_ptr<ModSetState> mss = useMods->prepare( onDisk );
+
+                        bool willAdvanceCursor = multi && c->ok() && ( modsIsIndexed || ! mss->canApplyInPlace() );
+
+                        if ( willAdvanceCursor ) {
+                            if ( cc.get() ) {
+                                cc->setDoingDeletes( true );
+                            }
+                            c->prepareToTouchEarlierIterate();
                         }
 
-                    }
+                        if ( modsIsIndexed <= 0 && mss->canApplyInPlace() ) {
+                            mss->applyModsInPlace( true );// const_cast<BSONObj&>(onDisk) );
+                            if ( RecordChecksums::extra( d ) )
+                                RecordChecksums::update( r );
 
-                    if ( logop ) {
-                        DEV verify( mods->size() );
+                            DEBUGUPDATE( "\t\t\t doing in place update" );
+                            if ( profile && !multi )
+                                debug.fastmod = true;
 
-                        if ( mss->haveArrayDepMod() ) {
-                            BSONObjBuilder patternBuilder;
-                            patternBuilder.appendElements( pattern );
-                            mss->appendSizeSpecForArrayDepMods( patternBuilder );
-                            pattern = patternBuilder.obj();
-                        }
+                            if ( modsIsIndexed ) {
+                                seenObjects.insert( loc );
+                            }
 
-                        if ( forceRewrite || mss->needOpLogRewrite() ) {
-                            DEBUGUPDATE( "\t rewrite update: " << mss->getOpLogRewrite() );
-                            logOp("u", ns, mss->getOpLogRewrite() ,
-                                  &pattern, 0, fromMigrate );
+                            nsdt->notifyOfWriteOp();
+                            nsdt->recordGrowth().noteUpdate( d, onDisk.objsize(), onDisk.objsize(),
+                                                             false, 0 );
                         }
                         else {
-                            logOp("u", ns, updateobj, &pattern, 0, fromMigrate );
+                            if ( rs )
+                                rs->goingToDelete( onDisk );
+
+                            BSONObj newObj = mss->createNewFromMods();
+                            checkTooLarge(newObj);
+                            DiskLoc newLoc = theDataFileMgr.updateRecord(ns,
+                                                                         d,
+                                                                         nsdt,
+                                                                         r,
+                                                                         loc,
+                                                                         newObj.objdata(),
+                                                                         newObj.objsize(),
+                                                                         debug,
+                                                                         false,
+                                                                         useMods);
+
+                            if ( newLoc != loc || modsIsIndexed ){
+                                // log() << "Moved obj " << newLoc.obj()["_id"] << " from " << loc << " to " << newLoc << endl;
+                                // object moved, need to make sure we don' get again
+                                seenObjects.insert( newLoc );
+                            }
+
+                        }
+
+                        if ( logop ) {
+                            DEV verify( mods->size() );
+
+                            if ( mss->haveArrayDepMod() ) {
+                                BSONObjBuilder patternBuilder;
+                                patternBuilder.appendElements( pattern );
+                                mss->appendSizeSpecForArrayDepMods( patternBuilder );
+                                pattern = patternBuilder.obj();
+                            }
+
+                            if ( forceRewrite || mss->needOpLogRewrite() ) {
+                                DEBUGUPDATE( "\t rewrite update: " << mss->getOpLogRewrite() );
+                                logOp("u", ns, mss->getOpLogRewrite() ,
+                                      &pattern, 0, fromMigrate, pre );
+                            }
+                            else {
+                                logOp("u", ns, updateobj, &pattern, 0, fromMigrate, pre );
+                            }
                         }
+                        numModded++;
+                        if ( ! multi )
+                            return UpdateResult( 1 , 1 , numModded , BSONObj() );
+                        if ( willAdvanceCursor )
+                            c->recoverFromTouchingEarlierIterate();
                     }
-                    numModded++;
-                    if ( ! multi )
-                        return UpdateResult( 1 , 1 , numModded , BSONObj() );
-                    if ( willAdvanceCursor )
-                        c->recoverFromTouchingEarlierIterate();
 
                     if ( debug.nscanned % 64 == 0 && ! atomic ) {
                         if ( cc.get() == 0 ) {
@@ -439,7 +523,7 @@ namespace mongo {
                         nsdt = &NamespaceDetailsTransient::get(ns);
                     }
 
-                    getDur().commitIfNeeded();
+                    OplogBatch::commitIfNeeded();
 
                     continue;
                 }
@@ -448,10 +532,11 @@ namespace mongo {
 
                 BSONElementManipulator::lookForTimestamps( updateobj );
                 checkNoMods( updateobj );
+                BSONObj pre = logop && oplogPreImages ? loc.obj().getOwned() : BSONObj();
                 theDataFileMgr.updateRecord(ns, d, nsdt, r, loc , updateobj.objdata(), updateobj.objsize(), debug, su);
                 if ( logop ) {
                     DEV wassert( !su ); // super used doesn't get logged, this would be bad.
-                    logOp("u", ns, updateobj, &pattern, 0, fromMigrate );
+                    logOp("u", ns, updateobj, &pattern, 0, fromMigrate, pre );
                 }
                 return UpdateResult( 1 , 0 , 1 , BSONObj() );
             } while ( c->ok() );
@@ -497,6 +497,54 @@ namespace mongo {
         return mss;
     }
 
+    bool ModSet::touchesIndex( const IndexDetails& idx ) const {
+        set<string> keys;
+        idx.keyPattern().getFieldNames( keys );
+        return touchesIndex( keys );
+    }
+
+    bool ModSet::touchesIndex( const set<string>& idxKeys ) const {
+        for ( ModHolder::const_iterator i = _mods.begin(); i != _mods.end(); ++i ) {
+            if ( i->second.isIndexed( idxKeys ) )
+                return true;
+        }
+        return false;
+    }
+
+    bool ModSet::applySingleInPlace( const BSONObj& obj , BSONObj* opLogRewrite ) const {
+        if ( _mods.size() != 1 || _isIndexed > 0 || _hasDynamicArray )
+            return false;
+        const Mod& m = _mods.begin()->second;
+        if ( m.op != Mod::INC && m.op != Mod::SET )
+            return false;
+        BSONElement e = obj.getFieldDotted( m.fieldName );
+        if ( e.eoo() )
+            return false;
+
+        if ( m.op == Mod::SET ) {
+            if ( m.elt.type() != e.type() || m.elt.valuesize() != e.valuesize() )
+                return false;
+            BSONElementManipulator( e ).ReplaceTypeAndValue( m.elt );
+            return true;
+        }
+
+        // the same checks as prepare(), which reports a non number
+        if ( !e.isNumber() )
+            return false;
+        if ( m.elt.type() != e.type() && m.elt.type() == NumberDouble )
+            return false;
+        if ( e.type() == NumberInt && e.numberLong() + m.elt.numberLong() > numeric_limits<int>::max() )
+            return false;
+        m.IncrementMe( e );
+
+        BSONObjBuilder b;
+        BSONObjBuilder bb( b.subobjStart( "$set" ) );
+        bb.appendAs( e , m.fieldName );
+        bb.done();
+        *opLogRewrite = b.obj();
+        return true;
+    }
+
     void ModState::appendForOpLog( BSONObjBuilder& b ) const {
         if ( dontApply ) {
             return;
@@ -27,6 +27,7 @@
 
 namespace mongo {
 
+    class IndexDetails;
     class ModState;
     class ModSetState;
 
@@ -352,6 +353,20 @@ namespace mongo {
 
         int isIndexed() const { return _isIndexed; }
 
+        /** @return true if a mod here could change idx's keys */
+        bool touchesIndex( const IndexDetails& idx ) const;
+        /** @return true if a mod here could change an index key of these fields */
+        bool touchesIndex( const set<string>& idxKeys ) const;
+
+        /**
+         * for an update that is a lone $inc, or a $set of a value the same size as the one there,
+         * and changes no index keys: applies it straight to obj on disk, writing only the bytes of
+         * the value, without making a ModSetState.
+         * @param opLogRewrite set to what to log in place of the update, for an $inc
+         * @return false, and obj untouched, if it can't be done that way; prepare() it then
+         */
+        bool applySingleInPlace( const BSONObj& obj , BSONObj* opLogRewrite ) const;
+
         unsigned size() const { return _mods.size(); }
 
         bool haveModForField( const char* fieldName ) const {
@@ -6,6 +6,8 @@
 #include "client.h"
 #include "pdfile.h"
 #include "server.h"
+#include "stats/namespace_io.h"
+#include "mongo/util/trace_span.h"
 
 namespace mongo { 
 
@@ -15,10 +17,12 @@ namespace mongo {
         cc().getPageFaultRetryableSection()->didLap();
         r = _r;
         era = LockMongoFilesShared::getEra();
+        NamespaceIO::notePageFault();
         LOG(2) << "PageFaultException thrown" << endl;
     }
 
     void PageFaultException::touch() { 
+        TraceSpan span( TraceSpans::Fault );
         if ( Lock::isLocked() ) {
             warning() << "PageFaultException::touch happening with a lock" << endl;
         }
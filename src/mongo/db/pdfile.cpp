@@ -47,8 +47,13 @@ _ disallow system* manipulations from the database.
 #include "instance.h"
 #include "replutil.h"
 #include "memconcept.h"
+#include "mongo/db/data_paths.h"
 #include "mongo/db/lasterror.h"
 #include "mongo/db/index_update.h"
+#include "mongo/db/oplog.h"
+#include "mongo/db/record_checksums.h"
+#include "mongo/db/stats/namespace_io.h"
+#include "mongo/db/time_partitions.h"
 
 #include <boost/filesystem/operations.hpp>
 
@@ -155,6 +160,26 @@ namespace mongo {
     string pidfilepath;
 
     DataFileMgr theDataFileMgr;
+
+    unsigned long long CappedInsertNotifier::version() {
+        scoped_lock lk( _m );
+        return _version;
+    }
+
+    void CappedInsertNotifier::notifyAll() {
+        scoped_lock lk( _m );
+        _version++;
+        _notifier.notify_all();
+    }
+
+    void CappedInsertNotifier::waitForInsert( unsigned long long version , unsigned millis ) {
+        scoped_lock lk( _m );
+        boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds( millis );
+        while ( _version == version ) {
+            if ( !_notifier.timed_wait( lk.boost() , deadline ) )
+                return; // timed out
+        }
+    }
     DatabaseHolder _dbHolder;
     int MAGIC = 0x1000;
 
@@ -204,7 +229,9 @@ namespace mongo {
     void _deleteDataFiles(const char *database) {
         if ( directoryperdb ) {
             FileAllocator::get()->waitUntilFinished();
-            MONGO_ASSERT_ON_EXCEPTION_WITH_MSG( boost::filesystem::remove_all( boost::filesystem::path( dbpath ) / database ), "delete data files with a directoryperdb" );
+            vector<boost::filesystem::path> dirs = dataFileDirs( dbpath, database );
+            for ( unsigned i = 0; i < dirs.size(); i++ )
+                MONGO_ASSERT_ON_EXCEPTION_WITH_MSG( boost::filesystem::remove_all( dirs[i] ), "delete data files with a directoryperdb" );
             return;
         }
         class : public FileOp {
@@ -245,6 +272,15 @@ namespace mongo {
 
         checkConfigNS(ns);
 
+        bool timePartitioned = options.hasField( "timePartitioned" );
+        if ( timePartitioned ) {
+            TimePartitions::parse( options["timePartitioned"] );
+            uassert( 16403 , "a time partitioned collection can't be capped" , ! options["capped"].trueValue() );
+        }
+        bool recordChecksums = options["recordChecksums"].trueValue();
+        uassert( 16421 , "a capped collection can't have record checksums" ,
+                 ! recordChecksums || ! options["capped"].trueValue() );
+
         long long size = Extent::initialSize(128);
         {
             BSONElement e = options.getField("size");
@@ -341,6 +377,18 @@ namespace mongo {
         if ( options["flags"].numberInt() ) {
             d->replaceUserFlags( options["flags"].numberInt() );
         }
+        if ( options["usePowerOf2Sizes"].trueValue() ) {
+            d->setUserFlag( NamespaceDetails::Flag_UsePowerOf2Sizes );
+        }
+        if ( options["cacheQueryResults"].trueValue() ) {
+            d->setUserFlag( NamespaceDetails::Flag_CacheQueryResults );
+        }
+        if ( timePartitioned ) {
+            d->setUserFlag( NamespaceDetails::Flag_TimePartitioned );
+        }
+        if ( recordChecksums ) {
+            d->setUserFlag( NamespaceDetails::Flag_RecordChecksums );
+        }
 
         return true;
     }
@@ -947,13 +995,14 @@ namespace mongo {
         ClientCursor::invalidate(name.c_str());
         Top::global.collectionDropped( name );
         NamespaceDetailsTransient::eraseForPrefix( name.c_str() );
+        OplogStartIndex::invalidate( name.c_str() );
         dropNS(name);
     }
 
     /* deletes a record, just the pdfile portion -- no index cleanup, no cursor cleanup, etc.
        caller must check if capped
     */
-    void DataFileMgr::_deleteRecord(NamespaceDetails *d, const char *ns, Record *todelete, const DiskLoc& dl) {
+    void DataFileMgr::_deleteRecord(NamespaceDetails *d, const char *ns, Record *todelete, const DiskLoc& dl, bool reuse) {
         /* remove ourself from the record next/prev chain */
         {
             if ( todelete->prevOfs() != DiskLoc::NullOfs )
@@ -987,6 +1036,9 @@ namespace mongo {
                 s->nrecords--;
             }
 
+            if ( !reuse )
+                return;
+
             if ( strstr(ns, ".system.indexes") ) {
                 /* temp: if in system.indexes, don't reuse, and zero out: we want to be
                    careful until validated more, as IndexDetails has pointers
@@ -1045,7 +1097,7 @@ namespace mongo {
         NamespaceDetails *d,
         NamespaceDetailsTransient *nsdt,
         Record *toupdate, const DiskLoc& dl,
-        const char *_buf, int _len, OpDebug& debug,  bool god) {
+        const char *_buf, int _len, OpDebug& debug,  bool god, const ModSet *mods) {
 
         dassert( toupdate == dl.rec() );
 
@@ -1072,14 +1124,22 @@ namespace mongo {
         */
         vector<IndexChanges> changes;
         bool changedId = false;
-        getIndexChanges(changes, ns, *d, objNew, objOld, changedId);
+        // a move rewrites every key, which is counted below, so all of them are needed then
+        bool fits = toupdate->netLength() >= objNew.objsize() + RecordChecksums::extra( d );
+        getIndexChanges(changes, ns, *d, objNew, objOld, changedId, fits ? mods : 0);
         uassert( 13596 , str::stream() << "cannot change _id of a document old:" << objOld << " new:" << objNew , ! changedId );
         dupCheck(changes, *d, dl);
 
-        if ( toupdate->netLength() < objNew.objsize() ) {
+        if ( !fits ) {
             // doesn't fit.  reallocate -----------------------------------------------------
             uassert( 10003 , "failing update: objects in a capped ns cannot grow", !(d && d->isCapped()));
-            d->paddingTooSmall();
+
+            // every key in every index is removed and reinserted for the new location
+            int keysRewritten = 0;
+            for ( unsigned x = 0; x < changes.size(); x++ )
+                keysRewritten += changes[x].oldkeys.size() + changes[x].newkeys.size();
+            nsdt->recordGrowth().noteUpdate( d, objOld.objsize(), objNew.objsize(), true, keysRewritten );
+
             deleteRecord(ns, toupdate, dl);
             DiskLoc res = insert(ns, objNew.objdata(), objNew.objsize(), god);
 
@@ -1092,7 +1152,7 @@ namespace mongo {
         }
 
         nsdt->notifyOfWriteOp();
-        d->paddingFits();
+        nsdt->recordGrowth().noteUpdate( d, objOld.objsize(), objNew.objsize(), false, 0 );
 
         /* have any index keys changed? */
         {
@@ -1138,6 +1198,8 @@ namespace mongo {
         //  update in place
         int sz = objNew.objsize();
         memcpy(getDur().writingPtr(toupdate->data(), sz), objNew.objdata(), sz);
+        if ( RecordChecksums::extra( d ) )
+            RecordChecksums::update( toupdate );
         return dl;
     }
 
@@ -1445,7 +1507,10 @@ namespace mongo {
             BSONElementManipulator::lookForTimestamps( io );
         }
 
-        int lenWHdr = d->getRecordAllocationSize( len + Record::HeaderSize );
+        // god tables (and btree buckets) aren't updated, so aren't padded for updates; nor are
+        // capped collections, whose documents can't grow, so skip their transient lookup too
+        int lenWHdr = d->getRecordAllocationSize( len + RecordChecksums::extra( d ) + Record::HeaderSize,
+                                                  god || d->isCapped() ? 0 : &NamespaceDetailsTransient::get( ns ).recordGrowth() );
 
         // If the collection is capped, check if the new object will violate a unique index
         // constraint before allocating space.
@@ -1508,6 +1573,8 @@ namespace mongo {
                 if( obuf ) // obuf can be null from internal callers
                     memcpy(r->data(), obuf, len);
             }
+            if ( obuf && RecordChecksums::extra( d ) )
+                RecordChecksums::update( r );
         }
 
         addRecordToRecListInExtent(r, loc);
@@ -1520,8 +1587,13 @@ namespace mongo {
         }
 
         // we don't bother resetting query optimizer stats for the god tables - also god is true when adding a btree bucket
-        if ( !god )
-            NamespaceDetailsTransient::get( ns ).notifyOfWriteOp();
+        if ( !god || d->isCapped() ) {
+            NamespaceDetailsTransient& nsdt = NamespaceDetailsTransient::get( ns );
+            if ( !god )
+                nsdt.notifyOfWriteOp();
+            if ( d->isCapped() )
+                nsdt.notifyCappedInsert();
+        }
 
         if ( tableToIndex ) {
             insert_makeIndex(tableToIndex, tabletoidxns, loc);
@@ -1554,15 +1626,13 @@ namespace mongo {
             }
         }
 
-        d->paddingFits();
-
         return loc;
     }
 
     /* special version of insert for transaction logging -- streamlined a bit.
        assumes ns is capped and no indexes
     */
-    Record* DataFileMgr::fast_oplog_insert(NamespaceDetails *d, const char *ns, int len) {
+    Record* DataFileMgr::fast_oplog_insert(NamespaceDetails *d, const char *ns, int len, DiskLoc *recLoc) {
         verify( d );
         RARELY verify( d == nsdetails(ns) );
         DEV verify( d == nsdetails(ns) );
@@ -1599,9 +1669,75 @@ namespace mongo {
             s->nrecords++;
         }
 
+        if ( recLoc )
+            *recLoc = loc;
         return r;
     }
 
+    char* DataFileMgr::fast_oplog_insert_batch(NamespaceDetails *d, const char *ns, const vector<int>& lens, vector<DiskLoc>* locs) {
+        verify( d );
+        verify( !lens.empty() );
+        DEV verify( d == nsdetails(ns) );
+
+        vector<int> sizes;
+        int total = 0;
+        for ( unsigned i = 0; i < lens.size(); i++ ) {
+            // the alignment alloc() would have given each on its own
+            sizes.push_back( ( lens[i] + Record::HeaderSize + 3 ) & 0xfffffffc );
+            total += sizes.back();
+        }
+
+        DiskLoc extentLoc;
+        DiskLoc loc = d->alloc(ns, total, extentLoc);
+        verify( !loc.isNull() );
+
+        Record *first = loc.rec();
+        const int extra = first->lengthWithHeaders() - total;
+        verify( extra >= 0 );
+        sizes.back() += extra;
+        const int extentOfs = first->extentOfs();
+        Extent *e = first->myExtent(loc);
+        const DiskLoc oldLast = e->lastRecord;
+
+        char *w = (char *) getDur().writingPtr( first, total + extra );
+        int ofs = 0;
+        int prevOfs = oldLast.isNull() ? DiskLoc::NullOfs : oldLast.getOfs();
+        long long datasize = 0;
+        DiskLoc last;
+        for ( unsigned i = 0; i < sizes.size(); i++ ) {
+            Record *r = (Record *) ( w + ofs );
+            r->lengthWithHeaders() = sizes[i];
+            r->extentOfs() = extentOfs;
+            r->prevOfs() = prevOfs;
+            r->nextOfs() = i + 1 < sizes.size() ? loc.getOfs() + ofs + sizes[i] : DiskLoc::NullOfs;
+
+            last = loc;
+            last.inc( ofs );
+            locs->push_back( last );
+            prevOfs = last.getOfs();
+            ofs += sizes[i];
+            datasize += sizes[i] - Record::HeaderSize;
+        }
+
+        if ( oldLast.isNull() ) {
+            Extent::FL *fl = getDur().writing( e->fl() );
+            fl->firstRecord = loc;
+            fl->lastRecord = last;
+        }
+        else {
+            getDur().writingInt( oldLast.rec()->nextOfs() ) = loc.getOfs();
+            e->lastRecord.writing() = last;
+        }
+
+        {
+            NamespaceDetails::Stats *s = getDur().writing(&d->stats);
+            s->datasize += datasize;
+            s->nrecords += lens.size();
+        }
+
+        return w;
+    }
+
 } // namespace mongo
 
 #include "clientcursor.h"
@@ -1643,6 +1779,7 @@ namespace mongo {
 
         Database::closeDatabase( d->name.c_str(), d->path );
         d = 0; // d is now deleted
+        NamespaceIO::forget( db + "." );
 
         _deleteDataFiles( db.c_str() );
     }
@@ -1841,13 +1978,26 @@ namespace mongo {
         MONGO_ASSERT_ON_EXCEPTION( ok = fo.apply( q ) );
         if ( ok )
             log(2) << fo.op() << " file " << q.string() << endl;
+        // the namespace tables db.ns has grown into
+        for ( int i = 1; ; i++ ) {
+            stringstream ss;
+            ss << c << "ns." << i;
+            q = p / ss.str();
+            MONGO_ASSERT_ON_EXCEPTION( ok = fo.apply( q ) );
+            if ( !ok )
+                break;
+            log(2) << fo.op() << " file " << q.string() << endl;
+        }
         int i = 0;
         int extra = 10; // should not be necessary, this is defensive in case there are missing files
         while ( 1 ) {
             verify( i <= DiskLoc::MaxFiles );
             stringstream ss;
             ss << c << i;
-            q = p / ss.str();
+            // with --dataPaths it may not be in the dbpath
+            q = findDataFile( path, database, i );
+            if ( q.empty() )
+                q = p / ss.str();
             MONGO_ASSERT_ON_EXCEPTION( ok = fo.apply(q) );
             if ( ok ) {
                 if ( extra != 10 ) {
@@ -25,6 +25,8 @@
 
 #pragma once
 
+#include <boost/thread/condition.hpp>
+
 #include "mongo/db/client.h"
 #include "mongo/db/diskloc.h"
 #include "mongo/db/jsobjmanipulator.h"
@@ -46,6 +48,7 @@ namespace mongo {
     class Extent;
     class Record;
     class Cursor;
+    class ModSet;
     class OpDebug;
 
     void dropDatabase(string db);
@@ -66,6 +69,7 @@ namespace mongo {
     class MongoDataFile {
         friend class DataFileMgr;
         friend class BasicCursor;
+        friend class ParallelCount;
     public:
         MongoDataFile(int fn) : _mb(0), fileNo(fn) { }
 
@@ -127,7 +131,8 @@ namespace mongo {
             NamespaceDetails *d,
             NamespaceDetailsTransient *nsdt,
             Record *toupdate, const DiskLoc& dl,
-            const char *buf, int len, OpDebug& debug, bool god=false);
+            const char *buf, int len, OpDebug& debug, bool god=false,
+            const ModSet *mods=0);
 
         // The object o may be updated if modified on insert.
         void insertAndLog( const char *ns, const BSONObj &o, bool god = false, bool fromMigrate = false );
@@ -148,7 +153,16 @@ namespace mongo {
            assumes ns is capped and no indexes
            no _id field check
         */
-        Record* fast_oplog_insert(NamespaceDetails *d, const char *ns, int len);
+        Record* fast_oplog_insert(NamespaceDetails *d, const char *ns, int len, DiskLoc *recLoc = 0);
+
+        /* fast_oplog_insert() for several records at once: they are carved out of a single
+           capped allocation and a single write intent is declared for all of them.
+           @param lens the data length of each record
+           @param locs filled in with where each record went
+           @return the writable start of the first record's header; the records follow
+                   back to back, and their data isn't declared again
+        */
+        char* fast_oplog_insert_batch(NamespaceDetails *d, const char *ns, const vector<int>& lens, vector<DiskLoc>* locs);
 
         static Extent* getExtent(const DiskLoc& dl);
         static Record* getRecord(const DiskLoc& dl);
@@ -156,8 +170,10 @@ namespace mongo {
 
         void deleteRecord(const char *ns, Record *todelete, const DiskLoc& dl, bool cappedOK = false, bool noWarn = false, bool logOp=false);
 
-        /* does not clean up indexes, etc. : just deletes the record in the pdfile. use deleteRecord() to unindex */
-        void _deleteRecord(NamespaceDetails *d, const char *ns, Record *todelete, const DiskLoc& dl);
+        /* does not clean up indexes, etc. : just deletes the record in the pdfile. use deleteRecord() to unindex
+           reuse - false leaves the space off the free list, for an extent that is about to be freed whole
+        */
+        void _deleteRecord(NamespaceDetails *d, const char *ns, Record *todelete, const DiskLoc& dl, bool reuse = true);
 
     private:
         vector<MongoDataFile *> files;
@@ -165,6 +181,26 @@ namespace mongo {
 
     extern DataFileMgr theDataFileMgr;
 
+    /**
+     * Wakes the awaitData cursors tailing a capped collection when a document goes in, rather
+     * than having them poll.  One per collection, made by the first cursor to wait on it, see
+     * NamespaceDetailsTransient::cappedInsertNotifier(); the oplog's tailers wait on OpTime.
+     */
+    class CappedInsertNotifier : boost::noncopyable {
+    public:
+        CappedInsertNotifier() : _m( "CappedInsertNotifier" ) , _version( 0 ) {}
+        /** inserts so far.  read it in the lock the cursor is read in. */
+        unsigned long long version();
+        /** write locked, so the waiters won't get in until the insert is done */
+        void notifyAll();
+        /** waits up to millis for an insert after the ones version counted */
+        void waitForInsert( unsigned long long version , unsigned millis );
+    private:
+        mongo::mutex _m;
+        boost::condition _notifier;
+        unsigned long long _version;
+    };
+
 #pragma pack(1)
 
     class DeletedRecord {
@@ -275,10 +311,17 @@ namespace mongo {
         Record* accessed();
 
         static bool likelyInPhysicalMemory( const char* data );
+
+        /**
+         * asks the os to read in the first page of each record in 'locs' not likely in physical
+         * memory, coalescing adjacent pages.  'locs' is sorted into file offset order.
+         */
+        static void prefetch( vector<DiskLoc> &locs );
         
         static bool blockCheckSupported();
 
     private:
+        friend class RecordChecksums; // reads records on threads without a Client
         
         int _netLength() const { return _lengthWithHeaders - HeaderSize; }
 
@@ -578,7 +621,18 @@ namespace mongo {
 
     inline NamespaceDetails* nsdetails(const char *ns) {
         // if this faults, did you set the current db first?  (Client::Context + dblock)
-        NamespaceDetails *d = nsindex(ns)->details(ns);
+        NamespaceIndex *ni = nsindex(ns);
+        NamespaceCache& cache = cc().nsCache();
+        NamespaceDetails *d = cache.details(ni, ns);
+        if( d ) {
+            if( d->isCapped() )
+                d->cappedCheckMigrate();
+        }
+        else {
+            d = ni->details(ns);
+            if( d )
+                cache.noteDetails(ni, ns, d);
+        }
         if( d ) {
             memconcept::is(d, memconcept::concept::nsdetails, ns, sizeof(NamespaceDetails));
         }
@@ -55,6 +55,10 @@ namespace mongo {
         verify(false); // these can't appear in arrays
     }
 
+    intrusive_ptr<const Value> Accumulator::getPartialValue() const {
+        return getValue();
+    }
+
     void agg_framework_reservedErrors() {
         uassert(16030, "reserved error", false);
         uassert(16031, "reserved error", false);
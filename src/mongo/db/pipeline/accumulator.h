@@ -43,6 +43,16 @@ namespace mongo {
          */
         virtual intrusive_ptr<const Value> getValue() const = 0;
 
+        /*
+          Get the accumulated value in the form that an accumulator of the
+          same kind in the router (see DocumentSourceGroup::createMerger())
+          can combine with others; this is what getValue() returns on a
+          shard.  It only differs from getValue() for $avg.
+
+          @returns the partial value
+         */
+        virtual intrusive_ptr<const Value> getPartialValue() const;
+
     protected:
         Accumulator();
 
@@ -80,7 +90,7 @@ namespace mongo {
 
     private:
         AccumulatorAddToSet(const intrusive_ptr<ExpressionContext> &pTheCtx);
-        typedef boost::unordered_set<intrusive_ptr<const Value>, Value::Hash > SetType;
+        typedef boost::unordered_set<HashedValue, HashedValue::Hash> SetType;
         mutable SetType set;
         mutable SetType::iterator itr; 
         intrusive_ptr<ExpressionContext> pCtx;
@@ -234,6 +244,7 @@ namespace mongo {
         virtual intrusive_ptr<const Value> evaluate(
             const intrusive_ptr<Document> &pDocument) const;
         virtual intrusive_ptr<const Value> getValue() const;
+        virtual intrusive_ptr<const Value> getPartialValue() const;
         virtual const char *getOpName() const;
 
         /*
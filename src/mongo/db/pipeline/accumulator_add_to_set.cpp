@@ -29,7 +29,7 @@ namespace mongo {
         if (prhs->getType() == Undefined)
             ; /* nothing to add to the array */
         else if (!pCtx->getInRouter())
-            set.insert(prhs);
+            set.insert(HashedValue(prhs));
         else {
             /*
               If we're in the router, we need to take apart the arrays we
@@ -42,7 +42,7 @@ namespace mongo {
             intrusive_ptr<ValueIterator> pvi(prhs->getArray());
             while(pvi->more()) {
                 intrusive_ptr<const Value> pElement(pvi->next());
-                set.insert(pElement);
+                set.insert(HashedValue(pElement));
             }
         }
 
@@ -53,7 +53,7 @@ namespace mongo {
         vector<intrusive_ptr<const Value> > valVec;
 
         for (itr = set.begin(); itr != set.end(); ++itr) {
-            valVec.push_back(*itr);
+            valVec.push_back(itr->getValue());
         }
         /* there is no issue of scope since createArray copy constructs */
         return Value::createArray(valVec);
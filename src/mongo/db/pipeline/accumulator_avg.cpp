@@ -81,18 +81,21 @@ namespace mongo {
     }
 
     intrusive_ptr<const Value> AccumulatorAvg::getValue() const {
-        if (!pCtx->getInShard()) {
-            double avg = 0;
-            if (count) {
-                if (totalType != NumberDouble)
-                    avg = static_cast<double>(longTotal / count);
-                else
-                    avg = doubleTotal / count;
-            }
-
-            return Value::createDouble(avg);
+        if (pCtx->getInShard())
+            return getPartialValue();
+
+        double avg = 0;
+        if (count) {
+            if (totalType != NumberDouble)
+                avg = static_cast<double>(longTotal / count);
+            else
+                avg = doubleTotal / count;
         }
 
+        return Value::createDouble(avg);
+    }
+
+    intrusive_ptr<const Value> AccumulatorAvg::getPartialValue() const {
         intrusive_ptr<Document> pDocument(Document::create());
 
         intrusive_ptr<const Value> pSubTotal;
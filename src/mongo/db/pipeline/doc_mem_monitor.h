@@ -76,6 +76,14 @@ namespace mongo {
          */
         void addToTotal(size_t amount);
 
+        /*
+          Decrement the total amount of memory used by the given amount, for
+          memory that was counted with addToTotal() and has been released.
+
+          @param amount the amount of memory to remove from the current total
+         */
+        void subtractFromTotal(size_t amount);
+
     private:
         /*
           Real constructor body.
@@ -0,0 +1,273 @@
+/**
+ * Copyright (c) 2012 10gen Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU Affero General Public License, version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pch.h"
+
+#include "db/pipeline/doc_spill.h"
+
+#include <algorithm>
+#include <boost/filesystem/convenience.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include "bson/util/atomic_int.h"
+#include "db/jsobj.h"
+#include "db/pipeline/document.h"
+#include "db/pipeline/document_source.h"
+#include "db/pipeline/value.h"
+
+namespace mongo {
+
+    /* used to give each spilling stage its own directory */
+    static AtomicUInt spillDirCounter;
+
+    DocSpillDirectory::DocSpillDirectory(const string &theParent,
+                                         const string &thePrefix):
+        parent(theParent),
+        prefix(thePrefix),
+        path(),
+        nFiles(0) {
+    }
+
+    DocSpillDirectory::~DocSpillDirectory() {
+        if (path.empty())
+            return;
+
+        try {
+            boost::filesystem::remove_all(path);
+        }
+        catch (const std::exception &e) {
+            warning() << "couldn't remove spill directory " << path <<
+                ": " << e.what() << endl;
+        }
+    }
+
+    string DocSpillDirectory::newFileName() {
+        if (path.empty()) {
+            stringstream ss;
+            ss << parent << "/" << prefix << "." << time(0) << "." <<
+                spillDirCounter++;
+            path = ss.str();
+            boost::filesystem::create_directories(path);
+            log(1) << "pipeline spilling to " << path << endl;
+        }
+
+        stringstream ss;
+        ss << path << "/run." << nFiles++;
+        return ss.str();
+    }
+
+    DocSpillWriter::DocSpillWriter(const string &theFileName):
+        fileName(theFileName) {
+        out.open(fileName.c_str(), ios_base::out | ios_base::binary);
+        assertStreamGood(16336, "couldn't open spill file: " + fileName,
+                         out);
+    }
+
+    void DocSpillWriter::write(const intrusive_ptr<Document> &pDocument) {
+        StackBSONObjBuilder<> builder;
+        pDocument->toBson(&builder);
+        BSONObj bsonObj(builder.done());
+        out.write(bsonObj.objdata(), bsonObj.objsize());
+    }
+
+    void DocSpillWriter::close() {
+        out.close();
+        uassert(16337, "error writing spill file: " + fileName, !out.fail());
+    }
+
+    DocRun::DocRun():
+        pCurrent() {
+    }
+
+    DocRun::~DocRun() {
+    }
+
+    bool DocRun::checkOrder() const {
+        return false;
+    }
+
+    namespace {
+        class DocRunFile :
+            public DocRun {
+        public:
+            DocRunFile(const string &theFileName):
+                fileName(theFileName) {
+                in.open(fileName.c_str(), ios_base::in | ios_base::binary);
+                assertStreamGood(16333, "couldn't open spill file: " +
+                                 fileName, in);
+                advance();
+            }
+
+            virtual void advance() {
+                /* each document is stored as a plain BSON object */
+                int size;
+                in.read((char *)&size, sizeof(size));
+                if (in.eof() && (in.gcount() == 0)) {
+                    pCurrent.reset();
+                    return;
+                }
+
+                uassert(16334, str::stream() << "corrupt spill file " <<
+                        fileName, in.good() && (size >= 5) &&
+                        (size <= BSONObjMaxInternalSize));
+                buf.resize(size);
+                memcpy(&buf[0], &size, sizeof(size));
+                in.read(&buf[sizeof(size)], size - sizeof(size));
+                uassert(16335, str::stream() << "truncated spill file " <<
+                        fileName, in.good());
+
+                BSONObj bsonObj(&buf[0]);
+                pCurrent = Document::createFromBsonObj(&bsonObj);
+            }
+
+        private:
+            string fileName;
+            ifstream in;
+            vector<char> buf;
+        };
+
+        class DocRunVector :
+            public DocRun {
+        public:
+            DocRunVector(const vector<intrusive_ptr<Document> > *pDocs):
+                pDocuments(pDocs),
+                position(0) {
+                advance();
+            }
+
+            virtual void advance() {
+                if (position == pDocuments->size()) {
+                    pCurrent.reset();
+                    return;
+                }
+                pCurrent = (*pDocuments)[position++];
+            }
+
+        private:
+            const vector<intrusive_ptr<Document> > *pDocuments;
+            size_t position;
+        };
+
+        class DocRunSource :
+            public DocRun {
+        public:
+            DocRunSource(DocumentSource *pS):
+                pSource(pS) {
+                if (!pSource->eof())
+                    pCurrent = pSource->getCurrent();
+            }
+
+            virtual void advance() {
+                if (pSource->advance())
+                    pCurrent = pSource->getCurrent();
+                else
+                    pCurrent.reset();
+            }
+
+            virtual bool checkOrder() const {
+                return true;
+            }
+
+        private:
+            DocumentSource *pSource;
+        };
+    }
+
+    DocRun *DocRun::createFromFile(const string &fileName) {
+        return new DocRunFile(fileName);
+    }
+
+    DocRun *DocRun::createFromVector(
+        const vector<intrusive_ptr<Document> > *pDocuments) {
+        return new DocRunVector(pDocuments);
+    }
+
+    DocRun *DocRun::createFromSource(DocumentSource *pSource) {
+        return new DocRunSource(pSource);
+    }
+
+    DocRunMerger::Comparator::~Comparator() {
+    }
+
+    DocRunMerger::DocRunMerger(Comparator *pC):
+        pComparator(pC),
+        runs(),
+        heap(),
+        started(false) {
+    }
+
+    void DocRunMerger::addRun(const shared_ptr<DocRun> &pRun) {
+        verify(!started);
+        runs.push_back(pRun);
+    }
+
+    bool DocRunMerger::HeapComparator::operator()(size_t l, size_t r) const {
+        /*
+          The STL heap functions keep the greatest element on top, so this
+          reverses the order; equal documents come out in run order.
+         */
+        int cmp = pMerger->pComparator->compare(
+            pMerger->runs[l]->getCurrent(), pMerger->runs[r]->getCurrent());
+        if (cmp)
+            return (cmp > 0);
+        return (l > r);
+    }
+
+    intrusive_ptr<Document> DocRunMerger::next() {
+        HeapComparator comparator(this);
+
+        if (!started) {
+            for(size_t i = 0; i < runs.size(); ++i) {
+                if (runs[i]->more())
+                    heap.push_back(i);
+            }
+            make_heap(heap.begin(), heap.end(), comparator);
+            started = true;
+        }
+
+        if (heap.empty())
+            return intrusive_ptr<Document>();
+
+        pop_heap(heap.begin(), heap.end(), comparator);
+        DocRun *pRun = runs[heap.back()].get();
+        intrusive_ptr<Document> pNext(pRun->getCurrent());
+
+        pRun->advance();
+        if (!pRun->more()) {
+            heap.pop_back();
+            return pNext;
+        }
+
+        uassert(16341, "pipeline merge input is out of order",
+                !pRun->checkOrder() ||
+                (pComparator->compare(pNext, pRun->getCurrent()) <= 0));
+        push_heap(heap.begin(), heap.end(), comparator);
+        return pNext;
+    }
+
+    int DocIdComparator::compare(const intrusive_ptr<Document> &pL,
+                                 const intrusive_ptr<Document> &pR) {
+        intrusive_ptr<const Value> pLeft(pL->getValue(Document::idName));
+        if (!pLeft.get())
+            pLeft = Value::getNull();
+        intrusive_ptr<const Value> pRight(pR->getValue(Document::idName));
+        if (!pRight.get())
+            pRight = Value::getNull();
+
+        return Value::compare(pLeft, pRight);
+    }
+
+}
@@ -0,0 +1,225 @@
+/**
+ * Copyright (c) 2012 10gen Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU Affero General Public License, version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "pch.h"
+
+#include <fstream>
+
+#include "util/intrusive_counter.h"
+
+namespace mongo {
+    class Document;
+    class DocumentSource;
+
+    /*
+      A directory for the temporary files of one pipeline stage that spills
+      to disk when what it accumulates no longer fits in memory.
+
+      The directory is created under the ExpressionContext's temporary
+      directory on the first call to newFileName(), and removed, along with
+      everything in it, when this is destroyed.
+     */
+    class DocSpillDirectory :
+        boost::noncopyable {
+    public:
+        /*
+          @param parent the directory to create this one under
+          @param prefix the start of this directory's name, e.g. "aggsort"
+         */
+        DocSpillDirectory(const string &parent, const string &prefix);
+        ~DocSpillDirectory();
+
+        /*
+          @returns the name of a file in this directory that hasn't been
+            handed out before
+         */
+        string newFileName();
+
+    private:
+        string parent;
+        string prefix;
+        string path; // empty until created
+        unsigned nFiles;
+    };
+
+
+    /*
+      Writes Documents out to a spill file as plain BSON objects, one after
+      the other.  DocRun::createFromFile() reads them back in the same order.
+     */
+    class DocSpillWriter :
+        boost::noncopyable {
+    public:
+        DocSpillWriter(const string &fileName);
+
+        void write(const intrusive_ptr<Document> &pDocument);
+
+        /*
+          Flush and close the file.
+
+          @throws if anything written couldn't be saved
+         */
+        void close();
+
+    private:
+        string fileName;
+        ofstream out;
+    };
+
+
+    /*
+      A sequence of Documents, already in order, that is merged with others
+      by DocRunMerger.
+     */
+    class DocRun :
+        boost::noncopyable {
+    public:
+        virtual ~DocRun();
+
+        /*
+          @returns true if getCurrent() is valid
+         */
+        bool more() const;
+
+        /*
+          @returns the Document at the current position
+         */
+        const intrusive_ptr<Document> &getCurrent() const;
+
+        /*
+          Move on to the next Document, if there is one.
+         */
+        virtual void advance() = 0;
+
+        /*
+          Whether DocRunMerger must check that this run really is in order.
+          True for runs we didn't sort ourselves.
+         */
+        virtual bool checkOrder() const;
+
+        /*
+          Read back a file written by DocSpillWriter.
+         */
+        static DocRun *createFromFile(const string &fileName);
+
+        /*
+          Iterate over Documents that are already sorted in memory.  The
+          vector must outlive the run.
+         */
+        static DocRun *createFromVector(
+            const vector<intrusive_ptr<Document> > *pDocuments);
+
+        /*
+          Iterate over what another DocumentSource produces.  The source
+          must outlive the run, and its output must already be in order.
+         */
+        static DocRun *createFromSource(DocumentSource *pSource);
+
+    protected:
+        DocRun();
+
+        intrusive_ptr<Document> pCurrent; // null at the end
+    };
+
+
+    /*
+      Merges several DocRuns, each already in order, into one sequence.
+      Ties go to the run that was added first.
+     */
+    class DocRunMerger :
+        boost::noncopyable {
+    public:
+        /*
+          The ordering to merge by.
+         */
+        class Comparator {
+        public:
+            virtual ~Comparator();
+
+            /*
+              @returns a number less than, equal to, or greater than zero,
+                indicating pL < pR, pL == pR, or pL > pR, respectively
+             */
+            virtual int compare(const intrusive_ptr<Document> &pL,
+                                const intrusive_ptr<Document> &pR) = 0;
+        };
+
+        /*
+          @param pComparator the ordering; must outlive the merger
+         */
+        DocRunMerger(Comparator *pComparator);
+
+        /*
+          Add a run to merge.  All runs must be added before the first call
+          to next().
+         */
+        void addRun(const shared_ptr<DocRun> &pRun);
+
+        /*
+          @returns the next Document in order, or null once all the runs
+            are exhausted
+          @throws if a run that needs checking turns out to be out of order
+         */
+        intrusive_ptr<Document> next();
+
+    private:
+        /* STL heap ordering over indexes into runs */
+        class HeapComparator {
+        public:
+            bool operator()(size_t l, size_t r) const;
+            inline HeapComparator(DocRunMerger *pM):
+                pMerger(pM) {
+            }
+        private:
+            DocRunMerger *pMerger;
+        };
+
+        Comparator *pComparator;
+        vector<shared_ptr<DocRun> > runs;
+        vector<size_t> heap;
+        bool started;
+    };
+
+
+    /*
+      Orders Documents by their _id, as $group produces them; missing ids
+      sort as null.
+     */
+    class DocIdComparator :
+        public DocRunMerger::Comparator {
+    public:
+        virtual int compare(const intrusive_ptr<Document> &pL,
+                            const intrusive_ptr<Document> &pR);
+    };
+
+}
+
+
+/* ======================= INLINED IMPLEMENTATIONS ========================== */
+
+namespace mongo {
+
+    inline bool DocRun::more() const {
+        return (pCurrent.get() != NULL);
+    }
+
+    inline const intrusive_ptr<Document> &DocRun::getCurrent() const {
+        return pCurrent;
+    }
+
+}
@@ -17,7 +17,6 @@
 #include "pch.h"
 #include <boost/functional/hash.hpp>
 #include "db/jsobj.h"
-#include "db/pipeline/dependency_tracker.h"
 #include "db/pipeline/document.h"
 #include "db/pipeline/value.h"
 #include "util/mongoutils/str.h"
@@ -28,35 +27,65 @@ namespace mongo {
     string Document::idName("_id");
 
     intrusive_ptr<Document> Document::createFromBsonObj(
-        BSONObj *pBsonObj, const DependencyTracker *pDependencies) {
+        BSONObj *pBsonObj, const vector<string> *pFieldNames) {
         intrusive_ptr<Document> pDocument(
-            new Document(pBsonObj, pDependencies));
+            new Document(pBsonObj, pFieldNames));
         return pDocument;
     }
 
     Document::Document(BSONObj *pBsonObj,
-                       const DependencyTracker *pDependencies):
-        vFieldName(),
-        vpValue() {
+                       const vector<string> *pFieldNames):
+        vFields() {
+        if (pFieldNames) {
+            /*
+              Only convert the requested fields.  With few of them, a
+              linear scan of the names beats anything that would need a
+              string built for each element of the BSON.  Stop as soon as
+              they've all been found.
+             */
+            const size_t nWanted = pFieldNames->size();
+            vFields.reserve(nWanted);
+
+            BSONObjIterator bsonIterator(pBsonObj->begin());
+            while(bsonIterator.more() && (vFields.size() < nWanted)) {
+                BSONElement bsonElement(bsonIterator.next());
+                const char *pFieldName = bsonElement.fieldName();
+
+                for(size_t i = 0; i < nWanted; ++i) {
+                    if ((*pFieldNames)[i] == pFieldName) {
+                        vFields.push_back(FieldPair(
+                            pFieldName,
+                            Value::createFromBsonElement(&bsonElement)));
+                        break;
+                    }
+                }
+            }
+            return;
+        }
+
+        /*
+          Counting the fields first costs a walk over the BSON, but saves
+          growing the field table one reallocation at a time.
+         */
+        vFields.reserve(pBsonObj->nFields());
+
         BSONObjIterator bsonIterator(pBsonObj->begin());
         while(bsonIterator.more()) {
             BSONElement bsonElement(bsonIterator.next());
-            string fieldName(bsonElement.fieldName());
 
-            // LATER check pDependencies
             // LATER grovel through structures???
-            intrusive_ptr<const Value> pValue(
-                Value::createFromBsonElement(&bsonElement));
-
-            vFieldName.push_back(fieldName);
-            vpValue.push_back(pValue);
+            vFields.push_back(FieldPair(
+                bsonElement.fieldName(),
+                Value::createFromBsonElement(&bsonElement)));
         }
     }
 
     void Document::toBson(BSONObjBuilder *pBuilder) {
-        const size_t n = vFieldName.size();
-        for(size_t i = 0; i < n; ++i)
-            vpValue[i]->addToBsonObj(pBuilder, vFieldName[i]);
+        const size_t n = getFieldCount();
+        for(size_t i = 0; i < n; ++i) {
+            const FieldPair &rField = fieldAt(i);
+            rField.second->addToBsonObj(pBuilder, rField.first);
+        }
     }
 
     intrusive_ptr<Document> Document::create(size_t sizeHint) {
@@ -65,23 +94,57 @@ namespace mongo {
     }
 
     Document::Document(size_t sizeHint):
-        vFieldName(),
-        vpValue() {
-        if (sizeHint) {
-            vFieldName.reserve(sizeHint);
-            vpValue.reserve(sizeHint);
-        }
+        vFields(),
+        pBase(),
+        overlayIndex(0),
+        overlayField() {
+        if (sizeHint)
+            vFields.reserve(sizeHint);
     }
 
     intrusive_ptr<Document> Document::clone() {
-        const size_t n = vFieldName.size();
-        intrusive_ptr<Document> pNew(Document::create(n));
-        for(size_t i = 0; i < n; ++i)
-            pNew->addField(vFieldName[i], vpValue[i]);
+        /* the fields were already checked when they were added here */
+        intrusive_ptr<Document> pNew(Document::create(0));
+        if (pBase.get()) {
+            /* an overlay of the same base is just as good */
+            pNew->pBase = pBase;
+            pNew->overlayIndex = overlayIndex;
+            pNew->overlayField = overlayField;
+        }
+        else
+            pNew->vFields = vFields;
+        return pNew;
+    }
 
+    intrusive_ptr<Document> Document::createOverlay(
+        const intrusive_ptr<Document> &pBase, size_t index,
+        const intrusive_ptr<const Value> &pValue) {
+        verify(index < pBase->getFieldCount());
+        verify(pValue.get());
+        uassert(16377, str::stream() << "cannot set undefined field " <<
+                pBase->fieldAt(index).first << " to document",
+                pValue->getType() != Undefined);
+
+        intrusive_ptr<Document> pNew(Document::create(0));
+        pNew->pBase = pBase;
+        pNew->overlayIndex = index;
+        pNew->overlayField = FieldPair(pBase->fieldAt(index).first, pValue);
         return pNew;
     }
 
+    void Document::materialize() {
+        if (!pBase.get())
+            return;
+
+        const size_t n = getFieldCount();
+        vFields.reserve(n);
+        for(size_t i = 0; i < n; ++i)
+            vFields.push_back(fieldAt(i));
+
+        pBase.reset();
+        overlayField = FieldPair();
+    }
+
     Document::~Document() {
     }
 
@@ -100,10 +163,11 @@ namespace mongo {
           in a particular place as we would with a statically compilable
           reference.
         */
-        const size_t n = vFieldName.size();
+        const size_t n = getFieldCount();
         for(size_t i = 0; i < n; ++i) {
-            if (fieldName.compare(vFieldName[i]) == 0)
-                return vpValue[i];
+            const FieldPair &rField = fieldAt(i);
+            if (fieldName.compare(rField.first) == 0)
+                return rField.second;
         }
 
         return(intrusive_ptr<const Value>());
@@ -114,17 +178,18 @@ namespace mongo {
         uassert(15945, str::stream() << "cannot add undefined field " <<
                 fieldName << " to document", pValue->getType() != Undefined);
 
-        vFieldName.push_back(fieldName);
-        vpValue.push_back(pValue);
+        materialize();
+        vFields.push_back(FieldPair(fieldName, pValue));
     }
 
     void Document::setField(size_t index,
                             const string &fieldName,
                             const intrusive_ptr<const Value> &pValue) {
+        materialize();
+
         /* special case:  should this field be removed? */
         if (!pValue.get()) {
-            vFieldName.erase(vFieldName.begin() + index);
-            vpValue.erase(vpValue.begin() + index);
+            vFields.erase(vFields.begin() + index);
             return;
         }
 
@@ -133,15 +198,16 @@ namespace mongo {
                 fieldName << " to document", pValue->getType() != Undefined);
 
         /* set the indicated field */
-        vFieldName[index] = fieldName;
-        vpValue[index] = pValue;
+        vFields[index].first = fieldName;
+        vFields[index].second = pValue;
     }
 
     intrusive_ptr<const Value> Document::getField(const string &fieldName) const {
-        const size_t n = vFieldName.size();
+        const size_t n = getFieldCount();
         for(size_t i = 0; i < n; ++i) {
-            if (fieldName.compare(vFieldName[i]) == 0)
-                return vpValue[i];
+            const FieldPair &rField = fieldAt(i);
+            if (fieldName.compare(rField.first) == 0)
+                return rField.second;
         }
 
         /* if we got here, there's no such field */
@@ -150,18 +216,18 @@ namespace mongo {
 
     size_t Document::getApproximateSize() const {
         size_t size = sizeof(Document);
-        const size_t n = vpValue.size();
+        const size_t n = getFieldCount();
         for(size_t i = 0; i < n; ++i)
-            size += vpValue[i]->getApproximateSize();
+            size += fieldAt(i).second->getApproximateSize();
 
         return size;
     }
 
     size_t Document::getFieldIndex(const string &fieldName) const {
-        const size_t n = vFieldName.size();
+        const size_t n = getFieldCount();
         size_t i = 0;
         for(; i < n; ++i) {
-            if (fieldName.compare(vFieldName[i]) == 0)
+            if (fieldName.compare(fieldAt(i).first) == 0)
                 break;
         }
 
@@ -169,17 +235,18 @@ namespace mongo {
     }
 
     void Document::hash_combine(size_t &seed) const {
-        const size_t n = vFieldName.size();
+        const size_t n = getFieldCount();
         for(size_t i = 0; i < n; ++i) {
-            boost::hash_combine(seed, vFieldName[i]);
-            vpValue[i]->hash_combine(seed);
+            const FieldPair &rField = fieldAt(i);
+            boost::hash_combine(seed, rField.first);
+            rField.second->hash_combine(seed);
         }
     }
 
     int Document::compare(const intrusive_ptr<Document> &rL,
                           const intrusive_ptr<Document> &rR) {
-        const size_t lSize = rL->vFieldName.size();
-        const size_t rSize = rR->vFieldName.size();
+        const size_t lSize = rL->getFieldCount();
+        const size_t rSize = rR->getFieldCount();
 
         for(size_t i = 0; true; ++i) {
             if (i >= lSize) {
@@ -192,11 +259,15 @@ namespace mongo {
             if (i >= rSize)
                 return 1; // right document is shorter
 
-            const int nameCmp = rL->vFieldName[i].compare(rR->vFieldName[i]);
+            const FieldPair &rLField = rL->fieldAt(i);
+            const FieldPair &rRField = rR->fieldAt(i);
+
+            const int nameCmp = rLField.first.compare(rRField.first);
             if (nameCmp)
                 return nameCmp; // field names are unequal
 
-            const int valueCmp = Value::compare(rL->vpValue[i], rR->vpValue[i]);
+            const int valueCmp = Value::compare(rLField.second,
+                                                rRField.second);
             if (valueCmp)
                 return valueCmp; // fields are unequal
         }
@@ -214,14 +285,11 @@ namespace mongo {
     }
 
     bool FieldIterator::more() const {
-        return (index < pDocument->vFieldName.size());
+        return (index < pDocument->getFieldCount());
     }
 
     pair<string, intrusive_ptr<const Value> > FieldIterator::next() {
         verify(more());
-        pair<string, intrusive_ptr<const Value> > result(
-            pDocument->vFieldName[index], pDocument->vpValue[index]);
-        ++index;
-        return result;
+        return pDocument->fieldAt(index++);
     }
 }
@@ -22,7 +22,6 @@
 
 namespace mongo {
     class BSONObj;
-    class DependencyTracker;
     class FieldIterator;
     class Value;
 
@@ -37,14 +36,19 @@ namespace mongo {
           Document field values may be pointed to in the BSONObj, so it
           must live at least as long as the resulting Document.
 
-          LATER - use an abstract class for the dependencies; something like
-          a "lookup(const string &fieldName)" so there can be other
-          implementations.
+          If the pipeline only needs some of the top-level fields, pass
+          their names to skip converting the rest; the resulting Document
+          then only has those fields that are present, in the BSONObj's
+          order.  This is meant to be used with the names a closed
+          DependencyTracker reports, which are usually few.
 
+          @param pBsonObj the object to convert
+          @param pFieldNames if not NULL, the names of the only top-level
+            fields to convert
           @returns shared pointer to the newly created Document
         */
         static intrusive_ptr<Document> createFromBsonObj(
-            BSONObj *pBsonObj, const DependencyTracker *pDependencies = NULL);
+            BSONObj *pBsonObj, const vector<string> *pFieldNames = NULL);
 
         /*
           Create a new empty Document.
@@ -67,6 +71,25 @@ namespace mongo {
         */
         intrusive_ptr<Document> clone();
 
+        /*
+          Create a document that reads as pBase with one field's value
+          replaced, without copying pBase's fields:  it refers to pBase for
+          all the others.  This is what $unwind produces for each element,
+          so that unwinding a large array of a large document doesn't copy
+          the document's fields over and over.
+
+          The overlay may be read like any other Document.  The first
+          change made to it copies the fields in after all.
+
+          @param pBase the document to read the other fields from
+          @param index the index of the field to replace
+          @param pValue the value for that field; it may not be NULL
+          @returns the new document
+         */
+        static intrusive_ptr<Document> createOverlay(
+            const intrusive_ptr<Document> &pBase, size_t index,
+            const intrusive_ptr<const Value> &pValue);
+
         /*
           Add this document to the BSONObj under construction with the
           given BSONObjBuilder.
@@ -190,11 +213,30 @@ namespace mongo {
         friend class FieldIterator;
 
         Document(size_t sizeHint);
-        Document(BSONObj *pBsonObj, const DependencyTracker *pDependencies);
+        Document(BSONObj *pBsonObj, const vector<string> *pFieldNames);
+
+        /* the field at index, wherever it's held */
+        const FieldPair &fieldAt(size_t index) const;
+
+        /* copy in an overlay's fields, before changing them */
+        void materialize();
+
+        /*
+          The field table.  Names and values are kept side by side in one
+          vector, so that a Document needs a single allocation for its
+          fields, and lookups and iteration walk contiguous memory.
+         */
+        typedef vector<FieldPair> FieldVector;
+        FieldVector vFields;
 
-        /* these two vectors parallel each other */
-        vector<string> vFieldName;
-        vector<intrusive_ptr<const Value> > vpValue;
+        /*
+          For an overlay (see createOverlay()), the document holding the
+          fields, and the one field that's different; vFields is then
+          empty.
+         */
+        intrusive_ptr<Document> pBase;
+        size_t overlayIndex;
+        FieldPair overlayField;
     };
 
 
@@ -241,12 +283,23 @@ namespace mongo {
 namespace mongo {
 
     inline size_t Document::getFieldCount() const {
-        return vFieldName.size();
+        if (pBase.get())
+            return pBase->getFieldCount();
+        return vFields.size();
+    }
+
+    inline const Document::FieldPair &Document::fieldAt(size_t index) const {
+        if (pBase.get()) {
+            if (index == overlayIndex)
+                return overlayField;
+            return pBase->fieldAt(index);
+        }
+        return vFields[index];
     }
     
     inline Document::FieldPair Document::getField(size_t index) const {
-        verify( index < vFieldName.size() );
-        return FieldPair(vFieldName[index], vpValue[index]);
+        verify( index < getFieldCount() );
+        return fieldAt(index);
     }
 
 }
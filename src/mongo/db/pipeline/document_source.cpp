@@ -59,6 +59,17 @@ namespace mongo {
         return false;
     }
 
+    size_t DocumentSource::getBatch(
+        vector<intrusive_ptr<Document> > *pBatch, size_t maxDocuments) {
+        size_t n = 0;
+        for(bool hasNext = !eof(); hasNext && (n < maxDocuments); ++n) {
+            pBatch->push_back(getCurrent());
+            hasNext = advance();
+        }
+
+        return n;
+    }
+
     void DocumentSource::addToBsonArray(
         BSONArrayBuilder *pBuilder, bool explain) const {
         BSONObjBuilder insides;
@@ -18,22 +18,28 @@
 
 #include "pch.h"
 
+#include <boost/thread/thread.hpp>
 #include <boost/unordered_map.hpp>
 #include "mongo/bson/bsonobj.h"
 #include "mongo/client/parallel.h"
 #include "mongo/db/clientcursor.h"
+#include "mongo/db/interrupt_status.h"
 #include "mongo/db/jsobj.h"
 #include "mongo/db/pipeline/dependency_tracker.h"
+#include "mongo/db/pipeline/doc_spill.h"
 #include "mongo/db/pipeline/document.h"
 #include "mongo/db/pipeline/expression.h"
 #include "mongo/db/pipeline/value.h"
 #include "mongo/util/intrusive_counter.h"
+#include "mongo/util/mem_accounting.h"
+#include "mongo/util/queue.h"
 #include "mongo/util/string_writer.h"
 
 namespace mongo {
     class Accumulator;
     class Cursor;
     class DependencyTracker;
+    class dbtempreleasecond;
     class Document;
     class Expression;
     class ExpressionContext;
@@ -95,6 +101,27 @@ namespace mongo {
         */
         virtual intrusive_ptr<Document> getCurrent() = 0;
 
+        /**
+          Take several documents at once, beginning with the current one.
+
+          Afterwards the source is where advance() would have left it after
+          each of the documents taken, so the one at a time interface can
+          carry on from there.  Stages which just pass documents on, or
+          through an expression, override this to work through the whole
+          batch in a loop, rather than make three virtual calls per
+          document down the pipeline.  The default implementation does
+          that.
+
+          @param pBatch the vector to append the documents to
+          @param maxDocuments the most documents to take
+          @returns the number of documents taken; 0 only at eof
+         */
+        virtual size_t getBatch(vector<intrusive_ptr<Document> > *pBatch,
+                                size_t maxDocuments);
+
+        /* the usual number of documents for getBatch() to ask for */
+        static const size_t batchSize = 128;
+
         /**
            Get the source's name.
 
@@ -290,6 +317,16 @@ namespace mongo {
             string &errmsg, FuturesList *pList,
             const intrusive_ptr<ExpressionContext> &pExpCtx);
 
+        /**
+          Merge the shards' results in _id order, rather than returning
+          one shard's results after another.  Each shard's results must
+          already be in _id order.  This waits for all the shards before
+          returning anything.
+
+          Must be called before the first document is fetched.
+         */
+        void setMergeById();
+
     protected:
         // virtuals from DocumentSource
         virtual void sourceToBson(BSONObjBuilder *pBuilder, bool explain) const;
@@ -301,18 +338,89 @@ namespace mongo {
         /**
           Advance to the next document, setting pCurrent appropriately.
 
-          Adjusts pCurrent, pBsonSource, and iterator, as needed.  On exit,
+          Adjusts pCurrent, pShardSource, and iterator, as needed.  On exit,
           pCurrent is the Document to return, or NULL.  If NULL, this
           indicates there is nothing more to return.
          */
         void getNextDocument();
 
+        /**
+          Create the source for a shard's output:  the cursor it returned
+          its output through, or, for an explain, its result array.
+
+          @param pResult the shard's reply, which has arrived
+          @returns the source, or NULL if the reply had neither
+         */
+        intrusive_ptr<DocumentSource> createShardSource(
+            const shared_ptr<Future::CommandResult> &pResult);
+
         bool newSource; // set to true for the first item of a new source
-        intrusive_ptr<DocumentSourceBsonArray> pBsonSource;
+        intrusive_ptr<DocumentSource> pShardSource;
         intrusive_ptr<Document> pCurrent;
         FuturesList::iterator iterator;
         FuturesList::iterator listEnd;
         string &errmsg;
+
+        /*
+          For setMergeById():  start the merge of all the shards' results,
+          once they have all arrived.
+         */
+        void startMergeById();
+
+        bool mergeById;
+        vector<intrusive_ptr<DocumentSource> > vpShardSource;
+        DocIdComparator idComparator;
+        scoped_ptr<DocRunMerger> pMerger;
+    };
+
+
+    /*
+      Reads the output a shard returned through a cursor:  the first batch,
+      from the shard's reply to the "aggregate" command, and then the rest,
+      a batch at a time, through getMore()s over the connection the command
+      went to the shard on.
+     */
+    class DocumentSourceShardCursor :
+        public DocumentSource {
+    public:
+        // virtuals from DocumentSource
+        virtual ~DocumentSourceShardCursor();
+        virtual bool eof();
+        virtual bool advance();
+        virtual intrusive_ptr<Document> getCurrent();
+        virtual void setSource(DocumentSource *pSource);
+
+        /**
+          Create a source for a shard's cursor.
+
+          @param cursorObj the "cursor" field of the shard's reply, which
+            must outlive the source
+          @param pConnection the connection to get more from; it must
+            outlive the source, which kills the cursor if it is dropped
+            before the end
+          @param pExpCtx the expression context for the pipeline
+          @returns the newly created document source
+         */
+        static intrusive_ptr<DocumentSourceShardCursor> create(
+            const BSONObj &cursorObj, DBClientBase *pConnection,
+            const intrusive_ptr<ExpressionContext> &pExpCtx);
+
+    protected:
+        // virtuals from DocumentSource
+        virtual void sourceToBson(BSONObjBuilder *pBuilder, bool explain) const;
+
+    private:
+        DocumentSourceShardCursor(
+            const BSONObj &cursorObj, DBClientBase *pConnection,
+            const intrusive_ptr<ExpressionContext> &pExpCtx);
+
+        /* move on to the next document, from the first batch or a getMore() */
+        void findNext();
+
+        BSONObjIterator batchIterator; // over the first batch
+        scoped_ptr<DBClientCursor> pCursor; // NULL if there are no more
+        BSONObj current; // only valid until the next findNext()
+        bool haveCurrent;
     };
 
 
@@ -373,11 +481,25 @@ namespace mongo {
          */
         void setSort(const shared_ptr<BSONObj> &pBsonObj);
 
+        /*
+          Stop after producing this many documents.
+
+          This is used when a $limit follows the parts of the pipeline that
+          were folded into the cursor; the $limit stays in the pipeline,
+          but this lets the cursor be released as soon as it is done, and
+          shows up in explain output.
+
+          @param limit the maximum number of documents to produce
+         */
+        void setLimit(long long limit);
+
         /**
            Record the select list that was specified forthe cursor this wraps.
 
            This will get used to determine which fields are copied from the
-           cursor and passed downstream.
+           cursor and passed downstream:  only the top-level fields it
+           refers to (and _id) are converted into the Documents this source
+           produces.  An empty select list means all fields.
 
            @param pBsonObj the select list
          */
@@ -402,6 +524,28 @@ namespace mongo {
          */
         void releaseCursor();
 
+        /**
+           Note where the cursor is before the lock is released between
+           the getMore()s of a cursor over the pipeline's output, so that
+           it is told about deletes made meanwhile, as it is when it
+           yields.
+         */
+        void noteLocation();
+
+        /**
+           With the lock held again, recover from noteLocation().
+         */
+        void checkLocation();
+
+        /**
+           Release the lock, keeping the cursor safe as a yield does, so
+           that the pipeline's output can be written under a write lock;
+           see DocumentSourceOut.  Each unlock() is followed by a relock(),
+           which throws if the collection went away in between.
+         */
+        void unlock();
+        void relock();
+
     protected:
         // virtuals from DocumentSource
         virtual void sourceToBson(BSONObjBuilder *pBuilder, bool explain) const;
@@ -416,6 +560,16 @@ namespace mongo {
 
         string ns; // namespace
 
+        long long limit; // zero if there is no limit
+        long long nProduced;
+
+        /*
+          The top-level fields to convert, taken from the select list; if
+          selectAll, every field is converted.
+         */
+        bool selectAll;
+        vector<string> vSelectField;
+
         /*
           The bsonDependencies must outlive the Cursor wrapped by this
           source.  Therefore, bsonDependencies must appear before pCursor
@@ -432,6 +586,11 @@ namespace mongo {
          */
         ClientCursor::Holder pClientCursor;
 
+        /* between unlock() and relock() */
+        ClientCursor::YieldData yieldData;
+        bool yielded;
+        scoped_ptr<dbtempreleasecond> pTempRelease;
+
         /*
           Advance the cursor, and yield sometimes.
 
@@ -443,6 +602,174 @@ namespace mongo {
     };
 
 
+    /*
+      Runs several copies of the first part of a pipeline at once, each on
+      its own thread, over this source's input, which is dealt out to them
+      a batch at a time.  What they produce is merged by _id.  This is how
+      a mongod runs the shards' half of a pipeline split for sharding (see
+      Pipeline::splitForSharded()) on several cores; the rest of the
+      pipeline then merges the partial groups, as it would on mongos.
+
+      The input is only read from the thread that uses this source, which
+      is the one holding the lock the input needs.
+     */
+    class DocumentSourceParallel :
+        public DocumentSource {
+    public:
+        // virtuals from DocumentSource
+        virtual ~DocumentSourceParallel();
+        virtual bool eof();
+        virtual bool advance();
+        virtual intrusive_ptr<Document> getCurrent();
+
+        /**
+          Create a parallel source, with no workers yet.
+
+          @param pExpCtx the expression context for the pipeline
+          @returns the newly created DocumentSource
+         */
+        static intrusive_ptr<DocumentSourceParallel> create(
+            const intrusive_ptr<ExpressionContext> &pExpCtx);
+
+        /**
+          Add a worker to run a chain of sources.  The first reads the
+          worker's share of this source's input.  The last must do all of
+          its work before returning anything, and return its documents in
+          _id order, as a $group does on a shard.
+
+          The sources aren't thread safe, so each worker needs its own, and
+          its own ExpressionContext, created with getWorkerInterruptStatus().
+
+          Must be called before the first document is fetched.
+
+          @param vpSources the sources, first to last
+          @param pWorkerCtx the expression context the sources were made
+            with
+         */
+        void addWorker(const vector<intrusive_ptr<DocumentSource> > &vpSources,
+                       const intrusive_ptr<ExpressionContext> &pWorkerCtx);
+
+        /**
+          Only the thread using this source can check for killOp(); the
+          workers check with this instead, which interrupts them if that
+          thread gives up on them.
+
+          @returns the InterruptStatus for the workers' ExpressionContexts
+         */
+        InterruptStatus *getWorkerInterruptStatus();
+
+        static const char parallelName[];
+
+    protected:
+        // virtuals from DocumentSource
+        virtual void sourceToBson(BSONObjBuilder *pBuilder, bool explain) const;
+
+    private:
+        DocumentSourceParallel(
+            const intrusive_ptr<ExpressionContext> &pExpCtx);
+
+        /* a batch of input; a null batch tells a worker there is no more */
+        typedef shared_ptr<vector<intrusive_ptr<Document> > > Batch;
+        typedef BlockingQueue<Batch> BatchQueue;
+
+        /*
+          Enough batches queued for the workers not to wait on the input
+          much, without reading far ahead of them.
+         */
+        static const size_t maxQueuedBatches = 16;
+
+        /*
+          The first source of each worker's chain, which takes the batches
+          off the queue they're shared out on.
+         */
+        class Feed :
+            public DocumentSource {
+        public:
+            // virtuals from DocumentSource
+            virtual bool eof();
+            virtual bool advance();
+            virtual intrusive_ptr<Document> getCurrent();
+            virtual size_t getBatch(vector<intrusive_ptr<Document> > *pBatch,
+                                    size_t maxDocuments);
+
+            Feed(BatchQueue *pQueue,
+                 const intrusive_ptr<ExpressionContext> &pExpCtx);
+
+            /*
+              Throw away anything else queued for the workers, up to this
+              worker's end of the input, so the input isn't held up by a
+              worker that has failed.
+             */
+            void drain();
+
+        protected:
+            // virtuals from DocumentSource
+            virtual void sourceToBson(BSONObjBuilder *pBuilder,
+                                      bool explain) const;
+
+        private:
+            /* make sure there's a document at iBatch, unless we're done */
+            void fetch();
+
+            BatchQueue *pQueue;
+            Batch pBatch;
+            size_t iBatch;
+            bool done;
+        };
+
+        /* interrupts the workers once abandoned is set */
+        class WorkerStatus :
+            public InterruptStatus {
+        public:
+            // virtuals from InterruptStatus
+            virtual void checkForInterrupt();
+            virtual const char *checkForInterruptNoAssert();
+
+            WorkerStatus();
+            void abandon();
+
+        private:
+            mongo::mutex mtx;
+            bool abandoned;
+        };
+
+        struct Worker {
+            vector<intrusive_ptr<DocumentSource> > vpSource;
+            intrusive_ptr<Feed> pFeed;
+            shared_ptr<boost::thread> pThread;
+
+            /* set if the worker failed */
+            int errorCode;
+            string errorMessage;
+        };
+
+        /*
+          Deal out all of the input to the workers, wait for them to
+          finish, and start merging what they produced.
+         */
+        void populate();
+
+        /* the body of each worker's thread */
+        void runWorker(Worker *pWorker);
+
+        /*
+          Tell the workers the input is finished, and wait for them all.
+
+          @param abandon whether to interrupt them first
+         */
+        void finish(bool abandon);
+
+        WorkerStatus workerStatus; // must outlive the workers' contexts
+        BatchQueue queue;
+        vector<shared_ptr<Worker> > vpWorker;
+
+        bool populated;
+        DocIdComparator idComparator;
+        scoped_ptr<DocRunMerger> pMerger;
+        intrusive_ptr<Document> pCurrent;
+    };
+
+
     /*
       This contains all the basic mechanics for filtering a stream of
       Documents, except for the actual predicate evaluation itself.  This was
@@ -457,6 +784,8 @@ namespace mongo {
         virtual bool eof();
         virtual bool advance();
         virtual intrusive_ptr<Document> getCurrent();
+        virtual size_t getBatch(vector<intrusive_ptr<Document> > *pBatch,
+                                size_t maxDocuments);
 
         /**
           Create a BSONObj suitable for Matcher construction.
@@ -491,6 +820,9 @@ namespace mongo {
         bool unstarted;
         bool hasNext;
         intrusive_ptr<Document> pCurrent;
+
+        /* getBatch()'s input, kept to reuse its storage */
+        vector<intrusive_ptr<Document> > vpInput;
     };
 
 
@@ -606,6 +938,27 @@ namespace mongo {
                             const intrusive_ptr<ExpressionContext> &),
                             const intrusive_ptr<Expression> &pExpression);
 
+        /*
+          The factory for an accumulator, as addAccumulator() takes.
+         */
+        typedef intrusive_ptr<Accumulator> (*AccumulatorFactory)(
+            const intrusive_ptr<ExpressionContext> &);
+
+        /**
+          Parse one of a group's computed fields, { <op> : <operand> },
+          as createFromBson() does.  The group command uses this to take
+          the same specification.
+
+          @param pFieldName the name of the field, for error messages
+          @param pGroupField the field, whose value holds the operator
+          @param pFactory where to put the operator's accumulator factory
+          @param ppExpression where to put the operand
+         */
+        static void parseAccumulator(
+            const char *pFieldName, BSONElement *pGroupField,
+            AccumulatorFactory *pFactory,
+            intrusive_ptr<Expression> *ppExpression);
+
         /**
           Create a grouping DocumentSource from BSON.
 
@@ -628,7 +981,47 @@ namespace mongo {
 
           @returns the grouping DocumentSource
         */
-        intrusive_ptr<DocumentSource> createMerger();
+        intrusive_ptr<DocumentSourceGroup> createMerger();
+
+        /**
+          Tell this group that its input is already in order of the group
+          key, as when it merges the partial groups from shards.  It then
+          combines consecutive documents with the same key as they stream
+          by, rather than holding all the groups in a hash table.
+
+          @param b true if the input is sorted by the group key
+         */
+        void setInputSortedByKey(bool b);
+
+        /**
+          If the group key is a single field path, add the sort on that
+          field which brings the input in order of the group key, for
+          setInputSortedByKey().
+
+          @param pBuilder where to put the sort key
+          @returns the field, or an empty string if there's no such sort
+         */
+        string inputSortToBson(BSONObjBuilder *pBuilder) const;
+
+        /**
+          Whether the groups depend on the order of the input:  they do if
+          it's streamed in key order, or if any accumulator keeps the
+          first, last or every value it's given.  A group which doesn't
+          may be run over separate parts of its input, in any order, and
+          the results merged with createMerger().
+
+          @returns true if the order of the input matters
+         */
+        bool dependsOnInputOrder() const;
+
+        /*
+          The approximate number of bytes of groups a $group holds in
+          memory before it writes them out to disk as a run of partial
+          groups sorted by _id.  As for DocumentSourceSort, this only
+          applies to pipelines whose ExpressionContext has a temporary
+          directory.
+         */
+        static size_t maxMemoryUsageBytes;
 
         static const char groupName[];
 
@@ -650,8 +1043,9 @@ namespace mongo {
 
         intrusive_ptr<Expression> pIdExpression;
 
-        typedef boost::unordered_map<intrusive_ptr<const Value>,
-            vector<intrusive_ptr<Accumulator> >, Value::Hash> GroupsType;
+        typedef vector<intrusive_ptr<Accumulator> > AccumulatorVector;
+        typedef boost::unordered_map<HashedValue,
+            AccumulatorVector, HashedValue::Hash> GroupsType;
         GroupsType groups;
 
         /*
@@ -675,8 +1069,99 @@ namespace mongo {
         intrusive_ptr<Document> makeDocument(
             const GroupsType::iterator &rIter);
 
+        /*
+          Make the result document for one group.
+
+          @param pKey the group's _id
+          @param rAccumulators the group's accumulators
+          @param partial use the accumulators' partial values, for another
+            $group to merge (see Accumulator::getPartialValue())
+          @returns the document
+         */
+        intrusive_ptr<Document> makeDocument(
+            const intrusive_ptr<const Value> &pKey,
+            const AccumulatorVector &rAccumulators, bool partial);
+
+        /*
+          Create a fresh set of accumulators for a new group.
+
+          @param pCtx the context to create them with
+          @param rExpressions the operands, parallel to vFieldName
+          @param pAccumulators where to put them
+         */
+        void createAccumulators(
+            const intrusive_ptr<ExpressionContext> &pCtx,
+            const vector<intrusive_ptr<Expression> > &rExpressions,
+            AccumulatorVector *pAccumulators);
+
+        /*
+          Get the groups in order of their _id.
+
+          @param pSorted where to put iterators for all the groups
+         */
+        void sortGroups(vector<GroupsType::iterator> *pSorted);
+
+        /*
+          Write all the groups out to a new run file of partial groups in
+          _id order, and clear the hash table.
+         */
+        void spill();
+
+        /*
+          The next document in _id order from the input that's being
+          streamed:  either the DocRun over pSource (for
+          setInputSortedByKey()), or the merge of the spilled runs.
+
+          @returns the next document, or null at the end
+         */
+        intrusive_ptr<Document> nextStreamedInput();
+
+        /*
+          Combine the next run of documents with the same key from the
+          streamed input.
+
+          @returns the group's result document, or null at the end
+         */
+        intrusive_ptr<Document> nextStreamedGroup();
+
         GroupsType::iterator groupsIterator;
         intrusive_ptr<Document> pCurrent;
+
+        /* used to return the groups in _id order on a shard */
+        bool sortedOutput;
+        vector<GroupsType::iterator> sortedGroups;
+        size_t sortedGroupsIndex;
+
+        /*
+          Approximate size of the groups in memory, to decide when to
+          spill, and whether any accumulator collects the values it's
+          given (making that size depend on the input documents).
+         */
+        size_t memoryUsageBytes;
+        MemAccounting::Charge heldMemory; // memoryUsageBytes, for serverStatus
+        bool collectsValues;
+
+        /*
+          Streaming state, used for setInputSortedByKey() and once groups
+          have spilled to disk.  A stream is grouped by pStreamIdExpression,
+          with accumulators created in pStreamCtx over vpStreamExpression.
+          When merging spilled runs, these read the partial groups' fields,
+          and pStreamCtx is in router mode, as for createMerger().
+         */
+        bool inputSortedByKey;
+        bool streaming;
+        intrusive_ptr<Expression> pStreamIdExpression;
+        vector<intrusive_ptr<Expression> > vpStreamExpression;
+        intrusive_ptr<ExpressionContext> pStreamCtx;
+        shared_ptr<DocRun> pStreamRun;
+        intrusive_ptr<Document> pNextInput;
+
+        /* spilled runs of partial groups */
+        scoped_ptr<DocSpillDirectory> pSpillDir;
+        vector<string> runFiles;
+        vector<intrusive_ptr<Document> > lastRun; // the groups left in memory
+        DocIdComparator idComparator;
+        scoped_ptr<DocRunMerger> pMerger;
     };
 
 
@@ -784,21 +1269,65 @@ namespace mongo {
         virtual intrusive_ptr<Document> getCurrent();
 
         /**
-          Create a document source for output and pass-through.
+          Create a document source for output.
 
-          This can be put anywhere in a pipeline and will store content as
-          well as pass it on.
+          This must be the last stage of a pipeline.  It consumes all of
+          its input, and replaces the collection it names with it; nothing
+          is passed on.
 
           @param pBsonElement the raw BSON specification for the source
           @param pExpCtx the expression context for the pipeline
           @returns the newly created document source
         */
-        static intrusive_ptr<DocumentSourceOut> createFromBson(
+        static intrusive_ptr<DocumentSource> createFromBson(
             BSONElement *pBsonElement,
             const intrusive_ptr<ExpressionContext> &pExpCtx);
 
         static const char outName[];
 
+        /*
+          The writing is done by a Writer, which the document source hands
+          its input to a batch at a time.  Writing needs what is only
+          available in mongod, so mongod supplies one; see
+          PipelineD::prepareCursorSource().
+         */
+        class Writer {
+        public:
+            virtual ~Writer();
+
+            /* write a batch of documents to where they will be collected */
+            virtual void insert(const vector<BSONObj> &batch) = 0;
+
+            /* replace the output collection with what has been written */
+            virtual void finish() = 0;
+
+            /*
+              Throw away what has been written after an error; this
+              mustn't throw.
+             */
+            virtual void abandon() = 0;
+        };
+
+        /*
+          Set where the output is written.
+
+          @param pWriter the writer
+         */
+        void setWriter(const shared_ptr<Writer> &pWriter);
+
+        /*
+          @returns the name of the collection the output replaces, without
+            the database name
+         */
+        string getOutputCollection() const;
+
+        /*
+          Batches are bounded by both of these, so that each holds the
+          write lock briefly.
+         */
+        static const size_t maxBatchDocs = 1000;
+        static const int maxBatchBytes = 1024 * 1024;
+
     protected:
         // virtuals from DocumentSource
         virtual void sourceToBson(BSONObjBuilder *pBuilder, bool explain) const;
@@ -806,6 +1335,19 @@ namespace mongo {
     private:
         DocumentSourceOut(BSONElement *pBsonElement,
             const intrusive_ptr<ExpressionContext> &pExpCtx);
+
+        /* write all of the input, the first time eof() or advance() asks */
+        void populate();
+
+        /* write out the documents batched so far */
+        void flush();
+
+        string collectionName;
+        bool populated;
+        shared_ptr<Writer> pWriter;
+
+        vector<BSONObj> vBatch;
+        int batchBytes;
     };
 
     
@@ -818,6 +1360,8 @@ namespace mongo {
         virtual bool advance();
         virtual const char *getSourceName() const;
         virtual intrusive_ptr<Document> getCurrent();
+        virtual size_t getBatch(vector<intrusive_ptr<Document> > *pBatch,
+                                size_t maxDocuments);
         virtual void optimize();
         virtual void manageDependencies(
             const intrusive_ptr<DependencyTracker> &pTracker);
@@ -880,10 +1424,17 @@ namespace mongo {
     private:
         DocumentSourceProject(const intrusive_ptr<ExpressionContext> &pExpCtx);
 
+        /* the projection of one input document */
+        intrusive_ptr<Document> project(
+            const intrusive_ptr<Document> &pInDocument) const;
+
         // configuration state
         bool excludeId;
         intrusive_ptr<ExpressionObject> pEO;
 
+        /* getBatch()'s input, kept to reuse its storage */
+        vector<intrusive_ptr<Document> > vpInput;
+
         /*
           Utility object used by manageDependencies().
 
@@ -929,11 +1480,17 @@ namespace mongo {
         virtual intrusive_ptr<Document> getCurrent();
         virtual void manageDependencies(
             const intrusive_ptr<DependencyTracker> &pTracker);
+        virtual void addToBsonArray(BSONArrayBuilder *pBuilder,
+                                    bool explain = false) const;
+
         /*
+          Absorb a $limit that follows this sort, so that only that many
+          documents need to be kept while sorting.
+
           TODO
           Adjacent sorts should reduce to the last sort.
+         */
         virtual bool coalesce(const intrusive_ptr<DocumentSource> &pNextSource);
-        */
 
         /**
           Create a new sorting DocumentSource.
@@ -964,6 +1521,12 @@ namespace mongo {
          */
         void sortKeyToBson(BSONObjBuilder *pBuilder, bool usePrefix) const;
 
+        /*
+          @returns the limit absorbed from a following $limit, or zero if
+            there isn't one
+         */
+        long long getLimit() const;
+
         /**
           Create a sorting DocumentSource from BSON.
 
@@ -982,6 +1545,14 @@ namespace mongo {
 
         static const char sortName[];
 
+        /*
+          The approximate number of bytes of documents a sort will hold in
+          memory before it writes them out to disk as a sorted run.  This
+          only applies to pipelines whose ExpressionContext has a temporary
+          directory; the others are bounded by DocMemMonitor instead.
+         */
+        static size_t maxMemoryUsageBytes;
+
     protected:
         // virtuals from DocumentSource
         virtual void sourceToBson(BSONObjBuilder *pBuilder, bool explain) const;
@@ -999,6 +1570,17 @@ namespace mongo {
         bool populated;
         long long count;
 
+        /*
+          If there's a limit, populate() keeps only the first limit
+          documents in a heap, the way ScanAndOrder does for queries, and
+          only falls back to spilling if those alone don't fit in memory.
+         */
+        long long limit; // zero if there is no limit
+        long long nReturned; // counts up to the limit, if there is one
+
+        /* the documents held in memory, for serverStatus */
+        MemAccounting::Charge heldMemory;
+
         /* these two parallel each other */
         typedef vector<intrusive_ptr<ExpressionFieldPath> > SortPaths;
         SortPaths vSortKey;
@@ -1040,6 +1622,33 @@ namespace mongo {
 
         VectorType::iterator docIterator;
         intrusive_ptr<Document> pCurrent;
+
+        /*
+          Sort the documents held in memory and write them out to a new run
+          file in the spill directory, leaving the documents vector empty.
+         */
+        void spill();
+
+        /* DocRunMerger ordering by the sort key */
+        class MergeComparator :
+            public DocRunMerger::Comparator {
+        public:
+            virtual int compare(const intrusive_ptr<Document> &pL,
+                                const intrusive_ptr<Document> &pR);
+
+            inline MergeComparator(DocumentSourceSort *pS):
+                pSort(pS) {
+            }
+
+        private:
+            DocumentSourceSort *pSort;
+        };
+
+        /* these are only used once the sort has spilled to disk */
+        scoped_ptr<DocSpillDirectory> pSpillDir;
+        vector<string> runFiles;
+        MergeComparator mergeComparator;
+        scoped_ptr<DocRunMerger> pMerger;
     };
 
 
@@ -1063,6 +1672,16 @@ namespace mongo {
         static intrusive_ptr<DocumentSourceLimit> create(
             const intrusive_ptr<ExpressionContext> &pExpCtx);
 
+        /**
+          Create a new limiting DocumentSource with the given limit.
+
+          @param pExpCtx the expression context for the pipeline
+          @param limit the maximum number of documents to pass along
+          @returns the DocumentSource
+         */
+        static intrusive_ptr<DocumentSourceLimit> create(
+            const intrusive_ptr<ExpressionContext> &pExpCtx, long long limit);
+
         /**
           Create a limiting DocumentSource from BSON.
 
@@ -1078,6 +1697,10 @@ namespace mongo {
             BSONElement *pBsonElement,
             const intrusive_ptr<ExpressionContext> &pExpCtx);
 
+        /*
+          @returns the maximum number of documents this will pass along
+         */
+        long long getLimit() const;
 
         static const char limitName[];
 
@@ -1223,17 +1846,20 @@ namespace mongo {
         /*
           Clone the current document being unwound.
 
-          This is a partial deep clone.  Because we're going to replace the
-          value at the end, we have to replace everything along the path
-          leading to that in order to not share that change with any other
-          clones (or the original) that we've made.
+          Because we're going to replace the value at the end, we have to
+          replace everything along the path leading to that in order to not
+          share that change with any other clones (or the original) that
+          we've made.  Each document along the path is replaced by an
+          overlay (see Document::createOverlay()) which shares all of its
+          other fields with the original, so this costs the same whatever
+          the size of the document.
 
           This expects pUnwindValue to have been set by a prior call to
           advance().  However, pUnwindValue may also be NULL, in which case
           the field will be removed -- this is the action for an empty
-          array.
+          array, and then the documents along the path are cloned.
 
-          @returns a partial deep clone of pNoUnwindDocument
+          @returns a copy of pNoUnwindDocument with the unwound value
          */
         intrusive_ptr<Document> clonePath() const;
     };
@@ -1258,6 +1884,10 @@ namespace mongo {
         pIdExpression = pExpression;
     }
 
+    inline void DocumentSourceGroup::setInputSortedByKey(bool b) {
+        inputSortedByKey = b;
+    }
+
     inline DocumentSourceProject::DependencyChecker::DependencyChecker(
         const intrusive_ptr<const DependencyTracker> &pTrack,
         const DocumentSourceProject *pT):
@@ -64,11 +64,20 @@ namespace mongo {
         const intrusive_ptr<ExpressionContext> &pExpCtx):
         DocumentSource(pExpCtx),
         newSource(false),
-        pBsonSource(),
+        pShardSource(),
         pCurrent(),
         iterator(pList->begin()),
         listEnd(pList->end()),
-        errmsg(theErrmsg) {
+        errmsg(theErrmsg),
+        mergeById(false),
+        vpShardSource(),
+        idComparator(),
+        pMerger() {
+    }
+
+    void DocumentSourceCommandFutures::setMergeById() {
+        verify(!pCurrent.get() && !pMerger);
+        mergeById = true;
     }
 
     intrusive_ptr<DocumentSourceCommandFutures>
@@ -80,9 +89,59 @@ namespace mongo {
         return pSource;
     }
 
+    void DocumentSourceCommandFutures::startMergeById() {
+        pMerger.reset(new DocRunMerger(&idComparator));
+
+        for(; iterator != listEnd; ++iterator) {
+            shared_ptr<Future::CommandResult> pResult(*iterator);
+            if (!pResult->join()) {
+                error() << "sharded pipeline failed on shard: " <<
+                    pResult->getServer() << " error: " <<
+                    pResult->result() << endl;
+                errmsg += "-- mongod pipeline failed: ";
+                errmsg += pResult->result().toString();
+                continue;
+            }
+
+            intrusive_ptr<DocumentSource> pSource(createShardSource(pResult));
+            if (!pSource.get())
+                continue;
+
+            vpShardSource.push_back(pSource);
+            pMerger->addRun(
+                shared_ptr<DocRun>(DocRun::createFromSource(pSource.get())));
+        }
+    }
+
+    intrusive_ptr<DocumentSource>
+    DocumentSourceCommandFutures::createShardSource(
+        const shared_ptr<Future::CommandResult> &pResult) {
+        BSONObj shardResult(pResult->result());
+
+        BSONElement cursorElement(shardResult["cursor"]);
+        if (cursorElement.type() == Object) {
+            return DocumentSourceShardCursor::create(
+                cursorElement.embeddedObject(), pResult->getConnection(),
+                pExpCtx);
+        }
+
+        BSONElement resultElement(shardResult["result"]);
+        if (resultElement.type() != Array)
+            return intrusive_ptr<DocumentSource>();
+
+        return DocumentSourceBsonArray::create(&resultElement, pExpCtx);
+    }
+
     void DocumentSourceCommandFutures::getNextDocument() {
+        if (mergeById) {
+            if (!pMerger)
+                startMergeById();
+            pCurrent = pMerger->next();
+            return;
+        }
+
         while(true) {
-            if (!pBsonSource.get()) {
+            if (!pShardSource.get()) {
                 /* if there aren't any more futures, we're done */
                 if (iterator == listEnd) {
                     pCurrent.reset();
@@ -105,31 +164,21 @@ namespace mongo {
                     continue;
                 }
 
-                /* grab the result array out of the shard server's response */
-                BSONObj shardResult(pResult->result());
-                BSONObjIterator objIterator(shardResult);
-                while(objIterator.more()) {
-                    BSONElement element(objIterator.next());
-                    const char *pFieldName = element.fieldName();
-
-                    /* find the result array and quit this loop */
-                    if (strcmp(pFieldName, "result") == 0) {
-                        pBsonSource = DocumentSourceBsonArray::create(
-                            &element, pExpCtx);
-                        newSource = true;
-                        break;
-                    }
-                }
+                /* read the output out of the shard server's response */
+                pShardSource = createShardSource(pResult);
+                if (!pShardSource.get())
+                    continue;
+                newSource = true;
             }
 
             /* if we're done with this shard's results, try the next */
-            if (pBsonSource->eof() ||
-                (!newSource && !pBsonSource->advance())) {
-                pBsonSource.reset();
+            if (pShardSource->eof() ||
+                (!newSource && !pShardSource->advance())) {
+                pShardSource.reset();
                 continue;
             }
 
-            pCurrent = pBsonSource->getCurrent();
+            pCurrent = pShardSource->getCurrent();
             newSource = false;
             return;
         }
@@ -79,11 +79,47 @@ namespace mongo {
         return pCurrent;
     }
 
+    size_t DocumentSourceFilterBase::getBatch(
+        vector<intrusive_ptr<Document> > *pBatch, size_t maxDocuments) {
+        DocumentSource::advance(); // check for interrupts
+
+        if (unstarted)
+            findNext();
+
+        if (!pCurrent.get() || !maxDocuments)
+            return 0;
+
+        /* the current document has already been accepted */
+        const size_t start = pBatch->size();
+        pBatch->push_back(pCurrent);
+
+        size_t taken = 1;
+        while(hasNext && (taken < maxDocuments)) {
+            pSource->getBatch(&vpInput, maxDocuments - taken);
+            hasNext = !pSource->eof();
+
+            const size_t n = vpInput.size();
+            for(size_t i = 0; i < n; ++i) {
+                if (accept(vpInput[i]))
+                    pBatch->push_back(vpInput[i]);
+            }
+            vpInput.clear();
+
+            taken = pBatch->size() - start;
+        }
+
+        /* line up the document after the last one taken */
+        findNext();
+
+        return taken;
+    }
+
     DocumentSourceFilterBase::DocumentSourceFilterBase(
         const intrusive_ptr<ExpressionContext> &pExpCtx):
         DocumentSource(pExpCtx),
         unstarted(true),
         hasNext(false),
-        pCurrent() {
+        pCurrent(),
+        vpInput() {
     }
 }
@@ -28,6 +28,36 @@
 namespace mongo {
     const char DocumentSourceGroup::groupName[] = "$group";
 
+    size_t DocumentSourceGroup::maxMemoryUsageBytes = 100 * 1024 * 1024;
+
+    /*
+      A rough allowance for the hash table entry of a group, and for each of
+      its accumulators, on top of the size of its key.
+     */
+    static const size_t groupOverheadBytes = 64;
+    static const size_t accumulatorOverheadBytes = 64;
+
+    namespace {
+        /* orders iterators over GroupsType by group key */
+        struct GroupKeyLess {
+            template<class Iterator>
+            bool operator()(const Iterator &rL, const Iterator &rR) const {
+                return (Value::compare(rL->first.getValue(),
+                                       rR->first.getValue()) < 0);
+            }
+        };
+
+        /* treat Undefined the same as NULL SERVER-4674 */
+        inline intrusive_ptr<const Value> groupKey(
+            const intrusive_ptr<Expression> &pIdExpression,
+            const intrusive_ptr<Document> &pDocument) {
+            intrusive_ptr<const Value> pId(pIdExpression->evaluate(pDocument));
+            if (pId->getType() == Undefined)
+                pId = Value::getNull();
+            return pId;
+        }
+    }
+
     DocumentSourceGroup::~DocumentSourceGroup() {
     }
 
@@ -39,6 +69,11 @@ namespace mongo {
         if (!populated)
             populate();
 
+        if (streaming)
+            return !pCurrent;
+        if (sortedOutput)
+            return (sortedGroupsIndex == sortedGroups.size());
+
         return (groupsIterator == groups.end());
     }
 
@@ -48,6 +83,24 @@ namespace mongo {
         if (!populated)
             populate();
 
+        if (streaming) {
+            verify(pCurrent);
+            pCurrent = nextStreamedGroup();
+            return (pCurrent.get() != NULL);
+        }
+
+        if (sortedOutput) {
+            verify(sortedGroupsIndex < sortedGroups.size());
+            ++sortedGroupsIndex;
+            if (sortedGroupsIndex == sortedGroups.size()) {
+                pCurrent.reset();
+                return false;
+            }
+
+            pCurrent = makeDocument(sortedGroups[sortedGroupsIndex]);
+            return true;
+        }
+
         verify(groupsIterator != groups.end());
 
         ++groupsIterator;
@@ -100,7 +153,16 @@ namespace mongo {
         groups(),
         vFieldName(),
         vpAccumulatorFactory(),
-        vpExpression() {
+        vpExpression(),
+        sortedOutput(false),
+        sortedGroups(),
+        sortedGroupsIndex(0),
+        memoryUsageBytes(0),
+        heldMemory(MemAccounting::Aggregation),
+        collectsValues(false),
+        inputSortedByKey(false),
+        streaming(false),
+        idComparator() {
     }
 
     void DocumentSourceGroup::addAccumulator(
@@ -111,6 +173,25 @@ namespace mongo {
         vFieldName.push_back(fieldName);
         vpAccumulatorFactory.push_back(pAccumulatorFactory);
         vpExpression.push_back(pExpression);
+
+        /* these hold on to every value they're given */
+        if ((pAccumulatorFactory == AccumulatorPush::create) ||
+            (pAccumulatorFactory == AccumulatorAddToSet::create))
+            collectsValues = true;
+    }
+
+    void DocumentSourceGroup::createAccumulators(
+        const intrusive_ptr<ExpressionContext> &pCtx,
+        const vector<intrusive_ptr<Expression> > &rExpressions,
+        AccumulatorVector *pAccumulators) {
+        const size_t n = vpAccumulatorFactory.size();
+        pAccumulators->reserve(n);
+        for(size_t i = 0; i < n; ++i) {
+            intrusive_ptr<Accumulator> pAccumulator(
+                (*vpAccumulatorFactory[i])(pCtx));
+            pAccumulator->addOperand(rExpressions[i]);
+            pAccumulators->push_back(pAccumulator);
+        }
     }
 
 
@@ -142,6 +223,62 @@ namespace mongo {
 
     static const size_t NGroupOp = sizeof(GroupOpTable)/sizeof(GroupOpTable[0]);
 
+    void DocumentSourceGroup::parseAccumulator(
+        const char *pFieldName, BSONElement *pGroupField,
+        AccumulatorFactory *pFactory,
+        intrusive_ptr<Expression> *ppExpression) {
+        uassert(15951, str::stream() <<
+                "the group aggregate field \"" << pFieldName <<
+                "\" must be defined as an expression inside an object",
+                pGroupField->type() == Object);
+
+        BSONObj subField(pGroupField->Obj());
+        BSONObjIterator subIterator(subField);
+        size_t subCount = 0;
+        for(; subIterator.more(); ++subCount) {
+            BSONElement subElement(subIterator.next());
+
+            /* look for the specified operator */
+            GroupOpDesc key;
+            key.pName = subElement.fieldName();
+            const GroupOpDesc *pOp =
+                (const GroupOpDesc *)bsearch(
+                      &key, GroupOpTable, NGroupOp, sizeof(GroupOpDesc),
+                              GroupOpDescCmp);
+
+            uassert(15952, str::stream() <<
+                    "unknown group operator \"" <<
+                    key.pName << "\"",
+                    pOp);
+
+            intrusive_ptr<Expression> pGroupExpr;
+
+            BSONType elementType = subElement.type();
+            if (elementType == Object) {
+                Expression::ObjectCtx oCtx(
+                    Expression::ObjectCtx::DOCUMENT_OK);
+                pGroupExpr = Expression::parseObject(
+                    &subElement, &oCtx);
+            }
+            else if (elementType == Array) {
+                uassert(15953, str::stream() <<
+                        "aggregating group operators are unary (" <<
+                        key.pName << ")", false);
+            }
+            else { /* assume its an atomic single operand */
+                pGroupExpr = Expression::parseOperand(&subElement);
+            }
+
+            *pFactory = pOp->pFactory;
+            *ppExpression = pGroupExpr;
+        }
+
+        uassert(15954, str::stream() <<
+                "the computed aggregate \"" <<
+                pFieldName << "\" must specify exactly one operator",
+                subCount == 1);
+    }
+
     intrusive_ptr<DocumentSource> DocumentSourceGroup::createFromBson(
         BSONElement *pBsonElement,
         const intrusive_ptr<ExpressionContext> &pExpCtx) {
@@ -233,56 +370,11 @@ namespace mongo {
                         pFieldName << "\" cannot be an operator name",
                         *pFieldName != '$');
 
-                uassert(15951, str::stream() <<
-                        "the group aggregate field \"" << pFieldName <<
-                        "\" must be defined as an expression inside an object",
-                        groupField.type() == Object);
-
-                BSONObj subField(groupField.Obj());
-                BSONObjIterator subIterator(subField);
-                size_t subCount = 0;
-                for(; subIterator.more(); ++subCount) {
-                    BSONElement subElement(subIterator.next());
-
-                    /* look for the specified operator */
-                    GroupOpDesc key;
-                    key.pName = subElement.fieldName();
-                    const GroupOpDesc *pOp =
-                        (const GroupOpDesc *)bsearch(
-                              &key, GroupOpTable, NGroupOp, sizeof(GroupOpDesc),
-                                      GroupOpDescCmp);
-
-                    uassert(15952, str::stream() <<
-                            "unknown group operator \"" <<
-                            key.pName << "\"",
-                            pOp);
-
-                    intrusive_ptr<Expression> pGroupExpr;
-
-                    BSONType elementType = subElement.type();
-                    if (elementType == Object) {
-                        Expression::ObjectCtx oCtx(
-                            Expression::ObjectCtx::DOCUMENT_OK);
-                        pGroupExpr = Expression::parseObject(
-                            &subElement, &oCtx);
-                    }
-                    else if (elementType == Array) {
-                        uassert(15953, str::stream() <<
-                                "aggregating group operators are unary (" <<
-                                key.pName << ")", false);
-                    }
-                    else { /* assume its an atomic single operand */
-                        pGroupExpr = Expression::parseOperand(&subElement);
-                    }
-
-                    pGroup->addAccumulator(
-                        pFieldName, pOp->pFactory, pGroupExpr);
-                }
-
-                uassert(15954, str::stream() <<
-                        "the computed aggregate \"" <<
-                        pFieldName << "\" must specify exactly one operator",
-                        subCount == 1);
+                AccumulatorFactory pFactory;
+                intrusive_ptr<Expression> pGroupExpr;
+                parseAccumulator(pFieldName, &groupField, &pFactory,
+                                 &pGroupExpr);
+                pGroup->addAccumulator(pFieldName, pFactory, pGroupExpr);
             }
         }
 
@@ -292,56 +384,121 @@ namespace mongo {
     }
 
     void DocumentSourceGroup::populate() {
-        for(bool hasNext = !pSource->eof(); hasNext;
-                hasNext = pSource->advance()) {
-            intrusive_ptr<Document> pDocument(pSource->getCurrent());
+        if (inputSortedByKey) {
+            /* combine consecutive documents with the same key */
+            streaming = true;
+            pStreamIdExpression = pIdExpression;
+            vpStreamExpression = vpExpression;
+            pStreamCtx = pExpCtx;
+            pStreamRun.reset(DocRun::createFromSource(pSource));
+
+            pNextInput = nextStreamedInput();
+            pCurrent = nextStreamedGroup();
+            populated = true;
+            return;
+        }
 
-            /* get the _id document */
-            intrusive_ptr<const Value> pId(pIdExpression->evaluate(pDocument));
+        /*
+          If we have somewhere to put them, write the groups out to disk as
+          a run of partial groups whenever they grow past
+          maxMemoryUsageBytes.
+         */
+        const bool canSpill = !pExpCtx->getTempDir().empty();
 
-            /* treat Undefined the same as NULL SERVER-4674 */
-            if (pId->getType() == Undefined)
-                pId = Value::getNull();
+        /* take the input in batches, so that stages before this can too */
+        vector<intrusive_ptr<Document> > vpBatch;
+        while(pSource->getBatch(&vpBatch, batchSize)) {
+            const size_t nBatch = vpBatch.size();
+            for(size_t iBatch = 0; iBatch < nBatch; ++iBatch) {
+                const intrusive_ptr<Document> &pDocument(vpBatch[iBatch]);
 
-            /*
-              Look for the _id value in the map; if it's not there, add a
-              new entry with a blank accumulator.
-            */
-            vector<intrusive_ptr<Accumulator> > *pGroup;
-            GroupsType::iterator it(groups.find(pId));
-            if (it != groups.end()) {
-                /* point at the existing accumulators */
-                pGroup = &it->second;
-            }
-            else {
-                /* insert a new group into the map */
-                groups.insert(it,
-                              pair<intrusive_ptr<const Value>,
-                              vector<intrusive_ptr<Accumulator> > >(
-                                  pId, vector<intrusive_ptr<Accumulator> >()));
-
-                /* find the accumulator vector (the map value) */
-                it = groups.find(pId);
-                pGroup = &it->second;
-
-                /* add the accumulators */
-                const size_t n = vpAccumulatorFactory.size();
-                pGroup->reserve(n);
-                for(size_t i = 0; i < n; ++i) {
-                    intrusive_ptr<Accumulator> pAccumulator(
-                        (*vpAccumulatorFactory[i])(pExpCtx));
-                    pAccumulator->addOperand(vpExpression[i]);
-                    pGroup->push_back(pAccumulator);
+                /* get the _id document, hashing it just this once */
+                const HashedValue id(groupKey(pIdExpression, pDocument));
+
+                /*
+                  Look for the _id value in the map; if it's not there, this
+                  adds a new entry for it with a blank accumulator vector.
+                */
+                pair<GroupsType::iterator, bool> found(
+                    groups.insert(make_pair(id, AccumulatorVector())));
+                AccumulatorVector *pGroup = &found.first->second;
+                if (found.second) {
+                    /* add the accumulators */
+                    createAccumulators(pExpCtx, vpExpression, pGroup);
+
+                    memoryUsageBytes += id.getValue()->getApproximateSize() +
+                        groupOverheadBytes +
+                        (pGroup->size() * accumulatorOverheadBytes);
                 }
-            }
 
-            /* point at the existing key */
-            // unneeded atm // pId = it.first;
+                /* tickle all the accumulators for the group we found */
+                const size_t n = pGroup->size();
+                for(size_t i = 0; i < n; ++i)
+                    (*pGroup)[i]->evaluate(pDocument);
 
-            /* tickle all the accumulators for the group we found */
-            const size_t n = pGroup->size();
+                if (collectsValues)
+                    memoryUsageBytes += pDocument->getApproximateSize();
+
+                if (canSpill && (memoryUsageBytes > maxMemoryUsageBytes))
+                    spill();
+                heldMemory.set(memoryUsageBytes);
+            }
+            vpBatch.clear();
+        }
+
+        if (!runFiles.empty()) {
+            /*
+              Merge the spilled runs with the groups still in memory.  Those
+              go last; they saw the latest input, which matters for $first
+              and $last.  The merge gives us the partial groups in _id
+              order, so we can combine them as they stream by, the way the
+              router does for shards.
+             */
+            vector<GroupsType::iterator> sorted;
+            sortGroups(&sorted);
+            const size_t nGroups = sorted.size();
+            lastRun.reserve(nGroups);
+            for(size_t i = 0; i < nGroups; ++i)
+                lastRun.push_back(
+                    makeDocument(sorted[i]->first.getValue(), sorted[i]->second,
+                                 true));
+            groups.clear();
+
+            pMerger.reset(new DocRunMerger(&idComparator));
+            for(size_t i = 0; i < runFiles.size(); ++i)
+                pMerger->addRun(
+                    shared_ptr<DocRun>(DocRun::createFromFile(runFiles[i])));
+            pMerger->addRun(
+                shared_ptr<DocRun>(DocRun::createFromVector(&lastRun)));
+
+            streaming = true;
+            pStreamIdExpression = ExpressionFieldPath::create(Document::idName);
+            const size_t n = vFieldName.size();
             for(size_t i = 0; i < n; ++i)
-                (*pGroup)[i]->evaluate(pDocument);
+                vpStreamExpression.push_back(
+                    ExpressionFieldPath::create(vFieldName[i]));
+            pStreamCtx = pExpCtx->clone();
+            pStreamCtx->setInRouter(true);
+
+            pNextInput = nextStreamedInput();
+            pCurrent = nextStreamedGroup();
+            populated = true;
+            return;
+        }
+
+        /*
+          On a shard, return the groups in _id order, so that the router
+          can merge the shards' results and stream them through its
+          merging group (see Pipeline::splitForSharded()).
+         */
+        if (pExpCtx->getInShard()) {
+            sortedOutput = true;
+            sortGroups(&sortedGroups);
+            sortedGroupsIndex = 0;
+            if (!sortedGroups.empty())
+                pCurrent = makeDocument(sortedGroups[0]);
+            populated = true;
+            return;
         }
 
         /* start the group iterator */
@@ -351,18 +508,95 @@ namespace mongo {
         populated = true;
     }
 
+    void DocumentSourceGroup::sortGroups(
+        vector<GroupsType::iterator> *pSorted) {
+        pSorted->reserve(groups.size());
+        for(GroupsType::iterator it(groups.begin()); it != groups.end(); ++it)
+            pSorted->push_back(it);
+
+        sort(pSorted->begin(), pSorted->end(), GroupKeyLess());
+    }
+
+    void DocumentSourceGroup::spill() {
+        if (!pSpillDir)
+            pSpillDir.reset(
+                new DocSpillDirectory(pExpCtx->getTempDir(), "agggroup"));
+
+        vector<GroupsType::iterator> sorted;
+        sortGroups(&sorted);
+
+        const string fileName(pSpillDir->newFileName());
+        DocSpillWriter writer(fileName);
+        const size_t n = sorted.size();
+        for(size_t i = 0; i < n; ++i)
+            writer.write(makeDocument(sorted[i]->first.getValue(),
+                                      sorted[i]->second, true));
+        writer.close();
+
+        runFiles.push_back(fileName);
+        log(2) << groupName << " wrote " << n << " groups to " <<
+            fileName << endl;
+
+        groups.clear();
+        memoryUsageBytes = 0;
+        heldMemory.set(0);
+    }
+
+    intrusive_ptr<Document> DocumentSourceGroup::nextStreamedInput() {
+        if (pMerger)
+            return pMerger->next();
+
+        if (!pStreamRun->more())
+            return intrusive_ptr<Document>();
+
+        intrusive_ptr<Document> pNext(pStreamRun->getCurrent());
+        pStreamRun->advance();
+        return pNext;
+    }
+
+    intrusive_ptr<Document> DocumentSourceGroup::nextStreamedGroup() {
+        if (!pNextInput)
+            return intrusive_ptr<Document>();
+
+        intrusive_ptr<const Value> pKey(
+            groupKey(pStreamIdExpression, pNextInput));
+        AccumulatorVector accumulators;
+        createAccumulators(pStreamCtx, vpStreamExpression, &accumulators);
+
+        const size_t n = accumulators.size();
+        while(true) {
+            for(size_t i = 0; i < n; ++i)
+                accumulators[i]->evaluate(pNextInput);
+
+            pNextInput = nextStreamedInput();
+            if (!pNextInput ||
+                (Value::compare(groupKey(pStreamIdExpression, pNextInput),
+                                pKey) != 0))
+                break;
+        }
+
+        return makeDocument(pKey, accumulators, false);
+    }
+
     intrusive_ptr<Document> DocumentSourceGroup::makeDocument(
         const GroupsType::iterator &rIter) {
-        vector<intrusive_ptr<Accumulator> > *pGroup = &rIter->second;
+        return makeDocument(rIter->first.getValue(), rIter->second, false);
+    }
+
+    intrusive_ptr<Document> DocumentSourceGroup::makeDocument(
+        const intrusive_ptr<const Value> &pKey,
+        const AccumulatorVector &rAccumulators, bool partial) {
         const size_t n = vFieldName.size();
         intrusive_ptr<Document> pResult(Document::create(1 + n));
 
         /* add the _id field */
-        pResult->addField(Document::idName, rIter->first);
+        pResult->addField(Document::idName, pKey);
 
         /* add the rest of the fields */
         for(size_t i = 0; i < n; ++i) {
-            intrusive_ptr<const Value> pValue((*pGroup)[i]->getValue());
+            intrusive_ptr<const Value> pValue(partial ?
+                rAccumulators[i]->getPartialValue() :
+                rAccumulators[i]->getValue());
             if (pValue->getType() != Undefined)
                 pResult->addField(vFieldName[i], pValue);
         }
@@ -370,7 +604,34 @@ namespace mongo {
         return pResult;
     }
 
-    intrusive_ptr<DocumentSource> DocumentSourceGroup::createMerger() {
+    string DocumentSourceGroup::inputSortToBson(
+        BSONObjBuilder *pBuilder) const {
+        const ExpressionFieldPath *pFieldPath =
+            dynamic_cast<ExpressionFieldPath *>(pIdExpression.get());
+        if (!pFieldPath)
+            return "";
+
+        string field(pFieldPath->getFieldPath(false));
+        pBuilder->append(field, 1);
+        return field;
+    }
+
+    bool DocumentSourceGroup::dependsOnInputOrder() const {
+        if (inputSortedByKey)
+            return true;
+
+        const size_t n = vpAccumulatorFactory.size();
+        for(size_t i = 0; i < n; ++i) {
+            if ((vpAccumulatorFactory[i] == AccumulatorFirst::create) ||
+                (vpAccumulatorFactory[i] == AccumulatorLast::create) ||
+                (vpAccumulatorFactory[i] == AccumulatorPush::create))
+                return true;
+        }
+
+        return false;
+    }
+
+    intrusive_ptr<DocumentSourceGroup> DocumentSourceGroup::createMerger() {
         intrusive_ptr<DocumentSourceGroup> pMerger(
             DocumentSourceGroup::create(pExpCtx));
 
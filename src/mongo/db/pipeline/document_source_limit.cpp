@@ -76,6 +76,10 @@ namespace mongo {
         return pSource->getCurrent();
     }
 
+    long long DocumentSourceLimit::getLimit() const {
+        return limit;
+    }
+
     void DocumentSourceLimit::sourceToBson(
         BSONObjBuilder *pBuilder, bool explain) const {
         pBuilder->append("$limit", limit);
@@ -88,6 +92,15 @@ namespace mongo {
         return pSource;
     }
 
+    intrusive_ptr<DocumentSourceLimit> DocumentSourceLimit::create(
+        const intrusive_ptr<ExpressionContext> &pExpCtx, long long limit) {
+        verify(limit > 0);
+        intrusive_ptr<DocumentSourceLimit> pSource(
+            new DocumentSourceLimit(pExpCtx));
+        pSource->limit = limit;
+        return pSource;
+    }
+
     intrusive_ptr<DocumentSource> DocumentSourceLimit::createFromBson(
         BSONElement *pBsonElement,
         const intrusive_ptr<ExpressionContext> &pExpCtx) {
@@ -54,7 +54,7 @@ namespace mongo {
           in here, and give that pDocument to create the created subset of
           fields, and then convert that instead.
         */
-        BSONObjBuilder objBuilder;
+        StackBSONObjBuilder<> objBuilder;
         pDocument->toBson(&objBuilder);
         BSONObj obj(objBuilder.done());
 
@@ -1,67 +1,141 @@
-/**
- * Copyright 2011 (c) 10gen Inc.
- *
- * This program is free software: you can redistribute it and/or  modify
- * it under the terms of the GNU Affero General Public License, version 3,
- * as published by the Free Software Foundation.
- *
- * This program is distributed in the hope that it will be useful,
- * but WITHOUT ANY WARRANTY; without even the implied warranty of
- * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
- * GNU Affero General Public License for more details.
- *
- * You should have received a copy of the GNU Affero General Public License
- * along with this program.  If not, see <http://www.gnu.org/licenses/>.
- */
-
-#include "pch.h"
-
-#include "db/pipeline/document_source.h"
-
-
-namespace mongo {
-
-    const char DocumentSourceOut::outName[] = "$out";
-
-    DocumentSourceOut::~DocumentSourceOut() {
-    }
-
-    const char *DocumentSourceOut::getSourceName() const {
-        return outName;
-    }
-
-    bool DocumentSourceOut::eof() {
-        return pSource->eof();
-    }
-
-    bool DocumentSourceOut::advance() {
-        DocumentSource::advance(); // check for interrupts
-
-        return pSource->advance();
-    }
-
-    boost::intrusive_ptr<Document> DocumentSourceOut::getCurrent() {
-        return pSource->getCurrent();
-    }
-
-    DocumentSourceOut::DocumentSourceOut(
-        BSONElement *pBsonElement,
-        const intrusive_ptr<ExpressionContext> &pExpCtx):
-        DocumentSource(pExpCtx) {
-        verify(false && "unimplemented");
-    }
-
-    intrusive_ptr<DocumentSourceOut> DocumentSourceOut::createFromBson(
-        BSONElement *pBsonElement,
-        const intrusive_ptr<ExpressionContext> &pExpCtx) {
-        intrusive_ptr<DocumentSourceOut> pSource(
-            new DocumentSourceOut(pBsonElement, pExpCtx));
-
-        return pSource;
-    }
-
-    void DocumentSourceOut::sourceToBson(
-        BSONObjBuilder *pBuilder, bool explain) const {
-        verify(false); // CW TODO
-    }
-}
+/**
+ * Copyright 2011 (c) 10gen Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU Affero General Public License, version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pch.h"
+
+#include "db/pipeline/document_source.h"
+
+#include "db/pipeline/document.h"
+#include "util/mongoutils/str.h"
+
+
+namespace mongo {
+
+    const char DocumentSourceOut::outName[] = "$out";
+
+    DocumentSourceOut::~DocumentSourceOut() {
+    }
+
+    DocumentSourceOut::Writer::~Writer() {
+    }
+
+    const char *DocumentSourceOut::getSourceName() const {
+        return outName;
+    }
+
+    bool DocumentSourceOut::eof() {
+        if (!populated)
+            populate();
+
+        return true;
+    }
+
+    bool DocumentSourceOut::advance() {
+        DocumentSource::advance(); // check for interrupts
+
+        if (!populated)
+            populate();
+
+        return false;
+    }
+
+    boost::intrusive_ptr<Document> DocumentSourceOut::getCurrent() {
+        /* nothing is passed on */
+        verify(false);
+        return intrusive_ptr<Document>();
+    }
+
+    void DocumentSourceOut::setWriter(const shared_ptr<Writer> &pTheWriter) {
+        pWriter = pTheWriter;
+    }
+
+    string DocumentSourceOut::getOutputCollection() const {
+        return collectionName;
+    }
+
+    void DocumentSourceOut::populate() {
+        uassert(16436, str::stream() << outName <<
+                " can only be run on mongod, against an unsharded collection",
+                pWriter);
+
+        try {
+            for(bool hasNext = !pSource->eof(); hasNext;
+                hasNext = pSource->advance()) {
+                BSONObjBuilder documentBuilder;
+                pSource->getCurrent()->toBson(&documentBuilder);
+                BSONObj document(documentBuilder.obj());
+
+                if (!vBatch.empty() &&
+                    ((vBatch.size() >= maxBatchDocs) ||
+                     (batchBytes + document.objsize() > maxBatchBytes)))
+                    flush();
+
+                vBatch.push_back(document);
+                batchBytes += document.objsize();
+            }
+
+            flush();
+            pWriter->finish();
+        }
+        catch(...) {
+            pWriter->abandon();
+            throw;
+        }
+
+        populated = true;
+    }
+
+    void DocumentSourceOut::flush() {
+        if (vBatch.empty())
+            return;
+
+        pWriter->insert(vBatch);
+        vBatch.clear();
+        batchBytes = 0;
+    }
+
+    DocumentSourceOut::DocumentSourceOut(
+        BSONElement *pBsonElement,
+        const intrusive_ptr<ExpressionContext> &pExpCtx):
+        DocumentSource(pExpCtx),
+        populated(false),
+        batchBytes(0) {
+        uassert(16437, str::stream() << outName <<
+                " must be given the name of a collection, as a string",
+                pBsonElement->type() == String);
+        collectionName = pBsonElement->String();
+
+        uassert(16438, str::stream() << "invalid " << outName <<
+                " collection name: " << collectionName,
+                !collectionName.empty() &&
+                (collectionName.find('$') == string::npos) &&
+                !str::startsWith(collectionName, "system."));
+    }
+
+    intrusive_ptr<DocumentSource> DocumentSourceOut::createFromBson(
+        BSONElement *pBsonElement,
+        const intrusive_ptr<ExpressionContext> &pExpCtx) {
+        intrusive_ptr<DocumentSourceOut> pSource(
+            new DocumentSourceOut(pBsonElement, pExpCtx));
+
+        return pSource;
+    }
+
+    void DocumentSourceOut::sourceToBson(
+        BSONObjBuilder *pBuilder, bool explain) const {
+        pBuilder->append(outName, collectionName);
+    }
+}
@@ -0,0 +1,273 @@
+/**
+ * Copyright (c) 2012 10gen Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU Affero General Public License, version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pch.h"
+
+#include "db/pipeline/document_source.h"
+
+#include "db/pipeline/document.h"
+
+namespace mongo {
+
+    const char DocumentSourceParallel::parallelName[] = "$parallel";
+
+    DocumentSourceParallel::~DocumentSourceParallel() {
+    }
+
+    bool DocumentSourceParallel::eof() {
+        if (!populated)
+            populate();
+
+        return (pCurrent.get() == NULL);
+    }
+
+    bool DocumentSourceParallel::advance() {
+        DocumentSource::advance(); // check for interrupts
+
+        if (eof())
+            return false;
+
+        pCurrent = pMerger->next();
+        return (pCurrent.get() != NULL);
+    }
+
+    intrusive_ptr<Document> DocumentSourceParallel::getCurrent() {
+        verify(!eof());
+        return pCurrent;
+    }
+
+    void DocumentSourceParallel::sourceToBson(
+        BSONObjBuilder *pBuilder, bool explain) const {
+        BSONObjBuilder insides;
+        insides.append("workers", (int)vpWorker.size());
+        pBuilder->append(parallelName, insides.done());
+    }
+
+    DocumentSourceParallel::DocumentSourceParallel(
+        const intrusive_ptr<ExpressionContext> &pExpCtx):
+        DocumentSource(pExpCtx),
+        workerStatus(),
+        queue(maxQueuedBatches),
+        vpWorker(),
+        populated(false),
+        idComparator(),
+        pMerger(),
+        pCurrent() {
+    }
+
+    intrusive_ptr<DocumentSourceParallel> DocumentSourceParallel::create(
+        const intrusive_ptr<ExpressionContext> &pExpCtx) {
+        intrusive_ptr<DocumentSourceParallel> pSource(
+            new DocumentSourceParallel(pExpCtx));
+        return pSource;
+    }
+
+    void DocumentSourceParallel::addWorker(
+        const vector<intrusive_ptr<DocumentSource> > &vpSources,
+        const intrusive_ptr<ExpressionContext> &pWorkerCtx) {
+        verify(!populated);
+        verify(vpSources.size());
+
+        shared_ptr<Worker> pWorker(new Worker);
+        pWorker->vpSource = vpSources;
+        pWorker->pFeed = new Feed(&queue, pWorkerCtx);
+        pWorker->errorCode = 0;
+
+        /* chain the sources together, as Pipeline::run() does */
+        DocumentSource *pPrevious = pWorker->pFeed.get();
+        for(size_t i = 0; i < vpSources.size(); ++i) {
+            vpSources[i]->setSource(pPrevious);
+            pPrevious = vpSources[i].get();
+        }
+
+        vpWorker.push_back(pWorker);
+    }
+
+    InterruptStatus *DocumentSourceParallel::getWorkerInterruptStatus() {
+        return &workerStatus;
+    }
+
+    void DocumentSourceParallel::populate() {
+        verify(!populated);
+        populated = true;
+
+        const size_t nWorkers = vpWorker.size();
+        verify(nWorkers);
+
+        for(size_t i = 0; i < nWorkers; ++i) {
+            Worker *pWorker = vpWorker[i].get();
+            pWorker->pThread.reset(new boost::thread(
+                boost::bind(&DocumentSourceParallel::runWorker,
+                            this, pWorker)));
+        }
+
+        try {
+            while(true) {
+                Batch pBatch(new vector<intrusive_ptr<Document> >);
+                pBatch->reserve(batchSize);
+                if (!pSource->getBatch(pBatch.get(), batchSize))
+                    break;
+                queue.push(pBatch);
+            }
+        }
+        catch(...) {
+            finish(true);
+            throw;
+        }
+        finish(false);
+
+        /* pass on the first failure, as it happened */
+        for(size_t i = 0; i < nWorkers; ++i) {
+            const Worker &rWorker = *vpWorker[i];
+            if (rWorker.errorCode)
+                uasserted(rWorker.errorCode, rWorker.errorMessage);
+        }
+
+        pMerger.reset(new DocRunMerger(&idComparator));
+        for(size_t i = 0; i < nWorkers; ++i) {
+            pMerger->addRun(shared_ptr<DocRun>(DocRun::createFromSource(
+                vpWorker[i]->vpSource.back().get())));
+        }
+        pCurrent = pMerger->next();
+    }
+
+    void DocumentSourceParallel::runWorker(Worker *pWorker) {
+        setThreadName("aggWorker");
+
+        try {
+            /* the last source does all of its work up front */
+            pWorker->vpSource.back()->eof();
+        }
+        catch(const DBException &e) {
+            pWorker->errorCode = e.getCode();
+            pWorker->errorMessage = e.what();
+        }
+        catch(const std::exception &e) {
+            pWorker->errorCode = 16379;
+            pWorker->errorMessage = str::stream() <<
+                "aggregation worker failed: " << e.what();
+        }
+
+        if (pWorker->errorCode)
+            pWorker->pFeed->drain();
+    }
+
+    void DocumentSourceParallel::finish(bool abandon) {
+        if (abandon)
+            workerStatus.abandon();
+
+        const size_t nWorkers = vpWorker.size();
+        for(size_t i = 0; i < nWorkers; ++i)
+            queue.push(Batch());
+
+        for(size_t i = 0; i < nWorkers; ++i) {
+            vpWorker[i]->pThread->join();
+            vpWorker[i]->pThread.reset();
+        }
+    }
+
+    DocumentSourceParallel::Feed::Feed(
+        BatchQueue *pTheQueue,
+        const intrusive_ptr<ExpressionContext> &pExpCtx):
+        DocumentSource(pExpCtx),
+        pQueue(pTheQueue),
+        pBatch(),
+        iBatch(0),
+        done(false) {
+    }
+
+    void DocumentSourceParallel::Feed::fetch() {
+        while(!done && (!pBatch.get() || (iBatch == pBatch->size()))) {
+            pBatch = pQueue->blockingPop();
+            iBatch = 0;
+            if (!pBatch.get())
+                done = true;
+        }
+    }
+
+    bool DocumentSourceParallel::Feed::eof() {
+        fetch();
+        return done;
+    }
+
+    bool DocumentSourceParallel::Feed::advance() {
+        DocumentSource::advance(); // check for interrupts
+
+        if (eof())
+            return false;
+
+        ++iBatch;
+        return !eof();
+    }
+
+    intrusive_ptr<Document> DocumentSourceParallel::Feed::getCurrent() {
+        verify(!eof());
+        return (*pBatch)[iBatch];
+    }
+
+    size_t DocumentSourceParallel::Feed::getBatch(
+        vector<intrusive_ptr<Document> > *pOut, size_t maxDocuments) {
+        DocumentSource::advance(); // check for interrupts
+
+        if (eof())
+            return 0;
+
+        /* hand over what's left of the current batch, up to the limit */
+        const size_t n = min(maxDocuments, pBatch->size() - iBatch);
+        pOut->insert(pOut->end(), pBatch->begin() + iBatch,
+                     pBatch->begin() + iBatch + n);
+        iBatch += n;
+        return n;
+    }
+
+    void DocumentSourceParallel::Feed::drain() {
+        while(!done) {
+            pBatch = pQueue->blockingPop();
+            if (!pBatch.get())
+                done = true;
+        }
+        pBatch.reset();
+    }
+
+    void DocumentSourceParallel::Feed::sourceToBson(
+        BSONObjBuilder *pBuilder, bool explain) const {
+        /* this has no BSON equivalent */
+        verify(false);
+    }
+
+    DocumentSourceParallel::WorkerStatus::WorkerStatus():
+        mtx("DocumentSourceParallel::WorkerStatus"),
+        abandoned(false) {
+    }
+
+    void DocumentSourceParallel::WorkerStatus::checkForInterrupt() {
+        const char *pMessage = checkForInterruptNoAssert();
+        uassert(16378, pMessage, !*pMessage);
+    }
+
+    const char *DocumentSourceParallel::WorkerStatus::checkForInterruptNoAssert() {
+        scoped_lock lk(mtx);
+        if (abandoned)
+            return "aggregation worker abandoned";
+        return "";
+    }
+
+    void DocumentSourceParallel::WorkerStatus::abandon() {
+        scoped_lock lk(mtx);
+        abandoned = true;
+    }
+
+}
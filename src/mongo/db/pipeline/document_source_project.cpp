@@ -33,7 +33,8 @@ namespace mongo {
         const intrusive_ptr<ExpressionContext> &pExpCtx):
         DocumentSource(pExpCtx),
         excludeId(false),
-        pEO(ExpressionObject::create()) {
+        pEO(ExpressionObject::create()),
+        vpInput() {
     }
 
     const char *DocumentSourceProject::getSourceName() const {
@@ -51,8 +52,23 @@ namespace mongo {
     }
 
     intrusive_ptr<Document> DocumentSourceProject::getCurrent() {
-        intrusive_ptr<Document> pInDocument(pSource->getCurrent());
+        return project(pSource->getCurrent());
+    }
+
+    size_t DocumentSourceProject::getBatch(
+        vector<intrusive_ptr<Document> > *pBatch, size_t maxDocuments) {
+        DocumentSource::advance(); // check for interrupts
+
+        const size_t n = pSource->getBatch(&vpInput, maxDocuments);
+        for(size_t i = 0; i < n; ++i)
+            pBatch->push_back(project(vpInput[i]));
+        vpInput.clear();
 
+        return n;
+    }
+
+    intrusive_ptr<Document> DocumentSourceProject::project(
+        const intrusive_ptr<Document> &pInDocument) const {
         /* create the result document */
         const size_t sizeHint =
             pEO->getSizeHint(pInDocument) + (excludeId ? 0 : 1);
@@ -85,6 +101,9 @@ namespace mongo {
     void DocumentSourceProject::optimize() {
         intrusive_ptr<Expression> pE(pEO->optimize());
         pEO = dynamic_pointer_cast<ExpressionObject>(pE);
+
+        /* evaluate repeated subexpressions only once per document */
+        CommonSubexpressions::shareIn(pEO);
     }
 
     void DocumentSourceProject::sourceToBson(
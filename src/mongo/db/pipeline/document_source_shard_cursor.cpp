@@ -0,0 +1,102 @@
+/**
+ * Copyright 2012 (c) 10gen Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU Affero General Public License, version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pch.h"
+
+#include "db/pipeline/document_source.h"
+
+#include "client/dbclientcursor.h"
+#include "db/pipeline/document.h"
+
+namespace mongo {
+
+    DocumentSourceShardCursor::~DocumentSourceShardCursor() {
+    }
+
+    bool DocumentSourceShardCursor::eof() {
+        return !haveCurrent;
+    }
+
+    bool DocumentSourceShardCursor::advance() {
+        DocumentSource::advance(); // check for interrupts
+
+        if (eof())
+            return false;
+
+        findNext();
+        return haveCurrent;
+    }
+
+    intrusive_ptr<Document> DocumentSourceShardCursor::getCurrent() {
+        verify(haveCurrent);
+        return Document::createFromBsonObj(&current);
+    }
+
+    void DocumentSourceShardCursor::setSource(DocumentSource *pSource) {
+        /* this doesn't take a source */
+        verify(false);
+    }
+
+    void DocumentSourceShardCursor::sourceToBson(
+        BSONObjBuilder *pBuilder, bool explain) const {
+        /* this has no BSON equivalent */
+        verify(false);
+    }
+
+    void DocumentSourceShardCursor::findNext() {
+        if (batchIterator.more()) {
+            current = batchIterator.next().Obj();
+            haveCurrent = true;
+            return;
+        }
+
+        /* the first batch is done with, so get the rest from the shard */
+        if (pCursor && pCursor->more()) {
+            current = pCursor->nextSafe();
+            haveCurrent = true;
+            return;
+        }
+
+        pCursor.reset();
+        haveCurrent = false;
+    }
+
+    DocumentSourceShardCursor::DocumentSourceShardCursor(
+        const BSONObj &cursorObj, DBClientBase *pConnection,
+        const intrusive_ptr<ExpressionContext> &pExpCtx):
+        DocumentSource(pExpCtx),
+        batchIterator(cursorObj["firstBatch"].Obj()),
+        pCursor(),
+        current(),
+        haveCurrent(false) {
+        long long cursorId = cursorObj["id"].numberLong();
+        if (cursorId) {
+            verify(pConnection);
+            pCursor.reset(new DBClientCursor(
+                pConnection, cursorObj["ns"].String(), cursorId, 0, 0));
+        }
+
+        findNext();
+    }
+
+    intrusive_ptr<DocumentSourceShardCursor> DocumentSourceShardCursor::create(
+        const BSONObj &cursorObj, DBClientBase *pConnection,
+        const intrusive_ptr<ExpressionContext> &pExpCtx) {
+        intrusive_ptr<DocumentSourceShardCursor> pSource(
+            new DocumentSourceShardCursor(cursorObj, pConnection, pExpCtx));
+        return pSource;
+    }
+}
@@ -30,6 +30,8 @@
 namespace mongo {
     const char DocumentSourceSort::sortName[] = "$sort";
 
+    size_t DocumentSourceSort::maxMemoryUsageBytes = 100 * 1024 * 1024;
+
     DocumentSourceSort::~DocumentSourceSort() {
     }
 
@@ -41,6 +43,9 @@ namespace mongo {
         if (!populated)
             populate();
 
+        if (pMerger)
+            return !pCurrent;
+
         return (docIterator == documents.end());
     }
 
@@ -50,6 +55,25 @@ namespace mongo {
         if (!populated)
             populate();
 
+        if (limit && (++nReturned >= limit)) {
+            /* everything past the limit is dropped */
+            pCurrent.reset();
+            docIterator = documents.end();
+            pMerger.reset();
+            count = 0;
+            return false;
+        }
+
+        if (pMerger) {
+            verify(pCurrent);
+            pCurrent = pMerger->next();
+            if (!pCurrent) {
+                count = 0;
+                return false;
+            }
+            return true;
+        }
+
         verify(docIterator != documents.end());
 
         ++docIterator;
@@ -70,6 +94,39 @@ namespace mongo {
         return pCurrent;
     }
 
+    bool DocumentSourceSort::coalesce(
+        const intrusive_ptr<DocumentSource> &pNextSource) {
+        DocumentSourceLimit *pLimit =
+            dynamic_cast<DocumentSourceLimit *>(pNextSource.get());
+
+        /* we only know how to absorb a following $limit */
+        if (!pLimit)
+            return false;
+
+        if (!limit || (pLimit->getLimit() < limit))
+            limit = pLimit->getLimit();
+        return true;
+    }
+
+    void DocumentSourceSort::addToBsonArray(
+        BSONArrayBuilder *pBuilder, bool explain) const {
+        DocumentSource::addToBsonArray(pBuilder, explain);
+
+        /*
+          Write an absorbed limit back out as the $limit it came from, so
+          that a pipeline sent on to the shards absorbs it again.
+         */
+        if (limit) {
+            BSONObjBuilder insides;
+            insides.append(DocumentSourceLimit::limitName, limit);
+            pBuilder->append(insides.done());
+        }
+    }
+
+    long long DocumentSourceSort::getLimit() const {
+        return limit;
+    }
+
     void DocumentSourceSort::sourceToBson(
         BSONObjBuilder *pBuilder, bool explain) const {
         BSONObjBuilder insides;
@@ -87,7 +144,11 @@ namespace mongo {
     DocumentSourceSort::DocumentSourceSort(
         const intrusive_ptr<ExpressionContext> &pExpCtx):
         DocumentSource(pExpCtx),
-        populated(false) {
+        populated(false),
+        limit(0),
+        nReturned(0),
+        heldMemory(MemAccounting::Aggregation),
+        mergeComparator(this) {
     }
 
     void DocumentSourceSort::addKey(const string &fieldPath, bool ascending) {
@@ -152,21 +213,110 @@ namespace mongo {
         /* make sure we've got a sort key */
         verify(vSortKey.size());
 
-        /* track and warn about how much physical memory has been used */
-        DocMemMonitor dmm(this);
+        /*
+          If we have somewhere to put them, write sorted runs out to disk
+          whenever the documents held here grow past maxMemoryUsageBytes.
+          Otherwise, everything has to fit in memory; track and warn about
+          how much physical memory has been used.
+         */
+        const bool canSpill = !pExpCtx->getTempDir().empty();
+        scoped_ptr<DocMemMonitor> pDmm;
+        if (!canSpill)
+            pDmm.reset(new DocMemMonitor(this));
+        size_t memoryUsageBytes = 0;
+        size_t heldBytes = 0; // in documents, whether or not we can spill
+
+        /*
+          With a limit, the documents vector is kept as a heap of the best
+          documents seen so far, with the one that sorts last on top.  Once
+          there are limit of them, a new document replaces the top if it
+          sorts before it, and is dropped otherwise.
+         */
+        Comparator comparator(this);
+        bool topK = (limit != 0);
 
         /* pull everything from the underlying source */
         for(bool hasNext = !pSource->eof(); hasNext;
             hasNext = pSource->advance()) {
+            heldMemory.set(heldBytes);
             intrusive_ptr<Document> pDocument(pSource->getCurrent());
+            const size_t size = pDocument->getApproximateSize();
+
+            if (topK) {
+                size_t released = 0;
+                if (documents.size() < (size_t)limit) {
+                    documents.push_back(pDocument);
+                }
+                else {
+                    if (!comparator(pDocument, documents.front()))
+                        continue;
+
+                    pop_heap(documents.begin(), documents.end(), comparator);
+                    released = documents.back()->getApproximateSize();
+                    documents.back() = pDocument;
+                }
+                push_heap(documents.begin(), documents.end(), comparator);
+                heldBytes += size - released;
+
+                if (!canSpill) {
+                    pDmm->addToTotal(size);
+                    pDmm->subtractFromTotal(released);
+                    continue;
+                }
+
+                memoryUsageBytes += size - released;
+                if (memoryUsageBytes > maxMemoryUsageBytes) {
+                    /*
+                      Even the first limit documents don't fit, so sort
+                      the rest the usual way; advance() still stops at
+                      the limit.
+                     */
+                    topK = false;
+                    spill();
+                    memoryUsageBytes = 0;
+                    heldBytes = 0;
+                }
+                continue;
+            }
+
             documents.push_back(pDocument);
+            heldBytes += size;
+            if (!canSpill) {
+                pDmm->addToTotal(size);
+                continue;
+            }
 
-            dmm.addToTotal(pDocument->getApproximateSize());
+            memoryUsageBytes += size;
+            if (memoryUsageBytes > maxMemoryUsageBytes) {
+                spill();
+                memoryUsageBytes = 0;
+                heldBytes = 0;
+            }
         }
+        heldMemory.set(heldBytes);
 
         /* sort the list */
-        Comparator comparator(this);
-        sort(documents.begin(), documents.end(), comparator);
+        if (topK)
+            sort_heap(documents.begin(), documents.end(), comparator);
+        else
+            sort(documents.begin(), documents.end(), comparator);
+
+        if (!runFiles.empty()) {
+            /*
+              Merge the run files with what's left in memory.  The
+              in-memory run goes last so that ties go to the earlier runs.
+             */
+            pMerger.reset(new DocRunMerger(&mergeComparator));
+            for(size_t i = 0; i < runFiles.size(); ++i)
+                pMerger->addRun(
+                    shared_ptr<DocRun>(DocRun::createFromFile(runFiles[i])));
+            pMerger->addRun(
+                shared_ptr<DocRun>(DocRun::createFromVector(&documents)));
+
+            pCurrent = pMerger->next();
+            populated = true;
+            return;
+        }
 
         /* start the sort iterator */
         docIterator = documents.begin();
@@ -176,6 +326,34 @@ namespace mongo {
         populated = true;
     }
 
+    void DocumentSourceSort::spill() {
+        if (!pSpillDir)
+            pSpillDir.reset(
+                new DocSpillDirectory(pExpCtx->getTempDir(), "aggsort"));
+
+        Comparator comparator(this);
+        sort(documents.begin(), documents.end(), comparator);
+
+        const string fileName(pSpillDir->newFileName());
+        DocSpillWriter writer(fileName);
+        const size_t n = documents.size();
+        for(size_t i = 0; i < n; ++i)
+            writer.write(documents[i]);
+        writer.close();
+
+        runFiles.push_back(fileName);
+        log(2) << sortName << " wrote " << n << " documents to " <<
+            fileName << endl;
+
+        /* release the memory, rather than just emptying the vector */
+        VectorType().swap(documents);
+    }
+
+    int DocumentSourceSort::MergeComparator::compare(
+        const intrusive_ptr<Document> &pL, const intrusive_ptr<Document> &pR) {
+        return pSort->compare(pL, pR);
+    }
+
     int DocumentSourceSort::compare(
         const intrusive_ptr<Document> &pL, const intrusive_ptr<Document> &pR) {
 
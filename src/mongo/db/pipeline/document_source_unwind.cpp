@@ -171,10 +171,36 @@ namespace mongo {
          */
         verify(pNoUnwindDocument.get());
 
-        intrusive_ptr<Document> pClone(pNoUnwindDocument->clone());
-        intrusive_ptr<Document> pCurrent(pClone);
         const size_t n = fieldIndex.size();
         verify(n);
+
+        if (pUnwindValue.get()) {
+            /* find the documents along the path */
+            vector<intrusive_ptr<Document> > vpPath;
+            vpPath.reserve(n);
+            vpPath.push_back(pNoUnwindDocument);
+            for(size_t i = 0; i + 1 < n; ++i) {
+                vpPath.push_back(
+                    vpPath[i]->getField(fieldIndex[i]).second->getDocument());
+            }
+
+            /*
+              Overlay the unwound value on the innermost document, then
+              each of those on the one containing it, on back up the path.
+            */
+            intrusive_ptr<Document> pOverlay(Document::createOverlay(
+                vpPath[n - 1], fieldIndex[n - 1], pUnwindValue));
+            for(size_t i = n - 1; i > 0; --i) {
+                pOverlay = Document::createOverlay(
+                    vpPath[i - 1], fieldIndex[i - 1],
+                    Value::createDocument(pOverlay));
+            }
+
+            return pOverlay;
+        }
+
+        intrusive_ptr<Document> pClone(pNoUnwindDocument->clone());
+        intrusive_ptr<Document> pCurrent(pClone);
         for(size_t i = 0; i < n; ++i) {
             const size_t fi = fieldIndex[i];
             Document::FieldPair fp(pCurrent->getField(fi));
@@ -35,6 +35,12 @@ namespace mongo {
         verify(false && "Expression::toMatcherBson()");
     }
 
+    intrusive_ptr<Expression> Expression::shareCommon(
+        CommonSubexpressions *pCommon) {
+        pCommon->opaque = true;
+        return intrusive_ptr<Expression>(this);
+    }
+
     Expression::ObjectCtx::ObjectCtx(int theOptions):
         options(theOptions),
         unwindField() {
@@ -655,6 +661,116 @@ namespace mongo {
         verify(false && "not possible"); // no equivalent of this
     }
 
+    /* ----------------------- ExpressionCommon ---------------------------- */
+
+    ExpressionCommon::~ExpressionCommon() {
+    }
+
+    intrusive_ptr<ExpressionCommon> ExpressionCommon::create(
+        const intrusive_ptr<Expression> &pExpression) {
+        intrusive_ptr<ExpressionCommon> pNew(
+            new ExpressionCommon(pExpression));
+        return pNew;
+    }
+
+    ExpressionCommon::ExpressionCommon(
+        const intrusive_ptr<Expression> &pTheExpression):
+        Expression(),
+        pExpression(pTheExpression),
+        pLastDocument(),
+        pLastValue() {
+    }
+
+    intrusive_ptr<Expression> ExpressionCommon::optimize() {
+        /* the subexpression was optimized before it was shared */
+        return intrusive_ptr<Expression>(this);
+    }
+
+    intrusive_ptr<Expression> ExpressionCommon::shareCommon(
+        CommonSubexpressions *pCommon) {
+        /* already shared */
+        return intrusive_ptr<Expression>(this);
+    }
+
+    void ExpressionCommon::addDependencies(
+        const intrusive_ptr<DependencyTracker> &pTracker,
+        const DocumentSource *pSource) const {
+        pExpression->addDependencies(pTracker, pSource);
+    }
+
+    intrusive_ptr<const Value> ExpressionCommon::evaluate(
+        const intrusive_ptr<Document> &pDocument) const {
+        /*
+          The last document is held on to, so a new one can't turn up at
+          the same address.
+         */
+        if (!pLastValue.get() || (pDocument.get() != pLastDocument.get())) {
+            pLastValue = pExpression->evaluate(pDocument);
+            pLastDocument = pDocument;
+        }
+
+        return pLastValue;
+    }
+
+    void ExpressionCommon::addToBsonObj(
+        BSONObjBuilder *pBuilder, string fieldName,
+        bool requireExpression) const {
+        pExpression->addToBsonObj(pBuilder, fieldName, requireExpression);
+    }
+
+    void ExpressionCommon::addToBsonArray(
+        BSONArrayBuilder *pBuilder) const {
+        pExpression->addToBsonArray(pBuilder);
+    }
+
+    void ExpressionCommon::toMatcherBson(BSONObjBuilder *pBuilder) const {
+        pExpression->toMatcherBson(pBuilder);
+    }
+
+    /* --------------------- CommonSubexpressions -------------------------- */
+
+    CommonSubexpressions::CommonSubexpressions():
+        opaque(false),
+        sharing(false),
+        occurrences(),
+        shared() {
+    }
+
+    void CommonSubexpressions::shareIn(
+        const intrusive_ptr<Expression> &pExpression) {
+        CommonSubexpressions common;
+        pExpression->shareCommon(&common);
+
+        common.sharing = true;
+        common.opaque = false;
+        pExpression->shareCommon(&common);
+    }
+
+    intrusive_ptr<Expression> CommonSubexpressions::share(
+        const intrusive_ptr<Expression> &pExpression) {
+        /*
+          Shared operands look the same as what they stand in for, so the
+          key doesn't change between the passes.
+         */
+        BSONArrayBuilder builder;
+        pExpression->addToBsonArray(&builder);
+        BSONArray keyArray(builder.arr());
+        string key(keyArray.objdata(), keyArray.objsize());
+
+        if (!sharing) {
+            ++occurrences[key];
+            return pExpression;
+        }
+
+        if (occurrences[key] < 2)
+            return pExpression;
+
+        intrusive_ptr<ExpressionCommon> &pShared = shared[key];
+        if (!pShared.get())
+            pShared = ExpressionCommon::create(pExpression);
+        return pShared;
+    }
+
     /* ----------------------- ExpressionCompare --------------------------- */
 
     ExpressionCompare::~ExpressionCompare() {
@@ -889,6 +1005,20 @@ namespace mongo {
         ExpressionNary::addOperand(pExpression);
     }
 
+    intrusive_ptr<Expression> ExpressionCond::optimize() {
+        intrusive_ptr<Expression> pE(ExpressionNary::optimize());
+        if ((pE.get() != this) || (vpOperand.size() != 3))
+            return pE;
+
+        /* if the condition is constant, only one branch can be taken */
+        const ExpressionConstant *pCond =
+            dynamic_cast<ExpressionConstant *>(vpOperand[0].get());
+        if (!pCond)
+            return pE;
+
+        return vpOperand[pCond->getValue()->coerceToBool() ? 1 : 2];
+    }
+
     intrusive_ptr<const Value> ExpressionCond::evaluate(
         const intrusive_ptr<Document> &pDocument) const {
         checkArgCount(3);
@@ -934,6 +1064,12 @@ namespace mongo {
         return intrusive_ptr<Expression>(this);
     }
 
+    intrusive_ptr<Expression> ExpressionConstant::shareCommon(
+        CommonSubexpressions *pCommon) {
+        /* nothing to save by sharing these */
+        return intrusive_ptr<Expression>(this);
+    }
+
     void ExpressionConstant::addDependencies(
         const intrusive_ptr<DependencyTracker> &pTracker,
         const DocumentSource *pSource) const {
@@ -1162,6 +1298,21 @@ namespace mongo {
         return intrusive_ptr<Expression>(this);
     }
 
+    intrusive_ptr<Expression> ExpressionObject::shareCommon(
+        CommonSubexpressions *pCommon) {
+        const size_t n = vpExpression.size();
+        for(size_t i = 0; i < n; ++i)
+            vpExpression[i] = vpExpression[i]->shareCommon(pCommon);
+
+        /*
+          Objects themselves aren't shared:  those standing for included
+          paths are evaluated over subdocuments, and addToDocument() needs
+          to see them as they are.
+         */
+        pCommon->opaque = true;
+        return intrusive_ptr<Expression>(this);
+    }
+
     void ExpressionObject::DependencyRemover::path(
         const FieldPath &rPath, bool include) {
         if (include)
@@ -1606,6 +1757,11 @@ namespace mongo {
         return intrusive_ptr<Expression>(this);
     }
 
+    intrusive_ptr<Expression> ExpressionFieldPath::shareCommon(
+        CommonSubexpressions *pCommon) {
+        return pCommon->share(intrusive_ptr<Expression>(this));
+    }
+
     void ExpressionFieldPath::addDependencies(
         const intrusive_ptr<DependencyTracker> &pTracker,
         const DocumentSource *pSource) const {
@@ -2425,6 +2581,23 @@ namespace mongo {
         ExpressionNary::addOperand(pExpression);
     }
 
+    intrusive_ptr<Expression> ExpressionIfNull::optimize() {
+        intrusive_ptr<Expression> pE(ExpressionNary::optimize());
+        if ((pE.get() != this) || (vpOperand.size() != 2))
+            return pE;
+
+        /* if the first operand is constant, we know which one is taken */
+        const ExpressionConstant *pLeft =
+            dynamic_cast<ExpressionConstant *>(vpOperand[0].get());
+        if (!pLeft)
+            return pE;
+
+        BSONType leftType = pLeft->getValue()->getType();
+        if ((leftType != Undefined) && (leftType != jstNULL))
+            return vpOperand[0];
+        return vpOperand[1];
+    }
+
     intrusive_ptr<const Value> ExpressionIfNull::evaluate(
         const intrusive_ptr<Document> &pDocument) const {
         checkArgCount(2);
@@ -2448,6 +2621,24 @@ namespace mongo {
         vpOperand() {
     }
 
+    intrusive_ptr<Expression> ExpressionNary::shareCommon(
+        CommonSubexpressions *pCommon) {
+        /* share the operands first; if any of them can't be, neither can this */
+        const bool parentOpaque = pCommon->opaque;
+        pCommon->opaque = false;
+
+        const size_t n = vpOperand.size();
+        for(size_t i = 0; i < n; ++i)
+            vpOperand[i] = vpOperand[i]->shareCommon(pCommon);
+
+        const bool opaque = pCommon->opaque;
+        pCommon->opaque = parentOpaque || opaque;
+        if (opaque)
+            return intrusive_ptr<Expression>(this);
+
+        return pCommon->share(intrusive_ptr<Expression>(this));
+    }
+
     intrusive_ptr<Expression> ExpressionNary::optimize() {
         unsigned constCount = 0; // count of constant operands
         unsigned stringCount = 0; // count of constant string operands
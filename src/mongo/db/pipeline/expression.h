@@ -27,6 +27,7 @@ namespace mongo {
 
     class BSONArrayBuilder;
     class BSONElement;
+    class CommonSubexpressions;
     class BSONObjBuilder;
     class Builder;
     class DependencyTracker;
@@ -56,6 +57,21 @@ namespace mongo {
          */
         virtual intrusive_ptr<Expression> optimize() = 0;
 
+        /*
+          Replace the subexpressions which occur more than once with shared
+          ExpressionCommons; see CommonSubexpressions.  This is done after
+          optimize().
+
+          The default implementation leaves the expression and its operands
+          as they are, and keeps any expression containing it from being
+          shared.
+
+          @param pCommon the subexpressions seen so far
+          @returns the expression to use in place of this one
+         */
+        virtual intrusive_ptr<Expression> shareCommon(
+            CommonSubexpressions *pCommon);
+
         /**
            Add this expression's field dependencies to the dependency tracker.
 
@@ -229,6 +245,8 @@ namespace mongo {
     public:
         // virtuals from Expression
         virtual intrusive_ptr<Expression> optimize();
+        virtual intrusive_ptr<Expression> shareCommon(
+            CommonSubexpressions *pCommon);
         virtual void addToBsonObj(
             BSONObjBuilder *pBuilder, string fieldName,
             bool requireExpression) const;
@@ -412,6 +430,97 @@ namespace mongo {
     };
 
 
+    class ExpressionCommon :
+        public Expression {
+    public:
+        // virtuals from Expression
+        virtual ~ExpressionCommon();
+        virtual intrusive_ptr<Expression> optimize();
+        virtual intrusive_ptr<Expression> shareCommon(
+            CommonSubexpressions *pCommon);
+        virtual void addDependencies(
+            const intrusive_ptr<DependencyTracker> &pTracker,
+            const DocumentSource *pSource) const;
+        virtual intrusive_ptr<const Value> evaluate(
+            const intrusive_ptr<Document> &pDocument) const;
+        virtual void addToBsonObj(
+            BSONObjBuilder *pBuilder, string fieldName,
+            bool requireExpression) const;
+        virtual void addToBsonArray(BSONArrayBuilder *pBuilder) const;
+        virtual void toMatcherBson(BSONObjBuilder *pBuilder) const;
+
+        /*
+          Create an expression standing in for every occurrence of a
+          repeated subexpression.
+
+          Evaluating it again over the same document returns the value
+          found the first time, so the subexpression is evaluated once
+          per document, however many times it occurs.  Expressions don't
+          have side effects, so only the cost changes.
+
+          @param pExpression the repeated subexpression
+          @returns the shared expression
+         */
+        static intrusive_ptr<ExpressionCommon> create(
+            const intrusive_ptr<Expression> &pExpression);
+
+    private:
+        ExpressionCommon(const intrusive_ptr<Expression> &pExpression);
+
+        intrusive_ptr<Expression> pExpression;
+
+        /* the last document evaluated over, and the result */
+        mutable intrusive_ptr<Document> pLastDocument;
+        mutable intrusive_ptr<const Value> pLastValue;
+    };
+
+
+    /*
+      Finds the subexpressions of an expression tree which occur more
+      than once, such as a field path used by several computed fields of
+      a $project, and replaces them with a single ExpressionCommon.
+
+      This takes two passes over the tree, through
+      Expression::shareCommon():  the first counts the subexpressions,
+      and the second replaces the repeated ones.  Subexpressions are told
+      apart by their BSON representation.
+     */
+    class CommonSubexpressions {
+    public:
+        /*
+          Share the repeated subexpressions within an expression.
+
+          @param pExpression the expression; it is not replaced itself, so
+            this is meant for an ExpressionObject, which never is
+         */
+        static void shareIn(const intrusive_ptr<Expression> &pExpression);
+
+        /*
+          Count the subexpression during the first pass, and in the second
+          get what should take its place.
+
+          @param pExpression the subexpression, whose operands have
+            already been through shareCommon()
+          @returns the expression to use in its place
+         */
+        intrusive_ptr<Expression> share(
+            const intrusive_ptr<Expression> &pExpression);
+
+        /*
+          Set by expressions which can't be shared; an expression with an
+          operand that can't be shared can't be shared either.
+         */
+        bool opaque;
+
+    private:
+        CommonSubexpressions();
+
+        bool sharing; // this is the second pass
+        map<string, unsigned> occurrences;
+        map<string, intrusive_ptr<ExpressionCommon> > shared;
+    };
+
+
     class ExpressionCompare :
         public ExpressionNary {
     public:
@@ -452,6 +561,7 @@ namespace mongo {
     public:
         // virtuals from ExpressionNary
         virtual ~ExpressionCond();
+        virtual intrusive_ptr<Expression> optimize();
         virtual intrusive_ptr<const Value> evaluate(
             const intrusive_ptr<Document> &pDocument) const;
         virtual const char *getOpName() const;
@@ -470,6 +580,8 @@ namespace mongo {
         // virtuals from Expression
         virtual ~ExpressionConstant();
         virtual intrusive_ptr<Expression> optimize();
+        virtual intrusive_ptr<Expression> shareCommon(
+            CommonSubexpressions *pCommon);
         virtual void addDependencies(
             const intrusive_ptr<DependencyTracker> &pTracker,
             const DocumentSource *pSource) const;
@@ -575,6 +687,8 @@ namespace mongo {
         // virtuals from Expression
         virtual ~ExpressionFieldPath();
         virtual intrusive_ptr<Expression> optimize();
+        virtual intrusive_ptr<Expression> shareCommon(
+            CommonSubexpressions *pCommon);
         virtual void addDependencies(
             const intrusive_ptr<DependencyTracker> &pTracker,
             const DocumentSource *pSource) const;
@@ -758,6 +872,7 @@ namespace mongo {
     public:
         // virtuals from ExpressionNary
         virtual ~ExpressionIfNull();
+        virtual intrusive_ptr<Expression> optimize();
         virtual intrusive_ptr<const Value> evaluate(
             const intrusive_ptr<Document> &pDocument) const;
         virtual const char *getOpName() const;
@@ -941,6 +1056,8 @@ namespace mongo {
         // virtuals from Expression
         virtual ~ExpressionObject();
         virtual intrusive_ptr<Expression> optimize();
+        virtual intrusive_ptr<Expression> shareCommon(
+            CommonSubexpressions *pCommon);
         virtual void addDependencies(
             const intrusive_ptr<DependencyTracker> &pTracker,
             const DocumentSource *pSource) const;
@@ -27,6 +27,7 @@ namespace mongo {
     inline ExpressionContext::ExpressionContext(InterruptStatus *pS):
         inShard(false),
         inRouter(false),
+        tempDir(),
         intCheckCounter(1),
         pStatus(pS) {
     }
@@ -45,4 +46,12 @@ namespace mongo {
         return new ExpressionContext(pStatus);
     }
 
+    ExpressionContext *ExpressionContext::clone() const {
+        ExpressionContext *pCtx = new ExpressionContext(pStatus);
+        pCtx->inShard = inShard;
+        pCtx->inRouter = inRouter;
+        pCtx->tempDir = tempDir;
+        return pCtx;
+    }
+
 }
@@ -35,6 +35,14 @@ namespace mongo {
         bool getInShard() const;
         bool getInRouter() const;
 
+        /*
+          A directory stages may write temporary files under.  It is empty
+          unless the pipeline runs somewhere that has a dbpath (i.e., not
+          on mongos); stages must then keep everything in memory.
+         */
+        void setTempDir(const string &dir);
+        const string &getTempDir() const;
+
         /**
            Used by a pipeline to check for interrupts so that killOp() works.
 
@@ -44,11 +52,18 @@ namespace mongo {
 
         static ExpressionContext *create(InterruptStatus *pStatus);
 
+        /*
+          Create a context with the same settings, for a stage that needs
+          to change one of them for its own use.
+         */
+        ExpressionContext *clone() const;
+
     private:
         ExpressionContext(InterruptStatus *pStatus);
         
         bool inShard;
         bool inRouter;
+        string tempDir;
         unsigned intCheckCounter; // interrupt check counter
         InterruptStatus *const pStatus;
     };
@@ -75,4 +90,12 @@ namespace mongo {
         return inRouter;
     }
 
+    inline void ExpressionContext::setTempDir(const string &dir) {
+        tempDir = dir;
+    }
+
+    inline const string &ExpressionContext::getTempDir() const {
+        return tempDir;
+    }
+
 };
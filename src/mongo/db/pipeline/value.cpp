@@ -98,6 +98,34 @@ namespace mongo {
 
     intrusive_ptr<const Value> Value::createFromBsonElement(
         BSONElement *pBsonElement) {
+        /*
+          Use the shared static instances for the most common scalars, so
+          that converting a document doesn't allocate for each of them.
+         */
+        switch(pBsonElement->type()) {
+        case jstNULL:
+            return getNull();
+
+        case Bool:
+            return (pBsonElement->boolean() ? getTrue() : getFalse());
+
+        case NumberInt:
+            switch(pBsonElement->numberInt()) {
+            case -1:
+                return getMinusOne();
+            case 0:
+                return getZero();
+            case 1:
+                return getOne();
+            default:
+                break;
+            }
+            break;
+
+        default:
+            break;
+        }
+
         intrusive_ptr<const Value> pValue(new Value(pBsonElement));
         return pValue;
     }
@@ -122,14 +150,12 @@ namespace mongo {
         }
 
         case Array: {
-            vector<BSONElement> vElement(pBsonElement->Array());
-            const size_t n = vElement.size();
-
-            vpValue.reserve(n); // save on realloc()ing
+            BSONObj array(pBsonElement->embeddedObject());
+            vpValue.reserve(array.nFields()); // save on realloc()ing
 
-            for(size_t i = 0; i < n; ++i) {
-                vpValue.push_back(
-                    Value::createFromBsonElement(&vElement[i]));
+            for(BSONObjIterator arrayIterator(array); arrayIterator.more();) {
+                BSONElement element(arrayIterator.next());
+                vpValue.push_back(Value::createFromBsonElement(&element));
             }
             break;
         }
@@ -662,6 +688,42 @@ namespace mongo {
         BSONType lType = rL->getType();
         BSONType rType = rR->getType();
 
+        /*
+          Most comparisons in $sort and $group are between keys of the same
+          scalar type; those need none of the NULL handling or numeric
+          promotion below, so settle them first.
+         */
+        if (lType == rType) {
+            switch(lType) {
+            case NumberInt: {
+                const int left = rL->simple.intValue;
+                const int right = rR->simple.intValue;
+                return (left < right) ? -1 : ((left > right) ? 1 : 0);
+            }
+
+            case NumberLong: {
+                const long long left = rL->simple.longValue;
+                const long long right = rR->simple.longValue;
+                return (left < right) ? -1 : ((left > right) ? 1 : 0);
+            }
+
+            case NumberDouble: {
+                const double left = rL->simple.doubleValue;
+                const double right = rR->simple.doubleValue;
+                return (left < right) ? -1 : ((left > right) ? 1 : 0);
+            }
+
+            case String:
+                return rL->stringValue.compare(rR->stringValue);
+
+            case jstOID:
+                return rL->oidValue.compare(rR->oidValue);
+
+            default:
+                break;
+            }
+        }
+
         /*
           Special handling for Undefined and NULL values; these are types,
           so it's easier to handle them here before we go below to handle
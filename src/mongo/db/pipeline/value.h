@@ -375,6 +375,37 @@ namespace mongo {
         return (Value::compare(v1, v2) == 0);
     }
 
+    /*
+      A Value paired with its hash, for use as the key of the hash tables
+      in $group and $addToSet.
+
+      The hash is computed once, when the key is made, so probing the
+      table, comparing keys and rehashing as the table grows don't have to
+      walk the Value again.  Keys whose hashes differ are unequal without
+      calling Value::compare() at all.
+     */
+    class HashedValue {
+    public:
+        explicit HashedValue(const intrusive_ptr<const Value> &pValue);
+
+        const intrusive_ptr<const Value> &getValue() const;
+        size_t getHash() const;
+
+        struct Hash :
+            unary_function<HashedValue, size_t> {
+            size_t operator()(const HashedValue &rKey) const;
+        };
+
+    private:
+        intrusive_ptr<const Value> pValue;
+        size_t hash;
+    };
+
+    inline bool operator==(const HashedValue &rL, const HashedValue &rR) {
+        return ((rL.getHash() == rR.getHash()) &&
+                (Value::compare(rL.getValue(), rR.getValue()) == 0));
+    }
+
     /*
       For performance reasons, there are various sharable static values
       defined in class Value, obtainable by methods such as getUndefined(),
@@ -450,6 +481,24 @@ namespace mongo {
         return seed;
     }
 
+    inline HashedValue::HashedValue(const intrusive_ptr<const Value> &pTheValue):
+        pValue(pTheValue),
+        hash(Value::Hash()(pTheValue)) {
+    }
+
+    inline const intrusive_ptr<const Value> &HashedValue::getValue() const {
+        return pValue;
+    }
+
+    inline size_t HashedValue::getHash() const {
+        return hash;
+    }
+
+    inline size_t HashedValue::Hash::operator()(
+        const HashedValue &rKey) const {
+        return rKey.getHash();
+    }
+
     inline ValueStatic::ValueStatic():
         Value() {
     }
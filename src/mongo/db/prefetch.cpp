@@ -24,53 +24,131 @@
 #include "mongo/db/index_update.h"
 #include "mongo/db/jsobj.h"
 #include "mongo/db/namespace_details.h"
+#include "mongo/db/pdfile.h"
 
 namespace mongo {
 
+    IndexPrefetchMode replIndexPrefetch = PREFETCH_ALL;
+    unsigned replPrefetchDepth = 1000;
+
+    static struct PrefetchCounters {
+        AtomicUInt ops;          // ops paged in by the prefetcher
+        AtomicUInt missedOps;    // ops applied before the prefetcher got to them
+        AtomicUInt indexes;      // index lookups paged in
+        AtomicUInt recordHits;   // records that were already in memory
+        AtomicUInt recordMisses; // records the prefetcher had to fault in
+        AtomicUInt errors;
+    } prefetchCounters;
+
+    const char* indexPrefetchModeName(IndexPrefetchMode mode) {
+        switch( mode ) {
+        case PREFETCH_NONE: return "none";
+        case PREFETCH_ID_ONLY: return "_id_only";
+        case PREFETCH_ALL: return "all";
+        }
+        return "unknown";
+    }
+
+    bool parseIndexPrefetchMode(const string& name, IndexPrefetchMode* mode) {
+        if( name == "none" )
+            *mode = PREFETCH_NONE;
+        else if( name == "_id_only" )
+            *mode = PREFETCH_ID_ONLY;
+        else if( name == "all" )
+            *mode = PREFETCH_ALL;
+        else
+            return false;
+        return true;
+    }
+
+    void appendReplPrefetchStats(BSONObjBuilder& b) {
+        b.append("indexMode", indexPrefetchModeName(replIndexPrefetch));
+        b.append("depth", (int) replPrefetchDepth);
+        b.appendNumber("ops", (long long) prefetchCounters.ops.get());
+        b.appendNumber("missedOps", (long long) prefetchCounters.missedOps.get());
+        b.appendNumber("indexes", (long long) prefetchCounters.indexes.get());
+        b.appendNumber("hits", (long long) prefetchCounters.recordHits.get());
+        b.appendNumber("misses", (long long) prefetchCounters.recordMisses.get());
+        b.appendNumber("errors", (long long) prefetchCounters.errors.get());
+    }
+
+    void notePrefetchMissedOp() {
+        prefetchCounters.missedOps++;
+    }
+
     // prefetch for an oplog operation
     void prefetchPagesForReplicatedOp(const BSONObj& op) {
         const char *opField;
         const char *opType = op.getStringField("op");
-        if ( *opType == 'i' )
+        if ( *opType == 'i' || *opType == 'd' )
             opField = "o";
         else if( *opType == 'u' )
             opField = "o2";
         else
             // prefetch ignores other ops
             return;
-         
+
         BSONObj obj = op.getObjectField(opField);
         const char *ns = op.getStringField("ns");
 
-        prefetchIndexPages(ns, obj);
+        try {
+            // don't open databases from the prefetcher; if it isn't open yet there is nothing
+            // to page in
+            Lock::DBRead lk(ns);
+            Database *db = dbHolder().get(ns, dbpath);
+            if( db == 0 )
+                return;
+            Client::Context ctx(dbpath, ns, db, false);
+            NamespaceDetails *nsd = nsdetails(ns);
+            if( nsd == 0 )
+                return;
+
+            prefetchCounters.ops++;
+
+            // on deletes obj only holds the _id, so this only really helps the _id index
+            prefetchIndexPages(nsd, obj);
 
-        // do not prefetch the data for inserts; it doesn't exist yet
-        if (*opType == 'u') {
-            prefetchRecordPages(ns, obj);
+            // do not prefetch the data for inserts; it doesn't exist yet.  capped collections
+            // typically have no _id index for findById() to use.
+            if( *opType == 'u' && !nsd->isCapped() ) {
+                prefetchRecordPages(ns, obj);
+            }
+        }
+        catch( DBException& e ) {
+            prefetchCounters.errors++;
+            LOG(2) << "ignoring exception in prefetchPagesForReplicatedOp(): " << e.what() << endl;
         }
     }
 
-    void prefetchIndexPages(const char *ns, const BSONObj& obj) {
-        DiskLoc unusedDl; // unused
+    void prefetchIndexPages(NamespaceDetails *nsd, const BSONObj& obj) {
+        // the record isn't inserted, we only want to find where its keys would go
+        DiskLoc unusedDl(0, 0);
         IndexInterface::IndexInserter inserter;
-        NamespaceDetails *nsd = nsdetails(ns);
-
-        // includes all indexes, including ones
-        // in the process of being built
-        int indexCount = nsd->nIndexesBeingBuilt(); 
         BSONObjSet unusedKeys;
-        //vector<int> multi;
-        //vector<BSONObjSet> multiKeys;
-        for ( int indexNo = 0; indexNo < indexCount; indexNo++ ) {
-            // This will page in all index pages for the given object.
-            fetchIndexInserters(/*out*/unusedKeys, inserter, nsd, indexNo, obj, unusedDl);
-            // do something with multikeys later?
-            // if( keys.size() > 1 ) {
-            //     multi.push_back(i);
-            //     multiKeys.push_back(BSONObjSet());
-            //     multiKeys[multiKeys.size()-1].swap(keys);
-            // }
-            unusedKeys.clear();
+
+        switch( replIndexPrefetch ) {
+        case PREFETCH_NONE:
+            return;
+        case PREFETCH_ID_ONLY: {
+            int indexNo = nsd->findIdIndex();
+            if( indexNo == -1 )
+                return;
+            fetchIndexInserters(/*out*/unusedKeys, inserter, nsd, indexNo, obj, unusedDl, /*allowDups*/true);
+            prefetchCounters.indexes++;
+            break;
+        }
+        case PREFETCH_ALL: {
+            // includes all indexes, including ones
+            // in the process of being built
+            int indexCount = nsd->nIndexesBeingBuilt();
+            for ( int indexNo = 0; indexNo < indexCount; indexNo++ ) {
+                // This will page in all index pages for the given object.
+                fetchIndexInserters(/*out*/unusedKeys, inserter, nsd, indexNo, obj, unusedDl, /*allowDups*/true);
+                prefetchCounters.indexes++;
+                unusedKeys.clear();
+            }
+            break;
+        }
         }
     }
 
@@ -79,17 +157,28 @@ namespace mongo {
         if( obj.getObjectID(_id) ) {
             BSONObjBuilder builder;
             builder.append(_id);
-            BSONObj result;
             Client::ReadContext ctx( ns );
             try {
-                if( Helpers::findById(cc(), ns, builder.done(), result) ) {
+                NamespaceDetails *nsd = nsdetails(ns);
+                if( nsd == 0 || nsd->findIdIndex() < 0 )
+                    return;
+                // the record is found through the _id index alone, so nothing has read it (and
+                // faulted it in) before we check whether it's resident
+                DiskLoc loc = Helpers::findById(nsd, builder.done());
+                if( !loc.isNull() ) {
+                    if( loc.rec()->likelyInPhysicalMemory() )
+                        prefetchCounters.recordHits++;
+                    else
+                        prefetchCounters.recordMisses++;
+
+                    BSONObj result = loc.obj();
                     volatile char _dummy_char;       
                     // Touch the first word on every page in order to fault it into memory
                     for (int i = 0; i < result.objsize(); i += g_minOSPageSizeBytes) {                        
                         _dummy_char += *(result.objdata() + i); 
                     }
                     // hit the last page, in case we missed it above
-                    _dummy_char += *(result.objdata() + result.objsize());
+                    _dummy_char += *(result.objdata() + result.objsize() - 1);
                 }
             }
             catch( AssertionException& ) {
@@ -20,12 +20,36 @@
 
 namespace mongo {
     class NamespaceDetails;
+
+    /** which indexes the replication prefetcher pages in.  setParameter replIndexPrefetch */
+    enum IndexPrefetchMode {
+        PREFETCH_NONE = 0,      // "none"
+        PREFETCH_ID_ONLY = 1,   // "_id_only"
+        PREFETCH_ALL = 2        // "all"
+    };
+    extern IndexPrefetchMode replIndexPrefetch;
+
+    /** how many buffered ops past the batch being applied the replication prefetcher pages in
+        while that batch is applied.  0 turns the look-ahead off.  setParameter replPrefetchDepth */
+    extern unsigned replPrefetchDepth;
+
+    const char* indexPrefetchModeName(IndexPrefetchMode mode);
+    /** @return false if name isn't one of "none", "_id_only" or "all" */
+    bool parseIndexPrefetchMode(const string& name, IndexPrefetchMode* mode);
+
     // page in pages needed for all index lookups on a given object
-    void prefetchIndexPages(const char *ns, const BSONObj& obj);
+    void prefetchIndexPages(NamespaceDetails *nsd, const BSONObj& obj);
 
     // page in the data pages for a record associated with an object
     void prefetchRecordPages(const char *ns, const BSONObj& obj);
 
-    // page in both index and data pages for an op from the oplog
+    // page in both index and data pages for an op from the oplog.  takes its own read lock;
+    // does nothing if the op's collection doesn't exist yet.
     void prefetchPagesForReplicatedOp(const BSONObj& op);
+
+    // for serverStatus: repl.prefetch
+    void appendReplPrefetchStats(BSONObjBuilder& b);
+
+    // counts an op that was applied before the prefetcher reached it
+    void notePrefetchMissedOp();
 }
@@ -247,9 +247,7 @@ namespace mongo {
 
             if ( _source[k.fieldName()].type() ) {
 
-                if ( strchr( k.fieldName() , '.' ) ) {
-                    // TODO we currently don't support dotted fields
-                    //      SERVER-2104
+                if ( strchr( k.fieldName() , '.' ) && ! _coverableDottedField( k.fieldName() ) ) {
                     return 0;
                 }
 
@@ -280,11 +278,44 @@ namespace mongo {
         return 0;
     }
 
+    bool Projection::_coverableDottedField( const char *name ) const {
+        // a projection of both 'a' and 'a.b' can't be built from separate key fields
+        size_t len = strlen( name );
+        BSONObjIterator i( _source );
+        while ( i.more() ) {
+            const char *other = i.next().fieldName();
+            size_t otherLen = strlen( other );
+            if ( otherLen == len )
+                continue;
+            const char *shorter = otherLen < len ? other : name;
+            const char *longer = otherLen < len ? name : other;
+            size_t shorterLen = min( len , otherLen );
+            if ( strncmp( shorter , longer , shorterLen ) == 0 && longer[shorterLen] == '.' )
+                return false;
+        }
+        return true;
+    }
+
     BSONObj Projection::KeyOnly::hydrate( const BSONObj& key ) const {
         verify( _include.size() == _names.size() );
 
         BSONObjBuilder b( key.objsize() + _stringSize + 16 );
 
+        if ( _dotted ) {
+            vector< pair< string , BSONElement > > fields;
+            BSONObjIterator i(key);
+            unsigned n=0;
+            while ( i.more() ) {
+                verify( n < _include.size() );
+                BSONElement e = i.next();
+                if ( _include[n] )
+                    fields.push_back( make_pair( _names[n] , e ) );
+                n++;
+            }
+            _appendNested( b , fields );
+            return b.obj();
+        }
+
         BSONObjIterator i(key);
         unsigned n=0;
         while ( i.more() ) {
@@ -298,4 +329,34 @@ namespace mongo {
 
         return b.obj();
     }
+
+    void Projection::KeyOnly::_appendNested( BSONObjBuilder& b ,
+                                             const vector< pair< string , BSONElement > >& fields ) {
+        vector<bool> used( fields.size() );
+        for ( size_t i = 0; i < fields.size(); ++i ) {
+            if ( used[i] )
+                continue;
+            used[i] = true;
+            const string& name = fields[i].first;
+            size_t dot = name.find( '.' );
+            if ( dot == string::npos ) {
+                b.appendAs( fields[i].second , name );
+                continue;
+            }
+
+            // the fields sharing this component go into one subobject, in key order
+            string prefix = name.substr( 0 , dot + 1 );
+            vector< pair< string , BSONElement > > sub;
+            sub.push_back( make_pair( name.substr( dot + 1 ) , fields[i].second ) );
+            for ( size_t j = i + 1; j < fields.size(); ++j ) {
+                if ( ! used[j] && fields[j].first.compare( 0 , prefix.size() , prefix ) == 0 ) {
+                    used[j] = true;
+                    sub.push_back( make_pair( fields[j].first.substr( dot + 1 ) , fields[j].second ) );
+                }
+            }
+            BSONObjBuilder nested( b.subobjStart( name.substr( 0 , dot ) ) );
+            _appendNested( nested , sub );
+            nested.done();
+        }
+    }
 }
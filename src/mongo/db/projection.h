@@ -33,8 +33,9 @@ namespace mongo {
         class KeyOnly {
         public:
 
-            KeyOnly() : _stringSize(0) {}
+            KeyOnly() : _stringSize(0) , _dotted(false) {}
 
+            /** dotted field names are expanded into nested objects, { 'a.b' : 1 } -> { a : { b : 1 } } */
             BSONObj hydrate( const BSONObj& key ) const;
 
             void addNo() { _add( false , "" ); }
@@ -46,12 +47,19 @@ namespace mongo {
                 _include.push_back( b );
                 _names.push_back( name );
                 _stringSize += name.size();
+                if ( name.find( '.' ) != string::npos )
+                    _dotted = true;
             }
 
+            /** appends 'fields', naming a subobject for each leading component of a dotted name */
+            static void _appendNested( BSONObjBuilder& b ,
+                                       const vector< pair< string , BSONElement > >& fields );
+
             vector<bool> _include; // one entry per field in key.  true iff should be in output
             vector<string> _names; // name of field since key doesn't have names
 
             int _stringSize;
+            bool _dotted; // some included name has a '.'
         };
 
         Projection() :
@@ -104,6 +112,9 @@ namespace mongo {
          */
         void append( BSONObjBuilder& b , const BSONElement& e ) const;
 
+        /** @return false if another projected field is a prefix of dotted 'name', or the reverse */
+        bool _coverableDottedField( const char *name ) const;
+
 
         void add( const string& field, bool include );
         void add( const string& field, int skip, int limit );
@@ -21,6 +21,7 @@
 #include "db.h"
 #include "btree.h"
 #include "cmdline.h"
+#include "intersectcursor.h"
 #include "../server.h"
 #include "pagefault.h"
 
@@ -124,7 +125,8 @@ namespace mongo {
         _utility( Helpful ),
         _special( special ),
         _type(0),
-        _startOrEndSpec() {
+        _startOrEndSpec(),
+        _intersectIdxNo( -1 ) {
     }
     
     void QueryPlan::init( const FieldRangeSetPair *originalFrsp,
@@ -262,6 +264,10 @@ doneCheckOrder:
             _utility = Disallowed;
         }
 
+        if ( idxSpec.isPartial() && !idxSpec.filterImplied( _frsMulti ) ) {
+            _utility = Disallowed;
+        }
+
         if ( _parsedQuery && _parsedQuery->getFields() && !_d->isMultikey( _idxNo ) ) { // Does not check modifiedKeys()
             _keyFieldsOnly.reset( _parsedQuery->getFields()->checkKey( _index->keyPattern() ) );
         }
@@ -291,18 +297,33 @@ doneCheckOrder:
                 
         massert( 10363 ,  "newCursor() with start location not implemented for indexed plans", startLoc.isNull() );
 
+        BtreeCursor *c;
         if ( _startOrEndSpec ) {
             // we are sure to spec _endKeyInclusive
-            return shared_ptr<Cursor>( BtreeCursor::make( _d, _idxNo, *_index, _startKey, _endKey, _endKeyInclusive, _direction >= 0 ? 1 : -1 ) );
+            c = BtreeCursor::make( _d, _idxNo, *_index, _startKey, _endKey, _endKeyInclusive, _direction >= 0 ? 1 : -1 );
         }
         else if ( _index->getSpec().getType() ) {
-            return shared_ptr<Cursor>( BtreeCursor::make( _d, _idxNo, *_index, _frv->startKey(), _frv->endKey(), true, _direction >= 0 ? 1 : -1 ) );
+            c = BtreeCursor::make( _d, _idxNo, *_index, _frv->startKey(), _frv->endKey(), true, _direction >= 0 ? 1 : -1 );
         }
         else {
-            return shared_ptr<Cursor>( BtreeCursor::make( _d, _idxNo, *_index, _frv,
-                                                         independentRangesSingleIntervalLimit(),
-                                                         _direction >= 0 ? 1 : -1 ) );
+            c = BtreeCursor::make( _d, _idxNo, *_index, _frv,
+                                   independentRangesSingleIntervalLimit(),
+                                   _direction >= 0 ? 1 : -1 );
+        }
+        shared_ptr<Cursor> btreeCursor( c );
+
+        // client queries return the records they match, while counts and updates may only need
+        // the keys
+        if ( _parsedQuery ) {
+            c->setPrefetchRecords( true );
         }
+
+        if ( _intersectIdxNo >= 0 ) {
+            return shared_ptr<Cursor>( new IntersectCursor( btreeCursor, _d, _intersectIdxNo,
+                                                            _d->idx( _intersectIdxNo ),
+                                                            _intersectFrv ) );
+        }
+        return btreeCursor;
     }
 
     shared_ptr<Cursor> QueryPlan::newReverseCursor() const {
@@ -325,8 +346,8 @@ doneCheckOrder:
     void QueryPlan::registerSelf( long long nScanned,
                                  CandidatePlanCharacter candidatePlans ) const {
         // Impossible query constraints can be detected before scanning and historically could not
-        // generate a QueryPattern.
-        if ( _utility == Impossible ) {
+        // generate a QueryPattern.  An intersection would be recorded as its first index alone.
+        if ( _utility == Impossible || _intersectIdxNo >= 0 ) {
             return;
         }
 
@@ -337,6 +358,15 @@ doneCheckOrder:
         nsdt.registerCachedQueryPlanForPattern( queryPattern, queryPlanToCache );
     }
     
+    void QueryPlan::setIntersectIndex( int idxNo ) {
+        verify( indexed() && !_type && !_startOrEndSpec && idxNo != _idxNo );
+        _intersectIdxNo = idxNo;
+        _intersectFrv.reset( new FieldRangeVector( _frsMulti, _d->idx( idxNo ).getSpec(), 1 ) );
+        // the other index's fields are only in the document
+        _keyFieldsOnly.reset();
+        _exactKeyMatch = false;
+    }
+
     void QueryPlan::checkTableScanAllowed() const {
         if ( likely( !cmdLine.noTableScan ) )
             return;
@@ -464,6 +494,8 @@ doneCheckOrder:
     string QueryPlan::toString() const {
         return BSON(
                     "index" << indexKey() <<
+                    "intersect" << ( _intersectIdxNo >= 0 ? _d->idx( _intersectIdxNo ).keyPattern()
+                                                          : BSONObj() ) <<
                     "frv" << ( _frv ? _frv->toString() : "" ) <<
                     "order" << _order
                     ).jsonString();
@@ -583,9 +615,45 @@ doneCheckOrder:
             ++i ) {
             _qps.addCandidatePlan( *i );
         }        
+
+        shared_ptr<QueryPlan> intersectPlan = newIntersectPlan( d, plans );
+        if ( intersectPlan ) {
+            _qps.addCandidatePlan( intersectPlan );
+        }
         
         _qps.addCandidatePlan( newPlan( d, -1 ) );
     }
+
+    /**
+     * @return a plan scanning the first candidate's index and skipping records outside another
+     * candidate's ranges, led by a field the first index doesn't have, or an empty pointer.
+     */
+    shared_ptr<QueryPlan> QueryPlanGenerator::newIntersectPlan
+            ( NamespaceDetails *d, const vector<shared_ptr<QueryPlan> > &plans ) const {
+        // Small collections are scanned quickly by any index, so the extra plan would only
+        // lengthen the race.  Sorted queries are left to the plans providing or not providing
+        // the order.
+        if ( plans.size() < 2 || d->stats.nrecords < 1000 || !_qps.order().isEmpty() ) {
+            return shared_ptr<QueryPlan>();
+        }
+        const QueryPlan &first = *plans[ 0 ];
+        if ( first.exactKeyMatch() ) {
+            return shared_ptr<QueryPlan>();
+        }
+        BSONObj firstKey = first.indexKey();
+        for( vector<shared_ptr<QueryPlan> >::const_iterator i = plans.begin() + 1;
+            i != plans.end(); ++i ) {
+            const char *field = (*i)->indexKey().firstElementFieldName();
+            if ( firstKey.hasField( field ) ||
+                first.multikeyFrs().range( field ).universal() ) {
+                continue;
+            }
+            shared_ptr<QueryPlan> p = newPlan( d, first.idxNo() );
+            p->setIntersectIndex( (*i)->idxNo() );
+            return p;
+        }
+        return shared_ptr<QueryPlan>();
+    }
     
     bool QueryPlanGenerator::addShortCircuitPlan( NamespaceDetails *d ) {
         return
@@ -845,7 +913,8 @@ doneCheckOrder:
     void QueryPlanSet::addCandidatePlan( const QueryPlanPtr &plan ) {
         // If _plans is nonempty, the new plan may be supplementing a recorded plan at the first
         // position of _plans.  It must not duplicate the first plan.
-        if ( nPlans() > 0 && plan->indexKey() == firstPlan()->indexKey() ) {
+        if ( nPlans() > 0 && plan->indexKey() == firstPlan()->indexKey() &&
+            plan->intersectIdxNo() == firstPlan()->intersectIdxNo() ) {
             return;
         }
         pushPlan( plan );
@@ -1524,7 +1593,7 @@ doneCheckOrder:
             while( i.more() ) {
                 IndexDetails& ii = i.next();
                 if ( indexWorks( ii.keyPattern(), min.isEmpty() ? max : min, ret.first, ret.second ) ) {
-                    if ( ii.getSpec().getType() == 0 ) {
+                    if ( ii.getSpec().getType() == 0 && !ii.getSpec().isPartial() ) {
                         id = &ii;
                         keyPattern = ii.keyPattern();
                         break;
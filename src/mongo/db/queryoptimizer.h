@@ -86,6 +86,14 @@ namespace mongo {
         /** Register this plan as a winner for its QueryPattern, with specified 'nscanned'. */
         void registerSelf( long long nScanned, CandidatePlanCharacter candidatePlans ) const;
 
+        /**
+         * Only return records which are also within this plan's ranges on index 'idxNo', which
+         * must be a standard btree index led by a field that isn't in this plan's index.
+         */
+        void setIntersectIndex( int idxNo );
+        /** @return the index intersected with this plan's index, or -1 if there is none. */
+        int intersectIdxNo() const { return _intersectIdxNo; }
+
         int direction() const { return _direction; }
         BSONObj indexKey() const;
         bool indexed() const { return _index != 0; }
@@ -152,6 +160,8 @@ namespace mongo {
         bool _startOrEndSpec;
         shared_ptr<Projection::KeyOnly> _keyFieldsOnly;
         mutable shared_ptr<CoveredIndexMatcher> _matcher; // Lazy initialization.
+        int _intersectIdxNo;
+        shared_ptr<FieldRangeVector> _intersectFrv;
     };
 
     std::ostream &operator<< ( std::ostream &out, const QueryPlan::Utility &utility );
@@ -332,6 +342,8 @@ namespace mongo {
                                       const BSONObj &min = BSONObj(),
                                       const BSONObj &max = BSONObj(),
                                       const string &special = "" ) const;
+        shared_ptr<QueryPlan> newIntersectPlan( NamespaceDetails *d,
+                                               const vector<shared_ptr<QueryPlan> > &plans ) const;
         bool setUnindexedPlanIf( bool set, NamespaceDetails *d );
         void setSingleUnindexedPlan( NamespaceDetails *d );
         void setHintedPlanForIndex( IndexDetails& id );
@@ -25,6 +25,7 @@
 #include "explain.h"
 #include "mongo/client/dbclientinterface.h"
 #include "mongo/db/queryoptimizer.h"
+#include "mongo/util/trace_span.h"
 
 namespace mongo {
     
@@ -834,6 +835,7 @@ namespace mongo {
     }
     
     shared_ptr<Cursor> CursorGenerator::generate() {
+        TraceSpan span( TraceSpans::Plan );
 
         setArgumentsHint();
         shared_ptr<Cursor> cursor = shortcutCursor();
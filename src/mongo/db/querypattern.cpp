@@ -113,5 +113,21 @@ namespace mongo {
     _planCharacter( planCharacter ) {
     }
 
+    void QueryPlanHistory::notePlan( const CachedQueryPlan &plan ) {
+        if ( plan.indexKey().isEmpty() ) {
+            _plan = CachedQueryPlan();
+            _wins = 0;
+            return;
+        }
+        if ( _wins > 0 && _plan.indexKey() == plan.indexKey() ) {
+            ++_wins;
+            _plan = CachedQueryPlan( plan.indexKey(), max( _plan.nScanned(), plan.nScanned() ),
+                                     plan.planCharacter() );
+            return;
+        }
+        _plan = plan;
+        _wins = 1;
+    }
+
     
 } // namespace mongo
@@ -93,6 +93,26 @@ namespace mongo {
         CandidatePlanCharacter _planCharacter;
     };
 
+    /**
+     * The plans recorded for a QueryPattern across query cache expirations.  A pattern whose
+     * plan races keep choosing the same index is stable, and that plan may be used again
+     * without racing once the cache entry has expired.
+     */
+    class QueryPlanHistory {
+    public:
+        QueryPlanHistory() : _wins() {}
+        /** Record the plan cached for the pattern, an empty plan forgets the history. */
+        void notePlan( const CachedQueryPlan &plan );
+        bool stable() const { return _wins >= StableWins; }
+        /** @return the plan, with the largest nscanned seen while it kept winning. */
+        const CachedQueryPlan &plan() const { return _plan; }
+        int wins() const { return _wins; }
+        static const int StableWins = 3;
+    private:
+        CachedQueryPlan _plan;
+        int _wins;
+    };
+
     inline bool QueryPattern::operator<( const QueryPattern &other ) const {
         map<string,Type>::const_iterator i = _fieldTypes.begin();
         map<string,Type>::const_iterator j = other._fieldTypes.begin();
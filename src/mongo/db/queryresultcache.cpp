@@ -0,0 +1,108 @@
+// @file queryresultcache.cpp - Replies to repeated queries on collections which rarely change.
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+
+#include "mongo/db/queryresultcache.h"
+
+#include "mongo/db/dbmessage.h"
+
+namespace mongo {
+
+    AtomicUInt QueryResultCache::_hits;
+    AtomicUInt QueryResultCache::_misses;
+    AtomicUInt QueryResultCache::_inserts;
+    AtomicUInt QueryResultCache::_invalidations;
+
+    QueryResultCache::QueryResultCache() :
+        _m( "QueryResultCache" ),
+        _bytes() {
+    }
+
+    string QueryResultCache::makeKey( const QueryMessage &q ) {
+        StringBuilder b;
+        b << q.ntoskip << ' ' << q.ntoreturn << ' ';
+        b.append( StringData( q.query.objdata(), q.query.objsize() ) );
+        if ( !q.fields.isEmpty() ) {
+            b.append( StringData( q.fields.objdata(), q.fields.objsize() ) );
+        }
+        return b.str();
+    }
+
+    bool QueryResultCache::get( const string &key, Message &result ) {
+        SimpleMutex::scoped_lock lk( _m );
+        map< string, Entries::iterator >::iterator i = _index.find( key );
+        if ( i == _index.end() ) {
+            _misses++;
+            return false;
+        }
+        _entries.splice( _entries.begin(), _entries, i->second );
+        const string &reply = i->second->second;
+        char *data = static_cast< char* >( malloc( reply.size() ) );
+        memcpy( data, reply.data(), reply.size() );
+        result.setData( reinterpret_cast< MsgData* >( data ), true );
+        _hits++;
+        return true;
+    }
+
+    void QueryResultCache::put( const string &key, const QueryResult *qr ) {
+        if ( qr->len > MaxEntryBytes ) {
+            return;
+        }
+        SimpleMutex::scoped_lock lk( _m );
+        if ( _index.count( key ) ) {
+            return;
+        }
+        _entries.push_front( make_pair( key, string( reinterpret_cast< const char* >( qr ),
+                                                     qr->len ) ) );
+        _index[ key ] = _entries.begin();
+        _bytes += key.size() + qr->len;
+        _inserts++;
+        while( _bytes > MaxBytes ) {
+            const pair< string, string > &last = _entries.back();
+            _bytes -= last.first.size() + last.second.size();
+            _index.erase( last.first );
+            _entries.pop_back();
+        }
+    }
+
+    void QueryResultCache::clear() {
+        SimpleMutex::scoped_lock lk( _m );
+        if ( _entries.empty() ) {
+            return;
+        }
+        _entries.clear();
+        _index.clear();
+        _bytes = 0;
+        _invalidations++;
+    }
+
+    void QueryResultCache::appendStats( BSONObjBuilder &b ) const {
+        SimpleMutex::scoped_lock lk( _m );
+        b.appendNumber( "entries", (long long)_index.size() );
+        b.appendNumber( "bytes", _bytes );
+    }
+
+    void QueryResultCache::appendGlobalStats( BSONObjBuilder &b ) {
+        b.appendNumber( "hits", (long long)_hits.get() );
+        b.appendNumber( "misses", (long long)_misses.get() );
+        b.appendNumber( "inserts", (long long)_inserts.get() );
+        b.appendNumber( "invalidations", (long long)_invalidations.get() );
+    }
+
+} // namespace mongo
@@ -0,0 +1,83 @@
+// @file queryresultcache.h - Replies to repeated queries on collections which rarely change.
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <list>
+
+#include "mongo/bson/util/atomic_int.h"
+#include "mongo/db/jsobj.h"
+#include "mongo/util/concurrency/mutex.h"
+
+namespace mongo {
+
+    class Message;
+    class QueryMessage;
+    struct QueryResult;
+
+    /**
+     * The replies to recent queries on one collection, for collections with the
+     * Flag_CacheQueryResults user flag set.  Only queries returning all their results in the
+     * first batch, without yielding, are cached.  A query is keyed by the bytes of its query
+     * object (including $orderby and any other modifiers), field selection, skip and limit, so
+     * equivalent queries with their fields in another order are cached separately.
+     *
+     * Any write to the collection empties its cache, see NamespaceDetailsTransient.  The least
+     * recently used replies are dropped to keep the cache under MaxBytes.
+     *
+     * Results are assumed to be repeatable: a $where reading the time or a random number is not.
+     */
+    class QueryResultCache : boost::noncopyable {
+    public:
+        QueryResultCache();
+
+        static string makeKey( const QueryMessage &q );
+
+        /** @return true and set 'result' to a copy of the reply cached for 'key', if there is one. */
+        bool get( const string &key, Message &result );
+
+        /** Caches 'qr' as the reply for 'key', unless it is larger than MaxEntryBytes. */
+        void put( const string &key, const QueryResult *qr );
+
+        /** Forgets all cached replies, @see NamespaceDetailsTransient::notifyOfWriteOp(). */
+        void clear();
+
+        /** Appends the number and size of the cached replies. */
+        void appendStats( BSONObjBuilder &b ) const;
+
+        /** Appends the hits, misses, inserts and invalidations of all collections, for serverStatus. */
+        static void appendGlobalStats( BSONObjBuilder &b );
+
+        static const long long MaxBytes = 4 * 1024 * 1024;
+        static const int MaxEntryBytes = 256 * 1024;
+
+    private:
+        typedef std::list< pair< string, string > > Entries; // key and reply, most recent first
+
+        mutable SimpleMutex _m;
+        Entries _entries;
+        map< string, Entries::iterator > _index;
+        long long _bytes;
+
+        static AtomicUInt _hits;
+        static AtomicUInt _misses;
+        static AtomicUInt _inserts;
+        static AtomicUInt _invalidations;
+    };
+
+} // namespace mongo
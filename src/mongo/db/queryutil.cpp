@@ -170,7 +170,7 @@ namespace mongo {
         // NOTE with $not, we could potentially form a complementary set of intervals.
         if ( !isNot && !e.eoo() && e.type() != RegEx && op == BSONObj::opIN ) {
             bool exactMatchesOnly = true;
-            set<BSONElement,element_lt> vals;
+            ElementSet vals;
             vector<FieldRange> regexes;
             uassert( 12580 , "invalid query" , e.isABSONObj() );
             BSONObjIterator i( e.embeddedObject() );
@@ -200,7 +200,9 @@ namespace mongo {
             }
 
             _simpleFiniteSet = exactMatchesOnly;
-            for( set<BSONElement,element_lt>::const_iterator i = vals.begin(); i != vals.end(); ++i )
+            vals.done();
+            _intervals.reserve( vals.size() );
+            for( ElementSet::const_iterator i = vals.begin(); i != vals.end(); ++i )
                 _intervals.push_back( FieldInterval(*i) );
 
             for( vector<FieldRange>::const_iterator i = regexes.begin(); i != regexes.end(); ++i )
@@ -1308,6 +1310,22 @@ namespace mongo {
         return true;
     }
     
+    bool FieldRangeVector::contiguous() const {
+        bool pastEqualities = false;
+        for( vector<FieldRange>::const_iterator i = _ranges.begin(); i != _ranges.end(); ++i ) {
+            if ( i->intervals().size() != 1 ) {
+                return false;
+            }
+            if ( pastEqualities && !i->universal() ) {
+                return false;
+            }
+            if ( !i->equality() ) {
+                pastEqualities = true;
+            }
+        }
+        return true;
+    }
+
     bool FieldRangeVector::matches( const BSONObj &obj ) const {
 
         bool ok = false;
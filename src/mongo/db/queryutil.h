@@ -87,6 +87,10 @@ namespace mongo {
         const BSONObj& getOrder() const { return _order; }
         const BSONObj& getHint() const { return _hint; }
         int getMaxScan() const { return _maxScan; }
+        /** whether a sort without an index may go to disk rather than fail at its memory limit */
+        bool sortSpill() const { return _sortSpill; }
+        /** the memory a sort without an index may use, 0 for the default */
+        unsigned getMaxSortBytes() const { return _maxSortBytes; }
         
         bool couldBeCommand() const {
             /* we assume you are using findOne() for running a cmd... */
@@ -158,6 +162,8 @@ namespace mongo {
             _returnKey = false;
             _showDiskLoc = false;
             _maxScan = 0;
+            _sortSpill = false;
+            _maxSortBytes = 0;
         }
         
         void _initTop( const BSONObj& top ) {
@@ -198,6 +204,13 @@ namespace mongo {
                         _maxScan = e.numberInt();
                     else if ( strcmp( "showDiskLoc" , name ) == 0 )
                         _showDiskLoc = e.trueValue();
+                    else if ( strcmp( "sortSpill" , name ) == 0 )
+                        _sortSpill = e.trueValue();
+                    else if ( strcmp( "maxSortBytes" , name ) == 0 ) {
+                        uassert( 16423 , "$maxSortBytes must be a positive number" ,
+                                 e.isNumber() && e.numberLong() > 0 );
+                        _maxSortBytes = (unsigned) std::min( e.numberLong() , 0x7fffffffLL );
+                    }
                     else if ( strcmp( "comment" , name ) == 0 ) {
                         ; // no-op
                     }
@@ -234,6 +247,8 @@ namespace mongo {
         BSONObj _max;
         BSONObj _hint;
         int _maxScan;
+        bool _sortSpill;
+        unsigned _maxSortBytes;
     };
     
     /**
@@ -585,13 +600,21 @@ namespace mongo {
          * index scan using this FieldRangeVector, BSONObj() if no such key.
          */
         BSONObj firstMatch( const BSONObj &obj ) const;
+
+        /** @return true iff index key 'key' is within the valid ranges. */
+        bool matchesKey( const BSONObj &key ) const;
+
+        /**
+         * @return true iff the matching keys are one contiguous run of the index: each field has a
+         * single interval, and every field after the first that isn't an equality is universal.
+         */
+        bool contiguous() const;
         
         string toString() const;
         
     private:
         int matchingLowElement( const BSONElement &e, int i, bool direction, bool &lowEquality ) const;
         bool matchesElement( const BSONElement &e, int i, bool direction ) const;
-        bool matchesKey( const BSONObj &key ) const;
         vector<FieldRange> _ranges;
         const IndexSpec _indexSpec;
         int _direction;
@@ -7,6 +7,8 @@
 #include "pagefault.h"
 #include "mongo/util/stack_introspect.h"
 #include "mongo/db/curop.h"
+#include "mongo/db/stats/namespace_io.h"
+#include "mongo/db/stats/working_set.h"
 
 namespace mongo {
 
@@ -206,6 +208,29 @@ namespace mongo {
         }
     }
 
+    void Record::prefetch( vector<DiskLoc> &locs ) {
+        sort( locs.begin(), locs.end() );
+        const size_t mask = ~( g_minOSPageSizeBytes - 1 );
+        char *runStart = 0;
+        char *runEnd = 0;
+        for( vector<DiskLoc>::const_iterator i = locs.begin(); i != locs.end(); ++i ) {
+            char *header = reinterpret_cast<char*>( DataFileMgr::getRecord( *i ) );
+            if ( likelyInPhysicalMemory( header ) )
+                continue;
+            char *page = reinterpret_cast<char*>( (size_t)header & mask );
+            if ( runStart && page >= runStart && page <= runEnd ) {
+                runEnd = page + g_minOSPageSizeBytes;
+                continue;
+            }
+            if ( runStart )
+                MAdvise::willNeed( runStart, runEnd - runStart );
+            runStart = page;
+            runEnd = page + g_minOSPageSizeBytes;
+        }
+        if ( runStart )
+            MAdvise::willNeed( runStart, runEnd - runStart );
+    }
+
     const bool blockSupported = ProcessInfo::blockCheckSupported();
 
     bool Record::blockCheckSupported() { 
@@ -270,10 +295,14 @@ namespace mongo {
 
 
     Record* Record::accessed() {
+        // before the access below makes the tracker call the page resident
+        NamespaceIO::noteRecord( _lengthWithHeaders , blockSupported ,
+                                 blockSupported && likelyInPhysicalMemory( _data ) );
         const size_t page = (size_t)_data >> 12;
         const size_t region = page >> 6;
         const size_t offset = page & 0x3f;        
         ps::rolling.access( region , offset , true );
+        WorkingSet::note( _data , WorkingSet::Data );
         return this;
     }
     
@@ -0,0 +1,149 @@
+// record_checksums.cpp
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+
+#include "mongo/db/record_checksums.h"
+
+#include "mongo/db/curop.h"
+#include "mongo/db/dur.h"
+#include "mongo/db/namespace_details.h"
+#include "mongo/db/pdfile.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/util/checksum.h"
+#include "mongo/util/concurrency/thread_pool.h"
+
+namespace mongo {
+
+    int recordChecksumSampleRate = 1000;
+
+    unsigned RecordChecksums::_reads = 0;
+
+    static AtomicInt64 sampledChecked;
+    static AtomicInt64 sampledBad;
+
+    int RecordChecksums::extra( const NamespaceDetails* d ) {
+        return d->isUserFlagSet( NamespaceDetails::Flag_RecordChecksums ) ? Size : 0;
+    }
+
+    void RecordChecksums::update( Record* r ) {
+        char* data = r->data();
+        int size = *reinterpret_cast<const int*>( data );
+        dassert( size + Size <= r->netLength() );
+        unsigned crc = crc32c( data, size );
+        memcpy( getDur().writingPtr( data + size, Size ), &crc, Size );
+    }
+
+    RecordChecksums::Result RecordChecksums::check( const Record* r ) {
+        // the raw fields, as a pool thread has no Client to note the access with
+        const char* data = r->_data;
+        int net = r->_netLength();
+        int size = *reinterpret_cast<const int*>( data );
+        if ( size < 5 || size > net )
+            return Bad;
+        if ( size + Size > net )
+            return None;
+        unsigned stored;
+        memcpy( &stored, data + size, Size );
+        return crc32c( data, size ) == stored ? Good : Bad;
+    }
+
+    void RecordChecksums::_sample( const char* ns, const Record* r, const DiskLoc& loc ) {
+        Result res = check( r );
+        if ( res == None )
+            return;
+        sampledChecked.fetchAndAdd( 1 );
+        if ( res == Good )
+            return;
+        sampledBad.fetchAndAdd( 1 );
+        error() << "record checksum mismatch in " << ns << " at " << loc.toString()
+                << ", run validate with checksums:true" << endl;
+    }
+
+    void RecordChecksums::_scanExtent( Extent* e, Counts* counts, DiskLoc* firstBad,
+                                       volatile bool* stop ) {
+        for ( DiskLoc loc = e->firstRecord; ! loc.isNull() && ! *stop; ) {
+            const Record* r = e->getRecord( loc );
+            switch ( check( r ) ) {
+            case None:
+                counts->none++;
+                break;
+            case Bad:
+                if ( ! counts->bad )
+                    *firstBad = loc;
+                counts->bad++;
+                // fall through
+            case Good:
+                counts->checked++;
+                break;
+            }
+            int next = r->_nextOfs;
+            if ( next == DiskLoc::NullOfs )
+                break;
+            loc = DiskLoc( loc.a(), next );
+        }
+    }
+
+    RecordChecksums::Counts RecordChecksums::scan( NamespaceDetails* d, int threads,
+                                                   DiskLoc* firstBad ) {
+        vector<Extent*> extents;
+        for ( DiskLoc L = d->firstExtent; ! L.isNull(); L = L.ext()->xnext )
+            extents.push_back( L.ext() );
+
+        vector<Counts> counts( extents.size() );
+        vector<DiskLoc> bad( extents.size() );
+        volatile bool stop = false;
+        threads = std::max( 1, std::min( threads, (int) extents.size() ) );
+        {
+            threadpool::ThreadPool pool( threads );
+            for ( unsigned i = 0; i < extents.size(); i++ )
+                pool.schedule( &RecordChecksums::_scanExtent, extents[i], &counts[i], &bad[i], &stop );
+
+            // the pool's threads have no CurOp, so killOp is seen to here
+            try {
+                while ( pool.tasks_remaining() > 0 ) {
+                    sleepmillis( 10 );
+                    killCurrentOp.checkForInterrupt( false );
+                }
+            }
+            catch ( ... ) {
+                stop = true;
+                pool.join();
+                throw;
+            }
+            pool.join();
+        }
+
+        Counts total;
+        for ( unsigned i = 0; i < counts.size(); i++ ) {
+            total.checked += counts[i].checked;
+            total.none += counts[i].none;
+            if ( counts[i].bad && ! total.bad )
+                *firstBad = bad[i];
+            total.bad += counts[i].bad;
+        }
+        return total;
+    }
+
+    void RecordChecksums::appendStats( BSONObjBuilder& b ) {
+        b.append( "sampleRate" , recordChecksumSampleRate );
+        b.appendNumber( "sampled" , sampledChecked.load() );
+        b.appendNumber( "sampledBad" , sampledBad.load() );
+    }
+
+}
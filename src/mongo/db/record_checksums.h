@@ -0,0 +1,89 @@
+// record_checksums.h
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+namespace mongo {
+
+    class BSONObjBuilder;
+    class DiskLoc;
+    class Extent;
+    class NamespaceDetails;
+    class Record;
+
+    extern int recordChecksumSampleRate; // reads per one checked, 0 for none
+
+    /**
+     * A collection created with { recordChecksums : true } keeps a CRC32C of each document in
+     * the 4 bytes after its BSON, inside the record, so silent corruption of the data files can
+     * be found without validate's full walk of the collection and its indexes.  The checksum is
+     * written with the document, under the same write intent; reads check one in
+     * recordChecksumSampleRate, and validate { checksums : true } checks them all.
+     */
+    class RecordChecksums {
+    public:
+        enum { Size = 4 };
+
+        enum Result {
+            None,   // the record has no room for one, e.g. written by an older version
+            Good,
+            Bad
+        };
+
+        /** @return the bytes a record in d needs past its document, 0 or Size */
+        static int extra( const NamespaceDetails* d );
+
+        /** @return true if d keeps checksums */
+        static bool enabled( const NamespaceDetails* d ) { return d && extra( d ); }
+
+        /** stores the checksum of r's document, declaring the write */
+        static void update( Record* r );
+
+        /** doesn't need a Client, or touch anything but r */
+        static Result check( const Record* r );
+
+        /** checks r if it is this thread's turn, logging and counting a bad one */
+        static void sample( const char* ns, const Record* r, const DiskLoc& loc ) {
+            if ( recordChecksumSampleRate > 0 && ++_reads % recordChecksumSampleRate == 0 )
+                _sample( ns, r, loc );
+        }
+
+        struct Counts {
+            Counts() : checked( 0 ), bad( 0 ), none( 0 ) {}
+            long long checked;
+            long long bad;
+            long long none;
+        };
+
+        /**
+         * checks every record in d, its extents shared among threads.  the caller holds at least
+         * a read lock on the database.
+         * @param firstBad set to the first bad record found, if any
+         */
+        static Counts scan( NamespaceDetails* d, int threads, DiskLoc* firstBad );
+
+        /** serverStatus().recordChecksums */
+        static void appendStats( BSONObjBuilder& b );
+
+    private:
+        static void _sample( const char* ns, const Record* r, const DiskLoc& loc );
+        static void _scanExtent( Extent* e, Counts* counts, DiskLoc* firstBad, volatile bool* stop );
+        static unsigned _reads; // not atomic, so the sampling is only roughly every n
+    };
+
+}
@@ -41,6 +41,7 @@
 #include "commands.h"
 #include "security.h"
 #include "cmdline.h"
+#include "../util/net/message_port.h"
 #include "repl_block.h"
 #include "repl/rs.h"
 #include "replutil.h"
@@ -250,6 +251,12 @@ namespace mongo {
 
             result.appendNumber("maxBsonObjectSize", BSONObjMaxUserSize);
             result.appendDate("localTime", jsTime());
+
+            // the reply may already be compressed; the other end reads that either way
+            if( cmdLine.networkCompression && cc().port() && offersCompression(cmdObj) ) {
+                cc().port()->setCompressing(true);
+                appendCompressionOffer(result);
+            }
             return true;
         }
     } cmdismaster;
@@ -1187,10 +1194,20 @@ namespace mongo {
         return conn()->runCommand( "admin" , cmd.obj() , res );
     }
 
+    void OplogReader::reconnect() {
+        string host = _conn->getServerAddress();
+        resetConnection();
+        if ( ! connect( host ) )
+            log() << "repl: couldn't reconnect to " << host << " after ending an exhaust query" << endl;
+    }
+
     void OplogReader::tailingQuery(const char *ns, const BSONObj& query, const BSONObj* fields ) {
         verify( !haveCursor() );
         LOG(2) << "repl: " << ns << ".find(" << query.toString() << ')' << endl;
-        cursor.reset( _conn->query( ns, query, 0, 0, fields, _tailingQueryOptions ).release() );
+        int options = _tailingQueryOptions;
+        if ( ! ( _conn->availableOptions() & QueryOption_Exhaust ) )
+            options &= ~QueryOption_Exhaust;
+        cursor.reset( _conn->query( ns, query, 0, 0, fields, options ).release() );
     }
     
     void OplogReader::tailingQueryGTE(const char *ns, OpTime t, const BSONObj* fields ) {
@@ -32,7 +32,7 @@ namespace replset {
         return o.objsize();
     }
 
-    BackgroundSync::BackgroundSync() : _buffer(256*1024*1024, &getSize),
+    BackgroundSync::BackgroundSync() : _buffer(BufferMaxSizeBytes, &getSize),
                                        _lastOpTimeFetched(0, 0),
                                        _lastH(0),
                                        _pause(true),
@@ -241,6 +241,9 @@ namespace replset {
         // from to track how far it has synced
         OplogReader r(false /* doHandshake */);
 
+        // have the sync source stream batches rather than wait for a getMore for each
+        r.setTailingQueryOptions( r.getTailingQueryOptions() | QueryOption_Exhaust );
+
         // find a target to sync from the last op time written
         getOplogReader(r);
 
@@ -270,8 +273,12 @@ namespace replset {
             return;
         }
 
+        const string host = r.conn()->getServerAddress();
+        time_t lastReevaluated = time(0);
+
         while (!inShutdown()) {
             while (!inShutdown()) {
+                long long fetchMicros = 0;
                 if (!r.moreInCurrentBatch()) {
                     if (theReplSet->gotForceSync()) {
                         return;
@@ -281,25 +288,48 @@ namespace replset {
                         return;
                     }
 
+                    Member* target;
                     {
                         boost::unique_lock<boost::mutex> lock(_mutex);
                         if (!_currentSyncTarget || !_currentSyncTarget->hbinfo().hbstate.readable()) {
                             return;
                         }
+                        target = _currentSyncTarget;
+                    }
+
+                    // every so often see whether another member has become a better source
+                    if (time(0) - lastReevaluated >= ReplSetImpl::SyncSourceReevaluateSecs) {
+                        lastReevaluated = time(0);
+                        if (theReplSet->shouldChangeSyncTarget(target)) {
+                            return;
+                        }
                     }
 
+                    unsigned long long start = curTimeMicros64();
                     r.more();
+                    fetchMicros = curTimeMicros64() - start;
                 }
 
                 if (!r.more())
                     break;
 
-                BSONObj o = r.nextSafe();
+                // take the whole batch the source sent.  the exhaust cursor means the source
+                // is already sending the next one while this one waits for room in the buffer.
+                vector<BSONObj> batch;
+                long long batchBytes = 0;
+                while (r.moreInCurrentBatch()) {
+                    batch.push_back(r.nextSafe().getOwned());
+                    batchBytes += batch.back().objsize();
+                }
+                if (fetchMicros) {
+                    theReplSet->noteSyncFetch(host, batchBytes, fetchMicros);
+                }
 
                 // the blocking queue will wait (forever) until there's room for us to push
-                _buffer.push(o.getOwned());
+                _buffer.pushAll(batch.begin(), batch.end());
 
                 {
+                    const BSONObj& o = batch.back();
                     boost::unique_lock<boost::mutex> lock(_mutex);
                     _lastH = o["h"].numberLong();
                     _lastOpTimeFetched = o["ts"]._opTime();
@@ -345,6 +375,24 @@ namespace replset {
         _buffer.blockingPop();
     }
 
+    bool BackgroundSync::peekAt(size_t i, BSONObj* op) {
+        return _buffer.peekAt(i, *op);
+    }
+
+    size_t BackgroundSync::peekRun(size_t i, size_t n, std::deque<BSONObj>* ops) {
+        return _buffer.peekRun(i, n, ops);
+    }
+
+    void BackgroundSync::consumeRun(size_t n) {
+        _buffer.popFront(n);
+    }
+
+    void BackgroundSync::appendBufferStats(BSONObjBuilder& b) const {
+        b.append("count", (long long) _buffer.count());
+        b.append("sizeBytes", (long long) _buffer.size());
+        b.append("maxSizeBytes", (long long) _buffer.maxSize());
+    }
+
     bool BackgroundSync::isStale(OplogReader& r, BSONObj& remoteOldestOp) {
         remoteOldestOp = r.findOne(rsoplog, Query());
         OpTime remoteTs = remoteOldestOp["ts"]._opTime();
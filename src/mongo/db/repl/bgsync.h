@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include <deque>
+
 #include <boost/thread/mutex.hpp>
 
 #include "mongo/util/queue.h"
@@ -32,6 +34,17 @@ namespace replset {
         virtual BSONObj* peek() = 0;
         virtual void consume() = 0;
         virtual Member* getSyncTarget() = 0;
+
+        // Copies the op i places behind the head of the buffer into op without removing it.
+        // Returns false if fewer than i+1 ops are buffered.  Does not block.
+        virtual bool peekAt(size_t i, BSONObj* op) = 0;
+
+        // Appends copies of up to n buffered ops, starting i places behind the head, to ops,
+        // taking the buffer's lock once.  Returns how many were copied.  Does not block.
+        virtual size_t peekRun(size_t i, size_t n, std::deque<BSONObj>* ops) = 0;
+
+        // Removes n applied ops from the head of the buffer at once.
+        virtual void consumeRun(size_t n) = 0;
     };
 
 
@@ -53,6 +66,9 @@ namespace replset {
         boost::mutex _mutex;
 
         // Production thread
+        // bounded by the bytes of the ops it holds rather than their number, so it neither runs
+        // dry on small ops nor balloons on big ones
+        static const size_t BufferMaxSizeBytes = 256 * 1024 * 1024;
         BlockingQueue<BSONObj> _buffer;
 
         BSONObj _currentOp;
@@ -119,6 +135,14 @@ namespace replset {
         // called by sync thread when it has applied an op
         virtual void consume();
 
+        // lets the sync thread look past the head of the buffer to build a batch
+        virtual bool peekAt(size_t i, BSONObj* op);
+        virtual size_t peekRun(size_t i, size_t n, std::deque<BSONObj>* ops);
+        virtual void consumeRun(size_t n);
+
+        // the buffer's fill, for serverStatus
+        void appendBufferStats(BSONObjBuilder& b) const;
+
         // return the member we're currently syncing from (or NULL)
         virtual Member* getSyncTarget();
     };
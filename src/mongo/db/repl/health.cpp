@@ -400,6 +400,9 @@ namespace mongo {
             v.push_back(bb.obj());
         }
 
+        // the inputs getMemberToSyncTo() weighs for each member
+        const OpTime newest = _newestOpTime();
+
         Member *m =_members.head();
         while( m ) {
             BSONObjBuilder bb;
@@ -422,6 +425,11 @@ namespace mongo {
             }
             bb.appendTimeT("lastHeartbeat", m->hbinfo().lastHeartbeat);
             bb.append("pingMs", m->hbinfo().ping);
+            if (!m->config().arbiterOnly) {
+                BSONObjBuilder cost(bb.subobjStart("syncSourceCost"));
+                syncSourceCost(m, newest, &cost);
+                cost.done();
+            }
             string s = m->lhb();
             if( !s.empty() )
                 bb.append("errmsg", s);
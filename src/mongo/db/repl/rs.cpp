@@ -357,7 +357,10 @@ namespace mongo {
         _self(0),
         _maintenanceMode(0),
         mgr( new Manager(this) ),
-        ghost( new GhostSync(this) ) {
+        ghost( new GhostSync(this) ),
+        _writerPool(replWriterThreadCount),
+        _prefetcherPool(replPrefetcherThreadCount),
+        _syncFetchMutex("syncFetchStats") {
 
         _cfg = 0;
         memset(_hbmsg, 0, sizeof(_hbmsg));
@@ -395,7 +398,10 @@ namespace mongo {
         _self(0),
         _maintenanceMode(0),
         mgr(0),
-        ghost(0) {
+        ghost(0),
+        _writerPool(replWriterThreadCount),
+        _prefetcherPool(replPrefetcherThreadCount),
+        _syncFetchMutex("syncFetchStats") {
     }
 
     ReplSet::ReplSet(ReplSetCmdline& replSetCmdline) : ReplSetImpl(replSetCmdline) {}
@@ -21,6 +21,7 @@
 #include "../../util/concurrency/list.h"
 #include "../../util/concurrency/value.h"
 #include "../../util/concurrency/msg.h"
+#include "../../util/concurrency/thread_pool.h"
 #include "../../util/net/hostandport.h"
 #include "../commands.h"
 #include "../oplog.h"
@@ -331,9 +332,18 @@ namespace mongo {
         bool forceSyncFrom(const string& host, string& errmsg, BSONObjBuilder& result);
 
         /**
-         * Find the closest member (using ping time) with a higher latest optime.
+         * Find the cheapest member to sync from with a higher latest optime.  Candidates are
+         * scored by ping time, how fast they have delivered oplog batches to us, and how far
+         * they are behind the freshest member; see syncSourceCost().
          */
         Member* getMemberToSyncTo();
+        /**
+         * @return true if a member other than 'current' is now enough cheaper than it to be
+         * worth changing sync sources for.
+         */
+        bool shouldChangeSyncTarget(const Member* current);
+        /** records that 'host' sent us 'bytes' of oplog in 'micros' */
+        void noteSyncFetch(const string& host, long long bytes, long long micros);
         void veto(const string& host, unsigned secs=10);
         bool gotForceSync();
         void goStale(const Member* m, const BSONObj& o);
@@ -496,7 +506,8 @@ namespace mongo {
 
     private:
         void _syncDoInitialSync();
-        bool _syncDoInitialSync_clone( const char *master, const list<string>& dbs , bool dataPass );
+        bool _syncDoInitialSync_clone( const char *master, const list<string>& dbs , bool dataPass ,
+                                       const set<string>& cloned );
         bool _syncDoInitialSync_applyToHead( replset::InitialSync& init, OplogReader* r , 
                                              const Member* source, const BSONObj& lastOp, 
                                              BSONObj& minValidOut);
@@ -508,9 +519,55 @@ namespace mongo {
 
         // keep a list of hosts that we've tried recently that didn't work
         map<string,time_t> _veto;
+
+        /**
+         * The best candidate to sync from, or 0.  If 'current' is a candidate it is kept unless
+         * another is SyncSourceSwitchRatio of its cost or less, so that selection doesn't flap.
+         * Must hold the rs lock.
+         */
+        Member* _chooseSyncSource(const Member* current);
+        /** the most recent optime any member has reported */
+        OpTime _newestOpTime() const;
+        /**
+         * Relative cost, in milliseconds, of syncing from m: its ping, the time to fetch
+         * SyncSourceRefBytes at the rate it has delivered so far, and its lag behind 'newest'.
+         * Appends the inputs to 'explain' if given.
+         */
+        double syncSourceCost(const Member* m, const OpTime& newest, BSONObjBuilder* explain) const;
+
+        // threads that apply the partitioned ops of a replication batch
+        ThreadPool _writerPool;
+        // threads that page in the data and index pages replicated ops will touch
+        ThreadPool _prefetcherPool;
+
+        // moving average of the oplog fetch throughput from each sync source we have used
+        map<string,double> _syncFetchBytesPerSec;
+        mutable SimpleMutex _syncFetchMutex;
     public:
+        static const int replWriterThreadCount = 16;
+        static const int replPrefetcherThreadCount = 16;
+
+        // oplog fetched from a source is only timed from batches at least this big
+        static const long long SyncFetchMinSampleBytes = 64 * 1024;
+        // amount of oplog the fetch throughput part of a candidate's cost is based on
+        static const long long SyncSourceRefBytes = 1024 * 1024;
+        // cost added for each second a candidate is behind the freshest member
+        static const int SyncSourceLagMillisPerSec = 100;
+        // a new source must cost at most this fraction of the current one's
+        static const double SyncSourceSwitchRatio;
+        // how often the background sync thread checks for a better source
+        static const int SyncSourceReevaluateSecs = 60;
+
+        ThreadPool& getWriterPool() { return _writerPool; }
+        ThreadPool& getPrefetchPool() { return _prefetcherPool; }
+
         const ReplSetConfig::MemberCfg& myConfig() const { return _config; }
         bool tryToGoLiveAsASecondary(OpTime&); // readlocks
+        /**
+         * Record the op that ends the batch about to be applied as minValid, so that if we
+         * crash mid-batch we stay RECOVERING until the whole batch has been reapplied.
+         */
+        void setMinValid(const BSONObj& lastOpInBatch); // locks local
         void syncRollback(OplogReader& r);
         void syncThread();
         const OpTime lastOtherOpTime() const;
@@ -20,6 +20,7 @@
 
 #include "mongo/db/client.h"
 #include "mongo/db/dbhelpers.h"
+#include "mongo/db/instance.h"
 #include "mongo/db/oplog.h"
 #include "mongo/db/oplogreader.h"
 #include "mongo/db/repl.h"
@@ -66,8 +67,71 @@ namespace mongo {
         fassert( 16233, failedAttempts < maxFailedAttempts);
     }
 
+    // collections the data pass clones at once (setParameter replInitialSyncThreads)
+    int replInitialSyncThreads = 4;
+
+    /**
+     * where a clone stands, so that an attempt which fails can be taken up by the next:
+     *   { _id : "start" , source : <host> , begin : <the source's last op when the clone began> }
+     *   { _id : <ns> , cloned : <whether ns's data is all there, or still being cloned> }
+     */
+    static const char* initialSyncProgressNS = "local.replset.initialSync";
+
+    static void noteCollectionCloned( const string& ns , bool cloned ) {
+        Client::WriteContext ctx( initialSyncProgressNS );
+        Helpers::upsert( initialSyncProgressNS , BSON( "_id" << ns << "cloned" << cloned ) );
+    }
+
+    /** forgets any earlier clone, recording one from source starting at begin */
+    static void startInitialSyncProgress( const string& source , const BSONObj& begin ) {
+        Client::WriteContext ctx( initialSyncProgressNS );
+        Helpers::emptyCollection( initialSyncProgressNS );
+        Helpers::upsert( initialSyncProgressNS , BSON( "_id" << "start" << "source" << source << "begin" << begin ) );
+    }
+
+    static void clearInitialSyncProgress() {
+        Client::WriteContext ctx( initialSyncProgressNS );
+        Helpers::emptyCollection( initialSyncProgressNS );
+    }
+
+    /**
+     * @return whether an earlier attempt's clone from source can be taken up: source must
+     *     still have the op it began at.  If so sets begin to that op, and cloned and partial to
+     *     the collections it finished and those it had started on.
+     */
+    static bool loadInitialSyncProgress( const string& source , OplogReader& r , BSONObj& begin ,
+                                         set<string>& cloned , set<string>& partial ) {
+        BSONObj start;
+        {
+            Client::WriteContext ctx( initialSyncProgressNS );
+            vector<BSONObj> all = Helpers::findAll( initialSyncProgressNS , BSONObj() );
+            for ( unsigned i = 0; i < all.size(); i++ ) {
+                BSONElement id = all[i]["_id"];
+                if ( id.type() != String )
+                    continue;
+                if ( id.String() == "start" )
+                    start = all[i].getOwned();
+                else if ( all[i]["cloned"].trueValue() )
+                    cloned.insert( id.String() );
+                else
+                    partial.insert( id.String() );
+            }
+        }
+
+        if ( start.isEmpty() || start["source"].str() != source || ! start["begin"].isABSONObj() )
+            return false;
+        begin = start["begin"].Obj();
+
+        BSONObjBuilder gte;
+        gte.appendTimestamp( "$gte" , begin["ts"]._opTime().asDate() );
+        BSONObj first = r.conn()->findOne( rsoplog , Query( BSON( "ts" << gte.obj() ) ) , 0 ,
+                                           QueryOption_SlaveOk | QueryOption_OplogReplay );
+        return ! first.isEmpty() && first["ts"]._opTime() == begin["ts"]._opTime() &&
+               first["h"].numberLong() == begin["h"].numberLong();
+    }
+
     /* todo : progress metering to sethbmsg. */
-    static bool clone(const char *master, string db, bool dataPass ) {
+    static bool clone(const char *master, string db, bool dataPass , const set<string>& cloned ) {
         CloneOptions options;
 
         options.fromDB = db;
@@ -82,12 +146,22 @@ namespace mongo {
         options.syncData = dataPass;
         options.syncIndexes = ! dataPass;
 
+        // admin and local can't be locked at once, so admin's few collections aren't noted in
+        // the progress, and a resumed sync clones them again
+        if ( dataPass && db != "admin" ) {
+            // indexes other than _id are built in the second pass, each in one go
+            options.collsToIgnore = cloned;
+            options.collectionThreads = replInitialSyncThreads;
+            options.noteCollection = &noteCollectionCloned;
+        }
+
         string err;
         return cloneFrom(master, options , err );
     }
 
 
-    bool ReplSetImpl::_syncDoInitialSync_clone( const char *master, const list<string>& dbs , bool dataPass ) {
+    bool ReplSetImpl::_syncDoInitialSync_clone( const char *master, const list<string>& dbs , bool dataPass ,
+                                                const set<string>& cloned ) {
         for( list<string>::const_iterator i = dbs.begin(); i != dbs.end(); i++ ) {
             string db = *i;
             if( db == "local" ) 
@@ -99,7 +173,7 @@ namespace mongo {
                 sethbmsg( str::stream() << "initial sync cloning indexes for : " << db , 0);
 
             Client::WriteContext ctx(db);
-            if ( ! clone( master, db, dataPass ) ) {
+            if ( ! clone( master, db, dataPass, cloned ) ) {
                 sethbmsg( str::stream() 
                               << "initial sync error clone of " << db 
                               << " dataPass: " << dataPass << " failed sleeping 5 minutes" ,0);
@@ -127,8 +201,6 @@ namespace mongo {
     Member* ReplSetImpl::getMemberToSyncTo() {
         lock lk(this);
 
-        bool buildIndexes = true;
-
         // if we have a target we've requested to sync from, use it
 
         if (_forceSyncTarget) {
@@ -146,11 +218,113 @@ namespace mongo {
                 OCCASIONALLY log() << "waiting for " << needMorePings << " pings from other members before syncing" << endl;
                 return NULL;
             }
+        }
+
+        Member *closest = _chooseSyncSource(0);
+        if (!closest) {
+            return NULL;
+        }
+
+        sethbmsg( str::stream() << "syncing to: " << closest->fullName(), 0);
+
+        return closest;
+    }
 
-            buildIndexes = myConfig().buildIndexes;
+    const double ReplSetImpl::SyncSourceSwitchRatio = 0.7;
+
+    bool ReplSetImpl::shouldChangeSyncTarget(const Member* current) {
+        lock lk(this);
+
+        // a requested target is picked up by gotForceSync()
+        if (_forceSyncTarget || !current) {
+            return false;
         }
 
-        // find the member with the lowest ping time that has more data than me
+        Member* best = _chooseSyncSource(current);
+        if (!best || best == current) {
+            return false;
+        }
+
+        log() << "replSet changing sync target from " << current->fullName() << " to "
+              << best->fullName() << ", which is now cheaper to sync from" << rsLog;
+        return true;
+    }
+
+    void ReplSetImpl::noteSyncFetch(const string& host, long long bytes, long long micros) {
+        // a batch which was already waiting in the socket says nothing about the link
+        if (bytes < SyncFetchMinSampleBytes || micros < 1000) {
+            return;
+        }
+
+        double rate = bytes * 1000000.0 / micros;
+        SimpleMutex::scoped_lock lk(_syncFetchMutex);
+        map<string,double>::iterator i = _syncFetchBytesPerSec.find(host);
+        if (i == _syncFetchBytesPerSec.end()) {
+            _syncFetchBytesPerSec[host] = rate;
+        }
+        else {
+            i->second = i->second * 0.8 + rate * 0.2;
+        }
+    }
+
+    OpTime ReplSetImpl::_newestOpTime() const {
+        OpTime newest = lastOpTimeWritten;
+        for (Member *m = _members.head(); m; m = m->next()) {
+            if (m->hbinfo().up() && newest < m->hbinfo().opTime) {
+                newest = m->hbinfo().opTime;
+            }
+        }
+        return newest;
+    }
+
+    double ReplSetImpl::syncSourceCost(const Member* m, const OpTime& newest,
+                                       BSONObjBuilder* explain) const {
+        const HeartbeatInfo& hb = m->hbinfo();
+        double cost = hb.ping;
+
+        int lagSecs = 0;
+        if (hb.opTime < newest) {
+            lagSecs = newest.getSecs() - hb.opTime.getSecs();
+        }
+        cost += (double) lagSecs * SyncSourceLagMillisPerSec;
+
+        // members we haven't synced from yet are assumed to be as fast as the average of
+        // those we have, so they are compared on ping and lag alone
+        double bytesPerSec = 0;
+        bool measured = false;
+        {
+            SimpleMutex::scoped_lock lk(_syncFetchMutex);
+            map<string,double>::const_iterator i = _syncFetchBytesPerSec.find(m->fullName());
+            if (i != _syncFetchBytesPerSec.end()) {
+                bytesPerSec = i->second;
+                measured = true;
+            }
+            else if (!_syncFetchBytesPerSec.empty()) {
+                for (i = _syncFetchBytesPerSec.begin(); i != _syncFetchBytesPerSec.end(); ++i) {
+                    bytesPerSec += i->second;
+                }
+                bytesPerSec /= _syncFetchBytesPerSec.size();
+            }
+        }
+        if (bytesPerSec > 0) {
+            cost += SyncSourceRefBytes * 1000.0 / bytesPerSec;
+        }
+
+        if (explain) {
+            explain->append("pingMs", hb.ping);
+            explain->append("lagSecs", lagSecs);
+            if (measured) {
+                explain->append("fetchBytesPerSec", (long long) bytesPerSec);
+            }
+            explain->append("cost", cost);
+        }
+        return cost;
+    }
+
+    Member* ReplSetImpl::_chooseSyncSource(const Member* current) {
+        verify( lockedByMe() );
+
+        bool buildIndexes = _cfg ? myConfig().buildIndexes : true;
 
         // Find primary's oplog time. Reject sync candidates that are more than
         // MAX_SLACK_TIME seconds behind.
@@ -171,7 +345,13 @@ namespace mongo {
 
         OpTime oldestSyncOpTime(primaryOpTime.getSecs() - maxSlackDurationSeconds, 0);
 
+        // lag is measured against the freshest member, which is the primary when there is
+        // one, so a secondary that is itself falling behind its source scores worse
+        const OpTime newest = _newestOpTime();
+
         Member *closest = 0;
+        double closestCost = 0;
+        double currentCost = -1;
         time_t now = 0;
 
         // Make two attempts.  The first attempt, we ignore those nodes with
@@ -199,16 +379,20 @@ namespace mongo {
                         continue;
                 }
 
-                // omit nodes that are more latent than anything we've already considered
-                if (closest && 
-                    (m->hbinfo().ping > closest->hbinfo().ping))
-                    continue;
-
                 if ( attempts == 0 &&
                      myConfig().slaveDelay < m->config().slaveDelay ) {
                     continue; // skip this one in the first attempt
                 }
 
+                // omit nodes that cost more than anything we've already considered
+                double cost = syncSourceCost(m, newest, 0);
+                if (m == current) {
+                    currentCost = cost;
+                }
+                else if (closest && cost > closestCost) {
+                    continue;
+                }
+
                 map<string,time_t>::iterator vetoed = _veto.find(m->fullName());
                 if (vetoed != _veto.end()) {
                     // Do some veto housekeeping
@@ -223,23 +407,34 @@ namespace mongo {
                             log() << "replSet not trying to sync from " << (*vetoed).first
                                   << ", it is vetoed for " << ((*vetoed).second - now) << " more seconds" << rsLog;
                         }
+                        if (m == current) {
+                            currentCost = -1;
+                        }
                         continue;
                     }
                     _veto.erase(vetoed);
                     // fall through, this is a valid candidate now
                 }
+
+                if (closest && cost > closestCost) {
+                    continue;
+                }
                 // This candidate has passed all tests; set 'closest'
                 closest = m;
+                closestCost = cost;
             }
             if (closest) break; // no need for second attempt
         }
 
-        if (!closest) {
-            return NULL;
+        // stay with the current source unless the best is clearly better
+        if (closest && currentCost >= 0 && closest != current &&
+            closestCost > currentCost * SyncSourceSwitchRatio) {
+            LOG(2) << "replSet keeping sync target " << current->fullName() << " (cost "
+                   << currentCost << ") over " << closest->fullName() << " (cost "
+                   << closestCost << ")" << rsLog;
+            return const_cast<Member*>(current);
         }
 
-        sethbmsg( str::stream() << "syncing to: " << closest->fullName(), 0);
-
         return closest;
     }
 
@@ -350,14 +545,39 @@ namespace mongo {
             return;
         }
         else {
-            sethbmsg("initial sync drop all databases", 0);
-            dropAllDatabasesExceptLocal();
+            BSONObj begin;
+            set<string> cloned;
+            set<string> partial;
+            if ( loadInitialSyncProgress( sourceHostname, r, begin, cloned, partial ) ) {
+                // the ops since the earlier attempt's start bring what it cloned up to date
+                sethbmsg( str::stream() << "initial sync resuming, " << cloned.size()
+                                        << " collections already cloned" , 0 );
+                lastOp = begin;
+
+                vector<string> local;
+                getDatabaseNames( local );
+                if ( std::find( local.begin(), local.end(), "admin" ) != local.end() ) {
+                    Client::WriteContext ctx( "admin" );
+                    dropDatabase( "admin" );
+                }
+                for ( set<string>::const_iterator i = partial.begin(); i != partial.end(); ++i ) {
+                    Client::WriteContext ctx( *i );
+                    string errmsg;
+                    BSONObjBuilder res;
+                    dropCollection( *i, errmsg, res );
+                }
+            }
+            else {
+                sethbmsg("initial sync drop all databases", 0);
+                dropAllDatabasesExceptLocal();
+                startInitialSyncProgress( sourceHostname, lastOp );
+            }
 
             sethbmsg("initial sync clone all databases", 0);
 
             list<string> dbs = r.conn()->getDatabaseNames();
 
-            if ( ! _syncDoInitialSync_clone( sourceHostname.c_str(), dbs, true ) ) {
+            if ( ! _syncDoInitialSync_clone( sourceHostname.c_str(), dbs, true, cloned ) ) {
                 veto(source->fullName(), 600);
                 sleepsecs(300);
                 return;
@@ -378,7 +598,7 @@ namespace mongo {
             lastH = 0;
 
             sethbmsg("initial sync building indexes",0);
-            if ( ! _syncDoInitialSync_clone( sourceHostname.c_str(), dbs, false ) ) {
+            if ( ! _syncDoInitialSync_clone( sourceHostname.c_str(), dbs, false, set<string>() ) ) {
                 veto(source->fullName(), 600);
                 sleepsecs(300);
                 return;
@@ -409,6 +629,7 @@ namespace mongo {
             Helpers::putSingleton("local.replset.minvalid", minValid);
             cx.ctx().db()->flushFiles(true);
         }
+        clearInitialSyncProgress();
 
         sethbmsg("initial sync done",0);
     }
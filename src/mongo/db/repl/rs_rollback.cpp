@@ -23,6 +23,8 @@
 #include "../ops/update.h"
 #include "../ops/delete.h"
 
+#include <boost/thread/thread.hpp>
+
 /* Scenarios
 
    We went offline with ops not replicated out.
@@ -56,6 +58,8 @@
       (2) do not consider copy valid until we pass reach an optime after when we fetched the new version of object
           -- i.e., reset minvalid.
       (3) we could skip operations on objects that are previous in time to our capture of the object as an optimization.
+      objects whose first op past 'd' was an insert, or logged a pre-image, are instead put back as they were at
+      'd' without asking the other server; applying its ops from 'd' brings them forward.
 
 */
 
@@ -86,6 +90,14 @@ namespace mongo {
            need to refetch it once. */
         set<DocID> toRefetch;
 
+        /* the earliest of our ops past the common point on each document.  if it was an insert, or
+           carries a pre-image (setParameter oplogPreImages), it tells us what the document was at
+           the common point, and we can restore that instead of refetching. */
+        map<DocID,bo> firstOp;
+
+        /* our ops which were stored compressed, uncompressed; DocIDs point into them */
+        list<bo> uncompressed;
+
         /* collections to drop */
         set<string> toDrop;
 
@@ -97,7 +109,12 @@ namespace mongo {
         int rbid; // remote server's current rollback sequence #
     };
 
-    static void refetch(HowToFixUp& h, const BSONObj& ourObj) {
+    static void refetch(HowToFixUp& h, const BSONObj& stored) {
+        BSONObj ourObj = uncompressOplogEntry(stored);
+        if( ourObj.objdata() != stored.objdata() ) {
+            h.uncompressed.push_back(ourObj);
+        }
+
         const char *op = ourObj.getStringField("op");
         if( *op == 'n' )
             return;
@@ -187,6 +204,8 @@ namespace mongo {
         }
 
         h.toRefetch.insert(d);
+        // we walk our oplog backwards, so this ends up as the earliest op on the document
+        h.firstOp[d] = ourObj;
     }
 
     int getRBID(DBClientConnection*);
@@ -304,6 +323,69 @@ namespace mongo {
         bson::bo goodVersionOfObject;
     };
 
+    // _ids refetched per $in query, and connections to the source running the queries at once
+    static const unsigned RefetchBatchSize = 500;
+    static const unsigned RefetchConnections = 4;
+
+    /** the _ids of one collection to refetch with a single query, and the documents it found */
+    struct RefetchBatch {
+        string ns;
+        bo query; // { _id : { $in : [ ... ] } }
+        list<bo> found;
+    };
+
+    struct ParallelRefetch {
+        ParallelRefetch() : m("ParallelRefetch"), next(0), totSize(0) { }
+        mongo::mutex m;
+        vector<RefetchBatch> batches;
+        unsigned next;              // the first batch not yet started (protected by m)
+        unsigned long long totSize; // bytes fetched so far (protected by m)
+        string errmsg;              // the first failure; once set the threads stop (protected by m)
+    };
+
+    /** runs batches taken from pr until there are none left, on conn */
+    static void refetchBatches(DBClientConnection *conn, ParallelRefetch *pr) {
+        try {
+            while( 1 ) {
+                RefetchBatch *b;
+                {
+                    scoped_lock lk(pr->m);
+                    if( pr->next == pr->batches.size() || !pr->errmsg.empty() )
+                        return;
+                    b = &pr->batches[pr->next++];
+                }
+
+                auto_ptr<DBClientCursor> c = conn->query(b->ns, b->query, 0, 0, 0, QueryOption_SlaveOk);
+                uassert(16368, str::stream() << "replSet rollback refetch query failed on " << b->ns, c.get());
+                unsigned long long bytes = 0;
+                while( c->more() ) {
+                    b->found.push_back(c->nextSafe().getOwned());
+                    bytes += b->found.back().objsize();
+                }
+
+                scoped_lock lk(pr->m);
+                pr->totSize += bytes;
+                uassert( 13410, "replSet too much data to roll back", pr->totSize < 300 * 1024 * 1024 );
+            }
+        }
+        catch(DBException& e) {
+            scoped_lock lk(pr->m);
+            if( pr->errmsg.empty() )
+                pr->errmsg = e.toString();
+        }
+    }
+
+    /** queues a query for the documents in 'pending', which are all in one collection, and clears it */
+    static void addRefetchBatch(vector<DocID>& pending, ParallelRefetch *pr) {
+        BSONArrayBuilder ids;
+        for( unsigned i = 0; i < pending.size(); i++ )
+            ids.append(pending[i]._id);
+        pr->batches.push_back(RefetchBatch());
+        pr->batches.back().ns = pending[0].ns;
+        pr->batches.back().query = BSON( "_id" << BSON( "$in" << ids.arr() ) );
+        pending.clear();
+    }
+
     static void setMinValid(bo newMinValid) {
         try {
             log() << "replSet minvalid=" << newMinValid["ts"]._opTime().toStringLong() << rsLog;
@@ -327,26 +409,87 @@ namespace mongo {
 
         bo newMinValid;
 
-        /* fetch all the goodVersions of each document from current primary */
-        DocID d;
-        unsigned long long n = 0;
-        try {
+        /* a document whose first rolled back op tells us what it was at the common point is restored
+           from that; the good versions of the rest are fetched from the current primary, a
+           collection's _ids many to a query, on several connections at once */
+        ParallelRefetch pr;
+        map<DocID,bo> restored;
+        {
+            vector<DocID> pending; // of one collection
             for( set<DocID>::iterator i = h.toRefetch.begin(); i != h.toRefetch.end(); i++ ) {
-                d = *i;
-
+                const DocID& d = *i;
                 verify( !d._id.eoo() );
 
-                {
-                    /* TODO : slow.  lots of round trips. */
-                    n++;
-                    bo good= them->findOne(d.ns, d._id.wrap(), NULL, QueryOption_SlaveOk).getOwned();
-                    totSize += good.objsize();
-                    uassert( 13410, "replSet too much data to roll back", totSize < 300 * 1024 * 1024 );
-
-                    // note good might be eoo, indicating we should delete it
-                    goodVersions.push_back(pair<DocID,bo>(d,good));
+                const bo& op = h.firstOp[d];
+                const char *opstr = op.getStringField("op");
+                if( *opstr == 'i' ) {
+                    // wasn't there; delete it
+                    restored[d] = bo();
+                    continue;
                 }
+                bo pre = op.getObjectField("pre");
+                if( !pre.isEmpty() ) {
+                    restored[d] = pre.getOwned();
+                    totSize += pre.objsize();
+                    continue;
+                }
+
+                if( !pending.empty() && ( strcmp(pending[0].ns, d.ns) != 0 || pending.size() == RefetchBatchSize ) ) {
+                    addRefetchBatch(pending, &pr);
+                }
+                pending.push_back(d);
+            }
+            if( !pending.empty() ) {
+                addRefetchBatch(pending, &pr);
             }
+        }
+        uassert( 13410, "replSet too much data to roll back", totSize < 300 * 1024 * 1024 );
+        pr.totSize = totSize;
+
+        sethbmsg(str::stream() << "rollback 3 restoring " << restored.size() << " documents locally, refetching "
+                 << h.toRefetch.size() - restored.size() << " in " << pr.batches.size() << " queries");
+        try {
+            // the extra connections are made here, as authenticating may need the lock we hold
+            vector< shared_ptr<OplogReader> > readers;
+            string host = them->getServerAddress();
+            unsigned want = min((unsigned) pr.batches.size(), RefetchConnections);
+            for( unsigned i = 1; i < want; i++ ) {
+                shared_ptr<OplogReader> reader(new OplogReader(false));
+                if( !reader->connect(host) ) {
+                    break;
+                }
+                readers.push_back(reader);
+            }
+
+            boost::thread_group threads;
+            for( unsigned i = 0; i < readers.size(); i++ ) {
+                threads.create_thread(boost::bind(&refetchBatches, readers[i]->conn(), &pr));
+            }
+            refetchBatches(them, &pr);
+            threads.join_all();
+
+            uassert( 16369, str::stream() << "replSet rollback re-get objects: " << pr.errmsg, pr.errmsg.empty() );
+
+            // note a document not found on the primary gets an empty good version: we should delete it
+            map<DocID,bo> found;
+            for( vector<RefetchBatch>::iterator b = pr.batches.begin(); b != pr.batches.end(); ++b ) {
+                for( list<bo>::iterator i = b->found.begin(); i != b->found.end(); ++i ) {
+                    DocID d;
+                    d.ns = b->ns.c_str();
+                    d._id = (*i)["_id"];
+                    found[d] = *i;
+                }
+            }
+            for( set<DocID>::iterator i = h.toRefetch.begin(); i != h.toRefetch.end(); i++ ) {
+                map<DocID,bo>::iterator j = restored.find(*i);
+                if( j != restored.end() ) {
+                    goodVersions.push_back(*j);
+                    continue;
+                }
+                map<DocID,bo>::iterator f = found.find(*i);
+                goodVersions.push_back(pair<DocID,bo>(*i, f == found.end() ? bo() : f->second));
+            }
+
             newMinValid = r.getLastOp(rsoplog);
             if( newMinValid.isEmpty() ) {
                 sethbmsg("rollback error newMinValid empty?");
@@ -355,8 +498,9 @@ namespace mongo {
         }
         catch(DBException& e) {
             sethbmsg(str::stream() << "rollback re-get objects: " << e.toString(),0);
-            log() << "rollback couldn't re-get ns:" << d.ns << " _id:" << d._id << ' ' << n << '/' << h.toRefetch.size() << rsLog;
-            throw e;
+            log() << "rollback couldn't re-get objects, " << pr.batches.size() << " queries for "
+                  << h.toRefetch.size() - restored.size() << " documents" << rsLog;
+            throw;
         }
 
         MemoryMappedFile::flushAll(true);
@@ -614,6 +758,11 @@ namespace mongo {
         sethbmsg("rollback 1");
         {
             r.resetCursor();
+            if( r.conn() == 0 ) {
+                // ending an exhaust query costs the connection, and reconnecting failed
+                sethbmsg("rollback 2 error lost connection to sync source");
+                return 10;
+            }
 
             sethbmsg("rollback 2 FindCommonPoint");
             try {
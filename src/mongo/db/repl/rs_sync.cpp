@@ -18,17 +18,27 @@
 
 #include "mongo/db/client.h"
 #include "mongo/db/commands/fsync.h"
+#include "mongo/db/prefetch.h"
 #include "mongo/db/repl.h"
 #include "mongo/db/repl/bgsync.h"
 #include "mongo/db/repl/rs.h"
 #include "mongo/db/repl/rs_sync.h"
+#include "third_party/murmurhash3/MurmurHash3.h"
 
 namespace mongo {
 
     using namespace bson;
     extern unsigned replSetForceInitialSyncFailure;
 
-    replset::SyncTail::SyncTail(BackgroundSyncInterface *q) : Sync(""), _queue(q) {}
+    // setParameter replApplySliceOps: 0 applies each batch under one ParallelBatchWriterMode
+    unsigned replApplySliceOps = 0;
+
+    replset::SyncTail::SyncTail(BackgroundSyncInterface *q) :
+        Sync(""), _queue(q), _writerThreads(ReplSetImpl::replWriterThreadCount) {}
+
+    void replset::SyncTail::setWriterThreads(unsigned n) {
+        _writerThreads = max(1U, min(n, (unsigned) ReplSetImpl::replWriterThreadCount));
+    }
 
     replset::SyncTail::~SyncTail() {}
 
@@ -210,176 +220,382 @@ namespace mongo {
         return golive;
     }
 
-    class DontLockOnEverySingleOperation : boost::noncopyable { 
-        scoped_ptr<Lock::ScopedLock> lk;
-        scoped_ptr<SimpleMutex::scoped_lock> fsync;
-    public:
-        void reset() {
-            lk.reset();
-            fsync.reset();
+    void ReplSetImpl::setMinValid(const BSONObj& lastOpInBatch) {
+        BSONObjBuilder b;
+        b.appendTimestamp("ts", lastOpInBatch["ts"]._opTime().asDate());
+        b.append(lastOpInBatch["h"]);
+        Lock::DBWrite lk("local");
+        Helpers::putSingleton("local.replset.minvalid", b.obj());
+    }
+
+    static AtomicUInt replWriterWorkerId;
+
+    static void initializeWriterThread() {
+        // only do this once per thread
+        if ( haveClient() )
+            return;
+        string threadName = str::stream() << "repl writer worker " << ++replWriterWorkerId;
+        Client::initThread( threadName.c_str() );
+        // allow us to get through the ParallelBatchWriterMode barrier
+        Lock::ParallelBatchWriterMode::iAmABatchParticipant();
+        replLocalAuth();
+    }
+
+    static AtomicUInt replPrefetcherWorkerId;
+
+    static void initializePrefetchThread() {
+        if ( haveClient() )
+            return;
+        string threadName = str::stream() << "repl prefetch worker " << ++replPrefetcherWorkerId;
+        Client::initThread( threadName.c_str() );
+        // prefetching runs alongside batches being applied, so has to get through the
+        // ParallelBatchWriterMode barrier too
+        Lock::ParallelBatchWriterMode::iAmABatchParticipant();
+        replLocalAuth();
+    }
+
+    /* run on a prefetcher pool thread */
+    static void prefetchOp(const BSONObj& op) {
+        initializePrefetchThread();
+        prefetchPagesForReplicatedOp(op);
+    }
+
+    void replset::SyncTail::prefetchOps(const deque<BSONObj>& ops) {
+        ThreadPool& prefetcherPool = theReplSet->getPrefetchPool();
+        prefetcherPool.join();
+
+        bool any = false;
+        for( deque<BSONObj>::const_iterator i = ops.begin(); i != ops.end(); ++i ) {
+            const OpTime ts = (*i)["ts"]._opTime();
+            if( ts <= _prefetchedThrough ) {
+                continue;
+            }
+            notePrefetchMissedOp();
+            prefetcherPool.schedule(prefetchOp, *i);
+            _prefetchedThrough = ts;
+            any = true;
         }
-        void reset(const char *ns) { 
-            reset();
-            verify( !Lock::isLocked() );
-            fsync.reset( new SimpleMutex::scoped_lock(filesLockedFsync) );
-            if( ns == 0 ) {
-                lk.reset( new Lock::GlobalWrite() );
+        if( any ) {
+            prefetcherPool.join();
+        }
+    }
+
+    void replset::SyncTail::prefetchAhead(size_t batchSize) {
+        ThreadPool& prefetcherPool = theReplSet->getPrefetchPool();
+        deque<BSONObj> ahead;
+        _queue->peekRun(batchSize, replPrefetchDepth, &ahead);
+        for( deque<BSONObj>::const_iterator i = ahead.begin(); i != ahead.end(); ++i ) {
+            const BSONObj& op = *i;
+            const OpTime ts = op["ts"]._opTime();
+            if( ts <= _prefetchedThrough ) {
+                continue;
             }
-            else {
-                lk.reset( new Lock::DBWrite(ns) );
+            prefetcherPool.schedule(prefetchOp, op);
+            _prefetchedThrough = ts;
+        }
+    }
+
+    /* run on a writer pool thread */
+    static void multiSyncApply(const vector<BSONObj>* ops, replset::SyncTail* st, AtomicUInt* failures) {
+        initializeWriterThread();
+        if( !st->applyWriterOps(*ops) ) {
+            (*failures)++;
+        }
+    }
+
+    bool replset::SyncTail::applyWriterOps(const vector<BSONObj>& ops) {
+        for( vector<BSONObj>::const_iterator i = ops.begin(); i != ops.end(); ++i ) {
+            const BSONObj& o = *i;
+            const char *ns = o.getStringField("ns");
+            try {
+                scoped_ptr<Lock::ScopedLock> lk;
+                if( *ns == 0 || str::contains(ns, ".$cmd") ) {
+                    // a command may need a global write lock. so we will conservatively go ahead and grab one here. suboptimal. :-(
+                    lk.reset( new Lock::GlobalWrite() );
+                }
+                else {
+                    lk.reset( new Lock::DBWrite(ns) );
+                }
+                syncApply(o);
+                getDur().commitIfNeeded();
+            }
+            catch (DBException& e) {
+                sethbmsg(str::stream() << "syncTail: " << e.toString());
+                log() << "syncing: " << o.toString() << endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void replset::SyncTail::fillWriterVectors(const deque<BSONObj>& ops,
+                                              vector< vector<BSONObj> >* writerVectors) {
+        for( deque<BSONObj>::const_iterator i = ops.begin(); i != ops.end(); ++i ) {
+            const BSONElement e = (*i)["ns"];
+            const char *ns = e.valuestrsafe();
+            // ops on a namespace must be applied in order, so a namespace always maps to the
+            // same writer.  (ops on different _ids of one collection could go to different
+            // writers, but with db level locking they would just queue on the same lock, and
+            // capped collections need their inserts kept in order.)
+            uint32_t hash = 0;
+            MurmurHash3_x86_32( ns, strlen(ns), 0, &hash );
+            (*writerVectors)[hash % writerVectors->size()].push_back(*i);
+        }
+    }
+
+    bool replset::SyncTail::applyOps(const vector< vector<BSONObj> >& writerVectors) {
+        ThreadPool& writerPool = theReplSet->getWriterPool();
+        AtomicUInt failures;
+        for( vector< vector<BSONObj> >::const_iterator i = writerVectors.begin(); i != writerVectors.end(); ++i ) {
+            if( !i->empty() ) {
+                writerPool.schedule(multiSyncApply, &(*i), this, &failures);
+            }
+        }
+        writerPool.join();
+        return failures.get() == 0;
+    }
+
+    bool replset::SyncTail::applyOpsToOplog(deque<BSONObj>* ops) {
+        {
+            Lock::DBWrite lk("local");
+            for( deque<BSONObj>::const_iterator i = ops->begin(); i != ops->end(); ++i ) {
+                // this updates theReplSet->lastOpTimeWritten
+                _logOpObjRS(*i);
             }
         }
-    };
+
+        // the ops were only peeked at while building the batch; now that they are applied
+        // and in our oplog take them off the queue.  check the batch still starts and ends
+        // where the buffer does, as the producer clears the buffer if it has to stop syncing
+        // from its current target.
+        if( ops->empty() ) {
+            return true;
+        }
+        BSONObj first, last;
+        if( !_queue->peekAt(0, &first) || !_queue->peekAt(ops->size() - 1, &last) ||
+            first["ts"]._opTime() != ops->front()["ts"]._opTime() ||
+            last["ts"]._opTime() != ops->back()["ts"]._opTime() ) {
+            log() << "replSet sync buffer was reset while applying a batch" << rsLog;
+            ops->clear();
+            return false;
+        }
+        _queue->consumeRun(ops->size());
+        ops->clear();
+        return true;
+    }
+
+    bool replset::SyncTail::multiApply(deque<BSONObj>& ops) {
+        // fault in what this batch will touch, then page in the ops behind it while it is
+        // applied below
+        prefetchOps(ops);
+        prefetchAhead(ops.size());
+
+        LOG(2) << "replication batch size is " << ops.size() << endl;
+
+        /* readers are shut out while a slice is applied, so they only ever see the data as of
+           the end of a slice, with lastOpTimeWritten at its last op.  each slice is a prefix of
+           what is left of the batch, so that is a point-in-time state of the primary. */
+        const size_t sliceOps = replApplySliceOps ? replApplySliceOps : ops.size();
+        while( !ops.empty() ) {
+            deque<BSONObj> slice;
+            while( !ops.empty() && slice.size() < sliceOps ) {
+                slice.push_back(ops.front());
+                ops.pop_front();
+            }
+            bool bufferReset = false;
+            if( !applySlice(&slice, &bufferReset) ) {
+                return false;
+            }
+            if( bufferReset ) {
+                // the rest of the batch is no longer at the head of the queue
+                ops.clear();
+            }
+        }
+        return true;
+    }
+
+    bool replset::SyncTail::applySlice(deque<BSONObj>* ops, bool* bufferReset) {
+        vector< vector<BSONObj> > writerVectors(_writerThreads);
+        fillWriterVectors(*ops, &writerVectors);
+
+        // we must grab this because we're going to grab write locks later.  we hold it the
+        // entire time we're writing; it doesn't matter because all readers are blocked anyway.
+        SimpleMutex::scoped_lock fsynclk(filesLockedFsync);
+
+        // stop all readers until we're done.  this also keeps us from becoming primary mid-slice.
+        Lock::ParallelBatchWriterMode pbwm;
+
+        /* if we have become primary, we dont' want to apply things from elsewhere
+           anymore. assumePrimary is in the global write lock so we are safe as long as
+           we check after taking pbwm above. */
+        if( theReplSet->isPrimary() ) {
+            log(0) << "replSet stopping syncTail we are now primary" << rsLog;
+            return false;
+        }
+
+        if( !applyOps(writerVectors) ) {
+            return false;
+        }
+
+        *bufferReset = !applyOpsToOplog(ops);
+        return true;
+    }
+
+    /* peek the next ops from the queue into the batch: the first op of a batch on its own,
+       after that whatever run of ops is buffered behind it, copied under one lock.
+       @return true if the batch should be ended early: either there is nothing more buffered,
+               or the next op is a command or an index build, which are applied on their own.
+       blocks up to a second waiting for the first op of a batch, as there are maintenance
+       things the caller needs to check periodically.
+    */
+    bool replset::SyncTail::tryPeekAndWaitForMore(OpQueue* ops) {
+        deque<BSONObj> run;
+        if( ops->empty() ) {
+            BSONObj *next = peek();
+            if( next == NULL ) {
+                return false;
+            }
+            run.push_back(*next);
+        }
+        else {
+            const size_t have = ops->getDeque().size();
+            const size_t room = have < replBatchLimitOperations ?
+                                replBatchLimitOperations - have : 1;
+            if( _queue->peekRun(have, room, &run) == 0 ) {
+                // nothing more buffered, apply what we have
+                return true;
+            }
+        }
+
+        for( deque<BSONObj>::const_iterator i = run.begin(); i != run.end(); ++i ) {
+            const char *ns = i->getStringField("ns");
+            if( *ns == 0 || str::contains(ns, ".$cmd") ||
+                NamespaceString(ns).coll == "system.indexes" ) {
+                if( ops->empty() ) {
+                    // apply commands and index builds one at a time
+                    ops->push_back(*i);
+                }
+
+                // otherwise, apply what we have so far and come back for the command
+                return true;
+            }
+
+            ops->push_back(*i);
+
+            // leave the rest of the run for the next batch; the caller ends this one
+            if( ops->getSize() >= replBatchLimitBytes ) {
+                break;
+            }
+        }
+        return false;
+    }
+
+    void replset::SyncTail::handleSlaveDelay(const BSONObj& lastOp) {
+        int sd = theReplSet->myConfig().slaveDelay;
+
+        // ignore slaveDelay if the box is still initializing. once
+        // it becomes secondary we can worry about it.
+        if( sd && theReplSet->isSecondary() ) {
+            const OpTime ts = lastOp["ts"]._opTime();
+            long long a = ts.getSecs();
+            long long b = time(0);
+            long long lag = b - a;
+            long long sleeptime = sd - lag;
+            if( sleeptime > 0 ) {
+                uassert(12000, "rs slaveDelay differential too big check clocks and systems", sleeptime < 0x40000000);
+                if( sleeptime < 60 ) {
+                    sleepsecs((int) sleeptime);
+                }
+                else {
+                    log() << "replSet slavedelay sleep long time: " << sleeptime << rsLog;
+                    // sleep(hours) would prevent reconfigs from taking effect & such!
+                    long long waitUntil = b + sleeptime;
+                    while( 1 ) {
+                        sleepsecs(6);
+                        if( time(0) >= waitUntil )
+                            break;
+
+                        if( theReplSet->myConfig().slaveDelay != sd ) // reconf
+                            break;
+                    }
+                }
+            }
+        } // endif slaveDelay
+    }
 
     /* tail an oplog.  ok to return, will be re-called. */
     void replset::SyncTail::oplogApplication() {
         while( 1 ) {
             verify( !Lock::isLocked() );
-            {
-                int count = 0;
-                Timer timeInWriteLock;
-                DontLockOnEverySingleOperation lk;
-                while( 1 ) {
-                    // occasionally check some things
-                    if (count-- <= 0 || time(0) % 10 == 0) {
-                        if (theReplSet->isPrimary()) {
-                            return;
-                        }
-
-                        // can we become secondary?
-                        // we have to check this before calling mgr, as we must be a secondary to
-                        // become primary
-                        if (!theReplSet->isSecondary()) {
-                            OpTime minvalid;
-                            theReplSet->tryToGoLiveAsASecondary(minvalid);
-                        }
-
-                        // normally msgCheckNewState gets called periodically, but in a single node repl set
-                        // there are no heartbeat threads, so we do it here to be sure.  this is relevant if the
-                        // singleton member has done a stepDown() and needs to come back up.
-                        if (theReplSet->config().members.size() == 1 &&
-                            theReplSet->myConfig().potentiallyHot()) {
-                            theReplSet->mgr->send(boost::bind(&Manager::msgCheckNewState, theReplSet->mgr));
-                            sleepsecs(1);
-                            return;
-                        }
-
-                        count = 200;
+
+            if (theReplSet->isPrimary()) {
+                return;
+            }
+
+            OpQueue ops;
+            Timer batchTimer;
+            int lastTimeChecked = -1;
+
+            // tryPeekAndWaitForMore returns true when we need to end a batch early
+            while( !tryPeekAndWaitForMore(&ops) &&
+                   ops.getSize() < replBatchLimitBytes ) {
+
+                int now = batchTimer.seconds();
+
+                // apply replication batch limits
+                if( !ops.empty() ) {
+                    if( now > replBatchLimitSeconds )
+                        break;
+                    if( ops.getDeque().size() >= replBatchLimitOperations )
+                        break;
+                }
+
+                // occasionally check some things
+                if( ops.empty() || now > lastTimeChecked ) {
+                    lastTimeChecked = now;
+
+                    if (theReplSet->isPrimary()) {
+                        return;
                     }
 
-                    if( timeInWriteLock.micros() > 1000 ) {
-                        lk.reset();
-                        timeInWriteLock.reset();
+                    // can we become secondary?
+                    // we have to check this before calling mgr, as we must be a secondary to
+                    // become primary
+                    if (!theReplSet->isSecondary()) {
+                        OpTime minvalid;
+                        theReplSet->tryToGoLiveAsASecondary(minvalid);
                     }
 
-                    {
-                        const BSONObj *next = peek();
+                    // normally msgCheckNewState gets called periodically, but in a single node repl set
+                    // there are no heartbeat threads, so we do it here to be sure.  this is relevant if the
+                    // singleton member has done a stepDown() and needs to come back up.
+                    if (theReplSet->config().members.size() == 1 &&
+                        theReplSet->myConfig().potentiallyHot()) {
+                        theReplSet->mgr->send(boost::bind(&Manager::msgCheckNewState, theReplSet->mgr));
+                        sleepsecs(1);
+                        return;
+                    }
+                }
+            }
 
-                        if (next == NULL) {
-                            bool golive = false;
+            if( ops.empty() ) {
+                continue;
+            }
 
-                            if (!theReplSet->isSecondary()) {
-                                OpTime minvalid;
-                                golive = theReplSet->tryToGoLiveAsASecondary(minvalid);
-                            }
+            const BSONObj& lastOp = ops.getDeque().back();
+            handleSlaveDelay(lastOp);
 
-                            if (!golive) {
-                                lk.reset();
-                                timeInWriteLock.reset();
-                                sleepsecs(1);
-                            }
+            // set minValid to the last op of the batch.  if we crash before the whole batch is
+            // applied and in our oplog, we come back up RECOVERING and reapply it.
+            theReplSet->setMinValid(lastOp);
 
-                            break;
-                        }
-
-                        const BSONObj& o = *next;
-
-                        int sd = theReplSet->myConfig().slaveDelay;
-
-                        // ignore slaveDelay if the box is still initializing. once
-                        // it becomes secondary we can worry about it.
-                        if( sd && theReplSet->isSecondary() ) {
-                            const OpTime ts = o["ts"]._opTime();
-                            long long a = ts.getSecs();
-                            long long b = time(0);
-                            long long lag = b - a;
-                            long long sleeptime = sd - lag;
-                            if( sleeptime > 0 ) {
-                                lk.reset();
-                                uassert(12000, "rs slaveDelay differential too big check clocks and systems", sleeptime < 0x40000000);
-                                if( sleeptime < 60 ) {
-                                    sleepsecs((int) sleeptime);
-                                }
-                                else {
-                                    log() << "replSet slavedelay sleep long time: " << sleeptime << rsLog;
-                                    // sleep(hours) would prevent reconfigs from taking effect & such!
-                                    long long waitUntil = b + sleeptime;
-                                    while( 1 ) {
-                                        sleepsecs(6);
-                                        if( time(0) >= waitUntil )
-                                            break;
-
-                                        if( theReplSet->myConfig().slaveDelay != sd ) // reconf
-                                            break;
-                                    }
-                                }
-                            }
-                        } // endif slaveDelay
-
-                        const char *ns = o.getStringField("ns");
-                        if( ns ) {
-                            if ( strlen(ns) == 0 ) {
-                                // this is ugly
-                                // this is often a no-op
-                                // but can't be 100% sure
-                                lk.reset();
-                                verify( !Lock::isLocked() );
-                                lk.reset(0);
-                            }
-                            else if( str::contains(ns, ".$cmd") ) {
-                                // a command may need a global write lock. so we will conservatively go ahead and grab one here. suboptimal. :-(
-                                lk.reset();
-                                verify( !Lock::isLocked() );
-                                lk.reset(0);
-                            }
-                            else if( !Lock::isWriteLocked(ns) || Lock::isW() ) {
-                                // we don't relock on every single op to try to be faster. however if switching collections, we have to.
-                                // note here we must reset to 0 first to assure the old object is destructed before our new operator invocation.
-                                lk.reset();
-                                verify( !Lock::isLocked() );
-                                lk.reset(ns);
-                            }
-                        }
-
-                        try {
-                            /* if we have become primary, we dont' want to apply things from elsewhere
-                               anymore. assumePrimary is in the db lock so we are safe as long as
-                               we check after we locked above. */
-                            if( theReplSet->isPrimary() ) {
-                                log(0) << "replSet stopping syncTail we are now primary" << rsLog;
-                                return;
-                            }
-
-                            syncApply(o);
-                            _logOpObjRS(o);   // with repl sets we write the ops to our oplog too
-                            getDur().commitIfNeeded();
-
-                            // we don't want the catch to reference next after it's been freed
-                            next = NULL;
-                            consume();
-                        }
-                        catch (DBException& e) {
-                            sethbmsg(str::stream() << "syncTail: " << e.toString());
-                            if (next) {
-                                log() << "syncing: " << next->toString() << endl;
-                            }
-                            lk.reset();
-                            sleepsecs(30);
-                            return;
-                        }
-                    }
-                } // end while
-            } // end writelock scope
+            if( !multiApply(ops.getDeque()) ) {
+                // the failed batch is still at the head of the queue; back off and retry it
+                if( !theReplSet->isPrimary() ) {
+                    sleepsecs(30);
+                }
+                return;
+            }
         }
     }
 
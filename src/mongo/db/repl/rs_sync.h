@@ -16,10 +16,21 @@
 
 #pragma once
 
+#include <deque>
+#include <vector>
+
 #include "mongo/db/oplog.h"
 #include "mongo/db/client.h"
+#include "mongo/db/dur.h"
 
 namespace mongo {
+
+    /** the most ops applied while readers are blocked.  a batch bigger than this is applied
+        in consecutive slices, releasing ParallelBatchWriterMode between them, so a read on a
+        secondary waits for at most one slice and then sees the data as of the end of the last
+        slice applied.  0 applies a batch in one go.  setParameter replApplySliceOps */
+    extern unsigned replApplySliceOps;
+
 namespace replset {
 
     class BackgroundSyncInterface;
@@ -29,13 +40,90 @@ namespace replset {
      */
     class SyncTail : public Sync {
         BackgroundSyncInterface* _queue;
+        // the last op handed to the prefetcher
+        OpTime _prefetchedThrough;
+        // how many writers a batch is divided between
+        unsigned _writerThreads;
     public:
         virtual ~SyncTail();
         SyncTail(BackgroundSyncInterface *q);
+
+        /** apply a single op.  the caller must hold the appropriate write lock. */
         virtual bool syncApply(const BSONObj &o);
+
+        /** tail the queue, applying ops in batches on the writer pool.  ok to return, will be
+            re-called. */
         void oplogApplication();
         BSONObj* peek();
         void consume();
+
+        /** a batch of ops, peeked at but not yet consumed from the queue */
+        class OpQueue {
+        public:
+            OpQueue() : _size(0) {}
+            size_t getSize() const { return _size; }
+            std::deque<BSONObj>& getDeque() { return _deque; }
+            void push_back(const BSONObj& op) {
+                _deque.push_back(op);
+                _size += op.objsize();
+            }
+            bool empty() const { return _deque.empty(); }
+        private:
+            std::deque<BSONObj> _deque;
+            size_t _size;
+        };
+
+        /** divide batches between n writers, at most the writer pool's
+            ReplSetImpl::replWriterThreadCount, which is the default.  for benchmarks */
+        void setWriterThreads(unsigned n);
+
+        /** applies the ops of one writer's share of a batch, locking as it goes.  runs on a
+            writer pool thread.  @return false if an op threw. */
+        bool applyWriterOps(const std::vector<BSONObj>& ops);
+
+        // cap the batches using the limit on journal commits; no group commit can happen while
+        // a batch is being applied.
+        static const unsigned int replBatchLimitBytes = dur::UncommittedBytesLimit;
+        static const int replBatchLimitSeconds = 1;
+        static const unsigned int replBatchLimitOperations = 5000;
+
+    protected:
+        /** peeks the next op into ops.
+            @return true if the batch should be ended early: there is nothing more buffered, or
+                    the next op (a command or an index build) must be applied on its own. */
+        bool tryPeekAndWaitForMore(OpQueue* ops);
+
+        /** apply a batch of ops on the writer pool, then write them to our oplog, in slices of
+            replApplySliceOps ops so readers get in between slices.
+            @return false if any op failed to apply; the slice it was in, and the rest of the
+                    batch, are then left in the queue. */
+        bool multiApply(std::deque<BSONObj>& ops);
+
+        /** partition ops by namespace so ops on one collection stay ordered on one writer */
+        void fillWriterVectors(const std::deque<BSONObj>& ops,
+                               std::vector< std::vector<BSONObj> >* writerVectors);
+
+    private:
+        /** waits for the look-ahead started during the previous batch, then pages in whatever
+            part of this batch it didn't get to */
+        void prefetchOps(const std::deque<BSONObj>& ops);
+
+        /** starts paging in the buffered ops that follow the first batchSize ops, without
+            waiting for it to finish.  see replPrefetchDepth */
+        void prefetchAhead(size_t batchSize);
+
+        /** hand out the writer vectors to the writer pool and wait for them all to finish */
+        bool applyOps(const std::vector< std::vector<BSONObj> >& writerVectors);
+
+        /** apply one slice of a batch with all readers blocked, and log it.  sets bufferReset
+            if the queue was reset while it was applied. */
+        bool applySlice(std::deque<BSONObj>* ops, bool* bufferReset);
+
+        /** write the ops of an applied batch to our oplog and remove them from the queue.
+            @return false if the queue was reset while they were applied */
+        bool applyOpsToOplog(std::deque<BSONObj>* ops);
+
+        void handleSlaveDelay(const BSONObj& lastOp);
     };
 
     /**
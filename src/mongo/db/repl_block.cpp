@@ -59,7 +59,7 @@ namespace mongo {
             BSONObj obj;
         };
 
-        SlaveTracking() : _mutex("SlaveTracking") {
+        SlaveTracking() : _waitersMutex("SlaveTrackingWaiters"), _mutex("SlaveTracking") {
             _dirty = false;
             _started = false;
             _currentlyUpdatingCache = false;
@@ -119,23 +119,58 @@ namespace mongo {
 
             Ident ident(rid,host,ns);
 
-            scoped_lock mylk(_mutex);
+            {
+                scoped_lock mylk(_mutex);
 
-            _slaves[ident] = last;
-            _dirty = true;
+                _slaves[ident] = last;
+                _dirty = true;
 
-            if (theReplSet && theReplSet->isPrimary()) {
-                theReplSet->ghost->updateSlave(ident.obj["_id"].OID(), last);
-            }
+                if (theReplSet && theReplSet->isPrimary()) {
+                    theReplSet->ghost->updateSlave(ident.obj["_id"].OID(), last);
+                }
 
-            if ( ! _started ) {
-                // start background thread here since we definitely need it
-                _started = true;
-                go();
+                if ( ! _started ) {
+                    // start background thread here since we definitely need it
+                    _started = true;
+                    go();
+                }
             }
 
+            wake( last );
+        }
+
+        /** wakes the waiters for optimes up to last, which some member now has */
+        void wake( const OpTime& last ) {
+            scoped_lock lk( _waitersMutex );
+            multimap<OpTime,Waiter*>::iterator end = _waiters.upper_bound( last );
+            for ( multimap<OpTime,Waiter*>::iterator i = _waiters.begin(); i != end; ++i )
+                i->second->cond.notify_one();
         }
 
+        template< class W >
+        bool awaitReplication( OpTime op , const W& w , int millis ) {
+            Timer t;
+            Waiter me;
+            scoped_lock lk( _waitersMutex );
+            multimap<OpTime,Waiter*>::iterator pos = _waiters.insert( make_pair( op , &me ) );
+            bool enough;
+            try {
+                // checked under _waitersMutex, so progress reported meanwhile wakes us
+                while ( ! ( enough = replicatedEnough( op , w ) ) && t.millis() < millis ) {
+                    me.cond.timed_wait( lk.boost() , boost::posix_time::milliseconds( millis - t.millis() ) );
+                }
+            }
+            catch ( ... ) {
+                _waiters.erase( pos );
+                throw;
+            }
+            _waiters.erase( pos );
+            return enough;
+        }
+
+        bool replicatedEnough( OpTime op , BSONElement w ) { return opReplicatedEnough( op , w ); }
+        bool replicatedEnough( OpTime op , int w ) { return replicatedToNum( op , w ); }
+
         bool opReplicatedEnough( OpTime op , BSONElement w ) {
             RARELY {
                 REPLDEBUG( "looking for : " << op << " w=" << w );
@@ -188,6 +223,15 @@ namespace mongo {
             return _slaves.size();
         }
 
+        struct Waiter {
+            boost::condition cond;
+        };
+
+        // waiters for w, by the optime they wait for.  may be held while taking _mutex, not
+        // the other way around
+        mongo::mutex _waitersMutex;
+        multimap<OpTime,Waiter*> _waiters;
+
         // need to be careful not to deadlock with this
         mutable mongo::mutex _mutex;
         map<Ident,OpTime> _slaves;
@@ -229,6 +273,14 @@ namespace mongo {
         return slaveTracking.replicatedToNum( op , w );
     }
 
+    bool awaitReplication( OpTime op , BSONElement w , int millis ) {
+        return slaveTracking.awaitReplication( op , w , millis );
+    }
+
+    bool awaitReplication( OpTime op , int w , int millis ) {
+        return slaveTracking.awaitReplication( op , w , millis );
+    }
+
     void resetSlaveCache() {
         slaveTracking.reset();
     }
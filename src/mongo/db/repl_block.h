@@ -34,6 +34,14 @@ namespace mongo {
     bool opReplicatedEnough( OpTime op , int w );
     bool opReplicatedEnough( OpTime op , BSONElement w );
 
+    /**
+     * Waits up to millis for opReplicatedEnough( op , w ).  Rather than polling, a waiter is
+     * queued by op and woken when a slave reports reaching it.
+     * @return opReplicatedEnough( op , w ) at the end of the wait
+     */
+    bool awaitReplication( OpTime op , BSONElement w , int millis );
+    bool awaitReplication( OpTime op , int w , int millis );
+
     void resetSlaveCache();
     unsigned getSlaveCount();
 }
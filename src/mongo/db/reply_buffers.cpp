@@ -0,0 +1,123 @@
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+
+#include "mongo/db/reply_buffers.h"
+
+#include "mongo/db/client.h"
+#include "mongo/db/curop.h"
+#include "mongo/db/jsobj.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/util/concurrency/threadlocal.h"
+#include "mongo/util/net/message.h"
+
+namespace mongo {
+
+    static AtomicInt64 pooledBytes;
+    static AtomicUInt64 reused;
+    static AtomicUInt64 allocated;
+    static AtomicUInt64 kept;
+
+    struct ThreadReplyBuffers {
+        ThreadReplyBuffers() : keptBuf(0), keptSize(0), sentBuf(0), sentSize(0), sentOp(0) { }
+        ~ThreadReplyBuffers() {
+            if ( keptBuf ) {
+                free( keptBuf );
+                pooledBytes.fetchAndSubtract( keptSize );
+            }
+        }
+
+        char *keptBuf;
+        int keptSize;
+
+        // the reply being sent, and the operation which built it: a nested operation's reply
+        // may have been freed since, and its address reused
+        const char *sentBuf;
+        int sentSize;
+        unsigned sentOp;
+    };
+
+    TSP_DECLARE(ThreadReplyBuffers, threadReplyBuffers)
+    TSP_DEFINE(ThreadReplyBuffers, threadReplyBuffers)
+
+    void ReplyBuffers::reserve( BufBuilder &b, int size ) {
+        ThreadReplyBuffers *t = threadReplyBuffers.getMake();
+        if ( t->keptBuf && t->keptSize >= size ) {
+            char *buf = t->keptBuf;
+            int bufSize = t->keptSize;
+            t->keptBuf = 0;
+            t->keptSize = 0;
+            pooledBytes.fetchAndSubtract( bufSize );
+            reused.fetchAndAdd( 1 );
+            b.adopt( buf, bufSize );
+            return;
+        }
+        char *buf = (char *) malloc( size );
+        if ( buf == 0 )
+            msgasserted( 16348, "out of memory ReplyBuffers::reserve" );
+        allocated.fetchAndAdd( 1 );
+        b.adopt( buf, size );
+    }
+
+    void ReplyBuffers::sending( const BufBuilder &b ) {
+        ThreadReplyBuffers *t = threadReplyBuffers.getMake();
+        t->sentBuf = b.buf();
+        t->sentSize = b.getSize();
+        t->sentOp = cc().curop()->opNum();
+    }
+
+    void ReplyBuffers::recycle( Message &m ) {
+        ThreadReplyBuffers *t = threadReplyBuffers.get();
+        if ( t == 0 || t->sentBuf == 0 )
+            return;
+        const char *sent = t->sentBuf;
+        int size = t->sentSize;
+        t->sentBuf = 0;
+
+        if ( m.empty() || reinterpret_cast<const char *>( m.header() ) != sent ||
+             t->sentOp != cc().curop()->opNum() || m.header()->len > size )
+            return;
+        if ( size < MinPooled )
+            return;
+        if ( size <= t->keptSize )
+            return; // already keeping one at least as big
+
+        long long reservedSize = size - t->keptSize;
+        if ( pooledBytes.addAndFetch( reservedSize ) > MaxPooledBytes ) {
+            pooledBytes.fetchAndSubtract( reservedSize );
+            return;
+        }
+        MsgData *d = m.releaseSingleData();
+        if ( d == 0 ) {
+            pooledBytes.fetchAndSubtract( reservedSize );
+            return;
+        }
+        if ( t->keptBuf )
+            free( t->keptBuf );
+        t->keptBuf = reinterpret_cast<char *>( d );
+        t->keptSize = size;
+        kept.fetchAndAdd( 1 );
+    }
+
+    void ReplyBuffers::appendStats( BSONObjBuilder &b ) {
+        b.appendNumber( "pooledBytes" , pooledBytes.load() );
+        b.appendNumber( "reused" , (long long) reused.load() );
+        b.appendNumber( "allocated" , (long long) allocated.load() );
+        b.appendNumber( "kept" , (long long) kept.load() );
+    }
+
+} // namespace mongo
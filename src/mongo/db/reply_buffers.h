@@ -0,0 +1,62 @@
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "mongo/bson/util/builder.h"
+
+namespace mongo {
+
+    class BSONObjBuilder;
+    class Message;
+
+    /**
+     * Reuses the buffers of query and getMore replies, which run to several megabytes for
+     * large batches, instead of mallocing and freeing one per reply.
+     *
+     * Each connection thread keeps the buffer of its last reply once it is sent, and hands it
+     * to the next reply builder which asks for one:
+     *
+     *   BufBuilder b( 0 );
+     *   ReplyBuffers::reserve( b, size );   // the kept buffer if it is big enough
+     *   ... build the reply ...
+     *   ReplyBuffers::sending( b );         // then decouple() into the Message
+     *   ... once MessagingPort::reply() returns ...
+     *   ReplyBuffers::recycle( message );
+     *
+     * Only buffers of at least MinPooled bytes are kept, and no more than MaxPooledBytes over
+     * all threads, so idle connections don't pin much memory.
+     */
+    class ReplyBuffers {
+    public:
+        enum { MinPooled = 64 * 1024, MaxPooledBytes = 128 * 1024 * 1024 };
+
+        /** gives b an empty buffer of at least size bytes, reusing this thread's kept one */
+        static void reserve( BufBuilder &b, int size );
+
+        /** notes that b's buffer is about to be decoupled into a reply Message */
+        static void sending( const BufBuilder &b );
+
+        /**
+         * called once m has been sent: takes back the buffer noted by sending(), if m holds it,
+         * to keep for the next reply.  otherwise m frees its buffers as usual.
+         */
+        static void recycle( Message &m );
+
+        static void appendStats( BSONObjBuilder &b );
+    };
+
+} // namespace mongo
@@ -85,7 +85,7 @@ namespace mongo {
 
             bool html = false;
 
-            stringstream ss;
+            StringBuilder ss;
 
             if ( method == "GET" ) {
                 responseCode = 200;
@@ -110,7 +110,7 @@ namespace mongo {
             responseMsg = ss.str();
         }
 
-        bool handleRESTQuery( string ns , string action , BSONObj & params , int & responseCode , stringstream & out ) {
+        bool handleRESTQuery( string ns , string action , BSONObj & params , int & responseCode , StringBuilder & out ) {
             Timer t;
 
             int html = _getOption( params["html"] , 0 );
@@ -152,7 +152,8 @@ namespace mongo {
             if ( one ) {
                 if ( cursor->more() ) {
                     BSONObj obj = cursor->next();
-                    out << obj.jsonString(Strict,html?1:0) << '\n';
+                    obj.jsonString( out, Strict, html?1:0 );
+                    out << '\n';
                 }
                 else {
                     responseCode = 404;
@@ -178,16 +179,18 @@ namespace mongo {
                     out << " ,\n";
                 BSONObj obj = cursor->next();
                 if( html ) {
-                    if( out.tellp() > 4 * 1024 * 1024 ) {
+                    if( out.len() > 4 * 1024 * 1024 ) {
                         out << "Stopping output: more than 4MB returned and in html mode\n";
                         break;
                     }
-                    out << obj.jsonString(Strict, html?1:0) << "\n\n";
+                    obj.jsonString( out, Strict, 1 );
+                    out << "\n\n";
                 }
                 else {
-                    if( out.tellp() > 50 * 1024 * 1024 ) // 50MB limit - we are using ram
+                    if( out.len() > 50 * 1024 * 1024 ) // 50MB limit - we are using ram
                         break;
-                    out << "    " << obj.jsonString();
+                    out << "    ";
+                    obj.jsonString( out );
                 }
             }
 
@@ -199,7 +202,9 @@ namespace mongo {
             else {
                 out << "\n  ],\n\n";
                 out << "  \"total_rows\" : " << howMany << " ,\n";
-                out << "  \"query\" : " << query.jsonString() << " ,\n";
+                out << "  \"query\" : ";
+                query.jsonString( out );
+                out << " ,\n";
                 out << "  \"millis\" : " << t.millis() << '\n';
                 out << "}\n";
             }
@@ -208,7 +213,7 @@ namespace mongo {
         }
 
         // TODO Generate id and revision per couch POST spec
-        void handlePost( string ns, const char *body, BSONObj& params, int & responseCode, stringstream & out ) {
+        void handlePost( string ns, const char *body, BSONObj& params, int & responseCode, StringBuilder & out ) {
             try {
                 BSONObj obj = fromjson( body );
                 db.insert( ns.c_str(), obj );
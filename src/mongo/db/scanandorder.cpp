@@ -20,11 +20,54 @@
 
 #include "pch.h"
 #include "scanandorder.h"
+#include "extsort.h"
 
 namespace mongo {
 
     const unsigned ScanAndOrder::MaxScanAndOrderBytes = 32 * 1024 * 1024;
 
+    /**
+     * the external sort a ScanAndOrder spilled to.  each entry is the sort key's elements followed
+     * by the document, so documents with equal keys still compare, and come back as a whole.
+     */
+    class ScanAndOrder::Spilled : boost::noncopyable {
+    public:
+        Spilled( const BSONObj& order, unsigned runBytes ) :
+            _sorter( *IndexDetails::iis[1], order, runBytes ), _left( 0 ) {
+            _sorter.hintNumObjects( 100000 );
+        }
+
+        void add( const BSONObj& k, const BSONObj& o ) {
+            BSONObjBuilder b( k.objsize() + o.objsize() + 16 );
+            b.appendElements( k );
+            b.append( "", o );
+            _sorter.add( b.obj(), DiskLoc() );
+        }
+
+        /** the next document in order, or an empty object once there are no more */
+        BSONObj next() {
+            if ( ! _it.get() ) {
+                _sorter.sort();
+                _it = _sorter.iterator();
+            }
+            if ( ! _it->more() )
+                return BSONObj();
+            BSONObjIterator i( _it->next().first );
+            BSONElement e;
+            while ( i.more() )
+                e = i.next();
+            return e.Obj();
+        }
+
+        int left() const { return _left; }
+        void setLeft( int left ) { _left = left; }
+
+    private:
+        BSONObjExternalSorter _sorter;
+        auto_ptr<BSONObjExternalSorter::Iterator> _it;
+        int _left; // how many more fill() left for remaining()
+    };
+
     void ScanAndOrder::add(const BSONObj& o, const DiskLoc* loc) {
         verify( o.isValid() );
         BSONObj k;
@@ -43,7 +86,7 @@ namespace mongo {
         if ( k.isEmpty() ) {
             return;   
         }
-        if ( (int) _best.size() < _limit ) {
+        if ( _spilled || (int) _best.size() < _limit ) {
             _add(k, o, loc);
             return;
         }
@@ -56,6 +99,24 @@ namespace mongo {
 
 
     void ScanAndOrder::fill(BufBuilder& b, const Projection *filter, int& nout ) const {
+        if ( _spilled ) {
+            // _limit counts the skipped ones too
+            int want = _limit == 0x7fffffff ? _limit : _limit - _startFrom;
+            for ( int i = 0; i < _startFrom && ! _spilled->next().isEmpty(); i++ )
+                ;
+            int nFilled = 0;
+            while ( nFilled < want && b.len() <= MaxBytesToReturnToClientAtOnce ) {
+                BSONObj o = _spilled->next();
+                if ( o.isEmpty() )
+                    break;
+                fillQueryResultFromObj(b, filter, o);
+                nFilled++;
+            }
+            _spilled->setLeft( want - nFilled );
+            nout = nFilled;
+            return;
+        }
+
         int n = 0;
         int nFilled = 0;
         for ( BestMap::const_iterator i = _best.begin(); i != _best.end(); i++ ) {
@@ -79,9 +140,36 @@ namespace mongo {
             b.append("$diskLoc", loc->toBSONObj());
             docToReturn = b.obj();
         }
-        _validateAndUpdateApproxSize( k.objsize() + docToReturn.objsize() );
+        int size = k.objsize() + docToReturn.objsize();
+        if ( ! _spilled && _spillAllowed && _approxSize + size >= _maxBytes )
+            _spill();
+        if ( _spilled ) {
+            _spilled->add( k, docToReturn );
+            return;
+        }
+        _validateAndUpdateApproxSize( size );
         _best.insert(make_pair(k.getOwned(),docToReturn.getOwned()));
     }
+
+    void ScanAndOrder::_spill() {
+        LOG(1) << "scanAndOrder: " << _best.size() << " documents, " << _approxSize
+               << " bytes, going to an external sort" << endl;
+        // runs of half the budget, as the sorter's write buffer takes about as much again
+        _spilled.reset( new Spilled( _order._spec.keyPattern, std::max( _maxBytes / 2, 1024U * 1024 ) ) );
+        for ( BestMap::const_iterator i = _best.begin(); i != _best.end(); ++i )
+            _spilled->add( i->first, i->second );
+        _best.clear();
+        _approxSize = 0;
+    }
+
+    shared_ptr<Cursor> ScanAndOrder::remaining() const {
+        if ( ! _spilled || _spilled->left() <= 0 )
+            return shared_ptr<Cursor>();
+        shared_ptr<Cursor> c( new ScanAndOrderCursor( _spilled, _spilled->left() ) );
+        if ( ! c->ok() )
+            return shared_ptr<Cursor>();
+        return c;
+    }
     
     void ScanAndOrder::_addIfBetter(const BSONObj& k, const BSONObj& o, const BestMap::iterator& i,
                                     const DiskLoc* loc) {
@@ -101,8 +189,24 @@ namespace mongo {
         verify( newApproxSize >= 0 );
         uassert( ScanAndOrderMemoryLimitExceededAssertionCode,
                 "too much data for sort() with no index.  add an index or specify a smaller limit",
-                (unsigned)newApproxSize < MaxScanAndOrderBytes );
+                (unsigned)newApproxSize < _maxBytes );
         _approxSize = newApproxSize;
     }
 
+    ScanAndOrderCursor::ScanAndOrderCursor( const shared_ptr<ScanAndOrder::Spilled>& spilled,
+                                            int left ) :
+        _spilled( spilled ), _left( left ) {
+        advance();
+    }
+
+    bool ScanAndOrderCursor::advance() {
+        if ( _left <= 0 ) {
+            _obj = BSONObj();
+            return false;
+        }
+        _left--;
+        _obj = _spilled->next();
+        return ok();
+    }
+
 } // namespace mongo
@@ -20,6 +20,7 @@
 
 #pragma once
 
+#include "cursor.h"
 #include "indexkey.h"
 #include "queryutil.h"
 #include "projection.h"
@@ -77,24 +78,39 @@ namespace mongo {
     public:
         static const unsigned MaxScanAndOrderBytes;
 
-        ScanAndOrder(int startFrom, int limit, const BSONObj &order, const FieldRangeSet &frs) :
+        /**
+         * @param maxBytes the memory the results may take, at most and by default MaxScanAndOrderBytes
+         * @param spill past maxBytes, sort externally on disk rather than fail
+         */
+        ScanAndOrder(int startFrom, int limit, const BSONObj &order, const FieldRangeSet &frs,
+                     unsigned maxBytes = 0, bool spill = false) :
             _best( BSONObjCmp( order ) ),
-            _startFrom(startFrom), _order(order, frs) {
+            _startFrom(startFrom), _order(order, frs),
+            _maxBytes( maxBytes && maxBytes < MaxScanAndOrderBytes ? maxBytes : MaxScanAndOrderBytes ), _spillAllowed( spill ) {
             _limit = limit > 0 ? limit + _startFrom : 0x7fffffff;
             _approxSize = 0;
         }
 
         int size() const { return _best.size(); }
 
+        /** true once the results have gone to an external sort */
+        bool spilled() const { return _spilled.get() != 0; }
+
         /**
          * @throw ScanAndOrderMemoryLimitExceededAssertionCode if adding would grow memory usage
-         * to ScanAndOrder::MaxScanAndOrderBytes.
+         * to the limit, and spilling isn't allowed.
          */
         void add(const BSONObj &o, const DiskLoc* loc);
 
-        /* scanning complete. stick the query result in b for n objects. */
+        /**
+         * scanning complete. stick the query result in b for n objects.  spilled results stop at
+         * MaxBytesToReturnToClientAtOnce, and the rest come from remaining().
+         */
         void fill(BufBuilder& b, const Projection *filter, int& nout ) const;
 
+        /** after fill(), the spilled results it had no room for, or null */
+        shared_ptr<Cursor> remaining() const;
+
     /** Functions for testing. */
     protected:
 
@@ -113,12 +129,47 @@ namespace mongo {
          */
         void _validateAndUpdateApproxSize( const int approxSizeDelta );
 
+        /** moves _best to an external sort, which takes every document from then on */
+        void _spill();
+        void _addSpilled(const BSONObj& k, const BSONObj& o);
+
         BestMap _best; // key -> full object
         int _startFrom;
         int _limit;   // max to send back.
         KeyType _order;
         unsigned _approxSize;
+        const unsigned _maxBytes;
+        const bool _spillAllowed;
+
+        class Spilled;
+        friend class ScanAndOrderCursor;
+        shared_ptr<Spilled> _spilled; // once _best has gone to disk
+    };
 
+    /**
+     * the results of a spilled ScanAndOrder after its first batch, for getMore.  they are copies,
+     * so don't depend on the collection: the cursor doesn't yield, nor has a location to relocate.
+     */
+    class ScanAndOrderCursor : public Cursor {
+    public:
+        ScanAndOrderCursor( const shared_ptr<ScanAndOrder::Spilled>& spilled, int left );
+        virtual bool ok() { return ! _obj.isEmpty(); }
+        virtual Record* _current() { return 0; }
+        virtual BSONObj current() { return _obj; }
+        virtual DiskLoc currLoc() { return DiskLoc(); }
+        virtual bool advance();
+        virtual DiskLoc refLoc() { return DiskLoc(); }
+        virtual bool supportGetMore() { return true; }
+        virtual bool supportYields() { return false; }
+        virtual string toString() { return "ScanAndOrderCursor"; }
+        virtual bool getsetdup(DiskLoc loc) { return false; }
+        virtual bool isMultiKey() const { return false; }
+        virtual bool modifiedKeys() const { return true; }
+        virtual long long nscanned() { return 0; }
+    private:
+        shared_ptr<ScanAndOrder::Spilled> _spilled;
+        int _left;
+        BSONObj _obj;
     };
 
 } // namespace mongo
@@ -34,14 +34,18 @@ namespace mongo {
     void AuthenticationInfo::setTemporaryAuthorization( BSONObj& obj ) {
         fassert( 16232, !_usingTempAuth );
         scoped_spinlock lk( _lock );
-        _tempAuthTable.setFromBSON( obj );
+        if ( !obj.binaryEqual( _tempAuthObj ) ) {
+            _tempAuthTable.setFromBSON( obj );
+            _tempAuthObj = obj.getOwned();
+            ++_tempAuthGeneration;
+        }
         _usingTempAuth = true;
     }
 
     void AuthenticationInfo::clearTemporaryAuthorization() {
         scoped_spinlock lk( _lock );
+        // _tempAuthTable is kept for the next request, which most likely sends the same
         _usingTempAuth = false;
-        _tempAuthTable.clearAuth();
     }
 
     string AuthenticationInfo::getUser( const string& dbname ) const {
@@ -41,6 +41,9 @@ namespace mongo {
             _isLocalHost = false; 
             _isLocalHostAndLocalHostIsAuthorizedForAll = false;
             _usingTempAuth = false;
+            _authGeneration = 1;
+            _tempAuthGeneration = 1;
+            _nextResolved = 0;
         }
         ~AuthenticationInfo() {}
         bool isLocalHost() const { return _isLocalHost; } // why are you calling this? makes no sense to be externalized
@@ -50,14 +53,17 @@ namespace mongo {
         void logout(const std::string& dbname ) {
             scoped_spinlock lk(_lock);
             _authTable.removeAuth( dbname );
+            ++_authGeneration;
         }
         void authorize(const std::string& dbname , const std::string& user ) {
             scoped_spinlock lk(_lock);
             _authTable.addAuth( dbname, user, Auth::WRITE );
+            ++_authGeneration;
         }
         void authorizeReadOnly(const std::string& dbname , const std::string& user ) {
             scoped_spinlock lk(_lock);
             _authTable.addAuth( dbname, user, Auth::READ );
+            ++_authGeneration;
         }
         
         // -- accessors ---
@@ -93,11 +99,14 @@ namespace mongo {
     private:
         void _checkLocalHostSpecialAdmin();
 
-        /** takes a lock */
+        /** takes a lock only when the level for dbname isn't already resolved */
         bool _isAuthorized(const std::string& dbname, Auth::Level level) const;
 
+        /** @return the level the table in use gives dbname, directly or through admin or local */
+        Auth::Level _resolvedLevel(const std::string& dbname) const;
+
         // Must be in _lock
-        bool _isAuthorizedSingle_inlock(const std::string& dbname, Auth::Level level) const;
+        Auth::Level _levelSingle_inlock(const std::string& dbname) const;
         
         /** cannot call this locked */
         bool _isAuthorizedSpecialChecks( const std::string& dbname ) const ;
@@ -118,7 +127,34 @@ namespace mongo {
         AuthenticationTable _tempAuthTable;
 
         bool _usingTempAuth;
+        // what _tempAuthTable was last set from, so the same auth sent again by mongos with each
+        // request leaves the table, and the levels resolved from it, as they are
+        BSONObj _tempAuthObj;
+
+        // bumped under _lock by each change to _authTable or _tempAuthTable
+        unsigned _authGeneration;
+        unsigned _tempAuthGeneration;
+
+        /**
+         * levels recently resolved by _isAuthorized(), good while the generation of the table
+         * they came from is unchanged.  only the connection's own thread checks authorization
+         * and changes the tables, so these are used without _lock.
+         */
+        struct ResolvedAuth {
+            ResolvedAuth() : level( Auth::NONE ), temp( false ), generation( 0 ) {}
+            std::string dbname;
+            Auth::Level level;
+            bool temp;
+            unsigned generation;
+        };
+        enum { ResolvedAuthSlots = 4 };
+        mutable ResolvedAuth _resolved[ ResolvedAuthSlots ];
+        mutable unsigned _nextResolved;
+
         static bool _warned;
     };
 
+    /** from getnonce, for this connection's next authenticate */
+    extern boost::thread_specific_ptr<nonce64> lastNonce;
+
 } // namespace mongo
@@ -130,24 +130,40 @@ namespace mongo {
         if ( noauth ) {
             return true;
         }
-        {
-            scoped_spinlock lk(_lock);
-
-            if ( _isAuthorizedSingle_inlock( dbname , level ) )
-                return true;
+        if ( _resolvedLevel( dbname ) >= level )
+            return true;
+        return _isAuthorizedSpecialChecks( dbname );
+    }
 
-            if ( _isAuthorizedSingle_inlock( "admin" , level ) )
-                return true;
+    Auth::Level AuthenticationInfo::_resolvedLevel(const string& dbname) const {
+        const bool temp = _usingTempAuth;
+        unsigned generation = temp ? _tempAuthGeneration : _authGeneration;
+        for ( int i = 0; i < ResolvedAuthSlots; i++ ) {
+            const ResolvedAuth& r = _resolved[i];
+            if ( r.generation == generation && r.temp == temp && r.dbname == dbname )
+                return r.level;
+        }
 
-            if ( _isAuthorizedSingle_inlock( "local" , level ) )
-                return true;
+        Auth::Level level;
+        {
+            scoped_spinlock lk(_lock);
+            generation = temp ? _tempAuthGeneration : _authGeneration;
+            level = std::max( _levelSingle_inlock( dbname ),
+                              std::max( _levelSingle_inlock( "admin" ),
+                                        _levelSingle_inlock( "local" ) ) );
         }
-        return _isAuthorizedSpecialChecks( dbname );
+
+        ResolvedAuth& r = _resolved[ _nextResolved++ % ResolvedAuthSlots ];
+        r.dbname = dbname;
+        r.level = level;
+        r.temp = temp;
+        r.generation = generation;
+        return level;
     }
 
-    bool AuthenticationInfo::_isAuthorizedSingle_inlock(const string& dbname, Auth::Level level) const {
+    Auth::Level AuthenticationInfo::_levelSingle_inlock(const string& dbname) const {
         const AuthenticationTable& authTable = _usingTempAuth ? _tempAuthTable : _authTable;
-        return authTable.getAuthForDb( dbname ).level >= level;
+        return authTable.getLevelForDb( dbname );
     }
 
 } // namespace mongo
@@ -19,8 +19,27 @@
 #include "pch.h"
 #include "../jsobj.h"
 #include "counters.h"
+#include "../../util/concurrency/threadlocal.h"
+#include "../../util/net/message_port.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/util/histogram.h"
 
 namespace mongo {
+
+    TSP_DECLARE(unsigned, statsShardNumber)
+    TSP_DEFINE(unsigned, statsShardNumber)
+
+    static AtomicUInt32 nextStatsShard;
+
+    unsigned statsShard() {
+        unsigned *s = statsShardNumber.get();
+        if ( s == 0 ) {
+            s = new unsigned( nextStatsShard.fetchAndAdd(1) % NStatsShards );
+            statsShardNumber.reset( s );
+        }
+        return *s;
+    }
+
     OpCounters::OpCounters() {}
 
     void OpCounters::gotOp( int op , bool isCommand ) {
@@ -46,33 +65,46 @@ namespace mongo {
 
     BSONObj OpCounters::getObj() {
         const unsigned MAX = 1 << 30;
+        unsigned insert = 0, query = 0, update = 0, del = 0, getmore = 0, command = 0;
+        for ( unsigned i = 0; i < NStatsShards; i++ ) {
+            const Shard& s = _shards[i];
+            insert += s.insert.get();
+            query += s.query.get();
+            update += s.update.get();
+            del += s.del.get();
+            getmore += s.getmore.get();
+            command += s.command.get();
+        }
         RARELY {
             bool wrap =
-            _insert.get() > MAX ||
-            _query.get() > MAX ||
-            _update.get() > MAX ||
-            _delete.get() > MAX ||
-            _getmore.get() > MAX ||
-            _command.get() > MAX;
+            insert > MAX ||
+            query > MAX ||
+            update > MAX ||
+            del > MAX ||
+            getmore > MAX ||
+            command > MAX;
 
             if ( wrap ) {
-                _insert.zero();
-                _query.zero();
-                _update.zero();
-                _delete.zero();
-                _getmore.zero();
-                _command.zero();
+                for ( unsigned i = 0; i < NStatsShards; i++ ) {
+                    Shard& s = _shards[i];
+                    s.insert.zero();
+                    s.query.zero();
+                    s.update.zero();
+                    s.del.zero();
+                    s.getmore.zero();
+                    s.command.zero();
+                }
             }
 
         }
         BSONObjBuilder b;
         {
-            b.append( "insert" , _insert.get() );
-            b.append( "query" , _query.get() );
-            b.append( "update" , _update.get() );
-            b.append( "delete" , _delete.get() );
-            b.append( "getmore" , _getmore.get() );
-            b.append( "command" , _command.get() );
+            b.append( "insert" , insert );
+            b.append( "query" , query );
+            b.append( "update" , update );
+            b.append( "delete" , del );
+            b.append( "getmore" , getmore );
+            b.append( "command" , command );
         }
         return b.obj();
     }
@@ -118,6 +150,10 @@ namespace mongo {
         : _total_time(0)
         , _flushes(0)
         , _last()
+        , _passBytes(0)
+        , _passFlushedBytes(0)
+        , _throttledBytes(0)
+        , _latencies(newMicrosHistogram())
     {}
 
     void FlushCounters::flushed(int ms) {
@@ -125,6 +161,17 @@ namespace mongo {
         _total_time += ms;
         _last_time = ms;
         _last = jsTime();
+        _latencies->insert( microsBucketValue( ms * 1000ULL ) );
+    }
+
+    void FlushCounters::passStarted(unsigned long long bytes) {
+        _passBytes = bytes;
+        _passFlushedBytes = 0;
+    }
+
+    void FlushCounters::flushedSome(unsigned long long bytes) {
+        _passFlushedBytes += bytes;
+        _throttledBytes += bytes;
     }
 
     void FlushCounters::append( BSONObjBuilder& b ) {
@@ -133,6 +180,15 @@ namespace mongo {
         b.appendNumber( "average_ms" , (_flushes ? (_total_time / double(_flushes)) : 0.0) );
         b.appendNumber( "last_ms" , _last_time );
         b.append("last_finished", _last);
+        b.append( "latencies" , histogramReport( *_latencies ) );
+        if( _throttledBytes || _passBytes ) {
+            BSONObjBuilder t( b.subobjStart( "throttled" ) );
+            t.append( "passMB" , _passBytes / 1000000.0 );
+            t.append( "passFlushedMB" , _passFlushedBytes / 1000000.0 );
+            t.append( "backlogMB" , ( _passBytes - _passFlushedBytes ) / 1000000.0 );
+            t.append( "totalFlushedMB" , _throttledBytes / 1000000.0 );
+            t.done();
+        }
     }
 
 
@@ -182,13 +238,84 @@ namespace mongo {
         b.appendNumber( "bytesOut" , _bytesOut );
         b.appendNumber( "numRequests" , _requests );
         _lock.unlock();
+
+        BSONObjBuilder c( b.subobjStart( "compression" ) );
+        MessagingPort::appendCompressionStats( c );
+        c.done();
     }
 
 
+    const char * const opKindNames[NOpKinds] =
+        { "query", "getmore", "insert", "update", "remove", "command", "other" };
+
+    OpKind opKind( int op , const char *ns ) {
+        switch ( op ) {
+        case dbQuery: return ns && strstr( ns, ".$cmd" ) ? OpCommand : OpQuery;
+        case dbGetMore: return OpGetMore;
+        case dbInsert: return OpInsert;
+        case dbUpdate: return OpUpdate;
+        case dbDelete: return OpRemove;
+        default: return OpOther;
+        }
+    }
+
+    Histogram* newMicrosHistogram() {
+        Histogram::Options opts;
+        opts.numBuckets = 24;
+        opts.bucketSize = 1;
+        opts.initialValue = 0;
+        opts.exponential = true;
+        return new Histogram( opts );
+    }
+
+    uint32_t microsBucketValue( unsigned long long micros ) {
+        return micros > 0xffffffffULL ? 0xffffffff : static_cast<uint32_t>( micros );
+    }
+
+    BSONObj histogramReport( const Histogram& h ) {
+        BSONObjBuilder b;
+        uint32_t n = h.getBucketsNum();
+        for ( uint32_t i = 0; i < n; i++ ) {
+            uint64_t c = h.getCount( i );
+            if ( c == 0 )
+                continue;
+            if ( i == n - 1 )
+                b.appendNumber( "more", (long long) c );
+            else
+                b.appendNumber( BSONObjBuilder::numStr( (int) h.getBoundary( i ) ), (long long) c );
+        }
+        return b.obj();
+    }
+
+    OpLatencyCounters::OpLatencyCounters() {
+        for ( int k = 0; k < NOpKinds; k++ )
+            for ( int p = 0; p < NPhases; p++ )
+                _h[k][p] = newMicrosHistogram();
+    }
+
+    void OpLatencyCounters::record( OpKind k , const unsigned long long micros[NPhases] ) {
+        for ( int p = 0; p < NPhases; p++ )
+            _h[k][p]->insert( microsBucketValue( micros[p] ) );
+        _count[k].fetchAndAdd( 1 );
+    }
+
+    void OpLatencyCounters::append( BSONObjBuilder& b ) {
+        static const char * const phaseNames[NPhases] =
+            { "queue", "receive", "lockWait", "execute", "write", "total" };
+        for ( int k = 0; k < NOpKinds; k++ ) {
+            BSONObjBuilder o( b.subobjStart( opKindNames[k] ) );
+            o.appendNumber( "count", (long long) _count[k].load() );
+            for ( int p = 0; p < NPhases; p++ )
+                o.append( phaseNames[p], histogramReport( *_h[k][p] ) );
+            o.done();
+        }
+    }
+
     OpCounters globalOpCounters;
     OpCounters replOpCounters;
     IndexCounters globalIndexCounters;
     FlushCounters globalFlushCounters;
     NetworkCounter networkCounter;
+    OpLatencyCounters opLatencyCounters;
 
 }
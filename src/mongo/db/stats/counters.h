@@ -23,24 +23,36 @@
 #include "../../util/processinfo.h"
 #include "../../util/concurrency/spin_lock.h"
 #include "mongo/db/pdfile.h"
+#include "mongo/platform/atomic_word.h"
 
 namespace mongo {
 
+    class Histogram;
+
+    /**
+     * each thread is given one of NStatsShards shards, round robin, for counters which are
+     * bumped on every operation and only summed when read.
+     * @return this thread's shard, in [0, NStatsShards)
+     */
+    enum { NStatsShards = 16, StatsCacheLine = 64 };
+    unsigned statsShard();
+
     /**
      * for storing operation counters
-     * note: not thread safe.  ok with that for speed
+     * the counts are sharded by thread so that connections don't contend for one cacheline,
+     * and are summed by getObj().
      */
     class OpCounters {
     public:
 
         OpCounters();
-        void incInsertInWriteLock(int n) { _insert.x += n; }
-        void gotInsert() { _insert++; }
-        void gotQuery() { _query++; }
-        void gotUpdate() { _update++; }
-        void gotDelete() { _delete++; }
-        void gotGetMore() { _getmore++; }
-        void gotCommand() { _command++; }
+        void incInsertInWriteLock(int n) { _mine().insert.signedAdd( n ); }
+        void gotInsert() { _mine().insert++; }
+        void gotQuery() { _mine().query++; }
+        void gotUpdate() { _mine().update++; }
+        void gotDelete() { _mine().del++; }
+        void gotGetMore() { _mine().getmore++; }
+        void gotCommand() { _mine().command++; }
 
         void gotOp( int op , bool isCommand );
 
@@ -48,14 +60,19 @@ namespace mongo {
 
     private:
 
-        // todo: there will be a lot of cache line contention on these.  need to do something 
-        //       else eventually.
-        AtomicUInt _insert;
-        AtomicUInt _query;
-        AtomicUInt _update;
-        AtomicUInt _delete;
-        AtomicUInt _getmore;
-        AtomicUInt _command;
+        struct Shard {
+            AtomicUInt insert;
+            AtomicUInt query;
+            AtomicUInt update;
+            AtomicUInt del;
+            AtomicUInt getmore;
+            AtomicUInt command;
+            char pad[StatsCacheLine - 6 * sizeof(AtomicUInt)];
+        };
+
+        Shard& _mine() { return _shards[ statsShard() ]; }
+
+        Shard _shards[NStatsShards];
     };
 
     extern OpCounters globalOpCounters;
@@ -104,6 +121,11 @@ namespace mongo {
 
         void flushed(int ms);
 
+        /** a throttled flush pass (--syncRateMB) has taken bytes of written ranges to flush */
+        void passStarted(unsigned long long bytes);
+        /** the throttled flush pass has flushed bytes more */
+        void flushedSome(unsigned long long bytes);
+
         void append( BSONObjBuilder& b );
 
     private:
@@ -111,6 +133,11 @@ namespace mongo {
         long long _flushes;
         int _last_time;
         Date_t _last;
+        Histogram *_latencies; // of each flush, in micros.  leaked
+        // throttled flushing
+        unsigned long long _passBytes;
+        unsigned long long _passFlushedBytes;
+        unsigned long long _throttledBytes;
     };
 
     extern FlushCounters globalFlushCounters;
@@ -142,4 +169,43 @@ namespace mongo {
     };
 
     extern NetworkCounter networkCounter;
+
+    /** the kinds of operation latency and lock wait statistics are kept by */
+    enum OpKind { OpQuery, OpGetMore, OpInsert, OpUpdate, OpRemove, OpCommand, OpOther, NOpKinds };
+    extern const char * const opKindNames[NOpKinds];
+
+    /** @param ns only looked at for dbQuery, to tell commands from queries */
+    OpKind opKind( int op , const char *ns );
+
+    /** a histogram of microseconds, in powers of two up to about 8 seconds */
+    Histogram* newMicrosHistogram();
+
+    /** micros, clamped to what a Histogram takes */
+    uint32_t microsBucketValue( unsigned long long micros );
+
+    /** only the buckets with anything in them, keyed by their upper bound */
+    BSONObj histogramReport( const Histogram& h );
+
+    /**
+     * histograms, by kind of operation, of the microseconds from a request's first bytes
+     * arriving to its reply being sent, and of the parts of that: waiting for a worker thread
+     * (only with --netWorkers), reading the rest of the request, waiting for locks, executing,
+     * and writing the reply.  counts may be lost to races, which is fine for a histogram.
+     */
+    class OpLatencyCounters {
+    public:
+        enum Phase { Queue, Receive, LockWait, Execute, Write, Total, NPhases };
+
+        OpLatencyCounters();
+
+        void record( OpKind k , const unsigned long long micros[NPhases] );
+
+        void append( BSONObjBuilder& b );
+
+    private:
+        Histogram *_h[NOpKinds][NPhases]; // leaked, like the lock histograms
+        AtomicUInt64 _count[NOpKinds];
+    };
+
+    extern OpLatencyCounters opLatencyCounters;
 }
@@ -0,0 +1,188 @@
+// namespace_io.cpp
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+
+#include "mongo/db/stats/namespace_io.h"
+
+#include <map>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/tss.hpp>
+
+#include "mongo/db/client.h"
+#include "mongo/db/curop.h"
+#include "mongo/db/index.h"
+#include "mongo/db/jsobj.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/util/concurrency/mutex.h"
+
+namespace mongo {
+
+    namespace {
+
+        enum {
+            PageSize = 4096 ,
+            BucketBytes = 8192  // the bucket size of both btree versions
+        };
+
+        struct Counts {
+            Counts() : accesses(0), checked(0), notInMemory(0), bytesNotInMemory(0), pageFaults(0) { }
+            long long accesses;
+            long long checked;          // accesses whose residency was looked up
+            long long notInMemory;
+            long long bytesNotInMemory; // whole pages spanned by what wasn't resident
+            long long pageFaults;
+        };
+
+        typedef boost::shared_ptr<Counts> CountsPtr;
+
+        SimpleMutex namespaceIOMutex( "namespaceIO" );
+        std::map< std::string , CountsPtr > namespaces;
+
+        // bumped by forget(), so threads let go of counters that were dropped
+        AtomicUInt32 generation;
+
+        CountsPtr lookup( const std::string& ns ) {
+            SimpleMutex::scoped_lock lk( namespaceIOMutex );
+            CountsPtr& c = namespaces[ ns ];
+            if ( ! c )
+                c.reset( new Counts() );
+            return c;
+        }
+
+        /** the counters this thread last used */
+        struct Recent {
+            Recent() : generation( 0 ) , index( 0 ) { }
+
+            unsigned generation;
+            std::string ns;
+            CountsPtr collection;
+            const IndexDetails *index;
+            CountsPtr indexCounts;
+
+            void check() {
+                unsigned g = mongo::generation.load();
+                if ( g == generation )
+                    return;
+                generation = g;
+                collection.reset();
+                index = 0;
+                indexCounts.reset();
+            }
+        };
+
+        boost::thread_specific_ptr<Recent> recent;
+
+        Recent& myRecent() {
+            Recent *r = recent.get();
+            if ( r == 0 ) {
+                r = new Recent();
+                recent.reset( r );
+            }
+            r->check();
+            return *r;
+        }
+
+        /** the current operation's collection, or 0 if there isn't one */
+        Counts* current() {
+            Client *c = currentClient.get();
+            CurOp *op = c ? c->curop() : 0;
+            if ( op == 0 || op->getNS()[0] == 0 )
+                return 0;
+            const char *ns = op->getNS();
+            Recent& r = myRecent();
+            if ( ! r.collection || r.ns != ns ) {
+                r.ns = ns;
+                r.collection = lookup( r.ns );
+            }
+            return r.collection.get();
+        }
+
+        Counts get( const std::string& ns ) {
+            SimpleMutex::scoped_lock lk( namespaceIOMutex );
+            std::map< std::string , CountsPtr >::const_iterator i = namespaces.find( ns );
+            return i == namespaces.end() ? Counts() : *i->second;
+        }
+
+        void appendRatio( BSONObjBuilder& b , const char *name , long long n , long long d ) {
+            b.append( name , d ? (double) n / d : 0.0 );
+        }
+    }
+
+    void NamespaceIO::noteRecord( int len , bool checked , bool inMemory ) {
+        Counts *c = current();
+        if ( c == 0 )
+            return;
+        c->accesses++;
+        if ( ! checked )
+            return;
+        c->checked++;
+        if ( ! inMemory ) {
+            c->notInMemory++;
+            c->bytesNotInMemory += (long long) ( len + PageSize - 1 ) / PageSize * PageSize;
+        }
+    }
+
+    void NamespaceIO::noteBucket( const IndexDetails& idx , bool inMemory ) {
+        Recent& r = myRecent();
+        if ( r.index != &idx || ! r.indexCounts ) {
+            r.indexCounts = lookup( idx.indexNamespace() );
+            r.index = &idx;
+        }
+        Counts *c = r.indexCounts.get();
+        c->accesses++;
+        c->checked++;
+        if ( ! inMemory ) {
+            c->notInMemory++;
+            c->bytesNotInMemory += BucketBytes;
+        }
+    }
+
+    void NamespaceIO::notePageFault() {
+        Counts *c = current();
+        if ( c )
+            c->pageFaults++;
+    }
+
+    void NamespaceIO::forget( const std::string& prefix ) {
+        SimpleMutex::scoped_lock lk( namespaceIOMutex );
+        std::map< std::string , CountsPtr >::iterator i = namespaces.lower_bound( prefix );
+        while ( i != namespaces.end() && i->first.compare( 0 , prefix.size() , prefix ) == 0 )
+            namespaces.erase( i++ );
+        generation.fetchAndAdd( 1 );
+    }
+
+    void NamespaceIO::appendCollection( const std::string& ns , BSONObjBuilder& b ) {
+        Counts c = get( ns );
+        b.appendNumber( "accesses" , c.accesses );
+        b.appendNumber( "notInMemory" , c.notInMemory );
+        appendRatio( b , "notInMemoryRatio" , c.notInMemory , c.checked );
+        b.appendNumber( "bytesNotInMemory" , c.bytesNotInMemory );
+        b.appendNumber( "pageFaults" , c.pageFaults );
+    }
+
+    void NamespaceIO::appendIndex( const std::string& indexNs , BSONObjBuilder& b ) {
+        Counts c = get( indexNs );
+        b.appendNumber( "accesses" , c.accesses );
+        b.appendNumber( "misses" , c.notInMemory );
+        appendRatio( b , "missRatio" , c.notInMemory , c.checked );
+        b.appendNumber( "bytesNotInMemory" , c.bytesNotInMemory );
+    }
+
+} // namespace mongo
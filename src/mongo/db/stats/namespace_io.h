@@ -0,0 +1,58 @@
+// namespace_io.h
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+
+namespace mongo {
+
+    class BSONObjBuilder;
+    class IndexDetails;
+
+    /**
+     * Page residency and page fault counts for each collection and index, so collStats can show
+     * which of them is going to disk.  Record::accessed() notes documents, against the current
+     * operation's namespace, and btree finds note buckets against their index.
+     *
+     * The counters are shared between threads and, like IndexCounters, updated without a mutex,
+     * so concurrent readers of one collection may lose a few counts.  Each thread remembers the
+     * counters it last used, so only a change of namespace takes the mutex.
+     */
+    class NamespaceIO {
+    public:
+        /**
+         * a document of len bytes, headers included, was read.  inMemory is false if it was
+         * likely not resident, and is ignored unless checked.
+         */
+        static void noteRecord( int len , bool checked , bool inMemory );
+
+        /** a bucket of idx was read */
+        static void noteBucket( const IndexDetails& idx , bool inMemory );
+
+        /** the current operation is yielding to fault in a page */
+        static void notePageFault();
+
+        /** drops the counts of the namespaces starting with prefix; for drops and renames */
+        static void forget( const std::string& prefix );
+
+        static void appendCollection( const std::string& ns , BSONObjBuilder& b );
+        static void appendIndex( const std::string& indexNs , BSONObjBuilder& b );
+    };
+
+} // namespace mongo
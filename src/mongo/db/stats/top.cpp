@@ -18,8 +18,10 @@
 
 #include "pch.h"
 #include "top.h"
+#include "counters.h"
 #include "../../util/net/message.h"
 #include "../commands.h"
+#include "../../util/mem_accounting.h"
 
 namespace mongo {
 
@@ -42,21 +44,49 @@ namespace mongo {
 
     }
 
+    void Top::CollectionData::add( const CollectionData& other ) {
+        total.add( other.total );
+        readLock.add( other.readLock );
+        writeLock.add( other.writeLock );
+        queries.add( other.queries );
+        getmore.add( other.getmore );
+        insert.add( other.insert );
+        update.add( other.update );
+        remove.add( other.remove );
+        commands.add( other.commands );
+    }
+
+    /** roughly what a collection's entry in a shard's usage map takes */
+    static long long usageEntryBytes( const string& ns ) {
+        return sizeof( Top::UsageMap::value_type ) + 4 * sizeof( void* ) + ns.size();
+    }
+
+    Top::Shard& Top::_mine() {
+        return _shards[ statsShard() % NShards ];
+    }
+
     void Top::record( const string& ns , int op , int lockType , long long micros , bool command ) {
         if ( ns[0] == '?' )
             return;
 
         //cout << "record: " << ns << "\t" << op << "\t" << command << endl;
-        scoped_lock lk(_lock);
+        Shard& s = _mine();
+        scoped_lock lk(s.lock);
 
-        if ( ( command || op == dbQuery ) && ns == _lastDropped ) {
-            _lastDropped = "";
+        if ( ( command || op == dbQuery ) && ns == s.lastDropped ) {
+            s.lastDropped = "";
             return;
         }
 
-        CollectionData& coll = _usage[ns];
-        _record( coll , op , lockType , micros , command );
-        _record( _global , op , lockType , micros , command );
+        if ( s.last == 0 || ns != s.lastNs ) {
+            size_t before = s.usage.size();
+            s.last = &s.usage[ns];
+            if ( s.usage.size() != before )
+                MemAccounting::add( MemAccounting::Top , usageEntryBytes( ns ) );
+            s.lastNs = ns;
+        }
+        _record( *s.last , op , lockType , micros , command );
+        _record( s.global , op , lockType , micros , command );
     }
 
     void Top::_record( CollectionData& c , int op , int lockType , long long micros , bool command ) {
@@ -103,19 +133,45 @@ namespace mongo {
 
     void Top::collectionDropped( const string& ns ) {
         //cout << "collectionDropped: " << ns << endl;
-        scoped_lock lk(_lock);
-        _usage.erase(ns);
-        _lastDropped = ns;
+        Shard& mine = _mine();
+        for ( unsigned i = 0; i < NShards; i++ ) {
+            Shard& s = _shards[i];
+            scoped_lock lk(s.lock);
+            if ( s.lastNs == ns ) {
+                s.last = 0;
+                s.lastNs = "";
+            }
+            if ( s.usage.erase(ns) )
+                MemAccounting::remove( MemAccounting::Top , usageEntryBytes( ns ) );
+            if ( &s == &mine )
+                s.lastDropped = ns;
+        }
     }
 
     void Top::cloneMap(Top::UsageMap& out) const {
-        scoped_lock lk(_lock);
-        out = _usage;
+        out.clear();
+        for ( unsigned i = 0; i < NShards; i++ ) {
+            const Shard& s = _shards[i];
+            scoped_lock lk(s.lock);
+            for ( UsageMap::const_iterator j = s.usage.begin(); j != s.usage.end(); ++j )
+                out[j->first].add( j->second );
+        }
+    }
+
+    Top::CollectionData Top::getGlobalData() const {
+        CollectionData global;
+        for ( unsigned i = 0; i < NShards; i++ ) {
+            const Shard& s = _shards[i];
+            scoped_lock lk(s.lock);
+            global.add( s.global );
+        }
+        return global;
     }
 
     void Top::append( BSONObjBuilder& b ) {
-        scoped_lock lk( _lock );
-        _appendToUsageMap( b , _usage );
+        UsageMap usage;
+        cloneMap( usage );
+        _appendToUsageMap( b , usage );
     }
 
     void Top::_appendToUsageMap( BSONObjBuilder& b , const UsageMap& map ) const {
@@ -23,11 +23,13 @@ namespace mongo {
 
     /**
      * tracks usage by collection
+     * each thread records into one of NShards shards with its own lock, so operations on
+     * different connections rarely contend; readers merge the shards.
      */
     class Top {
 
     public:
-        Top() : _lock("Top") { }
+        Top() { }
 
         struct UsageData {
             UsageData() : time(0) , count(0) {}
@@ -39,6 +41,11 @@ namespace mongo {
                 count++;
                 time += micros;
             }
+
+            void add( const UsageData& other ) {
+                count += other.count;
+                time += other.time;
+            }
         };
 
         struct CollectionData {
@@ -59,6 +66,9 @@ namespace mongo {
             UsageData update;
             UsageData remove;
             UsageData commands;
+
+            /** adds the usage in another shard */
+            void add( const CollectionData& other );
         };
 
         typedef map<string,CollectionData> UsageMap;
@@ -67,7 +77,7 @@ namespace mongo {
         void record( const string& ns , int op , int lockType , long long micros , bool command );
         void append( BSONObjBuilder& b );
         void cloneMap(UsageMap& out) const;
-        CollectionData getGlobalData() const { return _global; }
+        CollectionData getGlobalData() const;
         void collectionDropped( const string& ns );
 
     public: // static stuff
@@ -78,10 +88,22 @@ namespace mongo {
         void _appendStatsEntry( BSONObjBuilder& b , const char * statsName , const UsageData& map ) const;
         void _record( CollectionData& c , int op , int lockType , long long micros , bool command );
 
-        mutable mongo::mutex _lock;
-        CollectionData _global;
-        UsageMap _usage;
-        string _lastDropped;
+        struct Shard {
+            Shard() : lock("Top"), last(0) { }
+            mutable mongo::mutex lock;
+            CollectionData global;
+            UsageMap usage;
+            // the entry this shard recorded into last, as threads tend to stay on a collection
+            string lastNs;
+            CollectionData *last;
+            // set only in the shard of the thread which dropped the collection
+            string lastDropped;
+        };
+
+        enum { NShards = 16 };
+        Shard& _mine();
+
+        Shard _shards[NShards];
     };
 
 } // namespace mongo
@@ -0,0 +1,159 @@
+// working_set.cpp
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+
+#include "mongo/db/stats/working_set.h"
+
+#include <map>
+#include <string>
+
+#include "mongo/db/client.h"
+#include "mongo/db/database.h"
+#include "mongo/db/jsobj.h"
+#include "mongo/util/concurrency/mutex.h"
+#include "mongo/util/hyperloglog.h"
+#include "mongo/util/net/listen.h"
+
+namespace mongo {
+
+    namespace {
+
+        enum {
+            PageShift = 12 ,
+            Minutes = 11 ,   // the last 10, and the current one
+            TenMinutes = 7   // the last 6, and the current one
+        };
+
+        typedef HyperLogLog<10> Sketch;
+
+        const int windowMinutes[] = { 1 , 10 , 60 };
+        const char *windowNames[] = { "1min" , "10min" , "1h" };
+        const int NumWindows = 3;
+
+        /** the sketches of one database's pages of one kind */
+        class Spans {
+        public:
+            Spans() {
+                for ( int i = 0; i < Minutes; i++ )
+                    _minuteOf[i] = -1;
+                for ( int i = 0; i < TenMinutes; i++ )
+                    _tenMinutesOf[i] = -1;
+            }
+
+            void add( unsigned long long hash , long long minute ) {
+                _at( _minutes , _minuteOf , Minutes , minute ).add( hash );
+                _at( _tenMinutes , _tenMinutesOf , TenMinutes , minute / 10 ).add( hash );
+            }
+
+            /** merges into out the spans within 'window' minutes of now */
+            void unionOver( int window , long long minute , Sketch& out ) const {
+                if ( window <= Minutes - 1 ) {
+                    for ( int i = 0; i < Minutes; i++ )
+                        if ( _minuteOf[i] >= 0 && _minuteOf[i] >= minute - window )
+                            out.merge( _minutes[i] );
+                }
+                else {
+                    for ( int i = 0; i < TenMinutes; i++ )
+                        if ( _tenMinutesOf[i] >= 0 && _tenMinutesOf[i] >= minute / 10 - window / 10 )
+                            out.merge( _tenMinutes[i] );
+                }
+            }
+
+        private:
+            // the sketch for span t, emptied if it last held an older one
+            static Sketch& _at( Sketch *sketches , long long *spanOf , int n , long long t ) {
+                int i = (int) ( t % n );
+                if ( spanOf[i] != t ) {
+                    sketches[i].clear();
+                    spanOf[i] = t;
+                }
+                return sketches[i];
+            }
+
+            Sketch _minutes[Minutes];
+            long long _minuteOf[Minutes];
+            Sketch _tenMinutes[TenMinutes];
+            long long _tenMinutesOf[TenMinutes];
+        };
+
+        struct DatabaseSpans {
+            Spans kinds[WorkingSet::NumKinds];
+        };
+
+        SimpleMutex workingSetMutex( "workingSet" );
+        std::map< std::string , DatabaseSpans* > databases;
+
+        void appendWindows( BSONObjBuilder& b , const Sketch est[][NumWindows] ) {
+            for ( int w = 0; w < NumWindows; w++ ) {
+                BSONObjBuilder wb( b.subobjStart( windowNames[w] ) );
+                long long data = (long long) est[WorkingSet::Data][w].estimate();
+                long long index = (long long) est[WorkingSet::Index][w].estimate();
+                wb.appendNumber( "dataPages" , data );
+                wb.appendNumber( "indexPages" , index );
+                wb.appendNumber( "totalMB" , ( ( data + index ) << PageShift ) / ( 1024 * 1024 ) );
+                wb.done();
+            }
+        }
+    }
+
+    void WorkingSet::note( const void *addr , Kind kind ) {
+        Client *c = currentClient.get();
+        Database *db = c ? c->database() : 0;
+        if ( db == 0 )
+            return;
+        unsigned long long hash = Sketch::hash( (size_t) addr >> PageShift );
+        long long minute = Listener::getElapsedTimeMillis() / ( 60 * 1000 );
+
+        SimpleMutex::scoped_lock lk( workingSetMutex );
+        DatabaseSpans *&d = databases[ db->name ];
+        if ( d == 0 )
+            d = new DatabaseSpans();
+        d->kinds[kind].add( hash , minute );
+    }
+
+    void WorkingSet::append( BSONObjBuilder& b ) {
+        long long minute = Listener::getElapsedTimeMillis() / ( 60 * 1000 );
+        b.append( "pageSize" , 1 << PageShift );
+
+        Sketch overall[NumKinds][NumWindows];
+        BSONObjBuilder dbs;
+        {
+            SimpleMutex::scoped_lock lk( workingSetMutex );
+            for ( std::map< std::string , DatabaseSpans* >::const_iterator i = databases.begin();
+                  i != databases.end(); ++i ) {
+                Sketch est[NumKinds][NumWindows];
+                for ( int k = 0; k < NumKinds; k++ ) {
+                    for ( int w = 0; w < NumWindows; w++ ) {
+                        i->second->kinds[k].unionOver( windowMinutes[w] , minute , est[k][w] );
+                        overall[k][w].merge( est[k][w] );
+                    }
+                }
+                BSONObjBuilder db( dbs.subobjStart( i->first ) );
+                appendWindows( db , est );
+                db.done();
+            }
+        }
+
+        BSONObjBuilder o( b.subobjStart( "overall" ) );
+        appendWindows( o , overall );
+        o.done();
+        b.append( "dbs" , dbs.obj() );
+    }
+
+} // namespace mongo
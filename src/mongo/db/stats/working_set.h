@@ -0,0 +1,46 @@
+// working_set.h
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+namespace mongo {
+
+    class BSONObjBuilder;
+
+    /**
+     * Estimates the working set: how many distinct 4KB pages of data files were touched over
+     * the last minute, 10 minutes and hour, for each database and separately for documents and
+     * for btree buckets.  Record::accessed() notes document pages, and btree finds note bucket
+     * pages.
+     *
+     * Each database and kind keeps HyperLogLog sketches of each of the last few minutes and of the
+     * last few 10 minute spans, so memory stays at 36KB a database however large the set is.  A
+     * window also counts the part of the current minute (or 10 minutes) so far, so it covers
+     * between its length and that much more.  Reported in serverStatus().workingSet.
+     */
+    class WorkingSet {
+    public:
+        enum Kind { Data , Index , NumKinds };
+
+        /** notes that the page holding addr was touched, on behalf of the current database */
+        static void note( const void *addr , Kind kind );
+
+        static void append( BSONObjBuilder& b );
+    };
+
+} // namespace mongo
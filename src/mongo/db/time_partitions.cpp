@@ -0,0 +1,289 @@
+// time_partitions.cpp
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+
+#include "mongo/db/time_partitions.h"
+
+#include "mongo/db/commands.h"
+#include "mongo/db/dbhelpers.h"
+#include "mongo/db/instance.h"
+#include "mongo/db/namespace_details.h"
+#include "mongo/db/oplog.h"
+#include "mongo/db/pdfile.h"
+#include "mongo/db/queryutil.h"
+#include "mongo/util/mongoutils/str.h"
+
+namespace mongo {
+
+    TimePartitions::Spec TimePartitions::parse( const BSONElement& e ) {
+        uassert( 16400 , "timePartitioned must be an object" , e.type() == Object );
+        BSONObj o = e.Obj();
+        Spec s;
+        uassert( 16396 , "timePartitioned needs the name of a date field" ,
+                 o["field"].type() == String && ! o["field"].str().empty() );
+        s.field = o["field"].str();
+        BSONElement b = o["bucketSecs"];
+        uassert( 16397 , "timePartitioned bucketSecs must be a positive number" ,
+                 b.isNumber() && b.numberLong() > 0 );
+        s.bucketMillis = 1000 * b.numberLong();
+        BSONElement x = o["expireAfterSeconds"];
+        uassert( 16398 , "timePartitioned expireAfterSeconds must be a number, 0 for none" ,
+                 x.eoo() || ( x.isNumber() && x.numberLong() >= 0 ) );
+        s.expireMillis = 1000 * x.numberLong();
+        return s;
+    }
+
+    bool TimePartitions::spec( const char* ns , Spec* s ) {
+        NamespaceDetails* d = nsdetails( ns );
+        if ( ! d || ! d->isUserFlagSet( NamespaceDetails::Flag_TimePartitioned ) )
+            return false;
+
+        BSONObj o;
+        {
+            SimpleMutex::scoped_lock lk( NamespaceDetailsTransient::_qcMutex );
+            o = NamespaceDetailsTransient::get_inlock( ns ).timePartitioned();
+        }
+        if ( o.isEmpty() ) {
+            // once per ns, as the transient goes with a drop
+            BSONObj entry;
+            string system_namespaces = nsToDatabase( ns ) + ".system.namespaces";
+            if ( ! Helpers::findOne( system_namespaces , BSON( "name" << ns ) , entry ) )
+                return false;
+            o = entry.getObjectField( "options" ).getOwned();
+            SimpleMutex::scoped_lock lk( NamespaceDetailsTransient::_qcMutex );
+            NamespaceDetailsTransient::get_inlock( ns ).timePartitioned() = o;
+        }
+        *s = parse( o["timePartitioned"] );
+        return true;
+    }
+
+    string TimePartitions::bucketNs( const string& ns , long long start ) {
+        return str::stream() << ns << ".tp" << start;
+    }
+
+    string TimePartitions::bucketFor( const char* ns , const Spec& s , const BSONObj& js ) {
+        BSONElement e = js.getFieldDotted( s.field );
+        uassert( 16399 , str::stream() << "documents in time partitioned " << ns
+                                       << " need a date " << s.field ,
+                 e.type() == Date );
+        long long t = (long long) e.date().millis;
+        long long start = t - ( ( t % s.bucketMillis ) + s.bucketMillis ) % s.bucketMillis;
+        string b = bucketNs( ns , start );
+        if ( nsdetails( b.c_str() ) )
+            return b;
+
+        string err;
+        uassert( 16401 , str::stream() << "couldn't create bucket " << b << ": " << err ,
+                 userCreateNS( b.c_str() , BSONObj() , err , true ) );
+        log(1) << "created time partition " << b << endl;
+
+        // the parent's indexes, but for _id which the bucket has already
+        vector<BSONObj> specs;
+        {
+            NamespaceDetails::IndexIterator i = nsdetails( ns )->ii();
+            while ( i.more() ) {
+                IndexDetails& id = i.next();
+                if ( id.isIdIndex() )
+                    continue;
+                BSONObjBuilder ib;
+                BSONObjIterator j( id.info.obj() );
+                while ( j.more() ) {
+                    BSONElement f = j.next();
+                    if ( str::equals( f.fieldName() , "ns" ) )
+                        ib.append( "ns" , b );
+                    else if ( ! str::equals( f.fieldName() , "background" ) )
+                        ib.append( f );
+                }
+                specs.push_back( ib.obj() );
+            }
+        }
+        string system_indexes = nsToDatabase( ns ) + ".system.indexes";
+        for ( unsigned i = 0; i < specs.size(); i++ ) {
+            theDataFileMgr.insert( system_indexes.c_str() , specs[i].objdata() , specs[i].objsize() );
+            logOp( "i" , system_indexes.c_str() , specs[i] );
+        }
+        return b;
+    }
+
+    void TimePartitions::buckets( const string& ns , vector<long long>* starts ) {
+        string prefix = ns + ".tp";
+        list<string> all;
+        cc().database()->namespaceIndex.getNamespaces( all );
+        for ( list<string>::const_iterator i = all.begin(); i != all.end(); ++i ) {
+            if ( ! str::startsWith( *i , prefix ) )
+                continue;
+            const char* p = i->c_str() + prefix.size();
+            char* end;
+            long long start = strtoll( p , &end , 10 );
+            if ( *p && *end == 0 )
+                starts->push_back( start );
+        }
+        sort( starts->begin() , starts->end() );
+    }
+
+    void TimePartitions::prune( const Spec& s , const BSONObj& query , vector<long long>* starts ) {
+        FieldRangeSet frs( "" , query , true );
+        const FieldRange& r = frs.range( s.field.c_str() );
+        if ( r.empty() ) {
+            starts->clear();
+            return;
+        }
+
+        // a bound that isn't a date, e.g. the one type bracketing gives $lt, doesn't limit it
+        long long lo = numeric_limits<long long>::min();
+        long long hi = numeric_limits<long long>::max();
+        if ( r.min().type() == Date )
+            lo = (long long) r.min().date().millis;
+        if ( r.max().type() == Date )
+            hi = (long long) r.max().date().millis;
+
+        vector<long long> in;
+        for ( unsigned i = 0; i < starts->size(); i++ ) {
+            long long start = (*starts)[i];
+            if ( start + s.bucketMillis > lo && start <= hi )
+                in.push_back( start );
+        }
+        starts->swap( in );
+    }
+
+    /** drops bucket b along with its extents and indexes, in the oplog as a drop command */
+    static void dropBucket( const string& b ) {
+        string errmsg;
+        BSONObjBuilder result;
+        dropCollection( b , errmsg , result );
+        string dbName = nsToDatabase( b );
+        string logNs = dbName + ".$cmd";
+        logOp( "c" , logNs.c_str() , BSON( "drop" << b.substr( dbName.size() + 1 ) ) );
+    }
+
+    void TimePartitions::dropBuckets( const string& ns ) {
+        vector<long long> starts;
+        buckets( ns , &starts );
+        for ( unsigned i = 0; i < starts.size(); i++ )
+            dropBucket( bucketNs( ns , starts[i] ) );
+    }
+
+    /** @return the buckets of dbName's collections that have expired */
+    static vector<string> expiredBuckets( const string& dbName ) {
+        list<string> all;
+        cc().database()->namespaceIndex.getNamespaces( all );
+        long long now = curTimeMillis64();
+        vector<string> expired;
+        for ( list<string>::const_iterator i = all.begin(); i != all.end(); ++i ) {
+            TimePartitions::Spec s;
+            if ( ! TimePartitions::spec( i->c_str() , &s ) || s.expireMillis == 0 )
+                continue;
+            vector<long long> starts;
+            TimePartitions::buckets( *i , &starts );
+            for ( unsigned j = 0; j < starts.size(); j++ ) {
+                if ( starts[j] + s.bucketMillis + s.expireMillis > now )
+                    break;
+                expired.push_back( TimePartitions::bucketNs( *i , starts[j] ) );
+            }
+        }
+        return expired;
+    }
+
+    int TimePartitions::expire( const string& dbName ) {
+        {
+            // most passes have nothing to drop, which doesn't need the write lock
+            Client::ReadContext ctx( dbName );
+            if ( expiredBuckets( dbName ).empty() )
+                return 0;
+        }
+
+        Client::WriteContext ctx( dbName );
+        vector<string> expired = expiredBuckets( dbName );
+        for ( unsigned i = 0; i < expired.size(); i++ ) {
+            LOG(1) << "dropping expired time partition " << expired[i] << endl;
+            dropBucket( expired[i] );
+        }
+        return expired.size();
+    }
+
+    class CmdFindPartitioned : public Command {
+    public:
+        CmdFindPartitioned() : Command( "findPartitioned" ) {}
+        virtual bool slaveOk() const { return true; }
+        virtual bool logTheOp() { return false; }
+        virtual LockType locktype() const { return NONE; }
+        virtual void help( stringstream& help ) const {
+            help << "query a time partitioned collection, scanning only the buckets its range on the date field can match.\n"
+                    "{ findPartitioned : <collection>, query : <query>, limit : <n>, reverse : <bool> }\n"
+                    "results come a bucket at a time, oldest first, or newest with reverse; ordered by the date field within\n"
+                    "a bucket with limit or reverse";
+        }
+        virtual bool run( const string& dbname , BSONObj& cmdObj , int , string& errmsg , BSONObjBuilder& result , bool ) {
+            string ns = dbname + "." + cmdObj.firstElement().valuestrsafe();
+            BSONObj query = cmdObj.getObjectField( "query" );
+            long long limit = cmdObj["limit"].numberLong();
+            bool reverse = cmdObj["reverse"].trueValue();
+
+            TimePartitions::Spec s;
+            vector<long long> starts;
+            size_t total;
+            {
+                Client::ReadContext ctx( ns );
+                if ( ! TimePartitions::spec( ns.c_str() , &s ) ) {
+                    errmsg = "not a time partitioned collection";
+                    return false;
+                }
+                TimePartitions::buckets( ns , &starts );
+                total = starts.size();
+                TimePartitions::prune( s , query , &starts );
+            }
+            if ( reverse )
+                std::reverse( starts.begin() , starts.end() );
+
+            Query q( query );
+            if ( limit || reverse )
+                q.sort( s.field , reverse ? -1 : 1 );
+
+            const int bufSize = BSONObjMaxUserSize - 4096;
+            DBDirectClient db;
+            BSONArrayBuilder results( result.subarrayStart( "results" ) );
+            long long n = 0;
+            bool truncated = false;
+            unsigned scanned = 0;
+            for ( ; scanned < starts.size() && ! truncated && ( ! limit || n < limit ); scanned++ ) {
+                string b = TimePartitions::bucketNs( ns , starts[scanned] );
+                auto_ptr<DBClientCursor> c = db.query( b , q , limit ? (int) ( limit - n ) : 0 );
+                uassert( 16402 , str::stream() << "query of " << b << " failed" , c.get() );
+                while ( c->more() ) {
+                    BSONObj o = c->next();
+                    if ( results.len() + o.objsize() + 1024 > bufSize ) {
+                        truncated = true;
+                        break;
+                    }
+                    results.append( o );
+                    n++;
+                }
+            }
+            results.done();
+
+            result.appendNumber( "n" , n );
+            result.appendNumber( "buckets" , (long long) total );
+            result.append( "bucketsScanned" , scanned );
+            if ( truncated )
+                result.appendBool( "truncated" , true );
+            return true;
+        }
+    } cmdFindPartitioned;
+
+}
@@ -0,0 +1,79 @@
+// time_partitions.h
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "mongo/db/jsobj.h"
+
+namespace mongo {
+
+    /**
+     * A collection created with
+     *   { timePartitioned : { field : <name>, bucketSecs : <n>, expireAfterSeconds : <n> } }
+     * holds no documents itself.  Each insert goes to the bucket collection <ns>.tp<millis> for
+     * the bucketSecs wide slice of time its date field falls in, made on the first insert with
+     * the parent's indexes.  Expiring a bucket drops its collection, which gives its extents back
+     * to the free list and its index btrees with them, with no work per document.
+     *
+     * The bucket's create, index and insert ops are what go in the oplog, so a secondary applies
+     * them like any other.  Dropping the parent drops its buckets.  Updates and removes aren't
+     * routed: they go to the buckets directly, and findPartitioned queries only the buckets the
+     * query's range on the date field can match.
+     */
+    class TimePartitions {
+    public:
+        struct Spec {
+            Spec() : bucketMillis( 0 ) , expireMillis( 0 ) {}
+            string field;
+            long long bucketMillis;
+            long long expireMillis;     // 0 to keep buckets forever
+        };
+
+        /** uasserts if e isn't a valid timePartitioned option */
+        static Spec parse( const BSONElement& e );
+
+        /** @return false if ns isn't time partitioned; in a lock on ns */
+        static bool spec( const char* ns , Spec* s );
+
+        /** @return the collection of ns's bucket starting at start */
+        static string bucketNs( const string& ns , long long start );
+
+        /**
+         * @return the bucket ns js is to be inserted into, created with the parent's indexes
+         * if it doesn't exist yet.  write locked.
+         */
+        static string bucketFor( const char* ns , const Spec& s , const BSONObj& js );
+
+        /** the start of each of ns's buckets, ascending */
+        static void buckets( const string& ns , vector<long long>* starts );
+
+        /** removes the buckets no document matching query could be in from starts */
+        static void prune( const Spec& s , const BSONObj& query , vector<long long>* starts );
+
+        /**
+         * drops the buckets of dbName's time partitioned collections whose documents have all
+         * expired.  takes the write lock.
+         * @return the number dropped
+         */
+        static int expire( const string& dbName );
+
+        /** drops all of ns's buckets, for a drop of ns.  write locked. */
+        static void dropBuckets( const string& ns );
+    };
+
+}
@@ -20,27 +20,164 @@
 
 #include "mongo/db/commands/fsync.h"
 #include "mongo/db/ttl.h"
+#include "mongo/db/btree.h"
 #include "mongo/db/databaseholder.h"
 #include "mongo/db/instance.h"
+#include "mongo/db/oplog.h"
 #include "mongo/db/ops/delete.h"
+#include "mongo/db/queryutil.h"
+#include "mongo/db/time_partitions.h"
 #include "mongo/util/background.h"
 #include "mongo/db/replutil.h"
 
 namespace mongo {
-    
+
+    int ttlBatchSize = 1000;
+    int ttlMaxDocsPerSec = 0;
+    int ttlMonitorSleepSecs = 60;
+
+    /**
+     * Deletes expired documents a batch of at most ttlBatchSize at a time, each in a write lock
+     * of its own, so a collection with a lot expiring doesn't hold the lock for seconds.  An
+     * index with a backlog gets another batch as soon as its ttlMaxDocsPerSec allows, rather
+     * than waiting for the next pass; once none has, the monitor sleeps ttlMonitorSleepSecs.
+     * Each pass also drops the expired buckets of time partitioned collections.
+     */
     class TTLMonitor : public BackgroundJob {
     public:
-        TTLMonitor(){}
+        TTLMonitor() : _m( "TTLMonitor" ) , _passes( 0 ) , _bucketsDropped( 0 ) {}
         virtual ~TTLMonitor(){}
 
         virtual string name() const { return "TTLMonitor"; }
         
         static string secondsExpireField;
-        
-        void doTTLForDB( const string& dbName ) {
+
+        void appendStats( BSONObjBuilder& b ) {
+            scoped_lock lk( _m );
+            long long deleted = 0;
+            BSONObjBuilder indexes;
+            for ( map<string,IndexStats>::const_iterator i = _indexes.begin(); i != _indexes.end(); ++i ) {
+                const IndexStats& s = i->second;
+                deleted += s.deleted;
+                BSONObjBuilder bb( indexes.subobjStart( i->first ) );
+                bb.appendNumber( "deleted" , s.deleted );
+                bb.appendNumber( "batches" , s.batches );
+                bb.append( "lagSecs" , s.lagMillis / 1000.0 );
+                bb.appendNumber( "lastBatchMicros" , s.lastBatchMicros );
+                bb.done();
+            }
+            b.appendNumber( "passes" , _passes );
+            b.appendNumber( "deleted" , deleted );
+            b.appendNumber( "bucketsDropped" , _bucketsDropped );
+            b.append( "indexes" , indexes.obj() );
+        }
+
+    private:
+        struct IndexStats {
+            IndexStats() : deleted( 0 ) , batches( 0 ) , lagMillis( 0 ) , lastBatchMicros( 0 ) ,
+                           nextBatch( 0 ) , seen( false ) {}
+            long long deleted;
+            long long batches;
+            long long lagMillis;        // how long past expiry the oldest document left is
+            long long lastBatchMicros;  // with the wait for the write lock
+            unsigned long long nextBatch; // millis, when the docs per sec limit allows another
+            bool seen;                  // in this pass
+        };
+
+        /**
+         * deletes up to ttlBatchSize documents that have expired under idx
+         * @return true if that didn't get them all
+         */
+        bool doTTLBatch( const BSONObj& idx , IndexStats* stats ) {
+            BSONObj key = idx["key"].Obj();
+            uassert( 16230 , "key for ttl index can only have 1 field" , key.nFields() == 1 );
+
+            unsigned long long cutoff = curTimeMillis64() - ( 1000 * idx[secondsExpireField].numberLong() );
+            BSONObj query;
+            {
+                BSONObjBuilder b;
+                b.appendDate( "$lt" , cutoff );
+                query = BSON( key.firstElement().fieldName() << b.obj() );
+            }
+
+            LOG(1) << "TTL: " << key << " \t " << query << endl;
+
+            const unsigned batchSize = max( ttlBatchSize , 1 );
+            string ns = idx["ns"].String();
+            long long n = 0;
+            bool more = false;
+            long long oldest = 0;
+            Timer t;
+            {
+                Client::WriteContext ctx( ns );
+                NamespaceDetails* nsd = nsdetails( ns.c_str() );
+                if ( ! nsd )
+                    return false;
+                if ( nsd->setUserFlag( NamespaceDetails::Flag_UsePowerOf2Sizes ) ) {
+                    nsd->syncUserFlags( ns );
+                }
+                int idxNo = nsd->findIndexByKeyPattern( key );
+                if ( idxNo < 0 )
+                    return false;
+                IndexDetails& id = nsd->idx( idxNo );
+
+                // the expired keys, under the type bracketing $lt does, for an index either way
+                set<DiskLoc> locs;
+                {
+                    FieldRangeSet frs( ns.c_str() , query , true );
+                    shared_ptr<FieldRangeVector> bounds( new FieldRangeVector( frs , id.getSpec() , 1 ) );
+                    scoped_ptr<BtreeCursor> c( BtreeCursor::make( nsd , idxNo , id , bounds , 0 , 1 ) );
+                    for ( ; c->ok(); c->advance() ) {
+                        if ( locs.size() == batchSize ) {
+                            more = true;
+                            break;
+                        }
+                        long long k = c->currKey().firstElement().date().millis;
+                        if ( locs.empty() || k < oldest )
+                            oldest = k;
+                        locs.insert( c->currLoc() );
+                    }
+                }
+
+                for ( set<DiskLoc>::const_iterator i = locs.begin(); i != locs.end(); ++i ) {
+                    DiskLoc rloc = *i;
+                    BSONElement e;
+                    if ( BSONObj::make( rloc.rec() ).getObjectID( e ) ) {
+                        BSONObjBuilder b;
+                        b.append( e );
+                        bool replJustOne = true;
+                        logOp( "d" , ns.c_str() , b.done() , 0 , &replJustOne , false ,
+                               oplogPreImages ? rloc.obj() : BSONObj() );
+                    }
+                    else {
+                        problem() << "TTL deleted object without id, not logging" << endl;
+                    }
+                    theDataFileMgr.deleteRecord( ns.c_str() , rloc.rec() , rloc );
+                    getDur().commitIfNeeded();
+                    n++;
+                }
+            }
+
+            LOG(1) << "\tTTL deleted: " << n << endl;
+
+            scoped_lock lk( _m );
+            stats->deleted += n;
+            stats->batches++;
+            stats->lagMillis = more && (unsigned long long) oldest < cutoff ? cutoff - oldest : 0;
+            stats->lastBatchMicros = t.micros();
+            if ( ttlMaxDocsPerSec > 0 )
+                stats->nextBatch = curTimeMillis64() + n * 1000 / ttlMaxDocsPerSec;
+            return more;
+        }
+
+        /**
+         * a batch for each of dbName's ttl indexes the docs per sec limit allows
+         * @return whether any has documents left, and *nextBatch, the soonest a limited one can go
+         */
+        bool doTTLForDB( const string& dbName , unsigned long long* nextBatch ) {
             
             if ( ! isMasterNs( dbName.c_str() ) )
-                return;
+                return false;
             
             Client::GodScope god;
 
@@ -55,44 +192,54 @@ namespace mongo {
                 }
             }
             
+            bool backlog = false;
             for ( unsigned i=0; i<indexes.size(); i++ ) {
                 BSONObj idx = indexes[i];
-                
-
-                BSONObj key = idx["key"].Obj();
-                uassert( 16230 , "key for ttl index can only have 1 field" , key.nFields() == 1 );
+                string name = idx["ns"].String() + "." + idx["name"].String();
 
-                BSONObj query;
+                IndexStats* stats;
                 {
-                    BSONObjBuilder b;
-                    b.appendDate( "$lt" , curTimeMillis64() - ( 1000 * idx[secondsExpireField].numberLong() ) );
-                    query = BSON( key.firstElement().fieldName() << b.obj() );
-                }
-                
-                LOG(1) << "TTL: " << key << " \t " << query << endl;
-                
-                long long n = 0;
-                {
-                    string ns = idx["ns"].String();
-                    Client::WriteContext ctx( ns );
-                    NamespaceDetails* nsd = nsdetails( ns.c_str() );
-                    if ( nsd->setUserFlag( NamespaceDetails::Flag_UsePowerOf2Sizes ) ) {
-                        nsd->syncUserFlags( ns );
+                    scoped_lock lk( _m );
+                    stats = &_indexes[name];
+                    stats->seen = true;
+                    if ( stats->nextBatch > curTimeMillis64() ) {
+                        backlog = true;
+                        *nextBatch = min( *nextBatch , stats->nextBatch );
+                        continue;
                     }
-                    n = deleteObjects( ns.c_str() , query , false , true );
                 }
 
-                LOG(1) << "\tTTL deleted: " << n << endl;
+                if ( doTTLBatch( idx , stats ) ) {
+                    backlog = true;
+                    scoped_lock lk( _m );
+                    *nextBatch = min( *nextBatch , stats->nextBatch );
+                }
             }
-            
-            
+
+            // time partitioned collections expire a bucket at a time
+            int dropped = TimePartitions::expire( dbName );
+            if ( dropped ) {
+                scoped_lock lk( _m );
+                _bucketsDropped += dropped;
+            }
+            return backlog;
         }
 
         virtual void run() {
             Client::initThread( name().c_str() );
 
+            bool backlog = false;
+            unsigned long long nextBatch = 0;
             while ( ! inShutdown() ) {
-                sleepsecs( 60 );
+                if ( ! backlog ) {
+                    sleepsecs( max( ttlMonitorSleepSecs , 1 ) );
+                }
+                else {
+                    // pace the indexes with a backlog, which the next pass comes back to
+                    unsigned long long now = curTimeMillis64();
+                    if ( nextBatch > now )
+                        sleepmillis( min( nextBatch - now , 1000ULL ) );
+                }
                 
                 LOG(3) << "TTLMonitor thread awake" << endl;
                 
@@ -100,6 +247,7 @@ namespace mongo {
                     // note: this is not perfect as you can go into fsync+lock between 
                     // this and actually doing the delete later
                     LOG(3) << " locked for writing" << endl;
+                    backlog = false;
                     continue;
                 }
 
@@ -108,22 +256,58 @@ namespace mongo {
                     Lock::DBRead lk( "local" );
                     dbHolder().getAllShortNames( dbs );
                 }
-                
+
+                {
+                    scoped_lock lk( _m );
+                    _passes++;
+                    for ( map<string,IndexStats>::iterator i = _indexes.begin(); i != _indexes.end(); ++i )
+                        i->second.seen = false;
+                }
+
+                backlog = false;
+                nextBatch = ~0ULL;
                 for ( set<string>::const_iterator i=dbs.begin(); i!=dbs.end(); ++i ) {
                     string db = *i;
-                    doTTLForDB( db );
+                    try {
+                        if ( doTTLForDB( db , &nextBatch ) )
+                            backlog = true;
+                    }
+                    catch ( DBException& e ) {
+                        error() << "error processing ttl for db: " << db << " " << e << endl;
+                    }
                 }
 
+                // forget the indexes that have gone
+                scoped_lock lk( _m );
+                map<string,IndexStats>::iterator i = _indexes.begin();
+                while ( i != _indexes.end() ) {
+                    if ( i->second.seen )
+                        ++i;
+                    else
+                        _indexes.erase( i++ );
+                }
             }
         }
 
         DBDirectClient db;
+
+        mongo::mutex _m; // protects _indexes, _passes and _bucketsDropped, for appendStats()
+        map<string,IndexStats> _indexes; // by index ns
+        long long _passes;
+        long long _bucketsDropped;      // of time partitioned collections
     };
 
+    static TTLMonitor* ttlMonitor = 0;
+
     void startTTLBackgroundJob() {
-        TTLMonitor* ttl = new TTLMonitor();
-        ttl->go();
+        ttlMonitor = new TTLMonitor();
+        ttlMonitor->go();
     }    
+
+    void appendTTLStats( BSONObjBuilder& b ) {
+        if ( ttlMonitor )
+            ttlMonitor->appendStats( b );
+    }
     
     string TTLMonitor::secondsExpireField = "expireAfterSeconds";
 }
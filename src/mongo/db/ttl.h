@@ -19,5 +19,15 @@
 #pragma once
 
 namespace mongo {
+
+    class BSONObjBuilder;
+
+    extern int ttlBatchSize;        // documents deleted per write lock
+    extern int ttlMaxDocsPerSec;    // per index, 0 for no limit
+    extern int ttlMonitorSleepSecs; // between passes, once no index has a backlog
+
     void startTTLBackgroundJob();
+
+    /** serverStatus().ttl */
+    void appendTTLStats( BSONObjBuilder& b );
 }
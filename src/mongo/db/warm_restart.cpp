@@ -0,0 +1,303 @@
+// warm_restart.cpp
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+
+#include "mongo/db/warm_restart.h"
+
+#include <fstream>
+#include <boost/filesystem/operations.hpp>
+
+#include "mongo/db/client.h"
+#include "mongo/db/instance.h"
+#include "mongo/db/mongommf.h"
+#include "mongo/db/namespace_details.h"
+#include "mongo/util/background.h"
+#include "mongo/util/mmap.h"
+#include "mongo/util/processinfo.h"
+#include "mongo/util/timer.h"
+
+namespace mongo {
+
+    int warmRestartSecs = 0;
+    int warmRestartRateMB = 64;
+
+    // residency is noted, and read back, a region at a time
+    static const unsigned RegionSize = 1024 * 1024;
+
+    static mongo::mutex statsMutex( "warmRestart" );
+    static long long snapshots = 0;
+    static long long hotBytes = 0;         // in the last snapshot
+    static long long prefetchedBytes = 0;
+    static bool prefetching = false;
+
+    static string hotPagesFile() {
+        return ( boost::filesystem::path( dbpath ) / "hotpages.bson" ).string();
+    }
+
+    /**
+     * @return a { file, length, regionSize, regions } for mmf, regions a bitmap of the regions
+     * at least a quarter in memory, or an empty object if there are none
+     */
+    static BSONObj hotRegions( MongoMMF* mmf ) {
+        const char* view = (const char*) mmf->getView();
+        unsigned long long length = mmf->length();
+        if ( ! view || length == 0 )
+            return BSONObj();
+
+        size_t numPages = length / g_minOSPageSizeBytes;
+        vector<char> resident;
+        if ( ! ProcessInfo::pagesInMemory( view , numPages , &resident ) )
+            return BSONObj();
+
+        const size_t pagesPerRegion = RegionSize / g_minOSPageSizeBytes;
+        size_t numRegions = ( numPages + pagesPerRegion - 1 ) / pagesPerRegion;
+        vector<unsigned char> bits( ( numRegions + 7 ) / 8 );
+        long long hot = 0;
+        for ( size_t r = 0; r < numRegions; r++ ) {
+            size_t n = 0;
+            size_t end = min( numPages , ( r + 1 ) * pagesPerRegion );
+            for ( size_t p = r * pagesPerRegion; p < end; p++ )
+                n += resident[p];
+            if ( n * 4 >= pagesPerRegion ) {
+                bits[r / 8] |= 1 << ( r % 8 );
+                hot++;
+            }
+        }
+        if ( hot == 0 )
+            return BSONObj();
+
+        BSONObjBuilder b;
+        b.append( "file" , mmf->filename() );
+        b.appendNumber( "length" , (long long) length );
+        b.append( "regionSize" , (int) RegionSize );
+        b.appendBinData( "regions" , bits.size() , BinDataGeneral , &bits[0] );
+        return b.obj();
+    }
+
+    void snapshotHotPages() {
+        vector<BSONObj> files;
+        {
+            LockMongoFilesShared lk;
+            set<MongoFile*>& all = MongoFile::getAllFiles();
+            for ( set<MongoFile*>::iterator i = all.begin(); i != all.end(); ++i ) {
+                if ( ! (*i)->isMongoMMF() )
+                    continue;
+                BSONObj o = hotRegions( (MongoMMF*) *i );
+                if ( ! o.isEmpty() )
+                    files.push_back( o );
+            }
+        }
+
+        // written aside and renamed over, so a crash midway leaves the last one
+        string path = hotPagesFile();
+        string tmp = path + ".tmp";
+        long long hot = 0;
+        {
+            ofstream out( tmp.c_str() , ios_base::out | ios_base::binary | ios_base::trunc );
+            for ( unsigned i = 0; i < files.size(); i++ ) {
+                out.write( files[i].objdata() , files[i].objsize() );
+                int len;
+                const unsigned char* bits = (const unsigned char*) files[i]["regions"].binData( len );
+                for ( int j = 0; j < len; j++ )
+                    for ( unsigned char k = bits[j]; k; k &= k - 1 )
+                        hot += RegionSize;
+            }
+            out.close();
+            if ( out.fail() ) {
+                warning() << "couldn't write " << tmp << endl;
+                return;
+            }
+        }
+        try {
+            boost::filesystem::remove( path );
+            boost::filesystem::rename( tmp , path );
+        }
+        catch ( boost::filesystem::filesystem_error& e ) {
+            warning() << "couldn't rename " << tmp << ": " << e.what() << endl;
+            return;
+        }
+
+        scoped_lock lk( statsMutex );
+        snapshots++;
+        hotBytes = hot;
+        LOG(1) << "noted " << ( hot / ( 1024 * 1024 ) ) << "MB of hot data file regions in " << path << endl;
+    }
+
+    struct FileNameLess {
+        bool operator()( const BSONObj& a , const BSONObj& b ) const {
+            return a["file"].str() < b["file"].str();
+        }
+    };
+
+    /** @return the files and regions the last run noted, in file order */
+    static vector<BSONObj> readHotPages() {
+        vector<BSONObj> files;
+        string path = hotPagesFile();
+        ifstream in( path.c_str() , ios_base::in | ios_base::binary );
+        if ( ! in )
+            return files;
+        while ( true ) {
+            int size;
+            in.read( (char*) &size , 4 );
+            if ( in.eof() )
+                break;
+            if ( ! in || size < 5 || size > BSONObjMaxUserSize ) {
+                warning() << "ignoring the rest of corrupt " << path << endl;
+                break;
+            }
+            boost::shared_ptr<char> buf( (char*) malloc( size ) , free );
+            memcpy( buf.get() , &size , 4 );
+            in.read( buf.get() + 4 , size - 4 );
+            BSONObj o( buf.get() );
+            if ( ! in || ! o.valid() || o["regions"].type() != BinData ) {
+                warning() << "ignoring the rest of corrupt " << path << endl;
+                break;
+            }
+            files.push_back( o.getOwned() );
+        }
+        sort( files.begin() , files.end() , FileNameLess() );
+        return files;
+    }
+
+    /** the database a data file belongs to, e.g. test for .../test.3 */
+    static string databaseOf( const string& file ) {
+        string leaf = boost::filesystem::path( file ).leaf();
+        size_t dot = leaf.rfind( '.' );
+        return dot == string::npos ? "" : leaf.substr( 0 , dot );
+    }
+
+    /**
+     * Reads the noted regions back in with MADV_WILLNEED a region at a time, pacing itself to
+     * warmRestartRateMB.  The files lock is only held per region, so a file closed meanwhile is
+     * just skipped.
+     */
+    static void prefetchHotPages() {
+        vector<BSONObj> files = readHotPages();
+        if ( files.empty() )
+            return;
+        {
+            scoped_lock lk( statsMutex );
+            prefetching = true;
+        }
+        log() << "reading back the hot regions of " << files.size() << " data files" << endl;
+
+        Timer t;
+        long long done = 0;
+        for ( unsigned i = 0; i < files.size() && ! inShutdown(); i++ ) {
+            const string file = files[i]["file"].str();
+            const unsigned regionSize = files[i]["regionSize"].numberInt();
+            if ( regionSize == 0 || ! boost::filesystem::exists( file ) )
+                continue;
+
+            // the files are mapped once the database is opened
+            string dbName = databaseOf( file );
+            if ( dbName.empty() )
+                continue;
+            try {
+                Client::ReadContext ctx( dbName );
+            }
+            catch ( DBException& e ) {
+                warning() << "couldn't open " << dbName << " to read back " << file << ": " << e << endl;
+                continue;
+            }
+
+            int len;
+            const unsigned char* bits = (const unsigned char*) files[i]["regions"].binData( len );
+            for ( long long r = 0; r < len * 8LL && ! inShutdown(); r++ ) {
+                if ( ! ( bits[r / 8] & ( 1 << ( r % 8 ) ) ) )
+                    continue;
+                {
+                    MongoFileFinder finder;
+                    MongoFile* mf = finder.findByPath( file );
+                    if ( ! mf || ! mf->isMongoMMF() )
+                        break;
+                    MongoMMF* mmf = (MongoMMF*) mf;
+                    unsigned long long ofs = r * regionSize;
+                    if ( ofs >= mmf->length() )
+                        break;
+                    unsigned n = (unsigned) min( (unsigned long long) regionSize , mmf->length() - ofs );
+                    MAdvise::willNeed( (char*) mmf->getView() + ofs , n );
+                    done += n;
+                }
+                {
+                    scoped_lock lk( statsMutex );
+                    prefetchedBytes = done;
+                }
+
+                int rate = warmRestartRateMB;
+                if ( rate > 0 ) {
+                    long long ahead = done * 1000000 / ( rate * 1024LL * 1024 ) - t.micros();
+                    if ( ahead > 0 )
+                        sleepmicros( ahead );
+                }
+            }
+        }
+
+        {
+            scoped_lock lk( statsMutex );
+            prefetching = false;
+        }
+        log() << "read back " << ( done / ( 1024 * 1024 ) ) << "MB of hot data file regions in "
+              << t.seconds() << "s" << endl;
+    }
+
+    class WarmRestart : public BackgroundJob {
+    public:
+        virtual string name() const { return "WarmRestart"; }
+
+        virtual void run() {
+            Client::initThread( name().c_str() );
+            try {
+                if ( warmRestartSecs > 0 )
+                    prefetchHotPages();
+            }
+            catch ( DBException& e ) {
+                error() << "error reading back hot pages: " << e << endl;
+            }
+
+            while ( ! inShutdown() ) {
+                // turned off, it looks in now and again in case it's turned back on
+                int secs = warmRestartSecs;
+                sleepsecs( secs > 0 ? secs : 10 );
+                if ( warmRestartSecs <= 0 || inShutdown() )
+                    continue;
+                try {
+                    snapshotHotPages();
+                }
+                catch ( std::exception& e ) {
+                    error() << "error noting hot pages: " << e.what() << endl;
+                }
+            }
+        }
+    };
+
+    void startWarmRestartJob() {
+        WarmRestart* w = new WarmRestart();
+        w->go();
+    }
+
+    void appendWarmRestartStats( BSONObjBuilder& b ) {
+        scoped_lock lk( statsMutex );
+        b.append( "snapshotSecs" , warmRestartSecs );
+        b.appendNumber( "snapshots" , snapshots );
+        b.appendNumber( "hotBytes" , hotBytes );
+        b.appendNumber( "prefetchedBytes" , prefetchedBytes );
+        b.appendBool( "prefetching" , prefetching );
+    }
+}
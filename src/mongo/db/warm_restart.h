@@ -0,0 +1,40 @@
+// warm_restart.h
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+namespace mongo {
+
+    class BSONObjBuilder;
+
+    extern int warmRestartSecs;    // --warmRestartSecs between notes of the hot pages, 0 for none
+    extern int warmRestartRateMB;  // --warmRestartRateMB the startup read back's MB/s, 0 for no limit
+
+    /**
+     * Every warmRestartSecs notes which regions of the data files are in memory in
+     * <dbpath>/hotpages.bson.  If warmRestartSecs is set at startup, it first reads back in,
+     * in file order, the regions the last run noted, while the server takes traffic.
+     */
+    void startWarmRestartJob();
+
+    /** notes the hot regions now, as at shutdown while the files are still open */
+    void snapshotHotPages();
+
+    /** serverStatus().warmRestart */
+    void appendWarmRestartStats( BSONObjBuilder& b );
+}
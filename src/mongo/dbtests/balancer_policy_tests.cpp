@@ -179,6 +179,43 @@ namespace BalancerPolicyTests {
         }
     };
 
+    class BalanceBusyShardTest {
+    public:
+        void run() {
+            // 2, 0 and 0 chunk shards, with shard1 already receiving a chunk this round
+            BalancerPolicy::ShardToChunksMap chunkMap;
+            vector<BSONObj> chunks;
+            chunks.push_back(BSON( "min" << BSON( "x" << BSON( "$minKey"<<1) ) <<
+                                   "max" << BSON( "x" << 49 )));
+            chunks.push_back(BSON( "min" << BSON( "x" << 49 ) <<
+                                   "max" << BSON( "x" << BSON( "$maxkey"<<1 ))));
+            chunkMap["shard0"] = chunks;
+            chunks.clear();
+            chunkMap["shard1"] = chunks;
+            chunkMap["shard2"] = chunks;
+
+            // no limits
+            BalancerPolicy::ShardToLimitsMap limitsMap;
+            BSONObj limits = BSON( sf::maxSize(0LL) << lf::currSize(0LL) << sf::draining(false) << lf::hasOpsQueued(false) );
+            limitsMap["shard0"] = limits;
+            limitsMap["shard1"] = limits;
+            limitsMap["shard2"] = limits;
+
+            set<string> busy;
+            busy.insert( "shard1" );
+            BalancerPolicy::ChunkInfo* c = NULL;
+            c = BalancerPolicy::balance( "ns", limitsMap, chunkMap, 1, busy );
+            ASSERT( c );
+            ASSERT_EQUALS( c->from , "shard0" );
+            ASSERT_EQUALS( c->to , "shard2" );
+
+            // with the donor busy too there's nothing to do
+            busy.insert( "shard0" );
+            c = BalancerPolicy::balance( "ns", limitsMap, chunkMap, 1, busy );
+            ASSERT( ! c );
+        }
+    };
+
 //
 // TODO SERVER-1822
 //
@@ -197,6 +234,7 @@ namespace BalancerPolicyTests {
             // add< BalanceDrainingTest >();
             // add< BalanceEndedDrainingTest >();
             // add< BalanceImpasseTest >();
+            // add< BalanceBusyShardTest >();
         }
     } allTests;
 
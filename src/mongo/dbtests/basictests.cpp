@@ -27,6 +27,8 @@
 #include "../util/paths.h"
 #include "../util/stringutils.h"
 #include "../util/compress.h"
+#include "../util/arena.h"
+#include "../util/checksum.h"
 #include "../db/db.h"
 
 namespace BasicTests {
@@ -587,6 +589,18 @@ namespace BasicTests {
             bad("\xF5\x80\x80\x80"); // U+140000 > U+10FFFF
             bad("\x80"); //cant start with continuation byte
             bad("\xC0\x80"); // 2-byte version of ASCII NUL
+
+            // runs of ascii, checked a word at a time, around the multibyte ones from every
+            // alignment
+            for ( int i = 0; i < 17; i++ ) {
+                string pad( i , 'x' );
+                good(pad);
+                good(pad + "\xE2\x82\xAC" + pad + pad);
+                good(pad + pad + "\xF0\x9D\x90\x80");
+                bad(pad + pad + "\xC2");
+                bad(pad + "\x80" + pad + pad);
+                bad(pad + pad + pad + "\xE2\x82" + pad);
+            }
 #undef good
 #undef bad
         }
@@ -605,6 +619,33 @@ namespace BasicTests {
         }
     };
 
+    static size_t intSize( const int& i ) { return i; }
+
+    class QueueRunTest {
+    public:
+        void run() {
+            BlockingQueue<int> q( 10 , &intSize );
+            int a[] = { 4 , 5 , 1 };
+            q.pushAll( a , a + 3 );
+            ASSERT_EQUALS( 3u , q.count() );
+            ASSERT_EQUALS( 10u , q.size() );
+
+            vector<int> run;
+            ASSERT_EQUALS( 2u , q.peekRun( 1 , 5 , &run ) );
+            ASSERT_EQUALS( 5 , run[0] );
+            ASSERT_EQUALS( 1 , run[1] );
+            ASSERT_EQUALS( 0u , q.peekRun( 3 , 5 , &run ) );
+
+            ASSERT_EQUALS( 3u , q.popFront( 5 ) );
+            ASSERT( q.empty() );
+            ASSERT_EQUALS( 0u , q.size() );
+
+            // bigger than the whole queue, but it is empty so gets in anyway
+            q.push( 25 );
+            ASSERT_EQUALS( 25u , q.size() );
+        }
+    };
+
     class StrTests {
     public:
 
@@ -723,6 +764,122 @@ namespace BasicTests {
         Tee _tee;
     };
 
+    namespace ArenaTests {
+
+        /** builders draw from the current arena, and the last buffer grows in place */
+        class Basic {
+        public:
+            void run() {
+                Arena arena;
+                Arena::Scope scope( arena );
+                ASSERT( Arena::current() == &arena );
+                ArenaBufBuilder a( 64 );
+                char *first = a.buf();
+                for( int i = 0; i < 1000; ++i )
+                    a.appendNum( i );
+                ASSERT( a.buf() == first );
+                ASSERT_EQUALS( 999, ((int *) a.buf())[999] );
+
+                ArenaStringBuilder s;
+                s << "arena" << 5;
+                ASSERT_EQUALS( "arena5", s.str() );
+
+                // a nested scope doesn't take over or reset the arena
+                {
+                    Arena other;
+                    Arena::Scope nested( other );
+                    ASSERT( Arena::current() == &arena );
+                }
+                unsigned generation = arena.generation();
+                ArenaBufBuilder b;
+                ASSERT_EQUALS( generation, arena.generation() );
+            }
+        };
+
+        /** buffers past MaxAllocation, or built outside a scope, come from malloc */
+        class Fallback {
+        public:
+            void run() {
+                ASSERT( Arena::current() == 0 );
+                ArenaBufBuilder outside;
+                outside.appendStr( "x" );
+
+                Arena arena;
+                {
+                    Arena::Scope scope( arena );
+                    ArenaBufBuilder b( 64 );
+                    for( int i = 0; i <= Arena::MaxAllocation; ++i )
+                        b.appendChar( (char) i );
+                    ASSERT_EQUALS( (char) 7, b.buf()[7] );
+                    ASSERT_EQUALS( (char) 12345, b.buf()[12345] );
+                }
+                ASSERT( Arena::current() == 0 );
+                ASSERT_EQUALS( 1U, arena.generation() );
+            }
+        };
+
+        /** the most recent allocation is given back, and reset reclaims everything */
+        class ReleaseAndReset {
+        public:
+            void run() {
+                Arena arena;
+                void *p = arena.allocate( 100 );
+                arena.release( p, 100 );
+                ASSERT( arena.allocate( 100 ) == p );
+                for( int i = 0; i < 100; ++i )
+                    ASSERT( arena.allocate( Arena::MaxAllocation ) );
+                ASSERT( arena.allocate( Arena::MaxAllocation + 1 ) == 0 );
+                arena.reset();
+                ASSERT( arena.allocate( 8 ) == p );
+            }
+        };
+
+        /** a BSONObjBuilder built in an arena block, which goes back when the builder does */
+        class BSONObjBuilderBlock {
+        public:
+            void run() {
+                Arena arena;
+                Arena::Scope scope( arena );
+                BSONObj kept;
+                void *block;
+                {
+                    ArenaBSONObjBuilder b( 256 );
+                    block = b.bb().buf();
+                    b.append( "a" , 1 );
+                    BSONObj temp = b.done();
+                    ASSERT( temp.objdata() >= (char *) block &&
+                            temp.objdata() < (char *) block + 256 );
+                    kept = b.obj();
+                    ASSERT( kept.objdata() != temp.objdata() );
+                }
+                ASSERT_EQUALS( BSON( "a" << 1 ) , kept );
+                // the block was the last allocation, so the next builder has it again
+                ArenaBSONObjBuilder c( 256 );
+                ASSERT( c.bb().buf() == block );
+            }
+        };
+
+    } // namespace ArenaTests
+
+    /** the check value and the iSCSI vectors of RFC 3720, whole and in pieces at odd alignments */
+    class Crc32cTests {
+    public:
+        void run() {
+            ASSERT_EQUALS( 0xe3069283U , crc32c( "123456789" , 9 ) );
+            char buf[ 40 ];
+            memset( buf , 0 , sizeof( buf ) );
+            ASSERT_EQUALS( 0x8a9136aaU , crc32c( buf + 3 , 32 ) );
+            memset( buf , 0xff , sizeof( buf ) );
+            ASSERT_EQUALS( 0x62a8ab43U , crc32c( buf + 1 , 32 ) );
+            for ( int i = 0; i < 32; i++ )
+                buf[ i ] = i;
+            ASSERT_EQUALS( 0x46dd794eU , crc32c( buf , 32 ) );
+            for ( int k = 0; k <= 32; k++ )
+                ASSERT_EQUALS( 0x46dd794eU , crc32c( buf + k , 32 - k , crc32c( buf , k ) ) );
+            ASSERT_EQUALS( 0U , crc32c( buf , 0 ) );
+        }
+    };
+
 
     class All : public Suite {
     public:
@@ -756,6 +913,7 @@ namespace BasicTests {
             add< IsValidUTF8Test >();
 
             add< QueueTest >();
+            add< QueueRunTest >();
 
             add< StrTests >();
 
@@ -766,6 +924,13 @@ namespace BasicTests {
             add< CompressionTest1 >();
 
             add< LogTee >();
+
+            add< ArenaTests::Basic >();
+            add< ArenaTests::Fallback >();
+            add< ArenaTests::ReleaseAndReset >();
+            add< ArenaTests::BSONObjBuilderBlock >();
+
+            add< Crc32cTests >();
         }
     } myall;
 
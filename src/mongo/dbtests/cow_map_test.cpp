@@ -0,0 +1,129 @@
+// cow_map_test.cpp : cow_map.h unit tests
+
+/**
+ *    Copyright (C) 2012 10gen Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../pch.h"
+
+#include "dbtests.h"
+#include "../util/cow_map.h"
+
+namespace CowMapTests {
+
+    typedef mongo::CowMap<int,int> IntMap;
+
+    static void assertSame( const IntMap& m , const map<int,int>& expected ) {
+        ASSERT_EQUALS( m.size() , expected.size() );
+        map<int,int>::const_iterator j = expected.begin();
+        for ( IntMap::const_iterator i = m.begin(); i != m.end(); ++i, ++j ) {
+            ASSERT_EQUALS( i->first , j->first );
+            ASSERT_EQUALS( i->second , j->second );
+        }
+        if ( ! m.empty() )
+            ASSERT_EQUALS( boost::prior( m.end() )->first , expected.rbegin()->first );
+    }
+
+    class Lookups {
+    public:
+        void run() {
+            IntMap m;
+            ASSERT( m.begin() == m.end() );
+            ASSERT( m.find( 1 ) == m.end() );
+
+            // enough to span several leaves
+            for ( int i = 0; i < 1000; i++ )
+                ASSERT( m.insert( make_pair( i * 2 , i ) ).second );
+            ASSERT( ! m.insert( make_pair( 10 , 0 ) ).second );
+            ASSERT_EQUALS( m.size() , 1000u );
+
+            ASSERT_EQUALS( m.find( 10 )->second , 5 );
+            ASSERT( m.find( 11 ) == m.end() );
+            ASSERT_EQUALS( m.lower_bound( 11 )->first , 12 );
+            ASSERT_EQUALS( m.lower_bound( 12 )->first , 12 );
+            ASSERT_EQUALS( m.upper_bound( 12 )->first , 14 );
+            ASSERT( m.upper_bound( 1998 ) == m.end() );
+            ASSERT_EQUALS( m.lower_bound( -5 )->first , 0 );
+        }
+    };
+
+    class Erase {
+    public:
+        void run() {
+            IntMap m;
+            map<int,int> expected;
+            for ( int i = 0; i < 1000; i++ ) {
+                m[i] = i;
+                expected[i] = i;
+            }
+
+            m.erase( m.lower_bound( 100 ) , m.lower_bound( 700 ) );
+            expected.erase( expected.lower_bound( 100 ) , expected.lower_bound( 700 ) );
+            assertSame( m , expected );
+
+            ASSERT_EQUALS( m.erase( 5 ) , 1u );
+            ASSERT_EQUALS( m.erase( 5 ) , 0u );
+            expected.erase( 5 );
+            assertSame( m , expected );
+
+            m.erase( m.begin() , m.end() );
+            ASSERT( m.empty() );
+            m.insert( make_pair( 3 , 3 ) );
+            ASSERT_EQUALS( m.begin()->first , 3 );
+        }
+    };
+
+    /** changing a copy leaves the original, and other copies, as they were */
+    class CopiesAreIndependent {
+    public:
+        void run() {
+            IntMap m;
+            map<int,int> expected;
+            for ( int i = 0; i < 1000; i++ ) {
+                m[i] = i;
+                expected[i] = i;
+            }
+
+            IntMap a = m;
+            IntMap b = m;
+            map<int,int> expectedA = expected;
+
+            a[500] = -1;
+            a.erase( 10 );
+            a.insert( make_pair( 5000 , 5000 ) );
+            expectedA[500] = -1;
+            expectedA.erase( 10 );
+            expectedA[5000] = 5000;
+
+            b.clear();
+
+            assertSame( m , expected );
+            assertSame( a , expectedA );
+            ASSERT( b.empty() );
+        }
+    };
+
+    class All : public Suite {
+    public:
+        All() : Suite( "cow_map" ) {}
+
+        void setupTests() {
+            add< Lookups >();
+            add< Erase >();
+            add< CopiesAreIndependent >();
+        }
+    } myall;
+
+} // namespace CowMapTests
@@ -97,6 +97,12 @@ namespace mongo {
         };
 
         unsigned perfHist = 1;
+        unsigned perfRepeat = 1;
+        unsigned perfWarmup = 0;
+        string perfOut;
+        string perfBaseline;
+        double perfThreshold = 10;
+        string perfOplog;
 
         int runDbTests( int argc , char** argv , string default_dbpath ) {
             unsigned long long seed = time( 0 );
@@ -121,6 +127,12 @@ namespace mongo {
             ("nodur", "disable journaling")
             ("seed", po::value<unsigned long long>(&seed), "random number seed")
             ("perfHist", po::value<unsigned>(&perfHist), "number of back runs of perf stats to display")
+            ("perfRepeat", po::value<unsigned>(&perfRepeat), "timed runs of each perf test, for a confidence interval")
+            ("perfWarmup", po::value<unsigned>(&perfWarmup), "untimed runs of each perf test before the timed ones")
+            ("perfOut", po::value<string>(&perfOut), "file to append perf results to, one JSON object per test")
+            ("perfBaseline", po::value<string>(&perfBaseline), "perfOut file of an earlier run; perf tests slower than it fail")
+            ("perfThreshold", po::value<double>(&perfThreshold), "percent slower than perfBaseline which counts as a regression (default 10)")
+            ("perfOplog", po::value<string>(&perfOplog), "oplog entries, e.g. a mongodump of local.oplog.rs, for the oplog-apply perf tests to apply instead of generated ones")
             ;
 
             hidden_options.add_options()
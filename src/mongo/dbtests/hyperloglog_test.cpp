@@ -0,0 +1,80 @@
+// hyperloglog_test.cpp : hyperloglog.h unit tests
+
+/**
+ *    Copyright (C) 2012 10gen Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../pch.h"
+
+#include "dbtests.h"
+#include "../util/hyperloglog.h"
+
+namespace HyperLogLogTests {
+
+    typedef mongo::HyperLogLog<10> Sketch;
+
+    static void assertNear( double estimate , double actual ) {
+        // a little over three standard errors
+        ASSERT( fabs( estimate - actual ) <= 0.1 * actual + 1 );
+    }
+
+    class Estimates {
+    public:
+        void run() {
+            Sketch s;
+            assertNear( s.estimate() , 0 );
+
+            unsigned long long added = 0;
+            const unsigned long long counts[] = { 10 , 1000 , 100000 };
+            for ( int c = 0; c < 3; c++ ) {
+                for ( ; added < counts[c]; added++ )
+                    s.add( Sketch::hash( added ) );
+                assertNear( s.estimate() , counts[c] );
+            }
+
+            // repeats don't count
+            for ( unsigned long long i = 0; i < 1000; i++ )
+                s.add( Sketch::hash( i ) );
+            assertNear( s.estimate() , 100000 );
+
+            s.clear();
+            assertNear( s.estimate() , 0 );
+        }
+    };
+
+    class Merge {
+    public:
+        void run() {
+            Sketch a, b;
+            for ( unsigned long long i = 0; i < 20000; i++ )
+                a.add( Sketch::hash( i ) );
+            for ( unsigned long long i = 10000; i < 40000; i++ )
+                b.add( Sketch::hash( i ) );
+            a.merge( b );
+            assertNear( a.estimate() , 40000 );
+        }
+    };
+
+    class All : public Suite {
+    public:
+        All() : Suite( "hyperloglog" ) {}
+
+        void setupTests() {
+            add< Estimates >();
+            add< Merge >();
+        }
+    } myall;
+
+} // namespace HyperLogLogTests
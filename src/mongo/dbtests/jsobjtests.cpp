@@ -110,6 +110,42 @@ namespace JsobjTests {
         }
     };
 
+    /** builds in its own space until outgrown, and obj() copies out of it */
+    class StackBSONObjBuilderBasic {
+    public:
+        void run() {
+            StackBSONObjBuilder<64> b;
+            const char *start = b.bb().buf();
+            ASSERT( b.bb().onCallersBuffer() );
+            b.append( "a" , 1 );
+            ASSERT( b.done().objdata() > start && b.done().objdata() < start + 64 );
+
+            StackBSONObjBuilder<64> c;
+            c.append( "a" , 1 );
+            BSONObj o = c.obj();
+            ASSERT( ! c.bb().buf() );
+            ASSERT_EQUALS( BSON( "a" << 1 ) , o );
+            ASSERT( o.isOwned() );
+
+            // past its space it spills to the heap, and obj() hands that over as usual
+            StackBSONObjBuilder<64> d;
+            for ( int i = 0; i < 50; i++ )
+                d.append( BSONObjBuilder::numStr( i ) , i );
+            ASSERT( ! d.bb().onCallersBuffer() );
+            BSONObj big = d.obj();
+            ASSERT_EQUALS( 50 , big.nFields() );
+            ASSERT_EQUALS( 49 , big[ "49" ].numberInt() );
+
+            // sub-builders share its buffer
+            StackBSONObjBuilder<> e;
+            e.append( "x" , 1 );
+            BSONObjBuilder sub( e.subobjStart( "sub" ) );
+            sub.append( "y" , 2 );
+            sub.done();
+            ASSERT_EQUALS( BSON( "x" << 1 << "sub" << BSON( "y" << 2 ) ) , e.done() );
+        }
+    };
+
     class BSONElementBasic {
     public:
         void run() {
@@ -313,6 +349,109 @@ namespace JsobjTests {
             }
         };
 
+        /** normalized keys sort by their bytes as the keys do, and decode back to the keys */
+        class NormalizedKeys : public Base {
+        public:
+            void run() {
+                vector<BSONObj> values;
+                values.push_back( BSONObjBuilder().appendMinKey( "" ).obj() );
+                values.push_back( BSONObjBuilder().appendMaxKey( "" ).obj() );
+                values.push_back( BSONObjBuilder().appendNull( "" ).obj() );
+                {
+                    BSONObjBuilder b;
+                    b.appendUndefined( "" );
+                    values.push_back( b.obj() );
+                }
+                values.push_back( BSON( "" << numeric_limits<double>::quiet_NaN() ) );
+                values.push_back( BSON( "" << -numeric_limits<double>::infinity() ) );
+                values.push_back( BSON( "" << -1.5 ) );
+                values.push_back( BSON( "" << -1 ) );
+                values.push_back( BSON( "" << -0.0 ) );
+                values.push_back( BSON( "" << 0 ) );
+                values.push_back( BSON( "" << 0LL ) );
+                values.push_back( BSON( "" << 1 ) );
+                values.push_back( BSON( "" << 1.0 ) );
+                values.push_back( BSON( "" << 1.5 ) );
+                values.push_back( BSON( "" << 3LL ) );
+                values.push_back( BSON( "" << 1e300 ) );
+                values.push_back( BSON( "" << "" ) );
+                values.push_back( BSON( "" << "a" ) );
+                values.push_back( BSON( "" << string( "a\0", 2 ) ) );
+                values.push_back( BSON( "" << string( "a\0b", 3 ) ) );
+                values.push_back( BSON( "" << "a\x01" ) );
+                values.push_back( BSON( "" << "ab" ) );
+                values.push_back( BSON( "" << "\xff" ) );
+                values.push_back( BSONObjBuilder().appendSymbol( "", "ab" ).obj() );
+                values.push_back( BSONObjBuilder().appendCode( "", "abc" ).obj() );
+                values.push_back( BSON( "" << BSONObj() ) );
+                values.push_back( BSON( "" << BSON( "a" << 1 ) ) );
+                values.push_back( BSON( "" << BSON( "a" << "x" ) ) );
+                values.push_back( BSON( "" << BSON( "a" << 1 << "b" << 1 ) ) );
+                values.push_back( BSON( "" << BSON( "ab" << 1 ) ) );
+                values.push_back( BSON( "" << BSON( "b" << 0 ) ) );
+                values.push_back( BSON( "" << BSONArray() ) );
+                values.push_back( BSON( "" << BSON_ARRAY( 1 << 2 ) ) );
+                values.push_back( BSON( "" << BSON_ARRAY( 1 << BSON_ARRAY( "x" ) ) ) );
+                values.push_back( BSONObjBuilder().appendBinData( "", 3, BinDataGeneral, "abc" ).obj() );
+                values.push_back( BSONObjBuilder().appendBinData( "", 3, (BinDataType) 4, "abc" ).obj() );
+                values.push_back( BSONObjBuilder().appendBinData( "", 4, BinDataGeneral, "abcd" ).obj() );
+                values.push_back( BSONObjBuilder().appendBinData( "", 0, BinDataGeneral, "" ).obj() );
+                values.push_back( BSON( "" << OID( "000000000000000000000000" ) ) );
+                values.push_back( BSON( "" << OID( "ffffffffffffffffffffffff" ) ) );
+                values.push_back( BSON( "" << false ) );
+                values.push_back( BSON( "" << true ) );
+                values.push_back( BSONObjBuilder().appendDate( "", -50 ).obj() );
+                values.push_back( BSONObjBuilder().appendDate( "", 0 ).obj() );
+                values.push_back( BSONObjBuilder().appendDate( "", 50 ).obj() );
+
+                // single fields each way, and pairs with the second descending
+                check( values , BSON( "a" << 1 ) );
+                check( values , BSON( "a" << -1 ) );
+                vector<BSONObj> pairs;
+                for ( unsigned i = 0; i < values.size(); i += 3 ) {
+                    for ( unsigned j = 0; j < values.size(); j += 5 ) {
+                        BSONObjBuilder b;
+                        b.appendAs( values[i].firstElement() , "" );
+                        b.appendAs( values[j].firstElement() , "" );
+                        pairs.push_back( b.obj() );
+                    }
+                }
+                check( pairs , BSON( "a" << 1 << "b" << -1 ) );
+
+                Ordering o = Ordering::make( BSON( "a" << 1 ) );
+                KeyNormalized k;
+                ASSERT( ! k.normalize( BSONObjBuilder().appendRegex( "", "a" ).obj() , o ) );
+                ASSERT( ! k.normalize( BSONObjBuilder().appendTimestamp( "", 5 ).obj() , o ) );
+                ASSERT( ! k.normalize( BSON( "" << ( 1LL << 53 ) + 1 ) , o ) );
+                ASSERT( k.isEmpty() );
+                ASSERT( k.normalize( BSON( "" << ( 1LL << 53 ) ) , o ) );
+            }
+        private:
+            static int sign( int x ) { return x < 0 ? -1 : x > 0 ? 1 : 0; }
+
+            void check( const vector<BSONObj>& keys , const BSONObj& pattern ) {
+                Ordering o = Ordering::make( pattern );
+                vector<KeyNormalized> n( keys.size() );
+                for ( unsigned i = 0; i < keys.size(); i++ ) {
+                    ASSERT( n[i].normalize( keys[i] , o ) );
+                    BSONObj back = n[i].toBson( o );
+                    if ( isNaN( keys[i].firstElement().number() ) )
+                        ASSERT( isNaN( back.firstElement().number() ) );
+                    else
+                        ASSERT( back.binaryEqual( keys[i] ) );
+                }
+                for ( unsigned i = 0; i < keys.size(); i++ ) {
+                    for ( unsigned j = 0; j < keys.size(); j++ ) {
+                        int want = sign( keys[i].woCompare( keys[j] , o , false ) );
+                        if ( want != sign( n[i].compare( n[j] ) ) ) {
+                            log() << keys[i] << " " << keys[j] << " " << pattern << endl;
+                            ASSERT_EQUALS( want , sign( n[i].compare( n[j] ) ) );
+                        }
+                    }
+                }
+            }
+        };
+
         class TimestampTest : public Base {
         public:
             void run() {
@@ -831,6 +970,16 @@ namespace JsobjTests {
                 ASSERT_EQUALS( 3 , o.getFieldDotted( "c.0.a" ).numberInt() );
                 ASSERT_EQUALS( 4 , o.getFieldDotted( "c.1.a" ).numberInt() );
                 keyTest(o);
+
+                // names sharing a first byte or a prefix with another field
+                BSONObj p = BSON( "ab" << 1 << "a" << 2 << "" << 3 << "abc" << BSON( "d" << 4 ) );
+                ASSERT_EQUALS( 1 , p.getField( "ab" ).numberInt() );
+                ASSERT_EQUALS( 2 , p.getField( "a" ).numberInt() );
+                ASSERT_EQUALS( 3 , p.getField( "" ).numberInt() );
+                ASSERT( p.getField( "abcd" ).eoo() );
+                ASSERT_EQUALS( 1 , p.getField( "abc.d" , 2 ).numberInt() );
+                ASSERT_EQUALS( 4 , p.getFieldDotted( "abc.d" ).numberInt() );
+                ASSERT( p.getFieldDotted( "ab.d" ).eoo() );
             }
         };
 
@@ -1124,6 +1273,40 @@ namespace JsobjTests {
                 BSONType type_;
             };
 
+            // Every single bit flip of a varied object: whatever valid() lets through has to
+            // hold together when walked.
+            class BitFlips {
+            public:
+                void run() {
+                    BSONObj orig = fromjson( "{\"one\":2, \"two\":\"abc\", \"three\": {},"
+                                             "\"four\": { \"five\": { \"six\" : 11 } },"
+                                             "\"seven\": [ \"a\", \"bb\", \"ccc\", 5 ],"
+                                             "\"eight\": Dbref( \"rrr\", \"01234567890123456789aaaa\" ),"
+                                             "\"nine\": { \"$binary\": \"abc=\", \"$type\": \"00\" },"
+                                             "\"ten\": Date( 44 ), \"eleven\": /foooooo/i }" );
+                    BSONObjBuilder b;
+                    b.appendElements( orig );
+                    b.appendCodeWScope( "twelve" , "return x;" , BSON( "x" << 1 ) );
+                    BSONObj o = b.obj();
+                    ASSERT( o.valid() );
+
+                    int accepted = 0;
+                    for( int i = 4; i < o.objsize(); ++i ) {
+                        for( unsigned char j = 1; j; j <<= 1 ) {
+                            BSONObj c = o.copy();
+                            const_cast< char * >( c.objdata() )[ i ] ^= j;
+                            if ( ! c.valid() )
+                                continue;
+                            accepted++;
+                            c.toString();
+                            ASSERT( c.copy().equal( c ) );
+                        }
+                    }
+                    // the ones that only change a value
+                    ASSERT( accepted > 0 );
+                }
+            };
+
             // Randomized BSON parsing test.  See if we seg fault.
             // NOTE This test is disabled (below), see SERVER-4948.
             class Fuzz {
@@ -1726,6 +1909,65 @@ namespace JsobjTests {
             }
         };
 
+        /** big enough to be sorted in pieces on several threads, read back through AsyncIterator */
+        class ParallelInMemory {
+        public:
+            void run() {
+                const int total = 200000;
+                BSONObjExternalSorter sorter( indexInterfaceForTheseTests );
+                for ( int i=0; i<total; i++ ) {
+                    sorter.add( BSON( "x" << rand() % 50000 ) , 5 , i );
+                }
+
+                sorter.sort();
+                ASSERT_EQUALS( 0 , sorter.numFiles() );
+
+                auto_ptr<BSONObjExternalSorter::AsyncIterator> i = sorter.asyncIterator();
+                int num=0;
+                BSONObjExternalSorter::Data prev;
+                while ( i->more() ) {
+                    BSONObjExternalSorter::Data p = i->next();
+                    if ( num > 0 ) {
+                        int c = p.first["x"].numberInt() - prev.first["x"].numberInt();
+                        ASSERT( c > 0 || ( c == 0 && prev.second.compare( p.second ) < 0 ) );
+                    }
+                    prev = p;
+                    num++;
+                }
+                ASSERT_EQUALS( total , num );
+            }
+        };
+
+        class AsyncMerge {
+        public:
+            void run() {
+                const int total = 20000;
+                BSONObjExternalSorter sorter( indexInterfaceForTheseTests, BSONObj() , 20000 );
+                for ( int i=0; i<total; i++ ) {
+                    sorter.add( BSON( "x" << rand() % 10000 ) , 5 , i );
+                }
+
+                sorter.sort();
+                ASSERT( sorter.numFiles() > 2 );
+
+                auto_ptr<BSONObjExternalSorter::AsyncIterator> i = sorter.asyncIterator();
+                int num=0;
+                double prev = 0;
+                while ( i->more() ) {
+                    double cur = i->next().first["x"].number();
+                    ASSERT( cur >= prev );
+                    prev = cur;
+                    num++;
+                }
+                ASSERT_EQUALS( total , num );
+
+                // stopping part way through must not hang
+                auto_ptr<BSONObjExternalSorter::AsyncIterator> j = sorter.asyncIterator();
+                ASSERT( j->more() );
+                j->next();
+            }
+        };
+
         class D1 {
         public:
             void run() {
@@ -2244,6 +2486,7 @@ namespace JsobjTests {
 
         void setupTests() {
             add< BufBuilderBasic >();
+            add< StackBSONObjBuilderBasic >();
             add< BSONElementBasic >();
             add< BSONObjTests::NullString >();
             add< BSONObjTests::Create >();
@@ -2256,6 +2499,7 @@ namespace JsobjTests {
             add< BSONObjTests::WoSortOrder >();
             add< BSONObjTests::IsPrefixOf >();
             add< BSONObjTests::MultiKeySortOrder > ();
+            add< BSONObjTests::NormalizedKeys >();
             add< BSONObjTests::TimestampTest >();
             add< BSONObjTests::Nan >();
             add< BSONObjTests::AsTempObj >();
@@ -2295,6 +2539,7 @@ namespace JsobjTests {
             add< BSONObjTests::Validation::NoSize >( Object );
             add< BSONObjTests::Validation::NoSize >( Array );
             add< BSONObjTests::Validation::NoSize >( BinData );
+            add< BSONObjTests::Validation::BitFlips >();
             if ( 0 ) { // SERVER-4948
             add< BSONObjTests::Validation::Fuzz >( .5 );
             add< BSONObjTests::Validation::Fuzz >( .1 );
@@ -2332,6 +2577,8 @@ namespace JsobjTests {
             add< external_sort::ByDiskLock >();
             add< external_sort::Big1 >();
             add< external_sort::Big2 >();
+            add< external_sort::ParallelInMemory >();
+            add< external_sort::AsyncMerge >();
             add< external_sort::D1 >();
             add< CompatBSON >();
             add< CompareDottedFieldNamesTest >();
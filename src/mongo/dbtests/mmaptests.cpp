@@ -103,11 +103,62 @@ namespace MMapTests {
         }
     };
 
+#if !defined(_WIN32)
+    /** remapping the private view only resets the chunks noted as dirty */
+    class RemapDirtyChunksTest {
+        const string fn;
+        const int optOld;
+    public:
+        RemapDirtyChunksTest() :
+            fn( (boost::filesystem::path(dbpath) / "testremap.map").string() ), optOld(cmdLine.durOptions)
+        { 
+            cmdLine.durOptions = 0; // the private view deliberately differs from the file here
+        }
+        ~RemapDirtyChunksTest() {
+            cmdLine.durOptions = optOld;
+            try { boost::filesystem::remove(fn); }
+            catch(...) { }
+        }
+        void run() {
+            if( !cmdLine.dur )
+                return;
+
+            try { boost::filesystem::remove(fn); }
+            catch(...) { }
+
+            Lock::GlobalWrite lk;
+
+            MongoMMF f;
+            unsigned long long len = 4 * 1024 * 1024;
+            verify( f.create(fn, len, /*sequential*/false) );
+            char *p = (char *) f.getView();
+            char *w = (char *) f.view_write();
+            const unsigned far = 2 * 1024 * 1024 + 100;
+
+            // only the first write is noted, as if only it had been journaled
+            p[10] = 'a';
+            p[far] = 'b';
+            f.noteDirty(10, 1);
+            f.remapThePrivateView();
+            ASSERT_EQUALS( w[10], p[10] );
+            ASSERT_EQUALS( 'b', p[far] );
+
+            // with most of the file dirty the whole view is remapped
+            f.noteDirty(0, (unsigned) len);
+            f.remapThePrivateView();
+            ASSERT_EQUALS( w[far], p[far] );
+        }
+    };
+#endif
+
     class All : public Suite {
     public:
         All() : Suite( "mmap" ) {}
         void setupTests() {
             add< LeakTest >();
+#if !defined(_WIN32)
+            add< RemapDirtyChunksTest >();
+#endif
         }
     } myall;
 
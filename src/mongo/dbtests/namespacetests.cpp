@@ -444,6 +444,35 @@ namespace NamespaceTests {
 
         };
 
+        /** repeated array members give one key each, in order, owned beyond the document */
+        class ArrayDuplicates : public Base {
+        public:
+            void run() {
+                create();
+                BSONObjSet keys;
+                {
+                    BSONObj obj = fromjson( "{a:[3,1,{b:5},3,2,1,{b:5}],c:'x'}" );
+                    id().getKeysFromObject( obj, keys );
+                }
+                checkSize( 4, keys );
+                BSONObjSet::iterator i = keys.begin();
+                assertEquals( BSON( "" << 1 << "" << "x" ), *i++ );
+                assertEquals( BSON( "" << 2 << "" << "x" ), *i++ );
+                assertEquals( BSON( "" << 3 << "" << "x" ), *i++ );
+                assertEquals( BSON( "" << BSON( "b" << 5 ) << "" << "x" ), *i++ );
+                for( i = keys.begin(); i != keys.end(); ++i )
+                    ASSERT( i->isOwned() );
+
+                // added to keys already there, as when an update compares old and new keys
+                id().getKeysFromObject( fromjson( "{a:[2,4],c:'x'}" ), keys );
+                checkSize( 5, keys );
+            }
+        private:
+            virtual BSONObj key() const {
+                return BSON( "a" << 1 << "c" << 1 );
+            }
+        };
+
         class ArraySubelementComplex : public Base {
         public:
             void run() {
@@ -1264,6 +1293,28 @@ namespace NamespaceTests {
                 assertCachedIndexKey( BSON( "a" << 1 ) );
             }
         };
+
+        /** the Client's cached NamespaceDetails and transient go with a drop */
+        class CachedLookupDropped : public Base {
+        public:
+            void run() {
+                create();
+                NamespaceDetails *d = nsdetails( ns() );
+                ASSERT( d );
+                ASSERT_EQUALS( d, nsdetails( ns() ) );
+                ASSERT_EQUALS( d, cc().nsCache().details( nsindex( ns() ), ns() ) );
+                NamespaceDetailsTransient *t = &nsdt();
+                ASSERT_EQUALS( t, &nsdt() );
+                ASSERT_EQUALS( t, cc().nsCache().transient( ns() ) );
+
+                string errmsg;
+                BSONObjBuilder result;
+                dropCollection( ns(), errmsg, result );
+                ASSERT( !cc().nsCache().details( nsindex( ns() ), ns() ) );
+                ASSERT( !cc().nsCache().transient( ns() ) );
+                ASSERT( !nsdetails( ns() ) );
+            }
+        };
         
     } // namespace NamespaceDetailsTests
 
@@ -1282,7 +1333,76 @@ namespace NamespaceTests {
                 assertCachedIndexKey( BSONObj() );
             }
         };                                                                                         
+
+        /** expireQueryCache() keeps the plans of patterns which chose the same index repeatedly. */
+        class ExpireQueryCacheKeepsStablePlans : public NamespaceDetailsTests::CachedPlanBase {
+        public:
+            void run() {
+                // One win isn't a stable history.
+                registerIndexKey( BSON( "a" << 1 ) );
+                nsdt().expireQueryCache();
+                assertCachedIndexKey( BSONObj() );
+
+                // A different index starts a new history.
+                registerIndexKey( BSON( "b" << 1 ) );
+                registerIndexKey( BSON( "a" << 1 ) );
+                registerIndexKey( BSON( "a" << 1 ) );
+                nsdt().expireQueryCache();
+                assertCachedIndexKey( BSONObj() );
+
+                registerIndexKey( BSON( "a" << 1 ) );
+                nsdt().expireQueryCache();
+                assertCachedIndexKey( BSON( "a" << 1 ) );
+
+                // Clearing a pattern's plan, as done when the plan performs badly, forgets it.
+                nsdt().registerCachedQueryPlanForPattern( _pattern, CachedQueryPlan() );
+                nsdt().expireQueryCache();
+                assertCachedIndexKey( BSONObj() );
+
+                // clearQueryCache() forgets the history as well.
+                for( int i = 0; i < QueryPlanHistory::StableWins; ++i ) {
+                    registerIndexKey( BSON( "a" << 1 ) );
+                }
+                nsdt().clearQueryCache();
+                assertCachedIndexKey( BSONObj() );
+            }
+        };
         
+        /** RecordGrowth pads each size class for the growth of its own updates. */
+        class RecordGrowthPadding : public NamespaceDetailsTests::Base {
+        public:
+            void run() {
+                create();
+                RecordGrowth growth;
+                ASSERT_EQUALS( 1.3, growth.padding( 1000, 1.3 ) );
+
+                // small documents double, large ones don't grow; a tenth of them may still move
+                for ( int i = 0; i < RecordGrowth::WindowSize; ++i ) {
+                    growth.noteUpdate( nsd(), 100, i % 10 == 0 ? 400 : 200, i % 10 == 0, 2 );
+                    growth.noteUpdate( nsd(), 10000, 10000, false, 0 );
+                }
+                ASSERT_EQUALS( 2.0, growth.padding( 100 + Record::HeaderSize, 1.3 ) );
+                ASSERT_EQUALS( 1.0, growth.padding( 10000 + Record::HeaderSize, 1.3 ) );
+                ASSERT_EQUALS( 1.3, growth.padding( 1000, 1.3 ) );
+                ASSERT_EQUALS( 1.5, nsd()->paddingFactor() );
+
+                // the next window only moves the padding half way
+                for ( int i = 0; i < RecordGrowth::WindowSize; ++i )
+                    growth.noteUpdate( nsd(), 100, 110, false, 0 );
+                ASSERT( fabs( growth.padding( 100 + Record::HeaderSize, 1.3 ) - 1.55 ) < 1e-9 );
+
+                BSONObjBuilder b;
+                growth.appendStats( b );
+                BSONObj stats = b.obj();
+                ASSERT_EQUALS( 3 * RecordGrowth::WindowSize, stats[ "updates" ].numberInt() );
+                ASSERT_EQUALS( RecordGrowth::WindowSize / 10 + 1, stats[ "moves" ].numberInt() );
+                ASSERT_EQUALS( 2 * stats[ "moves" ].numberInt(),
+                               stats[ "indexKeysRewritten" ].numberInt() );
+            }
+        private:
+            virtual string spec() const { return "{}"; }
+        };
+
     } // namespace NamespaceDetailsTransientTests
                                                                                  
     class All : public Suite {
@@ -1327,6 +1447,7 @@ namespace NamespaceTests {
             add< IndexDetailsTests::MissingField >();
             add< IndexDetailsTests::SubobjectMissing >();
             add< IndexDetailsTests::CompoundMissing >();
+            add< IndexDetailsTests::ArrayDuplicates >();
             add< IndexSpecTests::Suitability >();
             add< IndexSpecTests::NumericFieldSuitability >();
             add< NamespaceDetailsTests::Create >();
@@ -1338,7 +1459,10 @@ namespace NamespaceTests {
             //            add< NamespaceDetailsTests::BigCollection >();
             add< NamespaceDetailsTests::Size >();
             add< NamespaceDetailsTests::SetIndexIsMultikey >();
+            add< NamespaceDetailsTests::CachedLookupDropped >();
             add< NamespaceDetailsTransientTests::ClearQueryCache >();
+            add< NamespaceDetailsTransientTests::ExpireQueryCacheKeepsStablePlans >();
+            add< NamespaceDetailsTransientTests::RecordGrowthPadding >();
         }
     } myall;
 } // namespace NamespaceTests
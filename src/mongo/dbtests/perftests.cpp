@@ -38,8 +38,16 @@
 #include "../util/checksum.h"
 #include "../util/version.h"
 #include "../db/key.h"
+#include "../db/matcher.h"
 #include "../util/compress.h"
 #include "../util/concurrency/qlock.h"
+#include "../db/btree.h"
+#include "../db/queryutil.h"
+#include "../db/stats/namespace_io.h"
+#include "../db/oplog.h"
+#include "../db/repl/bgsync.h"
+#include "../db/repl/rs.h"
+#include "../db/repl/rs_sync.h"
 #include <boost/filesystem/operations.hpp>
 
 using namespace bson;
@@ -47,12 +55,24 @@ using namespace bson;
 namespace mongo {
     namespace dbtests {
         extern unsigned perfHist;
+        extern unsigned perfRepeat;
+        extern unsigned perfWarmup;
+        extern string perfOut;
+        extern string perfBaseline;
+        extern double perfThreshold;
+        extern string perfOplog;
     }
 }
 
 namespace PerfTests {
 
     using mongo::dbtests::perfHist;
+    using mongo::dbtests::perfRepeat;
+    using mongo::dbtests::perfWarmup;
+    using mongo::dbtests::perfOut;
+    using mongo::dbtests::perfBaseline;
+    using mongo::dbtests::perfThreshold;
+    using mongo::dbtests::perfOplog;
 
     const bool profiling = false;
 
@@ -184,8 +204,50 @@ namespace PerfTests {
     }
 
 
+    /** one timed run of a test */
+    struct Sample {
+        Sample( unsigned long long n_ , int ms_ ) : n(n_), ms(ms_) { }
+        unsigned long long n;
+        int ms;
+        double rps() const { return n * 1000.0 / max( ms , 1 ); }
+    };
+
+    /** half the width of the 95% confidence interval of the mean of v, from Student's t */
+    static double confidence95( const vector<double>& v , double mean ) {
+        static const double t[] = { 0, 12.71, 4.30, 3.18, 2.78, 2.57, 2.45, 2.36, 2.31, 2.26, 2.23 };
+        if ( v.size() < 2 )
+            return 0;
+        double ss = 0;
+        for ( unsigned i = 0; i < v.size(); i++ )
+            ss += ( v[i] - mean ) * ( v[i] - mean );
+        double sd = sqrt( ss / ( v.size() - 1 ) );
+        unsigned df = v.size() - 1;
+        return ( df < sizeof( t ) / sizeof( t[0] ) ? t[df] : 1.96 ) * sd / sqrt( (double) v.size() );
+    }
+
+    /** rps by test name, from the --perfBaseline file */
+    static const map<string,double>& baseline() {
+        static map<string,double> b;
+        static bool loaded = false;
+        if ( ! loaded && ! perfBaseline.empty() ) {
+            loaded = true;
+            ifstream f( perfBaseline.c_str() );
+            if ( ! f.good() )
+                cout << "can't read --perfBaseline " << perfBaseline << endl;
+            string line;
+            while ( getline( f , line ) ) {
+                if ( line.empty() )
+                    continue;
+                BSONObj o = fromjson( line );
+                b[ o["test"].String() ] = o["rps"].Number();
+            }
+        }
+        return b;
+    }
+
     class B : public ClientBase {
         string _ns;
+        vector<string> _regressions;
     protected:
         const char *ns() { return _ns.c_str(); }
 
@@ -208,16 +270,71 @@ namespace PerfTests {
         /* override if your test output doesn't need that */
         virtual bool showDurStats() { return true; }
 
+        /** more to report, given the mean rps; shown on the stats line and saved to --perfOut */
+        virtual void appendExtra( BSONObjBuilder& b , double rps ) { }
+
     public:
         virtual unsigned batchSize() { return 50; }
 
         void say(unsigned long long n, int ms, string s) {
-            unsigned long long rps = n*1000/ms;
+            say( vector<Sample>( 1 , Sample( n , ms ) ) , s );
+        }
+
+        /** reports the mean of several runs, with a confidence interval if there are several */
+        void say(const vector<Sample>& samples, string s) {
+            vector<double> rpsEach;
+            double sum = 0;
+            int msSum = 0;
+            for ( unsigned i = 0; i < samples.size(); i++ ) {
+                rpsEach.push_back( samples[i].rps() );
+                sum += rpsEach.back();
+                msSum += samples[i].ms;
+            }
+            double mean = sum / samples.size();
+            double ci = confidence95( rpsEach , mean );
+            unsigned long long rps = (unsigned long long) mean;
+            int ms = msSum / samples.size();
+
+            BSONObjBuilder extraBuilder;
+            appendExtra( extraBuilder , mean );
+            BSONObj extra = extraBuilder.obj();
+
             cout << "stats " << setw(42) << left << s << ' ' << right << setw(9) << rps << ' ' << right << setw(5) << ms << "ms ";
+            if ( samples.size() > 1 )
+                cout << "+-" << fixed << setprecision(1) << setw(4) << 100 * ci / max( mean , 1.0 ) << "% ";
             if( showDurStats() )
                 cout << dur::stats.curr->_asCSV();
+            if ( ! extra.isEmpty() )
+                cout << extra.jsonString();
             cout << endl;
 
+            if ( ! perfOut.empty() ) {
+                BSONObjBuilder b;
+                b.append( "test" , s );
+                b.append( "rps" , mean );
+                b.append( "ci95" , ci );
+                b.append( "samples" , rpsEach );
+                b.append( "millis" , ms );
+                b.appendBool( "dur" , cmdLine.dur );
+                b.append( "version" , versionString );
+                b.append( "git" , gitVersion() );
+                b.appendElements( extra );
+                ofstream f( perfOut.c_str() , ios::app );
+                f << b.obj().jsonString() << endl;
+            }
+
+            map<string,double>::const_iterator base = baseline().find( s );
+            if ( base != baseline().end() ) {
+                // only when slower by more than the threshold and by more than the noise
+                double limit = base->second * ( 1 - perfThreshold / 100 );
+                if ( mean < limit && mean + ci < base->second ) {
+                    stringstream ss;
+                    ss << s << ": " << rps << " rps, baseline " << (unsigned long long) base->second;
+                    cout << "stats REGRESSION " << ss.str() << endl;
+                    _regressions.push_back( ss.str() );
+                }
+            }
+
             if( conn && !conn->isFailed() ) {
                 const char *ns = "perf.pstats";
                 if( perfHist ) {
@@ -305,16 +422,10 @@ namespace PerfTests {
             return hlm;
         }
 
-        void run() {
-            _ns = string("perftest.") + name();
-            client().dropCollection(ns());
-            prep();
-            int hlm = howLong();
-            dur::stats._intervalMicros = 0; // no auto rotate
+        Sample timedRun(int hlm, unsigned Batch) {
             dur::stats.curr->reset();
             mongo::Timer t;
             n = 0;
-            const unsigned Batch = batchSize();
 
             if( hlm == 0 ) {
                 // means just do once
@@ -330,28 +441,51 @@ namespace PerfTests {
             }
 
             client().getLastError(); // block until all ops are finished
-            int ms = t.millis();
+            return Sample( n , t.millis() );
+        }
 
-            say(n, ms, name());
+        Sample timed2Run(int hlm, unsigned Batch) {
+            dur::stats.curr->reset();
+            mongo::Timer t;
+            unsigned long long n = 0;
+            while( 1 ) {
+                unsigned i;
+                for( i = 0; i < Batch; i++ )
+                    timed2(client());
+                n += i;
+                if( t.millis() > hlm )
+                    break;
+            }
+            return Sample( n , t.millis() );
+        }
+
+        void run() {
+            _ns = string("perftest.") + name();
+            client().dropCollection(ns());
+            prep();
+            int hlm = howLong();
+            dur::stats._intervalMicros = 0; // no auto rotate
+            const unsigned Batch = batchSize();
+            const unsigned repeat = max( perfRepeat , 1U );
+
+            for ( unsigned i = 0; i < perfWarmup; i++ )
+                timedRun( hlm , Batch );
+            vector<Sample> samples;
+            for ( unsigned i = 0; i < repeat; i++ )
+                samples.push_back( timedRun( hlm , Batch ) );
+            say(samples, name());
 
             post();
 
             string test2name = timed2(client());
             {
                 if( test2name.size() != 0 ) {
-                    dur::stats.curr->reset();
-                    mongo::Timer t;
-                    unsigned long long n = 0;
-                    while( 1 ) {
-                        unsigned i;
-                        for( i = 0; i < Batch; i++ )
-                            timed2(client());
-                        n += i;
-                        if( t.millis() > hlm )
-                            break;
-                    }
-                    int ms = t.millis();
-                    say(n, ms, test2name);
+                    for ( unsigned i = 0; i < perfWarmup; i++ )
+                        timed2Run( hlm , Batch );
+                    vector<Sample> samples2;
+                    for ( unsigned i = 0; i < repeat; i++ )
+                        samples2.push_back( timed2Run( hlm , Batch ) );
+                    say(samples2, test2name);
                 }
             }
 
@@ -362,6 +496,13 @@ namespace PerfTests {
                 launchThreads(nThreads);
                 say(n, t.millis(), test2name+"-threaded");
             }
+
+            if ( ! _regressions.empty() ) {
+                string msg = "slower than --perfBaseline:";
+                for ( unsigned i = 0; i < _regressions.size(); i++ )
+                    msg += " " + _regressions[i] + ";";
+                FAIL( msg );
+            }
         }
 
         bool stop;
@@ -1072,6 +1213,609 @@ namespace PerfTests {
         }
     };
 
+    /** finds on a secondary index of 50k keys */
+    class BtreeFind : public B {
+    public:
+        enum { N = 50000 };
+        string name() { return "btree-find"; }
+        void prep() {
+            for ( int i = 0; i < N; i++ )
+                client().insert( ns(), BSON( "x" << i ) );
+            client().ensureIndex( ns(), BSON( "x" << 1 ) );
+        }
+        void timed() {
+            client().findOne( ns(), QUERY( "x" << rand() % N ) );
+        }
+    };
+
+    /** ascending keys, which always go in the btree's rightmost bucket */
+    class BtreeInsertAscending : public B {
+        unsigned i;
+    public:
+        BtreeInsertAscending() : i(0) { }
+        string name() { return "btree-insert-ascending"; }
+        void prep() {
+            client().ensureIndex( ns(), BSON( "x" << 1 << "y" << 1 ) );
+        }
+        void timed() {
+            i++;
+            client().insert( ns(), BSON( "x" << i << "y" << "abcdefghij" ) );
+        }
+    };
+
+    class MatcherMatch : public NonDurTest {
+        Matcher _m;
+        BSONObj _o;
+    public:
+        MatcherMatch() :
+            _m( fromjson( "{a:{$gt:5},'b.c':{$in:[1,2,3]},d:/^ab/}" ) ),
+            _o( fromjson( "{_id:1,a:10,b:{c:2,e:'x'},d:'abcdef',f:[1,2,3]}" ) ) {
+        }
+        string name() { return "matcher-match"; }
+        void timed() {
+            if ( _m.matches( _o ) )
+                dontOptimizeOutHopefully++;
+        }
+    };
+
+    /** $group of 10k documents into 100 groups */
+    class AggregateGroup : public B {
+    public:
+        virtual int howLongMillis() { return 3000; }
+        virtual unsigned batchSize() { return 1; }
+        string name() { return "aggregate-group"; }
+        void prep() {
+            for ( int i = 0; i < 10000; i++ )
+                client().insert( ns(), BSON( "k" << i % 100 << "v" << i ) );
+        }
+        void timed() {
+            BSONObj res;
+            BSONObj cmd = BSON( "aggregate" << name() << "pipeline" <<
+                                BSON_ARRAY( BSON( "$group" << BSON( "_id" << "$k" << "total" <<
+                                                                    BSON( "$sum" << "$v" ) ) ) ) );
+            verify( client().runCommand( "perftest", cmd, res ) );
+        }
+    };
+
+    /** inserts that each wait for the journal; group commit bounds this, not the insert */
+    class InsertJournalCommit : public B {
+        unsigned i;
+    public:
+        InsertJournalCommit() : i(0) { }
+        virtual unsigned batchSize() { return 5; }
+        string name() { return "insert-journal-commit"; }
+        void timed() {
+            client().insert( ns(), BSON( "_id" << i++ ) );
+            client().getLastError( false, cmdLine.dur );
+        }
+    };
+
+    /** applyOps of 50 inserts, as a secondary applies a batch of the oplog */
+    class ApplyOpsInsert : public B {
+        unsigned i;
+    public:
+        ApplyOpsInsert() : i(0) { }
+        virtual unsigned batchSize() { return 5; }
+        string name() { return "applyOps-insert-50"; }
+        void timed() {
+            BSONArrayBuilder ops;
+            for ( int j = 0; j < 50; j++ )
+                ops.append( BSON( "op" << "i" << "ns" << ns() <<
+                                  "o" << BSON( "_id" << i++ << "x" << 1 ) ) );
+            BSONObj res;
+            verify( client().runCommand( "perftest", BSON( "applyOps" << ops.arr() ), res ) );
+        }
+    };
+
+    /** a $in of the k of every step'th document from 'from', which a cursor skips between */
+    template< class Shape >
+    BSONObj inEvery( unsigned from , unsigned step ) {
+        BSONArrayBuilder in;
+        for ( unsigned j = 0; j < 100; j++ )
+            in.append( Shape::doc( from + j * step ).firstElement() );
+        return BSON( "k" << BSON( "$in" << in.arr() ) );
+    }
+
+    /**
+     * Shapes of documents for the btree benchmarks.  doc(i) sorts by i on the index pattern,
+     * except that a multikey document has several keys.
+     */
+    struct OidShape {
+        static const char *name() { return "oid"; }
+        static BSONObj pattern() { return BSON( "k" << 1 ); }
+        /** as a driver makes them: a second's worth share a time, and a counter orders them */
+        static BSONObj doc( unsigned i ) {
+            char hex[25];
+            sprintf( hex , "%08x%010x%06x" , 1350000000 + ( i >> 24 ) , 0xc0ffee , i & 0xffffff );
+            OID o;
+            o.init( string( hex ) );
+            return BSON( "k" << o );
+        }
+        static BSONObj skipQuery( unsigned from ) { return inEvery<OidShape>( from , 10 ); }
+    };
+
+    struct Int64Shape {
+        static const char *name() { return "int64"; }
+        static BSONObj pattern() { return BSON( "k" << 1 ); }
+        static BSONObj doc( unsigned i ) { return BSON( "k" << ( 1LL << 40 ) + i * 1000003LL ); }
+        static BSONObj skipQuery( unsigned from ) { return inEvery<Int64Shape>( from , 10 ); }
+    };
+
+    /** a customer and an order, 100 orders a customer */
+    struct CompoundStringShape {
+        static const char *name() { return "compound-string"; }
+        static BSONObj pattern() { return BSON( "a" << 1 << "b" << 1 ); }
+        static string a( unsigned i ) { return padded( "customer-" , i / 100 ); }
+        static string b( unsigned i ) { return padded( "order-" , i % 100 ); }
+        static string padded( const char *prefix , unsigned n ) {
+            char buf[32];
+            sprintf( buf , "%s%010u" , prefix , n );
+            return buf;
+        }
+        static BSONObj doc( unsigned i ) { return BSON( "a" << a( i ) << "b" << b( i ) ); }
+        /** two orders of each of 50 customers: a range on a, skipping over the other values of b */
+        static BSONObj skipQuery( unsigned from ) {
+            return BSON( "a" << BSON( "$gte" << a( from ) << "$lte" << a( from + 4999 ) ) <<
+                         "b" << BSON( "$in" << BSON_ARRAY( b( 5 ) << b( 55 ) ) ) );
+        }
+    };
+
+    /** an array of 4 values, so 4 keys a document */
+    struct MultikeyShape {
+        static const char *name() { return "multikey"; }
+        static BSONObj pattern() { return BSON( "k" << 1 ); }
+        static BSONObj doc( unsigned i ) {
+            long long k = i * 4LL;
+            return BSON( "k" << BSON_ARRAY( k << k + 1 << k + 2 << k + 3 ) );
+        }
+        static BSONObj skipQuery( unsigned from ) {
+            BSONArrayBuilder in;
+            for ( unsigned j = 0; j < 100; j++ )
+                in.append( ( from + j * 10 ) * 4LL );
+            return BSON( "k" << BSON( "$in" << in.arr() ) );
+        }
+    };
+
+    /**
+     * Btree operations on an index of version Version over documents of Shape, called directly
+     * rather than through queries so that the btree is nearly all that is timed.  The keys point
+     * at a dummy record.  Reports ns per operation, and bucket touches per operation: the
+     * buckets searched on the way down the tree (counted by BtreeBucket::find, where page
+     * residency can be checked) and the buckets a cursor moves through.
+     */
+    template< int Version , class Shape >
+    class BtreeBench : public B {
+    public:
+        BtreeBench() : _next(0), _idx(0), _order( Ordering::make( BSONObj() ) ), _ops(0), _scanned(0),
+            _findsBefore(0) { }
+    protected:
+        enum { N = 100000 };  // documents in the index before timing starts
+
+        virtual int howLongMillis() { return 1000; }
+        virtual bool showDurStats() { return false; }
+        virtual string op() = 0;
+        /** documents to load before timing, which get i from 0 to N */
+        virtual unsigned scramble( unsigned i ) { return i; }
+
+        string name() {
+            return str::stream() << "btree-v" << Version << "-" << Shape::name() << "-" << op();
+        }
+
+        void prep() {
+            client().ensureIndex( ns() , Shape::pattern() , false , "k" , false , false , Version );
+            _lk.reset( new Lock::DBWrite( ns() ) );
+            _ctx.reset( new Client::Context( ns() ) );
+            NamespaceDetails *d = nsdetails( ns() );
+            _idx = &d->idx( d->findIndexByName( "k" ) );
+            _order = Ordering::make( _idx->keyPattern() );
+            for ( unsigned i = 0; i < N; i++ )
+                insert( Shape::doc( scramble( i ) ) );
+            _findsBefore = finds();
+        }
+
+        void post() {
+            _ctx.reset();
+            _lk.reset();
+        }
+
+        void appendExtra( BSONObjBuilder& b , double rps ) {
+            b.append( "nsPerOp" , rps > 0 ? 1e9 / rps : 0.0 );
+            if ( _ops == 0 )
+                return;
+            if ( Record::blockCheckSupported() )
+                b.append( "bucketFinds" , (double) ( finds() - _findsBefore ) / _ops );
+            b.append( "bucketsScanned" , (double) _scanned / _ops );
+        }
+
+        IndexDetails& idx() { return *_idx; }
+
+        /** the dummy record every key points at */
+        static DiskLoc recordLoc() { return DiskLoc( 0 , 2 ); }
+
+        void insert( const BSONObj& doc ) {
+            BSONObjSet keys;
+            idx().getKeysFromObject( doc , keys );
+            for ( BSONObjSet::const_iterator i = keys.begin(); i != keys.end(); ++i )
+                idx().idxInterface().bt_insert( idx().head , recordLoc() , *i , _order , true , idx() , true );
+            getDur().commitIfNeeded();
+        }
+
+        void remove( const BSONObj& doc ) {
+            BSONObjSet keys;
+            idx().getKeysFromObject( doc , keys );
+            for ( BSONObjSet::const_iterator i = keys.begin(); i != keys.end(); ++i )
+                idx().idxInterface().unindex( idx().head , idx() , *i , recordLoc() );
+            getDur().commitIfNeeded();
+        }
+
+        static BSONObj firstKey( const BSONObj& doc , const IndexDetails& id ) {
+            BSONObjSet keys;
+            id.getKeysFromObject( doc , keys );
+            return *keys.begin();
+        }
+
+        /** a key after all of them */
+        static BSONObj maxKey( const IndexDetails& id ) {
+            BSONObjBuilder b;
+            for ( BSONObjIterator i( id.keyPattern() ); i.more(); i.next() )
+                b.appendMaxKey( "" );
+            return b.obj();
+        }
+
+        /** walks c to its end, or through n keys, counting the buckets it moves through */
+        unsigned scan( BtreeCursor *bc , unsigned n ) {
+            DiskLoc last;
+            unsigned keys = 0;
+            for ( ; keys < n && bc->ok(); bc->advance(), keys++ ) {
+                if ( bc->getBucket() != last ) {
+                    last = bc->getBucket();
+                    _scanned++;
+                }
+            }
+            return keys;
+        }
+
+        unsigned _next;
+        IndexDetails *_idx;
+        Ordering _order;
+        unsigned long long _ops;
+        unsigned long long _scanned;
+
+    private:
+        long long finds() {
+            BSONObjBuilder b;
+            NamespaceIO::appendIndex( _idx->indexNamespace() , b );
+            return b.obj()["accesses"].numberLong();
+        }
+
+        scoped_ptr<Lock::DBWrite> _lk;
+        scoped_ptr<Client::Context> _ctx;
+        long long _findsBefore;
+    };
+
+    /** appends after the keys already there */
+    template< int Version , class Shape >
+    class BtreeInsertSequential : public BtreeBench<Version,Shape> {
+    public:
+        BtreeInsertSequential() { this->_next = this->N; }
+        string op() { return "insert-sequential"; }
+        void timed() {
+            this->insert( Shape::doc( this->_next++ ) );
+            this->_ops++;
+        }
+    };
+
+    /** inserts all over the key space */
+    template< int Version , class Shape >
+    class BtreeInsertRandom : public BtreeBench<Version,Shape> {
+    public:
+        BtreeInsertRandom() { this->_next = this->N; }
+        string op() { return "insert-random"; }
+        // odd multipliers permute the unsigneds, so there are no duplicates
+        unsigned scramble( unsigned i ) { return i * 2654435761U; }
+        void timed() {
+            this->insert( Shape::doc( scramble( this->_next++ ) ) );
+            this->_ops++;
+        }
+    };
+
+    template< int Version , class Shape >
+    class BtreeFindPoint : public BtreeBench<Version,Shape> {
+    public:
+        string op() { return "find"; }
+        void timed() {
+            BSONObj key = this->firstKey( Shape::doc( rand() % this->N ) , this->idx() );
+            verify( ! this->idx().idxInterface().findSingle( this->idx() , this->idx().head , key ).isNull() );
+            this->_ops++;
+        }
+    };
+
+    /** 100 keys from a random start */
+    template< int Version , class Shape >
+    class BtreeRangeScan : public BtreeBench<Version,Shape> {
+    public:
+        string op() { return "range-scan-100"; }
+        void timed() {
+            NamespaceDetails *d = nsdetails( this->ns() );
+            BSONObj start = this->firstKey( Shape::doc( rand() % ( this->N - 1000 ) ) , this->idx() );
+            scoped_ptr<BtreeCursor> c( BtreeCursor::make( d , this->idx() , start , this->maxKey( this->idx() ) , true , 1 ) );
+            this->scan( c.get() , 100 );
+            this->_ops++;
+        }
+    };
+
+    /** a query's bounds, which the cursor follows by skipping ahead with advanceTo */
+    template< int Version , class Shape >
+    class BtreeAdvanceTo : public BtreeBench<Version,Shape> {
+        vector< shared_ptr<FieldRangeVector> > _bounds;
+        unsigned _i;
+    public:
+        BtreeAdvanceTo() : _i(0) { }
+        string op() { return "advance-to"; }
+        void prep() {
+            BtreeBench<Version,Shape>::prep();
+            for ( int j = 0; j < 64; j++ ) {
+                FieldRangeSet frs( this->ns() , Shape::skipQuery( rand() % ( this->N / 2 ) ) , true );
+                _bounds.push_back( shared_ptr<FieldRangeVector>(
+                        new FieldRangeVector( frs , this->idx().getSpec() , 1 ) ) );
+            }
+        }
+        void timed() {
+            NamespaceDetails *d = nsdetails( this->ns() );
+            scoped_ptr<BtreeCursor> c( BtreeCursor::make( d , this->idx() , _bounds[ _i++ % _bounds.size() ] , 1 ) );
+            this->scan( c.get() , 0xffffffff );
+            this->_ops++;
+        }
+    };
+
+    /** deletes a document's keys and puts them back, so the index stays the same size */
+    template< int Version , class Shape >
+    class BtreeDelete : public BtreeBench<Version,Shape> {
+    public:
+        string op() { return "delete-reinsert"; }
+        void timed() {
+            BSONObj doc = Shape::doc( rand() % this->N );
+            this->remove( doc );
+            this->insert( doc );
+            this->_ops++;
+        }
+    };
+
+    /** the buffer a SyncTail applies from, holding just the batch being applied */
+    class OplogApplyQueue : public replset::BackgroundSyncInterface {
+    public:
+        std::deque<BSONObj> ops;
+        virtual BSONObj* peek() { return ops.empty() ? 0 : &ops.front(); }
+        virtual void consume() { ops.pop_front(); }
+        virtual Member* getSyncTarget() { return 0; }
+        virtual bool peekAt( size_t i , BSONObj* op ) {
+            if ( i >= ops.size() )
+                return false;
+            *op = ops[i];
+            return true;
+        }
+        virtual size_t peekRun( size_t i , size_t n , std::deque<BSONObj>* out ) {
+            size_t copied = 0;
+            for ( ; i < ops.size() && copied < n; i++, copied++ )
+                out->push_back( ops[i] );
+            return copied;
+        }
+        virtual void consumeRun( size_t n ) {
+            while ( n-- && ! ops.empty() )
+                ops.pop_front();
+        }
+    };
+
+    /** a secondary, for SyncTail's theReplSet calls */
+    class OplogApplyReplSet : public ReplSet {
+        ReplSetConfig _config;
+        ReplSetConfig::MemberCfg _myConfig;
+    public:
+        OplogApplyReplSet() :
+            _config( BSON( "_id" << "perftest" << "members" <<
+                           BSON_ARRAY( BSON( "_id" << 0 << "host" << "host1" ) ) ) ) {
+        }
+        virtual bool isSecondary() { return true; }
+        virtual bool isPrimary() { return false; }
+        virtual bool tryToGoLiveAsASecondary( OpTime& minvalid ) { return false; }
+        virtual const ReplSetConfig& config() { return _config; }
+        virtual const ReplSetConfig::MemberCfg& myConfig() { return _myConfig; }
+        virtual bool buildIndexes() const { return true; }
+    };
+
+    class OplogApplier : public replset::SyncTail {
+    public:
+        OplogApplier( OplogApplyQueue *q ) : SyncTail( q ) { }
+        using SyncTail::multiApply;
+    };
+
+    /**
+     * Applies batches of BatchOps oplog entries through SyncTail::multiApply, as a secondary
+     * does, divided between Threads writers.  The ops come from --perfOplog if given, cycled
+     * through with new timestamps, else they are generated: inserts, $inc updates and deletes
+     * of a moving window of documents in 4 collections.  Each op also writes our own oplog.
+     *
+     * Reports ops/sec, and the microseconds per op spent holding and waiting for locks, from
+     * serverStatus.
+     */
+    template< int BatchOps , int Threads >
+    class OplogApply : public B {
+        enum { Collections = 4 };
+        OplogApplyQueue _queue;
+        scoped_ptr<OplogApplier> _applier;
+        ReplSet *_oldReplSet;
+        string _oldReplSetName;
+        vector<BSONObj> _captured;
+        size_t _nextCaptured;
+        OpTime _ts;
+        long long _live[Collections][2];  // [first, end) of the _ids there
+        unsigned long long _ops;
+        long long _lockedBefore;
+        long long _acquiringBefore;
+    public:
+        OplogApply() : _oldReplSet(0), _nextCaptured(0), _ops(0), _lockedBefore(0), _acquiringBefore(0) { }
+
+        virtual int howLongMillis() { return 3000; }
+        virtual unsigned batchSize() { return 1; }
+        virtual bool showDurStats() { return false; }
+
+        string name() {
+            return str::stream() << "oplog-apply-" << ( perfOplog.empty() ? "generated" : "captured" )
+                                 << "-b" << BatchOps << "-t" << Threads;
+        }
+
+        void prep() {
+            _oldReplSetName = cmdLine._replSet;
+            _oldReplSet = theReplSet;
+            cmdLine._replSet = "perftest";
+            if ( cmdLine.oplogSize == 0 )
+                cmdLine.oplogSize = 64 * 1024 * 1024;
+            createOplog();
+            theReplSet = new OplogApplyReplSet();
+            _applier.reset( new OplogApplier( &_queue ) );
+            _applier->setWriterThreads( Threads );
+
+            {
+                Lock::GlobalWrite lk;
+                _ts = OpTime::_now();
+            }
+
+            if ( ! perfOplog.empty() ) {
+                loadCaptured();
+            }
+            else {
+                for ( int c = 0; c < Collections; c++ ) {
+                    client().dropCollection( collection( c ) );
+                    client().ensureIndex( collection( c ) , BSON( "x" << 1 ) );
+                    _live[c][0] = _live[c][1] = 0;
+                    // something to update and delete from the start
+                    for ( int i = 0; i < 1000; i++ )
+                        client().insert( collection( c ) , BSON( "_id" << _live[c][1]++ << "x" << 0 ) );
+                }
+                client().getLastError();
+            }
+
+            _lockedBefore = lockMicros( "timeLockedMicros" );
+            _acquiringBefore = lockMicros( "timeAcquiringMicros" );
+        }
+
+        void post() {
+            _applier.reset();
+            delete theReplSet;
+            theReplSet = _oldReplSet;
+            cmdLine._replSet = _oldReplSetName;
+        }
+
+        void timed() {
+            for ( int i = 0; i < BatchOps; i++ )
+                _queue.ops.push_back( perfOplog.empty() ? generated() : captured() );
+            deque<BSONObj> batch = _queue.ops;
+            verify( _applier->multiApply( batch ) );
+            verify( _queue.ops.empty() );
+            _ops += BatchOps;
+        }
+
+        void appendExtra( BSONObjBuilder& b , double rps ) {
+            b.append( "opsPerSec" , rps * BatchOps );
+            if ( _ops == 0 )
+                return;
+            b.append( "lockedMicrosPerOp" , (double) ( lockMicros( "timeLockedMicros" ) - _lockedBefore ) / _ops );
+            b.append( "acquiringMicrosPerOp" , (double) ( lockMicros( "timeAcquiringMicros" ) - _acquiringBefore ) / _ops );
+        }
+
+    private:
+        string collection( int c ) { return str::stream() << ns() << "_" << c; }
+
+        OpTime nextTs() {
+            _ts = OpTime( _ts.getSecs() , _ts.getInc() + 1 );
+            return _ts;
+        }
+
+        BSONObj generated() {
+            int c = rand() % Collections;
+            long long *live = _live[c];
+            int r = rand() % 10;
+            BSONObjBuilder b;
+            b.appendTimestamp( "ts" , nextTs().asDate() );
+            b.append( "h" , (long long) rand() );
+            if ( r < 5 || live[1] - live[0] < 100 ) {
+                b.append( "op" , "i" );
+                b.append( "ns" , collection( c ) );
+                b.append( "o" , BSON( "_id" << live[1]++ << "x" << 0 << "s" << string( 100 , 'x' ) ) );
+            }
+            else if ( r < 9 ) {
+                b.append( "op" , "u" );
+                b.append( "ns" , collection( c ) );
+                b.append( "o2" , BSON( "_id" << live[0] + rand() % ( live[1] - live[0] ) ) );
+                b.append( "o" , BSON( "$inc" << BSON( "x" << 1 ) ) );
+            }
+            else {
+                b.append( "op" , "d" );
+                b.append( "ns" , collection( c ) );
+                b.appendBool( "b" , true );
+                b.append( "o" , BSON( "_id" << live[0]++ ) );
+            }
+            return b.obj();
+        }
+
+        /** the next captured op, with a timestamp after the last one applied */
+        BSONObj captured() {
+            const BSONObj& op = _captured[ _nextCaptured++ % _captured.size() ];
+            BSONObjBuilder b;
+            b.appendTimestamp( "ts" , nextTs().asDate() );
+            BSONObjIterator i( op );
+            while ( i.more() ) {
+                BSONElement e = i.next();
+                if ( ! str::equals( e.fieldName() , "ts" ) )
+                    b.append( e );
+            }
+            return b.obj();
+        }
+
+        /** reads the inserts, updates and deletes of the --perfOplog file.  commands and index
+            builds, which a secondary applies on their own, are left out */
+        void loadCaptured() {
+            ifstream f( perfOplog.c_str() , ios::binary );
+            stringstream ss;
+            ss << f.rdbuf();
+            string data = ss.str();
+            uassert( 16393 , str::stream() << "can't read --perfOplog " << perfOplog , f.good() || f.eof() );
+            const char *p = data.data();
+            const char *end = p + data.size();
+            while ( end - p >= 5 ) {
+                int len = *reinterpret_cast<const int*>( p );
+                uassert( 16394 , str::stream() << "bad object in --perfOplog " << perfOplog ,
+                         len >= 5 && len <= end - p );
+                BSONObj op( p );
+                p += len;
+                const char *type = op.getStringField( "op" );
+                const char *opNs = op.getStringField( "ns" );
+                if ( ( str::equals( type , "i" ) || str::equals( type , "u" ) || str::equals( type , "d" ) ) &&
+                     ! str::contains( opNs , ".system." ) )
+                    _captured.push_back( op.getOwned() );
+            }
+            uassert( 16395 , str::stream() << "no inserts, updates or deletes in --perfOplog " << perfOplog ,
+                     ! _captured.empty() );
+        }
+
+        /** all the lock time serverStatus reports under 'field', over all locks and modes */
+        long long lockMicros( const char *field ) {
+            BSONObj status;
+            verify( client().runCommand( "admin" , BSON( "serverStatus" << 1 ) , status ) );
+            long long total = 0;
+            BSONObjIterator i( status.getObjectField( "locks" ) );
+            while ( i.more() ) {
+                BSONElement lock = i.next();
+                if ( lock.type() != Object )
+                    continue;
+                BSONObjIterator modes( lock.Obj().getObjectField( field ) );
+                while ( modes.more() )
+                    total += modes.next().numberLong();
+            }
+            return total;
+        }
+    };
+
     void t() {
         for( int i = 0; i < 20; i++ ) {
             sleepmillis(21);
@@ -1098,6 +1842,24 @@ namespace PerfTests {
     public:
         All() : Suite( "perf" ) { }
 
+        template< int Version , class Shape >
+        void addBtree() {
+            add< BtreeInsertSequential<Version,Shape> >();
+            add< BtreeInsertRandom<Version,Shape> >();
+            add< BtreeFindPoint<Version,Shape> >();
+            add< BtreeRangeScan<Version,Shape> >();
+            add< BtreeAdvanceTo<Version,Shape> >();
+            add< BtreeDelete<Version,Shape> >();
+        }
+
+        template< int Version >
+        void addBtree() {
+            addBtree< Version , OidShape >();
+            addBtree< Version , Int64Shape >();
+            addBtree< Version , CompoundStringShape >();
+            addBtree< Version , MultikeyShape >();
+        }
+
         Result * run( const string& filter ) {
             boost::thread a(t);
             Result * res = Suite::run(filter);
@@ -1159,6 +1921,20 @@ namespace PerfTests {
                 add< Update1 >();
                 add< MoreIndexes<Update1> >();
                 add< InsertBig >();
+                add< BtreeFind >();
+                add< BtreeInsertAscending >();
+                add< MatcherMatch >();
+                add< AggregateGroup >();
+                add< InsertJournalCommit >();
+                add< ApplyOpsInsert >();
+                addBtree< 0 >();
+                addBtree< 1 >();
+                add< OplogApply< 100 , 1 > >();
+                add< OplogApply< 100 , 16 > >();
+                add< OplogApply< 1000 , 1 > >();
+                add< OplogApply< 1000 , 4 > >();
+                add< OplogApply< 1000 , 16 > >();
+                add< OplogApply< 5000 , 16 > >();
             }
         }
     } myall;
@@ -0,0 +1,206 @@
+// prefetchtests.cpp : prefetch.{h,cpp} unit tests
+
+/**
+ *    Copyright (C) 2012 10gen Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../pch.h"
+
+#include "../db/instance.h"
+#include "../db/prefetch.h"
+
+#include "dbtests.h"
+
+namespace PrefetchTests {
+
+    DBDirectClient client;
+
+    class Base {
+    public:
+        Base() : _oldMode( replIndexPrefetch ) {
+            client.dropCollection( ns() );
+            client.insert( ns() , BSON( "_id" << 1 << "a" << 1 << "b" << 1 ) );
+            client.ensureIndex( ns() , BSON( "a" << 1 ) );
+            client.ensureIndex( ns() , BSON( "b" << 1 ) );
+        }
+        virtual ~Base() {
+            replIndexPrefetch = _oldMode;
+            client.dropCollection( ns() );
+        }
+    protected:
+        static const char *ns() { return "unittests.prefetch"; }
+
+        static BSONObj updateOp( const char *ns ) {
+            return BSON( "op" << "u" << "ns" << ns << "o2" << BSON( "_id" << 1 ) <<
+                         "o" << BSON( "$set" << BSON( "a" << 2 ) ) );
+        }
+        static BSONObj insertOp( const char *ns ) {
+            return BSON( "op" << "i" << "ns" << ns << "o" << BSON( "_id" << 2 << "a" << 2 << "b" << 2 ) );
+        }
+
+        /** what prefetching op paged in, per the repl.prefetch counters */
+        struct Touched {
+            long long ops;
+            long long indexes;
+            long long records;
+        };
+        static Touched prefetch( const BSONObj &op ) {
+            BSONObj before = stats();
+            prefetchPagesForReplicatedOp( op );
+            BSONObj after = stats();
+            Touched t;
+            t.ops = delta( before , after , "ops" );
+            t.indexes = delta( before , after , "indexes" );
+            t.records = delta( before , after , "hits" ) + delta( before , after , "misses" );
+            ASSERT_EQUALS( 0 , delta( before , after , "errors" ) );
+            return t;
+        }
+    private:
+        static BSONObj stats() {
+            BSONObjBuilder b;
+            appendReplPrefetchStats( b );
+            return b.obj();
+        }
+        static long long delta( const BSONObj &before , const BSONObj &after , const char *field ) {
+            return after[ field ].numberLong() - before[ field ].numberLong();
+        }
+        IndexPrefetchMode _oldMode;
+    };
+
+    /** replIndexPrefetch "none" pages in no index, only an update's record */
+    class ModeNone : public Base {
+    public:
+        void run() {
+            replIndexPrefetch = PREFETCH_NONE;
+            Touched t = prefetch( updateOp( ns() ) );
+            ASSERT_EQUALS( 1 , t.ops );
+            ASSERT_EQUALS( 0 , t.indexes );
+            ASSERT_EQUALS( 1 , t.records );
+        }
+    };
+
+    /** replIndexPrefetch "_id_only" pages in just the _id index */
+    class ModeIdOnly : public Base {
+    public:
+        void run() {
+            replIndexPrefetch = PREFETCH_ID_ONLY;
+            Touched t = prefetch( updateOp( ns() ) );
+            ASSERT_EQUALS( 1 , t.ops );
+            ASSERT_EQUALS( 1 , t.indexes );
+            ASSERT_EQUALS( 1 , t.records );
+        }
+    };
+
+    /** replIndexPrefetch "all" pages in every index */
+    class ModeAll : public Base {
+    public:
+        void run() {
+            replIndexPrefetch = PREFETCH_ALL;
+            Touched t = prefetch( updateOp( ns() ) );
+            ASSERT_EQUALS( 1 , t.ops );
+            ASSERT_EQUALS( 3 , t.indexes );
+            ASSERT_EQUALS( 1 , t.records );
+        }
+    };
+
+    /** an insert's record doesn't exist yet, so only its index pages are touched */
+    class InsertSkipsRecord : public Base {
+    public:
+        void run() {
+            replIndexPrefetch = PREFETCH_ALL;
+            Touched t = prefetch( insertOp( ns() ) );
+            ASSERT_EQUALS( 1 , t.ops );
+            ASSERT_EQUALS( 3 , t.indexes );
+            ASSERT_EQUALS( 0 , t.records );
+
+            replIndexPrefetch = PREFETCH_ID_ONLY;
+            t = prefetch( insertOp( ns() ) );
+            ASSERT_EQUALS( 1 , t.indexes );
+            ASSERT_EQUALS( 0 , t.records );
+        }
+    };
+
+    /** capped collections have no _id index to find an update's record with */
+    class CappedSkipsRecord : public Base {
+    public:
+        void run() {
+            const char *capped = "unittests.prefetch_capped";
+            client.dropCollection( capped );
+            ASSERT( client.createCollection( capped , 4096 , true ) );
+            client.insert( capped , BSON( "_id" << 1 << "a" << 1 ) );
+
+            replIndexPrefetch = PREFETCH_ALL;
+            Touched t = prefetch( updateOp( capped ) );
+            ASSERT_EQUALS( 1 , t.ops );
+            ASSERT_EQUALS( 0 , t.indexes );
+            ASSERT_EQUALS( 0 , t.records );
+            client.dropCollection( capped );
+        }
+    };
+
+    /** nothing is paged in for a collection that doesn't exist yet, or for other op types */
+    class Ignored : public Base {
+    public:
+        void run() {
+            replIndexPrefetch = PREFETCH_ALL;
+            client.dropCollection( "unittests.prefetch_missing" );
+            Touched t = prefetch( updateOp( "unittests.prefetch_missing" ) );
+            ASSERT_EQUALS( 0 , t.ops );
+            ASSERT_EQUALS( 0 , t.indexes );
+
+            t = prefetch( BSON( "op" << "c" << "ns" << "unittests.$cmd" << "o" << BSON( "drop" << "prefetch" ) ) );
+            ASSERT_EQUALS( 0 , t.ops );
+            t = prefetch( BSON( "op" << "n" << "ns" << "" << "o" << BSONObj() ) );
+            ASSERT_EQUALS( 0 , t.ops );
+        }
+    };
+
+    class ParseMode {
+    public:
+        void run() {
+            IndexPrefetchMode mode = PREFETCH_ALL;
+            ASSERT( parseIndexPrefetchMode( "none" , &mode ) );
+            ASSERT_EQUALS( PREFETCH_NONE , mode );
+            ASSERT( parseIndexPrefetchMode( "_id_only" , &mode ) );
+            ASSERT_EQUALS( PREFETCH_ID_ONLY , mode );
+            ASSERT( parseIndexPrefetchMode( "all" , &mode ) );
+            ASSERT_EQUALS( PREFETCH_ALL , mode );
+
+            ASSERT( !parseIndexPrefetchMode( "" , &mode ) );
+            ASSERT( !parseIndexPrefetchMode( "ALL" , &mode ) );
+            ASSERT( !parseIndexPrefetchMode( "id_only" , &mode ) );
+            ASSERT_EQUALS( PREFETCH_ALL , mode );
+
+            ASSERT_EQUALS( string( "_id_only" ) , indexPrefetchModeName( PREFETCH_ID_ONLY ) );
+        }
+    };
+
+    class All : public Suite {
+    public:
+        All() : Suite( "prefetch" ) {
+        }
+
+        void setupTests() {
+            add< ModeNone >();
+            add< ModeIdOnly >();
+            add< ModeAll >();
+            add< InsertSkipsRecord >();
+            add< CappedSkipsRecord >();
+            add< Ignored >();
+            add< ParseMode >();
+        }
+    } myall;
+
+} // namespace PrefetchTests
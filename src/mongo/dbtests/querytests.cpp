@@ -1476,11 +1476,31 @@ namespace QueryTests {
 
 
                 {
-                    // TODO: this is temporary SERVER-2104
                     Projection m;
                     m.init( BSON( "x.a" << 1 << "_id" << 0 ) );
 
                     scoped_ptr<Projection::KeyOnly> x( m.checkKey( BSON( "a" << 1 << "x.a" << 1 ) ) );
+                    ASSERT( x );
+                    ASSERT_EQUALS( BSON( "x" << BSON( "a" << 7 ) ),
+                                   x->hydrate( BSON( "" << 5 << "" << 7 ) ) );
+                }
+
+                {
+                    Projection m;
+                    m.init( BSON( "x.a" << 1 << "x.b" << 1 << "y" << 1 << "_id" << 0 ) );
+
+                    scoped_ptr<Projection::KeyOnly> x( m.checkKey( BSON( "x.a" << 1 << "y" << 1 << "x.b" << 1 ) ) );
+                    ASSERT( x );
+                    ASSERT_EQUALS( BSON( "x" << BSON( "a" << 1 << "b" << 3 ) << "y" << 2 ),
+                                   x->hydrate( BSON( "" << 1 << "" << 2 << "" << 3 ) ) );
+                }
+
+                {
+                    // 'x' and 'x.a' can't both be taken from the key
+                    Projection m;
+                    m.init( BSON( "x" << 1 << "x.a" << 1 << "_id" << 0 ) );
+
+                    scoped_ptr<Projection::KeyOnly> x( m.checkKey( BSON( "x" << 1 << "x.a" << 1 ) ) );
                     ASSERT( ! x );
                 }
 
@@ -1494,8 +1514,9 @@ namespace QueryTests {
         
         class TestableScanAndOrder : public ScanAndOrder {
         public:
-            TestableScanAndOrder(int startFrom, int limit, BSONObj order, const FieldRangeSet &frs)
-            : ScanAndOrder( startFrom, limit, order, frs ) {
+            TestableScanAndOrder(int startFrom, int limit, BSONObj order, const FieldRangeSet &frs,
+                                 unsigned maxBytes = 0, bool spill = false)
+            : ScanAndOrder( startFrom, limit, order, frs, maxBytes, spill ) {
             }
             unsigned approxSize() const { return ScanAndOrder::approxSize(); }
         };
@@ -1554,6 +1575,56 @@ namespace QueryTests {
                 assertNumFilled( 1, t );
             }
         };
+
+        /** Past its byte limit a spilling ScanAndOrder sorts on disk and returns the rest later. */
+        class Spill : public Base {
+        public:
+            void run() {
+                FieldRangeSet frs( "n/a", BSONObj(), true );
+                Testable t( 10, 0, BSON( "a" << 1 ), frs, 64 * 1024, true );
+                string filler( 10 * 1024, 'x' );
+                for( int i = 599; i >= 0; --i ) {
+                    t.add( BSON( "a" << i << "filler" << filler ), 0 );
+                }
+                ASSERT( t.spilled() );
+
+                BufBuilder bb;
+                int nout;
+                t.fill( bb, 0, nout );
+                ASSERT( nout > 0 );
+                ASSERT( nout < 590 );
+                const char *p = bb.buf();
+                for( int i = 0; i < nout; ++i ) {
+                    BSONObj o( p );
+                    ASSERT_EQUALS( 10 + i, o[ "a" ].number() );
+                    p += o.objsize();
+                }
+
+                shared_ptr<Cursor> c = t.remaining();
+                ASSERT( c );
+                int next = 10 + nout;
+                for( ; c->ok(); c->advance() ) {
+                    ASSERT_EQUALS( next++, c->current()[ "a" ].number() );
+                }
+                ASSERT_EQUALS( 600, next );
+            }
+        };
+
+        /** Without spilling, the same results exceed the limit. */
+        class NoSpill : public Base {
+        public:
+            void run() {
+                FieldRangeSet frs( "n/a", BSONObj(), true );
+                Testable t( 0, 0, BSON( "a" << 1 ), frs, 64 * 1024 );
+                string filler( 10 * 1024, 'x' );
+                ASSERT_THROWS( {
+                        for( int i = 0; i < 10; ++i ) {
+                            t.add( BSON( "a" << i << "filler" << filler ), 0 );
+                        }
+                    }, UserException );
+                ASSERT( !t.spilled() );
+            }
+        };
         
     } // namespace ScanAndOrderTests
 
@@ -1626,6 +1697,8 @@ namespace QueryTests {
             
             add< ScanAndOrderTests::Unlimited >();
             add< ScanAndOrderTests::LimitOne >();
+            add< ScanAndOrderTests::Spill >();
+            add< ScanAndOrderTests::NoSpill >();
         }
     } myall;
 
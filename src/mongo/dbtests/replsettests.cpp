@@ -29,6 +29,7 @@
 
 #include "mongo/db/repl/rs.h"
 #include "mongo/db/repl/bgsync.h"
+#include "mongo/db/repl/rs_sync.h"
 
 namespace mongo {
     void createOplog();
@@ -320,7 +321,7 @@ namespace ReplSetTests {
     };
 
     class BackgroundSyncTest : public replset::BackgroundSyncInterface {
-        std::queue<BSONObj> _queue;
+        std::deque<BSONObj> _queue;
     public:
         BackgroundSyncTest() {}
         virtual ~BackgroundSyncTest() {}
@@ -331,13 +332,32 @@ namespace ReplSetTests {
             return &_queue.front();
         }
         virtual void consume() {
-            _queue.pop();
+            _queue.pop_front();
         }
         virtual Member* getSyncTarget() {
             return 0;
         }
+        virtual bool peekAt(size_t i, BSONObj* op) {
+            if (i >= _queue.size()) {
+                return false;
+            }
+            *op = _queue[i];
+            return true;
+        }
+        virtual size_t peekRun(size_t i, size_t n, std::deque<BSONObj>* ops) {
+            size_t copied = 0;
+            for ( ; i < _queue.size() && copied < n; i++, copied++ ) {
+                ops->push_back(_queue[i]);
+            }
+            return copied;
+        }
+        virtual void consumeRun(size_t n) {
+            while (n-- && !_queue.empty()) {
+                _queue.pop_front();
+            }
+        }
         void addDoc(BSONObj doc) {
-            _queue.push(doc.getOwned());
+            _queue.push_back(doc.getOwned());
         }
     };
 
@@ -350,7 +370,10 @@ namespace ReplSetTests {
             delete _myConfig;
             delete _config;
         }
-        ReplSetTest() : _syncTail(0) {
+        // set to stop a sync tail without draining its queue
+        bool _primary;
+
+        ReplSetTest() : _syncTail(0), _primary(false) {
             BSONArrayBuilder members;
             members.append(BSON("_id" << 0 << "host" << "host1"));
             members.append(BSON("_id" << 1 << "host" << "host2"));
@@ -362,7 +385,7 @@ namespace ReplSetTests {
             return true;
         }
         virtual bool isPrimary() {
-            return _syncTail->peek() == 0;
+            return _primary || _syncTail->peek() == 0;
         }
         virtual bool tryToGoLiveAsASecondary(OpTime& minvalid) {
             return false;
@@ -381,21 +404,28 @@ namespace ReplSetTests {
         }
     };
 
-    class TestRSSync : public Base {
+    /** a queue, a sync tail on it and theReplSet to go with them */
+    class SyncTailBase : public Base {
+    protected:
         BackgroundSyncTest *_bgsync;
         replset::SyncTail *_tailer;
+        ReplSetTest *_rst;
+
+        virtual replset::SyncTail* makeTailer(replset::BackgroundSyncInterface *q) {
+            return new replset::SyncTail(q);
+        }
 
         void setup() {
             // setup background sync instance
             _bgsync = new BackgroundSyncTest();
 
             // setup tail
-            _tailer = new replset::SyncTail(_bgsync);
+            _tailer = makeTailer(_bgsync);
 
             // setup theReplSet
-            ReplSetTest *rst = new ReplSetTest();
-            rst->setSyncTail(_bgsync);
-            theReplSet = rst;
+            _rst = new ReplSetTest();
+            _rst->setSyncTail(_bgsync);
+            theReplSet = _rst;
         }
 
         void addOp(const string& op, BSONObj o, BSONObj* o2 = 0, const char* coll = 0) {
@@ -424,6 +454,18 @@ namespace ReplSetTests {
             _bgsync->addDoc(b.done());
         }
 
+        void applyOplog() {
+            _tailer->oplogApplication();
+        }
+    public:
+        SyncTailBase() : _bgsync(0), _tailer(0), _rst(0) {}
+        virtual ~SyncTailBase() {
+            delete _bgsync;
+            delete _tailer;
+        }
+    };
+
+    class TestRSSync : public SyncTailBase {
         void addInserts(int expected) {
             for (int i=0; i<expected; i++) {
                 addOp("i", BSON("_id" << i << "x" << 123));
@@ -451,16 +493,7 @@ namespace ReplSetTests {
             addOp("i", BSON("ns" << ns() << "key" << BSON("x" << 1) << "name" << "x1" << "unique" << true), 0, "unittests.system.indexes");
             addInserts(2);
         }
-
-        void applyOplog() {
-            _tailer->oplogApplication();
-        }
     public:
-        ~TestRSSync() {
-            delete _bgsync;
-            delete _tailer;
-        }
-
         void run() {
             const int expected = 100;
 
@@ -492,6 +525,207 @@ namespace ReplSetTests {
         }
     };
 
+    /** notes which writer applied each op, and throws on ops marked fail */
+    class RecordingSyncTail : public replset::SyncTail {
+    public:
+        struct Applied {
+            string ns;
+            int seq;
+            string thread;
+        };
+
+        RecordingSyncTail(replset::BackgroundSyncInterface *q, bool reallyApply) :
+            SyncTail(q), _reallyApply(reallyApply), _m("RecordingSyncTail") {}
+
+        virtual bool syncApply(const BSONObj& o) {
+            if (o["o"]["fail"].trueValue()) {
+                // stop the tail once this batch fails, rather than backing off
+                static_cast<ReplSetTest*>(theReplSet)->_primary = true;
+                uasserted(16445, "failing op");
+            }
+            {
+                scoped_lock lk(_m);
+                Applied a;
+                a.ns = o["ns"].String();
+                a.seq = o["o"]["seq"].numberInt();
+                a.thread = getThreadName();
+                applied.push_back(a);
+            }
+            return _reallyApply ? SyncTail::syncApply(o) : true;
+        }
+
+        bool peekMore(OpQueue* ops) { return tryPeekAndWaitForMore(ops); }
+        void split(const deque<BSONObj>& ops, vector< vector<BSONObj> >* writerVectors) {
+            fillWriterVectors(ops, writerVectors);
+        }
+
+        vector<Applied> applied;
+
+    private:
+        bool _reallyApply;
+        mongo::mutex _m;
+    };
+
+    class RecordingBase : public SyncTailBase {
+    protected:
+        virtual bool reallyApply() const { return false; }
+        virtual replset::SyncTail* makeTailer(replset::BackgroundSyncInterface *q) {
+            return new RecordingSyncTail(q, reallyApply());
+        }
+        RecordingSyncTail* tailer() { return static_cast<RecordingSyncTail*>(_tailer); }
+
+        void addInsert(const string& ns, int seq, bool fail = false) {
+            BSONObjBuilder b;
+            b.append("_id", seq);
+            b.append("seq", seq);
+            if (fail) {
+                b.append("fail", true);
+            }
+            addOp("i", b.obj(), 0, ns.c_str());
+        }
+
+        size_t queued() {
+            deque<BSONObj> all;
+            return _bgsync->peekRun(0, 1000000, &all);
+        }
+    };
+
+    /** a batch over several namespaces is split between the writers by namespace, and each
+        namespace's ops are applied in order on one writer */
+    class BatchSplitByNamespace : public RecordingBase {
+    public:
+        void run() {
+            setup();
+            const int nss = 8;
+            const int perNs = 20;
+            for (int i = 0; i < perNs; i++) {
+                for (int n = 0; n < nss; n++) {
+                    addInsert(str::stream() << "unittests.repl_split_" << n, i);
+                }
+            }
+            applyOplog();
+
+            const vector<RecordingSyncTail::Applied>& applied = tailer()->applied;
+            ASSERT_EQUALS(static_cast<size_t>(nss * perNs), applied.size());
+            ASSERT_EQUALS(0U, queued());
+
+            map<string, int> lastSeq;
+            map<string, string> writer;
+            set<string> writers;
+            for (vector<RecordingSyncTail::Applied>::const_iterator i = applied.begin(); i != applied.end(); ++i) {
+                if (lastSeq.count(i->ns)) {
+                    ASSERT_EQUALS(lastSeq[i->ns] + 1, i->seq);
+                    ASSERT_EQUALS(writer[i->ns], i->thread);
+                }
+                else {
+                    ASSERT_EQUALS(0, i->seq);
+                    writer[i->ns] = i->thread;
+                }
+                lastSeq[i->ns] = i->seq;
+                writers.insert(i->thread);
+            }
+            ASSERT_EQUALS(static_cast<size_t>(nss), lastSeq.size());
+            // applied on the pool, not the sync thread, and by more than one writer
+            ASSERT(!writers.count(getThreadName()));
+            ASSERT(writers.size() > 1);
+
+            // and the partitioning itself keeps each namespace whole on one writer
+            deque<BSONObj> ops;
+            for (int n = 0; n < nss; n++) {
+                ops.push_back(BSON("ns" << (string)(str::stream() << "unittests.repl_split_" << n) << "seq" << 0));
+                ops.push_back(BSON("ns" << (string)(str::stream() << "unittests.repl_split_" << n) << "seq" << 1));
+            }
+            vector< vector<BSONObj> > writerVectors(4);
+            tailer()->split(ops, &writerVectors);
+            size_t total = 0;
+            for (size_t w = 0; w < writerVectors.size(); w++) {
+                for (size_t j = 0; j < writerVectors[w].size(); j++) {
+                    if (writerVectors[w][j]["seq"].numberInt() == 0) {
+                        // its successor is the next op on this writer for its namespace
+                        size_t k = j + 1;
+                        while (k < writerVectors[w].size() &&
+                               writerVectors[w][k]["ns"].String() != writerVectors[w][j]["ns"].String()) {
+                            k++;
+                        }
+                        ASSERT(k < writerVectors[w].size());
+                        ASSERT_EQUALS(1, writerVectors[w][k]["seq"].numberInt());
+                    }
+                }
+                total += writerVectors[w].size();
+            }
+            ASSERT_EQUALS(ops.size(), total);
+        }
+    };
+
+    /** a batch that fails partway stays queued, with minValid already at its last op */
+    class FailedBatchStaysQueued : public RecordingBase {
+    protected:
+        virtual bool reallyApply() const { return true; }
+    public:
+        void run() {
+            setup();
+            drop();
+            for (int i = 0; i < 6; i++) {
+                addInsert(ns(), i, i == 3);
+            }
+            BSONObj last;
+            ASSERT(_bgsync->peekAt(5, &last));
+
+            applyOplog();
+            _rst->_primary = false;
+
+            // the writer stopped at the failing op, and nothing was taken off the queue
+            ASSERT_EQUALS(3, static_cast<int>(client()->count(ns())));
+            ASSERT_EQUALS(6U, queued());
+
+            // minValid was moved to the end of the batch before any of it was applied
+            BSONObj mv;
+            {
+                Lock::DBRead lk("local.replset.minvalid");
+                ASSERT(Helpers::getSingleton("local.replset.minvalid", mv));
+            }
+            ASSERT(mv["ts"]._opTime() == last["ts"]._opTime());
+            drop();
+        }
+    };
+
+    /** a batch ends before a command or an index build, which go in a batch of their own */
+    class CommandEndsBatch : public RecordingBase {
+    public:
+        void run() {
+            setup();
+            addInsert(ns(), 0);
+            addInsert(ns(), 1);
+            addOp("c", BSON("create" << "repl_cmd"), 0, "unittests.$cmd");
+            addInsert(ns(), 2);
+            addOp("i", BSON("ns" << ns() << "key" << BSON("seq" << 1) << "name" << "seq_1"), 0, "unittests.system.indexes");
+
+            replset::SyncTail::OpQueue first;
+            while (!tailer()->peekMore(&first)) {
+            }
+            ASSERT_EQUALS(2U, first.getDeque().size());
+            ASSERT_EQUALS("i", first.getDeque().back()["op"].String());
+            _bgsync->consumeRun(2);
+
+            replset::SyncTail::OpQueue cmd;
+            ASSERT(tailer()->peekMore(&cmd));
+            ASSERT_EQUALS(1U, cmd.getDeque().size());
+            ASSERT_EQUALS("c", cmd.getDeque().front()["op"].String());
+            _bgsync->consumeRun(1);
+
+            replset::SyncTail::OpQueue insert;
+            while (!tailer()->peekMore(&insert)) {
+            }
+            ASSERT_EQUALS(1U, insert.getDeque().size());
+            _bgsync->consumeRun(1);
+
+            replset::SyncTail::OpQueue index;
+            ASSERT(tailer()->peekMore(&index));
+            ASSERT_EQUALS(1U, index.getDeque().size());
+            ASSERT_EQUALS("unittests.system.indexes", index.getDeque().front()["ns"].String());
+        }
+    };
+
     class All : public Suite {
     public:
         All() : Suite( "replset" ) {
@@ -504,6 +738,9 @@ namespace ReplSetTests {
             add< CappedUpdate >();
             add< CappedInsert >();
             add< TestRSSync >();
+            add< BatchSplitByNamespace >();
+            add< FailedBatchStaysQueued >();
+            add< CommandEndsBatch >();
         }
     } myall;
 }
@@ -1118,6 +1118,44 @@ namespace ReplTests {
         }
     };
 
+    /** With a checkpoint every op, FindingStartCursor starts just short of the first match */
+    class FindingStartCursorIndexed : public Base {
+    public:
+        FindingStartCursorIndexed() : _old( __oplogStartCheckpointBytes ) {
+            __oplogStartCheckpointBytes = 1;
+            OplogStartIndex::invalidate( cllNS() );
+        }
+        ~FindingStartCursorIndexed() {
+            __oplogStartCheckpointBytes = _old;
+            OplogStartIndex::invalidate( cllNS() );
+        }
+        void run() {
+            for( int i = 0; i < 20; ++i ) {
+                client()->insert( ns(), BSON( "_id" << i ) );
+            }
+            OpTime ts = client()->query( "local.oplog.$main", Query().sort( BSON( "$natural" << 1 ) ), 1, 10 )->next()[ "ts" ]._opTime();
+            Client::Context ctx( cllNS() );
+            NamespaceDetails *nsd = nsdetails( cllNS() );
+            BSONObjBuilder b;
+            b.appendTimestamp( "$gte", ts.asDate() );
+            BSONObj query = BSON( "ts" << b.obj() );
+            FieldRangeSetPair frsp( cllNS(), query );
+            BSONObj order = BSON( "$natural" << 1 );
+            scoped_ptr<QueryPlan> qp( QueryPlan::make( nsd, -1, frsp, &frsp, query, order ) );
+            scoped_ptr<FindingStartCursor> fsc( FindingStartCursor::make( *qp ) );
+            int steps = 0;
+            while( !fsc->done() ) {
+                fsc->next();
+                ++steps;
+            }
+            // the op before the first match, then the match; a scan back from the end takes ten
+            ASSERT_EQUALS( 2, steps );
+            ASSERT( ts == fsc->cursor()->current()[ "ts" ]._opTime() );
+        }
+    private:
+        int _old;
+    };
+
     /** Check ReplSetConfig::MemberCfg equality */
     class ReplSetMemberCfgEquality : public Base {
     public:
@@ -1235,6 +1273,7 @@ namespace ReplTests {
             add< DatabaseIgnorerUpdate >();
             add< FindingStartCursorStale >();
             add< FindingStartCursorYield >();
+            add< FindingStartCursorIndexed >();
             add< ReplSetMemberCfgEquality >();
             add< ShouldRetry >();
         }
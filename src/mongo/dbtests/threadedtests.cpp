@@ -29,6 +29,7 @@
 #include "../db/d_concurrency.h"
 #include "../util/concurrency/synchronization.h"
 #include "../util/concurrency/qlock.h"
+#include "../util/concurrency/brlock.h"
 #include "dbtests.h"
 #include "mongo/util/concurrency/ticketholder.h"
 #include "mongo/platform/atomic_word.h"
@@ -295,6 +296,66 @@ namespace ThreadedTests {
         }
     };
 
+    /** OpTime::now() from many threads, without the mutex, hands out each time once, in order. */
+    class OpTimeNowIsUnique : public ThreadedTest<> {
+        static const int iterations = 100000;
+        mongo::mutex _m;
+        vector<unsigned long long> _all;
+
+    public:
+        OpTimeNowIsUnique() : _m( "OpTimeNowIsUnique" ) {}
+
+    private:
+        void subthread(int) {
+            vector<unsigned long long> mine;
+            mine.reserve( iterations );
+            for( int i = 0; i < iterations; i++ ) {
+                mine.push_back( OpTime::now().asDate() );
+                if ( i % 1000 == 0 ) {
+                    // the locked variant takes its turn too
+                    mongo::mutex::scoped_lock lk( OpTime::m );
+                    mine.push_back( OpTime::now( lk ).asDate() );
+                }
+            }
+            for( unsigned i = 1; i < mine.size(); i++ ) {
+                ASSERT( mine[ i - 1 ] < mine[ i ] );
+            }
+            scoped_lock lk( _m );
+            _all.insert( _all.end(), mine.begin(), mine.end() );
+        }
+        void validate() {
+            sort( _all.begin(), _all.end() );
+            ASSERT( adjacent_find( _all.begin(), _all.end() ) == _all.end() );
+            ASSERT_EQUALS( (size_t) nthreads * ( iterations + iterations / 1000 ), _all.size() );
+        }
+    };
+
+    /** OIDs from threads with their own blocks of increments are still all different. */
+    class OIDGenIsUnique : public ThreadedTest<> {
+        static const int iterations = 100000;
+        mongo::mutex _m;
+        vector<OID> _all;
+
+    public:
+        OIDGenIsUnique() : _m( "OIDGenIsUnique" ) {}
+
+    private:
+        void subthread(int) {
+            vector<OID> mine;
+            mine.reserve( iterations );
+            for( int i = 0; i < iterations; i++ ) {
+                mine.push_back( OID::gen() );
+            }
+            scoped_lock lk( _m );
+            _all.insert( _all.end(), mine.begin(), mine.end() );
+        }
+        void validate() {
+            sort( _all.begin(), _all.end() );
+            ASSERT( adjacent_find( _all.begin(), _all.end() ) == _all.end() );
+            ASSERT_EQUALS( (size_t) nthreads * iterations, _all.size() );
+        }
+    };
+
     template <typename _AtomicUInt>
     class IsAtomicWordAtomic : public ThreadedTest<> {
         static const int iterations = 1000000;
@@ -890,6 +951,202 @@ namespace ThreadedTests {
         }
     };
 
+    /** a reader sees a writer queue up behind it on its database, and nothing before that */
+    class OthersWaiting : public ThreadedTest<2> {
+    public:
+        OthersWaiting() : sawWriter(false) { }
+    private:
+        bool sawWriter;
+        virtual void validate() { ASSERT( sawWriter ); }
+        virtual void subthread(int x) {
+            Client::initThread("otherswaiting");
+            if( x == 1 ) {
+                Lock::DBRead r("otherswaiting");
+                ASSERT( !Lock::othersWaiting() );
+                Timer t;
+                while( !Lock::othersWaiting() && t.millis() < 5000 )
+                    sleepmillis(1);
+                sawWriter = Lock::othersWaiting();
+            }
+            if( x == 2 ) {
+                sleepmillis(100);
+                Lock::DBWrite w("otherswaiting");
+                ASSERT( !Lock::othersWaiting() );
+            }
+            cc().shutdown();
+        }
+    };
+
+    /** readers never see a writer's half done work, and writers never overlap anyone. */
+    class BRLockTest : public ThreadedTest<12> {
+    public:
+        BRLockTest() : a(0), b(0) { }
+    private:
+        BRLock m;
+        volatile unsigned a, b;
+        AtomicUInt32 readers, writers;
+        virtual void validate() {
+            ASSERT_EQUALS( a, b );
+            ASSERT_EQUALS( 0U, readers.load() );
+            ASSERT_EQUALS( 0U, writers.load() );
+        }
+        virtual void subthread(int x) {
+            for( int i = 0; i < 20000; i++ ) {
+                if( x % 4 == 0 && i % 10 == 0 ) {
+                    m.lock();
+                    ASSERT_EQUALS( 1U, writers.addAndFetch(1) );
+                    ASSERT_EQUALS( 0U, readers.load() );
+                    a++;
+                    b++;
+                    writers.subtractAndFetch(1);
+                    m.unlock();
+                }
+                else {
+                    m.lock_shared();
+                    readers.addAndFetch(1);
+                    ASSERT_EQUALS( 0U, writers.load() );
+                    ASSERT_EQUALS( a, b );
+                    readers.subtractAndFetch(1);
+                    m.unlock_shared();
+                }
+            }
+        }
+    };
+
+    /** a waiting writer holds off new readers, and the readers it held off go before the next writer. */
+    class BRLockIsFair : public ThreadedTest<4> {
+    public:
+        BRLockIsFair() : gotW(false), gotR(false) { }
+    private:
+        BRLock m;
+        volatile bool gotW, gotR;
+        virtual void validate() { }
+        virtual void subthread(int x) {
+            if( x == 1 ) {
+                m.lock_shared();
+                sleepmillis(300);
+                m.unlock_shared();
+            }
+            if( x == 2 ) {
+                sleepmillis(100);
+                m.lock();
+                gotW = true;
+                sleepmillis(100);
+                m.unlock();
+            }
+            if( x == 3 ) {
+                sleepmillis(200);
+                Timer t;
+                m.lock_shared();
+                ASSERT( gotW );
+                ASSERT( t.millis() > 50 );
+                gotR = true;
+                m.unlock_shared();
+            }
+            if( x == 4 ) {
+                sleepmillis(250);
+                m.lock();
+                ASSERT( gotR );
+                m.unlock();
+            }
+        }
+    };
+
+    /** nreaders readers hammer the shared lock while a writer takes it now and then: the writer
+        never finds a reader inside, nor a reader the writer.  each thread marks itself inside on
+        its own cacheline, so the check doesn't serialize the readers; it also logs how many
+        shared locks per second they got.
+    */
+    template <class whichlock, int nreaders>
+    class ReadLockScaling : public ThreadedTest<nreaders + 1> {
+    public:
+        ReadLockScaling() : done(false), writes(0) { }
+    private:
+        struct Inside {
+            AtomicUInt32 n;
+            char pad[64 - sizeof(AtomicUInt32)];
+        };
+        whichlock m;
+        volatile bool done;
+        Inside readerInside[nreaders + 2]; // by subthread number, 2..nreaders+1
+        AtomicUInt32 writerInside;
+        AtomicUInt32 overlaps;
+        AtomicUInt64 locks;
+        unsigned long long writes;
+        virtual void validate() {
+            ASSERT_EQUALS( 0U , overlaps.load() );
+            ASSERT( writes > 0 );
+            ASSERT( locks.load() > 0 );
+            log() << typeid(whichlock).name() << ' ' << nreaders << " readers: "
+                  << locks.load() * 2 << " shared locks/sec, " << writes << " writes" << endl;
+        }
+        virtual void subthread(int x) {
+            Timer t;
+            if( x == 1 ) {
+                // at least once, even if the readers are already done
+                do {
+                    m.lock();
+                    writerInside.store(1);
+                    for( int i = 2; i <= nreaders + 1; i++ ) {
+                        if( readerInside[i].n.load() )
+                            overlaps.fetchAndAdd(1);
+                    }
+                    writerInside.store(0);
+                    m.unlock();
+                    writes++;
+                    sleepmillis(1);
+                } while( !done );
+                return;
+            }
+            unsigned long long n = 0;
+            while( !done ) {
+                for( int i = 0; i < 1000; i++ ) {
+                    m.lock_shared();
+                    readerInside[x].n.store(1);
+                    if( writerInside.load() )
+                        overlaps.fetchAndAdd(1);
+                    readerInside[x].n.store(0);
+                    m.unlock_shared();
+                }
+                n += 1000;
+                if( t.millis() > 500 )
+                    done = true;
+            }
+            locks.fetchAndAdd(n);
+        }
+    };
+
+    // Many threads bumping a counter under one mutex: every increment must land, and each time
+    // a thread found the mutex held it either got it spinning or parked
+    template <class M, class L>
+    class AdaptiveMutexCounts : public ThreadedTest<8> {
+        enum { N = 20000 };
+        M _m;
+        long long _n;
+        static const char *name() { return "adaptiveMutexTest"; }
+    public:
+        AdaptiveMutexCounts() : _m( name() ), _n( 0 ) { }
+    private:
+        virtual void subthread( int ) {
+            for( int i = 0; i < N; i++ ) {
+                L lk( _m );
+                _n++;
+            }
+        }
+        virtual void validate() {
+            ASSERT_EQUALS( (long long) N * nthreads, _n );
+            vector<MutexContention::Entry> counts;
+            MutexContention::snapshot( counts );
+            for( unsigned i = 0; i < counts.size(); i++ ) {
+                if( counts[i].name == name() ) {
+                    ASSERT_EQUALS( counts[i].contended, counts[i].spun + counts[i].parked );
+                    log() << "AdaptiveMutexCounts contended:" << counts[i].contended
+                          << " spun:" << counts[i].spun << " parked:" << counts[i].parked << endl;
+                }
+            }
+        }
+    };
+
     // Tests waiting on the TicketHolder by running many more threads than can fit into the "hotel", but only
     // max _nRooms threads should ever get in at once
     class TicketHolderWaits : public ThreadedTest<10> {
@@ -972,6 +1229,13 @@ namespace ThreadedTests {
             add< WriteLocksAreGreedy >();
             add< QLockTest >();
             add< QLockTest >();
+            add< OthersWaiting >();
+            add< BRLockTest >();
+            add< BRLockIsFair >();
+            add< ReadLockScaling<SimpleRWLock,1> >();
+            add< ReadLockScaling<BRLock,1> >();
+            add< ReadLockScaling<SimpleRWLock,16> >();
+            add< ReadLockScaling<BRLock,16> >();
 
             // Slack is a test to see how long it takes for another thread to pick up
             // and begin work after another relinquishes the lock.  e.g. a spin lock 
@@ -980,6 +1244,8 @@ namespace ThreadedTests {
             add< Slack<SimpleMutex,SimpleMutex::scoped_lock> >();
             add< Slack<SimpleRWLock,SimpleRWLock::Exclusive> >();
             add< CondSlack >();
+            add< AdaptiveMutexCounts<mongo::mutex, mongo::mutex::scoped_lock> >();
+            add< AdaptiveMutexCounts<SimpleMutex, SimpleMutex::scoped_lock> >();
 
             add< UpgradableTest >();
             add< List1Test >();
@@ -988,6 +1254,8 @@ namespace ThreadedTests {
             add< IsAtomicUIntAtomic >();
             add< IsAtomicWordAtomic<AtomicUInt32> >();
             add< IsAtomicWordAtomic<AtomicUInt64> >();
+            add< OpTimeNowIsUnique >();
+            add< OIDGenIsUnique >();
             add< MVarTest >();
             add< ThreadPoolTest >();
             add< LockTest >();
@@ -0,0 +1,114 @@
+// timer_wheel_test.cpp : timer_wheel.h unit tests
+
+/**
+ *    Copyright (C) 2012 10gen Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../pch.h"
+
+#include "dbtests.h"
+#include "../util/timer_wheel.h"
+
+namespace TimerWheelTests {
+
+    using mongo::TimerWheel;
+
+    /** @return the ids expire( now ) gives back, sorted */
+    static vector<long long> expire( TimerWheel& w , long long now ) {
+        vector<long long> ids;
+        w.expire( now , &ids );
+        sort( ids.begin() , ids.end() );
+        return ids;
+    }
+
+    class Due {
+    public:
+        void run() {
+            TimerWheel w( 100 , 16 );
+            w.add( 1 , 250 , 0 );
+            w.add( 2 , 450 , 0 );
+            w.add( 3 , 470 , 0 );
+            ASSERT_EQUALS( 3U , w.size() );
+
+            ASSERT( expire( w , 199 ).empty() );
+            vector<long long> ids = expire( w , 299 );
+            ASSERT_EQUALS( 1U , ids.size() );
+            ASSERT_EQUALS( 1 , ids[0] );
+
+            // a late call catches up on every slot it missed
+            ids = expire( w , 1000 );
+            ASSERT_EQUALS( 2U , ids.size() );
+            ASSERT_EQUALS( 2 , ids[0] );
+            ASSERT_EQUALS( 3 , ids[1] );
+            ASSERT_EQUALS( 0U , w.size() );
+        }
+    };
+
+    class Remove {
+    public:
+        void run() {
+            TimerWheel w( 100 , 16 );
+            long long t = w.add( 1 , 250 , 0 );
+            w.add( 2 , 250 , 0 );
+            w.remove( 1 , t );
+            ASSERT_EQUALS( 1U , w.size() );
+            vector<long long> ids = expire( w , 300 );
+            ASSERT_EQUALS( 1U , ids.size() );
+            ASSERT_EQUALS( 2 , ids[0] );
+        }
+    };
+
+    /** past due goes in the slot now is in, beyond the ring at its far edge */
+    class Clamped {
+    public:
+        void run() {
+            TimerWheel w( 100 , 16 );
+            ASSERT( expire( w , 500 ).empty() );
+            w.add( 1 , 100 , 500 );
+            ASSERT_EQUALS( 1U , expire( w , 500 ).size() );
+
+            long long t = w.add( 2 , 1000000 , 500 );
+            ASSERT_EQUALS( 5 + 15 , t );
+            ASSERT( expire( w , 1999 ).empty() );
+            ASSERT_EQUALS( 1U , expire( w , 2000 ).size() );
+        }
+    };
+
+    /** a ring's worth of slots left unvisited is visited once */
+    class WrapsOnce {
+    public:
+        void run() {
+            TimerWheel w( 100 , 4 );
+            for ( long long i = 0; i < 4; i++ )
+                w.add( i , i * 100 , 0 );
+            ASSERT_EQUALS( 4U , expire( w , 100000 ).size() );
+            ASSERT( expire( w , 100000 ).empty() );
+            ASSERT_EQUALS( 0U , w.size() );
+        }
+    };
+
+    class All : public Suite {
+    public:
+        All() : Suite( "timerwheel" ) {}
+
+        void setupTests() {
+            add< Due >();
+            add< Remove >();
+            add< Clamped >();
+            add< WrapsOnce >();
+        }
+    } myall;
+
+} // namespace TimerWheelTests
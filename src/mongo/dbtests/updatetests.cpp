@@ -493,6 +493,23 @@ namespace UpdateTests {
     };
 
 
+    /** an update by _id of indexed fields, as on a secondary, keeps the index right */
+    class IndexModById : public SetBase {
+    public:
+        void run() {
+            client().ensureIndex( ns(), BSON( "a.b" << 1 ) );
+            client().ensureIndex( ns(), BSON( "n" << 1 ) );
+            client().insert( ns(), fromjson( "{'_id':0,a:{b:3},n:1}" ) );
+            // $inc of n could be done in place, were it not indexed
+            client().update( ns(), BSON( "_id" << 0 ), fromjson( "{$set:{'a.b':4},$inc:{n:1}}" ) );
+            ASSERT_EQUALS( fromjson( "{'_id':0,a:{b:4},n:2}" ) , client().findOne( ns(), Query() ) );
+            ASSERT( client().findOne( ns(), Query( fromjson( "{'a.b':3}" ) ).hint( BSON( "a.b" << 1 ) ) ).isEmpty() );
+            ASSERT( client().findOne( ns(), Query( fromjson( "{n:1}" ) ).hint( BSON( "n" << 1 ) ) ).isEmpty() );
+            ASSERT_EQUALS( fromjson( "{'_id':0,a:{b:4},n:2}" ) ,
+                           client().findOne( ns(), Query( fromjson( "{n:2}" ) ).hint( BSON( "n" << 1 ) ) ) );
+        }
+    };
+
     class PreserveIdWithIndex : public SetBase { // Not using $set, but base class is still useful
     public:
         void run() {
@@ -921,6 +938,7 @@ namespace UpdateTests {
             add< InsertInEmpty >();
             add< IndexParentOfMod >();
             add< IndexModSet >();
+            add< IndexModById >();
             add< PreserveIdWithIndex >();
             add< CheckNoMods >();
             add< UpdateMissingToNull >();
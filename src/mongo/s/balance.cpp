@@ -18,6 +18,8 @@
 
 #include "pch.h"
 
+#include <boost/thread/thread.hpp>
+
 #include "../db/jsobj.h"
 #include "../db/cmdline.h"
 
@@ -40,63 +42,92 @@ namespace mongo {
     Balancer::~Balancer() {
     }
 
-    int Balancer::_moveChunks( const vector<CandidateChunkPtr>* candidateChunks ) {
-        int movedCount = 0;
+    void Balancer::_moveChunk( const CandidateChunk& chunkInfo, int* moved ) {
+        *moved = 0;
 
-        for ( vector<CandidateChunkPtr>::const_iterator it = candidateChunks->begin(); it != candidateChunks->end(); ++it ) {
-            const CandidateChunk& chunkInfo = *it->get();
+        DBConfigPtr cfg = grid.getDBConfig( chunkInfo.ns );
+        verify( cfg );
 
-            DBConfigPtr cfg = grid.getDBConfig( chunkInfo.ns );
-            verify( cfg );
+        ChunkManagerPtr cm = cfg->getChunkManager( chunkInfo.ns );
+        verify( cm );
 
-            ChunkManagerPtr cm = cfg->getChunkManager( chunkInfo.ns );
+        const BSONObj& chunkToMove = chunkInfo.chunk;
+        ChunkPtr c = cm->findChunk( chunkToMove["min"].Obj() );
+        if ( c->getMin().woCompare( chunkToMove["min"].Obj() ) || c->getMax().woCompare( chunkToMove["max"].Obj() ) ) {
+            // likely a split happened somewhere
+            cm = cfg->getChunkManager( chunkInfo.ns , true /* reload */);
             verify( cm );
 
-            const BSONObj& chunkToMove = chunkInfo.chunk;
-            ChunkPtr c = cm->findChunk( chunkToMove["min"].Obj() );
+            c = cm->findChunk( chunkToMove["min"].Obj() );
             if ( c->getMin().woCompare( chunkToMove["min"].Obj() ) || c->getMax().woCompare( chunkToMove["max"].Obj() ) ) {
-                // likely a split happened somewhere
-                cm = cfg->getChunkManager( chunkInfo.ns , true /* reload */);
-                verify( cm );
-
-                c = cm->findChunk( chunkToMove["min"].Obj() );
-                if ( c->getMin().woCompare( chunkToMove["min"].Obj() ) || c->getMax().woCompare( chunkToMove["max"].Obj() ) ) {
-                    log() << "chunk mismatch after reload, ignoring will retry issue cm: "
-                          << c->getMin() << " min: " << chunkToMove["min"].Obj() << endl;
-                    continue;
-                }
+                log() << "chunk mismatch after reload, ignoring will retry issue cm: "
+                      << c->getMin() << " min: " << chunkToMove["min"].Obj() << endl;
+                return;
             }
+        }
 
-            BSONObj res;
-            if ( c->moveAndCommit( Shard::make( chunkInfo.to ) , Chunk::MaxChunkSize , res ) ) {
-                movedCount++;
-                continue;
+        BSONObj res;
+        if ( c->moveAndCommit( Shard::make( chunkInfo.to ) , Chunk::MaxChunkSize , res ) ) {
+            *moved = 1;
+            return;
+        }
+
+        // the move requires acquiring the collection metadata's lock, which can fail
+        log() << "balancer move failed: " << res << " from: " << chunkInfo.from << " to: " << chunkInfo.to
+              << " chunk: " << chunkToMove << endl;
+
+        if ( res["chunkTooBig"].trueValue() ) {
+            // reload just to be safe
+            cm = cfg->getChunkManager( chunkInfo.ns );
+            verify( cm );
+            c = cm->findChunk( chunkToMove["min"].Obj() );
+            
+            log() << "forcing a split because migrate failed for size reasons" << endl;
+            
+            res = BSONObj();
+            c->singleSplit( true , res );
+            log() << "forced split results: " << res << endl;
+            
+            if ( ! res["ok"].trueValue() ) {
+                log() << "marking chunk as jumbo: " << c->toString() << endl;
+                c->markAsJumbo();
+                // we count it as moved so we do another round right away
+                *moved = 1;
             }
 
-            // the move requires acquiring the collection metadata's lock, which can fail
-            log() << "balancer move failed: " << res << " from: " << chunkInfo.from << " to: " << chunkInfo.to
-                  << " chunk: " << chunkToMove << endl;
+        }
+    }
 
-            if ( res["chunkTooBig"].trueValue() ) {
-                // reload just to be safe
-                cm = cfg->getChunkManager( chunkInfo.ns );
-                verify( cm );
-                c = cm->findChunk( chunkToMove["min"].Obj() );
-                
-                log() << "forcing a split because migrate failed for size reasons" << endl;
-                
-                res = BSONObj();
-                c->singleSplit( true , res );
-                log() << "forced split results: " << res << endl;
-                
-                if ( ! res["ok"].trueValue() ) {
-                    log() << "marking chunk as jumbo: " << c->toString() << endl;
-                    c->markAsJumbo();
-                    // we increment moveCount so we do another round right away
-                    movedCount++;
-                }
+    void Balancer::_moveChunkInBackground( CandidateChunkPtr chunkInfo, int* moved ) {
+        try {
+            _moveChunk( *chunkInfo , moved );
+        }
+        catch ( std::exception& e ) {
+            log() << "balancer move of " << chunkInfo->chunk << " from: " << chunkInfo->from
+                  << " to: " << chunkInfo->to << " failed: " << e.what() << endl;
+        }
+    }
+
+    int Balancer::_moveChunks( const vector<MigrationBatch>* batches ) {
+        int movedCount = 0;
+
+        for ( vector<MigrationBatch>::const_iterator it = batches->begin(); it != batches->end(); ++it ) {
+            const MigrationBatch& batch = *it;
+            vector<int> moved( batch.size() , 0 );
 
+            if ( batch.size() == 1 ) {
+                _moveChunk( *batch[0] , &moved[0] );
             }
+            else {
+                log() << "balancer moving " << batch.size() << " chunks at once" << endl;
+                boost::thread_group threads;
+                for ( size_t i = 0; i < batch.size(); i++ )
+                    threads.create_thread( boost::bind( &Balancer::_moveChunkInBackground, this, batch[i], &moved[i] ) );
+                threads.join_all();
+            }
+
+            for ( size_t i = 0; i < moved.size(); i++ )
+                movedCount += moved[i];
         }
 
         return movedCount;
@@ -143,8 +174,9 @@ namespace mongo {
         return true;
     }
 
-    void Balancer::_doBalanceRound( DBClientBase& conn, vector<CandidateChunkPtr>* candidateChunks ) {
-        verify( candidateChunks );
+    void Balancer::_doBalanceRound( DBClientBase& conn, vector<MigrationBatch>* batches, unsigned maxParallel ) {
+        verify( batches );
+        verify( maxParallel > 0 );
 
         //
         // 1. Check whether there is any sharded collection to be balanced by querying
@@ -205,6 +237,8 @@ namespace mongo {
         // 3. For each collection, check if the balancing policy recommends moving anything around.
         //
 
+        typedef list< pair< string, BalancerPolicy::ShardToChunksMap > > PendingList;
+        PendingList pending;
         for (vector<string>::const_iterator it = collections.begin(); it != collections.end(); ++it ) {
             const string& ns = *it;
 
@@ -230,8 +264,40 @@ namespace mongo {
                 shardToChunksMap[s.getName()].size();
             }
 
-            CandidateChunk* p = _policy->balance( ns , shardLimitsMap , shardToChunksMap , _balancedLastTime );
-            if ( p ) candidateChunks->push_back( CandidateChunkPtr( p ) );
+            pending.push_back( make_pair( ns , BalancerPolicy::ShardToChunksMap() ) );
+            pending.back().second.swap( shardToChunksMap );
+        }
+
+        //
+        // 4. Group the moves in batches which share no shard. A collection has at most one move a round, as a move
+        // holds the collection's distributed lock. One whose move would use a shard busy in the batch being built
+        // waits for a later batch.
+        //
+
+        while ( ! pending.empty() ) {
+            set<string> busyShards;
+            MigrationBatch batch;
+            PendingList::iterator i = pending.begin();
+            while ( i != pending.end() && batch.size() < maxParallel ) {
+                CandidateChunk* p = _policy->balance( i->first , shardLimitsMap , i->second , _balancedLastTime , busyShards );
+                if ( p ) {
+                    batch.push_back( CandidateChunkPtr( p ) );
+                    busyShards.insert( p->from );
+                    busyShards.insert( p->to );
+                    i = pending.erase( i );
+                }
+                else if ( busyShards.empty() ) {
+                    // balanced, or stuck, whatever else moves
+                    i = pending.erase( i );
+                }
+                else {
+                    ++i;
+                }
+            }
+
+            if ( batch.empty() )
+                break;
+            batches->push_back( batch );
         }
     }
 
@@ -333,14 +399,20 @@ namespace mongo {
                     
                     LOG(1) << "*** start balancing round" << endl;
 
-                    vector<CandidateChunkPtr> candidateChunks;
-                    _doBalanceRound( conn.conn() , &candidateChunks );
-                    if ( candidateChunks.size() == 0 ) {
+                    // how many migrations may run at once; each must be between shards no other is using
+                    unsigned maxParallel = 1;
+                    BSONObj balancerDoc = conn->findOne( ShardNS::settings , BSON( "_id" << "balancer" ) );
+                    if ( balancerDoc["maxParallelMigrations"].isNumber() && balancerDoc["maxParallelMigrations"].numberInt() > 1 )
+                        maxParallel = balancerDoc["maxParallelMigrations"].numberInt();
+
+                    vector<MigrationBatch> batches;
+                    _doBalanceRound( conn.conn() , &batches , maxParallel );
+                    if ( batches.size() == 0 ) {
                         LOG(1) << "no need to move any chunk" << endl;
                         _balancedLastTime = 0;
                     }
                     else {
-                        _balancedLastTime = _moveChunks( &candidateChunks );
+                        _balancedLastTime = _moveChunks( &batches );
                     }
                     
                     LOG(1) << "*** end of balancing round" << endl;
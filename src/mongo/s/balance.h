@@ -31,7 +31,11 @@ namespace mongo {
      *
      * The balancer does act continuously but in "rounds". At a given round, it would decide if there is an imbalance by
      * checking the difference in chunks between the most and least loaded shards. It would issue a request for a chunk
-     * migration per round, if it found so.
+     * migration per collection per round, if it found so.
+     *
+     * The moves of a round are grouped in batches which share no shard, as a shard can only donate or receive one chunk
+     * at a time. The moves of a batch run at once, up to the 'maxParallelMigrations' of the balancer settings (default
+     * 1), and the batches one after the other.
      */
     class Balancer : public BackgroundJob {
     public:
@@ -47,6 +51,7 @@ namespace mongo {
     private:
         typedef BalancerPolicy::ChunkInfo CandidateChunk;
         typedef shared_ptr<CandidateChunk> CandidateChunkPtr;
+        typedef vector<CandidateChunkPtr> MigrationBatch; // moves on distinct shards
 
         // hostname:port of my mongos
         string _myid;
@@ -74,17 +79,28 @@ namespace mongo {
          * be moved.
          *
          * @param conn is the connection with the config server(s)
-         * @param candidateChunks (IN/OUT) filled with candidate chunks, one per collection, that could possibly be moved
+         * @param batches (IN/OUT) filled with candidate chunks, one per collection, that could possibly be moved,
+         * in batches of at most maxParallel which share no shard
          */
-        void _doBalanceRound( DBClientBase& conn, vector<CandidateChunkPtr>* candidateChunks );
+        void _doBalanceRound( DBClientBase& conn, vector<MigrationBatch>* batches, unsigned maxParallel );
 
         /**
-         * Issues chunk migration request, one at a time.
+         * Issues chunk migration requests, a batch at a time, with those of a batch running at once.
          *
-         * @param candidateChunks possible chunks to move
+         * @param batches possible chunks to move
          * @return number of chunks effectively moved
          */
-        int _moveChunks( const vector<CandidateChunkPtr>* candidateChunks );
+        int _moveChunks( const vector<MigrationBatch>* batches );
+
+        /**
+         * Issues one chunk migration request.
+         *
+         * @param moved (OUT) 1 if the chunk moved, or was marked jumbo so that the next round comes soon, else 0
+         */
+        void _moveChunk( const CandidateChunk& chunkInfo, int* moved );
+
+        /** _moveChunk() for a thread of a batch; logs rather than throws */
+        void _moveChunkInBackground( CandidateChunkPtr chunkInfo, int* moved );
 
         /**
          * Marks this balancer as being live on the config server(s).
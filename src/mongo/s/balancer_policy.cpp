@@ -33,7 +33,8 @@ namespace mongo {
     BalancerPolicy::ChunkInfo* BalancerPolicy::balance( const string& ns,
             const ShardToLimitsMap& shardToLimitsMap,
             const ShardToChunksMap& shardToChunksMap,
-            int balancedLastTime ) {
+            int balancedLastTime,
+            const set<string>& busyShards ) {
         pair<string,unsigned> min("",numeric_limits<unsigned>::max());
         pair<string,unsigned> max("",0);
         vector<string> drainingShards;
@@ -42,8 +43,14 @@ namespace mongo {
 
         for (ShardToChunksIter i = shardToChunksMap.begin(); i!=shardToChunksMap.end(); ++i ) {
 
-            // Find whether this shard's capacity or availability are exhausted
+            // A shard can only be in one migration at a time
             const string& shard = i->first;
+            if ( busyShards.count( shard ) ) {
+                LOG(1) << "won't move a chunk to or from: " << shard << " because it is in another migration" << endl;
+                continue;
+            }
+
+            // Find whether this shard's capacity or availability are exhausted
             BSONObj shardLimits;
             ShardToLimitsIter it = shardToLimitsMap.find( shard );
             if ( it != shardToLimitsMap.end() ) shardLimits = it->second;
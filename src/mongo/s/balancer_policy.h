@@ -38,12 +38,15 @@ namespace mongo {
          * @param shardToChunksMap is a map from shardId to chunks that live there. A chunk's format
          * is { }.
          * @param balancedLastTime is the number of chunks effectively moved in the last round.
+         * @param busyShards are shards already donating or receiving a chunk this round, which
+         * the move must leave out, so that the moves of a round can all run at once.
          * @returns NULL or ChunkInfo of the best move to make towards balacing the collection.
          */
         typedef map< string,BSONObj > ShardToLimitsMap;
         typedef map< string,vector<BSONObj> > ShardToChunksMap;
         static ChunkInfo* balance( const string& ns, const ShardToLimitsMap& shardToLimitsMap,
-                                   const ShardToChunksMap& shardToChunksMap, int balancedLastTime );
+                                   const ShardToChunksMap& shardToChunksMap, int balancedLastTime,
+                                   const set<string>& busyShards = set<string>() );
 
         // below exposed for testing purposes only -- treat it as private --
 
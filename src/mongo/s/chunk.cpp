@@ -53,7 +53,7 @@ namespace mongo {
     
 
     Chunk::Chunk(const ChunkManager * manager, BSONObj from)
-        : _manager(manager), _lastmod(0, OID()), _dataWritten(mkDataWritten())
+        : _core(manager->_core), _lastmod(0, OID()), _dataWritten(mkDataWritten())
     {
         string ns = from.getStringField( "ns" );
         _shard.reset( from.getStringField( "shard" ) );
@@ -67,7 +67,7 @@ namespace mongo {
         _jumbo = from["jumbo"].trueValue();
 
         uassert( 10170 ,  "Chunk needs a ns" , ! ns.empty() );
-        uassert( 13327 ,  "Chunk ns must match server ns" , ns == _manager->getns() );
+        uassert( 13327 ,  "Chunk ns must match server ns" , ns == _core->ns );
 
         uassert( 10171 ,  "Chunk needs a server" , _shard.ok() );
 
@@ -76,7 +76,7 @@ namespace mongo {
     }
 
     Chunk::Chunk(const ChunkManager * info , const BSONObj& min, const BSONObj& max, const Shard& shard, ShardChunkVersion lastmod)
-        : _manager(info), _min(min), _max(max), _shard(shard), _lastmod(lastmod), _jumbo(false), _dataWritten(mkDataWritten())
+        : _core(info->_core), _min(min), _max(max), _shard(shard), _lastmod(lastmod), _jumbo(false), _dataWritten(mkDataWritten())
     {}
 
     long Chunk::mkDataWritten() {
@@ -84,44 +84,44 @@ namespace mongo {
     }
 
     string Chunk::getns() const {
-        verify( _manager );
-        return _manager->getns();
+        verify( _core );
+        return _core->ns;
     }
 
     bool Chunk::contains( const BSONObj& obj ) const {
         return
-            _manager->getShardKey().compare( getMin() , obj ) <= 0 &&
-            _manager->getShardKey().compare( obj , getMax() ) < 0;
+            _core->key.compare( getMin() , obj ) <= 0 &&
+            _core->key.compare( obj , getMax() ) < 0;
     }
 
     bool ChunkRange::contains(const BSONObj& obj) const {
         // same as Chunk method
         return
-            _manager->getShardKey().compare( getMin() , obj ) <= 0 &&
-            _manager->getShardKey().compare( obj , getMax() ) < 0;
+            _core->key.compare( getMin() , obj ) <= 0 &&
+            _core->key.compare( obj , getMax() ) < 0;
     }
 
     bool Chunk::minIsInf() const {
-        return _manager->getShardKey().globalMin().woCompare( getMin() ) == 0;
+        return _core->key.globalMin().woCompare( getMin() ) == 0;
     }
 
     bool Chunk::maxIsInf() const {
-        return _manager->getShardKey().globalMax().woCompare( getMax() ) == 0;
+        return _core->key.globalMax().woCompare( getMax() ) == 0;
     }
 
     BSONObj Chunk::_getExtremeKey( int sort ) const {
         // We need to use a sharded connection here b/c there could be data left from stale migrations outside
         // our chunk ranges.
-        ShardConnection conn( getShard().getConnString() , _manager->getns() );
+        ShardConnection conn( getShard().getConnString() , _core->ns );
         Query q;
         if ( sort == 1 ) {
-            q.sort( _manager->getShardKey().key() );
+            q.sort( _core->key.key() );
         }
         else {
             // need to invert shard key pattern to sort backwards
             // TODO: make a helper in ShardKeyPattern?
 
-            BSONObj k = _manager->getShardKey().key();
+            BSONObj k = _core->key.key();
             BSONObjBuilder r;
 
             BSONObjIterator i(k);
@@ -137,7 +137,7 @@ namespace mongo {
         // find the extreme key
         BSONObj end;
         try {
-            end = conn->findOne( _manager->getns() , q );
+            end = conn->findOne( _core->ns , q );
             conn.done();
         }
         catch( StaleConfigException& ){
@@ -150,7 +150,7 @@ namespace mongo {
         if ( end.isEmpty() )
             return BSONObj();
 
-        return _manager->getShardKey().extractKey( end );
+        return _core->key.extractKey( end );
     }
 
     void Chunk::pickMedianKey( BSONObj& medianKey ) const {
@@ -159,8 +159,8 @@ namespace mongo {
                 ScopedDbConnection::getScopedDbConnection( getShard().getConnString() ) );
         BSONObj result;
         BSONObjBuilder cmd;
-        cmd.append( "splitVector" , _manager->getns() );
-        cmd.append( "keyPattern" , _manager->getShardKey().key() );
+        cmd.append( "splitVector" , _core->ns );
+        cmd.append( "keyPattern" , _core->key.key() );
         cmd.append( "min" , getMin() );
         cmd.append( "max" , getMax() );
         cmd.appendBool( "force" , true );
@@ -181,14 +181,15 @@ namespace mongo {
         conn->done();
     }
 
-    void Chunk::pickSplitVector( vector<BSONObj>& splitPoints , int chunkSize /* bytes */, int maxPoints, int maxObjs ) const {
+    void Chunk::pickSplitVector( vector<BSONObj>& splitPoints , int chunkSize /* bytes */, int maxPoints, int maxObjs ,
+                                 BSONObj* splitResult ) const {
         // Ask the mongod holding this chunk to figure out the split points.
         scoped_ptr<ScopedDbConnection> conn(
                 ScopedDbConnection::getScopedDbConnection( getShard().getConnString() ) );
         BSONObj result;
         BSONObjBuilder cmd;
-        cmd.append( "splitVector" , _manager->getns() );
-        cmd.append( "keyPattern" , _manager->getShardKey().key() );
+        cmd.append( "splitVector" , _core->ns );
+        cmd.append( "keyPattern" , _core->key.key() );
         cmd.append( "min" , getMin() );
         cmd.append( "max" , getMax() );
         cmd.append( "maxChunkSizeBytes" , chunkSize );
@@ -207,6 +208,8 @@ namespace mongo {
         while ( it.more() ) {
             splitPoints.push_back( it.next().Obj().getOwned() );
         }
+        if ( splitResult )
+            *splitResult = result.getOwned();
         conn->done();
     }
 
@@ -219,7 +222,7 @@ namespace mongo {
         if ( ! force ) {
             vector<BSONObj> candidates;
             const int maxPoints = 2;
-            pickSplitVector( candidates , getManager()->getCurrentDesiredChunkSize() , maxPoints , MaxObjectPerChunk );
+            pickSplitVector( candidates , ChunkManager::desiredChunkSize( _core->numChunks ) , maxPoints , MaxObjectPerChunk , &res );
             if ( candidates.size() <= 1 ) {
                 // no split points means there isn't enough data to split on
                 // 1 split point means we have between half the chunk size to full chunk size
@@ -275,7 +278,7 @@ namespace mongo {
     bool Chunk::multiSplit( const vector<BSONObj>& m , BSONObj& res ) const {
         const size_t maxSplitPoints = 8192;
 
-        uassert( 10165 , "can't split as shard doesn't have a manager" , _manager );
+        uassert( 10165 , "can't split as shard doesn't have a manager" , _core );
         uassert( 13332 , "need a split key to split chunk" , !m.empty() );
         uassert( 13333 , "can't split a chunk in that many parts", m.size() < maxSplitPoints );
         uassert( 13003 , "can't split a chunk with only one distinct value" , _min.woCompare(_max) );
@@ -284,8 +287,8 @@ namespace mongo {
                 ScopedDbConnection::getScopedDbConnection( getShard().getConnString() ) );
 
         BSONObjBuilder cmd;
-        cmd.append( "splitChunk" , _manager->getns() );
-        cmd.append( "keyPattern" , _manager->getShardKey().key() );
+        cmd.append( "splitChunk" , _core->ns );
+        cmd.append( "keyPattern" , _core->key.key() );
         cmd.append( "min" , getMin() );
         cmd.append( "max" , getMax() );
         cmd.append( "from" , getShard().getName() );
@@ -299,7 +302,7 @@ namespace mongo {
             conn->done();
 
             // Mark the minor version for *eventual* reload
-            _manager->markMinorForReload( this->_lastmod );
+            _core->splitHeuristics.markMinorForReload( _core->ns , this->_lastmod );
 
             return false;
         }
@@ -307,7 +310,7 @@ namespace mongo {
         conn->done();
         
         // force reload of config
-        _manager->reload();
+        _core->reload();
 
         return true;
     }
@@ -315,7 +318,7 @@ namespace mongo {
     bool Chunk::moveAndCommit( const Shard& to , long long chunkSize /* bytes */, BSONObj& res ) const {
         uassert( 10167 ,  "can't move shard to its current location!" , getShard() != to );
 
-        log() << "moving chunk ns: " << _manager->getns() << " moving ( " << toString() << ") " << _shard.toString() << " -> " << to.toString() << endl;
+        log() << "moving chunk ns: " << _core->ns << " moving ( " << toString() << ") " << _shard.toString() << " -> " << to.toString() << endl;
 
         Shard from = _shard;
 
@@ -323,7 +326,7 @@ namespace mongo {
                 ScopedDbConnection::getScopedDbConnection( from.getConnString() ) );
 
         bool worked = fromconn->get()->runCommand( "admin" ,
-                                                   BSON( "moveChunk" << _manager->getns() <<
+                                                   BSON( "moveChunk" << _core->ns <<
                                                          "from" << from.getAddress().toString() <<
                                                          "to" << to.getAddress().toString() <<
                                                          // NEEDED FOR 2.0 COMPATIBILITY
@@ -345,7 +348,7 @@ namespace mongo {
         // if succeeded, needs to reload to pick up the new location
         // if failed, mongos may be stale
         // reload is excessive here as the failure could be simply because collection metadata is taken
-        _manager->reload();
+        _core->reload();
 
         return worked;
     }
@@ -355,7 +358,7 @@ namespace mongo {
 
         try {
             _dataWritten += dataWritten;
-            int splitThreshold = getManager()->getCurrentDesiredChunkSize();
+            int splitThreshold = ChunkManager::desiredChunkSize( _core->numChunks );
             if ( minIsInf() || maxIsInf() ) {
                 splitThreshold = (int) ((double)splitThreshold * .9);
             }
@@ -363,11 +366,11 @@ namespace mongo {
             if ( _dataWritten < splitThreshold / ChunkManager::SplitHeuristics::splitTestFactor )
                 return false;
             
-            if ( ! getManager()->_splitHeuristics._splitTickets.tryAcquire() ) {
-                LOG(1) << "won't auto split becaue not enough tickets: " << getManager()->getns() << endl;
+            if ( ! _core->splitHeuristics._splitTickets.tryAcquire() ) {
+                LOG(1) << "won't auto split becaue not enough tickets: " << _core->ns << endl;
                 return false;
             }
-            TicketHolderReleaser releaser( &(getManager()->_splitHeuristics._splitTickets) );
+            TicketHolderReleaser releaser( &(_core->splitHeuristics._splitTickets) );
 
             // this is a bit ugly
             // we need it so that mongos blocks for the writes to actually be committed
@@ -383,6 +386,17 @@ namespace mongo {
             if ( splitPoint.isEmpty() ) {
                 // singleSplit would have issued a message if we got here
                 _dataWritten = 0; // this means there wasn't enough data to split, so don't want to try again until considerable more data
+
+                // A shard which says how full the chunk is lets us wait until it could be full,
+                // but no more than half a chunk longer, since other mongoses write to it too.
+                long long chunkKeys = res["chunkKeys"].numberLong();
+                long long keyCount = res["keyCount"].numberLong();
+                if ( keyCount > 0 && chunkKeys < 2 * keyCount ) {
+                    long toFill = (long) ( splitThreshold * ( 1 - chunkKeys / ( 2.0 * keyCount ) ) );
+                    long wait = toFill - splitThreshold / ChunkManager::SplitHeuristics::splitTestFactor;
+                    if ( wait > 0 )
+                        _dataWritten = - min( wait , (long) splitThreshold / 2 );
+                }
                 return false;
             }
             
@@ -393,9 +407,9 @@ namespace mongo {
                 _dataWritten = 0; // we're splitting, so should wait a bit
             }
 
-            bool shouldBalance = grid.shouldBalance( _manager->getns() );
+            bool shouldBalance = grid.shouldBalance( _core->ns );
 
-            log() << "autosplitted " << _manager->getns() << " shard: " << toString()
+            log() << "autosplitted " << _core->ns << " shard: " << toString()
                   << " on: " << splitPoint << " (splitThreshold " << splitThreshold << ")"
 #ifdef _DEBUG
                   << " size: " << getPhysicalSize() // slow - but can be useful when debugging
@@ -419,7 +433,7 @@ namespace mongo {
                     return true; // we did split even if we didn't migrate
                 }
 
-                ChunkManagerPtr cm = _manager->reload(false/*just reloaded in mulitsplit*/);
+                ChunkManagerPtr cm = _core->reload(false/*just reloaded in mulitsplit*/);
                 ChunkPtr toMove = cm->findChunk(min);
 
                 if ( ! (toMove->getMin() == min && toMove->getMax() == max) ){
@@ -435,7 +449,7 @@ namespace mongo {
                          toMove->moveAndCommit( newLocation , MaxChunkSize , res ) );
                 
                 // update our config
-                _manager->reload();
+                _core->reload();
             }
 
             return true;
@@ -443,7 +457,7 @@ namespace mongo {
         }
         catch ( DBException& e ) {
             // if the collection lock is taken (e.g. we're migrating), it is fine for the split to fail.
-            warning() << "could not autosplit collection " << _manager->getns() << causedBy( e ) << endl;
+            warning() << "could not autosplit collection " << _core->ns << causedBy( e ) << endl;
             return false;
         }
     }
@@ -454,8 +468,8 @@ namespace mongo {
 
         BSONObj result;
         uassert( 10169 ,  "datasize failed!" , conn->get()->runCommand( "admin" ,
-                 BSON( "datasize" << _manager->getns()
-                       << "keyPattern" << _manager->getShardKey().key()
+                 BSON( "datasize" << _core->ns
+                       << "keyPattern" << _core->key.key()
                        << "min" << getMin()
                        << "max" << getMax()
                        << "maxSize" << ( MaxChunkSize + 1 )
@@ -475,14 +489,14 @@ namespace mongo {
 
     bool Chunk::operator==( const Chunk& s ) const {
         return
-            _manager->getShardKey().compare( _min , s._min ) == 0 &&
-            _manager->getShardKey().compare( _max , s._max ) == 0
+            _core->key.compare( _min , s._min ) == 0 &&
+            _core->key.compare( _max , s._max ) == 0
             ;
     }
 
     void Chunk::serialize(BSONObjBuilder& to,ShardChunkVersion myLastMod) {
 
-        to.append( "_id" , genID( _manager->getns() , _min ) );
+        to.append( "_id" , genID( _core->ns , _min ) );
 
         if ( myLastMod.isSet() ) {
             myLastMod.addToBSON( to, "lastmod" );
@@ -494,7 +508,7 @@ namespace mongo {
             verify(0);
         }
 
-        to << "ns" << _manager->getns();
+        to << "ns" << _core->ns;
         to << "min" << _min;
         to << "max" << _max;
         to << "shard" << _shard.getName();
@@ -515,12 +529,12 @@ namespace mongo {
 
     string Chunk::toString() const {
         stringstream ss;
-        ss << "ns:" << _manager->getns() << " at: " << _shard.toString() << " lastmod: " << _lastmod.toString() << " min: " << _min << " max: " << _max;
+        ss << "ns:" << _core->ns << " at: " << _shard.toString() << " lastmod: " << _lastmod.toString() << " min: " << _min << " max: " << _max;
         return ss.str();
     }
 
     ShardKeyPattern Chunk::skey() const {
-        return _manager->getShardKey();
+        return _core->key;
     }
 
     void Chunk::markAsJumbo() const {
@@ -577,6 +591,7 @@ namespace mongo {
         _ns( ns ),
         _key( pattern ),
         _unique( unique ),
+        _core( new ChunkManagerCore( _ns , _key ) ),
         _chunkRanges(),
         _mutex("ChunkManager"),
         _sequenceNumber(++NextSequenceNumber)
@@ -592,6 +607,7 @@ namespace mongo {
         _ns( collDoc["_id"].type() == String ? collDoc["_id"].String() : "" ),
         _key( collDoc["key"].type() == Object ? collDoc["key"].Obj().getOwned() : BSONObj() ),
         _unique( collDoc["unique"].trueValue() ),
+        _core( new ChunkManagerCore( _ns , _key ) ),
         _chunkRanges(),
         _mutex("ChunkManager"),
         // The shard versioning mechanism hinges on keeping track of the number of times we reloaded ChunkManager's.
@@ -614,6 +630,7 @@ namespace mongo {
         _ns( oldManager->getns() ),
         _key( oldManager->getShardKey() ),
         _unique( oldManager->isUnique() ),
+        _core( oldManager->_core ),
         _chunkRanges(),
         _mutex("ChunkManager"),
         _sequenceNumber(++NextSequenceNumber)
@@ -656,6 +673,7 @@ namespace mongo {
                     const_cast<set<Shard>&>(_shards).swap(shards);
                     const_cast<ShardVersionMap&>(_shardVersions).swap(shardVersions);
                     const_cast<ChunkRangeManager&>(_chunkRanges).reloadAll(_chunkMap);
+                    _core->numChunks.set( _chunkMap.size() );
 
                     // Once we load data, clear reference to old manager
                     _oldManager.reset();
@@ -685,7 +703,7 @@ namespace mongo {
      *
      * The mongos adapter here tracks all shards, and stores ranges by (max, Chunk) in the map.
      */
-    class CMConfigDiffTracker : public ConfigDiffTracker<ChunkPtr,Shard> {
+    class CMConfigDiffTracker : public ConfigDiffTracker<ChunkPtr,Shard,ChunkMap> {
     public:
         CMConfigDiffTracker( ChunkManager* manager ) : _manager( manager ) {}
 
@@ -737,22 +755,10 @@ namespace mongo {
             // Load a copy of the old versions
             shardVersions = oldManager->_shardVersions;
 
-            // Load a copy of the chunk map, replacing the chunk manager with our own
-            const ChunkMap& oldChunkMap = oldManager->getChunkMap();
-
-            // Could be v.expensive
-            // TODO: If chunks were immutable and didn't reference the manager, we could do more
-            // interesting things here
-            for( ChunkMap::const_iterator it = oldChunkMap.begin(); it != oldChunkMap.end(); it++ ){
-
-                ChunkPtr oldC = it->second;
-                ChunkPtr c( new Chunk( this, oldC->getMin(),
-                                             oldC->getMax(),
-                                             oldC->getShard(),
-                                             oldC->getLastmod() ) );
-
-                chunkMap.insert( make_pair( oldC->getMax(), c ) );
-            }
+            // Share the old chunk map; the diffs below copy only the parts they change.  The
+            // chunks refer to the ChunkManagerCore we share with the old manager, not to it.
+            const ChunkMap& oldChunkMap = oldManager->_chunkMap;
+            chunkMap = oldChunkMap;
 
             // Also get any minor versions stored for reload
             oldManager->getMarkedMinorVersions( minorVersions );
@@ -810,19 +816,23 @@ namespace mongo {
 
     }
 
+    ChunkManagerPtr ChunkManagerCore::reload(bool force) const {
+        return grid.getDBConfig(ns)->getChunkManager(ns, force);
+    }
+
     ChunkManagerPtr ChunkManager::reload(bool force) const {
-        return grid.getDBConfig(getns())->getChunkManager(getns(), force);
+        return _core->reload(force);
     }
 
     void ChunkManager::markMinorForReload( ShardChunkVersion majorVersion ) const {
-        _splitHeuristics.markMinorForReload( getns(), majorVersion );
+        _core->splitHeuristics.markMinorForReload( getns(), majorVersion );
     }
 
     void ChunkManager::getMarkedMinorVersions( set<ShardChunkVersion>& minorVersions ) const {
-        _splitHeuristics.getMarkedMinorVersions( minorVersions );
+        _core->splitHeuristics.getMarkedMinorVersions( minorVersions );
     }
 
-    void ChunkManager::SplitHeuristics::markMinorForReload( const string& ns, ShardChunkVersion majorVersion ) {
+    void ChunkSplitHeuristics::markMinorForReload( const string& ns, ShardChunkVersion majorVersion ) {
 
         // When we get a stale minor version, it means that some *other* mongos has just split a
         // chunk into a number of smaller parts, so we shouldn't need reload the data needed to
@@ -860,7 +870,7 @@ namespace mongo {
             grid.getDBConfig( ns )->getChunkManagerIfExists( ns, true, true );
     }
 
-    void ChunkManager::SplitHeuristics::getMarkedMinorVersions( set<ShardChunkVersion>& minorVersions ) {
+    void ChunkSplitHeuristics::getMarkedMinorVersions( set<ShardChunkVersion>& minorVersions ) {
         scoped_lock lk( _staleMinorSetMutex );
         for( set<ShardChunkVersion>::iterator it = _staleMinorSet.begin(); it != _staleMinorSet.end(); it++ ){
             minorVersions.insert( *it );
@@ -1131,6 +1141,117 @@ namespace mongo {
         }
     }
 
+    void ChunkManager::getShardQueries( map<Shard,BSONObj>& queries , const set<Shard>& shards , const BSONObj& query ) const {
+        const char* first = _key.key().firstElementFieldName();
+
+        // which shards each $in value and $or clause needs
+        vector< set<Shard> > inShards;
+        BSONElement in;
+        BSONElement field = query[first];
+        if ( field.type() == Object && field.embeddedObject().firstElementFieldName()[0] == '$' ) {
+            in = field.embeddedObject()["$in"];
+            if ( in.type() == Array ) {
+                BSONForEach( v, in.embeddedObject() ) {
+                    // a regex or array matches more than the value itself
+                    if ( v.type() == RegEx || v.type() == Array ) {
+                        inShards.clear();
+                        break;
+                    }
+                    BSONObjBuilder min;
+                    BSONObjBuilder max;
+                    BSONForEach( k, _key.key() ) {
+                        if ( strcmp( k.fieldName(), first ) == 0 ) {
+                            min.appendAs( v, first );
+                            max.appendAs( v, first );
+                        }
+                        else {
+                            min.appendMinKey( k.fieldName() );
+                            max.appendMaxKey( k.fieldName() );
+                        }
+                    }
+                    inShards.push_back( set<Shard>() );
+                    getShardsForRange( inShards.back(), min.obj(), max.obj(), false );
+                }
+            }
+        }
+
+        vector< set<Shard> > orShards;
+        BSONElement orClauses = query["$or"];
+        if ( orClauses.type() == Array ) {
+            // the rest of the query only narrows a clause further, so the clause alone is enough
+            BSONForEach( clause, orClauses.embeddedObject() ) {
+                if ( clause.type() != Object ) {
+                    orShards.clear();
+                    break;
+                }
+                orShards.push_back( set<Shard>() );
+                getShardsForQuery( orShards.back(), clause.embeddedObject() );
+            }
+        }
+
+        if ( inShards.empty() && orShards.empty() )
+            return;
+
+        for ( set<Shard>::const_iterator s = shards.begin(); s != shards.end(); ++s ) {
+            const Shard& shard = *s;
+
+            BSONArrayBuilder values;
+            bool narrowedIn = false;
+            if ( ! inShards.empty() ) {
+                unsigned n = 0;
+                BSONForEach( v, in.embeddedObject() ) {
+                    if ( inShards[n++].count( shard ) )
+                        values.append( v );
+                    else
+                        narrowedIn = true;
+                }
+            }
+
+            BSONArrayBuilder clauses;
+            bool narrowedOr = false;
+            int kept = 0;
+            if ( ! orShards.empty() ) {
+                unsigned n = 0;
+                BSONForEach( clause, orClauses.embeddedObject() ) {
+                    if ( orShards[n++].count( shard ) ) {
+                        clauses.append( clause );
+                        kept++;
+                    }
+                    else {
+                        narrowedOr = true;
+                    }
+                }
+            }
+            // an empty $or is invalid; the shard was only picked so that there is one
+            if ( kept == 0 )
+                narrowedOr = false;
+
+            if ( ! narrowedIn && ! narrowedOr )
+                continue;
+
+            BSONObjBuilder b;
+            BSONForEach( e, query ) {
+                if ( narrowedIn && strcmp( e.fieldName(), first ) == 0 ) {
+                    BSONObjBuilder ops( b.subobjStart( first ) );
+                    BSONForEach( op, e.embeddedObject() ) {
+                        if ( strcmp( op.fieldName(), "$in" ) == 0 )
+                            ops.append( "$in", values.arr() );
+                        else
+                            ops.append( op );
+                    }
+                    ops.done();
+                }
+                else if ( narrowedOr && strcmp( e.fieldName(), "$or" ) == 0 ) {
+                    b.append( "$or", clauses.arr() );
+                }
+                else {
+                    b.append( e );
+                }
+            }
+            queries[shard] = b.obj();
+        }
+    }
+
     void ChunkManager::getShardsForRange(set<Shard>& shards, const BSONObj& min, const BSONObj& max, bool fullKeyReq ) const {
 
         if( fullKeyReq ){
@@ -1263,7 +1384,7 @@ namespace mongo {
         return ss.str();
     }
 
-    void ChunkRangeManager::assertValid() const {
+    void ChunkRangeManager::assertValid( const ChunkMap& chunks ) const {
         if (_ranges.empty())
             return;
 
@@ -1289,7 +1410,6 @@ namespace mongo {
             }
 
             // Make sure we match the original chunks
-            const ChunkMap chunks = _ranges.begin()->second->getManager()->_chunkMap;
             for ( ChunkMap::const_iterator i=chunks.begin(); i!=chunks.end(); ++i ) {
                 const ChunkPtr chunk = i->second;
 
@@ -1319,7 +1439,7 @@ namespace mongo {
         _ranges.clear();
         _insertRange(chunks.begin(), chunks.end());
 
-        DEV assertValid();
+        DEV assertValid( chunks );
     }
 
     void ChunkRangeManager::_insertRange(ChunkMap::const_iterator begin, const ChunkMap::const_iterator end) {
@@ -1334,14 +1454,12 @@ namespace mongo {
         }
     }
 
-    int ChunkManager::getCurrentDesiredChunkSize() const {
+    int ChunkManager::desiredChunkSize( int nc ) {
         // split faster in early chunks helps spread out an initial load better
         const int minChunkSize = 1 << 20;  // 1 MBytes
 
         int splitThreshold = Chunk::MaxChunkSize;
 
-        int nc = numChunks();
-
         if ( nc <= 1 ) {
             return 1024;
         }
@@ -1361,6 +1479,7 @@ namespace mongo {
     /** This is for testing only, just setting up minimal basic defaults. */
     ChunkManager::ChunkManager() :
     _unique(),
+    _core( new ChunkManagerCore( _ns , _key ) ),
     _chunkRanges(),
     _mutex( "ChunkManager" ),
     _sequenceNumber()
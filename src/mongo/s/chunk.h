@@ -27,6 +27,7 @@
 #include "shard.h"
 #include "util.h"
 #include "mongo/util/concurrency/ticketholder.h"
+#include "mongo/util/cow_map.h"
 
 namespace mongo {
 
@@ -39,11 +40,68 @@ namespace mongo {
     typedef shared_ptr<const Chunk> ChunkPtr;
 
     // key is max for each Chunk or ChunkRange
-    typedef map<BSONObj,ChunkPtr,BSONObjCmp> ChunkMap;
+    // a ChunkMap is copy-on-write, so a reload shares the chunks it doesn't change
+    typedef CowMap<BSONObj,ChunkPtr,BSONObjCmp> ChunkMap;
     typedef map<BSONObj,shared_ptr<ChunkRange>,BSONObjCmp> ChunkRangeMap;
 
     typedef shared_ptr<const ChunkManager> ChunkManagerPtr;
 
+    /** when to split a collection's chunks, and when another mongos's splits are worth a reload */
+    class ChunkSplitHeuristics {
+    public:
+
+        ChunkSplitHeuristics() :
+            _splitTickets( maxParallelSplits ),
+            _staleMinorSetMutex( "ChunkSplitHeuristics::staleMinorSet" ),
+            _staleMinorCount( 0 ) {}
+
+        void markMinorForReload( const string& ns, ShardChunkVersion majorVersion );
+        void getMarkedMinorVersions( set<ShardChunkVersion>& minorVersions );
+
+        TicketHolder _splitTickets;
+
+        mutex _staleMinorSetMutex;
+
+        // mutex protects below
+        int _staleMinorCount;
+        set<ShardChunkVersion> _staleMinorSet;
+
+        // Test whether we should split once data * splitTestFactor > chunkSize (approximately)
+        static const int splitTestFactor = 5;
+        // Maximum number of parallel threads requesting a split
+        static const int maxParallelSplits = 5;
+
+        // The idea here is that we're over-aggressive on split testing by a factor of
+        // splitTestFactor, so we can safely wait until we get to splitTestFactor invalid splits
+        // before changing.  Unfortunately, we also potentially over-request the splits by a
+        // factor of maxParallelSplits, but since the factors are identical it works out
+        // (for now) for parallel or sequential oversplitting.
+        // TODO: Make splitting a separate thread with notifications?
+        static const int staleMinorReloadThreshold = maxParallelSplits;
+
+    };
+
+    /**
+     * The part of a ChunkManager which carries over from one load of a collection to the next.
+     * Chunks refer to it rather than to the manager which loaded them, so a manager loaded
+     * from an older one can keep the older one's unchanged Chunks.
+     */
+    class ChunkManagerCore : boost::noncopyable {
+    public:
+        ChunkManagerCore( const string& ns , const ShardKeyPattern& key ) : ns( ns ) , key( key ) , numChunks( 0 ) {}
+
+        /** @return the collection's current ChunkManager, reloaded if force */
+        ChunkManagerPtr reload( bool force = true ) const;
+
+        const string ns;
+        const ShardKeyPattern key;
+
+        mutable ChunkSplitHeuristics splitHeuristics;
+
+        // in the most recently loaded manager
+        mutable AtomicUInt numChunks;
+    };
+
     /**
        config.chunks
        { ns : "alleyinsider.fs.chunks" , min : {} , max : {} , server : "localhost:30001" }
@@ -107,7 +165,8 @@ namespace mongo {
          *
          * @param force if set to true, will split the chunk regardless if the split is really necessary size wise
          *              if set to false, will only split if the chunk has reached the currently desired maximum size
-         * @param res the object containing details about the split execution
+         * @param res the object containing details about the split execution, or if there was no
+         *            split, the shard's splitVector reply
          * @return splitPoint if found a key and split successfully, else empty BSONObj
          */
         BSONObj singleSplit( bool force , BSONObj& res ) const;
@@ -133,8 +192,10 @@ namespace mongo {
          * @param chunkSize chunk size to target in bytes
          * @param maxPoints limits the number of split points that are needed, zero is max (optional)
          * @param maxObjs limits the number of objects in each chunk, zero is as max (optional)
+         * @param result set to the shard's reply, which may say how many keys the chunk has (optional)
          */
-        void pickSplitVector( vector<BSONObj>& splitPoints , int chunkSize , int maxPoints = 0, int maxObjs = 0) const;
+        void pickSplitVector( vector<BSONObj>& splitPoints , int chunkSize , int maxPoints = 0, int maxObjs = 0,
+                              BSONObj* result = 0 ) const;
 
         //
         // migration support
@@ -189,14 +250,14 @@ namespace mongo {
         string getns() const;
         const char * getNS() { return "config.chunks"; }
         Shard getShard() const { return _shard; }
-        const ChunkManager* getManager() const { return _manager; }
+        const ChunkManagerCore* getCore() const { return _core.get(); }
         
 
     private:
 
         // main shard info
         
-        const ChunkManager * _manager;
+        shared_ptr<const ChunkManagerCore> _core;
 
         BSONObj _min;
         BSONObj _max;
@@ -225,7 +286,7 @@ namespace mongo {
 
     class ChunkRange {
     public:
-        const ChunkManager* getManager() const { return _manager; }
+        const ChunkManagerCore* getCore() const { return _core; }
         Shard getShard() const { return _shard; }
 
         const BSONObj& getMin() const { return _min; }
@@ -235,14 +296,14 @@ namespace mongo {
         bool contains(const BSONObj& obj) const;
 
         ChunkRange(ChunkMap::const_iterator begin, const ChunkMap::const_iterator end)
-            : _manager(begin->second->getManager())
+            : _core(begin->second->getCore())
             , _shard(begin->second->getShard())
             , _min(begin->second->getMin())
             , _max(boost::prior(end)->second->getMax()) {
             verify( begin != end );
 
             DEV while (begin != end) {
-                verify(begin->second->getManager() == _manager);
+                verify(begin->second->getCore() == _core);
                 verify(begin->second->getShard() == _shard);
                 ++begin;
             }
@@ -250,12 +311,12 @@ namespace mongo {
 
         // Merge min and max (must be adjacent ranges)
         ChunkRange(const ChunkRange& min, const ChunkRange& max)
-            : _manager(min.getManager())
+            : _core(min.getCore())
             , _shard(min.getShard())
             , _min(min.getMin())
             , _max(max.getMax()) {
             verify(min.getShard() == max.getShard());
-            verify(min.getManager() == max.getManager());
+            verify(min.getCore() == max.getCore());
             verify(min.getMax() == max.getMin());
         }
 
@@ -264,7 +325,7 @@ namespace mongo {
         }
 
     private:
-        const ChunkManager* _manager;
+        const ChunkManagerCore* _core;
         const Shard _shard;
         const BSONObj _min;
         const BSONObj _max;
@@ -280,7 +341,7 @@ namespace mongo {
         void reloadAll(const ChunkMap& chunks);
 
         // Slow operation -- wrap with DEV
-        void assertValid() const;
+        void assertValid( const ChunkMap& chunks ) const;
 
         ChunkRangeMap::const_iterator upper_bound(const BSONObj& o) const { return _ranges.upper_bound(o); }
         ChunkRangeMap::const_iterator lower_bound(const BSONObj& o) const { return _ranges.lower_bound(o); }
@@ -356,6 +417,13 @@ namespace mongo {
         ChunkPtr findChunkOnServer( const Shard& shard ) const;
 
         void getShardsForQuery( set<Shard>& shards , const BSONObj& query ) const;
+        /**
+         * Narrows query for each of shards, which should come from getShardsForQuery(): the
+         * values of a top level $in on the first shard key field, and the top level $or
+         * clauses, which can't match anything owned by a shard are left out of its query.
+         * @param queries gets an entry for each shard whose query could be narrowed
+         */
+        void getShardQueries( map<Shard,BSONObj>& queries , const set<Shard>& shards , const BSONObj& query ) const;
         void getAllShards( set<Shard>& all ) const;
         /** @param shards set to the shards covered by the interval [min, max], see SERVER-4791 */
         void getShardsForRange(set<Shard>& shards, const BSONObj& min, const BSONObj& max, bool fullKeyReq = true) const;
@@ -389,7 +457,8 @@ namespace mongo {
 
         void _printChunks() const;
 
-        int getCurrentDesiredChunkSize() const;
+        int getCurrentDesiredChunkSize() const { return desiredChunkSize( numChunks() ); }
+        static int desiredChunkSize( int numChunks );
 
     private:
         ChunkManagerPtr reload(bool force=true) const; // doesn't modify self!
@@ -410,6 +479,9 @@ namespace mongo {
         const ShardKeyPattern _key;
         const bool _unique;
 
+        // shared with the managers loaded from this one
+        shared_ptr<ChunkManagerCore> _core;
+
         const ChunkMap _chunkMap;
         const ChunkRangeManager _chunkRanges;
 
@@ -429,52 +501,17 @@ namespace mongo {
         const unsigned long long _sequenceNumber;
 
         //
-        // Split Heuristic info
+        // Split Heuristic info, kept in the ChunkManagerCore
         //
 
+        typedef ChunkSplitHeuristics SplitHeuristics;
 
-        class SplitHeuristics {
-        public:
-
-            SplitHeuristics() :
-                _splitTickets( maxParallelSplits ),
-                _staleMinorSetMutex( "SplitHeuristics::staleMinorSet" ),
-                _staleMinorCount( 0 ) {}
-
-            void markMinorForReload( const string& ns, ShardChunkVersion majorVersion );
-            void getMarkedMinorVersions( set<ShardChunkVersion>& minorVersions );
-
-            TicketHolder _splitTickets;
-
-            mutex _staleMinorSetMutex;
-
-            // mutex protects below
-            int _staleMinorCount;
-            set<ShardChunkVersion> _staleMinorSet;
-
-            // Test whether we should split once data * splitTestFactor > chunkSize (approximately)
-            static const int splitTestFactor = 5;
-            // Maximum number of parallel threads requesting a split
-            static const int maxParallelSplits = 5;
-
-            // The idea here is that we're over-aggressive on split testing by a factor of
-            // splitTestFactor, so we can safely wait until we get to splitTestFactor invalid splits
-            // before changing.  Unfortunately, we also potentially over-request the splits by a
-            // factor of maxParallelSplits, but since the factors are identical it works out
-            // (for now) for parallel or sequential oversplitting.
-            // TODO: Make splitting a separate thread with notifications?
-            static const int staleMinorReloadThreshold = maxParallelSplits;
-
-        };
-
-        mutable SplitHeuristics _splitHeuristics;
 
         //
         // End split heuristics
         //
 
         friend class Chunk;
-        friend class ChunkRangeManager; // only needed for CRM::assertValid()
         static AtomicUInt NextSequenceNumber;
         
         /** Just for testing */
@@ -514,7 +551,7 @@ namespace mongo {
         Chunk _c;
     };
     */
-    inline string Chunk::genID() const { return genID(_manager->getns(), _min); }
+    inline string Chunk::genID() const { return genID(_core->ns, _min); }
 
     bool setShardVersion( DBClientBase & conn , const string& ns , ShardChunkVersion version , bool authoritative , BSONObj& result );
 
@@ -32,8 +32,10 @@
 #include "../util/stringutils.h"
 #include "../util/version.h"
 #include "../util/timer.h"
+#include "../util/mem_accounting.h"
 
 #include "../client/connpool.h"
+#include "../client/dbclient_rs.h"
 #include "mongo/client/dbclientcursor.h"
 
 #include "../db/dbmessage.h"
@@ -139,6 +141,12 @@ namespace mongo {
                     t.done();
                 }
 
+                {
+                    BSONObjBuilder bb( result.subobjStart( "memAccounting" ) );
+                    MemAccounting::appendStats( bb );
+                    bb.done();
+                }
+
                 {
                     BSONObjBuilder bb( result.subobjStart( "connections" ) );
                     bb.append( "current" , connTicketHolder.used() );
@@ -164,6 +172,18 @@ namespace mongo {
 
                 result.append( "shardCursorType" , shardedCursorTypes.getObj() );
 
+                {
+                    BSONObjBuilder bb( result.subobjStart( "writeBacks" ) );
+                    WriteBackListener::appendStats( bb );
+                    bb.done();
+                }
+
+                {
+                    BSONObjBuilder bb( result.subobjStart( "hedgedReads" ) );
+                    DBClientReplicaSet::appendHedgeStats( bb );
+                    bb.done();
+                }
+
                 {
                     BSONObjBuilder asserts( result.subobjStart( "asserts" ) );
                     asserts.append( "regular" , assertionCount.regular );
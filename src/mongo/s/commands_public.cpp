@@ -37,6 +37,7 @@
 #include "strategy.h"
 #include "grid.h"
 #include "client_info.h"
+#include "cursors.h"
 
 namespace mongo {
 
@@ -45,6 +46,10 @@ namespace mongo {
         return true;
     }
 
+    bool getParmsMongodSpecific(BSONObj& cmdObj, bool all, BSONObjBuilder& result) {
+        return false;
+    }
+
     namespace dbgrid_pub_cmds {
 
         class PublicGridCommand : public Command {
@@ -648,6 +653,28 @@ namespace mongo {
 
         } findAndModifyCmd;
 
+        class WriteBatchCmd : public PublicGridCommand {
+        public:
+            WriteBatchCmd() : PublicGridCommand("writeBatch") { }
+            bool run(const string& dbName, BSONObj& cmdObj, int, string& errmsg, BSONObjBuilder& result, bool) {
+                string collection = cmdObj.firstElement().valuestrsafe();
+                string fullns = dbName + "." + collection;
+
+                DBConfigPtr conf = grid.getDBConfig( dbName , false );
+
+                if ( ! conf || ! conf->isShardingEnabled() || ! conf->isSharded( fullns ) ) {
+                    return passthrough( conf , cmdObj , result);
+                }
+
+                ChunkManagerPtr cm = conf->getChunkManager( fullns );
+                massert( 16364 ,  "shard internal error chunk manager should never be null" , cm );
+
+                SHARDED->writeBatchOp( dbName , cmdObj , cm , result );
+                return true;
+            }
+
+        } writeBatchCmd;
+
         class DataSizeCmd : public PublicGridCommand {
         public:
             DataSizeCmd() : PublicGridCommand("dataSize", "datasize") { }
@@ -759,46 +786,44 @@ namespace mongo {
                     return passthrough( conf , cmdObj , options, result );
                 }
 
-                ChunkManagerPtr cm = conf->getChunkManager( fullns );
-                massert( 10420 ,  "how could chunk manager be null!" , cm );
-
-                BSONObj query = getQuery(cmdObj);
-                set<Shard> shards;
-                cm->getShardsForQuery(shards, query);
-
-                set<BSONObj,BSONObjCmp> all;
-                int size = 32;
-
-                for ( set<Shard>::iterator i=shards.begin(), end=shards.end() ; i != end; ++i ) {
-                    ShardConnection conn( *i , fullns );
-                    BSONObj res;
-                    bool ok = conn->runCommand( conf->getName() , cmdObj , res, options );
-                    conn.done();
+                // the shards run at once, and retry on a stale version, as for count
+                map<Shard,BSONObj> shardResults;
+                SHARDED->commandOp( dbName, cmdObj, options, fullns, getQuery( cmdObj ), shardResults );
 
-                    if ( ! ok ) {
+                // the values stay in the shards' replies until they're copied out below
+                vector<BSONElement> all;
+                for ( map<Shard,BSONObj>::const_iterator i = shardResults.begin(); i != shardResults.end(); ++i ) {
+                    const BSONObj& res = i->second;
+                    if ( ! res["ok"].trueValue() ) {
                         result.appendElements( res );
                         return false;
                     }
 
-                    BSONObjIterator it( res["values"].embeddedObject() );
-                    while ( it.more() ) {
-                        BSONElement nxt = it.next();
-                        BSONObjBuilder temp(32);
-                        temp.appendAs( nxt , "" );
-                        all.insert( temp.obj() );
-                    }
-
+                    BSONForEach( v, res["values"].embeddedObject() )
+                        all.push_back( v );
                 }
 
-                BSONObjBuilder b( size );
-                int n=0;
-                for ( set<BSONObj,BSONObjCmp>::iterator i = all.begin() ; i != all.end(); i++ ) {
-                    b.appendAs( i->firstElement() , b.numStr( n++ ) );
-                }
+                sort( all.begin(), all.end(), ElementLess() );
 
-                result.appendArray( "values" , b.obj() );
+                BSONArrayBuilder b( result.subarrayStart( "values" ) );
+                const BSONElement* last = 0;
+                for ( vector<BSONElement>::const_iterator i = all.begin(); i != all.end(); ++i ) {
+                    if ( last && last->woCompare( *i, false ) == 0 )
+                        continue;
+                    uassert( 10044, "distinct too big, 16mb cap", b.len() + i->size() + 1024 < BSONObjMaxUserSize );
+                    b.append( *i );
+                    last = &*i;
+                }
+                b.done();
                 return true;
             }
+
+        private:
+            struct ElementLess {
+                bool operator()( const BSONElement& a, const BSONElement& b ) const {
+                    return a.woCompare( b, false ) < 0;
+                }
+            };
         } disinctCmd;
 
         class FileMD5Cmd : public PublicGridCommand {
@@ -914,6 +939,57 @@ namespace mongo {
             }
         } fileMD5Cmd;
 
+        class FileReadCmd : public PublicGridCommand {
+        public:
+            FileReadCmd() : PublicGridCommand("fileread") {}
+            virtual void help( stringstream &help ) const {
+                help << " example: { fileread : ObjectId(aaaaaaa) , root : \"fs\" , offset : 0 , length : 1024 , chunkSize : 262144 }";
+            }
+            bool run(const string& dbName , BSONObj& cmdObj, int, string& errmsg, BSONObjBuilder& result, bool) {
+                string root = cmdObj.getStringField( "root" );
+                if ( root.size() == 0 )
+                    root = "fs";
+                string fullns = dbName + "." + root + ".chunks";
+
+                DBConfigPtr conf = grid.getDBConfig( dbName , false );
+
+                if ( ! conf || ! conf->isShardingEnabled() || ! conf->isSharded( fullns ) ) {
+                    return passthrough( conf , cmdObj , result );
+                }
+
+                ChunkManagerPtr cm = conf->getChunkManager( fullns );
+                massert( 16408 , "how could chunk manager be null!" , cm );
+
+                BSONObj finder;
+                if ( cm->getShardKey().key() == BSON("files_id" << 1) ) {
+                    finder = BSON("files_id" << cmdObj.firstElement());
+                }
+                else if ( cm->getShardKey().key() == BSON("files_id" << 1 << "n" << 1) ) {
+                    // to the shard with the range's first chunk, which replies up to the end of
+                    // its run of chunks; the client asks again from there
+                    long long chunkSize = cmdObj["chunkSize"].numberLong();
+                    if ( chunkSize <= 0 ) {
+                        errmsg = "fileread needs chunkSize when the chunks are sharded on {files_id:1, n:1}";
+                        return false;
+                    }
+                    int n = (int) ( cmdObj["offset"].numberLong() / chunkSize );
+                    finder = BSON("files_id" << cmdObj.firstElement() << "n" << n);
+                }
+                else {
+                    errmsg = "GridFS fs.chunks collection must be sharded on either {files_id:1} or {files_id:1, n:1}";
+                    return false;
+                }
+
+                map<Shard, BSONObj> resMap;
+                SHARDED->commandOp(dbName, cmdObj, 0, fullns, finder, resMap);
+                verify(resMap.size() == 1); // querying on shard key so should only talk to one shard
+                BSONObj res = resMap.begin()->second;
+
+                result.appendElements(res);
+                return res["ok"].trueValue();
+            }
+        } fileReadCmd;
+
         class Geo2dFindNearCmd : public PublicGridCommand {
         public:
             Geo2dFindNearCmd() : PublicGridCommand( "geoNear" ) {}
@@ -1434,6 +1510,130 @@ namespace mongo {
           Note these are in the pub_grid_cmds namespace, so they don't
           conflict with those in db/commands/pipeline_command.cpp.
          */
+        typedef DocumentSourceCommandFutures::FuturesList PipelineFutures;
+        typedef vector<boost::shared_ptr<ShardConnection> > PipelineConns;
+
+        /*
+          Send the shards their part of a pipeline, over connections that
+          the futures' cursors, if they return any, are read through.
+         */
+        static void spawnPipelineCommands(
+            const set<Shard> &shards, const string &dbName,
+            const string &fullns, const BSONObj &shardedCommand,
+            PipelineFutures *pFutures, PipelineConns *pShardConns) {
+            /*
+              From MRCmd::Run: "we need to use our connections to the shard
+              so filtering is done correctly for un-owned docs so we allocate
+              them in our thread and hand off"
+            */
+            for (set<Shard>::const_iterator i=shards.begin(), end=shards.end();
+                 i != end; i++) {
+                boost::shared_ptr<ShardConnection> temp(
+                    new ShardConnection(i->getConnString(), fullns));
+                verify(temp->get());
+                pFutures->push_back(
+                    Future::spawnCommand(i->getConnString(), dbName,
+                                         shardedCommand , 0, temp->get()));
+                pShardConns->push_back(temp);
+            }
+        }
+
+        /*
+          The output of a pipeline run here, for the CursorCache to hand
+          out through getMore()s, as it does a sharded query's results.  It
+          owns what the pipeline reads the shards' cursors through.
+         */
+        class PipelineClusteredCursor :
+            public ClusteredCursor {
+        public:
+            PipelineClusteredCursor(const string &ns);
+            virtual ~PipelineClusteredCursor();
+
+            /*
+              Send the shards their part of the pipeline, and set the rest
+              of it up to merge what they return.
+
+              @returns the source the pipeline's output comes out of
+             */
+            intrusive_ptr<DocumentSource> start(
+                const intrusive_ptr<Pipeline> &pPipeline,
+                const set<Shard> &shards, const string &dbName,
+                const BSONObj &shardedCommand,
+                const intrusive_ptr<ExpressionContext> &pExpCtx);
+
+            /* what went wrong on the shards, if anything did */
+            const string &getErrmsg() const { return errmsg; }
+
+            // virtuals from ClusteredCursor
+            virtual bool more();
+            virtual BSONObj next();
+            virtual string type() const { return "PipelineClusteredCursor"; }
+            virtual void explain(BSONObjBuilder &b) {
+                uasserted(16431, "can't explain the cursor of an aggregate");
+            }
+
+        protected:
+            // virtuals from ClusteredCursor
+            virtual void _init() {}
+            virtual void _explain(map< string,list<BSONObj> > &out) {}
+
+        private:
+            string errmsg;
+            PipelineFutures futures;
+            PipelineConns shardConns;
+            intrusive_ptr<Pipeline> pPipeline;
+            intrusive_ptr<DocumentSource> pInput;
+            intrusive_ptr<DocumentSource> pOutput;
+        };
+
+        PipelineClusteredCursor::PipelineClusteredCursor(const string &ns):
+            ClusteredCursor(ns, BSONObj()) {
+        }
+
+        PipelineClusteredCursor::~PipelineClusteredCursor() {
+            /* the shards' cursors go first, while their connections are up */
+            pOutput.reset();
+            pPipeline.reset();
+            pInput.reset();
+            futures.clear();
+
+            for(unsigned i = 0; i < shardConns.size(); ++i)
+                shardConns[i]->done();
+        }
+
+        intrusive_ptr<DocumentSource> PipelineClusteredCursor::start(
+            const intrusive_ptr<Pipeline> &pThePipeline,
+            const set<Shard> &shards, const string &dbName,
+            const BSONObj &shardedCommand,
+            const intrusive_ptr<ExpressionContext> &pExpCtx) {
+            spawnPipelineCommands(shards, dbName, _ns, shardedCommand,
+                                  &futures, &shardConns);
+
+            intrusive_ptr<DocumentSourceCommandFutures> pSource(
+                DocumentSourceCommandFutures::create(
+                    errmsg, &futures, pExpCtx));
+            if (pThePipeline->getMergeShardResultsById())
+                pSource->setMergeById();
+
+            pPipeline = pThePipeline;
+            pInput = pSource;
+            pOutput = pPipeline->stitch(pInput);
+            return pOutput;
+        }
+
+        bool PipelineClusteredCursor::more() {
+            return !pOutput->eof();
+        }
+
+        BSONObj PipelineClusteredCursor::next() {
+            BSONObjBuilder documentBuilder;
+            pOutput->getCurrent()->toBson(&documentBuilder);
+            BSONObj document(documentBuilder.obj());
+            pOutput->advance();
+            return document;
+        }
+
+
         class PipelineCommand :
             public PublicGridCommand {
         public:
@@ -1445,7 +1645,24 @@ namespace mongo {
                              BSONObjBuilder &result, bool fromRepl);
 
         private:
-            
+            /*
+              For a collection that isn't sharded, the mongod the command
+              goes to returns the cursor, and its getMore()s go there.
+             */
+            bool passthroughCursor(DBConfigPtr conf, const BSONObj &cmdObj,
+                                   BSONObjBuilder &result);
+
+            /*
+              For a sharded collection, the merging part of the pipeline
+              runs here, reading the shards' cursors as it goes.  This
+              returns its first batch; the CursorCache keeps the rest.
+             */
+            bool runCursor(const string &dbName, const string &fullns,
+                           const set<Shard> &shards,
+                           const BSONObj &shardedCommand,
+                           const intrusive_ptr<Pipeline> &pPipeline,
+                           const intrusive_ptr<ExpressionContext> &pExpCtx,
+                           string &errmsg, BSONObjBuilder &result);
         };
 
 
@@ -1479,8 +1696,16 @@ namespace mongo {
               isn't sharded, pass this on to a mongod.
             */
             DBConfigPtr conf(grid.getDBConfig(dbName , false));
-            if (!conf || !conf->isShardingEnabled() || !conf->isSharded(fullns))
+            if (!conf || !conf->isShardingEnabled() || !conf->isSharded(fullns)) {
+                if (pPipeline->isCursorCommand())
+                    return passthroughCursor(conf, cmdObj, result);
                 return passthrough(conf, cmdObj, result);
+            }
+
+            /* each shard would write its own part of the output */
+            uassert(16443, str::stream() << DocumentSourceOut::outName <<
+                    " isn't supported on a sharded collection",
+                    !pPipeline->hasOutStage());
 
             /* split the pipeline into pieces for mongods and this mongos */
             intrusive_ptr<Pipeline> pShardPipeline(
@@ -1505,28 +1730,21 @@ namespace mongo {
             set<Shard> shards;
             cm->getShardsForQuery(shards, shardQuery);
 
-            /*
-              From MRCmd::Run: "we need to use our connections to the shard
-              so filtering is done correctly for un-owned docs so we allocate
-              them in our thread and hand off"
-            */
-            vector<boost::shared_ptr<ShardConnection> > shardConns;
-            list<boost::shared_ptr<Future::CommandResult> > futures;
-            for (set<Shard>::iterator i=shards.begin(), end=shards.end();
-                 i != end; i++) {
-                boost::shared_ptr<ShardConnection> temp(
-                    new ShardConnection(i->getConnString(), fullns));
-                verify(temp->get());
-                futures.push_back(
-                    Future::spawnCommand(i->getConnString(), dbName,
-                                         shardedCommand , 0, temp->get()));
-                shardConns.push_back(temp);
-            }
-                    
+            if (pPipeline->isCursorCommand() && !pPipeline->isExplain())
+                return runCursor(dbName, fullns, shards, shardedCommand,
+                                 pPipeline, pExpCtx, errmsg, result);
+
+            PipelineConns shardConns;
+            PipelineFutures futures;
+            spawnPipelineCommands(shards, dbName, fullns, shardedCommand,
+                                  &futures, &shardConns);
+
             /* wrap the list of futures with a source */
             intrusive_ptr<DocumentSourceCommandFutures> pSource(
                 DocumentSourceCommandFutures::create(
                     errmsg, &futures, pExpCtx));
+            if (pPipeline->getMergeShardResultsById())
+                pSource->setMergeById();
 
             /* run the pipeline */
             bool failed = pPipeline->run(result, errmsg, pSource);
@@ -1550,6 +1768,11 @@ namespace mongo {
             }
 */
 
+            /*
+              A $limit can leave the shards' cursors unfinished; they're
+              killed when the source goes, so that has to come first.
+             */
+            pSource.reset();
             for(unsigned i = 0; i < shardConns.size(); ++i)
                 shardConns[i]->done();
 
@@ -1559,6 +1782,55 @@ namespace mongo {
             return true;
         }
 
+        bool PipelineCommand::passthroughCursor(DBConfigPtr conf,
+                                                const BSONObj &cmdObj,
+                                                BSONObjBuilder &result) {
+            BSONObjBuilder shardResultBuilder;
+            bool ok = passthrough(conf, cmdObj, shardResultBuilder);
+            BSONObj shardResult(shardResultBuilder.done());
+
+            long long cursorId =
+                shardResult.getFieldDotted("cursor.id").numberLong();
+            if (cursorId)
+                cursorCache.storeRef(conf->getPrimary().getConnString(),
+                                     cursorId);
+
+            result.appendElements(shardResult);
+            return ok;
+        }
+
+        bool PipelineCommand::runCursor(
+            const string &dbName, const string &fullns,
+            const set<Shard> &shards, const BSONObj &shardedCommand,
+            const intrusive_ptr<Pipeline> &pPipeline,
+            const intrusive_ptr<ExpressionContext> &pExpCtx,
+            string &errmsg, BSONObjBuilder &result) {
+            auto_ptr<PipelineClusteredCursor> pCursor(
+                new PipelineClusteredCursor(fullns));
+            intrusive_ptr<DocumentSource> pOutput(
+                pCursor->start(pPipeline, shards, dbName, shardedCommand,
+                               pExpCtx));
+
+            BSONArrayBuilder batch;
+            bool more = pPipeline->fillFirstBatch(&batch, pOutput);
+            if (!pCursor->getErrmsg().empty()) {
+                errmsg = pCursor->getErrmsg();
+                return false;
+            }
+
+            long long cursorId = 0;
+            if (more) {
+                ShardedClientCursorPtr pClientCursor(
+                    new ShardedClientCursor(pCursor.release(),
+                                            batch.arrSize()));
+                cursorCache.store(pClientCursor);
+                cursorId = pClientCursor->getId();
+            }
+
+            Pipeline::writeCursor(result, cursorId, fullns, &batch);
+            return true;
+        }
+
     } // namespace pub_grid_cmds
 
     bool Command::runAgainstRegistered(const char *ns, BSONObj& jsobj, BSONObjBuilder& anObjBuilder, int queryOptions) {
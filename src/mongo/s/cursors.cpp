@@ -29,18 +29,30 @@ namespace mongo {
     // --------  ShardedCursor -----------
 
     ShardedClientCursor::ShardedClientCursor( QueryMessage& q , ClusteredCursor * cursor ) {
+        _init( cursor , q.queryOptions );
+        _skip = q.ntoskip;
+        _ntoreturn = q.ntoreturn;
+    }
+
+    ShardedClientCursor::ShardedClientCursor( ClusteredCursor * cursor , int sent ) {
+        _init( cursor , 0 );
+        _totalSent = sent;
+    }
+
+    void ShardedClientCursor::_init( ClusteredCursor * cursor , int queryOptions ) {
         verify( cursor );
         _cursor = cursor;
 
-        _skip = q.ntoskip;
-        _ntoreturn = q.ntoreturn;
+        _skip = 0;
+        _ntoreturn = 0;
 
         _totalSent = 0;
         _done = false;
 
         _id = 0;
+        _timeoutTick = -1;
 
-        if ( q.queryOptions & QueryOption_NoCursorTimeout ) {
+        if ( queryOptions & QueryOption_NoCursorTimeout ) {
             _lastAccessMillis = 0;
         }
         else
@@ -144,7 +156,8 @@ namespace mongo {
     long long CursorCache::TIMEOUT = 600000;
 
     CursorCache::CursorCache()
-        :_mutex( "CursorCache" ), _shardedTotal(0) {
+        :_mutex( "CursorCache" ), _timeouts( 1000 , 1024 ), _shardedTotal(0), _timedOut(0),
+         _timedOutLastMinute(0), _timedOutBeforeMinute(0), _minute(0) {
     }
 
     CursorCache::~CursorCache() {
@@ -176,13 +189,31 @@ namespace mongo {
         LOG(_myLogLevel) << "CursorCache::store cursor " << " id: " << cursor->getId() << endl;
         verify( cursor->getId() );
         scoped_lock lk( _mutex );
+        MapSharded::iterator i = _cursors.find( cursor->getId() );
+        if ( i != _cursors.end() )
+            _erase_inlock( i );
         _cursors[cursor->getId()] = cursor;
+        _fileForTimeout_inlock( cursor.get() , Listener::getElapsedTimeMillis() );
         _shardedTotal++;
     }
     void CursorCache::remove( long long id ) {
         verify( id );
         scoped_lock lk( _mutex );
-        _cursors.erase( id );
+        MapSharded::iterator i = _cursors.find( id );
+        if ( i != _cursors.end() )
+            _erase_inlock( i );
+    }
+
+    void CursorCache::_fileForTimeout_inlock( ShardedClientCursor* cursor , long long now ) {
+        if ( cursor->_lastAccessMillis == 0 )
+            return;
+        cursor->_timeoutTick = _timeouts.add( cursor->getId() , cursor->_lastAccessMillis + TIMEOUT , now );
+    }
+
+    void CursorCache::_erase_inlock( MapSharded::iterator i ) {
+        if ( i->second->_timeoutTick >= 0 )
+            _timeouts.remove( i->first , i->second->_timeoutTick );
+        _cursors.erase( i );
     }
     
     void CursorCache::storeRef( const string& server , long long id ) {
@@ -255,7 +286,7 @@ namespace mongo {
 
                 MapSharded::iterator i = _cursors.find( id );
                 if ( i != _cursors.end() ) {
-                    _cursors.erase( i );
+                    _erase_inlock( i );
                     continue;
                 }
 
@@ -284,22 +315,48 @@ namespace mongo {
         result.appendNumber( "shardedEver" , _shardedTotal );
         result.append( "refs" , (int)_refs.size() );
         result.append( "totalOpen" , (int)(_cursors.size() + _refs.size() ) );
+        result.appendNumber( "timedOut" , _timedOut );
+        result.appendNumber( "timedOutLastMinute" , _timedOutLastMinute );
     }
 
     void CursorCache::doTimeouts() {
         long long now = Listener::getElapsedTimeMillis();
         scoped_lock lk( _mutex );
-        for ( MapSharded::iterator i=_cursors.begin(); i!=_cursors.end(); ++i ) {
-            // Note: cursors with no timeout will always have an idleTime of 0
+
+        // only the cursors whose time may be up, as of when each was filed
+        vector<long long> due;
+        _timeouts.expire( now , &due );
+        for ( vector<long long>::const_iterator j = due.begin(); j != due.end(); ++j ) {
+            MapSharded::iterator i = _cursors.find( *j );
+            if ( i == _cursors.end() )
+                continue;
+            i->second->_timeoutTick = -1;
             long long idleFor = i->second->idleTime( now );
             if ( idleFor < TIMEOUT ) {
+                // used since it was filed
+                _fileForTimeout_inlock( i->second.get() , now );
                 continue;
             }
             log() << "killing old cursor " << i->second->getId() << " idle for: " << idleFor << "ms" << endl; // TODO: make log(1)
             _cursors.erase( i );
-            i = _cursors.begin(); // possible 2nd entry will get skipped, will get on next pass
-            if ( i == _cursors.end() )
-                break;
+            _timedOut++;
+        }
+
+        if ( now / 60000 != _minute ) {
+            _minute = now / 60000;
+            _timedOutLastMinute = _timedOut - _timedOutBeforeMinute;
+            _timedOutBeforeMinute = _timedOut;
+        }
+    }
+
+    void CursorCache::setTimeout( long long millis ) {
+        long long now = Listener::getElapsedTimeMillis();
+        scoped_lock lk( _mutex );
+        TIMEOUT = millis;
+        for ( MapSharded::iterator i = _cursors.begin(); i != _cursors.end(); ++i ) {
+            if ( i->second->_timeoutTick >= 0 )
+                _timeouts.remove( i->first , i->second->_timeoutTick );
+            _fileForTimeout_inlock( i->second.get() , now );
         }
     }
 
@@ -330,7 +387,7 @@ namespace mongo {
         bool run(const string&, BSONObj& jsobj, int, string& errmsg, BSONObjBuilder& result, bool fromRepl ) {
             cursorCache.appendInfo( result );
             if ( jsobj["setTimeout"].isNumber() )
-                CursorCache::TIMEOUT = jsobj["setTimeout"].numberLong();
+                cursorCache.setTimeout( jsobj["setTimeout"].numberLong() );
             return true;
         }
     } cmdCursorInfo;
@@ -23,6 +23,7 @@
 #include "../db/jsobj.h"
 #include "../db/dbmessage.h"
 #include "../client/parallel.h"
+#include "../util/timer_wheel.h"
 
 #include "request.h"
 
@@ -31,6 +32,14 @@ namespace mongo {
     class ShardedClientCursor : boost::noncopyable {
     public:
         ShardedClientCursor( QueryMessage& q , ClusteredCursor * cursor );
+
+        /**
+         * For output made here rather than by a query, such as a pipeline's, the first batch of
+         * which went back in a command reply.
+         * @param sent the number of documents in the first batch
+         */
+        ShardedClientCursor( ClusteredCursor * cursor , int sent );
+
         virtual ~ShardedClientCursor();
 
         long long getId();
@@ -69,6 +78,9 @@ namespace mongo {
         static const int INIT_REPLY_BUFFER_SIZE;
 
     protected:
+        friend class CursorCache;
+
+        void _init( ClusteredCursor * cursor , int queryOptions );
 
         ClusteredCursor * _cursor;
 
@@ -80,6 +92,7 @@ namespace mongo {
 
         long long _id;
         long long _lastAccessMillis; // 0 means no timeout
+        long long _timeoutTick; // where CursorCache has it filed for timing out, -1 if not
 
     };
 
@@ -113,13 +126,25 @@ namespace mongo {
 
         void doTimeouts();
         void startTimeoutThread();
+
+        /** changes TIMEOUT, refiling every cursor so a shorter one takes effect now */
+        void setTimeout( long long millis );
     private:
+        /** files cursor in _timeouts to be looked at when it may time out, unless it can't */
+        void _fileForTimeout_inlock( ShardedClientCursor* cursor , long long now );
+        void _erase_inlock( MapSharded::iterator i );
+
         mutable mongo::mutex _mutex;
 
         MapSharded _cursors;
         MapNormal _refs;
+        TimerWheel _timeouts; // the sharded cursors which can time out, by when they next may
 
         long long _shardedTotal;
+        long long _timedOut;
+        long long _timedOutLastMinute;
+        long long _timedOutBeforeMinute;
+        long long _minute; // of the last doTimeouts()
 
         static const int _myLogLevel;
     };
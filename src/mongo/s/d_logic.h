@@ -24,6 +24,7 @@
 
 #include "d_chunk_manager.h"
 #include "util.h"
+#include "mongo/platform/atomic_word.h"
 #include "mongo/util/concurrency/ticketholder.h"
 
 namespace mongo {
@@ -158,6 +159,29 @@ namespace mongo {
         // a ShardChunkManager carries all state we need for a collection at this shard, including its version information
         typedef map<string,ShardChunkManagerPtr> ChunkManagersMap;
         ChunkManagersMap _chunks;
+
+    public:
+        /** a thread's copy of the published _chunks; see chunks() */
+        struct ChunksSnapshot {
+            ChunksSnapshot() : generation( 0 ) {}
+            unsigned long long generation;
+            shared_ptr<const ChunkManagersMap> chunks;
+        };
+
+    private:
+        /**
+         * @return _chunks as last published, for readers without _mutex.  each thread keeps its
+         * own reference to the published copy, and takes _mutex only to catch up when a change
+         * was published since, so version checks don't write to any shared state.  the result
+         * is only good until the thread's next call.
+         */
+        const ChunkManagersMap& chunks() const;
+
+        /** copies _chunks for chunks() readers; _mutex must be held, after every change */
+        void _publishChunks();
+
+        shared_ptr<const ChunkManagersMap> _published; // under _mutex
+        AtomicUInt64 _publishedGeneration; // bumped after each change of _published
     };
 
     extern ShardingState shardingState;
@@ -179,6 +203,11 @@ namespace mongo {
 
         static ShardedConnectionInfo* get( bool create );
         static void reset();
+
+        /** for moving the connection to another thread: takes this thread's info off it */
+        static ShardedConnectionInfo* release();
+        /** makes info, from release(), this thread's */
+        static void set( ShardedConnectionInfo* info );
         static void addHook();
 
         bool inForceVersionOkMode() const {
@@ -246,6 +275,21 @@ namespace mongo {
     }
 
     void logOpForSharding( const char * opstr , const char * ns , const BSONObj& obj , BSONObj * patt );
+
+    // d_split.cpp keeps splitVector's key counts of the chunks it walked up to date
+    void noteInsertForSplit( const char* ns , const BSONObj& doc );
+    void noteUpsertForSplit( const char* ns );
     void aboutToDeleteForSharding( const Database* db , const DiskLoc& dl );
+    // compact moving a document mid migration keeps it in the clone
+    void aboutToMoveForSharding( const Database* db , const DiskLoc& from , const DiskLoc& to );
+
+    // d_migrate.cpp deletes the ranges moveChunk gives away in the background, a batch at a time
+
+    extern int rangeDeleterBatchSize;     // documents per batch
+    extern int rangeDeleterMaxDocsPerSec; // 0 for no limit
+
+    /** resumes the ranges left in local.rangeDeletions, then starts the deleting thread */
+    void startRangeDeleter();
+    void appendRangeDeleterStats( BSONObjBuilder& b );
 
 }
@@ -37,6 +37,8 @@
 #include "../db/repl_block.h"
 #include "../db/dur.h"
 #include "../db/clientcursor.h"
+#include "../db/instance.h"
+#include "../db/replutil.h"
 
 #include "../client/connpool.h"
 #include "../client/distlock.h"
@@ -46,6 +48,7 @@
 #include "../util/startup_test.h"
 #include "../util/processinfo.h"
 #include "../util/ramlog.h"
+#include "../util/background.h"
 
 #include "shard.h"
 #include "d_logic.h"
@@ -142,61 +145,40 @@ namespace mongo {
 
     };
 
-    struct OldDataCleanup {
-        static AtomicUInt _numThreads; // how many threads are doing async cleanup
+    int rangeDeleterBatchSize = 100;
+    int rangeDeleterMaxDocsPerSec = 0;
 
+    static const char * const rangeDeletionsNs = "local.rangeDeletions";
+    static const char * const rangeDeleterThreadName = "rangeDeleter";
+
+    /**
+     * A range moveChunk has given away, waiting to be deleted.  Its entry in
+     * local.rangeDeletions lets a restarted shard pick up where it left off.
+     */
+    struct RangeDeletion {
+        OID id;
         string ns;
         BSONObj min;
         BSONObj max;
-        set<CursorId> initial;
+        set<CursorId> initial; // cursors open at the commit, which may still be reading the range
+        Timer queued;
+        bool resumed; // reloaded at startup or after stepping down, not yet checked against this shard's chunks
+        shared_ptr<RemoveSaver> saver;
 
-        OldDataCleanup(){
-            _numThreads++;
-        }
-        OldDataCleanup( const OldDataCleanup& other ) {
-            ns = other.ns;
-            min = other.min.getOwned();
-            max = other.max.getOwned();
-            initial = other.initial;
-            _numThreads++;
-        }
-        ~OldDataCleanup(){
-            _numThreads--;
-        }
+        RangeDeletion() : resumed(false) {}
 
         string toString() const {
             return str::stream() << ns << " from " << min << " -> " << max;
         }
-        
-        void doRemove() {
+
+        long long removeBatch( int batchSize ) {
             ShardForceVersionOkModeBlock sf;
-            {
-                Lock::DBWrite lk(ns);
-                RemoveSaver rs("moveChunk",ns,"post-cleanup");
-                long long numDeleted = Helpers::removeRange( ns , min , max , true , false , cmdLine.moveParanoia ? &rs : 0, true );
-                log() << "moveChunk deleted: " << numDeleted << migrateLog;
-            }
-            
-            
-            ReplTime lastOpApplied = cc().getLastOp().asDate();
-            Timer t;
-            for ( int i=0; i<3600; i++ ) {
-                if ( opReplicatedEnough( lastOpApplied , ( getSlaveCount() / 2 ) + 1 ) ) {
-                    LOG(t.seconds() < 30 ? 1 : 0) << "moveChunk repl sync took " << t.seconds() << " seconds" << migrateLog;
-                    return;
-                }
-                sleepsecs(1);
-            }
-            
-            warning() << "moveChunk repl sync timed out after " << t.seconds() << " seconds" << migrateLog;
+            Lock::DBWrite lk(ns);
+            return Helpers::removeRangeBatch( ns , min , max , batchSize , saver.get() , true );
         }
 
     };
 
-    AtomicUInt OldDataCleanup::_numThreads = 0;
-
-    static const char * const cleanUpThreadName = "cleanupOldData";
-
     class ChunkCommandHelper : public Command {
     public:
         ChunkCommandHelper( const char * name )
@@ -297,7 +279,7 @@ namespace mongo {
 
             case 'd': {
 
-                if ( getThreadName() == cleanUpThreadName ) {
+                if ( getThreadName() == rangeDeleterThreadName ) {
                     // we don't want to xfer things we're cleaning
                     // as then they'll be deleted on TO
                     // which is bad
@@ -470,6 +452,8 @@ namespace mongo {
             return true;
         }
 
+        enum { ReadAheadRecords = 64 }; // records clone() faults in per trip out of the read lock
+
         bool clone( string& errmsg , BSONObjBuilder& result ) {
             if ( ! _getActive() ) {
                 errmsg = "not active";
@@ -492,7 +476,7 @@ namespace mongo {
                 bool filledBuffer = false;
                 
                 auto_ptr<LockMongoFilesShared> fileLock;
-                Record* recordToTouch = 0;
+                vector<Record*> recordsToTouch;
 
                 {
                     Client::ReadContext ctx( _ns );
@@ -506,8 +490,15 @@ namespace mongo {
                         
                         Record* r = dl.rec();
                         if ( ! r->likelyInPhysicalMemory() ) {
+                            // the locs are in disk order, so read ahead a run of them at once
+                            // rather than dropping the lock for each record
                             fileLock.reset( new LockMongoFilesShared() );
-                            recordToTouch = r;
+                            set<DiskLoc>::iterator j = i;
+                            for ( unsigned n = 0; j != _cloneLocs.end() && n < 4 * ReadAheadRecords && recordsToTouch.size() < ReadAheadRecords; ++j, ++n ) {
+                                Record* next = j->rec();
+                                if ( ! next->likelyInPhysicalMemory() )
+                                    recordsToTouch.push_back( next );
+                            }
                             break;
                         }
                         
@@ -529,13 +520,11 @@ namespace mongo {
                         break;
                 }
                 
-                if ( recordToTouch ) {
-                    // its safe to touch here bceause we have a LockMongoFilesShared
-                    // we can't do where we get the lock because we would have to unlock the main readlock and tne _trackerLocks
-                    // simpler to handle this out there
-                    recordToTouch->touch();
-                    recordToTouch = 0;
-                }
+                // its safe to touch here bceause we have a LockMongoFilesShared
+                // we can't do where we get the lock because we would have to unlock the main readlock and tne _trackerLocks
+                // simpler to handle this out there
+                for ( unsigned j = 0; j < recordsToTouch.size(); j++ )
+                    recordsToTouch[j]->touch();
                 
             }
 
@@ -561,6 +550,22 @@ namespace mongo {
             _cloneLocs.erase( dl );
         }
 
+        void aboutToMove( const Database* db , const DiskLoc& from , const DiskLoc& to ) {
+            verify(db);
+            Lock::assertWriteLocked(db->name);
+
+            if ( ! _getActive() )
+                return;
+
+            if ( ! db->ownsNS( _ns ) )
+                return;
+
+            scoped_spinlock lk( _trackerLocks ); 
+
+            if ( _cloneLocs.erase( from ) )
+                _cloneLocs.insert( to );
+        }
+
         long long mbUsed() const { return _memoryUsed / ( 1024 * 1024 ); }
 
         bool getInCriticalSection() const { scoped_lock l(_m); return _inCriticalSection; }
@@ -568,19 +573,16 @@ namespace mongo {
 
         bool isActive() const { return _getActive(); }
         
-        void doRemove( OldDataCleanup& cleanup ) {
-            int it = 0;
-            while ( true ) { 
-                if ( it > 20 && it % 10 == 0 ) log() << "doRemote iteration " << it << " for: " << cleanup << endl;
-                {
-                    scoped_lock ll(_workLock);
-                    if ( ! _active ) {
-                        cleanup.doRemove();
-                        return;
-                    }
-                }
-                sleepmillis( 1000 );
-            }
+        /**
+         * deletes the next batch of the range, unless a migration is under way
+         * @return false if the batch has to wait
+         */
+        bool doRemoveBatch( RangeDeletion& range , int batchSize , long long* numDeleted ) {
+            scoped_lock ll(_workLock);
+            if ( _active )
+                return false;
+            *numDeleted = range.removeBatch( batchSize );
+            return true;
         }
 
     private:
@@ -623,60 +625,246 @@ namespace mongo {
         }
     };
 
-    void _cleanupOldData( OldDataCleanup cleanup ) {
-        Client::initThread( cleanUpThreadName );
-        if (!noauth) {
-            cc().getAuthenticationInfo()->authorize("local", internalSecurity.user);
+    /**
+     * Deletes the ranges moveChunk gives away, a batch at a time, dropping the write lock in
+     * between.  After each batch it waits for a majority of the set to catch up, and stays
+     * under rangeDeleterMaxDocsPerSec if that's set, so a large chunk doesn't crowd out the
+     * shard's own traffic or leave its secondaries behind.
+     */
+    class RangeDeleter : public BackgroundJob {
+    public:
+        RangeDeleter() : _m("RangeDeleter") {}
+
+        virtual string name() const { return rangeDeleterThreadName; }
+
+        /** picks up the ranges an earlier run didn't finish */
+        void load() {
+            DBDirectClient conn;
+            auto_ptr<DBClientCursor> c = conn.query( rangeDeletionsNs , BSONObj() );
+            while ( c.get() && c->more() ) {
+                BSONObj o = c->next();
+                RangeDeletion range;
+                range.id = o["_id"].OID();
+                range.ns = o["ns"].String();
+                range.min = o["min"].Obj().getOwned();
+                range.max = o["max"].Obj().getOwned();
+                range.resumed = true;
+                _add( range );
+            }
+            if ( backlog() )
+                log() << "resuming deletion of " << backlog() << " ranges left by moveChunk" << migrateLog;
+        }
+
+        void add( const string& ns , const BSONObj& min , const BSONObj& max , const set<CursorId>& cursors ) {
+            RangeDeletion range;
+            range.id.init();
+            range.ns = ns;
+            range.min = min.getOwned();
+            range.max = max.getOwned();
+            range.initial = cursors;
+
+            DBDirectClient conn;
+            conn.insert( rangeDeletionsNs , BSON( "_id" << range.id << "ns" << ns << "min" << range.min << "max" << range.max ) );
+            _add( range );
+        }
+
+        /** @return true if a range still to be deleted overlaps [min, max) of ns */
+        bool overlaps( const string& ns , const BSONObj& min , const BSONObj& max ) const {
+            scoped_lock lk( _m );
+            for ( list<RangeDeletion>::const_iterator i = _ranges.begin(); i != _ranges.end(); ++i ) {
+                if ( i->ns == ns && i->min.woCompare( max ) < 0 && min.woCompare( i->max ) < 0 )
+                    return true;
+            }
+            return false;
         }
-        log() << " (start) waiting to cleanup " << cleanup << "  # cursors:" << cleanup.initial.size() << migrateLog;
 
-        int loops = 0;
-        Timer t;
-        while ( t.seconds() < 900 ) { // 15 minutes
-            verify( !Lock::isLocked() );
-            sleepmillis( 20 );
+        int backlog() const {
+            scoped_lock lk( _m );
+            return _ranges.size();
+        }
 
-            set<CursorId> now;
-            ClientCursor::find( cleanup.ns , now );
+        void appendStats( BSONObjBuilder& b ) const {
+            b.append( "backlog" , backlog() );
+            b.appendNumber( "docsDeleted" , (long long) _docsDeleted.load() );
+            b.appendNumber( "batches" , (long long) _batches.load() );
+            b.appendNumber( "replWaitMillis" , (long long) _replWaitMillis.load() );
+        }
 
-            set<CursorId> left;
-            for ( set<CursorId>::iterator i=cleanup.initial.begin(); i!=cleanup.initial.end(); ++i ) {
-                CursorId id = *i;
-                if ( now.count(id) )
-                    left.insert( id );
+        virtual void run() {
+            Client::initThread( name().c_str() );
+            if (!noauth) {
+                cc().getAuthenticationInfo()->authorize("local", internalSecurity.user);
             }
 
-            if ( left.size() == 0 )
-                break;
-            cleanup.initial = left;
+            while ( ! inShutdown() ) {
+                RangeDeletion* range = _next();
+                if ( ! range ) {
+                    sleepmillis( 100 );
+                    continue;
+                }
+
+                try {
+                    if ( _doBatch( *range ) )
+                        _done( range , true );
+                }
+                catch ( std::exception& e ) {
+                    log() << "error deleting " << *range << ": " << e.what() << migrateLog;
+                    sleepsecs( 1 );
+                }
+            }
+
+            cc().shutdown();
+        }
+
+    private:
+        void _add( const RangeDeletion& range ) {
+            scoped_lock lk( _m );
+            _ranges.push_back( range );
+            if ( cmdLine.moveParanoia )
+                _ranges.back().saver.reset( new RemoveSaver( "moveChunk" , range.ns , "post-cleanup" ) );
+        }
+
+        void _done( RangeDeletion* range , bool deleted ) {
+            if ( deleted )
+                log() << "moveChunk deleted " << *range << migrateLog;
 
-            if ( ( loops++ % 200 ) == 0 ) {
-                log() << " (looping " << loops << ") waiting to cleanup " << cleanup.ns << " from " << cleanup.min << " -> " << cleanup.max << "  # cursors:" << cleanup.initial.size() << migrateLog;
+            DBDirectClient conn;
+            conn.remove( rangeDeletionsNs , BSON( "_id" << range->id ) );
 
-                stringstream ss;
-                for ( set<CursorId>::iterator i=cleanup.initial.begin(); i!=cleanup.initial.end(); ++i ) {
-                    CursorId id = *i;
-                    ss << id << " ";
+            scoped_lock lk( _m );
+            for ( list<RangeDeletion>::iterator i = _ranges.begin(); i != _ranges.end(); ++i ) {
+                if ( &*i == range ) {
+                    _ranges.erase( i );
+                    break;
                 }
-                log() << " cursors: " << ss.str() << migrateLog;
             }
         }
 
-        migrateFromStatus.doRemove( cleanup );
+        /**
+         * @return the oldest range whose cursors have gone, or have had their 15 minutes.
+         * Only this thread takes ranges off the list, so the pointer stays good.
+         */
+        RangeDeletion* _next() {
+            vector<RangeDeletion*> ranges;
+            {
+                scoped_lock lk( _m );
+                for ( list<RangeDeletion>::iterator i = _ranges.begin(); i != _ranges.end(); ++i )
+                    ranges.push_back( &*i );
+            }
 
-        cc().shutdown();
-    }
+            for ( unsigned i = 0; i < ranges.size(); i++ ) {
+                RangeDeletion* range = ranges[i];
+
+                if ( range->resumed && ! _checkResumed( range ) )
+                    continue;
+
+                if ( range->initial.size() && range->queued.seconds() < 900 ) {
+                    set<CursorId> now;
+                    ClientCursor::find( range->ns , now );
 
-    void cleanupOldData( OldDataCleanup cleanup ) {
-        try {
-            _cleanupOldData( cleanup );
+                    set<CursorId> left;
+                    for ( set<CursorId>::iterator j = range->initial.begin(); j != range->initial.end(); ++j ) {
+                        if ( now.count( *j ) )
+                            left.insert( *j );
+                    }
+                    range->initial = left;
+                    if ( left.size() )
+                        continue;
+                }
+
+                return range;
+            }
+            return 0;
         }
-        catch ( std::exception& e ) {
-            log() << " error cleaning old data:" << e.what() << migrateLog;
+
+        /**
+         * A range reloaded at startup may have been moved back here since, so it waits until
+         * this shard has loaded its chunks for the collection, and is dropped if it owns any
+         * part of the range.
+         * @return true if the range can be deleted
+         */
+        bool _checkResumed( RangeDeletion* range ) {
+            if ( ! shardingState.enabled() )
+                return false;
+            ShardChunkManagerPtr chunks = shardingState.getShardChunkManager( range->ns );
+            if ( ! chunks )
+                return false;
+
+            BSONObj lookup;
+            while ( true ) {
+                BSONObj min , max;
+                bool last = chunks->getNextChunk( lookup , &min , &max );
+                if ( min.isEmpty() )
+                    break;
+                if ( min.woCompare( range->max ) < 0 && range->min.woCompare( max ) < 0 ) {
+                    warning() << "not deleting " << *range << ", this shard owns " << min << " -> " << max << " again" << migrateLog;
+                    _done( range , false );
+                    return false;
+                }
+                if ( last )
+                    break;
+                lookup = min;
+            }
+
+            range->resumed = false;
+            return true;
         }
-        catch ( ... ) {
-            log() << " unknown error cleaning old data" << migrateLog;
+
+        /** @return true once the range is empty */
+        bool _doBatch( RangeDeletion& range ) {
+            if ( ! isMasterNs( range.ns.c_str() ) ) {
+                // the range may come back while another member is primary; stepping down
+                // reset the sharding state, so checking again waits for it to be reloaded
+                range.resumed = true;
+                sleepsecs( 1 );
+                return false;
+            }
+
+            int batchSize = max( rangeDeleterBatchSize , 1 );
+            long long n = 0;
+            Timer t;
+            if ( ! migrateFromStatus.doRemoveBatch( range , batchSize , &n ) ) {
+                sleepmillis( 100 );
+                return false;
+            }
+            _docsDeleted.fetchAndAdd( n );
+            _batches.fetchAndAdd( 1 );
+
+            if ( n > 0 ) {
+                ReplTime lastOpApplied = cc().getLastOp().asDate();
+                Timer r;
+                if ( ! awaitReplication( lastOpApplied , ( getSlaveCount() / 2 ) + 1 , 60 * 1000 ) ) {
+                    warning() << "range deleter repl sync timed out after " << r.seconds() << " seconds" << migrateLog;
+                }
+                _replWaitMillis.fetchAndAdd( r.millis() );
+            }
+
+            int perSec = rangeDeleterMaxDocsPerSec;
+            if ( perSec > 0 ) {
+                long long millis = n * 1000 / perSec;
+                if ( millis > t.millis() )
+                    sleepmillis( millis - t.millis() );
+            }
+
+            return n < batchSize;
         }
+
+        mutable mongo::mutex _m; // protects _ranges
+        list<RangeDeletion> _ranges;
+
+        AtomicUInt64 _docsDeleted;
+        AtomicUInt64 _batches;
+        AtomicUInt64 _replWaitMillis;
+
+    } rangeDeleter;
+
+    void startRangeDeleter() {
+        rangeDeleter.load();
+        rangeDeleter.go();
+    }
+
+    void appendRangeDeleterStats( BSONObjBuilder& b ) {
+        rangeDeleter.appendStats( b );
     }
 
     void logOpForSharding( const char * opstr , const char * ns , const BSONObj& obj , BSONObj * patt ) {
@@ -687,6 +875,10 @@ namespace mongo {
         migrateFromStatus.aboutToDelete( db , dl );
     }
 
+    void aboutToMoveForSharding( const Database* db , const DiskLoc& from , const DiskLoc& to ) {
+        migrateFromStatus.aboutToMove( db , from , to );
+    }
+
     class TransferModsCommand : public ChunkCommandHelper {
     public:
         TransferModsCommand() : ChunkCommandHelper( "_transferMods" ) {}
@@ -1251,22 +1443,10 @@ namespace mongo {
 
             {
                 // 6.
-                OldDataCleanup c;
-                c.ns = ns;
-                c.min = min.getOwned();
-                c.max = max.getOwned();
-                ClientCursor::find( ns , c.initial );
-                if ( c.initial.size() ) {
-                    log() << "forking for cleaning up chunk data" << migrateLog;
-                    boost::thread t( boost::bind( &cleanupOldData , c ) );
-                }
-                else {
-                    log() << "doing delete inline" << migrateLog;
-                    // 7.
-                    c.doRemove();
-                }
-
-
+                set<CursorId> cursors;
+                ClientCursor::find( ns , cursors );
+                log() << "queueing chunk data for deletion, # cursors: " << cursors.size() << migrateLog;
+                rangeDeleter.add( ns , min , max , cursors );
             }
             timing.done(6);
 
@@ -1298,6 +1478,8 @@ namespace mongo {
         
         MigrateStatus() : m_active("MigrateStatus") { active = false; }
 
+        enum { InsertsPerLock = 100 }; // cloned documents inserted per write lock
+
         void prepare() {
             scoped_lock l(m_active); // reading and writing 'active'
 
@@ -1346,6 +1528,10 @@ namespace mongo {
             ScopedDbConnection& conn = *connPtr;
             conn->getLastError(); // just test connection
 
+            bool empty = false;
+            string system_indexes;
+            vector<BSONObj> deferredIndexes;
+
             {
                 // 1. copy indexes
                 auto_ptr<DBClientCursor> indexes = conn->getIndexes( ns );
@@ -1356,9 +1542,18 @@ namespace mongo {
 
                 Client::WriteContext ct( ns );
 
-                string system_indexes = cc().database()->name + ".system.indexes";
+                // when we have none of the collection yet, only the _id index is kept up as
+                // documents arrive; the rest are built in bulk once the clone is done
+                NamespaceDetails *d = nsdetails( ns.c_str() );
+                empty = d == NULL || d->stats.nrecords == 0;
+
+                system_indexes = cc().database()->name + ".system.indexes";
                 for ( unsigned i=0; i<all.size(); i++ ) {
                     BSONObj idx = all[i];
+                    if ( empty && idx["name"].str() != "_id_" ) {
+                        deferredIndexes.push_back( idx );
+                        continue;
+                    }
                     theDataFileMgr.insertAndLog( system_indexes.c_str() , idx, true /* flag fromMigrate in oplog */ );
                 }
 
@@ -1367,11 +1562,14 @@ namespace mongo {
 
             {
                 // 2. delete any data already in range
-                Lock::DBWrite lk( ns );
-                RemoveSaver rs( "moveChunk" , ns , "preCleanup" );
-                long long num = Helpers::removeRange( ns , min , max , true , false , cmdLine.moveParanoia ? &rs : 0, true /* flag fromMigrate in oplog */ );
-                if ( num )
-                    warning() << "moveChunkCmd deleted data already in chunk # objects: " << num << migrateLog;
+                // (an empty collection has none, and may not have the shard key index yet)
+                if ( ! empty ) {
+                    Lock::DBWrite lk( ns );
+                    RemoveSaver rs( "moveChunk" , ns , "preCleanup" );
+                    long long num = Helpers::removeRange( ns , min , max , true , false , cmdLine.moveParanoia ? &rs : 0, true /* flag fromMigrate in oplog */ );
+                    if ( num )
+                        warning() << "moveChunkCmd deleted data already in chunk # objects: " << num << migrateLog;
+                }
 
                 timing.done(2);
             }
@@ -1395,22 +1593,42 @@ namespace mongo {
                     BSONObj arr = res["objects"].Obj();
                     int thisTime = 0;
 
+                    // a lock per run of documents rather than per document
                     BSONObjIterator i( arr );
                     while( i.more() ) {
-                        BSONObj o = i.next().Obj();
-                        {
-                            Lock::DBWrite lk( ns );
+                        Lock::DBWrite lk( ns );
+                        for ( int n = 0; n < InsertsPerLock && i.more(); n++ ) {
+                            BSONObj o = i.next().Obj();
                             Helpers::upsert( ns, o, true );
+                            thisTime++;
+                            numCloned++;
+                            clonedBytes += o.objsize();
                         }
-                        thisTime++;
-                        numCloned++;
-                        clonedBytes += o.objsize();
                     }
 
                     if ( thisTime == 0 )
                         break;
                 }
 
+                if ( deferredIndexes.size() ) {
+                    // 3.b build the remaining indexes over what was cloned, with BtreeBuilder
+                    try {
+                        Client::WriteContext ct( ns );
+                        for ( unsigned i=0; i<deferredIndexes.size(); i++ ) {
+                            BSONObj idx = deferredIndexes[i];
+                            theDataFileMgr.insertAndLog( system_indexes.c_str() , idx, true /* flag fromMigrate in oplog */ );
+                        }
+                    }
+                    catch ( DBException& e ) {
+                        state = FAIL;
+                        errmsg = str::stream() << "building indexes after clone failed: " << e.toString();
+                        error() << errmsg << migrateLog;
+                        conn.done();
+                        return;
+                    }
+                    log() << "moveChunk built " << deferredIndexes.size() << " indexes after cloning " << numCloned << " documents" << migrateLog;
+                }
+
                 timing.done(3);
             }
 
@@ -1450,7 +1668,7 @@ namespace mongo {
                             warning() << "secondaries having hard time keeping up with migrate" << migrateLog;
                         }
 
-                        sleepmillis( 20 );
+                        mongo::awaitReplication( lastOpApplied , slaveCount , 20 );
                     }
 
                     if ( i == maxIterations ) {
@@ -1707,11 +1925,14 @@ namespace mongo {
                 return false;
             }
             
-            if ( OldDataCleanup::_numThreads > 0 ) {
-                errmsg = 
-                    str::stream() 
-                    << "still waiting for a previous migrates data to get cleaned, can't accept new chunks, num threads: " 
-                    << OldDataCleanup::_numThreads;
+            string ns = cmdObj.firstElement().String();
+            BSONObj min = cmdObj["min"].Obj();
+            BSONObj max = cmdObj["max"].Obj();
+            if ( rangeDeleter.overlaps( ns , min , max ) ) {
+                errmsg =
+                    str::stream()
+                    << "still waiting for a previous migrates data to get cleaned, can't accept new chunks, ranges left: "
+                    << rangeDeleter.backlog();
                 return false;
             }
 
@@ -1720,10 +1941,10 @@ namespace mongo {
 
             migrateStatus.prepare();
 
-            migrateStatus.ns = cmdObj.firstElement().String();
+            migrateStatus.ns = ns;
             migrateStatus.from = cmdObj["from"].String();
-            migrateStatus.min = cmdObj["min"].Obj().getOwned();
-            migrateStatus.max = cmdObj["max"].Obj().getOwned();
+            migrateStatus.min = min.getOwned();
+            migrateStatus.max = max.getOwned();
 
             boost::thread m( migrateThread );
 
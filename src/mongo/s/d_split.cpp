@@ -229,6 +229,134 @@ namespace mongo {
         }
     } cmdCheckShardingIndex;
 
+    /**
+     * How many keys splitVector found in the chunk ranges it walked to the end, plus the
+     * inserts made into each range since, so that a later splitVector can tell a chunk is still
+     * too small to split without walking it again.  Deletes aren't taken off, so each count is
+     * an upper bound.  Upserts, whose documents aren't seen here, drop their namespace's counts,
+     * a change of shard version makes them stale, and they expire in case of writes which never
+     * came through here, such as those a secondary replicated before it was elected.
+     */
+    class SplitKeyCounts {
+    public:
+        enum { MaxAgeMillis = 10 * 60 * 1000 };
+
+        SplitKeyCounts() : _mutex( "SplitKeyCounts" ) {}
+
+        /** starts counting the range before it's walked, so inserts made meanwhile are counted */
+        void start( const string& ns , const BSONObj& keyPattern , const BSONObj& min , const BSONObj& max ,
+                    const ConfigVersion& version ) {
+            scoped_lock lk( _mutex );
+            Ranges& r = _counts[ns];
+            for ( Ranges::iterator i = r.begin(); i != r.end(); ) {
+                if ( ! i->second.version.isEquivalentTo( version ) )
+                    r.erase( i++ );
+                else
+                    ++i;
+            }
+
+            Count& c = r[min.getOwned()];
+            c.max = max.getOwned();
+            c.keyPattern = keyPattern.getOwned();
+            c.keys = 0;
+            c.version = version;
+            c.taken = jsTime();
+            c.complete = false;
+        }
+
+        /** @param keys the number found in the range, which counts only if it was walked to the end */
+        void finish( const string& ns , const BSONObj& min , long long keys , bool complete ) {
+            scoped_lock lk( _mutex );
+            Ranges& r = _counts[ns];
+            Ranges::iterator i = r.find( min );
+            if ( i == r.end() )
+                return;
+            if ( ! complete ) {
+                r.erase( i );
+                return;
+            }
+            i->second.keys += keys;
+            i->second.complete = true;
+        }
+
+        /** @return whether *keys was set to at most how many keys [min, max) holds */
+        bool get( const string& ns , const BSONObj& min , const BSONObj& max , const ConfigVersion& version ,
+                  long long* keys ) {
+            scoped_lock lk( _mutex );
+            map<string,Ranges>::iterator n = _counts.find( ns );
+            if ( n == _counts.end() )
+                return false;
+            Ranges::iterator i = n->second.find( min );
+            if ( i == n->second.end() )
+                return false;
+
+            const Count& c = i->second;
+            if ( ! c.complete || c.max.woCompare( max ) != 0 )
+                return false;
+            if ( ! c.version.isEquivalentTo( version ) || jsTime() - c.taken > (unsigned long long) MaxAgeMillis ) {
+                n->second.erase( i );
+                return false;
+            }
+            *keys = c.keys;
+            return true;
+        }
+
+        void noteInsert( const char* ns , const BSONObj& doc ) {
+            scoped_lock lk( _mutex );
+            if ( _counts.empty() )
+                return;
+            map<string,Ranges>::iterator n = _counts.find( ns );
+            if ( n == _counts.end() || n->second.empty() )
+                return;
+
+            Ranges& r = n->second;
+            const BSONObj& keyPattern = r.begin()->second.keyPattern;
+            BSONObj key = doc.extractFields( keyPattern );
+            if ( key.nFields() != keyPattern.nFields() ) {
+                // can't tell which range it went into
+                r.clear();
+                return;
+            }
+
+            Ranges::iterator i = r.upper_bound( key );
+            if ( i == r.begin() )
+                return;
+            --i;
+            if ( key.woCompare( i->second.max ) < 0 )
+                i->second.keys++;
+        }
+
+        void drop( const char* ns ) {
+            scoped_lock lk( _mutex );
+            if ( ! _counts.empty() )
+                _counts.erase( ns );
+        }
+
+    private:
+        struct Count {
+            BSONObj max;
+            BSONObj keyPattern;
+            long long keys;
+            ConfigVersion version;
+            unsigned long long taken;
+            bool complete; // whether the walk has finished
+        };
+        typedef map<BSONObj,Count,BSONObjCmp> Ranges;
+
+        mongo::mutex _mutex;
+        map<string,Ranges> _counts;
+    } splitKeyCounts;
+
+    void noteInsertForSplit( const char* ns , const BSONObj& doc ) {
+        if ( shardingState.enabled() )
+            splitKeyCounts.noteInsert( ns , doc );
+    }
+
+    void noteUpsertForSplit( const char* ns ) {
+        if ( shardingState.enabled() )
+            splitKeyCounts.drop( ns );
+    }
+
     class SplitVector : public Command {
     public:
         SplitVector() : Command( "splitVector" , false ) {}
@@ -361,7 +489,25 @@ namespace mongo {
                     log() << "limiting split vector to " << maxChunkObjects << " (from " << keyCount << ") objects " << endl;
                     keyCount = maxChunkObjects;
                 }
-                
+                result.appendNumber( "keyCount" , keyCount );
+
+                // A walk would find no split point in a range which hasn't had more than keyCount
+                // keys since the last one.  Inserts are only noted once sharding is on.
+                const bool counting = ! force && shardingState.enabled();
+                const ConfigVersion version = shardingState.getVersion( ns );
+                long long chunkKeys = 0;
+                if ( counting && splitKeyCounts.get( ns , min , max , version , &chunkKeys ) && chunkKeys <= keyCount ) {
+                    LOG(1) << "no split points for chunk " << ns << " " << min << " -->> " << max
+                           << ": at most " << chunkKeys << " keys since it was last looked at" << endl;
+                    result.appendNumber( "chunkKeys" , chunkKeys );
+                    result.append( "splitKeys" , vector<BSONObj>() );
+                    return true;
+                }
+                if ( counting )
+                    splitKeyCounts.start( ns , keyPattern , min , max , version );
+                bool walkedToEnd = true;
+                long long walked = 0;
+
                 //
                 // 2. Traverse the index and add the keyCount-th key to the result vector. If that key
                 //    appeared in the vector before, we omit it. The invariant here is that all the
@@ -388,6 +534,7 @@ namespace mongo {
                 while ( 1 ) {
                     while ( cc->ok() ) {
                         currCount++;
+                        walked++;
                         BSONObj currKey = c->currKey();
                         
                         DEV verify( currKey.woCompare( max ) <= 0 );
@@ -415,6 +562,7 @@ namespace mongo {
                             log() << "max number of requested split points reached (" << numChunks
                                   << ") before the end of chunk " << ns << " " << min << " -->> " << max
                                   << endl;
+                            walkedToEnd = false;
                             break;
                         }
                         
@@ -425,6 +573,7 @@ namespace mongo {
                             // don't use the btree cursor pointer to access keys beyond this point but ok
                             // to use it for format the keys we've got already
                             cc.release();
+                            walkedToEnd = false;
                             break;
                         }
                     }
@@ -442,6 +591,11 @@ namespace mongo {
                     cc.reset( new ClientCursor( QueryOption_NoCursorTimeout , c , ns ) );
                 }
                 
+                if ( counting )
+                    splitKeyCounts.finish( ns , min , walked , walkedToEnd );
+                if ( walkedToEnd && counting )
+                    result.appendNumber( "chunkKeys" , walked );
+
                 //
                 // 3. Format the result and issue any warnings about the data we gathered while traversing the
                 //    index
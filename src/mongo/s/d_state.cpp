@@ -37,6 +37,7 @@
 #include "shard.h"
 #include "d_logic.h"
 #include "config.h"
+#include "mongo/util/concurrency/threadlocal.h"
 #include "mongo/util/concurrency/ticketholder.h"
 
 using namespace std;
@@ -47,7 +48,26 @@ namespace mongo {
 
     ShardingState::ShardingState()
         : _enabled(false) , _mutex( "ShardingState" ),
-          _configServerTickets( 3 /* max number of concurrent config server refresh threads */ ) {
+          _configServerTickets( 3 /* max number of concurrent config server refresh threads */ ),
+          _published( new ChunkManagersMap() ), _publishedGeneration( 1 ) {
+    }
+
+    TSP_DECLARE(ShardingState::ChunksSnapshot, chunksSnapshot)
+    TSP_DEFINE(ShardingState::ChunksSnapshot, chunksSnapshot)
+
+    const ShardingState::ChunkManagersMap& ShardingState::chunks() const {
+        ChunksSnapshot *s = chunksSnapshot.getMake();
+        if ( s->generation != _publishedGeneration.load() ) {
+            scoped_lock lk( _mutex );
+            s->chunks = _published;
+            s->generation = _publishedGeneration.load();
+        }
+        return *s->chunks;
+    }
+
+    void ShardingState::_publishChunks() {
+        _published.reset( new ChunkManagersMap( _chunks ) );
+        _publishedGeneration.fetchAndAdd( 1 );
     }
 
     void ShardingState::enable( const string& server ) {
@@ -109,35 +129,30 @@ namespace mongo {
         _shardName.clear();
         _shardHost.clear();
         _chunks.clear();
+        _publishChunks();
     }
 
     // TODO we shouldn't need three ways for checking the version. Fix this.
     bool ShardingState::hasVersion( const string& ns ) {
-        scoped_lock lk(_mutex);
-
-        ChunkManagersMap::const_iterator it = _chunks.find(ns);
-        return it != _chunks.end();
+        const ChunkManagersMap& chunks = this->chunks();
+        return chunks.find( ns ) != chunks.end();
     }
 
     bool ShardingState::hasVersion( const string& ns , ConfigVersion& version ) {
-        scoped_lock lk(_mutex);
-
-        ChunkManagersMap::const_iterator it = _chunks.find(ns);
-        if ( it == _chunks.end() )
+        const ChunkManagersMap& chunks = this->chunks();
+        ChunkManagersMap::const_iterator it = chunks.find(ns);
+        if ( it == chunks.end() )
             return false;
 
-        ShardChunkManagerPtr p = it->second;
-        version = p->getVersion();
+        version = it->second->getVersion();
         return true;
     }
 
     const ConfigVersion ShardingState::getVersion( const string& ns ) const {
-        scoped_lock lk(_mutex);
-
-        ChunkManagersMap::const_iterator it = _chunks.find( ns );
-        if ( it != _chunks.end() ) {
-            ShardChunkManagerPtr p = it->second;
-            return p->getVersion();
+        const ChunkManagersMap& chunks = this->chunks();
+        ChunkManagersMap::const_iterator it = chunks.find( ns );
+        if ( it != chunks.end() ) {
+            return it->second->getVersion();
         }
         else {
             return ConfigVersion( 0, OID() );
@@ -156,6 +171,7 @@ namespace mongo {
 
         ShardChunkManagerPtr cloned( p->cloneMinus( min , max , version ) );
         _chunks[ns] = cloned;
+        _publishChunks();
     }
 
     void ShardingState::undoDonateChunk( const string& ns , const BSONObj& min , const BSONObj& max , ShardChunkVersion version ) {
@@ -165,6 +181,7 @@ namespace mongo {
         verify( it != _chunks.end() ) ;
         ShardChunkManagerPtr p( it->second->clonePlus( min , max , version ) );
         _chunks[ns] = p;
+        _publishChunks();
     }
 
     void ShardingState::splitChunk( const string& ns , const BSONObj& min , const BSONObj& max , const vector<BSONObj>& splitKeys ,
@@ -175,12 +192,14 @@ namespace mongo {
         verify( it != _chunks.end() ) ;
         ShardChunkManagerPtr p( it->second->cloneSplit( min , max , splitKeys , version ) );
         _chunks[ns] = p;
+        _publishChunks();
     }
 
     void ShardingState::resetVersion( const string& ns ) {
         scoped_lock lk( _mutex );
 
         _chunks.erase( ns );
+        _publishChunks();
     }
 
     bool ShardingState::trySetVersion( const string& ns , ConfigVersion& version /* IN-OUT */ ) {
@@ -212,10 +231,10 @@ namespace mongo {
         ConfigVersion storedVersion;
         ShardChunkManagerPtr currManager;
         {
-            scoped_lock lk( _mutex );
-            ChunkManagersMap::const_iterator it = _chunks.find( ns );
-            if ( it != _chunks.end() ) currManager = it->second;
-            if ( it != _chunks.end() && ( storedVersion = it->second->getVersion() ).isEquivalentTo( version ) )
+            const ChunkManagersMap& chunks = this->chunks();
+            ChunkManagersMap::const_iterator it = chunks.find( ns );
+            if ( it != chunks.end() ) currManager = it->second;
+            if ( it != chunks.end() && ( storedVersion = it->second->getVersion() ).isEquivalentTo( version ) )
                 return true;
         }
         
@@ -244,6 +263,7 @@ namespace mongo {
             ChunkManagersMap::const_iterator it = _chunks.find( ns );
             if ( it == _chunks.end() || p->getVersion() >= it->second->getVersion() ) {
                 _chunks[ns] = p;
+                _publishChunks();
             }
 
             ShardChunkVersion oldVersion = version;
@@ -264,9 +284,8 @@ namespace mongo {
         {
             BSONObjBuilder bb( b.subobjStart( "versions" ) );
 
-            scoped_lock lk(_mutex);
-
-            for ( ChunkManagersMap::iterator it = _chunks.begin(); it != _chunks.end(); ++it ) {
+            const ChunkManagersMap& chunks = this->chunks();
+            for ( ChunkManagersMap::const_iterator it = chunks.begin(); it != chunks.end(); ++it ) {
                 ShardChunkManagerPtr p = it->second;
                 bb.appendTimestamp( it->first , p->getVersion().toLong() );
             }
@@ -286,10 +305,9 @@ namespace mongo {
     }
 
     ShardChunkManagerPtr ShardingState::getShardChunkManager( const string& ns ) {
-        scoped_lock lk( _mutex );
-
-        ChunkManagersMap::const_iterator it = _chunks.find( ns );
-        if ( it == _chunks.end() ) {
+        const ChunkManagersMap& chunks = this->chunks();
+        ChunkManagersMap::const_iterator it = chunks.find( ns );
+        if ( it == chunks.end() ) {
             return ShardChunkManagerPtr();
         }
         else {
@@ -324,6 +342,14 @@ namespace mongo {
         _tl.reset();
     }
 
+    ShardedConnectionInfo* ShardedConnectionInfo::release() {
+        return _tl.release();
+    }
+
+    void ShardedConnectionInfo::set( ShardedConnectionInfo* info ) {
+        _tl.reset( info );
+    }
+
     const ConfigVersion ShardedConnectionInfo::getVersion( const string& ns ) const {
         NSVersionMap::const_iterator it = _versions.find( ns );
         if ( it != _versions.end() ) {
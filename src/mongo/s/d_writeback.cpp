@@ -23,8 +23,10 @@
 #include "../util/net/listen.h"
 #include "../db/curop.h"
 #include "../db/client.h"
+#include "mongo/util/concurrency/threadlocal.h"
 #include "mongo/util/stacktrace.h"
 
+#include "d_logic.h"
 #include "d_writeback.h"
 
 using namespace std;
@@ -36,6 +38,15 @@ namespace mongo {
     // TODO init at mongod startup
     WriteBackManager writeBackManager;
 
+    // whether this thread's last write back went onto a full queue
+    static ThreadLocalValue<bool> queuedOnFull( false );
+
+    /** @return whether q holds MaxQueued operations or more */
+    static bool isFull( BlockingQueue<BSONObj>& q ) {
+        BSONObj o;
+        return q.peekAt( WriteBackManager::MaxQueued - 1 , o );
+    }
+
     WriteBackManager::WriteBackManager() : _writebackQueueLock("sharding:writebackQueueLock") {
     }
 
@@ -56,7 +67,29 @@ namespace mongo {
             }
         }
         lastOID = e.OID();
-        getWritebackQueue( remote )->queue.push( o );
+        BlockingQueue<BSONObj>& q = getWritebackQueue( remote )->queue;
+        q.push( o );
+        if ( isFull( q ) )
+            queuedOnFull.set( true );
+    }
+
+    void WriteBackManager::waitForRoom() {
+        if ( ! queuedOnFull.get() )
+            return;
+        queuedOnFull.set( false );
+
+        ShardedConnectionInfo* info = ShardedConnectionInfo::get( false );
+        if ( ! info || ! info->getID().isSet() )
+            return;
+
+        // the mongos takes a batch at a time, so a little room soon becomes a lot
+        Timer t;
+        shared_ptr<QueueInfo> q = getWritebackQueue( info->getID().str() );
+        while ( isFull( q->queue ) && t.seconds() < 10 && ! inShutdown() )
+            sleepmillis( 10 );
+
+        _heldBack.fetchAndAdd( 1 );
+        _heldBackMillis.fetchAndAdd( t.millis() );
     }
 
     shared_ptr<WriteBackManager::QueueInfo> WriteBackManager::getWritebackQueue( const string& remote ) {
@@ -99,6 +132,9 @@ namespace mongo {
 
         b.appendBool( "hasOpsQueued" , totalQueued > 0 );
         b.appendNumber( "totalOpsQueued" , totalQueued );
+        b.appendNumber( "maxQueued" , (long long) MaxQueued );
+        b.appendNumber( "heldBack" , (long long) _heldBack.load() );
+        b.appendNumber( "heldBackMillis" , (long long) _heldBackMillis.load() );
         b.append( "queues" , sub.obj() );
     }
 
@@ -143,6 +179,8 @@ namespace mongo {
 
         WriteBackCommand() : Command( "writebacklisten" ) {}
 
+        enum { BatchBytes = 4 * 1024 * 1024 };
+
         void help(stringstream& h) const { h<<"internal"; }
 
         bool run(const string& , BSONObj& cmdObj, int, string& errmsg, BSONObjBuilder& result, bool) {
@@ -159,12 +197,35 @@ namespace mongo {
             // get the command issuer's (a mongos) serverID
             const OID id = e.__oid();
 
+            // a mongos asking for a batch of up to batchSize gets them in "batch", all it can
+            // have without waiting up to BatchBytes; others get one at a time in "data"
+            const int batchSize = cmdObj["batchSize"].numberInt();
+            shared_ptr<WriteBackManager::QueueInfo> q = writeBackManager.getWritebackQueue( id.str() );
+
             // the command issuer is blocked awaiting a response
             // we want to do return at least at every 5 minutes so sockets don't timeout
             BSONObj z;
-            if ( writeBackManager.getWritebackQueue(id.str())->queue.blockingPop( z, 5 * 60 /* 5 minutes */ ) ) {
+            if ( q->queue.blockingPop( z, 5 * 60 /* 5 minutes */ ) ) {
                 LOG(1) << "WriteBackCommand got : " << z << endl;
-                result.append( "data" , z );
+                if ( batchSize <= 0 ) {
+                    result.append( "data" , z );
+                }
+                else {
+                    BSONArrayBuilder batch( result.subarrayStart( "batch" ) );
+                    batch.append( z );
+                    int bytes = z.objsize();
+                    BSONObj next;
+                    for ( int n = 1; n < batchSize; n++ ) {
+                        if ( ! q->queue.peekAt( 0 , next ) || bytes + next.objsize() > BatchBytes )
+                            break;
+                        if ( ! q->queue.tryPop( next ) )
+                            break;
+                        LOG(1) << "WriteBackCommand got : " << next << endl;
+                        batch.append( next );
+                        bytes += next.objsize();
+                    }
+                    batch.done();
+                }
             }
             else {
                 result.appendBool( "noop" , true );
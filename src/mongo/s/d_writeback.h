@@ -22,6 +22,7 @@
 
 #include "../util/queue.h"
 #include "../util/background.h"
+#include "mongo/platform/atomic_word.h"
 
 namespace mongo {
 
@@ -43,6 +44,10 @@ namespace mongo {
             long long lastCall;   // this is ellapsed millis since startup
         };
 
+        // past this many operations queued for one mongos, writes that add to it are held back
+        // until it drains; see waitForRoom()
+        enum { MaxQueued = 10000 };
+
         // a map from mongos's serverIDs to queues of "rejected" operations
         // an operation is rejected if it targets data that does not live on this shard anymore
         typedef map<string,shared_ptr<QueueInfo> > WriteBackQueuesMap;
@@ -61,6 +66,13 @@ namespace mongo {
          */
         void queueWriteBack( const string& remote , const BSONObj& op );
 
+        /**
+         * If this thread's last write was queued for write back onto a queue holding MaxQueued
+         * operations or more, waits, for a while at most, until the mongos has taken some.
+         * Writes are queued under the database lock, so this is called once it's released.
+         */
+        void waitForRoom();
+
         /*
          * @param remote server ID
          * @return the queue for operations that came from 'remote'
@@ -90,6 +102,9 @@ namespace mongo {
         // '_writebackQueueLock' protects only the map itself, since each queue is syncrhonized.
         mutable mongo::mutex _writebackQueueLock;
         WriteBackQueuesMap _writebackQueues;
+
+        AtomicUInt64 _heldBack;       // writes waitForRoom() held back
+        AtomicUInt64 _heldBackMillis; // and for how long in all
         
         class Cleaner : public PeriodicTask {
         public:
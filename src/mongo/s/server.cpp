@@ -23,6 +23,7 @@
 #include "../util/net/message.h"
 #include "../util/startup_test.h"
 #include "../client/connpool.h"
+#include "../client/dbclient_rs.h"
 #include "../util/net/message_server.h"
 #include "../util/stringutils.h"
 #include "../util/version.h"
@@ -46,6 +47,7 @@
 #include "mongo/util/concurrency/remap_lock.h"
 #include "mongo/db/lasterror.h"
 #include "mongo/util/stacktrace.h"
+#include "mongo/util/trace_span.h"
 
 #if defined(_WIN32)
 # include "../util/ntservice.h"
@@ -110,6 +112,7 @@ namespace mongo {
             Request r( m , p );
 
             verify( le );
+            TraceSpans::beginRequest( p->recvStartMicros , p->recvEndMicros );
             lastError.startRequest( m , le );
 
             try {
@@ -140,6 +143,7 @@ namespace mongo {
                     replyToQuery( ResultFlag_ErrSet, p , m , err );
                 }
             }
+            TraceSpans::endRequest();
         }
 
         virtual void disconnected( AbstractMessagingPort* p ) {
@@ -324,6 +328,10 @@ int _main(int argc, char* argv[]) {
     ( "test" , "just run unit tests" )
     ( "upgrade" , "upgrade meta data version" )
     ( "chunkSize" , po::value<int>(), "maximum amount of data per chunk" )
+    ( "connPoolMinPerHost" , po::value<int>(), "connections to keep ready to each shard and config server, made in the background" )
+    ( "connPoolMaxConnecting" , po::value<int>(), "most connections to make to one host at once; further requests wait for those (default no limit)" )
+    ( "exhaustShardQueries" , "have shards stream query results instead of waiting for a getMore per batch" )
+    ( "hedgedReads" , "send slaveOk queries a secondary is slow to answer to another secondary too, and use the first answer" )
     ( "ipv6", "enable IPv6 support (disabled by default)" )
     ( "jsonp","allow JSONP access via http (has security implications)" )
     ( "noscripting", "disable scripting engine" )
@@ -366,6 +374,24 @@ int _main(int argc, char* argv[]) {
         Chunk::MaxChunkSize = csize * 1024 * 1024;
     }
 
+    if ( params.count( "connPoolMinPerHost" ) ) {
+        int n = params["connPoolMinPerHost"].as<int>();
+        if ( n < 0 ) {
+            out() << "error: connPoolMinPerHost can't be negative" << endl;
+            return 11;
+        }
+        PoolForHost::setMinPerHost( n );
+    }
+
+    if ( params.count( "connPoolMaxConnecting" ) ) {
+        int n = params["connPoolMaxConnecting"].as<int>();
+        if ( n < 0 ) {
+            out() << "error: connPoolMaxConnecting can't be negative" << endl;
+            return 11;
+        }
+        PoolForHost::setMaxConnecting( n );
+    }
+
     if ( params.count( "localThreshold" ) ) {
         cmdLine.defaultLocalThresholdMillis = params["localThreshold"].as<int>();
     }
@@ -393,6 +419,14 @@ int _main(int argc, char* argv[]) {
         noHttpInterface = true;
     }
 
+    if ( params.count( "exhaustShardQueries" ) ) {
+        ParallelSortClusteredCursor::setExhaustShardQueries( true );
+    }
+
+    if ( params.count( "hedgedReads" ) ) {
+        DBClientReplicaSet::setHedgedReads( true );
+    }
+
     if ( ! params.count( "configdb" ) ) {
         out() << "error: no args for --configdb" << endl;
         return 4;
@@ -465,6 +499,7 @@ namespace mongo {
 #endif
 
 int main(int argc, char* argv[]) {
+    TraceSpans::propagate = true;
     try {
         int exitCode = _main(argc, argv);
         ::_exit(exitCode);
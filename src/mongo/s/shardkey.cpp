@@ -75,6 +75,27 @@ namespace mongo {
         return pattern.toString();
     }
 
+    bool ShardKeyPattern::isInFront(const BSONObj& obj) const {
+        bool movesKeys = false;
+        BSONForEach(e, pattern) {
+            if (strchr(e.fieldName(), '.') == NULL && strcmp(e.fieldName(), "_id") != 0)
+                movesKeys = true;
+        }
+        if (!movesKeys)
+            return true;
+
+        // in front means no key field comes after a field that isn't one
+        bool seenOther = false;
+        BSONForEach(e, obj) {
+            const bool isKey = strcmp(e.fieldName(), "_id") == 0 || pattern.hasField(e.fieldName());
+            if (!isKey)
+                seenOther = true;
+            else if (seenOther)
+                return false;
+        }
+        return true;
+    }
+
     BSONObj ShardKeyPattern::moveToFront(const BSONObj& obj) const {
         vector<const char*> keysToMove;
         keysToMove.push_back("_id");
@@ -97,6 +97,12 @@ namespace mongo {
          */
         BSONObj moveToFront(const BSONObj& obj) const;
 
+        /**
+         * @return true if moveToFront(obj) would give back obj as it is, so it can be sent on
+         * without being copied.
+         */
+        bool isInFront(const BSONObj& obj) const;
+
     private:
         BSONObj pattern;
         BSONObj gMin;
@@ -43,6 +43,17 @@ namespace mongo {
             verify( false );
         }
 
+        /**
+         * runs a writeBatch command on a sharded collection, sending each shard the statements
+         * which may touch its chunks, and merges the shards' outcomes into result
+         */
+        virtual void writeBatchOp( const string& db, const BSONObj& cmdObj, ChunkManagerPtr manager,
+                                   BSONObjBuilder& result )
+        {
+            // Only call this from sharded
+            verify( false );
+        }
+
         // These interfaces will merge soon, so make it easy to share logic
         friend class ShardStrategy;
         friend class SingleStrategy;
@@ -25,6 +25,7 @@
 #include "mongo/db/index.h"
 #include "mongo/s/client_info.h"
 #include "mongo/s/cursors.h"
+#include "mongo/s/grid.h"
 #include "mongo/s/request.h"
 #include "mongo/s/stats.h"
 #include "mongo/s/chunk.h"
@@ -54,6 +55,9 @@ namespace mongo {
 
             QuerySpec qSpec( (string)q.ns, q.query, q.fields, q.ntoskip, q.ntoreturn, q.queryOptions );
 
+            if ( ! qSpec.isExplain() && _queryOneShard( r , qSpec ) )
+                return;
+
             ParallelSortClusteredCursor * cursor = new ParallelSortClusteredCursor( qSpec, CommandInfo() );
             verify( cursor );
 
@@ -108,6 +112,44 @@ namespace mongo {
             }
         }
 
+        /**
+         * A query that can only match documents on one shard goes to that shard as it came, and
+         * the shard's reply goes back to the client as it came, rather than being parsed apart and
+         * copied through a ShardedClientCursor.  getMore and killCursors then find the shard by
+         * the cursor's ref in cursorCache, as for an unsharded collection.
+         * @return false if the query has to go through a ParallelSortClusteredCursor
+         */
+        bool _queryOneShard( Request& r , const QuerySpec& qSpec ) {
+            // the shard would keep sending batches; only the parallel cursor reads them
+            if ( qSpec.options() & QueryOption_Exhaust )
+                return false;
+
+            Shard shard;
+            ChunkManagerPtr manager = r.getChunkManager();
+            if ( manager ) {
+                set<Shard> shards;
+                manager->getShardsForQuery( shards , qSpec.filter() );
+                if ( shards.size() != 1 )
+                    return false;
+                shard = *shards.begin();
+            }
+            else {
+                shard = r.primaryShard();
+            }
+
+            try {
+                doQuery( r , shard );
+            }
+            catch ( StaleConfigException& e ) {
+                // nothing has gone to the client yet; the parallel cursor sorts out the new config
+                LOG(1) << "single shard query will be retried b/c of StaleConfigException, ns: "
+                       << r.getns() << causedBy( e ) << endl;
+                r.reset();
+                return false;
+            }
+            return true;
+        }
+
         virtual void commandOp( const string& db, const BSONObj& command, int options,
                                 const string& versionedNS, const BSONObj& filter,
                                 map<Shard,BSONObj>& results )
@@ -135,7 +177,8 @@ namespace mongo {
             // for now has same semantics as legacy request
             ChunkManagerPtr info = r.getChunkManager();
 
-            if( ! info ){
+            // a cursor we passed straight through from one shard, see _queryOneShard()
+            if( ! info || cursorCache.getRef( r.d().getInt64( 4 ) ).size() ){
                 SINGLE->getMore( r );
                 return;
             }
@@ -323,32 +366,66 @@ namespace mongo {
                 insertsRemaining.push_back( d.nextJsObj() );
             }
 
+            if ( _insertOneChunk( r, d, manager, insertsRemaining ) )
+                return;
+
             map<ChunkPtr, vector<BSONObj> > insertsForChunks; // Map for bulk inserts to diff chunks
 
             _insert( r, d, manager, insertsRemaining, insertsForChunks );
         }
 
-        void _update( Request& r , DbMessage& d, ChunkManagerPtr manager ) {
-            // const details of the request
-            const int flags = d.pullInt();
-            const BSONObj query = d.nextJsObj();
-            uassert( 10201 ,  "invalid update" , d.moreJSObjs() );
-            const BSONObj toupdate = d.nextJsObj();
-            const bool upsert = flags & UpdateOption_Upsert;
-            const bool multi = flags & UpdateOption_Multi;
+        /**
+         * When every document already has its shard key in front and they all go to one chunk,
+         * the insert message goes to that chunk's shard as it came, with only ContinueOnError
+         * turned on in its flags, instead of being rebuilt from copies of the documents.
+         * @return false if the inserts have to be grouped by chunk
+         */
+        bool _insertOneChunk( Request& r , DbMessage& d, ChunkManagerPtr manager, const vector<BSONObj>& inserts ) {
+            const ShardKeyPattern& sk = manager->getShardKey();
+            ChunkPtr c;
+            int bytesWritten = 0;
+            for( vector<BSONObj>::const_iterator i = inserts.begin(); i != inserts.end(); ++i ){
+                if ( ! sk.hasShardKey( *i ) || ! sk.isInFront( *i ) )
+                    return false;
+                ChunkPtr ci = manager->findChunk( *i );
+                if ( c && ci != c )
+                    return false;
+                c = ci;
+                bytesWritten += i->objsize();
+            }
+            if ( ! c )
+                return false;
 
-            uassert( 13506 ,  "$atomic not supported sharded" , !query.hasField("$atomic") );
+            d.reservedField() |= InsertOption_ContinueOnError; // always on when using sharding
 
-            // This are used for routing the request and are listed in order of priority
-            // If one is empty, go to next. If both are empty, send to all shards
-            BSONObj key; // the exact shard key
-            BSONObj chunkFinder; // a query listing
+            try {
+                // a stale version throws before anything is sent
+                doWrite( dbInsert , r , c->getShard() );
+            }
+            catch ( StaleConfigException& e ) {
+                LOG(1) << "single chunk insert will be retried b/c of StaleConfigException, ns: "
+                       << r.getns() << causedBy( e ) << endl;
+                return false;
+            }
+
+            for ( size_t i = 0; i < inserts.size(); i++ )
+                r.gotInsert();
+
+            if ( r.getClientInfo()->autoSplitOk() )
+                c->splitIfShould( bytesWritten );
+            return true;
+        }
+
+        /**
+         * checks that an update leaves the shard key alone.  @return the exact shard key it is
+         * routed by, or an empty object if it goes to every shard the query may match
+         */
+        BSONObj _updateKey( ChunkManagerPtr manager, const BSONObj& query, const BSONObj& toupdate, bool multi ) {
+            BSONObj key;
 
             const ShardKeyPattern& sk = manager->getShardKey();
 
             if (toupdate.firstElementFieldName()[0] == '$') { // $op style update
-                chunkFinder = query;
-
                 BSONForEach(op, toupdate){
                     // this block is all about validation
                     uassert(16064, "can't mix $operator style update with non-$op fields", op.fieldName()[0] == '$');
@@ -389,6 +466,22 @@ namespace mongo {
                 }
 
             }
+            return key;
+        }
+
+        void _update( Request& r , DbMessage& d, ChunkManagerPtr manager ) {
+            // const details of the request
+            const int flags = d.pullInt();
+            const BSONObj query = d.nextJsObj();
+            uassert( 10201 ,  "invalid update" , d.moreJSObjs() );
+            const BSONObj toupdate = d.nextJsObj();
+            const bool upsert = flags & UpdateOption_Upsert;
+            const bool multi = flags & UpdateOption_Multi;
+
+            uassert( 13506 ,  "$atomic not supported sharded" , !query.hasField("$atomic") );
+
+            const BSONObj key = _updateKey( manager, query, toupdate, multi );
+            const ShardKeyPattern& sk = manager->getShardKey();
 
             const int LEFT_START = 5;
             int left = LEFT_START;
@@ -483,6 +576,259 @@ namespace mongo {
             }
         }
 
+        /** what a write batch statement did, merged over the shards it was sent to */
+        struct WriteOutcome {
+            WriteOutcome() : n(0), updatedExisting(false), code(0) { }
+            long long n;
+            bool updatedExisting;
+            BSONObj upserted;
+            string err;
+            int code;
+            set<Shard> shards;   // where it has to go
+            set<Shard> done;     // where it has been applied
+            ChunkPtr chunk;      // set if it goes to exactly one chunk, for autosplitting
+        };
+
+        /** works out which shards a write batch statement goes to, noting an error if it can't */
+        void _routeStatement( ChunkManagerPtr manager, const BSONObj& statement, WriteOutcome& out ) {
+            out.shards.clear();
+            out.chunk.reset();
+            try {
+                BSONElement op = statement.firstElement();
+                uassert( 16354 , str::stream() << "write batch statements must be an insert, update or remove: " << statement ,
+                         op.type() == Object );
+                BSONObj arg = op.embeddedObject();
+                const ShardKeyPattern& sk = manager->getShardKey();
+
+                if ( str::equals( op.fieldName() , "insert" ) ) {
+                    uassert( 16355 , "tried to insert object with no valid shard key" , sk.hasShardKey( arg ) );
+                    out.chunk = manager->findChunk( sk.extractKey( arg ) );
+                    out.shards.insert( out.chunk->getShard() );
+                }
+                else if ( str::equals( op.fieldName() , "update" ) ) {
+                    BSONObj query = arg.getObjectField( "q" );
+                    uassert( 16356 , "$atomic not supported sharded" , !query.hasField( "$atomic" ) );
+                    BSONObj key = _updateKey( manager, query, arg.getObjectField( "u" ), arg["multi"].trueValue() );
+                    if ( key.isEmpty() ) {
+                        uassert( 16357 , "can't upsert something without full valid shard key" , !arg["upsert"].trueValue() );
+                        manager->getShardsForQuery( out.shards, query );
+                    }
+                    else {
+                        out.chunk = manager->findChunk( key );
+                        out.shards.insert( out.chunk->getShard() );
+                    }
+                }
+                else if ( str::equals( op.fieldName() , "remove" ) ) {
+                    BSONObj query = arg.getObjectField( "q" );
+                    uassert( 16358 , "$atomic not supported sharded" , !query.hasField( "$atomic" ) );
+                    manager->getShardsForQuery( out.shards, query );
+                    uassert( 16359 , "can only delete with a non-shard key pattern if can delete as many as we find" ,
+                             out.shards.size() == 1 || ! arg["justOne"].trueValue() || query.hasField( "_id" ) );
+                }
+                else {
+                    uasserted( 16360 , str::stream() << "write batch statements must be an insert, update or remove: " << statement );
+                }
+            }
+            catch ( DBException& e ) {
+                out.shards.clear();
+                out.err = e.what();
+                out.code = e.getCode();
+            }
+        }
+
+        /**
+         * applies statements [begin, end) on the shards they're routed to.  a shard that turns
+         * out to have a newer config than we do has done none of its part, so the chunks are
+         * reloaded and what it was sent is routed again.
+         */
+        void _writeBatchRound( const string& db, const string& ns, const vector<BSONObj>& statements,
+                               bool ordered, const BSONObj& writeConcern, size_t begin, size_t end,
+                               ChunkManagerPtr& manager, vector<WriteOutcome>& outcomes,
+                               BSONObjBuilder& writeConcerns ) {
+            const int LEFT_START = 5;
+            int left = LEFT_START;
+            while ( true ) {
+                map< Shard, vector<size_t> > byShard;
+                for ( size_t i = begin; i < end; i++ ) {
+                    WriteOutcome& out = outcomes[i];
+                    for ( set<Shard>::const_iterator s = out.shards.begin(); s != out.shards.end(); ++s ) {
+                        if ( out.err.empty() && ! out.done.count( *s ) )
+                            byShard[*s].push_back( i );
+                    }
+                }
+                if ( byShard.empty() )
+                    return;
+
+                vector<size_t> stale;
+                for ( map< Shard, vector<size_t> >::const_iterator s = byShard.begin(); s != byShard.end(); ++s ) {
+                    const vector<size_t>& mine = s->second;
+
+                    BSONObjBuilder cmd;
+                    cmd.append( "writeBatch" , ns.substr( db.size() + 1 ) );
+                    BSONArrayBuilder writes( cmd.subarrayStart( "writes" ) );
+                    for ( size_t k = 0; k < mine.size(); k++ )
+                        writes.append( statements[mine[k]] );
+                    writes.done();
+                    cmd.appendBool( "ordered" , ordered );
+                    if ( ! writeConcern.isEmpty() )
+                        cmd.append( "writeConcern" , writeConcern );
+
+                    BSONObj res;
+                    bool ok = false;
+                    try {
+                        ShardConnection conn( s->first , ns , manager );
+                        ok = conn->runCommand( db , cmd.obj() , res );
+                        conn.done();
+                    }
+                    catch ( StaleConfigException& e ) {
+                        LOG(1) << "write batch for " << ns << " on " << s->first.getName() << " hit stale config" << causedBy( e ) << endl;
+                        stale.insert( stale.end(), mine.begin(), mine.end() );
+                        continue;
+                    }
+
+                    if ( ! ok && res["code"].numberInt() == RecvStaleConfigCode ) {
+                        stale.insert( stale.end(), mine.begin(), mine.end() );
+                        continue;
+                    }
+
+                    if ( ! ok ) {
+                        for ( size_t k = 0; k < mine.size(); k++ ) {
+                            WriteOutcome& out = outcomes[mine[k]];
+                            out.err = res["errmsg"].str();
+                            out.code = res["code"].numberInt();
+                        }
+                        continue;
+                    }
+
+                    if ( res["writeConcern"].isABSONObj() )
+                        writeConcerns.append( s->first.getName() , res["writeConcern"].Obj() );
+
+                    // an ordered batch stops early, leaving the rest of its statements undone
+                    vector<BSONElement> got = res["results"].Array();
+                    for ( size_t k = 0; k < mine.size() && k < got.size(); k++ ) {
+                        WriteOutcome& out = outcomes[mine[k]];
+                        BSONObj r = got[k].Obj();
+                        out.done.insert( s->first );
+                        if ( r.hasField( "err" ) ) {
+                            if ( out.err.empty() ) {
+                                out.err = r["err"].str();
+                                out.code = r["code"].numberInt();
+                            }
+                            continue;
+                        }
+                        out.n += r["n"].numberLong();
+                        out.updatedExisting = out.updatedExisting || r["updatedExisting"].trueValue();
+                        if ( r.hasField( "upserted" ) )
+                            out.upserted = r["upserted"].wrap( "upserted" );
+                        if ( out.chunk ) {
+                            ClientInfo *client = ClientInfo::get();
+                            if ( client && client->autoSplitOk() )
+                                out.chunk->splitIfShould( statements[mine[k]].objsize() );
+                        }
+                    }
+                }
+
+                if ( stale.empty() )
+                    return;
+
+                if ( left <= 0 ) {
+                    for ( size_t k = 0; k < stale.size(); k++ ) {
+                        WriteOutcome& out = outcomes[stale[k]];
+                        if ( out.err.empty() ) {
+                            out.err = "sharding config info stayed stale";
+                            out.code = RecvStaleConfigCode;
+                        }
+                    }
+                    return;
+                }
+                log( left == LEFT_START ) << "write batch will be retried b/c sharding config info is stale, "
+                                          << " left:" << left - 1 << " ns: " << ns << endl;
+                left--;
+
+                manager = grid.getDBConfig( ns )->getChunkManager( ns , true );
+                uassert( 16361 , "collection no longer sharded" , manager );
+                for ( size_t k = 0; k < stale.size(); k++ ) {
+                    WriteOutcome& out = outcomes[stale[k]];
+                    if ( out.err.empty() ) {
+                        // whatever was already done on other shards stays done
+                        _routeStatement( manager, statements[stale[k]], out );
+                    }
+                }
+            }
+        }
+
+        virtual void writeBatchOp( const string& db, const BSONObj& cmdObj, ChunkManagerPtr manager,
+                                   BSONObjBuilder& result )
+        {
+            const string ns = db + "." + cmdObj.firstElement().valuestrsafe();
+            uassert( 16362 , "writes must be an array of statements" , cmdObj["writes"].type() == Array );
+            vector<BSONObj> statements;
+            BSONForEach( e, cmdObj["writes"].embeddedObject() ) {
+                uassert( 16363 , "write batch statements must be objects" , e.type() == Object );
+                statements.push_back( e.embeddedObject() );
+            }
+            const bool ordered = cmdObj["ordered"].eoo() || cmdObj["ordered"].trueValue();
+            const BSONObj writeConcern = cmdObj.getObjectField( "writeConcern" );
+
+            vector<WriteOutcome> outcomes( statements.size() );
+            for ( size_t i = 0; i < statements.size(); i++ )
+                _routeStatement( manager, statements[i], outcomes[i] );
+
+            // an unordered batch goes out in one round, one message per shard.  an ordered one
+            // goes out a run of statements for the same shard at a time, and stops at an error
+            BSONObjBuilder writeConcerns;
+            size_t reported = statements.size();
+            size_t begin = 0;
+            while ( begin < statements.size() ) {
+                size_t end = statements.size();
+                if ( ordered ) {
+                    end = begin + 1;
+                    if ( outcomes[begin].shards.size() == 1 ) {
+                        while ( end < statements.size() && outcomes[end].shards == outcomes[begin].shards )
+                            end++;
+                    }
+                }
+
+                _writeBatchRound( db, ns, statements, ordered, writeConcern, begin, end,
+                                  manager, outcomes, writeConcerns );
+
+                if ( ordered ) {
+                    size_t i = begin;
+                    while ( i < end && outcomes[i].err.empty() && ! outcomes[i].done.empty() )
+                        i++;
+                    if ( i < end ) {
+                        reported = outcomes[i].err.empty() ? i : i + 1;
+                        break;
+                    }
+                }
+                begin = end;
+            }
+
+            long long applied = 0;
+            BSONArrayBuilder results( result.subarrayStart( "results" ) );
+            for ( size_t i = 0; i < reported; i++ ) {
+                const WriteOutcome& out = outcomes[i];
+                BSONObjBuilder b( results.subobjStart() );
+                if ( ! out.err.empty() ) {
+                    b.append( "err" , out.err );
+                    b.append( "code" , out.code );
+                }
+                else {
+                    applied++;
+                    b.appendNumber( "n" , out.n );
+                    if ( str::equals( statements[i].firstElementFieldName() , "update" ) )
+                        b.appendBool( "updatedExisting" , out.updatedExisting );
+                    if ( ! out.upserted.isEmpty() )
+                        b.appendElements( out.upserted );
+                }
+                b.done();
+            }
+            results.done();
+            result.appendNumber( "applied" , applied );
+            if ( ! writeConcern.isEmpty() )
+                result.append( "writeConcern" , writeConcerns.obj() );
+        }
+
         virtual void writeOp( int op , Request& r ) {
 
             ChunkManagerPtr info;
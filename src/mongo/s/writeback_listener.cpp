@@ -18,6 +18,8 @@
 
 #include "pch.h"
 
+#include <boost/thread/thread.hpp>
+
 #include "../util/timer.h"
 
 #include "config.h"
@@ -39,6 +41,11 @@ namespace mongo {
     map<WriteBackListener::ConnectionIdent,WriteBackListener::WBStatus> WriteBackListener::_seenWritebacks;
     mongo::mutex WriteBackListener::_seenWritebacksLock("WriteBackListener::seen");
 
+    AtomicUInt64 WriteBackListener::_replayed;
+    AtomicUInt64 WriteBackListener::_batches;
+    AtomicInt64 WriteBackListener::_inFlight;
+    AtomicUInt64 WriteBackListener::_replayMillis;
+
     WriteBackListener::WriteBackListener( const string& addr ) : _addr( addr ) {
         _name = str::stream() << "WriteBackListener-" << addr;
         log() << "creating WriteBackListener for: " << addr << " serverID: " << serverID << endl;
@@ -111,6 +118,180 @@ namespace mongo {
         throw 1; // never gets here
     }
 
+    void WriteBackListener::_replay( const BSONObj& data ) {
+        Timer timer;
+
+        string ns = data["ns"].valuestrsafe();
+
+        ConnectionIdent cid( "" , 0 );
+        OID wid;
+        if ( data["connectionId"].isNumber() && data["id"].type() == jstOID ) {
+            string s = "";
+            if ( data["instanceIdent"].type() == String )
+                s = data["instanceIdent"].String();
+            cid = ConnectionIdent( s , data["connectionId"].numberLong() );
+            wid = data["id"].OID();
+        }
+        else {
+            warning() << "mongos/mongod version mismatch (1.7.5 is the split)" << endl;
+        }
+
+        int len; // not used, but needed for next call
+        Message msg( (void*)data["msg"].binData( len ) , false );
+        massert( 10427 ,  "invalid writeback message" , msg.header()->valid() );
+
+        DBConfigPtr db = grid.getDBConfig( ns );
+        ShardChunkVersion needVersion = ShardChunkVersion::fromBSON( data["version"] );
+
+        // TODO: The logic here could be refactored, but keeping to the original codepath for safety for now
+        ChunkManagerPtr manager = db->getChunkManagerIfExists( ns );
+
+        if ( ! manager ) {
+            // I don't trust the above code
+            // for this to be valid, we would have to have gotten a writeback because
+            // a collection was sharded
+            // and then for the collection to be dropped between the time the write hit mongod
+            // and the time it gets here
+            // possible - but I think there are more likely cases
+            // and in that case a little slowness isn't a horrible issue
+            manager = db->getChunkManagerIfExists( ns , true , true );
+            if ( manager ) {
+                warning() << "after reload, getChunkManagerIfExists works, this is inefficient, but should be" << endl;
+            }
+
+        }
+
+        LOG(1) << "connectionId: " << cid << " writebackId: " << wid << " needVersion : " << needVersion.toString()
+               << " mine : " << ( manager ? manager->getVersion().toString() : "(unknown)" )
+               << endl;
+
+        LOG(1) << msg.toString() << endl;
+
+        if ( needVersion.isSet() && manager && needVersion <= manager->getVersion() ) {
+            // this means when the write went originally, the version was old
+            // if we're here, it means we've already updated the config, so don't need to do again
+            //db->getChunkManager( ns , true ); // SERVER-1349
+        }
+        else {
+            // we received a writeback object that was sent to a previous version of a shard
+            // the actual shard may not have the object the writeback operation is for
+            // we need to reload the chunk manager and get the new shard versions
+            manager = db->getChunkManager( ns , true );
+        }
+
+        // do request and then call getLastError
+        // we have to call getLastError so we can return the right fields to the user if they decide to call getLastError
+
+        BSONObj gle;
+        int attempts = 0;
+        while ( true ) {
+            attempts++;
+
+            try {
+
+                Request r( msg , 0 );
+                r.init();
+
+                r.d().reservedField() |= DbMessage::Reserved_FromWriteback;
+
+                ClientInfo * ci = r.getClientInfo();
+                if (!noauth) {
+                    ci->getAuthenticationInfo()->authorize("admin", internalSecurity.user);
+                }
+                ci->noAutoSplit();
+
+                r.process();
+
+                ci->newRequest(); // this so we flip prev and cur shards
+
+                BSONObjBuilder b;
+                if ( ! ci->getLastError( BSON( "getLastError" << 1 ) , b , true ) ) {
+                    b.appendBool( "commandFailed" , true );
+                }
+                gle = b.obj();
+
+                if ( gle["code"].numberInt() == 9517 ) {
+                    log() << "writeback failed because of stale config, retrying attempts: " << attempts << endl;
+                    if( ! db->getChunkManagerIfExists( ns , true, attempts > 2 ) ){
+                        uassert( 15884, str::stream() << "Could not reload chunk manager after " << attempts << " attempts.", attempts <= 4 );
+                        sleepsecs( attempts - 1 );
+                    }
+                    continue;
+                }
+
+                ci->clearSinceLastGetError();
+            }
+            catch ( DBException& e ) {
+                error() << "error processing writeback: " << e << endl;
+                BSONObjBuilder b;
+                b.append( "err" , e.toString() );
+                e.getInfo().append( b );
+                gle = b.obj();
+            }
+
+            break;
+        }
+
+        {
+            scoped_lock lk( _seenWritebacksLock );
+            WBStatus& s = _seenWritebacks[cid];
+            s.id = wid;
+            s.gle = gle;
+        }
+
+        _replayed.fetchAndAdd( 1 );
+        _replayMillis.fetchAndAdd( timer.millis() );
+    }
+
+    void WriteBackListener::_replayAll( const vector<BSONObj>& ops ) {
+        for ( unsigned i = 0; i < ops.size(); i++ ) {
+            try {
+                _replay( ops[i] );
+            }
+            catch ( std::exception& e ) {
+                error() << "error replaying writeback: " << e.what() << endl;
+            }
+            _inFlight.fetchAndSubtract( 1 );
+        }
+    }
+
+    void WriteBackListener::_replayBatch( const vector<BSONObj>& batch ) {
+        // a client connection's writes must replay in order, and its getLastError waits for the
+        // last of them, but different connections' writes are independent
+        map< ConnectionIdent , vector<BSONObj> > byConnection;
+        for ( unsigned i = 0; i < batch.size(); i++ ) {
+            const BSONObj& data = batch[i];
+            ConnectionIdent cid( data["instanceIdent"].type() == String ? data["instanceIdent"].String() : "" ,
+                                 data["connectionId"].numberLong() );
+            byConnection[cid].push_back( data );
+        }
+
+        _batches.fetchAndAdd( 1 );
+        _inFlight.fetchAndAdd( batch.size() );
+
+        const unsigned nThreads = min( (unsigned) byConnection.size() , (unsigned) MaxReplayThreads );
+        vector< vector<BSONObj> > work( nThreads );
+        unsigned n = 0;
+        for ( map< ConnectionIdent , vector<BSONObj> >::iterator i = byConnection.begin(); i != byConnection.end(); ++i ) {
+            vector<BSONObj>& w = work[ n++ % nThreads ];
+            w.insert( w.end() , i->second.begin() , i->second.end() );
+        }
+
+        // the first share is replayed on the listener's own thread
+        boost::thread_group threads;
+        for ( unsigned i = 1; i < nThreads; i++ )
+            threads.create_thread( boost::bind( &WriteBackListener::_replayAll , boost::cref( work[i] ) ) );
+        _replayAll( work[0] );
+        threads.join_all();
+    }
+
+    void WriteBackListener::appendStats( BSONObjBuilder& b ) {
+        b.appendNumber( "replayed" , (long long) _replayed.load() );
+        b.appendNumber( "batches" , (long long) _batches.load() );
+        b.appendNumber( "inFlight" , _inFlight.load() );
+        b.appendNumber( "totalReplayMillis" , (long long) _replayMillis.load() );
+    }
+
     void WriteBackListener::run() {
         int secsToSleep = 0;
         while ( ! inShutdown() ) {
@@ -130,6 +311,7 @@ namespace mongo {
                 {
                     BSONObjBuilder cmd;
                     cmd.appendOID( "writebacklisten" , &serverID ); // Command will block for data
+                    cmd.append( "batchSize" , (int) BatchSize );
                     if ( ! conn->get()->runCommand( "admin" , cmd.obj() , result ) ) {
                         result = result.getOwned();
                         log() <<  "writebacklisten command failed!  "  << result << endl;
@@ -142,125 +324,26 @@ namespace mongo {
 
                 LOG(1) << "writebacklisten result: " << result << endl;
 
-                BSONObj data = result.getObjectField( "data" );
-                if ( data.getBoolField( "writeBack" ) ) {
-                    string ns = data["ns"].valuestrsafe();
-
-                    ConnectionIdent cid( "" , 0 );
-                    OID wid;
-                    if ( data["connectionId"].isNumber() && data["id"].type() == jstOID ) {
-                        string s = "";
-                        if ( data["instanceIdent"].type() == String )
-                            s = data["instanceIdent"].String();
-                        cid = ConnectionIdent( s , data["connectionId"].numberLong() );
-                        wid = data["id"].OID();
-                    }
-                    else {
-                        warning() << "mongos/mongod version mismatch (1.7.5 is the split)" << endl;
-                    }
-
-                    int len; // not used, but needed for next call
-                    Message msg( (void*)data["msg"].binData( len ) , false );
-                    massert( 10427 ,  "invalid writeback message" , msg.header()->valid() );
-
-                    DBConfigPtr db = grid.getDBConfig( ns );
-                    ShardChunkVersion needVersion = ShardChunkVersion::fromBSON( data["version"] );
-
-                    // TODO: The logic here could be refactored, but keeping to the original codepath for safety for now
-                    ChunkManagerPtr manager = db->getChunkManagerIfExists( ns );
-
-                    if ( ! manager ) {
-                        // I don't trust the above code
-                        // for this to be valid, we would have to have gotten a writeback because
-                        // a collection was sharded
-                        // and then for the collection to be dropped between the time the write hit mongod
-                        // and the time it gets here
-                        // possible - but I think there are more likely cases
-                        // and in that case a little slowness isn't a horrible issue
-                        manager = db->getChunkManagerIfExists( ns , true , true );
-                        if ( manager ) {
-                            warning() << "after reload, getChunkManagerIfExists works, this is inefficient, but should be" << endl;
-                        }
-
-                    }
-
-                    LOG(1) << "connectionId: " << cid << " writebackId: " << wid << " needVersion : " << needVersion.toString()
-                           << " mine : " << ( manager ? manager->getVersion().toString() : "(unknown)" )
-                           << endl;
-
-                    LOG(1) << msg.toString() << endl;
-
-                    if ( needVersion.isSet() && manager && needVersion <= manager->getVersion() ) {
-                        // this means when the write went originally, the version was old
-                        // if we're here, it means we've already updated the config, so don't need to do again
-                        //db->getChunkManager( ns , true ); // SERVER-1349
-                    }
-                    else {
-                        // we received a writeback object that was sent to a previous version of a shard
-                        // the actual shard may not have the object the writeback operation is for
-                        // we need to reload the chunk manager and get the new shard versions
-                        manager = db->getChunkManager( ns , true );
-                    }
+                vector<BSONObj> batch;
+                BSONElement b = result["batch"];
+                if ( b.type() == Array ) {
+                    BSONForEach( e , b.embeddedObject() )
+                        batch.push_back( e.Obj() );
+                }
+                else if ( result["data"].isABSONObj() ) {
+                    batch.push_back( result["data"].Obj() );
+                }
 
-                    // do request and then call getLastError
-                    // we have to call getLastError so we can return the right fields to the user if they decide to call getLastError
-
-                    BSONObj gle;
-                    int attempts = 0;
-                    while ( true ) {
-                        attempts++;
-
-                        try {
-
-                            Request r( msg , 0 );
-                            r.init();
-
-                            r.d().reservedField() |= DbMessage::Reserved_FromWriteback;
-
-                            ClientInfo * ci = r.getClientInfo();
-                            if (!noauth) {
-                                ci->getAuthenticationInfo()->authorize("admin", internalSecurity.user);
-                            }
-                            ci->noAutoSplit();
-
-                            r.process();
-
-                            ci->newRequest(); // this so we flip prev and cur shards
-
-                            BSONObjBuilder b;
-                            if ( ! ci->getLastError( BSON( "getLastError" << 1 ) , b , true ) ) {
-                                b.appendBool( "commandFailed" , true );
-                            }
-                            gle = b.obj();
-
-                            if ( gle["code"].numberInt() == 9517 ) {
-                                log() << "writeback failed because of stale config, retrying attempts: " << attempts << endl;
-                                if( ! db->getChunkManagerIfExists( ns , true, attempts > 2 ) ){
-                                    uassert( 15884, str::stream() << "Could not reload chunk manager after " << attempts << " attempts.", attempts <= 4 );
-                                    sleepsecs( attempts - 1 );
-                                }
-                                continue;
-                            }
-
-                            ci->clearSinceLastGetError();
-                        }
-                        catch ( DBException& e ) {
-                            error() << "error processing writeback: " << e << endl;
-                            BSONObjBuilder b;
-                            b.append( "err" , e.toString() );
-                            e.getInfo().append( b );
-                            gle = b.obj();
-                        }
-
-                        break;
-                    }
+                vector<BSONObj> writeBacks;
+                for ( unsigned i = 0; i < batch.size(); i++ ) {
+                    if ( batch[i].getBoolField( "writeBack" ) )
+                        writeBacks.push_back( batch[i] );
+                    else
+                        log() << "unknown writeBack result: " << batch[i] << endl;
+                }
 
-                    {
-                        scoped_lock lk( _seenWritebacksLock );
-                        WBStatus& s = _seenWritebacks[cid];
-                        s.id = wid;
-                        s.gle = gle;
-                    }
+                if ( ! writeBacks.empty() ) {
+                    _replayBatch( writeBacks );
                 }
                 else if ( result["noop"].trueValue() ) {
                     // no-op
@@ -21,6 +21,7 @@
 #include "../pch.h"
 
 #include "../client/connpool.h"
+#include "../platform/atomic_word.h"
 #include "../util/background.h"
 #include "../db/client.h"
 
@@ -61,6 +62,9 @@ namespace mongo {
 
         static BSONObj waitFor( const ConnectionIdent& ident, const OID& oid );
 
+        /** counts of writebacks replayed by all listeners, for serverStatus */
+        static void appendStats( BSONObjBuilder& b );
+
     protected:
         WriteBackListener( const string& addr );
 
@@ -68,6 +72,18 @@ namespace mongo {
         void run();
 
     private:
+        // writebacks asked for from a shard at once, and the most threads replaying them
+        enum { BatchSize = 100, MaxReplayThreads = 8 };
+
+        /** replays one writeback and records its getLastError for waitFor() */
+        static void _replay( const BSONObj& data );
+
+        /** replays in order, logging and moving past any which fail */
+        static void _replayAll( const vector<BSONObj>& ops );
+
+        /** replays a batch, each client connection's writebacks on one thread, in order */
+        static void _replayBatch( const vector<BSONObj>& batch );
+
         string _addr;
         string _name;
 
@@ -82,6 +98,11 @@ namespace mongo {
 
         static mongo::mutex _seenWritebacksLock;  // protects _seenWritbacks
         static map<ConnectionIdent,WBStatus> _seenWritebacks; // connectionId -> last write back GLE
+
+        static AtomicUInt64 _replayed;
+        static AtomicUInt64 _batches;
+        static AtomicInt64 _inFlight;      // fetched from a shard but not yet replayed
+        static AtomicUInt64 _replayMillis;
     };
 
     void waitForWriteback( const OID& oid );
@@ -64,11 +64,39 @@ namespace mongo {
     void BenchRunEventCounter::reset() {
         _numEvents = 0;
         _totalTimeMicros = 0;
+        _maxTimeMicros = 0;
+        memset(_buckets, 0, sizeof(_buckets));
     }
 
     void BenchRunEventCounter::updateFrom(const BenchRunEventCounter &other) {
         _numEvents += other._numEvents;
         _totalTimeMicros += other._totalTimeMicros;
+        _maxTimeMicros = std::max(_maxTimeMicros, other._maxTimeMicros);
+        for (unsigned i = 0; i < NumBuckets; ++i)
+            _buckets[i] += other._buckets[i];
+    }
+
+    unsigned long long BenchRunEventCounter::bucketUpperBound(unsigned bucket) {
+        if (bucket < SubBuckets)
+            return bucket;
+        unsigned shift = bucket / SubBuckets - 1;
+        unsigned long long sub = bucket % SubBuckets;
+        return ((SubBuckets + sub + 1) << shift) - 1;
+    }
+
+    unsigned long long BenchRunEventCounter::percentileMicros(double p) const {
+        if (_numEvents == 0)
+            return 0;
+        unsigned long long target = static_cast<unsigned long long>(ceil(p * _numEvents));
+        if (target == 0)
+            target = 1;
+        unsigned long long seen = 0;
+        for (unsigned i = 0; i < NumBuckets; ++i) {
+            seen += _buckets[i];
+            if (seen >= target)
+                return std::min(bucketUpperBound(i), _maxTimeMicros);
+        }
+        return _maxTimeMicros;
     }
 
     BenchRunStats::BenchRunStats() {
@@ -115,8 +143,12 @@ namespace mongo {
         username = "";
         password = "";
 
+        hosts.clear();
+
         parallel = 1;
         seconds = 1;
+        opsPerSecond = 0;
+        randomSeed = 0;
         hideResults = true;
         handleErrors = false;
         hideErrors = false;
@@ -143,6 +175,12 @@ namespace mongo {
 
         if ( args["host"].type() == String )
             this->host = args["host"].String();
+        if ( args["hosts"].type() == Array ) {
+            BSONForEach( h, args["hosts"].Obj() ) {
+                uassert( 16390, "benchRun hosts must be strings", h.type() == String );
+                this->hosts.push_back( h.String() );
+            }
+        }
         if ( args["db"].type() == String )
             this->db = args["db"].String();
         if ( args["username"].type() == String )
@@ -154,6 +192,10 @@ namespace mongo {
             this->parallel = args["parallel"].numberInt();
         if ( args["seconds"].isNumber() )
             this->seconds = args["seconds"].number();
+        if ( args["opsPerSecond"].isNumber() )
+            this->opsPerSecond = args["opsPerSecond"].number();
+        if ( args["randomSeed"].isNumber() )
+            this->randomSeed = args["randomSeed"].numberLong();
         if ( ! args["hideResults"].eoo() )
             this->hideResults = args["hideResults"].trueValue();
         if ( ! args["handleErrors"].eoo() )
@@ -194,9 +236,19 @@ namespace mongo {
         this->ops = args["ops"].Obj().getOwned();
     }
 
+    std::vector<std::string> BenchRunConfig::targets() const {
+        if ( hosts.empty() )
+            return std::vector<std::string>( 1, host );
+        return hosts;
+    }
+
     DBClientBase *BenchRunConfig::createConnection() const {
+        return createConnection( host );
+    }
+
+    DBClientBase *BenchRunConfig::createConnection( const std::string &target ) const {
         std::string errorMessage;
-        ConnectionString connectionString = ConnectionString::parse( host, errorMessage  );
+        ConnectionString connectionString = ConnectionString::parse( target, errorMessage  );
         uassert( 16157, errorMessage, connectionString.isValid() );
         DBClientBase *connection = connectionString.connect(errorMessage);
         uassert( 16158, errorMessage, connection != NULL );
@@ -285,66 +337,24 @@ namespace mongo {
         return false;
     }
 
-    static void _fixField( BSONObjBuilder& b , const BSONElement& e ) {
-        verify( e.type() == Object );
-
-        BSONObj sub = e.Obj();
-        verify( sub.nFields() == 1 );
-
-        BSONElement f = sub.firstElement();
-        if ( str::equals( "#RAND_INT" , f.fieldName() ) ) {
-            BSONObjIterator i( f.Obj() );
-            int min = i.next().numberInt();
-            int max = i.next().numberInt();
-
-            int x = min + ( rand() % ( max - min ) );
-
-            if ( i.more() )
-                x *= i.next().numberInt();
-
-            b.append( e.fieldName() , x );
-        }
-        else {
-            uasserted( 14811 , str::stream() << "invalid bench dynamic piece: " << f.fieldName() );
-        }
-
-    }
-
-    static void fixQuery( BSONObjBuilder& b  , const BSONObj& obj ) {
-        BSONObjIterator i( obj );
-        while ( i.more() ) {
-            BSONElement e = i.next();
-
-            if ( ! e.isABSONObj() ) {
-                b.append( e );
-                continue;
-            }
-
-            BSONObj sub = e.Obj();
-            if ( sub.firstElement().fieldName()[0] == '#' ) {
-                _fixField( b , e );
-            }
-            else {
-                BSONObjBuilder xx( e.type() == Object ? b.subobjStart( e.fieldName() ) : b.subarrayStart( e.fieldName() ) );
-                fixQuery( xx , sub );
-                xx.done();
-            }
-
-        }
-    }
-
-    static BSONObj fixQuery( const BSONObj& obj ) {
+    BSONObj BenchRunWorker::fixQuery( const BSONObj& obj ) {
 
         if ( ! _hasSpecial( obj ) ) 
             return obj;
 
         BSONObjBuilder b( obj.objsize() + 128 );
-        fixQuery( b , obj );
+        BsonTemplateEvaluator::Status st = _evaluator.evaluate( obj , b );
+        uassert( 14811 , str::stream() << "invalid bench dynamic piece in " << obj ,
+                 st == BsonTemplateEvaluator::StatusSuccess );
         return b.obj();
     }
 
-    BenchRunWorker::BenchRunWorker(const BenchRunConfig *config, BenchRunState *brState)
-        : _config(config), _brState(brState) {
+    BenchRunWorker::BenchRunWorker(const BenchRunConfig *config, BenchRunState *brState, unsigned index)
+        : _config(config), _brState(brState), _index(index) {
+        if ( _config->randomSeed )
+            _evaluator.setSeed( _config->randomSeed + index );
+        // each thread takes its own share of every #SEQ_INT sequence
+        _evaluator.setStream( index , std::max( _config->parallel , 1U ) );
     }
 
     BenchRunWorker::~BenchRunWorker() {}
@@ -362,6 +372,12 @@ namespace mongo {
         long long count = 0;
         mongo::Timer timer;
 
+        // with a target rate, when this thread's next op is due
+        unsigned long long opIntervalMicros = 0;
+        if ( _config->opsPerSecond > 0 )
+            opIntervalMicros = static_cast<unsigned long long>( 1000000.0 * _config->parallel / _config->opsPerSecond );
+        unsigned long long nextOpMicros = 0;
+
         while ( !shouldStop() ) {
             BSONObjIterator i( _config->ops );
             while ( i.more() ) {
@@ -370,6 +386,16 @@ namespace mongo {
 
                 BSONElement e = i.next();
 
+                unsigned long long lag = 0;
+                if ( opIntervalMicros ) {
+                    unsigned long long now = timer.micros();
+                    if ( nextOpMicros > now )
+                        sleepmicros( nextOpMicros - now );
+                    else
+                        lag = now - nextOpMicros;
+                    nextOpMicros += opIntervalMicros;
+                }
+
                 string ns = e["ns"].String();
                 string op = e["op"].String();
 
@@ -416,7 +442,7 @@ namespace mongo {
 
                         BSONObj result;
                         {
-                            BenchRunEventTrace _bret(&_stats.findOneCounter);
+                            BenchRunEventTrace _bret(&_stats.findOneCounter, lag);
                             result = conn->findOne( ns , fixQuery( e["query"].Obj() ) );
                         }
 
@@ -466,7 +492,7 @@ namespace mongo {
                         auto_ptr<DBClientCursor> cursor;
 
                         {
-                            BenchRunEventTrace _bret(&_stats.queryCounter);
+                            BenchRunEventTrace _bret(&_stats.queryCounter, lag);
                             cursor = conn->query( ns, fixQuery( e["query"].Obj() ), limit, skip, &filter, options, batchSize );
                         }
 
@@ -502,8 +528,8 @@ namespace mongo {
                         bool safe = e["safe"].trueValue();
 
                         {
-                            BenchRunEventTrace _bret(&_stats.updateCounter);
-                            conn->update( ns, fixQuery( query ), update, upsert , multi );
+                            BenchRunEventTrace _bret(&_stats.updateCounter, lag);
+                            conn->update( ns, fixQuery( query ), fixQuery( update ), upsert , multi );
                             if (safe)
                                 result = conn->getLastErrorDetailed();
                         }
@@ -531,7 +557,7 @@ namespace mongo {
                         bool safe = e["safe"].trueValue();
                         BSONObj result;
                         {
-                            BenchRunEventTrace _bret(&_stats.insertCounter);
+                            BenchRunEventTrace _bret(&_stats.insertCounter, lag);
                             conn->insert( ns, fixQuery( e["doc"].Obj() ) );
                             if (safe)
                                 result = conn->getLastErrorDetailed();
@@ -564,7 +590,7 @@ namespace mongo {
                         BSONObj result;
 
                         {
-                            BenchRunEventTrace _bret(&_stats.deleteCounter);
+                            BenchRunEventTrace _bret(&_stats.deleteCounter, lag);
                             conn->remove( ns, fixQuery( query ), ! multi );
                             if (safe)
                                 result = conn->getLastErrorDetailed();
@@ -665,7 +691,8 @@ namespace mongo {
     void BenchRunWorker::run() {
         BenchRunWorkerStateGuard _workerStateGuard( _brState );
 
-        boost::scoped_ptr<DBClientBase> conn( _config->createConnection() );
+        std::vector<std::string> targets = _config->targets();
+        boost::scoped_ptr<DBClientBase> conn( _config->createConnection( targets[_index % targets.size()] ) );
 
         try {
             if ( !_config->username.empty() ) {
@@ -701,19 +728,41 @@ namespace mongo {
              delete _workers[i];
      }
 
-     void BenchRunner::start( ) {
+     /**
+      * The opcounters of every target host added up, as { opcounters : { ... } }.  Only that
+      * section of serverStatus is asked for.
+      */
+     static BSONObj totalOpcounters( const BenchRunConfig &config ) {
+         std::map<std::string, long long> totals;
+         std::vector<std::string> targets = config.targets();
+         for ( size_t i = 0; i < targets.size(); i++ ) {
+             boost::scoped_ptr<DBClientBase> conn( config.createConnection( targets[i] ) );
+             BSONObj status;
+             conn->runCommand( "admin",
+                               BSON( "serverStatus" << 1 << "sections" << BSON_ARRAY( "opcounters" ) ),
+                               status );
+             if ( status["opcounters"].type() != Object )
+                 continue;
+             BSONForEach( e, status["opcounters"].Obj() )
+                 totals[e.fieldName()] += e.numberLong();
+         }
 
+         BSONObjBuilder b;
+         BSONObjBuilder opcounters( b.subobjStart( "opcounters" ) );
+         for ( std::map<std::string, long long>::const_iterator i = totals.begin(); i != totals.end(); ++i )
+             opcounters.appendNumber( i->first, i->second );
+         opcounters.done();
+         return b.obj();
+     }
 
-         {
-             boost::scoped_ptr<DBClientBase> conn( _config->createConnection() );
-             // Get initial stats
-             conn->simpleCommand( "admin" , &before , "serverStatus" );
-             before = before.getOwned();
-         }
+     void BenchRunner::start( ) {
+
+         // Get initial stats
+         before = totalOpcounters( *_config );
 
          // Start threads
          for ( unsigned i = 0; i < _config->parallel; i++ ) {
-             BenchRunWorker *worker = new BenchRunWorker(_config.get(), &_brState);
+             BenchRunWorker *worker = new BenchRunWorker(_config.get(), &_brState, i);
              worker->start();
              _workers.push_back(worker);
          }
@@ -725,12 +774,8 @@ namespace mongo {
          _brState.tellWorkersToFinish();
          _brState.waitForState(BenchRunState::BRS_FINISHED);
 
-         {
-             boost::scoped_ptr<DBClientBase> conn( _config->createConnection() );
-             // Get final stats
-             conn->simpleCommand( "admin" , &after , "serverStatus" );
-             after = after.getOwned();
-         }
+         // Get final stats
+         after = totalOpcounters( *_config );
 
          {
              boost::mutex::scoped_lock lk(_staticMutex);
@@ -774,6 +819,19 @@ namespace mongo {
                         static_cast<double>(counter.getTotalTimeMicros()) / counter.getNumEvents());
      }
 
+     static void appendPercentilesIfAvailable(
+             BSONObjBuilder &buf, const std::string &name, const BenchRunEventCounter &counter) {
+
+         if (counter.getNumEvents() == 0)
+             return;
+         BSONObjBuilder b(buf.subobjStart(name));
+         b.appendNumber("p50", static_cast<long long>(counter.percentileMicros(0.5)));
+         b.appendNumber("p99", static_cast<long long>(counter.percentileMicros(0.99)));
+         b.appendNumber("p999", static_cast<long long>(counter.percentileMicros(0.999)));
+         b.appendNumber("max", static_cast<long long>(counter.getMaxTimeMicros()));
+         b.done();
+     }
+
      BSONObj BenchRunner::finish( BenchRunner* runner ) {
 
          runner->stop();
@@ -800,6 +858,11 @@ namespace mongo {
          appendAverageMsIfAvailable(buf, "deleteLatencyAverageMs", stats.deleteCounter);
          appendAverageMsIfAvailable(buf, "updateLatencyAverageMs", stats.updateCounter);
          appendAverageMsIfAvailable(buf, "queryLatencyAverageMs", stats.queryCounter);
+         appendPercentilesIfAvailable(buf, "findOneLatencyMicros", stats.findOneCounter);
+         appendPercentilesIfAvailable(buf, "insertLatencyMicros", stats.insertCounter);
+         appendPercentilesIfAvailable(buf, "deleteLatencyMicros", stats.deleteCounter);
+         appendPercentilesIfAvailable(buf, "updateLatencyMicros", stats.updateCounter);
+         appendPercentilesIfAvailable(buf, "queryLatencyMicros", stats.queryCounter);
 
          {
              BSONObjIterator i( after );
@@ -17,6 +17,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include <boost/shared_ptr.hpp>
 #include <boost/thread/condition.hpp>
@@ -26,6 +27,7 @@
 #include "mongo/bson/util/atomic_int.h"
 #include "mongo/client/dbclientinterface.h"
 #include "mongo/db/jsobj.h"
+#include "mongo/scripting/bson_template_evaluator.h"
 #include "mongo/util/timer.h"
 
 namespace mongo {
@@ -51,11 +53,26 @@ namespace mongo {
         // Create a new connection to the mongo instance specified by this configuration.
         DBClientBase *createConnection() const;
 
+        // Create a new connection to one of the instances specified by this configuration.
+        DBClientBase *createConnection( const std::string &target ) const;
+
+        /**
+         * The connection strings the workers are spread over: "hosts" if it was given, round
+         * robin, otherwise "host" alone.
+         */
+        std::vector<std::string> targets() const;
+
         /**
          * Connection string describing the host to which to connect.
          */
         std::string host;
 
+        /**
+         * Optional connection strings, such as the members of a replica set or several mongos,
+         * which the parallel threads are spread over instead of connecting to "host".
+         */
+        std::vector<std::string> hosts;
+
         /**
          * Name of the database on which to operate.
          */
@@ -85,6 +102,21 @@ namespace mongo {
          */
         double seconds;
 
+        /**
+         * Optional target rate of operations, over all threads.  When set, each thread starts
+         * its operations on a fixed schedule instead of as soon as the previous one returns, and
+         * an operation's latency is counted from when it was due, so a stall shows up in every
+         * operation it held back.  0 runs flat out.
+         */
+        double opsPerSecond;
+
+        /**
+         * Seed for the templates (#RAND_INT, #ZIPF, ...) in the operations.  Thread i uses
+         * randomSeed + i, so a run with the same seed and parallelism generates the same
+         * values.  0 seeds each thread from the clock.
+         */
+        long long randomSeed;
+
         bool hideResults;
         bool handleErrors;
         bool hideErrors;
@@ -116,7 +148,9 @@ namespace mongo {
     };
 
     /**
-     * An event counter for events that have an associated duration.
+     * An event counter for events that have an associated duration, which also keeps a histogram
+     * of the durations.  The histogram has 16 linear buckets for each power of two, so a
+     * percentile read from it is within about 6% of the true value.
      *
      * Not thread safe.  Expected use is one instance per thread during parallel execution.
      */
@@ -142,8 +176,22 @@ namespace mongo {
         void countOne(unsigned long long timeMicros) {
             ++_numEvents;
             _totalTimeMicros += timeMicros;
+            ++_buckets[bucketFor(timeMicros)];
+            if (timeMicros > _maxTimeMicros)
+                _maxTimeMicros = timeMicros;
         }
 
+        /**
+         * Get the upper bound of the histogram bucket holding the fraction "p" of the events, or 0
+         * if there were none.
+         */
+        unsigned long long percentileMicros(double p) const;
+
+        /**
+         * Get the duration of the longest event.
+         */
+        unsigned long long getMaxTimeMicros() const { return _maxTimeMicros; }
+
         /**
          * Get the total number of microseconds ellapsed during all observed events.
          */
@@ -155,8 +203,23 @@ namespace mongo {
         unsigned long long getNumEvents() const { return _numEvents; }
 
     private:
+        enum { SubBuckets = 16, NumBuckets = SubBuckets * 61 };
+
+        static unsigned bucketFor(unsigned long long micros) {
+            if (micros < SubBuckets)
+                return static_cast<unsigned>(micros);
+            unsigned shift = 0;
+            while ((micros >> shift) >= 2 * SubBuckets)
+                ++shift;
+            return SubBuckets * (shift + 1) + static_cast<unsigned>((micros >> shift) - SubBuckets);
+        }
+
+        static unsigned long long bucketUpperBound(unsigned bucket);
+
         unsigned long long _numEvents;
         unsigned long long _totalTimeMicros;
+        unsigned long long _maxTimeMicros;
+        unsigned long long _buckets[NumBuckets];
     };
 
     /**
@@ -174,18 +237,25 @@ namespace mongo {
      */
     class BenchRunEventTrace : private boost::noncopyable {
     public:
-        explicit BenchRunEventTrace(BenchRunEventCounter *eventCounter) {
+        /**
+         * "lagMicros" is added to the event's duration: how long it was held back past when it
+         * was due to start.
+         */
+        explicit BenchRunEventTrace(BenchRunEventCounter *eventCounter,
+                                    unsigned long long lagMicros=0) {
             initialize(eventCounter, eventCounter, false);
+            _lagMicros = lagMicros;
         }
 
         BenchRunEventTrace(BenchRunEventCounter *successCounter,
                            BenchRunEventCounter *failCounter,
                            bool defaultToFailure=true) {
             initialize(successCounter, failCounter, defaultToFailure);
+            _lagMicros = 0;
         }
 
         ~BenchRunEventTrace() {
-            (_succeeded ? _successCounter : _failCounter)->countOne(_timer.micros());
+            (_succeeded ? _successCounter : _failCounter)->countOne(_timer.micros() + _lagMicros);
         }
 
         void succeed() { _succeeded = true; }
@@ -204,6 +274,7 @@ namespace mongo {
         BenchRunEventCounter *_successCounter;
         BenchRunEventCounter *_failCounter;
         bool _succeeded;
+        unsigned long long _lagMicros;
     };
 
     /**
@@ -304,9 +375,10 @@ namespace mongo {
         /**
          * Create a new worker, performing one thread's worth of the activity described in
          * "config", and part of the larger activity with state "brState".  Both "config"
-         * and "brState" must exist for the life of this object.
+         * and "brState" must exist for the life of this object.  "index" numbers the worker
+         * among the others, and picks its target host.
          */
-        BenchRunWorker(const BenchRunConfig *config, BenchRunState *brState);
+        BenchRunWorker(const BenchRunConfig *config, BenchRunState *brState, unsigned index);
         ~BenchRunWorker();
 
         /**
@@ -332,9 +404,14 @@ namespace mongo {
         /// Predicate, used to decide whether or not it's time to terminate the worker.
         bool shouldStop() const;
 
+        /// Evaluates the templates in "obj", if it has any.
+        BSONObj fixQuery( const BSONObj& obj );
+
         const BenchRunConfig *_config;
         BenchRunState *_brState;
+        unsigned _index;
         BenchRunStats _stats;
+        BsonTemplateEvaluator _evaluator;
     };
 
     /**
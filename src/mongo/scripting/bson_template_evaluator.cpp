@@ -18,7 +18,11 @@
 
 #include "mongo/scripting/bson_template_evaluator.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstdlib>
+#include <ctime>
+#include <limits>
 
 #include "mongo/util/map_util.h"
 
@@ -26,10 +30,21 @@ namespace mongo {
 
     void BsonTemplateEvaluator::initializeEvaluator() {
         addOperator("RAND_INT", &BsonTemplateEvaluator::evalRandInt);
+        addOperator("RAND_STRING", &BsonTemplateEvaluator::evalRandString);
+        addOperator("OID", &BsonTemplateEvaluator::evalObjectId);
+        addOperator("ZIPF", &BsonTemplateEvaluator::evalZipf);
+        addOperator("HOTSPOT", &BsonTemplateEvaluator::evalHotspot);
+        addOperator("SEQ_INT", &BsonTemplateEvaluator::evalSeqInt);
+        addOperator("LATEST", &BsonTemplateEvaluator::evalLatest);
     }
 
-    BsonTemplateEvaluator::BsonTemplateEvaluator() {
+    BsonTemplateEvaluator::BsonTemplateEvaluator() : _streamIndex(0), _numStreams(1) {
         initializeEvaluator();
+        setSeed(static_cast<unsigned long long>(time(0)) ^
+                reinterpret_cast<size_t>(this));
+    }
+
+    BsonTemplateEvaluator::~BsonTemplateEvaluator() {
     }
 
     void BsonTemplateEvaluator::addOperator(const std::string& name, const OperatorFn& op) {
@@ -41,6 +56,113 @@ namespace mongo {
         return mapFindWithDefault(_operatorFunctions, op, OperatorFn());
     }
 
+    void BsonTemplateEvaluator::setSeed(unsigned long long seed) {
+        // splitmix64, so that nearby seeds (one per worker) start far apart
+        unsigned long long z = seed + 0x9E3779B97F4A7C15ULL;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        z ^= z >> 31;
+        _randomState = z ? z : 1; // xorshift never leaves 0
+    }
+
+    void BsonTemplateEvaluator::setStream(unsigned index, unsigned numStreams) {
+        verify(numStreams > 0 && index < numStreams);
+        _streamIndex = index;
+        _numStreams = numStreams;
+    }
+
+    unsigned long long BsonTemplateEvaluator::nextRandom() {
+        // xorshift64*
+        _randomState ^= _randomState >> 12;
+        _randomState ^= _randomState << 25;
+        _randomState ^= _randomState >> 27;
+        return _randomState * 2685821657736338717ULL;
+    }
+
+    double BsonTemplateEvaluator::nextDouble() {
+        return (nextRandom() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    BsonTemplateEvaluator::Zipfian::Zipfian(double theta) :
+        _theta(theta),
+        _zeta2(1.0 + pow(0.5, theta)),
+        _n(0),
+        _zetaN(0),
+        _eta(0) {
+    }
+
+    void BsonTemplateEvaluator::Zipfian::setN(long long n) {
+        if (n < _n) {
+            _n = 0;
+            _zetaN = 0;
+        }
+        for (long long i = _n + 1; i <= n; i++)
+            _zetaN += 1.0 / pow(static_cast<double>(i), _theta);
+        _n = n;
+        // with n <= 2 next() never gets as far as eta
+        _eta = n > 2 ? (1.0 - pow(2.0 / n, 1.0 - _theta)) / (1.0 - _zeta2 / _zetaN) : 0;
+    }
+
+    long long BsonTemplateEvaluator::Zipfian::next(double u) const {
+        double uz = u * _zetaN;
+        if (uz < 1.0)
+            return 0;
+        if (uz < _zeta2)
+            return 1;
+        long long v = static_cast<long long>(_n * pow(_eta * u - _eta + 1.0,
+                                                      1.0 / (1.0 - _theta)));
+        return std::min(v, _n - 1);
+    }
+
+    BsonTemplateEvaluator::Zipfian& BsonTemplateEvaluator::_zipfian(long long n, double theta) {
+        std::pair<long long, double> key(n, theta);
+        std::map< std::pair<long long, double>, Zipfian >::iterator i = _zipfians.find(key);
+        if (i == _zipfians.end()) {
+            i = _zipfians.insert(std::make_pair(key, Zipfian(theta))).first;
+            i->second.setN(n);
+        }
+        return i->second;
+    }
+
+    BsonTemplateEvaluator::Sequence& BsonTemplateEvaluator::_sequence(long long start,
+                                                                      long long step) {
+        return _sequences[std::make_pair(start, step)];
+    }
+
+    long long BsonTemplateEvaluator::_sequenceValue(long long start, long long step,
+                                                    long long k) const {
+        return start + step * (k * _numStreams + _streamIndex);
+    }
+
+    namespace {
+        // appends v as an int when it fits, as the shell's numbers would be
+        void appendInteger(BSONObjBuilder& out, const char* fieldName, long long v) {
+            if (v >= std::numeric_limits<int>::min() && v <= std::numeric_limits<int>::max())
+                out.append(fieldName, static_cast<int>(v));
+            else
+                out.append(fieldName, v);
+        }
+
+        // the array of arguments in { #OP: [ ... ] }, with at least minArgs numbers
+        bool numberArgs(const BSONObj& in, int minArgs, BSONObj* args) {
+            BSONElement e = in.firstElement();
+            if (e.type() != Array)
+                return false;
+            *args = e.embeddedObject();
+            BSONForEach(arg, *args) {
+                if (!arg.isNumber())
+                    return false;
+            }
+            return args->nFields() >= minArgs;
+        }
+
+        // theta for a zipfian distribution, from args[i] if present
+        bool zipfTheta(const BSONObj& args, int i, double* theta) {
+            *theta = args.nFields() > i ? args[i].numberDouble() : 0.99;
+            return *theta > 0 && *theta < 1;
+        }
+    }
+
     /* This is the top level method for using this library. It takes a BSON Object as input,
      * evaluates the templates and saves the result in the builder object.
      * The method returns appropriate Status on success/error condition.
@@ -57,14 +179,22 @@ namespace mongo {
 
     BsonTemplateEvaluator::Status BsonTemplateEvaluator::_evalElem(BSONElement in,
                                                                    BSONObjBuilder& out) {
-       if (in.type() != Object) {
+       if (in.type() != Object && in.type() != Array) {
            out.append(in);
            return StatusSuccess;
        }
        BSONObj subObj = in.embeddedObject();
        const char* opOrNot = subObj.firstElementFieldName();
-       if (opOrNot[0] != '#') {
-           out.append(in);
+       if (in.type() == Array || opOrNot[0] != '#') {
+           // not a template itself, but there may be some inside
+           BSONObjBuilder sub(in.type() == Array ? out.subarrayStart(in.fieldName())
+                                                 : out.subobjStart(in.fieldName()));
+           BSONForEach(e, subObj) {
+               Status st = _evalElem(e, sub);
+               if (st != StatusSuccess)
+                   return st;
+           }
+           sub.done();
            return StatusSuccess;
        }
        const char* op = opOrNot+1;
@@ -89,7 +219,8 @@ namespace mongo {
         const int max  = range["1"].numberInt();
         if (max <= min)
             return StatusOpEvaluationError;
-        int randomNum = min + (rand() % (max - min));
+        int randomNum = min + static_cast<int>(btl->nextRandom() %
+                                               static_cast<unsigned long long>(max - min));
         if (range.nFields() == 3) {
             if (!range[2].isNumber())
                 return StatusOpEvaluationError;
@@ -99,4 +230,117 @@ namespace mongo {
         return StatusSuccess;
     }
 
+    BsonTemplateEvaluator::Status BsonTemplateEvaluator::evalRandString(BsonTemplateEvaluator* btl,
+                                                                        const char* fieldName,
+                                                                        const BSONObj in,
+                                                                        BSONObjBuilder& out) {
+        // in = { #RAND_STRING: [8] }
+        static const char chars[] =
+            "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+        BSONObj args;
+        if (!numberArgs(in, 1, &args))
+            return StatusOpEvaluationError;
+        const int length = args[0].numberInt();
+        if (length < 0 || length > BSONObjMaxUserSize)
+            return StatusOpEvaluationError;
+        std::string s(length, ' ');
+        for (int i = 0; i < length; i++)
+            s[i] = chars[btl->nextRandom() % (sizeof(chars) - 1)];
+        out.append(fieldName, s);
+        return StatusSuccess;
+    }
+
+    BsonTemplateEvaluator::Status BsonTemplateEvaluator::evalObjectId(BsonTemplateEvaluator* btl,
+                                                                      const char* fieldName,
+                                                                      const BSONObj in,
+                                                                      BSONObjBuilder& out) {
+        // in = { #OID: 1 }
+        OID oid;
+        oid.init();
+        out.append(fieldName, oid);
+        return StatusSuccess;
+    }
+
+    BsonTemplateEvaluator::Status BsonTemplateEvaluator::evalZipf(BsonTemplateEvaluator* btl,
+                                                                  const char* fieldName,
+                                                                  const BSONObj in,
+                                                                  BSONObjBuilder& out) {
+        // in = { #ZIPF: [1000000, 0.99] }
+        BSONObj args;
+        double theta;
+        if (!numberArgs(in, 1, &args) || !zipfTheta(args, 1, &theta))
+            return StatusOpEvaluationError;
+        const long long n = args[0].numberLong();
+        if (n <= 0)
+            return StatusOpEvaluationError;
+        appendInteger(out, fieldName, btl->_zipfian(n, theta).next(btl->nextDouble()));
+        return StatusSuccess;
+    }
+
+    BsonTemplateEvaluator::Status BsonTemplateEvaluator::evalHotspot(BsonTemplateEvaluator* btl,
+                                                                     const char* fieldName,
+                                                                     const BSONObj in,
+                                                                     BSONObjBuilder& out) {
+        // in = { #HOTSPOT: [1000000, 0.1, 0.9] }
+        BSONObj args;
+        if (!numberArgs(in, 3, &args))
+            return StatusOpEvaluationError;
+        const long long n = args[0].numberLong();
+        const double hotSet = args[1].numberDouble();
+        const double hotOps = args[2].numberDouble();
+        if (n <= 0 || hotSet < 0 || hotSet > 1 || hotOps < 0 || hotOps > 1)
+            return StatusOpEvaluationError;
+        const long long hotN = static_cast<long long>(n * hotSet);
+        long long v;
+        if (hotN == n || (hotN > 0 && btl->nextDouble() < hotOps))
+            v = btl->nextRandom() % hotN;
+        else
+            v = hotN + btl->nextRandom() % (n - hotN);
+        appendInteger(out, fieldName, v);
+        return StatusSuccess;
+    }
+
+    BsonTemplateEvaluator::Status BsonTemplateEvaluator::evalSeqInt(BsonTemplateEvaluator* btl,
+                                                                    const char* fieldName,
+                                                                    const BSONObj in,
+                                                                    BSONObjBuilder& out) {
+        // in = { #SEQ_INT: [0, 1] }
+        BSONObj args;
+        if (!numberArgs(in, 2, &args))
+            return StatusOpEvaluationError;
+        const long long start = args[0].numberLong();
+        const long long step = args[1].numberLong();
+        if (step == 0)
+            return StatusOpEvaluationError;
+        Sequence& seq = btl->_sequence(start, step);
+        appendInteger(out, fieldName, btl->_sequenceValue(start, step, seq.count++));
+        return StatusSuccess;
+    }
+
+    BsonTemplateEvaluator::Status BsonTemplateEvaluator::evalLatest(BsonTemplateEvaluator* btl,
+                                                                    const char* fieldName,
+                                                                    const BSONObj in,
+                                                                    BSONObjBuilder& out) {
+        // in = { #LATEST: [0, 1, 1000, 0.99] }
+        BSONObj args;
+        double theta;
+        if (!numberArgs(in, 3, &args) || !zipfTheta(args, 3, &theta))
+            return StatusOpEvaluationError;
+        const long long start = args[0].numberLong();
+        const long long step = args[1].numberLong();
+        const long long window = args[2].numberLong();
+        if (step == 0 || window <= 0)
+            return StatusOpEvaluationError;
+        Sequence& seq = btl->_sequence(start, step);
+        long long k = 0; // before the sequence has begun, its first value
+        if (seq.count > 0) {
+            if (seq.latest.theta() != theta)
+                seq.latest = Zipfian(theta);
+            seq.latest.setN(std::min(window, seq.count));
+            k = seq.count - 1 - seq.latest.next(btl->nextDouble());
+        }
+        appendInteger(out, fieldName, btl->_sequenceValue(start, step, k));
+        return StatusSuccess;
+    }
+
 } // end namespace mongo
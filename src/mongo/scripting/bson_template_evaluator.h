@@ -18,8 +18,8 @@
 
 /*
  * This library supports a templating language that helps in generating BSON documents from a
- * template. The language supports the following template:
- * #RAND_INT #LITERAL, #CONCAT, #RAND_STRING.
+ * template. The language supports the following templates:
+ * #RAND_INT, #RAND_STRING, #OID, #ZIPF, #HOTSPOT, #SEQ_INT and #LATEST.
  *
  * The language will help in quickly expressing richer documents  for use in benchRun.
  * Ex. : { key : { #RAND_INT: [10, 20] } } or  { key : { #CONCAT: ["hello", " ", "world"] } }
@@ -28,13 +28,32 @@
  * { key : { #CONCAT: [{ #RAND_INT: [10, 20] }, " ", "world"] } }
  *
  * This library DOES NOT support combining or nesting the templates in an arbitrary fashion.
- * eg. { key : { #RAND_INT: [{ #RAND_INT: [10, 15] }, 20] } } is not supported.
+ * eg. { key : { #RAND_INT: [{ #RAND_INT: [10, 15] }, 20] } } is not supported.  Templates may
+ * appear anywhere inside ordinary subobjects and arrays, though:
+ * { $set : { a : [ { #RAND_STRING: [8] }, 1 ] } }
  *
+ * The distributions, with n the number of keys:
+ *   { #RAND_INT: [min, max, multiplier?] }  uniform in [min, max)
+ *   { #RAND_STRING: [len] }                 len random alphanumeric characters
+ *   { #OID: 1 }                             a new ObjectId
+ *   { #ZIPF: [n, theta?] }                  zipfian in [0, n); 0 is the most frequent and theta,
+ *                                           0.99 by default, is the skew, between 0 and 1
+ *   { #HOTSPOT: [n, hotSet, hotOps] }       the fraction hotOps of values fall uniformly in the
+ *                                           first hotSet fraction of [0, n), the rest uniformly
+ *                                           in the remainder
+ *   { #SEQ_INT: [start, step] }             start, start + step, ... (see setStream)
+ *   { #LATEST: [start, step, window, theta?] }  a recent value of the #SEQ_INT with the same
+ *                                           start and step, zipfian over the last window values
+ *                                           with the newest the most frequent
+ *
+ * Random values come from a generator private to each evaluator, so a run is repeatable given
+ * the same seeds; see setSeed().
  */
 #pragma once
 
 #include <map>
 #include <string>
+#include <utility>
 
 #include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
@@ -110,6 +129,25 @@ namespace mongo {
          */
         Status evaluate(const BSONObj& src, BSONObjBuilder& builder);
 
+        /*
+         * Restarts this evaluator's random numbers from "seed".  Without a call, the seed comes
+         * from the clock.
+         */
+        void setSeed(unsigned long long seed);
+
+        /*
+         * Makes #SEQ_INT and #LATEST take only every "numStreams"th value of each sequence,
+         * starting with the "index"th, so evaluators used in parallel (one per benchRun worker)
+         * never generate the same value.
+         */
+        void setStream(unsigned index, unsigned numStreams);
+
+        /* @return 64 uniformly random bits */
+        unsigned long long nextRandom();
+
+        /* @return a uniformly random double in [0, 1) */
+        double nextDouble();
+
     private:
         void initializeEvaluator();
         // map that holds operators along with their respective function pointers
@@ -119,9 +157,57 @@ namespace mongo {
         // evaluates a BSON element. This is internally called by the top level evaluate method.
         Status _evalElem(BSONElement in, BSONObjBuilder& out);
 
+        /*
+         * Zipfian values in [0, n), generated as in Gray et al., "Quickly Generating Billion-Record
+         * Synthetic Databases".  zeta(n) takes O(n) to compute, so generators are kept, and one
+         * whose n grows (for #LATEST) only adds the new terms.
+         */
+        class Zipfian {
+        public:
+            Zipfian(double theta);
+            void setN(long long n);
+            long long next(double u) const;
+            double theta() const { return _theta; }
+        private:
+            double _theta;
+            double _zeta2;
+            long long _n;
+            double _zetaN;
+            double _eta;
+        };
+
+        // a #SEQ_INT sequence, by start and step
+        struct Sequence {
+            Sequence() : count(0), latest(0.99) {}
+            long long count; // values taken so far by this evaluator
+            Zipfian latest;  // of the offsets back from the newest value, for #LATEST
+        };
+
+        Zipfian& _zipfian(long long n, double theta);
+        Sequence& _sequence(long long start, long long step);
+        long long _sequenceValue(long long start, long long step, long long k) const;
+
+        unsigned long long _randomState;
+        unsigned _streamIndex;
+        unsigned _numStreams;
+        std::map< std::pair<long long, double>, Zipfian > _zipfians;
+        std::map< std::pair<long long, long long>, Sequence > _sequences;
+
         // operator methods
         static Status evalRandInt(BsonTemplateEvaluator* btl, const char* fieldName,
                                   const BSONObj in, BSONObjBuilder& out);
+        static Status evalRandString(BsonTemplateEvaluator* btl, const char* fieldName,
+                                     const BSONObj in, BSONObjBuilder& out);
+        static Status evalObjectId(BsonTemplateEvaluator* btl, const char* fieldName,
+                                   const BSONObj in, BSONObjBuilder& out);
+        static Status evalZipf(BsonTemplateEvaluator* btl, const char* fieldName,
+                               const BSONObj in, BSONObjBuilder& out);
+        static Status evalHotspot(BsonTemplateEvaluator* btl, const char* fieldName,
+                                  const BSONObj in, BSONObjBuilder& out);
+        static Status evalSeqInt(BsonTemplateEvaluator* btl, const char* fieldName,
+                                 const BSONObj in, BSONObjBuilder& out);
+        static Status evalLatest(BsonTemplateEvaluator* btl, const char* fieldName,
+                                 const BSONObj in, BSONObjBuilder& out);
 
     };
 
@@ -162,5 +162,122 @@ namespace mongo {
             ASSERT_GREATER_THAN_OR_EQUALS(obj12.firstElement().numberInt(), 0);
             ASSERT_LESS_THAN_OR_EQUALS(obj12.firstElement().numberInt(), 16);
         }
+
+        TEST(BSONTemplateEvaluatorTest, RAND_STRING) {
+            BsonTemplateEvaluator t;
+
+            BSONObjBuilder builder1;
+            ASSERT_EQUALS( BsonTemplateEvaluator::StatusOpEvaluationError,
+                           t.evaluate(BSON("s" << BSON("#RAND_STRING" << BSON_ARRAY("x"))),
+                                      builder1) );
+
+            BSONObjBuilder builder2;
+            ASSERT_EQUALS( BsonTemplateEvaluator::StatusSuccess,
+                           t.evaluate(BSON("s" << BSON("#RAND_STRING" << BSON_ARRAY(12))),
+                                      builder2) );
+            BSONObj obj2 = builder2.obj();
+            ASSERT_EQUALS(obj2.firstElement().type(), String);
+            string s = obj2.firstElement().String();
+            ASSERT_EQUALS(s.size(), 12U);
+            for (size_t i = 0; i < s.size(); i++)
+                ASSERT(isalnum(s[i]));
+        }
+
+        TEST(BSONTemplateEvaluatorTest, OID) {
+            BsonTemplateEvaluator t;
+            BSONObjBuilder builder;
+            ASSERT_EQUALS( BsonTemplateEvaluator::StatusSuccess,
+                           t.evaluate(BSON("_id" << BSON("#OID" << 1) << "_id2" <<
+                                           BSON("#OID" << 1)), builder) );
+            BSONObj obj = builder.obj();
+            ASSERT_EQUALS(obj["_id"].type(), jstOID);
+            ASSERT_NOT_EQUALS(obj["_id"].OID(), obj["_id2"].OID());
+        }
+
+        TEST(BSONTemplateEvaluatorTest, ZIPF) {
+            BsonTemplateEvaluator t;
+
+            BSONObjBuilder builder1;
+            ASSERT_EQUALS( BsonTemplateEvaluator::StatusOpEvaluationError,
+                           t.evaluate(BSON("k" << BSON("#ZIPF" << BSON_ARRAY(100 << 1.5))),
+                                      builder1) );
+
+            // the lowest values are far the most frequent
+            int counts[100] = { 0 };
+            BSONObj templ = BSON("k" << BSON("#ZIPF" << BSON_ARRAY(100)));
+            for (int i = 0; i < 10000; i++) {
+                BSONObjBuilder builder;
+                ASSERT_EQUALS( BsonTemplateEvaluator::StatusSuccess,
+                               t.evaluate(templ, builder) );
+                int k = builder.obj().firstElement().numberInt();
+                ASSERT_GREATER_THAN_OR_EQUALS(k, 0);
+                ASSERT_LESS_THAN(k, 100);
+                counts[k]++;
+            }
+            ASSERT_GREATER_THAN(counts[0], counts[10]);
+            ASSERT_GREATER_THAN(counts[0] + counts[1] + counts[2], 10000 / 4);
+        }
+
+        TEST(BSONTemplateEvaluatorTest, HOTSPOT) {
+            BsonTemplateEvaluator t;
+            BSONObj templ = BSON("k" << BSON("#HOTSPOT" << BSON_ARRAY(1000 << 0.1 << 0.9)));
+            int hot = 0;
+            for (int i = 0; i < 10000; i++) {
+                BSONObjBuilder builder;
+                ASSERT_EQUALS( BsonTemplateEvaluator::StatusSuccess,
+                               t.evaluate(templ, builder) );
+                int k = builder.obj().firstElement().numberInt();
+                ASSERT_GREATER_THAN_OR_EQUALS(k, 0);
+                ASSERT_LESS_THAN(k, 1000);
+                if (k < 100)
+                    hot++;
+            }
+            ASSERT_GREATER_THAN(hot, 8500);
+            ASSERT_LESS_THAN(hot, 9500);
+        }
+
+        TEST(BSONTemplateEvaluatorTest, SEQ_INT_LATEST) {
+            // two streams interleave, so between them take every value once
+            BsonTemplateEvaluator t0, t1;
+            t0.setStream(0, 2);
+            t1.setStream(1, 2);
+            BSONObj seq = BSON("k" << BSON("#SEQ_INT" << BSON_ARRAY(10 << 5)));
+            for (int i = 0; i < 4; i++) {
+                BSONObjBuilder builder0, builder1;
+                ASSERT_EQUALS( BsonTemplateEvaluator::StatusSuccess, t0.evaluate(seq, builder0) );
+                ASSERT_EQUALS( BsonTemplateEvaluator::StatusSuccess, t1.evaluate(seq, builder1) );
+                ASSERT_EQUALS(builder0.obj().firstElement().numberInt(), 10 + 5 * 2 * i);
+                ASSERT_EQUALS(builder1.obj().firstElement().numberInt(), 10 + 5 * (2 * i + 1));
+            }
+
+            // #LATEST reads back what this stream's #SEQ_INT generated, within the window
+            BSONObj latest = BSON("k" << BSON("#LATEST" << BSON_ARRAY(10 << 5 << 2)));
+            for (int i = 0; i < 100; i++) {
+                BSONObjBuilder builder;
+                ASSERT_EQUALS( BsonTemplateEvaluator::StatusSuccess,
+                               t0.evaluate(latest, builder) );
+                int k = builder.obj().firstElement().numberInt();
+                ASSERT(k == 10 + 5 * 4 || k == 10 + 5 * 6);
+            }
+        }
+
+        TEST(BSONTemplateEvaluatorTest, SeedAndNesting) {
+            BsonTemplateEvaluator t1, t2;
+            t1.setSeed(42);
+            t2.setSeed(42);
+            BSONObj templ = BSON("$set" << BSON("a" << BSON_ARRAY(
+                                     BSON("#RAND_STRING" << BSON_ARRAY(8)) <<
+                                     BSON("#ZIPF" << BSON_ARRAY(1000)) << 7)));
+            BSONObjBuilder builder1, builder2;
+            ASSERT_EQUALS( BsonTemplateEvaluator::StatusSuccess, t1.evaluate(templ, builder1) );
+            ASSERT_EQUALS( BsonTemplateEvaluator::StatusSuccess, t2.evaluate(templ, builder2) );
+            BSONObj obj1 = builder1.obj();
+            ASSERT_EQUALS(obj1, builder2.obj());
+
+            BSONObj a = obj1["$set"]["a"].Obj();
+            ASSERT_EQUALS(a[0].type(), String);
+            ASSERT(a[1].isNumber());
+            ASSERT_EQUALS(a[2].numberInt(), 7);
+        }
     } // end anonymous namespace
 } // end namespace mongo
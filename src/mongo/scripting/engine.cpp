@@ -266,6 +266,10 @@ namespace mongo {
 
     typedef map< string , list<Scope*> > PoolToScopes;
 
+    // idle scopes kept per pool for other threads once a connection is done with them
+    // (setParameter jsPooledScopesPerDb)
+    int jsPooledScopesPerDb = 4;
+
     class ScopeCache {
     public:
 
@@ -304,6 +308,27 @@ namespace mongo {
             }
         }
 
+        /** keeps s, which has already been reset, unless pool has maxIdle idle scopes */
+        void keep( const string& pool , Scope * s , unsigned maxIdle ) {
+            scoped_lock lk( _mutex );
+            list<Scope*> & l = _pools[pool];
+            if ( l.size() >= maxIdle ) {
+                delete s;
+                return;
+            }
+            l.push_back( s );
+        }
+
+        /** hands all idle scopes to 'to', which keeps up to maxIdle of them per pool */
+        void moveTo( ScopeCache& to , unsigned maxIdle ) {
+            scoped_lock lk( _mutex );
+            for ( PoolToScopes::iterator i=_pools.begin() ; i != _pools.end(); i++ ) {
+                for ( list<Scope*>::iterator j=i->second.begin(); j != i->second.end(); j++ )
+                    to.keep( i->first , *j , maxIdle );
+            }
+            _pools.clear();
+        }
+
         Scope * get( const string& pool ) {
             scoped_lock lk( _mutex );
             list<Scope*> & l = _pools[pool];
@@ -340,6 +365,10 @@ namespace mongo {
 
     thread_specific_ptr<ScopeCache> scopeCache;
 
+    // scopes already set up for a db, which outlive the connection that used them, so that
+    // the next connection's first $where or map/reduce doesn't have to start from scratch
+    static ScopeCache sharedScopes;
+
     class PooledScope : public Scope {
     public:
         PooledScope( const string pool , Scope * real ) : _pool( pool ) , _real( real ) {
@@ -471,6 +500,9 @@ namespace mongo {
         }
 
         Scope * s = scopeCache->get( pool );
+        if ( ! s ) {
+            s = sharedScopes.get( pool );
+        }
         if ( ! s ) {
             s = newScope();
         }
@@ -483,7 +515,7 @@ namespace mongo {
     void ScriptEngine::threadDone() {
         ScopeCache * sc = scopeCache.get();
         if ( sc ) {
-            sc->clear();
+            sc->moveTo( sharedScopes , jsPooledScopesPerDb );
         }
     }
 
@@ -179,7 +179,10 @@ namespace mongo {
          * @return the scope */
         auto_ptr<Scope> getPooledScope( const string& pool );
 
-        /** call this method to release some JS resources when a thread is done */
+        /**
+         * call this method to release some JS resources when a thread is done.
+         * up to jsPooledScopesPerDb idle scopes per pool are kept for other threads
+         */
         void threadDone();
 
         void setScopeInitCallback( void ( *func )( Scope & ) ) { _scopeInitCallback = func; }
@@ -1657,7 +1657,9 @@ namespace mongo {
 
         void setFunction( const char *field , const char * code ) {
             smlock;
-            jsval v = OBJECT_TO_JSVAL(JS_GetFunctionObject(_convertor->compileFunction(code)));
+            // compiled once per scope, like any other function
+            JSFunction * f = reinterpret_cast<JSFunction*>( createFunction( code ) );
+            jsval v = OBJECT_TO_JSVAL(JS_GetFunctionObject(f));
             JS_SetProperty( _context , _global , field , &v );
         }
 
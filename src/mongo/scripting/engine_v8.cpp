@@ -102,26 +102,37 @@ namespace mongo {
           return Handle<Value>();
       Local< External > scp = External::Cast( *info.Data() );
       V8Scope* scope = (V8Scope*)(scp->Value());
-      Handle<v8::Value> val = scope->mongoToV8Element(elmt, false);
+      Handle<v8::Value> val = scope->lazyElement(elmt, false, *holder);
       info.This()->ForceSet(name, val, DontEnum);
 
-      if (elmt.type() == mongo::Object || elmt.type() == mongo::Array) {
-          // if accessing a subobject, it may get modified and base obj would not know
-          // have to set base as modified, which means some optim is lost
-          unwrapHolder(info.Holder())->_modified = true;
+      if (elmt.type() == mongo::Object) {
+          // a subobject may get modified without the base obj knowing; v8ToMongo checks it
+          holder->_fetched.push_back( key );
+      }
+      else if (elmt.type() == mongo::Array) {
+          // arrays aren't lazy, so there is no telling if they get modified; the base obj
+          // has to be taken as modified, which means some optim is lost
+          holder->_modified = true;
       }
       return val;
     }
 
     static Handle<v8::Value> namedGetRO(Local<v8::String> name, const v8::AccessorInfo &info) {
+      if ( info.This()->HasRealNamedProperty( name ) ) {
+          // value already cached
+          return info.This()->GetRealNamedProperty(name);
+      }
+
       string key = toSTLString(name);
-      BSONObj obj = unwrapBSONObj(info.Holder());
-      BSONElement elmt = obj.getField(key.c_str());
+      BSONHolder* holder = unwrapHolder(info.Holder());
+      BSONElement elmt = holder->_obj.getField(key.c_str());
       if (elmt.eoo())
           return Handle<Value>();
       Local< External > scp = External::Cast( *info.Data() );
       V8Scope* scope = (V8Scope*)(scp->Value());
-      Handle<v8::Value> val = scope->mongoToV8Element(elmt, true);
+      Handle<v8::Value> val = scope->lazyElement(elmt, true, *holder);
+      // so that the field is only decoded once, and is the same object each time
+      info.This()->ForceSet(name, val, PropertyAttribute(ReadOnly | DontEnum | DontDelete));
       return val;
     }
 
@@ -204,13 +215,15 @@ namespace mongo {
         BSONElement elmt = obj.getField(key);
         if (elmt.eoo())
             return Handle<Value>();
-        Handle<Value> val = scope->mongoToV8Element(elmt, false);
+        Handle<Value> val = scope->lazyElement(elmt, false, *holder);
         info.This()->ForceSet(name, val, DontEnum);
 
-        if (elmt.type() == mongo::Object || elmt.type() == mongo::Array) {
-            // if accessing a subobject, it may get modified and base obj would not know
-            // have to set base as modified, which means some optim is lost
-            unwrapHolder(info.Holder())->_modified = true;
+        if (elmt.type() == mongo::Object) {
+            // see namedGet
+            holder->_fetched.push_back( key );
+        }
+        else if (elmt.type() == mongo::Array) {
+            holder->_modified = true;
         }
         return val;
     }
@@ -243,11 +256,11 @@ namespace mongo {
 //            if (!val.IsEmpty() && !val->IsNull())
 //                return val;
 //        }
-        BSONObj obj = unwrapBSONObj(info.Holder());
-        BSONElement elmt = obj.getField(key);
+        BSONHolder* holder = unwrapHolder(info.Holder());
+        BSONElement elmt = holder->_obj.getField(key);
         if (elmt.eoo())
             return Handle<Value>();
-        Handle<Value> val = scope->mongoToV8Element(elmt, true);
+        Handle<Value> val = scope->lazyElement(elmt, true, *holder);
 //        info.This()->ForceSet(name, val);
         return val;
     }
@@ -757,8 +770,13 @@ namespace mongo {
     }
 
     void V8Scope::setFunction( const char *field , const char * code ) {
+        // compiled once per scope, like any other function
+        ScriptingFunction f = createFunction( code );
         V8_SIMPLE_HEADER
-        _global->Set( getV8Str( field ) , __createFunction(code) );
+        if ( f )
+            _global->Set( getV8Str( field ) , _funcs[f-1] );
+        else
+            _global->Set( getV8Str( field ) , v8::Undefined() );
     }
 
 //    void V8Scope::setThis( const BSONObj * obj ) {
@@ -1236,8 +1254,22 @@ namespace mongo {
      * converts a BSONObj to a Lazy V8 object
      */
     Handle<v8::Object> V8Scope::mongoToLZV8( const BSONObj& m , bool array, bool readOnly ) {
+        return _newLazyObject( new BSONHolder( m ) , array , readOnly );
+    }
+
+    Handle<v8::Object> V8Scope::mongoToLZV8( const BSONObj& m , bool readOnly , const BSONHolder& owner ) {
+        return _newLazyObject( new BSONHolder( m , owner.owner() ) , false , readOnly );
+    }
+
+    Handle<v8::Value> V8Scope::lazyElement( const BSONElement &f , bool readOnly , const BSONHolder& owner ) {
+        if ( f.type() == mongo::Object )
+            return mongoToLZV8( f.embeddedObject() , readOnly , owner );
+        return mongoToV8Element( f , readOnly );
+    }
+
+    Handle<v8::Object> V8Scope::_newLazyObject( BSONHolder* own , bool array , bool readOnly ) {
+        const BSONObj& m = own->_obj;
         Local<v8::Object> o;
-        BSONHolder* own = new BSONHolder(m);
 
         if ( readOnly ) {
             o = roObjectTemplate->NewInstance();
@@ -1564,12 +1596,29 @@ namespace mongo {
         cout << "don't know how to convert to mongo field [" << sname << "]\t" << value << endl;
     }
 
+    /**
+     * whether a lazy object, or any lazy subobject handed out by it, has been modified
+     */
+    static bool lazyObjectModified( const Handle<v8::Object>& o , const Handle<v8::String>& bsonStr ) {
+        BSONHolder* holder = unwrapHolder(o);
+        if ( holder->_modified )
+            return true;
+        for ( list<string>::const_iterator i = holder->_fetched.begin(); i != holder->_fetched.end(); ++i ) {
+            // a replaced or deleted field marks the holder, so this is the subobject handed out
+            Handle<v8::Value> v = o->Get( v8::String::New( i->c_str() ) );
+            if ( !v->IsObject() || !v->ToObject()->Has( bsonStr ) )
+                return true;
+            if ( lazyObjectModified( v->ToObject() , bsonStr ) )
+                return true;
+        }
+        return false;
+    }
+
     BSONObj V8Scope::v8ToMongo( v8::Handle<v8::Object> o , int depth ) {
         BSONObj originalBSON;
         if (o->Has(V8STR_BSON)) {
             originalBSON = unwrapBSONObj(o);
-            BSONHolder* holder = unwrapHolder(o);
-            if ( !holder->_modified ) {
+            if ( !lazyObjectModified( o , V8STR_BSON ) ) {
                 // object was not modified, use bson as is
                 return originalBSON;
             }
@@ -80,13 +80,23 @@ namespace mongo {
             _modified = false;
         }
 
+        /** for a subobject of owner, which is owned: shares its buffer rather than copying */
+        BSONHolder( BSONObj obj , BSONObj owner ) : _obj( obj ), _owner( owner ) {
+            _modified = false;
+        }
+
         ~BSONHolder() {
         }
 
+        /** the owned object _obj lies in */
+        const BSONObj& owner() const { return _owner.isEmpty() ? _obj : _owner; }
+
         BSONObj _obj;
+        BSONObj _owner; // empty when _obj is owned
         bool _modified;
         list<string> _extra;
         set<string> _removed;
+        list<string> _fetched; // subobjects handed out, which may have been changed since
 
     };
 
@@ -143,6 +153,10 @@ namespace mongo {
 
         v8::Local<v8::Object> mongoToV8( const mongo::BSONObj & m , bool array = 0 , bool readOnly = false );
         v8::Handle<v8::Object> mongoToLZV8( const mongo::BSONObj & m , bool array = 0 , bool readOnly = false );
+        /** a lazy object for a subobject of owner's, sharing its buffer */
+        v8::Handle<v8::Object> mongoToLZV8( const mongo::BSONObj & m , bool readOnly , const BSONHolder& owner );
+        /** converts a field of a lazy object, leaving objects lazy and sharing owner's buffer */
+        v8::Handle<v8::Value> lazyElement( const BSONElement &f , bool readOnly , const BSONHolder& owner );
         mongo::BSONObj v8ToMongo( v8::Handle<v8::Object> o , int depth = 0 );
 
         void v8ToMongoElement( BSONObjBuilder & b , const string sname , v8::Handle<v8::Value> value , int depth = 0, BSONObj* originalParent=0 );
@@ -197,6 +211,9 @@ namespace mongo {
     private:
         void _startCall();
 
+        /** wraps own, which the object then owns, in a lazy object */
+        v8::Handle<v8::Object> _newLazyObject( BSONHolder* own , bool array , bool readOnly );
+
         static Handle< Value > nativeCallback( V8Scope* scope, const Arguments &args );
         static v8::Handle< v8::Value > v8Callback( const v8::Arguments &args );
         static Handle< Value > load( V8Scope* scope, const Arguments &args );
@@ -400,6 +400,46 @@ namespace mongo {
         return JS_TRUE;
     }
 
+    /** a cursor a command returned, such as aggregate's: 0 - namespace, 1 - cursor id, 2 - batch size */
+    JSBool mongo_cursor_from_id(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval) {
+        try {
+            smuassert( cx , "cursorFromId needs 2 or 3 args" , argc == 2 || argc == 3 );
+            shared_ptr< DBClientWithCommands > * connHolder = (shared_ptr< DBClientWithCommands >*)JS_GetPrivate( cx , obj );
+            smuassert( cx ,  "no connection!" , connHolder && connHolder->get() );
+            DBClientWithCommands *conn = connHolder->get();
+
+            Convertor c( cx );
+
+            string ns = c.toString( argv[0] );
+
+            long long cursorId;
+            if ( JSVAL_IS_OBJECT( argv[1] ) &&
+                 JS_InstanceOf( cx , JSVAL_TO_OBJECT( argv[1] ) , &numberlong_class , 0 ) )
+                cursorId = c.toNumberLongUnsafe( JSVAL_TO_OBJECT( argv[1] ) );
+            else
+                cursorId = (long long) c.toNumber( argv[1] );
+
+            int batchSize = argc == 3 ? (int) c.toNumber( argv[2] ) : 0;
+
+            auto_ptr<DBClientCursor> cursor( new DBClientCursor( conn , ns , cursorId , batchSize , 0 ) );
+            JSObject * mycursor = JS_NewObject( cx , &internal_cursor_class , 0 , 0 );
+            CHECKNEWOBJECT( mycursor, cx, "internal_cursor_class" );
+            verify( JS_SetPrivate( cx , mycursor , new CursorHolder( cursor, *connHolder ) ) );
+            *rval = OBJECT_TO_JSVAL( mycursor );
+        }
+        catch ( const AssertionException& e ) {
+            if ( ! JS_IsExceptionPending( cx ) ) {
+                JS_ReportError( cx, e.what() );
+            }
+            return JS_FALSE;
+        }
+        catch ( const std::exception& e ) {
+            log() << "unhandled exception: " << e.what() << ", throwing Fatal Assertion" << endl;
+            fassertFailed( 16432 );
+        }
+        return JS_TRUE;
+    }
+
     JSBool mongo_update(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval) {
         try {
             smuassert( cx ,  "mongo_update needs at least 3 args" , argc >= 3 );
@@ -547,6 +587,7 @@ namespace mongo {
     JSFunctionSpec mongo_functions[] = {
         { "auth" , mongo_auth , 0 , JSPROP_READONLY | JSPROP_PERMANENT, 0 } ,
         { "find" , mongo_find , 0 , JSPROP_READONLY | JSPROP_PERMANENT, 0 } ,
+        { "cursorFromId" , mongo_cursor_from_id , 0 , JSPROP_READONLY | JSPROP_PERMANENT, 0 } ,
         { "update" , mongo_update , 0 , JSPROP_READONLY | JSPROP_PERMANENT, 0 } ,
         { "insert" , mongo_insert , 0 , JSPROP_READONLY | JSPROP_PERMANENT, 0 } ,
         { "remove" , mongo_remove , 0 , JSPROP_READONLY | JSPROP_PERMANENT, 0 } ,
@@ -54,6 +54,7 @@ namespace mongo {
         mongo->InstanceTemplate()->SetInternalFieldCount( 1 );
         v8::Handle<v8::Template> proto = mongo->PrototypeTemplate();
         scope->injectV8Function("find", mongoFind, proto);
+        scope->injectV8Function("cursorFromId", mongoCursorFromId, proto);
         scope->injectV8Function("insert", mongoInsert, proto);
         scope->injectV8Function("remove", mongoRemove, proto);
         scope->injectV8Function("update", mongoUpdate, proto);
@@ -331,6 +332,41 @@ namespace mongo {
         }
     }
 
+    /**
+       a cursor a command returned, such as aggregate's
+       0 - namespace
+       1 - cursor id
+       2 - batch size
+    */
+    Handle<Value> mongoCursorFromId(V8Scope* scope, const Arguments& args) {
+        HandleScope handle_scope;
+
+        jsassert( args.Length() == 2 || args.Length() == 3 , "cursorFromId needs 2 or 3 args" );
+        DBClientBase * conn = getConnection( args );
+        GETNS;
+
+        long long cursorId;
+        if ( args[1]->IsObject() && args[1]->ToObject()->HasRealNamedProperty( scope->getV8Str( "floatApprox" ) ) )
+            cursorId = numberLongVal( args[1]->ToObject() );
+        else
+            cursorId = (long long)( args[1]->ToNumber()->Value() );
+        int batchSize = args.Length() == 3 ? (int)( args[2]->ToNumber()->Value() ) : 0;
+
+        Local<v8::Object> mongo = args.This();
+
+        auto_ptr<mongo::DBClientCursor> cursor( new DBClientCursor( conn , ns , cursorId , batchSize , 0 ) );
+        v8::Function * cons = (v8::Function*)( *( mongo->Get( scope->getV8Str( "internalCursor" ) ) ) );
+        if ( !cons ) {
+            // may get here in case of thread termination
+            return v8::ThrowException( v8::String::New( "Could not create a cursor" ) );
+        }
+
+        Persistent<v8::Object> c = Persistent<v8::Object>::New( cons->NewInstance() );
+        c.MakeWeak( cursor.get() , destroyCursor );
+        c->SetInternalField( 0 , External::New( cursor.release() ) );
+        return handle_scope.Close(c);
+    }
+
     v8::Handle<v8::Value> mongoInsert(V8Scope* scope, const v8::Arguments& args) {
         jsassert( args.Length() == 2 , "insert needs 2 args" );
         jsassert( args[1]->IsObject() , "have to insert an object" );
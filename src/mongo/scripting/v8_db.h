@@ -41,6 +41,7 @@ namespace mongo {
     v8::Handle<v8::Value> mongoConsExternal(V8Scope* scope, const v8::Arguments& args);
 
     v8::Handle<v8::Value> mongoFind(V8Scope* scope, const v8::Arguments& args);
+    v8::Handle<v8::Value> mongoCursorFromId(V8Scope* scope, const v8::Arguments& args);
     v8::Handle<v8::Value> mongoInsert(V8Scope* scope, const v8::Arguments& args);
     v8::Handle<v8::Value> mongoRemove(V8Scope* scope, const v8::Arguments& args);
     v8::Handle<v8::Value> mongoUpdate(V8Scope* scope, const v8::Arguments& args);
@@ -72,6 +73,7 @@ namespace mongo {
     v8::Handle<v8::Value> hexDataInit( V8Scope* scope, const v8::Arguments& args );
 
     v8::Handle<v8::Value> numberLongInit( V8Scope* scope, const v8::Arguments& args );
+    long long numberLongVal( const v8::Handle< v8::Object > &it );
     v8::Handle<v8::Value> numberLongToNumber(V8Scope* scope, const v8::Arguments& args);
     v8::Handle<v8::Value> numberLongValueOf(V8Scope* scope, const v8::Arguments& args);
     v8::Handle<v8::Value> numberLongToString(V8Scope* scope, const v8::Arguments& args);
@@ -590,6 +590,19 @@ DBCollection.prototype.aggregate = function( ops ) {
     return this.runCommand( "aggregate" , { pipeline : arr } );
 }
 
+/**
+ * runs the aggregate pipeline ops with its output returned through a cursor rather than in one
+ * document, so the output isn't limited to 16MB.  batchSize bounds each batch.
+ * @return a DBCommandCursor
+ */
+DBCollection.prototype.aggregateCursor = function( ops , batchSize ) {
+    var cursor = {};
+    if ( batchSize != undefined )
+        cursor.batchSize = batchSize;
+    var res = this.runCommand( "aggregate" , { pipeline : ops , cursor : cursor } );
+    return new DBCommandCursor( this._mongo , res , batchSize );
+}
+
 DBCollection.prototype.group = function( params ){
     params.ns = this._shortName;
     return this._db.group( params );
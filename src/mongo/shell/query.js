@@ -343,6 +343,62 @@ DBQuery.prototype.toString = function(){
 
 DBQuery.shellBatchSize = 20;
 
+/**
+ * iterates the cursor : { id , ns , firstBatch } a command such as aggregate returns, getting
+ * more from the server until the cursor is exhausted
+ */
+DBCommandCursor = function( mongo , cmdResult , batchSize ){
+    assert.commandWorked( cmdResult );
+    this._mongo = mongo;
+    this._ns = cmdResult.cursor.ns;
+    this._batch = cmdResult.cursor.firstBatch;
+    this._pos = 0;
+    this._cursor = null;
+    var id = cmdResult.cursor.id;
+    if ( bsonWoCompare( { x : id } , { x : NumberLong( 0 ) } ) != 0 )
+        this._cursor = mongo.cursorFromId( this._ns , id , batchSize || 0 );
+}
+
+DBCommandCursor.prototype.hasNext = function(){
+    if ( this._pos < this._batch.length )
+        return true;
+    return this._cursor != null && this._cursor.hasNext();
+}
+
+DBCommandCursor.prototype.next = function(){
+    if ( this._pos < this._batch.length )
+        return this._batch[ this._pos++ ];
+    if ( this._cursor == null )
+        throw "error hasNext: false";
+    var ret = this._cursor.next();
+    if ( ret.$err )
+        throw "error: " + tojson( ret );
+    return ret;
+}
+
+DBCommandCursor.prototype.objsLeftInBatch = function(){
+    if ( this._pos < this._batch.length )
+        return this._batch.length - this._pos;
+    return this._cursor == null ? 0 : this._cursor.objsLeftInBatch();
+}
+
+DBCommandCursor.prototype.forEach = DBQuery.prototype.forEach;
+DBCommandCursor.prototype.map = DBQuery.prototype.map;
+DBCommandCursor.prototype.itcount = DBQuery.prototype.itcount;
+
+DBCommandCursor.prototype.toArray = function(){
+    var a = [];
+    while ( this.hasNext() )
+        a.push( this.next() );
+    return a;
+}
+
+DBCommandCursor.prototype.shellPrint = DBQuery.prototype.shellPrint;
+
+DBCommandCursor.prototype.toString = function(){
+    return "DBCommandCursor: " + this._ns;
+}
+
 /**
  * Query option flag bit constants.
  * @see http://www.mongodb.org/display/DOCS/Mongo+Wire+Protocol#MongoWireProtocol-OPQUERY
@@ -71,7 +71,10 @@ public:
             return 1;
         }
 
-        processFile( root );
+        // along with the rest of a collection dumped in segments
+        vector<boost::filesystem::path> segments = bsonSegmentPaths( root );
+        for ( size_t i = 0; i < segments.size(); i++ )
+            processFile( segments[i] );
         return 0;
     }
 
@@ -27,6 +27,7 @@
 
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/convenience.hpp>
+#include <boost/thread/thread.hpp>
 
 using namespace mongo;
 
@@ -49,9 +50,14 @@ public:
         ("oplog", "Use oplog for point-in-time snapshotting" )
         ("repair", "try to recover a crashed database" )
         ("forceTableScan", "force a table scan (do not use $snapshot)" )
+        ("numSegments", po::value<int>()->default_value(1), "dump each collection larger than 64MB in up to this many _id ranges at once, into <coll>.bson, <coll>.bson.1 and so on" )
+        ("compress", po::value<string>() , "compress the .bson files written; the only kind is snappy" )
         ;
     }
 
+    // collections smaller than this are never split into segments
+    static const long long minSegmentedSize = 64 * 1024 * 1024;
+
     virtual void preSetup() {
         string out = getParam("out");
         if ( out == "-" ) {
@@ -67,18 +73,10 @@ public:
 
     // This is a functor that writes a BSONObj to a file
     struct Writer {
-        Writer(FILE* out, ProgressMeter* m) :_out(out), _m(m) {}
+        Writer(BSONOutput* out, ProgressMeter* m) :_out(out), _m(m) {}
 
         void operator () (const BSONObj& obj) {
-            size_t toWrite = obj.objsize();
-            size_t written = 0;
-
-            while (toWrite) {
-                size_t ret = fwrite( obj.objdata()+written, 1, toWrite, _out );
-                uassert(14035, errnoWithPrefix("couldn't write to file"), ret);
-                toWrite -= ret;
-                written += ret;
-            }
+            _out->append(obj);
 
             // if there's a progress bar, hit it
             if (_m) {
@@ -86,21 +84,29 @@ public:
             }
         }
 
-        FILE* _out;
+        BSONOutput* _out;
         ProgressMeter* _m;
     };
 
-    void doCollection( const string coll , FILE* out , ProgressMeter *m ) {
+    /**
+     * dumps coll, over c if given rather than conn(true).  with an idRange query, only the
+     * documents in it, found through the _id index.
+     */
+    void doCollection( const string coll , BSONOutput& out , ProgressMeter *m ,
+                       DBClientBase* c = 0 , const BSONObj& idRange = BSONObj() ) {
         Query q = _query;
 
         int queryOptions = QueryOption_SlaveOk | QueryOption_NoCursorTimeout;
         if (startsWith(coll.c_str(), "local.oplog."))
             queryOptions |= QueryOption_OplogReplay;
+        else if ( !idRange.isEmpty() )
+            // like $snapshot, an _id index scan returns each document once
+            q = Query( idRange ).hint( BSON( "_id" << 1 ) );
         else if ( _query.isEmpty() && !hasParam("dbpath") && !hasParam("forceTableScan") )
             q.snapshot();
         
-        DBClientBase& connBase = conn(true);
-        Writer writer(out, m);
+        DBClientBase& connBase = c ? *c : conn(true);
+        Writer writer(&out, m);
 
         // use low-latency "exhaust" mode if going over the network
         if (!_usingMongos && typeid(connBase) == typeid(DBClientConnection&)) {
@@ -117,20 +123,118 @@ public:
         }
     }
 
-    void writeCollectionFile( const string coll , boost::filesystem::path outputFile ) {
+    void writeCollectionFile( const string coll , boost::filesystem::path outputFile , bool splittable = false ) {
         log() << "\t" << coll << " to " << outputFile.string() << endl;
 
+        // segments left from an earlier dump here would be restored along with this one
+        for ( int i = 1; boost::filesystem::exists( bsonSegmentPath( outputFile , i ) ); i++ )
+            boost::filesystem::remove( bsonSegmentPath( outputFile , i ) );
+
+        if ( splittable ) {
+            vector<BSONObj> splitKeys = segmentSplitKeys( coll );
+            if ( ! splitKeys.empty() ) {
+                writeSegments( coll , outputFile , splitKeys );
+                return;
+            }
+        }
+
         FilePtr f (fopen(outputFile.string().c_str(), "wb"));
         uassert(10262, errnoWithPrefix("couldn't open file"), f);
+        BSONOutput out(f, _compressed);
 
         ProgressMeter m( conn( true ).count( coll.c_str() , BSONObj() , QueryOption_SlaveOk ) );
         m.setUnits("objects");
 
-        doCollection(coll, f, &m);
+        doCollection(coll, out, &m);
+        out.flush();
 
         log() << "\t\t " << m.done() << " objects" << endl;
     }
 
+    /**
+     * @return the _id keys cutting coll into about _numSegments ranges of even size, or none
+     * if it is too small to be worth splitting or the server can't say where to split it
+     */
+    vector<BSONObj> segmentSplitKeys( const string& coll ) {
+        vector<BSONObj> splitKeys;
+        if ( _numSegments < 2 || _usingMongos || hasParam( "dbpath" ) || ! _query.isEmpty() )
+            return splitKeys;
+
+        NamespaceString ns( coll );
+        BSONObj stats;
+        if ( ! conn( true ).runCommand( ns.db , BSON( "collstats" << ns.coll ) , stats ) )
+            return splitKeys;
+        long long size = stats["size"].numberLong();
+        long long count = stats["count"].numberLong();
+        if ( size < minSegmentedSize || count < _numSegments )
+            return splitKeys;
+
+        // splitVector cuts at half of maxChunkSizeBytes
+        BSONObj res;
+        BSONObj cmd = BSON( "splitVector" << coll << "keyPattern" << BSON( "_id" << 1 ) <<
+                            "maxChunkSizeBytes" << 2 * size / _numSegments <<
+                            "maxChunkObjects" << count / _numSegments + 1 <<
+                            "maxSplitPoints" << _numSegments - 1 );
+        if ( ! conn( true ).runCommand( ns.db , cmd , res ) ) {
+            log(1) << "\t\t not splitting " << coll << ": " << res << endl;
+            return splitKeys;
+        }
+
+        BSONObjIterator i( res["splitKeys"].Obj() );
+        while ( i.more() )
+            splitKeys.push_back( i.next().Obj().getOwned() );
+        return splitKeys;
+    }
+
+    // dumps coll in splitKeys.size() + 1 _id ranges, each on its own connection and thread
+    void writeSegments( const string coll , boost::filesystem::path outputFile , const vector<BSONObj>& splitKeys ) {
+        const size_t n = splitKeys.size() + 1;
+        log() << "\t\t in " << n << " segments" << endl;
+
+        vector<long long> counts( n , 0 );
+        vector<string> errors( n );
+        boost::thread_group threads;
+        for ( size_t i = 0; i < n; i++ ) {
+            BSONObjBuilder b;
+            {
+                BSONObjBuilder id( b.subobjStart( "_id" ) );
+                if ( i > 0 )
+                    id.appendAs( splitKeys[i - 1]["_id"] , "$gte" );
+                if ( i < splitKeys.size() )
+                    id.appendAs( splitKeys[i]["_id"] , "$lt" );
+            }
+            threads.create_thread( boost::bind( &Dump::writeSegment , this , coll ,
+                                                bsonSegmentPath( outputFile , i ) , b.obj() ,
+                                                &counts[i] , &errors[i] ) );
+        }
+        threads.join_all();
+
+        long long total = 0;
+        for ( size_t i = 0; i < n; i++ ) {
+            uassert( 16387 , errors[i] , errors[i].empty() );
+            total += counts[i];
+        }
+        log() << "\t\t " << total << " objects" << endl;
+    }
+
+    void writeSegment( const string coll , boost::filesystem::path file , BSONObj idRange ,
+                       long long* count , string* error ) {
+        try {
+            scoped_ptr<DBClientBase> c( createConnection( NamespaceString( coll ).db ) );
+
+            FilePtr f (fopen(file.string().c_str(), "wb"));
+            uassert(10262, errnoWithPrefix("couldn't open file"), f);
+            BSONOutput out(f, _compressed);
+
+            doCollection(coll, out, NULL, c.get(), idRange);
+            out.flush();
+            *count = out.count();
+        }
+        catch ( DBException& e ) {
+            *error = e.toString();
+        }
+    }
+
     void writeMetadataFile( const string coll, boost::filesystem::path outputFile, 
                             map<string, BSONObj> options, multimap<string, BSONObj> indexes ) {
         log() << "\tMetadata for " << coll << " to " << outputFile.string() << endl;
@@ -167,7 +271,9 @@ public:
 
 
     void writeCollectionStdout( const string coll ) {
-        doCollection(coll, stdout, NULL);
+        BSONOutput out(stdout, _compressed);
+        doCollection(coll, out, NULL);
+        out.flush();
     }
 
     void go( const string db , const boost::filesystem::path outdir ) {
@@ -230,7 +336,18 @@ public:
         for (vector<string>::iterator it = collections.begin(); it != collections.end(); ++it) {
             string name = *it;
             const string filename = name.substr( db.size() + 1 );
-            writeCollectionFile( name , outdir / ( filename + ".bson" ) );
+
+            // a capped collection's order, and everything without an _id index, has to be
+            // kept to one scan
+            bool splittable = ! startsWith( filename , "system." ) &&
+                ! ( collectionOptions.count( name ) && collectionOptions[name]["capped"].trueValue() );
+            bool hasIdIndex = false;
+            for (multimap<string, BSONObj>::iterator i=indexes.equal_range(name).first; i!=indexes.equal_range(name).second; ++i) {
+                if ( str::equals( i->second.getStringField( "name" ) , "_id_" ) )
+                    hasIdIndex = true;
+            }
+
+            writeCollectionFile( name , outdir / ( filename + ".bson" ) , splittable && hasIdIndex );
             writeMetadataFile( name, outdir / (filename + ".metadata.json"), collectionOptions, indexes);
         }
 
@@ -340,7 +457,8 @@ public:
         ProgressMeter m( nsd->stats.nrecords * 2 );
         m.setUnits("objects");
         
-        Writer w( f , &m );
+        BSONOutput out( f , _compressed );
+        Writer w( &out , &m );
 
         try {
             log() << "forward extent pass" << endl;
@@ -368,6 +486,7 @@ public:
             error() << "ERROR: backwards extent pass failed:" << e.toString() << endl;
         }
 
+        out.flush();
         log() << "\t\t " << m.done() << " objects" << endl;
     }
     
@@ -411,6 +530,16 @@ public:
 
     int run() {
         
+        _numSegments = getParam( "numSegments" , 1 );
+        _compressed = false;
+        if ( hasParam( "compress" ) ) {
+            if ( getParam( "compress" ) != "snappy" ) {
+                log() << "unknown compression: " << getParam( "compress" ) << endl;
+                return -1;
+            }
+            _compressed = true;
+        }
+
         if ( hasParam( "repair" ) ){
             warning() << "repair is a work in progress" << endl;
             return repair();
@@ -524,6 +653,8 @@ public:
 
     bool _usingMongos;
     BSONObj _query;
+    int _numSegments;
+    bool _compressed;
 };
 
 int main( int argc , char ** argv ) {
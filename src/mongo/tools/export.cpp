@@ -210,6 +210,11 @@ public:
         if (jsonArray)
             out << '[';
 
+        // json documents are formatted into one buffer which is written out a megabyte at a
+        // time, rather than building a string per document and flushing it with endl
+        StringBuilder buf;
+        const int flushSize = 1024 * 1024;
+
         long long num = 0;
         while ( cursor->more() ) {
             num++;
@@ -227,15 +232,22 @@ public:
             }
             else {
                 if (jsonArray && num != 1)
-                    out << ',';
+                    buf << ',';
 
-                out << obj.jsonString();
+                obj.jsonString( buf );
 
                 if (!jsonArray)
-                    out << endl;
+                    buf << '\n';
+
+                if ( buf.len() >= flushSize ) {
+                    out.write( buf.data() , buf.len() );
+                    buf.reset();
+                }
             }
         }
 
+        out.write( buf.data() , buf.len() );
+
         if (jsonArray)
             out << ']' << endl;
 
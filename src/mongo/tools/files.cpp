@@ -82,6 +82,8 @@ public:
         }
 
         GridFS g( conn() , _db );
+        // the md5 as it uploads, saving the server a second pass over the chunks
+        g.setClientSideMD5( true );
         auth();
 
         string filename = getParam( "file" );
@@ -20,6 +20,7 @@
 #include "db/json.h"
 
 #include "tool.h"
+#include "../util/queue.h"
 #include "../util/text.h"
 
 #include <fstream>
@@ -28,6 +29,7 @@
 #include <boost/program_options.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem/operations.hpp>
+#include <boost/thread/thread.hpp>
 
 using namespace mongo;
 using std::string;
@@ -47,8 +49,19 @@ class Import : public Tool {
     bool _doimport;
     bool _jsonArray;
     vector<string> _upsertFields;
+    int _batchSize;
+    int _numWorkers;
     static const int BUF_SIZE;
 
+    // lines handed from the reading thread to the workers parsing and inserting them
+    typedef boost::shared_ptr< vector<string> > Chunk;
+    static const size_t LINES_PER_CHUNK = 1000;
+
+    mongo::mutex _workerMutex; // guards the rest
+    long long _workerObjects;
+    int _workerErrors;
+    bool _stopping; // set on the first error with --stopOnError
+
     void csvTokenizeRow(const string& row, vector<string>& tokens) {
         bool inQuotes = false;
         bool prevWasQuote = false;
@@ -184,11 +197,7 @@ class Import : public Tool {
                 *end = 0;
                 end--;
             }
-            try {
-                o = fromjson( line );
-            } catch ( MsgAssertionException& e ) {
-                uasserted(13504, string("BSON representation of supplied JSON is too large: ") + e.what());
-            }
+            o = parseJSONLine( line );
             return true;
         }
 
@@ -225,17 +234,35 @@ class Import : public Tool {
             csvTokenizeRow(row, tokens);
         }
         else {  // _type == TSV
-            while (line[0] != '\t' && isspace(line[0])) { // Strip leading whitespace, but not tabs
-                line++;
-            }
+            tsvTokenizeRow(line, tokens);
+        }
 
-            boost::split(tokens, line, boost::is_any_of(_sep));
+        o = tokensToObject(tokens);
+        return true;
+    }
+
+    BSONObj parseJSONLine(const char* line) {
+        try {
+            return fromjson( line );
+        } catch ( MsgAssertionException& e ) {
+            uasserted(13504, string("BSON representation of supplied JSON is too large: ") + e.what());
         }
+        return BSONObj(); // unreachable
+    }
+
+    void tsvTokenizeRow(const char* line, vector<string>& tokens) {
+        while (line[0] != '\t' && isspace(line[0])) { // Strip leading whitespace, but not tabs
+            line++;
+        }
+
+        boost::split(tokens, line, boost::is_any_of(_sep));
+    }
 
-        // Now that the row is tokenized, create a BSONObj out of it.
+    // Makes a BSONObj out of a tokenized row, or takes the field names from it if it's the header.
+    BSONObj tokensToObject(const vector<string>& tokens) {
         BSONObjBuilder b;
         unsigned int pos=0;
-        for (vector<string>::iterator it = tokens.begin(); it != tokens.end(); ++it) {
+        for (vector<string>::const_iterator it = tokens.begin(); it != tokens.end(); ++it) {
             string token = *it;
             if ( _headerLine ) {
                 _fields.push_back(token);
@@ -255,12 +282,168 @@ class Import : public Tool {
                 _append( b , name , token );
             }
         }
-        o = b.obj();
-        return true;
+        return b.obj();
+    }
+
+    /**
+     * Reads the input into chunks of lines for _numWorkers workers, which parse and insert
+     * them on connections of their own.  Only for JSON and TSV files, whose objects are each
+     * on a line of their own, and plain inserts, whose order doesn't matter.
+     */
+    int importInParallel( istream* in , const string& ns , long long fileSize ) {
+        _workerObjects = 0;
+        _workerErrors = 0;
+        _stopping = false;
+
+        time_t start = time(0);
+        ProgressMeter pm( fileSize );
+        boost::scoped_array<char> buffer(new char[BUF_SIZE+2]);
+        int readErrors = 0;
+
+        // the workers need the field names
+        while ( _headerLine && in->rdstate() == 0 ) {
+            BSONObj o;
+            int len = 0;
+            if ( parseRow( in , o , len ) )
+                _headerLine = false;
+            pm.hit( len + 1 );
+        }
+
+        BlockingQueue<Chunk> chunks( _numWorkers * 2 );
+        boost::thread_group threads;
+        for ( int i = 0; i < _numWorkers; i++ )
+            threads.create_thread( boost::bind( &Import::importWorker , this , ns , &chunks ) );
+
+        Chunk chunk( new vector<string>() );
+        while ( in->rdstate() == 0 ) {
+            {
+                scoped_lock lk( _workerMutex );
+                if ( _stopping )
+                    break;
+            }
+
+            char* line = buffer.get();
+            int len = 0;
+            try {
+                len = getLine( in , line );
+                line += len;
+                len += strlen( line );
+            }
+            catch ( std::exception& e ) {
+                log() << "exception:" << e.what() << endl;
+                readErrors++;
+                if ( hasParam( "stopOnError" ) )
+                    break;
+                continue;
+            }
+
+            if ( line[0] != '\0' ) {
+                chunk->push_back( line );
+                if ( chunk->size() == LINES_PER_CHUNK ) {
+                    chunks.push( chunk );
+                    chunk.reset( new vector<string>() );
+                }
+            }
+
+            if ( pm.hit( len + 1 ) ) {
+                scoped_lock lk( _workerMutex );
+                log() << "\t\t\t" << _workerObjects << "\t" << ( _workerObjects / ( time(0) - start ) ) << "/second" << endl;
+            }
+        }
+
+        if ( ! chunk->empty() )
+            chunks.push( chunk );
+        // an empty chunk for each worker says there are no more
+        for ( int i = 0; i < _numWorkers; i++ )
+            chunks.push( Chunk() );
+        threads.join_all();
+
+        log() << "imported " << _workerObjects << " objects" << endl;
+
+        int errors = readErrors + _workerErrors;
+        if ( errors == 0 )
+            return 0;
+
+        error() << "encountered " << errors << " error" << ( errors == 1 ? "" : "s" ) << endl;
+        return -1;
+    }
+
+    void importWorker( const string ns , BlockingQueue<Chunk>* chunks ) {
+        long long objects = 0;
+        int errors = 0;
+        bool done = false;
+        try {
+            scoped_ptr<DBClientBase> c( _doimport ? createConnection( _db ) : 0 );
+            scoped_ptr<BatchedInserter> inserter( c ? new BatchedInserter( *c , ns , 0 , _batchSize ) : 0 );
+
+            while ( ! done ) {
+                Chunk chunk = chunks->blockingPop();
+                if ( ! chunk ) {
+                    done = true;
+                    break;
+                }
+
+                for ( size_t i = 0; i < chunk->size(); i++ ) {
+                    const string& line = (*chunk)[i];
+                    try {
+                        BSONObj o;
+                        if ( _type == JSON ) {
+                            o = parseJSONLine( line.c_str() );
+                        }
+                        else {
+                            vector<string> tokens;
+                            tsvTokenizeRow( line.c_str() , tokens );
+                            o = tokensToObject( tokens );
+                        }
+                        if ( inserter )
+                            inserter->insert( o );
+                        objects++;
+                    }
+                    catch ( std::exception& e ) {
+                        log() << "exception:" << e.what() << endl;
+                        log() << line << endl;
+                        errors++;
+
+                        if ( hasParam( "stopOnError" ) ) {
+                            scoped_lock lk( _workerMutex );
+                            _stopping = true;
+                            break;
+                        }
+                    }
+                }
+
+                scoped_lock lk( _workerMutex );
+                _workerObjects += objects;
+                objects = 0;
+                if ( _stopping )
+                    break;
+            }
+
+            if ( inserter ) {
+                inserter->flush();
+                c->getLastError();
+            }
+        }
+        catch ( std::exception& e ) {
+            log() << "exception:" << e.what() << endl;
+            errors++;
+            scoped_lock lk( _workerMutex );
+            _stopping = true;
+        }
+
+        // the reader may still be waiting to hand out chunks and the end of them
+        while ( ! done ) {
+            if ( ! chunks->blockingPop() )
+                done = true;
+        }
+
+        scoped_lock lk( _workerMutex );
+        _workerObjects += objects;
+        _workerErrors += errors;
     }
 
 public:
-    Import() : Tool( "import" ) {
+    Import() : Tool( "import" ), _workerMutex( "Import::workers" ) {
         addFieldOptions();
         add_options()
         ("ignoreBlanks","if given, empty fields in csv and tsv will be ignored")
@@ -272,6 +455,8 @@ public:
         ("upsertFields", po::value<string>(), "comma-separated fields for the query part of the upsert. You should make sure this is indexed" )
         ("stopOnError", "stop importing at first error rather than continuing" )
         ("jsonArray", "load a json array, not one item per line. Currently limited to 16MB." )
+        ("batchSize", po::value<int>()->default_value(1000), "most documents to send in one insert message" )
+        ("numWorkers", po::value<int>()->default_value(1), "parse and insert on this many threads and connections at once; json and tsv inserts only" )
         ;
         add_hidden_options()
         ("noimport", "don't actually import. useful for benchmarking parser" )
@@ -283,6 +468,8 @@ public:
         _upsert = false;
         _doimport = true;
         _jsonArray = false;
+        _batchSize = 1000;
+        _numWorkers = 1;
     }
 
     virtual void printExtraHelp( ostream & out ) {
@@ -383,6 +570,19 @@ public:
             _jsonArray = true;
         }
 
+        _batchSize = max( getParam( "batchSize" , 1000 ) , 1 );
+        _numWorkers = max( getParam( "numWorkers" , 1 ) , 1 );
+        if ( _numWorkers > 1 ) {
+            if ( _type == CSV || _jsonArray || _upsert || hasParam( "dbpath" ) ) {
+                log() << "numWorkers is only for json and tsv inserts over the network, using 1" << endl;
+                _numWorkers = 1;
+            }
+            else {
+                log(1) << "filesize: " << fileSize << endl;
+                return importInParallel( in , ns , fileSize );
+            }
+        }
+
         time_t start = time(0);
         log(1) << "filesize: " << fileSize << endl;
         ProgressMeter pm( fileSize );
@@ -392,6 +592,7 @@ public:
         // buffer and line are only used when parsing a jsonArray
         boost::scoped_array<char> buffer(new char[BUF_SIZE+2]);
         char* line = buffer.get();
+        BatchedInserter inserter( conn() , ns , 0 , _batchSize );
 
         while ( _jsonArray || in->rdstate() == 0 ) {
             try {
@@ -434,10 +635,12 @@ public:
                     }
 
                     if (doUpsert) {
+                        // after the inserts before it
+                        inserter.flush();
                         conn().update(ns, Query(b.obj()), o, true);
                     }
                     else {
-                        conn().insert( ns.c_str() , o );
+                        inserter.insert( o );
                     }
                 }
 
@@ -457,6 +660,14 @@ public:
             }
         }
 
+        try {
+            inserter.flush();
+        }
+        catch ( std::exception& e ) {
+            log() << "exception:" << e.what() << endl;
+            errors++;
+        }
+
         log() << "imported " << ( num - headerRows ) << " objects" << endl;
 
         conn().getLastError();
@@ -21,38 +21,90 @@
 #include "db/oplogreader.h"
 
 #include "tool.h"
+#include "../util/queue.h"
 
 #include <fstream>
 #include <iostream>
 
+#include <boost/filesystem/convenience.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/program_options.hpp>
+#include <boost/thread/thread.hpp>
 
 using namespace mongo;
 
 namespace po = boost::program_options;
 
-class OplogTool : public Tool {
+/**
+ * with --backup, archives are segments named oplog-<secs>-<inc>.bson after their first op, so
+ * they sort in oplog order.  a segment is written as a .tmp file and renamed when complete.
+ */
+static const char archivePrefix[] = "oplog-";
+
+class OplogTool : public BSONTool {
+
+    // --backup
+    bool _compressed;
+    long long _segmentSize;
+    OpTime _resumeFrom;   // the archive's last op, which the oplog must still have
+    bool _resumeChecked;
+    FILE* _segmentFile;
+    scoped_ptr<BSONOutput> _segment;
+    boost::filesystem::path _segmentPath;
+    long long _segmentBytes;
+    long long _archived;
+
+    // --replay.  ops are spread over the workers by namespace, keeping each namespace's in order
+    typedef boost::shared_ptr< vector<BSONObj> > Batch;
+    int _numWorkers;
+    int _batchSize;
+    static const int maxBatchBytes = 8 * 1024 * 1024;
+    vector<Batch> _pending;   // the ops gathered for each worker
+    vector<int> _pendingBytes;
+    vector< boost::shared_ptr< BlockingQueue<Batch> > > _queues;
+    scoped_ptr<boost::thread_group> _threads;
+
+    mongo::mutex _workerMutex; // guards the rest
+    long long _applied;
+    int _errors;
+
 public:
-    OplogTool() : Tool( "oplog" ) {
+    OplogTool() : BSONTool( "oplog" ), _segmentFile( 0 ), _workerMutex( "OplogTool::workers" ) {
         addFieldOptions();
         add_options()
         ("seconds,s" , po::value<int>() , "seconds to go back default:86400" )
         ("from", po::value<string>() , "host to pull from" )
         ("oplogns", po::value<string>()->default_value( "local.oplog.rs" ) , "ns to pull from" )
+        ("backup", po::value<string>() , "instead of replaying, archive --from's oplog into this directory, carrying on from the last op archived there" )
+        ("segmentSize", po::value<int>()->default_value( 256 ) , "with --backup, MB of ops in each archive segment" )
+        ("compress", po::value<string>() , "with --backup, compress the segments; the only kind is snappy" )
+        ("replay", po::value<string>() , "apply the ops archived in this directory by --backup" )
+        ("batchSize", po::value<int>()->default_value( 1000 ) , "with --replay, ops applied in each applyOps command" )
+        ("numWorkers", po::value<int>()->default_value( 1 ) , "with --replay, connections applying ops at once.  each namespace's ops stay in order" )
         ;
     }
 
     virtual void printExtraHelp(ostream& out) {
-        out << "Pull and replay a remote MongoDB oplog.\n" << endl;
+        out << "Pull and replay a remote MongoDB oplog, or archive one and replay the archive.\n" << endl;
     }
 
-    int run() {
+    virtual void gotObject( const BSONObj& op ) {
+        replayOp( op );
+    }
+
+    int doRun() {
+        if ( hasParam( "replay" ) )
+            return replay();
 
         if ( ! hasParam( "from" ) ) {
             log() << "need to specify --from" << endl;
             return -1;
         }
 
+        if ( hasParam( "backup" ) )
+            return backup();
+
         Client::initThread( "oplogreplay" );
 
         log() << "going to connect" << endl;
@@ -108,6 +160,310 @@ public:
 
         return 0;
     }
+
+private:
+    static vector<boost::filesystem::path> archiveSegments( const boost::filesystem::path& dir ) {
+        vector<boost::filesystem::path> segments;
+        boost::filesystem::directory_iterator end;
+        for ( boost::filesystem::directory_iterator i( dir ); i != end; ++i ) {
+            const string leaf = i->path().leaf();
+            if ( str::startsWith( leaf , archivePrefix ) && str::endsWith( leaf , ".bson" ) )
+                segments.push_back( i->path() );
+        }
+        sort( segments.begin() , segments.end() );
+        return segments;
+    }
+
+    static void noteTs( OpTime* last , const BSONObj& op ) {
+        *last = op["ts"]._opTime();
+    }
+
+    int backup() {
+        if ( hasFilter() ) {
+            log() << "--filter only applies to --replay" << endl;
+            return -1;
+        }
+        _segmentSize = getParam( "segmentSize" , 256 ) * 1024LL * 1024;
+        _compressed = false;
+        if ( hasParam( "compress" ) ) {
+            if ( getParam( "compress" ) != "snappy" ) {
+                log() << "unknown compression: " << getParam( "compress" ) << endl;
+                return -1;
+            }
+            _compressed = true;
+        }
+
+        boost::filesystem::path dir( getParam( "backup" ) );
+        boost::filesystem::create_directories( dir );
+
+        // a segment left by a run which didn't finish is written again
+        boost::filesystem::directory_iterator end;
+        for ( boost::filesystem::directory_iterator i( dir ); i != end; ++i ) {
+            if ( str::endsWith( i->path().leaf() , ".bson.tmp" ) ) {
+                log() << "removing incomplete segment " << i->path().string() << endl;
+                boost::filesystem::remove( i->path() );
+            }
+        }
+
+        vector<boost::filesystem::path> segments = archiveSegments( dir );
+        OpTime start( time(0) - getParam( "seconds" , 86400 ) , 0 );
+        _resumeChecked = segments.empty();
+        if ( ! segments.empty() ) {
+            processFile( segments.back() , boost::bind( &OplogTool::noteTs , &_resumeFrom , _1 ) );
+            start = _resumeFrom;
+            log() << "carrying on from " << start.toStringPretty() << ", the last op in " << segments.back().string() << endl;
+        }
+        else {
+            log() << "starting from " << start.toStringPretty() << endl;
+        }
+
+        DBClientConnection from;
+        string errmsg;
+        if ( ! from.connect( getParam( "from" ) , errmsg ) ) {
+            log() << "couldn't connect to " << getParam( "from" ) << ": " << errmsg << endl;
+            return -1;
+        }
+
+        BSONObjBuilder q;
+        q.appendDate( "$gte" , start.asDate() );
+        BSONObjBuilder query;
+        query.append( "ts" , q.done() );
+
+        // an exhaust query streams the oplog as it is now without a round trip per batch
+        _archived = 0;
+        string ns = getParam( "oplogns" );
+        boost::function<void(DBClientCursorBatchIterator&)> f = boost::bind( &OplogTool::archiveBatch , this , _1 );
+        try {
+            from.query( f , ns , query.done() , 0 ,
+                        QueryOption_SlaveOk | QueryOption_OplogReplay | QueryOption_NoCursorTimeout );
+        }
+        catch ( std::exception& e ) {
+            log() << "error reading the oplog: " << e.what() << endl;
+            closeSegment( false );
+            return -1;
+        }
+        closeSegment( true );
+
+        if ( ! _resumeChecked ) {
+            log() << "the oplog no longer has " << _resumeFrom.toStringPretty()
+                  << ", the last op archived; a new dump is needed" << endl;
+            return -1;
+        }
+
+        log() << "archived " << _archived << " ops" << endl;
+        return 0;
+    }
+
+    void archiveBatch( DBClientCursorBatchIterator& i ) {
+        while ( i.moreInCurrentBatch() ) {
+            BSONObj op = i.nextSafe();
+
+            if ( ! _resumeChecked ) {
+                // the first op should be the last one archived, or the oplog has moved past it
+                uassert( 16389 , str::stream() << "the oplog no longer has " << _resumeFrom.toStringPretty()
+                         << ", the last op archived; a new dump is needed" ,
+                         op["ts"]._opTime() == _resumeFrom );
+                _resumeChecked = true;
+                continue;
+            }
+
+            if ( ! _segment )
+                openSegment( op["ts"]._opTime() );
+            _segment->append( op );
+            _segmentBytes += op.objsize();
+            _archived++;
+            if ( _segmentBytes >= _segmentSize )
+                closeSegment( true );
+        }
+    }
+
+    void openSegment( const OpTime& first ) {
+        char name[64];
+        sprintf( name , "%s%010u-%010u.bson" , archivePrefix , first.getSecs() , first.getInc() );
+        _segmentPath = boost::filesystem::path( getParam( "backup" ) ) / name;
+        string tmp = _segmentPath.string() + ".tmp";
+        _segmentFile = fopen( tmp.c_str() , "wb" );
+        uassert( 10262 , errnoWithPrefix( "couldn't open file" ) , _segmentFile );
+        _segment.reset( new BSONOutput( _segmentFile , _compressed ) );
+        _segmentBytes = 0;
+    }
+
+    /** with complete, the segment is renamed into the archive; otherwise it is dropped */
+    void closeSegment( bool complete ) {
+        if ( ! _segment )
+            return;
+        string tmp = _segmentPath.string() + ".tmp";
+        if ( complete )
+            _segment->flush();
+        long long n = _segment->count();
+        _segment.reset();
+        fclose( _segmentFile );
+        _segmentFile = 0;
+        if ( ! complete ) {
+            boost::filesystem::remove( tmp );
+            return;
+        }
+        boost::filesystem::rename( tmp , _segmentPath );
+        log() << "\t wrote " << n << " ops to " << _segmentPath.string() << endl;
+    }
+
+    int replay() {
+        _numWorkers = getParam( "numWorkers" , 1 );
+        _batchSize = getParam( "batchSize" , 1000 );
+        if ( _numWorkers < 1 || _batchSize < 1 ) {
+            log() << "--numWorkers and --batchSize must be at least 1" << endl;
+            return -1;
+        }
+        if ( _numWorkers > 1 && hasParam( "dbpath" ) ) {
+            log() << "--numWorkers is disabled with --dbpath" << endl;
+            return -1;
+        }
+
+        boost::filesystem::path dir( getParam( "replay" ) );
+        vector<boost::filesystem::path> segments;
+        if ( boost::filesystem::is_directory( dir ) )
+            segments = archiveSegments( dir );
+        if ( segments.empty() ) {
+            log() << "no oplog archive in " << dir.string() << endl;
+            return -1;
+        }
+
+        _applied = 0;
+        _errors = 0;
+        _pending.clear();
+        _pendingBytes.assign( _numWorkers , 0 );
+        for ( int i = 0; i < _numWorkers; i++ )
+            _pending.push_back( Batch( new vector<BSONObj>() ) );
+
+        startWorkers();
+        for ( size_t i = 0; i < segments.size(); i++ ) {
+            log() << segments[i].string() << endl;
+            processFile( segments[i] );
+        }
+        stopWorkers();
+
+        log() << "applied " << _applied << " ops" << endl;
+        if ( _errors == 0 )
+            return 0;
+        error() << _errors << " op" << ( _errors == 1 ? "" : "s" ) << " failed" << endl;
+        return -1;
+    }
+
+    void replayOp( const BSONObj& op ) {
+        const char* kind = op["op"].valuestrsafe();
+        if ( str::equals( kind , "n" ) )
+            return;
+
+        if ( str::equals( kind , "c" ) ) {
+            // a command may touch any namespace, so everything before it is applied first
+            stopWorkers();
+            vector<BSONObj> ops( 1 , op );
+            int errors = applyBatch( conn() , ops );
+            _applied++;
+            _errors += errors;
+            startWorkers();
+            return;
+        }
+
+        size_t w = boost::hash<string>()( op["ns"].str() ) % _numWorkers;
+        _pending[w]->push_back( op.getOwned() );
+        _pendingBytes[w] += op.objsize();
+        if ( (int) _pending[w]->size() >= _batchSize || _pendingBytes[w] >= maxBatchBytes )
+            dispatch( w );
+    }
+
+    void dispatch( size_t w ) {
+        Batch b = _pending[w];
+        if ( b->empty() )
+            return;
+        _pending[w].reset( new vector<BSONObj>() );
+        _pendingBytes[w] = 0;
+
+        if ( ! _threads ) {
+            int errors = applyBatch( conn() , *b );
+            _applied += b->size();
+            _errors += errors;
+            return;
+        }
+        _queues[w]->push( b );
+    }
+
+    // with one worker the ops are applied by the reading thread, on conn()
+    void startWorkers() {
+        if ( _numWorkers == 1 )
+            return;
+        _queues.clear();
+        _threads.reset( new boost::thread_group() );
+        for ( int i = 0; i < _numWorkers; i++ ) {
+            _queues.push_back( boost::shared_ptr< BlockingQueue<Batch> >( new BlockingQueue<Batch>( 2 ) ) );
+            _threads->create_thread( boost::bind( &OplogTool::replayWorker , this , _queues.back().get() ) );
+        }
+    }
+
+    /** applies all the ops gathered so far, and waits for them */
+    void stopWorkers() {
+        for ( int i = 0; i < _numWorkers; i++ )
+            dispatch( i );
+        if ( ! _threads )
+            return;
+        // an empty batch for each worker says there are no more
+        for ( int i = 0; i < _numWorkers; i++ )
+            _queues[i]->push( Batch() );
+        _threads->join_all();
+        _threads.reset();
+        _queues.clear();
+    }
+
+    void replayWorker( BlockingQueue<Batch>* batches ) {
+        try {
+            scoped_ptr<DBClientBase> c( createConnection( "admin" ) );
+            while ( Batch b = batches->blockingPop() ) {
+                int errors = applyBatch( *c , *b );
+                scoped_lock lk( _workerMutex );
+                _applied += b->size();
+                _errors += errors;
+            }
+            return;
+        }
+        catch ( std::exception& e ) {
+            log() << "exception:" << e.what() << endl;
+        }
+
+        // the ops still to come for this worker aren't applied
+        while ( Batch b = batches->blockingPop() ) {
+            scoped_lock lk( _workerMutex );
+            _errors += b->size();
+        }
+        scoped_lock lk( _workerMutex );
+        _errors++;
+    }
+
+    /** applies ops in one applyOps command. @return how many failed */
+    static int applyBatch( DBClientBase& c , const vector<BSONObj>& ops ) {
+        BSONObjBuilder b;
+        BSONArrayBuilder updates( b.subarrayStart( "applyOps" ) );
+        for ( size_t i = 0; i < ops.size(); i++ )
+            updates.append( ops[i] );
+        updates.done();
+
+        BSONObj res;
+        if ( c.runCommand( "admin" , b.obj() , res ) )
+            return 0;
+
+        if ( res["results"].type() != Array ) {
+            log() << "applyOps failed: " << res << endl;
+            return ops.size();
+        }
+        int errors = 0;
+        BSONObjIterator i( res["results"].Obj() );
+        for ( size_t n = 0; n < ops.size() && i.more(); n++ ) {
+            if ( i.next().trueValue() )
+                continue;
+            log() << "couldn't apply " << ops[n] << endl;
+            errors++;
+        }
+        return errors;
+    }
 };
 
 int main( int argc , char** argv ) {
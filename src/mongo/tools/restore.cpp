@@ -21,6 +21,7 @@
 #include <boost/filesystem/convenience.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/program_options.hpp>
+#include <boost/thread/thread.hpp>
 #include <fcntl.h>
 #include <fstream>
 #include <set>
@@ -53,7 +54,30 @@ public:
     string _curcoll;
     set<string> _users; // For restoring users with --drop
     auto_ptr<Matcher> _opmatcher; // For oplog replay
-    Restore() : BSONTool( "restore" ) , _drop(false) {
+
+    // the data files of ordinary collections, loaded once everything has been found
+    struct DataFile {
+        boost::filesystem::path file;
+        string ns;
+    };
+    vector<DataFile> _dataFiles;
+
+    // index builds wait until all the data is in, so they go through the bulk build
+    struct PendingIndex {
+        string ns;
+        BSONObj spec;
+        string fileName;
+    };
+    vector<PendingIndex> _pendingIndexes;
+    vector<DataFile> _indexFiles; // system.indexes.bson files
+
+    int _numParallel;
+    mongo::mutex _dataFilesMutex; // guards _nextDataFile and _dataError
+    size_t _nextDataFile;
+    string _dataError;
+
+    Restore() : BSONTool( "restore" ) , _drop(false) , _numParallel(1) ,
+                _dataFilesMutex( "Restore::_dataFiles" ) , _nextDataFile(0) {
         add_options()
         ("drop" , "drop each collection before import" )
         ("oplogReplay", "replay oplog for point-in-time restore")
@@ -62,6 +86,7 @@ public:
         ("noOptionsRestore" , "don't restore collection options")
         ("noIndexRestore" , "don't restore indexes")
         ("w" , po::value<int>()->default_value(1) , "minimum number of replicas per write" )
+        ("numParallelCollections" , po::value<int>()->default_value(4) , "number of collections to restore at once, each over its own connection" )
         ;
         add_hidden_options()
         ("dir", po::value<string>()->default_value("dump"), "directory to restore from")
@@ -100,6 +125,11 @@ public:
         _restoreIndexes = !hasParam("noIndexRestore");
         _w = getParam( "w" , 1 );
 
+        // a direct client and the filter's matcher are only for this thread
+        _numParallel = getParam( "numParallelCollections" , 4 );
+        if ( _numParallel < 1 || _host == "DIRECT" || hasFilter() )
+            _numParallel = 1;
+
         bool doOplog = hasParam( "oplogReplay" );
 
         if (doOplog) {
@@ -157,6 +187,8 @@ public:
          * .bson file, or a single .bson file itself (a collection).
          */
         drillDown(root, _db != "", _coll != "", true);
+        restoreData();
+        restoreIndexes();
 
         // should this happen for oplog replay as well?
         conn().getLastError();
@@ -225,6 +257,11 @@ public:
             return;
         }
 
+        if ( isLaterBSONSegment( root ) ) {
+            // so are the segments after the first of a collection dumped in parts
+            return;
+        }
+
         if ( ! ( endsWith( root.string().c_str() , ".bson" ) ||
                  endsWith( root.string().c_str() , ".bin" ) ) ) {
             error() << "don't know what to do with file [" << root.string() << "]" << endl;
@@ -316,6 +353,30 @@ public:
             createCollectionWithOptions(metadataObject["options"].Obj());
         }
 
+        if ( endsWith( _curns.c_str() , ".system.indexes" ) ) {
+            DataFile f = { root , ns };
+            _indexFiles.push_back( f );
+            return;
+        }
+
+        if (_restoreIndexes && metadataObject.hasField("indexes")) {
+            vector<BSONElement> indexes = metadataObject["indexes"].Array();
+            for (vector<BSONElement>::iterator it = indexes.begin(); it != indexes.end(); ++it) {
+                PendingIndex index = { ns , (*it).Obj().getOwned() , root.string() };
+                _pendingIndexes.push_back( index );
+            }
+        }
+
+        if ( ! startsWith( _curcoll , "system." ) ) {
+            // each segment of a collection dumped in parts is loaded on its own
+            vector<boost::filesystem::path> segments = bsonSegmentPaths( root );
+            for ( size_t i = 0; i < segments.size(); i++ ) {
+                DataFile f = { segments[i] , ns };
+                _dataFiles.push_back( f );
+            }
+            return;
+        }
+
         processFile( root );
         if (_drop && root.leaf() == "system.users.bson") {
             // Delete any users that used to exist but weren't in the dump file
@@ -325,13 +386,83 @@ public:
             }
             _users.clear();
         }
+    }
 
-        if (_restoreIndexes && metadataObject.hasField("indexes")) {
-            vector<BSONElement> indexes = metadataObject["indexes"].Array();
-            for (vector<BSONElement>::iterator it = indexes.begin(); it != indexes.end(); ++it) {
-                createIndex((*it).Obj(), false);
+    /**
+     * loads the data files found by drillDown(), several collections at once when there's
+     * more than one connection to do it with
+     */
+    void restoreData() {
+        if ( _dataFiles.empty() )
+            return;
+
+        size_t nThreads = min( _dataFiles.size() , (size_t) _numParallel );
+        if ( nThreads == 1 ) {
+            for ( size_t i = 0; i < _dataFiles.size(); i++ )
+                restoreDataFile( conn() , _dataFiles[i] );
+            return;
+        }
+
+        log() << "	 restoring " << _dataFiles.size() << " files over "
+              << nThreads << " connections" << endl;
+
+        boost::thread_group threads;
+        for ( size_t i = 0; i < nThreads; i++ )
+            threads.create_thread( boost::bind( &Restore::dataWorker , this ) );
+        threads.join_all();
+
+        uassert( 16383 , _dataError , _dataError.empty() );
+    }
+
+    void dataWorker() {
+        try {
+            scoped_ptr<DBClientBase> c( createConnection() );
+            while ( true ) {
+                DataFile f;
+                {
+                    scoped_lock lk( _dataFilesMutex );
+                    if ( _nextDataFile == _dataFiles.size() || ! _dataError.empty() )
+                        return;
+                    f = _dataFiles[_nextDataFile++];
+                }
+                restoreDataFile( *c , f );
             }
         }
+        catch ( DBException& e ) {
+            scoped_lock lk( _dataFilesMutex );
+            if ( _dataError.empty() )
+                _dataError = e.toString();
+        }
+    }
+
+    void restoreDataFile( DBClientBase& c , const DataFile& f ) {
+        log() << "	 loading " << f.file.string() << " into " << f.ns << endl;
+
+        BatchedInserter inserter( c , f.ns , _w );
+        processFile( f.file , boost::bind( &BatchedInserter::insert , &inserter , _1 ) );
+        inserter.flush();
+
+        // the index builds after this, on another connection, need the data to be there
+        c.getLastError();
+    }
+
+    /** creates the indexes, from the metadata files and then any system.indexes dumps */
+    void restoreIndexes() {
+        for ( size_t i = 0; i < _pendingIndexes.size(); i++ ) {
+            const PendingIndex& index = _pendingIndexes[i];
+            _curns = index.ns;
+            _curdb = NamespaceString(_curns).db;
+            _curcoll = NamespaceString(_curns).coll;
+            _fileName = index.fileName;
+            createIndex( index.spec , false );
+        }
+
+        for ( size_t i = 0; i < _indexFiles.size(); i++ ) {
+            _curns = _indexFiles[i].ns;
+            _curdb = NamespaceString(_curns).db;
+            _curcoll = NamespaceString(_curns).coll;
+            processFile( _indexFiles[i].file );
+        }
     }
 
     virtual void gotObject( const BSONObj& obj ) {
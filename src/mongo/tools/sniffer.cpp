@@ -37,6 +37,7 @@
 #include "../bson/util/builder.h"
 #include "../util/net/message.h"
 #include "../util/mmap.h"
+#include "../util/time_support.h"
 #include "../db/dbmessage.h"
 
 #include <stdio.h>
@@ -51,11 +52,19 @@
 #include <arpa/inet.h>
 #endif
 
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <map>
 #include <string>
+#include <vector>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 using namespace std;
 using mongo::Message;
@@ -79,6 +88,9 @@ set<int> serverPorts;
 string forwardAddress;
 bool objcheck = false;
 
+ofstream recordFile;
+long long packetMicros = 0; // capture time of the packet being processed
+
 ostream *outPtr = &cout;
 ostream &out() { return *outPtr; }
 
@@ -160,9 +172,38 @@ map< Connection, unsigned > expectedSeq;
 map< Connection, boost::shared_ptr<DBClientConnection> > forwarder;
 map< Connection, long long > lastCursor;
 map< Connection, map< long long, long long > > mapCursor;
+map< Connection, unsigned > connectionIds;
 
 void processMessage( Connection& c , Message& d );
 
+/* --record file format: each message is preceded by this header.  Requests are recorded whole;
+   of a reply only the header and the fixed QueryResult fields, which are enough to match the
+   cursor it returned to later getMores.  connection numbers the client connection, the same
+   for both directions. */
+struct ReplayRecord {
+    long long micros;
+    unsigned connection;
+    int len;
+};
+
+void recordMessage( const Connection& c , Message& m ) {
+    bool reply = m.operation() == mongo::opReply;
+    unsigned& id = connectionIds[ reply ? c.reverse() : c ];
+    if ( id == 0 )
+        id = connectionIds.size();
+
+    ReplayRecord r;
+    r.micros = packetMicros;
+    r.connection = id;
+    r.len = m.header()->len;
+    if ( reply ) {
+        QueryResult *qr = (QueryResult *) m.singleData();
+        r.len = (int) ( qr->data() - (const char *) qr );
+    }
+    recordFile.write( (const char *) &r , sizeof( r ) );
+    recordFile.write( (const char *) m.singleData() , r.len );
+}
+
 void got_packet(u_char *args, const struct pcap_pkthdr *header, const u_char *packet) {
 
     const struct sniff_ip* ip = (struct sniff_ip*)(packet + captureHeaderSize);
@@ -211,6 +252,7 @@ void got_packet(u_char *args, const struct pcap_pkthdr *header, const u_char *pa
     }
 
     expectedSeq[ c ] = ntohl( tcp->th_seq ) + size_payload;
+    packetMicros = (long long) header->ts.tv_sec * 1000000 + header->ts.tv_usec;
 
     Message m;
 
@@ -275,6 +317,9 @@ public:
 void processMessage( Connection& c , Message& m ) {
     AuditingDbMessage d(m);
 
+    if ( recordFile.is_open() )
+        recordMessage( c , m );
+
     if ( m.operation() == mongo::opReply )
         out() << " - " << (unsigned)m.header()->responseTo;
     out() << '\n';
@@ -425,11 +470,248 @@ void processDiagLog( const char * file ) {
     f.close();
 }
 
+/* --replay: one thread per recorded connection sends its requests on its own connection to
+   the target, each when it falls due relative to the start of the recording, so concurrency and
+   (scaled by --speed) timing are as they were captured. */
+
+double replaySpeed = 1; // 0 is as fast as possible
+
+const char *replayOpName( const Message& m ) {
+    switch ( m.operation() ) {
+    case mongo::dbQuery:
+        return mongo::str::endsWith( DbMessage( m ).getns(), ".$cmd" ) ? "command" : "query";
+    case mongo::dbGetMore: return "getmore";
+    case mongo::dbInsert: return "insert";
+    case mongo::dbUpdate: return "update";
+    case mongo::dbDelete: return "remove";
+    case mongo::dbKillCursors: return "killcursors";
+    default: return "other";
+    }
+}
+
+class ReplayConnection {
+public:
+    enum { MaxQueued = 1000 };
+
+    ReplayConnection( long long startMicros ) :
+        _startMicros( startMicros ), _done( false ), _maxLagMicros( 0 ) {
+    }
+
+    void start() {
+        _thread.reset( new boost::thread( boost::bind( &ReplayConnection::run, this ) ) );
+    }
+
+    /** @param offsetMicros when m is due, from the start of the replay */
+    void push( long long offsetMicros , boost::shared_ptr<Message> m ) {
+        boost::mutex::scoped_lock lk( _mutex );
+        while ( _queue.size() >= (size_t) MaxQueued )
+            _changed.wait( lk );
+        _queue.push_back( make_pair( offsetMicros, m ) );
+        _changed.notify_all();
+    }
+
+    void finish() {
+        {
+            boost::mutex::scoped_lock lk( _mutex );
+            _done = true;
+            _changed.notify_all();
+        }
+        _thread->join();
+    }
+
+    // latencies in micros of the round trips, by replayOpName(); writes only count as sent
+    map< string, vector<long long> > latencies;
+    map< string, long long > counts;
+    long long maxLagMicros() const { return _maxLagMicros; }
+
+private:
+    void run() {
+        DBClientConnection conn( true );
+        string errmsg;
+        bool connected = conn.connect( forwardAddress, errmsg );
+        if ( ! connected )
+            cerr << "replay can't connect to " << forwardAddress << ": " << errmsg << endl;
+
+        map< int, long long > newCursorFor;  // by recorded request id, until its reply is seen
+        map< long long, long long > cursors; // recorded cursor id to the target's
+
+        while ( true ) {
+            pair< long long, boost::shared_ptr<Message> > next;
+            {
+                boost::mutex::scoped_lock lk( _mutex );
+                while ( _queue.empty() && ! _done )
+                    _changed.wait( lk );
+                if ( _queue.empty() )
+                    return;
+                next = _queue.front();
+                _queue.pop_front();
+                _changed.notify_all();
+            }
+            if ( ! connected )
+                continue;
+
+            Message &m = *next.second;
+            if ( m.operation() == mongo::opReply ) {
+                QueryResult *qr = (QueryResult *) m.singleData();
+                map< int, long long >::iterator i = newCursorFor.find( qr->responseTo );
+                if ( i != newCursorFor.end() ) {
+                    if ( qr->cursorId )
+                        cursors[ qr->cursorId ] = i->second;
+                    newCursorFor.erase( i );
+                }
+                continue;
+            }
+
+            long long dueMicros = _startMicros + next.first;
+            long long nowMicros = (long long) mongo::curTimeMicros64();
+            if ( nowMicros < dueMicros )
+                mongo::sleepmicros( dueMicros - nowMicros );
+            else
+                _maxLagMicros = max( _maxLagMicros, nowMicros - dueMicros );
+
+            const char *name = replayOpName( m );
+            counts[ name ]++;
+            int recordedId = m.header()->id;
+            try {
+                if ( m.operation() == mongo::dbQuery || m.operation() == mongo::dbGetMore ) {
+                    if ( m.operation() == mongo::dbGetMore ) {
+                        DbMessage d( m );
+                        d.pullInt();
+                        long long &cId = d.pullInt64();
+                        cId = cursors[ cId ];
+                    }
+                    Message response;
+                    long long sent = (long long) mongo::curTimeMicros64();
+                    conn.port().call( m, response );
+                    latencies[ name ].push_back( (long long) mongo::curTimeMicros64() - sent );
+                    QueryResult *qr = (QueryResult *) response.singleData();
+                    if ( ! ( qr->resultFlags() & mongo::ResultFlag_CursorNotFound ) )
+                        newCursorFor[ recordedId ] = qr->cursorId;
+                }
+                else {
+                    conn.port().say( m );
+                }
+            }
+            catch ( std::exception& e ) {
+                cerr << "replay of " << name << " failed: " << e.what() << endl;
+                connected = conn.connect( forwardAddress, errmsg );
+            }
+        }
+    }
+
+    long long _startMicros;
+    boost::mutex _mutex;
+    boost::condition _changed;
+    deque< pair< long long, boost::shared_ptr<Message> > > _queue;
+    bool _done;
+    long long _maxLagMicros;
+    boost::shared_ptr<boost::thread> _thread;
+};
+
+long long percentile( const vector<long long>& sorted , double p ) {
+    if ( sorted.empty() )
+        return 0;
+    size_t i = (size_t) ( p * sorted.size() );
+    return sorted[ min( i, sorted.size() - 1 ) ];
+}
+
+int replayFile( const char *file ) {
+    ifstream in( file, ios::in | ios::binary );
+    if ( ! in ) {
+        cerr << "error opening recording " << file << endl;
+        return -1;
+    }
+
+    // the first op goes out a moment after the start, once its connection is up
+    long long startMicros = (long long) mongo::curTimeMicros64() + 100 * 1000;
+    long long firstMicros = -1;
+    map< unsigned, boost::shared_ptr<ReplayConnection> > connections;
+
+    ReplayRecord r;
+    while ( in.read( (char *) &r, sizeof( r ) ) ) {
+        if ( r.len < (int) sizeof( MsgData ) - 4 || r.len > 48 * 1024 * 1024 ) {
+            cerr << "bad record in " << file << ", stopping" << endl;
+            break;
+        }
+        char *buf = (char *) malloc( r.len );
+        if ( ! in.read( buf, r.len ) ) {
+            free( buf );
+            cerr << "truncated record in " << file << ", stopping" << endl;
+            break;
+        }
+        boost::shared_ptr<Message> m( new Message( buf, true ) );
+
+        if ( firstMicros < 0 )
+            firstMicros = r.micros;
+        long long offsetMicros = 0;
+        if ( replaySpeed > 0 )
+            offsetMicros = (long long) ( ( r.micros - firstMicros ) / replaySpeed );
+
+        boost::shared_ptr<ReplayConnection>& c = connections[ r.connection ];
+        if ( ! c ) {
+            c.reset( new ReplayConnection( startMicros ) );
+            c->start();
+        }
+        c->push( offsetMicros, m );
+    }
+
+    map< string, vector<long long> > latencies;
+    map< string, long long > counts;
+    long long total = 0;
+    long long maxLagMicros = 0;
+    for ( map< unsigned, boost::shared_ptr<ReplayConnection> >::iterator i = connections.begin();
+          i != connections.end(); ++i ) {
+        ReplayConnection &c = *i->second;
+        c.finish();
+        for ( map< string, long long >::iterator j = c.counts.begin(); j != c.counts.end(); ++j ) {
+            counts[ j->first ] += j->second;
+            total += j->second;
+        }
+        for ( map< string, vector<long long> >::iterator j = c.latencies.begin();
+              j != c.latencies.end(); ++j ) {
+            vector<long long> &all = latencies[ j->first ];
+            all.insert( all.end(), j->second.begin(), j->second.end() );
+        }
+        maxLagMicros = max( maxLagMicros, c.maxLagMicros() );
+    }
+    double seconds = ( (long long) mongo::curTimeMicros64() - startMicros ) / 1000000.0;
+
+    cout << "replayed " << total << " ops on " << connections.size() << " connections in "
+         << seconds << " seconds";
+    if ( seconds > 0 )
+        cout << " (" << (long long) ( total / seconds ) << " ops/sec)";
+    cout << "\nmost an op started behind schedule: " << maxLagMicros / 1000 << "ms\n\n";
+
+    cout << "op              count    p50us    p95us    p99us    maxus\n";
+    for ( map< string, long long >::iterator i = counts.begin(); i != counts.end(); ++i ) {
+        vector<long long> &l = latencies[ i->first ];
+        sort( l.begin(), l.end() );
+        cout << setw( 12 ) << left << i->first << right << setw( 9 ) << i->second;
+        if ( l.empty() )
+            cout << "        -        -        -        -";
+        else
+            cout << setw( 9 ) << percentile( l, 0.50 ) << setw( 9 ) << percentile( l, 0.95 )
+                 << setw( 9 ) << percentile( l, 0.99 ) << setw( 9 ) << l.back();
+        cout << '\n';
+    }
+    cout << endl;
+    return 0;
+}
+
 void usage() {
     cout <<
-         "Usage: mongosniff [--help] [--forward host:port] [--source (NET <interface> | (FILE | DIAGLOG) <filename>)] [<port0> <port1> ... ]\n"
+         "Usage: mongosniff [--help] [--forward host:port] [--source (NET <interface> | (FILE | DIAGLOG) <filename>)] [--record <file>] [<port0> <port1> ... ]\n"
+         "       mongosniff --replay <file> --forward host:port [--speed <n> | --speed max]\n"
          "--forward       Forward all parsed request messages to mongod instance at \n"
          "                specified host:port\n"
+         "--record        Save the messages, with their capture times, to a file for\n"
+         "                --replay.  Messages read from a diaglog have no times, and\n"
+         "                replay as fast as possible.\n"
+         "--replay        Send the requests saved by --record to the --forward host,\n"
+         "                one connection for each recorded, and each request when it\n"
+         "                was captured, then report the latencies seen.\n"
+         "--speed         Replay n times faster than recorded, or as fast as the\n"
+         "                server allows with max.  The default is 1.\n"
          "--source        Source of traffic to sniff, either a network interface or a\n"
          "                file containing previously captured packets in pcap format,\n"
          "                or a file containing output from mongod's --diaglog option.\n"
@@ -461,6 +743,7 @@ int main(int argc, char **argv) {
     bool replay = false;
     bool diaglog = false;
     const char *file = 0;
+    const char *replayPath = 0;
 
     vector< const char * > args;
     for( int i = 1; i < argc; ++i )
@@ -476,6 +759,19 @@ int main(int argc, char **argv) {
             else if ( arg == string( "--forward" ) ) {
                 forwardAddress = args[ ++i ];
             }
+            else if ( arg == string( "--record" ) ) {
+                recordFile.open( args[ ++i ], ios::out | ios::binary | ios::trunc );
+                uassert( 16391 , "can't open --record file" , recordFile.good() );
+            }
+            else if ( arg == string( "--replay" ) ) {
+                replayPath = args[ ++i ];
+            }
+            else if ( arg == string( "--speed" ) ) {
+                const char *speed = args[ ++i ];
+                replaySpeed = speed == string( "max" ) ? 0 : atof( speed );
+                uassert( 16392 , "--speed must be a positive number or max" ,
+                         replaySpeed > 0 || speed == string( "max" ) );
+            }
             else if ( arg == string( "--source" ) ) {
                 uassert( 10266 ,  "can't use --source twice" , source == false );
                 uassert( 10267 ,  "source needs more args" , args.size() > i + 2);
@@ -501,6 +797,14 @@ int main(int argc, char **argv) {
         return -1;
     }
 
+    if ( replayPath ) {
+        if ( forwardAddress.empty() ) {
+            cerr << "--replay needs a --forward host to replay to" << endl;
+            return -1;
+        }
+        return replayFile( replayPath );
+    }
+
     if ( !serverPorts.size() )
         serverPorts.insert( 27017 );
 
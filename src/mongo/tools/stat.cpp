@@ -50,6 +50,8 @@ namespace mongo {
             ("http", "use http instead of raw db connection")
             ("discover" , "discover nodes and display stats for all" )
             ("all" , "all optional fields" )
+            ("latencies" , "operation latency percentiles, and the longest journal remap and data file flush, from the server's histograms" )
+            ("intervalMillis" , po::value<int>() , "milliseconds between calls, for intervals shorter than a second" )
             ;
 
             addPositionArg( "sleep" , 1 );
@@ -83,6 +85,11 @@ namespace mongo {
             out << "   ar|aw    \t- active clients (read|write)\n";
             out << "   netIn    \t- network traffic in - bits\n";
             out << "   netOut   \t- network traffic out - bits\n";
+            out << "   lat50    \t- with --latencies, median op latency (from the server's power of two buckets; getmores left out)\n";
+            out << "   lat99    \t- with --latencies, 99th percentile op latency\n";
+            out << "   latmax   \t- with --latencies, longest op\n";
+            out << "   remapmax \t- with --latencies, longest journal remap of the private view\n";
+            out << "   flushmax \t- with --latencies, longest data file flush\n";
             out << "   conn     \t- number of open connections\n";
             out << "   set      \t- replica set name\n";
             out << "   repl     \t- replication type \n";
@@ -123,13 +130,26 @@ namespace mongo {
                 return e.embeddedObjectUserCheck();
             }
             BSONObj out;
-            if ( ! conn().simpleCommand( _db , &out , "serverStatus" ) ) {
+            if ( ! conn().runCommand( _db , statusCommand( _statUtil.getLatencies() ) , out ) ) {
                 cout << "error: " << out << endl;
                 return BSONObj();
             }
             return out.getOwned();
         }
 
+        /** serverStatus limited to what the columns need.  older servers send everything */
+        static BSONObj statusCommand( bool latencies ) {
+            BSONObjBuilder b;
+            b.append( "serverStatus" , 1 );
+            BSONArrayBuilder sections( b.subarrayStart( "sections" ) );
+            sections << "opcounters" << "repl" << "backgroundFlushing" << "mem" << "extra_info"
+                     << "globalLock" << "indexCounters" << "network" << "connections";
+            if ( latencies )
+                sections << "opLatencies" << "dur";
+            sections.done();
+            return b.obj();
+        }
+
 
         virtual void preSetup() {
             if ( hasParam( "http" ) ) {
@@ -150,7 +170,14 @@ namespace mongo {
 
         int run() {
             _statUtil.setSeconds( getParam( "sleep" , 1 ) );
+            if ( hasParam( "intervalMillis" ) )
+                _statUtil.setSeconds( getParam( "intervalMillis" , 1000 ) / 1000.0 );
+            if ( _statUtil.getSeconds() <= 0 ) {
+                cout << "the interval has to be more than 0" << endl;
+                return -1;
+            }
             _statUtil.setAll( hasParam( "all" ) );
+            _statUtil.setLatencies( hasParam( "latencies" ) );
             if ( _many )
                 return runMany();
             return runNormal();
@@ -209,7 +236,7 @@ namespace mongo {
                 return -1;
 
             while ( rowCount == 0 || rowNum < rowCount ) {
-                sleepsecs((int)ceil(_statUtil.getSeconds()));
+                sleepmillis( (long long) ( _statUtil.getSeconds() * 1000 ) );
                 BSONObj now;
                 try {
                     now = stats();
@@ -262,6 +289,7 @@ namespace mongo {
 
             string username;
             string password;
+            BSONObj command;
         };
 
         static void serverThread( shared_ptr<ServerState> state ) {
@@ -278,7 +306,7 @@ namespace mongo {
                 while ( ++cycleNumber ) {
                     try {
                         BSONObj out;
-                        if ( conn.simpleCommand( "admin" , &out , "serverStatus" ) ) {
+                        if ( conn.runCommand( "admin" , state->command , out ) ) {
                             scoped_lock lk( state->lock );
                             state->error = "";
                             state->lastUpdate = time(0);
@@ -331,6 +359,7 @@ namespace mongo {
 
             state.reset( new ServerState() );
             state->host = host;
+            state->command = statusCommand( _statUtil.getLatencies() );
             state->thr.reset( new boost::thread( boost::bind( serverThread , state ) ) );
             state->username = _username;
             state->password = _password;
@@ -421,7 +450,7 @@ namespace mongo {
             bool discover = hasParam( "discover" );
 
             while ( 1 ) {
-                sleepsecs( (int)ceil(_statUtil.getSeconds()) );
+                sleepmillis( (long long) ( _statUtil.getSeconds() * 1000 ) );
 
                 // collect data
                 vector<Row> rows;
@@ -25,7 +25,8 @@ namespace mongo {
 
     StatUtil::StatUtil( double seconds , bool all ) :
         _seconds( seconds ) ,
-        _all( all )
+        _all( all ) ,
+        _latencies( false )
         
     {
 
@@ -147,6 +148,37 @@ namespace mongo {
             _appendNet( result , "netOut" , diff( "bytesOut" , ax , bx ) );
         }
 
+        if ( _latencies && a["opLatencies"].isABSONObj() && b["opLatencies"].isABSONObj() ) {
+            BSONObj ax = a["opLatencies"].embeddedObject();
+            map<unsigned long long,long long> buckets;
+            BSONForEach( kind , b["opLatencies"].embeddedObject() ) {
+                // a getmore on a tailable cursor waits for data, which isn't a stall
+                if ( str::equals( kind.fieldName() , "getmore" ) || ! kind.isABSONObj() )
+                    continue;
+                BSONElement was = ax.getFieldDotted( string( kind.fieldName() ) + ".total" );
+                _histogramDiff( was.isABSONObj() ? was.Obj() : BSONObj() , kind.Obj()["total"].Obj() , buckets );
+            }
+            _appendMicros( result , "lat50" , _percentile( buckets , 0.5 ) );
+            _appendMicros( result , "lat99" , _percentile( buckets , 0.99 ) );
+            _appendMicros( result , "latmax" , _percentile( buckets , 1 ) );
+        }
+
+        if ( _latencies && b.getFieldDotted( "dur.latencies.remapPrivateView" ).isABSONObj() ) {
+            BSONElement was = a.getFieldDotted( "dur.latencies.remapPrivateView" );
+            map<unsigned long long,long long> buckets;
+            _histogramDiff( was.isABSONObj() ? was.Obj() : BSONObj() ,
+                            b.getFieldDotted( "dur.latencies.remapPrivateView" ).Obj() , buckets );
+            _appendMicros( result , "remapmax" , _percentile( buckets , 1 ) );
+        }
+
+        if ( _latencies && b.getFieldDotted( "backgroundFlushing.latencies" ).isABSONObj() ) {
+            BSONElement was = a.getFieldDotted( "backgroundFlushing.latencies" );
+            map<unsigned long long,long long> buckets;
+            _histogramDiff( was.isABSONObj() ? was.Obj() : BSONObj() ,
+                            b.getFieldDotted( "backgroundFlushing.latencies" ).Obj() , buckets );
+            _appendMicros( result , "flushmax" , _percentile( buckets , 1 ) );
+        }
+
         _append( result , "conn" , 5 , b.getFieldDotted( "connections.current" ).numberInt() );
 
         if ( b["repl"].type() == Object ) {
@@ -184,14 +216,17 @@ namespace mongo {
         }
 
         {
+            unsigned long long now = curTimeMillis64();
             struct tm t;
-            time_t_to_Struct( time(0), &t , true );
+            time_t_to_Struct( now / 1000, &t , true );
             stringstream temp;
             temp << setfill('0') << setw(2) << t.tm_hour
                  << ":"
                  << setfill('0') << setw(2) << t.tm_min
                  << ":"
                  << setfill('0') << setw(2) << t.tm_sec;
+            if ( _seconds < 1 )
+                temp << "." << setfill('0') << setw(3) << now % 1000;
             _append( result , "time" , 10 , temp.str() );
         }
         return result.obj();
@@ -220,6 +255,52 @@ namespace mongo {
     }
 
 
+    void StatUtil::_histogramDiff( const BSONObj& a , const BSONObj& b , map<unsigned long long,long long>& buckets ) {
+        BSONForEach( e , b ) {
+            long long n = e.numberLong() - a[e.fieldName()].numberLong();
+            if ( n <= 0 )
+                continue;
+            unsigned long long bound = str::equals( e.fieldName() , "more" ) ?
+                std::numeric_limits<unsigned long long>::max() : strtoull( e.fieldName() , 0 , 10 );
+            buckets[bound] += n;
+        }
+    }
+
+    unsigned long long StatUtil::_percentile( const map<unsigned long long,long long>& buckets , double p ) {
+        long long total = 0;
+        for ( map<unsigned long long,long long>::const_iterator i = buckets.begin(); i != buckets.end(); ++i )
+            total += i->second;
+        if ( total == 0 )
+            return 0;
+
+        long long target = (long long) ceil( total * p );
+        long long seen = 0;
+        for ( map<unsigned long long,long long>::const_iterator i = buckets.begin(); i != buckets.end(); ++i ) {
+            seen += i->second;
+            if ( seen >= target )
+                return i->first;
+        }
+        return buckets.rbegin()->first;
+    }
+
+    void StatUtil::_appendMicros( BSONObjBuilder& result , const string& name , unsigned long long micros ) {
+        string out;
+        if ( micros == 0 )
+            out = "-";
+        else if ( micros == std::numeric_limits<unsigned long long>::max() )
+            out = ">4.2s"; // past the last bucket of the server's histograms
+        else if ( micros < 1000 )
+            out = str::stream() << micros << "us";
+        else if ( micros < 1000000 )
+            out = str::stream() << micros / 1000 << "ms";
+        else {
+            stringstream ss;
+            ss << setprecision(2) << micros / 1000000.0 << "s";
+            out = ss.str();
+        }
+        _append( result , name , 6 , out );
+    }
+
     void StatUtil::_appendNet( BSONObjBuilder& result , const string& name , double diff ) {
         // I think 1000 is correct for megabit, but I've seen conflicting things (ERH 11/2010)
         const double div = 1000;
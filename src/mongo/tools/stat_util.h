@@ -42,9 +42,12 @@ namespace mongo {
 
         double getSeconds() const { return _seconds; }
         bool getAll() const { return _all; }
+        bool getLatencies() const { return _latencies; }
 
         void setSeconds( double seconds ) { _seconds = seconds; }
         void setAll( bool all ) { _all = all; }
+        /** show percentiles from the latency histograms, which need opLatencies and dur */
+        void setLatencies( bool latencies ) { _latencies = latencies; }
 
     private:
 
@@ -57,6 +60,18 @@ namespace mongo {
 
         void _appendNet( BSONObjBuilder& result , const string& name , double diff );
 
+        /** @param micros a histogram bucket's upper bound, or 0 for none */
+        void _appendMicros( BSONObjBuilder& result , const string& name , unsigned long long micros );
+
+        /**
+         * adds the counts which histogram report b has over report a to buckets, keyed by upper
+         * bound.  the bucket without one ("more") is keyed by the largest value.
+         */
+        static void _histogramDiff( const BSONObj& a , const BSONObj& b , map<unsigned long long,long long>& buckets );
+
+        /** @return the upper bound of the bucket holding fraction p of the counts, or 0 if none */
+        static unsigned long long _percentile( const map<unsigned long long,long long>& buckets , double p );
+
         template<typename T>
         void _append( BSONObjBuilder& result , const string& name , unsigned width , const T& t ) {
             if ( name.size() > width )
@@ -71,6 +86,7 @@ namespace mongo {
 
         double _seconds;
         bool _all;
+        bool _latencies;
         
     };
     
@@ -24,7 +24,9 @@
 #include "pcrecpp.h"
 
 #include "mongo/db/namespace_details.h"
+#include "mongo/util/compress.h"
 #include "mongo/util/file_allocator.h"
+#include "mongo/util/mmap.h"
 #include "mongo/util/password.h"
 #include "mongo/util/version.h"
 #include "mongo/client/dbclient_rs.h"
@@ -435,6 +437,30 @@ namespace mongo {
         throw UserException( 9997 , (string)"authentication failed: " + errmsg );
     }
 
+    DBClientBase* Tool::createConnection( string dbname ) {
+        uassert( 16380 , "can't open another connection with --dbpath" , _host != "DIRECT" );
+
+        if ( ! dbname.size() )
+            dbname = _db;
+
+        string errmsg;
+        ConnectionString cs = ConnectionString::parse( _host , errmsg );
+        uassert( 16381 , str::stream() << "invalid hostname [" << _host << "] " << errmsg ,
+                 cs.isValid() );
+
+        auto_ptr<DBClientBase> c( cs.connect( errmsg ) );
+        uassert( 16382 , str::stream() << "couldn't connect to [" << _host << "] " << errmsg ,
+                 c.get() );
+
+        if ( _username.size() || _password.size() ) {
+            if ( ! c->auth( dbname , _username , _password , errmsg ) &&
+                 ! c->auth( "admin" , _username , _password , errmsg ) )
+                throw UserException( 9997 , (string)"authentication failed: " + errmsg );
+        }
+
+        return c.release();
+    }
+
     BSONTool::BSONTool( const char * name, DBAccess access , bool objcheck )
         : Tool( name , access , "" , "" , false ) , _objcheck( objcheck ) {
 
@@ -454,72 +480,198 @@ namespace mongo {
         return doRun();
     }
 
+    namespace {
+
+        /**
+         * the bytes of a .bson file, in order.  the file is mapped when it can be, so objects
+         * are read in place, and otherwise each is read into a buffer.  what read() returns is
+         * valid until the next call.
+         */
+        class BSONFileInput : boost::noncopyable {
+        public:
+            BSONFileInput( const string& fileName , unsigned long long length ) :
+                _fileName( fileName ), _length( length ), _view( 0 ), _pos( 0 ), _readAhead( 0 ), _file( 0 ) {
+            }
+
+            ~BSONFileInput() {
+                if ( _file )
+                    fclose( _file );
+            }
+
+            /** @return false if the file can't be opened */
+            bool open() {
+                _view = (const char*) _mmf.mapWithOptions( _fileName.c_str() ,
+                                                           MongoFile::SEQUENTIAL | MongoFile::READONLY );
+                if ( _view ) {
+                    readAhead();
+                    return true;
+                }
+
+                // e.g. too big for a 32 bit address space
+                log(1) << "\t couldn't map " << _fileName << ", reading it instead" << endl;
+                _file = fopen( _fileName.c_str() , "rb" );
+                if ( ! _file )
+                    return false;
+#if !defined(__sunos__) && defined(POSIX_FADV_SEQUENTIAL)
+                posix_fadvise(fileno(_file), 0, _length, POSIX_FADV_SEQUENTIAL);
+#endif
+                _buf.reset( new char[BufSize] );
+                return true;
+            }
+
+            /** skips the n bytes at the start of the file if they're these. @return whether they were */
+            bool skipIf( const char* bytes , size_t n ) {
+                if ( _length < n )
+                    return false;
+                if ( _view ) {
+                    if ( memcmp( _view , bytes , n ) != 0 )
+                        return false;
+                    _pos = n;
+                    return true;
+                }
+                if ( fread( _buf.get() , 1 , n , _file ) == n && memcmp( _buf.get() , bytes , n ) == 0 ) {
+                    _pos = n;
+                    return true;
+                }
+                rewind( _file );
+                return false;
+            }
+
+            const char* read( size_t n ) {
+                uassert( 16388 , str::stream() << "unexpected end of file " << _fileName ,
+                         n <= _length - _pos );
+                if ( _view ) {
+                    const char* p = _view + _pos;
+                    _pos += n;
+                    if ( _pos > _readAhead )
+                        readAhead();
+                    return p;
+                }
+                uassert( 10264 , str::stream() << "invalid object size: " << n , n < (size_t) BufSize );
+                verify( fread( _buf.get() , 1 , n , _file ) == n );
+                _pos += n;
+                return _buf.get();
+            }
+
+            int readInt() {
+                int i;
+                memcpy( &i , read( 4 ) , 4 );
+                return i;
+            }
+
+            /** @return the next BSON object's data */
+            const char* readObject() {
+                uassert( 16388 , str::stream() << "unexpected end of file " << _fileName ,
+                         _length - _pos >= 4 );
+                if ( _view ) {
+                    int size = *(const int*)( _view + _pos );
+                    uassert( 10264 , str::stream() << "invalid object size: " << size , size >= 5 );
+                    return read( size );
+                }
+                // readInt() leaves the size at the start of the buffer, for the rest to follow
+                int size = readInt();
+                uassert( 10264 , str::stream() << "invalid object size: " << size ,
+                         size >= 5 && size < BufSize );
+                uassert( 16388 , str::stream() << "unexpected end of file " << _fileName ,
+                         (unsigned long long) size - 4 <= _length - _pos );
+                verify( fread( _buf.get() + 4 , 1 , size - 4 , _file ) == (size_t)( size - 4 ) );
+                _pos += size - 4;
+                return _buf.get();
+            }
+
+            enum { BufSize = BSONObjMaxUserSize + ( 1024 * 1024 ) };
+
+        private:
+            // asks for the next ReadAheadSize bytes to be read in before they're reached
+            void readAhead() {
+                if ( _readAhead >= _length )
+                    return;
+                unsigned long long n = min( (unsigned long long) ReadAheadSize , _length - _readAhead );
+                MAdvise::willNeed( (void*)( _view + _readAhead ) , (unsigned) n );
+                _readAhead += n;
+            }
+
+            enum { ReadAheadSize = 32 * 1024 * 1024 };
+
+            const string _fileName;
+            const unsigned long long _length;
+
+            MemoryMappedFile _mmf;
+            const char* _view;
+            unsigned long long _pos;
+            unsigned long long _readAhead; // where the range asked for ends
+
+            FILE* _file;
+            boost::scoped_array<char> _buf;
+        };
+
+    }
+
     long long BSONTool::processFile( const boost::filesystem::path& root ) {
         _fileName = root.string();
+        return processFile( root , boost::bind( &BSONTool::gotObject , this , _1 ) );
+    }
+
+    long long BSONTool::processFile( const boost::filesystem::path& root ,
+                                     const boost::function<void (const BSONObj&)>& sink ) {
+        const string fileName = root.string();
 
         unsigned long long fileLength = file_size( root );
 
         if ( fileLength == 0 ) {
-            out() << "file " << _fileName << " empty, skipping" << endl;
+            out() << "file " << fileName << " empty, skipping" << endl;
             return 0;
         }
 
 
-        FILE* file = fopen( _fileName.c_str() , "rb" );
-        if ( ! file ) {
-            log() << "error opening file: " << _fileName << " " << errnoWithDescription() << endl;
+        BSONFileInput input( fileName , fileLength );
+        if ( ! input.open() ) {
+            log() << "error opening file: " << fileName << " " << errnoWithDescription() << endl;
             return 0;
         }
 
-#if !defined(__sunos__) && defined(POSIX_FADV_SEQUENTIAL)
-        posix_fadvise(fileno(file), 0, fileLength, POSIX_FADV_SEQUENTIAL);
-#endif
-
         log(1) << "\t file size: " << fileLength << endl;
 
         unsigned long long read = 0;
         unsigned long long num = 0;
         unsigned long long processed = 0;
 
-        const int BUF_SIZE = BSONObjMaxUserSize + ( 1024 * 1024 );
-        boost::scoped_array<char> buf_holder(new char[BUF_SIZE]);
-        char * buf = buf_holder.get();
-
         ProgressMeter m( fileLength );
         m.setUnits( "bytes" );
 
+        const bool compressed = input.skipIf( compressedBSONMagic , sizeof(compressedBSONMagic) );
+        if ( compressed ) {
+            read += sizeof(compressedBSONMagic);
+            m.hit( sizeof(compressedBSONMagic) );
+        }
+
+        string block;
         while ( read < fileLength ) {
-            size_t amt = fread(buf, 1, 4, file);
-            verify( amt == 4 );
-
-            int size = ((int*)buf)[0];
-            uassert( 10264 , str::stream() << "invalid object size: " << size , size < BUF_SIZE );
-
-            amt = fread(buf+4, 1, size-4, file);
-            verify( amt == (size_t)( size - 4 ) );
-
-            BSONObj o( buf );
-            if ( _objcheck && ! o.valid() ) {
-                cerr << "INVALID OBJECT - going try and pring out " << endl;
-                cerr << "size: " << size << endl;
-                BSONObjIterator i(o);
-                while ( i.more() ) {
-                    BSONElement e = i.next();
-                    try {
-                        e.validate();
-                    }
-                    catch ( ... ) {
-                        cerr << "\t\t NEXT ONE IS INVALID" << endl;
-                    }
-                    cerr << "\t name : " << e.fieldName() << " " << e.type() << endl;
-                    cerr << "\t " << e << endl;
+            if ( compressed ) {
+                int blockSize = input.readInt();
+                uassert( 16384 , str::stream() << "invalid compressed block size: " << blockSize ,
+                         blockSize > 0 && blockSize < BSONFileInput::BufSize );
+                const char* compressedBlock = input.read( blockSize );
+                uassert( 16385 , "couldn't uncompress block" , uncompress( compressedBlock , blockSize , &block ) );
+
+                for ( size_t pos = 0; pos < block.size(); num++ ) {
+                    uassert( 16386 , "truncated object in compressed block" ,
+                             block.size() - pos >= 4 &&
+                             *(int*)( block.data() + pos ) <= (int)( block.size() - pos ) );
+                    BSONObj o( block.data() + pos );
+                    if ( processObject( o , sink ) )
+                        processed++;
+                    pos += o.objsize();
                 }
+
+                read += 4 + blockSize;
+                m.hit( 4 + blockSize );
+                continue;
             }
 
-            if ( _matcher.get() == 0 || _matcher->matches( o ) ) {
-                gotObject( o );
+            BSONObj o( input.readObject() );
+            if ( processObject( o , sink ) )
                 processed++;
-            }
 
             read += o.objsize();
             num++;
@@ -527,15 +679,124 @@ namespace mongo {
             m.hit( o.objsize() );
         }
 
-        fclose( file );
-
         uassert( 10265 ,  "counts don't match" , m.done() == fileLength );
-        (_usesstdout ? cout : cerr ) << m.hits() << " objects found" << endl;
+        (_usesstdout ? cout : cerr ) << num << " objects found" << endl;
         if ( _matcher.get() )
             (_usesstdout ? cout : cerr ) << processed << " objects processed" << endl;
         return processed;
     }
 
+    bool BSONTool::processObject( const BSONObj& o , const boost::function<void (const BSONObj&)>& sink ) {
+        if ( _objcheck && ! o.valid() ) {
+            cerr << "INVALID OBJECT - going try and pring out " << endl;
+            cerr << "size: " << o.objsize() << endl;
+            BSONObjIterator i(o);
+            while ( i.more() ) {
+                BSONElement e = i.next();
+                try {
+                    e.validate();
+                }
+                catch ( ... ) {
+                    cerr << "\t\t NEXT ONE IS INVALID" << endl;
+                }
+                cerr << "\t name : " << e.fieldName() << " " << e.type() << endl;
+                cerr << "\t " << e << endl;
+            }
+        }
+
+        if ( _matcher.get() != 0 && ! _matcher->matches( o ) )
+            return false;
+        sink( o );
+        return true;
+    }
+
+    BatchedInserter::BatchedInserter( DBClientBase& conn , const string& ns , int w , int maxObjects )
+        : _conn( conn ) , _ns( ns ) , _w( w ) , _maxObjects( maxObjects ) , _bytes( 0 ) {
+    }
+
+    void BatchedInserter::insert( const BSONObj& obj ) {
+        if ( ! _batch.empty() && ( _bytes + obj.objsize() > BSONObjMaxUserSize ||
+                                   ( _maxObjects && (int) _batch.size() >= _maxObjects ) ) )
+            flush();
+        _batch.push_back( obj.getOwned() );
+        _bytes += obj.objsize();
+    }
+
+    void BatchedInserter::flush() {
+        if ( _batch.empty() )
+            return;
+
+        _conn.insert( _ns , _batch , InsertOption_ContinueOnError );
+
+        // wait for the batch to propagate to "w" nodes (doesn't warn if w used without replset)
+        if ( _w > 1 )
+            _conn.getLastErrorDetailed( false , false , _w );
+
+        _batch.clear();
+        _bytes = 0;
+    }
+
+    const char compressedBSONMagic[8] = { 0 , 0 , 0 , 0 , 's' , 'n' , 'p' , 'y' };
+
+    BSONOutput::BSONOutput( FILE* out , bool compressed ) : _out( out ), _compressed( compressed ), _count( 0 ) {
+        if ( _compressed )
+            write( compressedBSONMagic , sizeof( compressedBSONMagic ) );
+    }
+
+    void BSONOutput::append( const BSONObj& obj ) {
+        _count++;
+        if ( ! _compressed ) {
+            write( obj.objdata() , obj.objsize() );
+            return;
+        }
+        _block.append( obj.objdata() , obj.objsize() );
+        if ( _block.size() >= (size_t) compressedBSONBlockSize )
+            flush();
+    }
+
+    void BSONOutput::flush() {
+        if ( _block.empty() )
+            return;
+        string compressedBlock;
+        compress( _block.data() , _block.size() , &compressedBlock );
+        int size = compressedBlock.size();
+        write( (const char*) &size , 4 );
+        write( compressedBlock.data() , compressedBlock.size() );
+        _block.clear();
+    }
+
+    void BSONOutput::write( const char* data , size_t toWrite ) {
+        size_t written = 0;
+        while ( toWrite ) {
+            size_t ret = fwrite( data + written , 1 , toWrite , _out );
+            uassert( 14035 , errnoWithPrefix( "couldn't write to file" ) , ret );
+            toWrite -= ret;
+            written += ret;
+        }
+    }
+
+    boost::filesystem::path bsonSegmentPath( const boost::filesystem::path& first , int n ) {
+        if ( n == 0 )
+            return first;
+        return first.branch_path() / ( first.leaf() + "." + BSONObjBuilder::numStr( n ) );
+    }
+
+    vector<boost::filesystem::path> bsonSegmentPaths( const boost::filesystem::path& first ) {
+        vector<boost::filesystem::path> paths( 1 , first );
+        while ( boost::filesystem::exists( bsonSegmentPath( first , paths.size() ) ) )
+            paths.push_back( bsonSegmentPath( first , paths.size() ) );
+        return paths;
+    }
+
+    bool isLaterBSONSegment( const boost::filesystem::path& file ) {
+        const string leaf = file.leaf();
+        size_t dot = leaf.find_last_of( '.' );
+        if ( dot == string::npos || dot + 1 == leaf.size() ||
+             leaf.find_first_not_of( "0123456789" , dot + 1 ) != string::npos )
+            return false;
+        return endsWith( leaf.substr( 0 , dot ).c_str() , ".bson" );
+    }
+
 
 
     void setupSignals( bool inFork ) {}
@@ -105,6 +105,12 @@ namespace mongo {
         mongo::DBClientBase &conn( bool slaveIfPaired = false );
         void auth( string db = "",  Auth::Level * level = NULL);
 
+        /**
+         * opens another connection to the same server, authenticated as conn() is, for a
+         * thread of its own.  the caller owns it.  not possible with --dbpath.
+         */
+        mongo::DBClientBase* createConnection( string db = "" );
+
         string _name;
 
         string _db;
@@ -155,6 +161,86 @@ namespace mongo {
 
         long long processFile( const boost::filesystem::path& file );
 
+        /**
+         * like processFile(), but hands each object to sink instead of gotObject().  the
+         * object is only valid during the call.  safe to use from several threads at once.
+         */
+        long long processFile( const boost::filesystem::path& file ,
+                               const boost::function<void (const BSONObj&)>& sink );
+
+        /** whether a --filter was given, which only one thread at a time may use */
+        bool hasFilter() const { return _matcher.get() != 0; }
+
+    private:
+        /** checks o if asked to and gives it to sink if it matches. @return whether it did */
+        bool processObject( const BSONObj& o , const boost::function<void (const BSONObj&)>& sink );
+    };
+
+    /**
+     * gathers the documents of one collection into as few insert messages as it can, of at
+     * most maxObjects documents if that's given.  like single inserts, a failed document
+     * doesn't stop the rest.
+     */
+    class BatchedInserter : boost::noncopyable {
+    public:
+        BatchedInserter( DBClientBase& conn , const string& ns , int w = 0 , int maxObjects = 0 );
+
+        void insert( const BSONObj& obj );
+
+        /** sends what's gathered, waiting for it to reach w nodes if w is more than one */
+        void flush();
+
+    private:
+        DBClientBase& _conn;
+        const string _ns;
+        const int _w;
+        const int _maxObjects;
+        vector<BSONObj> _batch;
+        int _bytes;
+    };
+
+    /**
+     * a .bson file may be compressed.  one that is starts with compressedBSONMagic, which no
+     * BSON object can start with, followed by blocks of an int length and that many bytes of
+     * snappy compressed BSON objects laid end to end.
+     */
+    extern const char compressedBSONMagic[8];
+
+    /** how many bytes of objects mongodump collects before compressing them as a block */
+    const int compressedBSONBlockSize = 1024 * 1024;
+
+    /** writes BSONObjs to a file, in compressed blocks if asked to.  flush() before closing it */
+    class BSONOutput : boost::noncopyable {
+    public:
+        BSONOutput( FILE* out , bool compressed );
+
+        void append( const BSONObj& obj );
+
+        /** writes out the objects not yet in a compressed block */
+        void flush();
+
+        long long count() const { return _count; }
+
+    private:
+        void write( const char* data , size_t toWrite );
+
+        FILE* _out;
+        bool _compressed;
+        string _block;
+        long long _count;
     };
 
+    /**
+     * a collection dumped in several _id ranges at once is in numbered segments: the first
+     * in <coll>.bson as usual, then <coll>.bson.1, <coll>.bson.2 and so on.
+     * @return the file segment n of the collection whose first file is given is in
+     */
+    boost::filesystem::path bsonSegmentPath( const boost::filesystem::path& first , int n );
+
+    /** @return the collection's first file and any later segments of it, in order */
+    vector<boost::filesystem::path> bsonSegmentPaths( const boost::filesystem::path& first );
+
+    /** @return whether file is one of the segments after the first, read along with it */
+    bool isLaterBSONSegment( const boost::filesystem::path& file );
+
 }
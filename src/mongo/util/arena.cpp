@@ -0,0 +1,185 @@
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+
+#include "mongo/util/arena.h"
+
+#include "mongo/db/jsobj.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/util/concurrency/threadlocal.h"
+
+namespace mongo {
+
+    static ThreadLocalValue<Arena*> currentArena;
+
+    static AtomicUInt64 highWaterBytes;   // most one operation has taken from its arena
+    static AtomicInt64 reservedBytes;     // chunks held by all arenas
+    static AtomicUInt64 chunksAllocated;
+    static AtomicUInt64 resets;
+    static AtomicUInt64 fallbacks;
+
+    static size_t rounded( size_t sz ) {
+        return ( sz + 7 ) & ~size_t( 7 );
+    }
+
+    Arena::Arena() :
+        _chunk(0),
+        _used(0),
+        _inUse(0),
+        _peak(0),
+        _last(0),
+        _generation(0) {
+    }
+
+    Arena::~Arena() {
+        for ( unsigned i = 0; i < _chunks.size(); i++ )
+            free( _chunks[i] );
+        reservedBytes.fetchAndSubtract( (long long) _chunks.size() * ChunkSize );
+    }
+
+    char* Arena::chunkFor( size_t sz ) {
+        if ( _chunk < _chunks.size() && _used + sz <= (size_t) ChunkSize )
+            return _chunks[_chunk] + _used;
+        if ( _chunk < _chunks.size() ) {
+            // what's left of this chunk is wasted until the reset
+            _inUse += ChunkSize - _used;
+            _chunk++;
+        }
+        if ( _chunk == _chunks.size() ) {
+            char *c = (char *) malloc( ChunkSize );
+            if ( c == 0 )
+                return 0;
+            _chunks.push_back( c );
+            reservedBytes.fetchAndAdd( ChunkSize );
+            chunksAllocated.fetchAndAdd( 1 );
+        }
+        _used = 0;
+        return _chunks[_chunk];
+    }
+
+    void* Arena::allocate( size_t sz ) {
+        if ( sz > (size_t) MaxAllocation )
+            return 0;
+        sz = rounded( sz );
+        char *p = chunkFor( sz );
+        if ( p == 0 )
+            return 0;
+        _used += sz;
+        _inUse += sz;
+        if ( _inUse > _peak )
+            _peak = _inUse;
+        _last = p;
+        return p;
+    }
+
+    bool Arena::extend( void *p, size_t oldSize, size_t newSize ) {
+        if ( p != _last )
+            return false;
+        oldSize = rounded( oldSize );
+        newSize = rounded( newSize );
+        if ( newSize > (size_t) MaxAllocation || _used - oldSize + newSize > (size_t) ChunkSize )
+            return false;
+        _used += newSize - oldSize;
+        _inUse += newSize - oldSize;
+        if ( _inUse > _peak )
+            _peak = _inUse;
+        return true;
+    }
+
+    void Arena::release( void *p, size_t sz ) {
+        if ( p != _last )
+            return;
+        sz = rounded( sz );
+        _used -= sz;
+        _inUse -= sz;
+        _last = 0;
+    }
+
+    void Arena::reset() {
+        unsigned long long peak = _peak;
+        unsigned long long high = highWaterBytes.load();
+        while ( peak > high ) {
+            unsigned long long was = highWaterBytes.compareAndSwap( high, peak );
+            if ( was == high )
+                break;
+            high = was;
+        }
+        resets.fetchAndAdd( 1 );
+
+        // the first chunk covers most requests; an outsized one shouldn't pin the rest
+        for ( unsigned i = 1; i < _chunks.size(); i++ )
+            free( _chunks[i] );
+        if ( _chunks.size() > 1 ) {
+            reservedBytes.fetchAndSubtract( (long long) ( _chunks.size() - 1 ) * ChunkSize );
+            _chunks.resize( 1 );
+        }
+        _chunk = 0;
+        _used = 0;
+        _inUse = 0;
+        _peak = 0;
+        _last = 0;
+        _generation++;
+    }
+
+    Arena* Arena::current() {
+        return currentArena.get();
+    }
+
+    Arena::Scope::Scope( Arena &a ) : _arena(0) {
+        if ( currentArena.get() == 0 ) {
+            _arena = &a;
+            currentArena.set( _arena );
+        }
+    }
+
+    Arena::Scope::~Scope() {
+        if ( _arena ) {
+            currentArena.set( 0 );
+            _arena->reset();
+        }
+    }
+
+    ArenaBlock::ArenaBlock( int size ) : _block(0), _blockSize(size), _arena(Arena::current()), _generation(0) {
+        if ( _arena == 0 )
+            return;
+        _block = (char *) _arena->allocate( size );
+        if ( _block == 0 ) {
+            Arena::noteFallback();
+            _arena = 0;
+            return;
+        }
+        _generation = _arena->generation();
+    }
+
+    ArenaBlock::~ArenaBlock() {
+        if ( _arena && _arena->generation() == _generation )
+            _arena->release( _block, _blockSize );
+    }
+
+    void Arena::noteFallback() {
+        fallbacks.fetchAndAdd( 1 );
+    }
+
+    void Arena::appendStats( BSONObjBuilder &b ) {
+        b.appendNumber( "highWaterBytes" , (long long) highWaterBytes.load() );
+        b.appendNumber( "reservedBytes" , reservedBytes.load() );
+        b.appendNumber( "chunksAllocated" , (long long) chunksAllocated.load() );
+        b.appendNumber( "resets" , (long long) resets.load() );
+        b.appendNumber( "fallbacks" , (long long) fallbacks.load() );
+    }
+
+} // namespace mongo
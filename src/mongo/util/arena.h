@@ -0,0 +1,190 @@
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "mongo/bson/util/builder.h"
+#include "mongo/db/jsobj.h"
+
+namespace mongo {
+
+    /**
+     * A bump allocator for memory which only lives as long as one request.  Each Client owns
+     * one, and assembleResponse() opens an Arena::Scope around every operation, which resets
+     * the arena when the operation ends.  Nothing is freed before then, except the most recent
+     * allocation, which may be given back or grown in place.
+     *
+     * Only the thread owning the Client uses its arena.  Requests larger than MaxAllocation,
+     * and those made while no scope is open, are left to malloc by ArenaAllocator.
+     */
+    class Arena : boost::noncopyable {
+    public:
+        enum { ChunkSize = 32 * 1024, MaxAllocation = 16 * 1024 };
+
+        Arena();
+        ~Arena();
+
+        /** @return sz bytes, or 0 if sz is more than MaxAllocation */
+        void* allocate( size_t sz );
+
+        /** grows the most recent allocation in place. @return false if it can't be */
+        bool extend( void *p, size_t oldSize, size_t newSize );
+
+        /** gives back the most recent allocation; anything else waits for reset() */
+        void release( void *p, size_t sz );
+
+        /** frees everything allocated, keeping the first chunk for the next request */
+        void reset();
+
+        /** changes on each reset(), so stale allocations can be recognized */
+        unsigned generation() const { return _generation; }
+
+        /** @return the arena of the current operation on this thread, or 0 */
+        static Arena* current();
+
+        /** makes 'a' this thread's current arena, unless one already is, until destroyed */
+        class Scope : boost::noncopyable {
+        public:
+            Scope( Arena &a );
+            ~Scope();
+        private:
+            Arena *_arena;
+        };
+
+        /** high water marks over all arenas, for serverStatus */
+        static void appendStats( BSONObjBuilder &b );
+
+        /** counts an allocation ArenaAllocator had to leave to malloc */
+        static void noteFallback();
+
+    private:
+        char* chunkFor( size_t sz );
+
+        std::vector<char*> _chunks;
+        unsigned _chunk;   // index of the chunk being allocated from
+        size_t _used;      // bytes used in that chunk
+        size_t _inUse;     // bytes allocated since the last reset
+        size_t _peak;      // the most _inUse reached since the last reset
+        char *_last;       // most recent allocation
+        unsigned _generation;
+    };
+
+    /**
+     * An Allocator for _BufBuilder and StringBuilderImpl which draws from the current
+     * operation's arena.  Like StackAllocator it tracks the single buffer its builder owns.
+     */
+    class ArenaAllocator {
+    public:
+        ArenaAllocator() : _arena(0), _generation(0), _size(0) { }
+
+        void* Malloc( size_t sz ) {
+            Arena *a = Arena::current();
+            if ( a ) {
+                void *p = a->allocate( sz );
+                if ( p ) {
+                    _arena = a;
+                    _generation = a->generation();
+                    _size = sz;
+                    return p;
+                }
+            }
+            Arena::noteFallback();
+            _arena = 0;
+            return malloc( sz );
+        }
+
+        void* Realloc( void *p, size_t sz ) {
+            if ( _arena == 0 )
+                return realloc( p, sz );
+            dassert( _arena->generation() == _generation );
+            if ( _arena->extend( p, _size, sz ) ) {
+                _size = sz;
+                return p;
+            }
+            void *d = _arena->allocate( sz );
+            if ( d == 0 ) {
+                Arena::noteFallback();
+                d = malloc( sz );
+                if ( d == 0 )
+                    return 0;
+                memcpy( d, p, _size );
+                _arena = 0;
+                return d;
+            }
+            memcpy( d, p, _size );
+            _size = sz;
+            return d;
+        }
+
+        void Free( void *p ) {
+            if ( _arena == 0 ) {
+                free( p );
+                return;
+            }
+            // after a reset the memory has already been reclaimed
+            if ( _arena->generation() == _generation )
+                _arena->release( p, _size );
+            _arena = 0;
+        }
+
+    private:
+        Arena *_arena; // 0 when the buffer came from malloc
+        unsigned _generation;
+        size_t _size;
+    };
+
+    /**
+     * A BufBuilder for buffers which are finished with before the operation ends.  Like
+     * StackBufBuilder, the buffer can't be decoupled.
+     */
+    class ArenaBufBuilder : public _BufBuilder<ArenaAllocator> {
+    public:
+        ArenaBufBuilder( int initsize = 512 ) : _BufBuilder<ArenaAllocator>( initsize ) { }
+        void decouple(); // not allowed. not implemented.
+    };
+
+    /** a StringBuilder whose buffer comes from the current operation's arena */
+    typedef StringBuilderImpl<ArenaAllocator> ArenaStringBuilder;
+
+    /** a block of the current operation's arena, given back when done with if it can be */
+    class ArenaBlock : boost::noncopyable {
+    public:
+        ArenaBlock( int size );
+        ~ArenaBlock();
+    protected:
+        char *_block;    // 0 when there's no arena, or size is more than it hands out
+        int _blockSize;
+    private:
+        Arena *_arena;
+        unsigned _generation;
+    };
+
+    /**
+     * A BSONObjBuilder which starts out in the current operation's arena, for objects that are
+     * finished with, or copied out with obj(), before the operation ends.  Outgrowing its block,
+     * or without an arena, it carries on on the heap.
+     */
+    class ArenaBSONObjBuilder : private ArenaBlock, public BSONObjBuilder {
+    public:
+        ArenaBSONObjBuilder( int initsize = 512 ) :
+            ArenaBlock( initsize ), BSONObjBuilder( _block , initsize ) { }
+    };
+
+} // namespace mongo
@@ -16,6 +16,8 @@
  *    limitations under the License.
  */
 
+#include <algorithm>
+
 namespace mongo {
 
     /*
@@ -58,10 +60,20 @@ namespace mongo {
             qsort( _data , _size , sizeof(T) , comp );
         }
 
+        /** sort with a std::sort style "less than" functor */
+        template< class Less >
+        void sort( const Less& less ) {
+            std::sort( _data , _data + _size , less );
+        }
+
         int size() {
             return _size;
         }
 
+        T * data() {
+            return _data;
+        }
+
         bool hasSpace() {
             return _size < _capacity;
         }
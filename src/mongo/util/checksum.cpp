@@ -0,0 +1,126 @@
+// checksum.cpp
+
+/*    Copyright 2012 10gen Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "pch.h"
+
+#include "mongo/util/checksum.h"
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#include <nmmintrin.h>
+#define MONGO_CRC32C_X64 1
+#elif defined(__GNUC__) && defined(__x86_64__)
+#include <cpuid.h>
+#define MONGO_CRC32C_X64 1
+#endif
+
+namespace mongo {
+
+    namespace {
+
+        /** the byte at a time table for the reflected polynomial 0x82f63b78 */
+        struct Crc32cTable {
+            unsigned t[256];
+            Crc32cTable() {
+                for ( unsigned i = 0; i < 256; i++ ) {
+                    unsigned c = i;
+                    for ( int k = 0; k < 8; k++ )
+                        c = c & 1 ? ( c >> 1 ) ^ 0x82f63b78 : c >> 1;
+                    t[i] = c;
+                }
+            }
+        } table;
+
+        unsigned crc32cSoftware( const unsigned char *p, size_t len, unsigned c ) {
+            while ( len-- )
+                c = table.t[ ( c ^ *p++ ) & 0xff ] ^ ( c >> 8 );
+            return c;
+        }
+
+#if defined(MONGO_CRC32C_X64)
+        bool haveSSE42() {
+#if defined(_MSC_VER)
+            int info[4];
+            __cpuid( info, 1 );
+            return ( info[2] & ( 1 << 20 ) ) != 0;
+#else
+            unsigned a, b, c, d;
+            if ( !__get_cpuid( 1, &a, &b, &c, &d ) )
+                return false;
+            return ( c & ( 1 << 20 ) ) != 0;
+#endif
+        }
+        const bool sse42 = haveSSE42();
+
+        inline unsigned long long crc32u64( unsigned long long c, unsigned long long v ) {
+#if defined(_MSC_VER)
+            return _mm_crc32_u64( c, v );
+#else
+            // as an instruction rather than the intrinsic, which would need -msse4.2 for the file
+            __asm__( "crc32q %1, %0" : "+r" ( c ) : "rm" ( v ) );
+            return c;
+#endif
+        }
+
+        inline unsigned crc32u8( unsigned c, unsigned char v ) {
+#if defined(_MSC_VER)
+            return _mm_crc32_u8( c, v );
+#else
+            __asm__( "crc32b %1, %0" : "+r" ( c ) : "rm" ( v ) );
+            return c;
+#endif
+        }
+
+        unsigned crc32cSSE42( const unsigned char *p, size_t len, unsigned c ) {
+            // up to an 8 byte boundary, then 8 at a time
+            while ( len && ( (size_t) p & 7 ) ) {
+                c = crc32u8( c, *p++ );
+                len--;
+            }
+            unsigned long long c64 = c;
+            while ( len >= 8 ) {
+                c64 = crc32u64( c64, *(const unsigned long long *) p );
+                p += 8;
+                len -= 8;
+            }
+            c = (unsigned) c64;
+            while ( len-- )
+                c = crc32u8( c, *p++ );
+            return c;
+        }
+#endif
+
+    } // namespace
+
+    bool crc32cHardware() {
+#if defined(MONGO_CRC32C_X64)
+        return sse42;
+#else
+        return false;
+#endif
+    }
+
+    unsigned crc32c( const void *buf, size_t len, unsigned crc ) {
+        const unsigned char *p = (const unsigned char *) buf;
+#if defined(MONGO_CRC32C_X64)
+        if ( sse42 )
+            return ~crc32cSSE42( p, len, ~crc );
+#endif
+        return ~crc32cSoftware( p, len, ~crc );
+    }
+
+} // namespace mongo
@@ -34,4 +34,13 @@ namespace mongo {
         bool operator==(const Checksum& rhs) const { return words[0]==rhs.words[0] && words[1]==rhs.words[1]; }
         bool operator!=(const Checksum& rhs) const { return words[0]!=rhs.words[0] || words[1]!=rhs.words[1]; }
     };
+
+    /** CRC32C (the Castagnoli polynomial) of len bytes at buf, continuing from crc.  uses SSE 4.2's
+        crc32 instruction when the cpu has it, a table otherwise; both give the same value.
+        crc32c("123456789", 9) == 0xe3069283
+    */
+    unsigned crc32c(const void *buf, size_t len, unsigned crc = 0);
+
+    /** true if crc32c() has the instruction to use */
+    bool crc32cHardware();
 }
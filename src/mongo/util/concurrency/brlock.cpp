@@ -0,0 +1,120 @@
+// @file brlock.cpp
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+
+#include "mongo/util/concurrency/brlock.h"
+
+#include "mongo/util/concurrency/threadlocal.h"
+
+namespace mongo {
+
+    TSP_DECLARE(unsigned, brlockSlot)
+    TSP_DEFINE(unsigned, brlockSlot)
+
+    static AtomicUInt32 nextSlot;
+
+    /* AtomicWord's load, store and fetchAndAdd are full barriers, which the fast paths rely
+       on: a reader counts itself then checks _writers, and a writer announces itself then
+       checks the readers, so at least one of the two sees the other.
+    */
+
+    BRLock::BRLock() :
+        _nextTicket(0),
+        _nowServing(0),
+        _generation(0),
+        _waitingReaders(0),
+        _grantedReaders(0) {
+        BOOST_STATIC_ASSERT( sizeof(Slot) == CacheLine );
+        Slot *s = slots();
+        for( unsigned i = 0; i < NSlots; i++ )
+            new ( &s[i] ) Slot();
+    }
+
+    unsigned BRLock::mySlot() {
+        unsigned *s = brlockSlot.get();
+        if( s == 0 ) {
+            s = new unsigned( nextSlot.fetchAndAdd(1) % NSlots );
+            brlockSlot.reset( s );
+        }
+        return *s;
+    }
+
+    bool BRLock::anyReaders() const {
+        for( unsigned i = 0; i < NSlots; i++ ) {
+            if( slots()[i].readers.load() )
+                return true;
+        }
+        return false;
+    }
+
+    void BRLock::lock_shared() {
+        unsigned slot = mySlot();
+        slots()[slot].readers.fetchAndAdd(1);
+        if( _writers.load() == 0 )
+            return;
+        // a writer is around; back out and queue behind it.
+        slots()[slot].readers.subtractAndFetch(1);
+        waitToRead( slot );
+    }
+
+    void BRLock::waitToRead( unsigned slot ) {
+        boost::mutex::scoped_lock lk(_m);
+        // we may have made the writer wait on our slot
+        _writersMayEnter.notify_all();
+        if( _writers.load() ) {
+            unsigned long long gen = _generation;
+            _waitingReaders++;
+            while( gen == _generation )
+                _readersMayEnter.wait(lk);
+            _grantedReaders--;
+        }
+        // writers announce themselves and check the slots under _m, so counting ourselves
+        // before releasing it can't race with one.
+        slots()[slot].readers.fetchAndAdd(1);
+    }
+
+    void BRLock::unlock_shared() {
+        slots()[mySlot()].readers.subtractAndFetch(1);
+        if( _writers.load() ) {
+            boost::mutex::scoped_lock lk(_m);
+            _writersMayEnter.notify_all();
+        }
+    }
+
+    void BRLock::lock() {
+        boost::mutex::scoped_lock lk(_m);
+        unsigned long long ticket = _nextTicket++;
+        _writers.fetchAndAdd(1);
+        while( ticket != _nowServing || _grantedReaders || anyReaders() )
+            _writersMayEnter.wait(lk);
+    }
+
+    void BRLock::unlock() {
+        boost::mutex::scoped_lock lk(_m);
+        _nowServing++;
+        _writers.subtractAndFetch(1);
+        // let the readers queued behind us in ahead of the next writer
+        _grantedReaders += _waitingReaders;
+        _waitingReaders = 0;
+        _generation++;
+        _readersMayEnter.notify_all();
+        _writersMayEnter.notify_all();
+    }
+
+}
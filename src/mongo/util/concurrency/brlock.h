@@ -0,0 +1,86 @@
+// @file brlock.h big reader lock
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "mongo/platform/atomic_word.h"
+
+namespace mongo {
+
+    /** "Big Reader" lock
+        a reader-writer lock where readers don't share a cacheline unless a writer is around.
+        each thread counts itself in one of NSlots reader indicators, each on its own cacheline,
+        and only checks that no writer has announced itself; readers on different slots never
+        write to the same memory.  writers take a mutex, announce themselves, and wait for every
+        slot to drain, so writing costs a scan of all the slots.
+
+        writers are served in the order they arrive.  readers arriving while a writer holds or
+        waits for the lock queue behind it, and all the readers queued when a writer unlocks
+        are let in before the next writer, so neither side starves the other.
+
+        Non-recursive, like SimpleRWLock.  footprint is NSlots+1 cachelines, about 2KB.
+    */
+    class BRLock : boost::noncopyable {
+    public:
+        BRLock();
+
+        void lock();
+        void unlock();
+        void lock_shared();
+        void unlock_shared();
+
+        enum { NSlots = 32, CacheLine = 64 };
+
+    private:
+        struct Slot {
+            AtomicUInt32 readers;
+            char pad[CacheLine - sizeof(AtomicUInt32)];
+        };
+
+        /** @return the reader slot of this thread, assigned round robin on its first read. */
+        static unsigned mySlot();
+        bool anyReaders() const;
+        /** the slow path of lock_shared(), queueing behind writers. */
+        void waitToRead( unsigned slot );
+
+        /** the slots start on a cacheline boundary within _slotSpace, as a BRLock itself (often
+            allocated with new) needn't be aligned; otherwise every slot straddles two lines and
+            shares one with its neighbour. */
+        Slot* slots() {
+            return reinterpret_cast<Slot*>( ( reinterpret_cast<size_t>( _slotSpace ) + CacheLine - 1 ) & ~( (size_t) CacheLine - 1 ) );
+        }
+        const Slot* slots() const { return const_cast<BRLock*>( this )->slots(); }
+
+        char _slotSpace[ ( NSlots + 1 ) * CacheLine ];
+        AtomicUInt32 _writers;          // writers holding or waiting for the lock
+
+        boost::mutex _m;                // guards the rest, and writers announcing themselves
+        boost::condition _readersMayEnter;
+        boost::condition _writersMayEnter;
+        unsigned long long _nextTicket; // writers are served in ticket order
+        unsigned long long _nowServing;
+        unsigned long long _generation; // bumped by each writer unlock, to release queued readers
+        unsigned _waitingReaders;       // queued behind the current writer
+        unsigned _grantedReaders;       // released by a writer unlock but not yet counted in a slot
+    };
+
+}
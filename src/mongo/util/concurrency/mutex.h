@@ -25,13 +25,12 @@
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/xtime.hpp>
 
+#include "mongo/bson/inline_decls.h"
 #include "mongo/util/assert_util.h"
 #include "mongo/util/heapcheck.h"
 #include "mongo/util/concurrency/threadlocal.h"
 
-#if defined(_DEBUG)
 #include "mongo/util/concurrency/mutexdebugger.h"
-#endif
 
 namespace mongo {
 
@@ -56,6 +55,25 @@ namespace mongo {
         ~StaticObserver() { _destroyingStatics = true; }
     };
 
+    /** SimpleMutex and mongo::mutex don't park a thread as soon as they find the mutex held:
+        most of our critical sections are short, so the holder is likely to be done within a
+        few microseconds.  waiting rounds of cpu pauses, doubling up to MaxPauses, come first.
+        on a single cpu the holder can't run while we spin, so we park right away there.
+    */
+    struct AdaptiveSpin {
+        enum { MaxPauses = 128 };
+        static bool enabled();
+        static void pause( unsigned n ) {
+            for( unsigned i = 0; i < n; i++ ) {
+#if defined(__i386__) || defined(__x86_64__)
+                asm volatile ( "pause" );
+#elif defined(_WIN32)
+                YieldProcessor();
+#endif
+            }
+        }
+    };
+
     /** On pthread systems, it is an error to destroy a mutex while held (boost mutex 
      *    may use pthread).  Static global mutexes may be held upon shutdown in our 
      *    implementation, and this way we avoid destroying them.
@@ -64,7 +82,7 @@ namespace mongo {
     class mutex : boost::noncopyable {
     public:
         const char * const _name;
-        mutex(const char *name) : _name(name)
+        mutex(const char *name) : _name(name), _contention(0)
         {
             _m = new boost::timed_mutex();
             IGNORE_OBJECT( _m  );   // Turn-off heap checking on _m
@@ -100,7 +118,9 @@ namespace mongo {
 #if defined(_DEBUG)
             _mut(&m),
 #endif
-            _l( m.boost() ) {
+            _l( m.boost(), boost::try_to_lock ) {
+                if ( !_l.owns_lock() )
+                    m.lockContended( _l );
 #if defined(_DEBUG)
                 mutexDebugger.entering(_mut->_name);
 #endif
@@ -116,7 +136,10 @@ namespace mongo {
         };
     private:
         boost::timed_mutex &boost() { return *_m; }
+        /** spins and then blocks on l, whose mutex was found held */
+        NOINLINE_DECL void lockContended( boost::timed_mutex::scoped_lock &l );
         boost::timed_mutex *_m;
+        MutexContention::Counts *_contention; // looked up the first time we're contended
     };
 
     typedef mongo::mutex::scoped_lock scoped_lock;
@@ -129,7 +152,8 @@ namespace mongo {
 #if defined(_WIN32)
     class SimpleMutex : boost::noncopyable {
     public:
-        SimpleMutex( const char * ) { InitializeCriticalSection( &_cs ); }
+        // the critical section spins before it waits, like the pthread version below
+        SimpleMutex( const char * ) { InitializeCriticalSectionAndSpinCount( &_cs, 4000 ); }
         void dassertLocked() const { }
         void lock() { EnterCriticalSection( &_cs ); }
         void unlock() { LeaveCriticalSection( &_cs ); }
@@ -148,14 +172,20 @@ namespace mongo {
     class SimpleMutex : boost::noncopyable {
     public:
         void dassertLocked() const { }
-        SimpleMutex(const char* name) { verify( pthread_mutex_init(&_lock,0) == 0 ); }
+        SimpleMutex(const char* name) : _name(name), _contention(0) {
+            verify( pthread_mutex_init(&_lock,0) == 0 );
+        }
         ~SimpleMutex(){ 
             if ( ! StaticObserver::_destroyingStatics ) { 
                 verify( pthread_mutex_destroy(&_lock) == 0 ); 
             }
         }
 
-        void lock() { verify( pthread_mutex_lock(&_lock) == 0 ); }
+        void lock() {
+            if ( MONGO_likely( pthread_mutex_trylock(&_lock) == 0 ) )
+                return;
+            lockContended();
+        }
         void unlock() { verify( pthread_mutex_unlock(&_lock) == 0 ); }
     public:
         class scoped_lock : boost::noncopyable {
@@ -167,7 +197,11 @@ namespace mongo {
         };
 
     private:
+        /** spins and then blocks, see AdaptiveSpin */
+        NOINLINE_DECL void lockContended();
         pthread_mutex_t _lock;
+        const char * const _name;
+        MutexContention::Counts *_contention; // looked up the first time we're contended
     };
 #endif
 
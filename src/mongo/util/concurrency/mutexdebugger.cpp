@@ -20,8 +20,86 @@
 #include "mutex.h"
 #include "value.h"
 
+#include <boost/thread/thread.hpp>
+
 namespace mongo {
 
+    bool AdaptiveSpin::enabled() {
+        static bool multiCpu = boost::thread::hardware_concurrency() > 1;
+        return multiCpu;
+    }
+
+    namespace {
+        // function statics, as a mutex may be contended before this file's statics are set
+        // up.  intentional leaks, as mutexes may still be locked while statics are destroyed.
+        boost::mutex &contentionMutex() {
+            static boost::mutex &m = *(new boost::mutex());
+            return m;
+        }
+        map<string, MutexContention::Counts*> &contention() {
+            static map<string, MutexContention::Counts*> &c =
+                *(new map<string, MutexContention::Counts*>());
+            return c;
+        }
+    }
+
+    MutexContention::Counts* MutexContention::forName( const char *name ) {
+        boost::mutex::scoped_lock lk( contentionMutex() );
+        Counts *&c = contention()[ name ? name : "(unnamed)" ];
+        if( c == 0 )
+            c = new Counts();
+        return c;
+    }
+
+    void MutexContention::snapshot( vector<Entry> &out ) {
+        boost::mutex::scoped_lock lk( contentionMutex() );
+        const map<string, Counts*> &c = contention();
+        for( map<string, Counts*>::const_iterator i = c.begin(); i != c.end(); ++i ) {
+            Entry e;
+            e.name = i->first;
+            e.contended = i->second->contended.load();
+            e.spun = i->second->spun.load();
+            e.parked = i->second->parked.load();
+            out.push_back( e );
+        }
+    }
+
+    void mutex::lockContended( boost::timed_mutex::scoped_lock &l ) {
+        if( _contention == 0 )
+            _contention = MutexContention::forName( _name );
+        _contention->contended.fetchAndAdd( 1 );
+        if( AdaptiveSpin::enabled() ) {
+            for( unsigned pauses = 1; pauses <= AdaptiveSpin::MaxPauses; pauses *= 2 ) {
+                AdaptiveSpin::pause( pauses );
+                if( l.try_lock() ) {
+                    _contention->spun.fetchAndAdd( 1 );
+                    return;
+                }
+            }
+        }
+        _contention->parked.fetchAndAdd( 1 );
+        l.lock();
+    }
+
+#if !defined(_WIN32)
+    void SimpleMutex::lockContended() {
+        if( _contention == 0 )
+            _contention = MutexContention::forName( _name );
+        _contention->contended.fetchAndAdd( 1 );
+        if( AdaptiveSpin::enabled() ) {
+            for( unsigned pauses = 1; pauses <= AdaptiveSpin::MaxPauses; pauses *= 2 ) {
+                AdaptiveSpin::pause( pauses );
+                if( pthread_mutex_trylock( &_lock ) == 0 ) {
+                    _contention->spun.fetchAndAdd( 1 );
+                    return;
+                }
+            }
+        }
+        _contention->parked.fetchAndAdd( 1 );
+        verify( pthread_mutex_lock( &_lock ) == 0 );
+    }
+#endif
+
 #if defined(_DEBUG)
 
     scoped_lock::PostStaticCheck::PostStaticCheck() {
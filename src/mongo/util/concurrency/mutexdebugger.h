@@ -9,11 +9,13 @@
 #include <set>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "boost/thread/mutex.hpp"
 
 #include "mongo/client/redef_macros.h"
 
+#include "mongo/platform/atomic_word.h"
 #include "mongo/util/assert_util.h"
 
 namespace mongo {
@@ -130,4 +132,27 @@ namespace mongo {
     };
     extern MutexDebugger &mutexDebugger;
 
+    /** kept in all builds, unlike MutexDebugger.
+        counts, for each mutex name, how often SimpleMutex and mongo::mutex found the mutex held,
+        and whether spinning got it or the thread had to park.  mutexes of one name share counts.
+    */
+    class MutexContention {
+    public:
+        struct Counts {
+            AtomicUInt64 contended;   // lock() found it held
+            AtomicUInt64 spun;        // ... and got it while spinning
+            AtomicUInt64 parked;      // ... and blocked in the kernel
+        };
+
+        /** @return the counts for mutexes called name, which live until the program ends */
+        static Counts* forName( const char *name );
+
+        struct Entry {
+            std::string name;
+            unsigned long long contended, spun, parked;
+        };
+        /** the counts of each mutex name which has been contended */
+        static void snapshot( std::vector<Entry> &out );
+    };
+
 }
@@ -0,0 +1,254 @@
+// @file cow_map.h
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+namespace mongo {
+
+    /**
+     * An ordered map which is cheap to copy.  It is a two level B-tree: a root holding sorted
+     * leaves of up to LeafSize entries, all shared between copies.  Copying only takes a
+     * reference to the root; the first change to a copy copies the root's leaf pointers and
+     * the one leaf changed, and leaves everything else shared with the original.
+     *
+     * A map which is only read may be read from any number of threads, and each copy can be
+     * changed without affecting the others.  Like a vector, and unlike std::map, any change
+     * invalidates the map's iterators.  Iterators are bidirectional and read only.
+     */
+    template < class K, class V, class Cmp = std::less<K> >
+    class CowMap {
+    public:
+        typedef K key_type;
+        typedef V mapped_type;
+        typedef std::pair<K,V> value_type;
+
+        enum { LeafSize = 128 };
+
+    private:
+        typedef std::vector<value_type> Leaf;
+        typedef std::vector< boost::shared_ptr<Leaf> > Root;
+
+    public:
+        class const_iterator : public std::iterator<std::bidirectional_iterator_tag, value_type> {
+        public:
+            const_iterator() : _root(0), _leaf(0), _pos(0) {}
+
+            const value_type& operator*() const { return (*(*_root)[_leaf])[_pos]; }
+            const value_type* operator->() const { return &**this; }
+
+            const_iterator& operator++() {
+                if ( ++_pos == (*_root)[_leaf]->size() ) {
+                    _leaf++;
+                    _pos = 0;
+                }
+                return *this;
+            }
+            const_iterator operator++(int) { const_iterator i = *this; ++*this; return i; }
+
+            const_iterator& operator--() {
+                if ( _pos == 0 ) {
+                    _leaf--;
+                    _pos = (*_root)[_leaf]->size() - 1;
+                }
+                else {
+                    _pos--;
+                }
+                return *this;
+            }
+            const_iterator operator--(int) { const_iterator i = *this; --*this; return i; }
+
+            bool operator==( const const_iterator& other ) const { return _leaf == other._leaf && _pos == other._pos; }
+            bool operator!=( const const_iterator& other ) const { return ! ( *this == other ); }
+
+        private:
+            friend class CowMap;
+            const_iterator( const Root* root , size_t leaf , size_t pos ) : _root(root), _leaf(leaf), _pos(pos) {}
+
+            const Root* _root;
+            size_t _leaf;
+            size_t _pos;
+        };
+
+        typedef const_iterator iterator;
+
+        CowMap() : _size(0) {}
+
+        size_t size() const { return _size; }
+        bool empty() const { return _size == 0; }
+
+        const_iterator begin() const { return const_iterator( _root.get() , 0 , 0 ); }
+        const_iterator end() const { return const_iterator( _root.get() , _root ? _root->size() : 0 , 0 ); }
+
+        const_iterator lower_bound( const K& k ) const { return _bound( k , false ); }
+        const_iterator upper_bound( const K& k ) const { return _bound( k , true ); }
+
+        const_iterator find( const K& k ) const {
+            const_iterator i = lower_bound( k );
+            if ( i == end() || _cmp( k , i->first ) )
+                return end();
+            return i;
+        }
+
+        std::pair<const_iterator,bool> insert( const value_type& v ) {
+            if ( ! _root || _root->empty() ) {
+                _root.reset( new Root() );
+                _root->push_back( boost::shared_ptr<Leaf>( new Leaf( 1 , v ) ) );
+                _size = 1;
+                return std::make_pair( begin() , true );
+            }
+
+            const_iterator i = lower_bound( v.first );
+            if ( i != end() && ! _cmp( v.first , i->first ) )
+                return std::make_pair( i , false );
+
+            // past the last key goes on the end of the last leaf
+            size_t leaf = i._leaf;
+            size_t pos = i._pos;
+            if ( leaf == _root->size() ) {
+                leaf--;
+                pos = (*_root)[leaf]->size();
+            }
+
+            Leaf& l = _mutableLeaf( leaf );
+            l.insert( l.begin() + pos , v );
+            _size++;
+
+            if ( l.size() > (size_t) LeafSize ) {
+                boost::shared_ptr<Leaf> right( new Leaf( l.begin() + l.size() / 2 , l.end() ) );
+                l.erase( l.begin() + l.size() / 2 , l.end() );
+                _root->insert( _root->begin() + leaf + 1 , right );
+                if ( pos >= l.size() ) {
+                    pos -= l.size();
+                    leaf++;
+                }
+            }
+            return std::make_pair( const_iterator( _root.get() , leaf , pos ) , true );
+        }
+
+        V& operator[]( const K& k ) {
+            const_iterator i = insert( value_type( k , V() ) ).first;
+            return _mutableLeaf( i._leaf )[i._pos].second;
+        }
+
+        /** @return where the entry after the one erased is now */
+        const_iterator erase( const_iterator i ) {
+            size_t leaf = i._leaf;
+            size_t pos = i._pos;
+
+            Leaf& l = _mutableLeaf( leaf );
+            l.erase( l.begin() + pos );
+            _size--;
+
+            if ( l.empty() ) {
+                _root->erase( _root->begin() + leaf );
+                pos = 0;
+            }
+            else if ( pos == l.size() ) {
+                leaf++;
+                pos = 0;
+            }
+            return const_iterator( _root.get() , leaf , pos );
+        }
+
+        void erase( const_iterator first , const_iterator last ) {
+            size_t n = 0;
+            for ( const_iterator i = first; i != last; ++i )
+                n++;
+            while ( n-- )
+                first = erase( first );
+        }
+
+        size_t erase( const K& k ) {
+            const_iterator i = find( k );
+            if ( i == end() )
+                return 0;
+            erase( i );
+            return 1;
+        }
+
+        void clear() {
+            _root.reset();
+            _size = 0;
+        }
+
+        void swap( CowMap& other ) {
+            _root.swap( other._root );
+            std::swap( _size , other._size );
+        }
+
+    private:
+        // the first entry not before k, or with upper, the first after it
+        const_iterator _bound( const K& k , bool upper ) const {
+            if ( ! _root )
+                return end();
+
+            size_t lo = 0;
+            size_t hi = _root->size();
+            while ( lo < hi ) {
+                size_t mid = ( lo + hi ) / 2;
+                const K& last = (*_root)[mid]->back().first;
+                if ( upper ? ! _cmp( k , last ) : _cmp( last , k ) )
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            if ( lo == _root->size() )
+                return end();
+
+            const Leaf& l = *(*_root)[lo];
+            typename Leaf::const_iterator j;
+            if ( upper )
+                j = std::upper_bound( l.begin() , l.end() , k , _KeyCmp( _cmp ) );
+            else
+                j = std::lower_bound( l.begin() , l.end() , k , _KeyCmp( _cmp ) );
+            return const_iterator( _root.get() , lo , j - l.begin() );
+        }
+
+        // copies the root, and then the leaf, unless this map is all that refers to them
+        Leaf& _mutableLeaf( size_t leaf ) {
+            if ( ! _root.unique() )
+                _root.reset( new Root( *_root ) );
+            boost::shared_ptr<Leaf>& l = (*_root)[leaf];
+            if ( ! l.unique() )
+                l.reset( new Leaf( *l ) );
+            return *l;
+        }
+
+        class _KeyCmp {
+        public:
+            _KeyCmp( const Cmp& cmp ) : _cmp( cmp ) {}
+            bool operator()( const value_type& a , const K& k ) const { return _cmp( a.first , k ); }
+            bool operator()( const K& k , const value_type& b ) const { return _cmp( k , b.first ); }
+        private:
+            Cmp _cmp;
+        };
+
+        boost::shared_ptr<Root> _root;
+        size_t _size;
+        Cmp _cmp;
+    };
+
+} // namespace mongo
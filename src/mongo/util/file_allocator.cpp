@@ -74,7 +74,7 @@ namespace mongo {
     }
 
     FileAllocator::FileAllocator()
-        : _pendingMutex("FileAllocator"), _failed() {
+        : _pendingMutex("FileAllocator"), _failed(), _lastAllocationMillis(0) {
     }
 
 
@@ -161,7 +161,15 @@ namespace mongo {
         }
 #endif
 
-#if defined(__linux__)
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+        // fallocate() reserves the blocks as unwritten extents, which read back as zeroes.  unlike
+        // posix_fallocate() it fails where the filesystem can't do that, rather than writing to
+        // every block itself, so we may as well zero-fill below with bigger writes then.
+        if ( fallocate(fd, 0, 0, size) == 0 )
+            return;
+
+        log() << "FileAllocator: fallocate failed: " << errnoWithDescription() << " falling back" << endl;
+#elif defined(__linux__)
         int ret = posix_fallocate(fd,0,size);
         if ( ret == 0 )
             return;
@@ -184,7 +192,7 @@ namespace mongo {
                      1 == write(fd, "", 1) );
             lseek(fd, 0, SEEK_SET);
 
-            const long z = 256 * 1024;
+            const long z = 1024 * 1024;
             const boost::scoped_array<char> buf_holder (new char[z]);
             char* buf = buf_holder.get();
             memset(buf, 0, z);
@@ -263,7 +271,7 @@ namespace mongo {
                 string tmp;
                 long fd = 0;
                 try {
-                    log() << "allocating new datafile " << name << ", filling with zeroes..." << endl;
+                    log() << "allocating new datafile " << name << endl;
                     
                     boost::filesystem::path parent = ensureParentDirCreated(name);
                     tmp = makeTempFileName( parent );
@@ -303,6 +311,7 @@ namespace mongo {
                           << "size: " << size/1024/1024 << "MB, "
                           << " took " << ((double)t.millis())/1000.0 << " secs"
                           << endl;
+                    fa->_lastAllocationMillis = t.millis();
 
                     // no longer in a failed state. allow new writers.
                     fa->_failed = false;
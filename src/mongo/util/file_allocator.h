@@ -54,6 +54,9 @@ namespace mongo {
         
         bool hasFailed() const;
 
+        /** @return how long the last file took to allocate, 0 before the first */
+        unsigned long long lastAllocationMillis() const { return _lastAllocationMillis; }
+
         static void ensureLength(int fd, long size);
 
         /** @return the singletone */
@@ -83,6 +86,8 @@ namespace mongo {
 
         bool _failed;
 
+        volatile unsigned long long _lastAllocationMillis;
+
         static FileAllocator* _instance;
 
     };
@@ -68,6 +68,12 @@ namespace mongo {
         _buckets[ _findBucket(element) ] += 1;
     }
 
+    void Histogram::clear() {
+        for ( uint32_t i = 0; i < _numBuckets; i++ ) {
+            _buckets[i] = 0;
+        }
+    }
+
     std::string Histogram::toHTML() const {
         uint64_t max = 0;
         for ( uint32_t i = 0; i < _numBuckets; i++ ) {
@@ -75,6 +75,11 @@ namespace mongo {
          */
         void insert( uint32_t element );
 
+        /**
+         * Zero the count of every bucket.
+         */
+        void clear();
+
         /**
          * Render the histogram as string that can be used inside an
          * HTML doc.
@@ -0,0 +1,87 @@
+// @file hyperloglog.h
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstring>
+
+namespace mongo {
+
+    /**
+     * A HyperLogLog sketch (Flajolet et al.), which estimates how many distinct values it has
+     * been given in 2^P bytes, whatever the count, to within about 1.04 / sqrt(2^P): 3% for
+     * P = 10.  Values go in as well mixed 64 bit hashes; see hash().  Sketches of different
+     * sets merge into a sketch of their union.  Not thread safe.
+     */
+    template< int P >
+    class HyperLogLog {
+    public:
+        enum { Registers = 1 << P };
+
+        HyperLogLog() { clear(); }
+
+        void clear() { memset( _r , 0 , sizeof( _r ) ); }
+
+        void add( unsigned long long hash ) {
+            const unsigned i = (unsigned) ( hash >> ( 64 - P ) );
+            // the rest of the bits, with a guard so the count of zeros ends
+            unsigned long long w = ( hash << P ) | ( 1ULL << ( P - 1 ) );
+            unsigned char rank = 1;
+            while ( ! ( w & 0x8000000000000000ULL ) ) {
+                rank++;
+                w <<= 1;
+            }
+            if ( rank > _r[i] )
+                _r[i] = rank;
+        }
+
+        void merge( const HyperLogLog& other ) {
+            for ( int i = 0; i < Registers; i++ )
+                if ( other._r[i] > _r[i] )
+                    _r[i] = other._r[i];
+        }
+
+        double estimate() const {
+            const double m = Registers;
+            double sum = 0;
+            int zeros = 0;
+            for ( int i = 0; i < Registers; i++ ) {
+                sum += std::ldexp( 1.0 , -_r[i] );
+                if ( _r[i] == 0 )
+                    zeros++;
+            }
+            double e = 0.7213 / ( 1 + 1.079 / m ) * m * m / sum;
+            // small counts leave registers empty, and linear counting does better there
+            if ( e <= 2.5 * m && zeros )
+                e = m * std::log( m / zeros );
+            return e;
+        }
+
+        /** mixes x (splitmix64's finalizer), so that nearby values make unrelated hashes */
+        static unsigned long long hash( unsigned long long x ) {
+            x = ( x ^ ( x >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+            x = ( x ^ ( x >> 27 ) ) * 0x94D049BB133111EBULL;
+            return x ^ ( x >> 31 );
+        }
+
+    private:
+        unsigned char _r[Registers];
+    };
+
+} // namespace mongo
@@ -0,0 +1,83 @@
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+
+#include "mongo/util/mem_accounting.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#endif
+
+#include "mongo/db/jsobj.h"
+#include "mongo/platform/atomic_word.h"
+
+namespace mongo {
+
+    namespace {
+
+        AtomicInt64 tagBytes[MemAccounting::NumTags];
+        AtomicInt64 tagPeakBytes[MemAccounting::NumTags];
+
+        const char *tagNames[] = { "clientCursors" , "cursorBatches" , "mapReduce" , "aggregation" ,
+                                   "writeIntents" , "connectionStacks" , "top" };
+
+    }
+
+    void MemAccounting::add( Tag tag , long long bytes ) {
+        long long now = tagBytes[tag].fetchAndAdd( bytes ) + bytes;
+        long long peak = tagPeakBytes[tag].load();
+        while ( now > peak ) {
+            long long was = tagPeakBytes[tag].compareAndSwap( peak , now );
+            if ( was == peak )
+                break;
+            peak = was;
+        }
+    }
+
+    long long MemAccounting::bytes( Tag tag ) {
+        return tagBytes[tag].load();
+    }
+
+    void MemAccounting::appendStats( BSONObjBuilder& b ) {
+        long long total = 0;
+        for ( int i = 0; i < NumTags; i++ ) {
+            long long bytes = tagBytes[i].load();
+            BSONObjBuilder t( b.subobjStart( tagNames[i] ) );
+            t.appendNumber( "bytes" , bytes );
+            t.appendNumber( "peakBytes" , tagPeakBytes[i].load() );
+            t.done();
+            total += bytes;
+        }
+        b.appendNumber( "totalBytes" , total );
+    }
+
+    long long MemAccounting::threadStackBytes() {
+#if defined(__linux__)
+        pthread_attr_t attrs;
+        size_t size = 0;
+        if ( pthread_getattr_np( pthread_self() , &attrs ) == 0 ) {
+            pthread_attr_getstacksize( &attrs , &size );
+            pthread_attr_destroy( &attrs );
+        }
+        if ( size )
+            return size;
+#endif
+        // what boost and the platforms default to, near enough
+        return 1024 * 1024;
+    }
+
+} // namespace mongo
@@ -0,0 +1,79 @@
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+
+namespace mongo {
+
+    class BSONObjBuilder;
+
+    /**
+     * Bytes held by the subsystems whose memory use can grow with load, so heap growth can be
+     * put down to one of them.  Each subsystem counts its own structures where they are
+     * allocated and freed; the figures are its estimates rather than what malloc handed out,
+     * and compare with extra_info.heap_usage_bytes in serverStatus.
+     */
+    class MemAccounting {
+    public:
+        enum Tag {
+            ClientCursors,      // ClientCursor objects and their queries
+            CursorBatches,      // replies DBClientCursors hold, mostly in mongos
+            MapReduce,          // in memory map/reduce tuples
+            Aggregation,        // documents held by $sort and $group
+            WriteIntents,       // the journal's write intents awaiting a group commit
+            ConnectionStacks,   // stacks of the threads serving connections
+            Top,                // the per collection usage map
+            NumTags
+        };
+
+        static void add( Tag tag , long long bytes );
+        static void remove( Tag tag , long long bytes ) { add( tag , -bytes ); }
+
+        static long long bytes( Tag tag );
+
+        /** serverStatus().memAccounting */
+        static void appendStats( BSONObjBuilder& b );
+
+        /** the stack size of the calling thread */
+        static long long threadStackBytes();
+
+        /**
+         * The bytes one structure holds under tag, kept up to date with set() as the structure
+         * grows and shrinks, and given back when the Charge is destroyed.
+         */
+        class Charge : boost::noncopyable {
+        public:
+            explicit Charge( Tag tag ) : _tag( tag ), _bytes( 0 ) { }
+            ~Charge() { set( 0 ); }
+
+            void set( long long bytes ) {
+                if ( bytes != _bytes ) {
+                    MemAccounting::add( _tag , bytes - _bytes );
+                    _bytes = bytes;
+                }
+            }
+            long long bytes() const { return _bytes; }
+
+        private:
+            const Tag _tag;
+            long long _bytes;
+        };
+    };
+
+} // namespace mongo
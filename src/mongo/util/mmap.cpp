@@ -41,6 +41,9 @@ namespace mongo {
     set<MongoFile*> MongoFile::mmfiles;
     map<string,MongoFile*> MongoFile::pathToFile;
 
+    MemoryMappedFile::NumaPolicy MemoryMappedFile::numaPolicy = MemoryMappedFile::NumaDefault;
+    bool MemoryMappedFile::hugePages = false;
+
     /* Create. Must not exist.
     @param zero fill file with zeros when true
     */
@@ -21,6 +21,8 @@
 
 namespace mongo {
 
+    class BSONObjBuilder;
+
     extern const size_t g_minOSPageSizeBytes;
     void minOSPageSizeBytesTest(size_t minOSPageSizeBytes);  // lame-o
 
@@ -31,6 +33,9 @@ namespace mongo {
         enum Advice { Sequential=1 , Random=2 };
         MAdvise(void *p, unsigned len, Advice a); 
         ~MAdvise(); // destructor resets the range to MADV_NORMAL
+
+        /** asks the os to start reading in a range which will be used soon.  nothing to undo. */
+        static void willNeed(void *p, unsigned len);
     };
 
     // lock order: lock dbMutex before this if you lock both
@@ -198,6 +203,21 @@ namespace mongo {
         void* createReadOnlyMap();
         void* createPrivateMap();
 
+        /** where the os puts a view's pages: --numa, set at startup */
+        enum NumaPolicy { NumaDefault, NumaInterleave, NumaLocal };
+        static NumaPolicy numaPolicy;
+        /** advise the os to back the views with huge pages where it can: --hugePages, set at startup */
+        static bool hugePages;
+
+        /** applies numaPolicy to this thread and those it starts, which is what places the page cache
+            the shared views are made of; call from main before starting any.
+            @return false if the os refused
+        */
+        static bool applyNumaPolicy();
+
+        /** the settings above, how the os took them and how much is mapped with huge pages, for serverStatus */
+        static void appendPlacementStats(BSONObjBuilder& b);
+
         /** make the private map range writable (necessary for our windows implementation) */
         static void makeWritable(void *, unsigned len)
 #if defined(_WIN32)
@@ -228,6 +248,19 @@ namespace mongo {
 
         /** close the current private view and open a new replacement */
         void* remapPrivateView(void *oldPrivateAddr);
+
+#if !defined(_WIN32)
+    public:
+        /** synchronously flush [p, p+len) of a shared view to disk.  p must be page aligned.
+            it's ok if the view has been unmapped meanwhile, we then just log.
+        */
+        static void flushRange(void *p, size_t len);
+    protected:
+        /** replace just [ofs, ofs+len) of the private view with a fresh mapping of the file.
+            ofs must be page aligned.  the rest of the view is left as it is.
+        */
+        void remapPrivateViewRange(void *privateAddr, size_t ofs, size_t len);
+#endif
     };
 
     typedef MemoryMappedFile MMF;
@@ -24,6 +24,11 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <fstream>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#include "../bson/util/atomic_int.h"
 #include "../util/processinfo.h"
 #include "mongoutils/str.h"
 using namespace mongoutils;
@@ -67,6 +72,7 @@ namespace mongo {
 #if defined(__sunos__)
     MAdvise::MAdvise(void *,unsigned, Advice) { }
     MAdvise::~MAdvise() { }
+    void MAdvise::willNeed(void *,unsigned) { }
 #else
     MAdvise::MAdvise(void *p, unsigned len, Advice a) {
         
@@ -89,7 +95,166 @@ namespace mongo {
     MAdvise::~MAdvise() { 
         madvise(_p,_len,MADV_NORMAL);
     }
+    void MAdvise::willNeed(void *p, unsigned len) {
+        void *start = (void*)((long)p & ~(g_minOSPageSizeBytes-1));
+        len += (unsigned long long)p-(unsigned long long)start;
+        // only a hint, so a failure is not worth reporting
+        madvise(start,len,MADV_WILLNEED);
+    }
+#endif
+
+    // views the os wouldn't place as asked; only the first of each is logged
+    static AtomicUInt hugePageFailures;
+    static AtomicUInt numaFailures;
+
+    static const char *numaPolicyName() {
+        switch ( MemoryMappedFile::numaPolicy ) {
+        case MemoryMappedFile::NumaInterleave: return "interleave";
+        case MemoryMappedFile::NumaLocal: return "local";
+        default: return "default";
+        }
+    }
+
+#if defined(__linux__)
+    // from linux/mempolicy.h, which the build boxes don't all have
+    static const int mpolPreferred = 1;
+    static const int mpolInterleave = 3;
+
+    /** the online numa nodes, as a mask for mbind and set_mempolicy */
+    static unsigned long numaNodes() {
+        static unsigned long nodes = 0;
+        if ( nodes )
+            return nodes;
+        // e.g. "0-1" or "0,2-3"
+        string s = "0";
+        ifstream f( "/sys/devices/system/node/online" );
+        if ( f )
+            getline( f , s );
+        unsigned long mask = 0;
+        const char *p = s.c_str();
+        while ( *p ) {
+            char *end;
+            long lo = strtol( p , &end , 10 ), hi = lo;
+            if ( end == p )
+                break;
+            p = end;
+            if ( *p == '-' ) {
+                hi = strtol( p + 1 , &end , 10 );
+                p = end;
+            }
+            for ( long n = lo; n <= hi && n < (long) sizeof(mask) * 8; n++ )
+                mask |= 1UL << n;
+            if ( *p == ',' )
+                p++;
+            else
+                break;
+        }
+        nodes = mask ? mask : 1;
+        return nodes;
+    }
+
+    /** @return mbind's or set_mempolicy's mode and mask for numaPolicy */
+    static int numaMode( unsigned long *mask , unsigned long *maxnode ) {
+        if ( MemoryMappedFile::numaPolicy == MemoryMappedFile::NumaInterleave ) {
+            *mask = numaNodes();
+            *maxnode = sizeof(*mask) * 8;
+            return mpolInterleave;
+        }
+        // preferred with no nodes is the node of the thread that faults the page in
+        *mask = 0;
+        *maxnode = 0;
+        return mpolPreferred;
+    }
+
+    bool MemoryMappedFile::applyNumaPolicy() {
+        if ( numaPolicy == NumaDefault )
+            return true;
+        unsigned long mask, maxnode;
+        int mode = numaMode( &mask , &maxnode );
+        if ( syscall( __NR_set_mempolicy , mode , maxnode ? &mask : 0 , maxnode ) ) {
+            warning() << "set_mempolicy " << numaPolicyName() << " failed: " << errnoWithDescription() << endl;
+            numaFailures++;
+            return false;
+        }
+        log() << "numa policy " << numaPolicyName() << endl;
+        return true;
+    }
+
+    /** the share of this process's memory the os maps with huge pages, in bytes */
+    static long long hugeBytesMapped() {
+        ifstream f( "/proc/self/smaps_rollup" );
+        if ( !f )
+            return -1;
+        long long kb = 0;
+        string line;
+        while ( getline( f , line ) ) {
+            if ( str::startsWith( line , "AnonHugePages:" ) ||
+                 str::startsWith( line , "ShmemPmdMapped:" ) ||
+                 str::startsWith( line , "FilePmdMapped:" ) )
+                kb += atoll( line.c_str() + line.find( ':' ) + 1 );
+        }
+        return kb * 1024;
+    }
+
+    /** the bracketed choice of the os's transparent huge page setting, e.g. "madvise" */
+    static string hugePagesOS() {
+        ifstream f( "/sys/kernel/mm/transparent_hugepage/enabled" );
+        string s;
+        if ( !f || !getline( f , s ) )
+            return "unsupported";
+        size_t b = s.find( '[' ), e = s.find( ']' );
+        if ( b == string::npos || e == string::npos || e < b )
+            return s;
+        return s.substr( b + 1 , e - b - 1 );
+    }
+#else
+    bool MemoryMappedFile::applyNumaPolicy() {
+        return numaPolicy == NumaDefault;
+    }
+    static long long hugeBytesMapped() { return -1; }
+    static string hugePagesOS() { return "unsupported"; }
+#endif
+
+    /** applies --hugePages and --numa to a new view */
+    static void placeView( void *view , size_t length , const char *filename ) {
+#if defined(MADV_HUGEPAGE)
+        if ( MemoryMappedFile::hugePages && madvise( view , length , MADV_HUGEPAGE ) ) {
+            if ( hugePageFailures++ == 0 )
+                warning() << "madvise MADV_HUGEPAGE failed for " << filename << ' ' << errnoWithDescription() << endl;
+        }
+#endif
+#if defined(__linux__)
+        if ( MemoryMappedFile::numaPolicy != MemoryMappedFile::NumaDefault ) {
+            // policy for the pages of a private view; the page cache behind a shared one goes by
+            // the process's, see applyNumaPolicy()
+            unsigned long mask, maxnode;
+            int mode = numaMode( &mask , &maxnode );
+            if ( syscall( __NR_mbind , view , length , mode , maxnode ? &mask : 0 , maxnode , 0 ) ) {
+                if ( numaFailures++ == 0 )
+                    warning() << "mbind " << numaPolicyName() << " failed for " << filename << ' ' << errnoWithDescription() << endl;
+            }
+        }
+#endif
+    }
+
+    void MemoryMappedFile::appendPlacementStats( BSONObjBuilder& b ) {
+        b.appendNumber( "pageSize" , (long long) g_minOSPageSizeBytes );
+        b.appendBool( "hugePages" , hugePages );
+        b.append( "hugePagesOS" , hugePagesOS() );
+        b.appendNumber( "hugePageFailures" , (long long) hugePageFailures.get() );
+        long long huge = hugeBytesMapped();
+        if ( huge >= 0 )
+            b.appendNumber( "hugeBytesMapped" , huge );
+        b.append( "numa" , numaPolicyName() );
+#if defined(__linux__)
+        unsigned long nodes = numaNodes();
+        int n = 0;
+        for ( ; nodes; nodes &= nodes - 1 )
+            n++;
+        b.append( "numaNodes" , n );
 #endif
+        b.appendNumber( "numaFailures" , (long long) numaFailures.get() );
+    }
 
     void* MemoryMappedFile::map(const char *filename, unsigned long long &length, int options) {
         // length may be updated by callee.
@@ -99,7 +264,12 @@ namespace mongo {
 
         massert( 10446 , str::stream() << "mmap: can't map area of size 0 file: " << filename, length > 0 );
 
-        fd = open(filename, O_RDWR | O_NOATIME);
+        const bool readOnly = options & READONLY;
+        fd = open(filename, ( readOnly ? O_RDONLY : O_RDWR ) | O_NOATIME);
+        if ( fd < 0 && errno == EPERM && readOnly ) {
+            // O_NOATIME is only for the file's owner, and someone else's file may be read
+            fd = open(filename, O_RDONLY);
+        }
         if ( fd <= 0 ) {
             log() << "couldn't open " << filename << ' ' << errnoWithDescription() << endl;
             fd = 0; // our sentinel for not opened
@@ -110,7 +280,7 @@ namespace mongo {
         uassert(10447,  str::stream() << "map file alloc failed, wanted: " << length << " filelen: " << filelen << ' ' << sizeof(size_t), filelen == length );
         lseek( fd, 0, SEEK_SET );
 
-        void * view = mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        void * view = mmap(NULL, length, readOnly ? PROT_READ : PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
         if ( view == MAP_FAILED ) {
             error() << "  mmap() failed for " << filename << " len:" << length << " " << errnoWithDescription() << endl;
             if ( errno == ENOMEM ) {
@@ -132,6 +302,7 @@ namespace mongo {
             }
         }
 #endif
+        placeView( view , length , filename );
 
         views.push_back( view );
 
@@ -168,6 +339,7 @@ namespace mongo {
             }
             return 0;
         }
+        placeView( x , len , filename().c_str() );
 
         views.push_back(x);
         return x;
@@ -184,9 +356,31 @@ namespace mongo {
             abort();
         }
         verify( x == oldPrivateAddr );
+        placeView( x , len , filename().c_str() );
         return x;
     }
 
+    void MemoryMappedFile::remapPrivateViewRange(void *privateAddr, size_t ofs, size_t len) {
+        dassert( ofs % g_minOSPageSizeBytes == 0 );
+        dassert( ofs + len <= this->len );
+        void *p = ((char *) privateAddr) + ofs;
+        void * x = mmap( p, len , PROT_READ|PROT_WRITE , MAP_PRIVATE|MAP_NORESERVE|MAP_FIXED , fd , ofs );
+        if( x == MAP_FAILED ) {
+            int err = errno;
+            error()  << "16342 Couldn't remap private view range: " << errnoWithDescription(err) << endl;
+            log() << "aborting" << endl;
+            printMemInfo();
+            abort();
+        }
+        verify( x == p );
+    }
+
+    void MemoryMappedFile::flushRange(void *p, size_t len) {
+        dassert( ((size_t) p) % g_minOSPageSizeBytes == 0 );
+        if ( msync(p, len, MS_SYNC) )
+            LOG(1) << "msync range " << errnoWithDescription() << endl;
+    }
+
     void MemoryMappedFile::flush(bool sync) {
         if ( views.empty() || fd == 0 )
             return;
@@ -35,12 +35,24 @@ namespace mongo {
     }
     const size_t g_minOSPageSizeBytes = fetchMinOSPageSizeBytes();
 
+    // --hugePages and --numa are linux only, so the views are placed as the os likes
+    bool MemoryMappedFile::applyNumaPolicy() {
+        return numaPolicy == NumaDefault;
+    }
+
+    void MemoryMappedFile::appendPlacementStats( BSONObjBuilder& b ) {
+        b.appendNumber( "pageSize" , (long long) g_minOSPageSizeBytes );
+        b.appendBool( "hugePages" , false );
+        b.append( "numa" , "default" );
+    }
+
 
     mutex mapViewMutex("mapView");
     ourbitset writable;
 
     MAdvise::MAdvise(void *,unsigned, Advice) { }
     MAdvise::~MAdvise() { }
+    void MAdvise::willNeed(void *,unsigned) { }
 
     // SERVER-2942 -- We do it this way because RemapLock is used in both mongod and mongos but
     // we need different effects.  When called in mongod it needs to be a mutex and in mongos it
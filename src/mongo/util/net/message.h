@@ -38,7 +38,11 @@ namespace mongo {
         dbQuery = 2004,
         dbGetMore = 2005,
         dbDelete = 2006,
-        dbKillCursors = 2007
+        dbKillCursors = 2007,
+        /* another message, snappy compressed. after the header: int original opCode, int
+           uncompressed size of what follows the original header, then the compressed bytes.
+           only sent to a peer which asked for it in isMaster; see MessagingPort::setCompressing */
+        dbCompressed = 2012
     };
 
     bool doesOpGetAResponse( int op );
@@ -54,6 +58,7 @@ namespace mongo {
         case dbGetMore: return "getmore";
         case dbDelete: return "remove";
         case dbKillCursors: return "killcursors";
+        case dbCompressed: return "compressed";
         default:
             massert( 16141, str::stream() << "cannot translate opcode " << op, !op );
             return "";
@@ -280,6 +285,17 @@ namespace mongo {
             return _freeIt;
         }
 
+        /** @return the single buffer, which the caller must then free(), or 0 if there isn't one
+                    this message owns */
+        MsgData* releaseSingleData() {
+            if ( !_buf || !_freeIt )
+                return 0;
+            MsgData *d = _buf;
+            _buf = 0;
+            _freeIt = false;
+            return d;
+        }
+
         void send( MessagingPort &p, const char *context );
         
         string toString() const;
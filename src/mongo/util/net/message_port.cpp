@@ -28,7 +28,12 @@
 #include "../background.h"
 #include "../time_support.h"
 #include "../../db/cmdline.h"
+#include "../../db/jsobj.h"
+#include "../compress.h"
 #include "../scopeguard.h"
+#include "../timer.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/util/trace_span.h"
 
 
 #ifndef _WIN32
@@ -120,21 +125,141 @@ namespace mongo {
     }
 
     MessagingPort::MessagingPort(int fd, const SockAddr& remote) 
-        : psock( new Socket( fd , remote ) ) , piggyBackData(0) {
+        : psock( new Socket( fd , remote ) ) , piggyBackData(0), _compressing(false) {
         ports.insert(this);
     }
 
     MessagingPort::MessagingPort( double timeout, int ll ) 
-        : psock( new Socket( timeout, ll ) ) {
+        : psock( new Socket( timeout, ll ) ), _compressing(false) {
         ports.insert(this);
         piggyBackData = 0;
     }
 
     MessagingPort::MessagingPort( boost::shared_ptr<Socket> sock )
-        : psock( sock ), piggyBackData( 0 ) {
+        : psock( sock ), piggyBackData( 0 ), _compressing( false ) {
         ports.insert(this);
     }
 
+    namespace {
+        const char compressorName[] = "snappy";
+
+        // the body of a dbCompressed message starts with the original opCode and size
+        const int CompressedPrefix = 8;
+        const int MaxMessageLen = 48000000;
+
+        AtomicUInt64 compressedOut;      // messages
+        AtomicUInt64 compressedOutBytes;      // before compression
+        AtomicUInt64 compressedOutWireBytes;  // after
+        AtomicUInt64 compressMicros;
+        AtomicUInt64 notCompressible;    // large messages sent plain as they didn't shrink
+        AtomicUInt64 compressedIn;
+        AtomicUInt64 compressedInWireBytes;
+        AtomicUInt64 compressedInBytes;       // after uncompressing
+        AtomicUInt64 uncompressMicros;
+
+        /** @return the dbCompressed form of m, or 0 if it wouldn't be smaller. m must be a single buffer */
+        MsgData* compressMessage( MsgData *m ) {
+            Timer t;
+            size_t bodyLen = m->dataLen();
+            size_t max = maxCompressedLength( bodyLen );
+            MsgData *c = (MsgData *) malloc( MsgDataHeaderSize + CompressedPrefix + max );
+            verify( c );
+            size_t compressedLen = 0;
+            rawCompress( m->_data, bodyLen,
+                         reinterpret_cast<char*>( c ) + MsgDataHeaderSize + CompressedPrefix,
+                         &compressedLen );
+            if ( compressedLen + CompressedPrefix >= bodyLen ) {
+                free( c );
+                notCompressible.fetchAndAdd( 1 );
+                return 0;
+            }
+            c->len = MsgDataHeaderSize + CompressedPrefix + compressedLen;
+            c->id = m->id;
+            c->responseTo = m->responseTo;
+            c->setOperation( dbCompressed );
+            int *prefix = reinterpret_cast<int*>( c->_data );
+            prefix[0] = m->operation();
+            prefix[1] = (int) bodyLen;
+
+            compressedOut.fetchAndAdd( 1 );
+            compressedOutBytes.fetchAndAdd( m->len );
+            compressedOutWireBytes.fetchAndAdd( c->len );
+            compressMicros.fetchAndAdd( t.micros() );
+            return c;
+        }
+
+        /** @return the message c holds, or 0 if it's malformed */
+        MsgData* uncompressMessage( MsgData *c ) {
+            Timer t;
+            if ( c->dataLen() < CompressedPrefix )
+                return 0;
+            const int *prefix = reinterpret_cast<const int*>( c->_data );
+            int op = prefix[0];
+            int bodyLen = prefix[1];
+            if ( op == dbCompressed || bodyLen < 0 || bodyLen > MaxMessageLen - MsgDataHeaderSize )
+                return 0;
+
+            string body;
+            if ( ! uncompress( c->_data + CompressedPrefix, c->dataLen() - CompressedPrefix, &body ) ||
+                 body.size() != (size_t) bodyLen )
+                return 0;
+
+            int len = MsgDataHeaderSize + bodyLen;
+            MsgData *m = (MsgData *) malloc( ( len + 1023 ) & 0xfffffc00 );
+            verify( m );
+            m->len = len;
+            m->id = c->id;
+            m->responseTo = c->responseTo;
+            m->setOperation( op );
+            memcpy( m->_data, body.data(), bodyLen );
+
+            compressedIn.fetchAndAdd( 1 );
+            compressedInWireBytes.fetchAndAdd( c->len );
+            compressedInBytes.fetchAndAdd( len );
+            uncompressMicros.fetchAndAdd( t.micros() );
+            return m;
+        }
+    }
+
+    void MessagingPort::appendCompressionStats( BSONObjBuilder& b ) {
+        BSONObjBuilder out( b.subobjStart( "sent" ) );
+        out.appendNumber( "messages", (long long) compressedOut.load() );
+        out.appendNumber( "bytes", (long long) compressedOutBytes.load() );
+        out.appendNumber( "wireBytes", (long long) compressedOutWireBytes.load() );
+        if ( compressedOutBytes.load() )
+            out.append( "ratio", (double) compressedOutWireBytes.load() / compressedOutBytes.load() );
+        out.appendNumber( "micros", (long long) compressMicros.load() );
+        out.appendNumber( "notCompressible", (long long) notCompressible.load() );
+        out.done();
+        BSONObjBuilder in( b.subobjStart( "received" ) );
+        in.appendNumber( "messages", (long long) compressedIn.load() );
+        in.appendNumber( "bytes", (long long) compressedInBytes.load() );
+        in.appendNumber( "wireBytes", (long long) compressedInWireBytes.load() );
+        if ( compressedInBytes.load() )
+            in.append( "ratio", (double) compressedInWireBytes.load() / compressedInBytes.load() );
+        in.appendNumber( "micros", (long long) uncompressMicros.load() );
+        in.done();
+    }
+
+    void appendCompressionOffer( BSONObjBuilder& b ) {
+        BSONArrayBuilder a( b.subarrayStart( "compression" ) );
+        a.append( compressorName );
+        a.done();
+    }
+
+    bool offersCompression( const BSONObj& o ) {
+        BSONElement e = o["compression"];
+        if ( e.type() != Array )
+            return false;
+        BSONObjIterator i( e.embeddedObject() );
+        while ( i.more() ) {
+            BSONElement c = i.next();
+            if ( c.type() == String && strcmp( c.valuestr(), compressorName ) == 0 )
+                return true;
+        }
+        return false;
+    }
+
     void MessagingPort::shutdown() {
         psock->close();
     }
@@ -155,6 +280,7 @@ again:
             char *lenbuf = (char *) &len;
             int lft = 4;
             psock->recv( lenbuf, lft );
+            recvStartMicros = curTimeMicros64();
 
             if ( len < 16 || len > 48000000 ) { // messages must be large enough for headers
                 if ( len == -1 ) {
@@ -189,6 +315,19 @@ again:
             int left = len -4;
 
             psock->recv( p, left );
+            recvEndMicros = curTimeMicros64();
+
+            if ( md->operation() == dbCompressed ) {
+                MsgData *u = uncompressMessage( md );
+                if ( u == 0 ) {
+                    log(0) << "recv(): bad compressed message from " << remote() << endl;
+                    return false;
+                }
+                guard.Dismiss();
+                free( md );
+                m.setData(u, true);
+                return true;
+            }
 
             guard.Dismiss();
             m.setData(md, true);
@@ -203,10 +342,12 @@ again:
     }
 
     void MessagingPort::reply(Message& received, Message& response) {
+        TraceSpan span( TraceSpans::Send );
         say(/*received.from, */response, received.header()->id);
     }
 
     void MessagingPort::reply(Message& received, Message& response, MSGID responseTo) {
+        TraceSpan span( TraceSpans::Send );
         say(/*received.from, */response, responseTo);
     }
 
@@ -263,6 +404,17 @@ again:
             }
         }
 
+        if ( _compressing && toSend.header()->len > CompressMinBytes &&
+             toSend.operation() != dbCompressed ) {
+            toSend.concat();
+            MsgData *c = compressMessage( toSend.singleData() );
+            if ( c ) {
+                Message compressed( c, true );
+                compressed.send( *this, "say" );
+                return;
+            }
+        }
+
         toSend.send( *this, "say" );
     }
 
@@ -22,6 +22,8 @@
 
 namespace mongo {
 
+    class BSONObj;
+    class BSONObjBuilder;
     class MessagingPort;
     class PiggyBackData;
 
@@ -29,7 +31,7 @@ namespace mongo {
 
     class AbstractMessagingPort : boost::noncopyable {
     public:
-        AbstractMessagingPort() : tag(0) {}
+        AbstractMessagingPort() : tag(0), queuedMicros(0), recvStartMicros(0), recvEndMicros(0) {}
         virtual ~AbstractMessagingPort() { }
         virtual void reply(Message& received, Message& response, MSGID responseTo) = 0; // like the reply below, but doesn't rely on received.data still being available
         virtual void reply(Message& received, Message& response) = 0;
@@ -39,12 +41,23 @@ namespace mongo {
 
         virtual void assertStillConnected() = 0;
 
+        /** compress large messages sent from now on; for ports which can */
+        virtual void setCompressing( bool on ) { }
+
     public:
         // TODO make this private with some helpers
 
         /* ports can be tagged with various classes.  see closeAllSockets(tag). defaults to 0. */
         unsigned tag;
 
+        /* for latency stats, in curTimeMicros64() terms, 0 if unknown: when the port was queued
+           for a worker thread with a request ready (--netWorkers), and when the last recv()
+           got the first bytes of its message and the whole of it.
+        */
+        unsigned long long queuedMicros;
+        unsigned long long recvStartMicros;
+        unsigned long long recvEndMicros;
+
     };
 
     class MessagingPort : public AbstractMessagingPort {
@@ -90,6 +103,15 @@ namespace mongo {
 
         void assertStillConnected();
 
+        /** messages larger than CompressMinBytes are sent as dbCompressed once this is on.
+            dbCompressed messages are always understood when received. */
+        enum { CompressMinBytes = 4096 };
+        virtual void setCompressing( bool on ) { _compressing = on; }
+        bool compressing() const { return _compressing; }
+
+        /** messages compressed and uncompressed, over all ports, for serverStatus */
+        static void appendCompressionStats( BSONObjBuilder& b );
+
         boost::shared_ptr<Socket> psock;
                 
         void send( const char * data , int len, const char *context ) {
@@ -111,6 +133,7 @@ namespace mongo {
     private:
         
         PiggyBackData * piggyBackData;
+        bool _compressing;
         
         // this is the parsed version of remote
         // mutable because its initialized only on call to remote()
@@ -122,5 +145,11 @@ namespace mongo {
         friend class PiggyBackData;
     };
 
+    /** adds the compression this end can speak to an isMaster command or reply */
+    void appendCompressionOffer( BSONObjBuilder& b );
+
+    /** @return true if an isMaster command or reply offers the compression this end speaks */
+    bool offersCompression( const BSONObj& o );
+
 
 } // namespace mongo
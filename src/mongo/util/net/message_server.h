@@ -44,9 +44,26 @@ namespace mongo {
         virtual void process( Message& m , AbstractMessagingPort* p , LastError * err ) = 0;
 
         /**
-         * called once when a socket is disconnected
+         * called once when a socket is disconnected.  must free the connection's thread
+         * state, as with a worker pool the thread goes on to serve other connections.
          */
         virtual void disconnected( AbstractMessagingPort* p ) = 0;
+
+        /**
+         * true if detach() and attach() move all of a connection's thread state, so that a
+         * worker pool may serve its messages from any thread.  otherwise each connection gets
+         * a thread of its own.
+         */
+        virtual bool canDetach() const { return false; }
+
+        /**
+         * takes the current connection's state (its Client, say) off this thread, between
+         * messages. @return the state, for attach()
+         */
+        virtual void* detach() { return 0; }
+
+        /** makes state from detach() this thread's again, before the connection's next message */
+        virtual void attach( void* state ) { }
     };
 
     class MessageServer {
@@ -54,8 +71,9 @@ namespace mongo {
         struct Options {
             int port;                   // port to bind to
             string ipList;             // addresses to bind to
+            int workers;                // threads to serve connections from; 0 for one per connection
 
-            Options() : port(0), ipList("") {}
+            Options() : port(0), ipList(""), workers(0) {}
         };
 
         virtual ~MessageServer() {}
@@ -63,6 +81,5 @@ namespace mongo {
         virtual void setAsTimeTracker() = 0;
     };
 
-    // TODO use a factory here to decide between port and asio variations
     MessageServer * createServer( const MessageServer::Options& opts , MessageHandler * handler );
 }
@@ -19,8 +19,6 @@
 
 #include <boost/thread/thread.hpp>
 
-#ifndef USE_ASIO
-
 #include "message.h"
 #include "message_port.h"
 #include "message_server.h"
@@ -31,9 +29,11 @@
 #include "../../db/stats/counters.h"
 #include "mongo/util/concurrency/remap_lock.h"
 #include "mongo/util/concurrency/ticketholder.h"
+#include "mongo/util/mem_accounting.h"
 
 #ifdef __linux__  // TODO: consider making this ifndef _WIN32
 # include <sys/resource.h>
+# include <sys/epoll.h>
 #endif
 
 namespace mongo {
@@ -44,6 +44,8 @@ namespace mongo {
 
         void threadRun( MessagingPort * inPort) {
             TicketHolderReleaser connTicketReleaser( &connTicketHolder );
+            MemAccounting::Charge stack( MemAccounting::ConnectionStacks );
+            stack.set( MemAccounting::threadStackBytes() );
 
             setThreadName( "conn" );
             
@@ -106,15 +108,253 @@ namespace mongo {
             handler->disconnected( p.get() );
         }
 
+#ifdef __linux__
+        /** a connection of the worker pool; parked in epoll while it waits for a message */
+        struct PooledConnection {
+            PooledConnection( MessagingPort *p ) :
+                port( p ), le( 0 ), state( 0 ), started( false ), registered( false ) { }
+            scoped_ptr<MessagingPort> port;
+            LastError *le;
+            void *state;       // from handler->detach()
+            string otherSide;
+            bool started;      // handler->connected() has been called
+            bool registered;   // with epoll
+        };
+
+        /**
+         * Serves connections from a fixed set of threads, rather than a thread each.  Idle
+         * connections wait in epoll; when one is readable a worker attaches its state, reads
+         * and processes one message, and parks it again.
+         *
+         * A worker blocked in a long operation (waiting on a lock, say) can't serve anything
+         * else, so if the queue of ready connections goes unserved for StarvedMillis another
+         * worker is started, up to 4 times the configured number.
+         */
+        class WorkerPool : boost::noncopyable {
+        public:
+            enum { StarvedMillis = 500 };
+
+            WorkerPool( int workers ) :
+                _m( "netWorkerPool" ), _threads( 0 ), _idle( 0 ), _maxThreads( workers * 4 ) {
+                _epfd = epoll_create( 1024 );
+                massert( 16349, str::stream() << "epoll_create failed: " << errnoWithDescription(),
+                         _epfd >= 0 );
+                for ( int i = 0; i < workers; i++ )
+                    startWorker();
+                boost::thread poller( boost::bind( &WorkerPool::poll, this ) );
+            }
+
+            /** takes ownership of p, which holds a connection ticket */
+            void add( MessagingPort *p ) {
+                dispatch( new PooledConnection( p ) );
+            }
+
+        private:
+            void startWorker() {
+                boost::thread thr( boost::bind( &WorkerPool::work, this ) );
+                _threads++;
+            }
+
+            void dispatch( PooledConnection *c ) {
+                c->port->queuedMicros = curTimeMicros64();
+                scoped_lock lk( _m );
+                _queue.push_back( make_pair( c, curTimeMillis64() ) );
+                if ( _idle > 0 )
+                    _ready.notify_one();
+            }
+
+            void poll() {
+                setThreadName( "netPoller" );
+                const int MaxEvents = 256;
+                struct epoll_event events[MaxEvents];
+                while ( ! inShutdown() ) {
+                    int n = epoll_wait( _epfd, events, MaxEvents, 100 );
+                    if ( n < 0 ) {
+                        if ( errno != EINTR ) {
+                            error() << "epoll_wait failed: " << errnoWithDescription() << endl;
+                            sleepmillis( 10 );
+                        }
+                        continue;
+                    }
+                    for ( int i = 0; i < n; i++ )
+                        dispatch( static_cast<PooledConnection*>( events[i].data.ptr ) );
+
+                    scoped_lock lk( _m );
+                    if ( ! _queue.empty() && _idle == 0 && _threads < _maxThreads &&
+                         curTimeMillis64() - _queue.front().second > (unsigned long long) StarvedMillis ) {
+                        log() << "network workers all busy for " << (int) StarvedMillis << "ms, starting another ("
+                              << _threads + 1 << " of at most " << _maxThreads << ")" << endl;
+                        startWorker();
+                    }
+                }
+            }
+
+            void work() {
+                MemAccounting::Charge stack( MemAccounting::ConnectionStacks );
+                stack.set( MemAccounting::threadStackBytes() );
+                while ( 1 ) {
+                    PooledConnection *c;
+                    {
+                        scoped_lock lk( _m );
+                        _idle++;
+                        while ( _queue.empty() )
+                            _ready.wait( lk.boost() );
+                        _idle--;
+                        c = _queue.front().first;
+                        _queue.pop_front();
+                    }
+                    if ( ! c->started )
+                        start( c );
+                    else
+                        serve( c );
+                }
+            }
+
+            void start( PooledConnection *c ) {
+                MessagingPort *p = c->port.get();
+                c->started = true;
+                try {
+                    p->psock->setLogLevel(1);
+                    p->psock->postFork();
+                    c->otherSide = p->psock->remoteString();
+                    c->le = new LastError();
+                    lastError.reset( c->le );
+                    // connected() numbers the connection only if the thread isn't already "connN"
+                    setThreadName( "netWorker" );
+                    handler->connected( p );
+                }
+                catch ( std::exception& e ) {
+                    log() << "exception starting connection " << c->otherSide << ", closing it: " << e.what() << endl;
+                    close( c );
+                    return;
+                }
+                park( c );
+            }
+
+            void serve( PooledConnection *c ) {
+                MessagingPort *p = c->port.get();
+                handler->attach( c->state );
+                c->state = 0;
+                lastError.reset( c->le );
+                bool ok = false;
+                Message m;
+                try {
+                    p->psock->clearCounters();
+                    ok = p->recv( m );
+                    if ( ok ) {
+                        handler->process( m , p , c->le );
+                        networkCounter.hit( p->psock->getBytesIn() , p->psock->getBytesOut() );
+                    }
+                    else if ( !cmdLine.quiet ) {
+                        int conns = connTicketHolder.used()-1;
+                        const char* word = (conns == 1 ? " connection" : " connections");
+                        log() << "end connection " << c->otherSide << " (" << conns << word << " now open)" << endl;
+                    }
+                }
+                catch ( AssertionException& e ) {
+                    log() << "AssertionException handling request, closing client connection: " << e << endl;
+                }
+                catch ( SocketException& e ) {
+                    log() << "SocketException handling request, closing client connection: " << e << endl;
+                }
+                catch ( const DBException& e ) { // must be right above std::exception to avoid catching subclasses
+                    log() << "DBException handling request, closing client connection: " << e << endl;
+                }
+                catch ( std::exception &e ) {
+                    error() << "Uncaught std::exception: " << e.what() << ", terminating" << endl;
+                    dbexit( EXIT_UNCAUGHT );
+                }
+                catch ( ... ) {
+                    error() << "Uncaught exception, terminating" << endl;
+                    dbexit( EXIT_UNCAUGHT );
+                }
+
+                if ( ! ok || inShutdown() ) {
+                    close( c );
+                    return;
+                }
+                park( c );
+            }
+
+            /** waits for c's next message, with its state off this thread */
+            void park( PooledConnection *c ) {
+                c->state = handler->detach();
+                lastError.release();
+
+                // pipelined messages may already have been read off the socket with this one;
+                // epoll won't report those, so queue the connection straight away
+                if ( c->port->psock->hasBufferedInput() ) {
+                    dispatch( c );
+                    return;
+                }
+
+                struct epoll_event ev;
+                memset( &ev, 0, sizeof( ev ) );
+                ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+                ev.data.ptr = c;
+                int op = c->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+                if ( epoll_ctl( _epfd, op, c->port->psock->rawFD(), &ev ) != 0 ) {
+                    log() << "epoll_ctl failed for " << c->otherSide << ", closing connection: "
+                          << errnoWithDescription() << endl;
+                    handler->attach( c->state );
+                    c->state = 0;
+                    lastError.reset( c->le );
+                    close( c );
+                    return;
+                }
+                c->registered = true;
+            }
+
+            /** with c's state on this thread */
+            void close( PooledConnection *c ) {
+                c->port->shutdown();
+                if ( c->started ) {
+                    try {
+                        handler->disconnected( c->port.get() );
+                    }
+                    catch ( std::exception& e ) {
+                        log() << "exception closing connection " << c->otherSide << ": " << e.what() << endl;
+                    }
+                }
+                lastError.reset( 0 );
+                delete c; // closing the socket takes it out of epoll
+                connTicketHolder.release();
+            }
+
+            int _epfd;
+            mongo::mutex _m;
+            boost::condition _ready;
+            deque< pair<PooledConnection*, unsigned long long> > _queue; // ready, with when they were queued
+            int _threads;
+            int _idle;
+            const int _maxThreads;
+        };
+#endif
+
     }
 
     class PortMessageServer : public MessageServer , public Listener {
     public:
         PortMessageServer(  const MessageServer::Options& opts, MessageHandler * handler ) :
-            Listener( "" , opts.ipList, opts.port ) {
+            Listener( "" , opts.ipList, opts.port ), _workers( 0 ) {
 
             uassert( 10275 ,  "multiple PortMessageServer not supported" , ! pms::handler );
             pms::handler = handler;
+
+            if ( opts.workers > 0 ) {
+#ifdef __linux__
+                bool pool = handler->canDetach();
+# ifdef MONGO_SSL
+                pool = pool && ! cmdLine.sslOnNormalPorts; // SSL buffers input out of epoll's sight
+# endif
+                if ( pool ) {
+                    log() << "serving connections from " << opts.workers << " worker threads" << endl;
+                    _workers = new pms::WorkerPool( opts.workers );
+                }
+                else
+#endif
+                    warning() << "a worker pool isn't supported here, using a thread per connection" << endl;
+            }
         }
 
         virtual void acceptedMP(MessagingPort * p) {
@@ -130,6 +370,13 @@ namespace mongo {
                 return;
             }
 
+#ifdef __linux__
+            if ( _workers ) {
+                _workers->add( p );
+                return;
+            }
+#endif
+
             try {
 #ifndef __linux__  // TODO: consider making this ifdef _WIN32
                 {
@@ -201,6 +448,13 @@ namespace mongo {
         }
 
         virtual bool useUnixSockets() const { return true; }
+
+    private:
+#ifdef __linux__
+        pms::WorkerPool *_workers; // leaked; lives as long as the process
+#else
+        void *_workers;
+#endif
     };
 
 
@@ -209,5 +463,3 @@ namespace mongo {
     }
 
 }
-
-#endif
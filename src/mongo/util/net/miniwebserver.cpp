@@ -163,11 +163,12 @@ namespace mongo {
         ss << "Connection: close\r\n";
         ss << "Content-Length: " << responseMsg.size() << "\r\n";
         ss << "\r\n";
-        ss << responseMsg;
         string response = ss.str();
 
         try {
+            // the body can be tens of megabytes; send it as it is rather than copying it in
             psock->send( response.c_str(), response.size() , "http response" );
+            psock->send( responseMsg.c_str(), responseMsg.size() , "http response" );
             psock->close();
         }
         catch ( SocketException& e ) {
@@ -519,6 +519,9 @@ namespace mongo {
     void Socket::_init() {
         _bytesOut = 0;
         _bytesIn = 0;
+        _readAhead = 0;
+        _readAheadStart = 0;
+        _readAheadEnd = 0;
 #ifdef MONGO_SSL
         _ssl = 0;
         _sslAccepted = 0;
@@ -537,6 +540,14 @@ namespace mongo {
             closesocket( _fd );
             _fd = -1;
         }
+        _releaseReadAhead();
+    }
+
+    void Socket::_releaseReadAhead() {
+        free( _readAhead );
+        _readAhead = 0;
+        _readAheadStart = 0;
+        _readAheadEnd = 0;
     }
     
 #ifdef MONGO_SSL
@@ -726,7 +737,7 @@ namespace mongo {
         struct msghdr meta;
         memset( &meta, 0, sizeof( meta ) );
         meta.msg_iov = &d[ 0 ];
-        meta.msg_iovlen = d.size();
+        meta.msg_iovlen = i; // the parts that aren't empty
 
         while( meta.msg_iovlen > 0 ) {
             int ret = ::sendmsg( _fd , &meta , portSendFlags );
@@ -806,9 +817,42 @@ namespace mongo {
     }
 
     int Socket::unsafe_recv( char *buf, int max ) {
-        int x = _recv( buf , max );
+        if ( hasBufferedInput() ) {
+            int n = min( max , _readAheadEnd - _readAheadStart );
+            memcpy( buf , _readAhead + _readAheadStart , n );
+            _readAheadStart += n;
+            if ( ! hasBufferedInput() )
+                _releaseReadAhead();
+            return n;
+        }
+
+        if ( max >= ReadAheadSize ) {
+            // big enough to be worth the syscall on its own, and saves a copy
+            int x = _recv( buf , max );
+            if ( x > 0 )
+                _bytesIn += x;
+            return x;
+        }
+
+        if ( _readAhead == 0 ) {
+            _readAhead = (char *) malloc( ReadAheadSize );
+            // without the buffer just read what was asked for
+            if ( _readAhead == 0 ) {
+                int x = _recv( buf , max );
+                if ( x > 0 )
+                    _bytesIn += x;
+                return x;
+            }
+        }
+        int x = _recv( _readAhead , ReadAheadSize );
+        if ( x <= 0 ) {
+            _releaseReadAhead();
+            return x;
+        }
         _bytesIn += x;
-        return x;
+        _readAheadStart = 0;
+        _readAheadEnd = x;
+        return unsafe_recv( buf , max );
     }
 
 
@@ -195,7 +195,11 @@ namespace mongo {
 
         // recv len or throw SocketException
         void recv( char * data , int len );
+        /** like ::recv, but hands out anything already read ahead first */
         int unsafe_recv( char *buf, int max );
+
+        /** @return true if bytes have been read from the wire that nobody has asked for yet */
+        bool hasBufferedInput() const { return _readAheadEnd > _readAheadStart; }
         
         int getLogLevel() const { return _logLevel; }
         void setLogLevel( int ll ) { _logLevel = ll; }
@@ -210,6 +214,9 @@ namespace mongo {
         
         void setTimeout( double secs );
 
+        /** for polling readiness; don't read or write it directly */
+        int rawFD() const { return _fd; }
+
         bool stillConnected();
 
 #ifdef MONGO_SSL
@@ -238,6 +245,19 @@ namespace mongo {
         /** raw recv, same semantics as ::recv */
         int _recv( char * buf , int max );
 
+        /** frees the read ahead buffer, discarding anything left in it */
+        void _releaseReadAhead();
+
+        /**
+         * Small reads (a message header, a short body) are served from a buffer filled with
+         * whatever the socket has ready, so a small message, or several pipelined ones, costs
+         * one syscall instead of two each.  The buffer only exists while it holds bytes.
+         */
+        enum { ReadAheadSize = 16 * 1024 };
+        char *_readAhead;
+        int _readAheadStart;
+        int _readAheadEnd;
+
         int _fd;
         SockAddr _remote;
         double _timeout;
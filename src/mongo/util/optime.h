@@ -19,6 +19,8 @@
 
 #include <boost/thread/condition.hpp>
 
+#include "mongo/platform/atomic_word.h"
+
 namespace mongo {
 
     struct ClockSkewException : public DBException {
@@ -37,13 +39,13 @@ namespace mongo {
     class OpTime {
         unsigned i; // ordinal comes first so we can do a single 64 bit compare on little endian
         unsigned secs;
-        static OpTime last;
-        static OpTime skewed();
+        static AtomicUInt64 last; // asDate() of the latest OpTime handed out
+        static OpTime skewed( const OpTime& prev );
     public:
         static void setLast(const Date_t &date) {
             mutex::scoped_lock lk(m);
             notifier.notify_all(); // won't really do anything until write-lock released
-            last = OpTime(date);
+            last.store( OpTime(date).asDate() );
         }
         unsigned getSecs() const {
             return secs;
@@ -78,8 +80,19 @@ namespace mongo {
 
         static mongo::mutex m;
 
+        /**
+         * Under m, for the oplog: its entries go in in OpTime order, and this wakes anyone in
+         * waitForDifferent().
+         */
         static OpTime now(const mongo::mutex::scoped_lock&);
 
+        /**
+         * A new OpTime, greater than all before it, by a compare and swap rather than under m.
+         * For times that don't go in the oplog, such as those of Timestamp fields. Still wakes
+         * waitForDifferent(), as it too has changed the last OpTime.
+         */
+        static OpTime now();
+
         static OpTime getLast(const mongo::mutex::scoped_lock&);
 
         // Waits for global OpTime to be different from *this
@@ -30,6 +30,7 @@ namespace mongo {
     using namespace mongoutils;
 
     extern string dbpath;
+    extern vector<string> dataPaths;
 
     /** this is very much like a boost::path.  however, we define a new type to get some type
         checking.  if you want to say 'my param MUST be a relative path", use this.
@@ -51,7 +52,12 @@ namespace mongo {
             string fullpath = f.string();
             string relative = str::after(fullpath, dbp.string());
             if( relative.empty() ) {
-                log() << "warning file is not under db path? " << fullpath << ' ' << dbp.string() << endl;
+                // a data file striped onto one of --dataPaths is kept by its full path
+                bool striped = false;
+                for( unsigned i = 0; i < dataPaths.size() && !striped; i++ )
+                    striped = str::startsWith(fullpath, boost::filesystem::path(dataPaths[i]).string());
+                if( !striped )
+                    log() << "warning file is not under db path? " << fullpath << ' ' << dbp.string() << endl;
                 RelativePath rp;
                 rp._p = fullpath;
                 return rp;
@@ -74,6 +80,8 @@ namespace mongo {
         bool operator<(const RelativePath& r) const { return _p < r._p; }
 
         string asFullPath() const {
+            if( boost::filesystem::path(_p).is_complete() )
+                return _p;
             boost::filesystem::path x(dbpath);
             x /= _p;
             return x.string();
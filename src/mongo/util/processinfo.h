@@ -104,6 +104,13 @@ namespace mongo {
 
         static bool blockInMemory( char * start );
 
+        /**
+         * notes in (*out)[i] whether the i'th of the numPages pages from start, which must be
+         * page aligned, is in memory
+         * @return false if that can't be told
+         */
+        static bool pagesInMemory( const char * start , size_t numPages , vector<char> * out );
+
     private:
         /**
          * Host and operating system info.  Does not change over time.
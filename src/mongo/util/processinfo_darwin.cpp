@@ -185,4 +185,18 @@ namespace mongo {
         return x & 0x1;
     }
 
+    bool ProcessInfo::pagesInMemory( const char * start , size_t numPages , vector<char> * out ) {
+        static long pageSize = sysconf( _SC_PAGESIZE );
+        out->resize( numPages );
+        if ( numPages == 0 )
+            return true;
+        if ( mincore( (void*) start , numPages * pageSize , &(*out)[0] ) ) {
+            log() << "mincore failed: " << errnoWithDescription() << endl;
+            return false;
+        }
+        for ( size_t i = 0; i < numPages; i++ )
+            (*out)[i] &= 0x1;
+        return true;
+    }
+
 }
@@ -62,4 +62,8 @@ namespace mongo {
         return true;
     }
 
+    bool ProcessInfo::pagesInMemory( const char * start , size_t numPages , vector<char> * out ) {
+        return false;
+    }
+
 }
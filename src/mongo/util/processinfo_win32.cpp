@@ -223,4 +223,30 @@ namespace mongo {
         return false;
     }
 
+    bool ProcessInfo::pagesInMemory( const char * start , size_t numPages , vector<char> * out ) {
+        if ( ! blockCheckSupported() )
+            return false;
+        static DWORD pageSize = 0;
+        if ( pageSize == 0 ) {
+            SYSTEM_INFO si;
+            GetSystemInfo( &si );
+            pageSize = si.dwPageSize;
+        }
+        out->resize( numPages );
+        // a batch of pages a call
+        const size_t Batch = 1024;
+        vector<PSAPI_WORKING_SET_EX_INFORMATION> wsinfo( Batch );
+        for ( size_t i = 0; i < numPages; i += Batch ) {
+            size_t n = min( Batch , numPages - i );
+            for ( size_t j = 0; j < n; j++ )
+                wsinfo[j].VirtualAddress = (void*) ( start + ( i + j ) * pageSize );
+            if ( ! psapiGlobal.QueryWSEx( GetCurrentProcess() , &wsinfo[0] ,
+                                          (DWORD) ( n * sizeof(PSAPI_WORKING_SET_EX_INFORMATION) ) ) )
+                return false;
+            for ( size_t j = 0; j < n; j++ )
+                (*out)[i+j] = wsinfo[j].VirtualAttributes.Valid;
+        }
+        return true;
+    }
+
 }
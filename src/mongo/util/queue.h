@@ -19,8 +19,8 @@
 
 #include "pch.h"
 
+#include <deque>
 #include <limits>
-#include <queue>
 
 #include "mongo/util/timer.h"
 
@@ -34,7 +34,8 @@ namespace mongo {
     /**
      * Simple blocking queue with optional max size.
      * A custom sizing function can optionally be given.  By default, size is calculated as
-     * _queue.size().
+     * _queue.size().  An element is always let into an empty queue, so one bigger than the max
+     * size can't wedge it.
      */
     template<typename T>
     class BlockingQueue : boost::noncopyable {
@@ -43,25 +44,33 @@ namespace mongo {
         BlockingQueue() :
             _lock("BlockingQueue"),
             _maxSize(std::numeric_limits<std::size_t>::max()),
+            _currentSize(0),
             _getSize(&_getSizeDefault) {}
         BlockingQueue(size_t size) :
             _lock("BlockingQueue(bounded)"),
             _maxSize(size),
+            _currentSize(0),
             _getSize(&_getSizeDefault) {}
         BlockingQueue(size_t size, getSizeFunc f) :
             _lock("BlockingQueue(custom size)"),
             _maxSize(size),
+            _currentSize(0),
             _getSize(f) {}
 
         void push(T const& t) {
             scoped_lock l( _lock );
-            size_t tSize = _getSize(t);
-            while (_queue.size()+tSize >= _maxSize) {
-                _cvNoLongerFull.wait( l.boost() );
-            }
-            _queue.push( t );
-            _currentSize += tSize;
-            _cvNoLongerEmpty.notify_one();
+            _push( l, t );
+        }
+
+        /**
+         * pushes the elements in order, taking the lock once.  waits for room before each one,
+         * so a consumer can start on the front of the run while the rest waits.
+         */
+        template <typename It>
+        void pushAll(It begin, It end) {
+            scoped_lock l( _lock );
+            for ( ; begin != end; ++begin )
+                _push( l, *begin );
         }
 
         bool empty() const {
@@ -74,9 +83,17 @@ namespace mongo {
             return _currentSize;
         }
 
+        /** @return the number of elements queued, whatever the sizing function */
+        size_t count() const {
+            scoped_lock l( _lock );
+            return _queue.size();
+        }
+
+        size_t maxSize() const { return _maxSize; }
+
         void clear() {
             scoped_lock l(_lock);
-            _queue = std::queue<T>();
+            _queue.clear();
             _currentSize = 0;
         }
 
@@ -86,7 +103,7 @@ namespace mongo {
                 return false;
 
             t = _queue.front();
-            _queue.pop();
+            _queue.pop_front();
             _currentSize -= _getSize(t);
             _cvNoLongerFull.notify_one();
 
@@ -100,7 +117,7 @@ namespace mongo {
                 _cvNoLongerEmpty.wait( l.boost() );
 
             T t = _queue.front();
-            _queue.pop();
+            _queue.pop_front();
             _currentSize -= _getSize(t);
             _cvNoLongerFull.notify_one();
 
@@ -128,7 +145,7 @@ namespace mongo {
             }
 
             t = _queue.front();
-            _queue.pop();
+            _queue.pop_front();
             _currentSize -= _getSize(t);
             _cvNoLongerFull.notify_one();
             return true;
@@ -151,9 +168,63 @@ namespace mongo {
             return true;
         }
 
+        /**
+         * copies the element at position i (0 is the front) into t without removing it.
+         * does not block.
+         * @return false if there are not more than i elements queued
+         */
+        bool peekAt(size_t i, T& t) const {
+            scoped_lock l( _lock );
+            if ( i >= _queue.size() )
+                return false;
+
+            t = _queue[i];
+            return true;
+        }
+
+        /**
+         * appends copies of up to n elements, starting at position start, to out.  does not
+         * block or remove anything.
+         * @return the number of elements copied
+         */
+        template <typename Container>
+        size_t peekRun(size_t start, size_t n, Container* out) const {
+            scoped_lock l( _lock );
+            size_t i = start;
+            for ( ; i < _queue.size() && i - start < n; i++ )
+                out->push_back( _queue[i] );
+            return i - start;
+        }
+
+        /**
+         * removes up to n elements from the front.  does not block.
+         * @return the number of elements removed
+         */
+        size_t popFront(size_t n) {
+            scoped_lock l( _lock );
+            size_t i = 0;
+            for ( ; i < n && !_queue.empty(); i++ ) {
+                _currentSize -= _getSize( _queue.front() );
+                _queue.pop_front();
+            }
+            if ( i > 0 )
+                _cvNoLongerFull.notify_all();
+            return i;
+        }
+
     private:
+        void _push(scoped_lock& l, T const& t) {
+            size_t tSize = _getSize(t);
+            while ( !_queue.empty() && _currentSize + tSize > _maxSize ) {
+                _cvNoLongerFull.wait( l.boost() );
+            }
+            _queue.push_back( t );
+            _currentSize += tSize;
+            _cvNoLongerEmpty.notify_one();
+        }
+
         mutable mongo::mutex _lock;
-        std::queue<T> _queue;
+        std::deque<T> _queue;
         const size_t _maxSize;
         size_t _currentSize;
         getSizeFunc _getSize;
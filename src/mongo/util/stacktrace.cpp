@@ -44,6 +44,19 @@ namespace mongo {
         os.flush();
         ::free( strings );
     }
+
+    int getStackFrames( void** frames, int maxFrames ) {
+        return ::backtrace( frames, maxFrames );
+    }
+
+    void describeStackFrames( void* const* frames, int n, std::vector<std::string>* out ) {
+        char **strings = ::backtrace_symbols( frames, n );
+        if ( ! strings )
+            return;
+        for ( int i = 0; i < n; i++ )
+            out->push_back( strings[i] );
+        ::free( strings );
+    }
 }
 
 #elif defined(_WIN32)
@@ -262,3 +275,21 @@ namespace mongo {
 
 #endif
 
+#ifndef MONGO_HAVE_EXECINFO_BACKTRACE
+
+#include <sstream>
+
+namespace mongo {
+    int getStackFrames( void** frames, int maxFrames ) { return 0; }
+
+    void describeStackFrames( void* const* frames, int n, std::vector<std::string>* out ) {
+        for ( int i = 0; i < n; i++ ) {
+            std::stringstream ss;
+            ss << frames[i];
+            out->push_back( ss.str() );
+        }
+    }
+}
+
+#endif
+
@@ -7,10 +7,20 @@
 #pragma once
 
 #include <iostream>
+#include <string>
+#include <vector>
 
 namespace mongo {
 
     // Print stack trace information to "os", default to std::cout.
     void printStackTrace(std::ostream &os=std::cout);
 
+    // Store up to "maxFrames" return addresses of the current thread's stack in "frames", and
+    // return how many were stored; 0 where that isn't supported.  The first call may allocate,
+    // later ones don't, so a signal handler can call it once something else already has.
+    int getStackFrames(void** frames, int maxFrames);
+
+    // Append a printable description of each of the "n" frames to "out".
+    void describeStackFrames(void* const* frames, int n, std::vector<std::string>* out);
+
 }  // namespace mongo
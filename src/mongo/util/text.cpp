@@ -102,6 +102,16 @@ namespace mongo {
     bool isValidUTF8(const char *s) {
         int left = 0; // how many bytes are left in the current codepoint
         while (*s) {
+            // eight ascii bytes at a time, none of them the terminator.  aligned, so the load
+            // can't run off the end of the page the string ends in
+            if (!left && ((size_t)s & 7) == 0) {
+                const unsigned long long w = *(const unsigned long long*) s;
+                const unsigned long long highBits = 0x8080808080808080ULL;
+                if (!(w & highBits) && !((w - 0x0101010101010101ULL) & ~w & highBits)) {
+                    s += 8;
+                    continue;
+                }
+            }
             const unsigned char c = (unsigned char) *(s++);
             const int ones = leadingOnes(c);
             if (left) {
@@ -0,0 +1,88 @@
+// @file timer_wheel.h
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+namespace mongo {
+
+    /**
+     * Ids filed by the time they next need looking at, in a ring of slots of slotMillis each, so
+     * that timing things out visits only what has come due rather than everything.
+     *
+     * Filing an id or removing it costs a set insert or erase in one slot.  A due time past the
+     * far edge of the ring is filed at the edge, and expire() can hand back an id before it is
+     * due, so whoever files ids checks what expire() returns and files again what isn't done.
+     * That also makes touching an entry free: note the time it was used, and refile it when its
+     * slot comes round.
+     *
+     * Not thread safe.
+     */
+    class TimerWheel {
+    public:
+        TimerWheel( long long slotMillis , unsigned nSlots ) :
+            _slotMillis( slotMillis ), _slots( nSlots ), _nextTick( 0 ), _size( 0 ) {
+        }
+
+        /**
+         * files id to come back from expire() once due has passed.
+         * @return the tick to remove( id ) with
+         */
+        long long add( long long id , long long due , long long now ) {
+            long long nowTick = now / _slotMillis;
+            long long tick = std::max( due / _slotMillis , std::max( nowTick , _nextTick ) );
+            tick = std::min( tick , nowTick + (long long) _slots.size() - 1 );
+            if ( _slots[ tick % _slots.size() ].insert( id ).second )
+                _size++;
+            return tick;
+        }
+
+        void remove( long long id , long long tick ) {
+            _size -= _slots[ tick % _slots.size() ].erase( id );
+        }
+
+        /**
+         * removes the ids in the slots which have come due by now and adds them to ids.  the
+         * slot now falls in is visited again by the next call, as more may be filed in it.
+         */
+        void expire( long long now , std::vector<long long>* ids ) {
+            long long nowTick = now / _slotMillis;
+            long long n = std::min( nowTick - _nextTick + 1 , (long long) _slots.size() );
+            for ( long long i = 0; i < n; i++ ) {
+                std::set<long long>& slot = _slots[ ( _nextTick + i ) % _slots.size() ];
+                ids->insert( ids->end() , slot.begin() , slot.end() );
+                _size -= slot.size();
+                slot.clear();
+            }
+            _nextTick = std::max( _nextTick , nowTick );
+        }
+
+        /** @return the number of ids filed */
+        size_t size() const { return _size; }
+
+    private:
+        long long _slotMillis;
+        std::vector< std::set<long long> > _slots;
+        long long _nextTick; // the first tick expire() hasn't finished with
+        size_t _size;
+    };
+
+}
@@ -22,21 +22,159 @@
 #include <list>
 #include <string>
 
+#include "mongo/db/btree.h"
 #include "mongo/db/curop.h"
 #include "mongo/db/pdfile.h"
 #include "mongo/db/database.h"
+#include "mongo/util/concurrency/thread_pool.h"
 #include "mongo/util/mmap.h"
 #include "mongo/util/progress_meter.h"
+#include "mongo/util/timer.h"
 
 namespace mongo {
     struct touch_location {
         HANDLE fd;
         int offset;
         size_t length;
-        Extent *ext;
+        const char *mapped;
     };
-        
-    void touchNs( const std::string& ns ) { 
+
+    // extents are cut into pieces this long, so the pool can share a big one out and the
+    // throttle gets a look in between reads
+    static const size_t TouchPieceBytes = 1024 * 1024;
+
+    static void addRange( std::vector< touch_location >& ranges, HANDLE fd, int offset, size_t length,
+                          const char *mapped ) {
+        for ( size_t done = 0; done < length; done += TouchPieceBytes ) {
+            touch_location tl;
+            tl.fd = fd;
+            tl.offset = offset + done;
+            tl.length = std::min( TouchPieceBytes, length - done );
+            tl.mapped = mapped + done;
+            ranges.push_back(tl);
+        }
+    }
+
+    /** what the threads touching one set of ranges share: the rate they may read at, and how far they got */
+    class Toucher : boost::noncopyable {
+    public:
+        Toucher( int rateMB ) : _m( "Toucher" ), _rateMB( rateMB ), _started( 0 ), _touched( 0 ),
+                                _done( 0 ), _errCode( 0 ), _stop( false ) {}
+
+        void touch( const touch_location& tl ) {
+            long long ahead = 0;
+            {
+                scoped_lock lk( _m );
+                _started += tl.length;
+                if ( _rateMB > 0 )
+                    ahead = _started * 1000000 / ( _rateMB * 1024LL * 1024 ) - _t.micros();
+            }
+            if ( ahead > 0 && ! _stop )
+                sleepmicros( ahead );
+
+            bool ok = false;
+            if ( ! _stop ) {
+                try {
+                    touch_pages( tl.fd, tl.offset, tl.length, tl.mapped );
+                    ok = true;
+                }
+                catch ( DBException& e ) {
+                    scoped_lock lk( _m );
+                    if ( ! _errCode ) {
+                        _errCode = e.getCode();
+                        _errMsg = e.what();
+                    }
+                    _stop = true;
+                }
+            }
+
+            scoped_lock lk( _m );
+            if ( ok )
+                _touched += tl.length;
+            _done++;
+        }
+
+        /** the ranges not yet started are skipped */
+        void stop() { _stop = true; }
+        bool stopped() const { return _stop; }
+
+        int done() {
+            scoped_lock lk( _m );
+            return _done;
+        }
+
+        long long touched() {
+            scoped_lock lk( _m );
+            return _touched;
+        }
+
+        /** rethrows the first range's failure, if one failed */
+        void check() {
+            scoped_lock lk( _m );
+            if ( _errCode )
+                msgasserted( _errCode, _errMsg );
+        }
+
+    private:
+        mongo::mutex _m;
+        Timer _t;
+        const int _rateMB;
+        long long _started;
+        long long _touched;
+        int _done;
+        int _errCode;
+        std::string _errMsg;
+        volatile bool _stop;
+    };
+
+    /** the caller holds LockMongoFilesShared, so the files stay mapped, but no db lock */
+    static long long touchRanges( const std::vector< touch_location >& ranges,
+                                  const std::string& what,
+                                  const TouchOptions& options ) {
+        std::string progress_msg = "touch " + what;
+        ProgressMeterHolder pm( cc().curop()->setMessage( progress_msg.c_str() , ranges.size() ) );
+        Toucher toucher( options.rateMB );
+
+        int threads = std::min( options.threads, (int) ranges.size() );
+        if ( threads <= 1 ) {
+            for ( std::vector< touch_location >::const_iterator it = ranges.begin();
+                  it != ranges.end() && ! toucher.stopped();
+                  ++it ) {
+                toucher.touch( *it );
+                pm.hit();
+                killCurrentOp.checkForInterrupt(false);
+            }
+        }
+        else {
+            threadpool::ThreadPool pool( threads );
+            for ( std::vector< touch_location >::const_iterator it = ranges.begin(); it != ranges.end(); ++it )
+                pool.schedule( &Toucher::touch, &toucher, *it );
+
+            // the pool's threads have no CurOp of their own, so progress and killOp are seen to here
+            int reported = 0;
+            try {
+                while ( pool.tasks_remaining() > 0 ) {
+                    sleepmillis( 20 );
+                    int done = toucher.done();
+                    pm.hit( done - reported );
+                    reported = done;
+                    killCurrentOp.checkForInterrupt(false);
+                }
+            }
+            catch ( ... ) {
+                toucher.stop();
+                pool.join();
+                throw;
+            }
+            pool.join();
+            pm.hit( toucher.done() - reported );
+        }
+        toucher.check();
+        pm.finished();
+        return toucher.touched();
+    }
+
+    long long touchNs( const std::string& ns, const TouchOptions& options ) { 
         std::vector< touch_location > ranges;
         Client::ReadContext ctx(ns);
         {
@@ -47,30 +185,74 @@ namespace mongo {
             for( DiskLoc L = nsd->firstExtent; !L.isNull(); L = L.ext()->xnext )  {
                 MongoDataFile* mdf = cc().database()->getFile( L.a() );
                 massert( 16238, "can't fetch extent file structure", mdf );
+                Extent *ext = L.ext();
+                addRange( ranges, mdf->getFd(), L.getOfs(), ext->length,
+                          static_cast<const char *>(static_cast<const void *>(ext)) );
+            }
+
+        }
+        LockMongoFilesShared lk;
+        Lock::TempRelease tr;
+        return touchRanges( ranges, ns + " extents", options );
+    }
+
+    /** orders records by where they are on disk */
+    static bool locationLess( const touch_location& a, const touch_location& b ) {
+        if ( a.fd != b.fd )
+            return a.fd < b.fd;
+        return a.offset < b.offset;
+    }
+
+    long long touchIdRange( const std::string& ns, const BSONElement& min, const BSONElement& max,
+                            const TouchOptions& options ) {
+        std::vector< touch_location > records;
+        Client::ReadContext ctx(ns);
+        {
+            NamespaceDetails *nsd = nsdetails(ns.c_str());
+            uassert( 16154, "namespace does not exist", nsd );
+            int idxNo = nsd->findIdIndex();
+            uassert( 16416, "touch by _id range needs an _id index", idxNo >= 0 );
+
+            BSONObjBuilder lo, hi;
+            lo.appendAs( min, "" );
+            hi.appendAs( max, "" );
+            // walking the index for the locations pages in the part of it the range covers, too
+            scoped_ptr<Cursor> c( BtreeCursor::make( nsd, idxNo, nsd->idx( idxNo ), lo.obj(), hi.obj(), true, 1 ) );
+            for ( ; c->ok(); c->advance() ) {
+                DiskLoc loc = c->currLoc();
+                MongoDataFile* mdf = cc().database()->getFile( loc.a() );
+                massert( 16238, "can't fetch extent file structure", mdf );
                 touch_location tl;
                 tl.fd = mdf->getFd();
-                tl.offset = L.getOfs();
-                tl.ext = L.ext();
-                tl.length = tl.ext->length;
-                
-                ranges.push_back(tl);                
+                tl.offset = loc.getOfs();
+                Record *r = loc.rec();
+                tl.mapped = static_cast<const char *>(static_cast<const void *>(r));
+                tl.length = r->lengthWithHeaders();
+                records.push_back( tl );
+                killCurrentOp.checkForInterrupt(false);
             }
+        }
 
+        // _id order isn't disk order: sort them and run neighbours in the same file, a page or
+        // so apart, together, so each page is read once and mostly in the order it's laid out
+        std::sort( records.begin(), records.end(), locationLess );
+        std::vector< touch_location > ranges;
+        for ( std::vector< touch_location >::const_iterator it = records.begin(); it != records.end(); ) {
+            touch_location run = *it;
+            for ( ++it; it != records.end() && it->fd == run.fd &&
+                        it->offset <= run.offset + (long long) ( run.length + g_minOSPageSizeBytes ); ++it ) {
+                run.length = std::max( run.length, (size_t) ( it->offset + it->length - run.offset ) );
+            }
+            addRange( ranges, run.fd, run.offset, run.length, run.mapped );
         }
+
         LockMongoFilesShared lk;
         Lock::TempRelease tr;
-        std::string progress_msg = "touch " + ns + " extents";
-        ProgressMeterHolder pm( cc().curop()->setMessage( progress_msg.c_str() , ranges.size() ) );
-        for ( std::vector< touch_location >::iterator it = ranges.begin(); it != ranges.end(); ++it ) {
-            touch_pages( it->fd, it->offset, it->length, it->ext );
-            pm.hit();
-            killCurrentOp.checkForInterrupt(false);
-        }
-        pm.finished();
+        return touchRanges( ranges, ns + " _id range", options );
     }
 
 #if defined(__linux__)    
-    void touch_pages( HANDLE fd, int offset, size_t length, const Extent* ext ) {
+    void touch_pages( HANDLE fd, int offset, size_t length, const void* mapped ) {
         if ( -1 == readahead(fd, offset, length) ) {
             massert( 16237, str::stream() << "readahead failed on fd " << fd 
                      << " offset " << offset << " len " << length 
@@ -79,9 +261,9 @@ namespace mongo {
     }
 #else // if defined __linux__
     char _touch_pages_char_reader; // goes in .bss
-    void touch_pages( HANDLE fd, int offset, size_t length, const Extent* ext ) {
+    void touch_pages( HANDLE fd, int offset, size_t length, const void* mapped ) {
         // read first byte of every page, in order
-        const char *p = static_cast<const char *>(static_cast<const void *> (ext));
+        const char *p = static_cast<const char *>(mapped);
         for( size_t i = 0; i < length; i += g_minOSPageSizeBytes ) { 
             _touch_pages_char_reader += p[i];
         }
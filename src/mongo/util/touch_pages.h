@@ -18,13 +18,27 @@
 #include <string>
 
 namespace mongo {
-    class Extent;
+    class BSONElement;
+
+    struct TouchOptions {
+        TouchOptions() : threads( 1 ), rateMB( 0 ) {}
+        // how many ranges are paged in at once
+        int threads;
+        // the most MB/s all of them together may read, 0 for no limit
+        int rateMB;
+    };
 
     // Given a namespace, page in all pages associated with that namespace
-    void touchNs( const std::string& ns );
+    // @return the number of bytes touched
+    long long touchNs( const std::string& ns , const TouchOptions& options = TouchOptions() );
+
+    // Page in only the records of ns whose _id is in [min, max], found with its _id index.
+    // @return the number of bytes touched
+    long long touchIdRange( const std::string& ns , const BSONElement& min , const BSONElement& max ,
+                            const TouchOptions& options = TouchOptions() );
 
     // Touch a range of pages using an OS-specific method.
     // Takes a file descriptor, offset, and length, for Linux use.
-    // Additionally takes an Extent pointer for use on other platforms.
-    void touch_pages( HANDLE fd, int offset, size_t length, const Extent* ext );
+    // Additionally takes the range's mapped address for use on other platforms.
+    void touch_pages( HANDLE fd, int offset, size_t length, const void* mapped );
 }
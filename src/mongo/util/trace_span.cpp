@@ -0,0 +1,282 @@
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+
+#include "mongo/util/trace_span.h"
+
+#include <vector>
+
+#include <boost/thread/tss.hpp>
+
+#include "mongo/db/jsobj.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/util/concurrency/mutex.h"
+#include "mongo/util/concurrency/threadlocal.h"
+#include "mongo/util/goodies.h"
+
+namespace mongo {
+
+    bool TraceSpans::enabled = false;
+    bool TraceSpans::propagate = false;
+
+    namespace {
+
+        struct Span {
+            unsigned long long traceId;
+            unsigned long long begin;
+            unsigned micros;
+            unsigned char stage;
+        };
+
+        /**
+         * the spans of one thread.  only its thread writes it, each span before counting it in
+         * _written, so a reader that sees _written unchanged after copying spans out knows
+         * which of them weren't being overwritten meanwhile.
+         */
+        class Ring {
+        public:
+            Ring() { }
+
+            void push( const Span& s ) {
+                unsigned long long w = _written.load();
+                _spans[ w % TraceSpans::RingSize ] = s;
+                _written.store( w + 1 );
+            }
+
+            unsigned long long written() const { return _written.load(); }
+
+            void retag( unsigned long long from , unsigned long long traceId ) {
+                unsigned long long w = _written.load();
+                if ( w > from + TraceSpans::RingSize )
+                    from = w - TraceSpans::RingSize;
+                for ( unsigned long long i = from; i < w; i++ )
+                    _spans[ i % TraceSpans::RingSize ].traceId = traceId;
+            }
+
+            /** the spans since 'from', oldest first, that weren't overwritten while copied */
+            void copy( unsigned long long from , vector<Span>* out ) const {
+                unsigned long long w = _written.load();
+                if ( w > from + TraceSpans::RingSize )
+                    from = w - TraceSpans::RingSize;
+                vector<Span> spans;
+                for ( unsigned long long i = from; i < w; i++ )
+                    spans.push_back( _spans[ i % TraceSpans::RingSize ] );
+                // the writer may be in the middle of the slot after the last it counted
+                unsigned long long after = _written.load();
+                unsigned long long firstIntact = after + 1 > TraceSpans::RingSize ?
+                                                 after + 1 - TraceSpans::RingSize : 0;
+                for ( unsigned long long i = from; i < w; i++ )
+                    if ( i >= firstIntact )
+                        out->push_back( spans[ i - from ] );
+            }
+
+            string thread;
+
+        private:
+            Span _spans[TraceSpans::RingSize];
+            AtomicUInt64 _written;
+        };
+
+        SimpleMutex ringsMutex( "traceSpans" );
+        vector<Ring*> rings;      // all there are, never freed
+        vector<Ring*> freeRings;  // of threads which have ended
+
+        struct ThreadTrace {
+            ThreadTrace() : ring( 0 ), traceId( 0 ), requestStart( 0 ) { }
+            Ring *ring;
+            unsigned long long traceId;
+            unsigned long long requestStart;  // the ring's count of spans when the request began
+        };
+
+        void releaseThreadTrace( ThreadTrace *t ) {
+            if ( t->ring ) {
+                SimpleMutex::scoped_lock lk( ringsMutex );
+                freeRings.push_back( t->ring );
+            }
+            delete t;
+        }
+
+        boost::thread_specific_ptr<ThreadTrace> threadTrace( releaseThreadTrace );
+
+        ThreadTrace& myTrace() {
+            ThreadTrace *t = threadTrace.get();
+            if ( t == 0 ) {
+                t = new ThreadTrace();
+                threadTrace.reset( t );
+            }
+            if ( t->ring == 0 ) {
+                SimpleMutex::scoped_lock lk( ringsMutex );
+                if ( freeRings.empty() ) {
+                    t->ring = new Ring();
+                    rings.push_back( t->ring );
+                }
+                else {
+                    t->ring = freeRings.back();
+                    freeRings.pop_back();
+                }
+                t->ring->thread = getThreadName();
+            }
+            return *t;
+        }
+
+        AtomicUInt64 traceIds;
+
+        /** unlikely to be the same as another server's */
+        unsigned long long newTraceId() {
+            static const unsigned long long base = curTimeMicros64() * 0x9e3779b97f4a7c15ULL;
+            unsigned long long z = base + traceIds.fetchAndAdd( 1 ) * 0x9e3779b97f4a7c15ULL;
+            z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+            z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+            z ^= z >> 31;
+            return z ? z : 1;
+        }
+
+        const char *stageNames[] = { "receive" , "lock" , "plan" , "btree" , "fault" ,
+                                     "commitWait" , "send" , "remote" };
+    }
+
+    const char* TraceSpans::stageName( Stage stage ) {
+        return stage < NumStages ? stageNames[stage] : "?";
+    }
+
+    void TraceSpans::beginRequest( unsigned long long recvStart , unsigned long long recvEnd ) {
+        if ( ! enabled )
+            return;
+        ThreadTrace& t = myTrace();
+        t.traceId = newTraceId();
+        t.requestStart = t.ring->written();
+        if ( recvStart && recvEnd >= recvStart )
+            record( Receive , recvStart , recvEnd );
+    }
+
+    void TraceSpans::endRequest() {
+        ThreadTrace *t = threadTrace.get();
+        if ( t )
+            t->traceId = 0;
+    }
+
+    void TraceSpans::joinTrace( unsigned long long traceId ) {
+        ThreadTrace *t = threadTrace.get();
+        if ( t == 0 || t->traceId == 0 || traceId == 0 )
+            return;
+        t->traceId = traceId;
+        t->ring->retag( t->requestStart , traceId );
+    }
+
+    unsigned long long TraceSpans::currentTraceId() {
+        ThreadTrace *t = threadTrace.get();
+        return t ? t->traceId : 0;
+    }
+
+    void TraceSpans::record( Stage stage , unsigned long long beginMicros , unsigned long long endMicros ) {
+        ThreadTrace *t = threadTrace.get();
+        if ( t == 0 || t->traceId == 0 )
+            return;
+        Span s;
+        s.traceId = t->traceId;
+        s.begin = beginMicros;
+        s.micros = endMicros > beginMicros ? (unsigned) ( endMicros - beginMicros ) : 0;
+        s.stage = (unsigned char) stage;
+        t->ring->push( s );
+    }
+
+    BSONObj TraceSpans::tagQuery( const BSONObj& query , bool isCommand ) {
+        unsigned long long id = currentTraceId();
+        if ( id == 0 || query.hasField( "$traceId" ) )
+            return query;
+        BSONObjBuilder b;
+        // a command's wrapper is only recognized as its first field
+        bool wrapped;
+        if ( isCommand )
+            wrapped = strcmp( query.firstElementFieldName() , "$query" ) == 0;
+        else
+            wrapped = query["query"].isABSONObj() || query["$query"].isABSONObj();
+        if ( wrapped )
+            b.appendElements( query );
+        else
+            b.append( "$query" , query );
+        b.append( "$traceId" , (long long) id );
+        return b.obj();
+    }
+
+    unsigned long long TraceSpans::traceIdOf( const BSONObj& query ) {
+        BSONElement e = query["$traceId"];
+        return e.isNumber() ? (unsigned long long) e.numberLong() : 0;
+    }
+
+    void TraceSpans::append( BSONArrayBuilder& b , unsigned long long traceId , int limit ) {
+        vector< vector<Span> > copies;
+        vector<string> threads;
+        {
+            SimpleMutex::scoped_lock lk( ringsMutex );
+            for ( unsigned i = 0; i < rings.size(); i++ ) {
+                copies.push_back( vector<Span>() );
+                rings[i]->copy( 0 , &copies.back() );
+                threads.push_back( rings[i]->thread );
+            }
+        }
+
+        // most recent first, so the limit keeps the latest
+        vector< pair<unsigned long long, pair<unsigned,unsigned> > > order;
+        for ( unsigned i = 0; i < copies.size(); i++ )
+            for ( unsigned j = 0; j < copies[i].size(); j++ )
+                if ( traceId == 0 || copies[i][j].traceId == traceId )
+                    order.push_back( make_pair( copies[i][j].begin , make_pair( i , j ) ) );
+        sort( order.begin() , order.end() );
+        size_t first = limit > 0 && order.size() > (size_t) limit ? order.size() - limit : 0;
+
+        for ( size_t k = first; k < order.size(); k++ ) {
+            const Span& s = copies[ order[k].second.first ][ order[k].second.second ];
+            BSONObjBuilder sb( b.subobjStart() );
+            sb.append( "traceId" , (long long) s.traceId );
+            sb.append( "stage" , stageName( (Stage) s.stage ) );
+            sb.appendDate( "begin" , s.begin / 1000 );
+            sb.append( "beginMicros" , (long long) s.begin );
+            sb.append( "micros" , (int) s.micros );
+            // the ring's thread now, which is the span's unless the ring has been reused
+            sb.append( "thread" , threads[ order[k].second.first ] );
+            sb.done();
+        }
+    }
+
+    string TraceSpans::currentSummary() {
+        ThreadTrace *t = threadTrace.get();
+        if ( t == 0 || t->traceId == 0 )
+            return "";
+        vector<Span> spans;
+        t->ring->copy( t->requestStart , &spans );
+        unsigned long long micros[NumStages] = { 0 };
+        unsigned counts[NumStages] = { 0 };
+        for ( unsigned i = 0; i < spans.size(); i++ ) {
+            if ( spans[i].traceId != t->traceId || spans[i].stage >= NumStages )
+                continue;
+            micros[ spans[i].stage ] += spans[i].micros;
+            counts[ spans[i].stage ]++;
+        }
+        StringBuilder s;
+        s << " trace:" << (long long) t->traceId;
+        for ( int i = 0; i < NumStages; i++ ) {
+            if ( counts[i] == 0 )
+                continue;
+            s << ' ' << stageNames[i] << ':' << micros[i] << "us";
+            if ( counts[i] > 1 )
+                s << 'x' << counts[i];
+        }
+        return s.str();
+    }
+
+} // namespace mongo
@@ -0,0 +1,97 @@
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <string>
+
+#include <boost/noncopyable.hpp>
+
+#include "mongo/util/time_support.h"
+
+namespace mongo {
+
+    class BSONArrayBuilder;
+    class BSONObj;
+
+    /**
+     * Timed spans of the stages of requests, for following a slow request through mongos and
+     * its shards.  Each thread keeps its last RingSize spans in a ring of its own, written
+     * without locking, that the traceSpans command reads and slow operations are logged with.
+     *
+     * A request gets a new trace id when it starts.  mongos adds the id to the queries and
+     * commands it sends shards as $traceId, and a shard's request for one of them joins that
+     * trace, so a trace id picks out a request's spans on every server.  Writes, which have no
+     * room for it in their message, are traced under the id of the getLastError that follows.
+     *
+     * Off unless setParameter traceSpans is true; a span then costs two clock reads.
+     */
+    class TraceSpans {
+    public:
+        enum Stage { Receive , Lock , Plan , Btree , Fault , CommitWait , Send , Remote , NumStages };
+        enum { RingSize = 1024 };
+
+        static bool enabled;
+
+        /** set by mongos, so queries it sends shards carry the trace id */
+        static bool propagate;
+
+        /** starts a request on this thread, its message having been read over the given span */
+        static void beginRequest( unsigned long long recvStart , unsigned long long recvEnd );
+        static void endRequest();
+
+        /** moves this thread's request, and the spans it has so far, into trace traceId */
+        static void joinTrace( unsigned long long traceId );
+
+        /** @return this thread's trace, or 0 if it isn't in one */
+        static unsigned long long currentTraceId();
+
+        static void record( Stage stage , unsigned long long beginMicros , unsigned long long endMicros );
+
+        /** @return query, with this thread's trace id as $traceId if it is in a trace */
+        static BSONObj tagQuery( const BSONObj& query , bool isCommand );
+
+        /** @return the $traceId of a query, or 0 */
+        static unsigned long long traceIdOf( const BSONObj& query );
+
+        /** appends the most recent spans, at most limit, of traceId or if 0 of all traces */
+        static void append( BSONArrayBuilder& b , unsigned long long traceId , int limit );
+
+        /** the time spent in each stage so far by this thread's request, for the slow op log.
+            empty if it isn't in a trace */
+        static std::string currentSummary();
+
+        static const char* stageName( Stage stage );
+    };
+
+    /** times the scope it is declared in as a span of stage, when tracing is enabled */
+    class TraceSpan : boost::noncopyable {
+    public:
+        explicit TraceSpan( TraceSpans::Stage stage ) :
+            _stage( stage ),
+            _begin( TraceSpans::enabled ? curTimeMicros64() : 0 ) {
+        }
+        ~TraceSpan() {
+            if ( _begin )
+                TraceSpans::record( _stage , _begin , curTimeMicros64() );
+        }
+    private:
+        const TraceSpans::Stage _stage;
+        const unsigned long long _begin;
+    };
+
+} // namespace mongo
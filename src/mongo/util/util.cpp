@@ -163,7 +163,7 @@ namespace mongo {
         }
     } utilTest;
 
-    OpTime OpTime::last(0, 0);
+    AtomicUInt64 OpTime::last;
 
     ostream& operator<<( ostream &s, const ThreadSafeString &o ) {
         s << o.toString();
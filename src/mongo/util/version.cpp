@@ -31,6 +31,7 @@
 #include "../db/cmdline.h"
 #include "processinfo.h"
 #include "mongo/db/pdfile.h"
+#include "mongo/util/mmap.h"
 
 #include <boost/filesystem/operations.hpp>
 
@@ -197,11 +198,13 @@ namespace mongo {
                         log() << "** WARNING: cannot parse numa_maps" << startupWarningsLog;
                         warned = true;
                     }
-                    else if ( ! startsWith(space+1, "interleave") ) {
+                    else if ( ! startsWith(space+1, "interleave") &&
+                              MemoryMappedFile::numaPolicy == MemoryMappedFile::NumaDefault ) {
                         log() << startupWarningsLog;
                         log() << "** WARNING: You are running on a NUMA machine." << startupWarningsLog;
                         log() << "**          We suggest launching mongod like this to avoid performance problems:" << startupWarningsLog;
                         log() << "**              numactl --interleave=all mongod [other options]" << startupWarningsLog;
+                        log() << "**          or with --numa interleave" << startupWarningsLog;
                         warned = true;
                     }
                 }